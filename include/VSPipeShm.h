@@ -0,0 +1,104 @@
+/*
+* Copyright (c) 2013-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef VSPIPESHM_H
+#define VSPIPESHM_H
+
+#include <stdint.h>
+
+/*
+ * Shared memory frame transport used by vspipe --shm NAME (Linux only)
+ *
+ * vspipe creates the POSIX shared memory object "/NAME" and it consists of a VSPipeShmHeader followed by
+ * numSlots slots of slotSize bytes, the first one starting at slotOffset. Every slot starts with a
+ * VSPipeShmSlot and plane p of the frame is found at planeOffset[p] from the start of the slot with
+ * planeStride[p] bytes between rows. Offsets and strides are multiples of 64. When hasAlpha is set the
+ * alpha plane comes last and is included in numPlanes.
+ *
+ * writeCount and readCount count the published and consumed frames and wrap around at 2^32. writeEvent
+ * is incremented after every change of writeCount or status so a consumer can't miss the end of the stream.
+ * Waiting is done with FUTEX_WAIT (not the private variant) on a counter and the last value read from it.
+ *
+ * Producer: waits on readCount while writeCount - readCount == numSlots, fills slot writeCount % numSlots,
+ * stores writeCount + 1 with release semantics, increments writeEvent and wakes all waiters on it. When all
+ * frames are published, or on error, status is set and writeEvent is incremented and woken the same way.
+ *
+ * Consumer: loads writeEvent, then loads writeCount and status with acquire semantics, and waits on the
+ * loaded writeEvent value if readCount == writeCount and status is VSPIPE_SHM_RUNNING. Otherwise it reads
+ * slot readCount % numSlots, stores readCount + 1 with release semantics and wakes all waiters on readCount.
+ *
+ * The producer unlinks the object after all frames have been consumed, existing mappings stay valid. It
+ * blocks as long as no consumer frees up slots. Only one consumer is supported.
+ */
+
+#define VSPIPE_SHM_MAGIC 0x53505356 /* "VSPS" */
+#define VSPIPE_SHM_VERSION 1
+
+typedef enum VSPipeShmStatus {
+    VSPIPE_SHM_RUNNING = 0,
+    VSPIPE_SHM_FINISHED = 1,
+    VSPIPE_SHM_ERROR = 2
+} VSPipeShmStatus;
+
+typedef struct VSPipeShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numSlots;
+    uint32_t numPlanes;
+    uint64_t slotOffset;
+    uint64_t slotSize;
+
+    /* the VSVideoFormat and VSVideoInfo fields of the clip */
+    int32_t colorFamily;
+    int32_t sampleType;
+    int32_t bitsPerSample;
+    int32_t bytesPerSample;
+    int32_t subSamplingW;
+    int32_t subSamplingH;
+    int32_t width;
+    int32_t height;
+    int32_t numFrames;
+    int32_t hasAlpha;
+    int64_t fpsNum;
+    int64_t fpsDen;
+
+    uint64_t planeOffset[4];
+    uint64_t planeStride[4];
+    int32_t planeWidth[4];
+    int32_t planeHeight[4];
+
+    /* the counters are kept on separate cache lines */
+    uint8_t reserved0[64];
+    uint32_t writeCount;
+    uint32_t writeEvent;
+    uint32_t status; /* VSPipeShmStatus */
+    uint8_t reserved1[52];
+    uint32_t readCount;
+    uint8_t reserved2[60];
+} VSPipeShmHeader;
+
+typedef struct VSPipeShmSlot {
+    int64_t frameNumber;
+    int64_t durationNum; /* the _DurationNum and _DurationDen frame properties, 0 when missing */
+    int64_t durationDen;
+    uint8_t reserved[40];
+} VSPipeShmSlot;
+
+#endif /* VSPIPESHM_H */
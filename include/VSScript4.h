@@ -24,7 +24,7 @@
 #include "VapourSynth4.h"
 
 #define VSSCRIPT_API_MAJOR 4
-#define VSSCRIPT_API_MINOR 1
+#define VSSCRIPT_API_MINOR 2
 #define VSSCRIPT_API_VERSION VS_MAKE_VERSION(VSSCRIPT_API_MAJOR, VSSCRIPT_API_MINOR)
 
 typedef struct VSScript VSScript;
@@ -52,6 +52,9 @@ struct VSSCRIPTAPI {
     * it means that the main module won't be unnamed in error messages.
     * 
     * Returns 0 on success.
+    *
+    * Different VSScript objects can be evaluated from different threads at the same time, calls on the same object are
+    * serialized. Evaluations with the working directory set run alone since it is shared by the whole process.
     * 
     * Note that calling any function other than getError() and freeScript() on a VSScript object in the error state
     * will result in undefined behavior.
@@ -90,6 +93,16 @@ struct VSSCRIPTAPI {
     */
     void (VS_CC *evalSetWorkingDir)(VSScript *handle, int setCWD) VS_NOEXCEPT;
 
+    /*
+    * Set whether later evaluations of the same handle are incremental. Off by default.
+    * An incremental evaluation keeps the core, forgets the variables and outputs the previous
+    * evaluation created and gets back the same nodes, caches included, for every filter call
+    * whose arguments are identical to a call the previous evaluation made. Editors can use it
+    * to re-run a script after every change without losing the caches of its unchanged part.
+    * Only calls that return nodes are reused and source filters won't notice changed files.
+    */
+    void (VS_CC *evalSetIncremental)(VSScript *handle, int incremental) VS_NOEXCEPT;
+
 };
 
 VS_API(const VSSCRIPTAPI *) getVSScriptAPI(int version) VS_NOEXCEPT;
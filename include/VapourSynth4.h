@@ -26,10 +26,11 @@
 
 #define VS_MAKE_VERSION(major, minor) (((major) << 16) | (minor))
 #define VAPOURSYNTH_API_MAJOR 4
-#define VAPOURSYNTH_API_MINOR 0
+#define VAPOURSYNTH_API_MINOR 1
 #define VAPOURSYNTH_API_VERSION VS_MAKE_VERSION(VAPOURSYNTH_API_MAJOR, VAPOURSYNTH_API_MINOR)
 
 #define VS_AUDIO_FRAME_SAMPLES 3072
+#define VS_AUDIO_MAX_FRAME_SAMPLES (VS_AUDIO_FRAME_SAMPLES * 512) /* the most samples a frame of a node set up with setAudioFrameSamples() can have */
 
 /* Convenience for C++ users. */
 #ifdef __cplusplus
@@ -72,8 +73,10 @@ typedef struct VSPlugin VSPlugin;
 typedef struct VSPluginFunction VSPluginFunction;
 typedef struct VSFunction VSFunction;
 typedef struct VSMap VSMap;
+typedef struct VSMapKey VSMapKey;
 typedef struct VSLogHandle VSLogHandle;
 typedef struct VSFrameContext VSFrameContext;
+typedef struct VSFrameWindow VSFrameWindow;
 typedef struct VSPLUGINAPI VSPLUGINAPI;
 typedef struct VSAPI VSAPI;
 
@@ -277,13 +280,30 @@ typedef enum VSMessageType {
 typedef enum VSCoreCreationFlags {
     ccfEnableGraphInspection = 1,
     ccfDisableAutoLoading = 2,
-    ccfDisableLibraryUnloading = 4
+    ccfDisableLibraryUnloading = 4,
+    ccfNumaAware = 8, /* pin worker threads to NUMA nodes and keep node local frame buffer pools */
+    ccfLargePages = 16, /* use huge pages for frame buffers on Linux, large pages are always used on Windows when available */
+    ccfPrefaultFrames = 32, /* fault in newly allocated frame buffers immediately, only has an effect together with ccfLargePages */
+    ccfEnableTracing = 64, /* record every filter call and idle period of the worker threads, retrieve the result with getCoreTrace() */
+    ccfEnablePerfCounters = 128, /* count cycles, instructions, cache and branch misses per filter with hardware performance counters, Linux only and requires ccfEnableGraphInspection */
+    ccfAdaptiveThreads = 256, /* continuously adjust the number of running threads between 1 and the set thread count to maximize the output frame rate */
+    ccfLowLatency = 512, /* the most recent getFrameAsync() request is processed before older ones, useful for previewers with random access */
+    ccfFrameGuard = 1024, /* surround every 64th frame plane with guard bytes that are checked when a filter returns the frame, catches filters writing outside their frames at almost no cost */
+    ccfSharedResources = 2048, /* split the threads and frame memory set with setSharedResourceLimits() evenly between all cores in the process created with this flag, cores without work give up their part */
+    ccfTopologyAware = 4096, /* pin worker threads so the P-cores and the first thread of every core are used first, threads on E-cores and SMT siblings prefer light and speculative work over fmParallel filters with the fcExpensive hint */
+    ccfStreamingCaches = 8192, /* treat inputs of consumers that set a temporal radius of 0 with setFilterHints() like strictly spatial ones so they aren't cached, between the soft and hard cache limit the inputs of temporal filters may keep growing while only the other caches are trimmed */
+    ccfRealTime = 16384 /* requests made with getFrameDeadlineAsync() are processed earliest deadline first ahead of all other work and returned as soon as their deadline passes, for live sources where a late frame is worse than a dropped one */
 } VSCoreCreationFlags;
 
 typedef enum VSPluginConfigFlags {
     pcModifiable = 1
 } VSPluginConfigFlags;
 
+typedef enum VSPluginFunctionFlags {
+    pffDeterministic = 1, /* identical arguments, input nodes compared by identity, always produce an equivalent node and creating it has no side effects */
+    pffProxyScalable = 2 /* the function works at the reduced resolution used by setProxyScale(), pixel measured arguments are divided by getNodeProxyScale() of the input */
+} VSPluginFunctionFlags;
+
 typedef enum VSDataTypeHint {
     dtUnknown = -1,
     dtBinary = 0,
@@ -296,13 +316,47 @@ typedef enum VSRequestPattern {
     rpStrictSpatial = 2 /* Always (and only) requests frame n from input clip when generating output frame n, never requests frames beyond the end of the clip */
 } VSRequestPattern;
 
+typedef enum VSAccessPattern {
+    apUnknown = 0, /* No hint, the default */
+    apLinear = 1 /* Frames will be requested in increasing order, the core may start producing the next frames ahead of time when threads are idle */
+} VSAccessPattern;
+
+typedef enum VSFilterCost {
+    fcUnknown = 0, /* No hint, the default */
+    fcCheap = 1, /* a simple operation per pixel, producing a frame again is about as cheap as caching it */
+    fcModerate = 2,
+    fcExpensive = 3 /* producing a frame is slow compared to keeping it around, for example motion search or neural networks */
+} VSFilterCost;
+
+typedef enum VSDeviceType {
+    dtNone = 0,
+    dtCUDA = 1,
+    dtVulkan = 2,
+    dtOther = 3
+} VSDeviceType;
+
+typedef enum VSPlaneResidency {
+    prHost = 1, /* the copy of the plane in host memory is up to date */
+    prDevice = 2 /* the copy in device memory is up to date */
+} VSPlaneResidency;
+
+/* The result of a function called with callFrameFunction, a FrameEval function returns a node and a ModifyFrame function a frame.
+   Ownership of them passes to the caller. error is set instead on failure and only has to stay valid until the function returns. */
+typedef struct VSFrameCallResult {
+    VSNode *node;
+    const VSFrame *frame;
+    const char *error;
+} VSFrameCallResult;
+
 /* Core entry point */
 typedef const VSAPI *(VS_CC *VSGetVapourSynthAPI)(int version);
 
 /* Plugin, function and filter related */
 typedef void (VS_CC *VSPublicFunction)(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi);
+typedef void (VS_CC *VSFrameCallFunction)(int n, const VSFrame * const *frames, int numFrames, VSFrameCallResult *result, void *userData, VSCore *core, const VSAPI *vsapi); /* the frames are borrowed, result is zeroed before the call */
 typedef void (VS_CC *VSInitPlugin)(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
 typedef void (VS_CC *VSFreeFunctionData)(void *userData);
+typedef void (VS_CC *VSFreeExternalMemory)(void *userData);
 typedef const VSFrame *(VS_CC *VSFilterGetFrame)(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi);
 typedef void (VS_CC *VSFilterFree)(void *instanceData, VSCore *core, const VSAPI *vsapi);
 
@@ -310,11 +364,14 @@ typedef void (VS_CC *VSFilterFree)(void *instanceData, VSCore *core, const VSAPI
 typedef void (VS_CC *VSFrameDoneCallback)(void *userData, const VSFrame *f, int n, VSNode *node, const char *errorMsg);
 typedef void (VS_CC *VSLogHandler)(int msgType, const char *msg, void *userData);
 typedef void (VS_CC *VSLogHandlerFree)(void *userData);
+typedef void (VS_CC *VSParallelForFunc)(int index, void *userData);
+typedef void (VS_CC *VSFilterStripe)(int plane, const uint8_t *srcp, ptrdiff_t srcStride, uint8_t *dstp, ptrdiff_t dstStride, int width, int height, void *instanceData, const VSAPI *vsapi);
 
 struct VSPLUGINAPI {
     int (VS_CC *getAPIVersion)(void) VS_NOEXCEPT; /* returns VAPOURSYNTH_API_VERSION of the library */
     int (VS_CC *configPlugin)(const char *identifier, const char *pluginNamespace, const char *name, int pluginVersion, int apiVersion, int flags, VSPlugin *plugin) VS_NOEXCEPT; /* use the VS_MAKE_VERSION macro for pluginVersion */
     int (VS_CC *registerFunction)(const char *name, const char *args, const char *returnType, VSPublicFunction argsFunc, void *functionData, VSPlugin *plugin) VS_NOEXCEPT; /* non-zero return value on success  */
+    int (VS_CC *setFunctionFlags)(const char *name, int flags, VSPlugin *plugin) VS_NOEXCEPT; /* flags is a combination of VSPluginFunctionFlags, call after registerFunction, non-zero return value on success; calls to a deterministic function returning a single clip:vnode that match a call whose node still exists return that node */
 };
 
 typedef struct VSFilterDependency {
@@ -322,6 +379,69 @@ typedef struct VSFilterDependency {
     int requestPattern; /* VSRequestPattern */
 } VSFilterDependency;
 
+/* Device memory for frames, provided by a GPU plugin with setDeviceMemoryFunctions(). The functions are called from any thread.
+ * Device pointers are treated as byte addresses and offsets into them are added for views of frames, with Vulkan alloc
+ * has to return a buffer device address. */
+typedef struct VSDeviceMemoryFunctions {
+    int deviceType; /* VSDeviceType */
+    void *(VS_CC *alloc)(size_t size, void *userData); /* returns NULL on failure */
+    void (VS_CC *free)(void *ptr, void *userData);
+    int (VS_CC *download)(uint8_t *dst, const void *src, size_t size, void *userData); /* device to host and done on return, non-zero on success */
+    int (VS_CC *upload)(void *dst, const uint8_t *src, size_t size, void *userData); /* host to device, src may be reused on return */
+    int (VS_CC *copy)(void *dst, const void *src, size_t size, void *userData); /* device to device, may be NULL */
+    void *userData;
+} VSDeviceMemoryFunctions;
+
+/* Kernels run on the device set with setDeviceMemoryFunctions(), provided with setDeviceComputeFunctions(). The source is CUDA C that
+ * HIP also accepts, providers for other APIs have to translate it. Launches have to be ordered with the transfers of the memory functions. */
+typedef struct VSDeviceComputeFunctions {
+    void *(VS_CC *compileKernel)(const char *source, const char *entryPoint, void *userData); /* returns NULL on failure */
+    int (VS_CC *launchKernel)(void *kernel, int width, int height, void **params, void *userData); /* one thread per pixel of the width x height grid, params point to the values of the kernel's parameters, non-zero on success */
+    void (VS_CC *freeKernel)(void *kernel, void *userData);
+    void *userData;
+} VSDeviceComputeFunctions;
+
+#ifdef VS_GRAPH_API
+#define VS_NODE_STATS_BUCKETS 32
+
+/* Collected per node when the core was created with ccfEnableGraphInspection. All times are in nanoseconds.
+ * The histograms count events by duration, bucket 0 holds everything below 1 microsecond and bucket i
+ * the durations from 2^(i-1) up to 2^i microseconds, the last bucket also holds everything longer. */
+typedef struct VSNodeStats {
+    int64_t framesProduced;
+    int64_t getFrameCalls;
+    int64_t cacheHits;
+    int64_t cacheMisses;
+    int64_t queueWaitTime; /* time tasks spent queued before a thread picked them up */
+    int64_t serialWaitTime; /* time runnable tasks were held back because another thread had the filter's serial lock */
+    int64_t hwCycles; /* the hardware counters are only collected with ccfEnablePerfCounters, user space only */
+    int64_t hwInstructions;
+    int64_t hwCacheMisses; /* last level cache */
+    int64_t hwBranchMisses;
+    int64_t getFrameLatency[VS_NODE_STATS_BUCKETS]; /* duration of each call to the filter's getframe function */
+    int64_t queueWait[VS_NODE_STATS_BUCKETS];
+} VSNodeStats;
+
+/* A snapshot of the thread pool, unlike the node statistics it's also available without ccfEnableGraphInspection */
+typedef struct VSCoreStats {
+    int threads; /* worker threads that currently exist */
+    int activeThreads; /* threads running a task or looking for one */
+    int threadLimit; /* the number of threads allowed to run tasks at the same time */
+    int64_t queuedTasks; /* tasks that are ready to run and wait for a thread */
+    int64_t externalRequests; /* frames requested through getFrame(), getFrameAsync() and the like that haven't been returned yet */
+    int64_t deadlineMisses; /* requests made with getFrameDeadlineAsync() that weren't done by their deadline, only counted with ccfRealTime */
+} VSCoreStats;
+
+/* Memory held by a node, the cache is always reported. Planes are only attributed to the node whose getframe function
+ * allocated them when the core was created with ccfEnableGraphInspection, frameBytes and peakFrameBytes stay 0 otherwise. */
+typedef struct VSNodeMemoryStats {
+    int64_t cacheBytes; /* planes of the frames in the node's cache, planes shared by several cached frames are counted for each of them */
+    int64_t cachedFrames;
+    int64_t frameBytes; /* planes allocated by the node that still exist, in its cache, in flight or held by anything else */
+    int64_t peakFrameBytes; /* the highest frameBytes has been, including temporary frames the filter freed before returning */
+} VSNodeMemoryStats;
+#endif
+
 struct VSAPI {
     /* Audio and video filter related including nodes */
     void (VS_CC *createVideoFilter)(VSMap *out, const char *name, const VSVideoInfo *vi, VSFilterGetFrame getFrame, VSFilterFree free, int filterMode, const VSFilterDependency *dependencies, int numDeps, void *instanceData, VSCore *core) VS_NOEXCEPT; /* output nodes are appended to the clip key in the out map */
@@ -476,6 +596,109 @@ struct VSAPI {
     int64_t (VS_CC *getNodeFilterTime)(VSNode *node) VS_NOEXCEPT; /* time spent processing frames in nanoseconds */
     const VSFilterDependency *(VS_CC *getNodeDependencies)(VSNode *node) VS_NOEXCEPT;
     int (VS_CC *getNumNodeDependencies)(VSNode *node) VS_NOEXCEPT;
+#else
+    void *reservedGraphAPI[7]; /* keeps the functions added later at the same offsets with and without VS_GRAPH_API */
+#endif
+
+    /* Added in API 4.1 */
+
+    /* Scheduling hints */
+    void (VS_CC *setNodeAccessPattern)(VSNode *node, int pattern, int lookahead) VS_NOEXCEPT; /* pattern uses VSAccessPattern, lookahead is how many frames after the last requested one may be produced speculatively */
+
+    /* Batched frame requests, only use inside a filter's getframe function */
+    void (VS_CC *requestFrameRangeFilter)(int first, int last, VSNode *node, VSFrameContext *frameCtx) VS_NOEXCEPT; /* requests frames first to last inclusive, frame numbers are clamped to the valid range and duplicates are only requested once */
+    int (VS_CC *getFrameRangeFilter)(int first, int last, VSNode *node, VSFrameContext *frameCtx, const VSFrame **frames) VS_NOEXCEPT; /* frames must have room for last - first + 1 references that all have to be freed, returns non-zero and sets no references if any frame is unavailable */
+
+    /* Intra-frame parallelism, mostly useful when only a few frames are processed at the same time */
+    void (VS_CC *parallelFor)(int count, VSParallelForFunc func, void *userData, VSCore *core) VS_NOEXCEPT; /* calls func once for every index from 0 to count - 1 and returns when all calls are done, idle worker threads may help out so func has to be thread-safe */
+
+    /* Request cancellation */
+    int (VS_CC *cancelFrameAsync)(int n, VSNode *node, VSFrameDoneCallback callback, void *userData) VS_NOEXCEPT; /* cancels outstanding getFrameAsync() requests made with the same arguments, the callback is still invoked once per request but with an error unless the frame was already being produced, returns the number of requests cancelled */
+
+    /* Stripe execution, call right after creating the node and before anything else uses it */
+    int (VS_CC *setFilterStripe)(VSNode *node, VSFilterStripe stripe, int radius, int planes) VS_NOEXCEPT; /* declares that stripe produces the planes in the planes bitmask from the same rows of the node's single strictly spatial input, looking at most radius rows up and down and treating the first and last row it's given as frame edges, other planes and frame properties are passed through unchanged, returns non-zero when the node was merged with its input so the whole chain runs stripe by stripe */
+
+    /* Map access by key handle, the handle is compared by address so no string compares or hashing happen on lookups */
+    const VSMapKey *(VS_CC *getMapKey)(const char *key) VS_NOEXCEPT; /* returns NULL for invalid keys, the handle stays valid for the lifetime of the process so look it up once when creating the filter */
+    int (VS_CC *mapNumElementsKey)(const VSMap *map, const VSMapKey *key) VS_NOEXCEPT; /* returns -1 if a key doesn't exist */
+    int64_t (VS_CC *mapGetIntKey)(const VSMap *map, const VSMapKey *key, int index, int *error) VS_NOEXCEPT;
+    int (VS_CC *mapSetIntKey)(VSMap *map, const VSMapKey *key, int64_t i, int append) VS_NOEXCEPT;
+    double (VS_CC *mapGetFloatKey)(const VSMap *map, const VSMapKey *key, int index, int *error) VS_NOEXCEPT;
+    int (VS_CC *mapSetFloatKey)(VSMap *map, const VSMapKey *key, double d, int append) VS_NOEXCEPT;
+
+    /* Node reuse between script evaluations */
+    void (VS_CC *setNodeReuse)(VSCore *core, int enable) VS_NOEXCEPT; /* while enabled plugin function calls whose arguments are identical to an earlier call get the same nodes back, nodes, frames and functions count as identical only when they are the same object, disabling forgets all remembered calls */
+    int (VS_CC *releaseUnusedNodes)(VSCore *core) VS_NOEXCEPT; /* forgets the remembered calls that weren't made again since the previous call, returns how many were forgotten */
+
+    /* Cost and footprint hints, use right after create*Filter* */
+    void (VS_CC *setFilterHints)(VSNode *node, int cost, int temporalRadius, int spatialRadius) VS_NOEXCEPT; /* cost uses VSFilterCost, temporalRadius is how many frames before and after n are requested from the inputs with rpGeneral and spatialRadius how many pixels around a pixel are read, pass -1 when unknown; cheap nodes are only cached for several consumers, expensive ones give up cache space last and inputs get room for the whole temporal window */
+
+    /* Zero copy data properties, the contents of data properties are never copied when maps or frames are copied */
+    int (VS_CC *mapConsumeData)(VSMap *map, const char *key, const char *data, int size, int type, VSFreeFunctionData free, void *userData, int append) VS_NOEXCEPT; /* like mapSetData but data is used in place and must not be modified anymore, free is called with userData once no map references it, also on error; unlike copied data it isn't followed by a terminating zero */
+    int (VS_CC *mapShareData)(VSMap *dst, const char *dstKey, const VSMap *src, const char *srcKey, int index, int append) VS_NOEXCEPT; /* sets dstKey to the same data as element index of srcKey without copying it, returns non-zero on error */
+
+    /* Output memoization, call right after creating the node */
+    void (VS_CC *setNodeMemoization)(VSNode *node, int maxFrames) VS_NOEXCEPT; /* declares that the node requests all its frames in arInitial, doesn't use frameData, that its output pixels only depend on the pixels of the frames it requested relative to n and that it passes on the properties of frame n of its first dependency unchanged; when every input frame carries a _ContentHash, as added by std.Dedup, and the hashes match one of the last maxFrames calls the planes of that call's output are returned without calling the filter, 0 disables it */
+    void (VS_CC *setSharedResourceLimits)(int threads, int64_t memoryBytes) VS_NOEXCEPT; /* the total number of threads and bytes of frame memory used by all cores created with ccfSharedResources, threads <= 0 means the number of logical cpus and memoryBytes <= 0 no limit beyond each core's own */
+    void (VS_CC *setNodeSeekSensitive)(VSNode *node, int enabled) VS_NOEXCEPT; /* for fmUnordered sources where seeking is expensive, pending requests are handed to the filter in increasing frame order starting at the last decoded position instead of the order they were made in, implied by setLinearFilter() */
+
+    /* Region requests, the region is in luma pixels and grown to whole chroma samples */
+    void (VS_CC *getFrameRegionAsync)(int n, VSNode *node, int left, int top, int width, int height, VSFrameDoneCallback callback, void *userData) VS_NOEXCEPT; /* like getFrameAsync() but only the pixels inside the region are guaranteed to be correct, the rest of the frame may contain anything; filters that declared a spatialRadius with setFilterHints() pass the region grown by it on to inputs of the same size */
+    void (VS_CC *requestFrameRegionFilter)(int n, VSNode *node, int left, int top, int width, int height, VSFrameContext *frameCtx) VS_NOEXCEPT; /* like requestFrameFilter() but the filter only reads the region of the frame, for inputs whose coordinates differ from the output such as with cropping */
+    int (VS_CC *getRequestedRegion)(VSFrameContext *frameCtx, int *left, int *top, int *width, int *height) VS_NOEXCEPT; /* returns non-zero and the region when only a part of the output frame is needed, pixels outside it don't have to be processed */
+
+    /* Proxy evaluation, set before the script is evaluated */
+    void (VS_CC *setProxyScale)(VSCore *core, int scale) VS_NOEXCEPT; /* sources created afterwards are downscaled by scale and functions flagged with pffProxyScalable work on the small clips, all other functions get their inputs upscaled to the full size again, 1 disables it */
+    int (VS_CC *getNodeProxyScale)(VSNode *node) VS_NOEXCEPT; /* how many times smaller than the clip it stands in for node is, 1 for clips at full resolution */
+
+    /* Props-only requests, for analysis passes that never look at the pixels */
+    void (VS_CC *getFramePropsAsync)(int n, VSNode *node, VSFrameDoneCallback callback, void *userData) VS_NOEXCEPT; /* like getFrameAsync() but only the properties of the frame are guaranteed to be correct, filters that declared a spatialRadius with setFilterHints() make the same kind of request to all their inputs */
+    void (VS_CC *requestFramePropsFilter)(int n, VSNode *node, VSFrameContext *frameCtx) VS_NOEXCEPT; /* like requestFrameFilter() but the filter only reads the properties of the frame */
+    int (VS_CC *isPropsOnlyRequest)(VSFrameContext *frameCtx) VS_NOEXCEPT; /* returns non-zero when only the properties of the output frame are needed, the filter may return a frame with any pixels, such as one sharing the planes of an input */
+
+    /* Device memory frames, planes are copied between host and device memory only when the side that's read is out of date */
+    int (VS_CC *setDeviceMemoryFunctions)(const VSDeviceMemoryFunctions *funcs, VSCore *core) VS_NOEXCEPT; /* can only be set once per core, returns non-zero on success and when the same functions are set again */
+    int (VS_CC *getDeviceType)(VSCore *core) VS_NOEXCEPT; /* the VSDeviceType of the functions set for the core, dtNone when there are none, filters only use device pointers when they can work with it */
+    int64_t (VS_CC *setDeviceMemoryLimit)(int64_t bytes, VSCore *core) VS_NOEXCEPT; /* separate from the host limit, device planes are allocated in host memory instead once it's reached; returns the new limit and bytes <= 0 only queries it */
+    VSFrame *(VS_CC *newVideoFrameDevice)(const VSVideoFormat *format, int width, int height, const VSFrame *propSrc, VSCore *core) VS_NOEXCEPT; /* like newVideoFrame() but the planes are only allocated in device memory, when possible, and meant to be written with getWriteDevicePtr() */
+    const void *(VS_CC *getReadDevicePtr)(const VSFrame *f, int plane) VS_NOEXCEPT; /* the plane in device memory with the same stride as getStride(), uploaded first when only the host copy is up to date; NULL for audio or when no device memory is available */
+    void *(VS_CC *getWriteDevicePtr)(VSFrame *f, int plane) VS_NOEXCEPT; /* like getReadDevicePtr() but the host copy is out of date afterwards and downloaded again when getReadPtr() or getWritePtr() is called */
+    int (VS_CC *getPlaneResidency)(const VSFrame *f, int plane) VS_NOEXCEPT; /* a combination of VSPlaneResidency */
+    int (VS_CC *setDeviceComputeFunctions)(const VSDeviceComputeFunctions *funcs, VSCore *core) VS_NOEXCEPT; /* needs the memory functions to be set first, can only be set once per core, returns non-zero on success and when the same functions are set again */
+
+    /* Video frames whose planes point at memory owned by the caller, it must stay unchanged until free is called with userData once
+     * nothing uses it anymore. Planes are never written in place, the first write makes a copy. A plane whose pointer or positive stride
+     * isn't a multiple of the alignment of frames from newVideoFrame() is copied right away, free may be called before this returns
+     * when that happens to all of them. free may be NULL. */
+    VSFrame *(VS_CC *newVideoFrameExternal)(const VSVideoFormat *format, int width, int height, const uint8_t * const *planes, const ptrdiff_t *strides, VSFreeExternalMemory free, void *userData, const VSFrame *propSrc, VSCore *core) VS_NOEXCEPT;
+
+    /* Large audio frames, for audio only graphs where the per frame overhead of VS_AUDIO_FRAME_SAMPLES sized frames dominates */
+    int (VS_CC *setAudioFrameSamples)(VSNode *node, int samples) VS_NOEXCEPT; /* use right after createAudioFilter*, every frame but the last has samples samples, a multiple of VS_AUDIO_FRAME_SAMPLES up to VS_AUDIO_MAX_FRAME_SAMPLES, and the numFrames of the node is updated; it also declares that the filter can handle inputs with any frame size, requesting frames from inputs that don't use VS_AUDIO_FRAME_SAMPLES is an error for all other filters; returns non-zero on success */
+    int (VS_CC *getAudioFrameSamples)(VSNode *node) VS_NOEXCEPT; /* the number of samples in every frame but the last, 0 for video nodes */
+
+    /* Functions taking a frame number and a list of frames, like the ones of FrameEval and ModifyFrame, can be called without any maps */
+    VSFunction *(VS_CC *createFrameCallFunction)(VSFrameCallFunction func, void *userData, VSFreeFunctionData free, VSCore *core) VS_NOEXCEPT; /* callFunction also works, it passes "n" and the "f" frames and returns the result as "val" */
+    int (VS_CC *callFrameFunction)(VSFunction *func, int n, const VSFrame * const *frames, int numFrames, VSFrameCallResult *result) VS_NOEXCEPT; /* returns zero without calling anything if func was made with createFunction, use callFunction with maps for it instead */
+
+    /* Real-time requests, only differ from getFrameAsync() on cores created with ccfRealTime */
+    void (VS_CC *getFrameDeadlineAsync)(int n, VSNode *node, int64_t latency, const VSFrame *fallback, VSFrameDoneCallback callback, void *userData) VS_NOEXCEPT; /* the frame is due latency nanoseconds from now, a request that isn't done by then is returned right away with a new reference to fallback, or with an error when fallback is NULL, and the work only it was waiting for is abandoned */
+
+    /* Shared temporal windows, every temporal filter attached to the same node shares one window that holds the frames any of them may still need */
+    VSFrameWindow *(VS_CC *attachFrameWindow)(VSNode *node, int radius) VS_NOEXCEPT; /* call when creating the filter, the window keeps its own reference to node and frames n - radius to n + radius around the output frames recently produced with it stay in memory independently of the cache size; returns NULL if radius is negative */
+    void (VS_CC *detachFrameWindow)(VSFrameWindow *window) VS_NOEXCEPT; /* call from the filter's free function, the frames are released once no filter is attached anymore */
+    void (VS_CC *requestFrameWindowFilter)(int n, VSFrameWindow *window, VSFrameContext *frameCtx) VS_NOEXCEPT; /* requests frames n - radius to n + radius of the window's node, clamped like requestFrameRangeFilter(), only the ones the window doesn't already hold are actually requested */
+    int (VS_CC *getFrameWindowFilter)(int n, VSFrameWindow *window, VSFrameContext *frameCtx, const VSFrame **frames) VS_NOEXCEPT; /* frames must have room for 2 * radius + 1 references that all have to be freed, like getFrameRangeFilter(n - radius, n + radius) and the frames become part of the window; returns non-zero and sets no references if any frame is unavailable */
+
+#ifdef VS_GRAPH_API
+    /* Graph information added in API 4.1, with the same caveats as the functions above */
+    int (VS_CC *getNodeCacheBudget)(VSNode *node) VS_NOEXCEPT; /* the number of frames the cache may currently hold, 0 when caching is disabled */
+    void (VS_CC *getNodeCompressedCacheStats)(VSNode *node, int64_t *hits, int64_t *misses, int64_t *size) VS_NOEXCEPT; /* hits and misses of the compressed cache tier and its current size in bytes, any pointer may be NULL */
+    void (VS_CC *getNodeStats)(VSNode *node, VSNodeStats *stats) VS_NOEXCEPT;
+    void (VS_CC *getCoreTrace)(VSCore *core, VSMap *out) VS_NOEXCEPT; /* stores everything recorded so far in Chrome trace event JSON format as the utf8 data key "trace", sets an error if the core wasn't created with ccfEnableTracing */
+    void (VS_CC *getNodeFilterHints)(VSNode *node, int *cost, int *temporalRadius, int *spatialRadius) VS_NOEXCEPT; /* the values passed to setFilterHints, any pointer may be NULL */
+    void (VS_CC *getCoreStats)(VSCore *core, VSCoreStats *stats) VS_NOEXCEPT; /* safe to call while frames are being processed */
+    const char *(VS_CC *getNodeCreationFunctionOutput)(VSNode *node, int level, int *index) VS_NOEXCEPT; /* the key and array index the function at level returned the node as, NULL if the node wasn't one of its return values */
+    void (VS_CC *getNodeMemoryStats)(VSNode *node, VSNodeMemoryStats *stats) VS_NOEXCEPT; /* safe to call while frames are being processed */
 #endif
 };
 
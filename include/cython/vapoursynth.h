@@ -29,6 +29,8 @@ __PYX_EXTERN_C char const *vpy4_getError(VSScript *);
 __PYX_EXTERN_C VSNode *vpy4_getOutput(VSScript *, int);
 __PYX_EXTERN_C VSNode *vpy4_getAlphaOutput(VSScript *, int);
 __PYX_EXTERN_C int vpy4_getAltOutputMode(VSScript *, int);
+__PYX_EXTERN_C int vpy4_setOutput(VSScript *, int, VSNode *, VSNode *, int);
+__PYX_EXTERN_C void vpy4_setError(VSScript *, char const *);
 __PYX_EXTERN_C int vpy_clearOutput(VSScript *, int);
 __PYX_EXTERN_C VSCore *vpy4_getCore(VSScript *);
 __PYX_EXTERN_C VSAPI const *vpy4_getVSAPI(int);
@@ -28,6 +28,10 @@ static VSNode *(*__pyx_api_f_11vapoursynth_vpy4_getAlphaOutput)(VSScript *, int)
 #define vpy4_getAlphaOutput __pyx_api_f_11vapoursynth_vpy4_getAlphaOutput
 static int (*__pyx_api_f_11vapoursynth_vpy4_getAltOutputMode)(VSScript *, int) = 0;
 #define vpy4_getAltOutputMode __pyx_api_f_11vapoursynth_vpy4_getAltOutputMode
+static int (*__pyx_api_f_11vapoursynth_vpy4_setOutput)(VSScript *, int, VSNode *, VSNode *, int) = 0;
+#define vpy4_setOutput __pyx_api_f_11vapoursynth_vpy4_setOutput
+static void (*__pyx_api_f_11vapoursynth_vpy4_setError)(VSScript *, char const *) = 0;
+#define vpy4_setError __pyx_api_f_11vapoursynth_vpy4_setError
 static int (*__pyx_api_f_11vapoursynth_vpy_clearOutput)(VSScript *, int) = 0;
 #define vpy_clearOutput __pyx_api_f_11vapoursynth_vpy_clearOutput
 static VSCore *(*__pyx_api_f_11vapoursynth_vpy4_getCore)(VSScript *) = 0;
@@ -126,6 +130,8 @@ static int import_vapoursynth(void) {
   if (__Pyx_ImportFunction(module, "vpy4_getOutput", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy4_getOutput, "VSNode *(VSScript *, int)") < 0) goto bad;
   if (__Pyx_ImportFunction(module, "vpy4_getAlphaOutput", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy4_getAlphaOutput, "VSNode *(VSScript *, int)") < 0) goto bad;
   if (__Pyx_ImportFunction(module, "vpy4_getAltOutputMode", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy4_getAltOutputMode, "int (VSScript *, int)") < 0) goto bad;
+  if (__Pyx_ImportFunction(module, "vpy4_setOutput", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy4_setOutput, "int (VSScript *, int, VSNode *, VSNode *, int)") < 0) goto bad;
+  if (__Pyx_ImportFunction(module, "vpy4_setError", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy4_setError, "void (VSScript *, char const *)") < 0) goto bad;
   if (__Pyx_ImportFunction(module, "vpy_clearOutput", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy_clearOutput, "int (VSScript *, int)") < 0) goto bad;
   if (__Pyx_ImportFunction(module, "vpy4_getCore", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy4_getCore, "VSCore *(VSScript *)") < 0) goto bad;
   if (__Pyx_ImportFunction(module, "vpy4_getVSAPI", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy4_getVSAPI, "VSAPI const *(int)") < 0) goto bad;
@@ -109,11 +109,12 @@ setup(
     version = "57",
     long_description = "A portable replacement for Avisynth" if is_portable else "A modern replacement for Avisynth",
     platforms = "All",
-    ext_modules = [Extension("vapoursynth", [join("src", "cython", "vapoursynth.pyx")],
+    ext_modules = [Extension("vapoursynth", [join("src", "cython", "vapoursynth.pyx"), join("src", "common", "framewriter.cpp")],
                              libraries = ["vapoursynth"],
                              library_dirs = library_dirs,
                              include_dirs = [
                                  curdir,
+                                 "include",
                                  join("src", "cython"),
                                  join("src", "vsscript")
                             ])],
@@ -12,6 +12,10 @@
 #include <atomic>
 #include <algorithm>
 #include <new>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <chrono>
 #include <thread>
 #include <string>
@@ -59,16 +59,41 @@ class VapourSynther final :
 
     std::string lastStringValue;
 
-    std::vector<uint8_t> packedFrame;
-
-    // Frame read ahead.
+    // Packed copies of recently read and prefetched frames, most recently used
+    // first and limited to packedCacheSize bytes. Prefetched frames are packed
+    // in frameDoneCallback on the core's threads so reads of them are a copy.
+    struct PackedFrame {
+        int n;
+        std::shared_ptr<std::vector<uint8_t>> data;
+    };
+
+    bool needsPacking = false;
+    size_t packedSize = 0;
+    size_t packedCacheSize = 0;
+    std::mutex packedLock;
+    std::list<PackedFrame> packedFrames;
+    std::set<int> requestedFrames; // prefetches in flight, protected by packedLock
+    std::shared_ptr<std::vector<uint8_t>> packedFrame;
+
+    // Frame read ahead. Frames are prefetched along the stride between the
+    // last reads, which catches forward and backward playback as well as
+    // skipping through a clip. The window grows while prefetched frames get
+    // read and falls back to prefetchFrames when they don't.
     int prefetchFrames = 0;
+    int readAheadWindow = 0;
+    int lastRequest = -1;
+    int lastStride = 0;
     std::atomic<int> pendingRequests;
 
     // Cache last accessed frame, to reduce interference with read-ahead.
     int lastPosition = -1;
     const VSFrame *lastFrame = nullptr;
 
+    void packFrame(const VSFrame *f, uint8_t *dst);
+    std::shared_ptr<std::vector<uint8_t>> findPackedFrame(int n);
+    void addPackedFrame(int n, const std::shared_ptr<std::vector<uint8_t>> &data);
+    void prefetch(int n, bool hit);
+
     // Exception protected take a copy of the current error message
     void setError(const char *text, const wchar_t *alt = 0);
 
@@ -120,6 +145,18 @@ public:
 
 void VS_CC VapourSynther::frameDoneCallback(void *userData, const VSFrame *f, int n, VSNode *, const char *errorMsg) {
     VapourSynther *vsynther = static_cast<VapourSynther *>(userData);
+
+    if (f && vsynther->needsPacking) {
+        auto data = std::make_shared<std::vector<uint8_t>>(vsynther->packedSize);
+        vsynther->packFrame(f, data->data());
+        vsynther->addPackedFrame(n, data);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(vsynther->packedLock);
+        vsynther->requestedFrames.erase(n);
+    }
+
     vsynther->vsapi->freeFrame(f);
     --vsynther->pendingRequests;
 }
@@ -127,6 +164,85 @@ void VS_CC VapourSynther::frameDoneCallback(void *userData, const VSFrame *f, in
 /*---------------------------------------------------------
 ---------------------------------------------------------*/
 
+void VapourSynther::packFrame(const VSFrame *f, uint8_t *dst) {
+    const uint8_t *src[3] = {};
+    ptrdiff_t src_stride[3] = {};
+
+    for (int plane = 0; plane < vi->format.numPlanes; plane++) {
+        src[plane] = vsapi->getReadPtr(f, plane);
+        src_stride[plane] = vsapi->getStride(f, plane);
+    }
+
+    PackOutputFrame(src, src_stride, dst, vsapi->getFrameWidth(f, 0), vsapi->getFrameHeight(f, 0), vi->format, alt_output);
+}
+
+std::shared_ptr<std::vector<uint8_t>> VapourSynther::findPackedFrame(int n) {
+    std::lock_guard<std::mutex> lock(packedLock);
+
+    for (auto iter = packedFrames.begin(); iter != packedFrames.end(); ++iter) {
+        if (iter->n == n) {
+            packedFrames.splice(packedFrames.begin(), packedFrames, iter);
+            return iter->data;
+        }
+    }
+
+    return nullptr;
+}
+
+void VapourSynther::addPackedFrame(int n, const std::shared_ptr<std::vector<uint8_t>> &data) {
+    std::lock_guard<std::mutex> lock(packedLock);
+
+    for (const auto &iter : packedFrames)
+        if (iter.n == n)
+            return;
+
+    packedFrames.push_front({ n, data });
+
+    // Evicted frames stay alive as long as they're the current packedFrame
+    while (packedFrames.size() > 1 && packedFrames.size() * packedSize > packedCacheSize)
+        packedFrames.pop_back();
+}
+
+void VapourSynther::prefetch(int n, bool hit) {
+    int stride = n - lastRequest;
+    bool pattern = lastRequest >= 0 && (stride == 1 || (stride != 0 && stride == lastStride && std::abs(stride) <= prefetchFrames));
+
+    if (pattern && hit)
+        readAheadWindow = std::min(readAheadWindow * 2, prefetchFrames * 4);
+    else
+        readAheadWindow = prefetchFrames;
+
+    lastRequest = n;
+    lastStride = stride;
+
+    if (!pattern)
+        return;
+
+    for (int i = 1; i <= readAheadWindow; i++) {
+        int next = n + stride * i;
+        if (next < 0 || next >= vi->numFrames)
+            break;
+
+        {
+            std::lock_guard<std::mutex> lock(packedLock);
+            if (requestedFrames.count(next))
+                continue;
+            bool cached = false;
+            for (const auto &iter : packedFrames)
+                cached = cached || iter.n == next;
+            if (cached)
+                continue;
+            requestedFrames.insert(next);
+        }
+
+        ++pendingRequests;
+        vsapi->getFrameAsync(next, videoNode, VapourSynther::frameDoneCallback, static_cast<void *>(this));
+    }
+}
+
+/*---------------------------------------------------------
+---------------------------------------------------------*/
+
 std::string get_file_contents(const std::wstring &filename) {
     std::ifstream in(filename, std::ios::in | std::ios::binary);
     if (in) {
@@ -203,8 +319,9 @@ int/*error*/ VapourSynther::Import(const wchar_t* wszScriptName) {
 
             alt_output = vssapi->getAltOutputMode(se, 0);
 
-            packedFrame.clear();
-            packedFrame.resize(BMPSize());
+            needsPacking = NeedsPacking(vi->format, alt_output);
+            packedSize = BMPSize();
+            packedFrame = std::make_shared<std::vector<uint8_t>>(packedSize);
 
             return 0;
         } else {
@@ -259,8 +376,9 @@ bool VapourSynther::GetAudio(AvfsLog_ *log, void *buf, __int64 start, unsigned c
 
     uint8_t *dst = reinterpret_cast<uint8_t *>(buf);
 
-    int startFrame = static_cast<int>(start / VS_AUDIO_FRAME_SAMPLES);
-    int endFrame = static_cast<int>((start + count - 1) / VS_AUDIO_FRAME_SAMPLES);
+    int frameSamples = vsapi->getAudioFrameSamples(audioNode);
+    int startFrame = static_cast<int>(start / frameSamples);
+    int endFrame = static_cast<int>((start + count - 1) / frameSamples);
     
     std::vector<const uint8_t *> tmp;
     tmp.resize(af.numChannels);
@@ -269,9 +387,9 @@ bool VapourSynther::GetAudio(AvfsLog_ *log, void *buf, __int64 start, unsigned c
 
     for (int i = startFrame; i <= endFrame; i++) {
         const VSFrame *f = vsapi->getFrame(i, audioNode, nullptr, 0);
-        int64_t firstFrameSample = i * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES);
+        int64_t firstFrameSample = i * static_cast<int64_t>(frameSamples);
         size_t offset = 0;
-        int copyLength = VS_AUDIO_FRAME_SAMPLES;
+        int copyLength = frameSamples;
         if (firstFrameSample < start) {
             offset = (start - firstFrameSample) * af.bytesPerSample;
             copyLength -= (start - firstFrameSample);
@@ -309,55 +427,50 @@ const VSFrame *VapourSynther::GetFrame(AvfsLog_* log, int n, bool *_success) {
 
     const VSFrame *f = nullptr;
     bool success = false;
-    bool doPrefetch = false;
 
     if (n == lastPosition) {
-        f = vsapi->addFrameRef(lastFrame);
+        f = lastFrame ? vsapi->addFrameRef(lastFrame) : nullptr;
         success = true;
     } else {
-        int ndiff = n - lastPosition;
-        doPrefetch = (ndiff == 1 && lastPosition >= 0); // only prefetch if seeking forward one or a few frames at a time
         lastPosition = -1;
         vsapi->freeFrame(lastFrame);
         lastFrame = nullptr;
 
+        bool hit = false;
+
         if (videoNode) {
-            char errMsg[512];
-            f = vsapi->getFrame(n, videoNode, errMsg, sizeof(errMsg));
-            success = !!f;
-            if (success) {
-                if (NeedsPacking(vi->format, alt_output)) {
-                    const uint8_t *src[3] = {};
-                    ptrdiff_t src_stride[3] = {};
-
-                    for (int plane = 0; plane < vi->format.numPlanes; plane++) {
-                        src[plane] = vsapi->getReadPtr(f, plane);
-                        src_stride[plane] = vsapi->getStride(f, plane);
-                    }
+            std::shared_ptr<std::vector<uint8_t>> packed = needsPacking ? findPackedFrame(n) : nullptr;
 
-                    PackOutputFrame(src, src_stride, packedFrame.data(), vsapi->getFrameWidth(f, 0), vsapi->getFrameHeight(f, 0), vi->format, alt_output);
-                }
+            if (packed) {
+                packedFrame = packed;
+                hit = success = true;
             } else {
-                setError(errMsg);
+                char errMsg[512];
+                f = vsapi->getFrame(n, videoNode, errMsg, sizeof(errMsg));
+                success = !!f;
+                if (success) {
+                    if (needsPacking) {
+                        packed = std::make_shared<std::vector<uint8_t>>(packedSize);
+                        packFrame(f, packed->data());
+                        addPackedFrame(n, packed);
+                        packedFrame = packed;
+                    }
+                } else {
+                    setError(errMsg);
+                }
             }
         }
         if (!success) {
             log->Line(getError());
         } else {
             lastPosition = n;
-            lastFrame = vsapi->addFrameRef(f);
+            lastFrame = f ? vsapi->addFrameRef(f) : nullptr;
+            prefetch(n, hit);
         }
     }
 
     if (_success) *_success = success;
 
-    if (success && doPrefetch) {
-        for (int i = n + 1; i < std::min(n + prefetchFrames, vi->numFrames); i++) {
-            ++pendingRequests;
-            vsapi->getFrameAsync(i, videoNode, VapourSynther::frameDoneCallback, static_cast<void *>(this));
-        }
-    }
-
     return f;
 }
 
@@ -505,6 +618,15 @@ int/*error*/ VapourSynther::Init(
         prefetchFrames = GetVarAsInt("AVFS_ReadAheadFrameCount", -1);
         if (prefetchFrames < 0)
             prefetchFrames = info.numThreads;
+        readAheadWindow = prefetchFrames;
+
+        // By default hold the largest read-ahead window and the frames read
+        // before it, AVFS_PackedCacheSize overrides it in megabytes.
+        int cacheSize = GetVarAsInt("AVFS_PackedCacheSize", -1);
+        if (cacheSize < 0)
+            packedCacheSize = packedSize * (prefetchFrames * 4 + 2);
+        else
+            packedCacheSize = static_cast<size_t>(cacheSize) << 20;
     }
 
     return error;
@@ -547,7 +669,7 @@ int VapourSynther::BMPSize() {
 ---------------------------------------------------------*/
 
 uint8_t *VapourSynther::GetPackedFrame() {
-    return packedFrame.data();
+    return packedFrame->data();
 }
 
 const VSAPI *VapourSynther::GetVSApi() {
@@ -41,7 +41,9 @@ struct VapourSynther_ : public Synther_ {
     virtual void AddRef(void) = 0;
     virtual void Release(void) = 0;
 
-    // Exception protected PVideoFrame->GetFrame()
+    // Exception protected PVideoFrame->GetFrame(). For formats that need
+    // packing the frame may be null when it came from the packed frame cache,
+    // the data is always available from GetPackedFrame() on success.
     virtual const VSFrame *GetFrame(AvfsLog_* log, int n, bool *success = 0) = 0;
 
     // Readonly reference to VideoInfo
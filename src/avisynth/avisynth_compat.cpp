@@ -28,10 +28,13 @@
 #include <cstddef>
 #include <limits>
 #include "../common/vsutf16.h"
-#include "p2p_api.h"
 
 #include <Windows.h>
 
+#ifdef VS_TARGET_CPU_X86
+#include <emmintrin.h>
+#endif
+
 extern const AVS_Linkage* const AVS_linkage;
 
 namespace {
@@ -137,6 +140,107 @@ static bool AVSPixelTypeToVSFormat(VSVideoFormat &f, bool &unpack, const VideoIn
     return false;
 }
 
+//////////////////////////////////////////
+// Packed format conversion
+// SSE2 is always available when running VapourSynth on x86, the scalar code
+// handles the ends of the rows and other architectures.
+
+static void packYUY2Row(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dst, int width) {
+    int x = 0;
+#ifdef VS_TARGET_CPU_X86
+    for (; x + 16 <= width; x += 16) {
+        __m128i y = _mm_loadu_si128((const __m128i *)(srcY + x));
+        __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(srcU + x / 2)), _mm_loadl_epi64((const __m128i *)(srcV + x / 2)));
+        _mm_storeu_si128((__m128i *)(dst + x * 2), _mm_unpacklo_epi8(y, uv));
+        _mm_storeu_si128((__m128i *)(dst + x * 2 + 16), _mm_unpackhi_epi8(y, uv));
+    }
+#endif
+    for (; x + 2 <= width; x += 2) {
+        dst[x * 2 + 0] = srcY[x];
+        dst[x * 2 + 1] = srcU[x / 2];
+        dst[x * 2 + 2] = srcY[x + 1];
+        dst[x * 2 + 3] = srcV[x / 2];
+    }
+}
+
+static void unpackYUY2Row(const uint8_t *src, uint8_t *dstY, uint8_t *dstU, uint8_t *dstV, int width) {
+    int x = 0;
+#ifdef VS_TARGET_CPU_X86
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + x * 2));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + x * 2 + 16));
+        _mm_storeu_si128((__m128i *)(dstY + x), _mm_packus_epi16(_mm_and_si128(a, lowMask), _mm_and_si128(b, lowMask)));
+        __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storel_epi64((__m128i *)(dstU + x / 2), _mm_packus_epi16(_mm_and_si128(uv, lowMask), _mm_setzero_si128()));
+        _mm_storel_epi64((__m128i *)(dstV + x / 2), _mm_packus_epi16(_mm_srli_epi16(uv, 8), _mm_setzero_si128()));
+    }
+#endif
+    for (; x + 2 <= width; x += 2) {
+        dstY[x] = src[x * 2 + 0];
+        dstU[x / 2] = src[x * 2 + 1];
+        dstY[x + 1] = src[x * 2 + 2];
+        dstV[x / 2] = src[x * 2 + 3];
+    }
+}
+
+// RGB32 is stored as B, G, R, A in memory and the alpha is always set to 255
+static void packRGB32Row(const uint8_t *srcR, const uint8_t *srcG, const uint8_t *srcB, uint8_t *dst, int width) {
+    int x = 0;
+#ifdef VS_TARGET_CPU_X86
+    const __m128i alpha = _mm_set1_epi8(-1);
+    for (; x + 16 <= width; x += 16) {
+        __m128i r = _mm_loadu_si128((const __m128i *)(srcR + x));
+        __m128i g = _mm_loadu_si128((const __m128i *)(srcG + x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(srcB + x));
+        __m128i bgLo = _mm_unpacklo_epi8(b, g);
+        __m128i bgHi = _mm_unpackhi_epi8(b, g);
+        __m128i raLo = _mm_unpacklo_epi8(r, alpha);
+        __m128i raHi = _mm_unpackhi_epi8(r, alpha);
+        _mm_storeu_si128((__m128i *)(dst + x * 4), _mm_unpacklo_epi16(bgLo, raLo));
+        _mm_storeu_si128((__m128i *)(dst + x * 4 + 16), _mm_unpackhi_epi16(bgLo, raLo));
+        _mm_storeu_si128((__m128i *)(dst + x * 4 + 32), _mm_unpacklo_epi16(bgHi, raHi));
+        _mm_storeu_si128((__m128i *)(dst + x * 4 + 48), _mm_unpackhi_epi16(bgHi, raHi));
+    }
+#endif
+    for (; x < width; x++) {
+        dst[x * 4 + 0] = srcB[x];
+        dst[x * 4 + 1] = srcG[x];
+        dst[x * 4 + 2] = srcR[x];
+        dst[x * 4 + 3] = 255;
+    }
+}
+
+static void unpackRGB32Row(const uint8_t *src, uint8_t *dstR, uint8_t *dstG, uint8_t *dstB, int width) {
+    int x = 0;
+#ifdef VS_TARGET_CPU_X86
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+    // the sign extension keeps the 16 bit values intact through the signed saturation
+#define RGB32_LOW_WORDS(v0, v1) _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(v0, 16), 16), _mm_srai_epi32(_mm_slli_epi32(v1, 16), 16))
+#define RGB32_HIGH_WORDS(v0, v1) _mm_packs_epi32(_mm_srai_epi32(v0, 16), _mm_srai_epi32(v1, 16))
+    for (; x + 16 <= width; x += 16) {
+        __m128i p0 = _mm_loadu_si128((const __m128i *)(src + x * 4));
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(src + x * 4 + 16));
+        __m128i p2 = _mm_loadu_si128((const __m128i *)(src + x * 4 + 32));
+        __m128i p3 = _mm_loadu_si128((const __m128i *)(src + x * 4 + 48));
+        __m128i bg0 = RGB32_LOW_WORDS(p0, p1);
+        __m128i bg1 = RGB32_LOW_WORDS(p2, p3);
+        __m128i ra0 = RGB32_HIGH_WORDS(p0, p1);
+        __m128i ra1 = RGB32_HIGH_WORDS(p2, p3);
+        _mm_storeu_si128((__m128i *)(dstB + x), _mm_packus_epi16(_mm_and_si128(bg0, lowMask), _mm_and_si128(bg1, lowMask)));
+        _mm_storeu_si128((__m128i *)(dstG + x), _mm_packus_epi16(_mm_srli_epi16(bg0, 8), _mm_srli_epi16(bg1, 8)));
+        _mm_storeu_si128((__m128i *)(dstR + x), _mm_packus_epi16(_mm_and_si128(ra0, lowMask), _mm_and_si128(ra1, lowMask)));
+    }
+#undef RGB32_LOW_WORDS
+#undef RGB32_HIGH_WORDS
+#endif
+    for (; x < width; x++) {
+        dstB[x] = src[x * 4 + 0];
+        dstG[x] = src[x * 4 + 1];
+        dstR[x] = src[x * 4 + 2];
+    }
+}
+
 //////////////////////////////////////////
 // PackYUY2
 
@@ -155,19 +259,17 @@ static const VSFrame *VS_CC packYUY2GetFrame(int n, int activationReason, void *
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
         VSFrame *dst = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, src, core);
 
-        p2p_buffer_param p = {};
-        p.packing = p2p_yuy2;
-        p.width = d->vi.width;
-        p.height = d->vi.height;
-        p.dst[0] = vsapi->getWritePtr(dst, 0);
-        p.dst_stride[0] = vsapi->getStride(dst, 0);
-
+        const uint8_t *srcp[3];
+        ptrdiff_t srcStride[3];
         for (int plane = 0; plane < 3; plane++) {
-            p.src[plane] = vsapi->getReadPtr(src, plane);
-            p.src_stride[plane] = vsapi->getStride(src, plane);
+            srcp[plane] = vsapi->getReadPtr(src, plane);
+            srcStride[plane] = vsapi->getStride(src, plane);
         }
+        uint8_t *dstp = vsapi->getWritePtr(dst, 0);
+        ptrdiff_t dstStride = vsapi->getStride(dst, 0);
 
-        p2p_pack_frame(&p, 0);
+        for (int y = 0; y < d->vi.height; y++)
+            packYUY2Row(srcp[0] + y * srcStride[0], srcp[1] + y * srcStride[1], srcp[2] + y * srcStride[2], dstp + y * dstStride, d->vi.width);
 
         vsapi->freeFrame(src);
 
@@ -212,19 +314,17 @@ static const VSFrame *VS_CC unpackYUY2GetFrame(int n, int activationReason, void
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
         VSFrame *dst = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, src, core);
 
-        p2p_buffer_param p = {};
-        p.packing = p2p_yuy2;
-        p.width = d->vi.width;
-        p.height = d->vi.height;
-        p.src[0] = vsapi->getReadPtr(src, 0);
-        p.src_stride[0] = vsapi->getStride(src, 0);
-
+        const uint8_t *srcp = vsapi->getReadPtr(src, 0);
+        ptrdiff_t srcStride = vsapi->getStride(src, 0);
+        uint8_t *dstp[3];
+        ptrdiff_t dstStride[3];
         for (int plane = 0; plane < 3; plane++) {
-            p.dst[plane] = vsapi->getWritePtr(dst, plane);
-            p.dst_stride[plane] = vsapi->getStride(dst, plane);
+            dstp[plane] = vsapi->getWritePtr(dst, plane);
+            dstStride[plane] = vsapi->getStride(dst, plane);
         }
 
-        p2p_unpack_frame(&p, 0);
+        for (int y = 0; y < d->vi.height; y++)
+            unpackYUY2Row(srcp + y * srcStride, dstp[0] + y * dstStride[0], dstp[1] + y * dstStride[1], dstp[2] + y * dstStride[2], d->vi.width);
 
         vsapi->freeFrame(src);
 
@@ -269,19 +369,17 @@ static const VSFrame *VS_CC packRGB32GetFrame(int n, int activationReason, void
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
         VSFrame *dst = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, src, core);
 
-        p2p_buffer_param p = {};
-        p.packing = p2p_argb32;
-        p.width = d->vi.width;
-        p.height = d->vi.height;
-        p.dst[0] = vsapi->getWritePtr(dst, 0);
-        p.dst_stride[0] = vsapi->getStride(dst, 0);
-
+        const uint8_t *srcp[3];
+        ptrdiff_t srcStride[3];
         for (int plane = 0; plane < 3; plane++) {
-            p.src[plane] = vsapi->getReadPtr(src, plane);
-            p.src_stride[plane] = vsapi->getStride(src, plane);
+            srcp[plane] = vsapi->getReadPtr(src, plane);
+            srcStride[plane] = vsapi->getStride(src, plane);
         }
+        uint8_t *dstp = vsapi->getWritePtr(dst, 0);
+        ptrdiff_t dstStride = vsapi->getStride(dst, 0);
 
-        p2p_pack_frame(&p, P2P_ALPHA_SET_ONE);
+        for (int y = 0; y < d->vi.height; y++)
+            packRGB32Row(srcp[0] + y * srcStride[0], srcp[1] + y * srcStride[1], srcp[2] + y * srcStride[2], dstp + y * dstStride, d->vi.width);
 
         vsapi->freeFrame(src);
 
@@ -326,19 +424,17 @@ static const VSFrame *VS_CC unpackRGB32GetFrame(int n, int activationReason, voi
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
         VSFrame *dst = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, src, core);
 
-        p2p_buffer_param p = {};
-        p.packing = p2p_argb32;
-        p.width = d->vi.width;
-        p.height = d->vi.height;
-        p.src[0] = vsapi->getReadPtr(src, 0);
-        p.src_stride[0] = vsapi->getStride(src, 0);
-
+        const uint8_t *srcp = vsapi->getReadPtr(src, 0);
+        ptrdiff_t srcStride = vsapi->getStride(src, 0);
+        uint8_t *dstp[3];
+        ptrdiff_t dstStride[3];
         for (int plane = 0; plane < 3; plane++) {
-            p.dst[plane] = vsapi->getWritePtr(dst, plane);
-            p.dst_stride[plane] = vsapi->getStride(dst, plane);
+            dstp[plane] = vsapi->getWritePtr(dst, plane);
+            dstStride[plane] = vsapi->getStride(dst, plane);
         }
 
-        p2p_unpack_frame(&p, 0);
+        for (int y = 0; y < d->vi.height; y++)
+            unpackRGB32Row(srcp + y * srcStride, dstp[0] + y * dstStride[0], dstp[1] + y * dstStride[1], dstp[2] + y * dstStride[2], d->vi.width);
 
         vsapi->freeFrame(src);
 
@@ -554,8 +650,12 @@ PVideoFrame VSClip::GetFrame(int n, IScriptEnvironment *env) {
     return pvf;
 }
 
-WrappedClip::WrappedClip(const std::string &filterName, const PClip &clip, const std::vector<VSNode *> &preFetchClips, const PrefetchInfo &prefetchInfo, FakeAvisynth *fakeEnv)
-    : filterName(filterName), prefetchInfo(prefetchInfo), preFetchClips(preFetchClips), clip(clip), fakeEnv(fakeEnv) {
+WrappedInstance::WrappedInstance(const PClip &clip, const std::vector<VSNode *> &preFetchClips, FakeAvisynth *fakeEnv)
+    : preFetchClips(preFetchClips), clip(clip), fakeEnv(fakeEnv) {
+}
+
+WrappedClip::WrappedClip(const std::string &filterName, const PrefetchInfo &prefetchInfo)
+    : filterName(filterName), prefetchInfo(prefetchInfo), nextInstance(0) {
 }
 
 static void prefetchHelper(int n, VSNode *node, const PrefetchInfo &p, VSFrameContext *frameCtx, const VSAPI *vsapi) {
@@ -754,19 +854,33 @@ static PrefetchInfo getPrefetchInfo(const std::string &name, const VSMap *in, VS
 
 static const VSFrame *VS_CC avisynthFilterGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     WrappedClip *clip = reinterpret_cast<WrappedClip *>(instanceData);
-    PVideoFrame frame;
-    n = std::min(n, clip->clip->GetVideoInfo().num_frames - 1);
+    WrappedInstance *inst;
+
+    // The frames are requested from the input nodes of the instance that will use them
+    if (activationReason == arInitial) {
+        inst = clip->instances[clip->nextInstance++ % clip->instances.size()].get();
+        *frameData = inst;
+    } else {
+        inst = reinterpret_cast<WrappedInstance *>(*frameData);
+    }
+
+    n = std::min(n, inst->clip->GetVideoInfo().num_frames - 1);
+
+    const VSFrame *ref = nullptr;
+
+    if (activationReason == arAllFramesReady || (activationReason == arInitial && (inst->preFetchClips.empty() || clip->prefetchInfo.from > clip->prefetchInfo.to))) {
+        std::lock_guard<std::mutex> lock(inst->lock);
+        PVideoFrame frame;
 
-    if (activationReason == arAllFramesReady || (activationReason == arInitial && (clip->preFetchClips.empty() || clip->prefetchInfo.from > clip->prefetchInfo.to))) {
         // Ready the global stuff needed to make things work behind the scenes, the locking model makes this technically safe but quite ugly.
         // The frame number is needed to pass through frame attributes for filters that create a new frame to return, the context is for GetFrame().
-        if (!clip->preFetchClips.empty()) {
-            clip->fakeEnv->uglyN = n;
-            clip->fakeEnv->uglyCtx = frameCtx;
+        if (!inst->preFetchClips.empty()) {
+            inst->fakeEnv->uglyN = n;
+            inst->fakeEnv->uglyCtx = frameCtx;
         }
 
         try {
-            frame = clip->clip->GetFrame(n, clip->fakeEnv);
+            frame = inst->clip->GetFrame(n, inst->fakeEnv);
 
             if (!frame)
                 vsapi->logMessage(mtFatal, "Avisynth Error: no frame returned", core);
@@ -778,21 +892,18 @@ static const VSFrame *VS_CC avisynthFilterGetFrame(int n, int activationReason,
             vsapi->logMessage(mtFatal, "Avisynth Error: avisynth errors are unrecoverable, crashing...", core);
         }
 
-        clip->fakeEnv->uglyCtx = nullptr;
+        inst->fakeEnv->uglyCtx = nullptr;
+
+        // Enjoy the casting to trigger the void * operator. Please contact me if you can make it pretty.
+        if (frame)
+            ref = inst->fakeEnv->avsToVSFrame((VideoFrame *)((void *)frame));
     } else if (activationReason == arInitial) {
-        for (VSNode *c : clip->preFetchClips)
+        for (VSNode *c : inst->preFetchClips)
             prefetchHelper(n, c, clip->prefetchInfo, frameCtx, vsapi);
     } else if (activationReason == arError) {
         return nullptr;
     }
 
-    // Enjoy the casting to trigger the void * operator. Please contact me if you can make it pretty.
-
-    const VSFrame *ref = nullptr;
-
-    if (frame)
-        ref = clip->fakeEnv->avsToVSFrame((VideoFrame *)((void *)frame));
-
     return ref;
 }
 
@@ -809,15 +920,12 @@ static bool isSupportedPF(const VSVideoFormat &f, int interfaceVersion) {
     }
 }
 
-static void VS_CC fakeAvisynthFunctionWrapper(const VSMap *in, VSMap *out, void *userData,
-        VSCore *core, const VSAPI *vsapi) {
-    WrappedFunction *wf = (WrappedFunction *)userData;
-    std::unique_ptr<FakeAvisynth> fakeEnv(new FakeAvisynth(wf->interfaceVersion, core, vsapi));
+// Converts the arguments and invokes the Avisynth function once, every call
+// gets a separate environment and separate input clips.
+static bool applyAvisynthFunction(WrappedFunction *wf, const VSMap *in, VSMap *out, bool pack, std::unique_ptr<FakeAvisynth> &fakeEnv,
+        std::vector<VSNode *> &preFetchClips, AVSValue &ret, VSCore *core, const VSAPI *vsapi) {
+    fakeEnv.reset(new FakeAvisynth(wf->interfaceVersion, core, vsapi));
     std::vector<AVSValue> inArgs(wf->parsedArgs.size());
-    std::vector<VSNode *> preFetchClips;
-
-    int err;
-    bool pack = !!vsapi->mapGetInt(in, "compatpack", 0, &err);
 
     for (size_t i = 0; i < inArgs.size(); i++) {
         const AvisynthArgs &parsedArg = wf->parsedArgs.at(i);
@@ -842,7 +950,7 @@ static void VS_CC fakeAvisynthFunctionWrapper(const VSMap *in, VSMap *out, void
                 if (!isConstantVideoFormat(vi) || !isSupportedPF(vi->format, wf->interfaceVersion)) {
                     vsapi->mapSetError(out, "Invalid avisynth colorspace in one of the input clips");
                     vsapi->freeNode(cr);
-                    return;
+                    return false;
                 }
 
                 VSClip *tmpclip = new VSClip(cr, fakeEnv.get(), pack, vsapi);
@@ -854,29 +962,78 @@ static void VS_CC fakeAvisynthFunctionWrapper(const VSMap *in, VSMap *out, void
     }
 
     AVSValue inArgAVSValue(inArgs.data(), static_cast<int>(wf->parsedArgs.size()));
-    AVSValue ret;
 
     try {
         ret = wf->apply(inArgAVSValue, wf->avsUserData, fakeEnv.get());
     } catch (const AvisynthError &e) {
         vsapi->mapSetError(out, e.msg);
-        return;
+        return false;
     } catch (const IScriptEnvironment::NotFound &) {
         vsapi->logMessage(mtFatal, "Avisynth Error: escaped IScriptEnvironment::NotFound exceptions are non-recoverable, crashing... ", core);
     }
 
     fakeEnv->initializing = false;
+    return true;
+}
+
+static void VS_CC fakeAvisynthFunctionWrapper(const VSMap *in, VSMap *out, void *userData,
+        VSCore *core, const VSAPI *vsapi) {
+    WrappedFunction *wf = (WrappedFunction *)userData;
+    std::unique_ptr<FakeAvisynth> fakeEnv;
+    std::vector<VSNode *> preFetchClips;
+    AVSValue ret;
+
+    int err;
+    bool pack = !!vsapi->mapGetInt(in, "compatpack", 0, &err);
+
+    // 0 means one instance per thread
+    int numInstances = vsapi->mapGetIntSaturated(in, "compatinstances", 0, &err);
+    if (err) {
+        numInstances = 1;
+    } else if (numInstances <= 0) {
+        VSCoreInfo info;
+        vsapi->getCoreInfo(core, &info);
+        numInstances = info.numThreads;
+    }
+
+    if (!applyAvisynthFunction(wf, in, out, pack, fakeEnv, preFetchClips, ret, core, vsapi))
+        return;
 
     if (ret.IsClip()) {
         PClip clip = ret.AsClip();
 
         PrefetchInfo prefetchInfo = getPrefetchInfo(wf->name, in, core, vsapi);
-        std::unique_ptr<WrappedClip> filterData(new WrappedClip(wf->name, clip, preFetchClips, prefetchInfo, fakeEnv.get()));
+        std::unique_ptr<WrappedClip> filterData(new WrappedClip(wf->name, prefetchInfo));
+        filterData->instances.emplace_back(new WrappedInstance(clip, preFetchClips, fakeEnv.release()));
+
+        const VideoInfo &viAvs = clip->GetVideoInfo();
+
+        for (int i = 1; i < numInstances; i++) {
+            std::vector<VSNode *> instanceClips;
+            AVSValue instanceRet;
+
+            if (!applyAvisynthFunction(wf, in, out, pack, fakeEnv, instanceClips, instanceRet, core, vsapi))
+                return;
+
+            if (!instanceRet.IsClip()) {
+                vsapi->mapSetError(out, "Avisynth Compat: additional instance didn't return a clip");
+                return;
+            }
 
-        if (!filterData->preFetchClips.empty())
-            filterData->fakeEnv->uglyNode = filterData->preFetchClips.front();
+            PClip instanceClip = instanceRet.AsClip();
+            const VideoInfo &viInstance = instanceClip->GetVideoInfo();
+            if (viInstance.width != viAvs.width || viInstance.height != viAvs.height || viInstance.num_frames != viAvs.num_frames || viInstance.pixel_type != viAvs.pixel_type) {
+                vsapi->mapSetError(out, "Avisynth Compat: additional instance returned a different clip");
+                return;
+            }
+
+            filterData->instances.emplace_back(new WrappedInstance(instanceClip, instanceClips, fakeEnv.release()));
+        }
+
+        for (auto &inst : filterData->instances)
+            if (!inst->preFetchClips.empty())
+                inst->fakeEnv->uglyNode = inst->preFetchClips.front();
 
-        const VideoInfo &viAvs = filterData->clip->GetVideoInfo();
         VSVideoInfo vi;
         vi.height = viAvs.height;
         vi.width = viAvs.width;
@@ -892,17 +1049,24 @@ static void VS_CC fakeAvisynthFunctionWrapper(const VSMap *in, VSMap *out, void
         }
 
         std::vector<VSFilterDependency> deps;
-        for (size_t i = 0; i < preFetchClips.size(); i++)
-            deps.push_back({preFetchClips[i], rpGeneral});
+        for (auto &inst : filterData->instances)
+            for (size_t i = 0; i < inst->preFetchClips.size(); i++)
+                deps.push_back({inst->preFetchClips[i], rpGeneral});
+
+        VSFilterMode mode;
+        if (numInstances > 1)
+            mode = fmParallel;
+        else
+            mode = (preFetchClips.empty() || prefetchInfo.from > prefetchInfo.to) ? fmFrameState : fmParallelRequests;
 
         VSNode *node = vsapi->createVideoFilter2(
                                     wf->name.c_str(),
                                     &vi,
                                     avisynthFilterGetFrame,
                                     avisynthFilterFree,
-                                    (preFetchClips.empty() || prefetchInfo.from > prefetchInfo.to) ? fmFrameState : fmParallelRequests,
+                                    mode,
                                     deps.data(),
-                                    preFetchClips.size(),
+                                    static_cast<int>(deps.size()),
                                     filterData.release(),
                                     core);
 
@@ -978,6 +1142,7 @@ void FakeAvisynth::AddFunction(const char *name, const char *params, ApplyFunc a
     }
 
     newArgs += "compatpack:int:opt;";
+    newArgs += "compatinstances:int:opt;";
 
     std::lock_guard<std::mutex> lock(registerFunctionLock);
 
@@ -1090,6 +1255,16 @@ bool FakeAvisynth::MakeWritable(PVideoFrame *pvf) {
     auto it = ownedFrames.find(vfb);
     assert(it != ownedFrames.end());
     VSFrame *ref = vsapi->copyFrame(it->second, core);
+
+    // When the filter holds the only reference to the wrapped frame it can be
+    // given up before writing so the planes are only duplicated if the frame
+    // is still referenced elsewhere, for example by a cache
+    bool unique = (vfb->refcount == 1);
+    if (unique) {
+        vsapi->freeFrame(it->second);
+        ownedFrames.erase(it);
+    }
+
     uint8_t *firstPlanePtr = vsapi->getWritePtr(ref, 0);
     VideoFrame *newVfb = new VideoFrame(
         // the data will never be modified due to the writable protections embedded in this mess
@@ -1105,6 +1280,8 @@ bool FakeAvisynth::MakeWritable(PVideoFrame *pvf) {
         (*pvf)->row_sizeUV,
         (*pvf)->heightUV);
     *pvf = PVideoFrame(newVfb);
+    if (unique)
+        delete vfb;
     ownedFrames.insert(std::make_pair(newVfb, ref));
     return true;
 }
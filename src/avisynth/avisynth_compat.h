@@ -24,7 +24,9 @@
 #include "avisynth.h"
 #include "VapourSynth4.h"
 #include "VSHelper4.h"
+#include <atomic>
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 #include <string>
@@ -197,19 +199,30 @@ struct PrefetchInfo {
     PrefetchInfo(int div, int mul, int from, int to) : div(div), mul(mul), from(from), to(to) { }
 };
 
-struct WrappedClip {
-    std::string filterName;
-    PrefetchInfo prefetchInfo;
+// One copy of a wrapped filter. The pseudo globals in its environment mean
+// only one thread at a time can use it.
+struct WrappedInstance {
     std::vector<VSNode *> preFetchClips;
     PClip clip;
     FakeAvisynth *fakeEnv;
-    WrappedClip(const std::string &filterName, const PClip &clip, const std::vector<VSNode *> &preFetchClips, const PrefetchInfo &prefetchInfo, FakeAvisynth *fakeEnv);
-    ~WrappedClip() {
+    std::mutex lock;
+    WrappedInstance(const PClip &clip, const std::vector<VSNode *> &preFetchClips, FakeAvisynth *fakeEnv);
+    ~WrappedInstance() {
         clip = nullptr;
         delete fakeEnv;
     }
 };
 
+struct WrappedClip {
+    std::string filterName;
+    PrefetchInfo prefetchInfo;
+    // More than one instance is created with the same arguments when
+    // compatinstances is passed, frames are handed to them round-robin.
+    std::vector<std::unique_ptr<WrappedInstance>> instances;
+    std::atomic<unsigned> nextInstance;
+    WrappedClip(const std::string &filterName, const PrefetchInfo &prefetchInfo);
+};
+
 struct AvisynthArgs {
     std::string name;
     short type;
@@ -20,12 +20,25 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iterator>
 #include <utility>
 #include "fourcc.h"
 #include "p2p_api.h"
 #include "VSHelper4.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FOURCC_X86
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define FOURCC_TARGET_SSSE3
+#else
+#define FOURCC_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
 namespace {
 
 constexpr VSColorFamily cfPackedRGB = static_cast<VSColorFamily>(-static_cast<int>(cfRGB));
@@ -93,6 +106,260 @@ const Traits *find_traits(const VSVideoFormat &fi, int alt_output) {
     return it == std::end(fourcc_traits) ? nullptr : &*it;
 }
 
+///////////////////////////////////////////////////////////////////////////
+// Row packers for the common fourccs, everything else goes through p2p.
+// The SIMD versions produce the same bytes as the scalar ones, which handle
+// the ends of the rows.
+
+// Y, U and V interleaved for 4:2:2, the same sequence v210 packs 3 at a time.
+inline void PackV210Group(const uint16_t *srcY, const uint16_t *srcU, const uint16_t *srcV, uint8_t *dst, int pixels) {
+    uint32_t s[12] = {};
+
+    for (int i = 0; i < pixels; i++) {
+        s[i * 2 + 1] = srcY[i] & 0x3FF;
+        if (!(i & 1)) {
+            s[i * 2] = srcU[i / 2] & 0x3FF;
+            s[i * 2 + 2] = srcV[i / 2] & 0x3FF;
+        }
+    }
+
+    for (int i = 0; i < 4; i++) {
+        uint32_t v = s[i * 3] | (s[i * 3 + 1] << 10) | (s[i * 3 + 2] << 20);
+        memcpy(dst + i * 4, &v, 4);
+    }
+}
+
+void PackV210Row_c(const uint16_t *srcY, const uint16_t *srcU, const uint16_t *srcV, uint8_t *dst, int width, int x) {
+    for (; x < width; x += 6)
+        PackV210Group(srcY + x, srcU + x / 2, srcV + x / 2, dst + x / 6 * 16, std::min(width - x, 6));
+}
+
+void PackNVRow_c(const uint16_t *srcU, const uint16_t *srcV, uint16_t *dst, int width, int shift) {
+    for (int x = 0; x < width; x++) {
+        dst[x * 2] = srcU[x] << shift;
+        dst[x * 2 + 1] = srcV[x] << shift;
+    }
+}
+
+void PackShiftRow_c(const uint16_t *src, uint16_t *dst, int width, int shift) {
+    for (int x = 0; x < width; x++)
+        dst[x] = src[x] << shift;
+}
+
+void PackYUY2Row_c(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dst, int width, bool uyvy, int x) {
+    for (; x < width; x += 2) {
+        uint8_t *d = dst + x * 2;
+        d[uyvy ? 1 : 0] = srcY[x];
+        d[uyvy ? 0 : 1] = srcU[x / 2];
+        d[uyvy ? 3 : 2] = srcY[x + 1];
+        d[uyvy ? 2 : 3] = srcV[x / 2];
+    }
+}
+
+void PackARGB32Row_c(const uint8_t *srcR, const uint8_t *srcG, const uint8_t *srcB, uint8_t *dst, int width, int x) {
+    for (; x < width; x++) {
+        dst[x * 4 + 0] = srcB[x];
+        dst[x * 4 + 1] = srcG[x];
+        dst[x * 4 + 2] = srcR[x];
+        dst[x * 4 + 3] = 0xFF;
+    }
+}
+
+#ifdef FOURCC_X86
+bool HasSSSE3() {
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 1);
+    return !!(regs[2] & (1 << 9));
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+FOURCC_TARGET_SSSE3 void PackV210Row_ssse3(const uint16_t *srcY, const uint16_t *srcU, const uint16_t *srcV, uint8_t *dst, int width) {
+    // Moves 16 bit samples of the interleaved sequence s0 to s7 and s8 to s15
+    // into the 32 bit lanes of the three 10 bit fields of each dword.
+#define V210_LANE(i) (char)((i) * 2), (char)((i) * 2 + 1), -1, -1
+#define V210_NONE -1, -1, -1, -1
+    const __m128i loA = _mm_setr_epi8(V210_LANE(0), V210_LANE(3), V210_LANE(6), V210_NONE);
+    const __m128i hiA = _mm_setr_epi8(V210_NONE, V210_NONE, V210_NONE, V210_LANE(1));
+    const __m128i loB = _mm_setr_epi8(V210_LANE(1), V210_LANE(4), V210_LANE(7), V210_NONE);
+    const __m128i hiB = _mm_setr_epi8(V210_NONE, V210_NONE, V210_NONE, V210_LANE(2));
+    const __m128i loC = _mm_setr_epi8(V210_LANE(2), V210_LANE(5), V210_NONE, V210_NONE);
+    const __m128i hiC = _mm_setr_epi8(V210_NONE, V210_NONE, V210_LANE(0), V210_LANE(3));
+#undef V210_LANE
+#undef V210_NONE
+    const __m128i mask = _mm_set1_epi16(0x3FF);
+    int x;
+
+    // 8 luma samples are read to pack 6
+    for (x = 0; x + 8 <= width; x += 6) {
+        __m128i y = _mm_and_si128(_mm_loadu_si128((const __m128i *)(srcY + x)), mask);
+        __m128i u = _mm_and_si128(_mm_loadl_epi64((const __m128i *)(srcU + x / 2)), mask);
+        __m128i v = _mm_and_si128(_mm_loadl_epi64((const __m128i *)(srcV + x / 2)), mask);
+        __m128i uv = _mm_unpacklo_epi16(u, v);
+        __m128i lo = _mm_unpacklo_epi16(uv, y);
+        __m128i hi = _mm_unpackhi_epi16(uv, y);
+
+        __m128i a = _mm_or_si128(_mm_shuffle_epi8(lo, loA), _mm_shuffle_epi8(hi, hiA));
+        __m128i b = _mm_or_si128(_mm_shuffle_epi8(lo, loB), _mm_shuffle_epi8(hi, hiB));
+        __m128i c = _mm_or_si128(_mm_shuffle_epi8(lo, loC), _mm_shuffle_epi8(hi, hiC));
+
+        __m128i out = _mm_or_si128(_mm_or_si128(a, _mm_slli_epi32(b, 10)), _mm_slli_epi32(c, 20));
+        _mm_storeu_si128((__m128i *)(dst + x / 6 * 16), out);
+    }
+
+    PackV210Row_c(srcY, srcU, srcV, dst, width, x);
+}
+
+void PackNVRow_sse2(const uint16_t *srcU, const uint16_t *srcV, uint16_t *dst, int width, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+        __m128i u = _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(srcU + x)), count);
+        __m128i v = _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(srcV + x)), count);
+        _mm_storeu_si128((__m128i *)(dst + x * 2), _mm_unpacklo_epi16(u, v));
+        _mm_storeu_si128((__m128i *)(dst + x * 2 + 8), _mm_unpackhi_epi16(u, v));
+    }
+
+    PackNVRow_c(srcU + x, srcV + x, dst + x * 2, width - x, shift);
+}
+
+void PackShiftRow_sse2(const uint16_t *src, uint16_t *dst, int width, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8)
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(src + x)), count));
+
+    PackShiftRow_c(src + x, dst + x, width - x, shift);
+}
+
+void PackYUY2Row_sse2(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dst, int width, bool uyvy) {
+    int x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m128i y = _mm_loadu_si128((const __m128i *)(srcY + x));
+        __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(srcU + x / 2)), _mm_loadl_epi64((const __m128i *)(srcV + x / 2)));
+        __m128i lo = uyvy ? _mm_unpacklo_epi8(uv, y) : _mm_unpacklo_epi8(y, uv);
+        __m128i hi = uyvy ? _mm_unpackhi_epi8(uv, y) : _mm_unpackhi_epi8(y, uv);
+        _mm_storeu_si128((__m128i *)(dst + x * 2), lo);
+        _mm_storeu_si128((__m128i *)(dst + x * 2 + 16), hi);
+    }
+
+    PackYUY2Row_c(srcY, srcU, srcV, dst, width, uyvy, x);
+}
+
+void PackARGB32Row_sse2(const uint8_t *srcR, const uint8_t *srcG, const uint8_t *srcB, uint8_t *dst, int width) {
+    const __m128i alpha = _mm_set1_epi8((char)0xFF);
+    int x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m128i r = _mm_loadu_si128((const __m128i *)(srcR + x));
+        __m128i g = _mm_loadu_si128((const __m128i *)(srcG + x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(srcB + x));
+        __m128i bgLo = _mm_unpacklo_epi8(b, g);
+        __m128i bgHi = _mm_unpackhi_epi8(b, g);
+        __m128i raLo = _mm_unpacklo_epi8(r, alpha);
+        __m128i raHi = _mm_unpackhi_epi8(r, alpha);
+        _mm_storeu_si128((__m128i *)(dst + x * 4), _mm_unpacklo_epi16(bgLo, raLo));
+        _mm_storeu_si128((__m128i *)(dst + x * 4 + 16), _mm_unpackhi_epi16(bgLo, raLo));
+        _mm_storeu_si128((__m128i *)(dst + x * 4 + 32), _mm_unpacklo_epi16(bgHi, raHi));
+        _mm_storeu_si128((__m128i *)(dst + x * 4 + 48), _mm_unpackhi_epi16(bgHi, raHi));
+    }
+
+    PackARGB32Row_c(srcR, srcG, srcB, dst, width, x);
+}
+#endif
+
+void PackV210Row(const uint16_t *srcY, const uint16_t *srcU, const uint16_t *srcV, uint8_t *dst, int width) {
+#ifdef FOURCC_X86
+    static const bool ssse3 = HasSSSE3();
+    if (ssse3)
+        return PackV210Row_ssse3(srcY, srcU, srcV, dst, width);
+#endif
+    PackV210Row_c(srcY, srcU, srcV, dst, width, 0);
+}
+
+void PackNVRow(const uint16_t *srcU, const uint16_t *srcV, uint16_t *dst, int width, int shift) {
+#ifdef FOURCC_X86
+    PackNVRow_sse2(srcU, srcV, dst, width, shift);
+#else
+    PackNVRow_c(srcU, srcV, dst, width, shift);
+#endif
+}
+
+void PackShiftRow(const uint16_t *src, uint16_t *dst, int width, int shift) {
+#ifdef FOURCC_X86
+    PackShiftRow_sse2(src, dst, width, shift);
+#else
+    PackShiftRow_c(src, dst, width, shift);
+#endif
+}
+
+void PackYUY2Row(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dst, int width, bool uyvy) {
+#ifdef FOURCC_X86
+    PackYUY2Row_sse2(srcY, srcU, srcV, dst, width, uyvy);
+#else
+    PackYUY2Row_c(srcY, srcU, srcV, dst, width, uyvy, 0);
+#endif
+}
+
+void PackARGB32Row(const uint8_t *srcR, const uint8_t *srcG, const uint8_t *srcB, uint8_t *dst, int width) {
+#ifdef FOURCC_X86
+    PackARGB32Row_sse2(srcR, srcG, srcB, dst, width);
+#else
+    PackARGB32Row_c(srcR, srcG, srcB, dst, width, 0);
+#endif
+}
+
+// Returns false for the packings left to p2p
+bool PackFast(const uint8_t *src[3], const ptrdiff_t src_stride[3], uint8_t *dst, ptrdiff_t dst_stride, ptrdiff_t dst_stride_uv, int width, int height, const VSVideoFormat &fi, p2p_packing packing) {
+    switch (packing) {
+    case p2p_v210_le:
+        for (int y = 0; y < height; y++)
+            PackV210Row(reinterpret_cast<const uint16_t *>(src[0] + src_stride[0] * y), reinterpret_cast<const uint16_t *>(src[1] + src_stride[1] * y),
+                reinterpret_cast<const uint16_t *>(src[2] + src_stride[2] * y), dst + dst_stride * y, width);
+        return true;
+    case p2p_p010_le:
+    case p2p_p016_le:
+    case p2p_p210_le:
+    case p2p_p216_le:
+    {
+        // 10 bit samples are stored in the upper bits
+        int shift = 16 - fi.bitsPerSample;
+        for (int y = 0; y < height; y++) {
+            const uint16_t *srcY = reinterpret_cast<const uint16_t *>(src[0] + src_stride[0] * y);
+            uint16_t *dstY = reinterpret_cast<uint16_t *>(dst + dst_stride * y);
+            if (shift)
+                PackShiftRow(srcY, dstY, width, shift);
+            else
+                memcpy(dstY, srcY, width * sizeof(uint16_t));
+        }
+
+        uint8_t *dstUV = dst + dst_stride * height;
+        for (int y = 0; y < (height >> fi.subSamplingH); y++)
+            PackNVRow(reinterpret_cast<const uint16_t *>(src[1] + src_stride[1] * y), reinterpret_cast<const uint16_t *>(src[2] + src_stride[2] * y),
+                reinterpret_cast<uint16_t *>(dstUV + dst_stride_uv * y), width >> fi.subSamplingW, shift);
+        return true;
+    }
+    case p2p_yuy2:
+    case p2p_uyvy:
+        for (int y = 0; y < height; y++)
+            PackYUY2Row(src[0] + src_stride[0] * y, src[1] + src_stride[1] * y, src[2] + src_stride[2] * y, dst + dst_stride * y, width, packing == p2p_uyvy);
+        return true;
+    case p2p_argb32_le:
+        // DIB, bottom up
+        for (int y = 0; y < height; y++)
+            PackARGB32Row(src[0] + src_stride[0] * y, src[1] + src_stride[1] * y, src[2] + src_stride[2] * y, dst + dst_stride * (height - 1 - y), width);
+        return true;
+    default:
+        return false;
+    }
+}
+
 } // namespace
 
 static bool IsSameVideoFormat(const VSVideoFormat &f, unsigned colorFamily, unsigned sampleType, unsigned bitsPerSample, unsigned subSamplingW = 0, unsigned subSamplingH = 0) noexcept {
@@ -221,7 +488,10 @@ void PackOutputFrame(const uint8_t *src[3], const ptrdiff_t src_stride[3], uint8
             vsh::bitblt(dst_ptr, dst_stride, src[inputPlane], src_stride[inputPlane], (width >> subSamplingW) * fi.bytesPerSample, height >> subSamplingH);
             dst += row_size * (height >> subSamplingH);
         }
-    } else {
+    } else if (!PackFast(src, src_stride, dst,
+                         (traits->flags & NV_PACKED) ? RowSizePlanar(width, fi.bytesPerSample, traits) : RowSizeInterleaved(width, traits),
+                         (traits->flags & NV_PACKED) ? RowSizePlanar((width >> fi.subSamplingW) * 2, fi.bytesPerSample, traits) : 0,
+                         width, height, fi, traits->packing_mode)) {
         p2p_buffer_param p2p_params = {};
         p2p_params.width = width;
         p2p_params.height = height;
@@ -0,0 +1,358 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "framewriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+int vsfwGetY4MHeader(const VSVideoInfo *vi, char *buf, size_t size) {
+    const VSVideoFormat &f = vi->format;
+    std::string y4mFormat;
+
+    if (f.colorFamily == cfGray) {
+        y4mFormat = "mono";
+        if (f.bitsPerSample > 8)
+            y4mFormat += std::to_string(f.bitsPerSample);
+    } else if (f.colorFamily == cfYUV) {
+        if (f.subSamplingW == 1 && f.subSamplingH == 1)
+            y4mFormat = "420";
+        else if (f.subSamplingW == 1 && f.subSamplingH == 0)
+            y4mFormat = "422";
+        else if (f.subSamplingW == 0 && f.subSamplingH == 0)
+            y4mFormat = "444";
+        else if (f.subSamplingW == 2 && f.subSamplingH == 2)
+            y4mFormat = "410";
+        else if (f.subSamplingW == 2 && f.subSamplingH == 0)
+            y4mFormat = "411";
+        else if (f.subSamplingW == 0 && f.subSamplingH == 1)
+            y4mFormat = "440";
+        else
+            return -1;
+
+        if (f.sampleType == stFloat) {
+            if (f.bitsPerSample == 16)
+                y4mFormat += "ph";
+            else if (f.bitsPerSample == 32)
+                y4mFormat += "ps";
+            else if (f.bitsPerSample == 64)
+                y4mFormat += "pd";
+            else
+                return -1;
+        } else if (f.bitsPerSample > 8) {
+            y4mFormat += "p" + std::to_string(f.bitsPerSample);
+        }
+    } else {
+        return -1;
+    }
+
+    return snprintf(buf, size, "YUV4MPEG2 C%s W%d H%d F%" PRId64 ":%" PRId64 " Ip A0:0 XLENGTH=%d\n", y4mFormat.c_str(), vi->width, vi->height, vi->fpsNum, vi->fpsDen, vi->numFrames);
+}
+
+int vsfwWritePieces(int fd, const VSFWPiece *pieces, size_t numPieces) {
+#ifdef _WIN32
+    for (size_t i = 0; i < numPieces; i++) {
+        const uint8_t *data = pieces[i].data;
+        size_t remaining = pieces[i].size;
+        while (remaining) {
+            int written = _write(fd, data, static_cast<unsigned>(std::min<size_t>(remaining, INT_MAX)));
+            if (written < 0)
+                return -1;
+            data += written;
+            remaining -= written;
+        }
+    }
+#else
+    std::vector<iovec> iov;
+    size_t first = 0;
+    size_t offset = 0;
+    while (first < numPieces) {
+        iov.clear();
+        for (size_t i = first; i < numPieces && iov.size() < IOV_MAX; i++)
+            iov.push_back({ const_cast<uint8_t *>(pieces[i].data) + ((i == first) ? offset : 0), pieces[i].size - ((i == first) ? offset : 0) });
+
+        ssize_t written = writev(fd, iov.data(), static_cast<int>(iov.size()));
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        // skip past what was written, partial writes resume inside a piece
+        size_t remaining = static_cast<size_t>(written);
+        while (first < numPieces && remaining >= pieces[first].size - offset) {
+            remaining -= pieces[first].size - offset;
+            offset = 0;
+            first++;
+        }
+        offset += remaining;
+    }
+#endif
+    return 0;
+}
+
+namespace {
+
+struct VSFrameWriter {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<const VSFrame *> ring; // frame n is stored at n % ring.size()
+    int requestedFrames = 0;
+    int completedFrames = 0;
+    bool error = false;
+    std::string errorMessage;
+};
+
+} // namespace
+
+static void VS_CC frameWriterCallback(void *userData, const VSFrame *f, int n, VSNode *node, const char *errorMsg) {
+    VSFrameWriter *writer = reinterpret_cast<VSFrameWriter *>(userData);
+    std::lock_guard<std::mutex> lock(writer->mutex);
+    if (f) {
+        writer->ring[n % writer->ring.size()] = f;
+    } else if (!writer->error) {
+        writer->error = true;
+        writer->errorMessage = "Failed to retrieve frame " + std::to_string(n) + (errorMsg ? std::string(" with error: ") + errorMsg : std::string());
+    }
+    writer->completedFrames++;
+    writer->condition.notify_one();
+}
+
+static void addPlanePieces(const VSFrame *frame, std::vector<VSFWPiece> &pieces, const VSAPI *vsapi) {
+    const VSVideoFormat *fi = vsapi->getVideoFrameFormat(frame);
+    for (int p = 0; p < fi->numPlanes; p++) {
+        ptrdiff_t stride = vsapi->getStride(frame, p);
+        const uint8_t *readPtr = vsapi->getReadPtr(frame, p);
+        size_t rowSize = vsapi->getFrameWidth(frame, p) * fi->bytesPerSample;
+        int height = vsapi->getFrameHeight(frame, p);
+
+        if (static_cast<ptrdiff_t>(rowSize) == stride) {
+            pieces.push_back({ readPtr, rowSize * height });
+        } else {
+            for (int y = 0; y < height; y++)
+                pieces.push_back({ readPtr + y * stride, rowSize });
+        }
+    }
+}
+
+int vsfwOutputNode(VSNode *node, int fd, int y4m, int requests, VSFWProgress progress, void *userData, char *errorMsg, size_t errorSize, const VSAPI *vsapi) {
+    static const char frameHeader[] = "FRAME\n";
+    const VSVideoInfo *vi = vsapi->getVideoInfo(node);
+    std::string error;
+    int result = 0;
+
+    if (y4m) {
+        char header[256];
+        int headerSize = vsfwGetY4MHeader(vi, header, sizeof(header));
+        VSFWPiece piece = { reinterpret_cast<const uint8_t *>(header), static_cast<size_t>(headerSize) };
+        if (headerSize < 0)
+            error = "Can only use GRAY and YUV for Y4M-Streams";
+        else if (vsfwWritePieces(fd, &piece, 1))
+            error = "Failed to write the y4m header, errno: " + std::to_string(errno);
+    }
+
+    VSFrameWriter writer;
+    writer.ring.resize(std::max(requests, 1));
+
+    if (error.empty()) {
+        int totalFrames = vi->numFrames;
+        int initialRequests = std::min<int>(totalFrames, static_cast<int>(writer.ring.size()));
+        writer.requestedFrames = initialRequests;
+        for (int n = 0; n < initialRequests; n++)
+            vsapi->getFrameAsync(n, node, frameWriterCallback, &writer);
+
+        std::vector<VSFWPiece> pieces;
+        for (int n = 0; n < totalFrames; n++) {
+            const VSFrame *frame;
+            int nextRequest = -1;
+            {
+                std::unique_lock<std::mutex> lock(writer.mutex);
+                writer.condition.wait(lock, [&writer, n] { return writer.ring[n % writer.ring.size()] || writer.error; });
+                if (writer.error)
+                    break;
+                frame = writer.ring[n % writer.ring.size()];
+                writer.ring[n % writer.ring.size()] = nullptr;
+                // the slot just freed is the only one the next frame can go in
+                if (writer.requestedFrames < totalFrames)
+                    nextRequest = writer.requestedFrames++;
+            }
+
+            if (nextRequest >= 0)
+                vsapi->getFrameAsync(nextRequest, node, frameWriterCallback, &writer);
+
+            pieces.clear();
+            if (y4m)
+                pieces.push_back({ reinterpret_cast<const uint8_t *>(frameHeader), 6 });
+            addPlanePieces(frame, pieces, vsapi);
+            int writeResult = vsfwWritePieces(fd, pieces.data(), pieces.size());
+            int writeErrno = errno;
+            vsapi->freeFrame(frame);
+
+            if (writeResult) {
+                error = "Write failed when writing frame " + std::to_string(n) + ", errno: " + std::to_string(writeErrno);
+                break;
+            }
+
+            if (progress && progress(n + 1, totalFrames, userData)) {
+                result = 1;
+                break;
+            }
+        }
+    }
+
+    // every outstanding request still has to come back before the ring can go away
+    {
+        std::unique_lock<std::mutex> lock(writer.mutex);
+        writer.condition.wait(lock, [&writer] { return writer.completedFrames == writer.requestedFrames; });
+        if (error.empty() && writer.error)
+            error = writer.errorMessage;
+    }
+
+    for (const VSFrame *f : writer.ring)
+        vsapi->freeFrame(f);
+
+    if (!error.empty()) {
+        if (errorSize) {
+            strncpy(errorMsg, error.c_str(), errorSize - 1);
+            errorMsg[errorSize - 1] = 0;
+        }
+        return -1;
+    }
+    return result;
+}
+
+namespace {
+
+struct VSFrameBatch {
+    std::mutex mutex;
+    std::condition_variable condition;
+    const VSAPI *vsapi;
+    uint8_t *dst;
+    ptrdiff_t strides[4];
+    int start;
+    int end;
+    int requestedFrames = 0;
+    int completedFrames = 0;
+    bool error = false;
+    std::string errorMessage;
+};
+
+} // namespace
+
+template<typename T>
+static void copyPlaneStrided(uint8_t *dst, ptrdiff_t dstStride, ptrdiff_t sampleStride, const uint8_t *src, ptrdiff_t srcStride, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        const T *srcp = reinterpret_cast<const T *>(src + y * srcStride);
+        uint8_t *dstp = dst + y * dstStride;
+        for (int x = 0; x < width; x++)
+            memcpy(dstp + x * sampleStride, srcp + x, sizeof(T));
+    }
+}
+
+// the frames are copied by the threads that produced them, so the copies run in parallel with each other
+static void VS_CC frameBatchCallback(void *userData, const VSFrame *f, int n, VSNode *node, const char *errorMsg) {
+    VSFrameBatch *batch = reinterpret_cast<VSFrameBatch *>(userData);
+    const VSAPI *vsapi = batch->vsapi;
+
+    if (f) {
+        const VSVideoFormat *fi = vsapi->getVideoFrameFormat(f);
+        uint8_t *frameDst = batch->dst + (n - batch->start) * batch->strides[0];
+        for (int p = 0; p < fi->numPlanes; p++) {
+            uint8_t *dstp = frameDst + p * batch->strides[1];
+            const uint8_t *srcp = vsapi->getReadPtr(f, p);
+            ptrdiff_t srcStride = vsapi->getStride(f, p);
+            int width = vsapi->getFrameWidth(f, p);
+            int height = vsapi->getFrameHeight(f, p);
+            if (batch->strides[3] == fi->bytesPerSample) {
+                size_t rowSize = static_cast<size_t>(width) * fi->bytesPerSample;
+                if (static_cast<ptrdiff_t>(rowSize) == srcStride && srcStride == batch->strides[2]) {
+                    memcpy(dstp, srcp, rowSize * height);
+                } else {
+                    for (int y = 0; y < height; y++)
+                        memcpy(dstp + y * batch->strides[2], srcp + y * srcStride, rowSize);
+                }
+            } else if (fi->bytesPerSample == 1) {
+                copyPlaneStrided<uint8_t>(dstp, batch->strides[2], batch->strides[3], srcp, srcStride, width, height);
+            } else if (fi->bytesPerSample == 2) {
+                copyPlaneStrided<uint16_t>(dstp, batch->strides[2], batch->strides[3], srcp, srcStride, width, height);
+            } else {
+                copyPlaneStrided<uint32_t>(dstp, batch->strides[2], batch->strides[3], srcp, srcStride, width, height);
+            }
+        }
+        vsapi->freeFrame(f);
+    }
+
+    int nextRequest = -1;
+    {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        if (!f && !batch->error) {
+            batch->error = true;
+            batch->errorMessage = "Failed to retrieve frame " + std::to_string(n) + (errorMsg ? std::string(" with error: ") + errorMsg : std::string());
+        }
+        batch->completedFrames++;
+        if (!batch->error && batch->start + batch->requestedFrames < batch->end)
+            nextRequest = batch->start + batch->requestedFrames++;
+        batch->condition.notify_one();
+    }
+
+    if (nextRequest >= 0)
+        vsapi->getFrameAsync(nextRequest, node, frameBatchCallback, batch);
+}
+
+int vsfwCopyFrames(VSNode *node, int start, int count, uint8_t *dst, const ptrdiff_t *strides, int requests, char *errorMsg, size_t errorSize, const VSAPI *vsapi) {
+    VSFrameBatch batch;
+    batch.vsapi = vsapi;
+    batch.dst = dst;
+    for (int i = 0; i < 4; i++)
+        batch.strides[i] = strides[i];
+    batch.start = start;
+    batch.end = start + count;
+
+    // counted up front, the callbacks of the first frames may already request the following ones
+    int initialRequests = std::min(std::max(requests, 1), count);
+    batch.requestedFrames = initialRequests;
+    for (int i = 0; i < initialRequests; i++)
+        vsapi->getFrameAsync(start + i, node, frameBatchCallback, &batch);
+
+    std::unique_lock<std::mutex> lock(batch.mutex);
+    batch.condition.wait(lock, [&batch] { return batch.completedFrames == batch.requestedFrames && (batch.error || batch.completedFrames == batch.end - batch.start); });
+
+    if (batch.error) {
+        if (errorSize) {
+            strncpy(errorMsg, batch.errorMessage.c_str(), errorSize - 1);
+            errorMsg[errorSize - 1] = 0;
+        }
+        return -1;
+    }
+    return 0;
+}
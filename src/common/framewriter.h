@@ -0,0 +1,71 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "VapourSynth4.h"
+
+/*
+* Raw and y4m output shared by vspipe and the Python module, the interface is plain C so it can be
+* called from the Cython generated code.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct VSFWPiece {
+    const uint8_t *data;
+    size_t size;
+} VSFWPiece;
+
+/* Called after every written frame, returning non-zero stops the output */
+typedef int (VS_CC *VSFWProgress)(int written, int total, void *userData);
+
+/* Puts the y4m stream header in buf and returns its length, returns -1 when the format has no y4m identifier */
+int vsfwGetY4MHeader(const VSVideoInfo *vi, char *buf, size_t size);
+
+/* Writes all pieces in order with as few calls as possible, returns 0 on success and -1 with errno set on failure */
+int vsfwWritePieces(int fd, const VSFWPiece *pieces, size_t numPieces);
+
+/*
+* Writes every frame of node to fd with its planes in order, preceded by a y4m header when y4m is set. At most requests
+* frames are in flight and reordered in a ring while the calling thread writes, so it never needs to call back into the
+* caller except for progress. Returns 0 on success, 1 when progress stopped the output and -1 with the reason in
+* errorMsg on failure.
+*/
+int vsfwOutputNode(VSNode *node, int fd, int y4m, int requests, VSFWProgress progress, void *userData, char *errorMsg, size_t errorSize, const VSAPI *vsapi);
+
+/*
+* Copies the count frames of node starting at start into dst, frame i plane p row y sample x going to
+* dst + i * strides[0] + p * strides[1] + y * strides[2] + x * strides[3]. All planes must have the same dimensions.
+* At most requests frames are in flight and each one is copied by the thread that produced it. Returns 0 on success
+* and -1 with the reason in errorMsg on failure, dst may then be partially written.
+*/
+int vsfwCopyFrames(VSNode *node, int start, int count, uint8_t *dst, const ptrdiff_t *strides, int requests, char *errorMsg, size_t errorSize, const VSAPI *vsapi);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* FRAMEWRITER_H */
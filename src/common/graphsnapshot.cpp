@@ -0,0 +1,399 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "graphsnapshot.h"
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <cstring>
+#include <climits>
+#include <cstdint>
+
+// Everything is stored little endian with lengths and counts as 32 bit values
+static const char snapshotSignature[8] = { 'V', 'S', 'G', 'R', 'A', 'P', 'H', 1 };
+
+namespace {
+
+class SnapshotWriter {
+    std::string &data;
+public:
+    explicit SnapshotWriter(std::string &data) : data(data) {}
+
+    void u8(uint8_t v) {
+        data.push_back(static_cast<char>(v));
+    }
+
+    void u32(uint32_t v) {
+        for (int i = 0; i < 4; i++)
+            u8(static_cast<uint8_t>(v >> (i * 8)));
+    }
+
+    void u64(uint64_t v) {
+        for (int i = 0; i < 8; i++)
+            u8(static_cast<uint8_t>(v >> (i * 8)));
+    }
+
+    void str(const char *s, size_t length) {
+        if (length > UINT32_MAX)
+            throw std::runtime_error("Argument data is too large to store");
+        u32(static_cast<uint32_t>(length));
+        data.append(s, length);
+    }
+
+    void str(const std::string &s) {
+        str(s.c_str(), s.size());
+    }
+
+    void bytes(const std::string &s) {
+        data += s;
+    }
+};
+
+class SnapshotReader {
+    const uint8_t *pos;
+    const uint8_t *end;
+
+    void need(size_t n) {
+        if (static_cast<size_t>(end - pos) < n)
+            throw std::runtime_error("Snapshot is truncated");
+    }
+public:
+    SnapshotReader(const void *data, size_t size) : pos(static_cast<const uint8_t *>(data)), end(static_cast<const uint8_t *>(data) + size) {}
+
+    uint8_t u8() {
+        need(1);
+        return *pos++;
+    }
+
+    uint32_t u32() {
+        need(4);
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++)
+            v |= static_cast<uint32_t>(*pos++) << (i * 8);
+        return v;
+    }
+
+    uint64_t u64() {
+        need(8);
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i++)
+            v |= static_cast<uint64_t>(*pos++) << (i * 8);
+        return v;
+    }
+
+    std::string str() {
+        uint32_t length = u32();
+        need(length);
+        std::string s(reinterpret_cast<const char *>(pos), length);
+        pos += length;
+        return s;
+    }
+
+    void skip(size_t n) {
+        need(n);
+        pos += n;
+    }
+
+    bool atEnd() const {
+        return pos == end;
+    }
+};
+
+struct NodeRef {
+    uint32_t call;
+    std::string key;
+    uint32_t index;
+};
+
+static void writeNodeRef(SnapshotWriter &w, const NodeRef &ref) {
+    w.u32(ref.call);
+    w.str(ref.key);
+    w.u32(ref.index);
+}
+
+static NodeRef readNodeRef(SnapshotReader &r) {
+    NodeRef ref;
+    ref.call = r.u32();
+    ref.key = r.str();
+    ref.index = r.u32();
+    return ref;
+}
+
+class SnapshotSaver {
+    VSCore *core;
+    const VSAPI *vsapi;
+    // the argument map of a call is shared by every node it created so it identifies the call
+    std::map<const VSMap *, uint32_t> callIndex;
+    uint32_t numCalls = 0;
+    std::string calls;
+
+    static int getMaxLevel(VSNode *node, const VSAPI *vsapi) {
+        for (int i = 0; i < INT_MAX; i++) {
+            if (!vsapi->getNodeCreationFunctionArguments(node, i))
+                return i - 1;
+        }
+        return -1;
+    }
+
+    void writeArgs(SnapshotWriter &w, const VSMap *args, const std::string &funcName) {
+        int numKeys = vsapi->mapNumKeys(args);
+        w.u32(numKeys);
+        for (int i = 0; i < numKeys; i++) {
+            const char *key = vsapi->mapGetKey(args, i);
+            int type = vsapi->mapGetType(args, key);
+            int numElems = vsapi->mapNumElements(args, key);
+            w.str(key, strlen(key));
+            w.u8(static_cast<uint8_t>(type));
+            w.u32(numElems > 0 ? numElems : 0);
+
+            for (int j = 0; j < numElems; j++) {
+                switch (type) {
+                    case ptInt:
+                        w.u64(static_cast<uint64_t>(vsapi->mapGetInt(args, key, j, nullptr)));
+                        break;
+                    case ptFloat: {
+                        double v = vsapi->mapGetFloat(args, key, j, nullptr);
+                        uint64_t bits;
+                        memcpy(&bits, &v, sizeof(bits));
+                        w.u64(bits);
+                        break;
+                    }
+                    case ptData:
+                        w.u32(static_cast<uint32_t>(vsapi->mapGetDataTypeHint(args, key, j, nullptr)));
+                        w.str(vsapi->mapGetData(args, key, j, nullptr), vsapi->mapGetDataSize(args, key, j, nullptr));
+                        break;
+                    case ptVideoNode:
+                    case ptAudioNode: {
+                        VSNode *node = vsapi->mapGetNode(args, key, j, nullptr);
+                        NodeRef ref;
+                        try {
+                            ref = resolve(node);
+                        } catch (...) {
+                            vsapi->freeNode(node);
+                            throw;
+                        }
+                        vsapi->freeNode(node);
+                        writeNodeRef(w, ref);
+                        break;
+                    }
+                    default:
+                        throw std::runtime_error(funcName + ": argument '" + key + "' is a " + (type == ptFunction ? "function" : "frame") + " and can't be stored in a snapshot");
+                }
+            }
+        }
+    }
+public:
+    SnapshotSaver(VSCore *core, const VSAPI *vsapi) : core(core), vsapi(vsapi) {}
+
+    // The outermost call is the one made by the script, any calls it made internally are recreated by it
+    NodeRef resolve(VSNode *node) {
+        int level = getMaxLevel(node, vsapi);
+        if (level < 0)
+            throw std::runtime_error(std::string("Node '") + vsapi->getNodeName(node) + "' has no recorded creation function, graph inspection must be enabled on the core");
+
+        NodeRef ref;
+        int index = 0;
+        const char *key = vsapi->getNodeCreationFunctionOutput(node, level, &index);
+        std::string funcName = vsapi->getNodeCreationFunctionName(node, level);
+        if (!key)
+            throw std::runtime_error(funcName + ": node '" + vsapi->getNodeName(node) + "' wasn't one of the return values");
+        ref.key = key;
+        ref.index = index;
+
+        const VSMap *args = vsapi->getNodeCreationFunctionArguments(node, level);
+        auto iter = callIndex.find(args);
+        if (iter != callIndex.end()) {
+            ref.call = iter->second;
+            return ref;
+        }
+
+        size_t dot = funcName.find('.');
+        if (dot == std::string::npos)
+            throw std::runtime_error(funcName + ": malformed function name");
+        VSPlugin *plugin = vsapi->getPluginByNamespace(funcName.substr(0, dot).c_str(), core);
+        if (!plugin)
+            throw std::runtime_error(funcName + ": plugin not found");
+
+        // arguments are written first since resolving them adds the calls they depend on
+        std::string call;
+        SnapshotWriter w(call);
+        w.str(vsapi->getPluginID(plugin), strlen(vsapi->getPluginID(plugin)));
+        w.str(funcName.substr(dot + 1));
+        writeArgs(w, args, funcName);
+
+        calls += call;
+        ref.call = numCalls++;
+        callIndex[args] = ref.call;
+        return ref;
+    }
+
+    void write(SnapshotWriter &w) {
+        w.u32(numCalls);
+        w.bytes(calls);
+    }
+};
+
+struct MapDeleter {
+    const VSAPI *vsapi;
+    void operator()(VSMap *map) const {
+        vsapi->freeMap(map);
+    }
+};
+
+typedef std::unique_ptr<VSMap, MapDeleter> MapPtr;
+
+static VSNode *getResultNode(const std::vector<MapPtr> &results, const NodeRef &ref, const VSAPI *vsapi) {
+    if (ref.call >= results.size())
+        throw std::runtime_error("Snapshot refers to a call that hasn't been made yet");
+    int err = 0;
+    VSNode *node = vsapi->mapGetNode(results[ref.call].get(), ref.key.c_str(), static_cast<int>(ref.index), &err);
+    if (err)
+        throw std::runtime_error("Call " + std::to_string(ref.call) + " didn't return '" + ref.key + "' index " + std::to_string(ref.index) + ", the installed plugins don't match the snapshot");
+    return node;
+}
+
+static void readArgs(SnapshotReader &r, VSMap *args, const std::vector<MapPtr> &results, const VSAPI *vsapi) {
+    uint32_t numKeys = r.u32();
+    for (uint32_t i = 0; i < numKeys; i++) {
+        std::string key = r.str();
+        int type = r.u8();
+        uint32_t numElems = r.u32();
+
+        if (!numElems) {
+            if (vsapi->mapSetEmpty(args, key.c_str(), type))
+                throw std::runtime_error("Snapshot has an invalid argument type");
+            continue;
+        }
+
+        for (uint32_t j = 0; j < numElems; j++) {
+            switch (type) {
+                case ptInt:
+                    vsapi->mapSetInt(args, key.c_str(), static_cast<int64_t>(r.u64()), maAppend);
+                    break;
+                case ptFloat: {
+                    uint64_t bits = r.u64();
+                    double v;
+                    memcpy(&v, &bits, sizeof(v));
+                    vsapi->mapSetFloat(args, key.c_str(), v, maAppend);
+                    break;
+                }
+                case ptData: {
+                    int hint = static_cast<int32_t>(r.u32());
+                    std::string value = r.str();
+                    vsapi->mapSetData(args, key.c_str(), value.c_str(), static_cast<int>(value.size()), hint, maAppend);
+                    break;
+                }
+                case ptVideoNode:
+                case ptAudioNode:
+                    vsapi->mapConsumeNode(args, key.c_str(), getResultNode(results, readNodeRef(r), vsapi), maAppend);
+                    break;
+                default:
+                    throw std::runtime_error("Snapshot has an invalid argument type");
+            }
+        }
+    }
+}
+
+} // namespace
+
+bool isGraphSnapshot(const void *data, size_t size) {
+    return size >= sizeof(snapshotSignature) && !memcmp(data, snapshotSignature, sizeof(snapshotSignature));
+}
+
+bool saveGraphSnapshot(const std::vector<GraphSnapshotOutput> &outputs, std::string &data, std::string &error, VSCore *core, const VSAPI *vsapi) {
+    try {
+        SnapshotSaver saver(core, vsapi);
+        std::vector<std::pair<NodeRef, NodeRef>> refs;
+        for (const auto &iter : outputs)
+            refs.emplace_back(saver.resolve(iter.node), iter.alpha ? saver.resolve(iter.alpha) : NodeRef());
+
+        data.assign(snapshotSignature, sizeof(snapshotSignature));
+        SnapshotWriter w(data);
+        saver.write(w);
+        w.u32(static_cast<uint32_t>(outputs.size()));
+        for (size_t i = 0; i < outputs.size(); i++) {
+            w.u32(static_cast<uint32_t>(outputs[i].index));
+            w.u32(static_cast<uint32_t>(outputs[i].altOutput));
+            writeNodeRef(w, refs[i].first);
+            w.u8(!!outputs[i].alpha);
+            if (outputs[i].alpha)
+                writeNodeRef(w, refs[i].second);
+        }
+        return true;
+    } catch (std::exception &e) {
+        error = e.what();
+        return false;
+    }
+}
+
+bool loadGraphSnapshot(const void *data, size_t size, std::vector<GraphSnapshotOutput> &outputs, std::string &error, VSCore *core, const VSAPI *vsapi) {
+    std::vector<GraphSnapshotOutput> result;
+    try {
+        if (!isGraphSnapshot(data, size))
+            throw std::runtime_error("Not a graph snapshot");
+
+        SnapshotReader r(data, size);
+        r.skip(sizeof(snapshotSignature));
+
+        uint32_t numCalls = r.u32();
+        std::vector<MapPtr> results;
+        for (uint32_t i = 0; i < numCalls; i++) {
+            std::string id = r.str();
+            std::string funcName = r.str();
+            VSPlugin *plugin = vsapi->getPluginByID(id.c_str(), core);
+            if (!plugin)
+                throw std::runtime_error("No plugin with the identifier '" + id + "' is loaded");
+
+            MapPtr args(vsapi->createMap(), MapDeleter{ vsapi });
+            readArgs(r, args.get(), results, vsapi);
+            results.emplace_back(vsapi->invoke(plugin, funcName.c_str(), args.get()), MapDeleter{ vsapi });
+            if (const char *err = vsapi->mapGetError(results.back().get()))
+                throw std::runtime_error(std::string(vsapi->getPluginNamespace(plugin)) + "." + funcName + ": " + err);
+        }
+
+        uint32_t numOutputs = r.u32();
+        for (uint32_t i = 0; i < numOutputs; i++) {
+            GraphSnapshotOutput output = {};
+            output.index = static_cast<int32_t>(r.u32());
+            output.altOutput = static_cast<int32_t>(r.u32());
+            NodeRef ref = readNodeRef(r);
+            bool hasAlpha = !!r.u8();
+            NodeRef alphaRef = hasAlpha ? readNodeRef(r) : NodeRef();
+            output.node = getResultNode(results, ref, vsapi);
+            result.push_back(output);
+            if (hasAlpha)
+                result.back().alpha = getResultNode(results, alphaRef, vsapi);
+        }
+
+        if (!r.atEnd())
+            throw std::runtime_error("Snapshot has trailing data");
+    } catch (std::exception &e) {
+        for (auto &iter : result) {
+            vsapi->freeNode(iter.node);
+            vsapi->freeNode(iter.alpha);
+        }
+        error = e.what();
+        return false;
+    }
+
+    outputs.insert(outputs.end(), result.begin(), result.end());
+    return true;
+}
@@ -0,0 +1,52 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef GRAPHSNAPSHOT_H
+#define GRAPHSNAPSHOT_H
+
+#include <VapourSynth4.h>
+#include <string>
+#include <vector>
+
+/*
+* A graph snapshot records the function calls a script made to build its outputs, plugin ids, function
+* names and arguments in dependency order, so the graph can be rebuilt later by invoking the same calls
+* again without running the script. Only graphs created on a core with ccfEnableGraphInspection can be
+* saved and arguments that can't be stored, functions and frames, make saving fail.
+*/
+
+struct GraphSnapshotOutput {
+    int index;
+    VSNode *node;
+    VSNode *alpha; // may be NULL
+    int altOutput;
+};
+
+// Returns true if data starts with the snapshot signature
+bool isGraphSnapshot(const void *data, size_t size);
+
+// Serializes the calls needed to recreate all outputs into data, error is set on failure
+bool saveGraphSnapshot(const std::vector<GraphSnapshotOutput> &outputs, std::string &data, std::string &error, VSCore *core, const VSAPI *vsapi);
+
+// Rebuilds the graph in core, the returned output nodes are owned by the caller and error is set on failure
+bool loadGraphSnapshot(const void *data, size_t size, std::vector<GraphSnapshotOutput> &outputs, std::string &error, VSCore *core, const VSAPI *vsapi);
+
+#endif /* GRAPHSNAPSHOT_H */
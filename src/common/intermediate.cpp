@@ -0,0 +1,560 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "intermediate.h"
+#include <algorithm>
+#include <cstring>
+
+static const char headerMagic[8] = { 'V', 'S', 'L', 'I', 'N', 'T', '0', '1' };
+static const char recordMagic[4] = { 'V', 'S', 'L', 'F' };
+static const char trailerMagic[8] = { 'V', 'S', 'L', 'I', 'I', 'D', 'X', '1' };
+
+// Residuals with a quotient this large are stored as raw samples instead
+static const int maxUnary = 24;
+static const int numContexts = 16;
+
+//////////////////////////////////////////
+// Little endian fields
+
+static void putU32(std::vector<uint8_t> &data, uint32_t v) {
+    for (int i = 0; i < 4; i++)
+        data.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+static void putU64(std::vector<uint8_t> &data, uint64_t v) {
+    for (int i = 0; i < 8; i++)
+        data.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+static void setU64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++)
+        p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+static uint32_t getU32(const uint8_t *p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++)
+        v |= static_cast<uint32_t>(p[i]) << (8 * i);
+    return v;
+}
+
+static uint64_t getU64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++)
+        v |= static_cast<uint64_t>(p[i]) << (8 * i);
+    return v;
+}
+
+//////////////////////////////////////////
+// Bit streams
+
+namespace {
+
+struct BitWriter {
+    uint8_t *p;
+    uint64_t acc = 0;
+    int count = 0;
+
+    explicit BitWriter(uint8_t *p) : p(p) {}
+
+    // n is at most 32 and v has no bits set above it
+    void put(uint64_t v, int n) {
+        acc = (acc << n) | v;
+        count += n;
+        while (count >= 8) {
+            count -= 8;
+            *p++ = static_cast<uint8_t>(acc >> count);
+        }
+    }
+
+    uint8_t *flush() {
+        if (count)
+            *p++ = static_cast<uint8_t>(acc << (8 - count));
+        count = 0;
+        return p;
+    }
+};
+
+struct BitReader {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t acc = 0;
+    int count = 0;
+    bool ok = true;
+
+    BitReader(const uint8_t *p, const uint8_t *end) : p(p), end(end) {}
+
+    // past the end of the data only zeroes are returned
+    uint32_t peek(int n) {
+        while (count <= 56 && p < end) {
+            acc = (acc << 8) | *p++;
+            count += 8;
+        }
+        uint64_t mask = (static_cast<uint64_t>(1) << n) - 1;
+        if (count >= n)
+            return static_cast<uint32_t>((acc >> (count - n)) & mask);
+        else
+            return static_cast<uint32_t>((acc << (n - count)) & mask);
+    }
+
+    void skip(int n) {
+        if (n > count) {
+            ok = false;
+            count = 0;
+        } else {
+            count -= n;
+        }
+    }
+
+    uint32_t get(int n) {
+        if (!n)
+            return 0;
+        uint32_t v = peek(n);
+        skip(n);
+        return v;
+    }
+};
+
+// The rice parameter of a context follows the mean of the residuals coded with it
+struct RiceContext {
+    uint64_t a = 4;
+    uint32_t n = 1;
+
+    int parameter(int bits) const {
+        int k = 0;
+        while ((static_cast<uint64_t>(n) << k) < a && k < bits)
+            k++;
+        return k;
+    }
+
+    void update(uint64_t u) {
+        a += u;
+        if (++n == 64) {
+            a >>= 1;
+            n >>= 1;
+        }
+    }
+};
+
+} // namespace
+
+//////////////////////////////////////////
+// Planes
+
+// Float samples are reordered so their bit patterns sort like the values and neighbours predict each other
+static inline uint32_t mapFloat(uint32_t v, uint32_t top, uint32_t mask) {
+    return (v & top) ? (~v & mask) : (v | top);
+}
+
+static inline uint32_t unmapFloat(uint32_t m, uint32_t top, uint32_t mask) {
+    return (m & top) ? (m ^ top) : (~m & mask);
+}
+
+static inline int bitLength(uint64_t v) {
+#if defined(__GNUC__)
+    return v ? 64 - __builtin_clzll(v) : 0;
+#else
+    int n = 0;
+    while (v) {
+        v >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static inline uint32_t absDiff(uint32_t a, uint32_t b) {
+    return a > b ? a - b : b - a;
+}
+
+// The median edge detector, the first row is predicted from the left and the first column from above
+static inline uint32_t predict(const uint32_t *cur, const uint32_t *prev, int x, int y, int &context) {
+    context = 0;
+    if (!y)
+        return x ? cur[x - 1] : 0;
+    if (!x)
+        return prev[0];
+
+    uint32_t a = cur[x - 1];
+    uint32_t b = prev[x];
+    uint32_t c = prev[x - 1];
+    context = std::min(bitLength(static_cast<uint64_t>(absDiff(a, c)) + absDiff(b, c)), numContexts - 1);
+
+    uint32_t lo = std::min(a, b);
+    uint32_t hi = std::max(a, b);
+    if (c >= hi)
+        return lo;
+    else if (c <= lo)
+        return hi;
+    else
+        return a + b - c;
+}
+
+static size_t maxPlaneSize(int width, int height, int bits) {
+    return static_cast<size_t>(width) * height * (maxUnary + bits) / 8 + 16;
+}
+
+template<typename T>
+static void encodePlane(const uint8_t *src, ptrdiff_t stride, int width, int height, bool isFloat, std::vector<uint8_t> &out) {
+    const int bits = sizeof(T) * 8;
+    const uint64_t range = static_cast<uint64_t>(1) << bits;
+    const uint32_t mask = static_cast<uint32_t>(range - 1);
+    const uint32_t top = static_cast<uint32_t>(range >> 1);
+
+    size_t start = out.size();
+    out.resize(start + maxPlaneSize(width, height, bits));
+    BitWriter writer(out.data() + start);
+    RiceContext contexts[numContexts];
+
+    std::vector<uint32_t> rows(2 * static_cast<size_t>(width));
+    uint32_t *prev = rows.data();
+    uint32_t *cur = rows.data() + width;
+
+    for (int y = 0; y < height; y++) {
+        const T *srcp = reinterpret_cast<const T *>(src + y * stride);
+        for (int x = 0; x < width; x++)
+            cur[x] = isFloat ? mapFloat(srcp[x], top, mask) : srcp[x];
+
+        for (int x = 0; x < width; x++) {
+            int context;
+            uint32_t residual = (cur[x] - predict(cur, prev, x, y, context)) & mask;
+            uint64_t u = (residual < top) ? (static_cast<uint64_t>(residual) << 1) : (((range - residual) << 1) - 1);
+
+            RiceContext &ctx = contexts[context];
+            int k = ctx.parameter(bits);
+            uint64_t q = u >> k;
+            if (q < maxUnary) {
+                writer.put(1, static_cast<int>(q) + 1);
+                writer.put(u & ((static_cast<uint64_t>(1) << k) - 1), k);
+            } else {
+                writer.put(0, maxUnary);
+                writer.put(u, bits);
+            }
+            ctx.update(u);
+        }
+
+        std::swap(prev, cur);
+    }
+
+    out.resize(writer.flush() - out.data());
+}
+
+template<typename T>
+static bool decodePlane(const uint8_t *src, size_t size, uint8_t *dst, ptrdiff_t stride, int width, int height, bool isFloat) {
+    const int bits = sizeof(T) * 8;
+    const uint64_t range = static_cast<uint64_t>(1) << bits;
+    const uint32_t mask = static_cast<uint32_t>(range - 1);
+    const uint32_t top = static_cast<uint32_t>(range >> 1);
+
+    BitReader reader(src, src + size);
+    RiceContext contexts[numContexts];
+
+    std::vector<uint32_t> rows(2 * static_cast<size_t>(width));
+    uint32_t *prev = rows.data();
+    uint32_t *cur = rows.data() + width;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int context;
+            uint32_t prediction = predict(cur, prev, x, y, context);
+
+            RiceContext &ctx = contexts[context];
+            int k = ctx.parameter(bits);
+            uint64_t u;
+            uint32_t unary = reader.peek(maxUnary);
+            if (unary) {
+                int q = maxUnary - bitLength(unary);
+                reader.skip(q + 1);
+                u = (static_cast<uint64_t>(q) << k) | reader.get(k);
+            } else {
+                reader.skip(maxUnary);
+                u = reader.get(bits);
+            }
+            ctx.update(u);
+
+            uint64_t residual = (u & 1) ? range - ((u + 1) >> 1) : (u >> 1);
+            cur[x] = static_cast<uint32_t>((prediction + residual) & mask);
+        }
+
+        if (!reader.ok)
+            return false;
+
+        T *dstp = reinterpret_cast<T *>(dst + y * stride);
+        for (int x = 0; x < width; x++)
+            dstp[x] = static_cast<T>(isFloat ? unmapFloat(cur[x], top, mask) : cur[x]);
+
+        std::swap(prev, cur);
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////
+// Frame properties
+
+static bool isPrivateKey(const char *key) {
+    return !strncmp(key, intermediatePrivatePrefix, sizeof(intermediatePrivatePrefix) - 1);
+}
+
+// Only the value types can be stored, nodes, frames and functions are dropped
+static void encodeProperties(const VSMap *props, std::vector<uint8_t> &out, const VSAPI *vsapi) {
+    size_t countOffset = out.size();
+    putU32(out, 0);
+    uint32_t count = 0;
+
+    int numKeys = vsapi->mapNumKeys(props);
+    for (int i = 0; i < numKeys; i++) {
+        const char *key = vsapi->mapGetKey(props, i);
+        int type = vsapi->mapGetType(props, key);
+        if (isPrivateKey(key) || (type != ptInt && type != ptFloat && type != ptData))
+            continue;
+
+        int numElements = vsapi->mapNumElements(props, key);
+        size_t keyLength = strlen(key);
+        putU32(out, static_cast<uint32_t>(keyLength));
+        out.insert(out.end(), key, key + keyLength);
+        out.push_back(static_cast<uint8_t>(type));
+        putU32(out, static_cast<uint32_t>(numElements));
+
+        for (int j = 0; j < numElements; j++) {
+            if (type == ptInt) {
+                putU64(out, static_cast<uint64_t>(vsapi->mapGetInt(props, key, j, nullptr)));
+            } else if (type == ptFloat) {
+                double v = vsapi->mapGetFloat(props, key, j, nullptr);
+                uint64_t bits;
+                memcpy(&bits, &v, sizeof(bits));
+                putU64(out, bits);
+            } else {
+                const char *data = vsapi->mapGetData(props, key, j, nullptr);
+                int size = vsapi->mapGetDataSize(props, key, j, nullptr);
+                putU32(out, static_cast<uint32_t>(vsapi->mapGetDataTypeHint(props, key, j, nullptr)));
+                putU32(out, static_cast<uint32_t>(size));
+                out.insert(out.end(), data, data + size);
+            }
+        }
+        count++;
+    }
+
+    out[countOffset] = static_cast<uint8_t>(count);
+    out[countOffset + 1] = static_cast<uint8_t>(count >> 8);
+    out[countOffset + 2] = static_cast<uint8_t>(count >> 16);
+    out[countOffset + 3] = static_cast<uint8_t>(count >> 24);
+}
+
+static bool decodeProperties(const uint8_t *p, size_t size, VSMap *props, const VSAPI *vsapi) {
+    const uint8_t *end = p + size;
+    auto available = [&p, end](uint64_t n) { return static_cast<uint64_t>(end - p) >= n; };
+
+    if (!available(4))
+        return false;
+    uint32_t count = getU32(p);
+    p += 4;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!available(4))
+            return false;
+        uint32_t keyLength = getU32(p);
+        p += 4;
+        if (!available(static_cast<uint64_t>(keyLength) + 5))
+            return false;
+        std::string key(reinterpret_cast<const char *>(p), keyLength);
+        p += keyLength;
+        int type = *p++;
+        uint32_t numElements = getU32(p);
+        p += 4;
+
+        if (type != ptInt && type != ptFloat && type != ptData)
+            return false;
+        if (!numElements)
+            vsapi->mapSetEmpty(props, key.c_str(), type);
+
+        for (uint32_t j = 0; j < numElements; j++) {
+            if (type == ptInt || type == ptFloat) {
+                if (!available(8))
+                    return false;
+                uint64_t v = getU64(p);
+                p += 8;
+                if (type == ptInt) {
+                    vsapi->mapSetInt(props, key.c_str(), static_cast<int64_t>(v), maAppend);
+                } else {
+                    double d;
+                    memcpy(&d, &v, sizeof(d));
+                    vsapi->mapSetFloat(props, key.c_str(), d, maAppend);
+                }
+            } else {
+                if (!available(8))
+                    return false;
+                int typeHint = static_cast<int>(getU32(p));
+                uint32_t dataSize = getU32(p + 4);
+                p += 8;
+                if (!available(dataSize) || dataSize > INT32_MAX)
+                    return false;
+                vsapi->mapSetData(props, key.c_str(), reinterpret_cast<const char *>(p), static_cast<int>(dataSize), typeHint, maAppend);
+                p += dataSize;
+            }
+        }
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////
+// Containers
+
+void writeIntermediateHeader(const VSVideoInfo *vi, std::vector<uint8_t> &data) {
+    data.insert(data.end(), headerMagic, headerMagic + sizeof(headerMagic));
+    putU32(data, static_cast<uint32_t>(vi->format.colorFamily));
+    putU32(data, static_cast<uint32_t>(vi->format.sampleType));
+    putU32(data, static_cast<uint32_t>(vi->format.bitsPerSample));
+    putU32(data, static_cast<uint32_t>(vi->format.subSamplingW));
+    putU32(data, static_cast<uint32_t>(vi->format.subSamplingH));
+    putU32(data, static_cast<uint32_t>(vi->width));
+    putU32(data, static_cast<uint32_t>(vi->height));
+    putU32(data, 0);
+    putU64(data, static_cast<uint64_t>(vi->fpsNum));
+    putU64(data, static_cast<uint64_t>(vi->fpsDen));
+}
+
+bool readIntermediateHeader(const uint8_t *data, IntermediateHeader &header) {
+    if (memcmp(data, headerMagic, sizeof(headerMagic)))
+        return false;
+    const uint8_t *p = data + sizeof(headerMagic);
+    header.colorFamily = static_cast<int>(getU32(p));
+    header.sampleType = static_cast<int>(getU32(p + 4));
+    header.bitsPerSample = static_cast<int>(getU32(p + 8));
+    header.subSamplingW = static_cast<int>(getU32(p + 12));
+    header.subSamplingH = static_cast<int>(getU32(p + 16));
+    header.width = static_cast<int>(getU32(p + 20));
+    header.height = static_cast<int>(getU32(p + 24));
+    header.fpsNum = static_cast<int64_t>(getU64(p + 32));
+    header.fpsDen = static_cast<int64_t>(getU64(p + 40));
+    return true;
+}
+
+void encodeIntermediateFrame(const VSFrame *frame, std::vector<uint8_t> &record, const VSAPI *vsapi) {
+    const VSVideoFormat *fi = vsapi->getVideoFrameFormat(frame);
+    bool isFloat = (fi->sampleType == stFloat);
+
+    record.assign(recordMagic, recordMagic + sizeof(recordMagic));
+    putU32(record, static_cast<uint32_t>(fi->numPlanes));
+    putU64(record, 0);
+    size_t sizesOffset = record.size();
+    for (int p = 0; p < fi->numPlanes + 1; p++)
+        putU64(record, 0);
+
+    size_t start = record.size();
+    encodeProperties(vsapi->getFramePropertiesRO(frame), record, vsapi);
+    setU64(record.data() + sizesOffset, record.size() - start);
+
+    for (int p = 0; p < fi->numPlanes; p++) {
+        start = record.size();
+        const uint8_t *src = vsapi->getReadPtr(frame, p);
+        ptrdiff_t stride = vsapi->getStride(frame, p);
+        int width = vsapi->getFrameWidth(frame, p);
+        int height = vsapi->getFrameHeight(frame, p);
+        if (fi->bytesPerSample == 1)
+            encodePlane<uint8_t>(src, stride, width, height, isFloat, record);
+        else if (fi->bytesPerSample == 2)
+            encodePlane<uint16_t>(src, stride, width, height, isFloat, record);
+        else
+            encodePlane<uint32_t>(src, stride, width, height, isFloat, record);
+        setU64(record.data() + sizesOffset + 8 * (p + 1), record.size() - start);
+    }
+
+    setU64(record.data() + 8, record.size() - intermediateRecordPrefixSize);
+}
+
+uint64_t getIntermediateRecordSize(const uint8_t *prefix) {
+    if (memcmp(prefix, recordMagic, sizeof(recordMagic)) || getU32(prefix + 4) > 3)
+        return 0;
+    return getU64(prefix + 8) + intermediateRecordPrefixSize;
+}
+
+bool decodeIntermediateFrame(const uint8_t *record, size_t size, VSFrame *dst, std::string &error, const VSAPI *vsapi) {
+    const VSVideoFormat *fi = vsapi->getVideoFrameFormat(dst);
+    bool isFloat = (fi->sampleType == stFloat);
+
+    if (size < intermediateRecordPrefixSize || getIntermediateRecordSize(record) != size || static_cast<int>(getU32(record + 4)) != fi->numPlanes) {
+        error = "invalid frame record";
+        return false;
+    }
+
+    std::vector<uint64_t> sizes(fi->numPlanes + 1);
+    uint64_t offset = intermediateRecordPrefixSize + 8 * sizes.size();
+    if (offset > size) {
+        error = "truncated frame record";
+        return false;
+    }
+    for (size_t i = 0; i < sizes.size(); i++) {
+        sizes[i] = getU64(record + intermediateRecordPrefixSize + 8 * i);
+        if (sizes[i] > size - offset) {
+            error = "truncated frame record";
+            return false;
+        }
+        offset += sizes[i];
+    }
+
+    offset = intermediateRecordPrefixSize + 8 * sizes.size();
+    if (!decodeProperties(record + offset, static_cast<size_t>(sizes[0]), vsapi->getFramePropertiesRW(dst), vsapi)) {
+        error = "corrupt frame properties";
+        return false;
+    }
+    offset += sizes[0];
+
+    for (int p = 0; p < fi->numPlanes; p++) {
+        const uint8_t *src = record + offset;
+        size_t planeSize = static_cast<size_t>(sizes[p + 1]);
+        uint8_t *dstp = vsapi->getWritePtr(dst, p);
+        ptrdiff_t stride = vsapi->getStride(dst, p);
+        int width = vsapi->getFrameWidth(dst, p);
+        int height = vsapi->getFrameHeight(dst, p);
+        bool ok;
+        if (fi->bytesPerSample == 1)
+            ok = decodePlane<uint8_t>(src, planeSize, dstp, stride, width, height, isFloat);
+        else if (fi->bytesPerSample == 2)
+            ok = decodePlane<uint16_t>(src, planeSize, dstp, stride, width, height, isFloat);
+        else
+            ok = decodePlane<uint32_t>(src, planeSize, dstp, stride, width, height, isFloat);
+        if (!ok) {
+            error = "corrupt data in plane " + std::to_string(p);
+            return false;
+        }
+        offset += planeSize;
+    }
+
+    return true;
+}
+
+void writeIntermediateIndex(const std::vector<uint64_t> &offsets, uint64_t indexOffset, std::vector<uint8_t> &data) {
+    for (uint64_t offset : offsets)
+        putU64(data, offset);
+    putU32(data, static_cast<uint32_t>(offsets.size()));
+    putU32(data, 0);
+    putU64(data, indexOffset);
+    data.insert(data.end(), trailerMagic, trailerMagic + sizeof(trailerMagic));
+}
+
+bool readIntermediateTrailer(const uint8_t *trailer, uint32_t &numFrames, uint64_t &indexOffset) {
+    if (memcmp(trailer + 16, trailerMagic, sizeof(trailerMagic)))
+        return false;
+    numFrames = getU32(trailer);
+    indexOffset = getU64(trailer + 8);
+    return true;
+}
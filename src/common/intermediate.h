@@ -0,0 +1,81 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef INTERMEDIATE_H
+#define INTERMEDIATE_H
+
+#include <VapourSynth4.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+* The vsli intermediate format stores a video clip losslessly so a later pass can read it back in any order.
+* Every plane is compressed on its own with a median predictor and adaptive rice codes, cheap enough that the
+* frames can be encoded by the worker threads while they're rendered. The file is a header, one record per
+* frame and an index of the record offsets followed by a trailer at the very end so writing it only ever
+* appends. A file with a missing or damaged trailer can still be read by walking the records.
+*
+* Header:  "VSLINT01", colorFamily, sampleType, bitsPerSample, subSamplingW, subSamplingH, width, height and
+*          a reserved field as int32, fpsNum and fpsDen as int64
+* Record:  "VSLF", numPlanes as uint32, the size of everything after these first 16 bytes as uint64, the size
+*          of the frame properties and of every compressed plane as uint64, the properties, the planes
+* Index:   the offset of every record as uint64
+* Trailer: the number of frames and a reserved field as uint32, the index offset as uint64, "VSLIIDX1"
+*
+* Everything is little endian.
+*/
+
+struct IntermediateHeader {
+    int colorFamily;
+    int sampleType;
+    int bitsPerSample;
+    int subSamplingW;
+    int subSamplingH;
+    int width;
+    int height;
+    int64_t fpsNum;
+    int64_t fpsDen;
+};
+
+static const size_t intermediateHeaderSize = 56;
+static const size_t intermediateRecordPrefixSize = 16;
+static const size_t intermediateTrailerSize = 24;
+
+// Frame properties whose names start with this aren't stored, vspipe uses them to hand data to its writer
+static const char intermediatePrivatePrefix[] = "VSPipe";
+
+void writeIntermediateHeader(const VSVideoInfo *vi, std::vector<uint8_t> &data);
+bool readIntermediateHeader(const uint8_t *data, IntermediateHeader &header);
+
+// Compresses a frame into a complete record
+void encodeIntermediateFrame(const VSFrame *frame, std::vector<uint8_t> &record, const VSAPI *vsapi);
+
+// Returns the total size of the record starting with prefix, zero if it isn't a valid record
+uint64_t getIntermediateRecordSize(const uint8_t *prefix);
+
+// Decompresses the planes and properties of a record into dst which must have the format of the file, error is set on failure
+bool decodeIntermediateFrame(const uint8_t *record, size_t size, VSFrame *dst, std::string &error, const VSAPI *vsapi);
+
+// Appends the index and trailer for records starting at the given offsets, the index is written at indexOffset
+void writeIntermediateIndex(const std::vector<uint64_t> &offsets, uint64_t indexOffset, std::vector<uint8_t> &data);
+bool readIntermediateTrailer(const uint8_t *trailer, uint32_t &numFrames, uint64_t &indexOffset);
+
+#endif /* INTERMEDIATE_H */
@@ -0,0 +1,271 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef VSREMOTE_H
+#define VSREMOTE_H
+
+/*
+* The frame protocol spoken by vspipe --serve and std.RemoteClip over TCP. All fields are sent in
+* host byte order so both ends have to share it.
+*
+* The server starts every connection with a VSRemoteHello describing the clip. After that the client
+* sends VSRemoteRequests whenever it likes and the server answers each one with a VSRemoteReply once
+* the frame is done, in whatever order they complete. A frame reply is followed by the serialized
+* properties and then the rows of every plane without any padding, an error reply by the message.
+*/
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "VapourSynth4.h"
+
+#ifndef VS_TARGET_OS_WINDOWS
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// the peer going away must not kill a process that doesn't ignore SIGPIPE
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static const char remoteMagic[4] = { 'V', 'S', 'R', 'F' };
+static const uint32_t remoteVersion = 1;
+static const uint16_t remoteDefaultPort = 14765;
+
+enum VSRemoteMessage : uint32_t {
+    rmFrame = 1,
+    rmError = 2,
+    rmClose = 3
+};
+
+struct VSRemoteHello {
+    char magic[4];
+    uint32_t version;
+    uint32_t formatID;
+    int32_t width;
+    int32_t height;
+    int32_t numFrames;
+    int64_t fpsNum;
+    int64_t fpsDen;
+};
+
+struct VSRemoteRequest {
+    uint32_t type; // rmFrame or rmClose
+    int32_t n;
+};
+
+struct VSRemoteReply {
+    uint32_t type; // rmFrame or rmError
+    int32_t n;
+    uint32_t propSize; // or the length of the error message
+    uint32_t reserved;
+    uint64_t frameSize;
+};
+
+static inline bool sendAll(int fd, const void *data, size_t size) {
+    const char *p = static_cast<const char *>(data);
+    while (size) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static inline bool recvAll(int fd, void *data, size_t size) {
+    char *p = static_cast<char *>(data);
+    while (size) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// splits [host:]port, the host is empty when only a port is given
+static inline bool splitRemoteAddress(const std::string &address, std::string &host, std::string &port) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        host.clear();
+        port = address;
+    } else {
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+        // [::1]:port
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+            host = host.substr(1, host.size() - 2);
+    }
+    if (port.empty())
+        port = std::to_string(remoteDefaultPort);
+    return port.find_first_not_of("0123456789") == std::string::npos;
+}
+
+// returns a connected or listening socket, -1 and the reason in error on failure
+static inline int openRemoteSocket(const std::string &address, bool listening, std::string &error) {
+    std::string host, port;
+    if (!splitRemoteAddress(address, host, port)) {
+        error = "invalid address " + address;
+        return -1;
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    addrinfo *result = nullptr;
+    int gaiError = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+    if (gaiError) {
+        error = "failed to resolve " + address + ": " + gai_strerror(gaiError);
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo *ai = result; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        int one = 1;
+#ifdef SO_NOSIGPIPE
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (!bind(fd, ai->ai_addr, ai->ai_addrlen) && !listen(fd, 16))
+                break;
+        } else {
+            // requests are tiny and latency matters more than packet count
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            if (!connect(fd, ai->ai_addr, ai->ai_addrlen))
+                break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+
+    if (fd < 0)
+        error = std::string(listening ? "failed to listen on " : "failed to connect to ") + address + ", errno: " + std::to_string(errno);
+    return fd;
+}
+
+// only the property types that can live outside of a process are sent, the
+// layout is key, type, count and then the values for every key
+static inline void serializeRemoteProperties(const VSMap *props, std::vector<uint8_t> &dst, const VSAPI *vsapi) {
+    auto put = [&](const void *data, size_t len) {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        dst.insert(dst.end(), p, p + len);
+    };
+
+    int numKeys = vsapi->mapNumKeys(props);
+    for (int i = 0; i < numKeys; i++) {
+        const char *key = vsapi->mapGetKey(props, i);
+        int32_t type = vsapi->mapGetType(props, key);
+        int32_t numElems = vsapi->mapNumElements(props, key);
+        if (type != ptInt && type != ptFloat && type != ptData)
+            continue;
+        uint32_t keyLen = static_cast<uint32_t>(strlen(key));
+        put(&keyLen, sizeof(keyLen));
+        put(key, keyLen);
+        put(&type, sizeof(type));
+        put(&numElems, sizeof(numElems));
+        if (type == ptInt) {
+            put(vsapi->mapGetIntArray(props, key, nullptr), sizeof(int64_t) * numElems);
+        } else if (type == ptFloat) {
+            put(vsapi->mapGetFloatArray(props, key, nullptr), sizeof(double) * numElems);
+        } else {
+            for (int j = 0; j < numElems; j++) {
+                int32_t hint = vsapi->mapGetDataTypeHint(props, key, j, nullptr);
+                int32_t dataSize = vsapi->mapGetDataSize(props, key, j, nullptr);
+                put(&hint, sizeof(hint));
+                put(&dataSize, sizeof(dataSize));
+                put(vsapi->mapGetData(props, key, j, nullptr), dataSize);
+            }
+        }
+    }
+
+    uint32_t terminator = 0;
+    put(&terminator, sizeof(terminator));
+}
+
+// the data comes from the network so every length is checked
+static inline bool deserializeRemoteProperties(VSMap *props, const uint8_t *src, size_t size, const VSAPI *vsapi) {
+    const uint8_t *end = src + size;
+    auto get = [&](void *data, size_t len) {
+        if (static_cast<size_t>(end - src) < len)
+            return false;
+        memcpy(data, src, len);
+        src += len;
+        return true;
+    };
+
+    uint32_t keyLen;
+    if (!get(&keyLen, sizeof(keyLen)))
+        return false;
+    while (keyLen) {
+        if (static_cast<size_t>(end - src) < keyLen)
+            return false;
+        std::string key(reinterpret_cast<const char *>(src), keyLen);
+        src += keyLen;
+        int32_t type, numElems;
+        if (!get(&type, sizeof(type)) || !get(&numElems, sizeof(numElems)) || numElems < 0)
+            return false;
+        for (int j = 0; j < numElems; j++) {
+            if (type == ptInt) {
+                int64_t v;
+                if (!get(&v, sizeof(v)))
+                    return false;
+                vsapi->mapSetInt(props, key.c_str(), v, maAppend);
+            } else if (type == ptFloat) {
+                double v;
+                if (!get(&v, sizeof(v)))
+                    return false;
+                vsapi->mapSetFloat(props, key.c_str(), v, maAppend);
+            } else if (type == ptData) {
+                int32_t hint, dataSize;
+                if (!get(&hint, sizeof(hint)) || !get(&dataSize, sizeof(dataSize)) || dataSize < 0 || end - src < dataSize)
+                    return false;
+                vsapi->mapSetData(props, key.c_str(), reinterpret_cast<const char *>(src), dataSize, hint, maAppend);
+                src += dataSize;
+            } else {
+                return false;
+            }
+        }
+        if (!get(&keyLen, sizeof(keyLen)))
+            return false;
+    }
+    return true;
+}
+
+#endif
+
+#endif
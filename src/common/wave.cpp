@@ -22,6 +22,11 @@
 #include <cstring>
 #include <bitset>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WAVE_X86
+#endif
+
 #ifdef _WIN32
 #define WAVE_LITTLE_ENDIAN
 #elif defined(__BYTE_ORDER__)
@@ -47,7 +52,20 @@
 void PackChannels16to16le(const uint8_t *const *const Src, uint8_t *Dst, size_t Length, size_t Channels) {
     const uint16_t *const *const S = reinterpret_cast<const uint16_t *const *>(Src);
     uint16_t *D = reinterpret_cast<uint16_t *>(Dst);
-    for (size_t i = 0; i < Length; i++) {
+    size_t i = 0;
+#if defined(WAVE_X86) && defined(WAVE_LITTLE_ENDIAN)
+    // stereo is by far the most common case
+    if (Channels == 2) {
+        for (; i + 8 <= Length; i += 8) {
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i *>(S[0] + i));
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(S[1] + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(D), _mm_unpacklo_epi16(l, r));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(D + 8), _mm_unpackhi_epi16(l, r));
+            D += 16;
+        }
+    }
+#endif
+    for (; i < Length; i++) {
         for (size_t c = 0; c < Channels; c++)
             D[c] = WAVE_SWAP16_LE(S[c][i]);
         D += Channels;
@@ -57,15 +75,57 @@ void PackChannels16to16le(const uint8_t *const *const Src, uint8_t *Dst, size_t
 void PackChannels32to32le(const uint8_t *const *const Src, uint8_t *Dst, size_t Length, size_t Channels) {
     const uint32_t *const *const S = reinterpret_cast<const uint32_t *const *>(Src);
     uint32_t *D = reinterpret_cast<uint32_t *>(Dst);
-    for (size_t i = 0; i < Length; i++) {
+    size_t i = 0;
+#if defined(WAVE_X86) && defined(WAVE_LITTLE_ENDIAN)
+    if (Channels == 2) {
+        for (; i + 4 <= Length; i += 4) {
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i *>(S[0] + i));
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(S[1] + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(D), _mm_unpacklo_epi32(l, r));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(D + 4), _mm_unpackhi_epi32(l, r));
+            D += 8;
+        }
+    }
+#endif
+    for (; i < Length; i++) {
         for (size_t c = 0; c < Channels; c++)
             D[c] = WAVE_SWAP32_LE(S[c][i]);
         D += Channels;
     }
 }
 
+#if defined(WAVE_X86) && defined(WAVE_LITTLE_ENDIAN)
+// Drops the low byte of four samples and stores the remaining 12 bytes
+static inline void Store4Samples32to24le(__m128i x, uint8_t *Dst) {
+    x = _mm_srli_epi32(x, 8);
+    // join the two samples in every 64 bit half, then the two halves
+    x = _mm_or_si128(_mm_and_si128(x, _mm_set_epi32(0, 0xFFFFFF, 0, 0xFFFFFF)), _mm_and_si128(_mm_srli_epi64(x, 8), _mm_set_epi32(0xFFFF, 0xFF000000, 0xFFFF, 0xFF000000)));
+    x = _mm_or_si128(_mm_move_epi64(x), _mm_slli_si128(_mm_srli_si128(x, 8), 6));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(Dst), x);
+    int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(x, 8));
+    memcpy(Dst + 8, &tail, 4);
+}
+#endif
+
 void PackChannels32to24le(const uint8_t *const *const Src, uint8_t *Dst, size_t Length, size_t Channels) {
-    for (size_t i = 0; i < Length; i++) {
+    size_t i = 0;
+#if defined(WAVE_X86) && defined(WAVE_LITTLE_ENDIAN)
+    if (Channels == 1) {
+        for (; i + 4 <= Length; i += 4) {
+            Store4Samples32to24le(_mm_loadu_si128(reinterpret_cast<const __m128i *>(Src[0] + i * 4)), Dst);
+            Dst += 12;
+        }
+    } else if (Channels == 2) {
+        for (; i + 4 <= Length; i += 4) {
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Src[0] + i * 4));
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Src[1] + i * 4));
+            Store4Samples32to24le(_mm_unpacklo_epi32(l, r), Dst);
+            Store4Samples32to24le(_mm_unpackhi_epi32(l, r), Dst + 12);
+            Dst += 24;
+        }
+    }
+#endif
+    for (; i < Length; i++) {
         for (size_t c = 0; c < Channels; c++) {
 #ifdef WAVE_LITTLE_ENDIAN
             memcpy(Dst + c * 3, Src[c] + i * 4 + 1, 3);
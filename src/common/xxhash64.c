@@ -0,0 +1,151 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include "xxhash64.h"
+
+#define PRIME64_1 UINT64_C(0x9E3779B185EBCA87)
+#define PRIME64_2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define PRIME64_3 UINT64_C(0x165667B19E3779F9)
+#define PRIME64_4 UINT64_C(0x85EBCA77C2B2AE63)
+#define PRIME64_5 UINT64_C(0x27D4EB2F165667C5)
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+/* Input is always read as little endian */
+static uint64_t read64(const unsigned char *p)
+{
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+        ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t xxh64_merge_round(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh64_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+static void xxh64_stripe(uint64_t *v, const unsigned char *p)
+{
+    v[0] = xxh64_round(v[0], read64(p));
+    v[1] = xxh64_round(v[1], read64(p + 8));
+    v[2] = xxh64_round(v[2], read64(p + 16));
+    v[3] = xxh64_round(v[3], read64(p + 24));
+}
+
+void XXH64_Init(XXH64_CTX *ctx, uint64_t seed)
+{
+    ctx->v[0] = seed + PRIME64_1 + PRIME64_2;
+    ctx->v[1] = seed + PRIME64_2;
+    ctx->v[2] = seed;
+    ctx->v[3] = seed - PRIME64_1;
+    ctx->seed = seed;
+    ctx->totalSize = 0;
+    ctx->bufferSize = 0;
+}
+
+void XXH64_Update(XXH64_CTX *ctx, const void *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + size;
+
+    ctx->totalSize += size;
+
+    if (ctx->bufferSize + size < 32) {
+        memcpy(ctx->buffer + ctx->bufferSize, p, size);
+        ctx->bufferSize += (unsigned)size;
+        return;
+    }
+
+    if (ctx->bufferSize) {
+        unsigned fill = 32 - ctx->bufferSize;
+        memcpy(ctx->buffer + ctx->bufferSize, p, fill);
+        xxh64_stripe(ctx->v, ctx->buffer);
+        p += fill;
+        ctx->bufferSize = 0;
+    }
+
+    while (end - p >= 32) {
+        xxh64_stripe(ctx->v, p);
+        p += 32;
+    }
+
+    memcpy(ctx->buffer, p, end - p);
+    ctx->bufferSize = (unsigned)(end - p);
+}
+
+uint64_t XXH64_Final(const XXH64_CTX *ctx)
+{
+    const unsigned char *p = ctx->buffer;
+    const unsigned char *end = p + ctx->bufferSize;
+    uint64_t h64;
+
+    if (ctx->totalSize >= 32) {
+        h64 = rotl64(ctx->v[0], 1) + rotl64(ctx->v[1], 7) + rotl64(ctx->v[2], 12) + rotl64(ctx->v[3], 18);
+        h64 = xxh64_merge_round(h64, ctx->v[0]);
+        h64 = xxh64_merge_round(h64, ctx->v[1]);
+        h64 = xxh64_merge_round(h64, ctx->v[2]);
+        h64 = xxh64_merge_round(h64, ctx->v[3]);
+    } else {
+        h64 = ctx->seed + PRIME64_5;
+    }
+
+    h64 += ctx->totalSize;
+
+    while (end - p >= 8) {
+        h64 ^= xxh64_round(0, read64(p));
+        h64 = rotl64(h64, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+
+    if (end - p >= 4) {
+        h64 ^= (uint64_t)read32(p) * PRIME64_1;
+        h64 = rotl64(h64, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    while (p < end) {
+        h64 ^= (*p) * PRIME64_5;
+        h64 = rotl64(h64, 11) * PRIME64_1;
+        p++;
+    }
+
+    h64 ^= h64 >> 33;
+    h64 *= PRIME64_2;
+    h64 ^= h64 >> 29;
+    h64 *= PRIME64_3;
+    h64 ^= h64 >> 32;
+    return h64;
+}
@@ -0,0 +1,48 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Streaming implementation of the XXH64 hash, the result doesn't depend on how the data is split between updates */
+typedef struct {
+    uint64_t v[4];
+    uint64_t seed;
+    uint64_t totalSize;
+    unsigned char buffer[32];
+    unsigned bufferSize;
+} XXH64_CTX;
+
+void XXH64_Init(XXH64_CTX *ctx, uint64_t seed);
+void XXH64_Update(XXH64_CTX *ctx, const void *data, size_t size);
+uint64_t XXH64_Final(const XXH64_CTX *ctx);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* XXHASH64_H */
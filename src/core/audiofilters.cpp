@@ -19,6 +19,8 @@
 */
 
 #include <cstdlib>
+#include <cmath>
+#include <numeric>
 #include <cstdio>
 #include <cinttypes>
 #include <memory>
@@ -27,18 +29,35 @@
 #include <algorithm>
 #include <vector>
 #include <set>
+#include "cpufeatures.h"
 #include "internalfilters.h"
 #include "VSHelper4.h"
 #include "filtershared.h"
+#include "kernel/audiomix.h"
+#include "kernel/audioresample.h"
+#include "kernel/cpulevel.h"
 
 using namespace vsh;
 
+// audio filters produce frames with as many samples as the frames of their inputs, the default
+// size unless one of them was made with AudioReframe
+static void createAudioFilterFrameSamples(VSMap *out, const char *name, const VSAudioInfo *ai, VSFilterGetFrame getFrame, VSFilterFree free, int filterMode, const VSFilterDependency *dependencies, int numDeps, void *instanceData, int frameSamples, VSCore *core, const VSAPI *vsapi) {
+    vsapi->createAudioFilter(out, name, ai, getFrame, free, filterMode, dependencies, numDeps, instanceData, core);
+    int err;
+    VSNode *node = vsapi->mapGetNode(out, "clip", vsapi->mapNumElements(out, "clip") - 1, &err);
+    if (!err) {
+        vsapi->setAudioFrameSamples(node, frameSamples);
+        vsapi->freeNode(node);
+    }
+}
+
 //////////////////////////////////////////
 // AudioTrim
 
 typedef struct {
     VSAudioInfo ai;
     int64_t first;
+    int frameSamples;
 } AudioTrimDataExtra;
 
 typedef SingleNodeData<AudioTrimDataExtra> AudioTrimData;
@@ -46,34 +65,42 @@ typedef SingleNodeData<AudioTrimDataExtra> AudioTrimData;
 static const VSFrame *VS_CC audioTrimGetframe(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     AudioTrimData *d = reinterpret_cast<AudioTrimData *>(instanceData);
 
-    int64_t startSample = n * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES) + d->first;
-    int startFrame = (int)(startSample / VS_AUDIO_FRAME_SAMPLES);
-    int length = static_cast<int>(std::min<int64_t>(d->ai.numSamples - n * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES), VS_AUDIO_FRAME_SAMPLES));
+    int64_t startSample = n * static_cast<int64_t>(d->frameSamples) + d->first;
+    int startFrame = (int)(startSample / d->frameSamples);
+    int length = static_cast<int>(std::min<int64_t>(d->ai.numSamples - n * static_cast<int64_t>(d->frameSamples), d->frameSamples));
 
-    if (startSample % VS_AUDIO_FRAME_SAMPLES == 0 && n != d->ai.numFrames - 1) { // pass through audio frames when possible
+    if (startSample % d->frameSamples == 0 && n != d->ai.numFrames - 1) { // pass through audio frames when possible
         if (activationReason == arInitial) {
             vsapi->requestFrameFilter(startFrame, d->node, frameCtx);
         } else if (activationReason == arAllFramesReady) {
             const VSFrame *src = vsapi->getFrameFilter(startFrame, d->node, frameCtx);
             if (length == vsapi->getFrameLength(src))
                 return src;
-            VSFrame *dst = vsapi->newAudioFrame(&d->ai.format, length, src, core);
-            for (int channel = 0; channel < d->ai.format.numChannels; channel++)
-                memcpy(vsapi->getWritePtr(dst, channel), vsapi->getReadPtr(src, channel), length * d->ai.format.bytesPerSample);
+            VSFrame *dst = newAudioFrameView(src, 0, length);
             vsapi->freeFrame(src);
             return dst;
         }
     } else {
-        int numSrc1Samples = VS_AUDIO_FRAME_SAMPLES - (startSample % VS_AUDIO_FRAME_SAMPLES);
+        int numSrc1Samples = d->frameSamples - (startSample % d->frameSamples);
         if (activationReason == arInitial) {
             vsapi->requestFrameFilter(startFrame, d->node, frameCtx);
             if (numSrc1Samples < length)
                 vsapi->requestFrameFilter(startFrame + 1, d->node, frameCtx);
         } else if (activationReason == arAllFramesReady) {
             const VSFrame *src1 = vsapi->getFrameFilter(startFrame, d->node, frameCtx);
+
+            // an output frame inside a single source frame shares its samples when that keeps the channels aligned
+            if (length <= numSrc1Samples) {
+                VSFrame *view = newAudioFrameView(src1, d->frameSamples - numSrc1Samples, length);
+                if (view) {
+                    vsapi->freeFrame(src1);
+                    return view;
+                }
+            }
+
             VSFrame *dst = vsapi->newAudioFrame(&d->ai.format, length, src1, core);
             for (int channel = 0; channel < d->ai.format.numChannels; channel++)
-                memcpy(vsapi->getWritePtr(dst, channel), vsapi->getReadPtr(src1, channel) + (VS_AUDIO_FRAME_SAMPLES - numSrc1Samples) * d->ai.format.bytesPerSample, numSrc1Samples * d->ai.format.bytesPerSample);
+                memcpy(vsapi->getWritePtr(dst, channel), vsapi->getReadPtr(src1, channel) + (d->frameSamples - numSrc1Samples) * d->ai.format.bytesPerSample, numSrc1Samples * d->ai.format.bytesPerSample);
             vsapi->freeFrame(src1);
 
             if (length > numSrc1Samples) {
@@ -118,6 +145,7 @@ static void VS_CC audioTrimCreate(const VSMap *in, VSMap *out, void *userData, V
     d->node = vsapi->mapGetNode(in, "clip", 0, 0);
 
     d->ai = *vsapi->getAudioInfo(d->node);
+    d->frameSamples = vsapi->getAudioFrameSamples(d->node);
 
     if ((lastset && last >= d->ai.numSamples) || (lengthset && (d->first + length) > d->ai.numSamples) || (d->ai.numSamples <= d->first))
         RETERROR("AudioTrim: last sample beyond clip end");
@@ -139,7 +167,7 @@ static void VS_CC audioTrimCreate(const VSMap *in, VSMap *out, void *userData, V
     d->ai.numSamples = trimlen;
 
     VSFilterDependency deps[] = {{d->node, rpGeneral}};
-    vsapi->createAudioFilter(out, "AudioTrim", &d->ai, audioTrimGetframe, filterFree<AudioTrimData>, fmParallel, deps, 1, d.get(), core);
+    createAudioFilterFrameSamples(out, "AudioTrim", &d->ai, audioTrimGetframe, filterFree<AudioTrimData>, fmParallel, deps, 1, d.get(), d->frameSamples, core, vsapi);
     d.release();
 }
 
@@ -151,6 +179,7 @@ typedef struct {
     std::vector<int64_t> numSamples;
     std::vector<int64_t> cumSamples;
     std::vector<int> numFrames;
+    int frameSamples;
 } AudioSpliceDataExtra;
 
 typedef VariableNodeData<AudioSpliceDataExtra> AudioSpliceData;
@@ -158,18 +187,18 @@ typedef VariableNodeData<AudioSpliceDataExtra> AudioSpliceData;
 static const VSFrame *VS_CC audioSpliceGetframe(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     AudioSpliceData *d = reinterpret_cast<AudioSpliceData *>(instanceData);
 
-    int64_t sampleStart = n * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES);
-    int remainingSamples = static_cast<int>(std::min<int64_t>(VS_AUDIO_FRAME_SAMPLES, d->ai.numSamples - sampleStart));
+    int64_t sampleStart = n * static_cast<int64_t>(d->frameSamples);
+    int remainingSamples = static_cast<int>(std::min<int64_t>(d->frameSamples, d->ai.numSamples - sampleStart));
 
     if (activationReason == arInitial) {
-        for (size_t i = 0; i < d->cumSamples.size(); i++) {
+        for (size_t i = std::upper_bound(d->cumSamples.begin(), d->cumSamples.end(), sampleStart) - d->cumSamples.begin(); i < d->cumSamples.size(); i++) {
             if (d->cumSamples[i] > sampleStart) {
                 int64_t currentStartSample = sampleStart - ((i > 0) ? d->cumSamples[i - 1] : 0);
-                int64_t reqStartOffset = currentStartSample % VS_AUDIO_FRAME_SAMPLES;
-                int reqFrame = static_cast<int>(currentStartSample / VS_AUDIO_FRAME_SAMPLES);
+                int64_t reqStartOffset = currentStartSample % d->frameSamples;
+                int reqFrame = static_cast<int>(currentStartSample / d->frameSamples);
                 do {
-                    int64_t reqStart = reqFrame * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES);
-                    int reqSamples = static_cast<int>(std::min<int64_t>(VS_AUDIO_FRAME_SAMPLES - reqStartOffset, d->numSamples[i] - reqStart));
+                    int64_t reqStart = reqFrame * static_cast<int64_t>(d->frameSamples);
+                    int reqSamples = static_cast<int>(std::min<int64_t>(d->frameSamples - reqStartOffset, d->numSamples[i] - reqStart));
                     reqStartOffset = 0;
                     vsapi->requestFrameFilter(reqFrame, d->nodes[i], frameCtx);
                     remainingSamples -= reqSamples;
@@ -188,16 +217,27 @@ static const VSFrame *VS_CC audioSpliceGetframe(int n, int activationReason, voi
         VSFrame *dst = nullptr;
         size_t dstOffset = 0;
 
-        for (size_t i = 0; i < d->cumSamples.size(); i++) {
+        for (size_t i = std::upper_bound(d->cumSamples.begin(), d->cumSamples.end(), sampleStart) - d->cumSamples.begin(); i < d->cumSamples.size(); i++) {
             if (d->cumSamples[i] > sampleStart) {
                 int64_t currentStartSample = sampleStart - ((i > 0) ? d->cumSamples[i - 1] : 0);
-                int reqStartOffset = static_cast<int>(currentStartSample % VS_AUDIO_FRAME_SAMPLES);
-                int reqFrame = static_cast<int>(currentStartSample / VS_AUDIO_FRAME_SAMPLES);
+                int reqStartOffset = static_cast<int>(currentStartSample % d->frameSamples);
+                int reqFrame = static_cast<int>(currentStartSample / d->frameSamples);
                 do {
                     const VSFrame *src = vsapi->getFrameFilter(reqFrame++, d->nodes[i], frameCtx);
                     int length = vsapi->getFrameLength(src) - reqStartOffset;
-                    if (!dst)
+                    if (!dst) {
+                        // pass through or share the source frame when the whole output frame is inside it
+                        if (length >= remainingSamples) {
+                            if (reqStartOffset == 0 && length == remainingSamples)
+                                return src;
+                            VSFrame *view = newAudioFrameView(src, reqStartOffset, remainingSamples);
+                            if (view) {
+                                vsapi->freeFrame(src);
+                                return view;
+                            }
+                        }
                         dst = vsapi->newAudioFrame(&d->ai.format, remainingSamples, src, core);
+                    }
 
                     for (int p = 0; p < d->ai.format.numChannels; p++)
                         memcpy(vsapi->getWritePtr(dst, p) + dstOffset, vsapi->getReadPtr(src, p) + reqStartOffset * d->ai.format.bytesPerSample, std::min(length, remainingSamples) * d->ai.format.bytesPerSample);
@@ -230,15 +270,28 @@ static void VS_CC audioSpliceCreate(const VSMap *in, VSMap *out, void *userData,
   
     std::unique_ptr<AudioSpliceData> d(new AudioSpliceData(vsapi));
 
+    // take the clips of AudioSplice inputs nothing else uses so that splicing many clips pairwise doesn't nest
     d->nodes.reserve(numNodes);
-    for (int i = 0; i < numNodes; i++)
-        d->nodes.push_back(vsapi->mapGetNode(in, "clips", i, nullptr));
+    for (int i = 0; i < numNodes; i++) {
+        VSNode *node = vsapi->mapGetNode(in, "clips", i, nullptr);
+        if (const AudioSpliceData *inner = reinterpret_cast<const AudioSpliceData *>(getFusableInstanceData(node, audioSpliceGetframe))) {
+            for (VSNode *source : inner->nodes)
+                d->nodes.push_back(vsapi->addNodeRef(source));
+            vsapi->freeNode(node);
+        } else {
+            d->nodes.push_back(node);
+        }
+    }
+    numNodes = static_cast<int>(d->nodes.size());
 
     d->ai = *vsapi->getAudioInfo(d->nodes[0]);
+    d->frameSamples = vsapi->getAudioFrameSamples(d->nodes[0]);
 
     for (int i = 1; i < numNodes; i++) {
         if (!isSameAudioInfo(&d->ai, vsapi->getAudioInfo(d->nodes[i])))
             RETERROR("AudioSplice: format mismatch");
+        if (vsapi->getAudioFrameSamples(d->nodes[i]) != d->frameSamples)
+            RETERROR("AudioSplice: all clips must have the same number of samples per frame");
     }
 
     d->ai.numSamples = 0;
@@ -260,7 +313,7 @@ static void VS_CC audioSpliceCreate(const VSMap *in, VSMap *out, void *userData,
     std::vector<VSFilterDependency> deps;
     for (int i = 0; i < numNodes; i++)
         deps.push_back({d->nodes[i], (i == 0) ? rpNoFrameReuse : rpGeneral});
-    vsapi->createAudioFilter(out, "AudioSplice", &d->ai, audioSpliceGetframe, filterFree<AudioSpliceData>, fmParallel, deps.data(), numNodes, d.get(), core);
+    createAudioFilterFrameSamples(out, "AudioSplice", &d->ai, audioSpliceGetframe, filterFree<AudioSpliceData>, fmParallel, deps.data(), numNodes, d.get(), d->frameSamples, core, vsapi);
     d.release();
 }
 
@@ -271,6 +324,7 @@ struct AudioLoopDataExtra {
     VSAudioInfo ai;
     int64_t srcSamples;
     int srcFrames;
+    int frameSamples;
 };
 
 typedef SingleNodeData<AudioLoopDataExtra> AudioLoopData;
@@ -278,16 +332,16 @@ typedef SingleNodeData<AudioLoopDataExtra> AudioLoopData;
 static const VSFrame *VS_CC audioLoopGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     AudioLoopData *d = reinterpret_cast<AudioLoopData *>(instanceData);
 
-    int64_t reqStart = n * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES);
+    int64_t reqStart = n * static_cast<int64_t>(d->frameSamples);
     reqStart = reqStart % d->srcSamples;
-    int reqStartFrame = static_cast<int>(reqStart / VS_AUDIO_FRAME_SAMPLES);
+    int reqStartFrame = static_cast<int>(reqStart / d->frameSamples);
     int reqFrame = reqStartFrame;
-    int reqStartOffset = static_cast<int>(reqStart % VS_AUDIO_FRAME_SAMPLES);
-    int remainingSamples = static_cast<int>(std::min<int64_t>(VS_AUDIO_FRAME_SAMPLES, d->ai.numSamples - n * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES)));
+    int reqStartOffset = static_cast<int>(reqStart % d->frameSamples);
+    int remainingSamples = static_cast<int>(std::min<int64_t>(d->frameSamples, d->ai.numSamples - n * static_cast<int64_t>(d->frameSamples)));
 
     if (activationReason == arInitial) {
         do {
-            int reqSamples = static_cast<int>(std::min<int64_t>(VS_AUDIO_FRAME_SAMPLES - reqStartOffset, d->srcSamples - reqStart));
+            int reqSamples = static_cast<int>(std::min<int64_t>(d->frameSamples - reqStartOffset, d->srcSamples - reqStart));
             reqStartOffset = 0;
             vsapi->requestFrameFilter(reqFrame++, d->node, frameCtx);
             remainingSamples -= reqSamples;
@@ -336,6 +390,7 @@ static void VS_CC audioLoopCreate(const VSMap *in, VSMap *out, void *userData, V
     d->ai = *vsapi->getAudioInfo(d->node);
     d->srcSamples = d->ai.numSamples;
     d->srcFrames = d->ai.numFrames;
+    d->frameSamples = vsapi->getAudioFrameSamples(d->node);
 
     // early termination for the trivial case
     if (times == 1) {
@@ -352,7 +407,7 @@ static void VS_CC audioLoopCreate(const VSMap *in, VSMap *out, void *userData, V
     }
 
     VSFilterDependency deps[] = {{d->node, rpGeneral}};
-    vsapi->createAudioFilter(out, "AudioLoop", &d->ai, audioLoopGetFrame, filterFree<AudioLoopData>, fmParallel, deps, 1, d.get(), core);
+    createAudioFilterFrameSamples(out, "AudioLoop", &d->ai, audioLoopGetFrame, filterFree<AudioLoopData>, fmParallel, deps, 1, d.get(), d->frameSamples, core, vsapi);
     d.release();
 }
 
@@ -361,6 +416,7 @@ static void VS_CC audioLoopCreate(const VSMap *in, VSMap *out, void *userData, V
 
 struct AudioReverseDataExtra {
     const VSAudioInfo *ai;
+    int frameSamples;
 };
 
 typedef SingleNodeData<AudioReverseDataExtra> AudioReverseData;
@@ -373,14 +429,14 @@ static const VSFrame *VS_CC audioReverseGetFrame(int n, int activationReason, vo
 
     if (activationReason == arInitial) {
         vsapi->requestFrameFilter(n1, d->node, frameCtx);
-        if (d->ai->numSamples % VS_AUDIO_FRAME_SAMPLES != 0)
+        if (d->ai->numSamples % d->frameSamples != 0)
             vsapi->requestFrameFilter(n2, d->node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
-        int dstLength = static_cast<int>(std::min<int64_t>(VS_AUDIO_FRAME_SAMPLES, d->ai->numSamples - n * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES)));
+        int dstLength = static_cast<int>(std::min<int64_t>(d->frameSamples, d->ai->numSamples - n * static_cast<int64_t>(d->frameSamples)));
         const VSFrame *src1 = vsapi->getFrameFilter(n1, d->node, frameCtx);
         size_t l1 = vsapi->getFrameLength(src1);
-        size_t s1offset = l1 - (d->ai->numSamples % VS_AUDIO_FRAME_SAMPLES);
-        if (s1offset == VS_AUDIO_FRAME_SAMPLES)
+        size_t s1offset = l1 - (d->ai->numSamples % d->frameSamples);
+        if (s1offset == static_cast<size_t>(d->frameSamples))
             s1offset = 0;
         size_t s1samples = vsapi->getFrameLength(src1) - s1offset;
 
@@ -418,26 +474,57 @@ static void VS_CC audioReverseCreate(const VSMap *in, VSMap *out, void *userData
     std::unique_ptr<AudioReverseData> d(new AudioReverseData(vsapi));
     d->node = vsapi->mapGetNode(in, "clip", 0, nullptr);
     d->ai = vsapi->getAudioInfo(d->node);
+    d->frameSamples = vsapi->getAudioFrameSamples(d->node);
 
     VSFilterDependency deps[] = {{d->node, rpGeneral}};
     if (d->ai->format.bytesPerSample == 2)
-        vsapi->createAudioFilter(out, "AudioReverse", d->ai, audioReverseGetFrame<int16_t>, filterFree<AudioReverseData>, fmParallel, deps, 1, d.get(), core);
+        createAudioFilterFrameSamples(out, "AudioReverse", d->ai, audioReverseGetFrame<int16_t>, filterFree<AudioReverseData>, fmParallel, deps, 1, d.get(), d->frameSamples, core, vsapi);
     else
-        vsapi->createAudioFilter(out, "AudioReverse", d->ai, audioReverseGetFrame<int32_t>, filterFree<AudioReverseData>, fmParallel, deps, 1, d.get(), core);
+        createAudioFilterFrameSamples(out, "AudioReverse", d->ai, audioReverseGetFrame<int32_t>, filterFree<AudioReverseData>, fmParallel, deps, 1, d.get(), d->frameSamples, core, vsapi);
     d.release();
 }
 
+//////////////////////////////////////////
+// Shared by AudioGain and AudioMix
+
+static decltype(&vs_audio_mix_float_c) selectAudioMixFunc(const VSAudioFormat &format, VSCore *core) {
+#ifdef VS_TARGET_CPU_X86
+    if (getCPUFeatures()->avx2 && getCPUFeatures()->fma3 && vs_get_cpulevel(core) >= VS_CPU_LEVEL_AVX2) {
+        if (format.sampleType == stFloat)
+            return vs_audio_mix_float_avx2;
+        else if (format.bytesPerSample == 2)
+            return vs_audio_mix_int16_avx2;
+        else
+            return vs_audio_mix_int32_avx2;
+    } else if (vs_get_cpulevel(core) >= VS_CPU_LEVEL_SSE2) {
+        if (format.sampleType == stFloat)
+            return vs_audio_mix_float_sse2;
+        else if (format.bytesPerSample == 2)
+            return vs_audio_mix_int16_sse2;
+        else
+            return vs_audio_mix_int32_sse2;
+    }
+#endif
+
+    if (format.sampleType == stFloat)
+        return vs_audio_mix_float_c;
+    else if (format.bytesPerSample == 2)
+        return vs_audio_mix_int16_c;
+    else
+        return vs_audio_mix_int32_c;
+}
+
 //////////////////////////////////////////
 // AudioGain
 
 struct AudioGainDataExtra {
-    std::vector<float> gain;
+    std::vector<double> gain;
     const VSAudioInfo *ai;
+    decltype(&vs_audio_mix_float_c) func;
 };
 
 typedef SingleNodeData<AudioGainDataExtra> AudioGainData;
 
-template<typename T>
 static const VSFrame *VS_CC audioGainGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     AudioGainData *d = reinterpret_cast<AudioGainData *>(instanceData);
 
@@ -448,12 +535,10 @@ static const VSFrame *VS_CC audioGainGetFrame(int n, int activationReason, void
         int length = vsapi->getFrameLength(src);
         VSFrame *dst = vsapi->newAudioFrame(&d->ai->format, length, src, core);
 
+        // a gain is a mix of a single channel, so the same saturating kernels are used
         for (int p = 0; p < d->ai->format.numChannels; p++) {
-            float gain = d->gain[(d->gain.size() > 1) ? p : 0];
-            const T *srcPtr = reinterpret_cast<const T *>(vsapi->getReadPtr(src, p));
-            T *dstPtr = reinterpret_cast<T *>(vsapi->getWritePtr(dst, p));
-            for (int i = 0; i < length; i++)
-                dstPtr[i] = static_cast<T>(srcPtr[i] * gain);
+            const void *srcPtr = vsapi->getReadPtr(src, p);
+            d->func(&srcPtr, &d->gain[(d->gain.size() > 1) ? p : 0], 1, vsapi->getWritePtr(dst, p), length);
         }
 
         vsapi->freeFrame(src);
@@ -475,13 +560,10 @@ static void VS_CC audioGainCreate(const VSMap *in, VSMap *out, void *userData, V
     if (numGainValues != 1 && numGainValues != d->ai->format.numChannels)
         RETERROR("AudioGain: must provide one gain value per channel or a single value used for all channels");
 
+    d->func = selectAudioMixFunc(d->ai->format, core);
+
     VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
-    if (d->ai->format.bytesPerSample == 4 && d->ai->format.sampleType == stFloat)
-        vsapi->createAudioFilter(out, "AudioGain", d->ai, audioGainGetFrame<float>, filterFree<AudioGainData>, fmParallel, deps, 1, d.get(), core);
-    else if (d->ai->format.bytesPerSample == 2)
-        vsapi->createAudioFilter(out, "AudioGain", d->ai, audioGainGetFrame<int16_t>, filterFree<AudioGainData>, fmParallel, deps, 1, d.get(), core);
-    else
-        vsapi->createAudioFilter(out, "AudioGain", d->ai, audioGainGetFrame<int32_t>, filterFree<AudioGainData>, fmParallel, deps, 1, d.get(), core);
+    createAudioFilterFrameSamples(out, "AudioGain", d->ai, audioGainGetFrame, filterFree<AudioGainData>, fmParallel, deps, 1, d.get(), vsapi->getAudioFrameSamples(d->node), core, vsapi);
     d.release();
 }
 
@@ -495,14 +577,21 @@ struct AudioMixDataNode {
     std::vector<double> weights;
 };
 
+// the inputs with a nonzero weight for one output channel
+struct AudioMixDataOutput {
+    std::vector<int> srcIdx;
+    std::vector<double> weights;
+};
+
 struct AudioMixData {
     std::vector<VSNode *> reqNodes; // a list of all distinct nodes in sourceNodes to reduce function calls
     std::vector<AudioMixDataNode> sourceNodes;
+    std::vector<AudioMixDataOutput> outputs;
     std::vector<int> outputIdx;
     VSAudioInfo ai;
+    decltype(&vs_audio_mix_float_c) func;
 };
 
-template<typename T>
 static const VSFrame *VS_CC audioMixGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     AudioMixData *d = reinterpret_cast<AudioMixData *>(instanceData);
 
@@ -511,32 +600,27 @@ static const VSFrame *VS_CC audioMixGetFrame(int n, int activationReason, void *
             vsapi->requestFrameFilter(n, iter, frameCtx);
     } else if (activationReason == arAllFramesReady) {     
         int numOutChannels = d->ai.format.numChannels;
-        std::vector<const T *> srcPtrs;
+        std::vector<const void *> srcPtrs;
         std::vector<const VSFrame *> srcFrames;
         srcPtrs.reserve(d->sourceNodes.size());
         srcFrames.reserve(d->sourceNodes.size());
         for (size_t idx = 0; idx < d->sourceNodes.size(); idx++) {
             const VSFrame *src = vsapi->getFrameFilter(n, d->sourceNodes[idx].node, frameCtx);                
-            srcPtrs.push_back(reinterpret_cast<const T *>(vsapi->getReadPtr(src, d->sourceNodes[idx].idx)));
+            srcPtrs.push_back(vsapi->getReadPtr(src, d->sourceNodes[idx].idx));
             srcFrames.push_back(src);
         }
 
         int srcLength = vsapi->getFrameLength(srcFrames[0]);
         VSFrame *dst = vsapi->newAudioFrame(&d->ai.format, srcLength, srcFrames[0], core);
 
-        std::vector<T *> dstPtrs;
-        dstPtrs.resize(numOutChannels);
-        for (int idx = 0; idx < numOutChannels; idx++)
-            dstPtrs[idx] = reinterpret_cast<T *>(vsapi->getWritePtr(dst, d->outputIdx[idx]));
-
-        for (int i = 0; i < srcLength; i++) {
-            for (size_t dstIdx = 0; dstIdx < static_cast<size_t>(numOutChannels); dstIdx++) {
-                double tmp = 0;
-                for (size_t srcIdx = 0; srcIdx < srcPtrs.size(); srcIdx++)
-                    tmp += static_cast<double>(srcPtrs[srcIdx][i]) * d->sourceNodes[srcIdx].weights[dstIdx];
-
-                dstPtrs[dstIdx][i] = static_cast<T>(tmp);
-            }
+        std::vector<const void *> mixPtrs;
+        mixPtrs.reserve(srcPtrs.size());
+        for (int dstIdx = 0; dstIdx < numOutChannels; dstIdx++) {
+            const AudioMixDataOutput &output = d->outputs[dstIdx];
+            mixPtrs.clear();
+            for (int srcIdx : output.srcIdx)
+                mixPtrs.push_back(srcPtrs[srcIdx]);
+            d->func(mixPtrs.data(), output.weights.data(), static_cast<unsigned>(mixPtrs.size()), vsapi->getWritePtr(dst, d->outputIdx[dstIdx]), srcLength);
         }
 
         for (auto iter : srcFrames)
@@ -609,6 +693,10 @@ static void VS_CC audioMixCreate(const VSMap *in, VSMap *out, void *userData, VS
             err = "AudioMix: all inputs must have the same length, samplerate, bits per sample and sample type";
             break;
         }
+        if (vsapi->getAudioFrameSamples(d->sourceNodes[i].node) != vsapi->getAudioFrameSamples(d->sourceNodes[0].node)) {
+            err = "AudioMix: all inputs must have the same number of samples per frame";
+            break;
+        }
 
         d->ai.numSamples = std::max(d->ai.numSamples, ai->numSamples);
         for (int j = 0; j < numDstChannels; j++)
@@ -628,6 +716,18 @@ static void VS_CC audioMixCreate(const VSMap *in, VSMap *out, void *userData, VS
         return;
     }
 
+    d->outputs.resize(numDstChannels);
+    for (int j = 0; j < numDstChannels; j++) {
+        for (size_t i = 0; i < d->sourceNodes.size(); i++) {
+            if (d->sourceNodes[i].weights[j] != 0) {
+                d->outputs[j].srcIdx.push_back(static_cast<int>(i));
+                d->outputs[j].weights.push_back(d->sourceNodes[i].weights[j]);
+            }
+        }
+    }
+
+    d->func = selectAudioMixFunc(d->ai.format, core);
+
     std::set<VSNode *> nodeSet;
     for (const auto &iter : d->sourceNodes)
         nodeSet.insert(iter.node);
@@ -637,12 +737,7 @@ static void VS_CC audioMixCreate(const VSMap *in, VSMap *out, void *userData, VS
     std::vector<VSFilterDependency> deps;
     for (const auto &iter : d->reqNodes)
         deps.push_back({iter, rpStrictSpatial});
-    if (d->ai.format.sampleType == stFloat)
-        vsapi->createAudioFilter(out, "AudioMix", &d->ai, audioMixGetFrame<float>, audioMixFree, fmParallel, deps.data(), static_cast<int>(deps.size()), d.get(), core);
-    else if (d->ai.format.bytesPerSample == 2)
-        vsapi->createAudioFilter(out, "AudioMix", &d->ai, audioMixGetFrame<int16_t>, audioMixFree, fmParallel, deps.data(), static_cast<int>(deps.size()), d.get(), core);
-    else
-        vsapi->createAudioFilter(out, "AudioMix", &d->ai, audioMixGetFrame<int32_t>, audioMixFree, fmParallel, deps.data(), static_cast<int>(deps.size()), d.get(), core);
+    createAudioFilterFrameSamples(out, "AudioMix", &d->ai, audioMixGetFrame, audioMixFree, fmParallel, deps.data(), static_cast<int>(deps.size()), d.get(), vsapi->getAudioFrameSamples(d->reqNodes[0]), core, vsapi);
     d.release();
 }
 
@@ -664,6 +759,7 @@ struct ShuffleChannelsData {
     std::vector<VSNode *> reqNodes; // a list of all distinct nodes in sourceNodes to reduce function calls
     std::vector<ShuffleChannelsDataNode> sourceNodes;
     VSAudioInfo ai;
+    int frameSamples;
 };
 
 static const VSFrame *VS_CC shuffleChannelsGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
@@ -674,7 +770,7 @@ static const VSFrame *VS_CC shuffleChannelsGetFrame(int n, int activationReason,
             vsapi->requestFrameFilter(n, iter, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         VSFrame *dst = nullptr;
-        int dstLength = static_cast<int>(std::min<int64_t>(d->ai.numSamples - n * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES), VS_AUDIO_FRAME_SAMPLES));
+        int dstLength = static_cast<int>(std::min<int64_t>(d->ai.numSamples - n * static_cast<int64_t>(d->frameSamples), d->frameSamples));
         for (int idx = 0; idx < static_cast<int>(d->sourceNodes.size()); idx++) {
             const VSFrame *src = vsapi->getFrameFilter(n, d->sourceNodes[idx].node, frameCtx);;
             int srcLength = (n < d->sourceNodes[idx].numFrames) ? vsapi->getFrameLength(src) : 0;
@@ -729,12 +825,17 @@ static void VS_CC shuffleChannelsCreate(const VSMap *in, VSMap *out, void *userD
     const char *err = nullptr;
 
     d->ai = *vsapi->getAudioInfo(d->sourceNodes[0].node);
+    d->frameSamples = vsapi->getAudioFrameSamples(d->sourceNodes[0].node);
     for (size_t i = 0; i < d->sourceNodes.size(); i++) {
         const VSAudioInfo *ai = vsapi->getAudioInfo(d->sourceNodes[i].node);
         if (ai->sampleRate != d->ai.sampleRate || ai->format.bitsPerSample != d->ai.format.bitsPerSample || ai->format.sampleType != d->ai.format.sampleType) {
             err = "ShuffleChannels: all inputs must have the same samplerate, bits per sample and sample type";
             break;
         }
+        if (vsapi->getAudioFrameSamples(d->sourceNodes[i].node) != d->frameSamples) {
+            err = "ShuffleChannels: all inputs must have the same number of samples per frame";
+            break;
+        }
         // recalculate channel number to a simple index (add as a vsapi function?)
         if (d->sourceNodes[i].idx < 0) {
             d->sourceNodes[i].idx = (-d->sourceNodes[i].idx) - 1;
@@ -780,7 +881,7 @@ static void VS_CC shuffleChannelsCreate(const VSMap *in, VSMap *out, void *userD
     for (const auto &iter : d->reqNodes)
         deps.push_back({iter, (d->ai.numFrames <= vsapi->getVideoInfo(iter)->numFrames) ? rpStrictSpatial : rpGeneral});
 
-    vsapi->createAudioFilter(out, "ShuffleChannels", &d->ai, shuffleChannelsGetFrame, shuffleChannelsFree, fmParallel, deps.data(), static_cast<int>(deps.size()), d.get(), core);
+    createAudioFilterFrameSamples(out, "ShuffleChannels", &d->ai, shuffleChannelsGetFrame, shuffleChannelsFree, fmParallel, deps.data(), static_cast<int>(deps.size()), d.get(), d->frameSamples, core, vsapi);
     d.release();
 }
 
@@ -861,7 +962,282 @@ static void VS_CC assumeSampleRateCreate(const VSMap *in, VSMap *out, void *user
         RETERROR("AssumeSampleRate: invalid samplerate specified");
 
     VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
-    vsapi->createAudioFilter(out, "AssumeSampleRate", &ai, assumeSampleRateGetframe, filterFree<AssumeSampleRateData>, fmParallel, deps, 1, d.get(), core);
+    createAudioFilterFrameSamples(out, "AssumeSampleRate", &ai, assumeSampleRateGetframe, filterFree<AssumeSampleRateData>, fmParallel, deps, 1, d.get(), vsapi->getAudioFrameSamples(d->node), core, vsapi);
+    d.release();
+}
+
+//////////////////////////////////////////
+// AudioReframe
+
+typedef struct {
+    VSAudioInfo ai;
+    int srcFrameSamples;
+    int frameSamples;
+} AudioReframeDataExtra;
+
+typedef SingleNodeData<AudioReframeDataExtra> AudioReframeData;
+
+static const VSFrame *VS_CC audioReframeGetframe(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    AudioReframeData *d = reinterpret_cast<AudioReframeData *>(instanceData);
+
+    int64_t start = n * static_cast<int64_t>(d->frameSamples);
+    int length = static_cast<int>(std::min<int64_t>(d->frameSamples, d->ai.numSamples - start));
+    int firstFrame = static_cast<int>(start / d->srcFrameSamples);
+    int lastFrame = static_cast<int>((start + length - 1) / d->srcFrameSamples);
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameRangeFilter(firstFrame, lastFrame, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        std::vector<const VSFrame *> src(lastFrame - firstFrame + 1);
+        vsapi->getFrameRangeFilter(firstFrame, lastFrame, d->node, frameCtx, src.data());
+
+        // a smaller frame inside a single source frame shares its samples
+        if (src.size() == 1) {
+            VSFrame *view = newAudioFrameView(src[0], static_cast<int>(start - firstFrame * static_cast<int64_t>(d->srcFrameSamples)), length);
+            if (view) {
+                vsapi->freeFrame(src[0]);
+                return view;
+            }
+        }
+
+        VSFrame *dst = vsapi->newAudioFrame(&d->ai.format, length, src[0], core);
+        for (size_t i = 0; i < src.size(); i++) {
+            int64_t srcStart = (firstFrame + static_cast<int64_t>(i)) * d->srcFrameSamples;
+            int64_t copyStart = std::max(start, srcStart);
+            int64_t copyEnd = std::min<int64_t>(start + length, srcStart + vsapi->getFrameLength(src[i]));
+            for (int p = 0; p < d->ai.format.numChannels; p++)
+                memcpy(vsapi->getWritePtr(dst, p) + (copyStart - start) * d->ai.format.bytesPerSample, vsapi->getReadPtr(src[i], p) + (copyStart - srcStart) * d->ai.format.bytesPerSample, (copyEnd - copyStart) * d->ai.format.bytesPerSample);
+            vsapi->freeFrame(src[i]);
+        }
+
+        return dst;
+    }
+
+    return nullptr;
+}
+
+static void VS_CC audioReframeCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<AudioReframeData> d(new AudioReframeData(vsapi));
+
+    d->frameSamples = vsapi->mapGetIntSaturated(in, "samples", 0, nullptr);
+    if (d->frameSamples <= 0 || d->frameSamples > VS_AUDIO_MAX_FRAME_SAMPLES || d->frameSamples % VS_AUDIO_FRAME_SAMPLES)
+        RETERROR(("AudioReframe: samples must be a multiple of " + std::to_string(VS_AUDIO_FRAME_SAMPLES) + " no larger than " + std::to_string(VS_AUDIO_MAX_FRAME_SAMPLES)).c_str());
+
+    d->node = vsapi->mapGetNode(in, "clip", 0, nullptr);
+    d->ai = *vsapi->getAudioInfo(d->node);
+    d->srcFrameSamples = vsapi->getAudioFrameSamples(d->node);
+
+    if (d->frameSamples == d->srcFrameSamples) {
+        vsapi->mapSetNode(out, "clip", d->node, maAppend);
+        return;
+    }
+
+    // every source frame ends up in a single output frame when the output frames are made of whole source frames
+    VSFilterDependency deps[] = {{d->node, (d->frameSamples % d->srcFrameSamples) ? rpGeneral : rpNoFrameReuse}};
+    createAudioFilterFrameSamples(out, "AudioReframe", &d->ai, audioReframeGetframe, filterFree<AudioReframeData>, fmParallel, deps, 1, d.get(), d->frameSamples, core, vsapi);
+    d.release();
+}
+
+//////////////////////////////////////////
+// AudioResample
+
+// Windowed sinc polyphase resampler. Output sample k sits at input position k * down / up,
+// up and down being the output and input rates divided by their gcd.
+
+static const int audioResampleZeroCrossings = 64;
+static const unsigned audioResampleMaxPhases = 1024;
+static const double audioResampleBeta = 9.0;
+static const double audioResamplePi = 3.14159265358979323846;
+
+typedef struct {
+    const VSAudioInfo *srcAi;
+    VSAudioInfo ai;
+    int64_t up;
+    int64_t down;
+    int half; // taps on each side of the input position
+    unsigned taps;
+    unsigned phases;
+    std::vector<float> filters; // phases + 1 rows of taps coefficients
+    decltype(&vs_audio_resample_c) func;
+    int frameSamples; // the same for the input and output
+} AudioResampleDataExtra;
+
+typedef SingleNodeData<AudioResampleDataExtra> AudioResampleData;
+
+static double besselI0(double x) {
+    double sum = 1;
+    double term = 1;
+    for (int k = 1; k < 64; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-16)
+            break;
+    }
+    return sum;
+}
+
+static void audioResamplePosition(const AudioResampleData *d, int64_t k, int64_t &pos, int64_t &rem) {
+    int64_t r = (k % d->up) * d->down;
+    pos = (k / d->up) * d->down + r / d->up;
+    rem = r % d->up;
+}
+
+// the range of input samples needed for output frame n
+static void audioResampleRange(const AudioResampleData *d, int n, int64_t &first, int64_t &last) {
+    int64_t start = n * static_cast<int64_t>(d->frameSamples);
+    int64_t end = std::min<int64_t>(start + d->frameSamples, d->ai.numSamples) - 1;
+    int64_t rem;
+    audioResamplePosition(d, start, first, rem);
+    audioResamplePosition(d, end, last, rem);
+    first -= d->half - 1;
+    last += d->half;
+}
+
+static void audioResampleFrames(const AudioResampleData *d, int64_t first, int64_t last, int &firstFrame, int &lastFrame) {
+    firstFrame = static_cast<int>(std::min<int64_t>(std::max<int64_t>(first, 0) / d->frameSamples, d->srcAi->numFrames - 1));
+    lastFrame = static_cast<int>(std::max<int64_t>(std::min<int64_t>(last, d->srcAi->numSamples - 1) / d->frameSamples, firstFrame));
+}
+
+template<typename T>
+static T audioResampleStore(float v, int bits) {
+    double maxval = static_cast<double>((static_cast<int64_t>(1) << (bits - 1)) - 1);
+    return static_cast<T>(std::lrint(std::max(std::min(static_cast<double>(v), maxval), -maxval - 1)));
+}
+
+template<>
+float audioResampleStore<float>(float v, int bits) {
+    return v;
+}
+
+template<typename T>
+static const VSFrame *VS_CC audioResampleGetframe(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    AudioResampleData *d = reinterpret_cast<AudioResampleData *>(instanceData);
+
+    int64_t first, last;
+    int firstFrame, lastFrame;
+    audioResampleRange(d, n, first, last);
+    audioResampleFrames(d, first, last, firstFrame, lastFrame);
+
+    if (activationReason == arInitial) {
+        for (int i = firstFrame; i <= lastFrame; i++)
+            vsapi->requestFrameFilter(i, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        int64_t start = n * static_cast<int64_t>(d->frameSamples);
+        int length = static_cast<int>(std::min<int64_t>(d->frameSamples, d->ai.numSamples - start));
+        size_t bufferLength = static_cast<size_t>(last - first + 1);
+
+        std::vector<unsigned> pos(length);
+        std::vector<unsigned> phase(length);
+        std::vector<float> frac(length);
+        for (int i = 0; i < length; i++) {
+            int64_t p, rem;
+            audioResamplePosition(d, start + i, p, rem);
+            pos[i] = static_cast<unsigned>(p - (d->half - 1) - first);
+            if (d->phases == d->up) {
+                phase[i] = static_cast<unsigned>(rem);
+                frac[i] = 0;
+            } else {
+                double t = static_cast<double>(rem) * d->phases / d->up;
+                phase[i] = static_cast<unsigned>(t);
+                frac[i] = static_cast<float>(t - phase[i]);
+            }
+        }
+
+        std::vector<const VSFrame *> src;
+        for (int i = firstFrame; i <= lastFrame; i++)
+            src.push_back(vsapi->getFrameFilter(i, d->node, frameCtx));
+
+        VSFrame *dst = vsapi->newAudioFrame(&d->ai.format, length, src[0], core);
+        std::vector<float> buffer(bufferLength);
+        std::vector<float> result(length);
+
+        for (int p = 0; p < d->ai.format.numChannels; p++) {
+            std::fill(buffer.begin(), buffer.end(), 0.f);
+            for (size_t i = 0; i < src.size(); i++) {
+                int64_t frameStart = (firstFrame + static_cast<int64_t>(i)) * d->frameSamples;
+                int64_t copyStart = std::max(first, frameStart);
+                int64_t copyEnd = std::min(last + 1, frameStart + vsapi->getFrameLength(src[i]));
+                const T *srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src[i], p));
+                for (int64_t j = copyStart; j < copyEnd; j++)
+                    buffer[j - first] = static_cast<float>(srcp[j - frameStart]);
+            }
+
+            d->func(buffer.data(), result.data(), d->filters.data(), d->taps, pos.data(), phase.data(), frac.data(), length);
+
+            T *dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, p));
+            for (int i = 0; i < length; i++)
+                dstp[i] = audioResampleStore<T>(result[i], d->ai.format.bitsPerSample);
+        }
+
+        for (auto iter : src)
+            vsapi->freeFrame(iter);
+
+        return dst;
+    }
+
+    return nullptr;
+}
+
+static void VS_CC audioResampleCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<AudioResampleData> d(new AudioResampleData(vsapi));
+
+    d->node = vsapi->mapGetNode(in, "clip", 0, nullptr);
+    d->srcAi = vsapi->getAudioInfo(d->node);
+    d->ai = *d->srcAi;
+    d->frameSamples = vsapi->getAudioFrameSamples(d->node);
+    d->ai.sampleRate = vsapi->mapGetIntSaturated(in, "samplerate", 0, nullptr);
+
+    if (d->ai.sampleRate < 1)
+        RETERROR("AudioResample: invalid samplerate specified");
+
+    if (d->ai.sampleRate == d->srcAi->sampleRate) {
+        vsapi->mapSetNode(out, "clip", d->node, maAppend);
+        return;
+    }
+
+    int64_t g = std::gcd<int64_t>(d->srcAi->sampleRate, d->ai.sampleRate);
+    d->up = d->ai.sampleRate / g;
+    d->down = d->srcAi->sampleRate / g;
+
+    d->ai.numSamples = (d->srcAi->numSamples / d->down) * d->up + ((d->srcAi->numSamples % d->down) * d->up + d->down - 1) / d->down;
+    if (d->ai.numSamples > std::numeric_limits<int>::max() * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES))
+        RETERROR("AudioResample: the resulting clip is too long");
+
+    // the cutoff is relative to the input nyquist and leaves room for the transition band below the lower nyquist
+    double cutoff = 0.95 * std::min(1.0, static_cast<double>(d->up) / d->down);
+    d->half = (static_cast<int>(std::ceil(audioResampleZeroCrossings / cutoff)) + 3) & ~3;
+    d->taps = 2 * d->half;
+    d->phases = static_cast<unsigned>(std::min<int64_t>(d->up, audioResampleMaxPhases));
+
+    d->filters.resize((d->phases + 1) * static_cast<size_t>(d->taps));
+    for (unsigned j = 0; j <= d->phases; j++) {
+        float *h = d->filters.data() + j * static_cast<size_t>(d->taps);
+        double sum = 0;
+        for (unsigned i = 0; i < d->taps; i++) {
+            double x = static_cast<double>(i) - (d->half - 1) - static_cast<double>(j) / d->phases;
+            double w = x / d->half;
+            double s = (x == 0) ? 1.0 : std::sin(audioResamplePi * cutoff * x) / (audioResamplePi * cutoff * x);
+            double v = (w * w < 1) ? s * besselI0(audioResampleBeta * std::sqrt(1 - w * w)) : 0;
+            h[i] = static_cast<float>(v);
+            sum += v;
+        }
+        for (unsigned i = 0; i < d->taps; i++)
+            h[i] = static_cast<float>(h[i] / sum);
+    }
+
+    d->func = vs_audio_resample_c;
+#ifdef VS_TARGET_CPU_X86
+    if (getCPUFeatures()->avx2 && getCPUFeatures()->fma3 && vs_get_cpulevel(core) >= VS_CPU_LEVEL_AVX2)
+        d->func = vs_audio_resample_avx2;
+#endif
+
+    VSFilterDependency deps[] = {{d->node, rpGeneral}};
+    if (d->ai.format.sampleType == stFloat)
+        createAudioFilterFrameSamples(out, "AudioResample", &d->ai, audioResampleGetframe<float>, filterFree<AudioResampleData>, fmParallel, deps, 1, d.get(), d->frameSamples, core, vsapi);
+    else if (d->ai.format.bytesPerSample == 2)
+        createAudioFilterFrameSamples(out, "AudioResample", &d->ai, audioResampleGetframe<int16_t>, filterFree<AudioResampleData>, fmParallel, deps, 1, d.get(), d->frameSamples, core, vsapi);
+    else
+        createAudioFilterFrameSamples(out, "AudioResample", &d->ai, audioResampleGetframe<int32_t>, filterFree<AudioResampleData>, fmParallel, deps, 1, d.get(), d->frameSamples, core, vsapi);
     d.release();
 }
 
@@ -1057,6 +1433,8 @@ void audioInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->registerFunction("ShuffleChannels", "clips:anode[];channels_in:int[];channels_out:int[];", "clip:anode;", shuffleChannelsCreate, 0, plugin);
     vspapi->registerFunction("SplitChannels", "clip:anode;", "clip:anode[];", splitChannelsCreate, 0, plugin);
     vspapi->registerFunction("AssumeSampleRate", "clip:anode;src:anode:opt;samplerate:int:opt;", "clip:anode;", assumeSampleRateCreate, 0, plugin);
+    vspapi->registerFunction("AudioReframe", "clip:anode;samples:int;", "clip:anode;", audioReframeCreate, 0, plugin);
+    vspapi->registerFunction("AudioResample", "clip:anode;samplerate:int;", "clip:anode;", audioResampleCreate, 0, plugin);
     vspapi->registerFunction("BlankAudio", "clip:anode:opt;channels:int:opt;bits:int:opt;sampletype:int:opt;samplerate:int:opt;length:int:opt;keep:int:opt;", "clip:anode;", blankAudioCreate, 0, plugin);
     vspapi->registerFunction("TestAudio", "channels:int:opt;bits:int:opt;isfloat:int:opt;samplerate:int:opt;length:int:opt;", "clip:anode;", testAudioCreate, 0, plugin);
 }
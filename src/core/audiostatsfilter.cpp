@@ -0,0 +1,391 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <VapourSynth4.h>
+#include <VSHelper4.h>
+#include "filtershared.h"
+#include "internalfilters.h"
+#include "cpufeatures.h"
+#include "kernel/audiostats.h"
+#include "kernel/cpulevel.h"
+
+namespace {
+std::string operator""_s(const char *str, size_t len) { return{ str, len }; }
+
+///////////////////////////////////////
+// AudioStats
+
+// Loudness is measured as in ITU-R BS.1770-4 and EBU R128, the K-weighted mean square is collected in
+// 100 ms blocks, momentary and short-term loudness use the last 4 and 30 of them and the integrated
+// loudness gates the overlapping 400 ms blocks at -70 LUFS and then 10 LU below their mean
+static constexpr int shortTermBlocks = 30;
+static constexpr int gatingBlocks = 4;
+static constexpr double absoluteGate = -70;
+static constexpr double relativeGate = -10;
+static constexpr double histogramStep = 0.01;
+static constexpr int histogramBins = 9000;
+
+struct Biquad {
+    double b0, b1, b2, a1, a2;
+};
+
+struct AudioStatsChannel {
+    double weight;
+    double z[4];
+    float history[VS_AUDIO_TRUE_PEAK_TAPS - 1];
+    float maxPeak;
+    float maxTruePeak;
+};
+
+struct AudioStatsDataExtra {
+    const VSAudioInfo *ai;
+    int frameSamples;
+    int blockSamples;
+    int prerollFrames;
+    float scale;
+    Biquad shelf;
+    Biquad highpass;
+    decltype(&vs_audio_peak_energy_c) peakEnergy;
+    decltype(&vs_audio_true_peak_c) truePeak;
+
+    // the running state, fmFrameState makes sure only one frame at a time uses it
+    int nextFrame;
+    int startFrame;
+    int blockPos;
+    bool discardBlock;
+    double blockEnergy;
+    int64_t numBlocks;
+    std::vector<AudioStatsChannel> channels;
+    std::deque<double> blocks;
+    std::vector<int64_t> histogramCount;
+    std::vector<double> histogramEnergy;
+};
+
+typedef SingleNodeData<AudioStatsDataExtra> AudioStatsData;
+
+static double meanSquareToLoudness(double v) {
+    return -0.691 + 10 * std::log10(v);
+}
+
+static double toDecibels(float v) {
+    return 20 * std::log10(static_cast<double>(v));
+}
+
+// the filter coefficients for any sample rate, they round to the ones given for 48 kHz in BS.1770
+static void designKWeighting(double rate, Biquad &shelf, Biquad &highpass) {
+    double f0 = 1681.974450955533;
+    double g = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = std::tan(M_PI * f0 / rate);
+    double vh = std::pow(10.0, g / 20);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1 + k / q + k * k;
+    shelf = { (vh + vb * k / q + k * k) / a0, 2 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0, 2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0 };
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = std::tan(M_PI * f0 / rate);
+    a0 = 1 + k / q + k * k;
+    highpass = { 1, -2, 1, 2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0 };
+}
+
+// the surround channels are weighted by +1.5 dB and the LFE channel isn't included
+static double channelWeight(int channel) {
+    switch (channel) {
+    case acLowFrequency:
+    case acLowFrequency2:
+        return 0;
+    case acBackLeft:
+    case acBackRight:
+    case acSideLeft:
+    case acSideRight:
+        return 1.41;
+    default:
+        return 1;
+    }
+}
+
+static void audioStatsReset(AudioStatsData *d, int first) {
+    d->startFrame = first;
+    d->nextFrame = first;
+    // blocks stay aligned to the start of the clip so the same samples end up in them after a seek
+    d->blockPos = static_cast<int>((static_cast<int64_t>(first) * d->frameSamples) % d->blockSamples);
+    d->discardBlock = (d->blockPos != 0);
+    d->blockEnergy = 0;
+    d->numBlocks = 0;
+    d->blocks.clear();
+    std::fill(d->histogramCount.begin(), d->histogramCount.end(), 0);
+    std::fill(d->histogramEnergy.begin(), d->histogramEnergy.end(), 0.0);
+    for (auto &iter : d->channels) {
+        std::fill(std::begin(iter.z), std::end(iter.z), 0.0);
+        std::fill(std::begin(iter.history), std::end(iter.history), 0.f);
+        iter.maxPeak = 0;
+        iter.maxTruePeak = 0;
+    }
+}
+
+static void audioStatsCompleteBlock(AudioStatsData *d) {
+    double ms = d->blockEnergy / d->blockSamples;
+    d->blockEnergy = 0;
+    if (d->discardBlock) {
+        d->discardBlock = false;
+        return;
+    }
+
+    d->blocks.push_back(ms);
+    if (d->blocks.size() > shortTermBlocks)
+        d->blocks.pop_front();
+
+    if (++d->numBlocks >= gatingBlocks) {
+        double gated = 0;
+        for (size_t i = d->blocks.size() - gatingBlocks; i < d->blocks.size(); i++)
+            gated += d->blocks[i];
+        gated /= gatingBlocks;
+        double loudness = meanSquareToLoudness(gated);
+        if (loudness >= absoluteGate) {
+            int bin = std::min(static_cast<int>((loudness - absoluteGate) / histogramStep), histogramBins - 1);
+            d->histogramCount[bin]++;
+            d->histogramEnergy[bin] += gated;
+        }
+    }
+}
+
+static double audioStatsWindowLoudness(const AudioStatsData *d, size_t numBlocks) {
+    double sum = 0;
+    size_t n = std::min(numBlocks, d->blocks.size());
+    for (size_t i = d->blocks.size() - n; i < d->blocks.size(); i++)
+        sum += d->blocks[i];
+    // missing blocks at the start count as silence
+    return meanSquareToLoudness(sum / numBlocks);
+}
+
+static double audioStatsIntegratedLoudness(const AudioStatsData *d) {
+    int64_t count = 0;
+    double energy = 0;
+    for (int i = 0; i < histogramBins; i++) {
+        count += d->histogramCount[i];
+        energy += d->histogramEnergy[i];
+    }
+    if (!count)
+        return -std::numeric_limits<double>::infinity();
+
+    double threshold = meanSquareToLoudness(energy / count) + relativeGate;
+    int first = std::max(0, static_cast<int>(std::ceil((threshold - absoluteGate) / histogramStep)));
+    count = 0;
+    energy = 0;
+    for (int i = first; i < histogramBins; i++) {
+        count += d->histogramCount[i];
+        energy += d->histogramEnergy[i];
+    }
+    return count ? meanSquareToLoudness(energy / count) : -std::numeric_limits<double>::infinity();
+}
+
+template<typename T>
+static void audioStatsLoad(const uint8_t *src, float *dst, int length, float scale) {
+    const T *srcp = reinterpret_cast<const T *>(src);
+    for (int i = 0; i < length; i++)
+        dst[i] = static_cast<float>(srcp[i]) * scale;
+}
+
+static inline double biquad(const Biquad &f, double x, double &z1, double &z2) {
+    double y = f.b0 * x + z1;
+    z1 = f.b1 * x - f.a1 * y + z2;
+    z2 = f.b2 * x - f.a2 * y;
+    return y;
+}
+
+// feeds one frame through the running state, the per frame values go into the arrays when they're given
+static void audioStatsProcess(AudioStatsData *d, const VSFrame *src, double *peak, double *rms, double *truePeak, const VSAPI *vsapi) {
+    constexpr int pad = VS_AUDIO_TRUE_PEAK_TAPS - 1;
+    int length = vsapi->getFrameLength(src);
+    const VSAudioFormat &format = d->ai->format;
+    std::vector<float> buffer(pad + length);
+
+    // the energy of the parts of the 100 ms blocks in this frame, the first numComplete of them end a block
+    std::vector<int> segmentEnd;
+    for (int pos = d->blockSamples - d->blockPos; pos <= length; pos += d->blockSamples)
+        segmentEnd.push_back(pos);
+    size_t numComplete = segmentEnd.size();
+    if (segmentEnd.empty() || segmentEnd.back() != length)
+        segmentEnd.push_back(length);
+    std::vector<double> segmentEnergy(segmentEnd.size());
+
+    for (int c = 0; c < format.numChannels; c++) {
+        AudioStatsChannel &ch = d->channels[c];
+        float *samples = buffer.data() + pad;
+        std::copy(std::begin(ch.history), std::end(ch.history), buffer.begin());
+        if (format.sampleType == stFloat)
+            audioStatsLoad<float>(vsapi->getReadPtr(src, c), samples, length, d->scale);
+        else if (format.bytesPerSample == 2)
+            audioStatsLoad<int16_t>(vsapi->getReadPtr(src, c), samples, length, d->scale);
+        else
+            audioStatsLoad<int32_t>(vsapi->getReadPtr(src, c), samples, length, d->scale);
+
+        float framePeak = 0;
+        float frameTruePeak = 0;
+        double sumsq = 0;
+        d->peakEnergy(samples, length, &framePeak, &sumsq);
+        d->truePeak(samples, length, &frameTruePeak);
+        std::copy(buffer.end() - pad, buffer.end(), std::begin(ch.history));
+        ch.maxPeak = std::max(ch.maxPeak, framePeak);
+        ch.maxTruePeak = std::max(ch.maxTruePeak, frameTruePeak);
+        if (peak) {
+            peak[c] = toDecibels(framePeak);
+            rms[c] = toDecibels(static_cast<float>(std::sqrt(sumsq / length)));
+            truePeak[c] = toDecibels(frameTruePeak);
+        }
+
+        // the weighting filters can only run one sample at a time
+        if (ch.weight) {
+            int i = 0;
+            for (size_t s = 0; s < segmentEnd.size(); s++) {
+                double energy = 0;
+                for (; i < segmentEnd[s]; i++) {
+                    double y = biquad(d->highpass, biquad(d->shelf, samples[i], ch.z[0], ch.z[1]), ch.z[2], ch.z[3]);
+                    energy += y * y;
+                }
+                segmentEnergy[s] += ch.weight * energy;
+            }
+        }
+    }
+
+    for (size_t s = 0; s < segmentEnd.size(); s++) {
+        d->blockEnergy += segmentEnergy[s];
+        if (s < numComplete)
+            audioStatsCompleteBlock(d);
+    }
+    d->blockPos = (d->blockPos + length) % d->blockSamples;
+}
+
+static const VSFrame *VS_CC audioStatsGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    AudioStatsData *d = reinterpret_cast<AudioStatsData *>(instanceData);
+
+    if (activationReason == arInitial) {
+        // a frame that doesn't continue the previous one starts over a few seconds earlier so
+        // the momentary and short-term loudness are complete
+        int first = (n == d->nextFrame) ? n : std::max(0, n - d->prerollFrames);
+        *frameData = reinterpret_cast<void *>(static_cast<intptr_t>(first));
+        for (int i = first; i <= n; i++)
+            vsapi->requestFrameFilter(i, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        int first = static_cast<int>(reinterpret_cast<intptr_t>(*frameData));
+        if (first != d->nextFrame)
+            audioStatsReset(d, first);
+
+        int numChannels = d->ai->format.numChannels;
+        std::vector<double> peak(numChannels), rms(numChannels), truePeak(numChannels);
+        for (int i = first; i < n; i++) {
+            const VSFrame *src = vsapi->getFrameFilter(i, d->node, frameCtx);
+            audioStatsProcess(d, src, nullptr, nullptr, nullptr, vsapi);
+            vsapi->freeFrame(src);
+        }
+
+        const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+        audioStatsProcess(d, src, peak.data(), rms.data(), truePeak.data(), vsapi);
+        d->nextFrame = n + 1;
+
+        VSFrame *dst = vsapi->copyFrame(src, core);
+        vsapi->freeFrame(src);
+
+        std::vector<double> maxPeak(numChannels), maxTruePeak(numChannels);
+        for (int c = 0; c < numChannels; c++) {
+            maxPeak[c] = toDecibels(d->channels[c].maxPeak);
+            maxTruePeak[c] = toDecibels(d->channels[c].maxTruePeak);
+        }
+
+        VSMap *props = vsapi->getFramePropertiesRW(dst);
+        vsapi->mapSetFloatArray(props, "AudioPeak", peak.data(), numChannels);
+        vsapi->mapSetFloatArray(props, "AudioRMS", rms.data(), numChannels);
+        vsapi->mapSetFloatArray(props, "AudioTruePeak", truePeak.data(), numChannels);
+        vsapi->mapSetFloatArray(props, "AudioMaxPeak", maxPeak.data(), numChannels);
+        vsapi->mapSetFloatArray(props, "AudioMaxTruePeak", maxTruePeak.data(), numChannels);
+        vsapi->mapSetFloat(props, "AudioMomentaryLoudness", audioStatsWindowLoudness(d, gatingBlocks), maReplace);
+        vsapi->mapSetFloat(props, "AudioShortTermLoudness", audioStatsWindowLoudness(d, shortTermBlocks), maReplace);
+        vsapi->mapSetFloat(props, "AudioIntegratedLoudness", audioStatsIntegratedLoudness(d), maReplace);
+        vsapi->mapSetInt(props, "AudioStatsStart", d->startFrame, maReplace);
+        return dst;
+    }
+
+    return nullptr;
+}
+
+static void VS_CC audioStatsCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<AudioStatsData> d(new AudioStatsData(vsapi));
+
+    d->node = vsapi->mapGetNode(in, "clip", 0, nullptr);
+    d->ai = vsapi->getAudioInfo(d->node);
+    d->frameSamples = vsapi->getAudioFrameSamples(d->node);
+
+    if (d->ai->sampleRate < 8000)
+        RETERROR("AudioStats: the sample rate must be at least 8000 Hz");
+
+    const VSAudioFormat &format = d->ai->format;
+    d->scale = (format.sampleType == stFloat) ? 1.f : static_cast<float>(1.0 / (static_cast<int64_t>(1) << (format.bitsPerSample - 1)));
+    designKWeighting(d->ai->sampleRate, d->shelf, d->highpass);
+    d->blockSamples = d->ai->sampleRate / 10;
+    // the short-term window, one more block to make up for the partial one at the start and another for the filters to settle
+    d->prerollFrames = static_cast<int>((static_cast<int64_t>(shortTermBlocks + 2) * d->blockSamples + d->frameSamples - 1) / d->frameSamples);
+
+    d->peakEnergy = vs_audio_peak_energy_c;
+    d->truePeak = vs_audio_true_peak_c;
+#ifdef VS_TARGET_CPU_X86
+    if (getCPUFeatures()->avx2 && getCPUFeatures()->fma3 && vs_get_cpulevel(core) >= VS_CPU_LEVEL_AVX2) {
+        d->peakEnergy = vs_audio_peak_energy_avx2;
+        d->truePeak = vs_audio_true_peak_avx2;
+    } else if (vs_get_cpulevel(core) >= VS_CPU_LEVEL_SSE2) {
+        d->peakEnergy = vs_audio_peak_energy_sse2;
+        d->truePeak = vs_audio_true_peak_sse2;
+    }
+#endif
+
+    for (int i = 0; i < 64; i++) {
+        if (format.channelLayout & (static_cast<uint64_t>(1) << i))
+            d->channels.push_back({ channelWeight(i), {}, {}, 0, 0 });
+    }
+    d->histogramCount.resize(histogramBins);
+    d->histogramEnergy.resize(histogramBins);
+    d->nextFrame = -1;
+
+    // the running values need the frames in order, seeking only starts over from a few seconds earlier
+    VSFilterDependency deps[] = {{d->node, rpGeneral}};
+    int frameSamples = d->frameSamples;
+    VSNode *node = vsapi->createAudioFilter2("AudioStats", d->ai, audioStatsGetFrame, filterFree<AudioStatsData>, fmFrameState, deps, 1, d.get(), core);
+    d.release();
+    vsapi->setAudioFrameSamples(node, frameSamples);
+    vsapi->mapConsumeNode(out, "clip", node, maAppend);
+}
+
+} // namespace
+
+///////////////////////////////////////
+// Init
+
+void audioStatsInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
+    vspapi->registerFunction("AudioStats", "clip:anode;", "clip:anode;", audioStatsCreate, 0, plugin);
+}
@@ -23,14 +23,17 @@
 #include <cmath>
 #include <cfloat>
 #include <cstddef>
+#include <cstdint>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <vector>
 #include <VapourSynth4.h>
 #include <VSHelper4.h>
 #include "filtershared.h"
 #include "version.h"
+#include "cpufeatures.h"
 #include "kernel/average.h"
 #include "kernel/cpulevel.h"
 
@@ -54,10 +57,80 @@ typedef struct {
     float fscale;
     bool useSceneChange;
     bool process[3];
+
+    // Running per pixel sum of the window, used when consecutive frames are
+    // requested with uniform integer weights in single clip mode
+    bool sliding;
+    std::mutex slidingLock;
+    int slidingFrame;
+    std::vector<int32_t> slidingSum[3];
+
+    // single clip mode, shared with the other temporal filters reading the same clip
+    VSFrameWindow *window;
 } AverageFrameDataExtra;
 
 typedef VariableNodeData<AverageFrameDataExtra> AverageFrameData;
 
+// Only worth it when the window is large enough to make reading the accumulator cheaper than rereading the frames
+static const int slidingMinWeights = 9;
+
+static inline int32_t roundToInt(float v) {
+#ifdef VS_TARGET_CPU_X86
+    // same rounding as the SIMD kernels
+    return _mm_cvtss_si32(_mm_set_ss(v));
+#else
+    return static_cast<int32_t>(std::lrint(v));
+#endif
+}
+
+template<typename T>
+static void slidingRebuild(int32_t *sum, const void * const *srcs, unsigned num, unsigned w, unsigned h, ptrdiff_t stride) {
+    for (unsigned y = 0; y < h; y++) {
+        std::fill_n(sum, w, 0);
+        for (unsigned k = 0; k < num; k++) {
+            const T *src = reinterpret_cast<const T *>(static_cast<const uint8_t *>(srcs[k]) + y * stride);
+            for (unsigned x = 0; x < w; x++)
+                sum[x] += src[x];
+        }
+        sum += w;
+    }
+}
+
+template<typename T>
+static void slidingUpdate(int32_t *sum, const void *in, const void *out, unsigned w, unsigned h, ptrdiff_t stride) {
+    for (unsigned y = 0; y < h; y++) {
+        const T *inp = reinterpret_cast<const T *>(static_cast<const uint8_t *>(in) + y * stride);
+        const T *outp = reinterpret_cast<const T *>(static_cast<const uint8_t *>(out) + y * stride);
+        for (unsigned x = 0; x < w; x++)
+            sum[x] += static_cast<int32_t>(inp[x]) - static_cast<int32_t>(outp[x]);
+        sum += w;
+    }
+}
+
+template<typename T>
+static void slidingOutput(const int32_t *sum, void *dst, unsigned num, int weight, unsigned scale, bool chroma, unsigned depth, unsigned w, unsigned h, ptrdiff_t stride) {
+    int32_t maxval = (1 << depth) - 1;
+    int32_t bias = chroma ? (1 << (depth - 1)) : 0;
+    int32_t offset = static_cast<int32_t>(num) * bias;
+    float fscale = 1.0f / scale;
+
+    for (unsigned y = 0; y < h; y++) {
+        T *dstp = reinterpret_cast<T *>(static_cast<uint8_t *>(dst) + y * stride);
+        for (unsigned x = 0; x < w; x++) {
+            int32_t v = roundToInt(static_cast<float>((sum[x] - offset) * weight) * fscale) + bias;
+            dstp[x] = static_cast<T>(std::min(std::max(v, 0), maxval));
+        }
+        sum += w;
+    }
+}
+
+static void VS_CC averageFramesFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    AverageFrameData *d = static_cast<AverageFrameData *>(instanceData);
+    if (d->window)
+        vsapi->detachFrameWindow(d->window);
+    delete d;
+}
+
 static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     AverageFrameData *d = static_cast<AverageFrameData *>(instanceData);
     bool singleClipMode = (d->nodes.size() == 1);
@@ -66,8 +139,12 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
 
     if (activationReason == arInitial) {
         if (singleClipMode) {
-            for (int i = std::max(0, n - (int)(d->weights.size() / 2)); i <= lastframe; i++)
-                vsapi->requestFrameFilter(i, d->nodes[0], frameCtx);
+            if (clamp)
+                vsapi->requestFrameRangeFilter(n - (int)(d->weights.size() / 2), lastframe, d->nodes[0], frameCtx);
+            else
+                vsapi->requestFrameWindowFilter(n, d->window, frameCtx);
+            if (d->sliding && !clamp)
+                vsapi->requestFrameFilter(std::max(0, n - (int)(d->weights.size() / 2) - 1), d->nodes[0], frameCtx);
         } else {
             for (auto iter : d->nodes)
                 vsapi->requestFrameFilter(n, iter, frameCtx);
@@ -75,7 +152,9 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
     } else if (activationReason == arAllFramesReady) {
         std::vector<const VSFrame *> frames(d->weights.size());
 
-        if (singleClipMode) {
+        if (singleClipMode && !clamp) {
+            vsapi->getFrameWindowFilter(n, d->window, frameCtx, frames.data());
+        } else if (singleClipMode) {
             int fn = n - (int)(d->weights.size() / 2);
             for (size_t i = 0; i < d->weights.size(); i++) {
                 frames[i] = vsapi->getFrameFilter(std::max(0, fn), d->nodes[0], frameCtx);
@@ -87,6 +166,11 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
                 frames[i] = vsapi->getFrameFilter(n, d->nodes[i], frameCtx);
         }
 
+        // the frame that left the window since n - 1
+        const VSFrame *outgoing = nullptr;
+        if (d->sliding && !clamp)
+            outgoing = vsapi->getFrameFilter(std::max(0, n - (int)(d->weights.size() / 2) - 1), d->nodes[0], frameCtx);
+
         const VSFrame *center = (singleClipMode ? frames[frames.size() / 2] : frames[0]);
         const VSVideoFormat *fi = vsapi->getVideoFrameFormat(center);
 
@@ -155,15 +239,77 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
             }
         }
 
+        // Frames processed concurrently fall back to the regular kernels instead of waiting
+        std::unique_lock<std::mutex> slidingGuard;
+        if (outgoing)
+            slidingGuard = std::unique_lock<std::mutex>(d->slidingLock, std::try_to_lock);
+        bool slide = slidingGuard.owns_lock() && n > 0 && d->slidingFrame == n - 1;
+
         for (int plane = 0; plane < fi->numPlanes; plane++) {
             if (!d->process[plane])
                 continue;
 
+            if (slidingGuard.owns_lock()) {
+                unsigned w = vsapi->getFrameWidth(dst, plane);
+                unsigned h = vsapi->getFrameHeight(dst, plane);
+                ptrdiff_t stride = vsapi->getStride(dst, plane);
+                bool chroma = (plane == 1 || plane == 2) && fi->colorFamily == cfYUV;
+                std::vector<int32_t> &sum = d->slidingSum[plane];
+                sum.resize(static_cast<size_t>(w) * h);
+
+                if (slide) {
+                    if (fi->bytesPerSample == 1)
+                        slidingUpdate<uint8_t>(sum.data(), vsapi->getReadPtr(frames.back(), plane), vsapi->getReadPtr(outgoing, plane), w, h, stride);
+                    else
+                        slidingUpdate<uint16_t>(sum.data(), vsapi->getReadPtr(frames.back(), plane), vsapi->getReadPtr(outgoing, plane), w, h, stride);
+                } else {
+                    const void *src_ptrs[32];
+                    for (unsigned i = 0; i < frames.size(); ++i)
+                        src_ptrs[i] = vsapi->getReadPtr(frames[i], plane);
+                    if (fi->bytesPerSample == 1)
+                        slidingRebuild<uint8_t>(sum.data(), src_ptrs, static_cast<unsigned>(frames.size()), w, h, stride);
+                    else
+                        slidingRebuild<uint16_t>(sum.data(), src_ptrs, static_cast<unsigned>(frames.size()), w, h, stride);
+                }
+
+                if (fi->bytesPerSample == 1)
+                    slidingOutput<uint8_t>(sum.data(), vsapi->getWritePtr(dst, plane), static_cast<unsigned>(frames.size()), weights[0], d->scale, chroma, fi->bitsPerSample, w, h, stride);
+                else
+                    slidingOutput<uint16_t>(sum.data(), vsapi->getWritePtr(dst, plane), static_cast<unsigned>(frames.size()), weights[0], d->scale, chroma, fi->bitsPerSample, w, h, stride);
+                continue;
+            }
+
             decltype(&vs_average_plane_byte_luma_c) func = nullptr;
             bool chroma = (plane == 1 || plane == 2) && fi->colorFamily == cfYUV;
+            bool isFloat = (fi->sampleType == stFloat);
 
+            if (isFloat && fi->bytesPerSample == 2) {
 #ifdef VS_TARGET_CPU_X86
-            if (vs_get_cpulevel(core) >= VS_CPU_LEVEL_SSE2) {
+                if (getCPUFeatures()->avx2 && getCPUFeatures()->f16c && vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_AVERAGE) >= VS_CPU_LEVEL_AVX2)
+                    func = vs_average_plane_half_avx2;
+                else
+#endif
+                    func = vs_average_plane_half_c;
+            }
+
+#ifdef VS_TARGET_CPU_X86
+            if (!func && getCPUFeatures()->avx512_bw && getCPUFeatures()->avx512_vl && vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_AVERAGE) >= VS_CPU_LEVEL_AVX512) {
+                if (fi->bytesPerSample == 1)
+                    func = chroma ? vs_average_plane_byte_chroma_avx512 : vs_average_plane_byte_luma_avx512;
+                else if (fi->bytesPerSample == 2)
+                    func = chroma ? vs_average_plane_word_chroma_avx512 : vs_average_plane_word_luma_avx512;
+                else
+                    func = vs_average_plane_float_avx512;
+            }
+            if (!func && getCPUFeatures()->avx2 && vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_AVERAGE) >= VS_CPU_LEVEL_AVX2) {
+                if (fi->bytesPerSample == 1)
+                    func = chroma ? vs_average_plane_byte_chroma_avx2 : vs_average_plane_byte_luma_avx2;
+                else if (fi->bytesPerSample == 2)
+                    func = chroma ? vs_average_plane_word_chroma_avx2 : vs_average_plane_word_luma_avx2;
+                else
+                    func = vs_average_plane_float_avx2;
+            }
+            if (!func && vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_AVERAGE) >= VS_CPU_LEVEL_SSE2) {
                 if (fi->bytesPerSample == 1)
                     func = chroma ? vs_average_plane_byte_chroma_sse2 : vs_average_plane_byte_luma_sse2;
                 else if (fi->bytesPerSample == 2)
@@ -182,8 +328,8 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
             }
 
             const void *src_ptrs[32];
-            const void *weights_ptr = (fi->bytesPerSample == 1 || fi->bytesPerSample == 2) ? (const void *)weights.data() : fweights.data();
-            const void *scale_ptr = (fi->bytesPerSample == 1 || fi->bytesPerSample == 2) ? (const void *)&d->scale : &d->fscale;
+            const void *weights_ptr = isFloat ? (const void *)fweights.data() : weights.data();
+            const void *scale_ptr = isFloat ? (const void *)&d->fscale : &d->scale;
 
             for (unsigned n = 0; n < frames.size(); ++n) {
                 src_ptrs[n] = vsapi->getReadPtr(frames[n], plane);
@@ -193,8 +339,13 @@ static const VSFrame *VS_CC averageFramesGetFrame(int n, int activationReason, v
                 vsapi->getFrameWidth(dst, plane), vsapi->getFrameHeight(dst, plane), vsapi->getStride(dst, plane));
         }
 
+        if (slidingGuard.owns_lock())
+            d->slidingFrame = n;
+        slidingGuard = std::unique_lock<std::mutex>();
+
         for (auto iter : frames)
             vsapi->freeFrame(iter);
+        vsapi->freeFrame(outgoing);
 
         return dst;
     }
@@ -228,8 +379,8 @@ static void VS_CC averageFramesCreate(const VSMap *in, VSMap *out, void *userDat
             d->nodes.push_back(vsapi->mapGetNode(in, "clips", i, 0));
 
         d->vi = *vsapi->getVideoInfo(d->nodes[0]);
-        if (!is8to16orFloatFormat(d->vi.format))
-            throw std::runtime_error("clips must be constant format and of integer 8-16 bit type or 32 bit float");
+        if (!is8to16orHalfOrFloatFormat(d->vi.format))
+            throw std::runtime_error("clips must be constant format and of integer 8-16 bit type or 16/32 bit float");
 
         for (auto iter : d->nodes) {
             const VSVideoInfo *vi = vsapi->getVideoInfo(iter);
@@ -276,6 +427,12 @@ static void VS_CC averageFramesCreate(const VSMap *in, VSMap *out, void *userDat
 
         getPlanesArg(in, d->process, vsapi);
 
+        // Exact integer sums only, float would accumulate rounding errors as frames enter and leave
+        d->sliding = (numNodes == 1 && numWeights >= slidingMinWeights && d->vi.format.sampleType == stInteger && !d->useSceneChange && d->weights[0] > 0 &&
+            std::all_of(d->weights.begin(), d->weights.end(), [&](int w) { return w == d->weights[0]; }));
+        d->slidingFrame = -1;
+        d->window = (numNodes == 1) ? vsapi->attachFrameWindow(d->nodes[0], numWeights / 2) : nullptr;
+
     } catch (const std::runtime_error &e) {
         for (auto iter : d->nodes)
             vsapi->freeNode(iter);
@@ -290,8 +447,11 @@ static void VS_CC averageFramesCreate(const VSMap *in, VSMap *out, void *userDat
         for (int i = 0; i < numNodes; i++)
             deps.push_back({d->nodes[i], (vsapi->getVideoInfo(d->nodes[i])->numFrames >= d->vi.numFrames) ? rpStrictSpatial : rpGeneral});
     }
-    vsapi->createVideoFilter(out, "AverageFrames", &d->vi, averageFramesGetFrame, filterFree<AverageFrameData>, fmParallel, deps.data(), numNodes, d.get(), core);
+    int radius = (numNodes == 1) ? numWeights / 2 : 0;
+    VSNode *node = vsapi->createVideoFilter2("AverageFrames", &d->vi, averageFramesGetFrame, averageFramesFree, fmParallel, deps.data(), numNodes, d.get(), core);
     d.release();
+    vsapi->setFilterHints(node, fcModerate, radius, 0);
+    vsapi->mapConsumeNode(out, "clip", node, maAppend);
 }
 
 } // namespace
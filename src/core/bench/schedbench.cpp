@@ -0,0 +1,420 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+// Builds synthetic graphs out of core filters and renders them at several thread counts to put a
+// reproducible load on the scheduler. Every run gets a new core so caches and pools start out
+// empty. The frames are small by default so the time goes into scheduling rather than pixels.
+//
+// Thread time outside of filters is the thread count times the wall clock time minus the time
+// spent in getframe functions, it includes idle threads so it's only a pure scheduler overhead
+// when the utilization is close to 100%.
+//
+// With --calibrate the thread count that renders all graphs the fastest is printed as a Threads
+// setting for calibration.conf, together with a MaxCacheSize that fits a 1080p temporal graph
+// rendered with that many threads.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "VapourSynth4.h"
+#include "VSHelper4.h"
+
+namespace {
+
+struct Options {
+    std::vector<std::string> graphs;
+    std::vector<int> threads;
+    int width = 320;
+    int height = 240;
+    int frames = 1000;
+    int warmup = 50;
+    int depth = 64; // length of the chains
+    int fanout = 16;
+    int radius = 10;
+    int requests = 0; // outstanding requests, 0 means twice the number of threads
+    int coreFlags = 0;
+    bool json = false;
+    bool calibrate = false;
+};
+
+struct Result {
+    double seconds;
+    int64_t filterTime;
+    int64_t getFrameCalls;
+    int64_t queueWaitTime;
+    size_t nodes;
+    int64_t framebufferSize;
+};
+
+const VSAPI *vsapi = nullptr;
+
+[[noreturn]] void fail(const std::string &msg) {
+    fprintf(stderr, "%s\n", msg.c_str());
+    exit(1);
+}
+
+// a filter that only passes frames through, used to get nodes of a chosen filter mode between the core filters
+struct PassData {
+    VSNode *node;
+};
+
+const VSFrame *VS_CC passGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    PassData *d = reinterpret_cast<PassData *>(instanceData);
+    if (activationReason == arInitial)
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    else if (activationReason == arAllFramesReady)
+        return vsapi->getFrameFilter(n, d->node, frameCtx);
+    return nullptr;
+}
+
+void VS_CC passFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    PassData *d = reinterpret_cast<PassData *>(instanceData);
+    vsapi->freeNode(d->node);
+    delete d;
+}
+
+VSNode *pass(VSNode *node, int filterMode, VSCore *core) {
+    PassData *d = new PassData{ node };
+    VSFilterDependency deps[] = { { node, rpStrictSpatial } };
+    VSNode *result = vsapi->createVideoFilter2("Pass", vsapi->getVideoInfo(node), passGetFrame, passFree, filterMode, deps, 1, d, core);
+    if (!result)
+        fail("Failed to create a pass through filter");
+    return result;
+}
+
+// invokes a std function with args and returns the clip, args are freed
+VSNode *invoke(const char *name, VSMap *args, VSCore *core) {
+    VSMap *ret = vsapi->invoke(vsapi->getPluginByID(VSH_STD_PLUGIN_ID, core), name, args);
+    vsapi->freeMap(args);
+    if (vsapi->mapGetError(ret))
+        fail(std::string("std.") + name + ": " + vsapi->mapGetError(ret));
+    VSNode *node = vsapi->mapGetNode(ret, "clip", 0, nullptr);
+    vsapi->freeMap(ret);
+    return node;
+}
+
+VSNode *invoke1(const char *name, VSNode *clip, VSCore *core) {
+    VSMap *args = vsapi->createMap();
+    vsapi->mapConsumeNode(args, "clip", clip, maAppend);
+    return invoke(name, args, core);
+}
+
+VSNode *blankClip(const Options &opts, VSCore *core) {
+    VSMap *args = vsapi->createMap();
+    vsapi->mapSetInt(args, "width", opts.width, maAppend);
+    vsapi->mapSetInt(args, "height", opts.height, maAppend);
+    vsapi->mapSetInt(args, "format", pfYUV420P8, maAppend);
+    vsapi->mapSetInt(args, "length", opts.warmup + opts.frames, maAppend);
+    // a new frame every time so BlankClip itself is fmParallel
+    vsapi->mapSetInt(args, "keep", 0, maAppend);
+    return invoke("BlankClip", args, core);
+}
+
+VSNode *buildGraph(const std::string &graph, const Options &opts, VSCore *core) {
+    VSNode *node = blankClip(opts, core);
+
+    if (graph == "chain") {
+        for (int i = 0; i < opts.depth; i++)
+            node = invoke1("Invert", node, core);
+    } else if (graph == "fanout") {
+        VSMap *args = vsapi->createMap();
+        for (int i = 0; i < opts.fanout; i++)
+            vsapi->mapConsumeNode(args, "clips", invoke1("Invert", vsapi->addNodeRef(node), core), maAppend);
+        vsapi->freeNode(node);
+        node = invoke("StackHorizontal", args, core);
+    } else if (graph == "temporal") {
+        for (int i = 0; i < 2; i++) {
+            VSMap *args = vsapi->createMap();
+            vsapi->mapConsumeNode(args, "clips", node, maAppend);
+            for (int j = 0; j < opts.radius * 2 + 1; j++)
+                vsapi->mapSetFloat(args, "weights", 1, maAppend);
+            node = invoke("AverageFrames", args, core);
+        }
+    } else if (graph == "mixed") {
+        // fmUnordered nodes serialize everything that goes through them while the Inverts run in parallel
+        for (int i = 0; i < opts.depth; i++)
+            node = (i % 2) ? pass(node, fmUnordered, core) : invoke1("Invert", node, core);
+    } else {
+        vsapi->freeNode(node);
+        fail("Unknown graph: " + graph);
+    }
+
+    return node;
+}
+
+void collectNodes(VSNode *node, std::set<VSNode *> &nodes) {
+    if (!nodes.insert(node).second)
+        return;
+    const VSFilterDependency *deps = vsapi->getNodeDependencies(node);
+    int numDeps = vsapi->getNumNodeDependencies(node);
+    for (int i = 0; i < numDeps; i++)
+        collectNodes(deps[i].source, nodes);
+}
+
+void sumStats(const std::set<VSNode *> &nodes, Result &r, int sign) {
+    for (VSNode *node : nodes) {
+        VSNodeStats stats;
+        vsapi->getNodeStats(node, &stats);
+        r.filterTime += sign * vsapi->getNodeFilterTime(node);
+        r.getFrameCalls += sign * stats.getFrameCalls;
+        r.queueWaitTime += sign * stats.queueWaitTime;
+    }
+}
+
+struct Renderer {
+    VSNode *node;
+    int next;
+    int end;
+    int outstanding = 0;
+    std::string error;
+    std::mutex lock;
+    std::condition_variable done;
+
+    // requests the frames in [start, end) with up to requests of them in flight
+    void render(int start, int end, int requests) {
+        std::unique_lock<std::mutex> l(lock);
+        next = start;
+        this->end = end;
+        while (next < end && outstanding < requests) {
+            outstanding++;
+            vsapi->getFrameAsync(next++, node, callback, this);
+        }
+        done.wait(l, [this] { return outstanding == 0; });
+        if (!error.empty())
+            fail(error);
+    }
+
+    static void VS_CC callback(void *userData, const VSFrame *f, int n, VSNode *node, const char *errorMsg) {
+        Renderer *r = reinterpret_cast<Renderer *>(userData);
+        vsapi->freeFrame(f);
+        std::lock_guard<std::mutex> l(r->lock);
+        if (!f && r->error.empty())
+            r->error = std::string("Failed to get frame ") + std::to_string(n) + ": " + (errorMsg ? errorMsg : "");
+        if (r->next < r->end && r->error.empty())
+            vsapi->getFrameAsync(r->next++, r->node, callback, r);
+        else
+            r->outstanding--;
+        if (!r->outstanding)
+            r->done.notify_all();
+    }
+};
+
+Result run(const std::string &graph, int threads, const Options &opts) {
+    VSCore *core = vsapi->createCore(opts.coreFlags | ccfEnableGraphInspection);
+    vsapi->setThreadCount(threads, core);
+
+    Renderer renderer;
+    renderer.node = buildGraph(graph, opts, core);
+    int requests = opts.requests > 0 ? opts.requests : threads * 2;
+
+    std::set<VSNode *> nodes;
+    collectNodes(renderer.node, nodes);
+
+    renderer.render(0, opts.warmup, requests);
+
+    Result r = {};
+    r.nodes = nodes.size();
+    sumStats(nodes, r, -1);
+    auto start = std::chrono::steady_clock::now();
+    renderer.render(opts.warmup, opts.warmup + opts.frames, requests);
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sumStats(nodes, r, 1);
+
+    VSCoreInfo info;
+    vsapi->getCoreInfo(core, &info);
+    r.framebufferSize = info.usedFramebufferSize;
+
+    vsapi->freeNode(renderer.node);
+    vsapi->freeCore(core);
+    return r;
+}
+
+bool parseList(const char *s, std::vector<int> &list) {
+    std::string str = s;
+    size_t pos = 0;
+    while (pos <= str.size()) {
+        size_t comma = str.find(',', pos);
+        if (comma == std::string::npos)
+            comma = str.size();
+        int v = atoi(str.substr(pos, comma - pos).c_str());
+        if (v < 1)
+            return false;
+        list.push_back(v);
+        pos = comma + 1;
+    }
+    return !list.empty();
+}
+
+void printHelp() {
+    fprintf(stderr,
+        "Usage: schedbench [options]\n"
+        "Options:\n"
+        "  -g, --graph NAME         Graph to run out of chain, fanout, temporal and mixed, can be given several times, default all\n"
+        "  -t, --threads N[,N...]   Thread counts to run, default powers of two up to the number of logical cpus\n"
+        "  -f, --frames N           Frames measured after the warm-up, default 1000\n"
+        "  -w, --warmup N           Frames rendered before measuring, default 50\n"
+        "  -s, --size WxH           Frame size, default 320x240\n"
+        "      --depth N            Length of the chain and mixed graphs, default 64\n"
+        "      --fanout N           Number of branches in the fanout graph, default 16\n"
+        "      --radius N           Radius of the two AverageFrames in the temporal graph, at most 15, default 10\n"
+        "  -r, --requests N         Frames requested at the same time, default twice the thread count\n"
+        "      --core-flags N       Additional VSCoreCreationFlags for the cores, such as ccfNumaAware\n"
+        "  -j, --json               Print the results as JSON\n"
+        "      --calibrate          Print the fastest thread count and a cache size as settings for calibration.conf\n"
+        "  -h, --help               Show this help\n");
+}
+
+// picks the thread count with the highest geometric mean fps over the graphs and a cache that holds
+// what a 1080p temporal graph needs at that thread count four times over
+void calibrate(Options &opts) {
+    int bestThreads = 0;
+    double bestScore = 0;
+    for (int threads : opts.threads) {
+        double logSum = 0;
+        for (const std::string &graph : opts.graphs)
+            logSum += std::log(opts.frames / run(graph, threads, opts).seconds);
+        double score = std::exp(logSum / opts.graphs.size());
+        fprintf(stderr, "%d threads: %.2f fps\n", threads, score);
+        // more threads have to be clearly faster since they also cost memory
+        if (!bestThreads || score > bestScore * 1.02) {
+            bestThreads = threads;
+            bestScore = score;
+        }
+    }
+
+    opts.width = 1920;
+    opts.height = 1080;
+    opts.frames = std::min(opts.frames, 200);
+    Result r = run("temporal", bestThreads, opts);
+
+    const int64_t defaultCacheSize = (sizeof(void *) >= 8) ? 4096 : 1024;
+    int64_t cacheSize = (r.framebufferSize * 4 + (256 << 20) - 1) / (256 << 20) * 256;
+
+    printf("Threads=%d\n", bestThreads);
+    printf("MaxCacheSize=%" PRId64 "\n", std::max(cacheSize, defaultCacheSize));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options opts;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if ((arg == "-g" || arg == "--graph") && hasValue) {
+            opts.graphs.push_back(argv[++i]);
+        } else if ((arg == "-t" || arg == "--threads") && hasValue) {
+            if (!parseList(argv[++i], opts.threads))
+                fail(std::string("Invalid thread counts: ") + argv[i]);
+        } else if ((arg == "-f" || arg == "--frames") && hasValue) {
+            opts.frames = atoi(argv[++i]);
+        } else if ((arg == "-w" || arg == "--warmup") && hasValue) {
+            opts.warmup = atoi(argv[++i]);
+        } else if ((arg == "-s" || arg == "--size") && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &opts.width, &opts.height) != 2 || opts.width < 16 || opts.height < 16)
+                fail(std::string("Invalid size: ") + argv[i]);
+        } else if (arg == "--depth" && hasValue) {
+            opts.depth = atoi(argv[++i]);
+        } else if (arg == "--fanout" && hasValue) {
+            opts.fanout = atoi(argv[++i]);
+        } else if (arg == "--radius" && hasValue) {
+            opts.radius = atoi(argv[++i]);
+        } else if ((arg == "-r" || arg == "--requests") && hasValue) {
+            opts.requests = atoi(argv[++i]);
+        } else if (arg == "--core-flags" && hasValue) {
+            opts.coreFlags = atoi(argv[++i]);
+        } else if (arg == "-j" || arg == "--json") {
+            opts.json = true;
+        } else if (arg == "--calibrate") {
+            opts.calibrate = true;
+        } else if (arg == "-h" || arg == "--help") {
+            printHelp();
+            return 0;
+        } else {
+            printHelp();
+            fail("Unknown argument: " + arg);
+        }
+    }
+
+    if (opts.frames < 1 || opts.warmup < 0 || opts.depth < 1 || opts.fanout < 1 || opts.radius < 0 || opts.radius > 15)
+        fail("Invalid frames, warmup, depth, fanout or radius");
+
+    if (opts.graphs.empty())
+        opts.graphs = { "chain", "fanout", "temporal", "mixed" };
+
+    if (opts.threads.empty()) {
+        int cpus = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        for (int t = 1; t < cpus; t *= 2)
+            opts.threads.push_back(t);
+        opts.threads.push_back(cpus);
+    }
+
+    vsapi = getVapourSynthAPI(VAPOURSYNTH_API_VERSION);
+    if (!vsapi)
+        fail("Failed to initialize VapourSynth");
+
+    if (opts.calibrate) {
+        calibrate(opts);
+        return 0;
+    }
+
+    bool first = true;
+    if (opts.json)
+        printf("{\n  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %d,\n  \"results\": [", opts.width, opts.height, opts.frames);
+    else
+        printf("%-10s %7s %6s %10s %12s %12s %12s\n", "graph", "threads", "nodes", "fps", "utilization", "outside ns", "queue ns");
+
+    for (const std::string &graph : opts.graphs) {
+        for (int threads : opts.threads) {
+            Result r = run(graph, threads, opts);
+            double fps = opts.frames / r.seconds;
+            double threadTime = r.seconds * threads * 1e9;
+            double utilization = std::min(1.0, r.filterTime / threadTime);
+            double calls = static_cast<double>(std::max<int64_t>(1, r.getFrameCalls));
+            double outsidePerCall = std::max(0.0, threadTime - r.filterTime) / calls;
+            double queuePerCall = r.queueWaitTime / calls;
+
+            if (opts.json) {
+                printf("%s\n    { \"graph\": \"%s\", \"threads\": %d, \"nodes\": %zu, \"seconds\": %.6f, \"fps\": %.3f, \"getframe_calls\": %" PRId64 ", \"utilization\": %.4f, \"outside_filter_ns_per_call\": %.1f, \"queue_wait_ns_per_call\": %.1f }",
+                    first ? "" : ",", graph.c_str(), threads, r.nodes, r.seconds, fps, r.getFrameCalls, utilization, outsidePerCall, queuePerCall);
+                first = false;
+            } else {
+                printf("%-10s %7d %6zu %10.2f %11.1f%% %12.0f %12.0f\n", graph.c_str(), threads, r.nodes, fps, utilization * 100, outsidePerCall, queuePerCall);
+            }
+            fflush(stdout);
+        }
+    }
+
+    if (opts.json)
+        printf("\n  ]\n}\n");
+
+    return 0;
+}
@@ -20,6 +20,7 @@
 
 #include <memory>
 #include <algorithm>
+#include <climits>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -36,201 +37,243 @@ std::string operator""_s(const char *str, size_t len) { return{ str, len }; }
 
 struct BoxBlurData {
     VSNode *node;
-    int radius, passes;
+    int hradius, hpasses, vradius, vpasses;
 };
 
+// rows is the number of rows blurred together by the horizontal passes, their running sums are kept in adjacent lanes
 template<typename T>
-static void blurH(const T * VS_RESTRICT src, T * VS_RESTRICT dst, const int width, const int radius, const unsigned div, const unsigned round) {
-    unsigned acc = radius * src[0];
-    for (int x = 0; x < radius; x++)
-        acc += src[std::min(x, width - 1)];
-
-    for (int x = 0; x < std::min(radius, width); x++) {
-        acc += src[std::min(x + radius, width - 1)];
-        dst[x] = (acc + round) / div;
-        acc -= src[std::max(x - radius, 0)];
+struct BoxBlurTraits {
+    typedef uint32_t acc_type;
+    static const int rows = 16 / sizeof(T);
+};
+
+template<>
+struct BoxBlurTraits<float> {
+    typedef float acc_type;
+    static const int rows = 8;
+};
+
+// Computes (acc + round) / div exactly without a division per sample. The float estimate
+// is off by at most one since the quotient never exceeds 16 bits, the remainder corrects it.
+template<typename T>
+struct BoxBlurDiv {
+    uint32_t div;
+    uint32_t round;
+    float inv2;
+
+    BoxBlurDiv(int radius, int pass) : div(radius * 2 + 1), round((pass & 1) ? 0 : radius * 2), inv2(2.0f / (radius * 2 + 1)) {}
+
+    T operator()(uint32_t acc) const {
+        uint32_t n = acc + round;
+        uint32_t q = static_cast<uint32_t>(static_cast<int32_t>(static_cast<float>(static_cast<int32_t>(n >> 1)) * inv2));
+        int32_t r = static_cast<int32_t>(n - q * div);
+        q += (r >= static_cast<int32_t>(div));
+        q -= (r < 0);
+        return static_cast<T>(q);
     }
+};
 
-    if (width > radius) {
-        for (int x = radius; x < width - radius; x++) {
-            acc += src[x + radius];
-            dst[x] = (acc + round) / div;
-            acc -= src[x - radius];
-        }
+template<>
+struct BoxBlurDiv<float> {
+    float div;
 
-        for (int x = std::max(width - radius, radius); x < width; x++) {
-            acc += src[std::min(x + radius, width - 1)];
-            dst[x] = (acc + round) / div;
-            acc -= src[std::max(x - radius, 0)];
-        }
+    BoxBlurDiv(int radius, int pass) : div(1.0f / (radius * 2 + 1)) {}
+
+    float operator()(float acc) const {
+        return acc * div;
     }
-}
+};
 
-template<typename T>
-static void processPlane(const uint8_t *src, uint8_t *dst, ptrdiff_t stride, int width, int height, int passes, int radius, uint8_t *tmp) {
-    const unsigned div = radius * 2 + 1;
-    const unsigned round = div - 1;
-    for (int h = 0; h < height; h++) {
-        uint8_t *dst1 = (passes & 1) ? dst : tmp;
-        uint8_t *dst2 = (passes & 1) ? tmp : dst;
-        blurH(reinterpret_cast<const T *>(src), reinterpret_cast<T *>(dst1), width, radius, div, round);
-        for (int p = 1; p < passes; p++) {
-            blurH(reinterpret_cast<const T *>(dst1), reinterpret_cast<T *>(dst2), width, radius, div, (p & 1) ? 0 : round);
-            std::swap(dst1, dst2);
-        }
-        src += stride;
-        dst += stride;
+// One step of the running sums for n independent lanes, the lanes are columns for the
+// vertical passes and interleaved rows for the horizontal ones
+template<typename T, typename Acc, typename Div>
+static inline void boxBlurAddStore(Acc * VS_RESTRICT acc, const T * VS_RESTRICT add, T * VS_RESTRICT dst, int n, const Div &div) {
+    for (int i = 0; i < n; i++) {
+        acc[i] += add[i];
+        dst[i] = div(acc[i]);
     }
 }
 
+template<typename T, typename Acc>
+static inline void boxBlurAdd(Acc * VS_RESTRICT acc, const T * VS_RESTRICT add, int n) {
+    for (int i = 0; i < n; i++)
+        acc[i] += add[i];
+}
+
+template<typename T, typename Acc>
+static inline void boxBlurSub(Acc * VS_RESTRICT acc, const T * VS_RESTRICT sub, int n) {
+    for (int i = 0; i < n; i++)
+        acc[i] -= sub[i];
+}
+
+// All passes in both directions for one plane. The vertical passes work on whole rows with one
+// running sum per column and are chained through ring buffers of 2 * radius + 2 rows, so only the
+// final pass writes a full plane. The horizontal result feeds the first vertical pass the same way.
 template<typename T>
-static void blurHF(const T * VS_RESTRICT src, T * VS_RESTRICT dst, const int width, const int radius, const T div) {
-    T acc = radius * src[0];
-    for (int x = 0; x < radius; x++)
-        acc += src[std::min(x, width - 1)];
-
-    for (int x = 0; x < std::min(radius, width); x++) {
-        acc += src[std::min(x + radius, width - 1)];
-        dst[x] = acc * div;
-        acc -= src[std::max(x - radius, 0)];
+class BoxBlurPlane {
+    typedef typename BoxBlurTraits<T>::acc_type Acc;
+    static const int L = BoxBlurTraits<T>::rows;
+
+    const uint8_t *srcp;
+    uint8_t *dstp;
+    ptrdiff_t srcStride;
+    ptrdiff_t dstStride;
+    int width;
+    int height;
+    const BoxBlurData *d;
+
+    std::vector<T> lineA;
+    std::vector<T> lineB;
+    std::vector<T> hring;
+    int hcap;
+    int hnext;
+
+    std::vector<std::vector<T>> vring;
+    std::vector<std::vector<Acc>> vacc;
+    std::vector<int> vcap;
+    std::vector<int> vnext;
+
+    const T *srcRow(int y) const {
+        return reinterpret_cast<const T *>(srcp + y * srcStride);
     }
 
-    if (width > radius) {
-        for (int x = radius; x < width - radius; x++) {
-            acc += src[x + radius];
-            dst[x] = acc * div;
-            acc -= src[x - radius];
-        }
+    T *dstRow(int y) const {
+        return reinterpret_cast<T *>(dstp + y * dstStride);
+    }
+
+    void blurRowsH(const T * const *rows, T * const *out, int count) {
+        const int radius = d->hradius;
+        T *in = lineA.data();
+        T *res = lineB.data();
+
+        const T *lanes[L];
+        for (int l = 0; l < L; l++)
+            lanes[l] = rows[std::min(l, count - 1)];
+
+        for (int x = 0; x < width; x++)
+            for (int l = 0; l < L; l++)
+                in[x * L + l] = lanes[l][x];
+
+        for (int p = 0; p < d->hpasses; p++) {
+            BoxBlurDiv<T> div(radius, p);
+            Acc acc[L];
 
-        for (int x = std::max(width - radius, radius); x < width; x++) {
-            acc += src[std::min(x + radius, width - 1)];
-            dst[x] = acc * div;
-            acc -= src[std::max(x - radius, 0)];
+            for (int l = 0; l < L; l++)
+                acc[l] = radius * static_cast<Acc>(in[l]);
+            for (int x = 0; x < radius; x++)
+                boxBlurAdd(acc, in + std::min(x, width - 1) * L, L);
+
+            for (int x = 0; x < width; x++) {
+                boxBlurAddStore(acc, in + std::min(x + radius, width - 1) * L, res + x * L, L, div);
+                boxBlurSub(acc, in + std::max(x - radius, 0) * L, L);
+            }
+
+            std::swap(in, res);
         }
+
+        for (int l = 0; l < count; l++)
+            for (int x = 0; x < width; x++)
+                out[l][x] = in[x * L + l];
     }
-}
 
-template<typename T>
-static void processPlaneF(const uint8_t *src, uint8_t *dst, ptrdiff_t stride, int width, int height, int passes, int radius, uint8_t *tmp) {
-    const T div = static_cast<T>(1) / (radius * 2 + 1);
-    for (int h = 0; h < height; h++) {
-        uint8_t *dst1 = (passes & 1) ? dst : tmp;
-        uint8_t *dst2 = (passes & 1) ? tmp : dst;
-        blurHF(reinterpret_cast<const T *>(src), reinterpret_cast<T *>(dst1), width, radius, div);
-        for (int p = 1; p < passes; p++) {
-            blurHF(reinterpret_cast<const T *>(dst1), reinterpret_cast<T *>(dst2), width, radius, div);
-            std::swap(dst1, dst2);
+    // Row y of the input to vertical pass s, stage 0 is the horizontally blurred or unchanged source
+    const T *stageRow(int s, int y) {
+        if (s == 0) {
+            if (d->hpasses <= 0 || d->hradius <= 0)
+                return srcRow(y);
+
+            while (hnext <= y) {
+                const T *rows[L];
+                T *out[L];
+                int count = std::min(height - hnext, static_cast<int>(L));
+                for (int l = 0; l < count; l++) {
+                    rows[l] = srcRow(hnext + l);
+                    out[l] = hring.data() + static_cast<size_t>((hnext + l) % hcap) * width;
+                }
+                blurRowsH(rows, out, count);
+                hnext += count;
+            }
+            return hring.data() + static_cast<size_t>(y % hcap) * width;
         }
-        src += stride;
-        dst += stride;
-    }
-}
 
-template<typename T>
-static void blurHR1(const T *src, T *dst, int width, const unsigned round) {
-    unsigned tmp[2] = { src[0], src[1] };
-    unsigned acc = tmp[0] * 2 + tmp[1];
-    dst[0] = (acc + round) / 3;
-    acc -= tmp[0];
-
-    unsigned v = src[2];
-    acc += v;
-    dst[1] = (acc + round) / 3;
-    acc -= tmp[0];
-    tmp[0] = v;
-
-    for (int x = 2; x < width - 2; x += 2) {
-        v = src[x + 1];
-        acc += v;
-        dst[x] = (acc + round) / 3;
-        acc -= tmp[1];
-        tmp[1] = v;
-
-        v = src[x + 2];
-        acc += v;
-        dst[x + 1] = (acc + round) / 3;
-        acc -= tmp[0];
-        tmp[0] = v;
+        while (vnext[s - 1] <= y)
+            stepV(s - 1);
+        return stageOut(s - 1, y);
     }
 
-    if (width & 1) {
-        acc += tmp[0];
-        dst[width - 1] = (acc + round) / 3;
-    } else {
-        v = src[width - 1];
-        acc += v;
-        dst[width - 2] = (acc + round) / 3;
-        acc -= tmp[1];
-
-        acc += v;
-        dst[width - 1] = (acc + round) / 3;
+    T *stageOut(int p, int y) {
+        if (p == d->vpasses - 1)
+            return dstRow(y);
+        return vring[p].data() + static_cast<size_t>(y % vcap[p]) * width;
     }
-}
 
-template<typename T>
-static void processPlaneR1(const uint8_t *src, uint8_t *dst, ptrdiff_t stride, int width, int height, int passes) {
-    for (int h = 0; h < height; h++) {
-        blurHR1(reinterpret_cast<const T *>(src), reinterpret_cast<T *>(dst), width, 2);
-        for (int p = 1; p < passes; p++)
-            blurHR1(reinterpret_cast<const T *>(dst), reinterpret_cast<T *>(dst), width, (p & 1) ? 0 : 2);
-        src += stride;
-        dst += stride;
-    }
-}
+    void stepV(int p) {
+        const int radius = d->vradius;
+        const int y = vnext[p];
+        Acc *acc = vacc[p].data();
+        BoxBlurDiv<T> div(radius, p);
+
+        if (y == 0) {
+            const T *v = stageRow(p, 0);
+            for (int x = 0; x < width; x++)
+                acc[x] = radius * static_cast<Acc>(v[x]);
+            for (int k = 0; k < radius; k++)
+                boxBlurAdd(acc, stageRow(p, std::min(k, height - 1)), width);
+        }
 
-template<typename T>
-static void blurHR1F(const T *src, T *dst, int width) {
-    T tmp[2] = { src[0], src[1] };
-    T acc = tmp[0] * 2 + tmp[1];
-    const T div = static_cast<T>(1) / 3;
-    dst[0] = acc * div;
-    acc -= tmp[0];
-
-    T v = src[2];
-    acc += v;
-    dst[1] = acc * div;
-    acc -= tmp[0];
-    tmp[0] = v;
-
-    for (int x = 2; x < width - 2; x += 2) {
-        v = src[x + 1];
-        acc += v;
-        dst[x] = acc * div;
-        acc -= tmp[1];
-        tmp[1] = v;
-
-        v = src[x + 2];
-        acc += v;
-        dst[x + 1] = acc * div;
-        acc -= tmp[0];
-        tmp[0] = v;
-    }
+        const T *add = stageRow(p, std::min(y + radius, height - 1));
+        boxBlurAddStore(acc, add, stageOut(p, y), width, div);
+        boxBlurSub(acc, stageRow(p, std::max(y - radius, 0)), width);
 
-    if (width & 1) {
-        acc += tmp[0];
-        dst[width - 1] = acc * div;
+        vnext[p]++;
     }
-    else {
-        v = src[width - 1];
-        acc += v;
-        dst[width - 2] = acc * div;
-        acc -= tmp[1];
-
-        acc += v;
-        dst[width - 1] = acc * div;
+
+public:
+    BoxBlurPlane(const uint8_t *srcp, ptrdiff_t srcStride, uint8_t *dstp, ptrdiff_t dstStride, int width, int height, const BoxBlurData *d) :
+        srcp(srcp), dstp(dstp), srcStride(srcStride), dstStride(dstStride), width(width), height(height), d(d), hcap(0), hnext(0) {
     }
-}
 
-template<typename T>
-static void processPlaneR1F(const uint8_t *src, uint8_t *dst, ptrdiff_t stride, int width, int height, int passes) {
-    for (int h = 0; h < height; h++) {
-        blurHR1F(reinterpret_cast<const T *>(src), reinterpret_cast<T *>(dst), width);
-        for (int p = 1; p < passes; p++)
-            blurHR1F(reinterpret_cast<const T *>(dst), reinterpret_cast<T *>(dst), width);
-        src += stride;
-        dst += stride;
+    void process() {
+        bool hblur = (d->hradius > 0) && (d->hpasses > 0);
+        bool vblur = (d->vradius > 0) && (d->vpasses > 0);
+
+        if (hblur) {
+            lineA.resize(static_cast<size_t>(width) * L);
+            lineB.resize(static_cast<size_t>(width) * L);
+        }
+
+        if (!vblur) {
+            for (int y = 0; y < height; y += L) {
+                const T *rows[L];
+                T *out[L];
+                int count = std::min(height - y, static_cast<int>(L));
+                for (int l = 0; l < count; l++) {
+                    rows[l] = srcRow(y + l);
+                    out[l] = dstRow(y + l);
+                }
+                blurRowsH(rows, out, count);
+            }
+            return;
+        }
+
+        if (hblur) {
+            hcap = std::min(2 * d->vradius + static_cast<int>(L) + 1, height);
+            hring.resize(static_cast<size_t>(hcap) * width);
+        }
+
+        vring.resize(d->vpasses - 1);
+        vcap.resize(d->vpasses - 1);
+        for (int p = 0; p < d->vpasses - 1; p++) {
+            vcap[p] = std::min(2 * d->vradius + 2, height);
+            vring[p].resize(static_cast<size_t>(vcap[p]) * width);
+        }
+        vacc.resize(d->vpasses, std::vector<Acc>(width));
+        vnext.resize(d->vpasses, 0);
+
+        while (vnext[d->vpasses - 1] < height)
+            stepV(d->vpasses - 1);
     }
-}
+};
 
 static const VSFrame *VS_CC boxBlurGetframe(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     BoxBlurData *d = reinterpret_cast<BoxBlurData *>(instanceData);
@@ -242,8 +285,6 @@ static const VSFrame *VS_CC boxBlurGetframe(int n, int activationReason, void *i
         const VSVideoFormat *fi = vsapi->getVideoFrameFormat(src);
         VSFrame *dst = vsapi->newVideoFrame(fi, vsapi->getFrameWidth(src, 0), vsapi->getFrameHeight(src, 0), src, core);
         int bytesPerSample = fi->bytesPerSample;
-        int radius = d->radius;
-        uint8_t *tmp = (radius > 1 && d->passes > 1) ? new uint8_t[bytesPerSample * vsapi->getFrameWidth(src, 0)] : nullptr;
 
         const uint8_t *srcp = vsapi->getReadPtr(src, 0);
         ptrdiff_t stride = vsapi->getStride(src, 0);
@@ -251,23 +292,12 @@ static const VSFrame *VS_CC boxBlurGetframe(int n, int activationReason, void *i
         int h = vsapi->getFrameHeight(src, 0);
         int w = vsapi->getFrameWidth(src, 0);
 
-        if (radius == 1) {
-            if (bytesPerSample == 1)
-                processPlaneR1<uint8_t>(srcp, dstp, stride, w, h, d->passes);
-            else if (bytesPerSample == 2)
-                processPlaneR1<uint16_t>(srcp, dstp, stride, w, h, d->passes);
-            else
-                processPlaneR1F<float>(srcp, dstp, stride, w, h, d->passes);
-        } else {
-            if (bytesPerSample == 1)
-                processPlane<uint8_t>(srcp, dstp, stride, w, h, d->passes, radius, tmp);
-            else if (bytesPerSample == 2)
-                processPlane<uint16_t>(srcp, dstp, stride, w, h, d->passes, radius, tmp);
-            else
-                processPlaneF<float>(srcp, dstp, stride, w, h, d->passes, radius, tmp);
-        }
-
-        delete[] tmp;
+        if (bytesPerSample == 1)
+            BoxBlurPlane<uint8_t>(srcp, stride, dstp, stride, w, h, d).process();
+        else if (bytesPerSample == 2)
+            BoxBlurPlane<uint16_t>(srcp, stride, dstp, stride, w, h, d).process();
+        else
+            BoxBlurPlane<float>(srcp, stride, dstp, stride, w, h, d).process();
 
         vsapi->freeFrame(src);
         return dst;
@@ -276,6 +306,15 @@ static const VSFrame *VS_CC boxBlurGetframe(int n, int activationReason, void *i
     return nullptr;
 }
 
+static void VS_CC boxBlurStripe(int plane, const uint8_t *srcp, ptrdiff_t srcStride, uint8_t *dstp, ptrdiff_t dstStride, int width, int height, void *instanceData, const VSAPI *vsapi) {
+    BoxBlurData *d = reinterpret_cast<BoxBlurData *>(instanceData);
+
+    if (vsapi->getVideoInfo(d->node)->format.bytesPerSample == 1)
+        BoxBlurPlane<uint8_t>(srcp, srcStride, dstp, dstStride, width, height, d).process();
+    else
+        BoxBlurPlane<uint16_t>(srcp, srcStride, dstp, dstStride, width, height, d).process();
+}
+
 static void VS_CC boxBlurFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     BoxBlurData *d = reinterpret_cast<BoxBlurData *>(instanceData);
     vsapi->freeNode(d->node);
@@ -283,31 +322,16 @@ static void VS_CC boxBlurFree(void *instanceData, VSCore *core, const VSAPI *vsa
 }
 
 static VSNode *applyBoxBlurPlaneFiltering(VSPlugin *stdplugin, VSNode *node, int hradius, int hpasses, int vradius, int vpasses, VSCore *core, const VSAPI *vsapi) {
-    bool hblur = (hradius > 0) && (hpasses > 0);
-    bool vblur = (vradius > 0) && (vpasses > 0);
-
-    if (hblur) {
-        VSFilterDependency deps[] = {{node, rpStrictSpatial}};
-        node = vsapi->createVideoFilter2("BoxBlur", vsapi->getVideoInfo(node), boxBlurGetframe, boxBlurFree, fmParallel, deps, 1, new BoxBlurData{node, hradius, hpasses}, core);
-    }
-
-    if (vblur) {
-        VSMap *vtmp1 = vsapi->createMap();
-        vsapi->mapConsumeNode(vtmp1, "clip", node, maAppend);
-        VSMap *vtmp2 = vsapi->invoke(stdplugin, "Transpose", vtmp1);
-        vsapi->clearMap(vtmp1);
-        node = vsapi->mapGetNode(vtmp2, "clip", 0, nullptr);
-        vsapi->clearMap(vtmp2);
-        VSFilterDependency deps[] = {{node, rpStrictSpatial}};
-        vsapi->createVideoFilter(vtmp2, "BoxBlur", vsapi->getVideoInfo(node), boxBlurGetframe, boxBlurFree, fmParallel, deps, 1, new BoxBlurData{ node, vradius, vpasses }, core);
-        vsapi->freeMap(vtmp1);
-        vtmp1 = vsapi->invoke(stdplugin, "Transpose", vtmp2);
-        vsapi->freeMap(vtmp2);
-        node = vsapi->mapGetNode(vtmp1, "clip", 0, nullptr);
-        vsapi->freeMap(vtmp1);
-    }
-
-    return node;
+    const VSVideoInfo *vi = vsapi->getVideoInfo(node);
+    VSFilterDependency deps[] = {{node, rpStrictSpatial}};
+    VSNode *out = vsapi->createVideoFilter2("BoxBlur", vi, boxBlurGetframe, boxBlurFree, fmParallel, deps, 1, new BoxBlurData{ node, hradius, hpasses, vradius, vpasses }, core);
+    int64_t radius = std::max(static_cast<int64_t>(hradius) * hpasses, static_cast<int64_t>(vradius) * vpasses);
+    vsapi->setFilterHints(out, fcCheap, 0, static_cast<int>(std::min<int64_t>(radius, INT_MAX)));
+
+    // float running sums depend on where they start so only integer formats can be split into stripes
+    if (vi->format.sampleType == stInteger)
+        vsapi->setFilterStripe(out, boxBlurStripe, static_cast<int>(std::min<int64_t>(static_cast<int64_t>(vradius) * vpasses, INT_MAX)), 1);
+    return out;
 }
 
 static void VS_CC boxBlurCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
@@ -351,6 +375,15 @@ static void VS_CC boxBlurCreate(const VSMap *in, VSMap *out, void *userData, VSC
         if (!hblur && !vblur)
             throw std::runtime_error("nothing to be performed");
 
+        // a reduced proxy clip gets a proportionally smaller blur
+        int proxyScale = vsapi->getNodeProxyScale(node);
+        if (proxyScale > 1) {
+            if (hblur)
+                hradius = std::max((hradius + proxyScale / 2) / proxyScale, 1);
+            if (vblur)
+                vradius = std::max((vradius + proxyScale / 2) / proxyScale, 1);
+        }
+
         VSPlugin *stdplugin = vsapi->getPluginByID(VSH_STD_PLUGIN_ID, core);
 
         if (vi->format.numPlanes == 1) {
@@ -401,4 +434,5 @@ static void VS_CC boxBlurCreate(const VSMap *in, VSMap *out, void *userData, VSC
 
 void boxBlurInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->registerFunction("BoxBlur", "clip:vnode;planes:int[]:opt;hradius:int:opt;hpasses:int:opt;vradius:int:opt;vpasses:int:opt;", "clip:vnode;", boxBlurCreate, 0, plugin);
+    vspapi->setFunctionFlags("BoxBlur", pffDeterministic | pffProxyScalable, plugin);
 }
@@ -22,6 +22,10 @@
 
 #include "cpufeatures.h"
 
+#if !defined(VS_TARGET_CPU_X86) && !defined(_WIN32)
+#include <unistd.h>
+#endif
+
 #ifdef VS_TARGET_CPU_X86
 
 #ifdef _MSC_VER
@@ -30,25 +34,63 @@
 #include <cpuid.h>
 #endif
 
-static void vs_cpu_cpuid(int index, int* eax, int* ebx, int* ecx, int* edx) {
+static void vs_cpu_cpuid_count(int index, int subleaf, int* eax, int* ebx, int* ecx, int* edx) {
     *eax = 0;
     *ebx = 0;
     *ecx = 0;
     *edx = 0;
 #ifdef _MSC_VER
     int regs[4];
-    __cpuidex(regs, index, 0);
+    __cpuidex(regs, index, subleaf);
     *eax = regs[0];
     *ebx = regs[1];
     *ecx = regs[2];
     *edx = regs[3];
 #elif defined(__GNUC__)
-    __cpuid_count(index, 0, *eax, *ebx, *ecx, *edx);
+    __cpuid_count(index, subleaf, *eax, *ebx, *ecx, *edx);
 #else
 #error "Unknown compiler, can't get cpuid"
 #endif
 }
 
+static void vs_cpu_cpuid(int index, int* eax, int* ebx, int* ecx, int* edx) {
+    vs_cpu_cpuid_count(index, 0, eax, ebx, ecx, edx);
+}
+
+// Intel lists every cache in leaf 4, AMD only reports the sizes in the extended leaf 0x80000006
+static void getCacheSizes(CPUFeatures *cpuFeatures) {
+    int eax, ebx, ecx, edx;
+    vs_cpu_cpuid(0, &eax, &ebx, &ecx, &edx);
+    if (eax >= 4) {
+        for (int i = 0; i < 16; i++) {
+            vs_cpu_cpuid_count(4, i, &eax, &ebx, &ecx, &edx);
+            unsigned type = eax & 0x1F;
+            unsigned level = (eax >> 5) & 0x7;
+            if (!type)
+                break;
+            if (type == 2) // instructions
+                continue;
+            unsigned b = static_cast<unsigned>(ebx);
+            size_t size = static_cast<size_t>((b >> 22) + 1) * (((b >> 12) & 0x3FF) + 1) * ((b & 0xFFF) + 1) * (static_cast<unsigned>(ecx) + 1);
+            if (level == 2)
+                cpuFeatures->l2_cache_size = size;
+            else if (level == 3)
+                cpuFeatures->l3_cache_size = size;
+        }
+    }
+
+    if (!cpuFeatures->l2_cache_size || !cpuFeatures->l3_cache_size) {
+        vs_cpu_cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+        if (static_cast<unsigned>(eax) >= 0x80000006) {
+            vs_cpu_cpuid(0x80000006, &eax, &ebx, &ecx, &edx);
+            if (!cpuFeatures->l2_cache_size)
+                cpuFeatures->l2_cache_size = static_cast<size_t>(static_cast<unsigned>(ecx) >> 16) * 1024;
+            if (!cpuFeatures->l3_cache_size)
+                cpuFeatures->l3_cache_size = static_cast<size_t>(static_cast<unsigned>(edx) >> 18) * 512 * 1024;
+        }
+    }
+}
+
 static unsigned long long vs_cpu_xgetbv(unsigned ecx) {
 #if defined(_MSC_VER)
     return _xgetbv(ecx);
@@ -101,11 +143,19 @@ static void doGetCPUFeatures(CPUFeatures *cpuFeatures) {
             }
         }
     }
+
+    getCacheSizes(cpuFeatures);
 }
 #else
 static void doGetCPUFeatures(CPUFeatures *cpuFeatures) {
     memset(cpuFeatures, 0, sizeof(CPUFeatures));
     cpuFeatures->can_run_vs = 1;
+#if defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    cpuFeatures->l2_cache_size = l2 > 0 ? static_cast<size_t>(l2) : 0;
+    cpuFeatures->l3_cache_size = l3 > 0 ? static_cast<size_t>(l3) : 0;
+#endif
 }
 #endif
 
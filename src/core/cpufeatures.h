@@ -21,6 +21,8 @@
 #ifndef CPUFEATURES_H
 #define CPUFEATURES_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -48,6 +50,10 @@ typedef struct CPUFeatures {
     char avx512_dq;
     char avx512_vl;
 #endif
+    // Data cache sizes in bytes, 0 when they couldn't be determined. The L3 size is the one shared
+    // by all cores.
+    size_t l2_cache_size;
+    size_t l3_cache_size;
 } CPUFeatures;
 
 const CPUFeatures *getCPUFeatures(void);
@@ -0,0 +1,693 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+// DiskCache stores the frames of a clip in a memory-mapped file so later runs of the same
+// script (or several vspipe processes at once) can skip recomputing the upstream filters.
+// The file is named after a hash of the upstream graph: every node's creating function,
+// its arguments and video info, walked the same way printgraph.cpp does it.
+// SharedCache uses the same layout in a named shared memory segment instead, it only lives
+// as long as some process has it open and is meant for chunked encodes running side by side.
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "VapourSynth4.h"
+#include "VSHelper4.h"
+#include "filtershared.h"
+#include "internalfilters.h"
+
+#ifdef VS_TARGET_OS_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <winioctl.h>
+#include "../common/vsutf16.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace vsh;
+
+namespace {
+
+//////////////////////////////////////////
+// Graph hashing
+
+struct GraphHash {
+    uint64_t h = 14695981039346656037ULL;
+
+    void add(const void *data, size_t size) {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; i++) {
+            h ^= p[i];
+            h *= 1099511628211ULL;
+        }
+    }
+
+    template<typename T>
+    void add(const T &v) {
+        add(&v, sizeof(v));
+    }
+
+    void add(const char *str) {
+        add(str, strlen(str) + 1);
+    }
+};
+
+static void hashVideoInfo(GraphHash &hash, const VSVideoInfo *vi) {
+    hash.add(vi->format.colorFamily);
+    hash.add(vi->format.sampleType);
+    hash.add(vi->format.bitsPerSample);
+    hash.add(vi->format.subSamplingW);
+    hash.add(vi->format.subSamplingH);
+    hash.add(vi->width);
+    hash.add(vi->height);
+    hash.add(vi->numFrames);
+    hash.add(vi->fpsNum);
+    hash.add(vi->fpsDen);
+}
+
+static void hashMap(GraphHash &hash, const VSMap *args, const VSAPI *vsapi) {
+    int numKeys = vsapi->mapNumKeys(args);
+    hash.add(numKeys);
+    for (int i = 0; i < numKeys; i++) {
+        const char *key = vsapi->mapGetKey(args, i);
+        int type = vsapi->mapGetType(args, key);
+        int numElems = vsapi->mapNumElements(args, key);
+        hash.add(key);
+        hash.add(type);
+        hash.add(numElems);
+
+        for (int j = 0; j < numElems; j++) {
+            switch (type) {
+                case ptInt:
+                    hash.add(vsapi->mapGetInt(args, key, j, nullptr));
+                    break;
+                case ptFloat:
+                    hash.add(vsapi->mapGetFloat(args, key, j, nullptr));
+                    break;
+                case ptData:
+                    hash.add(vsapi->mapGetData(args, key, j, nullptr), vsapi->mapGetDataSize(args, key, j, nullptr));
+                    break;
+                case ptVideoNode: {
+                    // the node itself is covered by walking the dependencies
+                    VSNode *ref = vsapi->mapGetNode(args, key, j, nullptr);
+                    hashVideoInfo(hash, vsapi->getVideoInfo(ref));
+                    vsapi->freeNode(ref);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+// returns false if the graph can't be identified because graph inspection isn't enabled
+static bool hashGraph(GraphHash &hash, VSNode *node, const VSAPI *vsapi) {
+    const char *funcName = vsapi->getNodeCreationFunctionName(node, 0);
+    if (!funcName)
+        return false;
+
+    hash.add(funcName);
+    hash.add(vsapi->getNodeName(node));
+    hash.add(vsapi->getNodeType(node));
+    if (vsapi->getNodeType(node) == mtVideo)
+        hashVideoInfo(hash, vsapi->getVideoInfo(node));
+    hashMap(hash, vsapi->getNodeCreationFunctionArguments(node, 0), vsapi);
+
+    int numDeps = vsapi->getNumNodeDependencies(node);
+    const VSFilterDependency *deps = vsapi->getNodeDependencies(node);
+    hash.add(numDeps);
+    for (int i = 0; i < numDeps; i++)
+        if (!hashGraph(hash, deps[i].source, vsapi))
+            return false;
+    return true;
+}
+
+//////////////////////////////////////////
+// Cache file
+
+// File layout: header, one state word per frame, then fixed size slots holding the
+// serialized frame properties followed by the packed planes of each frame
+struct DiskCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t formatID;
+    uint64_t graphHash;
+    int32_t width;
+    int32_t height;
+    int32_t numFrames;
+    uint32_t propSize;
+    uint64_t frameSize;
+};
+
+static const char diskCacheMagic[8] = { 'V', 'S', 'D', 'C', 'A', 'C', 'H', 'E' };
+static const uint32_t diskCacheVersion = 1;
+
+// per frame state, several processes may map the file at the same time so only whoever
+// manages to move a frame from empty to writing stores it
+enum DiskFrameState : uint32_t {
+    dfsEmpty = 0,
+    dfsWriting = 1,
+    dfsStored = 2,
+    dfsUncacheable = 3 // the properties don't fit, don't bother trying again
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "frame states are shared between processes and must be plain lock-free words");
+
+// Shared memory segments have no file lock to serialize their creation, whoever creates the
+// segment fills in the header and sets ready last, the others wait for it before looking
+struct SharedCacheControl {
+    std::atomic<uint32_t> ready;
+    std::atomic<uint32_t> users; // the last one to leave removes the segment
+};
+
+static const size_t sharedCacheHeaderOffset = 64;
+static_assert(sizeof(SharedCacheControl) <= sharedCacheHeaderOffset, "the control words must fit in front of the header");
+
+class DiskCacheFile {
+private:
+#ifdef VS_TARGET_OS_WINDOWS
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+    std::string shmName;
+#endif
+    uint8_t *base = nullptr;
+    size_t mappedSize = 0;
+    size_t headerOffset = 0;
+    size_t dataOffset = 0;
+    size_t slotSize = 0;
+    bool sharedMemory = false;
+    bool attached = false; // counted as a user of the shared segment
+
+    bool lock(bool exclusive);
+    void unlock();
+    std::string attachShared(const std::string &name, const DiskCacheHeader &header, bool create);
+public:
+    ~DiskCacheFile();
+    std::string open(const std::string &path, const DiskCacheHeader &header);
+    std::string openShared(const std::string &name, const DiskCacheHeader &header);
+    bool commitSlot(int n);
+
+    static size_t getDataOffset(int numFrames, size_t headerOffset) {
+        return (headerOffset + sizeof(DiskCacheHeader) + sizeof(uint32_t) * static_cast<size_t>(numFrames) + 63) & ~static_cast<size_t>(63);
+    }
+
+    SharedCacheControl *control() {
+        return reinterpret_cast<SharedCacheControl *>(base);
+    }
+
+    std::atomic<uint32_t> *states() {
+        return reinterpret_cast<std::atomic<uint32_t> *>(base + headerOffset + sizeof(DiskCacheHeader));
+    }
+
+    uint8_t *slot(int n) {
+        return base + dataOffset + static_cast<size_t>(n) * slotSize;
+    }
+};
+
+// Fills in a segment that was just created or waits for whoever created it to finish and checks that it's the same clip
+std::string DiskCacheFile::attachShared(const std::string &name, const DiskCacheHeader &header, bool create) {
+    SharedCacheControl *ctl = control();
+    if (create) {
+        memcpy(base + headerOffset, &header, sizeof(header));
+        ctl->users.store(1, std::memory_order_relaxed);
+        ctl->ready.store(1, std::memory_order_release);
+        attached = true;
+        return std::string();
+    }
+
+    // a creator that's still setting the segment up is given a few seconds before giving up
+    for (int i = 0; !ctl->ready.load(std::memory_order_acquire); i++) {
+        if (i == 5000)
+            return name + " was never initialized";
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (memcmp(base + headerOffset, &header, sizeof(header)))
+        return name + " doesn't match the clip";
+    ctl->users.fetch_add(1, std::memory_order_acq_rel);
+    attached = true;
+    return std::string();
+}
+
+#ifdef VS_TARGET_OS_WINDOWS
+
+DiskCacheFile::~DiskCacheFile() {
+    if (base)
+        UnmapViewOfFile(base);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+}
+
+bool DiskCacheFile::lock(bool exclusive) {
+    OVERLAPPED ov = {};
+    return !!LockFileEx(file, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, MAXDWORD, MAXDWORD, &ov);
+}
+
+void DiskCacheFile::unlock() {
+    OVERLAPPED ov = {};
+    UnlockFileEx(file, 0, MAXDWORD, MAXDWORD, &ov);
+}
+
+std::string DiskCacheFile::open(const std::string &path, const DiskCacheHeader &header) {
+    dataOffset = getDataOffset(header.numFrames, headerOffset);
+    slotSize = static_cast<size_t>(header.propSize + header.frameSize);
+    size_t totalSize = dataOffset + slotSize * header.numFrames;
+    file = CreateFileW(utf16_from_utf8(path).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return "failed to open " + path;
+    if (!lock(true))
+        return "failed to lock " + path;
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    bool create = (size.QuadPart == 0);
+    if (create) {
+        // most frames will never be written in a partial run, don't allocate disk space for them
+        DWORD returned;
+        DeviceIoControl(file, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr);
+    } else if (static_cast<uint64_t>(size.QuadPart) != totalSize) {
+        unlock();
+        return path + " doesn't match the clip";
+    }
+
+    mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(totalSize) >> 32), static_cast<DWORD>(totalSize), nullptr);
+    if (mapping)
+        base = static_cast<uint8_t *>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, totalSize));
+    if (!base) {
+        unlock();
+        return "failed to map " + path;
+    }
+    mappedSize = totalSize;
+
+    std::string error;
+    if (create)
+        memcpy(base, &header, sizeof(header));
+    else if (memcmp(base, &header, sizeof(header)))
+        error = path + " doesn't match the clip";
+    unlock();
+    return error;
+}
+
+std::string DiskCacheFile::openShared(const std::string &name, const DiskCacheHeader &header) {
+    sharedMemory = true;
+    headerOffset = sharedCacheHeaderOffset;
+    dataOffset = getDataOffset(header.numFrames, headerOffset);
+    slotSize = static_cast<size_t>(header.propSize + header.frameSize);
+    size_t totalSize = dataOffset + slotSize * header.numFrames;
+
+    // the section only reserves the address space, pages are committed as frames get stored and the
+    // section goes away once the last process closes it
+    mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE | SEC_RESERVE, static_cast<DWORD>(static_cast<uint64_t>(totalSize) >> 32), static_cast<DWORD>(totalSize), utf16_from_utf8("Local\\" + name).c_str());
+    if (!mapping)
+        return "failed to create " + name;
+    bool create = (GetLastError() != ERROR_ALREADY_EXISTS);
+
+    base = static_cast<uint8_t *>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, totalSize));
+    if (!base)
+        return name + " doesn't match the clip";
+    mappedSize = totalSize;
+    if (!VirtualAlloc(base, dataOffset, MEM_COMMIT, PAGE_READWRITE))
+        return "failed to commit memory for " + name;
+
+    return attachShared(name, header, create);
+}
+
+bool DiskCacheFile::commitSlot(int n) {
+    return !sharedMemory || VirtualAlloc(slot(n), slotSize, MEM_COMMIT, PAGE_READWRITE);
+}
+
+#else
+
+DiskCacheFile::~DiskCacheFile() {
+    if (attached && control()->users.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        shm_unlink(shmName.c_str());
+    if (base)
+        munmap(base, mappedSize);
+    if (fd >= 0)
+        close(fd);
+}
+
+bool DiskCacheFile::lock(bool exclusive) {
+    return !flock(fd, exclusive ? LOCK_EX : LOCK_SH);
+}
+
+void DiskCacheFile::unlock() {
+    flock(fd, LOCK_UN);
+}
+
+std::string DiskCacheFile::open(const std::string &path, const DiskCacheHeader &header) {
+    dataOffset = getDataOffset(header.numFrames, headerOffset);
+    slotSize = static_cast<size_t>(header.propSize + header.frameSize);
+    size_t totalSize = dataOffset + slotSize * header.numFrames;
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0)
+        return "failed to open " + path;
+    if (!lock(true))
+        return "failed to lock " + path;
+
+    struct stat st;
+    fstat(fd, &st);
+    bool create = (st.st_size == 0);
+    // the file is sparse so only frames that actually get stored take up disk space
+    if (create && ftruncate(fd, totalSize)) {
+        unlock();
+        return "failed to resize " + path;
+    } else if (!create && static_cast<uint64_t>(st.st_size) != totalSize) {
+        unlock();
+        return path + " doesn't match the clip";
+    }
+
+    void *p = mmap(nullptr, totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        unlock();
+        return "failed to map " + path;
+    }
+    base = static_cast<uint8_t *>(p);
+    mappedSize = totalSize;
+
+    std::string error;
+    if (create)
+        memcpy(base, &header, sizeof(header));
+    else if (memcmp(base, &header, sizeof(header)))
+        error = path + " doesn't match the clip";
+    unlock();
+    return error;
+}
+
+std::string DiskCacheFile::openShared(const std::string &name, const DiskCacheHeader &header) {
+    sharedMemory = true;
+    headerOffset = sharedCacheHeaderOffset;
+    dataOffset = getDataOffset(header.numFrames, headerOffset);
+    slotSize = static_cast<size_t>(header.propSize + header.frameSize);
+    size_t totalSize = dataOffset + slotSize * header.numFrames;
+    shmName = "/" + name;
+
+    // the last user may remove an existing segment between the two calls
+    bool create = false;
+    for (int attempt = 0; fd < 0 && attempt < 10; attempt++) {
+        fd = shm_open(shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        create = (fd >= 0);
+        if (fd < 0 && errno != EEXIST)
+            return "failed to create " + name;
+        if (fd < 0)
+            fd = shm_open(shmName.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0)
+        return "failed to open " + name;
+
+    auto fail = [&](const std::string &error) {
+        if (create)
+            shm_unlink(shmName.c_str());
+        return error;
+    };
+
+    // like the file the segment is sparse, only pages that are written take up memory
+    if (create && ftruncate(fd, totalSize))
+        return fail("failed to resize " + name);
+
+    struct stat st = {};
+    for (int i = 0; !create && !fstat(fd, &st) && st.st_size == 0; i++) {
+        if (i == 5000)
+            return name + " was never initialized";
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (!create && static_cast<uint64_t>(st.st_size) != totalSize)
+        return name + " doesn't match the clip";
+
+    void *p = mmap(nullptr, totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return fail("failed to map " + name);
+    base = static_cast<uint8_t *>(p);
+    mappedSize = totalSize;
+
+    return attachShared(name, header, create);
+}
+
+bool DiskCacheFile::commitSlot(int n) {
+#ifdef VS_TARGET_OS_DARWIN
+    return true;
+#else
+    // writing to pages that tmpfs has no room for raises SIGBUS, allocating them first fails gracefully instead
+    return !sharedMemory || !posix_fallocate(fd, static_cast<off_t>(slot(n) - base), static_cast<off_t>(slotSize));
+#endif
+}
+
+#endif
+
+//////////////////////////////////////////
+// Property serialization
+
+// only the property types that can live outside of a process are stored, the
+// layout is key, type, count and then the values for every key
+static bool serializeProperties(const VSMap *props, uint8_t *dst, size_t size, const VSAPI *vsapi) {
+    uint8_t *end = dst + size;
+    auto put = [&](const void *data, size_t len) {
+        if (static_cast<size_t>(end - dst) < len)
+            return false;
+        memcpy(dst, data, len);
+        dst += len;
+        return true;
+    };
+
+    int numKeys = vsapi->mapNumKeys(props);
+    for (int i = 0; i < numKeys; i++) {
+        const char *key = vsapi->mapGetKey(props, i);
+        int32_t type = vsapi->mapGetType(props, key);
+        int32_t numElems = vsapi->mapNumElements(props, key);
+        if (type != ptInt && type != ptFloat && type != ptData)
+            continue;
+        uint32_t keyLen = static_cast<uint32_t>(strlen(key));
+        if (!put(&keyLen, sizeof(keyLen)) || !put(key, keyLen) || !put(&type, sizeof(type)) || !put(&numElems, sizeof(numElems)))
+            return false;
+        if (type == ptInt) {
+            if (!put(vsapi->mapGetIntArray(props, key, nullptr), sizeof(int64_t) * numElems))
+                return false;
+        } else if (type == ptFloat) {
+            if (!put(vsapi->mapGetFloatArray(props, key, nullptr), sizeof(double) * numElems))
+                return false;
+        } else {
+            for (int j = 0; j < numElems; j++) {
+                int32_t hint = vsapi->mapGetDataTypeHint(props, key, j, nullptr);
+                int32_t dataSize = vsapi->mapGetDataSize(props, key, j, nullptr);
+                if (!put(&hint, sizeof(hint)) || !put(&dataSize, sizeof(dataSize)) || !put(vsapi->mapGetData(props, key, j, nullptr), dataSize))
+                    return false;
+            }
+        }
+    }
+
+    uint32_t terminator = 0;
+    return put(&terminator, sizeof(terminator));
+}
+
+static void deserializeProperties(VSMap *props, const uint8_t *src, const VSAPI *vsapi) {
+    auto get = [&](void *data, size_t len) {
+        memcpy(data, src, len);
+        src += len;
+    };
+
+    uint32_t keyLen;
+    get(&keyLen, sizeof(keyLen));
+    while (keyLen) {
+        std::string key(reinterpret_cast<const char *>(src), keyLen);
+        src += keyLen;
+        int32_t type, numElems;
+        get(&type, sizeof(type));
+        get(&numElems, sizeof(numElems));
+        for (int j = 0; j < numElems; j++) {
+            if (type == ptInt) {
+                int64_t v;
+                get(&v, sizeof(v));
+                vsapi->mapSetInt(props, key.c_str(), v, maAppend);
+            } else if (type == ptFloat) {
+                double v;
+                get(&v, sizeof(v));
+                vsapi->mapSetFloat(props, key.c_str(), v, maAppend);
+            } else {
+                int32_t hint, dataSize;
+                get(&hint, sizeof(hint));
+                get(&dataSize, sizeof(dataSize));
+                vsapi->mapSetData(props, key.c_str(), reinterpret_cast<const char *>(src), dataSize, hint, maAppend);
+                src += dataSize;
+            }
+        }
+        get(&keyLen, sizeof(keyLen));
+    }
+}
+
+//////////////////////////////////////////
+// DiskCache
+
+typedef struct {
+    const VSVideoInfo *vi;
+    DiskCacheFile file;
+    uint32_t propSize;
+} DiskCacheDataExtra;
+
+typedef SingleNodeData<DiskCacheDataExtra> DiskCacheData;
+
+static const VSFrame *VS_CC diskCacheGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    DiskCacheData *d = reinterpret_cast<DiskCacheData *>(instanceData);
+    std::atomic<uint32_t> &state = d->file.states()[n];
+
+    if (activationReason == arInitial) {
+        if (state.load(std::memory_order_acquire) == dfsStored) {
+            const uint8_t *srcp = d->file.slot(n);
+            VSFrame *dst = vsapi->newVideoFrame(&d->vi->format, d->vi->width, d->vi->height, nullptr, core);
+            deserializeProperties(vsapi->getFramePropertiesRW(dst), srcp, vsapi);
+            srcp += d->propSize;
+            for (int plane = 0; plane < d->vi->format.numPlanes; plane++) {
+                int rowSize = vsapi->getFrameWidth(dst, plane) * d->vi->format.bytesPerSample;
+                int height = vsapi->getFrameHeight(dst, plane);
+                bitblt(vsapi->getWritePtr(dst, plane), vsapi->getStride(dst, plane), srcp, rowSize, rowSize, height);
+                srcp += static_cast<size_t>(rowSize) * height;
+            }
+            return dst;
+        }
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+
+        uint32_t expected = dfsEmpty;
+        if (state.compare_exchange_strong(expected, dfsWriting, std::memory_order_acquire)) {
+            uint8_t *dstp = d->file.slot(n);
+            if (!d->file.commitSlot(n)) {
+                // out of memory for now, someone may have better luck later
+                state.store(dfsEmpty, std::memory_order_release);
+            } else if (!serializeProperties(vsapi->getFramePropertiesRO(src), dstp, d->propSize, vsapi)) {
+                state.store(dfsUncacheable, std::memory_order_release);
+            } else {
+                dstp += d->propSize;
+                for (int plane = 0; plane < d->vi->format.numPlanes; plane++) {
+                    int rowSize = vsapi->getFrameWidth(src, plane) * d->vi->format.bytesPerSample;
+                    int height = vsapi->getFrameHeight(src, plane);
+                    bitblt(dstp, rowSize, vsapi->getReadPtr(src, plane), vsapi->getStride(src, plane), rowSize, height);
+                    dstp += static_cast<size_t>(rowSize) * height;
+                }
+                state.store(dfsStored, std::memory_order_release);
+            }
+        }
+
+        return src;
+    }
+
+    return nullptr;
+}
+
+// DiskCache and SharedCache only differ in where the frames are kept
+static void createCache(const VSMap *in, VSMap *out, bool shared, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<DiskCacheData> d(new DiskCacheData(vsapi));
+    const std::string funcName = shared ? "SharedCache" : "DiskCache";
+    int err;
+
+    d->node = vsapi->mapGetNode(in, "clip", 0, nullptr);
+    d->vi = vsapi->getVideoInfo(d->node);
+
+    if (!isConstantVideoFormat(d->vi))
+        RETERROR((funcName + ": only constant format clips supported").c_str());
+
+    int64_t propSize = vsapi->mapGetInt(in, "propsize", 0, &err);
+    if (err)
+        propSize = 16384;
+    if (propSize < 4 || propSize > 16 * 1024 * 1024)
+        RETERROR((funcName + ": propsize must be between 4 bytes and 16 MiB").c_str());
+    // keep the planes of every slot aligned
+    d->propSize = static_cast<uint32_t>((propSize + 63) & ~63);
+
+    GraphHash hash;
+    hashVideoInfo(hash, d->vi);
+    const char *key = vsapi->mapGetData(in, "key", 0, &err);
+    if (!err)
+        hash.add(key);
+    else if (!hashGraph(hash, d->node, vsapi))
+        RETERROR((funcName + ": the clip can only be identified with graph inspection enabled, pass a key instead").c_str());
+
+    DiskCacheHeader header = {};
+    memcpy(header.magic, diskCacheMagic, sizeof(header.magic));
+    header.version = diskCacheVersion;
+    header.formatID = vsapi->queryVideoFormatID(d->vi->format.colorFamily, d->vi->format.sampleType, d->vi->format.bitsPerSample, d->vi->format.subSamplingW, d->vi->format.subSamplingH, core);
+    header.graphHash = hash.h;
+    header.width = d->vi->width;
+    header.height = d->vi->height;
+    header.numFrames = d->vi->numFrames;
+    header.propSize = d->propSize;
+    for (int plane = 0; plane < d->vi->format.numPlanes; plane++)
+        header.frameSize += static_cast<uint64_t>(planeWidth(d->vi, plane)) * d->vi->format.bytesPerSample * planeHeight(d->vi, plane);
+    header.frameSize = (header.frameSize + 63) & ~static_cast<uint64_t>(63);
+
+    uint64_t totalSize = DiskCacheFile::getDataOffset(header.numFrames, shared ? sharedCacheHeaderOffset : 0) + static_cast<uint64_t>(header.numFrames) * (header.propSize + header.frameSize);
+    if (totalSize > static_cast<uint64_t>(std::numeric_limits<size_t>::max() / 2))
+        RETERROR((funcName + ": the clip is too big to be mapped into memory").c_str());
+
+    char hashStr[17];
+    snprintf(hashStr, sizeof(hashStr), "%016llx", static_cast<unsigned long long>(hash.h));
+    std::string error;
+    if (shared) {
+        const char *prefix = vsapi->mapGetData(in, "name", 0, &err);
+        if (!err && (!*prefix || strpbrk(prefix, "/\\")))
+            RETERROR("SharedCache: name must be non-empty and can't contain slashes");
+        error = d->file.openShared(std::string(err ? "vscache" : prefix) + "-" + hashStr, header);
+    } else {
+        std::string path = vsapi->mapGetData(in, "path", 0, nullptr);
+        if (!path.empty() && path.back() != '/' && path.back() != '\\')
+            path += '/';
+        path += hashStr;
+        path += ".vscache";
+        error = d->file.open(path, header);
+    }
+    if (!error.empty())
+        RETERROR((funcName + ": " + error).c_str());
+
+    VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
+    vsapi->createVideoFilter(out, funcName.c_str(), d->vi, diskCacheGetFrame, filterFree<DiskCacheData>, fmParallel, deps, 1, d.get(), core);
+    d.release();
+}
+
+static void VS_CC diskCacheCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    createCache(in, out, false, core, vsapi);
+}
+
+static void VS_CC sharedCacheCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    createCache(in, out, true, core, vsapi);
+}
+
+} // namespace
+
+//////////////////////////////////////////
+// Init
+
+void diskCacheInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
+    vspapi->registerFunction("DiskCache", "clip:vnode;path:data;key:data:opt;propsize:int:opt;", "clip:vnode;", diskCacheCreate, nullptr, plugin);
+    vspapi->registerFunction("SharedCache", "clip:vnode;name:data:opt;key:data:opt;propsize:int:opt;", "clip:vnode;", sharedCacheCreate, nullptr, plugin);
+}
@@ -0,0 +1,584 @@
+/*
+* Copyright (c) 2012-2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+// Compiles every expression of a corpus, one per line, for a set of sample types and runs it
+// through the interpreter and the JIT at every cpulevel. Besides the compile times and the time
+// per pixel it checks that all of them produce the same output as the unoptimized bytecode in
+// the interpreter, and that turning off one of the optimizer passes doesn't make the code faster.
+// The exit code is non-zero when any of that fails so it can run as a test.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "VapourSynth4.h"
+#include "VSHelper4.h"
+#include "../cpufeatures.h"
+#include "../kernel/cpulevel.h"
+#include "expr.h"
+#include "interpreter.h"
+#include "jitcompiler.h"
+
+#ifdef VS_TARGET_OS_WINDOWS
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+using namespace expr;
+using namespace vsh;
+
+namespace {
+
+const int maxRows = 64;
+
+struct Options {
+    std::vector<std::string> corpus;
+    std::vector<int> depths;
+    int width = 1920;
+    int height = 32;
+    double minTime = 0.01;
+    double threshold = 0.05;
+    float tolerance = 1e-4f;
+    bool json = false;
+};
+
+struct Variant {
+    const char *name;
+    bool optimize;
+    unsigned disabledPasses;
+};
+
+// the first one is the reference for the output, the second one for the speed
+const Variant variants[] = {
+    { "unoptimized", false, 0 },
+    { "optimized", true, 0 },
+    { "no_algebraic", true, PASS_ALGEBRAIC },
+    { "no_strength_reduction", true, PASS_STRENGTH_REDUCTION },
+    { "no_op_fusion", true, PASS_OP_FUSION },
+};
+const int numVariants = sizeof(variants) / sizeof(variants[0]);
+
+struct Row {
+    int clip;
+    int dy;
+    BoundaryCondition boundary;
+};
+
+// the bytecode with every vertically offset load on its own row like in the filter
+struct Program {
+    std::vector<ExprInstruction> bytecode;
+    std::vector<Row> rows;
+    std::vector<Row> prefetch;
+    int leftBorder = 0;
+    int rightBorder = 0;
+};
+
+struct Plane {
+    uint8_t *data;
+    ptrdiff_t stride;
+    int bytes;
+
+    Plane(int width, int height, int bytes) : bytes(bytes) {
+        // whole vectors may be written past the end of a row
+        stride = (static_cast<ptrdiff_t>(width) * bytes + 64 + 63) & ~static_cast<ptrdiff_t>(63);
+        data = vsh_aligned_malloc<uint8_t>(stride * height, 64);
+        if (!data)
+            throw std::bad_alloc();
+        memset(data, 0, stride * height);
+    }
+
+    Plane(const Plane &) = delete;
+    Plane &operator=(const Plane &) = delete;
+
+    ~Plane() {
+        vsh_aligned_free(data);
+    }
+};
+
+struct Code {
+    ExprCompiler::ProcessPlaneProc proc = nullptr;
+    size_t size = 0;
+
+    Code() = default;
+    Code(std::pair<ExprCompiler::ProcessPlaneProc, size_t> code) : proc(code.first), size(code.second) {}
+    Code(const Code &) = delete;
+    Code &operator=(const Code &) = delete;
+
+    ~Code() {
+        if (proc) {
+#ifdef VS_TARGET_OS_WINDOWS
+            VirtualFree((LPVOID)proc, 0, MEM_RELEASE);
+#else
+            munmap((void *)proc, size);
+#endif
+        }
+    }
+};
+
+struct Measurement {
+    const char *variant;
+    std::string backend;
+    size_t instructions;
+    double compileTime; // of the machine code, 0 for the interpreter
+    double nsPerPixel;
+    int64_t mismatches;
+};
+
+struct Case {
+    std::string expr;
+    int depth;
+    std::string error;
+    double compileTime;
+    std::vector<Measurement> results;
+    std::vector<std::string> regressions;
+    std::vector<std::string> notes;
+};
+
+template<typename F>
+double bestTime(F func, double minTime) {
+    double best = 0;
+    double total = 0;
+    for (int runs = 0; total < minTime || runs < 3; runs++) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = runs ? std::min(best, t) : t;
+        total += t;
+    }
+    return best;
+}
+
+Program makeProgram(const std::string &expr, const VSVideoInfo * const vi[], const VSVideoInfo &outvi, const Variant &v, std::vector<FrameConstant> &constants) {
+    Program p;
+    constants.clear();
+    p.bytecode = compile(expr, vi, MAX_EXPR_INPUTS, outvi, v.optimize, BoundaryCondition::CLAMP, &constants, v.disabledPasses);
+
+    for (int i = 0; i < MAX_EXPR_INPUTS; i++)
+        p.rows.push_back({ i, 0, BoundaryCondition::CLAMP });
+
+    bool used[MAX_EXPR_INPUTS] = {};
+    int lowest[MAX_EXPR_INPUTS] = {};
+
+    for (auto &insn : p.bytecode) {
+        if (insn.op.type != ExprOpType::MEM_LOAD_U8 && insn.op.type != ExprOpType::MEM_LOAD_U16 && insn.op.type != ExprOpType::MEM_LOAD_F16 && insn.op.type != ExprOpType::MEM_LOAD_F32)
+            continue;
+        p.leftBorder = std::max(p.leftBorder, -insn.op.dx);
+        p.rightBorder = std::max(p.rightBorder, insn.op.dx);
+        int clip = static_cast<int>(insn.op.imm.u);
+        lowest[clip] = used[clip] ? std::max(lowest[clip], insn.op.dy) : insn.op.dy;
+        used[clip] = true;
+        if (!insn.op.dy)
+            continue;
+        auto it = std::find_if(p.rows.begin(), p.rows.end(), [&](const Row &row) { return row.clip == clip && row.dy == insn.op.dy && row.boundary == insn.op.boundary; });
+        if (it == p.rows.end()) {
+            if (p.rows.size() >= maxRows)
+                throw std::runtime_error("Too many distinct rows referenced by relative pixel access");
+            it = p.rows.insert(p.rows.end(), { clip, insn.op.dy, insn.op.boundary });
+        }
+        insn.op.imm.u = static_cast<unsigned>(it - p.rows.begin());
+    }
+
+    for (int i = 0; i < MAX_EXPR_INPUTS; i++) {
+        if (used[i])
+            p.prefetch.push_back({ i, lowest[i] + 1, BoundaryCondition::CLAMP });
+    }
+    return p;
+}
+
+// the same split between the JIT and the interpreter as the filter uses, proc may be null
+void render(const Program &p, ExprCompiler::ProcessPlaneProc proc, const std::vector<std::unique_ptr<Plane>> &srcs, Plane &dst, int w, int h, const float *consts) {
+    int numRows = static_cast<int>(p.rows.size());
+    int numPrefetch = static_cast<int>(p.prefetch.size());
+    const uint8_t *srcp[maxRows];
+    alignas(32) intptr_t ptroffsets[(1 + maxRows + MAX_EXPR_INPUTS + 7) & ~7] = {};
+    ptroffsets[0] = dst.bytes * 8;
+    for (int i = 0; i < numRows; i++)
+        ptroffsets[1 + i] = srcs[p.rows[i].clip]->bytes * 8;
+    for (int i = 0; i < numPrefetch; i++)
+        ptroffsets[1 + numRows + i] = srcs[p.prefetch[i].clip]->bytes * 8;
+
+    int xs = 0;
+    int xe = w;
+    if (p.leftBorder || p.rightBorder) {
+        xs = std::min((p.leftBorder + 15) & ~15, w);
+        xe = xs + std::max(w - p.rightBorder - xs, 0) / 16 * 16;
+    }
+    if (!proc) {
+        xs = 0;
+        xe = 0;
+    }
+
+    ExprInterpreter interpreter(p.bytecode.data(), p.bytecode.size(), w, consts);
+    int niterations = (xe - xs + 7) / 8;
+    int rowPointers = exprRowPointers(1, numRows, numPrefetch);
+    std::vector<uint8_t *> rwptrs;
+    if (niterations > 0)
+        rwptrs.resize(static_cast<size_t>(h) * rowPointers);
+
+    for (int y = 0; y < h; y++) {
+        for (int i = 0; i < numRows; i++) {
+            const Row &row = p.rows[i];
+            srcp[i] = srcs[row.clip]->data + srcs[row.clip]->stride * (row.dy ? exprBoundary(y + row.dy, h, row.boundary) : y);
+        }
+        uint8_t *dstp = dst.data + dst.stride * y;
+
+        if (niterations > 0) {
+            uint8_t **block = rwptrs.data() + static_cast<size_t>(y) * rowPointers;
+            block[0] = dstp + dst.bytes * xs;
+            for (int i = 0; i < numRows; i++)
+                block[1 + i] = const_cast<uint8_t *>(srcp[i] + srcs[p.rows[i].clip]->bytes * xs);
+            for (int i = 0; i < numPrefetch; i++) {
+                const Row &row = p.prefetch[i];
+                block[1 + numRows + i] = const_cast<uint8_t *>(srcs[row.clip]->data + srcs[row.clip]->stride * exprBoundary(y + row.dy, h, row.boundary) + srcs[row.clip]->bytes * xs);
+            }
+        }
+
+        for (int x = 0; x < xs; x += ExprInterpreter::blockSize)
+            interpreter.eval(srcp, &dstp, x, std::min(ExprInterpreter::blockSize, xs - x));
+        for (int x = xe; x < w; x += ExprInterpreter::blockSize)
+            interpreter.eval(srcp, &dstp, x, std::min(ExprInterpreter::blockSize, w - x));
+    }
+
+    if (niterations > 0)
+        proc(rwptrs.data(), ptroffsets, niterations, consts, h);
+}
+
+int64_t countMismatches(const Plane &a, const Plane &ref, int w, int h, int depth, float tolerance) {
+    int64_t count = 0;
+    for (int y = 0; y < h; y++) {
+        const uint8_t *pa = a.data + a.stride * y;
+        const uint8_t *pr = ref.data + ref.stride * y;
+        for (int x = 0; x < w; x++) {
+            if (depth == 32) {
+                float va = reinterpret_cast<const float *>(pa)[x];
+                float vr = reinterpret_cast<const float *>(pr)[x];
+                if (std::isnan(va) && std::isnan(vr))
+                    continue;
+                if (!(std::fabs(va - vr) <= tolerance * std::max(1.0f, std::fabs(vr))))
+                    count++;
+            } else {
+                int va = depth > 8 ? reinterpret_cast<const uint16_t *>(pa)[x] : pa[x];
+                int vr = depth > 8 ? reinterpret_cast<const uint16_t *>(pr)[x] : pr[x];
+                // rounding of values that end up exactly between two integers may differ
+                if (std::abs(va - vr) > 1)
+                    count++;
+            }
+        }
+    }
+    return count;
+}
+
+// vs_cpulevel_to_str() lives in the core which this doesn't link
+const char *levelName(int level) {
+    switch (level) {
+    case VS_CPU_LEVEL_SSE2: return "sse2";
+    case VS_CPU_LEVEL_AVX2: return "avx2";
+    case VS_CPU_LEVEL_AVX512: return "avx512";
+    default: return "none";
+    }
+}
+
+std::vector<int> jitLevels() {
+    std::vector<int> levels;
+#ifdef VS_TARGET_CPU_X86
+    const CPUFeatures *f = getCPUFeatures();
+    levels.push_back(VS_CPU_LEVEL_SSE2);
+    if (f->avx2)
+        levels.push_back(VS_CPU_LEVEL_AVX2);
+    if (f->avx512_f)
+        levels.push_back(VS_CPU_LEVEL_AVX512);
+#endif
+    return levels;
+}
+
+Case runCase(const std::string &expr, int depth, const Options &opts, const std::vector<std::unique_ptr<Plane>> &srcs) {
+    Case c;
+    c.expr = expr;
+    c.depth = depth;
+
+    VSVideoInfo vi = {};
+    vi.format.colorFamily = cfGray;
+    vi.format.sampleType = depth == 32 ? stFloat : stInteger;
+    vi.format.bitsPerSample = depth;
+    vi.format.bytesPerSample = depth == 32 ? 4 : (depth > 8 ? 2 : 1);
+    vi.format.numPlanes = 1;
+    vi.width = opts.width;
+    vi.height = opts.height;
+    const VSVideoInfo *vis[MAX_EXPR_INPUTS];
+    for (int i = 0; i < MAX_EXPR_INPUTS; i++)
+        vis[i] = &vi;
+
+    int w = opts.width;
+    int h = opts.height;
+    double pixels = static_cast<double>(w) * h;
+    std::vector<FrameConstant> constants;
+    Program programs[numVariants];
+
+    try {
+        for (int v = 0; v < numVariants; v++)
+            programs[v] = makeProgram(expr, vis, vi, variants[v], constants);
+        c.compileTime = bestTime([&] { std::vector<FrameConstant> tmp; compile(expr, vis, MAX_EXPR_INPUTS, vi, true, BoundaryCondition::CLAMP, &tmp); }, opts.minTime);
+    } catch (std::exception &e) {
+        c.error = e.what();
+        return c;
+    }
+
+    // the frame properties are all 1 which avoids dividing by 0 in the common normalizations
+    std::vector<float> consts(std::max<size_t>(constants.size(), 1), 1.0f);
+
+    Plane reference(w, h, vi.format.bytesPerSample);
+    Plane output(w, h, vi.format.bytesPerSample);
+    render(programs[0], nullptr, srcs, reference, w, h, consts.data());
+
+    std::vector<int> levels = jitLevels();
+
+    for (int v = 0; v < numVariants; v++) {
+        const Program &p = programs[v];
+        double t = bestTime([&] { render(p, nullptr, srcs, output, w, h, consts.data()); }, opts.minTime);
+        c.results.push_back({ variants[v].name, "interpreter", p.bytecode.size(), 0, t * 1e9 / pixels, countMismatches(output, reference, w, h, depth, opts.tolerance) });
+
+        for (int level : levels) {
+            double compileTime = bestTime([&] { Code tmp(compile_jit(p.bytecode.data(), p.bytecode.size(), static_cast<int>(p.rows.size()), static_cast<int>(p.prefetch.size()), level)); }, opts.minTime);
+            Code code(compile_jit(p.bytecode.data(), p.bytecode.size(), static_cast<int>(p.rows.size()), static_cast<int>(p.prefetch.size()), level));
+            if (!code.proc) {
+                c.regressions.push_back(std::string("JIT compilation failed for ") + variants[v].name + " at " + levelName(level));
+                continue;
+            }
+            t = bestTime([&] { render(p, code.proc, srcs, output, w, h, consts.data()); }, opts.minTime);
+            c.results.push_back({ variants[v].name, levelName(level), p.bytecode.size(), compileTime, t * 1e9 / pixels, countMismatches(output, reference, w, h, depth, opts.tolerance) });
+        }
+    }
+
+    // the passes are only ever used all together so a difference with one of them turned off, such as
+    // a pow left behind by the algebraic rewrites, is worth knowing about but not a failure
+    for (const Measurement &m : c.results) {
+        if (!m.mismatches)
+            continue;
+        std::string msg = std::string(m.variant) + " " + m.backend + " differs from the unoptimized interpreter in " + std::to_string(m.mismatches) + " pixels";
+        if (!strcmp(m.variant, "optimized") || !strcmp(m.variant, "unoptimized"))
+            c.regressions.push_back(msg);
+        else
+            c.notes.push_back(msg);
+    }
+
+    // an optimizer pass that makes the generated code slower than it is without the pass
+    for (const Measurement &opt : c.results) {
+        if (strcmp(opt.variant, "optimized"))
+            continue;
+        for (const Measurement &m : c.results) {
+            if (m.backend != opt.backend || m.backend == "interpreter" || !strcmp(m.variant, "optimized") || !strcmp(m.variant, "unoptimized"))
+                continue;
+            if (m.nsPerPixel < opt.nsPerPixel * (1 - opts.threshold)) {
+                char buf[64];
+                snprintf(buf, sizeof(buf), " is %.1f%% faster", (1 - m.nsPerPixel / opt.nsPerPixel) * 100);
+                c.regressions.push_back(std::string(m.variant) + " " + m.backend + buf + " than optimized");
+            }
+        }
+    }
+
+    return c;
+}
+
+std::string jsonString(const std::string &s) {
+    std::string r = "\"";
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\') {
+            r += '\\';
+            r += ch;
+        } else if (static_cast<unsigned char>(ch) < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            r += buf;
+        } else {
+            r += ch;
+        }
+    }
+    return r + "\"";
+}
+
+void printCase(const Case &c, bool json, bool first) {
+    if (json) {
+        printf("%s\n    { \"expr\": %s, \"depth\": %d", first ? "" : ",", jsonString(c.expr).c_str(), c.depth);
+        if (!c.error.empty()) {
+            printf(", \"error\": %s }", jsonString(c.error).c_str());
+            return;
+        }
+        printf(", \"compile_us\": %.3f, \"results\": [", c.compileTime * 1e6);
+        for (size_t i = 0; i < c.results.size(); i++) {
+            const Measurement &m = c.results[i];
+            printf("%s\n        { \"variant\": \"%s\", \"backend\": \"%s\", \"instructions\": %zu, \"jit_compile_us\": %.3f, \"ns_per_pixel\": %.4f, \"mismatches\": %lld }",
+                i ? "," : "", m.variant, m.backend.c_str(), m.instructions, m.compileTime * 1e6, m.nsPerPixel, static_cast<long long>(m.mismatches));
+        }
+        printf(" ], \"regressions\": [");
+        for (size_t i = 0; i < c.regressions.size(); i++)
+            printf("%s%s", i ? ", " : " ", jsonString(c.regressions[i]).c_str());
+        printf("%s], \"notes\": [", c.regressions.empty() ? "" : " ");
+        for (size_t i = 0; i < c.notes.size(); i++)
+            printf("%s%s", i ? ", " : " ", jsonString(c.notes[i]).c_str());
+        printf("%s] }", c.notes.empty() ? "" : " ");
+        return;
+    }
+
+    printf("%s (%d bits)\n", c.expr.c_str(), c.depth);
+    if (!c.error.empty()) {
+        printf("  error: %s\n", c.error.c_str());
+        return;
+    }
+    printf("  compile: %.1f us\n", c.compileTime * 1e6);
+    for (const Measurement &m : c.results)
+        printf("  %-22s %-12s %4zu insns %9.1f us %9.3f ns/pixel\n", m.variant, m.backend.c_str(), m.instructions, m.compileTime * 1e6, m.nsPerPixel);
+    for (const std::string &r : c.regressions)
+        printf("  REGRESSION: %s\n", r.c_str());
+    for (const std::string &n : c.notes)
+        printf("  note: %s\n", n.c_str());
+}
+
+void printHelp() {
+    fprintf(stderr,
+        "Usage: exprbench [options] corpus...\n"
+        "Every line of the corpus files is an expression, empty lines and lines starting with # are skipped.\n"
+        "test/expr_compiler has two corpora of real world expressions.\n"
+        "Options:\n"
+        "  -d, --depth N            Sample type to run out of 8, 10, 16 and 32, can be given several times, default all\n"
+        "  -s, --size WxH           Plane size, default 1920x32\n"
+        "  -t, --time MS            Minimum time spent on each measurement, default 10\n"
+        "      --threshold PCT      How much faster code without a pass has to be to count as a regression, default 5\n"
+        "      --tolerance X        Relative difference allowed for float output, default 0.0001\n"
+        "  -j, --json               Print the results as JSON\n"
+        "  -h, --help               Show this help\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) try {
+    Options opts;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if ((arg == "-d" || arg == "--depth") && hasValue) {
+            int depth = atoi(argv[++i]);
+            if (depth != 8 && depth != 10 && depth != 16 && depth != 32) {
+                fprintf(stderr, "Invalid depth %s\n", argv[i]);
+                return 1;
+            }
+            opts.depths.push_back(depth);
+        } else if ((arg == "-s" || arg == "--size") && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &opts.width, &opts.height) != 2 || opts.width < 16 || opts.height < 1) {
+                fprintf(stderr, "Invalid size %s\n", argv[i]);
+                return 1;
+            }
+        } else if ((arg == "-t" || arg == "--time") && hasValue) {
+            opts.minTime = atof(argv[++i]) / 1000;
+        } else if (arg == "--threshold" && hasValue) {
+            opts.threshold = atof(argv[++i]) / 100;
+        } else if (arg == "--tolerance" && hasValue) {
+            opts.tolerance = static_cast<float>(atof(argv[++i]));
+        } else if (arg == "-j" || arg == "--json") {
+            opts.json = true;
+        } else if (arg == "-h" || arg == "--help") {
+            printHelp();
+            return 0;
+        } else if (!arg.empty() && arg[0] != '-') {
+            opts.corpus.push_back(arg);
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", arg.c_str());
+            printHelp();
+            return 1;
+        }
+    }
+
+    if (opts.corpus.empty()) {
+        printHelp();
+        return 1;
+    }
+    if (opts.depths.empty())
+        opts.depths = { 8, 10, 16, 32 };
+
+    std::vector<std::string> exprs;
+    for (const std::string &file : opts.corpus) {
+        std::ifstream in(file);
+        if (!in) {
+            fprintf(stderr, "Failed to open %s\n", file.c_str());
+            return 1;
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t'))
+                line.pop_back();
+            if (!line.empty() && line[0] != '#')
+                exprs.push_back(line);
+        }
+    }
+
+    bool failed = false;
+    bool first = true;
+    std::mt19937 rng(1);
+
+    if (opts.json)
+        printf("{\n  \"width\": %d,\n  \"height\": %d,\n  \"results\": [", opts.width, opts.height);
+
+    for (int depth : opts.depths) {
+        int bytes = depth == 32 ? 4 : (depth > 8 ? 2 : 1);
+        std::vector<std::unique_ptr<Plane>> srcs;
+        for (int i = 0; i < MAX_EXPR_INPUTS; i++) {
+            srcs.emplace_back(new Plane(opts.width, opts.height, bytes));
+            Plane &p = *srcs.back();
+            for (int y = 0; y < opts.height; y++) {
+                uint8_t *row = p.data + p.stride * y;
+                for (int x = 0; x < opts.width; x++) {
+                    if (depth == 32)
+                        reinterpret_cast<float *>(row)[x] = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+                    else if (depth > 8)
+                        reinterpret_cast<uint16_t *>(row)[x] = static_cast<uint16_t>(rng() & ((1U << depth) - 1));
+                    else
+                        row[x] = static_cast<uint8_t>(rng());
+                }
+            }
+        }
+
+        for (const std::string &expr : exprs) {
+            Case c = runCase(expr, depth, opts, srcs);
+            failed = failed || !c.regressions.empty();
+            printCase(c, opts.json, first);
+            first = false;
+            fflush(stdout);
+        }
+    }
+
+    if (opts.json)
+        printf("\n  ]\n}\n");
+
+    return failed ? 1 : 0;
+} catch (std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+}
@@ -21,6 +21,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <locale>
 #include <map>
@@ -29,6 +30,7 @@
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -94,6 +96,7 @@ struct ExpressionTreeNode {
 
 class ExpressionTree {
     std::vector<std::unique_ptr<ExpressionTreeNode>> nodes;
+    std::vector<ExpressionTreeNode *> roots;
     ExpressionTreeNode *root;
 public:
     ExpressionTree() : root() {}
@@ -103,6 +106,15 @@ public:
 
     void setRoot(ExpressionTreeNode *node) { root = node; }
 
+    // Expressions with several outputs have one root per output, most passes only work on the selected one.
+    const std::vector<ExpressionTreeNode *> &getRoots() const { return roots; }
+
+    void setRoots(const std::vector<ExpressionTreeNode *> &nodes)
+    {
+        roots = nodes;
+        root = roots.empty() ? nullptr : roots.front();
+    }
+
     ExpressionTreeNode *makeNode(ExprOp data)
     {
         nodes.push_back(std::unique_ptr<ExpressionTreeNode>(new ExpressionTreeNode(data)));
@@ -125,7 +137,7 @@ bool equalSubTree(const ExpressionTreeNode *lhs, const ExpressionTreeNode *rhs)
 {
     if (lhs->valueNum >= 0 && rhs->valueNum >= 0)
         return lhs->valueNum == rhs->valueNum;
-    if (lhs->op.type != rhs->op.type || lhs->op.imm.u != rhs->op.imm.u)
+    if (lhs->op != rhs->op)
         return false;
     if (!!lhs->left != !!rhs->left || !!lhs->right != !!rhs->right)
         return false;
@@ -136,6 +148,8 @@ bool equalSubTree(const ExpressionTreeNode *lhs, const ExpressionTreeNode *rhs)
     return true;
 }
 
+} // namespace
+
 std::vector<std::string> tokenize(const std::string &expr)
 {
     std::vector<std::string> tokens;
@@ -158,7 +172,9 @@ std::vector<std::string> tokenize(const std::string &expr)
     return tokens;
 }
 
-ExprOp decodeToken(const std::string &token)
+namespace {
+
+ExprOp decodeToken(const std::string &token, BoundaryCondition boundary)
 {
     static const std::unordered_map<std::string, ExprOp> simple{
         { "+",    { ExprOpType::ADD } },
@@ -167,6 +183,7 @@ ExprOp decodeToken(const std::string &token)
         { "/",    { ExprOpType::DIV } } ,
         { "sqrt", { ExprOpType::SQRT } },
         { "abs",  { ExprOpType::ABS } },
+        { "round", { ExprOpType::ROUND } },
         { "max",  { ExprOpType::MAX } },
         { "min",  { ExprOpType::MIN } },
         { "<",    { ExprOpType::CMP, static_cast<int>(ComparisonType::LT) } },
@@ -193,6 +210,43 @@ ExprOp decodeToken(const std::string &token)
         return it->second;
     } else if (token.size() == 1 && token[0] >= 'a' && token[0] <= 'z') {
         return{ ExprOpType::MEM_LOAD_U8, token[0] >= 'x' ? token[0] - 'x' : token[0] - 'a' + 3 };
+    } else if (token.size() > 1 && token[0] >= 'a' && token[0] <= 'z' && token[1] == '[') {
+        // Relative pixel access, x[dx,dy] optionally followed by :c or :m to pick the edge handling.
+        ExprOp op{ ExprOpType::MEM_LOAD_U8, token[0] >= 'x' ? token[0] - 'x' : token[0] - 'a' + 3 };
+        size_t comma = token.find(',');
+        size_t close = token.find(']');
+        size_t count1 = 0;
+        size_t count2 = 0;
+
+        if (comma == std::string::npos || close == std::string::npos || comma > close)
+            throw std::runtime_error("illegal token: " + token);
+
+        try {
+            op.dx = std::stoi(token.substr(2, comma - 2), &count1);
+            op.dy = std::stoi(token.substr(comma + 1, close - comma - 1), &count2);
+        } catch (...) {
+            // ...
+        }
+
+        if (count1 != comma - 2 || count2 != close - comma - 1)
+            throw std::runtime_error("illegal token: " + token);
+        if (std::abs(op.dx) > 65535 || std::abs(op.dy) > 65535)
+            throw std::runtime_error("relative pixel offset out of range: " + token);
+
+        std::string suffix = token.substr(close + 1);
+        if (suffix == ":c")
+            op.boundary = BoundaryCondition::CLAMP;
+        else if (suffix == ":m")
+            op.boundary = BoundaryCondition::MIRROR;
+        else if (suffix.empty())
+            op.boundary = boundary;
+        else
+            throw std::runtime_error("illegal token: " + token);
+
+        // the edge handling only matters when there's an offset, keep plain loads identical
+        if (!op.dx && !op.dy)
+            op.boundary = BoundaryCondition::CLAMP;
+        return op;
     } else if (token.substr(0, 3) == "dup" || token.substr(0, 4) == "swap") {
         size_t prefix = token[0] == 'd' ? 3 : 4;
         size_t count = 0;
@@ -220,7 +274,7 @@ ExprOp decodeToken(const std::string &token)
     }
 }
 
-ExpressionTree parseExpr(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs)
+ExpressionTree parseExpr(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, BoundaryCondition boundary, std::vector<FrameConstant> *constants, size_t numOutputs)
 {
     constexpr unsigned char numOperands[] = {
         0, // MEM_LOAD_U8
@@ -228,6 +282,7 @@ ExpressionTree parseExpr(const std::string &expr, const VSVideoInfo * const srcF
         0, // MEM_LOAD_F16
         0, // MEM_LOAD_F32
         0, // CONSTANT
+        0, // CONST_LOAD
         0, // MEM_STORE_U8
         0, // MEM_STORE_U16
         0, // MEM_STORE_F16
@@ -240,9 +295,11 @@ ExpressionTree parseExpr(const std::string &expr, const VSVideoInfo * const srcF
         1, // SQRT
         1, // ABS
         1, // NEG
+        1, // ROUND
         2, // MAX
         2, // MIN
         2, // CMP
+        1, // INT_TO_FLOAT
         2, // AND
         2, // OR
         2, // XOR
@@ -265,7 +322,28 @@ ExpressionTree parseExpr(const std::string &expr, const VSVideoInfo * const srcF
     std::vector<ExpressionTreeNode *> stack;
 
     for (const std::string &tok : tokens) {
-        ExprOp op = decodeToken(tok);
+        ExprOp op{ ExprOpType::CONST_LOAD };
+
+        // The frame number and frame properties (x.PropName) are looked up once per frame.
+        if (tok == "N" || (tok.size() > 2 && tok[0] >= 'a' && tok[0] <= 'z' && tok[1] == '.')) {
+            FrameConstant c{ -1, std::string() };
+            if (tok != "N") {
+                c.clip = tok[0] >= 'x' ? tok[0] - 'x' : tok[0] - 'a' + 3;
+                c.name = tok.substr(2);
+            }
+
+            if (c.clip >= numInputs)
+                throw std::runtime_error("reference to undefined clip: " + tok);
+            if (!constants)
+                throw std::runtime_error("frame properties unavailable: " + tok);
+
+            auto it = std::find(constants->begin(), constants->end(), c);
+            if (it == constants->end())
+                it = constants->insert(constants->end(), c);
+            op.imm.u = static_cast<unsigned>(it - constants->begin());
+        } else {
+            op = decodeToken(tok, boundary);
+        }
 
         // Check validity.
         if (op.type == ExprOpType::MEM_LOAD_U8 && op.imm.i >= numInputs)
@@ -335,10 +413,13 @@ ExpressionTree parseExpr(const std::string &expr, const VSVideoInfo * const srcF
 
     if (stack.empty())
         throw std::runtime_error("empty expression: " + expr);
-    if (stack.size() > 1)
+    // no expected number of outputs accepts any
+    if (numOutputs && stack.size() > numOutputs)
         throw std::runtime_error("unconsumed values on stack: " + expr);
+    if (numOutputs && stack.size() < numOutputs)
+        throw std::runtime_error("expected " + std::to_string(numOutputs) + " values on stack, got " + std::to_string(stack.size()) + ": " + expr);
 
-    tree.setRoot(stack.back());
+    tree.setRoots(stack);
     return tree;
 }
 
@@ -349,6 +430,7 @@ bool isConstantExpr(const ExpressionTreeNode &node)
     case ExprOpType::MEM_LOAD_U16:
     case ExprOpType::MEM_LOAD_F16:
     case ExprOpType::MEM_LOAD_F32:
+    case ExprOpType::CONST_LOAD:
         return false;
     case ExprOpType::CONSTANT:
         return true;
@@ -393,6 +475,7 @@ float evalConstantExpr(const ExpressionTreeNode &node)
     case ExprOpType::SQRT: return std::sqrt(LEFT);
     case ExprOpType::ABS: return std::fabs(LEFT);
     case ExprOpType::NEG: return -LEFT;
+    case ExprOpType::ROUND: return std::nearbyint(LEFT);
     case ExprOpType::MAX: return std::max(LEFT, RIGHT);
     case ExprOpType::MIN: return std::min(LEFT, RIGHT);
     case ExprOpType::CMP:
@@ -450,31 +533,36 @@ void swapNodeContents(ExpressionTreeNode &lhs, ExpressionTreeNode &rhs)
     std::swap(lhs.parent, rhs.parent);
 }
 
+// Numbers the values of all outputs together so that they can share subexpressions.
 void applyValueNumbering(ExpressionTree &tree)
 {
     std::vector<ExpressionTreeNode *> numbered;
     int valueNum = 0;
 
-    tree.getRoot()->postorder([&](ExpressionTreeNode &node)
-    {
-        node.valueNum = -1;
-    });
-
-    tree.getRoot()->postorder([&](ExpressionTreeNode &node)
-    {
-        if (node.op.type == ExprOpType::MUX)
-            return;
+    for (ExpressionTreeNode *root : tree.getRoots()) {
+        root->postorder([&](ExpressionTreeNode &node)
+        {
+            node.valueNum = -1;
+        });
+    }
 
-        for (ExpressionTreeNode *testnode : numbered) {
-            if (equalSubTree(&node, testnode)) {
-                node.valueNum = testnode->valueNum;
+    for (ExpressionTreeNode *root : tree.getRoots()) {
+        root->postorder([&](ExpressionTreeNode &node)
+        {
+            if (node.op.type == ExprOpType::MUX)
                 return;
+
+            for (ExpressionTreeNode *testnode : numbered) {
+                if (equalSubTree(&node, testnode)) {
+                    node.valueNum = testnode->valueNum;
+                    return;
+                }
             }
-        }
 
-        node.valueNum = valueNum++;
-        numbered.push_back(&node);
-    });
+            node.valueNum = valueNum++;
+            numbered.push_back(&node);
+        });
+    }
 }
 
 ExpressionTreeNode *emitIntegerPow(ExpressionTree &tree, const ExpressionTreeNode &node, int exponent)
@@ -515,12 +603,12 @@ class ExponentMap {
             // Ordering criteria for each category:
             //
             // constants: order by value
-            // memory: order by variable name
+            // memory: order by variable name and position
             // other: order by value number (unstable)
             if (lhsCategory == 2)
                 return lhsNode->op.imm.f < rhsNode->op.imm.f;
             else if (lhsCategory == 1)
-                return lhsNode->op.imm.u < rhsNode->op.imm.u;
+                return std::make_tuple(lhsNode->op.imm.u, lhsNode->op.dy, lhsNode->op.dx, lhsNode->op.boundary) < std::make_tuple(rhsNode->op.imm.u, rhsNode->op.dy, rhsNode->op.dx, rhsNode->op.boundary);
             else
                 return lhs.first < rhs.first;
         };
@@ -1401,6 +1489,169 @@ bool applyOpFusion(ExpressionTree &tree)
     return changed;
 }
 
+// Values that stay within this magnitude are exact in a float, so integer lanes produce the same result.
+constexpr double integerLimit = 1 << 24;
+
+typedef std::unordered_map<const ExpressionTreeNode *, std::pair<double, double>> IntegerRanges;
+
+void assignIntegerTypes(ExpressionTree &tree, ExpressionTreeNode &node, bool parentInteger, const IntegerRanges &ranges)
+{
+    // Leaves and multiplies only become integer when their consumer is.
+    if (node.op.type == ExprOpType::MUX) {
+        node.op.integer = parentInteger;
+    } else {
+        bool regionStart = node.left && node.op.type != ExprOpType::MUL && node.op.type != ExprOpType::FMA;
+        node.op.integer = ranges.count(&node) && (parentInteger || regionStart);
+    }
+
+    auto visit = [&](ExpressionTreeNode *child, void (ExpressionTreeNode::*set)(ExpressionTreeNode *))
+    {
+        if (!child)
+            return;
+
+        assignIntegerTypes(tree, *child, node.op.integer, ranges);
+
+        if (child->op.type != ExprOpType::MUX && child->op.integer && !node.op.integer) {
+            ExpressionTreeNode *conv = tree.makeNode(ExprOpType::INT_TO_FLOAT);
+            (node.*set)(conv);
+            conv->setLeft(child);
+        }
+    };
+
+    visit(node.left, &ExpressionTreeNode::setLeft);
+    visit(node.right, &ExpressionTreeNode::setRight);
+}
+
+// Finds the subexpressions that provably produce integers and marks them for evaluation in integer lanes. Integer
+// regions start at an integer store or at an operation that consumes only integers, conversions are inserted where a
+// float operation reads an integer value.
+void applyIntegerTypes(ExpressionTree &tree, bool integerStore)
+{
+    typedef IntegerRanges::mapped_type Range;
+    IntegerRanges ranges;
+
+    auto range = [&](const ExpressionTreeNode *node, Range &r)
+    {
+        auto it = ranges.find(node);
+        if (it == ranges.end())
+            return false;
+        r = it->second;
+        return true;
+    };
+
+    tree.getRoot()->postorder([&](ExpressionTreeNode &node)
+    {
+        Range a, b, c;
+        Range r;
+
+        switch (node.op.type) {
+        case ExprOpType::MEM_LOAD_U8:
+            r = { 0, UINT8_MAX };
+            break;
+        case ExprOpType::MEM_LOAD_U16:
+            r = { 0, UINT16_MAX };
+            break;
+        case ExprOpType::CONSTANT:
+            if (!isInteger(node.op.imm.f))
+                return;
+            r = { node.op.imm.f, node.op.imm.f };
+            break;
+        case ExprOpType::ADD:
+            if (!range(node.left, a) || !range(node.right, b))
+                return;
+            r = { a.first + b.first, a.second + b.second };
+            break;
+        case ExprOpType::SUB:
+            if (!range(node.left, a) || !range(node.right, b))
+                return;
+            r = { a.first - b.second, a.second - b.first };
+            break;
+        case ExprOpType::MUL:
+            if (!range(node.left, a) || !range(node.right, b))
+                return;
+            r = std::minmax({ a.first * b.first, a.first * b.second, a.second * b.first, a.second * b.second });
+            break;
+        case ExprOpType::FMA:
+        {
+            if (!range(node.left, a) || !range(node.right->left, b) || !range(node.right->right, c))
+                return;
+            FMAType type = static_cast<FMAType>(node.op.imm.u);
+            Range p = std::minmax({ b.first * c.first, b.first * c.second, b.second * c.first, b.second * c.second });
+
+            if (type == FMAType::FNMADD || type == FMAType::FNMSUB)
+                p = { -p.second, -p.first };
+            if (std::max(std::abs(p.first), std::abs(p.second)) > integerLimit)
+                return;
+            if (type == FMAType::FMADD || type == FMAType::FNMADD)
+                r = { p.first + a.first, p.second + a.second };
+            else
+                r = { p.first - a.second, p.second - a.first };
+            break;
+        }
+        case ExprOpType::MAX:
+            if (!range(node.left, a) || !range(node.right, b))
+                return;
+            r = { std::max(a.first, b.first), std::max(a.second, b.second) };
+            break;
+        case ExprOpType::MIN:
+            if (!range(node.left, a) || !range(node.right, b))
+                return;
+            r = { std::min(a.first, b.first), std::min(a.second, b.second) };
+            break;
+        case ExprOpType::ABS:
+            if (!range(node.left, a))
+                return;
+            if (a.first >= 0)
+                r = a;
+            else if (a.second <= 0)
+                r = { -a.second, -a.first };
+            else
+                r = { 0, std::max(-a.first, a.second) };
+            break;
+        case ExprOpType::NEG:
+            if (!range(node.left, a))
+                return;
+            r = { -a.second, -a.first };
+            break;
+        case ExprOpType::ROUND:
+            if (!range(node.left, r))
+                return;
+            break;
+        case ExprOpType::CMP:
+        case ExprOpType::AND:
+        case ExprOpType::OR:
+        case ExprOpType::XOR:
+            if (!range(node.left, a) || !range(node.right, b))
+                return;
+            r = { 0, 1 };
+            break;
+        case ExprOpType::NOT:
+            if (!range(node.left, a))
+                return;
+            r = { 0, 1 };
+            break;
+        case ExprOpType::TERNARY:
+            if (!range(node.left, a) || !range(node.right->left, b) || !range(node.right->right, c))
+                return;
+            r = { std::min(b.first, c.first), std::max(b.second, c.second) };
+            break;
+        default:
+            return;
+        }
+
+        if (std::max(std::abs(r.first), std::abs(r.second)) <= integerLimit)
+            ranges[&node] = r;
+    });
+
+    assignIntegerTypes(tree, *tree.getRoot(), integerStore, ranges);
+
+    if (tree.getRoot()->op.integer && !integerStore) {
+        ExpressionTreeNode *conv = tree.makeNode(ExprOpType::INT_TO_FLOAT);
+        conv->setLeft(tree.getRoot());
+        tree.setRoot(conv);
+    }
+}
+
 void renameRegisters(std::vector<ExprInstruction> &code)
 {
     std::unordered_map<int, int> table;
@@ -1447,78 +1698,94 @@ void renameRegisters(std::vector<ExprInstruction> &code)
     }
 }
 
-std::vector<ExprInstruction> compile(ExpressionTree &tree, const VSVideoInfo &vi, bool optimize = true)
+std::vector<ExprInstruction> compile(ExpressionTree &tree, const VSVideoInfo * const dstFormats[], bool optimize = true, unsigned disabledPasses = 0)
 {
     std::vector<ExprInstruction> code;
     std::unordered_set<int> found;
+    std::vector<ExpressionTreeNode *> roots = tree.getRoots();
+    bool algebraic = !(disabledPasses & PASS_ALGEBRAIC);
+    bool strengthReduction = !(disabledPasses & PASS_STRENGTH_REDUCTION);
+    bool opFusion = !(disabledPasses & PASS_OP_FUSION);
 
-    if (!tree.getRoot())
+    if (roots.empty())
         return code;
 
-    if (optimize) {
-        constexpr unsigned max_passes = 1000;
-        unsigned num_passes = 0;
+    for (size_t i = 0; i < roots.size(); ++i) {
+        tree.setRoot(roots[i]);
 
-        while (applyLocalOptimizations(tree) || combinePowerTerms(tree) || applyAlgebraicOptimizations(tree) || applyComparisonOptimizations(tree)) {
-            if (++num_passes > max_passes)
-                throw std::runtime_error{ "expression compilation did not complete" };
-        }
+        if (optimize) {
+            constexpr unsigned max_passes = 1000;
+            unsigned num_passes = 0;
+
+            while (applyLocalOptimizations(tree) || (algebraic && (combinePowerTerms(tree) || applyAlgebraicOptimizations(tree) || applyComparisonOptimizations(tree)))) {
+                if (++num_passes > max_passes)
+                    throw std::runtime_error{ "expression compilation did not complete" };
+            }
 
-        while (applyLocalOptimizations(tree) || applyStrengthReduction(tree) || applyOpFusion(tree)) {
-            if (++num_passes > max_passes)
-                throw std::runtime_error{ "expression compilation did not complete" };
+            while (applyLocalOptimizations(tree) || (strengthReduction && applyStrengthReduction(tree)) || (opFusion && applyOpFusion(tree))) {
+                if (++num_passes > max_passes)
+                    throw std::runtime_error{ "expression compilation did not complete" };
+            }
         }
+
+        applyIntegerTypes(tree, dstFormats[i]->format.sampleType == stInteger);
+        roots[i] = tree.getRoot();
     }
 
+    tree.setRoots(roots);
     applyValueNumbering(tree);
 
-    tree.getRoot()->postorder([&](ExpressionTreeNode &node)
-    {
-        if (node.op.type == ExprOpType::MUX)
-            return;
-        if (found.find(node.valueNum) != found.end())
-            return;
+    for (size_t i = 0; i < roots.size(); ++i) {
+        roots[i]->postorder([&](ExpressionTreeNode &node)
+        {
+            if (node.op.type == ExprOpType::MUX)
+                return;
+            if (found.find(node.valueNum) != found.end())
+                return;
 
-        ExprInstruction opcode(node.op);
-        opcode.dst = node.valueNum;
+            ExprInstruction opcode(node.op);
+            opcode.dst = node.valueNum;
 
-        if (node.left) {
-            assert(node.left->valueNum >= 0);
-            opcode.src1 = node.left->valueNum;
-        }
-        if (node.right) {
-            if (node.right->op.type == ExprOpType::MUX) {
-                assert(node.right->left->valueNum >= 0);
-                assert(node.right->right->valueNum >= 0);
-                opcode.src2 = node.right->left->valueNum;
-                opcode.src3 = node.right->right->valueNum;
-            } else {
-                assert(node.right->valueNum >= 0);
-                opcode.src2 = node.right->valueNum;
+            if (node.left) {
+                assert(node.left->valueNum >= 0);
+                opcode.src1 = node.left->valueNum;
+            }
+            if (node.right) {
+                if (node.right->op.type == ExprOpType::MUX) {
+                    assert(node.right->left->valueNum >= 0);
+                    assert(node.right->right->valueNum >= 0);
+                    opcode.src2 = node.right->left->valueNum;
+                    opcode.src3 = node.right->right->valueNum;
+                } else {
+                    assert(node.right->valueNum >= 0);
+                    opcode.src2 = node.right->valueNum;
+                }
             }
-        }
-
-        code.push_back(opcode);
-        found.insert(node.valueNum);
-    });
-
-    ExprInstruction store(ExprOpType::MEM_STORE_U8);
-    const VSVideoFormat &format = vi.format;
-
-    if (format.sampleType == stInteger && format.bytesPerSample == 1)
-        store.op.type = ExprOpType::MEM_STORE_U8;
-    else if (format.sampleType == stInteger && format.bytesPerSample == 2)
-        store.op.type = ExprOpType::MEM_STORE_U16;
-    else if (format.sampleType == stFloat && format.bytesPerSample == 2)
-        store.op.type = ExprOpType::MEM_STORE_F16;
-    else if (format.sampleType == stFloat && format.bytesPerSample == 4)
-        store.op.type = ExprOpType::MEM_STORE_F32;
-
-    if (store.op.type == ExprOpType::MEM_STORE_U16)
-        store.op.imm.u = format.bitsPerSample;
 
-    store.src1 = code.back().dst;
-    code.push_back(store);
+            code.push_back(opcode);
+            found.insert(node.valueNum);
+        });
+
+        const VSVideoFormat &format = dstFormats[i]->format;
+        ExprInstruction store(ExprOpType::MEM_STORE_U8);
+
+        if (format.sampleType == stInteger && format.bytesPerSample == 1)
+            store.op.type = ExprOpType::MEM_STORE_U8;
+        else if (format.sampleType == stInteger && format.bytesPerSample == 2)
+            store.op.type = ExprOpType::MEM_STORE_U16;
+        else if (format.sampleType == stFloat && format.bytesPerSample == 2)
+            store.op.type = ExprOpType::MEM_STORE_F16;
+        else if (format.sampleType == stFloat && format.bytesPerSample == 4)
+            store.op.type = ExprOpType::MEM_STORE_F32;
+
+        if (store.op.type == ExprOpType::MEM_STORE_U16)
+            store.op.imm.u = format.bitsPerSample;
+
+        store.src1 = roots[i]->valueNum;
+        store.op.integer = roots[i]->op.integer;
+        store.op.output = static_cast<int>(i);
+        code.push_back(store);
+    }
 
     renameRegisters(code);
     return code;
@@ -1527,10 +1794,23 @@ std::vector<ExprInstruction> compile(ExpressionTree &tree, const VSVideoInfo &vi
 } // namespace
 
 
-std::vector<ExprInstruction> compile(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo &dstFormat, bool optimize)
+std::vector<ExprInstruction> compile(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo &dstFormat, bool optimize, BoundaryCondition boundary, std::vector<FrameConstant> *constants, unsigned disabledPasses)
+{
+    const VSVideoInfo *dstFormats[] = { &dstFormat };
+    return compile(expr, srcFormats, numInputs, dstFormats, 1, optimize, boundary, constants, disabledPasses);
+}
+
+int countOutputs(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs)
+{
+    std::vector<FrameConstant> constants;
+    ExpressionTree tree = parseExpr(expr, srcFormats, numInputs, BoundaryCondition::CLAMP, &constants, 0);
+    return static_cast<int>(tree.getRoots().size());
+}
+
+std::vector<ExprInstruction> compile(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo * const dstFormats[], int numOutputs, bool optimize, BoundaryCondition boundary, std::vector<FrameConstant> *constants, unsigned disabledPasses)
 {
-    ExpressionTree tree = parseExpr(expr, srcFormats, numInputs);
-    return compile(tree, dstFormat, optimize);
+    ExpressionTree tree = parseExpr(expr, srcFormats, numInputs, boundary, constants, numOutputs);
+    return compile(tree, dstFormats, optimize, disabledPasses);
 }
 
 } // namespace expr
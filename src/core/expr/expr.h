@@ -33,11 +33,14 @@ namespace expr {
 
 enum class ExprOpType {
     // Terminals.
-    MEM_LOAD_U8, MEM_LOAD_U16, MEM_LOAD_F16, MEM_LOAD_F32, CONSTANT,
+    MEM_LOAD_U8, MEM_LOAD_U16, MEM_LOAD_F16, MEM_LOAD_F32, CONSTANT, CONST_LOAD,
     MEM_STORE_U8, MEM_STORE_U16, MEM_STORE_F16, MEM_STORE_F32,
 
     // Arithmetic primitives.
-    ADD, SUB, MUL, DIV, FMA, SQRT, ABS, NEG, MAX, MIN, CMP,
+    ADD, SUB, MUL, DIV, FMA, SQRT, ABS, NEG, ROUND, MAX, MIN, CMP,
+
+    // Conversion of an integer lane value for use by float operations.
+    INT_TO_FLOAT,
 
     // Logical operators.
     AND, OR, XOR, NOT,
@@ -71,6 +74,19 @@ enum class ComparisonType {
     NLE = 6,
 };
 
+// Bits for the disabledPasses argument of compile(), to find out which optimization made an expression slower.
+enum OptimizerPass : unsigned {
+    PASS_ALGEBRAIC = 1, // power terms, algebraic and comparison rewrites
+    PASS_STRENGTH_REDUCTION = 2,
+    PASS_OP_FUSION = 4,
+};
+
+// Edge handling of relative pixel loads, mirroring doesn't repeat the edge pixel.
+enum class BoundaryCondition {
+    CLAMP = 0,
+    MIRROR = 1,
+};
+
 union ExprUnion {
     int32_t i;
     uint32_t u;
@@ -86,13 +102,30 @@ union ExprUnion {
 struct ExprOp {
     ExprOpType type;
     ExprUnion imm;
-
-    ExprOp(ExprOpType type, ExprUnion param = {}) : type(type), imm(param) {}
+    // Position of a MEM_LOAD_* relative to the pixel being processed.
+    int dx;
+    int dy;
+    BoundaryCondition boundary;
+    // The value is an exact integer and may be computed in 32 bit integer lanes, constants still store a float.
+    bool integer;
+    // Output written by a MEM_STORE_*.
+    int output;
+
+    ExprOp(ExprOpType type, ExprUnion param = {}) : type(type), imm(param), dx(), dy(), boundary(), integer(), output() {}
 };
 
-inline bool operator==(const ExprOp &lhs, const ExprOp &rhs) { return lhs.type == rhs.type && lhs.imm.u == rhs.imm.u; }
+inline bool operator==(const ExprOp &lhs, const ExprOp &rhs) { return lhs.type == rhs.type && lhs.imm.u == rhs.imm.u && lhs.dx == rhs.dx && lhs.dy == rhs.dy && lhs.boundary == rhs.boundary && lhs.integer == rhs.integer && lhs.output == rhs.output; }
 inline bool operator!=(const ExprOp &lhs, const ExprOp &rhs) { return !(lhs == rhs); }
 
+// A value that changes per frame but not per pixel, imm of CONST_LOAD indexes the list of these.
+// The clip is -1 for the frame number.
+struct FrameConstant {
+    int clip;
+    std::string name;
+};
+
+inline bool operator==(const FrameConstant &lhs, const FrameConstant &rhs) { return lhs.clip == rhs.clip && lhs.name == rhs.name; }
+
 struct ExprInstruction {
     ExprOp op;
     int dst;
@@ -103,7 +136,13 @@ struct ExprInstruction {
     ExprInstruction(ExprOp op) : op(op), dst(-1), src1(-1), src2(-1), src3(-1) {}
 };
 
-std::vector<ExprInstruction> compile(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo &dstFormat, bool optimize = true);
+std::vector<std::string> tokenize(const std::string &expr);
+// The number of values the expression leaves on the stack.
+int countOutputs(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs);
+std::vector<ExprInstruction> compile(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo &dstFormat, bool optimize = true, BoundaryCondition boundary = BoundaryCondition::CLAMP, std::vector<FrameConstant> *constants = nullptr, unsigned disabledPasses = 0);
+// An expression with several outputs leaves one value per output on the stack, the bottom one is the first output.
+// Common subexpressions are computed once for all of them.
+std::vector<ExprInstruction> compile(const std::string &expr, const VSVideoInfo * const srcFormats[], int numInputs, const VSVideoInfo * const dstFormats[], int numOutputs, bool optimize = true, BoundaryCondition boundary = BoundaryCondition::CLAMP, std::vector<FrameConstant> *constants = nullptr, unsigned disabledPasses = 0);
 
 } // namespace expr
 
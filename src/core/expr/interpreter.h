@@ -0,0 +1,225 @@
+/*
+* Copyright (c) 2012-2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef EXPR_INTERPRETER_H
+#define EXPR_INTERPRETER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <vector>
+#include "expr.h"
+
+namespace expr {
+
+// Index of the pixel or row used for position i of n after the edge handling.
+inline int exprBoundary(int i, int n, BoundaryCondition boundary) {
+    if (boundary == BoundaryCondition::MIRROR && n > 1) {
+        int period = 2 * (n - 1);
+        i = std::abs(i) % period;
+        return i < n ? i : period - i;
+    }
+    return std::min(std::max(i, 0), n - 1);
+}
+
+class ExprInterpreter {
+    const ExprInstruction *bytecode;
+    size_t numInsns;
+    int width;
+    const float *consts;
+    std::vector<float> registers;
+
+    template <class T>
+    static T clamp_int(float x, int depth = std::numeric_limits<T>::digits)
+    {
+        float maxval = static_cast<float>((1U << depth) - 1);
+        return static_cast<T>(std::lrint(std::min(std::max(x, static_cast<float>(std::numeric_limits<T>::min())), maxval)));
+    }
+
+    static float half2float(uint16_t x)
+    {
+        uint32_t sign = static_cast<uint32_t>(x & 0x8000) << 16;
+        uint32_t exponent = (x >> 10) & 0x1F;
+        uint32_t mantissa = x & 0x3FF;
+        uint32_t bits;
+
+        if (exponent == 0) {
+            float f = std::ldexp(static_cast<float>(mantissa), -24);
+            return sign ? -f : f;
+        } else if (exponent == 0x1F) {
+            bits = sign | 0x7F800000 | (mantissa << 13);
+        } else {
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    // rounds to nearest even like the F16C conversion used by the JIT
+    static uint16_t float2half(float f)
+    {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+        bits &= 0x7FFFFFFF;
+
+        if (bits >= 0x7F800000)
+            return sign | 0x7C00 | (bits > 0x7F800000 ? 0x200 : 0);
+        if (bits < 0x38800000) {
+            float a;
+            memcpy(&a, &bits, sizeof(a));
+            return sign | static_cast<uint16_t>(std::nearbyint(a * 16777216.0f));
+        }
+        return sign | static_cast<uint16_t>((bits - 0x38000000 + 0xFFF + ((bits >> 13) & 1)) >> 13);
+    }
+
+    static float bool2float(bool x) { return x ? 1.0f : 0.0f; }
+    static bool float2bool(float x) { return x > 0.0f; }
+
+    template <class T>
+    void load(float *dst, const uint8_t *row, const ExprInstruction &insn, int x, int n) const
+    {
+        const T *src = reinterpret_cast<const T *>(row);
+        int dx = insn.op.dx;
+
+        if (x + dx >= 0 && x + dx + n <= width) {
+            src += x + dx;
+            for (int i = 0; i < n; i++)
+                dst[i] = src[i];
+        } else {
+            for (int i = 0; i < n; i++)
+                dst[i] = src[exprBoundary(x + i + dx, width, insn.op.boundary)];
+        }
+    }
+
+    void loadF16(float *dst, const uint8_t *row, const ExprInstruction &insn, int x, int n) const
+    {
+        const uint16_t *src = reinterpret_cast<const uint16_t *>(row);
+        for (int i = 0; i < n; i++) {
+            int xx = x + i + insn.op.dx;
+            dst[i] = half2float(src[insn.op.dx ? exprBoundary(xx, width, insn.op.boundary) : xx]);
+        }
+    }
+public:
+    // Pixels are evaluated in blocks so that every instruction becomes a simple loop the compiler can
+    // vectorize, this is what runs on cpus without a JIT backend.
+    static constexpr int blockSize = 64;
+
+    ExprInterpreter(const ExprInstruction *bytecode, size_t numInsns, int width, const float *consts) : bytecode(bytecode), numInsns(numInsns), width(width), consts(consts)
+    {
+        int maxreg = 0;
+        for (size_t i = 0; i < numInsns; ++i) {
+            maxreg = std::max(maxreg, bytecode[i].dst);
+        }
+        registers.resize((maxreg + 1) * blockSize);
+    }
+
+    // evaluates n <= blockSize pixels starting at x
+    void eval(const uint8_t * const *srcp, uint8_t * const *dstp, int x, int n)
+    {
+        for (size_t i = 0; i < numInsns; ++i) {
+            const ExprInstruction &insn = bytecode[i];
+            float *dst = insn.dst >= 0 ? registers.data() + insn.dst * blockSize : nullptr;
+            const float *src1 = insn.src1 >= 0 ? registers.data() + insn.src1 * blockSize : nullptr;
+            const float *src2 = insn.src2 >= 0 ? registers.data() + insn.src2 * blockSize : nullptr;
+            const float *src3 = insn.src3 >= 0 ? registers.data() + insn.src3 * blockSize : nullptr;
+
+#define UNARY(expr) for (int j = 0; j < n; j++) { float a = src1[j]; dst[j] = (expr); } break
+#define BINARY(expr) for (int j = 0; j < n; j++) { float a = src1[j]; float b = src2[j]; dst[j] = (expr); } break
+#define TERNARY(expr) for (int j = 0; j < n; j++) { float a = src1[j]; float b = src2[j]; float c = src3[j]; dst[j] = (expr); } break
+            switch (insn.op.type) {
+            case ExprOpType::MEM_LOAD_U8: load<uint8_t>(dst, srcp[insn.op.imm.u], insn, x, n); break;
+            case ExprOpType::MEM_LOAD_U16: load<uint16_t>(dst, srcp[insn.op.imm.u], insn, x, n); break;
+            case ExprOpType::MEM_LOAD_F16: loadF16(dst, srcp[insn.op.imm.u], insn, x, n); break;
+            case ExprOpType::MEM_LOAD_F32: load<float>(dst, srcp[insn.op.imm.u], insn, x, n); break;
+            case ExprOpType::CONSTANT: std::fill_n(dst, n, insn.op.imm.f); break;
+            case ExprOpType::CONST_LOAD: std::fill_n(dst, n, consts[insn.op.imm.u]); break;
+            case ExprOpType::ADD: BINARY(a + b);
+            case ExprOpType::SUB: BINARY(a - b);
+            case ExprOpType::MUL: BINARY(a * b);
+            case ExprOpType::DIV: BINARY(a / b);
+            case ExprOpType::FMA:
+                switch (static_cast<FMAType>(insn.op.imm.u)) {
+                case FMAType::FMADD: TERNARY(b * c + a);
+                case FMAType::FMSUB: TERNARY(b * c - a);
+                case FMAType::FNMADD: TERNARY(-(b * c) + a);
+                case FMAType::FNMSUB: TERNARY(-(b * c) - a);
+                };
+                break;
+            case ExprOpType::MAX: BINARY(std::max(a, b));
+            case ExprOpType::MIN: BINARY(std::min(a, b));
+            case ExprOpType::EXP: UNARY(std::exp(a));
+            case ExprOpType::LOG: UNARY(std::log(a));
+            case ExprOpType::POW: BINARY(std::pow(a, b));
+            case ExprOpType::SQRT: UNARY(std::sqrt(a));
+            case ExprOpType::SIN: UNARY(std::sin(a));
+            case ExprOpType::COS: UNARY(std::cos(a));
+            case ExprOpType::ABS: UNARY(std::fabs(a));
+            case ExprOpType::NEG: UNARY(-a);
+            case ExprOpType::ROUND: UNARY(std::nearbyint(a));
+            case ExprOpType::INT_TO_FLOAT: UNARY(a);
+            case ExprOpType::CMP:
+                switch (static_cast<ComparisonType>(insn.op.imm.u)) {
+                case ComparisonType::EQ: BINARY(bool2float(a == b));
+                case ComparisonType::LT: BINARY(bool2float(a < b));
+                case ComparisonType::LE: BINARY(bool2float(a <= b));
+                case ComparisonType::NEQ: BINARY(bool2float(a != b));
+                case ComparisonType::NLT: BINARY(bool2float(a >= b));
+                case ComparisonType::NLE: BINARY(bool2float(a > b));
+                }
+                break;
+            case ExprOpType::TERNARY: TERNARY(float2bool(a) ? b : c);
+            case ExprOpType::AND: BINARY(bool2float(float2bool(a) && float2bool(b)));
+            case ExprOpType::OR: BINARY(bool2float(float2bool(a) || float2bool(b)));
+            case ExprOpType::XOR: BINARY(bool2float(float2bool(a) != float2bool(b)));
+            case ExprOpType::NOT: UNARY(bool2float(!float2bool(a)));
+            case ExprOpType::MEM_STORE_U8:
+                for (int j = 0; j < n; j++)
+                    reinterpret_cast<uint8_t *>(dstp[insn.op.output])[x + j] = clamp_int<uint8_t>(src1[j]);
+                break;
+            case ExprOpType::MEM_STORE_U16:
+                for (int j = 0; j < n; j++)
+                    reinterpret_cast<uint16_t *>(dstp[insn.op.output])[x + j] = clamp_int<uint16_t>(src1[j], insn.op.imm.u);
+                break;
+            case ExprOpType::MEM_STORE_F16:
+                for (int j = 0; j < n; j++)
+                    reinterpret_cast<uint16_t *>(dstp[insn.op.output])[x + j] = float2half(src1[j]);
+                break;
+            case ExprOpType::MEM_STORE_F32:
+                std::copy_n(src1, n, reinterpret_cast<float *>(dstp[insn.op.output]) + x);
+                break;
+            default: fprintf(stderr, "%s", "illegal opcode\n"); std::terminate(); return;
+            }
+#undef TERNARY
+#undef BINARY
+#undef UNARY
+        }
+    }
+};
+
+} // namespace expr
+
+#endif // EXPR_INTERPRETER_H
@@ -18,11 +18,19 @@
 * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include "../cpufeatures.h"
 #include "../kernel/cpulevel.h"
 #include "jitcompiler.h"
 
+#ifdef VS_TARGET_OS_WINDOWS
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
 namespace expr {
 
 void ExprCompiler::addInstruction(const ExprInstruction &insn)
@@ -33,6 +41,7 @@ void ExprCompiler::addInstruction(const ExprInstruction &insn)
     case ExprOpType::MEM_LOAD_F16: loadF16(insn); break;
     case ExprOpType::MEM_LOAD_F32: loadF32(insn); break;
     case ExprOpType::CONSTANT: loadConst(insn); break;
+    case ExprOpType::CONST_LOAD: loadFrameConst(insn); break;
     case ExprOpType::MEM_STORE_U8: store8(insn); break;
     case ExprOpType::MEM_STORE_U16: store16(insn); break;
     case ExprOpType::MEM_STORE_F16: storeF16(insn); break;
@@ -47,11 +56,13 @@ void ExprCompiler::addInstruction(const ExprInstruction &insn)
     case ExprOpType::SQRT: sqrt(insn); break;
     case ExprOpType::ABS: abs(insn); break;
     case ExprOpType::NEG: neg(insn); break;
+    case ExprOpType::ROUND: round(insn); break;
     case ExprOpType::NOT: not_(insn); break;
     case ExprOpType::AND: and_(insn); break;
     case ExprOpType::OR: or_(insn); break;
     case ExprOpType::XOR: xor_(insn); break;
     case ExprOpType::CMP: cmp(insn); break;
+    case ExprOpType::INT_TO_FLOAT: intToFloat(insn); break;
     case ExprOpType::TERNARY: ternary(insn); break;
     case ExprOpType::EXP: exp(insn); break;
     case ExprOpType::LOG: log(insn); break;
@@ -62,17 +73,56 @@ void ExprCompiler::addInstruction(const ExprInstruction &insn)
     }
 }
 
-std::pair<ExprCompiler::ProcessLineProc, size_t> compile_jit(const ExprInstruction *bytecode, size_t numInsns, int numInputs, int cpulevel)
+std::pair<ExprCompiler::ProcessPlaneProc, size_t> make_executable(const void *code, size_t size)
+{
+	// Pages are never writable and executable at the same time, hardened systems
+	// refuse that and then the interpreter is used instead.
+#ifdef VS_TARGET_OS_WINDOWS
+	void *ptr = VirtualAlloc(nullptr, size, MEM_COMMIT, PAGE_READWRITE);
+	if (!ptr)
+		return{};
+	memcpy(ptr, code, size);
+
+	DWORD oldProtect;
+	if (!VirtualProtect(ptr, size, PAGE_EXECUTE_READ, &oldProtect)) {
+		VirtualFree(ptr, 0, MEM_RELEASE);
+		return{};
+	}
+#else
+	void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+	if (ptr == MAP_FAILED)
+		return{};
+	memcpy(ptr, code, size);
+
+	if (mprotect(ptr, size, PROT_READ | PROT_EXEC)) {
+		munmap(ptr, size);
+		return{};
+	}
+#endif
+	return{ reinterpret_cast<ExprCompiler::ProcessPlaneProc>(ptr), size };
+}
+
+std::pair<ExprCompiler::ProcessPlaneProc, size_t> compile_jit(const ExprInstruction *bytecode, size_t numInsns, int numInputs, int numPrefetch, int cpulevel)
 {
 	std::unique_ptr<ExprCompiler> compiler;
+	int numOutputs = 0;
+
+	for (size_t i = 0; i < numInsns; ++i) {
+		ExprOpType type = bytecode[i].op.type;
+		if (type == ExprOpType::MEM_STORE_U8 || type == ExprOpType::MEM_STORE_U16 || type == ExprOpType::MEM_STORE_F16 || type == ExprOpType::MEM_STORE_F32)
+			numOutputs = std::max(numOutputs, bytecode[i].op.output + 1);
+	}
 
 #ifdef VS_TARGET_CPU_X86
-	if (getCPUFeatures()->avx2 && cpulevel >= VS_CPU_LEVEL_AVX2)
-		compiler = make_ymm_compiler(numInputs);
+	if (getCPUFeatures()->avx512_f && cpulevel >= VS_CPU_LEVEL_AVX512)
+		compiler = make_zmm_compiler(numInputs, numOutputs, numPrefetch);
+	else if (getCPUFeatures()->avx2 && cpulevel >= VS_CPU_LEVEL_AVX2)
+		compiler = make_ymm_compiler(numInputs, numOutputs, numPrefetch);
 	else
-		compiler = make_xmm_compiler(numInputs);
+		compiler = make_xmm_compiler(numInputs, numOutputs, numPrefetch);
 #endif
 
+	// there's no backend for other cpus such as ARM64, callers fall back to ExprInterpreter
 	if (!compiler)
 		return{};
 
@@ -29,13 +29,15 @@ namespace expr {
 
 class ExprCompiler {
 public:
-    typedef void (*ProcessLineProc)(void *rwptrs, intptr_t ptroff[MAX_EXPR_INPUTS + 1], intptr_t niter);
+    // Processes nrows rows of niter iterations each, rwptrs holds one block of exprRowPointers() pointers per row
+    typedef void (*ProcessPlaneProc)(void *rwptrs, const intptr_t *ptroff, intptr_t niter, const float *consts, intptr_t nrows);
 private:
     virtual void load8(const ExprInstruction &insn) = 0;
     virtual void load16(const ExprInstruction &insn) = 0;
     virtual void loadF16(const ExprInstruction &insn) = 0;
     virtual void loadF32(const ExprInstruction &insn) = 0;
     virtual void loadConst(const ExprInstruction &insn) = 0;
+    virtual void loadFrameConst(const ExprInstruction &insn) = 0;
     virtual void store8(const ExprInstruction &insn) = 0;
     virtual void store16(const ExprInstruction &insn) = 0;
     virtual void storeF16(const ExprInstruction &insn) = 0;
@@ -50,11 +52,13 @@ private:
     virtual void sqrt(const ExprInstruction &insn) = 0;
     virtual void abs(const ExprInstruction &insn) = 0;
     virtual void neg(const ExprInstruction &insn) = 0;
+    virtual void round(const ExprInstruction &insn) = 0;
     virtual void not_(const ExprInstruction &insn) = 0;
     virtual void and_(const ExprInstruction &insn) = 0;
     virtual void or_(const ExprInstruction &insn) = 0;
     virtual void xor_(const ExprInstruction &insn) = 0;
     virtual void cmp(const ExprInstruction &insn) = 0;
+    virtual void intToFloat(const ExprInstruction &insn) = 0;
     virtual void ternary(const ExprInstruction &insn) = 0;
     virtual void exp(const ExprInstruction &insn) = 0;
     virtual void log(const ExprInstruction &insn) = 0;
@@ -66,15 +70,28 @@ public:
 
     void addInstruction(const ExprInstruction &insn);
 
-    virtual std::pair<ProcessLineProc, size_t> getCode() = 0;
+    virtual std::pair<ProcessPlaneProc, size_t> getCode() = 0;
 };
 
+// The number of pointers in the block of each row, padded so the blocks can be advanced a vector at a time
+inline int exprRowPointers(int numOutputs, int numInputs, int numPrefetch)
+{
+    return (numOutputs + numInputs + numPrefetch + 7) & ~7;
+}
+
 #ifdef VS_TARGET_CPU_X86
-std::unique_ptr<ExprCompiler> make_xmm_compiler(int numInputs);
-std::unique_ptr<ExprCompiler> make_ymm_compiler(int numInputs);
+std::unique_ptr<ExprCompiler> make_xmm_compiler(int numInputs, int numOutputs, int numPrefetch);
+std::unique_ptr<ExprCompiler> make_ymm_compiler(int numInputs, int numOutputs, int numPrefetch);
+std::unique_ptr<ExprCompiler> make_zmm_compiler(int numInputs, int numOutputs, int numPrefetch);
 #endif
 
-std::pair<ExprCompiler::ProcessLineProc, size_t> compile_jit(const ExprInstruction *bytecode, size_t numInsns, int numInputs, int cpulevel);
+// Copies generated code to newly allocated executable memory, returns nullptr if that isn't possible.
+std::pair<ExprCompiler::ProcessPlaneProc, size_t> make_executable(const void *code, size_t size);
+
+// The block of row pointers passed to the code starts with one per output, followed by one per input row
+// and one per row that is only prefetched. Every pointer is advanced by its entry in ptroff after each
+// iteration, the prefetched ones usually point to the row below the lowest one read from each clip.
+std::pair<ExprCompiler::ProcessPlaneProc, size_t> compile_jit(const ExprInstruction *bytecode, size_t numInsns, int numInputs, int numPrefetch, int cpulevel);
 
 } // namespace expr
 
@@ -38,10 +38,10 @@ static_assert(static_cast<int>(ComparisonType::NEQ) == _CMP_NEQ_UQ, "");
 static_assert(static_cast<int>(ComparisonType::NLT) == _CMP_NLT_US, "");
 static_assert(static_cast<int>(ComparisonType::NLE) == _CMP_NLE_US, "");
 
-class ExprCompiler128 : public ExprCompiler, private jitasm::function<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t> {
-    typedef jitasm::function<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t> jit;
-    friend struct jitasm::function<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t>;
-    friend struct jitasm::function_cdecl<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t>;
+class ExprCompiler128 : public ExprCompiler, private jitasm::function<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t, const float *, intptr_t> {
+    typedef jitasm::function<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t, const float *, intptr_t> jit;
+    friend struct jitasm::function<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t, const float *, intptr_t>;
+    friend struct jitasm::function_cdecl<void, ExprCompiler128, uint8_t *, const intptr_t *, intptr_t, const float *, intptr_t>;
 
 #define SPLAT(x) { (x), (x), (x), (x) }
     static constexpr ExprUnion constData alignas(16)[53][4] = {
@@ -160,13 +160,38 @@ class ExprCompiler128 : public ExprCompiler, private jitasm::function<void, Expr
 #undef SPLAT
 
     // JitASM compiles everything from main(), so record the operations for later.
-    std::vector<std::function<void(Reg, XmmReg, Reg, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &)>> deferred;
+    std::vector<std::function<void(Reg, XmmReg, Reg, Reg, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &)>> deferred;
 
     CPUFeatures cpuFeatures;
     int numInputs;
+    int numOutputs;
+    int numPrefetch;
+
+    // Constants and frame constants are broadcast once before the loops, at most maxInvariants of them
+    // so that enough registers are left for the expression itself.
+    struct Invariant {
+        uint32_t value; // the bits of a constant or the index of a frame constant
+        bool frameConst;
+    };
+    static constexpr size_t maxInvariants = 4;
+    std::vector<Invariant> invariants;
+    std::vector<XmmReg> invariantRegs;
+
+    // Returns the index of the invariant with the value or -1, when add is set a missing one is added if there's room
+    int findInvariant(uint32_t value, bool frameConst, bool add)
+    {
+        for (size_t i = 0; i < invariants.size(); i++) {
+            if (invariants[i].value == value && invariants[i].frameConst == frameConst)
+                return static_cast<int>(i);
+        }
+        if (!add || invariants.size() >= maxInvariants)
+            return -1;
+        invariants.push_back({ value, frameConst });
+        return static_cast<int>(invariants.size() - 1);
+    }
     int curLabel;
 
-#define EMIT() [this, insn](Reg regptrs, XmmReg zero, Reg constants, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &bytecodeRegs)
+#define EMIT() [this, insn](Reg regptrs, XmmReg zero, Reg constants, Reg consts, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &bytecodeRegs)
 #define VEX1(op, arg1, arg2) \
 do { \
   if (cpuFeatures.avx) \
@@ -224,8 +249,9 @@ do { \
         {
             auto t1 = bytecodeRegs[insn.dst];
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            VEX1(movq, t1.first, mmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + numOutputs)]);
+            int offset = insn.op.dx;
+            VEX1(movq, t1.first, mmword_ptr[a + offset]);
             VEX2(punpcklbw, t1.first, t1.first, zero);
             VEX2(punpckhwd, t1.second, t1.first, zero);
             VEX2(punpcklwd, t1.first, t1.first, zero);
@@ -240,8 +266,12 @@ do { \
         {
             auto t1 = bytecodeRegs[insn.dst];
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            VEX1(movdqa, t1.first, xmmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + numOutputs)]);
+            int offset = insn.op.dx * 2;
+            if (insn.op.dx)
+                VEX1(movdqu, t1.first, xmmword_ptr[a + offset]);
+            else
+                VEX1(movdqa, t1.first, xmmword_ptr[a + offset]);
             VEX2(punpckhwd, t1.second, t1.first, zero);
             VEX2(punpcklwd, t1.first, t1.first, zero);
             VEX1(cvtdq2ps, t1.first, t1.first);
@@ -255,9 +285,10 @@ do { \
         {
             auto t1 = bytecodeRegs[insn.dst];
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vcvtph2ps(t1.first, qword_ptr[a]);
-            vcvtph2ps(t1.second, qword_ptr[a + 8]);
+            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + numOutputs)]);
+            int offset = insn.op.dx * 2;
+            vcvtph2ps(t1.first, qword_ptr[a + offset]);
+            vcvtph2ps(t1.second, qword_ptr[a + offset + 8]);
         });
     }
 
@@ -267,14 +298,31 @@ do { \
         {
             auto t1 = bytecodeRegs[insn.dst];
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            VEX1(movdqa, t1.first, xmmword_ptr[a]);
-            VEX1(movdqa, t1.second, xmmword_ptr[a + 16]);
+            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + numOutputs)]);
+            int offset = insn.op.dx * 4;
+            if (insn.op.dx) {
+                VEX1(movdqu, t1.first, xmmword_ptr[a + offset]);
+                VEX1(movdqu, t1.second, xmmword_ptr[a + offset + 16]);
+            } else {
+                VEX1(movdqa, t1.first, xmmword_ptr[a + offset]);
+                VEX1(movdqa, t1.second, xmmword_ptr[a + offset + 16]);
+            }
         });
     }
 
     void loadConst(const ExprInstruction &insn) override
     {
+        if (insn.op.imm.f != 0.0f && findInvariant(insn.op.imm.u, false, true) >= 0) {
+            deferred.push_back(EMIT()
+            {
+                auto t1 = bytecodeRegs[insn.dst];
+                XmmReg value = invariantRegs[findInvariant(insn.op.imm.u, false, false)];
+                VEX1(movaps, t1.first, value);
+                VEX1(movaps, t1.second, value);
+            });
+            return;
+        }
+
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
@@ -293,6 +341,28 @@ do { \
         });
     }
 
+    void loadFrameConst(const ExprInstruction &insn) override
+    {
+        if (findInvariant(insn.op.imm.u, true, true) >= 0) {
+            deferred.push_back(EMIT()
+            {
+                auto t1 = bytecodeRegs[insn.dst];
+                XmmReg value = invariantRegs[findInvariant(insn.op.imm.u, true, false)];
+                VEX1(movaps, t1.first, value);
+                VEX1(movaps, t1.second, value);
+            });
+            return;
+        }
+
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            VEX1(movss, t1.first, dword_ptr[consts + sizeof(float) * insn.op.imm.u]);
+            VEX2IMM(shufps, t1.first, t1.first, t1.first, 0);
+            VEX1(movaps, t1.second, t1.first);
+        });
+    }
+
     void store8(const ExprInstruction &insn) override
     {
         deferred.push_back(EMIT()
@@ -307,7 +377,7 @@ do { \
             VEX1(cvtps2dq, r2, r2);
             VEX2(packssdw, r1, r1, r2);
             VEX2(packuswb, r1, r1, zero);
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * insn.op.output]);
             VEX1(movq, mmword_ptr[a], r1);
         });
     }
@@ -339,7 +409,7 @@ do { \
                 if (depth >= 16)
                     VEX2(psubw, r1, r1, xmmword_ptr[constants + ConstantIndex::i16min_epi16 * 16]);
             }
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * insn.op.output]);
             VEX1(movaps, xmmword_ptr[a], r1);
         });
     }
@@ -351,7 +421,7 @@ do { \
             auto t1 = bytecodeRegs[insn.src1];
 
             Reg a;
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * insn.op.output]);
             vcvtps2ph(qword_ptr[a], t1.first, 0);
             vcvtps2ph(qword_ptr[a + 8], t1.second, 0);
         });
@@ -364,7 +434,7 @@ do { \
             auto t1 = bytecodeRegs[insn.src1];
 
             Reg a;
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * insn.op.output]);
             VEX1(movaps, xmmword_ptr[a], t1.first);
             VEX1(movaps, xmmword_ptr[a + 16], t1.second);
         });
@@ -529,6 +599,43 @@ do { \
         });
     }
 
+    void round(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.dst];
+
+            if (cpuFeatures.avx) {
+                vroundps(t2.first, t1.first, 0);
+                vroundps(t2.second, t1.second, 0);
+            } else if (cpuFeatures.sse4_1) {
+                roundps(t2.first, t1.first, 0);
+                roundps(t2.second, t1.second, 0);
+            } else {
+                // values this large are already integers and wouldn't survive the conversion
+                XmmReg r1, r2, limit, mask;
+                VEX1(movaps, limit, xmmword_ptr[constants + ConstantIndex::float_rintf * 16]);
+
+                VEX1(cvtps2dq, r1, t1.first);
+                VEX1(cvtdq2ps, r1, r1);
+                VEX2(andps, mask, t1.first, xmmword_ptr[constants + ConstantIndex::absmask * 16]);
+                VEX2IMM(cmpps, mask, mask, limit, _CMP_LT_OQ);
+                VEX2(andps, r1, r1, mask);
+                VEX2(andnps, mask, mask, t1.first);
+                VEX2(orps, t2.first, r1, mask);
+
+                VEX1(cvtps2dq, r2, t1.second);
+                VEX1(cvtdq2ps, r2, r2);
+                VEX2(andps, mask, t1.second, xmmword_ptr[constants + ConstantIndex::absmask * 16]);
+                VEX2IMM(cmpps, mask, mask, limit, _CMP_LT_OQ);
+                VEX2(andps, r2, r2, mask);
+                VEX2(andnps, mask, mask, t1.second);
+                VEX2(orps, t2.second, r2, mask);
+            }
+        });
+    }
+
     void not_(const ExprInstruction &insn) override
     {
         deferred.push_back(EMIT()
@@ -602,6 +709,18 @@ do { \
         });
     }
 
+    void intToFloat(const ExprInstruction &insn) override
+    {
+        // Integer typing is not used at this level, values are already float.
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.dst];
+            VEX1(movaps, t2.first, t1.first);
+            VEX1(movaps, t2.second, t1.second);
+        });
+    }
+
     void ternary(const ExprInstruction &insn) override
     {
         deferred.push_back(EMIT()
@@ -713,7 +832,7 @@ do { \
     {
         int l = curLabel++;
 
-        deferred.push_back([this, insn, l](Reg regptrs, XmmReg zero, Reg constants, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &bytecodeRegs)
+        deferred.push_back([this, insn, l](Reg regptrs, XmmReg zero, Reg constants, Reg consts, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &bytecodeRegs)
         {
             char label[] = "label-0000";
             sprintf(label, "label-%04d", l);
@@ -743,7 +862,7 @@ do { \
     {
         int l = curLabel++;
 
-        deferred.push_back([this, insn, l](Reg regptrs, XmmReg zero, Reg constants, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &bytecodeRegs)
+        deferred.push_back([this, insn, l](Reg regptrs, XmmReg zero, Reg constants, Reg consts, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &bytecodeRegs)
         {
             char label[] = "label-0000";
             sprintf(label, "label-%04d", l);
@@ -773,7 +892,7 @@ do { \
     {
         int l = curLabel++;
 
-        deferred.push_back([this, insn, l](Reg regptrs, XmmReg zero, Reg constants, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &bytecodeRegs)
+        deferred.push_back([this, insn, l](Reg regptrs, XmmReg zero, Reg constants, Reg consts, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &bytecodeRegs)
         {
             char label[] = "label-0000";
             sprintf(label, "label-%04d", l);
@@ -892,7 +1011,7 @@ do { \
     {
         int l = curLabel++;
 
-        deferred.push_back([this, issin, insn, l](Reg regptrs, XmmReg zero, Reg constants, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &bytecodeRegs)
+        deferred.push_back([this, issin, insn, l](Reg regptrs, XmmReg zero, Reg constants, Reg consts, std::unordered_map<int, std::pair<XmmReg, XmmReg>> &bytecodeRegs)
         {
             char label[] = "label-0000";
             sprintf(label, "label-%04d", l);
@@ -928,7 +1047,7 @@ do { \
         sincos(false, insn);
     }
 
-    void main(Reg regptrs, Reg regoffs, Reg niter)
+    void main(Reg regptrs, Reg regoffs, Reg niter, Reg consts, Reg nrows)
     {
         std::unordered_map<int, std::pair<XmmReg, XmmReg>> bytecodeRegs;
         XmmReg zero;
@@ -936,14 +1055,38 @@ do { \
         Reg constants;
         mov(constants, (uintptr_t)constData);
 
+        invariantRegs.clear();
+        for (const auto &c : invariants) {
+            XmmReg r;
+            if (c.frameConst) {
+                VEX1(movss, r, dword_ptr[consts + sizeof(float) * c.value]);
+            } else {
+                Reg32 a;
+                mov(a, c.value);
+                VEX1(movd, r, a);
+            }
+            VEX2IMM(shufps, r, r, r, 0);
+            invariantRegs.push_back(r);
+        }
+
+        L("hloop");
+        Reg count;
+        mov(count, niter);
+
         L("wloop");
 
         for (const auto &f : deferred) {
-            f(regptrs, zero, constants, bytecodeRegs);
+            f(regptrs, zero, constants, consts, bytecodeRegs);
+        }
+
+        for (int i = 0; i < numPrefetch; i++) {
+            Reg a;
+            mov(a, ptr[regptrs + sizeof(void *) * (numOutputs + numInputs + i)]);
+            prefetcht0(byte_ptr[a]);
         }
 
 #if UINTPTR_MAX > UINT32_MAX
-        for (int i = 0; i < numInputs / 2 + 1; i++) {
+        for (int i = 0; i < (numInputs + numOutputs + numPrefetch - 1) / 2 + 1; i++) {
             XmmReg r1, r2;
             VEX1(movdqu, r1, xmmword_ptr[regptrs + 16 * i]);
             VEX1(movdqu, r2, xmmword_ptr[regoffs + 16 * i]);
@@ -951,7 +1094,7 @@ do { \
             VEX1(movdqu, xmmword_ptr[regptrs + 16 * i], r1);
         }
 #else
-        for (int i = 0; i < numInputs / 4 + 1; i++) {
+        for (int i = 0; i < (numInputs + numOutputs + numPrefetch - 1) / 4 + 1; i++) {
             XmmReg r1, r2;
             VEX1(movdqu, r1, xmmword_ptr[regptrs + 16 * i]);
             VEX1(movdqu, r2, xmmword_ptr[regoffs + 16 * i]);
@@ -960,25 +1103,22 @@ do { \
         }
 #endif
 
-        jit::sub(niter, 1);
+        jit::sub(count, 1);
         jnz("wloop");
+
+        jit::add(regptrs, static_cast<int>(sizeof(void *) * exprRowPointers(numOutputs, numInputs, numPrefetch)));
+        jit::sub(nrows, 1);
+        jnz("hloop");
     }
 
 public:
-    explicit ExprCompiler128(int numInputs) : cpuFeatures(*getCPUFeatures()), numInputs(numInputs), curLabel() {}
+    ExprCompiler128(int numInputs, int numOutputs, int numPrefetch) : cpuFeatures(*getCPUFeatures()), numInputs(numInputs), numOutputs(numOutputs), numPrefetch(numPrefetch), curLabel() {}
 
-    std::pair<ProcessLineProc, size_t> getCode() override
+    std::pair<ProcessPlaneProc, size_t> getCode() override
     {
         size_t size;
-        if (jit::GetCode() && (size = GetCodeSize())) {
-#ifdef VS_TARGET_OS_WINDOWS
-            void *ptr = VirtualAlloc(nullptr, size, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-#else
-            void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANON | MAP_PRIVATE, 0, 0);
-#endif
-            memcpy(ptr, jit::GetCode(), size);
-            return { reinterpret_cast<ProcessLineProc>(ptr), size };
-        }
+        if (jit::GetCode() && (size = GetCodeSize()))
+            return make_executable(jit::GetCode(), size);
         return { nullptr, 0 };
     }
 #undef VEX2IMM
@@ -990,13 +1130,13 @@ public:
 
 constexpr ExprUnion ExprCompiler128::constData alignas(16)[53][4];
 
-class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t> {
-    typedef jitasm::function<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t> jit;
-    friend struct jitasm::function<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t>;
-    friend struct jitasm::function_cdecl<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t>;
+class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t, const float *, intptr_t> {
+    typedef jitasm::function<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t, const float *, intptr_t> jit;
+    friend struct jitasm::function<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t, const float *, intptr_t>;
+    friend struct jitasm::function_cdecl<void, ExprCompiler256, uint8_t *, const intptr_t *, intptr_t, const float *, intptr_t>;
 
 #define SPLAT(x) { (x), (x), (x), (x), (x), (x), (x), (x) }
-    static constexpr ExprUnion constData alignas(32)[53][8] = {
+    static constexpr ExprUnion constData alignas(32)[63][8] = {
         SPLAT(0x7FFFFFFF), // absmask
         SPLAT(0x80000000), // negmask
         SPLAT(0x7F), // x7F
@@ -1050,6 +1190,16 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         SPLAT(0x3D2AA73C), // float_cosC4
         SPLAT(static_cast<int32_t>(0XBAB58D50)), // float_cosC6
         SPLAT(0x37C1AD76), // float_cosC8
+        SPLAT(1), // int_one
+        SPLAT(255), // int_255
+        SPLAT(511), // int_511
+        SPLAT(1023), // int_1023
+        SPLAT(2047), // int_2047
+        SPLAT(4095), // int_4095
+        SPLAT(8191), // int_8191
+        SPLAT(16383), // int_16383
+        SPLAT(32767), // int_32767
+        SPLAT(65535), // int_65535
     };
 
     struct ConstantIndex {
@@ -1108,17 +1258,52 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         static constexpr int float_cosC4 = float_cosC2 + 1;
         static constexpr int float_cosC6 = float_cosC2 + 2;
         static constexpr int float_cosC8 = float_cosC2 + 3;
+        static constexpr int int_one = 53;
+        static constexpr int int_255 = 54;
+        static constexpr int int_511 = 55;
+        static constexpr int int_1023 = 56;
+        static constexpr int int_2047 = 57;
+        static constexpr int int_4095 = 58;
+        static constexpr int int_8191 = 59;
+        static constexpr int int_16383 = 60;
+        static constexpr int int_32767 = 61;
+        static constexpr int int_65535 = 62;
     };
 #undef SPLAT
 
     // JitASM compiles everything from main(), so record the operations for later.
-    std::vector<std::function<void(Reg, YmmReg, Reg, std::unordered_map<int, YmmReg> &)>> deferred;
+    std::vector<std::function<void(Reg, YmmReg, Reg, Reg, std::unordered_map<int, YmmReg> &)>> deferred;
 
     CPUFeatures cpuFeatures;
     int numInputs;
+    int numOutputs;
+    int numPrefetch;
+
+    // Constants and frame constants are broadcast once before the loops, at most maxInvariants of them
+    // so that enough registers are left for the expression itself.
+    struct Invariant {
+        uint32_t value; // the bits of a constant or the index of a frame constant
+        bool frameConst;
+    };
+    static constexpr size_t maxInvariants = 6;
+    std::vector<Invariant> invariants;
+    std::vector<YmmReg> invariantRegs;
+
+    // Returns the index of the invariant with the value or -1, when add is set a missing one is added if there's room
+    int findInvariant(uint32_t value, bool frameConst, bool add)
+    {
+        for (size_t i = 0; i < invariants.size(); i++) {
+            if (invariants[i].value == value && invariants[i].frameConst == frameConst)
+                return static_cast<int>(i);
+        }
+        if (!add || invariants.size() >= maxInvariants)
+            return -1;
+        invariants.push_back({ value, frameConst });
+        return static_cast<int>(invariants.size() - 1);
+    }
     int curLabel;
 
-#define EMIT() [this, insn](Reg regptrs, YmmReg zero, Reg constants, std::unordered_map<int, YmmReg> &bytecodeRegs)
+#define EMIT() [this, insn](Reg regptrs, YmmReg zero, Reg constants, Reg consts, std::unordered_map<int, YmmReg> &bytecodeRegs)
 
     void load8(const ExprInstruction &insn) override
     {
@@ -1126,9 +1311,11 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         {
             auto t1 = bytecodeRegs[insn.dst];
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vpmovzxbd(t1, mmword_ptr[a]);
-            vcvtdq2ps(t1, t1);
+            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + numOutputs)]);
+            int offset = insn.op.dx;
+            vpmovzxbd(t1, mmword_ptr[a + offset]);
+            if (!insn.op.integer)
+                vcvtdq2ps(t1, t1);
         });
     }
 
@@ -1138,9 +1325,11 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         {
             auto t1 = bytecodeRegs[insn.dst];
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vpmovzxwd(t1, xmmword_ptr[a]);
-            vcvtdq2ps(t1, t1);
+            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + numOutputs)]);
+            int offset = insn.op.dx * 2;
+            vpmovzxwd(t1, xmmword_ptr[a + offset]);
+            if (!insn.op.integer)
+                vcvtdq2ps(t1, t1);
         });
     }
 
@@ -1150,8 +1339,9 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         {
             auto t1 = bytecodeRegs[insn.dst];
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vcvtph2ps(t1, xmmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + numOutputs)]);
+            int offset = insn.op.dx * 2;
+            vcvtph2ps(t1, xmmword_ptr[a + offset]);
         });
     }
 
@@ -1161,13 +1351,32 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         {
             auto t1 = bytecodeRegs[insn.dst];
             Reg a;
-            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + 1)]);
-            vmovaps(t1, ymmword_ptr[a]);
+            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + numOutputs)]);
+            int offset = insn.op.dx * 4;
+            if (insn.op.dx)
+                vmovups(t1, ymmword_ptr[a + offset]);
+            else
+                vmovaps(t1, ymmword_ptr[a + offset]);
         });
     }
 
+    // Integer constants are splatted as int32 lanes.
+    static uint32_t constBits(const ExprInstruction &insn)
+    {
+        return insn.op.integer ? static_cast<uint32_t>(static_cast<int32_t>(insn.op.imm.f)) : insn.op.imm.u;
+    }
+
     void loadConst(const ExprInstruction &insn) override
     {
+        if (insn.op.imm.f != 0.0f && findInvariant(constBits(insn), false, true) >= 0) {
+            deferred.push_back(EMIT()
+            {
+                auto t1 = bytecodeRegs[insn.dst];
+                vmovaps(t1, invariantRegs[findInvariant(constBits(insn), false, false)]);
+            });
+            return;
+        }
+
         deferred.push_back(EMIT()
         {
             auto t1 = bytecodeRegs[insn.dst];
@@ -1179,12 +1388,30 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
 
             XmmReg r1;
             Reg32 a;
-            mov(a, insn.op.imm.u);
+            mov(a, constBits(insn));
             vmovd(r1, a);
             vbroadcastss(t1, r1);
         });
     }
 
+    void loadFrameConst(const ExprInstruction &insn) override
+    {
+        if (findInvariant(insn.op.imm.u, true, true) >= 0) {
+            deferred.push_back(EMIT()
+            {
+                auto t1 = bytecodeRegs[insn.dst];
+                vmovaps(t1, invariantRegs[findInvariant(insn.op.imm.u, true, false)]);
+            });
+            return;
+        }
+
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            vbroadcastss(t1, dword_ptr[consts + sizeof(float) * insn.op.imm.u]);
+        });
+    }
+
     void store8(const ExprInstruction &insn) override
     {
         deferred.push_back(EMIT()
@@ -1192,12 +1419,16 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
             auto t1 = bytecodeRegs[insn.src1];
             YmmReg r1;
             Reg a;
-            vminps(r1, t1, ymmword_ptr[constants + ConstantIndex::float_255 * 32]);
-            vcvtps2dq(r1, r1);
-            vpackssdw(r1, r1, r1);
+            if (insn.op.integer) {
+                vpackssdw(r1, t1, t1);
+            } else {
+                vminps(r1, t1, ymmword_ptr[constants + ConstantIndex::float_255 * 32]);
+                vcvtps2dq(r1, r1);
+                vpackssdw(r1, r1, r1);
+            }
             vpermq(r1, r1, 0x08);
             vpackuswb(r1, r1, zero);
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * insn.op.output]);
             vmovq(qword_ptr[a], r1.as128());
         });
     }
@@ -1210,11 +1441,15 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
             auto t1 = bytecodeRegs[insn.src1];
             YmmReg r1, limit;
             Reg a;
-            vminps(r1, t1, ymmword_ptr[constants + (ConstantIndex::float_255 + depth - 8) * 32]);
-            vcvtps2dq(r1, r1);
+            if (insn.op.integer) {
+                vpminsd(r1, t1, ymmword_ptr[constants + (ConstantIndex::int_255 + depth - 8) * 32]);
+            } else {
+                vminps(r1, t1, ymmword_ptr[constants + (ConstantIndex::float_255 + depth - 8) * 32]);
+                vcvtps2dq(r1, r1);
+            }
             vpackusdw(r1, r1, r1);
             vpermq(r1, r1, 0x08);
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * insn.op.output]);
             vmovaps(xmmword_ptr[a], r1.as128());
         });
     }
@@ -1225,7 +1460,7 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         {
             auto t1 = bytecodeRegs[insn.src1];
             Reg a;
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * insn.op.output]);
             vcvtps2ph(xmmword_ptr[a], t1, 0);
         });
     }
@@ -1236,7 +1471,7 @@ class ExprCompiler256 : public ExprCompiler, private jitasm::function<void, Expr
         {
             auto t1 = bytecodeRegs[insn.src1];
             Reg a;
-            mov(a, ptr[regptrs]);
+            mov(a, ptr[regptrs + sizeof(void *) * insn.op.output]);
             vmovaps(ymmword_ptr[a], t1);
         });
     }
@@ -1252,7 +1487,10 @@ do { \
     {
         deferred.push_back(EMIT()
         {
-            BINARYOP(vaddps);
+            if (insn.op.integer)
+                BINARYOP(vpaddd);
+            else
+                BINARYOP(vaddps);
         });
     }
 
@@ -1260,7 +1498,10 @@ do { \
     {
         deferred.push_back(EMIT()
         {
-            BINARYOP(vsubps);
+            if (insn.op.integer)
+                BINARYOP(vpsubd);
+            else
+                BINARYOP(vsubps);
         });
     }
 
@@ -1268,7 +1509,10 @@ do { \
     {
         deferred.push_back(EMIT()
         {
-            BINARYOP(vmulps);
+            if (insn.op.integer)
+                BINARYOP(vpmulld);
+            else
+                BINARYOP(vmulps);
         });
     }
 
@@ -1292,6 +1536,18 @@ do { \
             auto t3 = bytecodeRegs[insn.src3];
             auto t4 = bytecodeRegs[insn.dst];
 
+            if (insn.op.integer) {
+                YmmReg r1;
+                vpmulld(r1, t2, t3);
+                switch (type) {
+                case FMAType::FMADD: vpaddd(t4, r1, t1); break;
+                case FMAType::FMSUB: vpsubd(t4, r1, t1); break;
+                case FMAType::FNMADD: vpsubd(t4, t1, r1); break;
+                case FMAType::FNMSUB: vpaddd(r1, r1, t1); vpsubd(t4, zero, r1); break;
+                }
+                return;
+            }
+
 #define FMA3(op) \
 do { \
   if (insn.dst == insn.src1) { \
@@ -1319,7 +1575,10 @@ do { \
     {
         deferred.push_back(EMIT()
         {
-            BINARYOP(vmaxps);
+            if (insn.op.integer)
+                BINARYOP(vpmaxsd);
+            else
+                BINARYOP(vmaxps);
         });
     }
 
@@ -1327,7 +1586,10 @@ do { \
     {
         deferred.push_back(EMIT()
         {
-            BINARYOP(vminps);
+            if (insn.op.integer)
+                BINARYOP(vpminsd);
+            else
+                BINARYOP(vminps);
         });
     }
 #undef BINARYOP
@@ -1349,7 +1611,10 @@ do { \
         {
             auto t1 = bytecodeRegs[insn.src1];
             auto t2 = bytecodeRegs[insn.dst];
-            vandps(t2, t1, ymmword_ptr[constants + ConstantIndex::absmask * 32]);
+            if (insn.op.integer)
+                vpabsd(t2, t1);
+            else
+                vandps(t2, t1, ymmword_ptr[constants + ConstantIndex::absmask * 32]);
         });
     }
 
@@ -1359,7 +1624,23 @@ do { \
         {
             auto t1 = bytecodeRegs[insn.src1];
             auto t2 = bytecodeRegs[insn.dst];
-            vxorps(t2, t1, ymmword_ptr[constants + ConstantIndex::negmask * 32]);
+            if (insn.op.integer)
+                vpsubd(t2, zero, t1);
+            else
+                vxorps(t2, t1, ymmword_ptr[constants + ConstantIndex::negmask * 32]);
+        });
+    }
+
+    void round(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.dst];
+            if (insn.op.integer)
+                vmovaps(t2, t1);
+            else
+                vroundps(t2, t1, 0);
         });
     }
 
@@ -1369,9 +1650,13 @@ do { \
         {
             auto t1 = bytecodeRegs[insn.src1];
             auto t2 = bytecodeRegs[insn.dst];
-            YmmReg r1;
-            vcmpps(t2, t1, zero, _CMP_LE_OS);
-            vandps(t2, t2, ymmword_ptr[constants + ConstantIndex::float_one * 32]);
+            if (insn.op.integer) {
+                vpcmpgtd(t2, t1, zero);
+                vpandn(t2, t2, ymmword_ptr[constants + ConstantIndex::int_one * 32]);
+            } else {
+                vcmpps(t2, t1, zero, _CMP_LE_OS);
+                vandps(t2, t2, ymmword_ptr[constants + ConstantIndex::float_one * 32]);
+            }
         });
     }
 
@@ -1387,11 +1672,26 @@ do { \
   vandps(t3, t3, ymmword_ptr[constants + ConstantIndex::float_one * 32]); \
 } while (0)
 
+#define INTLOGICOP(op) \
+do { \
+  auto t1 = bytecodeRegs[insn.src1]; \
+  auto t2 = bytecodeRegs[insn.src2]; \
+  auto t3 = bytecodeRegs[insn.dst]; \
+  YmmReg tmp; \
+  vpcmpgtd(tmp, t1, zero); \
+  vpcmpgtd(t3, t2, zero); \
+  op(t3, t3, tmp); \
+  vpand(t3, t3, ymmword_ptr[constants + ConstantIndex::int_one * 32]); \
+} while (0)
+
     void and_(const ExprInstruction &insn) override
     {
         deferred.push_back(EMIT()
         {
-            LOGICOP(vandps);
+            if (insn.op.integer)
+                INTLOGICOP(vpand);
+            else
+                LOGICOP(vandps);
         });
     }
 
@@ -1399,7 +1699,10 @@ do { \
     {
         deferred.push_back(EMIT()
         {
-            LOGICOP(vorps);
+            if (insn.op.integer)
+                INTLOGICOP(vpor);
+            else
+                LOGICOP(vorps);
         });
     }
 
@@ -1407,9 +1710,13 @@ do { \
     {
         deferred.push_back(EMIT()
         {
-            LOGICOP(vxorps);
+            if (insn.op.integer)
+                INTLOGICOP(vpxor);
+            else
+                LOGICOP(vxorps);
         });
     }
+#undef INTLOGICOP
 #undef LOGICOP
 
     void cmp(const ExprInstruction &insn) override
@@ -1419,11 +1726,36 @@ do { \
             auto t1 = bytecodeRegs[insn.src1];
             auto t2 = bytecodeRegs[insn.src2];
             auto t3 = bytecodeRegs[insn.dst];
+
+            if (insn.op.integer) {
+                // Only equality and greater than exist, the other predicates swap operands or invert.
+                auto one = ymmword_ptr[constants + ConstantIndex::int_one * 32];
+                switch (static_cast<ComparisonType>(insn.op.imm.u)) {
+                case ComparisonType::EQ: vpcmpeqd(t3, t1, t2); vpand(t3, t3, one); break;
+                case ComparisonType::NEQ: vpcmpeqd(t3, t1, t2); vpandn(t3, t3, one); break;
+                case ComparisonType::LT: vpcmpgtd(t3, t2, t1); vpand(t3, t3, one); break;
+                case ComparisonType::NLT: vpcmpgtd(t3, t2, t1); vpandn(t3, t3, one); break;
+                case ComparisonType::LE: vpcmpgtd(t3, t1, t2); vpandn(t3, t3, one); break;
+                case ComparisonType::NLE: vpcmpgtd(t3, t1, t2); vpand(t3, t3, one); break;
+                }
+                return;
+            }
+
             vcmpps(t3, t1, t2, insn.op.imm.u);
             vandps(t3, t3, ymmword_ptr[constants + ConstantIndex::float_one * 32]);
         });
     }
 
+    void intToFloat(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.dst];
+            vcvtdq2ps(t2, t1);
+        });
+    }
+
     void ternary(const ExprInstruction &insn) override
     {
         deferred.push_back(EMIT()
@@ -1433,7 +1765,10 @@ do { \
             auto t3 = bytecodeRegs[insn.src3];
             auto t4 = bytecodeRegs[insn.dst];
             YmmReg r1;
-            vcmpps(r1, t1, zero, _CMP_NLE_US);
+            if (insn.op.integer)
+                vpcmpgtd(r1, t1, zero);
+            else
+                vcmpps(r1, t1, zero, _CMP_NLE_US);
             vblendvps(t4, t3, t2, r1);
         });
     }
@@ -1610,7 +1945,7 @@ do { \
         });
     }
 
-    void main(Reg regptrs, Reg regoffs, Reg niter)
+    void main(Reg regptrs, Reg regoffs, Reg niter, Reg consts, Reg nrows)
     {
         std::unordered_map<int, YmmReg> bytecodeRegs;
         YmmReg zero;
@@ -1618,14 +1953,39 @@ do { \
         Reg constants;
         mov(constants, (uintptr_t)constData);
 
+        invariantRegs.clear();
+        for (const auto &c : invariants) {
+            YmmReg r;
+            if (c.frameConst) {
+                vbroadcastss(r, dword_ptr[consts + sizeof(float) * c.value]);
+            } else {
+                XmmReg r1;
+                Reg32 a;
+                mov(a, c.value);
+                vmovd(r1, a);
+                vbroadcastss(r, r1);
+            }
+            invariantRegs.push_back(r);
+        }
+
+        L("hloop");
+        Reg count;
+        mov(count, niter);
+
         L("wloop");
 
         for (const auto &f : deferred) {
-            f(regptrs, zero, constants, bytecodeRegs);
+            f(regptrs, zero, constants, consts, bytecodeRegs);
+        }
+
+        for (int i = 0; i < numPrefetch; i++) {
+            Reg a;
+            mov(a, ptr[regptrs + sizeof(void *) * (numOutputs + numInputs + i)]);
+            prefetcht0(byte_ptr[a]);
         }
 
 #if UINTPTR_MAX > UINT32_MAX
-        for (int i = 0; i < numInputs / 4 + 1; i++) {
+        for (int i = 0; i < (numInputs + numOutputs + numPrefetch - 1) / 4 + 1; i++) {
             YmmReg r1, r2;
             vmovdqu(r1, ymmword_ptr[regptrs + 32 * i]);
             vmovdqu(r2, ymmword_ptr[regoffs + 32 * i]);
@@ -1633,7 +1993,7 @@ do { \
             vmovdqu(ymmword_ptr[regptrs + 32 * i], r1);
         }
 #else
-        for (int i = 0; i < numInputs / 8 + 1; i++) {
+        for (int i = 0; i < (numInputs + numOutputs + numPrefetch - 1) / 8 + 1; i++) {
             YmmReg r1, r2;
             vmovdqu(r1, ymmword_ptr[regptrs + 32 * i]);
             vmovdqu(r2, ymmword_ptr[regoffs + 32 * i]);
@@ -1642,43 +2002,925 @@ do { \
         }
 #endif
 
-        jit::sub(niter, 1);
+        jit::sub(count, 1);
         jnz("wloop");
+
+        jit::add(regptrs, static_cast<int>(sizeof(void *) * exprRowPointers(numOutputs, numInputs, numPrefetch)));
+        jit::sub(nrows, 1);
+        jnz("hloop");
     }
 
 public:
-    explicit ExprCompiler256(int numInputs) : cpuFeatures(*getCPUFeatures()), numInputs(numInputs) {}
+    ExprCompiler256(int numInputs, int numOutputs, int numPrefetch) : cpuFeatures(*getCPUFeatures()), numInputs(numInputs), numOutputs(numOutputs), numPrefetch(numPrefetch) {}
 
-    std::pair<ProcessLineProc, size_t> getCode() override
+    std::pair<ProcessPlaneProc, size_t> getCode() override
     {
         size_t size;
-        if (jit::GetCode(true) && (size = GetCodeSize())) {
-#ifdef VS_TARGET_OS_WINDOWS
-            void *ptr = VirtualAlloc(nullptr, size, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-#else
-            void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANON | MAP_PRIVATE, 0, 0);
-#endif
-            memcpy(ptr, jit::GetCode(true), size);
-            return { reinterpret_cast<ProcessLineProc>(ptr), size };
-        }
+        if (jit::GetCode(true) && (size = GetCodeSize()))
+            return make_executable(jit::GetCode(true), size);
         return { nullptr, 0 };
     }
 #undef EMIT
 };
 
-constexpr ExprUnion ExprCompiler256::constData alignas(32)[53][8];
+constexpr ExprUnion ExprCompiler256::constData alignas(32)[63][8];
 
+class ExprCompiler512 : public ExprCompiler, private jitasm::function<void, ExprCompiler512, uint8_t *, const intptr_t *, intptr_t, const float *, intptr_t> {
+    typedef jitasm::function<void, ExprCompiler512, uint8_t *, const intptr_t *, intptr_t, const float *, intptr_t> jit;
+    friend struct jitasm::function<void, ExprCompiler512, uint8_t *, const intptr_t *, intptr_t, const float *, intptr_t>;
+    friend struct jitasm::function_cdecl<void, ExprCompiler512, uint8_t *, const intptr_t *, intptr_t, const float *, intptr_t>;
 
-} // namespace
+#define SPLAT(x) { (x), (x), (x), (x), (x), (x), (x), (x), (x), (x), (x), (x), (x), (x), (x), (x) }
+    static constexpr ExprUnion constData alignas(64)[63][16] = {
+        SPLAT(0x7FFFFFFF), // absmask
+        SPLAT(0x80000000), // negmask
+        SPLAT(0x7F), // x7F
+        SPLAT(0x00800000), // min_norm_pos
+        SPLAT(~0x7F800000), // inv_mant_mask
+        SPLAT(1.0f), // float_one
+        SPLAT(0.5f), // float_half
+        SPLAT(255.0f), // float_255
+        SPLAT(511.0f), // float_511
+        SPLAT(1023.0f), // float_1023
+        SPLAT(2047.0f), // float_2047
+        SPLAT(4095.0f), // float_4095
+        SPLAT(8191.0f), // float_8191
+        SPLAT(16383.0f), // float_16383
+        SPLAT(32767.0f), // float_32767
+        SPLAT(65535.0f), // float_65535
+        SPLAT(static_cast<int32_t>(0x80008000)), // i16min_epi16
+        SPLAT(static_cast<int32_t>(0xFFFF8000)), // i16min_epi32
+        SPLAT(88.3762626647949f), // exp_hi
+        SPLAT(-88.3762626647949f), // exp_lo
+        SPLAT(1.44269504088896341f), // log2e
+        SPLAT(0.693359375f), // exp_c1
+        SPLAT(-2.12194440e-4f), // exp_c2
+        SPLAT(1.9875691500E-4f), // exp_p0
+        SPLAT(1.3981999507E-3f), // exp_p1
+        SPLAT(8.3334519073E-3f), // exp_p2
+        SPLAT(4.1665795894E-2f), // exp_p3
+        SPLAT(1.6666665459E-1f), // exp_p4
+        SPLAT(5.0000001201E-1f), // exp_p5
+        SPLAT(0.707106781186547524f), // sqrt_1_2
+        SPLAT(7.0376836292E-2f), // log_p0
+        SPLAT(-1.1514610310E-1f), // log_p1
+        SPLAT(1.1676998740E-1f), // log_p2
+        SPLAT(-1.2420140846E-1f), // log_p3
+        SPLAT(+1.4249322787E-1f), // log_p4
+        SPLAT(-1.6668057665E-1f), // log_p5
+        SPLAT(+2.0000714765E-1f), // log_p6
+        SPLAT(-2.4999993993E-1f), // log_p7
+        SPLAT(+3.3333331174E-1f), // log_p8
+        SPLAT(0x3ea2f983), // float_invpi, 1/pi
+        SPLAT(0x4b400000), // float_rintf
+        SPLAT(0x40490000), // float_pi1
+        SPLAT(0x3a7da000), // float_pi2
+        SPLAT(0x34222000), // float_pi3
+        SPLAT(0x2cb4611a), // float_pi4
+        SPLAT(0xbe2aaaa6), // float_sinC3
+        SPLAT(0x3c08876a), // float_sinC5
+        SPLAT(0xb94fb7ff), // float_sinC7
+        SPLAT(0x362edef8), // float_sinC9
+        SPLAT(static_cast<int32_t>(0xBEFFFFE2)), // float_cosC2
+        SPLAT(0x3D2AA73C), // float_cosC4
+        SPLAT(static_cast<int32_t>(0XBAB58D50)), // float_cosC6
+        SPLAT(0x37C1AD76), // float_cosC8
+        SPLAT(1), // int_one
+        SPLAT(255), // int_255
+        SPLAT(511), // int_511
+        SPLAT(1023), // int_1023
+        SPLAT(2047), // int_2047
+        SPLAT(4095), // int_4095
+        SPLAT(8191), // int_8191
+        SPLAT(16383), // int_16383
+        SPLAT(32767), // int_32767
+        SPLAT(65535), // int_65535
+    };
+
+    struct ConstantIndex {
+        static constexpr int absmask = 0;
+        static constexpr int negmask = 1;
+        static constexpr int x7F = 2;
+        static constexpr int min_norm_pos = 3;
+        static constexpr int inv_mant_mask = 4;
+        static constexpr int float_one = 5;
+        static constexpr int float_half = 6;
+        static constexpr int float_255 = 7;
+        static constexpr int float_511 = 8;
+        static constexpr int float_1023 = 9;
+        static constexpr int float_2047 = 10;
+        static constexpr int float_4095 = 11;
+        static constexpr int float_8191 = 12;
+        static constexpr int float_16383 = 13;
+        static constexpr int float_32767 = 14;
+        static constexpr int float_65535 = 15;
+        static constexpr int i16min_epi16 = 16;
+        static constexpr int i16min_epi32 = 17;
+        static constexpr int exp_hi = 18;
+        static constexpr int exp_lo = 19;
+        static constexpr int log2e = 20;
+        static constexpr int exp_c1 = 21;
+        static constexpr int exp_c2 = 22;
+        static constexpr int exp_p0 = 23;
+        static constexpr int exp_p1 = 24;
+        static constexpr int exp_p2 = 25;
+        static constexpr int exp_p3 = 26;
+        static constexpr int exp_p4 = 27;
+        static constexpr int exp_p5 = 28;
+        static constexpr int sqrt_1_2 = 29;
+        static constexpr int log_p0 = 30;
+        static constexpr int log_p1 = 31;
+        static constexpr int log_p2 = 32;
+        static constexpr int log_p3 = 33;
+        static constexpr int log_p4 = 34;
+        static constexpr int log_p5 = 35;
+        static constexpr int log_p6 = 36;
+        static constexpr int log_p7 = 37;
+        static constexpr int log_p8 = 38;
+        static constexpr int log_q1 = exp_c2;
+        static constexpr int log_q2 = exp_c1;
+        static constexpr int float_invpi = 39;
+        static constexpr int float_rintf = 40;
+        static constexpr int float_pi1 = 41;
+        static constexpr int float_pi2 = float_pi1 + 1;
+        static constexpr int float_pi3 = float_pi1 + 2;
+        static constexpr int float_pi4 = float_pi1 + 3;
+        static constexpr int float_sinC3 = 45;
+        static constexpr int float_sinC5 = float_sinC3 + 1;
+        static constexpr int float_sinC7 = float_sinC3 + 2;
+        static constexpr int float_sinC9 = float_sinC3 + 3;
+        static constexpr int float_cosC2 = 49;
+        static constexpr int float_cosC4 = float_cosC2 + 1;
+        static constexpr int float_cosC6 = float_cosC2 + 2;
+        static constexpr int float_cosC8 = float_cosC2 + 3;
+        static constexpr int int_one = 53;
+        static constexpr int int_255 = 54;
+        static constexpr int int_511 = 55;
+        static constexpr int int_1023 = 56;
+        static constexpr int int_2047 = 57;
+        static constexpr int int_4095 = 58;
+        static constexpr int int_8191 = 59;
+        static constexpr int int_16383 = 60;
+        static constexpr int int_32767 = 61;
+        static constexpr int int_65535 = 62;
+    };
+#undef SPLAT
+
+    // Opmask registers aren't register allocated, each operation only needs two of them.
+    const KReg k1{ jitasm::K1 };
+    const KReg k2{ jitasm::K2 };
+
+    // JitASM compiles everything from main(), so record the operations for later.
+    std::vector<std::function<void(Reg, ZmmReg, Reg, Reg, std::unordered_map<int, ZmmReg> &)>> deferred;
+
+    int numInputs;
+    int numOutputs;
+    int numPrefetch;
+
+    // Constants and frame constants are broadcast once before the loops, at most maxInvariants of them
+    // so that enough registers are left for the expression itself.
+    struct Invariant {
+        uint32_t value; // the bits of a constant or the index of a frame constant
+        bool frameConst;
+    };
+    static constexpr size_t maxInvariants = 16;
+    std::vector<Invariant> invariants;
+    std::vector<ZmmReg> invariantRegs;
+
+    // Returns the index of the invariant with the value or -1, when add is set a missing one is added if there's room
+    int findInvariant(uint32_t value, bool frameConst, bool add)
+    {
+        for (size_t i = 0; i < invariants.size(); i++) {
+            if (invariants[i].value == value && invariants[i].frameConst == frameConst)
+                return static_cast<int>(i);
+        }
+        if (!add || invariants.size() >= maxInvariants)
+            return -1;
+        invariants.push_back({ value, frameConst });
+        return static_cast<int>(invariants.size() - 1);
+    }
+
+#define EMIT() [this, insn](Reg regptrs, ZmmReg zero, Reg constants, Reg consts, std::unordered_map<int, ZmmReg> &bytecodeRegs)
+#define CONST(x) zmmword_ptr[constants + ConstantIndex::x * 64]
+
+    void load8(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            Reg a;
+            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + numOutputs)]);
+            int offset = insn.op.dx;
+            vpmovzxbd(t1, xmmword_ptr[a + offset]);
+            if (!insn.op.integer)
+                vcvtdq2ps(t1, t1);
+        });
+    }
+
+    void load16(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            Reg a;
+            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + numOutputs)]);
+            int offset = insn.op.dx * 2;
+            vpmovzxwd(t1, ymmword_ptr[a + offset]);
+            if (!insn.op.integer)
+                vcvtdq2ps(t1, t1);
+        });
+    }
+
+    void loadF16(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            Reg a;
+            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + numOutputs)]);
+            int offset = insn.op.dx * 2;
+            vcvtph2ps(t1, ymmword_ptr[a + offset]);
+        });
+    }
+
+    void loadF32(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            Reg a;
+            mov(a, ptr[regptrs + sizeof(void *) * (insn.op.imm.u + numOutputs)]);
+            int offset = insn.op.dx * 4;
+            if (insn.op.dx)
+                vmovups(t1, zmmword_ptr[a + offset]);
+            else
+                vmovaps(t1, zmmword_ptr[a + offset]);
+        });
+    }
+
+    // Integer constants are splatted as int32 lanes.
+    static uint32_t constBits(const ExprInstruction &insn)
+    {
+        return insn.op.integer ? static_cast<uint32_t>(static_cast<int32_t>(insn.op.imm.f)) : insn.op.imm.u;
+    }
+
+    void loadConst(const ExprInstruction &insn) override
+    {
+        if (insn.op.imm.f != 0.0f && findInvariant(constBits(insn), false, true) >= 0) {
+            deferred.push_back(EMIT()
+            {
+                auto t1 = bytecodeRegs[insn.dst];
+                vmovaps(t1, invariantRegs[findInvariant(constBits(insn), false, false)]);
+            });
+            return;
+        }
+
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+
+            if (insn.op.imm.f == 0.0f) {
+                vmovaps(t1, zero);
+                return;
+            }
+
+            XmmReg r1;
+            Reg32 a;
+            mov(a, constBits(insn));
+            vmovd(r1, a);
+            vbroadcastss(t1, r1);
+        });
+    }
+
+    void loadFrameConst(const ExprInstruction &insn) override
+    {
+        if (findInvariant(insn.op.imm.u, true, true) >= 0) {
+            deferred.push_back(EMIT()
+            {
+                auto t1 = bytecodeRegs[insn.dst];
+                vmovaps(t1, invariantRegs[findInvariant(insn.op.imm.u, true, false)]);
+            });
+            return;
+        }
+
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.dst];
+            vbroadcastss(t1, dword_ptr[consts + sizeof(float) * insn.op.imm.u]);
+        });
+    }
+
+    // The unsigned saturating narrowing stores need negative values clamped away first.
+    // Clamping against the maximum first keeps NaN mapping to it like the other backends.
+    void store8(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            ZmmReg r1;
+            Reg a;
+            if (insn.op.integer) {
+                vpmaxsd(r1, t1, zero);
+            } else {
+                vminps(r1, t1, CONST(float_255));
+                vmaxps(r1, r1, zero);
+                vcvtps2dq(r1, r1);
+            }
+            mov(a, ptr[regptrs + sizeof(void *) * insn.op.output]);
+            vpmovusdb(xmmword_ptr[a], r1);
+        });
+    }
+
+    void store16(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            int depth = insn.op.imm.u;
+            auto t1 = bytecodeRegs[insn.src1];
+            ZmmReg r1;
+            Reg a;
+            if (insn.op.integer) {
+                vpmaxsd(r1, t1, zero);
+                vpminsd(r1, r1, zmmword_ptr[constants + (ConstantIndex::int_255 + depth - 8) * 64]);
+            } else {
+                vminps(r1, t1, zmmword_ptr[constants + (ConstantIndex::float_255 + depth - 8) * 64]);
+                vmaxps(r1, r1, zero);
+                vcvtps2dq(r1, r1);
+            }
+            mov(a, ptr[regptrs + sizeof(void *) * insn.op.output]);
+            vpmovusdw(ymmword_ptr[a], r1);
+        });
+    }
+
+    void storeF16(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            Reg a;
+            mov(a, ptr[regptrs + sizeof(void *) * insn.op.output]);
+            vcvtps2ph(ymmword_ptr[a], t1, 0);
+        });
+    }
+
+    void storeF32(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            Reg a;
+            mov(a, ptr[regptrs + sizeof(void *) * insn.op.output]);
+            vmovaps(zmmword_ptr[a], t1);
+        });
+    }
+
+#define BINARYOP(op) \
+do { \
+  auto t1 = bytecodeRegs[insn.src1]; \
+  auto t2 = bytecodeRegs[insn.src2]; \
+  auto t3 = bytecodeRegs[insn.dst]; \
+  op(t3, t1, t2); \
+} while (0)
+    void add(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            if (insn.op.integer)
+                BINARYOP(vpaddd);
+            else
+                BINARYOP(vaddps);
+        });
+    }
+
+    void sub(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            if (insn.op.integer)
+                BINARYOP(vpsubd);
+            else
+                BINARYOP(vsubps);
+        });
+    }
+
+    void mul(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            if (insn.op.integer)
+                BINARYOP(vpmulld);
+            else
+                BINARYOP(vmulps);
+        });
+    }
+
+    void div(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            BINARYOP(vdivps);
+        });
+    }
+
+    void fma(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            FMAType type = static_cast<FMAType>(insn.op.imm.u);
+
+            // t1 + t2 * t3
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.src2];
+            auto t3 = bytecodeRegs[insn.src3];
+            auto t4 = bytecodeRegs[insn.dst];
+
+            if (insn.op.integer) {
+                ZmmReg r1;
+                vpmulld(r1, t2, t3);
+                switch (type) {
+                case FMAType::FMADD: vpaddd(t4, r1, t1); break;
+                case FMAType::FMSUB: vpsubd(t4, r1, t1); break;
+                case FMAType::FNMADD: vpsubd(t4, t1, r1); break;
+                case FMAType::FNMSUB: vpaddd(r1, r1, t1); vpsubd(t4, zero, r1); break;
+                }
+                return;
+            }
+
+#define FMA3(op) \
+do { \
+  if (insn.dst == insn.src1) { \
+    op##231ps(t1, t2, t3); \
+  } else if (insn.dst == insn.src2) { \
+    op##132ps(t2, t1, t3); \
+  } else if (insn.dst == insn.src3) { \
+    op##132ps(t3, t1, t2); \
+  } else { \
+    vmovaps(t4, t1); \
+    op##231ps(t4, t2, t3); \
+  } \
+} while (0)
+            switch (type) {
+            case FMAType::FMADD: FMA3(vfmadd); break;
+            case FMAType::FMSUB: FMA3(vfmsub); break;
+            case FMAType::FNMADD: FMA3(vfnmadd); break;
+            case FMAType::FNMSUB: FMA3(vfnmsub); break;
+            }
+#undef FMA3
+        });
+    }
+
+    void max(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            if (insn.op.integer)
+                BINARYOP(vpmaxsd);
+            else
+                BINARYOP(vmaxps);
+        });
+    }
+
+    void min(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            if (insn.op.integer)
+                BINARYOP(vpminsd);
+            else
+                BINARYOP(vminps);
+        });
+    }
+#undef BINARYOP
+
+    void sqrt(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.dst];
+            vmaxps(t2, t1, zero);
+            vsqrtps(t2, t2);
+        });
+    }
+
+    void abs(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.dst];
+            if (insn.op.integer)
+                vpabsd(t2, t1);
+            else
+                vpandd(t2, t1, CONST(absmask));
+        });
+    }
+
+    void neg(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.dst];
+            if (insn.op.integer)
+                vpsubd(t2, zero, t1);
+            else
+                vpxord(t2, t1, CONST(negmask));
+        });
+    }
+
+    void round(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.dst];
+            if (insn.op.integer)
+                vmovaps(t2, t1);
+            else
+                vrndscaleps(t2, t1, 0);
+        });
+    }
+
+    // Comparisons produce opmasks, which are turned back into 0.0/1.0 with a masked blend.
+    void not_(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.dst];
+            if (insn.op.integer) {
+                vpcmpd(k1, t1, zero, static_cast<int>(ComparisonType::LE));
+                vblendmps(t2, k1, zero, CONST(int_one));
+            } else {
+                vcmpps(k1, t1, zero, _CMP_LE_OS);
+                vblendmps(t2, k1, zero, CONST(float_one));
+            }
+        });
+    }
+
+#define LOGICOP(kop) \
+do { \
+  auto t1 = bytecodeRegs[insn.src1]; \
+  auto t2 = bytecodeRegs[insn.src2]; \
+  auto t3 = bytecodeRegs[insn.dst]; \
+  if (insn.op.integer) { \
+    vpcmpd(k1, t1, zero, static_cast<int>(ComparisonType::NLE)); \
+    vpcmpd(k2, t2, zero, static_cast<int>(ComparisonType::NLE)); \
+    kop(k1, k1, k2); \
+    vblendmps(t3, k1, zero, CONST(int_one)); \
+  } else { \
+    vcmpps(k1, t1, zero, _CMP_NLE_US); \
+    vcmpps(k2, t2, zero, _CMP_NLE_US); \
+    kop(k1, k1, k2); \
+    vblendmps(t3, k1, zero, CONST(float_one)); \
+  } \
+} while (0)
+
+    void and_(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            LOGICOP(kandw);
+        });
+    }
+
+    void or_(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            LOGICOP(korw);
+        });
+    }
+
+    void xor_(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            LOGICOP(kxorw);
+        });
+    }
+#undef LOGICOP
+
+    void cmp(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.src2];
+            auto t3 = bytecodeRegs[insn.dst];
+            if (insn.op.integer) {
+                vpcmpd(k1, t1, t2, insn.op.imm.u);
+                vblendmps(t3, k1, zero, CONST(int_one));
+            } else {
+                vcmpps(k1, t1, t2, insn.op.imm.u);
+                vblendmps(t3, k1, zero, CONST(float_one));
+            }
+        });
+    }
+
+    void intToFloat(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.dst];
+            vcvtdq2ps(t2, t1);
+        });
+    }
+
+    void ternary(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.src2];
+            auto t3 = bytecodeRegs[insn.src3];
+            auto t4 = bytecodeRegs[insn.dst];
+            if (insn.op.integer)
+                vpcmpd(k1, t1, zero, static_cast<int>(ComparisonType::NLE));
+            else
+                vcmpps(k1, t1, zero, _CMP_NLE_US);
+            vblendmps(t4, k1, t3, t2);
+        });
+    }
+
+    void exp_(ZmmReg x, ZmmReg zero, ZmmReg one, Reg constants)
+    {
+        ZmmReg fx, emm0, etmp, y, mask, z;
+        vminps(x, x, CONST(exp_hi));
+        vmaxps(x, x, CONST(exp_lo));
+        vmovaps(fx, CONST(log2e));
+        vfmadd213ps(fx, x, CONST(float_half));
+        vcvttps2dq(emm0, fx);
+        vcvtdq2ps(etmp, emm0);
+        vcmpps(k1, etmp, fx, _CMP_NLE_US);
+        vblendmps(mask, k1, zero, one);
+        vsubps(fx, etmp, mask);
+        vfnmadd231ps(x, fx, CONST(exp_c1));
+        vfnmadd231ps(x, fx, CONST(exp_c2));
+        vmulps(z, x, x);
+        vmovaps(y, CONST(exp_p0));
+        vfmadd213ps(y, x, CONST(exp_p1));
+        vfmadd213ps(y, x, CONST(exp_p2));
+        vfmadd213ps(y, x, CONST(exp_p3));
+        vfmadd213ps(y, x, CONST(exp_p4));
+        vfmadd213ps(y, x, CONST(exp_p5));
+        vfmadd213ps(y, z, x);
+        vaddps(y, y, one);
+        vcvttps2dq(emm0, fx);
+        vpaddd(emm0, emm0, CONST(x7F));
+        vpslld(emm0, emm0, 23);
+        vmulps(x, y, emm0);
+    }
+
+    void log_(ZmmReg x, ZmmReg zero, ZmmReg one, Reg constants)
+    {
+        ZmmReg emm0, mask, y, etmp, z;
+        vmaxps(x, x, CONST(min_norm_pos));
+        vpsrld(emm0, x, 23);
+        vpandd(x, x, CONST(inv_mant_mask));
+        vpord(x, x, CONST(float_half));
+        vpsubd(emm0, emm0, CONST(x7F));
+        vcvtdq2ps(emm0, emm0);
+        vaddps(emm0, emm0, one);
+        vcmpps(k1, x, CONST(sqrt_1_2), _CMP_LT_OS);
+        vblendmps(etmp, k1, zero, x);
+        vsubps(x, x, one);
+        vblendmps(mask, k1, zero, one);
+        vsubps(emm0, emm0, mask);
+        vaddps(x, x, etmp);
+        vmulps(z, x, x);
+        vmovaps(y, CONST(log_p0));
+        vfmadd213ps(y, x, CONST(log_p1));
+        vfmadd213ps(y, x, CONST(log_p2));
+        vfmadd213ps(y, x, CONST(log_p3));
+        vfmadd213ps(y, x, CONST(log_p4));
+        vfmadd213ps(y, x, CONST(log_p5));
+        vfmadd213ps(y, x, CONST(log_p6));
+        vfmadd213ps(y, x, CONST(log_p7));
+        vfmadd213ps(y, x, CONST(log_p8));
+        vmulps(y, y, x);
+        vmulps(y, y, z);
+        vfmadd231ps(y, emm0, CONST(log_q1));
+        vfnmadd231ps(y, z, CONST(float_half));
+        vaddps(x, x, y);
+        vfmadd231ps(x, emm0, CONST(log_q2));
+    }
+
+    void exp(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.dst];
+            ZmmReg one;
+            vmovaps(one, CONST(float_one));
+            vmovaps(t2, t1);
+            exp_(t2, zero, one, constants);
+        });
+    }
+
+    void log(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.dst];
+            ZmmReg one;
+            vmovaps(one, CONST(float_one));
+            vmovaps(t2, t1);
+            log_(t2, zero, one, constants);
+        });
+    }
+
+    void pow(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            auto t1 = bytecodeRegs[insn.src1];
+            auto t2 = bytecodeRegs[insn.src2];
+            auto t3 = bytecodeRegs[insn.dst];
+
+            ZmmReg r1, one;
+            vmovaps(one, CONST(float_one));
+            vmovaps(r1, t1);
+            log_(r1, zero, one, constants);
+            vmulps(r1, r1, t2);
+            exp_(r1, zero, one, constants);
+            vmovaps(t3, r1);
+        });
+    }
+
+    void sincos_(bool issin, const ExprInstruction &insn, Reg constants, std::unordered_map<int, ZmmReg> &bytecodeRegs)
+    {
+        auto x = bytecodeRegs[insn.src1];
+        auto y = bytecodeRegs[insn.dst];
+        ZmmReg t1, sign, t2, t3, t4;
+        // Remove sign
+        vmovaps(t1, CONST(absmask));
+        if (issin) {
+            vpandnd(sign, t1, x);
+        } else {
+            vpxord(sign, sign, sign);
+        }
+        vpandd(t1, t1, x);
+        // Range reduction
+        vmovaps(t3, CONST(float_rintf));
+        vmulps(t2, t1, CONST(float_invpi));
+        vaddps(t2, t2, t3);
+        vpslld(t4, t2, 31);
+        vpxord(sign, sign, t4);
+        vsubps(t2, t2, t3);
+        vfnmadd231ps(t1, t2, CONST(float_pi1));
+        vfnmadd231ps(t1, t2, CONST(float_pi2));
+        vfnmadd231ps(t1, t2, CONST(float_pi3));
+        vfnmadd231ps(t1, t2, CONST(float_pi4));
+        if (issin) {
+            // Evaluate minimax polynomial for sin(x) in [-pi/2, pi/2] interval
+            // Y <- X + X * X^2 * (C3 + X^2 * (C5 + X^2 * (C7 + X^2 * C9)))
+            vmulps(t2, t1, t1);
+            vmovaps(t3, CONST(float_sinC7));
+            vfmadd231ps(t3, t2, CONST(float_sinC9));
+            vfmadd213ps(t3, t2, CONST(float_sinC5));
+            vfmadd213ps(t3, t2, CONST(float_sinC3));
+            vmulps(t3, t3, t2);
+            vfmadd231ps(t1, t1, t3);
+        } else {
+            // Evaluate minimax polynomial for cos(x) in [-pi/2, pi/2] interval
+            // Y <- 1 + X^2 * (C2 + X^2 * (C4 + X^2 * (C6 + X^2 * C8)))
+            vmulps(t2, t1, t1);
+            vmovaps(t1, CONST(float_cosC6));
+            vfmadd231ps(t1, t2, CONST(float_cosC8));
+            vfmadd213ps(t1, t2, CONST(float_cosC4));
+            vfmadd213ps(t1, t2, CONST(float_cosC2));
+            vfmadd213ps(t1, t2, CONST(float_one));
+        }
+        // Apply sign
+        vpxord(y, t1, sign);
+    }
+
+    void sin(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            sincos_(true, insn, constants, bytecodeRegs);
+        });
+    }
+
+    void cos(const ExprInstruction &insn) override
+    {
+        deferred.push_back(EMIT()
+        {
+            sincos_(false, insn, constants, bytecodeRegs);
+        });
+    }
+
+    // The caller counts iterations and pointer increments in groups of 8 pixels like
+    // for the other backends, every iteration here handles two of them.
+    void main(Reg regptrs, Reg regoffs, Reg niter, Reg consts, Reg nrows)
+    {
+        std::unordered_map<int, ZmmReg> bytecodeRegs;
+        ZmmReg zero;
+        vpxord(zero, zero, zero);
+        Reg constants;
+        mov(constants, (uintptr_t)constData);
+
+        invariantRegs.clear();
+        for (const auto &c : invariants) {
+            ZmmReg r;
+            if (c.frameConst) {
+                vbroadcastss(r, dword_ptr[consts + sizeof(float) * c.value]);
+            } else {
+                XmmReg r1;
+                Reg32 a;
+                mov(a, c.value);
+                vmovd(r1, a);
+                vbroadcastss(r, r1);
+            }
+            invariantRegs.push_back(r);
+        }
+
+        // every iteration does two of the eight pixel steps
+        jit::add(niter, 1);
+        jit::shr(niter, 1);
+
+        L("hloop");
+        Reg count;
+        mov(count, niter);
+
+        L("wloop");
+
+        for (const auto &f : deferred) {
+            f(regptrs, zero, constants, consts, bytecodeRegs);
+        }
+
+        for (int i = 0; i < numPrefetch; i++) {
+            Reg a;
+            mov(a, ptr[regptrs + sizeof(void *) * (numOutputs + numInputs + i)]);
+            prefetcht0(byte_ptr[a]);
+        }
+
+#if UINTPTR_MAX > UINT32_MAX
+        for (int i = 0; i < (numInputs + numOutputs + numPrefetch - 1) / 4 + 1; i++) {
+            YmmReg r1, r2;
+            vmovdqu(r1, ymmword_ptr[regptrs + 32 * i]);
+            vmovdqu(r2, ymmword_ptr[regoffs + 32 * i]);
+            vpaddq(r1, r1, r2);
+            vpaddq(r1, r1, r2);
+            vmovdqu(ymmword_ptr[regptrs + 32 * i], r1);
+        }
+#else
+        for (int i = 0; i < (numInputs + numOutputs + numPrefetch - 1) / 8 + 1; i++) {
+            YmmReg r1, r2;
+            vmovdqu(r1, ymmword_ptr[regptrs + 32 * i]);
+            vmovdqu(r2, ymmword_ptr[regoffs + 32 * i]);
+            vpaddd(r1, r1, r2);
+            vpaddd(r1, r1, r2);
+            vmovdqu(ymmword_ptr[regptrs + 32 * i], r1);
+        }
+#endif
+
+        jit::sub(count, 1);
+        jnz("wloop");
+
+        jit::add(regptrs, static_cast<int>(sizeof(void *) * exprRowPointers(numOutputs, numInputs, numPrefetch)));
+        jit::sub(nrows, 1);
+        jnz("hloop");
+    }
+
+public:
+    ExprCompiler512(int numInputs, int numOutputs, int numPrefetch) : numInputs(numInputs), numOutputs(numOutputs), numPrefetch(numPrefetch) {}
+
+    std::pair<ProcessPlaneProc, size_t> getCode() override
+    {
+        size_t size;
+        if (jit::GetCode(true) && (size = GetCodeSize()))
+            return make_executable(jit::GetCode(true), size);
+        return { nullptr, 0 };
+    }
+#undef CONST
+#undef EMIT
+};
+
+constexpr ExprUnion ExprCompiler512::constData alignas(64)[63][16];
+
+
+} // namespace
+
+std::unique_ptr<ExprCompiler> make_xmm_compiler(int numInputs, int numOutputs, int numPrefetch)
+{
+    return std::make_unique<ExprCompiler128>(numInputs, numOutputs, numPrefetch);
+}
 
-std::unique_ptr<ExprCompiler> make_xmm_compiler(int numInputs)
+std::unique_ptr<ExprCompiler> make_ymm_compiler(int numInputs, int numOutputs, int numPrefetch)
 {
-    return std::make_unique<ExprCompiler128>(numInputs);
+    return std::make_unique<ExprCompiler256>(numInputs, numOutputs, numPrefetch);
 }
 
-std::unique_ptr<ExprCompiler> make_ymm_compiler(int numInputs)
+std::unique_ptr<ExprCompiler> make_zmm_compiler(int numInputs, int numOutputs, int numPrefetch)
 {
-    return std::make_unique<ExprCompiler256>(numInputs);
+    return std::make_unique<ExprCompiler512>(numInputs, numOutputs, numPrefetch);
 }
 
 } // namespace expr
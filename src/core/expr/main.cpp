@@ -6,9 +6,10 @@
 using namespace expr;
 
 static const char *op_names[] = {
-	"loadu8", "loadu16", "loadf16", "loadf32", "constant",
+	"loadu8", "loadu16", "loadf16", "loadf32", "constant", "constload",
 	"storeu8", "storeu16", "storef16", "storef32",
-	"add", "sub", "mul", "div", "fma", "sqrt", "abs", "neg", "max", "min", "cmp",
+	"add", "sub", "mul", "div", "fma", "sqrt", "abs", "neg", "round", "max", "min", "cmp",
+	"i2f",
 	"and", "or", "xor", "not",
 	"exp", "log", "pow", "sin", "cos",
 	"ternary",
@@ -37,10 +38,11 @@ int main(int argc, char **argv) try
 		std::cout << argv[1] << '\n';
 		bool optimize = argc > 2 ? !!std::atoi(argv[2]) : true;
 
-		std::vector<ExprInstruction> code = compile(argv[1], vi, 26, realvi, optimize);
+		std::vector<FrameConstant> constants;
+		std::vector<ExprInstruction> code = compile(argv[1], vi, 26, realvi, optimize, BoundaryCondition::CLAMP, &constants);
 
 		for (auto &insn : code) {
-			std::cout << std::setw(12) << std::left << op_names[static_cast<size_t>(insn.op.type)];
+			std::cout << std::setw(12) << std::left << (std::string(op_names[static_cast<size_t>(insn.op.type)]) + (insn.op.integer ? ".i" : ""));
 
 			if (insn.op.type == ExprOpType::MEM_STORE_U8 || insn.op.type == ExprOpType::MEM_STORE_U16 || insn.op.type == ExprOpType::MEM_STORE_F16 || insn.op.type == ExprOpType::MEM_STORE_F32) {
 				std::cout << " r" << insn.src1 << '\n';
@@ -62,10 +64,18 @@ int main(int argc, char **argv) try
 			case ExprOpType::MEM_LOAD_F16:
 			case ExprOpType::MEM_LOAD_F32:
 				std::cout << ',' << static_cast<char>(insn.op.imm.u < 3 ? 'x' + insn.op.imm.u : 'a' + insn.op.imm.u - 3);
+				if (insn.op.dx || insn.op.dy)
+					std::cout << '[' << insn.op.dx << ',' << insn.op.dy << ']' << (insn.op.boundary == BoundaryCondition::MIRROR ? ":m" : ":c");
 				break;
 			case ExprOpType::CONSTANT:
 				std::cout << ',' << insn.op.imm.f;
 				break;
+			case ExprOpType::CONST_LOAD:
+				if (constants[insn.op.imm.u].clip < 0)
+					std::cout << ",N";
+				else
+					std::cout << ',' << static_cast<char>(constants[insn.op.imm.u].clip < 3 ? 'x' + constants[insn.op.imm.u].clip : 'a' + constants[insn.op.imm.u].clip - 3) << '.' << constants[insn.op.imm.u].name;
+				break;
 			case ExprOpType::FMA:
 				std::cout << "," << insn.op.imm.u;
 				break;
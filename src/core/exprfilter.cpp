@@ -20,12 +20,15 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
-#include <tuple>
+#include <unordered_map>
 #include <vector>
 #include "VapourSynth4.h"
 #include "VSHelper4.h"
@@ -33,6 +36,7 @@
 #include "internalfilters.h"
 #include "filtershared.h"
 #include "expr/expr.h"
+#include "expr/interpreter.h"
 #include "expr/jitcompiler.h"
 #include "kernel/cpulevel.h"
 
@@ -51,119 +55,422 @@ enum PlaneOp {
     poProcess, poCopy, poUndefined
 };
 
+// Upper limit of distinct source rows an expression can read, every vertical offset needs its own
+static const int exprMaxRows = 64;
+
+// Upper limit of clips MultiExpr computes in one pass
+static const int exprMaxOutputs = 8;
+
+// A source row read by the expression, the first numInputs rows are the current ones of each clip
+struct ExprRow {
+    int clip;
+    int dy;
+    BoundaryCondition boundary;
+};
+
+// Parsed and optimized expression, before the frame constants are merged between planes
+struct ExprProgram {
+    std::vector<ExprInstruction> bytecode;
+    std::vector<FrameConstant> constants;
+};
+
+struct ExprCode {
+    ExprCompiler::ProcessPlaneProc proc;
+    size_t size;
+
+    ExprCode(std::pair<ExprCompiler::ProcessPlaneProc, size_t> code) : proc(code.first), size(code.second) {}
+    ExprCode(const ExprCode &) = delete;
+    ExprCode &operator=(const ExprCode &) = delete;
+
+    ~ExprCode() {
+        if (proc) {
+#ifdef VS_TARGET_OS_WINDOWS
+            VirtualFree((LPVOID)proc, 0, MEM_RELEASE);
+#else
+            munmap((void *)proc, size);
+#endif
+        }
+    }
+};
+
+// Scripts often create the same expression many times, identical programs and machine code are
+// shared between all instances and released once the last one using them is freed.
+template<typename T>
+class ExprCache {
+    std::mutex lock;
+    std::unordered_map<std::string, std::weak_ptr<T>> entries;
+public:
+    template<typename F>
+    std::shared_ptr<T> get(const std::string &key, F &&make) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            if (std::shared_ptr<T> entry = it->second.lock())
+                return entry;
+        }
+
+        std::shared_ptr<T> entry(new T(make()), [this, key](T *p) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                auto it = entries.find(key);
+                if (it != entries.end() && it->second.expired())
+                    entries.erase(it);
+            }
+            delete p;
+        });
+        entries[key] = entry;
+        return entry;
+    }
+};
+
+// never destroyed since instances may still be freed during static destruction
+static ExprCache<ExprProgram> &exprProgramCache() {
+    static ExprCache<ExprProgram> *cache = new ExprCache<ExprProgram>;
+    return *cache;
+}
+
+static ExprCache<ExprCode> &exprCodeCache() {
+    static ExprCache<ExprCode> *cache = new ExprCache<ExprCode>;
+    return *cache;
+}
+
 struct ExprData {
     VSNode *node[MAX_EXPR_INPUTS];
-    VSVideoInfo vi;
+    VSVideoInfo vi[exprMaxOutputs]; // the filter itself returns the first output, the others are attached to its frames
+    std::string expr[3]; // kept so later Expr filters can fuse with this one
+    BoundaryCondition boundary;
     std::vector<ExprInstruction> bytecode[3];
+    std::vector<ExprRow> rows[3];
+    std::vector<ExprRow> prefetch[3]; // the row below the lowest one read from each clip, only touched by the JIT
+    std::vector<FrameConstant> constants; // shared by all planes
+    int leftBorder[3]; // number of columns at each edge where relative loads need edge handling
+    int rightBorder[3];
     int plane[3];
     int numInputs;
-    ExprCompiler::ProcessLineProc proc[3];
-    size_t procSize[3];
+    int numOutputs;
+    ExprCompiler::ProcessPlaneProc proc[3];
+    std::shared_ptr<ExprProgram> program[3]; // keep the cache entries alive
+    std::shared_ptr<ExprCode> code[3];
+    int gpu; // -1 uses the device when the inputs are in device memory, 0 never and 1 whenever it can
+    std::once_flag deviceOnce[3];
+    void *deviceKernel[3]; // compiled on first use, nullptr if the plane can't run on the device
 
-    ExprData() : node(), vi(), plane(), numInputs(), proc() {}
+    ExprData() : node(), vi(), boundary(), leftBorder(), rightBorder(), plane(), numInputs(), numOutputs(1), proc(), gpu(), deviceKernel() {}
+};
 
-    ~ExprData() {
-        for (int i = 0; i < 3; i++) {
-            if (proc[i]) {
-#ifdef VS_TARGET_OS_WINDOWS
-                VirtualFree((LPVOID)proc[i], 0, MEM_RELEASE);
-#else
-                munmap((void *)proc[i], procSize[i]);
-#endif
-            }
+// The name of the property that carries an additional output on the frames of the first one.
+static std::string exprOutputProp(int output) {
+    return "_ExprOutput" + std::to_string(output);
+}
+
+// Each plane is cut into this many horizontal slices that can be processed in parallel
+static const int exprSlicesPerPlane = 8;
+
+static void exprProcessSlice(const ExprData *d, const VSFrame *const *src, VSFrame *const *dst, const float *consts, int plane, int slice, const VSAPI *vsapi) {
+    int numInputs = d->numInputs;
+    int numOutputs = d->numOutputs;
+    const std::vector<ExprRow> &rows = d->rows[plane];
+    int numRows = static_cast<int>(rows.size());
+    const uint8_t *srcbase[MAX_EXPR_INPUTS] = {};
+    ptrdiff_t src_stride[MAX_EXPR_INPUTS] = {};
+    int src_bps[MAX_EXPR_INPUTS] = {};
+    const uint8_t *srcp[exprMaxRows] = {};
+    uint8_t *dstp[exprMaxOutputs] = {};
+    ptrdiff_t dst_stride[exprMaxOutputs] = {};
+    int dst_bps[exprMaxOutputs] = {};
+    const std::vector<ExprRow> &prefetch = d->prefetch[plane];
+    int numPrefetch = static_cast<int>(prefetch.size());
+    alignas(32) intptr_t ptroffsets[((exprMaxOutputs + exprMaxRows + MAX_EXPR_INPUTS) + 7) & ~7] = {};
+
+    int h = vsapi->getFrameHeight(dst[0], plane);
+    int w = vsapi->getFrameWidth(dst[0], plane);
+    int y0 = static_cast<int>(static_cast<int64_t>(h) * slice / exprSlicesPerPlane);
+    int y1 = static_cast<int>(static_cast<int64_t>(h) * (slice + 1) / exprSlicesPerPlane);
+    if (y0 == y1)
+        return;
+
+    for (int i = 0; i < numInputs; i++) {
+        if (src[i]) {
+            src_stride[i] = vsapi->getStride(src[i], plane);
+            srcbase[i] = vsapi->getReadPtr(src[i], plane);
+            src_bps[i] = vsapi->getVideoFrameFormat(src[i])->bytesPerSample;
         }
     }
-};
+    for (int i = 0; i < numRows; i++)
+        ptroffsets[numOutputs + i] = src_bps[rows[i].clip] * 8;
+    for (int i = 0; i < numPrefetch; i++)
+        ptroffsets[numOutputs + numRows + i] = src_bps[prefetch[i].clip] * 8;
 
-class ExprInterpreter {
-    const ExprInstruction *bytecode;
-    size_t numInsns;
-    std::vector<float> registers;
+    for (int i = 0; i < numOutputs; i++) {
+        dst_bps[i] = d->vi[i].format.bytesPerSample;
+        dst_stride[i] = vsapi->getStride(dst[i], plane);
+        dstp[i] = vsapi->getWritePtr(dst[i], plane) + dst_stride[i] * y0;
+        ptroffsets[i] = dst_bps[i] * 8;
+    }
 
-    template <class T>
-    static T clamp_int(float x, int depth = std::numeric_limits<T>::digits)
-    {
-        float maxval = static_cast<float>((1U << depth) - 1);
-        return static_cast<T>(std::lrint(std::min(std::max(x, static_cast<float>(std::numeric_limits<T>::min())), maxval)));
+    // The JIT only runs on the columns where every relative load stays inside the frame, it starts
+    // on a multiple of 16 pixels to keep the aligned accesses aligned. The rest goes through the interpreter.
+    int xs = 0;
+    int xe = w;
+    if (d->leftBorder[plane] || d->rightBorder[plane]) {
+        xs = std::min((d->leftBorder[plane] + 15) & ~15, w);
+        xe = xs + std::max(w - d->rightBorder[plane] - xs, 0) / 16 * 16;
+    }
+    if (!d->proc[plane]) {
+        xs = 0;
+        xe = 0;
     }
 
-    static float bool2float(bool x) { return x ? 1.0f : 0.0f; }
-    static bool float2bool(float x) { return x > 0.0f; }
-public:
-    ExprInterpreter(const ExprInstruction *bytecode, size_t numInsns) : bytecode(bytecode), numInsns(numInsns)
-    {
-        int maxreg = 0;
-        for (size_t i = 0; i < numInsns; ++i) {
-            maxreg = std::max(maxreg, bytecode[i].dst);
+    std::unique_ptr<ExprInterpreter> interpreter;
+    if (xs > 0 || xe < w)
+        interpreter.reset(new ExprInterpreter(d->bytecode[plane].data(), d->bytecode[plane].size(), w, consts));
+
+    int niterations = (xe - xs + 7) / 8;
+
+    // the pointers of all rows are set up first so the JIT can do the whole slice in one call
+    int rowPointers = expr::exprRowPointers(numOutputs, numRows, numPrefetch);
+    std::vector<uint8_t *> rwptrs;
+    if (niterations > 0)
+        rwptrs.resize(static_cast<size_t>(y1 - y0) * rowPointers);
+
+    for (int y = y0; y < y1; y++) {
+        for (int i = 0; i < numRows; i++) {
+            const ExprRow &row = rows[i];
+            srcp[i] = srcbase[row.clip] + src_stride[row.clip] * (row.dy ? exprBoundary(y + row.dy, h, row.boundary) : y);
         }
-        registers.resize(maxreg + 1);
-    }
-
-    void eval(const uint8_t * const *srcp, uint8_t *dstp, int x)
-    {
-        for (size_t i = 0; i < numInsns; ++i) {
-            const ExprInstruction &insn = bytecode[i];
-
-#define SRC1 registers[insn.src1]
-#define SRC2 registers[insn.src2]
-#define SRC3 registers[insn.src3]
-#define DST registers[insn.dst]
-            switch (insn.op.type) {
-            case ExprOpType::MEM_LOAD_U8: DST = reinterpret_cast<const uint8_t *>(srcp[insn.op.imm.u])[x]; break;
-            case ExprOpType::MEM_LOAD_U16: DST = reinterpret_cast<const uint16_t *>(srcp[insn.op.imm.u])[x]; break;
-            case ExprOpType::MEM_LOAD_F16: DST = 0; break;
-            case ExprOpType::MEM_LOAD_F32: DST = reinterpret_cast<const float *>(srcp[insn.op.imm.u])[x]; break;
-            case ExprOpType::CONSTANT: DST = insn.op.imm.f; break;
-            case ExprOpType::ADD: DST = SRC1 + SRC2; break;
-            case ExprOpType::SUB: DST = SRC1 - SRC2; break;
-            case ExprOpType::MUL: DST = SRC1 * SRC2; break;
-            case ExprOpType::DIV: DST = SRC1 / SRC2; break;
-            case ExprOpType::FMA:
-                switch (static_cast<FMAType>(insn.op.imm.u)) {
-                case FMAType::FMADD: DST = SRC2 * SRC3 + SRC1; break;
-                case FMAType::FMSUB: DST = SRC2 * SRC3 - SRC1; break;
-                case FMAType::FNMADD: DST = -(SRC2 * SRC3) + SRC1; break;
-                case FMAType::FNMSUB: DST = -(SRC2 * SRC3) - SRC1; break;
-                };
-                break;
-            case ExprOpType::MAX: DST = std::max(SRC1, SRC2); break;
-            case ExprOpType::MIN: DST = std::min(SRC1, SRC2); break;
-            case ExprOpType::EXP: DST = std::exp(SRC1); break;
-            case ExprOpType::LOG: DST = std::log(SRC1); break;
-            case ExprOpType::POW: DST = std::pow(SRC1, SRC2); break;
-            case ExprOpType::SQRT: DST = std::sqrt(SRC1); break;
-            case ExprOpType::SIN: DST = std::sin(SRC1); break;
-            case ExprOpType::COS: DST = std::cos(SRC1); break;
-            case ExprOpType::ABS: DST = std::fabs(SRC1); break;
-            case ExprOpType::NEG: DST = -SRC1; break;
-            case ExprOpType::CMP:
-                switch (static_cast<ComparisonType>(insn.op.imm.u)) {
-                case ComparisonType::EQ: DST = bool2float(SRC1 == SRC2); break;
-                case ComparisonType::LT: DST = bool2float(SRC1 < SRC2); break;
-                case ComparisonType::LE: DST = bool2float(SRC1 <= SRC2); break;
-                case ComparisonType::NEQ: DST = bool2float(SRC1 != SRC2); break;
-                case ComparisonType::NLT: DST = bool2float(SRC1 >= SRC2); break;
-                case ComparisonType::NLE: DST = bool2float(SRC1 > SRC2); break;
-                }
-                break;
-            case ExprOpType::TERNARY: DST = float2bool(SRC1) ? SRC2 : SRC3; break;
-            case ExprOpType::AND: DST = bool2float((float2bool(SRC1) && float2bool(SRC2))); break;
-            case ExprOpType::OR:  DST = bool2float((float2bool(SRC1) || float2bool(SRC2))); break;
-            case ExprOpType::XOR: DST = bool2float((float2bool(SRC1) != float2bool(SRC2))); break;
-            case ExprOpType::NOT: DST = bool2float(!float2bool(SRC1)); break;
-            case ExprOpType::MEM_STORE_U8:  reinterpret_cast<uint8_t *>(dstp)[x] = clamp_int<uint8_t>(SRC1); return;
-            case ExprOpType::MEM_STORE_U16: reinterpret_cast<uint16_t *>(dstp)[x] = clamp_int<uint16_t>(SRC1, insn.op.imm.u); return;
-            case ExprOpType::MEM_STORE_F16: reinterpret_cast<uint16_t *>(dstp)[x] = 0; return;
-            case ExprOpType::MEM_STORE_F32: reinterpret_cast<float *>(dstp)[x] = SRC1; return;
-            default: fprintf(stderr, "%s", "illegal opcode\n"); std::terminate(); return;
+
+        if (niterations > 0) {
+            uint8_t **block = rwptrs.data() + static_cast<size_t>(y - y0) * rowPointers;
+            for (int i = 0; i < numOutputs; i++) {
+                block[i] = dstp[i] + dst_bps[i] * xs;
+            }
+            for (int i = 0; i < numRows; i++) {
+                block[numOutputs + i] = const_cast<uint8_t *>(srcp[i] + src_bps[rows[i].clip] * xs);
             }
-#undef DST
-#undef SRC3
-#undef SRC2
-#undef SRC1
+            for (int i = 0; i < numPrefetch; i++) {
+                const ExprRow &row = prefetch[i];
+                block[numOutputs + numRows + i] = const_cast<uint8_t *>(srcbase[row.clip] + src_stride[row.clip] * exprBoundary(y + row.dy, h, row.boundary) + src_bps[row.clip] * xs);
+            }
+        }
+
+        if (interpreter) {
+            for (int x = 0; x < xs; x += ExprInterpreter::blockSize)
+                interpreter->eval(srcp, dstp, x, std::min(ExprInterpreter::blockSize, xs - x));
+            for (int x = xe; x < w; x += ExprInterpreter::blockSize)
+                interpreter->eval(srcp, dstp, x, std::min(ExprInterpreter::blockSize, w - x));
         }
+
+        for (int i = 0; i < numOutputs; i++)
+            dstp[i] += dst_stride[i];
     }
-};
+
+    if (niterations > 0)
+        d->proc[plane](rwptrs.data(), ptroffsets, niterations, consts, y1 - y0);
+}
+
+//////////////////////////////////////////
+// Device kernels
+
+// Helpers of the generated kernels, they round and handle the edges exactly like the functions above
+static const char *exprDevicePrelude = R"(
+__device__ static float vs_half2float(unsigned short x) {
+    unsigned int sign = (unsigned int)(x & 0x8000) << 16;
+    unsigned int exponent = (x >> 10) & 0x1F;
+    unsigned int mantissa = x & 0x3FF;
+    if (exponent == 0) {
+        float f = ldexpf((float)mantissa, -24);
+        return sign ? -f : f;
+    }
+    return __uint_as_float(exponent == 0x1F ? (sign | 0x7F800000 | (mantissa << 13)) : (sign | ((exponent + 112) << 23) | (mantissa << 13)));
+}
+
+__device__ static unsigned short vs_float2half(float f) {
+    unsigned int bits = __float_as_uint(f);
+    unsigned short sign = (unsigned short)((bits >> 16) & 0x8000);
+    bits &= 0x7FFFFFFF;
+    if (bits >= 0x7F800000)
+        return sign | 0x7C00 | (bits > 0x7F800000 ? 0x200 : 0);
+    if (bits < 0x38800000)
+        return sign | (unsigned short)rintf(__uint_as_float(bits) * 16777216.0f);
+    return sign | (unsigned short)((bits - 0x38000000 + 0xFFF + ((bits >> 13) & 1)) >> 13);
+}
+
+__device__ static int vs_boundary(int i, int n, int mirror) {
+    if (mirror && n > 1) {
+        int period = 2 * (n - 1);
+        i = abs(i) % period;
+        return i < n ? i : period - i;
+    }
+    return min(max(i, 0), n - 1);
+}
+
+)";
+
+static std::string exprDeviceFloat(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    char buf[32];
+    snprintf(buf, sizeof(buf), "__uint_as_float(0x%08XU)", bits);
+    return buf;
+}
+
+// Translates the bytecode of a plane to a CUDA C kernel with one thread per pixel. The parameters
+// are the pointer and stride of every input, then those of every output, the width and height of
+// the plane and the frame constants. Returns an empty string if an instruction has no translation.
+static std::string exprDeviceSource(const ExprData *d, int plane) {
+    const std::vector<ExprInstruction> &bytecode = d->bytecode[plane];
+    const std::vector<ExprRow> &rows = d->rows[plane];
+    auto num = [](int i) { return std::to_string(i); };
+    auto reg = [&](int r) { return "r" + num(r); };
+
+    std::string s = exprDevicePrelude;
+    s += "extern \"C\" __global__ void vs_expr(";
+    for (int i = 0; i < d->numInputs; i++)
+        s += "const unsigned char *src" + num(i) + ", long long srcStride" + num(i) + ", ";
+    for (int i = 0; i < d->numOutputs; i++)
+        s += "unsigned char *dst" + num(i) + ", long long dstStride" + num(i) + ", ";
+    s += "int width, int height";
+    for (size_t i = 0; i < d->constants.size(); i++)
+        s += ", float c" + num(static_cast<int>(i));
+    s += ") {\n"
+        "    const int x = blockIdx.x * blockDim.x + threadIdx.x;\n"
+        "    const int y = blockIdx.y * blockDim.y + threadIdx.y;\n"
+        "    if (x >= width || y >= height)\n"
+        "        return;\n";
+
+    for (size_t i = 0; i < rows.size(); i++) {
+        const ExprRow &row = rows[i];
+        std::string ry = row.dy ? "vs_boundary(y + " + num(row.dy) + ", height, " + num(row.boundary == BoundaryCondition::MIRROR) + ")" : "y";
+        s += "    const unsigned char *row" + num(static_cast<int>(i)) + " = src" + num(row.clip) + " + srcStride" + num(row.clip) + " * " + ry + ";\n";
+    }
+
+    int maxreg = -1;
+    for (const auto &insn : bytecode)
+        maxreg = std::max(maxreg, insn.dst);
+    for (int i = 0; i <= maxreg; i++)
+        s += (i ? ", " : "    float ") + reg(i) + (i == maxreg ? ";\n" : "");
+
+    for (const auto &insn : bytecode) {
+        const ExprOp &op = insn.op;
+        std::string a = insn.src1 >= 0 ? reg(insn.src1) : std::string();
+        std::string b = insn.src2 >= 0 ? reg(insn.src2) : std::string();
+        std::string c = insn.src3 >= 0 ? reg(insn.src3) : std::string();
+        std::string x = op.dx ? "vs_boundary(x + " + num(op.dx) + ", width, " + num(op.boundary == BoundaryCondition::MIRROR) + ")" : "x";
+        std::string row = "row" + num(static_cast<int>(op.imm.u));
+        std::string out = "(dst" + num(op.output) + " + dstStride" + num(op.output) + " * y)";
+        std::string value;
+
+        switch (op.type) {
+        case ExprOpType::MEM_LOAD_U8: value = "(float)" + row + "[" + x + "]"; break;
+        case ExprOpType::MEM_LOAD_U16: value = "(float)((const unsigned short *)" + row + ")[" + x + "]"; break;
+        case ExprOpType::MEM_LOAD_F16: value = "vs_half2float(((const unsigned short *)" + row + ")[" + x + "])"; break;
+        case ExprOpType::MEM_LOAD_F32: value = "((const float *)" + row + ")[" + x + "]"; break;
+        case ExprOpType::CONSTANT: value = exprDeviceFloat(op.imm.f); break;
+        case ExprOpType::CONST_LOAD: value = "c" + num(static_cast<int>(op.imm.u)); break;
+        case ExprOpType::ADD: value = a + " + " + b; break;
+        case ExprOpType::SUB: value = a + " - " + b; break;
+        case ExprOpType::MUL: value = a + " * " + b; break;
+        case ExprOpType::DIV: value = a + " / " + b; break;
+        case ExprOpType::FMA:
+            switch (static_cast<FMAType>(op.imm.u)) {
+            case FMAType::FMADD: value = b + " * " + c + " + " + a; break;
+            case FMAType::FMSUB: value = b + " * " + c + " - " + a; break;
+            case FMAType::FNMADD: value = "-(" + b + " * " + c + ") + " + a; break;
+            case FMAType::FNMSUB: value = "-(" + b + " * " + c + ") - " + a; break;
+            }
+            break;
+        // the same operand order as std::max and std::min so NaNs propagate the same way
+        case ExprOpType::MAX: value = a + " < " + b + " ? " + b + " : " + a; break;
+        case ExprOpType::MIN: value = b + " < " + a + " ? " + b + " : " + a; break;
+        case ExprOpType::EXP: value = "expf(" + a + ")"; break;
+        case ExprOpType::LOG: value = "logf(" + a + ")"; break;
+        case ExprOpType::POW: value = "powf(" + a + ", " + b + ")"; break;
+        case ExprOpType::SQRT: value = "sqrtf(" + a + ")"; break;
+        case ExprOpType::SIN: value = "sinf(" + a + ")"; break;
+        case ExprOpType::COS: value = "cosf(" + a + ")"; break;
+        case ExprOpType::ABS: value = "fabsf(" + a + ")"; break;
+        case ExprOpType::NEG: value = "-" + a; break;
+        case ExprOpType::ROUND: value = "rintf(" + a + ")"; break;
+        case ExprOpType::INT_TO_FLOAT: value = a; break;
+        case ExprOpType::CMP: {
+            static const char *cmp[] = { " == ", " < ", " <= ", nullptr, " != ", " >= ", " > " };
+            if (op.imm.u >= 7 || !cmp[op.imm.u])
+                return std::string();
+            value = "(" + a + cmp[op.imm.u] + b + ") ? 1.0f : 0.0f";
+            break;
+        }
+        case ExprOpType::TERNARY: value = a + " > 0.0f ? " + b + " : " + c; break;
+        case ExprOpType::AND: value = "(" + a + " > 0.0f && " + b + " > 0.0f) ? 1.0f : 0.0f"; break;
+        case ExprOpType::OR: value = "(" + a + " > 0.0f || " + b + " > 0.0f) ? 1.0f : 0.0f"; break;
+        case ExprOpType::XOR: value = "((" + a + " > 0.0f) != (" + b + " > 0.0f)) ? 1.0f : 0.0f"; break;
+        case ExprOpType::NOT: value = a + " > 0.0f ? 0.0f : 1.0f"; break;
+        // fminf and fmaxf turn NaN into 0 like the conversion of the interpreter does on x86
+        case ExprOpType::MEM_STORE_U8:
+            s += "    " + out + "[x] = (unsigned char)rintf(fminf(fmaxf(" + a + ", 0.0f), 255.0f));\n";
+            continue;
+        case ExprOpType::MEM_STORE_U16:
+            s += "    ((unsigned short *)" + out + ")[x] = (unsigned short)rintf(fminf(fmaxf(" + a + ", 0.0f), " + num((1 << op.imm.u) - 1) + ".0f));\n";
+            continue;
+        case ExprOpType::MEM_STORE_F16:
+            s += "    ((unsigned short *)" + out + ")[x] = vs_float2half(" + a + ");\n";
+            continue;
+        case ExprOpType::MEM_STORE_F32:
+            s += "    ((float *)" + out + ")[x] = " + a + ";\n";
+            continue;
+        default:
+            return std::string();
+        }
+
+        s += "    " + reg(insn.dst) + " = " + value + ";\n";
+    }
+
+    s += "}\n";
+    return s;
+}
+
+static void *exprDeviceKernel(ExprData *d, int plane, VSCore *core) {
+    std::call_once(d->deviceOnce[plane], [&]() {
+        std::string source = exprDeviceSource(d, plane);
+        if (!source.empty())
+            d->deviceKernel[plane] = compileDeviceKernel(core, source.c_str(), "vs_expr");
+    });
+    return d->deviceKernel[plane];
+}
+
+// Runs the kernel of a plane on the device copies of the frames, false if it couldn't and the plane
+// has to be processed on the cpu instead.
+static bool exprProcessDevice(const ExprData *d, const VSFrame *const *src, VSFrame *const *dst, const float *consts, int plane, VSCore *core, const VSAPI *vsapi) {
+    const void *srcp[MAX_EXPR_INPUTS] = {};
+    long long srcStride[MAX_EXPR_INPUTS] = {};
+    void *dstp[exprMaxOutputs] = {};
+    long long dstStride[exprMaxOutputs] = {};
+    int width = vsapi->getFrameWidth(dst[0], plane);
+    int height = vsapi->getFrameHeight(dst[0], plane);
+    std::vector<void *> params;
+
+    for (int i = 0; i < d->numInputs; i++) {
+        srcp[i] = vsapi->getReadDevicePtr(src[i], plane);
+        srcStride[i] = vsapi->getStride(src[i], plane);
+        if (!srcp[i])
+            return false;
+        params.push_back(&srcp[i]);
+        params.push_back(&srcStride[i]);
+    }
+    for (int i = 0; i < d->numOutputs; i++) {
+        dstp[i] = vsapi->getWriteDevicePtr(dst[i], plane);
+        dstStride[i] = vsapi->getStride(dst[i], plane);
+        if (!dstp[i])
+            return false;
+        params.push_back(&dstp[i]);
+        params.push_back(&dstStride[i]);
+    }
+    params.push_back(&width);
+    params.push_back(&height);
+    for (size_t i = 0; i < d->constants.size(); i++)
+        params.push_back(const_cast<float *>(consts + i));
+
+    return launchDeviceKernel(core, d->deviceKernel[plane], width, height, params.data());
+}
 
 static const VSFrame *VS_CC exprGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     ExprData *d = static_cast<ExprData *>(instanceData);
@@ -179,81 +486,390 @@ static const VSFrame *VS_CC exprGetFrame(int n, int activationReason, void *inst
 
         int height = vsapi->getFrameHeight(src[0], 0);
         int width = vsapi->getFrameWidth(src[0], 0);
-        int planes[3] = { 0, 1, 2 };
-        const VSFrame *srcf[3] = { d->plane[0] != poCopy ? nullptr : src[0], d->plane[1] != poCopy ? nullptr : src[0], d->plane[2] != poCopy ? nullptr : src[0] };
-        VSFrame *dst = vsapi->newVideoFrame2(&d->vi.format, width, height, srcf, planes, src[0], core);
 
-        const uint8_t *srcp[MAX_EXPR_INPUTS] = {};
-        ptrdiff_t src_stride[MAX_EXPR_INPUTS] = {};
-        alignas(32) intptr_t ptroffsets[((MAX_EXPR_INPUTS + 1) + 7) & ~7] = { d->vi.format.bytesPerSample * 8 };
+        if (d->numOutputs == 1 && vsapi->isPropsOnlyRequest(frameCtx)) {
+            for (int i = 1; i < numInputs; i++)
+                vsapi->freeFrame(src[i]);
+            return propsOnlyFrame(src[0], &d->vi[0].format, width, height, core, vsapi);
+        }
+        int numPlanes = d->vi[0].format.numPlanes;
+        bool useDevice = d->gpu > 0;
+        for (int i = 0; i < numInputs && d->gpu < 0 && !useDevice; i++)
+            useDevice = !!(vsapi->getPlaneResidency(src[i], 0) & prDevice);
 
-        for (int plane = 0; plane < d->vi.format.numPlanes; plane++) {
-            if (d->plane[plane] != poProcess)
+        // the frames only start out in device memory when no plane is copied or done on the cpu
+        bool onDevice[3] = {};
+        bool allOnDevice = useDevice;
+        for (int plane = 0; plane < numPlanes; plane++) {
+            onDevice[plane] = useDevice && d->plane[plane] == poProcess && exprDeviceKernel(d, plane, core);
+            allOnDevice = allOnDevice && onDevice[plane];
+        }
+
+        int planes[3] = { 0, 1, 2 };
+        const VSVideoFormat *srcFormat = vsapi->getVideoFrameFormat(src[0]);
+        VSFrame *dst[exprMaxOutputs] = {};
+
+        for (int i = 0; i < d->numOutputs; i++) {
+            if (allOnDevice) {
+                dst[i] = vsapi->newVideoFrameDevice(&d->vi[i].format, width, height, src[0], core);
                 continue;
+            }
 
-            for (int i = 0; i < numInputs; i++) {
-                if (d->node[i]) {
-                    srcp[i] = vsapi->getReadPtr(src[i], plane);
-                    src_stride[i] = vsapi->getStride(src[i], plane);
-                    ptroffsets[i + 1] = vsapi->getVideoFrameFormat(src[i])->bytesPerSample * 8;
-                }
+            // the additional outputs also copy the planes without an expression when their format allows it
+            const VSVideoFormat &f = d->vi[i].format;
+            bool sameFormat = f.sampleType == srcFormat->sampleType && f.bitsPerSample == srcFormat->bitsPerSample;
+            const VSFrame *srcf[3] = {};
+            for (int plane = 0; plane < f.numPlanes; plane++) {
+                if (i ? (d->plane[plane] != poProcess && sameFormat) : d->plane[plane] == poCopy)
+                    srcf[plane] = src[0];
             }
+            dst[i] = vsapi->newVideoFrame2(&f, width, height, srcf, planes, src[0], core);
+        }
 
-            uint8_t *dstp = vsapi->getWritePtr(dst, plane);
-            ptrdiff_t dst_stride = vsapi->getStride(dst, plane);
-            int h = vsapi->getFrameHeight(dst, plane);
-            int w = vsapi->getFrameWidth(dst, plane);
+        std::vector<float> consts(d->constants.size());
+        for (size_t i = 0; i < d->constants.size(); i++) {
+            const FrameConstant &c = d->constants[i];
+            if (c.clip < 0) {
+                consts[i] = static_cast<float>(n);
+                continue;
+            }
 
-            if (d->proc[plane]) {
-                ExprCompiler::ProcessLineProc proc = d->proc[plane];
-                int niterations = (w + 7) / 8;
+            // missing and non-numeric properties evaluate to 0
+            const VSMap *props = vsapi->getFramePropertiesRO(src[c.clip]);
+            int err;
+            int type = vsapi->mapGetType(props, c.name.c_str());
+            if (type == ptInt)
+                consts[i] = static_cast<float>(vsapi->mapGetInt(props, c.name.c_str(), 0, &err));
+            else if (type == ptFloat)
+                consts[i] = static_cast<float>(vsapi->mapGetFloat(props, c.name.c_str(), 0, &err));
+        }
 
-                for (int i = 0; i < numInputs; i++) {
-                    if (d->node[i])
-                        ptroffsets[i + 1] = vsapi->getVideoFrameFormat(src[i])->bytesPerSample * 8;
-                }
+        for (int plane = 0; plane < numPlanes; plane++) {
+            if (d->plane[plane] != poProcess)
+                continue;
+            if (onDevice[plane] && exprProcessDevice(d, src, dst, consts.data(), plane, core, vsapi))
+                continue;
+            onDevice[plane] = false;
 
-                for (int y = 0; y < h; y++) {
-                    alignas(32) uint8_t *rwptrs[((MAX_EXPR_INPUTS + 1) + 7) & ~7] = { dstp + dst_stride * y };
-                    for (int i = 0; i < numInputs; i++) {
-                        rwptrs[i + 1] = const_cast<uint8_t *>(srcp[i] + src_stride[i] * y);
-                    }
-                    proc(rwptrs, ptroffsets, niterations);
-                }
-            } else {
-                ExprInterpreter interpreter(d->bytecode[plane].data(), d->bytecode[plane].size());
+            // make sure no plane still has to be unshared once the slices run on several threads
+            for (int i = 0; i < d->numOutputs; i++)
+                vsapi->getWritePtr(dst[i], plane);
+        }
 
-                for (int y = 0; y < h; y++) {
-                    for (int x = 0; x < w; x++) {
-                        interpreter.eval(srcp, dstp, x);
-                    }
+        parallelForEach(numPlanes * exprSlicesPerPlane, [&](int index) {
+            int plane = index / exprSlicesPerPlane;
+            if (d->plane[plane] == poProcess && !onDevice[plane])
+                exprProcessSlice(d, src, dst, consts.data(), plane, index % exprSlicesPerPlane, vsapi);
+        }, core, vsapi);
 
-                    for (int i = 0; i < numInputs; i++) {
-                        srcp[i] += src_stride[i];
-                    }
-                    dstp += dst_stride;
-                }
-            }
-        }
+        VSMap *props = d->numOutputs > 1 ? vsapi->getFramePropertiesRW(dst[0]) : nullptr;
+        for (int i = 1; i < d->numOutputs; i++)
+            vsapi->mapConsumeFrame(props, exprOutputProp(i).c_str(), dst[i], maReplace);
 
         for (int i = 0; i < MAX_EXPR_INPUTS; i++) {
             vsapi->freeFrame(src[i]);
         }
+        return dst[0];
+    }
+
+    return nullptr;
+}
+
+// MultiExpr returns every output through one of these, they take them apart again.
+struct ExprOutputDataExtra {
+    int output;
+    int numOutputs;
+};
+
+typedef SingleNodeData<ExprOutputDataExtra> ExprOutputData;
+
+static const VSFrame *VS_CC exprOutputGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    ExprOutputData *d = static_cast<ExprOutputData *>(instanceData);
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+
+        if (d->output > 0) {
+            const VSFrame *dst = vsapi->mapGetFrame(vsapi->getFramePropertiesRO(src), exprOutputProp(d->output).c_str(), 0, nullptr);
+            vsapi->freeFrame(src);
+            return dst;
+        }
+
+        VSFrame *dst = vsapi->copyFrame(src, core);
+        vsapi->freeFrame(src);
+        VSMap *props = vsapi->getFramePropertiesRW(dst);
+        for (int i = 1; i < d->numOutputs; i++)
+            vsapi->mapDeleteKey(props, exprOutputProp(i).c_str());
         return dst;
     }
 
     return nullptr;
 }
 
+//////////////////////////////////////////
+// Fusion
+
+// Relative loads such as x[-1,0] and properties such as x.PlaneStatsAverage count as references to their clip
+static int exprVarIndex(const std::string &token) {
+    if ((token.size() == 1 || token[1] == '[' || token[1] == '.') && token[0] >= 'a' && token[0] <= 'z')
+        return token[0] >= 'x' ? token[0] - 'x' : token[0] - 'a' + 3;
+    return -1;
+}
+
+static std::string exprVarName(int index) {
+    return std::string(1, static_cast<char>(index < 3 ? 'x' + index : 'a' + index - 3));
+}
+
+static bool exprUsesVar(const std::string &expr, int index, bool relative = false) {
+    for (const auto &tok : tokenize(expr)) {
+        if (exprVarIndex(tok) == index && (!relative || (tok.size() > 1 && tok[1] == '[')))
+            return true;
+    }
+    return false;
+}
+
+// An input produced by another Expr that nothing else uses can be evaluated inline instead of going
+// through an intermediate frame. The rounding and clamping of integer intermediates is kept so the
+// result stays bit identical, 16 bit float intermediates aren't fused since there's no equivalent.
+// Inputs read at other positions than the current pixel are never inlined.
+static bool exprCanFuse(const ExprData *d, const std::string expr[3], int input, const ExprData *src) {
+    const VSVideoFormat &f = src->vi[0].format;
+    if (f.sampleType == stFloat && f.bitsPerSample != 32)
+        return false;
+    if (src->vi[0].numFrames < d->vi[0].numFrames || src->numOutputs > 1)
+        return false;
+
+    for (int plane = 0; plane < d->vi[0].format.numPlanes; plane++) {
+        if (d->plane[plane] == poProcess && exprUsesVar(expr[plane], input) && src->plane[plane] == poUndefined)
+            return false;
+        if (d->plane[plane] == poProcess && exprUsesVar(expr[plane], input, true))
+            return false;
+        // plane copies come from the first input which changes with fusion
+        if (d->plane[plane] == poCopy && input == 0 && src->plane[plane] != poCopy)
+            return false;
+    }
+
+    return true;
+}
+
+static bool exprFuseInputs(ExprData *d, std::string expr[3], const VSAPI *vsapi) {
+    const ExprData *src[MAX_EXPR_INPUTS] = {};
+    bool any = false;
+    for (int i = 0; i < d->numInputs; i++) {
+        const ExprData *s = static_cast<const ExprData *>(getFusableInstanceData(d->node[i], exprGetFrame));
+        if (s && exprCanFuse(d, expr, i, s)) {
+            src[i] = s;
+            any = true;
+        }
+    }
+
+    if (!any)
+        return false;
+
+    // the first input has to stay first since frame properties are copied from it
+    std::vector<VSNode *> nodes;
+    auto inputIndex = [&nodes](VSNode *node) {
+        auto it = std::find(nodes.begin(), nodes.end(), node);
+        if (it != nodes.end())
+            return static_cast<int>(it - nodes.begin());
+        nodes.push_back(node);
+        return static_cast<int>(nodes.size() - 1);
+    };
+
+    int directIndex[MAX_EXPR_INPUTS] = {};
+    int fusedIndex[MAX_EXPR_INPUTS][MAX_EXPR_INPUTS] = {};
+    for (int i = 0; i < d->numInputs; i++) {
+        if (src[i]) {
+            for (int j = 0; j < src[i]->numInputs; j++)
+                fusedIndex[i][j] = inputIndex(src[i]->node[j]);
+        } else {
+            directIndex[i] = inputIndex(d->node[i]);
+        }
+    }
+
+    if (nodes.size() > MAX_EXPR_INPUTS)
+        return false;
+
+    std::string fused[3];
+    for (int plane = 0; plane < d->vi[0].format.numPlanes; plane++) {
+        if (d->plane[plane] != poProcess)
+            continue;
+
+        for (const auto &tok : tokenize(expr[plane])) {
+            int i = exprVarIndex(tok);
+            if (i < 0 || !src[i]) {
+                fused[plane] += (i < 0 ? tok : exprVarName(directIndex[i]) + tok.substr(1)) + " ";
+            } else if (tok.size() > 1 && tok[1] == '.') {
+                // Expr copies the frame properties of its first input
+                fused[plane] += exprVarName(fusedIndex[i][0]) + tok.substr(1) + " ";
+            } else if (src[i]->plane[plane] == poCopy) {
+                fused[plane] += exprVarName(fusedIndex[i][0]) + " ";
+            } else {
+                for (const auto &stok : tokenize(src[i]->expr[plane])) {
+                    int j = exprVarIndex(stok);
+                    std::string suffix = j < 0 ? std::string() : stok.substr(1);
+                    // pin the edge handling of the inlined expression, its default may differ
+                    if (!suffix.empty() && suffix.back() == ']')
+                        suffix += src[i]->boundary == BoundaryCondition::MIRROR ? ":m" : ":c";
+                    fused[plane] += (j < 0 ? stok : exprVarName(fusedIndex[i][j]) + suffix) + " ";
+                }
+
+                const VSVideoFormat &f = src[i]->vi[0].format;
+                if (f.sampleType == stInteger)
+                    fused[plane] += "0 max " + std::to_string((1 << f.bitsPerSample) - 1) + " min round ";
+            }
+        }
+    }
+
+    // take references to the new inputs before the fused ones are released, that may free their instance data
+    VSNode *oldNodes[MAX_EXPR_INPUTS];
+    int oldNumInputs = d->numInputs;
+    std::copy(d->node, d->node + oldNumInputs, oldNodes);
+    for (size_t i = 0; i < nodes.size(); i++)
+        d->node[i] = vsapi->addNodeRef(nodes[i]);
+    for (size_t i = nodes.size(); i < MAX_EXPR_INPUTS; i++)
+        d->node[i] = nullptr;
+    d->numInputs = static_cast<int>(nodes.size());
+    for (int plane = 0; plane < 3; plane++) {
+        if (d->plane[plane] == poProcess)
+            expr[plane] = fused[plane];
+    }
+    for (int i = 0; i < oldNumInputs; i++)
+        vsapi->freeNode(oldNodes[i]);
+
+    return true;
+}
+
+// Gives every vertically offset load its own row pointer after the ones of the inputs and
+// finds how far relative loads reach horizontally.
+static void exprAssignRows(ExprData *d, int plane) {
+    std::vector<ExprRow> &rows = d->rows[plane];
+    rows.clear();
+    for (int i = 0; i < d->numInputs; i++)
+        rows.push_back({ i, 0, BoundaryCondition::CLAMP });
+
+    bool used[MAX_EXPR_INPUTS] = {};
+    int lowest[MAX_EXPR_INPUTS] = {};
+
+    for (auto &insn : d->bytecode[plane]) {
+        if (insn.op.type != ExprOpType::MEM_LOAD_U8 && insn.op.type != ExprOpType::MEM_LOAD_U16 && insn.op.type != ExprOpType::MEM_LOAD_F16 && insn.op.type != ExprOpType::MEM_LOAD_F32)
+            continue;
+
+        d->leftBorder[plane] = std::max(d->leftBorder[plane], -insn.op.dx);
+        d->rightBorder[plane] = std::max(d->rightBorder[plane], insn.op.dx);
+
+        int clip = static_cast<int>(insn.op.imm.u);
+        lowest[clip] = used[clip] ? std::max(lowest[clip], insn.op.dy) : insn.op.dy;
+        used[clip] = true;
+
+        if (!insn.op.dy)
+            continue;
+
+        auto it = std::find_if(rows.begin(), rows.end(), [&](const ExprRow &row) { return row.clip == clip && row.dy == insn.op.dy && row.boundary == insn.op.boundary; });
+        if (it == rows.end()) {
+            if (rows.size() >= exprMaxRows)
+                throw std::runtime_error("Too many distinct rows referenced by relative pixel access");
+            it = rows.insert(rows.end(), { clip, insn.op.dy, insn.op.boundary });
+        }
+        insn.op.imm.u = static_cast<unsigned>(it - rows.begin());
+    }
+
+    // the rows further down are read anyway when the next row is processed, so only the first new one is prefetched
+    std::vector<ExprRow> &prefetch = d->prefetch[plane];
+    prefetch.clear();
+    for (int i = 0; i < d->numInputs; i++) {
+        if (used[i])
+            prefetch.push_back({ i, lowest[i] + 1, BoundaryCondition::CLAMP });
+    }
+}
+
+static void exprAppendKey(std::string &key, int value) {
+    key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void exprCompilePlane(ExprData *d, int plane, const std::string &expr, const VSVideoInfo * const vi[], int cpulevel) {
+    // the program only depends on the sample types of the inputs and output
+    std::string key = expr;
+    key += '\0';
+    exprAppendKey(key, d->numInputs);
+    for (int i = 0; i < d->numInputs; i++) {
+        exprAppendKey(key, vi[i]->format.sampleType);
+        exprAppendKey(key, vi[i]->format.bytesPerSample);
+    }
+    exprAppendKey(key, d->numOutputs);
+    for (int i = 0; i < d->numOutputs; i++) {
+        exprAppendKey(key, d->vi[i].format.sampleType);
+        exprAppendKey(key, d->vi[i].format.bitsPerSample);
+    }
+    exprAppendKey(key, static_cast<int>(d->boundary));
+
+    d->program[plane] = exprProgramCache().get(key, [&]() {
+        ExprProgram program;
+        const VSVideoInfo *outvi[exprMaxOutputs];
+        for (int i = 0; i < d->numOutputs; i++)
+            outvi[i] = &d->vi[i];
+        program.bytecode = compile(expr, vi, d->numInputs, outvi, d->numOutputs, true, d->boundary, &program.constants);
+        return program;
+    });
+
+    const ExprProgram &program = *d->program[plane];
+    d->bytecode[plane] = program.bytecode;
+    for (auto &insn : d->bytecode[plane]) {
+        if (insn.op.type != ExprOpType::CONST_LOAD)
+            continue;
+        const FrameConstant &c = program.constants[insn.op.imm.u];
+        auto it = std::find(d->constants.begin(), d->constants.end(), c);
+        if (it == d->constants.end())
+            it = d->constants.insert(d->constants.end(), c);
+        insn.op.imm.u = static_cast<unsigned>(it - d->constants.begin());
+    }
+
+    exprAssignRows(d, plane);
+
+    if (cpulevel <= VS_CPU_LEVEL_NONE)
+        return;
+
+    // the machine code doesn't depend on what the rows and constants are, only on their indices
+    int numRows = static_cast<int>(d->rows[plane].size());
+    key.clear();
+    exprAppendKey(key, cpulevel);
+    exprAppendKey(key, numRows);
+    exprAppendKey(key, static_cast<int>(d->prefetch[plane].size()));
+    for (const auto &insn : d->bytecode[plane]) {
+        exprAppendKey(key, static_cast<int>(insn.op.type));
+        exprAppendKey(key, insn.op.imm.i);
+        exprAppendKey(key, insn.op.dx);
+        exprAppendKey(key, static_cast<int>(insn.op.integer));
+        exprAppendKey(key, insn.op.output);
+        exprAppendKey(key, insn.dst);
+        exprAppendKey(key, insn.src1);
+        exprAppendKey(key, insn.src2);
+        exprAppendKey(key, insn.src3);
+    }
+
+    d->code[plane] = exprCodeCache().get(key, [&]() {
+        return expr::compile_jit(d->bytecode[plane].data(), d->bytecode[plane].size(), numRows, static_cast<int>(d->prefetch[plane].size()), cpulevel);
+    });
+    d->proc[plane] = d->code[plane]->proc;
+}
+
 static void VS_CC exprFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     ExprData *d = static_cast<ExprData *>(instanceData);
     for (int i = 0; i < MAX_EXPR_INPUTS; i++)
         vsapi->freeNode(d->node[i]);
+    for (int plane = 0; plane < 3; plane++) {
+        if (d->deviceKernel[plane])
+            freeDeviceKernel(core, d->deviceKernel[plane]);
+    }
     delete d;
 }
 
 static void VS_CC exprCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<ExprData> d(new ExprData);
+    bool multi = !!userData;
+    const char *name = multi ? "MultiExpr" : "Expr";
     int err;
 
 #ifdef VS_TARGET_CPU_X86
@@ -301,19 +917,8 @@ static void VS_CC exprCreate(const VSMap *in, VSMap *out, void *userData, VSCore
             }
         }
 
-        d->vi = *vi[0];
-        int format = vsapi->mapGetIntSaturated(in, "format", 0, &err);
-        if (!err) {
-            VSVideoFormat f;
-            if (vsapi->getVideoFormatByID(&f, format, core) && f.colorFamily != cfUndefined) {
-                if (d->vi.format.numPlanes != f.numPlanes)
-                    throw std::runtime_error("The number of planes in the inputs and output must match");
-                vsapi->queryVideoFormat(&d->vi.format, d->vi.format.colorFamily, f.sampleType, f.bitsPerSample, d->vi.format.subSamplingW, d->vi.format.subSamplingH, core);
-            }
-        }
-
         int nexpr = vsapi->mapNumElements(in, "expr");
-        if (nexpr > d->vi.format.numPlanes)
+        if (nexpr > vi[0]->format.numPlanes)
             throw std::runtime_error("More expressions given than there are planes");
 
         std::string expr[3];
@@ -324,25 +929,70 @@ static void VS_CC exprCreate(const VSMap *in, VSMap *out, void *userData, VSCore
             expr[i] = expr[nexpr - 1];
         }
 
+        // every value left on the stack is an output, all planes have to agree on how many there are
+        if (multi) {
+            for (int i = 0; i < vi[0]->format.numPlanes; i++) {
+                if (!expr[i].empty()) {
+                    d->numOutputs = countOutputs(expr[i], vi, d->numInputs);
+                    break;
+                }
+            }
+            if (d->numOutputs > exprMaxOutputs)
+                throw std::runtime_error("More than " + std::to_string(exprMaxOutputs) + " outputs");
+        }
+
+        // the last format is used for all remaining outputs
+        int nformat = vsapi->mapNumElements(in, "format");
+        for (int i = 0; i < d->numOutputs; i++) {
+            d->vi[i] = *vi[0];
+            int format = vsapi->mapGetIntSaturated(in, "format", std::max(std::min(i, nformat - 1), 0), &err);
+            if (!err) {
+                VSVideoFormat f;
+                if (vsapi->getVideoFormatByID(&f, format, core) && f.colorFamily != cfUndefined) {
+                    if (d->vi[i].format.numPlanes != f.numPlanes)
+                        throw std::runtime_error("The number of planes in the inputs and output must match");
+                    vsapi->queryVideoFormat(&d->vi[i].format, d->vi[i].format.colorFamily, f.sampleType, f.bitsPerSample, d->vi[i].format.subSamplingW, d->vi[i].format.subSamplingH, core);
+                }
+            }
+        }
+
+        int boundary = vsapi->mapGetIntSaturated(in, "boundary", 0, &err);
+        if (boundary < 0 || boundary > 1)
+            throw std::runtime_error("boundary must be 0 (clamp) or 1 (mirror)");
+        d->boundary = static_cast<BoundaryCondition>(boundary);
+
+        d->gpu = vsapi->mapGetIntSaturated(in, "gpu", 0, &err);
+        if (err)
+            d->gpu = -1;
+        if (d->gpu < -1 || d->gpu > 1)
+            throw std::runtime_error("gpu must be -1 (auto), 0 (never) or 1 (when available)");
+
         int cpulevel = vs_get_cpulevel(core);
 
-        for (int i = 0; i < d->vi.format.numPlanes; i++) {
+        for (int i = 0; i < d->vi[0].format.numPlanes; i++) {
             if (!expr[i].empty()) {
                 d->plane[i] = poProcess;
             } else {
-                if (d->vi.format.bitsPerSample == vi[0]->format.bitsPerSample && d->vi.format.sampleType == vi[0]->format.sampleType)
+                if (d->vi[0].format.bitsPerSample == vi[0]->format.bitsPerSample && d->vi[0].format.sampleType == vi[0]->format.sampleType)
                     d->plane[i] = poCopy;
                 else
                     d->plane[i] = poUndefined;
             }
+        }
+
+        // the additional outputs decide whether to copy planes by the first input, so MultiExpr doesn't fuse
+        int fuse = vsapi->mapGetIntSaturated(in, "fuse", 0, &err);
+        if (!multi && (err || fuse) && exprFuseInputs(d.get(), expr, vsapi)) {
+            for (int i = 0; i < MAX_EXPR_INPUTS; i++)
+                vi[i] = d->node[i] ? vsapi->getVideoInfo(d->node[i]) : nullptr;
+        }
 
+        for (int i = 0; i < d->vi[0].format.numPlanes; i++) {
             if (d->plane[i] != poProcess)
                 continue;
 
-            d->bytecode[i] = compile(expr[i], vi, d->numInputs, d->vi);
-
-            if (cpulevel > VS_CPU_LEVEL_NONE)
-                std::tie(d->proc[i], d->procSize[i]) = expr::compile_jit(d->bytecode[i].data(), d->bytecode[i].size(), d->numInputs, cpulevel);
+            d->expr[i] = expr[i];
+            exprCompilePlane(d.get(), i, expr[i], vi, cpulevel);
         }
 #ifdef VS_TARGET_OS_WINDOWS
         FlushInstructionCache(GetCurrentProcess(), nullptr, 0);
@@ -351,23 +1001,123 @@ static void VS_CC exprCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         for (int i = 0; i < MAX_EXPR_INPUTS; i++) {
             vsapi->freeNode(d->node[i]);
         }
-        vsapi->mapSetError(out, (std::string{ "Expr: " } + e.what()).c_str());
+        vsapi->mapSetError(out, (std::string{ name } + ": " + e.what()).c_str());
         return;
     }
 
     std::vector<VSFilterDependency> deps;
     for (int i = 0; i < d->numInputs; i++)
-        deps.push_back({d->node[i], (d->vi.numFrames <= vsapi->getVideoInfo(d->node[i])->numFrames) ? rpStrictSpatial : rpGeneral});
-    vsapi->createVideoFilter(out, "Expr", &d->vi, exprGetFrame, exprFree, fmParallel, deps.data(), d->numInputs, d.get(), core);
+        deps.push_back({d->node[i], (d->vi[0].numFrames <= vsapi->getVideoInfo(d->node[i])->numFrames) ? rpStrictSpatial : rpGeneral});
+
+    // relative pixel access is the only way to look at other pixels
+    int spatialRadius = 0;
+    for (int plane = 0; plane < d->vi[0].format.numPlanes; plane++) {
+        spatialRadius = std::max({ spatialRadius, d->leftBorder[plane], d->rightBorder[plane] });
+        for (const ExprRow &row : d->rows[plane])
+            spatialRadius = std::max(spatialRadius, std::abs(row.dy));
+    }
+
+    if (d->numOutputs == 1) {
+        VSNode *node = vsapi->createVideoFilter2(name, &d->vi[0], exprGetFrame, exprFree, fmParallel, deps.data(), d->numInputs, d.get(), core);
+        vsapi->setFilterHints(node, fcUnknown, 0, spatialRadius);
+        vsapi->mapConsumeNode(out, "clip", node, maAppend);
+        d.release();
+        return;
+    }
+
+    int numOutputs = d->numOutputs;
+    VSVideoInfo outvi[exprMaxOutputs];
+    std::copy(d->vi, d->vi + numOutputs, outvi);
+
+    VSMap *tmp = vsapi->createMap();
+    vsapi->createVideoFilter(tmp, name, &outvi[0], exprGetFrame, exprFree, fmParallel, deps.data(), d->numInputs, d.get(), core);
     d.release();
+    VSNode *node = vsapi->mapGetNode(tmp, "clip", 0, nullptr);
+    vsapi->freeMap(tmp);
+    vsapi->setFilterHints(node, fcUnknown, 0, spatialRadius);
+
+    // the node is requested by every output so its frames end up in the cache
+    for (int i = 0; i < numOutputs; i++) {
+        std::unique_ptr<ExprOutputData> od(new ExprOutputData(vsapi));
+        od->node = vsapi->addNodeRef(node);
+        od->output = i;
+        od->numOutputs = numOutputs;
+        VSFilterDependency odeps[] = {{od->node, rpStrictSpatial}};
+        VSNode *onode = vsapi->createVideoFilter2(name, &outvi[i], exprOutputGetFrame, filterFree<ExprOutputData>, fmParallel, odeps, 1, od.get(), core);
+        vsapi->setFilterHints(onode, fcUnknown, 0, 0);
+        vsapi->mapConsumeNode(out, "clip", onode, maAppend);
+        od.release();
+    }
+    vsapi->freeNode(node);
 }
 
 } // namespace
 
+//////////////////////////////////////////
+// Lookup tables
+
+void exprGenerateLut(const char *expr, int xbits, int ybits, const VSVideoFormat *dstFormat, void *lut, VSCore *core, const VSAPI *vsapi) {
+    ExprData d;
+    int width = 1 << xbits;
+    int height = 1 << ybits;
+
+    // every table entry is a pixel of a frame where x is the column and y is the row
+    VSVideoInfo vi[2] = {};
+    vsapi->queryVideoFormat(&vi[0].format, cfGray, stInteger, xbits, 0, 0, core);
+    if (ybits)
+        vsapi->queryVideoFormat(&vi[1].format, cfGray, stInteger, ybits, 0, 0, core);
+    vsapi->queryVideoFormat(&d.vi[0].format, cfGray, dstFormat->sampleType, dstFormat->bitsPerSample, 0, 0, core);
+    for (VSVideoInfo *v : { &vi[0], &vi[1], &d.vi[0] }) {
+        v->width = width;
+        v->height = height;
+        v->numFrames = 1;
+    }
+
+    d.numInputs = ybits ? 2 : 1;
+    d.plane[0] = poProcess;
+    const VSVideoInfo *vip[MAX_EXPR_INPUTS] = { &vi[0], ybits ? &vi[1] : nullptr };
+    exprCompilePlane(&d, 0, expr, vip, vs_get_cpulevel(core));
+
+    const VSFrame *src[MAX_EXPR_INPUTS] = {};
+    for (int i = 0; i < d.numInputs; i++) {
+        VSFrame *f = vsapi->newVideoFrame(&vi[i].format, width, height, nullptr, core);
+        ptrdiff_t stride = vsapi->getStride(f, 0);
+        uint8_t *p = vsapi->getWritePtr(f, 0);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int v = i ? y : x;
+                if (vi[i].format.bytesPerSample == 1)
+                    p[x] = static_cast<uint8_t>(v);
+                else
+                    reinterpret_cast<uint16_t *>(p)[x] = static_cast<uint16_t>(v);
+            }
+            p += stride;
+        }
+        src[i] = f;
+    }
+
+    // there is no frame, N and all properties are 0
+    std::vector<float> consts(d.constants.size());
+    VSFrame *dst = vsapi->newVideoFrame(&d.vi[0].format, width, height, nullptr, core);
+    parallelForEach(exprSlicesPerPlane, [&](int slice) {
+        exprProcessSlice(&d, src, &dst, consts.data(), 0, slice, vsapi);
+    }, core, vsapi);
+
+    size_t rowsize = width * d.vi[0].format.bytesPerSample;
+    bitblt(lut, rowsize, vsapi->getReadPtr(dst, 0), vsapi->getStride(dst, 0), rowsize, height);
+
+    vsapi->freeFrame(dst);
+    for (int i = 0; i < d.numInputs; i++)
+        vsapi->freeFrame(src[i]);
+}
+
 
 //////////////////////////////////////////
 // Init
 
 void exprInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
-    vspapi->registerFunction("Expr", "clips:vnode[];expr:data[];format:int:opt;", "clip:vnode;", exprCreate, nullptr, plugin);
+    vspapi->registerFunction("Expr", "clips:vnode[];expr:data[];format:int:opt;fuse:int:opt;boundary:int:opt;gpu:int:opt;", "clip:vnode;", exprCreate, nullptr, plugin);
+    vspapi->registerFunction("MultiExpr", "clips:vnode[];expr:data[];format:int[]:opt;boundary:int:opt;gpu:int:opt;", "clip:vnode[];", exprCreate, (void *)1, plugin);
+    vspapi->setFunctionFlags("Expr", pffDeterministic | pffProxyScalable, plugin);
+    vspapi->setFunctionFlags("MultiExpr", pffProxyScalable, plugin);
 }
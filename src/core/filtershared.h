@@ -27,6 +27,7 @@
 #include <string>
 #include <vector>
 #include <limits>
+#include <type_traits>
 
 #define RETERROR(x) do { vsapi->mapSetError(out, (x)); return; } while (0)
 
@@ -56,6 +57,36 @@ static inline int floatToIntS(float f) {
         return static_cast<int>(lround(f));
 }
 
+// calls func(i) for every i from 0 to count - 1, idle worker threads may run some of the calls so func must be thread-safe and not throw
+template<typename F>
+static inline void parallelForEach(int count, F &&func, VSCore *core, const VSAPI *vsapi) {
+    typedef typename std::remove_reference<F>::type FuncType;
+    vsapi->parallelFor(count, [](int index, void *userData) { (*static_cast<FuncType *>(userData))(index); }, &func, core);
+}
+
+// Takes over src, a request that only needs the properties gets it back as the output when the format and
+// size match so nothing is allocated or computed, otherwise a frame with its properties and undefined pixels
+static inline const VSFrame *propsOnlyFrame(const VSFrame *src, const VSVideoFormat *fi, int width, int height, VSCore *core, const VSAPI *vsapi) {
+    const VSVideoFormat *sf = vsapi->getVideoFrameFormat(src);
+    if (sf->colorFamily == fi->colorFamily && sf->sampleType == fi->sampleType && sf->bitsPerSample == fi->bitsPerSample &&
+        sf->subSamplingW == fi->subSamplingW && sf->subSamplingH == fi->subSamplingH &&
+        vsapi->getFrameWidth(src, 0) == width && vsapi->getFrameHeight(src, 0) == height)
+        return src;
+    VSFrame *dst = vsapi->newVideoFrame(fi, width, height, src, core);
+    vsapi->freeFrame(src);
+    return dst;
+}
+
+// Declares that the node just created in out passes the pixels of its inputs on unchanged so region
+// and props-only requests reach the inputs too
+static inline void setPassThroughHints(VSMap *out, const VSAPI *vsapi) {
+    VSNode *node = vsapi->mapGetNode(out, "clip", 0, nullptr);
+    if (node) {
+        vsapi->setFilterHints(node, fcUnknown, -1, 0);
+        vsapi->freeNode(node);
+    }
+}
+
 // Convenience structs for *NodeData templates
 
 typedef struct NoExtraData {
@@ -153,6 +184,17 @@ static bool is8to16orFloatFormat(const VSVideoFormat &fi, bool allowVariable = f
     return true;
 }
 
+// for the filters that also have kernels for half precision float
+static bool is8to16orHalfOrFloatFormat(const VSVideoFormat &fi, bool allowVariable = false) {
+    if (fi.colorFamily == cfUndefined && !allowVariable)
+        return false;
+
+    if ((fi.sampleType == stInteger && fi.bitsPerSample > 16) || (fi.sampleType == stFloat && fi.bitsPerSample != 16 && fi.bitsPerSample != 32))
+        return false;
+
+    return true;
+}
+
 template<typename T>
 static inline void vs_memset(void *ptr, T value, size_t num) {
     T *dstPtr = reinterpret_cast<T *>(ptr);
@@ -178,4 +220,9 @@ static inline void getPlanesArg(const VSMap *in, bool *process, const VSAPI *vsa
     }
 }
 
+// bitmask of the planes to process as used by setFilterStripe()
+static inline int getPlanesMask(const bool *process) {
+    return (process[0] ? 1 : 0) | (process[1] ? 2 : 0) | (process[2] ? 4 : 0);
+}
+
 #endif // FILTERSHARED_H
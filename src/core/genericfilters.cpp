@@ -27,6 +27,7 @@
 #include <cstdlib>
 #include <limits>
 #include <memory>
+#include <numeric>
 #include <string>
 #include <vector>
 #include "VapourSynth4.h"
@@ -36,6 +37,9 @@
 #include "internalfilters.h"
 #include "kernel/cpulevel.h"
 #include "kernel/generic.h"
+#include "kernel/half.h"
+#include "kernel/lut.h"
+#include "kernel/pointops.h"
 
 #ifdef _MSC_VER
 #define FORCE_INLINE inline __forceinline
@@ -107,7 +111,8 @@ enum GenericOperations {
 enum ConvolutionTypes {
     ConvolutionSquare,
     ConvolutionHorizontal,
-    ConvolutionVertical
+    ConvolutionVertical,
+    ConvolutionSeparable
 };
 
 struct GenericDataExtra {
@@ -126,6 +131,10 @@ struct GenericDataExtra {
     // Minimum, Maximum
     uint8_t enable;
 
+    // Median, Percentile
+    int radius;
+    int rank;
+
     // Convolution
     ConvolutionTypes convolution_type;
     int matrix[25];
@@ -149,6 +158,9 @@ static const VSFrame *VS_CC singlePixelGetFrame(int n, int activationReason, voi
         vsapi->requestFrameFilter(n, d->node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+        // the output has the format and properties of the input
+        if (vsapi->isPropsOnlyRequest(frameCtx))
+            return src;
         const VSVideoFormat *fi = vsapi->getVideoFrameFormat(src);
 
         if (!is8to16orFloatFormat(*fi)) {
@@ -166,7 +178,8 @@ static const VSFrame *VS_CC singlePixelGetFrame(int n, int activationReason, voi
 
         VSFrame *dst = vsapi->newVideoFrame2(fi, vsapi->getFrameWidth(src, 0), vsapi->getFrameHeight(src, 0), fr, pl, src, core);
 
-        for (int plane = 0; plane < fi->numPlanes; plane++) {
+        // processed planes are freshly allocated so they can be written from different threads
+        parallelForEach(fi->numPlanes, [&](int plane) {
             if (d->process[plane]) {
                 OP opts(d, fi, plane);
                 uint8_t * VS_RESTRICT dstp = vsapi->getWritePtr(dst, plane);
@@ -176,17 +189,12 @@ static const VSFrame *VS_CC singlePixelGetFrame(int n, int activationReason, voi
                 ptrdiff_t stride = vsapi->getStride(src, plane);
 
                 for (int h = 0; h < height; h++) {
-                    if (fi->bytesPerSample == 1)
-                        OP::template processPlane<uint8_t>(srcp, dstp, width, opts);
-                    else if (fi->bytesPerSample == 2)
-                        OP::template processPlane<uint16_t>(reinterpret_cast<const uint16_t *>(srcp), reinterpret_cast<uint16_t *>(dstp), width, opts);
-                    else if (fi->bytesPerSample == 4)
-                        OP::template processPlaneF<float>(reinterpret_cast<const float *>(srcp), reinterpret_cast<float *>(dstp), width, opts);
+                    opts.process(srcp, dstp, width);
                     srcp += stride;
                     dstp += stride;
                 }
             }
-        }
+        }, core, vsapi);
 
         vsapi->freeFrame(src);
 
@@ -217,6 +225,8 @@ vs_generic_params make_generic_params(const GenericData *d, const VSVideoFormat
     params.threshold = d->th;
     params.thresholdf = d->thf;
     params.stencil = d->enable;
+    params.radius = d->radius;
+    params.rank = d->rank;
 
     for (int i = 0; i < d->matrix_elements; ++i) {
         params.matrix[i] = d->matrix[i];
@@ -232,6 +242,63 @@ vs_generic_params make_generic_params(const GenericData *d, const VSVideoFormat
 }
 
 #ifdef VS_TARGET_CPU_X86
+template <GenericOperations op>
+static decltype(&vs_generic_3x3_conv_byte_c) genericSelectAVX512(const VSVideoFormat *fi, GenericData *d) {
+    if (fi->sampleType == stInteger && fi->bytesPerSample == 1) {
+        switch (op) {
+        case GenericPrewitt: return vs_generic_3x3_prewitt_byte_avx512;
+        case GenericSobel: return vs_generic_3x3_sobel_byte_avx512;
+        case GenericMinimum: return vs_generic_3x3_min_byte_avx512;
+        case GenericMaximum: return vs_generic_3x3_max_byte_avx512;
+        case GenericMedian:
+            if (d->radius == 1 && d->rank == 4)
+                return vs_generic_3x3_median_byte_avx512;
+            break;
+        case GenericDeflate: return vs_generic_3x3_deflate_byte_avx512;
+        case GenericInflate: return vs_generic_3x3_inflate_byte_avx512;
+        case GenericConvolution:
+            if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 9)
+                return vs_generic_3x3_conv_byte_avx512;
+            break;
+        }
+    } else if (fi->sampleType == stInteger && fi->bytesPerSample == 2) {
+        switch (op) {
+        case GenericPrewitt: return vs_generic_3x3_prewitt_word_avx512;
+        case GenericSobel: return vs_generic_3x3_sobel_word_avx512;
+        case GenericMinimum: return vs_generic_3x3_min_word_avx512;
+        case GenericMaximum: return vs_generic_3x3_max_word_avx512;
+        case GenericMedian:
+            if (d->radius == 1 && d->rank == 4)
+                return vs_generic_3x3_median_word_avx512;
+            break;
+        case GenericDeflate: return vs_generic_3x3_deflate_word_avx512;
+        case GenericInflate: return vs_generic_3x3_inflate_word_avx512;
+        case GenericConvolution:
+            if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 9)
+                return vs_generic_3x3_conv_word_avx512;
+            break;
+        }
+    } else if (fi->sampleType == stFloat && fi->bytesPerSample == 4) {
+        switch (op) {
+        case GenericPrewitt: return vs_generic_3x3_prewitt_float_avx512;
+        case GenericSobel: return vs_generic_3x3_sobel_float_avx512;
+        case GenericMinimum: return vs_generic_3x3_min_float_avx512;
+        case GenericMaximum: return vs_generic_3x3_max_float_avx512;
+        case GenericMedian:
+            if (d->radius == 1 && d->rank == 4)
+                return vs_generic_3x3_median_float_avx512;
+            break;
+        case GenericDeflate: return vs_generic_3x3_deflate_float_avx512;
+        case GenericInflate: return vs_generic_3x3_inflate_float_avx512;
+        case GenericConvolution:
+            if (d->convolution_type == ConvolutionSquare && d->matrix_elements == 9)
+                return vs_generic_3x3_conv_float_avx512;
+            break;
+        }
+    }
+    return nullptr;
+}
+
 template <GenericOperations op>
 static decltype(&vs_generic_3x3_conv_byte_c) genericSelectAVX2(const VSVideoFormat *fi, GenericData *d) {
     if (fi->sampleType == stInteger && fi->bytesPerSample == 1) {
@@ -240,7 +307,10 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectAVX2(const VSVideoForm
         case GenericSobel: return vs_generic_3x3_sobel_byte_avx2;
         case GenericMinimum: return vs_generic_3x3_min_byte_avx2;
         case GenericMaximum: return vs_generic_3x3_max_byte_avx2;
-        case GenericMedian: return vs_generic_3x3_median_byte_avx2;
+        case GenericMedian:
+            if (d->radius == 1 && d->rank == 4)
+                return vs_generic_3x3_median_byte_avx2;
+            break;
         case GenericDeflate: return vs_generic_3x3_deflate_byte_avx2;
         case GenericInflate: return vs_generic_3x3_inflate_byte_avx2;
         case GenericConvolution:
@@ -254,7 +324,10 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectAVX2(const VSVideoForm
         case GenericSobel: return vs_generic_3x3_sobel_word_avx2;
         case GenericMinimum: return vs_generic_3x3_min_word_avx2;
         case GenericMaximum: return vs_generic_3x3_max_word_avx2;
-        case GenericMedian: return vs_generic_3x3_median_word_avx2;
+        case GenericMedian:
+            if (d->radius == 1 && d->rank == 4)
+                return vs_generic_3x3_median_word_avx2;
+            break;
         case GenericDeflate: return vs_generic_3x3_deflate_word_avx2;
         case GenericInflate: return vs_generic_3x3_inflate_word_avx2;
         case GenericConvolution:
@@ -268,7 +341,10 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectAVX2(const VSVideoForm
         case GenericSobel: return vs_generic_3x3_sobel_float_avx2;
         case GenericMinimum: return vs_generic_3x3_min_float_avx2;
         case GenericMaximum: return vs_generic_3x3_max_float_avx2;
-        case GenericMedian: return vs_generic_3x3_median_float_avx2;
+        case GenericMedian:
+            if (d->radius == 1 && d->rank == 4)
+                return vs_generic_3x3_median_float_avx2;
+            break;
         case GenericDeflate: return vs_generic_3x3_deflate_float_avx2;
         case GenericInflate: return vs_generic_3x3_inflate_float_avx2;
         case GenericConvolution:
@@ -288,7 +364,10 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectSSE2(const VSVideoForm
         case GenericSobel: return vs_generic_3x3_sobel_byte_sse2;
         case GenericMinimum: return vs_generic_3x3_min_byte_sse2;
         case GenericMaximum: return vs_generic_3x3_max_byte_sse2;
-        case GenericMedian: return vs_generic_3x3_median_byte_sse2;
+        case GenericMedian:
+            if (d->radius == 1 && d->rank == 4)
+                return vs_generic_3x3_median_byte_sse2;
+            break;
         case GenericDeflate: return vs_generic_3x3_deflate_byte_sse2;
         case GenericInflate: return vs_generic_3x3_inflate_byte_sse2;
         case GenericConvolution:
@@ -302,7 +381,10 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectSSE2(const VSVideoForm
         case GenericSobel: return vs_generic_3x3_sobel_word_sse2;
         case GenericMinimum: return vs_generic_3x3_min_word_sse2;
         case GenericMaximum: return vs_generic_3x3_max_word_sse2;
-        case GenericMedian: return vs_generic_3x3_median_word_sse2;
+        case GenericMedian:
+            if (d->radius == 1 && d->rank == 4)
+                return vs_generic_3x3_median_word_sse2;
+            break;
         case GenericDeflate: return vs_generic_3x3_deflate_word_sse2;
         case GenericInflate: return vs_generic_3x3_inflate_word_sse2;
         case GenericConvolution:
@@ -316,7 +398,10 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectSSE2(const VSVideoForm
         case GenericSobel: return vs_generic_3x3_sobel_float_sse2;
         case GenericMinimum: return vs_generic_3x3_min_float_sse2;
         case GenericMaximum: return vs_generic_3x3_max_float_sse2;
-        case GenericMedian: return vs_generic_3x3_median_float_sse2;
+        case GenericMedian:
+            if (d->radius == 1 && d->rank == 4)
+                return vs_generic_3x3_median_float_sse2;
+            break;
         case GenericDeflate: return vs_generic_3x3_deflate_float_sse2;
         case GenericInflate: return vs_generic_3x3_inflate_float_sse2;
         case GenericConvolution:
@@ -337,7 +422,10 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSVideoFormat
         case GenericSobel: return vs_generic_3x3_sobel_byte_c;
         case GenericMinimum: return vs_generic_3x3_min_byte_c;
         case GenericMaximum: return vs_generic_3x3_max_byte_c;
-        case GenericMedian: return vs_generic_3x3_median_byte_c;
+        case GenericMedian:
+            if (d->radius == 1 && d->rank == 4)
+                return vs_generic_3x3_median_byte_c;
+            return vs_generic_rank_byte_c;
         case GenericDeflate: return vs_generic_3x3_deflate_byte_c;
         case GenericInflate: return vs_generic_3x3_inflate_byte_c;
         case GenericConvolution:
@@ -349,6 +437,8 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSVideoFormat
                 return vs_generic_1d_conv_h_byte_c;
             else if (d->convolution_type == ConvolutionVertical)
                 return vs_generic_1d_conv_v_byte_c;
+            else if (d->convolution_type == ConvolutionSeparable)
+                return vs_generic_sep_conv_byte_c;
             break;
         }
     } else if (fi->sampleType == stInteger && fi->bytesPerSample == 2) {
@@ -357,7 +447,10 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSVideoFormat
         case GenericSobel: return vs_generic_3x3_sobel_word_c;
         case GenericMinimum: return vs_generic_3x3_min_word_c;
         case GenericMaximum: return vs_generic_3x3_max_word_c;
-        case GenericMedian: return vs_generic_3x3_median_word_c;
+        case GenericMedian:
+            if (d->radius == 1 && d->rank == 4)
+                return vs_generic_3x3_median_word_c;
+            return vs_generic_rank_word_c;
         case GenericDeflate: return vs_generic_3x3_deflate_word_c;
         case GenericInflate: return vs_generic_3x3_inflate_word_c;
         case GenericConvolution:
@@ -369,6 +462,8 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSVideoFormat
                 return vs_generic_1d_conv_h_word_c;
             else if (d->convolution_type == ConvolutionVertical)
                 return vs_generic_1d_conv_v_word_c;
+            else if (d->convolution_type == ConvolutionSeparable)
+                return vs_generic_sep_conv_word_c;
             break;
         }
     } else if (fi->sampleType == stFloat && fi->bytesPerSample == 4) {
@@ -377,7 +472,10 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSVideoFormat
         case GenericSobel: return vs_generic_3x3_sobel_float_c;
         case GenericMinimum: return vs_generic_3x3_min_float_c;
         case GenericMaximum: return vs_generic_3x3_max_float_c;
-        case GenericMedian: return vs_generic_3x3_median_float_c;
+        case GenericMedian:
+            if (d->radius == 1 && d->rank == 4)
+                return vs_generic_3x3_median_float_c;
+            return vs_generic_rank_float_c;
         case GenericDeflate: return vs_generic_3x3_deflate_float_c;
         case GenericInflate: return vs_generic_3x3_inflate_float_c;
         case GenericConvolution:
@@ -389,12 +487,55 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSVideoFormat
                 return vs_generic_1d_conv_h_float_c;
             else if (d->convolution_type == ConvolutionVertical)
                 return vs_generic_1d_conv_v_float_c;
+            else if (d->convolution_type == ConvolutionSeparable)
+                return vs_generic_sep_conv_float_c;
             break;
         }
     }
     return nullptr;
 }
 
+static bool isHalfFormat(const VSVideoFormat *fi) {
+    return fi->sampleType == stFloat && fi->bytesPerSample == 2;
+}
+
+// F16 planes are processed by the float kernels
+template <GenericOperations op>
+static decltype(&vs_generic_3x3_conv_byte_c) genericSelect(const VSVideoFormat *fi, GenericData *d) {
+    decltype(&vs_generic_3x3_conv_byte_c) func = nullptr;
+    if (isHalfFormat(fi)) {
+        VSVideoFormat ff = *fi;
+        ff.bitsPerSample = 32;
+        ff.bytesPerSample = 4;
+        return genericSelect<op>(&ff, d);
+    }
+#ifdef VS_TARGET_CPU_X86
+    if (getCPUFeatures()->avx512_bw && getCPUFeatures()->avx512_vl && d->cpulevel >= VS_CPU_LEVEL_AVX512)
+        func = genericSelectAVX512<op>(fi, d);
+    if (!func && getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2)
+        func = genericSelectAVX2<op>(fi, d);
+    if (!func && d->cpulevel >= VS_CPU_LEVEL_SSE2)
+        func = genericSelectSSE2<op>(fi, d);
+#endif
+    if (!func)
+        func = genericSelectC<op>(fi, d);
+    return func;
+}
+
+// Runs a float kernel on an F16 plane by converting it to float and the result back
+static void genericHalfPlane(decltype(&vs_generic_3x3_conv_byte_c) func, const uint8_t *srcp, ptrdiff_t srcStride, uint8_t *dstp, ptrdiff_t dstStride, const vs_generic_params *params, int width, int height, int cpulevel) {
+    ptrdiff_t stride = (static_cast<ptrdiff_t>(width) * sizeof(float) + 63) & ~static_cast<ptrdiff_t>(63);
+    float *src = vsh::vsh_aligned_malloc<float>(stride * height, 64);
+    float *dst = vsh::vsh_aligned_malloc<float>(stride * height, 64);
+
+    vs_half_plane_to_float(src, stride, srcp, srcStride, width, height, cpulevel);
+    func(reinterpret_cast<const uint8_t *>(src), stride, reinterpret_cast<uint8_t *>(dst), stride, params, width, height);
+    vs_float_plane_to_half(dstp, dstStride, dst, stride, width, height, cpulevel);
+
+    vsh::vsh_aligned_free(src);
+    vsh::vsh_aligned_free(dst);
+}
+
 template <GenericOperations op>
 static const VSFrame *VS_CC genericGetframe(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     GenericData *d = static_cast<GenericData *>(instanceData);
@@ -403,11 +544,14 @@ static const VSFrame *VS_CC genericGetframe(int n, int activationReason, void *i
         vsapi->requestFrameFilter(n, d->node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+        // the output has the format and properties of the input
+        if (vsapi->isPropsOnlyRequest(frameCtx))
+            return src;
         const VSVideoFormat *fi = vsapi->getVideoFrameFormat(src);
 
         try {
-            if (!is8to16orFloatFormat(*fi))
-                throw std::runtime_error("Frame must be constant format and of integer 8-16 bit type or 32 bit float.");
+            if (!is8to16orHalfOrFloatFormat(*fi))
+                throw std::runtime_error("Frame must be constant format and of integer 8-16 bit type or 16/32 bit float.");
             if (vsapi->getFrameWidth(src, fi->numPlanes - 1) < 4 || vsapi->getFrameHeight(src, fi->numPlanes - 1) < 4)
                 throw std::runtime_error("Cannot process frames with subsampled planes smaller than 4x4.");
 
@@ -426,18 +570,10 @@ static const VSFrame *VS_CC genericGetframe(int n, int activationReason, void *i
 
         VSFrame *dst = vsapi->newVideoFrame2(fi, vsapi->getFrameWidth(src, 0), vsapi->getFrameHeight(src, 0), fr, pl, src, core);
 
-        void (*func)(const void *, ptrdiff_t, void *, ptrdiff_t, const vs_generic_params *, unsigned, unsigned) = nullptr;
+        decltype(&vs_generic_3x3_conv_byte_c) func = genericSelect<op>(fi, d);
 
-#ifdef VS_TARGET_CPU_X86
-        if (getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2)
-            func = genericSelectAVX2<op>(fi, d);
-        if (!func && d->cpulevel >= VS_CPU_LEVEL_SSE2)
-            func = genericSelectSSE2<op>(fi, d);
-#endif
-        if (!func)
-            func = genericSelectC<op>(fi, d);
-
-        for (int plane = 0; plane < fi->numPlanes; plane++) {
+        // processed planes are freshly allocated so they can be written from different threads
+        parallelForEach(fi->numPlanes, [&](int plane) {
             if (func && d->process[plane]) {
                 uint8_t *dstp = vsapi->getWritePtr(dst, plane);
                 const uint8_t *srcp = vsapi->getReadPtr(src, plane);
@@ -447,9 +583,12 @@ static const VSFrame *VS_CC genericGetframe(int n, int activationReason, void *i
                 ptrdiff_t dst_stride = vsapi->getStride(dst, plane);
 
                 vs_generic_params params = make_generic_params(d, fi, plane);
-                func(srcp, src_stride, dstp, dst_stride, &params, width, height);
+                if (isHalfFormat(fi))
+                    genericHalfPlane(func, srcp, src_stride, dstp, dst_stride, &params, width, height, d->cpulevel);
+                else
+                    func(srcp, src_stride, dstp, dst_stride, &params, width, height);
             }
-        }
+        }, core, vsapi);
 
         vsapi->freeFrame(src);
         return dst;
@@ -458,6 +597,44 @@ static const VSFrame *VS_CC genericGetframe(int n, int activationReason, void *i
     return nullptr;
 }
 
+template <GenericOperations op>
+static void VS_CC genericStripe(int plane, const uint8_t *srcp, ptrdiff_t srcStride, uint8_t *dstp, ptrdiff_t dstStride, int width, int height, void *instanceData, const VSAPI *vsapi) {
+    GenericData *d = static_cast<GenericData *>(instanceData);
+    vs_generic_params params = make_generic_params(d, &d->vi->format, plane);
+    if (isHalfFormat(&d->vi->format))
+        genericHalfPlane(genericSelect<op>(&d->vi->format, d), srcp, srcStride, dstp, dstStride, &params, width, height, d->cpulevel);
+    else
+        genericSelect<op>(&d->vi->format, d)(srcp, srcStride, dstp, dstStride, &params, width, height);
+}
+
+// The number of rows above and below a pixel that it depends on or -1 when the result also depends
+// on where processing starts, like the running sums of uniform vertical float convolutions
+template <GenericOperations op>
+static int genericStripeRadius(const GenericData *d) {
+    if (op == GenericMedian)
+        return d->radius;
+    if (op != GenericConvolution)
+        return 1;
+
+    switch (d->convolution_type) {
+    case ConvolutionHorizontal: return 0;
+    case ConvolutionVertical: return (d->vi->format.sampleType == stFloat) ? -1 : d->matrix_elements / 2;
+    default: return (d->matrix_elements == 9) ? 1 : 2;
+    }
+}
+
+// How far the operation looks around a pixel in any direction
+template <GenericOperations op>
+static int genericSpatialRadius(const GenericData *d) {
+    if (op == GenericMedian)
+        return d->radius;
+    if (op != GenericConvolution)
+        return 1;
+    if (d->convolution_type == ConvolutionHorizontal || d->convolution_type == ConvolutionVertical)
+        return d->matrix_elements / 2;
+    return (d->matrix_elements == 9) ? 1 : 2;
+}
+
 static inline int64_t floatToInt64S(float f) {
     if (f > static_cast<float>(std::numeric_limits<int64_t>::max()))
         return std::numeric_limits<int64_t>::max();
@@ -467,6 +644,67 @@ static inline int64_t floatToInt64S(float f) {
         return static_cast<int64_t>(llround(f));
 }
 
+// Rewrites a rank-1 5x5 matrix as its horizontal taps followed by its vertical taps so it can be
+// applied as two 1D passes. Integer factors are only accepted when they reproduce the matrix exactly.
+static void separateMatrix(GenericData *d, bool isFloat) {
+    const int size = 5;
+    const int *pivot = std::find_if(d->matrix, d->matrix + size * size, [](int c) { return c != 0; });
+    const float *pivotf = std::find_if(d->matrixf, d->matrixf + size * size, [](float c) { return c != 0.f; });
+    int p = static_cast<int>(isFloat ? pivotf - d->matrixf : pivot - d->matrix);
+    if (p == size * size)
+        return;
+
+    int prow = p / size;
+    int pcol = p % size;
+    int h[size], v[size];
+    float hf[size], vf[size];
+
+    if (isFloat) {
+        float maxabs = 0;
+        for (int i = 0; i < size * size; i++)
+            maxabs = std::max(maxabs, std::abs(d->matrixf[i]));
+        for (int c = 0; c < size; c++)
+            hf[c] = d->matrixf[prow * size + c];
+        for (int r = 0; r < size; r++) {
+            vf[r] = d->matrixf[r * size + pcol] / d->matrixf[p];
+            for (int c = 0; c < size; c++)
+                if (std::abs(vf[r] * hf[c] - d->matrixf[r * size + c]) > maxabs * 1e-6f)
+                    return;
+        }
+        for (int i = 0; i < size; i++) {
+            h[i] = lround(hf[i]);
+            v[i] = lround(vf[i]);
+        }
+    } else {
+        int g = 0;
+        for (int c = 0; c < size; c++)
+            g = std::gcd(g, d->matrix[prow * size + c]);
+        for (int c = 0; c < size; c++)
+            h[c] = d->matrix[prow * size + c] / g;
+        for (int r = 0; r < size; r++) {
+            if (d->matrix[r * size + pcol] % h[pcol])
+                return;
+            v[r] = d->matrix[r * size + pcol] / h[pcol];
+            for (int c = 0; c < size; c++)
+                if (v[r] * h[c] != d->matrix[r * size + c])
+                    return;
+        }
+        for (int i = 0; i < size; i++) {
+            hf[i] = static_cast<float>(h[i]);
+            vf[i] = static_cast<float>(v[i]);
+        }
+    }
+
+    for (int i = 0; i < size; i++) {
+        d->matrix[i] = h[i];
+        d->matrix[size + i] = v[i];
+        d->matrixf[i] = hf[i];
+        d->matrixf[size + i] = vf[i];
+    }
+    d->matrix_elements = 2 * size;
+    d->convolution_type = ConvolutionSeparable;
+}
+
 template <GenericOperations op>
 static void VS_CC genericCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<GenericData> d(new GenericData(vsapi));
@@ -477,8 +715,8 @@ static void VS_CC genericCreate(const VSMap *in, VSMap *out, void *userData, VSC
     d->vi = vsapi->getVideoInfo(d->node);
 
     try {
-        if (!is8to16orFloatFormat(d->vi->format))
-            throw std::runtime_error("Clip must be constant format and of integer 8-16 bit type or 32 bit float.");
+        if (!is8to16orHalfOrFloatFormat(d->vi->format))
+            throw std::runtime_error("Clip must be constant format and of integer 8-16 bit type or 16/32 bit float.");
 
         if (d->vi->height && d->vi->width)
             if (planeWidth(d->vi, d->vi->format.numPlanes - 1) < 4 || planeHeight(d->vi, d->vi->format.numPlanes - 1) < 4)
@@ -521,6 +759,25 @@ static void VS_CC genericCreate(const VSMap *in, VSMap *out, void *userData, VSC
         }
 
 
+        if (op == GenericMedian) {
+            d->radius = vsapi->mapGetIntSaturated(in, "radius", 0, &err);
+            if (err)
+                d->radius = 1;
+
+            if (d->radius < 1 || d->radius > 127)
+                throw std::runtime_error("radius must be between 1 and 127.");
+
+            double percentile = vsapi->mapGetFloat(in, "percentile", 0, &err);
+            if (err)
+                percentile = 50;
+
+            if (percentile < 0 || percentile > 100)
+                throw std::runtime_error("percentile must be between 0 and 100.");
+
+            int diameter = 2 * d->radius + 1;
+            d->rank = static_cast<int>(std::lround(percentile / 100 * (diameter * diameter - 1)));
+        }
+
         if (op == GenericPrewitt || op == GenericSobel) {
             d->scale = static_cast<float>(vsapi->mapGetFloat(in, "scale", 0, &err));
             if (err)
@@ -631,6 +888,8 @@ static void VS_CC genericCreate(const VSMap *in, VSMap *out, void *userData, VSC
                 d->matrixf[5] = 0.f;
                 d->matrixf[6] = 0.f;
                 d->matrixf[8] = 0.f;
+            } else if (op == GenericConvolution && d->convolution_type == ConvolutionSquare && d->matrix_elements == 25) {
+                separateMatrix(d.get(), d->vi->format.sampleType == stFloat);
             }
         }
 
@@ -639,53 +898,68 @@ static void VS_CC genericCreate(const VSMap *in, VSMap *out, void *userData, VSC
         if (op == GenericConvolution && d->convolution_type == ConvolutionVertical && d->matrix_elements / 2 >= planeHeight(d->vi, d->vi->format.numPlanes - 1))
             throw std::runtime_error("Height must be bigger than convolution radius.");
 
-        d->cpulevel = vs_get_cpulevel(core);
+        d->cpulevel = vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_GENERIC);
     } catch (const std::runtime_error &error) {
         vsapi->mapSetError(out, (d->filter_name + ": "_s + error.what()).c_str());
         return;
     }
 
     VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
-    vsapi->createVideoFilter(out, d->filter_name, d->vi, genericGetframe<op>, filterFree<GenericData>, fmParallel, deps, 1, d.get(), core);
-    d.release();
+    VSNode *node = vsapi->createVideoFilter2(d->filter_name, d->vi, genericGetframe<op>, filterFree<GenericData>, fmParallel, deps, 1, d.get(), core);
+    GenericData *data = d.release();
+
+    int radius = genericStripeRadius<op>(data);
+    if (radius >= 0 && genericSelect<op>(&data->vi->format, data))
+        vsapi->setFilterStripe(node, genericStripe<op>, radius, getPlanesMask(data->process));
+    vsapi->setFilterHints(node, fcUnknown, 0, genericSpatialRadius<op>(data));
+    vsapi->mapConsumeNode(out, "clip", node, maAppend);
 }
 
 ///////////////////////////////
 
 
+// The point operations all pick their kernel the same way, by sample size and cpu level.
+#ifdef VS_TARGET_CPU_X86
+#define SELECT_POINTOP(func, name, fi, cpulevel) \
+    do { \
+        func = nullptr; \
+        if (getCPUFeatures()->avx2 && (cpulevel) >= VS_CPU_LEVEL_AVX2) \
+            func = ((fi)->bytesPerSample == 1) ? name##_byte_avx2 : ((fi)->bytesPerSample == 2) ? name##_word_avx2 : name##_float_avx2; \
+        if (!func && (cpulevel) >= VS_CPU_LEVEL_SSE2) \
+            func = ((fi)->bytesPerSample == 1) ? name##_byte_sse2 : ((fi)->bytesPerSample == 2) ? name##_word_sse2 : name##_float_sse2; \
+        if (!func) \
+            func = ((fi)->bytesPerSample == 1) ? name##_byte_c : ((fi)->bytesPerSample == 2) ? name##_word_c : name##_float_c; \
+    } while (0)
+#else
+#define SELECT_POINTOP(func, name, fi, cpulevel) \
+    func = ((fi)->bytesPerSample == 1) ? name##_byte_c : ((fi)->bytesPerSample == 2) ? name##_word_c : name##_float_c
+#endif
+
 struct InvertDataExtra {
     const VSVideoInfo *vi;
     const char *name;
     bool process[3];
     bool mask;
+    int cpulevel;
 };
 
 typedef SingleNodeData<InvertDataExtra> InvertData;
 
 struct InvertOp {
-    uint16_t max;
-    bool uv;
+    decltype(&vs_invert_byte_c) func;
+    vs_pixel_value max;
 
     InvertOp(InvertData *d, const VSVideoFormat *fi, int plane) {
-        uv = (!d->mask) && (fi->colorFamily == cfYUV) && (plane > 0);
-        max = (1LL << fi->bitsPerSample) - 1;
+        bool uv = (!d->mask) && (fi->colorFamily == cfYUV) && (plane > 0);
+        if (fi->sampleType == stFloat)
+            max.f = uv ? 0.f : 1.f;
+        else
+            max.u = (1U << fi->bitsPerSample) - 1;
+        SELECT_POINTOP(func, vs_invert, fi, d->cpulevel);
     }
 
-    template<typename T>
-    static FORCE_INLINE void processPlane(const T * VS_RESTRICT src, T * VS_RESTRICT dst, unsigned width, const InvertOp &opts) {
-        for (unsigned w = 0; w < width; w++)
-            dst[w] = static_cast<T>(opts.max) - std::min(src[w], static_cast<T>(opts.max));
-    }
-
-    template<typename T>
-    static FORCE_INLINE void processPlaneF(const T * VS_RESTRICT src, T * VS_RESTRICT dst, unsigned width, const InvertOp &opts) {
-        if (opts.uv) {
-            for (unsigned w = 0; w < width; w++)
-                dst[w] = -src[w];
-        } else {
-            for (unsigned w = 0; w < width; w++)
-                dst[w] = 1 - src[w];
-        }
+    void process(const void *src, void *dst, unsigned width) const {
+        func(src, dst, max, width);
     }
 };
 
@@ -695,6 +969,7 @@ static void VS_CC invertCreate(const VSMap *in, VSMap *out, void *userData, VSCo
     try {
         templateInit(d, userData ? "InvertMask" : "Invert", true, in, out, vsapi);
         d->mask = !!userData;
+        d->cpulevel = vs_get_cpulevel(core);
     } catch (const std::runtime_error &error) {
         vsapi->mapSetError(out, (d->name + ": "_s + error.what()).c_str());
         return;
@@ -713,31 +988,28 @@ struct LimitDataExtra {
     bool process[3];
     uint16_t max[3], min[3];
     float maxf[3], minf[3];
+    int cpulevel;
 };
 
 typedef SingleNodeData<LimitDataExtra> LimitData;
 
 struct LimitOp {
-    uint16_t max, min;
-    float maxf, minf;
+    decltype(&vs_limit_byte_c) func;
+    vs_pixel_value max, min;
 
     LimitOp(LimitData *d, const VSVideoFormat *fi, int plane) {
-        max = d->max[plane];
-        min = d->min[plane];
-        maxf = d->maxf[plane];
-        minf = d->minf[plane];
-    }
-
-    template<typename T>
-    static FORCE_INLINE void processPlane(const T * VS_RESTRICT src, T * VS_RESTRICT dst, unsigned width, const LimitOp &opts) {
-        for (unsigned w = 0; w < width; w++)
-            dst[w] = std::min(static_cast<T>(opts.max), std::max(static_cast<T>(opts.min), src[w]));
+        if (fi->sampleType == stFloat) {
+            max.f = d->maxf[plane];
+            min.f = d->minf[plane];
+        } else {
+            max.u = d->max[plane];
+            min.u = d->min[plane];
+        }
+        SELECT_POINTOP(func, vs_limit, fi, d->cpulevel);
     }
 
-    template<typename T>
-    static FORCE_INLINE void processPlaneF(const T * VS_RESTRICT src, T * VS_RESTRICT dst, unsigned width, const LimitOp &opts) {
-        for (unsigned w = 0; w < width; w++)
-            dst[w] = std::min(opts.maxf, std::max(opts.minf, src[w]));
+    void process(const void *src, void *dst, unsigned width) const {
+        func(src, dst, min, max, width);
     }
 };
 
@@ -751,6 +1023,7 @@ static void VS_CC limitCreate(const VSMap *in, VSMap *out, void *userData, VSCor
         for (int i = 0; i < 3; i++)
             if (((d->vi->format.sampleType == stInteger) && (d->min[i] > d->max[i])) || ((d->vi->format.sampleType == stFloat) && (d->minf[i] > d->maxf[i])))
                 throw std::runtime_error("min bigger than max");
+        d->cpulevel = vs_get_cpulevel(core);
     } catch (const std::runtime_error &error) {
         vsapi->mapSetError(out, (d->name + ": "_s + error.what()).c_str());
         return;
@@ -769,39 +1042,30 @@ struct BinarizeDataExtra {
     bool process[3];
     uint16_t v0[3], v1[3], thr[3];
     float v0f[3], v1f[3], thrf[3];
+    int cpulevel;
 };
 
 typedef SingleNodeData<BinarizeDataExtra> BinarizeData;
 
 struct BinarizeOp {
-    uint16_t v0, v1, thr;
-    float v0f, v1f, thrf;
+    decltype(&vs_binarize_byte_c) func;
+    vs_pixel_value v0, v1, thr;
 
     BinarizeOp(BinarizeData *d, const VSVideoFormat *fi, int plane) {
-        v0 = d->v0[plane];
-        v1 = d->v1[plane];
-        v0f = d->v0f[plane];
-        v1f = d->v1f[plane];
-        thr = d->thr[plane];
-        thrf = d->thrf[plane];
-    }
-
-    template<typename T>
-    static FORCE_INLINE void processPlane(const T * VS_RESTRICT src, T * VS_RESTRICT dst, unsigned width, const BinarizeOp &opts) {
-        for (unsigned w = 0; w < width; w++)
-            if (src[w] < opts.thr)
-                dst[w] = static_cast<T>(opts.v0);
-            else
-                dst[w] = static_cast<T>(opts.v1);
+        if (fi->sampleType == stFloat) {
+            v0.f = d->v0f[plane];
+            v1.f = d->v1f[plane];
+            thr.f = d->thrf[plane];
+        } else {
+            v0.u = d->v0[plane];
+            v1.u = d->v1[plane];
+            thr.u = d->thr[plane];
+        }
+        SELECT_POINTOP(func, vs_binarize, fi, d->cpulevel);
     }
 
-    template<typename T>
-    static FORCE_INLINE void processPlaneF(const T * VS_RESTRICT src, T * VS_RESTRICT dst, unsigned width, const BinarizeOp &opts) {
-        for (unsigned w = 0; w < width; w++)
-            if (src[w] < opts.thrf)
-                dst[w] = opts.v0f;
-            else
-                dst[w] = opts.v1f;
+    void process(const void *src, void *dst, unsigned width) const {
+        func(src, dst, thr, v0, v1, width);
     }
 };
 
@@ -813,6 +1077,7 @@ static void VS_CC binarizeCreate(const VSMap *in, VSMap *out, void *userData, VS
         getPlanePixelRangeArgs(d->vi->format, in, "v0", d->v0, d->v0f, RangeLower, !!userData, vsapi);
         getPlanePixelRangeArgs(d->vi->format, in, "v1", d->v1, d->v1f, RangeUpper, !!userData, vsapi);
         getPlanePixelRangeArgs(d->vi->format, in, "threshold", d->thr, d->thrf, RangeMiddle, !!userData, vsapi);
+        d->cpulevel = vs_get_cpulevel(core);
     } catch (const std::runtime_error &error) {
         vsapi->mapSetError(out, (d->name + ": "_s + error.what()).c_str());
         return;
@@ -833,6 +1098,8 @@ struct LevelsDataExtra {
     float gamma;
     float max_in, max_out, min_in, min_out;
     std::vector<uint8_t> lut;
+    decltype(&vs_lut_byte_byte_c) lutfunc;
+    decltype(&vs_levels_float_c) levelsfunc;
 };
 
 typedef SingleNodeData<LevelsDataExtra> LevelsData;
@@ -845,12 +1112,15 @@ static const VSFrame *VS_CC levelsGetframe(int n, int activationReason, void *in
         vsapi->requestFrameFilter(n, d->node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+        // the output has the format and properties of the input
+        if (vsapi->isPropsOnlyRequest(frameCtx))
+            return src;
         const VSVideoFormat *fi = vsapi->getVideoFrameFormat(src);
         const int pl[] = { 0, 1, 2 };
         const VSFrame *fr[] = { d->process[0] ? 0 : src, d->process[1] ? 0 : src, d->process[2] ? 0 : src };
         VSFrame *dst = vsapi->newVideoFrame2(fi, vsapi->getFrameWidth(src, 0), vsapi->getFrameHeight(src, 0), fr, pl, src, core);
 
-        for (int plane = 0; plane < fi->numPlanes; plane++) {
+        parallelForEach(fi->numPlanes, [&](int plane) {
             if (d->process[plane]) {
                 const T * VS_RESTRICT srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane));
                 ptrdiff_t src_stride = vsapi->getStride(src, plane);
@@ -859,18 +1129,16 @@ static const VSFrame *VS_CC levelsGetframe(int n, int activationReason, void *in
                 int h = vsapi->getFrameHeight(src, plane);
                 int w = vsapi->getFrameWidth(src, plane);
 
-                T maxval = static_cast<T>((static_cast<int64_t>(1) << fi->bitsPerSample) - 1);
-                const T * VS_RESTRICT lut = reinterpret_cast<const T *>(d->lut.data());
+                unsigned maxval = (1U << fi->bitsPerSample) - 1;
 
                 for (int hl = 0; hl < h; hl++) {
-                    for (int x = 0; x < w; x++)
-                        dstp[x] = lut[std::min(srcp[x], maxval)];
+                    d->lutfunc(srcp, dstp, d->lut.data(), maxval, w);
 
                     dstp += dst_stride / sizeof(T);
                     srcp += src_stride / sizeof(T);
                 }
             }
-        }
+        }, core, vsapi);
 
         vsapi->freeFrame(src);
         return dst;
@@ -887,12 +1155,15 @@ static const VSFrame *VS_CC levelsGetframeF(int n, int activationReason, void *i
         vsapi->requestFrameFilter(n, d->node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+        // the output has the format and properties of the input
+        if (vsapi->isPropsOnlyRequest(frameCtx))
+            return src;
         const VSVideoFormat *fi = vsapi->getVideoFrameFormat(src);
         const int pl[] = { 0, 1, 2 };
         const VSFrame *fr[] = { d->process[0] ? 0 : src, d->process[1] ? 0 : src, d->process[2] ? 0 : src };
         VSFrame *dst = vsapi->newVideoFrame2(fi, vsapi->getFrameWidth(src, 0), vsapi->getFrameHeight(src, 0), fr, pl, src, core);
 
-        for (int plane = 0; plane < fi->numPlanes; plane++) {
+        parallelForEach(fi->numPlanes, [&](int plane) {
             if (d->process[plane]) {
                 const T * VS_RESTRICT srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane));
                 ptrdiff_t src_stride = vsapi->getStride(src, plane);
@@ -901,33 +1172,22 @@ static const VSFrame *VS_CC levelsGetframeF(int n, int activationReason, void *i
                 int h = vsapi->getFrameHeight(src, plane);
                 int w = vsapi->getFrameWidth(src, plane);
 
-                T gamma = d->gamma;
-                T range_in = 1.f / (d->max_in - d->min_in);
-                T range_out = d->max_out - d->min_out;
-                T min_in = d->min_in;
-                T min_out = d->min_out;
-                T max_in = d->max_in;
-
-                if (std::abs(d->gamma - static_cast<T>(1.0)) < std::numeric_limits<T>::epsilon()) {
-                    T range_scale = range_out / (d->max_in - d->min_in);
-                    for (int hl = 0; hl < h; hl++) {
-                        for (int x = 0; x < w; x++)
-                            dstp[x] = (std::max(std::min(srcp[x], max_in) - min_in, 0.f)) * range_scale + min_out;
-
-                        dstp += dst_stride / sizeof(T);
-                        srcp += src_stride / sizeof(T);
-                    }
-                } else {
-                    for (int hl = 0; hl < h; hl++) {
-                        for (int x = 0; x < w; x++)
-                            dstp[x] = std::pow((std::max(std::min(srcp[x], max_in) - min_in, 0.f)) * range_in, gamma) * range_out + min_out;
+                vs_levels_params params;
+                params.min_in = d->min_in;
+                params.max_in = d->max_in;
+                params.min_out = d->min_out;
+                params.scale_in = 1.f / (d->max_in - d->min_in);
+                params.scale_out = d->max_out - d->min_out;
+                params.gamma = (std::abs(d->gamma - static_cast<T>(1.0)) < std::numeric_limits<T>::epsilon()) ? 1.f : d->gamma;
 
-                        dstp += dst_stride / sizeof(T);
-                        srcp += src_stride / sizeof(T);
-                    }
+                for (int hl = 0; hl < h; hl++) {
+                    d->levelsfunc(srcp, dstp, &params, w);
+
+                    dstp += dst_stride / sizeof(T);
+                    srcp += src_stride / sizeof(T);
                 }
             }
-        }
+        }, core, vsapi);
 
         vsapi->freeFrame(src);
         return dst;
@@ -968,7 +1228,7 @@ static void VS_CC levelsCreate(const VSMap *in, VSMap *out, void *userData, VSCo
     // Implement with simple lut for integer
     if (d->vi->format.sampleType == stInteger) {
         int maxval = (1 << d->vi->format.bitsPerSample) - 1;
-        d->lut.resize(d->vi->format.bytesPerSample * (1 << d->vi->format.bitsPerSample));
+        d->lut.resize(d->vi->format.bytesPerSample * (1 << d->vi->format.bitsPerSample) + VS_LUT_PADDING);
 
         d->min_in = std::round(d->min_in);
         d->min_out = std::round(d->min_out);
@@ -985,6 +1245,24 @@ static void VS_CC levelsCreate(const VSMap *in, VSMap *out, void *userData, VSCo
         }
     }
 
+    bool byte = d->vi->format.bytesPerSample == 1;
+
+    d->lutfunc = byte ? vs_lut_byte_byte_c : vs_lut_word_word_c;
+    d->levelsfunc = vs_levels_float_c;
+#ifdef VS_TARGET_CPU_X86
+    int cpulevel = vs_get_cpulevel(core);
+    if (getCPUFeatures()->avx2 && cpulevel >= VS_CPU_LEVEL_AVX2)
+        d->lutfunc = byte ? vs_lut_byte_byte_avx2 : vs_lut_word_word_avx2;
+
+    // the approximation assumes the usual positive gamma, anything else keeps going through pow()
+    if (d->gamma > 0.f) {
+        if (getCPUFeatures()->avx2 && cpulevel >= VS_CPU_LEVEL_AVX2)
+            d->levelsfunc = vs_levels_float_avx2;
+        else if (cpulevel >= VS_CPU_LEVEL_SSE2)
+            d->levelsfunc = vs_levels_float_sse2;
+    }
+#endif
+
     VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
     if (d->vi->format.bytesPerSample == 1)
         vsapi->createVideoFilter(out, d->name, d->vi, levelsGetframe<uint8_t>, filterFree<LevelsData>, fmParallel, deps, 1, d.get(), core);
@@ -1016,9 +1294,17 @@ void genericInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
 
     vspapi->registerFunction("Median",
             "clip:vnode;"
-            "planes:int[]:opt;",
+            "planes:int[]:opt;"
+            "radius:int:opt;",
             "clip:vnode;",
             genericCreate<GenericMedian>, const_cast<char *>("Median"), plugin);
+    vspapi->registerFunction("Percentile",
+            "clip:vnode;"
+            "percentile:float:opt;"
+            "radius:int:opt;"
+            "planes:int[]:opt;",
+            "clip:vnode;",
+            genericCreate<GenericMedian>, const_cast<char *>("Percentile"), plugin);
 
     vspapi->registerFunction("Deflate",
             "clip:vnode;"
@@ -1107,4 +1393,8 @@ void genericInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
         "planes:int[]:opt;",
         "clip:vnode;",
         levelsCreate, nullptr, plugin);
+
+    for (const char *name : { "Minimum", "Maximum", "Median", "Percentile", "Deflate", "Inflate", "Convolution", "Prewitt", "Sobel",
+        "Invert", "InvertMask", "Limiter", "Binarize", "BinarizeMask", "Levels" })
+        vspapi->setFunctionFlags(name, pffProxyScalable, plugin);
 }
@@ -0,0 +1,214 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+// IntermediateSource reads the vsli files written by vspipe -c vsli. The frame index at the end of the
+// file gives random access, a file without one (an interrupted render) is indexed by walking the records.
+// Only reading the records is serialized, they're decompressed by the requesting threads.
+
+#include <climits>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "VapourSynth4.h"
+#include "VSHelper4.h"
+#include "filtershared.h"
+#include "internalfilters.h"
+#include "../common/intermediate.h"
+
+#ifdef VS_TARGET_OS_WINDOWS
+#include "../common/vsutf16.h"
+#endif
+
+using namespace vsh;
+
+namespace {
+
+static FILE *openFile(const std::string &path) {
+#ifdef VS_TARGET_OS_WINDOWS
+    return _wfopen(utf16_from_utf8(path).c_str(), L"rb");
+#else
+    return fopen(path.c_str(), "rb");
+#endif
+}
+
+static bool seekFile(FILE *file, uint64_t offset) {
+#ifdef VS_TARGET_OS_WINDOWS
+    return !_fseeki64(file, static_cast<int64_t>(offset), SEEK_SET);
+#else
+    return !fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+static bool readAt(FILE *file, uint64_t offset, void *dst, size_t size) {
+    return seekFile(file, offset) && fread(dst, 1, size, file) == size;
+}
+
+static uint64_t getFileSize(FILE *file) {
+#ifdef VS_TARGET_OS_WINDOWS
+    if (_fseeki64(file, 0, SEEK_END))
+        return 0;
+    int64_t size = _ftelli64(file);
+#else
+    if (fseeko(file, 0, SEEK_END))
+        return 0;
+    int64_t size = ftello(file);
+#endif
+    return (size > 0) ? static_cast<uint64_t>(size) : 0;
+}
+
+struct IntermediateSourceData {
+    VSVideoInfo vi = {};
+    FILE *file = nullptr;
+    std::vector<uint64_t> offsets; // the end of the last record is included
+    std::mutex lock;
+
+    ~IntermediateSourceData() {
+        if (file)
+            fclose(file);
+    }
+
+    bool readIndex(uint64_t fileSize) {
+        uint8_t trailer[intermediateTrailerSize];
+        uint32_t numFrames;
+        uint64_t indexOffset;
+        if (fileSize < intermediateHeaderSize + intermediateTrailerSize || !readAt(file, fileSize - intermediateTrailerSize, trailer, sizeof(trailer))
+            || !readIntermediateTrailer(trailer, numFrames, indexOffset) || !numFrames || indexOffset + 8 * static_cast<uint64_t>(numFrames) + intermediateTrailerSize != fileSize)
+            return false;
+
+        std::vector<uint8_t> index(8 * static_cast<size_t>(numFrames));
+        if (!readAt(file, indexOffset, index.data(), index.size()))
+            return false;
+
+        offsets.resize(numFrames + 1);
+        for (uint32_t i = 0; i < numFrames; i++) {
+            uint64_t offset = 0;
+            for (int j = 0; j < 8; j++)
+                offset |= static_cast<uint64_t>(index[8 * i + j]) << (8 * j);
+            offsets[i] = offset;
+        }
+        offsets[numFrames] = indexOffset;
+
+        if (offsets[0] != intermediateHeaderSize)
+            return false;
+        for (uint32_t i = 0; i < numFrames; i++) {
+            if (offsets[i + 1] <= offsets[i])
+                return false;
+        }
+        return true;
+    }
+
+    // stops at the first record that's cut short or damaged
+    void walkRecords(uint64_t fileSize) {
+        offsets.clear();
+        uint64_t offset = intermediateHeaderSize;
+        uint8_t prefix[intermediateRecordPrefixSize];
+        while (offset + sizeof(prefix) <= fileSize && readAt(file, offset, prefix, sizeof(prefix))) {
+            uint64_t size = getIntermediateRecordSize(prefix);
+            if (!size || size > fileSize - offset)
+                break;
+            offsets.push_back(offset);
+            offset += size;
+        }
+        offsets.push_back(offset);
+    }
+};
+
+static const VSFrame *VS_CC intermediateSourceGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    IntermediateSourceData *d = reinterpret_cast<IntermediateSourceData *>(instanceData);
+
+    if (activationReason == arInitial) {
+        std::vector<uint8_t> record(static_cast<size_t>(d->offsets[n + 1] - d->offsets[n]));
+        bool success;
+        {
+            std::lock_guard<std::mutex> lock(d->lock);
+            success = readAt(d->file, d->offsets[n], record.data(), record.size());
+        }
+        if (!success) {
+            vsapi->setFilterError(("IntermediateSource: failed to read frame " + std::to_string(n)).c_str(), frameCtx);
+            return nullptr;
+        }
+
+        VSFrame *dst = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, nullptr, core);
+        std::string error;
+        if (!decodeIntermediateFrame(record.data(), record.size(), dst, error, vsapi)) {
+            vsapi->freeFrame(dst);
+            vsapi->setFilterError(("IntermediateSource: frame " + std::to_string(n) + " has " + error).c_str(), frameCtx);
+            return nullptr;
+        }
+
+        VSMap *props = vsapi->getFramePropertiesRW(dst);
+        if (d->vi.fpsNum > 0 && vsapi->mapNumElements(props, "_DurationNum") <= 0) {
+            vsapi->mapSetInt(props, "_DurationNum", d->vi.fpsDen, maReplace);
+            vsapi->mapSetInt(props, "_DurationDen", d->vi.fpsNum, maReplace);
+        }
+        return dst;
+    }
+
+    return nullptr;
+}
+
+static void VS_CC intermediateSourceCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<IntermediateSourceData> d(new IntermediateSourceData());
+
+    std::string path = vsapi->mapGetData(in, "source", 0, nullptr);
+    d->file = openFile(path);
+    if (!d->file)
+        RETERROR(("IntermediateSource: failed to open " + path).c_str());
+
+    uint8_t headerData[intermediateHeaderSize];
+    IntermediateHeader header;
+    if (!readAt(d->file, 0, headerData, sizeof(headerData)) || !readIntermediateHeader(headerData, header))
+        RETERROR(("IntermediateSource: " + path + " is not a vsli file").c_str());
+
+    if (!vsapi->queryVideoFormat(&d->vi.format, header.colorFamily, header.sampleType, header.bitsPerSample, header.subSamplingW, header.subSamplingH, core)
+        || d->vi.format.colorFamily == cfUndefined || header.width <= 0 || header.height <= 0
+        || header.width % (1 << header.subSamplingW) || header.height % (1 << header.subSamplingH) || header.fpsNum < 0 || header.fpsDen < 0)
+        RETERROR(("IntermediateSource: " + path + " has an invalid header").c_str());
+    d->vi.width = header.width;
+    d->vi.height = header.height;
+    d->vi.fpsNum = header.fpsNum;
+    d->vi.fpsDen = header.fpsDen;
+
+    uint64_t fileSize = getFileSize(d->file);
+    if (!d->readIndex(fileSize)) {
+        d->walkRecords(fileSize);
+        vsapi->logMessage(mtWarning, ("IntermediateSource: " + path + " has no valid index, found " + std::to_string(d->offsets.size() - 1) + " complete frames").c_str(), core);
+    }
+
+    if (d->offsets.size() < 2)
+        RETERROR(("IntermediateSource: " + path + " contains no frames").c_str());
+    if (d->offsets.size() - 1 > static_cast<size_t>(INT_MAX))
+        RETERROR(("IntermediateSource: " + path + " contains too many frames").c_str());
+    d->vi.numFrames = static_cast<int>(d->offsets.size() - 1);
+
+    vsapi->createVideoFilter(out, "IntermediateSource", &d->vi, intermediateSourceGetFrame, filterFree<IntermediateSourceData>, fmParallel, nullptr, 0, d.get(), core);
+    d.release();
+}
+
+} // namespace
+
+//////////////////////////////////////////
+// Init
+
+void intermediateInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
+    vspapi->registerFunction("IntermediateSource", "source:data;", "clip:vnode;", intermediateSourceCreate, nullptr, plugin);
+}
@@ -27,6 +27,7 @@ void stdlibInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
 void mergeInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
 void reorderInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
 void audioInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
+void audioStatsInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
 void textInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
 void exprInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
 void genericInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
@@ -34,6 +35,58 @@ void lutInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
 void boxBlurInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
 void resizeInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
 void averageFramesInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
+void diskCacheInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
+void remoteInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
+void intermediateInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi);
+
+// cache settings that aren't exposed in the public api
+void setCacheRingMode(VSNode *node, bool ring);
+void setCacheScanResistant(VSNode *node, bool scanResistant);
+void setCompressedCacheSize(VSNode *node, int64_t bytes);
+void setNodeMaxConcurrency(VSNode *node, int max);
+void setCachePassthrough(VSNode *node);
+
+// kernels run through the functions set with setDeviceComputeFunctions, compiling returns nullptr when
+// there are none or the source is rejected
+void *compileDeviceKernel(VSCore *core, const char *source, const char *entryPoint);
+bool launchDeviceKernel(VSCore *core, void *kernel, int width, int height, void **params);
+void freeDeviceKernel(VSCore *core, void *kernel);
+
+// while a scope is entered on the current thread plugin function calls identical to an earlier call in the
+// same scope, input nodes compared by identity, get the same nodes back, entering returns the previous scope
+struct NodeReuseScope;
+NodeReuseScope *createNodeReuseScope(VSCore *core, size_t maxEntries);
+void freeNodeReuseScope(NodeReuseScope *scope);
+NodeReuseScope *enterNodeReuseScope(NodeReuseScope *scope);
+
+// graph rewriting, returns the instance data of node if it was created with getFrame and nothing consumes it yet
+void *getFusableInstanceData(VSNode *node, VSFilterGetFrame getFrame);
+
+// returns the source and window of node if it's a Crop nothing consumes yet, source is borrowed from the Crop
+bool getCropWindow(VSNode *node, VSNode **source, int *left, int *top, int *width, int *height);
+
+// returns a frame sharing the planes of f that shows only the given window, nullptr if the window's rows
+// wouldn't be aligned or its strides differ from those of a new frame of the same size
+VSFrame *newVideoFrameView(const VSFrame *f, int left, int top, int width, int height);
+// returns an audio frame sharing the data of f that holds only numSamples samples starting with
+// firstSample, nullptr if the channels wouldn't be aligned
+VSFrame *newAudioFrameView(const VSFrame *f, int firstSample, int numSamples);
+
+// marks a node whose filter writes its output frame only through that frame's stride and row width, so its
+// first new frame may be a window of another frame, the filter must not keep or share the frame
+void setNodeRendersInPlace(VSNode *node);
+
+// requests a frame like requestFrameFilter and asks for it to be rendered straight into the window of
+// target at left/top if the node renders in place and it has to be produced, target is writable without
+// copies until it's returned.
+// Rows may be written up to their aligned size, fillsRight means the caller overwrites whatever ends
+// up right of the window. Returns false if the window can't be used, a placed frame shares its planes
+// with target which can be checked with getReadPtr
+bool requestFrameFilterInto(int n, VSNode *node, VSFrameContext *frameCtx, VSFrame *target, int left, int top, bool fillsRight);
+
+// fills a Lut (ybits = 0) or Lut2 table by evaluating an Expr expression where x is the column and y the row,
+// throws std::runtime_error if the expression doesn't compile
+void exprGenerateLut(const char *expr, int xbits, int ybits, const VSVideoFormat *dstFormat, void *lut, VSCore *core, const VSAPI *vsapi);
 
 #ifdef VS_USE_MIMALLOC
 
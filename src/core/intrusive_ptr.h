@@ -22,6 +22,63 @@
 #define INTRUSIVE_PTR_H
 
 #include <algorithm>
+#include <cstddef>
+#include <new>
+
+// Small refcounted objects that are created and destroyed at a high rate on every thread derive from
+// this to get a per thread free list behind their operator new and delete. Memory freed on another
+// thread than where it was allocated ends up in that thread's list, the lists are bounded so freed
+// memory still goes back eventually. Derived classes of other sizes use the global allocator.
+template<typename T, size_t MaxFree = 256>
+struct vs_pooled {
+    static void *operator new(size_t size) {
+        FreeList &list = freeList();
+        if (size == sizeof(T) && list.head) {
+            FreeNode *node = list.head;
+            list.head = node->next;
+            list.count--;
+            return node;
+        }
+        return ::operator new(std::max(size, sizeof(FreeNode)));
+    }
+
+    static void operator delete(void *ptr, size_t size) noexcept {
+        if (!ptr)
+            return;
+        FreeList &list = freeList();
+        if (size == sizeof(T) && list.count < MaxFree) {
+            FreeNode *node = static_cast<FreeNode *>(ptr);
+            node->next = list.head;
+            list.head = node;
+            list.count++;
+            return;
+        }
+        ::operator delete(ptr);
+    }
+private:
+    struct FreeNode {
+        FreeNode *next;
+    };
+
+    struct FreeList {
+        FreeNode *head = nullptr;
+        size_t count = 0;
+        ~FreeList() {
+            while (head) {
+                FreeNode *node = head;
+                head = node->next;
+                ::operator delete(node);
+            }
+            // objects freed by later thread exit handlers go straight to the global allocator
+            count = MaxFree;
+        }
+    };
+
+    static FreeList &freeList() noexcept {
+        static thread_local FreeList list;
+        return list;
+    }
+};
 
 template<typename T>
 class vs_intrusive_ptr {
@@ -59,6 +116,16 @@ public:
         return *this;
     }
 
+    vs_intrusive_ptr &operator=(vs_intrusive_ptr &&ptr) noexcept {
+        if (this != &ptr) {
+            if (obj)
+                obj->release();
+            obj = ptr.obj;
+            ptr.obj = nullptr;
+        }
+        return *this;
+    }
+
     T *operator->() const noexcept {
         return obj;
     }
@@ -0,0 +1,54 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "audiomix.h"
+
+static int16_t audio_mix_store_int16(double v)
+{
+    return (int16_t)(v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v);
+}
+
+static int32_t audio_mix_store_int32(double v)
+{
+    return (int32_t)(v < INT32_MIN ? INT32_MIN : v > INT32_MAX ? INT32_MAX : v);
+}
+
+static float audio_mix_store_float(double v)
+{
+    return (float)v;
+}
+
+#define AUDIO_MIX_C(sample, type) \
+void vs_audio_mix_##sample##_c(const void * const *srcs, const double *weights, unsigned num_srcs, void *dst, unsigned n) \
+{ \
+    type *dstp = dst; \
+    unsigned i, k; \
+ \
+    for (i = 0; i < n; i++) { \
+        double tmp = 0; \
+        for (k = 0; k < num_srcs; k++) \
+            tmp += (double)((const type *)srcs[k])[i] * weights[k]; \
+        dstp[i] = audio_mix_store_##sample(tmp); \
+    } \
+}
+
+AUDIO_MIX_C(int16, int16_t)
+AUDIO_MIX_C(int32, int32_t)
+AUDIO_MIX_C(float, float)
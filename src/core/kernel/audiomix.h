@@ -0,0 +1,53 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef AUDIOMIX_H
+#define AUDIOMIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Computes one output channel from the input channels with a nonzero weight. Integer results are truncated and saturated. */
+#define DECL_AUDIO_MIX(sample, isa) void vs_audio_mix_##sample##_##isa(const void * const *srcs, const double *weights, unsigned num_srcs, void *dst, unsigned n);
+
+DECL_AUDIO_MIX(int16, c)
+DECL_AUDIO_MIX(int32, c)
+DECL_AUDIO_MIX(float, c)
+
+#ifdef VS_TARGET_CPU_X86
+DECL_AUDIO_MIX(int16, sse2)
+DECL_AUDIO_MIX(int32, sse2)
+DECL_AUDIO_MIX(float, sse2)
+DECL_AUDIO_MIX(int16, avx2)
+DECL_AUDIO_MIX(int32, avx2)
+DECL_AUDIO_MIX(float, avx2)
+#endif /* VS_TARGET_CPU_X86 */
+
+#undef DECL_AUDIO_MIX
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // AUDIOMIX_H
@@ -0,0 +1,47 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "audioresample.h"
+
+void vs_audio_resample_c(const float *src, float *dst, const float *filters, unsigned taps, const unsigned *pos, const unsigned *phase, const float *frac, unsigned n)
+{
+    unsigned i, k;
+
+    for (i = 0; i < n; i++) {
+        const float *srcp = src + pos[i];
+        const float *h0 = filters + (size_t)phase[i] * taps;
+        float accum0 = 0;
+
+        for (k = 0; k < taps; k++)
+            accum0 += srcp[k] * h0[k];
+
+        if (frac[i]) {
+            const float *h1 = h0 + taps;
+            float accum1 = 0;
+
+            for (k = 0; k < taps; k++)
+                accum1 += srcp[k] * h1[k];
+
+            accum0 += (accum1 - accum0) * frac[i];
+        }
+
+        dst[i] = accum0;
+    }
+}
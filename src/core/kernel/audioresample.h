@@ -0,0 +1,50 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef AUDIORESAMPLE_H
+#define AUDIORESAMPLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Output sample i is the dot product of src + pos[i] with the filter phase[i] of taps coefficients,
+ * linearly interpolated towards the next phase by frac[i]. The table holds one more phase than
+ * can be selected and taps must be a multiple of 8.
+ */
+#define DECL_AUDIO_RESAMPLE(isa) void vs_audio_resample_##isa(const float *src, float *dst, const float *filters, unsigned taps, const unsigned *pos, const unsigned *phase, const float *frac, unsigned n);
+
+DECL_AUDIO_RESAMPLE(c)
+
+#ifdef VS_TARGET_CPU_X86
+DECL_AUDIO_RESAMPLE(avx2)
+#endif /* VS_TARGET_CPU_X86 */
+
+#undef DECL_AUDIO_RESAMPLE
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // AUDIORESAMPLE_H
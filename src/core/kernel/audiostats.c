@@ -0,0 +1,69 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <math.h>
+#include "audiostats.h"
+
+const float vs_audio_true_peak_coeffs[VS_AUDIO_TRUE_PEAK_TAPS][4] = {
+    {  0.0017089843750f, -0.0291748046875f, -0.0189208984375f, -0.0083007812500f },
+    {  0.0109863281250f,  0.0292968750000f,  0.0330810546875f,  0.0148925781250f },
+    { -0.0196533203125f, -0.0517578125000f, -0.0582275390625f, -0.0266113281250f },
+    {  0.0332031250000f,  0.0891113281250f,  0.1015625000000f,  0.0476074218750f },
+    { -0.0594482421875f, -0.1665039062500f, -0.2003173828125f, -0.1022949218750f },
+    {  0.1373291015625f,  0.4650878906250f,  0.7797851562500f,  0.9721679687500f },
+    {  0.9721679687500f,  0.7797851562500f,  0.4650878906250f,  0.1373291015625f },
+    { -0.1022949218750f, -0.2003173828125f, -0.1665039062500f, -0.0594482421875f },
+    {  0.0476074218750f,  0.1015625000000f,  0.0891113281250f,  0.0332031250000f },
+    { -0.0266113281250f, -0.0582275390625f, -0.0517578125000f, -0.0196533203125f },
+    {  0.0148925781250f,  0.0330810546875f,  0.0292968750000f,  0.0109863281250f },
+    { -0.0083007812500f, -0.0189208984375f, -0.0291748046875f,  0.0017089843750f },
+};
+
+void vs_audio_peak_energy_c(const float *src, unsigned n, float *peak, double *sumsq)
+{
+    float m = *peak;
+    double s = 0;
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        m = fabsf(src[i]) > m ? fabsf(src[i]) : m;
+        s += (double)src[i] * src[i];
+    }
+
+    *peak = m;
+    *sumsq += s;
+}
+
+void vs_audio_true_peak_c(const float *src, unsigned n, float *peak)
+{
+    float m = *peak;
+    unsigned i, p, k;
+
+    for (i = 0; i < n; i++) {
+        for (p = 0; p < 4; p++) {
+            float accum = 0;
+            for (k = 0; k < VS_AUDIO_TRUE_PEAK_TAPS; k++)
+                accum += vs_audio_true_peak_coeffs[k][p] * src[(int)i - (int)k];
+            m = fabsf(accum) > m ? fabsf(accum) : m;
+        }
+    }
+
+    *peak = m;
+}
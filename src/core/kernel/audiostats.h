@@ -0,0 +1,59 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef AUDIOSTATS_H
+#define AUDIOSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of taps of every phase of the true peak interpolation filter, src must be preceded by this many samples minus one. */
+#define VS_AUDIO_TRUE_PEAK_TAPS 12
+
+/* The 4x oversampling filter of ITU-R BS.1770-4 annex 2, coeffs[tap][phase] */
+extern const float vs_audio_true_peak_coeffs[VS_AUDIO_TRUE_PEAK_TAPS][4];
+
+/* Updates peak with the largest absolute value and adds the sum of squares to sumsq. */
+#define DECL_AUDIO_STATS(isa) void vs_audio_peak_energy_##isa(const float *src, unsigned n, float *peak, double *sumsq);
+/* Updates peak with the largest absolute value of the 4x oversampled signal. */
+#define DECL_AUDIO_TRUE_PEAK(isa) void vs_audio_true_peak_##isa(const float *src, unsigned n, float *peak);
+
+DECL_AUDIO_STATS(c)
+DECL_AUDIO_TRUE_PEAK(c)
+
+#ifdef VS_TARGET_CPU_X86
+DECL_AUDIO_STATS(sse2)
+DECL_AUDIO_TRUE_PEAK(sse2)
+DECL_AUDIO_STATS(avx2)
+DECL_AUDIO_TRUE_PEAK(avx2)
+#endif /* VS_TARGET_CPU_X86 */
+
+#undef DECL_AUDIO_TRUE_PEAK
+#undef DECL_AUDIO_STATS
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // AUDIOSTATS_H
@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <stdint.h>
 #include "average.h"
+#include "half.h"
 
 namespace {
 
@@ -60,6 +61,30 @@ void average_plane_float(const void *weights_, const void * const *srcs, unsigne
 	}
 }
 
+void average_plane_half(const void *weights_, const void * const *srcs, unsigned num_srcs, void *dst_, const void *scale_, unsigned w, unsigned h, ptrdiff_t stride)
+{
+	const float *weights = static_cast<const float *>(weights_);
+	ptrdiff_t offset = 0;
+	float scale = 1.0f / *static_cast<const float *>(scale_);
+
+	for (unsigned i = 0; i < h; ++i) {
+		uint16_t *dst = reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(dst_) + offset);
+
+		for (unsigned j = 0; j < w; ++j) {
+			float accum = 0.0f;
+
+			for (unsigned k = 0; k < num_srcs; ++k) {
+				const uint16_t *src = reinterpret_cast<const uint16_t *>(static_cast<const uint8_t *>(srcs[k]) + offset);
+				accum += vs_half_to_float(src[j]) * weights[k];
+			}
+
+			dst[j] = vs_float_to_half(accum * scale);
+		}
+
+		offset += stride;
+	}
+}
+
 } // namespace
 
 
@@ -87,3 +112,9 @@ void vs_average_plane_float_c(const void *weights, const void * const *srcs, uns
 {
 	average_plane_float(weights, srcs, num_srcs, dst, scale, depth, w, h, stride, true);
 }
+
+void vs_average_plane_half_c(const void *weights, const void * const *srcs, unsigned num_srcs, void *dst, const void *scale, unsigned depth, unsigned w, unsigned h, ptrdiff_t stride)
+{
+	(void)depth;
+	average_plane_half(weights, srcs, num_srcs, dst, scale, w, h, stride);
+}
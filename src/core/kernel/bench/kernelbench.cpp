@@ -0,0 +1,598 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+// Runs every variant of the generic, merge, plane stats, average and transpose kernels over whole
+// planes and reports the best time of each one as GB/s of plane data touched and cycles per pixel.
+// The kernels are linked directly so no core or plugins are involved. On x86 the cycles come from
+// the time stamp counter, which runs at the nominal clock and not the boosted one.
+//
+// With --calibrate the fastest level of each kernel family is printed as CPULevel* settings for
+// calibration.conf instead, a higher level that is slower on this machine, such as when wide
+// vectors lower the clock, is then never used by the filters.
+//
+// --stride-padding pads the strides the way the StridePadding setting does, running a 1024 or 2048
+// wide plane with and without it shows what cache set aliasing costs the vertical kernels.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "VSHelper4.h"
+#include "../../cpufeatures.h"
+#include "../average.h"
+#include "../cpulevel.h"
+#include "../generic.h"
+#include "../merge.h"
+#include "../planestats.h"
+#include "../transpose.h"
+
+#ifdef VS_TARGET_CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+using namespace vsh;
+
+namespace {
+
+#ifdef VS_TARGET_CPU_X86
+const int numLevels = VS_CPU_LEVEL_AVX512 + 1;
+const char *levelNames[numLevels] = { "none", "sse2", "avx2", "avx512" };
+#else
+const int numLevels = 1;
+const char *levelNames[numLevels] = { "none" };
+#endif
+
+// the number of frames averaged, like a radius 2 temporal average
+const unsigned numAverageSrcs = 5;
+
+struct Plane {
+    uint8_t *data = nullptr;
+    ptrdiff_t stride = 0;
+
+    Plane(unsigned width, unsigned height, unsigned bytes, unsigned padding) {
+        stride = (static_cast<ptrdiff_t>(width) * bytes + 63) & ~static_cast<ptrdiff_t>(63);
+        if (!(stride % 1024))
+            stride += padding;
+        // the kernels may write whole vectors past the end of the last row
+        data = vsh_aligned_malloc<uint8_t>(stride * height + 64, 64);
+        if (!data) {
+            fprintf(stderr, "Failed to allocate %ux%u plane\n", width, height);
+            exit(1);
+        }
+    }
+
+    Plane(const Plane &) = delete;
+    Plane &operator=(const Plane &) = delete;
+
+    ~Plane() {
+        vsh_aligned_free(data);
+    }
+
+    void fill(unsigned width, unsigned height, unsigned depth, std::mt19937 &rng) {
+        for (unsigned y = 0; y < height; y++) {
+            uint8_t *row = data + stride * y;
+            for (unsigned x = 0; x < width; x++) {
+                if (depth == 32)
+                    reinterpret_cast<float *>(row)[x] = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+                else if (depth > 8)
+                    reinterpret_cast<uint16_t *>(row)[x] = static_cast<uint16_t>(rng() & ((1U << depth) - 1));
+                else
+                    row[x] = static_cast<uint8_t>(rng());
+            }
+        }
+    }
+};
+
+struct Context {
+    unsigned width;
+    unsigned height;
+    unsigned depth;
+    const void *srcs[numAverageSrcs];
+    ptrdiff_t stride;
+    void *dst;
+    void *transposed;
+    ptrdiff_t transposedStride;
+    vs_generic_params params;
+    int weights[numAverageSrcs];
+    float fweights[numAverageSrcs];
+    unsigned scale;
+    float fscale;
+};
+
+struct Case {
+    std::string name;
+    int level;
+    int pixel; // 0 byte, 1 word, 2 float
+    unsigned planesRead;
+    unsigned planesWritten;
+    std::function<void(const Context &)> run;
+};
+
+typedef void (*GenericFunc)(const void *, ptrdiff_t, void *, ptrdiff_t, const vs_generic_params *, unsigned, unsigned);
+typedef void (*MergeFunc)(const void *, const void *, void *, vs_merge_weight, unsigned);
+typedef void (*MaskMergeFunc)(const void *, const void *, const void *, void *, unsigned, unsigned, unsigned);
+typedef void (*DiffFunc)(const void *, const void *, void *, unsigned, unsigned);
+typedef void (*Stats1Func)(vs_plane_stats *, const void *, ptrdiff_t, unsigned, unsigned);
+typedef void (*Stats2Func)(vs_plane_stats *, const void *, ptrdiff_t, const void *, ptrdiff_t, unsigned, unsigned);
+typedef void (*AverageFunc)(const void *, const void * const *, unsigned, void *, const void *, unsigned, unsigned, unsigned, ptrdiff_t);
+typedef void (*TransposeFunc)(const void *, ptrdiff_t, void *, ptrdiff_t, unsigned, unsigned);
+
+template<typename F>
+struct KernelTable {
+    const char *name;
+    F funcs[numLevels][3];
+};
+
+#define PIXELS(prefix, suffix, isa) { prefix##byte##suffix##isa, prefix##word##suffix##isa, prefix##float##suffix##isa }
+#ifdef VS_TARGET_CPU_X86
+#define LEVELS(prefix, suffix) { PIXELS(prefix, suffix, c), PIXELS(prefix, suffix, sse2), PIXELS(prefix, suffix, avx2), PIXELS(prefix, suffix, avx512) }
+#else
+#define LEVELS(prefix, suffix) { PIXELS(prefix, suffix, c) }
+#endif
+
+#define GENERIC(kernel) { "generic_3x3_" #kernel, LEVELS(vs_generic_3x3_##kernel##_, _) }
+
+const KernelTable<GenericFunc> genericKernels[] = {
+    GENERIC(prewitt),
+    GENERIC(sobel),
+    GENERIC(min),
+    GENERIC(max),
+    GENERIC(median),
+    GENERIC(deflate),
+    GENERIC(inflate),
+    GENERIC(conv),
+};
+
+#undef GENERIC
+
+const KernelTable<MergeFunc> mergeKernels[] = { { "merge", LEVELS(vs_merge_, _) } };
+
+const KernelTable<MaskMergeFunc> maskMergeKernels[] = {
+    { "mask_merge", LEVELS(vs_mask_merge_, _) },
+    { "mask_merge_premul", LEVELS(vs_mask_merge_premul_, _) },
+};
+
+const KernelTable<DiffFunc> diffKernels[] = {
+    { "makediff", LEVELS(vs_makediff_, _) },
+    { "mergediff", LEVELS(vs_mergediff_, _) },
+};
+
+const KernelTable<Stats1Func> stats1Kernels[] = {
+    { "plane_stats_1", LEVELS(vs_plane_stats_1_, _) },
+    // there is no avx512 version of the squared sums
+#ifdef VS_TARGET_CPU_X86
+    { "plane_stats_sq", { PIXELS(vs_plane_stats_sq_, _, c), PIXELS(vs_plane_stats_sq_, _, sse2), PIXELS(vs_plane_stats_sq_, _, avx2), { nullptr, nullptr, nullptr } } },
+#else
+    { "plane_stats_sq", LEVELS(vs_plane_stats_sq_, _) },
+#endif
+};
+
+const KernelTable<Stats2Func> stats2Kernels[] = { { "plane_stats_2", LEVELS(vs_plane_stats_2_, _) } };
+
+#undef LEVELS
+#undef PIXELS
+
+#define AVERAGE(isa) { vs_average_plane_byte_luma_##isa, vs_average_plane_word_luma_##isa, vs_average_plane_float_##isa }, \
+                     { vs_average_plane_byte_chroma_##isa, vs_average_plane_word_chroma_##isa, nullptr }
+#define TRANSPOSE(isa) { vs_transpose_plane_byte_##isa, vs_transpose_plane_word_##isa, vs_transpose_plane_dword_##isa }
+
+const AverageFunc averageFuncs[numLevels][2][3] = {
+    { AVERAGE(c) },
+#ifdef VS_TARGET_CPU_X86
+    { AVERAGE(sse2) },
+    { AVERAGE(avx2) },
+    { AVERAGE(avx512) },
+#endif
+};
+
+const KernelTable<TransposeFunc> transposeKernels[] = { { "transpose",
+    {
+        TRANSPOSE(c),
+#ifdef VS_TARGET_CPU_X86
+        TRANSPOSE(sse2),
+        TRANSPOSE(avx2),
+        TRANSPOSE(avx512),
+#endif
+    } } };
+
+#undef TRANSPOSE
+#undef AVERAGE
+
+// the kernel families that have their own CPULevel* setting in the core
+struct Family {
+    const char *setting;
+    const char *prefixes[3];
+};
+
+const Family families[] = {
+    { "CPULevelGeneric", { "generic_", nullptr } },
+    { "CPULevelMerge", { "merge", "mask_merge", "makediff" } },
+    { "CPULevelPlaneStats", { "plane_stats_", nullptr } },
+    { "CPULevelAverage", { "average_", nullptr } },
+    { "CPULevelTranspose", { "transpose", nullptr } },
+};
+
+bool inFamily(const Family &family, const std::string &name) {
+    for (const char *prefix : family.prefixes) {
+        if (prefix && !name.compare(0, strlen(prefix), prefix))
+            return true;
+    }
+    return false;
+}
+
+struct Measurement {
+    const Case *c;
+    unsigned depth;
+    unsigned width;
+    unsigned height;
+    double seconds;
+};
+
+// the time all kernels of the family take with level as the limit, a kernel without a version for
+// the level counts with the highest one below it like the filters fall back to it
+double familySeconds(const Family &family, int level, const std::vector<Measurement> &measurements) {
+    double total = 0;
+    for (const Measurement &m : measurements) {
+        if (!inFamily(family, m.c->name) || m.c->level > level)
+            continue;
+        bool superseded = std::any_of(measurements.begin(), measurements.end(), [&](const Measurement &o) {
+            return o.c->name == m.c->name && o.depth == m.depth && o.width == m.width && o.height == m.height && o.c->level > m.c->level && o.c->level <= level;
+        });
+        if (!superseded)
+            total += m.seconds;
+    }
+    return total;
+}
+
+// same conditions as the filters use to pick the kernels
+bool levelSupported(int level) {
+#ifdef VS_TARGET_CPU_X86
+    const CPUFeatures *f = getCPUFeatures();
+    if (level >= VS_CPU_LEVEL_AVX512)
+        return f->avx512_bw && f->avx512_vl;
+    if (level >= VS_CPU_LEVEL_AVX2)
+        return !!f->avx2;
+#endif
+    return true;
+}
+
+template<typename F, size_t N, typename R>
+void addCases(std::vector<Case> &cases, const KernelTable<F> (&tables)[N], unsigned planesRead, unsigned planesWritten, R runner) {
+    for (const auto &table : tables) {
+        for (int level = 0; level < numLevels; level++) {
+            for (int pixel = 0; pixel < 3; pixel++) {
+                F func = table.funcs[level][pixel];
+                if (func)
+                    cases.push_back({ table.name, level, pixel, planesRead, planesWritten, std::bind(runner, func, std::placeholders::_1) });
+            }
+        }
+    }
+}
+
+std::vector<Case> buildCases() {
+    std::vector<Case> cases;
+
+    addCases(cases, genericKernels, 1, 1, [](GenericFunc func, const Context &c) {
+        func(c.srcs[0], c.stride, c.dst, c.stride, &c.params, c.width, c.height);
+    });
+
+    // the merge kernels work one row at a time like in the filters
+    addCases(cases, mergeKernels, 2, 1, [](MergeFunc func, const Context &c) {
+        vs_merge_weight weight;
+        if (c.depth == 32)
+            weight.f = 0.25f;
+        else
+            weight.u = 1U << 13;
+        for (unsigned y = 0; y < c.height; y++)
+            func(static_cast<const uint8_t *>(c.srcs[0]) + c.stride * y, static_cast<const uint8_t *>(c.srcs[1]) + c.stride * y, static_cast<uint8_t *>(c.dst) + c.stride * y, weight, c.width);
+    });
+
+    addCases(cases, maskMergeKernels, 3, 1, [](MaskMergeFunc func, const Context &c) {
+        for (unsigned y = 0; y < c.height; y++)
+            func(static_cast<const uint8_t *>(c.srcs[0]) + c.stride * y, static_cast<const uint8_t *>(c.srcs[1]) + c.stride * y, static_cast<const uint8_t *>(c.srcs[2]) + c.stride * y, static_cast<uint8_t *>(c.dst) + c.stride * y, c.depth, 0, c.width);
+    });
+
+    addCases(cases, diffKernels, 2, 1, [](DiffFunc func, const Context &c) {
+        for (unsigned y = 0; y < c.height; y++)
+            func(static_cast<const uint8_t *>(c.srcs[0]) + c.stride * y, static_cast<const uint8_t *>(c.srcs[1]) + c.stride * y, static_cast<uint8_t *>(c.dst) + c.stride * y, c.depth, c.width);
+    });
+
+    addCases(cases, stats1Kernels, 1, 0, [](Stats1Func func, const Context &c) {
+        vs_plane_stats stats = {};
+        func(&stats, c.srcs[0], c.stride, c.width, c.height);
+    });
+
+    addCases(cases, stats2Kernels, 2, 0, [](Stats2Func func, const Context &c) {
+        vs_plane_stats stats = {};
+        func(&stats, c.srcs[0], c.stride, c.srcs[1], c.stride, c.width, c.height);
+    });
+
+    for (int level = 0; level < numLevels; level++) {
+        for (int chroma = 0; chroma < 2; chroma++) {
+            for (int pixel = 0; pixel < 3; pixel++) {
+                AverageFunc func = averageFuncs[level][chroma][pixel];
+                if (!func)
+                    continue;
+                cases.push_back({ chroma ? "average_chroma" : "average_luma", level, pixel, numAverageSrcs, 1, [func](const Context &c) {
+                    const void *weights = c.depth == 32 ? static_cast<const void *>(c.fweights) : c.weights;
+                    const void *scale = c.depth == 32 ? static_cast<const void *>(&c.fscale) : &c.scale;
+                    func(weights, c.srcs, numAverageSrcs, c.dst, scale, c.depth, c.width, c.height, c.stride);
+                } });
+            }
+        }
+    }
+
+    addCases(cases, transposeKernels, 1, 1, [](TransposeFunc func, const Context &c) {
+        func(c.srcs[0], c.stride, c.transposed, c.transposedStride, c.width, c.height);
+    });
+
+    return cases;
+}
+
+uint64_t readCycles() {
+#ifdef VS_TARGET_CPU_X86
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+struct Result {
+    double seconds;
+    uint64_t cycles;
+};
+
+// runs the kernel until at least minTime has passed and keeps the fastest run
+Result measure(const Case &c, const Context &ctx, double minTime) {
+    c.run(ctx);
+
+    Result best = { 0, 0 };
+    double total = 0;
+    int runs = 0;
+    while (total < minTime || runs < 3) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t startCycles = readCycles();
+        c.run(ctx);
+        uint64_t cycles = readCycles() - startCycles;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!runs || seconds < best.seconds)
+            best = { seconds, cycles };
+        total += seconds;
+        runs++;
+    }
+    return best;
+}
+
+bool parseSize(const char *s, unsigned &width, unsigned &height) {
+    return sscanf(s, "%ux%u", &width, &height) == 2 && width >= 16 && height >= 16;
+}
+
+void printHelp() {
+    fprintf(stderr,
+        "Usage: kernelbench [options]\n"
+        "Options:\n"
+        "  -k, --kernel NAME        Only run kernels whose name contains NAME, can be given several times\n"
+        "  -s, --size WxH           Plane size, can be given several times, default 1920x1080 and 3840x2160\n"
+        "  -d, --depth N            Bit depth out of 8, 10, 16 and 32, can be given several times, default all\n"
+        "  -c, --cpulevel NAME      Highest level to run out of none, sse2, avx2 and avx512, default all supported\n"
+        "  -t, --time MS            Time spent on each case, default 100\n"
+        "  -j, --json               Print the results as JSON\n"
+        "  -p, --stride-padding N   Bytes added to strides that are a multiple of 1024, default 0\n"
+        "      --calibrate          Print the fastest level of each kernel family as settings for calibration.conf\n"
+        "  -h, --help               Show this help\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::vector<std::string> kernelFilters;
+    std::vector<std::pair<unsigned, unsigned>> sizes;
+    std::vector<unsigned> depths;
+    int maxLevel = numLevels - 1;
+    double minTime = 0.1;
+    bool json = false;
+    bool calibrate = false;
+    unsigned padding = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if ((arg == "-k" || arg == "--kernel") && hasValue) {
+            kernelFilters.push_back(argv[++i]);
+        } else if ((arg == "-s" || arg == "--size") && hasValue) {
+            unsigned width, height;
+            if (!parseSize(argv[++i], width, height)) {
+                fprintf(stderr, "Invalid size %s, must be WxH and at least 16x16\n", argv[i]);
+                return 1;
+            }
+            sizes.push_back(std::make_pair(width, height));
+        } else if ((arg == "-d" || arg == "--depth") && hasValue) {
+            unsigned depth = static_cast<unsigned>(atoi(argv[++i]));
+            if (depth != 8 && depth != 10 && depth != 16 && depth != 32) {
+                fprintf(stderr, "Invalid depth %s\n", argv[i]);
+                return 1;
+            }
+            depths.push_back(depth);
+        } else if ((arg == "-c" || arg == "--cpulevel") && hasValue) {
+            maxLevel = -1;
+            for (int level = 0; level < numLevels; level++) {
+                if (!strcmp(argv[i + 1], levelNames[level]))
+                    maxLevel = level;
+            }
+            if (maxLevel < 0) {
+                fprintf(stderr, "Unknown cpulevel %s\n", argv[i + 1]);
+                return 1;
+            }
+            i++;
+        } else if ((arg == "-t" || arg == "--time") && hasValue) {
+            minTime = atof(argv[++i]) / 1000;
+        } else if (arg == "-j" || arg == "--json") {
+            json = true;
+        } else if ((arg == "-p" || arg == "--stride-padding") && hasValue) {
+            int value = atoi(argv[++i]);
+            if (value < 0 || value % 64) {
+                fprintf(stderr, "Invalid stride padding %s, must be a multiple of 64\n", argv[i]);
+                return 1;
+            }
+            padding = value;
+        } else if (arg == "--calibrate") {
+            calibrate = true;
+        } else if (arg == "-h" || arg == "--help") {
+            printHelp();
+            return 0;
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", arg.c_str());
+            printHelp();
+            return 1;
+        }
+    }
+
+    if (!getCPUFeatures()->can_run_vs) {
+        fprintf(stderr, "This CPU is not supported\n");
+        return 1;
+    }
+
+    // calibration only needs one size and one depth of each pixel type
+    if (sizes.empty() && calibrate)
+        sizes = { { 1920, 1080 } };
+    else if (sizes.empty())
+        sizes = { { 1920, 1080 }, { 3840, 2160 } };
+    if (depths.empty() && calibrate)
+        depths = { 8, 16, 32 };
+    else if (depths.empty())
+        depths = { 8, 10, 16, 32 };
+    json = json && !calibrate;
+
+    std::vector<Case> cases = buildCases();
+    std::mt19937 rng(1);
+    bool first = true;
+
+    std::vector<Measurement> measurements;
+
+    if (json)
+        printf("{\n  \"cycles\": \"%s\",\n  \"results\": [", readCycles() ? "tsc" : "none");
+    else if (!calibrate)
+        printf("%-20s %-7s %5s %11s %10s %12s\n", "kernel", "level", "depth", "size", "GB/s", "cycles/pixel");
+
+    for (auto &size : sizes) {
+        unsigned width = size.first;
+        unsigned height = size.second;
+
+        for (unsigned depth : depths) {
+            unsigned bytes = depth == 8 ? 1 : (depth == 32 ? 4 : 2);
+            int pixel = depth == 8 ? 0 : (depth == 32 ? 2 : 1);
+
+            std::vector<std::unique_ptr<Plane>> srcs;
+            for (unsigned i = 0; i < numAverageSrcs; i++) {
+                srcs.emplace_back(new Plane(width, height, bytes, padding));
+                srcs.back()->fill(width, height, depth, rng);
+            }
+            Plane dst(width, height, bytes, padding);
+            Plane transposed(height, width, bytes, padding);
+
+            Context ctx = {};
+            ctx.width = width;
+            ctx.height = height;
+            ctx.depth = depth;
+            for (unsigned i = 0; i < numAverageSrcs; i++)
+                ctx.srcs[i] = srcs[i]->data;
+            ctx.stride = dst.stride;
+            ctx.dst = dst.data;
+            ctx.transposed = transposed.data;
+            ctx.transposedStride = transposed.stride;
+
+            ctx.params.maxval = depth == 32 ? 0 : static_cast<uint16_t>((1U << depth) - 1);
+            ctx.params.scale = 1.0f;
+            ctx.params.threshold = ctx.params.maxval;
+            ctx.params.thresholdf = 1.0f;
+            ctx.params.stencil = 0xFF;
+            ctx.params.matrixsize = 9;
+            for (int i = 0; i < 9; i++) {
+                ctx.params.matrix[i] = 1;
+                ctx.params.matrixf[i] = 1.0f;
+            }
+            ctx.params.div = 1.0f / 9;
+
+            for (unsigned i = 0; i < numAverageSrcs; i++) {
+                ctx.weights[i] = 1;
+                ctx.fweights[i] = 1.0f / numAverageSrcs;
+            }
+            ctx.scale = numAverageSrcs;
+            ctx.fscale = 1.0f;
+
+            for (const Case &c : cases) {
+                if (c.pixel != pixel || c.level > maxLevel || !levelSupported(c.level))
+                    continue;
+                if (!kernelFilters.empty() && std::none_of(kernelFilters.begin(), kernelFilters.end(), [&](const std::string &f) { return c.name.find(f) != std::string::npos; }))
+                    continue;
+
+                Result r = measure(c, ctx, minTime);
+                double pixels = static_cast<double>(width) * height;
+                double gbps = pixels * bytes * (c.planesRead + c.planesWritten) / r.seconds / 1e9;
+                double cyclesPerPixel = r.cycles / pixels;
+
+                if (calibrate) {
+                    measurements.push_back({ &c, depth, width, height, r.seconds });
+                } else if (json) {
+                    printf("%s\n    { \"kernel\": \"%s\", \"cpulevel\": \"%s\", \"depth\": %u, \"width\": %u, \"height\": %u, \"seconds\": %.9f, \"gbps\": %.3f, \"cycles_per_pixel\": %.4f }",
+                        first ? "" : ",", c.name.c_str(), levelNames[c.level], depth, width, height, r.seconds, gbps, cyclesPerPixel);
+                    first = false;
+                } else {
+                    printf("%-20s %-7s %5u %5ux%-5u %10.2f %12.3f\n", c.name.c_str(), levelNames[c.level], depth, width, height, gbps, cyclesPerPixel);
+                }
+                fflush(stdout);
+            }
+        }
+    }
+
+    if (json)
+        printf("\n  ]\n}\n");
+
+    if (calibrate) {
+        for (const Family &family : families) {
+            int best = -1;
+            double bestSeconds = 0;
+            for (int level = 0; level <= maxLevel; level++) {
+                if (!levelSupported(level))
+                    continue;
+                double seconds = familySeconds(family, level, measurements);
+                // a lower level has to be clearly faster so noise doesn't turn off the vector code
+                if (seconds > 0 && (best < 0 || seconds * 1.02 < bestSeconds)) {
+                    best = level;
+                    bestSeconds = seconds;
+                }
+            }
+            if (best >= 0)
+                printf("%s=%s\n", family.setting, levelNames[best]);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include "../cpufeatures.h"
+#include "copy.h"
+#include "cpulevel.h"
+
+/* used when the cpu doesn't report its caches */
+#define DEFAULT_L2_CACHE_SIZE (1024 * 1024)
+#define DEFAULT_L3_CACHE_SIZE (8 * 1024 * 1024)
+
+void vs_copy_plane_c(void *dst, ptrdiff_t dst_stride, const void *src, ptrdiff_t src_stride, size_t row_size, size_t height)
+{
+    const uint8_t *srcp = src;
+    uint8_t *dstp = dst;
+    size_t i;
+
+    if (src_stride == dst_stride && src_stride == (ptrdiff_t)row_size) {
+        memcpy(dstp, srcp, row_size * height);
+        return;
+    }
+
+    for (i = 0; i < height; i++) {
+        memcpy(dstp, srcp, row_size);
+        srcp += src_stride;
+        dstp += dst_stride;
+    }
+}
+
+void vs_copy_plane(void *dst, ptrdiff_t dst_stride, const void *src, ptrdiff_t src_stride, size_t row_size, size_t height, int output, int cpulevel)
+{
+#ifdef VS_TARGET_CPU_X86
+    const CPUFeatures *features = getCPUFeatures();
+    size_t limit = output ? features->l2_cache_size : features->l3_cache_size;
+    if (!limit)
+        limit = output ? DEFAULT_L2_CACHE_SIZE : DEFAULT_L3_CACHE_SIZE;
+
+    /* short rows are mostly the unaligned ends that can't be streamed */
+    if (cpulevel >= VS_CPU_LEVEL_SSE2 && row_size >= 64 && row_size * height > limit) {
+        vs_copy_plane_stream_sse2(dst, dst_stride, src, src_stride, row_size, height);
+        return;
+    }
+#endif
+    vs_copy_plane_c(dst, dst_stride, src, src_stride, row_size, height);
+}
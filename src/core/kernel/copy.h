@@ -0,0 +1,53 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef COPY_H
+#define COPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Plane copies with the same arguments as bitblt. The streaming version writes around the caches,
+ * which is faster once a copy doesn't fit in them anyway and leaves the data of whatever runs next
+ * where it is.
+ */
+void vs_copy_plane_c(void *dst, ptrdiff_t dst_stride, const void *src, ptrdiff_t src_stride, size_t row_size, size_t height);
+
+#ifdef VS_TARGET_CPU_X86
+void vs_copy_plane_stream_sse2(void *dst, ptrdiff_t dst_stride, const void *src, ptrdiff_t src_stride, size_t row_size, size_t height);
+#endif
+
+/*
+ * Picks a copy by its size. Output is set when nothing in the process reads the destination again
+ * soon, such as the buffers frames are written out through, those are streamed once they don't fit
+ * in the L2 cache and everything else once it doesn't fit in the L3 cache.
+ */
+void vs_copy_plane(void *dst, ptrdiff_t dst_stride, const void *src, ptrdiff_t src_stride, size_t row_size, size_t height, int output, int cpulevel);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
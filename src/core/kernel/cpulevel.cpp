@@ -30,6 +30,10 @@ int vs_set_cpulevel(struct VSCore *core, int level) {
     return core->setCpuLevel(level);
 }
 
+int vs_get_kernel_cpulevel(const struct VSCore *core, int family) {
+    return core->getKernelCpuLevel(family);
+}
+
 int vs_cpulevel_from_str(const char *name) {
     if (!strcmp(name, "none"))
         return VS_CPU_LEVEL_NONE;
@@ -38,6 +42,8 @@ int vs_cpulevel_from_str(const char *name) {
         return VS_CPU_LEVEL_SSE2;
     else if (!strcmp(name, "avx2"))
         return VS_CPU_LEVEL_AVX2;
+    else if (!strcmp(name, "avx512"))
+        return VS_CPU_LEVEL_AVX512;
 #endif
     else
         return VS_CPU_LEVEL_MAX;
@@ -51,7 +57,26 @@ const char *vs_cpulevel_to_str(int level) {
         return "sse2";
     else if (level <= VS_CPU_LEVEL_AVX2)
         return "avx2";
+    else if (level <= VS_CPU_LEVEL_AVX512)
+        return "avx512";
 #endif
     else
         return "";
 }
+
+const char *vs_kernel_family_setting(int family) {
+    switch (family) {
+    case VS_KERNEL_FAMILY_GENERIC:
+        return "CPULevelGeneric";
+    case VS_KERNEL_FAMILY_MERGE:
+        return "CPULevelMerge";
+    case VS_KERNEL_FAMILY_PLANESTATS:
+        return "CPULevelPlaneStats";
+    case VS_KERNEL_FAMILY_AVERAGE:
+        return "CPULevelAverage";
+    case VS_KERNEL_FAMILY_TRANSPOSE:
+        return "CPULevelTranspose";
+    default:
+        return "";
+    }
+}
@@ -32,18 +32,35 @@ enum {
 #ifdef VS_TARGET_CPU_X86
     VS_CPU_LEVEL_SSE2 = 1,
     VS_CPU_LEVEL_AVX2 = 2,
+    VS_CPU_LEVEL_AVX512 = 3,
 #endif
     VS_CPU_LEVEL_MAX = INT_MAX
 };
 
+// Groups of kernels whose cpulevel can be capped separately by the CPULevel* settings
+enum {
+    VS_KERNEL_FAMILY_GENERIC = 0,
+    VS_KERNEL_FAMILY_MERGE,
+    VS_KERNEL_FAMILY_PLANESTATS,
+    VS_KERNEL_FAMILY_AVERAGE,
+    VS_KERNEL_FAMILY_TRANSPOSE,
+    VS_KERNEL_FAMILY_COUNT
+};
+
 struct VSCore;
 
 int vs_get_cpulevel(const struct VSCore *core);
 int vs_set_cpulevel(struct VSCore *core, int level);
 
+// the lower of the core's cpulevel and the setting for the family
+int vs_get_kernel_cpulevel(const struct VSCore *core, int family);
+
 int vs_cpulevel_from_str(const char *name);
 const char *vs_cpulevel_to_str(int level);
 
+// the name of the setting that caps the family, such as CPULevelGeneric
+const char *vs_kernel_family_setting(int family);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,93 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdint.h>
+#include "downscale.h"
+#include "half.h"
+
+static unsigned box_shift(unsigned factor)
+{
+    return factor == 8 ? 6 : factor == 4 ? 4 : 2;
+}
+
+#define BOX_DOWNSCALE_INT(pixel, T) \
+void vs_box_downscale_##pixel##_c(const void *src, ptrdiff_t src_stride, void *dst, unsigned factor, unsigned width) \
+{ \
+    const uint8_t *srcp = src; \
+    T *dstp = dst; \
+    unsigned shift = box_shift(factor); \
+    uint32_t round = 1U << (shift - 1); \
+    unsigned x, i, j; \
+  \
+    for (x = 0; x < width; x++) { \
+        uint32_t sum = round; \
+  \
+        for (i = 0; i < factor; i++) { \
+            const T *row = (const T *)(srcp + i * src_stride) + x * factor; \
+            for (j = 0; j < factor; j++) \
+                sum += row[j]; \
+        } \
+  \
+        dstp[x] = (T)(sum >> shift); \
+    } \
+}
+
+BOX_DOWNSCALE_INT(byte, uint8_t)
+BOX_DOWNSCALE_INT(word, uint16_t)
+
+#undef BOX_DOWNSCALE_INT
+
+/* Columns are summed top to bottom and then added in pairs, the same order as in the vector versions. */
+#define BOX_DOWNSCALE_FLOAT(pixel, T, LOAD, STORE) \
+void vs_box_downscale_##pixel##_c(const void *src, ptrdiff_t src_stride, void *dst, unsigned factor, unsigned width) \
+{ \
+    const uint8_t *srcp = src; \
+    T *dstp = dst; \
+    float scale = 1.0f / (factor * factor); \
+    unsigned x, i, j, n; \
+  \
+    for (x = 0; x < width; x++) { \
+        float col[8]; \
+  \
+        for (j = 0; j < factor; j++) \
+            col[j] = 0.0f; \
+  \
+        for (i = 0; i < factor; i++) { \
+            const T *row = (const T *)(srcp + i * src_stride) + x * factor; \
+            for (j = 0; j < factor; j++) \
+                col[j] += LOAD(row[j]); \
+        } \
+  \
+        for (n = factor; n > 1; n /= 2) { \
+            for (j = 0; j < n / 2; j++) \
+                col[j] = col[2 * j] + col[2 * j + 1]; \
+        } \
+  \
+        dstp[x] = STORE(col[0] * scale); \
+    } \
+}
+
+#define IDENTITY(x) (x)
+
+BOX_DOWNSCALE_FLOAT(half, uint16_t, vs_half_to_float, vs_float_to_half)
+BOX_DOWNSCALE_FLOAT(float, float, IDENTITY, IDENTITY)
+
+#undef IDENTITY
+#undef BOX_DOWNSCALE_FLOAT
@@ -0,0 +1,59 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef DOWNSCALE_H
+#define DOWNSCALE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Produces one row of width samples from the factor rows starting at src, every sample is the average
+ * of a factor x factor block. The factor has to be 2, 4 or 8. Integer averages are rounded to nearest,
+ * float sums are formed in the same order by all versions so the results are identical.
+ */
+#define DECL_BOX_DOWNSCALE(pixel, isa) void vs_box_downscale_##pixel##_##isa(const void *src, ptrdiff_t src_stride, void *dst, unsigned factor, unsigned width);
+
+DECL_BOX_DOWNSCALE(byte, c)
+DECL_BOX_DOWNSCALE(word, c)
+DECL_BOX_DOWNSCALE(half, c)
+DECL_BOX_DOWNSCALE(float, c)
+
+#ifdef VS_TARGET_CPU_X86
+DECL_BOX_DOWNSCALE(byte, sse2)
+DECL_BOX_DOWNSCALE(word, sse2)
+DECL_BOX_DOWNSCALE(float, sse2)
+
+DECL_BOX_DOWNSCALE(byte, avx2)
+DECL_BOX_DOWNSCALE(word, avx2)
+DECL_BOX_DOWNSCALE(half, avx2) /* also needs F16C */
+DECL_BOX_DOWNSCALE(float, avx2)
+#endif
+
+#undef DECL_BOX_DOWNSCALE
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,105 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include "fill.h"
+#include "cpulevel.h"
+
+void vs_fill_byte_c(void *dst, uint32_t value, size_t n)
+{
+    memset(dst, (uint8_t)value, n);
+}
+
+void vs_fill_word_c(void *dst, uint32_t value, size_t n)
+{
+    uint16_t *dstp = dst;
+    size_t i;
+
+    if (!value) {
+        memset(dst, 0, n * 2);
+        return;
+    }
+
+    for (i = 0; i < n; i++)
+        dstp[i] = (uint16_t)value;
+}
+
+void vs_fill_dword_c(void *dst, uint32_t value, size_t n)
+{
+    uint32_t *dstp = dst;
+    size_t i;
+
+    if (!value) {
+        memset(dst, 0, n * 4);
+        return;
+    }
+
+    for (i = 0; i < n; i++)
+        dstp[i] = value;
+}
+
+typedef void (*fill_func)(void *dst, uint32_t value, size_t n);
+
+static fill_func select_fill(unsigned bytes_per_sample, int cpulevel)
+{
+#ifdef VS_TARGET_CPU_X86
+    if (cpulevel >= VS_CPU_LEVEL_AVX2) {
+        switch (bytes_per_sample) {
+        case 1: return vs_fill_byte_avx2;
+        case 2: return vs_fill_word_avx2;
+        case 4: return vs_fill_dword_avx2;
+        }
+    } else if (cpulevel >= VS_CPU_LEVEL_SSE2) {
+        switch (bytes_per_sample) {
+        case 1: return vs_fill_byte_sse2;
+        case 2: return vs_fill_word_sse2;
+        case 4: return vs_fill_dword_sse2;
+        }
+    }
+#else
+    (void)cpulevel;
+#endif
+    switch (bytes_per_sample) {
+    case 1: return vs_fill_byte_c;
+    case 2: return vs_fill_word_c;
+    case 4: return vs_fill_dword_c;
+    default: return NULL;
+    }
+}
+
+void vs_fill_plane(void *dst, ptrdiff_t stride, uint32_t value, unsigned bytes_per_sample, size_t width, size_t height, int cpulevel)
+{
+    fill_func func = select_fill(bytes_per_sample, cpulevel);
+    uint8_t *dstp = dst;
+    size_t i;
+
+    if (!func || !width || !height)
+        return;
+
+    if (stride == (ptrdiff_t)(width * bytes_per_sample)) {
+        width *= height;
+        height = 1;
+    }
+
+    for (i = 0; i < height; i++) {
+        func(dstp, value, width);
+        dstp += stride;
+    }
+}
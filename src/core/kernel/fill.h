@@ -0,0 +1,64 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef FILL_H
+#define FILL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sets n samples to value. The destination only has to be aligned to the sample size, fills that are
+ * shorter than a vector are done by the c version. Values are the raw sample bits, so float and half
+ * go through the dword and word versions.
+ */
+#define DECL_FILL(pixel, isa) void vs_fill_##pixel##_##isa(void *dst, uint32_t value, size_t n);
+
+DECL_FILL(byte, c)
+DECL_FILL(word, c)
+DECL_FILL(dword, c)
+
+#ifdef VS_TARGET_CPU_X86
+DECL_FILL(byte, sse2)
+DECL_FILL(word, sse2)
+DECL_FILL(dword, sse2)
+
+DECL_FILL(byte, avx2)
+DECL_FILL(word, avx2)
+DECL_FILL(dword, avx2)
+#endif
+
+#undef DECL_FILL
+
+/*
+ * Fills width samples of every row. Rows that are as long as the stride are filled as one, so the
+ * padding at the end of each row gets the value too.
+ */
+void vs_fill_plane(void *dst, ptrdiff_t stride, uint32_t value, unsigned bytes_per_sample, size_t width, size_t height, int cpulevel);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
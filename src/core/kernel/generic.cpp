@@ -24,6 +24,7 @@
 #include <cstdint>
 #include <limits>
 #include <type_traits>
+#include <vector>
 #include "generic.h"
 
 namespace {
@@ -282,6 +283,16 @@ void filter_plane_3x3(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_
     }
 }
 
+// Running sums of uniform kernels are kept in double for float so they don't drift over a plane.
+template <class T>
+using RunningSum = typename std::conditional<std::is_integral<T>::value, int32_t, double>::type;
+
+template <class Weight>
+bool is_uniform_kernel(const Weight *coeffs, unsigned fwidth)
+{
+    return std::all_of(coeffs + 1, coeffs + fwidth, [=](Weight c) { return c == coeffs[0]; });
+}
+
 template <class T>
 void conv_plane_5x5(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const vs_generic_params &params, unsigned width, unsigned height)
 {
@@ -310,7 +321,7 @@ void conv_plane_5x5(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t
         T *dst_p = static_cast<T *>(line_ptr(dst, i, dst_stride));
 
         for (unsigned j = 0; j < std::min(width, 2U); ++j) {
-            unsigned dist_from_right = width - 1 - i;
+            unsigned dist_from_right = width - 1 - j;
             unsigned idx[5];
 
             idx[0] = j < 2 ? std::min(2 - j, width - 1) : j - 2;
@@ -351,7 +362,7 @@ void conv_plane_5x5(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t
         }
 
         for (unsigned j = std::max(2U, width - std::min(width, 2U)); j < width; ++j) {
-            unsigned dist_from_right = width - 1 - i;
+            unsigned dist_from_right = width - 1 - j;
             unsigned idx[5];
 
             idx[0] = j < 2 ? std::min(2 - j, width - 1) : j - 2;
@@ -386,6 +397,7 @@ void conv_plane_h(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
     const Weight *coeffs = std::is_integral<T>::value ? (const Weight *)params.matrix : (const Weight *)params.matrixf;
     unsigned fwidth = params.matrixsize;
     unsigned support = fwidth / 2;
+    bool uniform = is_uniform_kernel(coeffs, fwidth);
 
     uint16_t maxval = params.maxval;
     float div = params.div;
@@ -397,7 +409,7 @@ void conv_plane_h(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
         T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
 
         for (unsigned j = 0; j < std::min(width, support); ++j) {
-            unsigned dist_from_right = width - 1 - i;
+            unsigned dist_from_right = width - 1 - j;
 
             Accum accum = 0;
 
@@ -415,21 +427,39 @@ void conv_plane_h(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
             dstp[j] = limit(xrint<T>(tmp), maxval);
         }
 
-        for (unsigned j = support; j < width - std::min(width, support); ++j) {
-            Accum accum = 0;
+        if (uniform) {
+            RunningSum<T> sum = 0;
 
             for (unsigned k = 0; k < fwidth; ++k) {
-                accum += coeffs[k] * static_cast<Accum>(srcp[j - support + k]);
+                sum += srcp[k];
             }
 
-            float tmp = static_cast<float>(accum) * div + bias;
-            tmp = saturate ? tmp : std::fabs(tmp);
-            dstp[j] = limit(xrint<T>(tmp), maxval);
+            for (unsigned j = support; j < width - std::min(width, support); ++j) {
+                Accum accum = static_cast<Accum>(coeffs[0] * sum);
+
+                float tmp = static_cast<float>(accum) * div + bias;
+                tmp = saturate ? tmp : std::fabs(tmp);
+                dstp[j] = limit(xrint<T>(tmp), maxval);
+
+                if (j + support + 1 < width)
+                    sum += static_cast<RunningSum<T>>(srcp[j + support + 1]) - srcp[j - support];
+            }
+        } else {
+            for (unsigned j = support; j < width - std::min(width, support); ++j) {
+                Accum accum = 0;
+
+                for (unsigned k = 0; k < fwidth; ++k) {
+                    accum += coeffs[k] * static_cast<Accum>(srcp[j - support + k]);
+                }
 
+                float tmp = static_cast<float>(accum) * div + bias;
+                tmp = saturate ? tmp : std::fabs(tmp);
+                dstp[j] = limit(xrint<T>(tmp), maxval);
+            }
         }
 
         for (unsigned j = std::max(support, width - std::min(width, support)); j < width; ++j) {
-            unsigned dist_from_right = width - 1 - i;
+            unsigned dist_from_right = width - 1 - j;
 
             Accum accum = 0;
 
@@ -458,6 +488,7 @@ void conv_plane_v(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
     const Weight *coeffs = std::is_integral<T>::value ? (const Weight *)params.matrix : (const Weight *)params.matrixf;
     unsigned fwidth = params.matrixsize;
     unsigned support = fwidth / 2;
+    bool uniform = is_uniform_kernel(coeffs, fwidth);
 
     uint16_t maxval = params.maxval;
     float div = params.div;
@@ -489,19 +520,53 @@ void conv_plane_v(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
             dstp[j] = limit(xrint<T>(tmp), maxval);
         }
     }
-    for (unsigned i = support; i < height - std::min(height, support); ++i) {
-        T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
+    if (uniform && support < height - std::min(height, support)) {
+        // Column sums over the window, updated by the rows entering and leaving it.
+        std::vector<RunningSum<T>> sum(width);
 
-        for (unsigned j = 0; j < width; ++j) {
-            Accum accum = 0;
+        for (unsigned k = 0; k < fwidth; ++k) {
+            const T *srcp = static_cast<const T *>(line_ptr(src, k, src_stride));
 
-            for (unsigned k = 0; k < fwidth; ++k) {
-                accum += coeffs[k] * static_cast<Accum>(static_cast<const T *>(line_ptr(src, i - support + k, src_stride))[j]);
+            for (unsigned j = 0; j < width; ++j) {
+                sum[j] += srcp[j];
             }
+        }
 
-            float tmp = static_cast<float>(accum) * div + bias;
-            tmp = saturate ? tmp : std::fabs(tmp);
-            dstp[j] = limit(xrint<T>(tmp), maxval);
+        for (unsigned i = support; i < height - std::min(height, support); ++i) {
+            T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
+
+            for (unsigned j = 0; j < width; ++j) {
+                Accum accum = static_cast<Accum>(coeffs[0] * sum[j]);
+
+                float tmp = static_cast<float>(accum) * div + bias;
+                tmp = saturate ? tmp : std::fabs(tmp);
+                dstp[j] = limit(xrint<T>(tmp), maxval);
+            }
+
+            if (i + support + 1 < height) {
+                const T *addp = static_cast<const T *>(line_ptr(src, i + support + 1, src_stride));
+                const T *subp = static_cast<const T *>(line_ptr(src, i - support, src_stride));
+
+                for (unsigned j = 0; j < width; ++j) {
+                    sum[j] += static_cast<RunningSum<T>>(addp[j]) - subp[j];
+                }
+            }
+        }
+    } else {
+        for (unsigned i = support; i < height - std::min(height, support); ++i) {
+            T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
+
+            for (unsigned j = 0; j < width; ++j) {
+                Accum accum = 0;
+
+                for (unsigned k = 0; k < fwidth; ++k) {
+                    accum += coeffs[k] * static_cast<Accum>(static_cast<const T *>(line_ptr(src, i - support + k, src_stride))[j]);
+                }
+
+                float tmp = static_cast<float>(accum) * div + bias;
+                tmp = saturate ? tmp : std::fabs(tmp);
+                dstp[j] = limit(xrint<T>(tmp), maxval);
+            }
         }
     }
     for (unsigned i = std::max(support, height - std::min(height, support)); i < height; ++i) {
@@ -531,6 +596,422 @@ void conv_plane_v(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
     }
 }
 
+// Horizontal pass of the separable convolution, the sums are kept at full precision.
+template <class T, class Accum, class Weight>
+void conv_line_h(const T *srcp, Accum *dstp, const Weight *coeffs, unsigned fwidth, unsigned width)
+{
+    unsigned support = fwidth / 2;
+
+    for (unsigned j = 0; j < width; ++j) {
+        if (j == support && width > 2 * support)
+            j = width - support;
+
+        unsigned dist_from_right = width - 1 - j;
+        Accum accum = 0;
+
+        for (unsigned k = 0; k < support; ++k) {
+            unsigned idx = j < support - k ? std::min(support - k - j, width - 1) : j - support + k;
+            accum += coeffs[k] * static_cast<Accum>(srcp[idx]);
+        }
+        for (unsigned k = support; k < fwidth; ++k) {
+            unsigned idx = dist_from_right < k - support ? j - std::min(k - support - dist_from_right, j) : j - support + k;
+            accum += coeffs[k] * static_cast<Accum>(srcp[idx]);
+        }
+
+        dstp[j] = accum;
+    }
+
+    for (unsigned j = support; j < width - std::min(width, support); ++j) {
+        dstp[j] = 0;
+    }
+    for (unsigned k = 0; k < fwidth; ++k) {
+        Accum c = coeffs[k];
+
+        for (unsigned j = support; j < width - std::min(width, support); ++j) {
+            dstp[j] += c * static_cast<Accum>(srcp[j - support + k]);
+        }
+    }
+}
+
+// A rank-1 matrix is applied as a horizontal pass followed by a vertical pass, params.matrix holds
+// the horizontal taps followed by the vertical taps. Only the horizontally filtered rows the current
+// output row needs are kept, row r lives in slot r % fwidth.
+template <class T>
+void conv_plane_separable(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const vs_generic_params &params, unsigned width, unsigned height)
+{
+    typedef typename std::conditional<std::is_integral<T>::value, int32_t, float>::type Accum;
+    typedef typename std::conditional<std::is_integral<T>::value, int16_t, float>::type Weight;
+
+    const Weight *coeffs = std::is_integral<T>::value ? (const Weight *)params.matrix : (const Weight *)params.matrixf;
+    unsigned fwidth = params.matrixsize / 2;
+    unsigned support = fwidth / 2;
+    const Weight *hcoeffs = coeffs;
+    const Weight *vcoeffs = coeffs + fwidth;
+
+    uint16_t maxval = params.maxval;
+    float div = params.div;
+    float bias = params.bias;
+    bool saturate = params.saturate;
+
+    std::vector<Accum> rows(static_cast<size_t>(fwidth) * width);
+    std::vector<Accum> accum(width);
+    unsigned next_row = 0;
+
+    for (unsigned i = 0; i < height; ++i) {
+        for (; next_row <= std::min(i + support, height - 1); ++next_row) {
+            conv_line_h(static_cast<const T *>(line_ptr(src, next_row, src_stride)), rows.data() + static_cast<size_t>(next_row % fwidth) * width, hcoeffs, fwidth, width);
+        }
+
+        unsigned dist_from_bottom = height - 1 - i;
+        unsigned idx[25];
+
+        for (unsigned k = 0; k < support; ++k) {
+            idx[k] = i < support - k ? std::min(support - k - i, height - 1) : i - support + k;
+        }
+        for (unsigned k = support; k < fwidth; ++k) {
+            idx[k] = dist_from_bottom < k - support ? i - std::min(k - support - dist_from_bottom, i) : i - support + k;
+        }
+
+        std::fill(accum.begin(), accum.end(), Accum{});
+
+        for (unsigned k = 0; k < fwidth; ++k) {
+            const Accum *rowp = rows.data() + static_cast<size_t>(idx[k] % fwidth) * width;
+            Accum c = vcoeffs[k];
+
+            for (unsigned j = 0; j < width; ++j) {
+                accum[j] += c * rowp[j];
+            }
+        }
+
+        T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
+
+        for (unsigned j = 0; j < width; ++j) {
+            float tmp = static_cast<float>(accum[j]) * div + bias;
+            tmp = saturate ? tmp : std::fabs(tmp);
+            dstp[j] = limit(xrint<T>(tmp), maxval);
+        }
+    }
+}
+
+// Reflects x into [0, n) without repeating the edge sample, also when the radius exceeds the plane.
+unsigned mirror_index(int x, unsigned n)
+{
+    int period = 2 * (static_cast<int>(n) - 1);
+    if (period == 0)
+        return 0;
+    x = std::abs(x) % period;
+    return x < static_cast<int>(n) ? x : period - x;
+}
+
+// Selection network for the sample at rank in a window of size elements. Batcher's odd-even merge
+// sort is generated for the next power of two, comparators that only move padding are folded into
+// the element mapping and the ones that don't contribute to the selected output are removed.
+struct RankNetwork {
+    struct Comparator {
+        unsigned lo;
+        unsigned hi;
+        bool need_lo;
+        bool need_hi;
+    };
+
+    std::vector<Comparator> ops;
+    unsigned output;
+
+    RankNetwork(unsigned size, unsigned rank)
+    {
+        unsigned n = 1;
+        while (n < size)
+            n *= 2;
+
+        // Padding sorts above all samples, so the rank of each sample is unaffected.
+        std::vector<int> phys(n, -1);
+        for (unsigned i = 0; i < size; ++i) {
+            phys[i] = i;
+        }
+
+        std::vector<Comparator> all;
+        auto compare = [&](unsigned a, unsigned b) {
+            if (phys[b] < 0)
+                return;
+            if (phys[a] < 0) {
+                std::swap(phys[a], phys[b]);
+                return;
+            }
+            all.push_back({ static_cast<unsigned>(phys[a]), static_cast<unsigned>(phys[b]), false, false });
+        };
+
+        for (unsigned p = 1; p < n; p *= 2) {
+            for (unsigned k = p; k >= 1; k /= 2) {
+                for (unsigned j = k % p; j + k < n; j += 2 * k) {
+                    for (unsigned i = 0; i < std::min(k, n - j - k); ++i) {
+                        if ((i + j) / (2 * p) == (i + j + k) / (2 * p))
+                            compare(i + j, i + j + k);
+                    }
+                }
+            }
+        }
+
+        output = phys[rank];
+
+        std::vector<bool> needed(size);
+        needed[output] = true;
+        for (auto it = all.rbegin(); it != all.rend(); ++it) {
+            it->need_lo = needed[it->lo];
+            it->need_hi = needed[it->hi];
+            if (it->need_lo || it->need_hi) {
+                needed[it->lo] = true;
+                needed[it->hi] = true;
+                ops.push_back(*it);
+            }
+        }
+        std::reverse(ops.begin(), ops.end());
+    }
+};
+
+// Spelled differently for integer and float samples so that gcc vectorizes both.
+template <class T>
+T rank_lo(T a, T b)
+{
+    return std::is_integral<T>::value ? (a < b ? a : b) : std::min(a, b);
+}
+
+template <class T>
+T rank_hi(T a, T b)
+{
+    return std::is_integral<T>::value ? (a < b ? b : a) : std::max(a, b);
+}
+
+template <class T>
+void rank_minmax(T * __restrict lo, T * __restrict hi, unsigned n)
+{
+    for (unsigned x = 0; x < n; ++x) {
+        T a = lo[x];
+        T b = hi[x];
+        lo[x] = rank_lo(a, b);
+        hi[x] = rank_hi(a, b);
+    }
+}
+
+template <class T>
+void rank_min(T * __restrict lo, const T * __restrict hi, unsigned n)
+{
+    for (unsigned x = 0; x < n; ++x) {
+        lo[x] = rank_lo(lo[x], hi[x]);
+    }
+}
+
+template <class T>
+void rank_max(const T * __restrict lo, T * __restrict hi, unsigned n)
+{
+    for (unsigned x = 0; x < n; ++x) {
+        hi[x] = rank_hi(lo[x], hi[x]);
+    }
+}
+
+// Small windows run the selection network over a block of columns at a time, every comparator is
+// a min/max between two rows of the block so it vectorizes across pixels.
+template <class T>
+void rank_plane_network(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, unsigned radius, unsigned rank, unsigned width, unsigned height)
+{
+    constexpr unsigned block = 128;
+    unsigned diameter = 2 * radius + 1;
+    unsigned size = diameter * diameter;
+    RankNetwork network(size, rank);
+
+    std::vector<T> padded(static_cast<size_t>(diameter) * (width + 2 * radius));
+    std::vector<T> values(static_cast<size_t>(size) * block);
+
+    for (unsigned i = 0; i < height; ++i) {
+        for (unsigned dy = 0; dy < diameter; ++dy) {
+            const T *srcp = static_cast<const T *>(line_ptr(src, mirror_index(static_cast<int>(i + dy) - static_cast<int>(radius), height), src_stride));
+            T *padp = padded.data() + static_cast<size_t>(dy) * (width + 2 * radius);
+
+            for (unsigned x = 0; x < width + 2 * radius; ++x) {
+                padp[x] = srcp[mirror_index(static_cast<int>(x) - static_cast<int>(radius), width)];
+            }
+        }
+
+        T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
+
+        for (unsigned x0 = 0; x0 < width; x0 += block) {
+            unsigned count = std::min(block, width - x0);
+
+            for (unsigned dy = 0; dy < diameter; ++dy) {
+                for (unsigned dx = 0; dx < diameter; ++dx) {
+                    const T *padp = padded.data() + static_cast<size_t>(dy) * (width + 2 * radius) + x0 + dx;
+                    std::copy_n(padp, count, values.data() + static_cast<size_t>(dy * diameter + dx) * block);
+                }
+            }
+
+            for (const RankNetwork::Comparator &op : network.ops) {
+                T *lo = values.data() + static_cast<size_t>(op.lo) * block;
+                T *hi = values.data() + static_cast<size_t>(op.hi) * block;
+
+                if (op.need_lo && op.need_hi)
+                    rank_minmax(lo, hi, block);
+                else if (op.need_lo)
+                    rank_min(lo, hi, block);
+                else
+                    rank_max(lo, hi, block);
+            }
+
+            std::copy_n(values.data() + static_cast<size_t>(network.output) * block, count, dstp + x0);
+        }
+    }
+}
+
+// Constant time histogram rank filter (Perreault and Hebert) for integer samples up to 10 bits.
+// Every column keeps a histogram of its window rows and the window histogram slides along the
+// row. Only the coarse level is updated for every pixel, a fine segment is brought up to date
+// when the selected sample falls into it.
+template <class T>
+void rank_plane_histogram(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, unsigned radius, unsigned rank, unsigned bits, unsigned width, unsigned height)
+{
+    unsigned bins = 1U << bits;
+    unsigned shift = (bits + 1) / 2;
+    unsigned fine = 1U << shift;
+    unsigned coarse = bins >> shift;
+    int r = static_cast<int>(radius);
+
+    std::vector<uint16_t> col_fine(static_cast<size_t>(width) * bins);
+    std::vector<uint16_t> col_coarse(static_cast<size_t>(width) * coarse);
+    std::vector<uint16_t> kernel_fine(bins);
+    std::vector<uint16_t> kernel_coarse(coarse);
+    std::vector<int> segment_col(coarse);
+    std::vector<unsigned> col_idx(width + 2 * radius + 1);
+
+    for (unsigned x = 0; x < col_idx.size(); ++x) {
+        col_idx[x] = mirror_index(static_cast<int>(x) - r - 1, width);
+    }
+    // Window columns of pixel j are col_idx[j + 1 .. j + 2 * radius + 1].
+    const unsigned *cols = col_idx.data() + 1 + radius;
+
+    auto update_columns = [&](unsigned row, int delta) {
+        const T *srcp = static_cast<const T *>(line_ptr(src, row, src_stride));
+
+        for (unsigned x = 0; x < width; ++x) {
+            unsigned v = srcp[x];
+            col_fine[static_cast<size_t>(x) * bins + v] += delta;
+            col_coarse[static_cast<size_t>(x) * coarse + (v >> shift)] += delta;
+        }
+    };
+
+    for (int dy = -r; dy <= r; ++dy) {
+        update_columns(mirror_index(dy, height), 1);
+    }
+
+    for (unsigned i = 0; i < height; ++i) {
+        if (i > 0) {
+            update_columns(mirror_index(static_cast<int>(i) - r - 1, height), -1);
+            update_columns(mirror_index(static_cast<int>(i) + r, height), 1);
+        }
+
+        std::fill(kernel_coarse.begin(), kernel_coarse.end(), 0);
+        std::fill(segment_col.begin(), segment_col.end(), -1);
+
+        for (int dx = -r; dx <= r; ++dx) {
+            const uint16_t *colp = col_coarse.data() + static_cast<size_t>(cols[dx]) * coarse;
+
+            for (unsigned c = 0; c < coarse; ++c) {
+                kernel_coarse[c] += colp[c];
+            }
+        }
+
+        T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
+
+        for (int j = 0; j < static_cast<int>(width); ++j) {
+            if (j > 0) {
+                const uint16_t *addp = col_coarse.data() + static_cast<size_t>(cols[j + r]) * coarse;
+                const uint16_t *subp = col_coarse.data() + static_cast<size_t>(cols[j - r - 1]) * coarse;
+
+                for (unsigned c = 0; c < coarse; ++c) {
+                    kernel_coarse[c] += addp[c] - subp[c];
+                }
+            }
+
+            unsigned count = 0;
+            unsigned s = 0;
+            while (count + kernel_coarse[s] <= rank)
+                count += kernel_coarse[s++];
+
+            uint16_t *segp = kernel_fine.data() + (s << shift);
+
+            if (segment_col[s] < 0 || j - segment_col[s] > 2 * r + 1) {
+                std::fill_n(segp, fine, 0);
+
+                for (int dx = -r; dx <= r; ++dx) {
+                    const uint16_t *colp = col_fine.data() + static_cast<size_t>(cols[j + dx]) * bins + (s << shift);
+
+                    for (unsigned b = 0; b < fine; ++b) {
+                        segp[b] += colp[b];
+                    }
+                }
+            } else {
+                for (int jj = segment_col[s] + 1; jj <= j; ++jj) {
+                    const uint16_t *addp = col_fine.data() + static_cast<size_t>(cols[jj + r]) * bins + (s << shift);
+                    const uint16_t *subp = col_fine.data() + static_cast<size_t>(cols[jj - r - 1]) * bins + (s << shift);
+
+                    for (unsigned b = 0; b < fine; ++b) {
+                        segp[b] += addp[b] - subp[b];
+                    }
+                }
+            }
+            segment_col[s] = j;
+
+            unsigned b = 0;
+            while (count + segp[b] <= rank)
+                count += segp[b++];
+
+            dstp[j] = static_cast<T>((s << shift) + b);
+        }
+    }
+}
+
+template <class T>
+void rank_plane_select(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, unsigned radius, unsigned rank, unsigned width, unsigned height)
+{
+    unsigned diameter = 2 * radius + 1;
+    std::vector<T> padded(static_cast<size_t>(diameter) * (width + 2 * radius));
+    std::vector<T> values(static_cast<size_t>(diameter) * diameter);
+
+    for (unsigned i = 0; i < height; ++i) {
+        for (unsigned dy = 0; dy < diameter; ++dy) {
+            const T *srcp = static_cast<const T *>(line_ptr(src, mirror_index(static_cast<int>(i + dy) - static_cast<int>(radius), height), src_stride));
+            T *padp = padded.data() + static_cast<size_t>(dy) * (width + 2 * radius);
+
+            for (unsigned x = 0; x < width + 2 * radius; ++x) {
+                padp[x] = srcp[mirror_index(static_cast<int>(x) - static_cast<int>(radius), width)];
+            }
+        }
+
+        T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
+
+        for (unsigned j = 0; j < width; ++j) {
+            for (unsigned dy = 0; dy < diameter; ++dy) {
+                std::copy_n(padded.data() + static_cast<size_t>(dy) * (width + 2 * radius) + j, diameter, values.data() + dy * diameter);
+            }
+            std::nth_element(values.begin(), values.begin() + rank, values.end());
+            dstp[j] = values[rank];
+        }
+    }
+}
+
+template <class T>
+void rank_plane(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const vs_generic_params &params, unsigned width, unsigned height)
+{
+    unsigned bits = 0;
+    while (bits < 16 && (params.maxval >> bits))
+        ++bits;
+
+    // The network grows faster than the window, the histogram is faster from 9x9 up.
+    if (std::is_integral<T>::value && bits <= 10 && params.radius > 3)
+        rank_plane_histogram<T>(src, src_stride, dst, dst_stride, params.radius, params.rank, bits, width, height);
+    else if (params.radius <= 7)
+        rank_plane_network<T>(src, src_stride, dst, dst_stride, params.radius, params.rank, width, height);
+    else
+        rank_plane_select<T>(src, src_stride, dst, dst_stride, params.radius, params.rank, width, height);
+}
+
 } // namespace
 
 
@@ -669,6 +1150,36 @@ void vs_generic_5x5_conv_float_c(const void *src, ptrdiff_t src_stride, void *ds
     conv_plane_5x5<float>(src, src_stride, dst, dst_stride, *params, width, height);
 }
 
+void vs_generic_sep_conv_byte_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    conv_plane_separable<uint8_t>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_sep_conv_word_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    conv_plane_separable<uint16_t>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_sep_conv_float_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    conv_plane_separable<float>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_rank_byte_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    rank_plane<uint8_t>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_rank_word_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    rank_plane<uint16_t>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_rank_float_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    rank_plane<float>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
 void vs_generic_1d_conv_h_byte_c(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
 {
     conv_plane_h<uint8_t>(src, src_stride, dst, dst_stride, *params, width, height);
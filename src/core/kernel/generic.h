@@ -41,7 +41,11 @@ struct vs_generic_params {
 	/* Minimum, Maximum. */
 	uint8_t stencil;
 
-	/* Convolution. */
+	/* Median, Percentile. */
+	unsigned radius;
+	unsigned rank;
+
+	/* Convolution. Separable convolution stores the horizontal taps followed by the vertical taps. */
 	unsigned matrixsize;
 	int16_t matrix[25];
 	float matrixf[25];
@@ -89,6 +93,14 @@ DECL(5x5_conv, byte, c)
 DECL(5x5_conv, word, c)
 DECL(5x5_conv, float, c)
 
+DECL(rank, byte, c)
+DECL(rank, word, c)
+DECL(rank, float, c)
+
+DECL(sep_conv, byte, c)
+DECL(sep_conv, word, c)
+DECL(sep_conv, float, c)
+
 DECL(1d_conv_h, byte, c)
 DECL(1d_conv_h, word, c)
 DECL(1d_conv_h, float, c)
@@ -161,6 +173,38 @@ DECL_3x3(inflate, float, avx2)
 DECL_3x3(conv, byte, avx2)
 DECL_3x3(conv, word, avx2)
 DECL_3x3(conv, float, avx2)
+
+DECL_3x3(prewitt, byte, avx512)
+DECL_3x3(prewitt, word, avx512)
+DECL_3x3(prewitt, float, avx512)
+
+DECL_3x3(sobel, byte, avx512)
+DECL_3x3(sobel, word, avx512)
+DECL_3x3(sobel, float, avx512)
+
+DECL_3x3(min, byte, avx512)
+DECL_3x3(min, word, avx512)
+DECL_3x3(min, float, avx512)
+
+DECL_3x3(max, byte, avx512)
+DECL_3x3(max, word, avx512)
+DECL_3x3(max, float, avx512)
+
+DECL_3x3(median, byte, avx512)
+DECL_3x3(median, word, avx512)
+DECL_3x3(median, float, avx512)
+
+DECL_3x3(deflate, byte, avx512)
+DECL_3x3(deflate, word, avx512)
+DECL_3x3(deflate, float, avx512)
+
+DECL_3x3(inflate, byte, avx512)
+DECL_3x3(inflate, word, avx512)
+DECL_3x3(inflate, float, avx512)
+
+DECL_3x3(conv, byte, avx512)
+DECL_3x3(conv, word, avx512)
+DECL_3x3(conv, float, avx512)
 #endif /* VS_TARGET_CPU_X86 */
 
 #undef DECL_3x3
@@ -0,0 +1,78 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "../cpufeatures.h"
+#include "cpulevel.h"
+#include "half.h"
+
+void vs_half_to_float_c(const void *src, float *dst, unsigned n)
+{
+    const uint16_t *srcp = src;
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = vs_half_to_float(srcp[i]);
+    }
+}
+
+void vs_float_to_half_c(const float *src, void *dst, unsigned n)
+{
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        dstp[i] = vs_float_to_half(src[i]);
+    }
+}
+
+void vs_half_plane_to_float(float *dst, ptrdiff_t dst_stride, const void *src, ptrdiff_t src_stride, unsigned width, unsigned height, int cpulevel)
+{
+    void (*func)(const void *, float *, unsigned) = vs_half_to_float_c;
+    unsigned y;
+
+#ifdef VS_TARGET_CPU_X86
+    if (getCPUFeatures()->avx2 && getCPUFeatures()->f16c && cpulevel >= VS_CPU_LEVEL_AVX2)
+        func = vs_half_to_float_avx2;
+#else
+    (void)cpulevel;
+#endif
+
+    for (y = 0; y < height; y++) {
+        func((const uint8_t *)src + y * src_stride, (float *)((uint8_t *)dst + y * dst_stride), width);
+    }
+}
+
+void vs_float_plane_to_half(void *dst, ptrdiff_t dst_stride, const float *src, ptrdiff_t src_stride, unsigned width, unsigned height, int cpulevel)
+{
+    void (*func)(const float *, void *, unsigned) = vs_float_to_half_c;
+    unsigned y;
+
+#ifdef VS_TARGET_CPU_X86
+    if (getCPUFeatures()->avx2 && getCPUFeatures()->f16c && cpulevel >= VS_CPU_LEVEL_AVX2)
+        func = vs_float_to_half_avx2;
+#else
+    (void)cpulevel;
+#endif
+
+    for (y = 0; y < height; y++) {
+        func((const float *)((const uint8_t *)src + y * src_stride), (uint8_t *)dst + y * dst_stride, width);
+    }
+}
@@ -0,0 +1,99 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef HALF_H
+#define HALF_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The F16 kernels do their arithmetic in float and only convert when loading and storing, the C versions with
+ * the functions below and the x86 ones with F16C. Both round to nearest even so all versions give the same result.
+ */
+static inline float vs_half_to_float(uint16_t x)
+{
+    uint32_t sign = (uint32_t)(x & 0x8000) << 16;
+    uint32_t exponent = (x >> 10) & 0x1F;
+    uint32_t mantissa = x & 0x3FF;
+    uint32_t bits;
+    float f;
+
+    if (exponent == 0) {
+        f = ldexpf((float)mantissa, -24);
+        return sign ? -f : f;
+    } else if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static inline uint16_t vs_float_to_half(float f)
+{
+    uint32_t bits;
+    uint16_t sign;
+
+    memcpy(&bits, &f, sizeof(bits));
+    sign = (uint16_t)((bits >> 16) & 0x8000);
+    bits &= 0x7FFFFFFF;
+
+    if (bits >= 0x7F800000)
+        return sign | 0x7C00 | (bits > 0x7F800000 ? 0x200 : 0);
+    if (bits < 0x38800000) {
+        float a;
+        memcpy(&a, &bits, sizeof(a));
+        return sign | (uint16_t)nearbyintf(a * 16777216.0f);
+    }
+    if (bits >= 0x477FF000) /* rounds up to more than the largest half */
+        return sign | 0x7C00;
+    return sign | (uint16_t)((bits - 0x38000000 + 0xFFF + ((bits >> 13) & 1)) >> 13);
+}
+
+void vs_half_to_float_c(const void *src, float *dst, unsigned n);
+void vs_float_to_half_c(const float *src, void *dst, unsigned n);
+
+#ifdef VS_TARGET_CPU_X86
+void vs_half_to_float_avx2(const void *src, float *dst, unsigned n); /* needs F16C */
+void vs_float_to_half_avx2(const float *src, void *dst, unsigned n);
+#endif
+
+/*
+ * Whole planes for the filters that convert F16 input to float and run their float kernels on it,
+ * strides are in bytes. The fastest conversion allowed by cpulevel is used.
+ */
+void vs_half_plane_to_float(float *dst, ptrdiff_t dst_stride, const void *src, ptrdiff_t src_stride, unsigned width, unsigned height, int cpulevel);
+void vs_float_plane_to_half(void *dst, ptrdiff_t dst_stride, const float *src, ptrdiff_t src_stride, unsigned width, unsigned height, int cpulevel);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // HALF_H
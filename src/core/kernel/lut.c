@@ -0,0 +1,42 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "lut.h"
+
+#define LUT_C(src_name, src_type, dst_name, dst_type) \
+void vs_lut_##src_name##_##dst_name##_c(const void *src, void *dst, const void *lut, unsigned maxval, unsigned n) \
+{ \
+    const src_type *srcp = src; \
+    dst_type *dstp = dst; \
+    const dst_type *table = lut; \
+    unsigned i; \
+ \
+    for (i = 0; i < n; i++) { \
+        unsigned v = srcp[i]; \
+        dstp[i] = table[v < maxval ? v : maxval]; \
+    } \
+}
+
+LUT_C(byte, uint8_t, byte, uint8_t)
+LUT_C(byte, uint8_t, word, uint16_t)
+LUT_C(byte, uint8_t, float, float)
+LUT_C(word, uint16_t, byte, uint8_t)
+LUT_C(word, uint16_t, word, uint16_t)
+LUT_C(word, uint16_t, float, float)
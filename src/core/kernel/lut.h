@@ -0,0 +1,59 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef LUT_H
+#define LUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The gather based kernels load 4 bytes per entry so tables need this many readable bytes after their end. */
+#define VS_LUT_PADDING 4
+
+/* Input above maxval is clamped. Byte input always has 8 bits and a full table so the simd kernels skip that. */
+#define DECL_LUT(in, out, isa) void vs_lut_##in##_##out##_##isa(const void *src, void *dst, const void *lut, unsigned maxval, unsigned n);
+
+DECL_LUT(byte, byte, c)
+DECL_LUT(byte, word, c)
+DECL_LUT(byte, float, c)
+DECL_LUT(word, byte, c)
+DECL_LUT(word, word, c)
+DECL_LUT(word, float, c)
+
+#ifdef VS_TARGET_CPU_X86
+DECL_LUT(byte, byte, avx2)
+DECL_LUT(byte, word, avx2)
+DECL_LUT(byte, float, avx2)
+DECL_LUT(word, byte, avx2)
+DECL_LUT(word, word, avx2)
+DECL_LUT(word, float, avx2)
+#endif /* VS_TARGET_CPU_X86 */
+
+#undef DECL_LUT
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // LUT_H
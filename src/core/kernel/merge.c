@@ -19,6 +19,7 @@
 */
 
 #define VS_MERGE_IMPL
+#include "half.h"
 #include "merge.h"
 #include "VSHelper4.h"
 
@@ -104,6 +105,21 @@ void vs_premultiply_float_c(const void *src1, const void *src2, void *dst, unsig
 
 }
 
+void vs_premultiply_half_c(const void *src1, const void *src2, void *dst, unsigned depth, unsigned offset, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+    (void)offset;
+
+    for (i = 0; i < n; i++) {
+        dstp[i] = vs_float_to_half(vs_half_to_float(srcp1[i]) * vs_half_to_float(srcp2[i]));
+    }
+}
+
 void vs_merge_byte_c(const void *src1, const void *src2, void *dst, union vs_merge_weight weight, unsigned n)
 {
     const uint8_t *srcp1 = src1;
@@ -149,6 +165,21 @@ void vs_merge_float_c(const void *src1, const void *src2, void *dst, union vs_me
     }
 }
 
+void vs_merge_half_c(const void *src1, const void *src2, void *dst, union vs_merge_weight weight, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    uint16_t *dstp = dst;
+    float w = weight.f;
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        float v1 = vs_half_to_float(srcp1[i]);
+        float v2 = vs_half_to_float(srcp2[i]);
+        dstp[i] = vs_float_to_half(v1 + (v2 - v1) * w);
+    }
+}
+
 
 void vs_mask_merge_byte_c(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
 {
@@ -213,6 +244,24 @@ void vs_mask_merge_float_c(const void *src1, const void *src2, const void *mask,
     }
 }
 
+void vs_mask_merge_half_c(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    const uint16_t *maskp = mask;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+    (void)offset;
+
+    for (i = 0; i < n; i++) {
+        float v1 = vs_half_to_float(srcp1[i]);
+        float v2 = vs_half_to_float(srcp2[i]);
+        dstp[i] = vs_float_to_half(v1 + (v2 - v1) * vs_half_to_float(maskp[i]));
+    }
+}
+
 void vs_mask_merge_premul_byte_c(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
 {
     const uint8_t *srcp1 = src1;
@@ -271,6 +320,24 @@ void vs_mask_merge_premul_float_c(const void *src1, const void *src2, const void
     }
 }
 
+void vs_mask_merge_premul_half_c(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    const uint16_t *maskp = mask;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+    (void)offset;
+
+    for (i = 0; i < n; i++) {
+        float v1 = vs_half_to_float(srcp1[i]);
+        float v2 = vs_half_to_float(srcp2[i]);
+        dstp[i] = vs_float_to_half((1.0f - vs_half_to_float(maskp[i])) * v1 + v2);
+    }
+}
+
 void vs_makediff_byte_c(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
 {
     const uint8_t *srcp1 = src1;
@@ -319,6 +386,20 @@ void vs_makediff_float_c(const void *src1, const void *src2, void *dst, unsigned
     }
 }
 
+void vs_makediff_half_c(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+
+    for (i = 0; i < n; i++) {
+        dstp[i] = vs_float_to_half(vs_half_to_float(srcp1[i]) - vs_half_to_float(srcp2[i]));
+    }
+}
+
 void vs_mergediff_byte_c(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
 {
     const uint8_t *srcp1 = src1;
@@ -366,3 +447,60 @@ void vs_mergediff_float_c(const void *src1, const void *src2, void *dst, unsigne
         dstp[i] = srcp1[i] + srcp2[i];
     }
 }
+
+void vs_mergediff_half_c(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+
+    for (i = 0; i < n; i++) {
+        dstp[i] = vs_float_to_half(vs_half_to_float(srcp1[i]) + vs_half_to_float(srcp2[i]));
+    }
+}
+
+#define MASK_SUBSAMPLE_C(pixel, T, acc_t, L) \
+void vs_mask_subsample_##pixel##_c(const void * const rows[4], void *tmp, void *dst, unsigned n) \
+{ \
+    const T *r0 = rows[0]; \
+    const T *r1 = rows[1]; \
+    const T *r2 = rows[2]; \
+    const T *r3 = rows[3]; \
+    T *dstp = dst; \
+    unsigned i; \
+\
+    (void)tmp; \
+\
+    for (i = 0; i < n; i++) { \
+        unsigned c0 = i ? 2 * i - 1 : 0; \
+        unsigned c1 = 2 * i; \
+        unsigned c2 = 2 * i + 1; \
+        unsigned c3 = i < n - 1 ? 2 * i + 2 : 2 * n - 1; \
+        acc_t v0 = L(r0[c0]) + L(r3[c0]) + 3 * (L(r1[c0]) + L(r2[c0])); \
+        acc_t v1 = L(r0[c1]) + L(r3[c1]) + 3 * (L(r1[c1]) + L(r2[c1])); \
+        acc_t v2 = L(r0[c2]) + L(r3[c2]) + 3 * (L(r1[c2]) + L(r2[c2])); \
+        acc_t v3 = L(r0[c3]) + L(r3[c3]) + 3 * (L(r1[c3]) + L(r2[c3])); \
+        dstp[i] = MASK_SUBSAMPLE_STORE_##pixel((v0 + v3) + 3 * (v1 + v2)); \
+    } \
+}
+
+#define MASK_SUBSAMPLE_STORE_byte(x) (uint8_t)(((x) + 32) >> 6)
+#define MASK_SUBSAMPLE_STORE_word(x) (uint16_t)(((x) + 32) >> 6)
+#define MASK_SUBSAMPLE_STORE_float(x) ((x) * (1.0f / 64))
+#define MASK_SUBSAMPLE_STORE_half(x) vs_float_to_half((x) * (1.0f / 64))
+#define MASK_SUBSAMPLE_LOAD(x) (x)
+
+MASK_SUBSAMPLE_C(byte, uint8_t, unsigned, MASK_SUBSAMPLE_LOAD)
+MASK_SUBSAMPLE_C(word, uint16_t, unsigned, MASK_SUBSAMPLE_LOAD)
+MASK_SUBSAMPLE_C(float, float, float, MASK_SUBSAMPLE_LOAD)
+MASK_SUBSAMPLE_C(half, uint16_t, float, vs_half_to_float)
+
+#undef MASK_SUBSAMPLE_LOAD
+#undef MASK_SUBSAMPLE_STORE_half
+#undef MASK_SUBSAMPLE_STORE_float
+#undef MASK_SUBSAMPLE_STORE_word
+#undef MASK_SUBSAMPLE_STORE_byte
+#undef MASK_SUBSAMPLE_C
@@ -39,30 +39,47 @@ union vs_merge_weight {
 #define DECL_MASK_MERGE_PREMUL(pixel, isa) void vs_mask_merge_premul_##pixel##_##isa(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n);
 #define DECL_MAKEDIFF(pixel, isa) void vs_makediff_##pixel##_##isa(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n);
 #define DECL_MERGEDIFF(pixel, isa) void vs_mergediff_##pixel##_##isa(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n);
+/*
+ * Halves the width of a mask row with the bilinear taps 1 3 3 1 after combining the four rows with the
+ * same taps, edge samples are repeated. The rows have 2 * n samples, tmp is scratch space for at least
+ * 2 * n + 64 32-bit values and dst is written in whole vectors like the other kernels.
+ */
+#define DECL_MASK_SUBSAMPLE(pixel, isa) void vs_mask_subsample_##pixel##_##isa(const void * const rows[4], void *tmp, void *dst, unsigned n);
 
 DECL_PREMUL(byte, c)
 DECL_PREMUL(word, c)
 DECL_PREMUL(float, c)
+DECL_PREMUL(half, c)
 
 DECL_MERGE(byte, c)
 DECL_MERGE(word, c)
 DECL_MERGE(float, c)
+DECL_MERGE(half, c)
 
 DECL_MASK_MERGE(byte, c)
 DECL_MASK_MERGE(word, c)
 DECL_MASK_MERGE(float, c)
+DECL_MASK_MERGE(half, c)
 
 DECL_MASK_MERGE_PREMUL(byte, c)
 DECL_MASK_MERGE_PREMUL(word, c)
 DECL_MASK_MERGE_PREMUL(float, c)
+DECL_MASK_MERGE_PREMUL(half, c)
 
 DECL_MAKEDIFF(byte, c)
 DECL_MAKEDIFF(word, c)
 DECL_MAKEDIFF(float, c)
+DECL_MAKEDIFF(half, c)
 
 DECL_MERGEDIFF(byte, c)
 DECL_MERGEDIFF(word, c)
 DECL_MERGEDIFF(float, c)
+DECL_MERGEDIFF(half, c)
+
+DECL_MASK_SUBSAMPLE(byte, c)
+DECL_MASK_SUBSAMPLE(word, c)
+DECL_MASK_SUBSAMPLE(float, c)
+DECL_MASK_SUBSAMPLE(half, c)
 
 #ifdef VS_TARGET_CPU_X86
 DECL_MERGE(byte, sse2);
@@ -85,27 +102,67 @@ DECL_MERGEDIFF(byte, sse2)
 DECL_MERGEDIFF(word, sse2)
 DECL_MERGEDIFF(float, sse2)
 
+DECL_MASK_SUBSAMPLE(byte, sse2)
+DECL_MASK_SUBSAMPLE(word, sse2)
+DECL_MASK_SUBSAMPLE(float, sse2)
+
+DECL_PREMUL(half, avx2)
+
 DECL_MERGE(byte, avx2);
 DECL_MERGE(word, avx2);
 DECL_MERGE(float, avx2);
+DECL_MERGE(half, avx2);
 
 DECL_MASK_MERGE(byte, avx2)
 DECL_MASK_MERGE(word, avx2)
 DECL_MASK_MERGE(float, avx2)
+DECL_MASK_MERGE(half, avx2)
 
 DECL_MASK_MERGE_PREMUL(byte, avx2)
 DECL_MASK_MERGE_PREMUL(word, avx2)
 DECL_MASK_MERGE_PREMUL(float, avx2)
+DECL_MASK_MERGE_PREMUL(half, avx2)
 
 DECL_MAKEDIFF(byte, avx2)
 DECL_MAKEDIFF(word, avx2)
 DECL_MAKEDIFF(float, avx2)
+DECL_MAKEDIFF(half, avx2)
 
 DECL_MERGEDIFF(byte, avx2)
 DECL_MERGEDIFF(word, avx2)
 DECL_MERGEDIFF(float, avx2)
+DECL_MERGEDIFF(half, avx2)
+
+DECL_MASK_SUBSAMPLE(byte, avx2)
+DECL_MASK_SUBSAMPLE(word, avx2)
+DECL_MASK_SUBSAMPLE(float, avx2)
+
+DECL_MERGE(byte, avx512);
+DECL_MERGE(word, avx512);
+DECL_MERGE(float, avx512);
+
+DECL_MASK_MERGE(byte, avx512)
+DECL_MASK_MERGE(word, avx512)
+DECL_MASK_MERGE(float, avx512)
+
+DECL_MASK_MERGE_PREMUL(byte, avx512)
+DECL_MASK_MERGE_PREMUL(word, avx512)
+DECL_MASK_MERGE_PREMUL(float, avx512)
+
+DECL_MAKEDIFF(byte, avx512)
+DECL_MAKEDIFF(word, avx512)
+DECL_MAKEDIFF(float, avx512)
+
+DECL_MERGEDIFF(byte, avx512)
+DECL_MERGEDIFF(word, avx512)
+DECL_MERGEDIFF(float, avx512)
+
+DECL_MASK_SUBSAMPLE(byte, avx512)
+DECL_MASK_SUBSAMPLE(word, avx512)
+DECL_MASK_SUBSAMPLE(float, avx512)
 #endif /* VS_TARGET_CPU_X86 */
 
+#undef DECL_MASK_SUBSAMPLE
 #undef DECL_MERGEDIFF
 #undef DECL_MAKEDIFF
 #undef DECL_MASK_MERGE_PREMUL
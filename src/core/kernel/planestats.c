@@ -19,6 +19,7 @@
 */
 
 #include <limits.h>
+#include "half.h"
 #include "planestats.h"
 #include "VSHelper4.h"
 
@@ -91,6 +92,29 @@ void vs_plane_stats_1_float_c(union vs_plane_stats *stats, const void *src, ptrd
     stats->f.acc = facc;
 }
 
+void vs_plane_stats_1_half_c(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = src;
+    unsigned x, y;
+    float fmin = INFINITY;
+    float fmax = -INFINITY;
+    double facc = 0;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            float v = vs_half_to_float(((const uint16_t *)srcp)[x]);
+            fmin = VSMIN(fmin, v);
+            fmax = VSMAX(fmax, v);
+            facc += v;
+        }
+        srcp += stride;
+    }
+
+    stats->f.min = fmin;
+    stats->f.max = fmax;
+    stats->f.acc = facc;
+}
+
 void vs_plane_stats_2_byte_c(union vs_plane_stats *stats, const void *src1, ptrdiff_t src1_stride, const void *src2, ptrdiff_t src2_stride, unsigned width, unsigned height)
 {
     const uint8_t *srcp1 = src1;
@@ -171,4 +195,154 @@ void vs_plane_stats_2_float_c(union vs_plane_stats *stats, const void *src1, ptr
         srcp1 += src1_stride;
         srcp2 += src2_stride;
     }
+
+    stats->f.min = fmin;
+    stats->f.max = fmax;
+    stats->f.acc = facc;
+    stats->f.diffacc = fdiffacc;
+}
+
+void vs_plane_stats_2_half_c(union vs_plane_stats *stats, const void *src1, ptrdiff_t src1_stride, const void *src2, ptrdiff_t src2_stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp1 = src1;
+    const uint8_t *srcp2 = src2;
+    unsigned x, y;
+    float fmin = INFINITY;
+    float fmax = -INFINITY;
+    double facc = 0;
+    double fdiffacc = 0;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            float v = vs_half_to_float(((const uint16_t *)srcp1)[x]);
+            float t = vs_half_to_float(((const uint16_t *)srcp2)[x]);
+            fmin = VSMIN(fmin, v);
+            fmax = VSMAX(fmax, v);
+            facc += v;
+            fdiffacc += fabsf(v - t);
+        }
+        srcp1 += src1_stride;
+        srcp2 += src2_stride;
+    }
+
+    stats->f.min = fmin;
+    stats->f.max = fmax;
+    stats->f.acc = facc;
+    stats->f.diffacc = fdiffacc;
+}
+
+void vs_plane_stats_sq_byte_c(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = src;
+    unsigned x, y;
+    unsigned imin = UINT_MAX;
+    unsigned imax = 0;
+    uint64_t acc = 0;
+    uint64_t sqacc = 0;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            uint8_t v = srcp[x];
+            imin = VSMIN(imin, v);
+            imax = VSMAX(imax, v);
+            acc += v;
+            sqacc += (unsigned)v * v;
+        }
+        srcp += stride;
+    }
+
+    stats->i.min = imin;
+    stats->i.max = imax;
+    stats->i.acc = acc;
+    stats->i.sqacc = sqacc;
+}
+
+void vs_plane_stats_sq_word_c(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = src;
+    unsigned x, y;
+    unsigned imin = UINT_MAX;
+    unsigned imax = 0;
+    uint64_t acc = 0;
+    uint64_t sqacc = 0;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            uint16_t v = ((const uint16_t *)srcp)[x];
+            imin = VSMIN(imin, v);
+            imax = VSMAX(imax, v);
+            acc += v;
+            sqacc += (uint64_t)v * v;
+        }
+        srcp += stride;
+    }
+
+    stats->i.min = imin;
+    stats->i.max = imax;
+    stats->i.acc = acc;
+    stats->i.sqacc = sqacc;
+}
+
+void vs_plane_stats_sq_float_c(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = src;
+    unsigned x, y;
+    float fmin = INFINITY;
+    float fmax = -INFINITY;
+    double facc = 0;
+    double fsqacc = 0;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            float v = ((const float *)srcp)[x];
+            fmin = VSMIN(fmin, v);
+            fmax = VSMAX(fmax, v);
+            facc += v;
+            fsqacc += (double)v * v;
+        }
+        srcp += stride;
+    }
+
+    stats->f.min = fmin;
+    stats->f.max = fmax;
+    stats->f.acc = facc;
+    stats->f.sqacc = fsqacc;
+}
+
+void vs_plane_histogram_byte_c(uint32_t *hist, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    /* Consecutive samples often repeat, spreading them over several tables avoids stalling on the same counter. */
+    uint32_t part[4][256] = { { 0 } };
+    const uint8_t *srcp = src;
+    unsigned x, y, i;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x + 4 <= width; x += 4) {
+            part[0][srcp[x + 0]]++;
+            part[1][srcp[x + 1]]++;
+            part[2][srcp[x + 2]]++;
+            part[3][srcp[x + 3]]++;
+        }
+        for (; x < width; x++) {
+            part[0][srcp[x]]++;
+        }
+        srcp += stride;
+    }
+
+    for (i = 0; i < 256; i++) {
+        hist[i] += part[0][i] + part[1][i] + part[2][i] + part[3][i];
+    }
+}
+
+void vs_plane_histogram_word_c(uint32_t *hist, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = src;
+    unsigned x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            hist[((const uint16_t *)srcp)[x]]++;
+        }
+        srcp += stride;
+    }
 }
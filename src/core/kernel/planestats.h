@@ -34,6 +34,7 @@ union vs_plane_stats {
         unsigned max;
         uint64_t acc;
         uint64_t diffacc;
+        uint64_t sqacc;
     } i;
 
     struct {
@@ -41,19 +42,32 @@ union vs_plane_stats {
         float max;
         double acc;
         double diffacc;
+        double sqacc;
     } f;
 };
 
 #define DECL_1(pixel, isa) void vs_plane_stats_1_##pixel##_##isa(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height);
+#define DECL_SQ(pixel, isa) void vs_plane_stats_sq_##pixel##_##isa(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height);
 #define DECL_2(pixel, isa) void vs_plane_stats_2_##pixel##_##isa(union vs_plane_stats *stats, const void *src1, ptrdiff_t src1_stride, const void *src2, ptrdiff_t src2_stride, unsigned width, unsigned height);
 
 DECL_1(byte, c)
 DECL_1(word, c)
 DECL_1(float, c)
+DECL_1(half, c)
 
 DECL_2(byte, c)
 DECL_2(word, c)
 DECL_2(float, c)
+DECL_2(half, c)
+
+/* Min, max, sum and sum of squares. */
+DECL_SQ(byte, c)
+DECL_SQ(word, c)
+DECL_SQ(float, c)
+
+/* Adds the count of every sample value to hist, which must have room for the largest value. */
+void vs_plane_histogram_byte_c(uint32_t *hist, const void *src, ptrdiff_t stride, unsigned width, unsigned height);
+void vs_plane_histogram_word_c(uint32_t *hist, const void *src, ptrdiff_t stride, unsigned width, unsigned height);
 
 #ifdef VS_TARGET_CPU_X86
 DECL_1(byte, sse2)
@@ -64,16 +78,35 @@ DECL_2(byte, sse2)
 DECL_2(word, sse2)
 DECL_2(float, sse2)
 
+DECL_SQ(byte, sse2)
+DECL_SQ(word, sse2)
+DECL_SQ(float, sse2)
+
 DECL_1(byte, avx2)
 DECL_1(word, avx2)
 DECL_1(float, avx2)
+DECL_1(half, avx2) /* needs F16C */
 
 DECL_2(byte, avx2)
 DECL_2(word, avx2)
 DECL_2(float, avx2)
+DECL_2(half, avx2) /* needs F16C */
+
+DECL_SQ(byte, avx2)
+DECL_SQ(word, avx2)
+DECL_SQ(float, avx2)
+
+DECL_1(byte, avx512)
+DECL_1(word, avx512)
+DECL_1(float, avx512)
+
+DECL_2(byte, avx512)
+DECL_2(word, avx512)
+DECL_2(float, avx512)
 #endif /* VS_TARGET_CPU_X86 */
 
 #undef DECL_2
+#undef DECL_SQ
 #undef DECL_1
 
 #ifdef __cplusplus
@@ -0,0 +1,116 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <math.h>
+#include "pointops.h"
+
+#define POINTOPS_INT_C(pixel, T) \
+void vs_invert_##pixel##_c(const void *src, void *dst, union vs_pixel_value max, unsigned n) \
+{ \
+    const T *srcp = src; \
+    T *dstp = dst; \
+    unsigned i; \
+ \
+    for (i = 0; i < n; i++) { \
+        dstp[i] = max.u - (srcp[i] < max.u ? srcp[i] : max.u); \
+    } \
+} \
+ \
+void vs_limit_##pixel##_c(const void *src, void *dst, union vs_pixel_value min, union vs_pixel_value max, unsigned n) \
+{ \
+    const T *srcp = src; \
+    T *dstp = dst; \
+    unsigned i; \
+ \
+    for (i = 0; i < n; i++) { \
+        unsigned v = srcp[i] > min.u ? srcp[i] : min.u; \
+        dstp[i] = v < max.u ? v : max.u; \
+    } \
+} \
+ \
+void vs_binarize_##pixel##_c(const void *src, void *dst, union vs_pixel_value threshold, union vs_pixel_value v0, union vs_pixel_value v1, unsigned n) \
+{ \
+    const T *srcp = src; \
+    T *dstp = dst; \
+    unsigned i; \
+ \
+    for (i = 0; i < n; i++) { \
+        dstp[i] = srcp[i] < threshold.u ? v0.u : v1.u; \
+    } \
+}
+
+POINTOPS_INT_C(byte, uint8_t)
+POINTOPS_INT_C(word, uint16_t)
+
+#undef POINTOPS_INT_C
+
+void vs_invert_float_c(const void *src, void *dst, union vs_pixel_value max, unsigned n)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        dstp[i] = max.f - srcp[i];
+    }
+}
+
+void vs_limit_float_c(const void *src, void *dst, union vs_pixel_value min, union vs_pixel_value max, unsigned n)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        float v = min.f < srcp[i] ? srcp[i] : min.f;
+        dstp[i] = v < max.f ? v : max.f;
+    }
+}
+
+void vs_binarize_float_c(const void *src, void *dst, union vs_pixel_value threshold, union vs_pixel_value v0, union vs_pixel_value v1, unsigned n)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        dstp[i] = srcp[i] < threshold.f ? v0.f : v1.f;
+    }
+}
+
+void vs_levels_float_c(const void *src, void *dst, const struct vs_levels_params *params, unsigned n)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    float scale = params->scale_in * params->scale_out;
+
+    for (i = 0; i < n; i++) {
+        float x = srcp[i] < params->max_in ? srcp[i] : params->max_in;
+        x = x - params->min_in;
+        x = x > 0.0f ? x : 0.0f;
+
+        if (params->gamma == 1.0f)
+            dstp[i] = x * scale + params->min_out;
+        else
+            dstp[i] = powf(x * params->scale_in, params->gamma) * params->scale_out + params->min_out;
+    }
+}
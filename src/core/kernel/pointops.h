@@ -0,0 +1,110 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef POINTOPS_H
+#define POINTOPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Integer kernels use u, float kernels use f. */
+union vs_pixel_value {
+    unsigned u;
+    float f;
+};
+
+/* Integer Levels is done with the lut kernels, this is only for float. */
+struct vs_levels_params {
+    float min_in;
+    float max_in;
+    float min_out;
+    float scale_in;
+    float scale_out;
+    float gamma;
+};
+
+/*
+ * Invert computes max - min(x, max) for integers and max - x for float.
+ * Binarize returns v0 below the threshold and v1 otherwise.
+ */
+#define DECL_INVERT(pixel, isa) void vs_invert_##pixel##_##isa(const void *src, void *dst, union vs_pixel_value max, unsigned n);
+#define DECL_LIMIT(pixel, isa) void vs_limit_##pixel##_##isa(const void *src, void *dst, union vs_pixel_value min, union vs_pixel_value max, unsigned n);
+#define DECL_BINARIZE(pixel, isa) void vs_binarize_##pixel##_##isa(const void *src, void *dst, union vs_pixel_value threshold, union vs_pixel_value v0, union vs_pixel_value v1, unsigned n);
+/* The simd versions evaluate pow with a polynomial approximation and need gamma > 0. */
+#define DECL_LEVELS(pixel, isa) void vs_levels_##pixel##_##isa(const void *src, void *dst, const struct vs_levels_params *params, unsigned n);
+
+DECL_INVERT(byte, c)
+DECL_INVERT(word, c)
+DECL_INVERT(float, c)
+
+DECL_LIMIT(byte, c)
+DECL_LIMIT(word, c)
+DECL_LIMIT(float, c)
+
+DECL_BINARIZE(byte, c)
+DECL_BINARIZE(word, c)
+DECL_BINARIZE(float, c)
+
+DECL_LEVELS(float, c)
+
+#ifdef VS_TARGET_CPU_X86
+DECL_INVERT(byte, sse2)
+DECL_INVERT(word, sse2)
+DECL_INVERT(float, sse2)
+
+DECL_LIMIT(byte, sse2)
+DECL_LIMIT(word, sse2)
+DECL_LIMIT(float, sse2)
+
+DECL_BINARIZE(byte, sse2)
+DECL_BINARIZE(word, sse2)
+DECL_BINARIZE(float, sse2)
+
+DECL_LEVELS(float, sse2)
+
+DECL_INVERT(byte, avx2)
+DECL_INVERT(word, avx2)
+DECL_INVERT(float, avx2)
+
+DECL_LIMIT(byte, avx2)
+DECL_LIMIT(word, avx2)
+DECL_LIMIT(float, avx2)
+
+DECL_BINARIZE(byte, avx2)
+DECL_BINARIZE(word, avx2)
+DECL_BINARIZE(float, avx2)
+
+DECL_LEVELS(float, avx2)
+#endif /* VS_TARGET_CPU_X86 */
+
+#undef DECL_LEVELS
+#undef DECL_BINARIZE
+#undef DECL_LIMIT
+#undef DECL_INVERT
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // POINTOPS_H
@@ -37,6 +37,14 @@ void vs_transpose_plane_dword_c(const void * VS_RESTRICT src, ptrdiff_t src_stri
 void vs_transpose_plane_byte_sse2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
 void vs_transpose_plane_word_sse2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
 void vs_transpose_plane_dword_sse2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+
+void vs_transpose_plane_byte_avx2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+void vs_transpose_plane_word_avx2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+void vs_transpose_plane_dword_avx2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+
+void vs_transpose_plane_byte_avx512(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+void vs_transpose_plane_word_avx512(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
+void vs_transpose_plane_dword_avx512(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height);
 #endif
 
 /* Implementation details. */
@@ -49,6 +57,13 @@ void vs_transpose_plane_dword_sse2(const void * VS_RESTRICT src, ptrdiff_t src_s
 #define CACHELINE_SIZE_WORD (CACHELINE_SIZE / sizeof(uint16_t))
 #define CACHELINE_SIZE_DWORD (CACHELINE_SIZE / sizeof(uint32_t))
 
+/*
+ * Full cache line strips are transposed in square tiles of TILE_SIZE pixels so that only TILE_SIZE
+ * source and destination rows (usually one page each) are live at a time. Must be a multiple of all
+ * block widths and cache line sizes in pixels.
+ */
+#define TILE_SIZE 64U
+
 static void transpose_block_byte(const uint8_t * VS_RESTRICT src, ptrdiff_t src_stride, uint8_t * VS_RESTRICT dst, ptrdiff_t dst_stride);
 static void transpose_block_word(const uint16_t * VS_RESTRICT src, ptrdiff_t src_stride, uint16_t * VS_RESTRICT dst, ptrdiff_t dst_stride);
 static void transpose_block_dword(const uint32_t * VS_RESTRICT src, ptrdiff_t src_stride, uint32_t * VS_RESTRICT dst, ptrdiff_t dst_stride);
@@ -61,15 +76,25 @@ static void transpose_plane_byte(const void * VS_RESTRICT src, ptrdiff_t src_str
     unsigned width_floor = width - width % BLOCK_WIDTH_BYTE;
     unsigned height_floor = height - height % CACHELINE_SIZE_BYTE;
     unsigned height_floor2 = height - height % BLOCK_HEIGHT_BYTE;
-    unsigned i, j, ii;
+    unsigned i, j, ii, ti, tj;
 
-    for (i = 0; i < height_floor; i += CACHELINE_SIZE_BYTE) {
-        for (j = 0; j < width_floor; j += BLOCK_WIDTH_BYTE) {
-            /* Prioritize contiguous stores over contiguous loads. */
-            for (ii = i; ii < i + CACHELINE_SIZE_BYTE; ii += BLOCK_HEIGHT_BYTE) {
-                transpose_block_byte(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride);
+    for (ti = 0; ti < height_floor; ti += TILE_SIZE) {
+        unsigned ti_end = VSMIN(height_floor, ti + TILE_SIZE);
+
+        for (tj = 0; tj < width_floor; tj += TILE_SIZE) {
+            unsigned tj_end = VSMIN(width_floor, tj + TILE_SIZE);
+
+            for (i = ti; i < ti_end; i += CACHELINE_SIZE_BYTE) {
+                for (j = tj; j < tj_end; j += BLOCK_WIDTH_BYTE) {
+                    /* Prioritize contiguous stores over contiguous loads. */
+                    for (ii = i; ii < i + CACHELINE_SIZE_BYTE; ii += BLOCK_HEIGHT_BYTE) {
+                        transpose_block_byte(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride);
+                    }
+                }
             }
         }
+    }
+    for (i = 0; i < height_floor; i += CACHELINE_SIZE_BYTE) {
         for (j = width_floor; j < width; ++j) {
             for (ii = i; ii < i + CACHELINE_SIZE_BYTE; ++ii) {
                 *(ADD_OFFSET(dst_p, j * dst_stride) + ii) = *(ADD_OFFSET(src_p, ii * src_stride) + j);
@@ -101,15 +126,25 @@ static void transpose_plane_word(const void * VS_RESTRICT src, ptrdiff_t src_str
     unsigned width_floor = width - width % BLOCK_WIDTH_WORD;
     unsigned height_floor = height - height % CACHELINE_SIZE_WORD;
     unsigned height_floor2 = height - height % BLOCK_HEIGHT_WORD;
-    unsigned i, j, ii;
+    unsigned i, j, ii, ti, tj;
 
-    for (i = 0; i < height_floor; i += CACHELINE_SIZE_WORD) {
-        for (j = 0; j < width_floor; j += BLOCK_WIDTH_WORD) {
-            /* Prioritize contiguous stores over contiguous loads. */
-            for (ii = i; ii < i + CACHELINE_SIZE_WORD; ii += BLOCK_HEIGHT_WORD) {
-                transpose_block_word(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride);
+    for (ti = 0; ti < height_floor; ti += TILE_SIZE) {
+        unsigned ti_end = VSMIN(height_floor, ti + TILE_SIZE);
+
+        for (tj = 0; tj < width_floor; tj += TILE_SIZE) {
+            unsigned tj_end = VSMIN(width_floor, tj + TILE_SIZE);
+
+            for (i = ti; i < ti_end; i += CACHELINE_SIZE_WORD) {
+                for (j = tj; j < tj_end; j += BLOCK_WIDTH_WORD) {
+                    /* Prioritize contiguous stores over contiguous loads. */
+                    for (ii = i; ii < i + CACHELINE_SIZE_WORD; ii += BLOCK_HEIGHT_WORD) {
+                        transpose_block_word(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride);
+                    }
+                }
             }
         }
+    }
+    for (i = 0; i < height_floor; i += CACHELINE_SIZE_WORD) {
         for (j = width_floor; j < width; ++j) {
             for (ii = i; ii < i + CACHELINE_SIZE_WORD; ++ii) {
                 *(ADD_OFFSET(dst_p, j * dst_stride) + ii) = *(ADD_OFFSET(src_p, ii * src_stride) + j);
@@ -138,18 +173,28 @@ static void transpose_plane_dword(const void * VS_RESTRICT src, ptrdiff_t src_st
     const uint32_t *src_p = src;
     uint32_t *dst_p = dst;
 
-    unsigned width_floor = width - width % BLOCK_WIDTH_BYTE;
-    unsigned height_floor = height - height % CACHELINE_SIZE_BYTE;
-    unsigned height_floor2 = height - height % BLOCK_HEIGHT_BYTE;
-    unsigned i, j, ii;
+    unsigned width_floor = width - width % BLOCK_WIDTH_DWORD;
+    unsigned height_floor = height - height % CACHELINE_SIZE_DWORD;
+    unsigned height_floor2 = height - height % BLOCK_HEIGHT_DWORD;
+    unsigned i, j, ii, ti, tj;
 
-    for (i = 0; i < height_floor; i += CACHELINE_SIZE_DWORD) {
-        for (j = 0; j < width_floor; j += BLOCK_WIDTH_DWORD) {
-            /* Prioritize contiguous stores over contiguous loads. */
-            for (ii = i; ii < i + CACHELINE_SIZE_DWORD; ii += BLOCK_HEIGHT_DWORD) {
-                transpose_block_dword(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride);
+    for (ti = 0; ti < height_floor; ti += TILE_SIZE) {
+        unsigned ti_end = VSMIN(height_floor, ti + TILE_SIZE);
+
+        for (tj = 0; tj < width_floor; tj += TILE_SIZE) {
+            unsigned tj_end = VSMIN(width_floor, tj + TILE_SIZE);
+
+            for (i = ti; i < ti_end; i += CACHELINE_SIZE_DWORD) {
+                for (j = tj; j < tj_end; j += BLOCK_WIDTH_DWORD) {
+                    /* Prioritize contiguous stores over contiguous loads. */
+                    for (ii = i; ii < i + CACHELINE_SIZE_DWORD; ii += BLOCK_HEIGHT_DWORD) {
+                        transpose_block_dword(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride);
+                    }
+                }
             }
         }
+    }
+    for (i = 0; i < height_floor; i += CACHELINE_SIZE_DWORD) {
         for (j = width_floor; j < width; ++j) {
             for (ii = i; ii < i + CACHELINE_SIZE_DWORD; ++ii) {
                 *(ADD_OFFSET(dst_p, j * dst_stride) + ii) = *(ADD_OFFSET(src_p, ii * src_stride) + j);
@@ -0,0 +1,104 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <immintrin.h>
+#include "../audiomix.h"
+
+/* Samples are widened to double so the results match the C version apart from fma rounding. */
+static inline void audio_mix_load_int16(const void *p, unsigned i, __m256d *lo, __m256d *hi)
+{
+    __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)((const int16_t *)p + i)));
+    *lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(x));
+    *hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1));
+}
+
+static inline void audio_mix_load_int32(const void *p, unsigned i, __m256d *lo, __m256d *hi)
+{
+    *lo = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)((const int32_t *)p + i)));
+    *hi = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)((const int32_t *)p + i + 4)));
+}
+
+static inline void audio_mix_load_float(const void *p, unsigned i, __m256d *lo, __m256d *hi)
+{
+    *lo = _mm256_cvtps_pd(_mm_loadu_ps((const float *)p + i));
+    *hi = _mm256_cvtps_pd(_mm_loadu_ps((const float *)p + i + 4));
+}
+
+static inline __m128i audio_mix_cvt_int32(__m256d v)
+{
+    v = _mm256_max_pd(_mm256_min_pd(v, _mm256_set1_pd(INT32_MAX)), _mm256_set1_pd(INT32_MIN));
+    return _mm256_cvttpd_epi32(v);
+}
+
+static inline void audio_mix_store_int16(void *p, unsigned i, __m256d lo, __m256d hi)
+{
+    _mm_storeu_si128((__m128i *)((int16_t *)p + i), _mm_packs_epi32(audio_mix_cvt_int32(lo), audio_mix_cvt_int32(hi)));
+}
+
+static inline void audio_mix_store_int32(void *p, unsigned i, __m256d lo, __m256d hi)
+{
+    _mm256_storeu_si256((__m256i *)((int32_t *)p + i), _mm256_set_m128i(audio_mix_cvt_int32(hi), audio_mix_cvt_int32(lo)));
+}
+
+static inline void audio_mix_store_float(void *p, unsigned i, __m256d lo, __m256d hi)
+{
+    _mm256_storeu_ps((float *)p + i, _mm256_set_m128(_mm256_cvtpd_ps(hi), _mm256_cvtpd_ps(lo)));
+}
+
+static inline double audio_mix_clamp(double v, double lo, double hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+#define AUDIO_MIX_TAIL_int16(v) (int16_t)audio_mix_clamp(v, INT16_MIN, INT16_MAX)
+#define AUDIO_MIX_TAIL_int32(v) (int32_t)audio_mix_clamp(v, INT32_MIN, INT32_MAX)
+#define AUDIO_MIX_TAIL_float(v) (float)(v)
+
+#define AUDIO_MIX_AVX2(sample, type) \
+void vs_audio_mix_##sample##_avx2(const void * const *srcs, const double *weights, unsigned num_srcs, void *dst, unsigned n) \
+{ \
+    unsigned i, k; \
+ \
+    for (i = 0; i < (n & ~7U); i += 8) { \
+        __m256d accum_lo = _mm256_setzero_pd(); \
+        __m256d accum_hi = _mm256_setzero_pd(); \
+ \
+        for (k = 0; k < num_srcs; k++) { \
+            __m256d w = _mm256_broadcast_sd(weights + k); \
+            __m256d lo, hi; \
+            audio_mix_load_##sample(srcs[k], i, &lo, &hi); \
+            accum_lo = _mm256_fmadd_pd(lo, w, accum_lo); \
+            accum_hi = _mm256_fmadd_pd(hi, w, accum_hi); \
+        } \
+ \
+        audio_mix_store_##sample(dst, i, accum_lo, accum_hi); \
+    } \
+ \
+    for (; i < n; i++) { \
+        double tmp = 0; \
+        for (k = 0; k < num_srcs; k++) \
+            tmp += (double)((const type *)srcs[k])[i] * weights[k]; \
+        ((type *)dst)[i] = AUDIO_MIX_TAIL_##sample(tmp); \
+    } \
+}
+
+AUDIO_MIX_AVX2(int16, int16_t)
+AUDIO_MIX_AVX2(int32, int32_t)
+AUDIO_MIX_AVX2(float, float)
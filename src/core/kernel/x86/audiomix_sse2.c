@@ -0,0 +1,109 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <emmintrin.h>
+#include "../audiomix.h"
+
+/* Multiplies and adds separately in double so the results are identical to the C version. */
+static inline void audio_mix_load_int16(const void *p, unsigned i, __m128d *lo, __m128d *hi)
+{
+    __m128i x = _mm_loadl_epi64((const __m128i *)((const int16_t *)p + i));
+    x = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    *lo = _mm_cvtepi32_pd(x);
+    *hi = _mm_cvtepi32_pd(_mm_srli_si128(x, 8));
+}
+
+static inline void audio_mix_load_int32(const void *p, unsigned i, __m128d *lo, __m128d *hi)
+{
+    __m128i x = _mm_loadu_si128((const __m128i *)((const int32_t *)p + i));
+    *lo = _mm_cvtepi32_pd(x);
+    *hi = _mm_cvtepi32_pd(_mm_srli_si128(x, 8));
+}
+
+static inline void audio_mix_load_float(const void *p, unsigned i, __m128d *lo, __m128d *hi)
+{
+    __m128 x = _mm_loadu_ps((const float *)p + i);
+    *lo = _mm_cvtps_pd(x);
+    *hi = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+}
+
+static inline __m128i audio_mix_cvt_int32(__m128d lo, __m128d hi)
+{
+    lo = _mm_max_pd(_mm_min_pd(lo, _mm_set1_pd(INT32_MAX)), _mm_set1_pd(INT32_MIN));
+    hi = _mm_max_pd(_mm_min_pd(hi, _mm_set1_pd(INT32_MAX)), _mm_set1_pd(INT32_MIN));
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+
+static inline void audio_mix_store_int16(void *p, unsigned i, __m128d lo, __m128d hi)
+{
+    __m128i x = audio_mix_cvt_int32(lo, hi);
+    _mm_storel_epi64((__m128i *)((int16_t *)p + i), _mm_packs_epi32(x, x));
+}
+
+static inline void audio_mix_store_int32(void *p, unsigned i, __m128d lo, __m128d hi)
+{
+    _mm_storeu_si128((__m128i *)((int32_t *)p + i), audio_mix_cvt_int32(lo, hi));
+}
+
+static inline void audio_mix_store_float(void *p, unsigned i, __m128d lo, __m128d hi)
+{
+    _mm_storeu_ps((float *)p + i, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+}
+
+static inline double audio_mix_clamp(double v, double lo, double hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+#define AUDIO_MIX_TAIL_int16(v) (int16_t)audio_mix_clamp(v, INT16_MIN, INT16_MAX)
+#define AUDIO_MIX_TAIL_int32(v) (int32_t)audio_mix_clamp(v, INT32_MIN, INT32_MAX)
+#define AUDIO_MIX_TAIL_float(v) (float)(v)
+
+#define AUDIO_MIX_SSE2(sample, type) \
+void vs_audio_mix_##sample##_sse2(const void * const *srcs, const double *weights, unsigned num_srcs, void *dst, unsigned n) \
+{ \
+    unsigned i, k; \
+ \
+    for (i = 0; i < (n & ~3U); i += 4) { \
+        __m128d accum_lo = _mm_setzero_pd(); \
+        __m128d accum_hi = _mm_setzero_pd(); \
+ \
+        for (k = 0; k < num_srcs; k++) { \
+            __m128d w = _mm_set1_pd(weights[k]); \
+            __m128d lo, hi; \
+            audio_mix_load_##sample(srcs[k], i, &lo, &hi); \
+            accum_lo = _mm_add_pd(accum_lo, _mm_mul_pd(lo, w)); \
+            accum_hi = _mm_add_pd(accum_hi, _mm_mul_pd(hi, w)); \
+        } \
+ \
+        audio_mix_store_##sample(dst, i, accum_lo, accum_hi); \
+    } \
+ \
+    for (; i < n; i++) { \
+        double tmp = 0; \
+        for (k = 0; k < num_srcs; k++) \
+            tmp += (double)((const type *)srcs[k])[i] * weights[k]; \
+        ((type *)dst)[i] = AUDIO_MIX_TAIL_##sample(tmp); \
+    } \
+}
+
+AUDIO_MIX_SSE2(int16, int16_t)
+AUDIO_MIX_SSE2(int32, int32_t)
+AUDIO_MIX_SSE2(float, float)
@@ -0,0 +1,62 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <immintrin.h>
+#include "../audioresample.h"
+
+static inline float hsum_ps(__m256 x)
+{
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(lo);
+}
+
+void vs_audio_resample_avx2(const float *src, float *dst, const float *filters, unsigned taps, const unsigned *pos, const unsigned *phase, const float *frac, unsigned n)
+{
+    unsigned i, k;
+
+    for (i = 0; i < n; i++) {
+        const float *srcp = src + pos[i];
+        const float *h0 = filters + (size_t)phase[i] * taps;
+        __m256 accum0 = _mm256_setzero_ps();
+
+        if (frac[i]) {
+            const float *h1 = h0 + taps;
+            __m256 accum1 = _mm256_setzero_ps();
+            float d0, d1;
+
+            for (k = 0; k < taps; k += 8) {
+                __m256 x = _mm256_loadu_ps(srcp + k);
+                accum0 = _mm256_fmadd_ps(x, _mm256_loadu_ps(h0 + k), accum0);
+                accum1 = _mm256_fmadd_ps(x, _mm256_loadu_ps(h1 + k), accum1);
+            }
+
+            d0 = hsum_ps(accum0);
+            d1 = hsum_ps(accum1);
+            dst[i] = d0 + (d1 - d0) * frac[i];
+        } else {
+            for (k = 0; k < taps; k += 8)
+                accum0 = _mm256_fmadd_ps(_mm256_loadu_ps(srcp + k), _mm256_loadu_ps(h0 + k), accum0);
+
+            dst[i] = hsum_ps(accum0);
+        }
+    }
+}
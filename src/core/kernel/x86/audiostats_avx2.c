@@ -0,0 +1,92 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <math.h>
+#include <immintrin.h>
+#include "../audiostats.h"
+
+static inline float audio_stats_hmax(__m256 v)
+{
+    __m128 x = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_max_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_max_ss(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(x);
+}
+
+void vs_audio_peak_energy_avx2(const float *src, unsigned n, float *peak, double *sumsq)
+{
+    const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 m = _mm256_set1_ps(*peak);
+    __m256d s0 = _mm256_setzero_pd();
+    __m256d s1 = _mm256_setzero_pd();
+    __m128d s2;
+    double s;
+    float mf;
+    unsigned i;
+
+    for (i = 0; i < (n & ~7U); i += 8) {
+        __m256 x = _mm256_loadu_ps(src + i);
+        __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(x));
+        __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1));
+        m = _mm256_max_ps(m, _mm256_and_ps(x, absmask));
+        s0 = _mm256_fmadd_pd(lo, lo, s0);
+        s1 = _mm256_fmadd_pd(hi, hi, s1);
+    }
+
+    s0 = _mm256_add_pd(s0, s1);
+    s2 = _mm_add_pd(_mm256_castpd256_pd128(s0), _mm256_extractf128_pd(s0, 1));
+    s = _mm_cvtsd_f64(_mm_add_sd(s2, _mm_unpackhi_pd(s2, s2)));
+    mf = audio_stats_hmax(m);
+
+    for (; i < n; i++) {
+        mf = fabsf(src[i]) > mf ? fabsf(src[i]) : mf;
+        s += (double)src[i] * src[i];
+    }
+
+    *peak = mf;
+    *sumsq += s;
+}
+
+/* Every phase is filtered for eight consecutive samples at a time, the results match the C version apart from fma rounding. */
+void vs_audio_true_peak_avx2(const float *src, unsigned n, float *peak)
+{
+    const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 m = _mm256_set1_ps(*peak);
+    float mf;
+    unsigned i, p, k;
+
+    for (i = 0; i < (n & ~7U); i += 8) {
+        __m256 accum[4] = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+
+        for (k = 0; k < VS_AUDIO_TRUE_PEAK_TAPS; k++) {
+            __m256 x = _mm256_loadu_ps(src + (int)i - (int)k);
+            for (p = 0; p < 4; p++)
+                accum[p] = _mm256_fmadd_ps(_mm256_set1_ps(vs_audio_true_peak_coeffs[k][p]), x, accum[p]);
+        }
+
+        for (p = 0; p < 4; p++)
+            m = _mm256_max_ps(m, _mm256_and_ps(accum[p], absmask));
+    }
+
+    mf = audio_stats_hmax(m);
+    if (i < n)
+        vs_audio_true_peak_c(src + i, n - i, &mf);
+    *peak = mf;
+}
@@ -0,0 +1,89 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <math.h>
+#include <emmintrin.h>
+#include "../audiostats.h"
+
+static inline float audio_stats_hmax(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_max_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+void vs_audio_peak_energy_sse2(const float *src, unsigned n, float *peak, double *sumsq)
+{
+    const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 m = _mm_set1_ps(*peak);
+    __m128d s0 = _mm_setzero_pd();
+    __m128d s1 = _mm_setzero_pd();
+    double s;
+    float mf;
+    unsigned i;
+
+    for (i = 0; i < (n & ~3U); i += 4) {
+        __m128 x = _mm_loadu_ps(src + i);
+        __m128d lo = _mm_cvtps_pd(x);
+        __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+        m = _mm_max_ps(m, _mm_and_ps(x, absmask));
+        s0 = _mm_add_pd(s0, _mm_mul_pd(lo, lo));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(hi, hi));
+    }
+
+    s0 = _mm_add_pd(s0, s1);
+    s = _mm_cvtsd_f64(_mm_add_sd(s0, _mm_unpackhi_pd(s0, s0)));
+    mf = audio_stats_hmax(m);
+
+    for (; i < n; i++) {
+        mf = fabsf(src[i]) > mf ? fabsf(src[i]) : mf;
+        s += (double)src[i] * src[i];
+    }
+
+    *peak = mf;
+    *sumsq += s;
+}
+
+/* Every phase is filtered for four consecutive samples at a time, the products are summed in the same order as in the C version. */
+void vs_audio_true_peak_sse2(const float *src, unsigned n, float *peak)
+{
+    const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 m = _mm_set1_ps(*peak);
+    float mf;
+    unsigned i, p, k;
+
+    for (i = 0; i < (n & ~3U); i += 4) {
+        __m128 accum[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+
+        for (k = 0; k < VS_AUDIO_TRUE_PEAK_TAPS; k++) {
+            __m128 x = _mm_loadu_ps(src + (int)i - (int)k);
+            for (p = 0; p < 4; p++)
+                accum[p] = _mm_add_ps(accum[p], _mm_mul_ps(_mm_set1_ps(vs_audio_true_peak_coeffs[k][p]), x));
+        }
+
+        for (p = 0; p < 4; p++)
+            m = _mm_max_ps(m, _mm_and_ps(accum[p], absmask));
+    }
+
+    mf = audio_stats_hmax(m);
+    if (i < n)
+        vs_audio_true_peak_c(src + i, n - i, &mf);
+    *peak = mf;
+}
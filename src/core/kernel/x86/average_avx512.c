@@ -0,0 +1,277 @@
+#include <assert.h>
+#include <stdint.h>
+#include <immintrin.h>
+#include "VSHelper4.h"
+#include "../average.h"
+
+static void load_int_srcs(const uint8_t **srcs, const void * const *srcs_, unsigned num_srcs)
+{
+	unsigned i;
+
+	assert(num_srcs <= 32);
+
+	for (i = 0; i < num_srcs; ++i) {
+		srcs[i] = srcs_[i];
+	}
+	if (num_srcs % 2)
+		srcs[num_srcs] = srcs[num_srcs - 1];
+}
+
+static void load_int_weights(__m512i mm_weights[16], const int *iweights, unsigned num_weights)
+{
+	unsigned i;
+
+	for (i = 0; i < 16; ++i) {
+		mm_weights[i] = _mm512_setzero_si512();
+	}
+	for (i = 0; i < (num_weights & ~1); i += 2) {
+		int16_t lo = iweights[i + 0];
+		int16_t hi = iweights[i + 1];
+		uint32_t coeff = ((uint32_t)(uint16_t)hi) << 16 | (uint16_t)lo;
+		mm_weights[i / 2] = _mm512_set1_epi32(coeff);
+	}
+	if (num_weights % 2)
+		mm_weights[num_weights / 2] = _mm512_set1_epi32((uint16_t)iweights[num_weights - 1]);
+}
+
+/* The last vector of a row is loaded and stored with a mask, nothing past w is touched. */
+static __mmask32 tail_mask32(unsigned n)
+{
+	return n >= 32 ? ~(__mmask32)0 : ((__mmask32)1 << n) - 1;
+}
+
+static __mmask16 tail_mask16(unsigned n)
+{
+	return n >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1U << n) - 1);
+}
+
+static __m512i scale_epi32(__m512i x, __m512 scale)
+{
+	return _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps(x), scale));
+}
+
+void vs_average_plane_byte_luma_avx512(const void *weights_, const void * const *srcs_, unsigned num_srcs, void *dst_, const void *scale_, unsigned depth, unsigned w, unsigned h, ptrdiff_t stride)
+{
+	const uint8_t *srcs[32];
+	__m512i weights[16];
+	__m512 scale = _mm512_set1_ps(1.0f / *(const int *)scale_);
+	ptrdiff_t offset = 0;
+	unsigned i, j, k;
+
+	load_int_srcs(srcs, srcs_, num_srcs);
+	load_int_weights(weights, weights_, num_srcs);
+
+	for (i = 0; i < h; ++i) {
+		uint8_t *dst = (uint8_t *)dst_ + offset;
+
+		for (j = 0; j < w; j += 32) {
+			__mmask32 m = tail_mask32(w - j);
+			__m512i lo = _mm512_setzero_si512();
+			__m512i hi = _mm512_setzero_si512();
+
+			for (k = 0; k < num_srcs; k += 2) {
+				const uint8_t *ptr1 = srcs[k + 0] + offset;
+				const uint8_t *ptr2 = srcs[k + 1] + offset;
+
+				__m512i coeffs = weights[k / 2];
+				__m512i v1 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, ptr1 + j));
+				__m512i v2 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, ptr2 + j));
+
+				lo = _mm512_add_epi32(lo, _mm512_madd_epi16(coeffs, _mm512_unpacklo_epi16(v1, v2)));
+				hi = _mm512_add_epi32(hi, _mm512_madd_epi16(coeffs, _mm512_unpackhi_epi16(v1, v2)));
+			}
+
+			lo = scale_epi32(lo, scale);
+			hi = scale_epi32(hi, scale);
+
+			lo = _mm512_max_epi16(_mm512_packs_epi32(lo, hi), _mm512_setzero_si512());
+			_mm256_mask_storeu_epi8(dst + j, m, _mm512_cvtusepi16_epi8(lo));
+		}
+
+		offset += stride;
+	}
+}
+
+void vs_average_plane_byte_chroma_avx512(const void *weights_, const void * const *srcs_, unsigned num_srcs, void *dst_, const void *scale_, unsigned depth, unsigned w, unsigned h, ptrdiff_t stride)
+{
+	const uint8_t *srcs[32];
+	__m512i weights[16];
+	__m512 scale = _mm512_set1_ps(1.0f / *(const int *)scale_);
+	__m512i bias_i16 = _mm512_set1_epi16(128);
+	__m256i bias_i8 = _mm256_set1_epi8(128);
+	ptrdiff_t offset = 0;
+	unsigned i, j, k;
+
+	load_int_srcs(srcs, srcs_, num_srcs);
+	load_int_weights(weights, weights_, num_srcs);
+
+	for (i = 0; i < h; ++i) {
+		uint8_t *dst = (uint8_t *)dst_ + offset;
+
+		for (j = 0; j < w; j += 32) {
+			__mmask32 m = tail_mask32(w - j);
+			__m512i lo = _mm512_setzero_si512();
+			__m512i hi = _mm512_setzero_si512();
+
+			for (k = 0; k < num_srcs; k += 2) {
+				const uint8_t *ptr1 = srcs[k + 0] + offset;
+				const uint8_t *ptr2 = srcs[k + 1] + offset;
+
+				__m512i coeffs = weights[k / 2];
+				__m512i v1 = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, ptr1 + j)), bias_i16);
+				__m512i v2 = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, ptr2 + j)), bias_i16);
+
+				lo = _mm512_add_epi32(lo, _mm512_madd_epi16(coeffs, _mm512_unpacklo_epi16(v1, v2)));
+				hi = _mm512_add_epi32(hi, _mm512_madd_epi16(coeffs, _mm512_unpackhi_epi16(v1, v2)));
+			}
+
+			lo = scale_epi32(lo, scale);
+			hi = scale_epi32(hi, scale);
+
+			lo = _mm512_packs_epi32(lo, hi);
+			_mm256_mask_storeu_epi8(dst + j, m, _mm256_add_epi8(_mm512_cvtsepi16_epi8(lo), bias_i8));
+		}
+
+		offset += stride;
+	}
+}
+
+void vs_average_plane_word_luma_avx512(const void *weights_, const void * const *srcs_, unsigned num_srcs, void *dst_, const void *scale_, unsigned depth, unsigned w, unsigned h, ptrdiff_t stride)
+{
+	const uint8_t *srcs[32];
+	__m512i weights[16];
+	__m512 scale = _mm512_set1_ps(1.0f / *(const int *)scale_);
+	__m512i maxval = _mm512_add_epi16(_mm512_set1_epi16((1U << depth) - 1), _mm512_set1_epi16(INT16_MIN));
+	__m512i accum_bias = _mm512_setzero_si512();
+	ptrdiff_t offset = 0;
+	unsigned i, j, k;
+
+	load_int_srcs(srcs, srcs_, num_srcs);
+	load_int_weights(weights, weights_, num_srcs);
+
+	/* sum(weights * int16_min) */
+	for (unsigned i = 0; i < num_srcs; i += 2) {
+		accum_bias = _mm512_add_epi32(accum_bias, _mm512_madd_epi16(_mm512_set1_epi16(INT16_MIN), weights[i / 2]));
+	}
+
+	for (i = 0; i < h; ++i) {
+		uint16_t *dst = (uint16_t *)((uint8_t *)dst_ + offset);
+
+		for (j = 0; j < w; j += 32) {
+			__mmask32 m = tail_mask32(w - j);
+			__m512i lo = _mm512_setzero_si512();
+			__m512i hi = _mm512_setzero_si512();
+
+			for (k = 0; k < num_srcs; k += 2) {
+				const uint16_t *ptr1 = (const uint16_t *)(srcs[k + 0] + offset);
+				const uint16_t *ptr2 = (const uint16_t *)(srcs[k + 1] + offset);
+
+				__m512i coeffs = weights[k / 2];
+				__m512i v1 = _mm512_add_epi16(_mm512_maskz_loadu_epi16(m, ptr1 + j), _mm512_set1_epi16(INT16_MIN));
+				__m512i v2 = _mm512_add_epi16(_mm512_maskz_loadu_epi16(m, ptr2 + j), _mm512_set1_epi16(INT16_MIN));
+
+				lo = _mm512_add_epi32(lo, _mm512_madd_epi16(coeffs, _mm512_unpacklo_epi16(v1, v2)));
+				hi = _mm512_add_epi32(hi, _mm512_madd_epi16(coeffs, _mm512_unpackhi_epi16(v1, v2)));
+			}
+			lo = _mm512_sub_epi32(lo, accum_bias);
+			hi = _mm512_sub_epi32(hi, accum_bias);
+
+			lo = scale_epi32(lo, scale);
+			hi = scale_epi32(hi, scale);
+
+			lo = _mm512_add_epi32(lo, _mm512_set1_epi32(INT16_MIN));
+			hi = _mm512_add_epi32(hi, _mm512_set1_epi32(INT16_MIN));
+			lo = _mm512_packs_epi32(lo, hi);
+
+			lo = _mm512_min_epi16(lo, maxval);
+			lo = _mm512_sub_epi16(lo, _mm512_set1_epi16(INT16_MIN));
+
+			_mm512_mask_storeu_epi16(dst + j, m, lo);
+		}
+
+		offset += stride;
+	}
+}
+
+void vs_average_plane_word_chroma_avx512(const void *weights_, const void * const *srcs_, unsigned num_srcs, void *dst_, const void *scale_, unsigned depth, unsigned w, unsigned h, ptrdiff_t stride)
+{
+	const uint8_t *srcs[32];
+	__m512i weights[16];
+	__m512 scale = _mm512_set1_ps(1.0f / *(const int *)scale_);
+	__m512i bias = _mm512_set1_epi16(1U << (depth - 1));
+	__m512i minval = _mm512_sub_epi16(_mm512_setzero_si512(), bias);
+	__m512i maxval = _mm512_sub_epi16(_mm512_set1_epi16((1U << depth) - 1), bias);
+	ptrdiff_t offset = 0;
+	unsigned i, j, k;
+
+	load_int_srcs(srcs, srcs_, num_srcs);
+	load_int_weights(weights, weights_, num_srcs);
+
+	for (i = 0; i < h; ++i) {
+		uint16_t *dst = (uint16_t *)((uint8_t *)dst_ + offset);
+
+		for (j = 0; j < w; j += 32) {
+			__mmask32 m = tail_mask32(w - j);
+			__m512i lo = _mm512_setzero_si512();
+			__m512i hi = _mm512_setzero_si512();
+
+			for (k = 0; k < num_srcs; k += 2) {
+				const uint16_t *ptr1 = (const uint16_t *)(srcs[k + 0] + offset);
+				const uint16_t *ptr2 = (const uint16_t *)(srcs[k + 1] + offset);
+
+				__m512i coeffs = weights[k / 2];
+				__m512i v1 = _mm512_sub_epi16(_mm512_maskz_loadu_epi16(m, ptr1 + j), bias);
+				__m512i v2 = _mm512_sub_epi16(_mm512_maskz_loadu_epi16(m, ptr2 + j), bias);
+
+				lo = _mm512_add_epi32(lo, _mm512_madd_epi16(coeffs, _mm512_unpacklo_epi16(v1, v2)));
+				hi = _mm512_add_epi32(hi, _mm512_madd_epi16(coeffs, _mm512_unpackhi_epi16(v1, v2)));
+			}
+
+			lo = scale_epi32(lo, scale);
+			hi = scale_epi32(hi, scale);
+			lo = _mm512_packs_epi32(lo, hi);
+
+			lo = _mm512_max_epi16(lo, minval);
+			lo = _mm512_min_epi16(lo, maxval);
+			lo = _mm512_add_epi16(lo, bias);
+
+			_mm512_mask_storeu_epi16(dst + j, m, lo);
+		}
+
+		offset += stride;
+	}
+}
+
+void vs_average_plane_float_avx512(const void *weights_, const void * const *srcs, unsigned num_srcs, void *dst_, const void *scale_, unsigned depth, unsigned w, unsigned h, ptrdiff_t stride)
+{
+	__m512 weights[32];
+	__m512 scale = _mm512_set1_ps(1.0f / *(const float *)scale_);
+	ptrdiff_t offset = 0;
+	unsigned i, j, k;
+
+	assert(num_srcs <= 32);
+
+	for (i = 0; i < num_srcs; ++i) {
+		weights[i] = _mm512_set1_ps(((const float *)weights_)[i]);
+	}
+
+	for (i = 0; i < h; ++i) {
+		float *dst = (float *)((uint8_t *)dst_ + offset);
+
+		for (j = 0; j < w; j += 16) {
+			__mmask16 m = tail_mask16(w - j);
+			__m512 accum = _mm512_setzero_ps();
+
+			for (k = 0; k < num_srcs; ++k) {
+				const float *ptr = (const float *)((const uint8_t *)srcs[k] + offset);
+				__m512 val = _mm512_maskz_loadu_ps(m, ptr + j);
+				accum = _mm512_fmadd_ps(val, weights[k], accum);
+			}
+
+			accum = _mm512_mul_ps(accum, scale);
+			_mm512_mask_storeu_ps(dst + j, m, accum);
+		}
+
+		offset += stride;
+	}
+}
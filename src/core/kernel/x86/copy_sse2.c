@@ -0,0 +1,55 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include <emmintrin.h>
+#include "../copy.h"
+
+void vs_copy_plane_stream_sse2(void *dst, ptrdiff_t dst_stride, const void *src, ptrdiff_t src_stride, size_t row_size, size_t height)
+{
+    const uint8_t *srcp = src;
+    uint8_t *dstp = dst;
+    size_t i;
+
+    if (src_stride == dst_stride && src_stride == (ptrdiff_t)row_size) {
+        row_size *= height;
+        height = 1;
+    }
+
+    for (i = 0; i < height; i++) {
+        size_t head = (16 - ((uintptr_t)dstp & 15)) & 15;
+        size_t x;
+
+        if (head > row_size)
+            head = row_size;
+        memcpy(dstp, srcp, head);
+
+        for (x = head; x + 16 <= row_size; x += 16)
+            _mm_stream_si128((__m128i *)(dstp + x), _mm_loadu_si128((const __m128i *)(srcp + x)));
+
+        memcpy(dstp + x, srcp + x, row_size - x);
+
+        srcp += src_stride;
+        dstp += dst_stride;
+    }
+
+    /* streaming stores are weakly ordered, they have to be visible before the destination is handed on */
+    _mm_sfence();
+}
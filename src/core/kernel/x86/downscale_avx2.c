@@ -0,0 +1,201 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdint.h>
+#include <immintrin.h>
+#include "../downscale.h"
+
+/*
+ * Same scheme as the sse2 version. The packs and shuffles work within 128 bit lanes, so after
+ * every pairwise step the quadwords are put back in order with a cross lane permute.
+ */
+
+#define ORDER_QWORDS _MM_SHUFFLE(3, 1, 2, 0)
+
+static inline void box_downscale_byte(const uint8_t *srcp, ptrdiff_t stride, uint8_t *dstp, unsigned factor, unsigned shift, unsigned width, unsigned *done)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i round = _mm256_set1_epi16(1 << (shift - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    unsigned x, i, j, n;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m256i v[8];
+
+        for (j = 0; j < factor; j++)
+            v[j] = _mm256_setzero_si256();
+
+        for (i = 0; i < factor; i++) {
+            const uint8_t *row = srcp + i * stride + x * factor;
+            for (j = 0; j < factor; j++)
+                v[j] = _mm256_add_epi16(v[j], _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(row + j * 16))));
+        }
+
+        for (n = factor; n > 1; n /= 2) {
+            for (j = 0; j < n / 2; j++) {
+                __m256i sums = _mm256_packs_epi32(_mm256_madd_epi16(v[2 * j], ones), _mm256_madd_epi16(v[2 * j + 1], ones));
+                v[j] = _mm256_permute4x64_epi64(sums, ORDER_QWORDS);
+            }
+        }
+
+        v[0] = _mm256_srl_epi16(_mm256_add_epi16(v[0], round), count);
+        v[0] = _mm256_permute4x64_epi64(_mm256_packus_epi16(v[0], v[0]), ORDER_QWORDS);
+        _mm_storeu_si128((__m128i *)(dstp + x), _mm256_castsi256_si128(v[0]));
+    }
+
+    *done = x;
+}
+
+static inline __m256 pairwise_add_ps(__m256 a, __m256 b)
+{
+    __m256 sums = _mm256_add_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sums), ORDER_QWORDS));
+}
+
+static inline __m256i pairwise_add_epi32(__m256i a, __m256i b)
+{
+    __m256 fa = _mm256_castsi256_ps(a);
+    __m256 fb = _mm256_castsi256_ps(b);
+    __m256i sums = _mm256_add_epi32(_mm256_castps_si256(_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0))), _mm256_castps_si256(_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1))));
+    return _mm256_permute4x64_epi64(sums, ORDER_QWORDS);
+}
+
+static inline void box_downscale_word(const uint8_t *srcp, ptrdiff_t stride, uint16_t *dstp, unsigned factor, unsigned shift, unsigned width, unsigned *done)
+{
+    const __m256i round = _mm256_set1_epi32(1 << (shift - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    unsigned x, i, j, n;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+        __m256i v[8];
+
+        for (j = 0; j < factor; j++)
+            v[j] = _mm256_setzero_si256();
+
+        for (i = 0; i < factor; i++) {
+            const uint16_t *row = (const uint16_t *)(srcp + i * stride) + x * factor;
+            for (j = 0; j < factor; j++)
+                v[j] = _mm256_add_epi32(v[j], _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(row + j * 8))));
+        }
+
+        for (n = factor; n > 1; n /= 2) {
+            for (j = 0; j < n / 2; j++)
+                v[j] = pairwise_add_epi32(v[2 * j], v[2 * j + 1]);
+        }
+
+        v[0] = _mm256_srl_epi32(_mm256_add_epi32(v[0], round), count);
+        v[0] = _mm256_permute4x64_epi64(_mm256_packus_epi32(v[0], v[0]), ORDER_QWORDS);
+        _mm_storeu_si128((__m128i *)(dstp + x), _mm256_castsi256_si128(v[0]));
+    }
+
+    *done = x;
+}
+
+static inline __m256 load_half(const uint16_t *p)
+{
+    return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)p));
+}
+
+static inline __m256 load_float(const float *p)
+{
+    return _mm256_loadu_ps(p);
+}
+
+#define BOX_DOWNSCALE_FLOAT(pixel, T, STORE) \
+static inline void box_downscale_##pixel(const uint8_t *srcp, ptrdiff_t stride, T *dstp, unsigned factor, unsigned width, unsigned *done) \
+{ \
+    const __m256 scale = _mm256_set1_ps(1.0f / (factor * factor)); \
+    unsigned x, i, j, n; \
+  \
+    for (x = 0; x + 8 <= width; x += 8) { \
+        __m256 v[8]; \
+  \
+        for (j = 0; j < factor; j++) \
+            v[j] = _mm256_setzero_ps(); \
+  \
+        for (i = 0; i < factor; i++) { \
+            const T *row = (const T *)(srcp + i * stride) + x * factor; \
+            for (j = 0; j < factor; j++) \
+                v[j] = _mm256_add_ps(v[j], load_##pixel(row + j * 8)); \
+        } \
+  \
+        for (n = factor; n > 1; n /= 2) { \
+            for (j = 0; j < n / 2; j++) \
+                v[j] = pairwise_add_ps(v[2 * j], v[2 * j + 1]); \
+        } \
+  \
+        STORE(dstp + x, _mm256_mul_ps(v[0], scale)); \
+    } \
+  \
+    *done = x; \
+}
+
+#define STORE_HALF(p, v) _mm_storeu_si128((__m128i *)(p), _mm256_cvtps_ph((v), _MM_FROUND_TO_NEAREST_INT))
+
+BOX_DOWNSCALE_FLOAT(half, uint16_t, STORE_HALF)
+BOX_DOWNSCALE_FLOAT(float, float, _mm256_storeu_ps)
+
+#undef STORE_HALF
+#undef BOX_DOWNSCALE_FLOAT
+
+#define BOX_DOWNSCALE_INT(pixel, T) \
+void vs_box_downscale_##pixel##_avx2(const void *src, ptrdiff_t src_stride, void *dst, unsigned factor, unsigned width) \
+{ \
+    const T *srcp = src; \
+    T *dstp = dst; \
+    unsigned x = 0; \
+  \
+    switch (factor) { \
+    case 2: box_downscale_##pixel(src, src_stride, dstp, 2, 2, width, &x); break; \
+    case 4: box_downscale_##pixel(src, src_stride, dstp, 4, 4, width, &x); break; \
+    case 8: box_downscale_##pixel(src, src_stride, dstp, 8, 6, width, &x); break; \
+    } \
+  \
+    if (x < width) \
+        vs_box_downscale_##pixel##_c(srcp + x * factor, src_stride, dstp + x, factor, width - x); \
+}
+
+BOX_DOWNSCALE_INT(byte, uint8_t)
+BOX_DOWNSCALE_INT(word, uint16_t)
+
+#undef BOX_DOWNSCALE_INT
+
+#define BOX_DOWNSCALE_FLOAT(pixel, T) \
+void vs_box_downscale_##pixel##_avx2(const void *src, ptrdiff_t src_stride, void *dst, unsigned factor, unsigned width) \
+{ \
+    const T *srcp = src; \
+    T *dstp = dst; \
+    unsigned x = 0; \
+  \
+    switch (factor) { \
+    case 2: box_downscale_##pixel(src, src_stride, dstp, 2, width, &x); break; \
+    case 4: box_downscale_##pixel(src, src_stride, dstp, 4, width, &x); break; \
+    case 8: box_downscale_##pixel(src, src_stride, dstp, 8, width, &x); break; \
+    } \
+  \
+    if (x < width) \
+        vs_box_downscale_##pixel##_c(srcp + x * factor, src_stride, dstp + x, factor, width - x); \
+}
+
+BOX_DOWNSCALE_FLOAT(half, uint16_t)
+BOX_DOWNSCALE_FLOAT(float, float)
+
+#undef BOX_DOWNSCALE_FLOAT
+#undef ORDER_QWORDS
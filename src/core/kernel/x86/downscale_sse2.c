@@ -0,0 +1,191 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdint.h>
+#include <emmintrin.h>
+#include "../downscale.h"
+
+/*
+ * The factor rows are first added up with one vector per group of source samples, after that
+ * neighbouring sums are added in pairs until a single vector with one sum per output sample is left.
+ * The helpers are inlined with a constant factor so the loops over the vectors disappear.
+ */
+
+static inline void box_downscale_byte(const uint8_t *srcp, ptrdiff_t stride, uint8_t *dstp, unsigned factor, unsigned shift, unsigned width, unsigned *done)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i round = _mm_set1_epi16(1 << (shift - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    unsigned x, i, j, n;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+        __m128i v[8];
+
+        for (j = 0; j < factor; j++)
+            v[j] = zero;
+
+        for (i = 0; i < factor; i++) {
+            const uint8_t *row = srcp + i * stride + x * factor;
+            for (j = 0; j < factor; j += 2) {
+                __m128i pix = _mm_loadu_si128((const __m128i *)(row + j * 8));
+                v[j] = _mm_add_epi16(v[j], _mm_unpacklo_epi8(pix, zero));
+                v[j + 1] = _mm_add_epi16(v[j + 1], _mm_unpackhi_epi8(pix, zero));
+            }
+        }
+
+        /* the sums stay below 2^15 so they can be narrowed again with signed saturation */
+        for (n = factor; n > 1; n /= 2) {
+            for (j = 0; j < n / 2; j++)
+                v[j] = _mm_packs_epi32(_mm_madd_epi16(v[2 * j], ones), _mm_madd_epi16(v[2 * j + 1], ones));
+        }
+
+        v[0] = _mm_srl_epi16(_mm_add_epi16(v[0], round), count);
+        _mm_storel_epi64((__m128i *)(dstp + x), _mm_packus_epi16(v[0], v[0]));
+    }
+
+    *done = x;
+}
+
+static inline __m128i pairwise_add_epi32(__m128i a, __m128i b)
+{
+    __m128 even = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+}
+
+static inline __m128 pairwise_add_ps(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+static inline void box_downscale_word(const uint8_t *srcp, ptrdiff_t stride, uint16_t *dstp, unsigned factor, unsigned shift, unsigned width, unsigned *done)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16(INT16_MIN);
+    unsigned x, i, j, n;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+        __m128i v[8];
+
+        for (j = 0; j < factor; j++)
+            v[j] = zero;
+
+        for (i = 0; i < factor; i++) {
+            const uint16_t *row = (const uint16_t *)(srcp + i * stride) + x * factor;
+            for (j = 0; j < factor; j += 2) {
+                __m128i pix = _mm_loadu_si128((const __m128i *)(row + j * 4));
+                v[j] = _mm_add_epi32(v[j], _mm_unpacklo_epi16(pix, zero));
+                v[j + 1] = _mm_add_epi32(v[j + 1], _mm_unpackhi_epi16(pix, zero));
+            }
+        }
+
+        for (n = factor; n > 1; n /= 2) {
+            for (j = 0; j < n / 2; j++)
+                v[j] = pairwise_add_epi32(v[2 * j], v[2 * j + 1]);
+        }
+
+        /* no unsigned 32 to 16 bit pack in sse2 so the range is moved to signed and back */
+        v[0] = _mm_sub_epi32(_mm_srl_epi32(_mm_add_epi32(v[0], round), count), bias32);
+        v[0] = _mm_add_epi16(_mm_packs_epi32(v[0], v[0]), bias16);
+        _mm_storel_epi64((__m128i *)(dstp + x), v[0]);
+    }
+
+    *done = x;
+}
+
+static inline void box_downscale_float(const uint8_t *srcp, ptrdiff_t stride, float *dstp, unsigned factor, unsigned width, unsigned *done)
+{
+    const __m128 scale = _mm_set_ps1(1.0f / (factor * factor));
+    unsigned x, i, j, n;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+        __m128 v[8];
+
+        for (j = 0; j < factor; j++)
+            v[j] = _mm_setzero_ps();
+
+        for (i = 0; i < factor; i++) {
+            const float *row = (const float *)(srcp + i * stride) + x * factor;
+            for (j = 0; j < factor; j++)
+                v[j] = _mm_add_ps(v[j], _mm_loadu_ps(row + j * 4));
+        }
+
+        for (n = factor; n > 1; n /= 2) {
+            for (j = 0; j < n / 2; j++)
+                v[j] = pairwise_add_ps(v[2 * j], v[2 * j + 1]);
+        }
+
+        _mm_storeu_ps(dstp + x, _mm_mul_ps(v[0], scale));
+    }
+
+    *done = x;
+}
+
+void vs_box_downscale_byte_sse2(const void *src, ptrdiff_t src_stride, void *dst, unsigned factor, unsigned width)
+{
+    const uint8_t *srcp = src;
+    uint8_t *dstp = dst;
+    unsigned x = 0;
+
+    switch (factor) {
+    case 2: box_downscale_byte(srcp, src_stride, dstp, 2, 2, width, &x); break;
+    case 4: box_downscale_byte(srcp, src_stride, dstp, 4, 4, width, &x); break;
+    case 8: box_downscale_byte(srcp, src_stride, dstp, 8, 6, width, &x); break;
+    }
+
+    if (x < width)
+        vs_box_downscale_byte_c(srcp + x * factor, src_stride, dstp + x, factor, width - x);
+}
+
+void vs_box_downscale_word_sse2(const void *src, ptrdiff_t src_stride, void *dst, unsigned factor, unsigned width)
+{
+    const uint16_t *srcp = src;
+    uint16_t *dstp = dst;
+    unsigned x = 0;
+
+    switch (factor) {
+    case 2: box_downscale_word(src, src_stride, dstp, 2, 2, width, &x); break;
+    case 4: box_downscale_word(src, src_stride, dstp, 4, 4, width, &x); break;
+    case 8: box_downscale_word(src, src_stride, dstp, 8, 6, width, &x); break;
+    }
+
+    if (x < width)
+        vs_box_downscale_word_c(srcp + x * factor, src_stride, dstp + x, factor, width - x);
+}
+
+void vs_box_downscale_float_sse2(const void *src, ptrdiff_t src_stride, void *dst, unsigned factor, unsigned width)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned x = 0;
+
+    switch (factor) {
+    case 2: box_downscale_float(src, src_stride, dstp, 2, width, &x); break;
+    case 4: box_downscale_float(src, src_stride, dstp, 4, width, &x); break;
+    case 8: box_downscale_float(src, src_stride, dstp, 8, width, &x); break;
+    }
+
+    if (x < width)
+        vs_box_downscale_float_c(srcp + x * factor, src_stride, dstp + x, factor, width - x);
+}
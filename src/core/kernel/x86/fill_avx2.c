@@ -0,0 +1,64 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <immintrin.h>
+#include "../fill.h"
+
+/* Same as the sse2 version, short fills only need a single 16 byte store from each end. */
+static void fill_avx2(uint8_t *dstp, __m256i v, size_t bytes)
+{
+    size_t x;
+
+    if (bytes < 32) {
+        _mm_storeu_si128((__m128i *)dstp, _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i *)(dstp + bytes - 16), _mm256_castsi256_si128(v));
+        return;
+    }
+
+    for (x = 0; x + 32 <= bytes; x += 32)
+        _mm256_storeu_si256((__m256i *)(dstp + x), v);
+
+    if (x < bytes)
+        _mm256_storeu_si256((__m256i *)(dstp + bytes - 32), v);
+}
+
+void vs_fill_byte_avx2(void *dst, uint32_t value, size_t n)
+{
+    if (n < 16)
+        vs_fill_byte_c(dst, value, n);
+    else
+        fill_avx2(dst, _mm256_set1_epi8((char)value), n);
+}
+
+void vs_fill_word_avx2(void *dst, uint32_t value, size_t n)
+{
+    if (n < 8)
+        vs_fill_word_c(dst, value, n);
+    else
+        fill_avx2(dst, _mm256_set1_epi16((short)value), n * 2);
+}
+
+void vs_fill_dword_avx2(void *dst, uint32_t value, size_t n)
+{
+    if (n < 4)
+        vs_fill_dword_c(dst, value, n);
+    else
+        fill_avx2(dst, _mm256_set1_epi32((int)value), n * 4);
+}
@@ -0,0 +1,61 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <emmintrin.h>
+#include "../fill.h"
+
+/*
+ * The value repeats with the sample size and every store starts on a sample, so the last store can
+ * overlap the one before it instead of leaving a tail.
+ */
+static void fill_sse2(uint8_t *dstp, __m128i v, size_t bytes)
+{
+    size_t x;
+
+    for (x = 0; x + 16 <= bytes; x += 16)
+        _mm_storeu_si128((__m128i *)(dstp + x), v);
+
+    if (x < bytes)
+        _mm_storeu_si128((__m128i *)(dstp + bytes - 16), v);
+}
+
+void vs_fill_byte_sse2(void *dst, uint32_t value, size_t n)
+{
+    if (n < 16)
+        vs_fill_byte_c(dst, value, n);
+    else
+        fill_sse2(dst, _mm_set1_epi8((char)value), n);
+}
+
+void vs_fill_word_sse2(void *dst, uint32_t value, size_t n)
+{
+    if (n < 8)
+        vs_fill_word_c(dst, value, n);
+    else
+        fill_sse2(dst, _mm_set1_epi16((short)value), n * 2);
+}
+
+void vs_fill_dword_sse2(void *dst, uint32_t value, size_t n)
+{
+    if (n < 4)
+        vs_fill_dword_c(dst, value, n);
+    else
+        fill_sse2(dst, _mm_set1_epi32((int)value), n * 4);
+}
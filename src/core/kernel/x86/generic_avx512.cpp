@@ -0,0 +1,1239 @@
+/*
+* Copyright (c) 2012-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+#include "../generic.h"
+
+#ifdef _MSC_VER
+#define FORCE_INLINE inline __forceinline
+#else
+#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 13
+// the unmasked AVX-512 intrinsics of GCC 12 pass _mm512_undefined_*() as the merge source, which it then
+// reports as maybe uninitialized wherever they get inlined
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace {
+
+template <class T>
+T *line_ptr(T *ptr, unsigned i, ptrdiff_t stride)
+{
+    return (T *)(((unsigned char *)ptr) + static_cast<ptrdiff_t>(i) * stride);
+}
+
+// shifts the whole register left by Bytes, unlike _mm512_bslli_epi128 across the 128-bit lanes
+template <unsigned Bytes>
+__m512i mm512_slli_ex_si512(__m512i a)
+{
+    static_assert(Bytes < 16, "");
+
+    __m512i tmp = _mm512_alignr_epi32(a, _mm512_setzero_si512(), 12);
+    return _mm512_alignr_epi8(a, tmp, 16 - Bytes);
+}
+
+__m512 and_ps(__m512 a, __m512 b)
+{
+    return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_castps_si512(b)));
+}
+
+/* Masked loads and stores at the row edges never touch memory past the last pixel. */
+struct ByteTraits {
+    typedef uint8_t T;
+    typedef __m512i vec_type;
+    typedef __mmask64 mask_type;
+    static constexpr unsigned vec_len = 64;
+
+    static __m512i load(const uint8_t *ptr) { return _mm512_load_si512(ptr); }
+    static __m512i loadu(const uint8_t *ptr) { return _mm512_loadu_si512(ptr); }
+    static __m512i maskz_loadu(__mmask64 mask, const uint8_t *ptr) { return _mm512_maskz_loadu_epi8(mask, ptr); }
+    static void store(uint8_t *ptr, __m512i x) { _mm512_store_si512(ptr, x); }
+    static void mask_storeu(uint8_t *ptr, __mmask64 mask, __m512i x) { _mm512_mask_storeu_epi8(ptr, mask, x); }
+    static __mmask64 tail_mask(unsigned n) { return n >= 64 ? ~static_cast<__mmask64>(0) : (static_cast<__mmask64>(1) << n) - 1; }
+
+    static __m512i shl_insert_lo(__m512i x, uint8_t y) { return _mm512_mask_set1_epi8(mm512_slli_ex_si512<1>(x), 1, y); }
+    static __m512i insert(__m512i x, uint8_t y, unsigned idx) { return _mm512_mask_set1_epi8(x, static_cast<__mmask64>(1) << idx, y); }
+};
+
+struct WordTraits {
+    typedef uint16_t T;
+    typedef __m512i vec_type;
+    typedef __mmask32 mask_type;
+    static constexpr unsigned vec_len = 32;
+
+    static __m512i load(const uint16_t *ptr) { return _mm512_load_si512(ptr); }
+    static __m512i loadu(const uint16_t *ptr) { return _mm512_loadu_si512(ptr); }
+    static __m512i maskz_loadu(__mmask32 mask, const uint16_t *ptr) { return _mm512_maskz_loadu_epi16(mask, ptr); }
+    static void store(uint16_t *ptr, __m512i x) { _mm512_store_si512(ptr, x); }
+    static void mask_storeu(uint16_t *ptr, __mmask32 mask, __m512i x) { _mm512_mask_storeu_epi16(ptr, mask, x); }
+    static __mmask32 tail_mask(unsigned n) { return n >= 32 ? ~static_cast<__mmask32>(0) : (static_cast<__mmask32>(1) << n) - 1; }
+
+    static __m512i shl_insert_lo(__m512i x, uint16_t y) { return _mm512_mask_set1_epi16(mm512_slli_ex_si512<2>(x), 1, y); }
+    static __m512i insert(__m512i x, uint16_t y, unsigned idx) { return _mm512_mask_set1_epi16(x, static_cast<__mmask32>(1) << idx, y); }
+};
+
+struct FloatTraits {
+    typedef float T;
+    typedef __m512 vec_type;
+    typedef __mmask16 mask_type;
+    static constexpr unsigned vec_len = 16;
+
+    static __m512 load(const float *ptr) { return _mm512_load_ps(ptr); }
+    static __m512 loadu(const float *ptr) { return _mm512_loadu_ps(ptr); }
+    static __m512 maskz_loadu(__mmask16 mask, const float *ptr) { return _mm512_maskz_loadu_ps(mask, ptr); }
+    static void store(float *ptr, __m512 x) { _mm512_store_ps(ptr, x); }
+    static void mask_storeu(float *ptr, __mmask16 mask, __m512 x) { _mm512_mask_storeu_ps(ptr, mask, x); }
+    static __mmask16 tail_mask(unsigned n) { return n >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1U << n) - 1); }
+
+    static __m512 shl_insert_lo(__m512 x, float y)
+    {
+        __m512i tmp = _mm512_alignr_epi32(_mm512_castps_si512(x), _mm512_setzero_si512(), 15);
+        return _mm512_mask_mov_ps(_mm512_castsi512_ps(tmp), 1, _mm512_set1_ps(y));
+    }
+
+    static __m512 insert(__m512 x, float y, unsigned idx) { return _mm512_mask_mov_ps(x, static_cast<__mmask16>(1U << idx), _mm512_set1_ps(y)); }
+};
+
+
+// MSVC 32-bit only allows up to 3 vector arguments to be passed by value.
+#define OP_ARGS const vec_type &a00_, const vec_type &a01_, const vec_type &a02_, const vec_type &a10_, const vec_type &a11_, const vec_type &a12_, const vec_type &a20_, const vec_type &a21_, const vec_type &a22_
+#define PROLOGUE() \
+  auto a00 = a00_; auto a01 = a01_; auto a02 = a02_; \
+  auto a10 = a10_; auto a11 = a11_; auto a12 = a12_; \
+  auto a20 = a20_; auto a21 = a21_; auto a22 = a22_;
+
+struct PrewittSobelTraits {
+    float scale;
+
+    explicit PrewittSobelTraits(const vs_generic_params &params) : scale{ params.scale } {}
+};
+
+template <bool Sobel>
+struct PrewittSobelByte : PrewittSobelTraits, ByteTraits {
+    using PrewittSobelTraits::PrewittSobelTraits;
+
+    FORCE_INLINE __m512i op(OP_ARGS)
+    {
+        PROLOGUE();
+        (void)a11;
+
+#define UNPCKLO(x) (_mm512_unpacklo_epi8(x, _mm512_setzero_si512()))
+#define UNPCKHI(x) (_mm512_unpackhi_epi8(x, _mm512_setzero_si512()))
+        __m512i gx_lo = _mm512_sub_epi16(UNPCKLO(a22), UNPCKLO(a00));
+        __m512i gx_hi = _mm512_sub_epi16(UNPCKHI(a22), UNPCKHI(a00));
+        __m512i gy_lo = gx_lo;
+        __m512i gy_hi = gx_hi;
+
+        gx_lo = _mm512_add_epi16(gx_lo, UNPCKLO(a20));
+        gx_lo = _mm512_add_epi16(gx_lo, Sobel ? _mm512_slli_epi16(UNPCKLO(a21), 1) : UNPCKLO(a21));
+        gx_lo = _mm512_sub_epi16(gx_lo, Sobel ? _mm512_slli_epi16(UNPCKLO(a01), 1) : UNPCKLO(a01));
+        gx_lo = _mm512_sub_epi16(gx_lo, UNPCKLO(a02));
+
+        gx_hi = _mm512_add_epi16(gx_hi, UNPCKHI(a20));
+        gx_hi = _mm512_add_epi16(gx_hi, Sobel ? _mm512_slli_epi16(UNPCKHI(a21), 1) : UNPCKHI(a21));
+        gx_hi = _mm512_sub_epi16(gx_hi, Sobel ? _mm512_slli_epi16(UNPCKHI(a01), 1) : UNPCKHI(a01));
+        gx_hi = _mm512_sub_epi16(gx_hi, UNPCKHI(a02));
+
+        gy_lo = _mm512_add_epi16(gy_lo, UNPCKLO(a02));
+        gy_lo = _mm512_add_epi16(gy_lo, Sobel ? _mm512_slli_epi16(UNPCKLO(a12), 1) : UNPCKLO(a12));
+        gy_lo = _mm512_sub_epi16(gy_lo, Sobel ? _mm512_slli_epi16(UNPCKLO(a10), 1) : UNPCKLO(a10));
+        gy_lo = _mm512_sub_epi16(gy_lo, UNPCKLO(a20));
+
+        gy_hi = _mm512_add_epi16(gy_hi, UNPCKHI(a02));
+        gy_hi = _mm512_add_epi16(gy_hi, Sobel ? _mm512_slli_epi16(UNPCKHI(a12), 1) : UNPCKHI(a12));
+        gy_hi = _mm512_sub_epi16(gy_hi, Sobel ? _mm512_slli_epi16(UNPCKHI(a10), 1) : UNPCKHI(a10));
+        gy_hi = _mm512_sub_epi16(gy_hi, UNPCKHI(a20));
+
+        __m512i gxy_lolo = _mm512_unpacklo_epi16(gx_lo, gy_lo);
+        __m512i gxy_lohi = _mm512_unpackhi_epi16(gx_lo, gy_lo);
+        __m512i gxy_hilo = _mm512_unpacklo_epi16(gx_hi, gy_hi);
+        __m512i gxy_hihi = _mm512_unpackhi_epi16(gx_hi, gy_hi);
+        gxy_lolo = _mm512_madd_epi16(gxy_lolo, gxy_lolo);
+        gxy_lohi = _mm512_madd_epi16(gxy_lohi, gxy_lohi);
+        gxy_hilo = _mm512_madd_epi16(gxy_hilo, gxy_hilo);
+        gxy_hihi = _mm512_madd_epi16(gxy_hihi, gxy_hihi);
+
+        __m512 tmpf_lolo = _mm512_sqrt_ps(_mm512_cvtepi32_ps(gxy_lolo));
+        __m512 tmpf_lohi = _mm512_sqrt_ps(_mm512_cvtepi32_ps(gxy_lohi));
+        __m512 tmpf_hilo = _mm512_sqrt_ps(_mm512_cvtepi32_ps(gxy_hilo));
+        __m512 tmpf_hihi = _mm512_sqrt_ps(_mm512_cvtepi32_ps(gxy_hihi));
+        tmpf_lolo = _mm512_mul_ps(tmpf_lolo, _mm512_set1_ps(scale));
+        tmpf_lohi = _mm512_mul_ps(tmpf_lohi, _mm512_set1_ps(scale));
+        tmpf_hilo = _mm512_mul_ps(tmpf_hilo, _mm512_set1_ps(scale));
+        tmpf_hihi = _mm512_mul_ps(tmpf_hihi, _mm512_set1_ps(scale));
+
+        __m512i tmpi_lo = _mm512_packs_epi32(_mm512_cvtps_epi32(tmpf_lolo), _mm512_cvtps_epi32(tmpf_lohi));
+        __m512i tmpi_hi = _mm512_packs_epi32(_mm512_cvtps_epi32(tmpf_hilo), _mm512_cvtps_epi32(tmpf_hihi));
+        return _mm512_packus_epi16(tmpi_lo, tmpi_hi);
+#undef UNPCKHI
+#undef UNPCKLO
+    }
+};
+
+template <bool Sobel>
+struct PrewittSobelWord : PrewittSobelTraits, WordTraits {
+    __m512i maxval;
+
+    static uint32_t interleave(uint16_t a, uint16_t b)
+    {
+        return (static_cast<uint32_t>(b) << 16) | a;
+    }
+
+    explicit PrewittSobelWord(const vs_generic_params &params) :
+        PrewittSobelTraits(params),
+        maxval(_mm512_set1_epi16(params.maxval))
+    {}
+
+    FORCE_INLINE __m512i op(OP_ARGS)
+    {
+        PROLOGUE();
+        (void)a11;
+
+#define UNPCKLO(x) (_mm512_unpacklo_epi16(x, _mm512_setzero_si512()))
+#define UNPCKHI(x) (_mm512_unpackhi_epi16(x, _mm512_setzero_si512()))
+        __m512i gx_lo = _mm512_sub_epi32(UNPCKLO(a22), UNPCKLO(a00));
+        __m512i gx_hi = _mm512_sub_epi32(UNPCKHI(a22), UNPCKHI(a00));
+        __m512i gy_lo = gx_lo;
+        __m512i gy_hi = gx_hi;
+
+        gx_lo = _mm512_add_epi32(gx_lo, UNPCKLO(a20));
+        gx_lo = _mm512_add_epi32(gx_lo, Sobel ? _mm512_slli_epi32(UNPCKLO(a21), 1) : UNPCKLO(a21));
+        gx_lo = _mm512_sub_epi32(gx_lo, Sobel ? _mm512_slli_epi32(UNPCKLO(a01), 1) : UNPCKLO(a01));
+        gx_lo = _mm512_sub_epi32(gx_lo, UNPCKLO(a02));
+
+        gx_hi = _mm512_add_epi32(gx_hi, UNPCKHI(a20));
+        gx_hi = _mm512_add_epi32(gx_hi, Sobel ? _mm512_slli_epi32(UNPCKHI(a21), 1) : UNPCKHI(a21));
+        gx_hi = _mm512_sub_epi32(gx_hi, Sobel ? _mm512_slli_epi32(UNPCKHI(a01), 1) : UNPCKHI(a01));
+        gx_hi = _mm512_sub_epi32(gx_hi, UNPCKHI(a02));
+
+        gy_lo = _mm512_add_epi32(gy_lo, UNPCKLO(a02));
+        gy_lo = _mm512_add_epi32(gy_lo, Sobel ? _mm512_slli_epi32(UNPCKLO(a12), 1) : UNPCKLO(a12));
+        gy_lo = _mm512_sub_epi32(gy_lo, Sobel ? _mm512_slli_epi32(UNPCKLO(a10), 1) : UNPCKLO(a10));
+        gy_lo = _mm512_sub_epi32(gy_lo, UNPCKLO(a20));
+
+        gy_hi = _mm512_add_epi32(gy_hi, UNPCKHI(a02));
+        gy_hi = _mm512_add_epi32(gy_hi, Sobel ? _mm512_slli_epi32(UNPCKHI(a12), 1) : UNPCKHI(a12));
+        gy_hi = _mm512_sub_epi32(gy_hi, Sobel ? _mm512_slli_epi32(UNPCKHI(a10), 1) : UNPCKHI(a10));
+        gy_hi = _mm512_sub_epi32(gy_hi, UNPCKHI(a20));
+
+        __m512 gxsq_lo = _mm512_cvtepi32_ps(gx_lo);
+        __m512 gxsq_hi = _mm512_cvtepi32_ps(gx_hi);
+        __m512 gysq_lo = _mm512_cvtepi32_ps(gy_lo);
+        __m512 gysq_hi = _mm512_cvtepi32_ps(gy_hi);
+        gxsq_lo = _mm512_mul_ps(gxsq_lo, gxsq_lo);
+        gxsq_hi = _mm512_mul_ps(gxsq_hi, gxsq_hi);
+        gysq_lo = _mm512_mul_ps(gysq_lo, gysq_lo);
+        gysq_hi = _mm512_mul_ps(gysq_hi, gysq_hi);
+
+        __m512 gxy_lo = _mm512_add_ps(gxsq_lo, gysq_lo);
+        __m512 gxy_hi = _mm512_add_ps(gxsq_hi, gysq_hi);
+        gxy_lo = _mm512_sqrt_ps(gxy_lo);
+        gxy_lo = _mm512_mul_ps(gxy_lo, _mm512_set1_ps(scale));
+        gxy_hi = _mm512_sqrt_ps(gxy_hi);
+        gxy_hi = _mm512_mul_ps(gxy_hi, _mm512_set1_ps(scale));
+
+        __m512i tmpi_lo = _mm512_cvtps_epi32(gxy_lo);
+        __m512i tmpi_hi = _mm512_cvtps_epi32(gxy_hi);
+        __m512i tmp = _mm512_packus_epi32(tmpi_lo, tmpi_hi);
+        tmp = _mm512_min_epu16(tmp, maxval);
+        return tmp;
+#undef UNPCKHI
+#undef UNPCKLO
+    }
+};
+
+template <bool Sobel>
+struct PrewittSobelFloat : PrewittSobelTraits, FloatTraits {
+    using PrewittSobelTraits::PrewittSobelTraits;
+
+    FORCE_INLINE __m512 op(OP_ARGS)
+    {
+        PROLOGUE();
+        (void)a11;
+
+        __m512 gx = _mm512_sub_ps(a22, a00);
+        __m512 gy = gx;
+
+        gx = _mm512_add_ps(gx, a20);
+        gx = _mm512_add_ps(gx, Sobel ? _mm512_mul_ps(a21, _mm512_set1_ps(2.0f)) : a21);
+        gx = _mm512_sub_ps(gx, Sobel ? _mm512_mul_ps(a01, _mm512_set1_ps(2.0f)) : a01);
+        gx = _mm512_sub_ps(gx, a02);
+
+        gy = _mm512_add_ps(gy, a02);
+        gy = _mm512_add_ps(gy, Sobel ? _mm512_mul_ps(a12, _mm512_set1_ps(2.0f)) : a12);
+        gy = _mm512_sub_ps(gy, Sobel ? _mm512_mul_ps(a10, _mm512_set1_ps(2.0f)) : a10);
+        gy = _mm512_sub_ps(gy, a20);
+
+        gx = _mm512_mul_ps(gx, gx);
+        gy = _mm512_mul_ps(gy, gy);
+
+        __m512 tmp = _mm512_add_ps(gx, gy);
+        tmp = _mm512_sqrt_ps(tmp);
+        tmp = _mm512_mul_ps(tmp, _mm512_set1_ps(scale));
+        return tmp;
+    }
+};
+
+template <class Derived, class vec_type>
+struct MinMaxTraits {
+    vec_type mask00;
+    vec_type mask01;
+    vec_type mask02;
+    vec_type mask10;
+    vec_type mask12;
+    vec_type mask20;
+    vec_type mask21;
+    vec_type mask22;
+
+    explicit MinMaxTraits(const vs_generic_params &params) :
+        mask00((params.stencil & 0x01) ? Derived::enabled_mask() : Derived::disabled_mask()),
+        mask01((params.stencil & 0x02) ? Derived::enabled_mask() : Derived::disabled_mask()),
+        mask02((params.stencil & 0x04) ? Derived::enabled_mask() : Derived::disabled_mask()),
+        mask10((params.stencil & 0x08) ? Derived::enabled_mask() : Derived::disabled_mask()),
+        mask12((params.stencil & 0x10) ? Derived::enabled_mask() : Derived::disabled_mask()),
+        mask20((params.stencil & 0x20) ? Derived::enabled_mask() : Derived::disabled_mask()),
+        mask21((params.stencil & 0x40) ? Derived::enabled_mask() : Derived::disabled_mask()),
+        mask22((params.stencil & 0x80) ? Derived::enabled_mask() : Derived::disabled_mask())
+    {}
+
+    FORCE_INLINE vec_type apply_stencil(OP_ARGS)
+    {
+        PROLOGUE();
+
+        vec_type val = a11;
+        val = Derived::reduce(val, a00, mask00);
+        val = Derived::reduce(val, a01, mask01);
+        val = Derived::reduce(val, a02, mask02);
+        val = Derived::reduce(val, a10, mask10);
+        val = Derived::reduce(val, a12, mask12);
+        val = Derived::reduce(val, a20, mask20);
+        val = Derived::reduce(val, a21, mask21);
+        val = Derived::reduce(val, a22, mask22);
+        return val;
+    }
+};
+
+template <bool Max>
+static __m512i limit_diff_epu8(__m512i val, __m512i orig, __m512i threshold)
+{
+    __m512i limit = Max ? _mm512_adds_epu8(orig, threshold) : _mm512_subs_epu8(orig, threshold);
+    val = Max ? _mm512_min_epu8(val, limit) : _mm512_max_epu8(val, limit);
+    return val;
+}
+
+template <bool Max>
+static __m512i limit_diff_epu16(__m512i val, __m512i orig, __m512i threshold)
+{
+    __m512i limit = Max ? _mm512_adds_epu16(orig, threshold) : _mm512_subs_epu16(orig, threshold);
+    val = Max ? _mm512_min_epu16(val, limit) : _mm512_max_epu16(val, limit);
+    return val;
+}
+
+template <bool Max>
+static __m512 limit_diff_ps(__m512 val, __m512 orig, __m512 threshold)
+{
+    __m512 limit = Max ? _mm512_add_ps(orig, threshold) : _mm512_sub_ps(orig, threshold);
+    val = Max ? _mm512_min_ps(val, limit) : _mm512_max_ps(val, limit);
+    return val;
+}
+
+template <bool Max>
+struct MinMaxByte : MinMaxTraits<MinMaxByte<Max>, __m512i>, ByteTraits {
+    typedef MinMaxTraits<MinMaxByte<Max>, __m512i> MinMaxTraitsT;
+    __m512i threshold;
+
+    static __m512i enabled_mask() { return Max ? _mm512_set1_epi8(UINT8_MAX) : _mm512_setzero_si512(); }
+    static __m512i disabled_mask() { return Max ? _mm512_setzero_si512() : _mm512_set1_epi8(UINT8_MAX); }
+
+    static __m512i reduce(__m512i lhs, __m512i rhs, __m512i mask)
+    {
+        return Max ? _mm512_max_epu8(lhs, _mm512_and_si512(mask, rhs)) : _mm512_min_epu8(lhs, _mm512_or_si512(mask, rhs));
+    }
+
+    explicit MinMaxByte(const vs_generic_params &params) :
+        MinMaxTraitsT(params),
+        threshold(_mm512_set1_epi8(static_cast<uint8_t>(std::min(params.threshold, static_cast<uint16_t>(UINT8_MAX)))))
+    {}
+
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+        __m512i val = MinMaxTraitsT::apply_stencil(a00, a01, a02, a10, a11, a12, a20, a21, a22);
+        return limit_diff_epu8<Max>(val, a11, threshold);
+    }
+};
+
+template <bool Max>
+struct MinMaxWord : MinMaxTraits<MinMaxWord<Max>, __m512i>, WordTraits {
+    typedef MinMaxTraits<MinMaxWord<Max>, __m512i> MinMaxTraitsT;
+    __m512i threshold;
+
+    static __m512i enabled_mask() { return Max ? _mm512_set1_epi16(UINT16_MAX) : _mm512_setzero_si512(); }
+    static __m512i disabled_mask() { return Max ? _mm512_setzero_si512() : _mm512_set1_epi16(UINT16_MAX); }
+
+    FORCE_INLINE static __m512i reduce(__m512i lhs, __m512i rhs, __m512i mask)
+    {
+        return Max ? _mm512_max_epu16(lhs, _mm512_and_si512(mask, rhs)) : _mm512_min_epu16(lhs, _mm512_or_si512(mask, rhs));
+    }
+
+    explicit MinMaxWord(const vs_generic_params &params) :
+        MinMaxTraitsT(params),
+        threshold(_mm512_set1_epi16(params.threshold))
+    {}
+
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+        __m512i val = MinMaxTraitsT::apply_stencil(a00, a01, a02, a10, a11, a12, a20, a21, a22);
+        return limit_diff_epu16<Max>(val, a11, threshold);
+    }
+};
+
+template <bool Max>
+struct MinMaxFloat : MinMaxTraits<MinMaxFloat<Max>, __m512>, FloatTraits {
+    typedef MinMaxTraits<MinMaxFloat<Max>, __m512> MinMaxTraitsT;
+    __m512 threshold;
+
+    static __m512 enabled_mask() { return Max ? _mm512_set1_ps(INFINITY) : _mm512_set1_ps(-INFINITY); }
+    static __m512 disabled_mask() { return Max ? _mm512_set1_ps(-INFINITY) : _mm512_set1_ps(INFINITY); }
+
+    FORCE_INLINE static __m512 reduce(__m512 lhs, __m512 rhs, __m512 mask)
+    {
+        // INFINITY is not a bit mask, so need to use min/max on rhs instead of and/or.
+        return Max ? _mm512_max_ps(lhs, _mm512_min_ps(rhs, mask)) : _mm512_min_ps(lhs, _mm512_max_ps(rhs, mask));
+    }
+
+    explicit MinMaxFloat(const vs_generic_params &params) :
+        MinMaxTraitsT(params),
+        threshold(_mm512_set1_ps(params.thresholdf))
+    {}
+
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+        __m512 val = MinMaxTraitsT::apply_stencil(a00, a01, a02, a10, a11, a12, a20, a21, a22);
+        return limit_diff_ps<Max>(val, a11, threshold);
+    }
+};
+
+constexpr uint8_t STENCIL_ALL = 0xFF;
+constexpr uint8_t STENCIL_H = 0x18;
+constexpr uint8_t STENCIL_V = 0x42;
+constexpr uint8_t STENCIL_PLUS = STENCIL_H | STENCIL_V;
+
+template <uint8_t Stencil, class Derived, class vec_type>
+struct MinMaxFixedTraits {
+    static FORCE_INLINE vec_type apply_stencil(OP_ARGS)
+    {
+        PROLOGUE();
+
+        vec_type val = a11;
+        val = (Stencil & 0x01) ? Derived::reduce(val, a00) : val;
+        val = (Stencil & 0x02) ? Derived::reduce(val, a01) : val;
+        val = (Stencil & 0x04) ? Derived::reduce(val, a02) : val;
+        val = (Stencil & 0x08) ? Derived::reduce(val, a10) : val;
+        val = (Stencil & 0x10) ? Derived::reduce(val, a12) : val;
+        val = (Stencil & 0x20) ? Derived::reduce(val, a20) : val;
+        val = (Stencil & 0x40) ? Derived::reduce(val, a21) : val;
+        val = (Stencil & 0x80) ? Derived::reduce(val, a22) : val;
+        return val;
+    }
+};
+
+template <uint8_t Stencil, bool Max>
+struct MinMaxFixedByte : MinMaxFixedTraits<Stencil, MinMaxFixedByte<Stencil, Max>, __m512i>, ByteTraits {
+    typedef MinMaxFixedTraits<Stencil, MinMaxFixedByte, __m512i> MinMaxFixedTraitsT;
+    __m512i threshold;
+
+    static __m512i reduce(__m512i lhs, __m512i rhs)
+    {
+        return Max ? _mm512_max_epu8(lhs, rhs) : _mm512_min_epu8(lhs, rhs);
+    }
+
+    explicit MinMaxFixedByte(const vs_generic_params &params) :
+        threshold(_mm512_set1_epi8(static_cast<uint8_t>(std::min(params.threshold, static_cast<uint16_t>(UINT8_MAX)))))
+    {}
+
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+        __m512i val = MinMaxFixedTraitsT::apply_stencil(a00, a01, a02, a10, a11, a12, a20, a21, a22);
+        return limit_diff_epu8<Max>(val, a11, threshold);
+    }
+};
+
+template <uint8_t Stencil, bool Max>
+struct MinMaxFixedWord : MinMaxFixedTraits<Stencil, MinMaxFixedWord<Stencil, Max>, __m512i>, WordTraits {
+    typedef MinMaxFixedTraits<Stencil, MinMaxFixedWord, __m512i> MinMaxFixedTraitsT;
+    __m512i threshold;
+
+    static __m512i reduce(__m512i lhs, __m512i rhs)
+    {
+        return Max ? _mm512_max_epu16(lhs, rhs) : _mm512_min_epu16(lhs, rhs);
+    }
+
+    explicit MinMaxFixedWord(const vs_generic_params &params) :
+        threshold(_mm512_set1_epi16(params.threshold))
+    {}
+
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+        __m512i val = MinMaxFixedTraitsT::apply_stencil(a00, a01, a02, a10, a11, a12, a20, a21, a22);
+        return limit_diff_epu16<Max>(val, a11, threshold);
+    }
+};
+
+template <uint8_t Stencil, bool Max>
+struct MinMaxFixedFloat : MinMaxFixedTraits<Stencil, MinMaxFixedFloat<Stencil, Max>, __m512>, FloatTraits {
+    typedef MinMaxFixedTraits<Stencil, MinMaxFixedFloat<Stencil, Max>, __m512> MinMaxFixedTraitsT;
+    __m512 threshold;
+
+    FORCE_INLINE static __m512 reduce(__m512 lhs, __m512 rhs)
+    {
+        return Max ? _mm512_max_ps(lhs, rhs) : _mm512_min_ps(lhs, rhs);
+    }
+
+    explicit MinMaxFixedFloat(const vs_generic_params &params) : threshold(_mm512_set1_ps(params.thresholdf)) {}
+
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+        __m512 val = MinMaxFixedTraitsT::apply_stencil(a00, a01, a02, a10, a11, a12, a20, a21, a22);
+        return limit_diff_ps<Max>(val, a11, threshold);
+    }
+};
+
+template <class Derived, class vec_type>
+struct MedianTraits {
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+        Derived::compare_exchange(a00, a01);
+        Derived::compare_exchange(a02, a10);
+        Derived::compare_exchange(a12, a20);
+        Derived::compare_exchange(a21, a22);
+
+        Derived::compare_exchange(a00, a02);
+        Derived::compare_exchange(a01, a10);
+        Derived::compare_exchange(a12, a21);
+        Derived::compare_exchange(a20, a22);
+
+        Derived::compare_exchange(a01, a02);
+        Derived::compare_exchange(a20, a21);
+
+        a12 = Derived::max(a00, a12);
+        a20 = Derived::max(a01, a20);
+        a02 = Derived::min(a02, a21);
+        a10 = Derived::min(a10, a22);
+
+        a12 = Derived::max(a02, a12);
+        a10 = Derived::min(a10, a20);
+
+        Derived::compare_exchange(a10, a12);
+
+        a11 = Derived::max(a10, a11);
+        a11 = Derived::min(a11, a12);
+        return a11;
+    }
+};
+
+struct MedianByte : MedianTraits<MedianByte, __m512i>, ByteTraits {
+    static __m512i min(__m512i lhs, __m512i rhs) { return _mm512_min_epu8(lhs, rhs); }
+    static __m512i max(__m512i lhs, __m512i rhs) { return _mm512_max_epu8(lhs, rhs); }
+
+    static FORCE_INLINE void compare_exchange(__m512i &lhs, __m512i &rhs)
+    {
+        __m512i a = lhs;
+        __m512i b = rhs;
+        lhs = _mm512_min_epu8(a, b);
+        rhs = _mm512_max_epu8(a, b);
+    }
+
+    explicit MedianByte(const vs_generic_params &) {}
+};
+
+struct MedianWord : MedianTraits<MedianWord, __m512i>, WordTraits {
+    static __m512i min(__m512i lhs, __m512i rhs) { return _mm512_min_epu16(lhs, rhs); }
+    static __m512i max(__m512i lhs, __m512i rhs) { return _mm512_max_epu16(lhs, rhs); }
+
+    static FORCE_INLINE void compare_exchange(__m512i &lhs, __m512i &rhs)
+    {
+        __m512i a = lhs;
+        __m512i b = rhs;
+        lhs = _mm512_min_epu16(a, b);
+        rhs = _mm512_max_epu16(a, b);
+    }
+
+    explicit MedianWord(const vs_generic_params &) {}
+};
+
+struct MedianFloat : MedianTraits<MedianFloat, __m512>, FloatTraits {
+    static __m512 min(__m512 lhs, __m512 rhs) { return _mm512_min_ps(lhs, rhs); }
+    static __m512 max(__m512 lhs, __m512 rhs) { return _mm512_max_ps(lhs, rhs); }
+
+    static FORCE_INLINE void compare_exchange(__m512 &lhs, __m512 &rhs)
+    {
+        __m512 a = lhs;
+        __m512 b = rhs;
+        lhs = _mm512_min_ps(a, b);
+        rhs = _mm512_max_ps(a, b);
+    }
+
+    explicit MedianFloat(const vs_generic_params &) {}
+};
+
+template <bool Inflate>
+struct DeflateInflateByte : ByteTraits {
+    __m512i threshold;
+
+    explicit DeflateInflateByte(const vs_generic_params &params) :
+        threshold(_mm512_set1_epi8(static_cast<uint8_t>(std::min(params.threshold, static_cast<uint16_t>(UINT8_MAX)))))
+    {}
+
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+#define UNPCKLO(x) (_mm512_unpacklo_epi8(x, _mm512_setzero_si512()))
+#define UNPCKHI(x) (_mm512_unpackhi_epi8(x, _mm512_setzero_si512()))
+        __m512i accum_lo = UNPCKLO(a00);
+        __m512i accum_hi = UNPCKHI(a00);
+        accum_lo = _mm512_add_epi16(accum_lo, UNPCKLO(a01));
+        accum_hi = _mm512_add_epi16(accum_hi, UNPCKHI(a01));
+        accum_lo = _mm512_add_epi16(accum_lo, UNPCKLO(a02));
+        accum_hi = _mm512_add_epi16(accum_hi, UNPCKHI(a02));
+        accum_lo = _mm512_add_epi16(accum_lo, UNPCKLO(a10));
+        accum_hi = _mm512_add_epi16(accum_hi, UNPCKHI(a10));
+        accum_lo = _mm512_add_epi16(accum_lo, UNPCKLO(a12));
+        accum_hi = _mm512_add_epi16(accum_hi, UNPCKHI(a12));
+        accum_lo = _mm512_add_epi16(accum_lo, UNPCKLO(a20));
+        accum_hi = _mm512_add_epi16(accum_hi, UNPCKHI(a20));
+        accum_lo = _mm512_add_epi16(accum_lo, UNPCKLO(a21));
+        accum_hi = _mm512_add_epi16(accum_hi, UNPCKHI(a21));
+        accum_lo = _mm512_add_epi16(accum_lo, UNPCKLO(a22));
+        accum_hi = _mm512_add_epi16(accum_hi, UNPCKHI(a22));
+        accum_lo = _mm512_add_epi16(accum_lo, _mm512_set1_epi16(4));
+        accum_hi = _mm512_add_epi16(accum_hi, _mm512_set1_epi16(4));
+
+        accum_lo = _mm512_srli_epi16(accum_lo, 3);
+        accum_hi = _mm512_srli_epi16(accum_hi, 3);
+
+        __m512i tmp = _mm512_packus_epi16(accum_lo, accum_hi);
+        tmp = Inflate ? _mm512_max_epu8(tmp, a11) : _mm512_min_epu8(tmp, a11);
+
+        __m512i limit = Inflate ? _mm512_adds_epu8(a11, threshold) : _mm512_subs_epu8(a11, threshold);
+        tmp = Inflate ? _mm512_min_epu8(tmp, limit) : _mm512_max_epu8(tmp, limit);
+
+        return tmp;
+#undef UNPCKHI
+#undef UNPCKLO
+    }
+};
+
+template <bool Inflate>
+struct DeflateInflateWord : WordTraits {
+    __m512i threshold;
+
+    explicit DeflateInflateWord(const vs_generic_params &params) : threshold(_mm512_set1_epi16(params.threshold)) {}
+
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+#define UNPCKLO(x) (_mm512_unpacklo_epi16(x, _mm512_setzero_si512()))
+#define UNPCKHI(x) (_mm512_unpackhi_epi16(x, _mm512_setzero_si512()))
+        __m512i accum_lo = UNPCKLO(a00);
+        __m512i accum_hi = UNPCKHI(a00);
+        accum_lo = _mm512_add_epi32(accum_lo, UNPCKLO(a01));
+        accum_hi = _mm512_add_epi32(accum_hi, UNPCKHI(a01));
+        accum_lo = _mm512_add_epi32(accum_lo, UNPCKLO(a02));
+        accum_hi = _mm512_add_epi32(accum_hi, UNPCKHI(a02));
+        accum_lo = _mm512_add_epi32(accum_lo, UNPCKLO(a10));
+        accum_hi = _mm512_add_epi32(accum_hi, UNPCKHI(a10));
+        accum_lo = _mm512_add_epi32(accum_lo, UNPCKLO(a12));
+        accum_hi = _mm512_add_epi32(accum_hi, UNPCKHI(a12));
+        accum_lo = _mm512_add_epi32(accum_lo, UNPCKLO(a20));
+        accum_hi = _mm512_add_epi32(accum_hi, UNPCKHI(a20));
+        accum_lo = _mm512_add_epi32(accum_lo, UNPCKLO(a21));
+        accum_hi = _mm512_add_epi32(accum_hi, UNPCKHI(a21));
+        accum_lo = _mm512_add_epi32(accum_lo, UNPCKLO(a22));
+        accum_hi = _mm512_add_epi32(accum_hi, UNPCKHI(a22));
+        accum_lo = _mm512_add_epi32(accum_lo, _mm512_set1_epi32(4));
+        accum_hi = _mm512_add_epi32(accum_hi, _mm512_set1_epi32(4));
+
+        accum_lo = _mm512_srli_epi32(accum_lo, 3);
+        accum_hi = _mm512_srli_epi32(accum_hi, 3);
+
+        __m512i tmp = _mm512_packus_epi32(accum_lo, accum_hi);
+        tmp = Inflate ? _mm512_max_epu16(tmp, a11) : _mm512_min_epu16(tmp, a11);
+
+        __m512i limit = Inflate ? _mm512_adds_epu16(a11, threshold) : _mm512_subs_epu16(a11, threshold);
+        tmp = Inflate ? _mm512_min_epu16(tmp, limit) : _mm512_max_epu16(tmp, limit);
+
+        return tmp;
+#undef UNPCKHI
+#undef UNPCKLO
+    }
+};
+
+template <bool Inflate>
+struct DeflateInflateFloat : FloatTraits {
+    __m512 threshold;
+
+    explicit DeflateInflateFloat(const vs_generic_params &params) : threshold(_mm512_set1_ps(params.thresholdf)) {}
+
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+        __m512 accum0 = _mm512_add_ps(a00, a01);
+        __m512 accum1 = _mm512_add_ps(a02, a10);
+        accum0 = _mm512_add_ps(accum0, a12);
+        accum1 = _mm512_add_ps(accum1, a20);
+        accum0 = _mm512_add_ps(accum0, a21);
+        accum1 = _mm512_add_ps(accum1, a22);
+
+        __m512 tmp = _mm512_add_ps(accum0, accum1);
+        tmp = _mm512_mul_ps(tmp, _mm512_set1_ps(1.0f / 8.0f));
+        tmp = Inflate ? _mm512_max_ps(tmp, a11) : _mm512_min_ps(tmp, a11);
+
+        __m512 limit = Inflate ? _mm512_add_ps(a11, threshold) : _mm512_sub_ps(a11, threshold);
+        tmp = Inflate ? _mm512_min_ps(tmp, limit) : _mm512_max_ps(tmp, limit);
+
+        return tmp;
+    }
+};
+
+struct ConvolutionTraits {
+    __m512 div;
+    __m512 bias;
+    __m512 saturate_mask;
+
+    explicit ConvolutionTraits(const vs_generic_params &params) :
+        div(_mm512_set1_ps(params.div)),
+        bias(_mm512_set1_ps(params.bias)),
+        saturate_mask(_mm512_castsi512_ps(_mm512_set1_epi32(params.saturate ? 0xFFFFFFFF : 0x7FFFFFFF)))
+    {}
+};
+
+struct ConvolutionIntTraits : ConvolutionTraits {
+    __m512i c00_01, c02_10, c11_12, c20_21, c22_xx;
+
+    static uint32_t interleave(int16_t a, int16_t b) { return (static_cast<uint32_t>(b) << 16) | static_cast<uint16_t>(a); }
+
+    explicit ConvolutionIntTraits(const vs_generic_params &params) :
+        ConvolutionTraits(params),
+        c00_01(_mm512_set1_epi32(interleave(params.matrix[0], params.matrix[1]))),
+        c02_10(_mm512_set1_epi32(interleave(params.matrix[2], params.matrix[3]))),
+        c11_12(_mm512_set1_epi32(interleave(params.matrix[4], params.matrix[5]))),
+        c20_21(_mm512_set1_epi32(interleave(params.matrix[6], params.matrix[7]))),
+        c22_xx(_mm512_set1_epi32(interleave(params.matrix[8], 0)))
+    {}
+};
+
+struct ConvolutionByte : ConvolutionIntTraits, ByteTraits {
+    using ConvolutionIntTraits::ConvolutionIntTraits;
+
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+#define UNPCKLO(x) (_mm512_unpacklo_epi8(x, _mm512_setzero_si512()))
+#define UNPCKHI(x) (_mm512_unpackhi_epi8(x, _mm512_setzero_si512()))
+        __m512i accum_lolo, accum_lohi, accum_hilo, accum_hihi;
+        __m512i tmp0_lo, tmp0_hi, tmp1_lo, tmp1_hi;
+
+        tmp0_lo = UNPCKLO(a00);
+        tmp0_hi = UNPCKHI(a00);
+        tmp1_lo = UNPCKLO(a01);
+        tmp1_hi = UNPCKHI(a01);
+        accum_lolo = _mm512_madd_epi16(c00_01, _mm512_unpacklo_epi16(tmp0_lo, tmp1_lo));
+        accum_lohi = _mm512_madd_epi16(c00_01, _mm512_unpackhi_epi16(tmp0_lo, tmp1_lo));
+        accum_hilo = _mm512_madd_epi16(c00_01, _mm512_unpacklo_epi16(tmp0_hi, tmp1_hi));
+        accum_hihi = _mm512_madd_epi16(c00_01, _mm512_unpackhi_epi16(tmp0_hi, tmp1_hi));
+
+        tmp0_lo = UNPCKLO(a02);
+        tmp0_hi = UNPCKHI(a02);
+        tmp1_lo = UNPCKLO(a10);
+        tmp1_hi = UNPCKHI(a10);
+        accum_lolo = _mm512_add_epi32(accum_lolo, _mm512_madd_epi16(c02_10, _mm512_unpacklo_epi16(tmp0_lo, tmp1_lo)));
+        accum_lohi = _mm512_add_epi32(accum_lohi, _mm512_madd_epi16(c02_10, _mm512_unpackhi_epi16(tmp0_lo, tmp1_lo)));
+        accum_hilo = _mm512_add_epi32(accum_hilo, _mm512_madd_epi16(c02_10, _mm512_unpacklo_epi16(tmp0_hi, tmp1_hi)));
+        accum_hihi = _mm512_add_epi32(accum_hihi, _mm512_madd_epi16(c02_10, _mm512_unpackhi_epi16(tmp0_hi, tmp1_hi)));
+
+        tmp0_lo = UNPCKLO(a11);
+        tmp0_hi = UNPCKHI(a11);
+        tmp1_lo = UNPCKLO(a12);
+        tmp1_hi = UNPCKHI(a12);
+        accum_lolo = _mm512_add_epi32(accum_lolo, _mm512_madd_epi16(c11_12, _mm512_unpacklo_epi16(tmp0_lo, tmp1_lo)));
+        accum_lohi = _mm512_add_epi32(accum_lohi, _mm512_madd_epi16(c11_12, _mm512_unpackhi_epi16(tmp0_lo, tmp1_lo)));
+        accum_hilo = _mm512_add_epi32(accum_hilo, _mm512_madd_epi16(c11_12, _mm512_unpacklo_epi16(tmp0_hi, tmp1_hi)));
+        accum_hihi = _mm512_add_epi32(accum_hihi, _mm512_madd_epi16(c11_12, _mm512_unpackhi_epi16(tmp0_hi, tmp1_hi)));
+
+        tmp0_lo = UNPCKLO(a20);
+        tmp0_hi = UNPCKHI(a20);
+        tmp1_lo = UNPCKLO(a21);
+        tmp1_hi = UNPCKHI(a21);
+        accum_lolo = _mm512_add_epi32(accum_lolo, _mm512_madd_epi16(c20_21, _mm512_unpacklo_epi16(tmp0_lo, tmp1_lo)));
+        accum_lohi = _mm512_add_epi32(accum_lohi, _mm512_madd_epi16(c20_21, _mm512_unpackhi_epi16(tmp0_lo, tmp1_lo)));
+        accum_hilo = _mm512_add_epi32(accum_hilo, _mm512_madd_epi16(c20_21, _mm512_unpacklo_epi16(tmp0_hi, tmp1_hi)));
+        accum_hihi = _mm512_add_epi32(accum_hihi, _mm512_madd_epi16(c20_21, _mm512_unpackhi_epi16(tmp0_hi, tmp1_hi)));
+
+        tmp0_lo = UNPCKLO(a22);
+        tmp0_hi = UNPCKHI(a22);
+        accum_lolo = _mm512_add_epi32(accum_lolo, _mm512_madd_epi16(c22_xx, _mm512_unpacklo_epi16(tmp0_lo, _mm512_setzero_si512())));
+        accum_lohi = _mm512_add_epi32(accum_lohi, _mm512_madd_epi16(c22_xx, _mm512_unpackhi_epi16(tmp0_lo, _mm512_setzero_si512())));
+        accum_hilo = _mm512_add_epi32(accum_hilo, _mm512_madd_epi16(c22_xx, _mm512_unpacklo_epi16(tmp0_hi, _mm512_setzero_si512())));
+        accum_hihi = _mm512_add_epi32(accum_hihi, _mm512_madd_epi16(c22_xx, _mm512_unpackhi_epi16(tmp0_hi, _mm512_setzero_si512())));
+
+        __m512 tmpf_lolo = _mm512_cvtepi32_ps(accum_lolo);
+        __m512 tmpf_lohi = _mm512_cvtepi32_ps(accum_lohi);
+        __m512 tmpf_hilo = _mm512_cvtepi32_ps(accum_hilo);
+        __m512 tmpf_hihi = _mm512_cvtepi32_ps(accum_hihi);
+        tmpf_lolo = _mm512_add_ps(_mm512_mul_ps(tmpf_lolo, div), bias);
+        tmpf_lohi = _mm512_add_ps(_mm512_mul_ps(tmpf_lohi, div), bias);
+        tmpf_hilo = _mm512_add_ps(_mm512_mul_ps(tmpf_hilo, div), bias);
+        tmpf_hihi = _mm512_add_ps(_mm512_mul_ps(tmpf_hihi, div), bias);
+        tmpf_lolo = and_ps(tmpf_lolo, saturate_mask);
+        tmpf_lohi = and_ps(tmpf_lohi, saturate_mask);
+        tmpf_hilo = and_ps(tmpf_hilo, saturate_mask);
+        tmpf_hihi = and_ps(tmpf_hihi, saturate_mask);
+
+        accum_lolo = _mm512_cvtps_epi32(tmpf_lolo);
+        accum_lohi = _mm512_cvtps_epi32(tmpf_lohi);
+        accum_hilo = _mm512_cvtps_epi32(tmpf_hilo);
+        accum_hihi = _mm512_cvtps_epi32(tmpf_hihi);
+
+        accum_lolo = _mm512_packs_epi32(accum_lolo, accum_lohi);
+        accum_hilo = _mm512_packs_epi32(accum_hilo, accum_hihi);
+        accum_lolo = _mm512_packus_epi16(accum_lolo, accum_hilo);
+        return accum_lolo;
+#undef UNPCKHI
+#undef UNPCKLO
+    }
+};
+
+struct ConvolutionWord : ConvolutionIntTraits, WordTraits {
+    __m512i maxval;
+
+    explicit ConvolutionWord(const vs_generic_params &params) :
+        ConvolutionIntTraits(params),
+        maxval(_mm512_set1_epi16(params.maxval))
+    {
+        int32_t x = 0;
+
+        for (unsigned i = 0; i < 9; ++i) {
+            x += params.matrix[i];
+        }
+
+        // Use the 10th weight to subtract the bias "INT16_MIN * sum(matrix)"
+        c22_xx = _mm512_set1_epi32(interleave(params.matrix[8], static_cast<int16_t>(-x)));
+    }
+
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+        __m512i accum_lo, accum_hi;
+
+        a00 = _mm512_add_epi16(a00, _mm512_set1_epi16(INT16_MIN));
+        a01 = _mm512_add_epi16(a01, _mm512_set1_epi16(INT16_MIN));
+        a02 = _mm512_add_epi16(a02, _mm512_set1_epi16(INT16_MIN));
+        a10 = _mm512_add_epi16(a10, _mm512_set1_epi16(INT16_MIN));
+        a11 = _mm512_add_epi16(a11, _mm512_set1_epi16(INT16_MIN));
+        a12 = _mm512_add_epi16(a12, _mm512_set1_epi16(INT16_MIN));
+        a20 = _mm512_add_epi16(a20, _mm512_set1_epi16(INT16_MIN));
+        a21 = _mm512_add_epi16(a21, _mm512_set1_epi16(INT16_MIN));
+        a22 = _mm512_add_epi16(a22, _mm512_set1_epi16(INT16_MIN));
+
+        accum_lo = _mm512_madd_epi16(c00_01, _mm512_unpacklo_epi16(a00, a01));
+        accum_hi = _mm512_madd_epi16(c00_01, _mm512_unpackhi_epi16(a00, a01));
+        accum_lo = _mm512_add_epi32(accum_lo, _mm512_madd_epi16(c02_10, _mm512_unpacklo_epi16(a02, a10)));
+        accum_hi = _mm512_add_epi32(accum_hi, _mm512_madd_epi16(c02_10, _mm512_unpackhi_epi16(a02, a10)));
+        accum_lo = _mm512_add_epi32(accum_lo, _mm512_madd_epi16(c11_12, _mm512_unpacklo_epi16(a11, a12)));
+        accum_hi = _mm512_add_epi32(accum_hi, _mm512_madd_epi16(c11_12, _mm512_unpackhi_epi16(a11, a12)));
+        accum_lo = _mm512_add_epi32(accum_lo, _mm512_madd_epi16(c20_21, _mm512_unpacklo_epi16(a20, a21)));
+        accum_hi = _mm512_add_epi32(accum_hi, _mm512_madd_epi16(c20_21, _mm512_unpackhi_epi16(a20, a21)));
+        accum_lo = _mm512_add_epi32(accum_lo, _mm512_madd_epi16(c22_xx, _mm512_unpacklo_epi16(a22, _mm512_set1_epi16(INT16_MIN))));
+        accum_hi = _mm512_add_epi32(accum_hi, _mm512_madd_epi16(c22_xx, _mm512_unpackhi_epi16(a22, _mm512_set1_epi16(INT16_MIN))));
+
+        __m512 tmpf_lo = _mm512_cvtepi32_ps(accum_lo);
+        __m512 tmpf_hi = _mm512_cvtepi32_ps(accum_hi);
+        tmpf_lo = _mm512_add_ps(_mm512_mul_ps(tmpf_lo, div), bias);
+        tmpf_hi = _mm512_add_ps(_mm512_mul_ps(tmpf_hi, div), bias);
+        tmpf_lo = and_ps(tmpf_lo, saturate_mask);
+        tmpf_hi = and_ps(tmpf_hi, saturate_mask);
+
+        accum_lo = _mm512_cvtps_epi32(tmpf_lo);
+        accum_hi = _mm512_cvtps_epi32(tmpf_hi);
+
+        __m512i tmp = _mm512_packus_epi32(accum_lo, accum_hi);
+        return _mm512_min_epu16(tmp, maxval);
+    }
+};
+
+struct ConvolutionFloat : ConvolutionTraits, FloatTraits {
+    __m512 c00, c01, c02, c10, c11, c12, c20, c21, c22;
+
+    explicit ConvolutionFloat(const vs_generic_params &params) :
+        ConvolutionTraits(params),
+        c00(_mm512_set1_ps(params.matrixf[0] * params.div)),
+        c01(_mm512_set1_ps(params.matrixf[1] * params.div)),
+        c02(_mm512_set1_ps(params.matrixf[2] * params.div)),
+        c10(_mm512_set1_ps(params.matrixf[3] * params.div)),
+        c11(_mm512_set1_ps(params.matrixf[4] * params.div)),
+        c12(_mm512_set1_ps(params.matrixf[5] * params.div)),
+        c20(_mm512_set1_ps(params.matrixf[6] * params.div)),
+        c21(_mm512_set1_ps(params.matrixf[7] * params.div)),
+        c22(_mm512_set1_ps(params.matrixf[8] * params.div))
+    {}
+
+    FORCE_INLINE vec_type op(OP_ARGS)
+    {
+        PROLOGUE();
+
+        __m512 accum0 = _mm512_mul_ps(c00, a00);
+        __m512 accum1 = _mm512_mul_ps(c01, a01);
+        accum0 = _mm512_fmadd_ps(c02, a02, accum0);
+        accum1 = _mm512_fmadd_ps(c10, a10, accum1);
+        accum0 = _mm512_fmadd_ps(c11, a11, accum0);
+        accum1 = _mm512_fmadd_ps(c12, a12, accum1);
+        accum0 = _mm512_fmadd_ps(c20, a20, accum0);
+        accum1 = _mm512_fmadd_ps(c21, a21, accum1);
+        accum0 = _mm512_fmadd_ps(c22, a22, accum0);
+        accum1 = _mm512_add_ps(accum1, bias);
+
+        __m512 tmp = _mm512_add_ps(accum0, accum1);
+        tmp = and_ps(tmp, saturate_mask);
+        return tmp;
+    }
+};
+#undef PROLOGUE
+#undef OP_ARGS
+
+
+template <class Traits>
+void filter_plane_3x3(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const vs_generic_params &params, unsigned width, unsigned height)
+{
+    typedef typename Traits::T T;
+    typedef typename Traits::vec_type vec_type;
+    typedef typename Traits::mask_type mask_type;
+
+    Traits traits{ params };
+
+    unsigned vec_end = (width - 1) & ~(Traits::vec_len - 1);
+
+#define INVOKE(p0, p1, p2) (traits.op(Traits::loadu(p0 - 1), Traits::load(p0), Traits::loadu(p0 + 1), Traits::loadu(p1 - 1), Traits::load(p1), Traits::loadu(p1 + 1), Traits::loadu(p2 - 1), Traits::load(p2), Traits::loadu(p2 + 1)))
+    for (unsigned i = 0; i < height; ++i) {
+        unsigned above_idx = i == 0 ? std::min(1U, height - 1) : i - 1;
+        unsigned below_idx = i == height - 1 ? height - std::min(2U, height) : i + 1;
+
+        const T *srcp0 = static_cast<const T *>(line_ptr(src, above_idx, src_stride));
+        const T *srcp1 = static_cast<const T *>(line_ptr(src, i, src_stride));
+        const T *srcp2 = static_cast<const T *>(line_ptr(src, below_idx, src_stride));
+        T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
+
+        {
+            mask_type mask = Traits::tail_mask(width);
+
+            vec_type a01 = Traits::maskz_loadu(mask, srcp0);
+            vec_type a11 = Traits::maskz_loadu(mask, srcp1);
+            vec_type a21 = Traits::maskz_loadu(mask, srcp2);
+
+            vec_type a00 = Traits::shl_insert_lo(a01, srcp0[std::min(1U, width - 1)]);
+            vec_type a10 = Traits::shl_insert_lo(a11, srcp1[std::min(1U, width - 1)]);
+            vec_type a20 = Traits::shl_insert_lo(a21, srcp2[std::min(1U, width - 1)]);
+
+            vec_type a02, a12, a22;
+            if (width > Traits::vec_len) {
+                a02 = Traits::loadu(srcp0 + 1);
+                a12 = Traits::loadu(srcp1 + 1);
+                a22 = Traits::loadu(srcp2 + 1);
+            } else {
+                mask_type mask_right = Traits::tail_mask(width - 1);
+                a02 = Traits::insert(Traits::maskz_loadu(mask_right, srcp0 + 1), srcp0[width - std::min(2U, width)], width - 1);
+                a12 = Traits::insert(Traits::maskz_loadu(mask_right, srcp1 + 1), srcp1[width - std::min(2U, width)], width - 1);
+                a22 = Traits::insert(Traits::maskz_loadu(mask_right, srcp2 + 1), srcp2[width - std::min(2U, width)], width - 1);
+            }
+
+            vec_type val = traits.op(a00, a01, a02, a10, a11, a12, a20, a21, a22);
+            Traits::mask_storeu(dstp + 0, mask, val);
+        }
+
+        for (unsigned j = Traits::vec_len; j < vec_end; j += Traits::vec_len) {
+            vec_type val = INVOKE(srcp0 + j, srcp1 + j, srcp2 + j);
+            Traits::store(dstp + j, val);
+        }
+
+        if (vec_end >= Traits::vec_len) {
+            unsigned n = width - vec_end;
+            mask_type mask_left = Traits::tail_mask(n + 1);
+            mask_type mask = Traits::tail_mask(n);
+            mask_type mask_right = Traits::tail_mask(n - 1);
+
+            vec_type a00 = Traits::maskz_loadu(mask_left, srcp0 + vec_end - 1);
+            vec_type a10 = Traits::maskz_loadu(mask_left, srcp1 + vec_end - 1);
+            vec_type a20 = Traits::maskz_loadu(mask_left, srcp2 + vec_end - 1);
+
+            vec_type a01 = Traits::maskz_loadu(mask, srcp0 + vec_end);
+            vec_type a11 = Traits::maskz_loadu(mask, srcp1 + vec_end);
+            vec_type a21 = Traits::maskz_loadu(mask, srcp2 + vec_end);
+
+            vec_type a02 = Traits::insert(Traits::maskz_loadu(mask_right, srcp0 + vec_end + 1), srcp0[width - 2], n - 1);
+            vec_type a12 = Traits::insert(Traits::maskz_loadu(mask_right, srcp1 + vec_end + 1), srcp1[width - 2], n - 1);
+            vec_type a22 = Traits::insert(Traits::maskz_loadu(mask_right, srcp2 + vec_end + 1), srcp2[width - 2], n - 1);
+
+            vec_type val = traits.op(a00, a01, a02, a10, a11, a12, a20, a21, a22);
+            Traits::mask_storeu(dstp + vec_end, mask, val);
+        }
+    }
+#undef INVOKE
+}
+
+} // namespace
+
+
+void vs_generic_3x3_prewitt_byte_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<PrewittSobelByte<false>>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_prewitt_word_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<PrewittSobelWord<false>>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_prewitt_float_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<PrewittSobelFloat<false>>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_sobel_byte_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<PrewittSobelByte<true>>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_sobel_word_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<PrewittSobelWord<true>>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_sobel_float_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<PrewittSobelFloat<true>>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_min_byte_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    switch (params->stencil) {
+    case STENCIL_H:
+        filter_plane_3x3<MinMaxFixedByte<STENCIL_H, false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_V:
+        filter_plane_3x3<MinMaxFixedByte<STENCIL_V, false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_PLUS:
+        filter_plane_3x3<MinMaxFixedByte<STENCIL_PLUS, false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_ALL:
+        filter_plane_3x3<MinMaxFixedByte<STENCIL_ALL, false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    default:
+        filter_plane_3x3<MinMaxByte<false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    }
+}
+
+void vs_generic_3x3_min_word_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    switch (params->stencil) {
+    case STENCIL_H:
+        filter_plane_3x3<MinMaxFixedWord<STENCIL_H, false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_V:
+        filter_plane_3x3<MinMaxFixedWord<STENCIL_V, false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_PLUS:
+        filter_plane_3x3<MinMaxFixedWord<STENCIL_PLUS, false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_ALL:
+        filter_plane_3x3<MinMaxFixedWord<STENCIL_ALL, false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    default:
+        filter_plane_3x3<MinMaxWord<false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    }
+}
+
+void vs_generic_3x3_min_float_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    switch (params->stencil) {
+    case STENCIL_H:
+        filter_plane_3x3<MinMaxFixedFloat<STENCIL_H, false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_V:
+        filter_plane_3x3<MinMaxFixedFloat<STENCIL_V, false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_PLUS:
+        filter_plane_3x3<MinMaxFixedFloat<STENCIL_PLUS, false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_ALL:
+        filter_plane_3x3<MinMaxFixedFloat<STENCIL_ALL, false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    default:
+        filter_plane_3x3<MinMaxFloat<false>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    }
+}
+
+void vs_generic_3x3_max_byte_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    switch (params->stencil) {
+    case STENCIL_H:
+        filter_plane_3x3<MinMaxFixedByte<STENCIL_H, true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_V:
+        filter_plane_3x3<MinMaxFixedByte<STENCIL_V, true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_PLUS:
+        filter_plane_3x3<MinMaxFixedByte<STENCIL_PLUS, true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_ALL:
+        filter_plane_3x3<MinMaxFixedByte<STENCIL_ALL, true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    default:
+        filter_plane_3x3<MinMaxByte<true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    }
+}
+
+void vs_generic_3x3_max_word_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    switch (params->stencil) {
+    case STENCIL_H:
+        filter_plane_3x3<MinMaxFixedWord<STENCIL_H, true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_V:
+        filter_plane_3x3<MinMaxFixedWord<STENCIL_V, true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_PLUS:
+        filter_plane_3x3<MinMaxFixedWord<STENCIL_PLUS, true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_ALL:
+        filter_plane_3x3<MinMaxFixedWord<STENCIL_ALL, true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    default:
+        filter_plane_3x3<MinMaxWord<true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    }
+}
+
+void vs_generic_3x3_max_float_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    switch (params->stencil) {
+    case STENCIL_H:
+        filter_plane_3x3<MinMaxFixedFloat<STENCIL_H, true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_V:
+        filter_plane_3x3<MinMaxFixedFloat<STENCIL_V, true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_PLUS:
+        filter_plane_3x3<MinMaxFixedFloat<STENCIL_PLUS, true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    case STENCIL_ALL:
+        filter_plane_3x3<MinMaxFixedFloat<STENCIL_ALL, true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    default:
+        filter_plane_3x3<MinMaxFloat<true>>(src, src_stride, dst, dst_stride, *params, width, height);
+        break;
+    }
+}
+
+void vs_generic_3x3_median_byte_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<MedianByte>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_median_word_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<MedianWord>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_median_float_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<MedianFloat>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_deflate_byte_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<DeflateInflateByte<false>>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_deflate_word_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<DeflateInflateWord<false>>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_deflate_float_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<DeflateInflateFloat<false>>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_inflate_byte_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<DeflateInflateByte<true>>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_inflate_word_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<DeflateInflateWord<true>>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_inflate_float_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<DeflateInflateFloat<true>>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_conv_byte_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<ConvolutionByte>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_conv_word_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<ConvolutionWord>(src, src_stride, dst, dst_stride, *params, width, height);
+}
+
+void vs_generic_3x3_conv_float_avx512(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height)
+{
+    filter_plane_3x3<ConvolutionFloat>(src, src_stride, dst, dst_stride, *params, width, height);
+}
@@ -0,0 +1,59 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include <immintrin.h>
+#include "../half.h"
+
+/* Uses F16C, which every CPU with AVX2 has. The tail is converted through a vector on the stack so
+ * neither side is accessed beyond n. */
+void vs_half_to_float_avx2(const void *src, float *dst, unsigned n)
+{
+    const uint16_t *srcp = src;
+    unsigned i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(srcp + i))));
+    }
+    if (i < n) {
+        uint16_t in[8] = { 0 };
+        float out[8];
+        memcpy(in, srcp + i, (n - i) * sizeof(uint16_t));
+        _mm256_storeu_ps(out, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)in)));
+        memcpy(dst + i, out, (n - i) * sizeof(float));
+    }
+}
+
+void vs_float_to_half_avx2(const float *src, void *dst, unsigned n)
+{
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        _mm_storeu_si128((__m128i *)(dstp + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    }
+    if (i < n) {
+        float in[8] = { 0 };
+        uint16_t out[8];
+        memcpy(in, src + i, (n - i) * sizeof(float));
+        _mm_storeu_si128((__m128i *)out, _mm256_cvtps_ph(_mm256_loadu_ps(in), _MM_FROUND_TO_NEAREST_INT));
+        memcpy(dstp + i, out, (n - i) * sizeof(uint16_t));
+    }
+}
@@ -0,0 +1,156 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <immintrin.h>
+#include "../lut.h"
+
+static inline __m256i lut_gather_byte(const void *lut, __m256i idx)
+{
+    return _mm256_and_si256(_mm256_i32gather_epi32((const int *)lut, idx, 1), _mm256_set1_epi32(0xFF));
+}
+
+static inline __m256i lut_gather_word(const void *lut, __m256i idx)
+{
+    return _mm256_and_si256(_mm256_i32gather_epi32((const int *)lut, idx, 2), _mm256_set1_epi32(0xFFFF));
+}
+
+static inline __m256 lut_gather_float(const void *lut, __m256i idx)
+{
+    return _mm256_i32gather_ps((const float *)lut, idx, 4);
+}
+
+static inline void lut_store_byte(uint8_t *dstp, __m256i lo, __m256i hi)
+{
+    __m256i w = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+    __m256i b = _mm256_permute4x64_epi64(_mm256_packus_epi16(w, w), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_store_si128((__m128i *)dstp, _mm256_castsi256_si128(b));
+}
+
+static inline void lut_store_word(uint16_t *dstp, __m256i lo, __m256i hi)
+{
+    __m256i w = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_store_si256((__m256i *)dstp, w);
+}
+
+void vs_lut_byte_byte_avx2(const void *src, void *dst, const void *lut, unsigned maxval, unsigned n)
+{
+    const uint8_t *srcp = src;
+    uint8_t *dstp = dst;
+    const uint8_t *table = lut;
+    __m256i tables[16];
+    unsigned i, h;
+
+    (void)maxval;
+
+    for (h = 0; h < 16; h++) {
+        tables[h] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(table + h * 16)));
+    }
+
+    for (i = 0; i < n; i += 32) {
+        __m256i x = _mm256_load_si256((const __m256i *)(srcp + i));
+        __m256i result = _mm256_setzero_si256();
+
+        for (h = 0; h < 16; h++) {
+            // entries of sub-table h end up in 0x70-0x7F, everything else saturates to 0x80 or above and shuffles to 0
+            __m256i idx = _mm256_adds_epu8(_mm256_xor_si256(x, _mm256_set1_epi8((char)(h << 4))), _mm256_set1_epi8(0x70));
+            result = _mm256_or_si256(result, _mm256_shuffle_epi8(tables[h], idx));
+        }
+
+        _mm256_store_si256((__m256i *)(dstp + i), result);
+    }
+}
+
+void vs_lut_byte_word_avx2(const void *src, void *dst, const void *lut, unsigned maxval, unsigned n)
+{
+    const uint8_t *srcp = src;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    (void)maxval;
+
+    for (i = 0; i < n; i += 16) {
+        __m128i x = _mm_load_si128((const __m128i *)(srcp + i));
+        __m256i lo = lut_gather_word(lut, _mm256_cvtepu8_epi32(x));
+        __m256i hi = lut_gather_word(lut, _mm256_cvtepu8_epi32(_mm_srli_si128(x, 8)));
+        lut_store_word(dstp + i, lo, hi);
+    }
+}
+
+void vs_lut_byte_float_avx2(const void *src, void *dst, const void *lut, unsigned maxval, unsigned n)
+{
+    const uint8_t *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    (void)maxval;
+
+    for (i = 0; i < n; i += 16) {
+        __m128i x = _mm_load_si128((const __m128i *)(srcp + i));
+        _mm256_store_ps(dstp + i + 0, lut_gather_float(lut, _mm256_cvtepu8_epi32(x)));
+        _mm256_store_ps(dstp + i + 8, lut_gather_float(lut, _mm256_cvtepu8_epi32(_mm_srli_si128(x, 8))));
+    }
+}
+
+void vs_lut_word_byte_avx2(const void *src, void *dst, const void *lut, unsigned maxval, unsigned n)
+{
+    const uint16_t *srcp = src;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    __m256i lim = _mm256_set1_epi32(maxval);
+
+    for (i = 0; i < n; i += 16) {
+        __m256i x = _mm256_load_si256((const __m256i *)(srcp + i));
+        __m256i lo = lut_gather_byte(lut, _mm256_min_epu32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(x)), lim));
+        __m256i hi = lut_gather_byte(lut, _mm256_min_epu32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(x, 1)), lim));
+        lut_store_byte(dstp + i, lo, hi);
+    }
+}
+
+void vs_lut_word_word_avx2(const void *src, void *dst, const void *lut, unsigned maxval, unsigned n)
+{
+    const uint16_t *srcp = src;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    __m256i lim = _mm256_set1_epi32(maxval);
+
+    for (i = 0; i < n; i += 16) {
+        __m256i x = _mm256_load_si256((const __m256i *)(srcp + i));
+        __m256i lo = lut_gather_word(lut, _mm256_min_epu32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(x)), lim));
+        __m256i hi = lut_gather_word(lut, _mm256_min_epu32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(x, 1)), lim));
+        lut_store_word(dstp + i, lo, hi);
+    }
+}
+
+void vs_lut_word_float_avx2(const void *src, void *dst, const void *lut, unsigned maxval, unsigned n)
+{
+    const uint16_t *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    __m256i lim = _mm256_set1_epi32(maxval);
+
+    for (i = 0; i < n; i += 16) {
+        __m256i x = _mm256_load_si256((const __m256i *)(srcp + i));
+        _mm256_store_ps(dstp + i + 0, lut_gather_float(lut, _mm256_min_epu32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(x)), lim)));
+        _mm256_store_ps(dstp + i + 8, lut_gather_float(lut, _mm256_min_epu32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(x, 1)), lim)));
+    }
+}
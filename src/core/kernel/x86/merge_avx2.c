@@ -104,6 +104,49 @@ void vs_merge_float_avx2(const void *src1, const void *src2, void *dst, union vs
     }
 }
 
+/* The F16 kernels convert to float with F16C and otherwise do the same as the float ones */
+static __m256 load_half(const uint16_t *p)
+{
+    return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)p));
+}
+
+static void store_half(uint16_t *p, __m256 x)
+{
+    _mm_storeu_si128((__m128i *)p, _mm256_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT));
+}
+
+void vs_premultiply_half_avx2(const void *src1, const void *src2, void *dst, unsigned depth, unsigned offset, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+    (void)offset;
+
+    for (i = 0; i < n; i += 8) {
+        store_half(dstp + i, _mm256_mul_ps(load_half(srcp1 + i), load_half(srcp2 + i)));
+    }
+}
+
+void vs_merge_half_avx2(const void *src1, const void *src2, void *dst, union vs_merge_weight weight, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    __m256 w2 = _mm256_set1_ps(weight.f);
+    __m256 w1 = _mm256_set1_ps(1.0f - weight.f);
+
+    for (i = 0; i < n; i += 8) {
+        __m256 v1 = load_half(srcp1 + i);
+        __m256 v2 = load_half(srcp2 + i);
+        store_half(dstp + i, _mm256_fmadd_ps(w1, v1, _mm256_mul_ps(w2, v2)));
+    }
+}
+
 
 static __m256i div255_epu16(__m256i x)
 {
@@ -214,6 +257,26 @@ void vs_mask_merge_float_avx2(const void *src1, const void *src2, const void *ma
     }
 }
 
+void vs_mask_merge_half_avx2(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    const uint16_t *maskp = mask;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+    (void)offset;
+
+    for (i = 0; i < n; i += 8) {
+        __m256 v1 = load_half(srcp1 + i);
+        __m256 v2 = load_half(srcp2 + i);
+        __m256 w2 = load_half(maskp + i);
+        __m256 diff = _mm256_sub_ps(v2, v1);
+        store_half(dstp + i, _mm256_fmadd_ps(diff, w2, v1));
+    }
+}
+
 void vs_mask_merge_premul_byte_avx2(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
 {
     const uint8_t *srcp1 = src1;
@@ -316,11 +379,30 @@ void vs_mask_merge_premul_float_avx2(const void *src1, const void *src2, const v
         __m256 v1 = _mm256_load_ps(srcp1 + i);
         __m256 v2 = _mm256_load_ps(srcp2 + i);
         __m256 w1 = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_load_ps(maskp + i));
-        __m256 result = _mm256_fmadd_ps(v2, w1, v1);
+        __m256 result = _mm256_fmadd_ps(v1, w1, v2);
         _mm256_store_ps(dstp + i, result);
     }
 }
 
+void vs_mask_merge_premul_half_avx2(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    const uint16_t *maskp = mask;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+    (void)offset;
+
+    for (i = 0; i < n; i += 8) {
+        __m256 v1 = load_half(srcp1 + i);
+        __m256 v2 = load_half(srcp2 + i);
+        __m256 w1 = _mm256_sub_ps(_mm256_set1_ps(1.0f), load_half(maskp + i));
+        store_half(dstp + i, _mm256_fmadd_ps(v1, w1, v2));
+    }
+}
+
 void vs_makediff_byte_avx2(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
 {
     const uint8_t *srcp1 = src1;
@@ -375,6 +457,20 @@ void vs_makediff_float_avx2(const void *src1, const void *src2, void *dst, unsig
     }
 }
 
+void vs_makediff_half_avx2(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+
+    for (i = 0; i < n; i += 8) {
+        store_half(dstp + i, _mm256_sub_ps(load_half(srcp1 + i), load_half(srcp2 + i)));
+    }
+}
+
 void vs_mergediff_byte_avx2(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
 {
     const uint8_t *srcp1 = src1;
@@ -428,3 +524,131 @@ void vs_mergediff_float_avx2(const void *src1, const void *src2, void *dst, unsi
         _mm256_store_ps(dstp + i, _mm256_add_ps(v1, v2));
     }
 }
+
+void vs_mergediff_half_avx2(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+
+    for (i = 0; i < n; i += 8) {
+        store_half(dstp + i, _mm256_add_ps(load_half(srcp1 + i), load_half(srcp2 + i)));
+    }
+}
+
+void vs_mask_subsample_byte_avx2(const void * const rows[4], void *tmp, void *dst, unsigned n)
+{
+    const uint8_t *r0 = rows[0];
+    const uint8_t *r1 = rows[1];
+    const uint8_t *r2 = rows[2];
+    const uint8_t *r3 = rows[3];
+    uint16_t *vsum = tmp;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    const __m256i taps_a = _mm256_set1_epi32(0x00030001);
+    const __m256i taps_b = _mm256_set1_epi32(0x00010003);
+
+    for (i = 0; i < 2 * n; i += 16) {
+        __m256i outer = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(r0 + i))), _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(r3 + i))));
+        __m256i inner = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(r1 + i))), _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(r2 + i))));
+        _mm256_storeu_si256((__m256i *)(vsum + 1 + i), _mm256_add_epi16(outer, _mm256_add_epi16(inner, _mm256_add_epi16(inner, inner))));
+    }
+
+    vsum[0] = vsum[1];
+    vsum[2 * n + 1] = vsum[2 * n];
+
+    for (i = 0; i < n; i += 16) {
+        __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(vsum + 2 * i)), taps_a),
+                                      _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(vsum + 2 * i + 2)), taps_b));
+        __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(vsum + 2 * i + 16)), taps_a),
+                                      _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(vsum + 2 * i + 18)), taps_b));
+        __m256i x;
+
+        lo = _mm256_srli_epi32(_mm256_add_epi32(lo, _mm256_set1_epi32(32)), 6);
+        hi = _mm256_srli_epi32(_mm256_add_epi32(hi, _mm256_set1_epi32(32)), 6);
+        x = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_store_si128((__m128i *)(dstp + i), _mm_packus_epi16(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1)));
+    }
+}
+
+/* Deinterleaves the even and odd 32-bit elements of two vectors, the shuffles work per lane so the
+ * 64-bit halves are put back in order afterwards. */
+static void deinterleave_ps(__m256 a, __m256 b, __m256 *even, __m256 *odd)
+{
+    *even = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+    *odd = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+static __m256i mask_subsample_epu32(const uint32_t *vsum)
+{
+    __m256 a0, a1, b0, b1;
+    __m256i x;
+
+    deinterleave_ps(_mm256_loadu_ps((const float *)vsum), _mm256_loadu_ps((const float *)(vsum + 8)), &a0, &a1);
+    deinterleave_ps(_mm256_loadu_ps((const float *)(vsum + 2)), _mm256_loadu_ps((const float *)(vsum + 10)), &b0, &b1);
+
+    x = _mm256_add_epi32(_mm256_castps_si256(a1), _mm256_castps_si256(b0));
+    x = _mm256_add_epi32(_mm256_add_epi32(_mm256_castps_si256(a0), _mm256_castps_si256(b1)), _mm256_add_epi32(x, _mm256_add_epi32(x, x)));
+    return _mm256_srli_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(32)), 6);
+}
+
+void vs_mask_subsample_word_avx2(const void * const rows[4], void *tmp, void *dst, unsigned n)
+{
+    const uint16_t *r0 = rows[0];
+    const uint16_t *r1 = rows[1];
+    const uint16_t *r2 = rows[2];
+    const uint16_t *r3 = rows[3];
+    uint32_t *vsum = tmp;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    for (i = 0; i < 2 * n; i += 8) {
+        __m256i outer = _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm_load_si128((const __m128i *)(r0 + i))), _mm256_cvtepu16_epi32(_mm_load_si128((const __m128i *)(r3 + i))));
+        __m256i inner = _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm_load_si128((const __m128i *)(r1 + i))), _mm256_cvtepu16_epi32(_mm_load_si128((const __m128i *)(r2 + i))));
+        _mm256_storeu_si256((__m256i *)(vsum + 1 + i), _mm256_add_epi32(outer, _mm256_add_epi32(inner, _mm256_add_epi32(inner, inner))));
+    }
+
+    vsum[0] = vsum[1];
+    vsum[2 * n + 1] = vsum[2 * n];
+
+    for (i = 0; i < n; i += 16) {
+        __m256i lo = mask_subsample_epu32(vsum + 2 * i);
+        __m256i hi = mask_subsample_epu32(vsum + 2 * i + 16);
+        _mm256_store_si256((__m256i *)(dstp + i), _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+}
+
+void vs_mask_subsample_float_avx2(const void * const rows[4], void *tmp, void *dst, unsigned n)
+{
+    const float *r0 = rows[0];
+    const float *r1 = rows[1];
+    const float *r2 = rows[2];
+    const float *r3 = rows[3];
+    float *vsum = tmp;
+    float *dstp = dst;
+    unsigned i;
+
+    const __m256 three = _mm256_set1_ps(3.0f);
+
+    for (i = 0; i < 2 * n; i += 8) {
+        __m256 outer = _mm256_add_ps(_mm256_load_ps(r0 + i), _mm256_load_ps(r3 + i));
+        __m256 inner = _mm256_add_ps(_mm256_load_ps(r1 + i), _mm256_load_ps(r2 + i));
+        _mm256_storeu_ps(vsum + 1 + i, _mm256_add_ps(outer, _mm256_mul_ps(inner, three)));
+    }
+
+    vsum[0] = vsum[1];
+    vsum[2 * n + 1] = vsum[2 * n];
+
+    for (i = 0; i < n; i += 8) {
+        __m256 a0, a1, b0, b1;
+
+        deinterleave_ps(_mm256_loadu_ps(vsum + 2 * i), _mm256_loadu_ps(vsum + 2 * i + 8), &a0, &a1);
+        deinterleave_ps(_mm256_loadu_ps(vsum + 2 * i + 2), _mm256_loadu_ps(vsum + 2 * i + 10), &b0, &b1);
+
+        _mm256_store_ps(dstp + i, _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(a0, b1), _mm256_mul_ps(_mm256_add_ps(a1, b0), three)), _mm256_set1_ps(1.0f / 64)));
+    }
+}
@@ -0,0 +1,569 @@
+/*
+* Copyright (c) 2012-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <immintrin.h>
+#define VS_MERGE_IMPL
+#include "../merge.h"
+#include "VSHelper4.h"
+
+#define MERGESHIFT 15
+#define ROUND (1U << (MERGESHIFT - 1))
+
+/* The last vector of a row is loaded and stored with a mask, nothing past n is touched. */
+static __mmask64 tail_mask64(unsigned n)
+{
+    return n >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << n) - 1;
+}
+
+static __mmask32 tail_mask32(unsigned n)
+{
+    return n >= 32 ? ~(__mmask32)0 : ((__mmask32)1 << n) - 1;
+}
+
+static __mmask16 tail_mask16(unsigned n)
+{
+    return n >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1U << n) - 1);
+}
+
+/* Same saturation as packus_epi16 without the lane interleave. */
+static __m256i packus_epi16(__m512i x)
+{
+    return _mm512_cvtusepi16_epi8(_mm512_max_epi16(x, _mm512_setzero_si512()));
+}
+
+/* Negates the elements where s is all ones. */
+static __m512i cond_neg_epi32(__m512i x, __m512i s)
+{
+    return _mm512_sub_epi32(_mm512_xor_si512(x, s), s);
+}
+
+void vs_merge_byte_avx512(const void *src1, const void *src2, void *dst, union vs_merge_weight weight, unsigned n)
+{
+    const uint8_t *srcp1 = src1;
+    const uint8_t *srcp2 = src2;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    __m512i w = _mm512_set1_epi16(weight.u);
+
+    for (i = 0; i < n; i += 32) {
+        __mmask32 m = tail_mask32(n - i);
+        __m512i v1 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, srcp1 + i));
+        __m512i v2 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, srcp2 + i));
+
+        // tmp1 = (v2 - v1) * 2
+        __m512i tmp1 = _mm512_slli_epi16(_mm512_sub_epi16(v2, v1), 1);
+        // tmp2 = ((tmp1 * w) >> 16) + (((tmp1 * w) >> 15) & 1)
+        __m512i tmp2 = _mm512_add_epi16(_mm512_add_epi16(_mm512_mulhi_epi16(tmp1, w), _mm512_srli_epi16(_mm512_mullo_epi16(tmp1, w), 15)), v1);
+
+        _mm256_mask_storeu_epi8(dstp + i, m, packus_epi16(tmp2));
+    }
+}
+
+void vs_merge_word_avx512(const void *src1, const void *src2, void *dst, union vs_merge_weight weight, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    unsigned w2 = VSMIN(VSMAX(weight.u, 1U), (1U << MERGESHIFT) - 1);
+    unsigned w1 = (1U << MERGESHIFT) - w2;
+    __m512i w = _mm512_set1_epi32((w2 << 16) | w1);
+
+    for (i = 0; i < n; i += 32) {
+        __mmask32 m = tail_mask32(n - i);
+        __m512i v1 = _mm512_maskz_loadu_epi16(m, srcp1 + i);
+        __m512i v2 = _mm512_maskz_loadu_epi16(m, srcp2 + i);
+        __m512i tmplo, tmphi, result;
+
+        v1 = _mm512_add_epi16(v1, _mm512_set1_epi16(INT16_MIN));
+        v2 = _mm512_add_epi16(v2, _mm512_set1_epi16(INT16_MIN));
+        tmplo = _mm512_unpacklo_epi16(v1, v2);
+        tmphi = _mm512_unpackhi_epi16(v1, v2);
+
+        // w1 * v1 + w2 * v2
+        tmplo = _mm512_madd_epi16(w, tmplo);
+        tmplo = _mm512_add_epi32(tmplo, _mm512_set1_epi32(ROUND));
+        tmplo = _mm512_srai_epi32(tmplo, MERGESHIFT);
+
+        tmphi = _mm512_madd_epi16(w, tmphi);
+        tmphi = _mm512_add_epi32(tmphi, _mm512_set1_epi32(ROUND));
+        tmphi = _mm512_srai_epi32(tmphi, MERGESHIFT);
+
+        result = _mm512_packs_epi32(tmplo, tmphi);
+        result = _mm512_sub_epi16(result, _mm512_set1_epi16(INT16_MIN));
+        _mm512_mask_storeu_epi16(dstp + i, m, result);
+    }
+}
+
+void vs_merge_float_avx512(const void *src1, const void *src2, void *dst, union vs_merge_weight weight, unsigned n)
+{
+    const float *srcp1 = src1;
+    const float *srcp2 = src2;
+    float *dstp = dst;
+    unsigned i;
+
+    __m512 w2 = _mm512_set1_ps(weight.f);
+    __m512 w1 = _mm512_set1_ps(1.0f - weight.f);
+
+    for (i = 0; i < n; i += 16) {
+        __mmask16 m = tail_mask16(n - i);
+        __m512 v1 = _mm512_maskz_loadu_ps(m, srcp1 + i);
+        __m512 v2 = _mm512_maskz_loadu_ps(m, srcp2 + i);
+        _mm512_mask_storeu_ps(dstp + i, m, _mm512_fmadd_ps(w1, v1, _mm512_mul_ps(w2, v2)));
+    }
+}
+
+
+static __m512i div255_epu16(__m512i x)
+{
+    x = _mm512_mulhi_epu16(x, _mm512_set1_epi16(0x8081));
+    x = _mm512_srli_epi16(x, 7);
+    return x;
+}
+
+static __m512i divX_epu32(__m512i x, unsigned depth)
+{
+    __m512i lo = _mm512_unpacklo_epi32(x, x);
+    __m512i hi = _mm512_unpackhi_epi32(x, x);
+    __m512i div = _mm512_set1_epi32(div_table[depth - 9]);
+    lo = _mm512_mul_epu32(lo, div);
+    hi = _mm512_mul_epu32(hi, div);
+    x = _mm512_castps_si512(_mm512_shuffle_ps(_mm512_castsi512_ps(lo), _mm512_castsi512_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+    x = _mm512_srl_epi32(x, _mm_cvtsi32_si128(shift_table[depth - 9]));
+    return x;
+}
+
+void vs_mask_merge_byte_avx512(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
+{
+    const uint8_t *srcp1 = src1;
+    const uint8_t *srcp2 = src2;
+    const uint8_t *maskp = mask;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+    (void)offset;
+
+    for (i = 0; i < n; i += 32) {
+        __mmask32 m = tail_mask32(n - i);
+        __m512i v1 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, srcp1 + i));
+        __m512i v2 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, srcp2 + i));
+        __m512i w2 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, maskp + i));
+        __m512i w1 = _mm512_sub_epi16(_mm512_set1_epi16(UINT8_MAX), w2);
+        __m512i tmp1 = _mm512_mullo_epi16(v1, w1);
+        __m512i tmp2 = _mm512_mullo_epi16(v2, w2);
+        __m512i tmp;
+
+        tmp = _mm512_add_epi16(_mm512_add_epi16(tmp1, tmp2), _mm512_set1_epi16(UINT8_MAX / 2));
+        tmp = div255_epu16(tmp);
+
+        _mm256_mask_storeu_epi8(dstp + i, m, _mm512_cvtepi16_epi8(tmp));
+    }
+}
+
+void vs_mask_merge_word_avx512(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    const uint16_t *maskp = mask;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    uint16_t maxval = (1U << depth) - 1;
+    (void)offset;
+
+    for (i = 0; i < n; i += 32) {
+        __mmask32 m = tail_mask32(n - i);
+        __m512i v1 = _mm512_maskz_loadu_epi16(m, srcp1 + i);
+        __m512i v2 = _mm512_maskz_loadu_epi16(m, srcp2 + i);
+        __m512i w2 = _mm512_maskz_loadu_epi16(m, maskp + i);
+        __m512i w1 = _mm512_sub_epi16(_mm512_set1_epi16(maxval), w2);
+
+        __m512i tmp1lo = _mm512_mullo_epi16(w1, v1);
+        __m512i tmp1hi = _mm512_mulhi_epu16(w1, v1);
+        __m512i tmp2lo = _mm512_mullo_epi16(w2, v2);
+        __m512i tmp2hi = _mm512_mulhi_epu16(w2, v2);
+
+        __m512i tmp1d_lo = _mm512_unpacklo_epi16(tmp1lo, tmp1hi);
+        __m512i tmp1d_hi = _mm512_unpackhi_epi16(tmp1lo, tmp1hi);
+        __m512i tmp2d_lo = _mm512_unpacklo_epi16(tmp2lo, tmp2hi);
+        __m512i tmp2d_hi = _mm512_unpackhi_epi16(tmp2lo, tmp2hi);
+        __m512i tmp;
+
+        tmp1d_lo = _mm512_add_epi32(tmp1d_lo, tmp2d_lo);
+        tmp1d_lo = _mm512_add_epi32(tmp1d_lo, _mm512_set1_epi32(maxval / 2));
+        tmp1d_hi = _mm512_add_epi32(tmp1d_hi, tmp2d_hi);
+        tmp1d_hi = _mm512_add_epi32(tmp1d_hi, _mm512_set1_epi32(maxval / 2));
+
+        tmp1d_lo = divX_epu32(tmp1d_lo, depth);
+        tmp1d_hi = divX_epu32(tmp1d_hi, depth);
+        tmp = _mm512_packus_epi32(tmp1d_lo, tmp1d_hi);
+        _mm512_mask_storeu_epi16(dstp + i, m, tmp);
+    }
+}
+
+void vs_mask_merge_float_avx512(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
+{
+    const float *srcp1 = src1;
+    const float *srcp2 = src2;
+    const float *maskp = mask;
+    float *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+    (void)offset;
+
+    for (i = 0; i < n; i += 16) {
+        __mmask16 m = tail_mask16(n - i);
+        __m512 v1 = _mm512_maskz_loadu_ps(m, srcp1 + i);
+        __m512 v2 = _mm512_maskz_loadu_ps(m, srcp2 + i);
+        __m512 w2 = _mm512_maskz_loadu_ps(m, maskp + i);
+        __m512 diff = _mm512_sub_ps(v2, v1);
+        __m512 result = _mm512_fmadd_ps(diff, w2, v1);
+        _mm512_mask_storeu_ps(dstp + i, m, result);
+    }
+}
+
+void vs_mask_merge_premul_byte_avx512(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
+{
+    const uint8_t *srcp1 = src1;
+    const uint8_t *srcp2 = src2;
+    const uint8_t *maskp = mask;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+
+    for (i = 0; i < n; i += 32) {
+        __mmask32 m = tail_mask32(n - i);
+        __m512i v1 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, srcp1 + i));
+        __m512i v2 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, srcp2 + i));
+        __m512i w2 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, maskp + i));
+        __m512i w1 = _mm512_sub_epi16(_mm512_set1_epi16(UINT8_MAX), w2);
+        __mmask32 sign;
+        __m512i tmp;
+
+        // Premultiply v1.
+        tmp = _mm512_sub_epi16(v1, _mm512_set1_epi16(offset));
+        sign = _mm512_movepi16_mask(tmp);
+        tmp = _mm512_abs_epi16(tmp);
+
+        tmp = _mm512_add_epi16(_mm512_mullo_epi16(tmp, w1), _mm512_set1_epi16(UINT8_MAX / 2));
+        tmp = div255_epu16(tmp);
+        tmp = _mm512_mask_sub_epi16(tmp, sign, _mm512_setzero_si512(), tmp);
+
+        // Saturated add v1 (-128...255) to v2 (0...255).
+        tmp = _mm512_add_epi16(tmp, v2);
+        _mm256_mask_storeu_epi8(dstp + i, m, packus_epi16(tmp));
+    }
+}
+
+void vs_mask_merge_premul_word_avx512(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    const uint16_t *maskp = mask;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    uint16_t maxval = (1U << depth) - 1;
+
+    for (i = 0; i < n; i += 32) {
+        __mmask32 m = tail_mask32(n - i);
+        __m512i v1 = _mm512_maskz_loadu_epi16(m, srcp1 + i);
+        __m512i v2 = _mm512_maskz_loadu_epi16(m, srcp2 + i);
+        __m512i w2 = _mm512_maskz_loadu_epi16(m, maskp + i);
+        __m512i w1 = _mm512_sub_epi16(_mm512_set1_epi16(maxval), w2);
+        __m512i sign, tmp, tmp_lo, tmp_hi, tmpd_lo, tmpd_hi;
+        __mmask32 signm;
+
+        // Premultiply v1.
+        signm = _mm512_cmplt_epu16_mask(v1, _mm512_set1_epi16(offset));
+        sign = _mm512_movm_epi16(signm);
+        tmp = _mm512_sub_epi16(v1, _mm512_set1_epi16(offset));
+        tmp = _mm512_mask_sub_epi16(tmp, signm, _mm512_setzero_si512(), tmp);
+
+        tmp_lo = _mm512_mullo_epi16(w1, tmp);
+        tmp_hi = _mm512_mulhi_epu16(w1, tmp);
+
+        tmpd_lo = _mm512_unpacklo_epi16(tmp_lo, tmp_hi);
+        tmpd_lo = _mm512_add_epi32(tmpd_lo, _mm512_set1_epi32(maxval / 2));
+        tmpd_lo = divX_epu32(tmpd_lo, depth);
+        tmpd_lo = cond_neg_epi32(tmpd_lo, _mm512_unpacklo_epi16(sign, sign));
+
+        tmpd_hi = _mm512_unpackhi_epi16(tmp_lo, tmp_hi);
+        tmpd_hi = _mm512_add_epi32(tmpd_hi, _mm512_set1_epi32(maxval / 2));
+        tmpd_hi = divX_epu32(tmpd_hi, depth);
+        tmpd_hi = cond_neg_epi32(tmpd_hi, _mm512_unpackhi_epi16(sign, sign));
+
+        // Saturated add v1 (-32768...65535) to v2 (0...65535)
+        tmpd_lo = _mm512_add_epi32(tmpd_lo, _mm512_unpacklo_epi16(v2, _mm512_setzero_si512()));
+        tmpd_hi = _mm512_add_epi32(tmpd_hi, _mm512_unpackhi_epi16(v2, _mm512_setzero_si512()));
+        tmp = _mm512_packus_epi32(tmpd_lo, tmpd_hi);
+        tmp = _mm512_min_epu16(tmp, _mm512_set1_epi16(maxval));
+        _mm512_mask_storeu_epi16(dstp + i, m, tmp);
+    }
+}
+
+void vs_mask_merge_premul_float_avx512(const void *src1, const void *src2, const void *mask, void *dst, unsigned depth, unsigned offset, unsigned n)
+{
+    const float *srcp1 = src1;
+    const float *srcp2 = src2;
+    const float *maskp = mask;
+    float *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+    (void)offset;
+
+    for (i = 0; i < n; i += 16) {
+        __mmask16 m = tail_mask16(n - i);
+        __m512 v1 = _mm512_maskz_loadu_ps(m, srcp1 + i);
+        __m512 v2 = _mm512_maskz_loadu_ps(m, srcp2 + i);
+        __m512 w1 = _mm512_sub_ps(_mm512_set1_ps(1.0f), _mm512_maskz_loadu_ps(m, maskp + i));
+        __m512 result = _mm512_fmadd_ps(v1, w1, v2);
+        _mm512_mask_storeu_ps(dstp + i, m, result);
+    }
+}
+
+void vs_makediff_byte_avx512(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
+{
+    const uint8_t *srcp1 = src1;
+    const uint8_t *srcp2 = src2;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+
+    for (i = 0; i < n; i += 64) {
+        __mmask64 m = tail_mask64(n - i);
+        __m512i v1 = _mm512_maskz_loadu_epi8(m, srcp1 + i);
+        __m512i v2 = _mm512_maskz_loadu_epi8(m, srcp2 + i);
+        __m512i diff = _mm512_subs_epi8(_mm512_add_epi8(v1, _mm512_set1_epi8(INT8_MIN)), _mm512_add_epi8(v2, _mm512_set1_epi8(INT8_MIN)));
+        diff = _mm512_sub_epi8(diff, _mm512_set1_epi8(INT8_MIN));
+        _mm512_mask_storeu_epi8(dstp + i, m, diff);
+    }
+}
+
+void vs_makediff_word_avx512(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    int32_t maxval = (1 << (depth - 1)) - 1;
+    int32_t minval = -maxval - 1;
+
+    for (i = 0; i < n; i += 32) {
+        __mmask32 m = tail_mask32(n - i);
+        __m512i v1 = _mm512_maskz_loadu_epi16(m, srcp1 + i);
+        __m512i v2 = _mm512_maskz_loadu_epi16(m, srcp2 + i);
+        __m512i diff = _mm512_subs_epi16(_mm512_add_epi16(v1, _mm512_set1_epi16(minval)), _mm512_add_epi16(v2, _mm512_set1_epi16(minval)));
+        diff = _mm512_min_epi16(_mm512_max_epi16(diff, _mm512_set1_epi16(minval)), _mm512_set1_epi16(maxval));
+        diff = _mm512_sub_epi16(diff, _mm512_set1_epi16(minval));
+        _mm512_mask_storeu_epi16(dstp + i, m, diff);
+    }
+}
+
+void vs_makediff_float_avx512(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
+{
+    const float *srcp1 = src1;
+    const float *srcp2 = src2;
+    float *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+
+    for (i = 0; i < n; i += 16) {
+        __mmask16 m = tail_mask16(n - i);
+        __m512 v1 = _mm512_maskz_loadu_ps(m, srcp1 + i);
+        __m512 v2 = _mm512_maskz_loadu_ps(m, srcp2 + i);
+        _mm512_mask_storeu_ps(dstp + i, m, _mm512_sub_ps(v1, v2));
+    }
+}
+
+void vs_mergediff_byte_avx512(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
+{
+    const uint8_t *srcp1 = src1;
+    const uint8_t *srcp2 = src2;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+
+    for (i = 0; i < n; i += 64) {
+        __mmask64 m = tail_mask64(n - i);
+        __m512i v1 = _mm512_maskz_loadu_epi8(m, srcp1 + i);
+        __m512i v2 = _mm512_maskz_loadu_epi8(m, srcp2 + i);
+        __m512i tmp = _mm512_adds_epi8(_mm512_add_epi8(v1, _mm512_set1_epi8(INT8_MIN)), _mm512_add_epi8(v2, _mm512_set1_epi8(INT8_MIN)));
+        tmp = _mm512_sub_epi8(tmp, _mm512_set1_epi8(INT8_MIN));
+        _mm512_mask_storeu_epi8(dstp + i, m, tmp);
+    }
+}
+
+void vs_mergediff_word_avx512(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
+{
+    const uint16_t *srcp1 = src1;
+    const uint16_t *srcp2 = src2;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    int32_t maxval = (1 << (depth - 1)) - 1;
+    int32_t minval = -maxval - 1;
+
+    for (i = 0; i < n; i += 32) {
+        __mmask32 m = tail_mask32(n - i);
+        __m512i v1 = _mm512_maskz_loadu_epi16(m, srcp1 + i);
+        __m512i v2 = _mm512_maskz_loadu_epi16(m, srcp2 + i);
+        __m512i tmp = _mm512_adds_epi16(_mm512_add_epi16(v1, _mm512_set1_epi16(minval)), _mm512_add_epi16(v2, _mm512_set1_epi16(minval)));
+        tmp = _mm512_min_epi16(_mm512_max_epi16(tmp, _mm512_set1_epi16(minval)), _mm512_set1_epi16(maxval));
+        tmp = _mm512_sub_epi16(tmp, _mm512_set1_epi16(minval));
+        _mm512_mask_storeu_epi16(dstp + i, m, tmp);
+    }
+}
+
+void vs_mergediff_float_avx512(const void *src1, const void *src2, void *dst, unsigned depth, unsigned n)
+{
+    const float *srcp1 = src1;
+    const float *srcp2 = src2;
+    float *dstp = dst;
+    unsigned i;
+
+    (void)depth;
+
+    for (i = 0; i < n; i += 16) {
+        __mmask16 m = tail_mask16(n - i);
+        __m512 v1 = _mm512_maskz_loadu_ps(m, srcp1 + i);
+        __m512 v2 = _mm512_maskz_loadu_ps(m, srcp2 + i);
+        _mm512_mask_storeu_ps(dstp + i, m, _mm512_add_ps(v1, v2));
+    }
+}
+
+void vs_mask_subsample_byte_avx512(const void * const rows[4], void *tmp, void *dst, unsigned n)
+{
+    const uint8_t *r0 = rows[0];
+    const uint8_t *r1 = rows[1];
+    const uint8_t *r2 = rows[2];
+    const uint8_t *r3 = rows[3];
+    uint16_t *vsum = tmp;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    const __m512i taps_a = _mm512_set1_epi32(0x00030001);
+    const __m512i taps_b = _mm512_set1_epi32(0x00010003);
+
+    for (i = 0; i < 2 * n; i += 32) {
+        __mmask32 m = tail_mask32(2 * n - i);
+        __m512i outer = _mm512_add_epi16(_mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, r0 + i)), _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, r3 + i)));
+        __m512i inner = _mm512_add_epi16(_mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, r1 + i)), _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(m, r2 + i)));
+        _mm512_mask_storeu_epi16(vsum + 1 + i, m, _mm512_add_epi16(outer, _mm512_add_epi16(inner, _mm512_add_epi16(inner, inner))));
+    }
+
+    vsum[0] = vsum[1];
+    vsum[2 * n + 1] = vsum[2 * n];
+
+    for (i = 0; i < n; i += 16) {
+        __mmask16 m = tail_mask16(n - i);
+        __m512i x = _mm512_add_epi32(_mm512_madd_epi16(_mm512_loadu_si512(vsum + 2 * i), taps_a),
+                                     _mm512_madd_epi16(_mm512_loadu_si512(vsum + 2 * i + 2), taps_b));
+        x = _mm512_srli_epi32(_mm512_add_epi32(x, _mm512_set1_epi32(32)), 6);
+        _mm_mask_storeu_epi8(dstp + i, m, _mm512_cvtepi32_epi8(x));
+    }
+}
+
+static __m512i mask_subsample_epu32(const uint32_t *vsum)
+{
+    const __m512i even = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i odd = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+
+    __m512i a = _mm512_loadu_si512(vsum);
+    __m512i b = _mm512_loadu_si512(vsum + 16);
+    __m512i c = _mm512_loadu_si512(vsum + 2);
+    __m512i d = _mm512_loadu_si512(vsum + 18);
+    __m512i x = _mm512_add_epi32(_mm512_permutex2var_epi32(a, odd, b), _mm512_permutex2var_epi32(c, even, d));
+
+    x = _mm512_add_epi32(_mm512_add_epi32(_mm512_permutex2var_epi32(a, even, b), _mm512_permutex2var_epi32(c, odd, d)), _mm512_add_epi32(x, _mm512_add_epi32(x, x)));
+    return _mm512_srli_epi32(_mm512_add_epi32(x, _mm512_set1_epi32(32)), 6);
+}
+
+void vs_mask_subsample_word_avx512(const void * const rows[4], void *tmp, void *dst, unsigned n)
+{
+    const uint16_t *r0 = rows[0];
+    const uint16_t *r1 = rows[1];
+    const uint16_t *r2 = rows[2];
+    const uint16_t *r3 = rows[3];
+    uint32_t *vsum = tmp;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    for (i = 0; i < 2 * n; i += 16) {
+        __mmask16 m = tail_mask16(2 * n - i);
+        __m512i outer = _mm512_add_epi32(_mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(m, r0 + i)), _mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(m, r3 + i)));
+        __m512i inner = _mm512_add_epi32(_mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(m, r1 + i)), _mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(m, r2 + i)));
+        _mm512_mask_storeu_epi32(vsum + 1 + i, m, _mm512_add_epi32(outer, _mm512_add_epi32(inner, _mm512_add_epi32(inner, inner))));
+    }
+
+    vsum[0] = vsum[1];
+    vsum[2 * n + 1] = vsum[2 * n];
+
+    for (i = 0; i < n; i += 16) {
+        __mmask16 m = tail_mask16(n - i);
+        _mm256_mask_storeu_epi16(dstp + i, m, _mm512_cvtusepi32_epi16(mask_subsample_epu32(vsum + 2 * i)));
+    }
+}
+
+void vs_mask_subsample_float_avx512(const void * const rows[4], void *tmp, void *dst, unsigned n)
+{
+    const float *r0 = rows[0];
+    const float *r1 = rows[1];
+    const float *r2 = rows[2];
+    const float *r3 = rows[3];
+    float *vsum = tmp;
+    float *dstp = dst;
+    unsigned i;
+
+    const __m512i even = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i odd = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+    const __m512 three = _mm512_set1_ps(3.0f);
+
+    for (i = 0; i < 2 * n; i += 16) {
+        __mmask16 m = tail_mask16(2 * n - i);
+        __m512 outer = _mm512_add_ps(_mm512_maskz_loadu_ps(m, r0 + i), _mm512_maskz_loadu_ps(m, r3 + i));
+        __m512 inner = _mm512_add_ps(_mm512_maskz_loadu_ps(m, r1 + i), _mm512_maskz_loadu_ps(m, r2 + i));
+        _mm512_mask_storeu_ps(vsum + 1 + i, m, _mm512_add_ps(outer, _mm512_mul_ps(inner, three)));
+    }
+
+    vsum[0] = vsum[1];
+    vsum[2 * n + 1] = vsum[2 * n];
+
+    for (i = 0; i < n; i += 16) {
+        __mmask16 m = tail_mask16(n - i);
+        __m512 a = _mm512_loadu_ps(vsum + 2 * i);
+        __m512 b = _mm512_loadu_ps(vsum + 2 * i + 16);
+        __m512 c = _mm512_loadu_ps(vsum + 2 * i + 2);
+        __m512 d = _mm512_loadu_ps(vsum + 2 * i + 18);
+        __m512 outer = _mm512_add_ps(_mm512_permutex2var_ps(a, even, b), _mm512_permutex2var_ps(c, odd, d));
+        __m512 inner = _mm512_add_ps(_mm512_permutex2var_ps(a, odd, b), _mm512_permutex2var_ps(c, even, d));
+        _mm512_mask_storeu_ps(dstp + i, m, _mm512_mul_ps(_mm512_add_ps(outer, _mm512_mul_ps(inner, three)), _mm512_set1_ps(1.0f / 64)));
+    }
+}
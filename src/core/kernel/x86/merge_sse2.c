@@ -439,3 +439,145 @@ void vs_mergediff_float_sse2(const void *src1, const void *src2, void *dst, unsi
         _mm_store_ps(dstp + i, _mm_add_ps(v1, v2));
     }
 }
+
+/* Vertical sums are kept in tmp offset by one sample so that the repeated edge samples fit on both sides
+ * and the horizontal taps can be read with unaligned loads. */
+void vs_mask_subsample_byte_sse2(const void * const rows[4], void *tmp, void *dst, unsigned n)
+{
+    const uint8_t *r0 = rows[0];
+    const uint8_t *r1 = rows[1];
+    const uint8_t *r2 = rows[2];
+    const uint8_t *r3 = rows[3];
+    uint16_t *vsum = tmp;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i taps_a = _mm_set1_epi32(0x00030001);
+    const __m128i taps_b = _mm_set1_epi32(0x00010003);
+
+    for (i = 0; i < 2 * n; i += 16) {
+        __m128i a = _mm_load_si128((const __m128i *)(r0 + i));
+        __m128i b = _mm_load_si128((const __m128i *)(r1 + i));
+        __m128i c = _mm_load_si128((const __m128i *)(r2 + i));
+        __m128i d = _mm_load_si128((const __m128i *)(r3 + i));
+        __m128i outer, inner;
+
+        outer = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(d, zero));
+        inner = _mm_add_epi16(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+        _mm_storeu_si128((__m128i *)(vsum + 1 + i), _mm_add_epi16(outer, _mm_add_epi16(inner, _mm_add_epi16(inner, inner))));
+
+        outer = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(d, zero));
+        inner = _mm_add_epi16(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+        _mm_storeu_si128((__m128i *)(vsum + 9 + i), _mm_add_epi16(outer, _mm_add_epi16(inner, _mm_add_epi16(inner, inner))));
+    }
+
+    vsum[0] = vsum[1];
+    vsum[2 * n + 1] = vsum[2 * n];
+
+    for (i = 0; i < n; i += 8) {
+        __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i *)(vsum + 2 * i)), taps_a),
+                                   _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(vsum + 2 * i + 2)), taps_b));
+        __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i *)(vsum + 2 * i + 8)), taps_a),
+                                   _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(vsum + 2 * i + 10)), taps_b));
+        __m128i x;
+
+        lo = _mm_srli_epi32(_mm_add_epi32(lo, _mm_set1_epi32(32)), 6);
+        hi = _mm_srli_epi32(_mm_add_epi32(hi, _mm_set1_epi32(32)), 6);
+        x = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64((__m128i *)(dstp + i), _mm_packus_epi16(x, x));
+    }
+}
+
+/* Deinterleaves the even and odd 32-bit elements of two vectors. */
+static void deinterleave_ps(__m128 a, __m128 b, __m128 *even, __m128 *odd)
+{
+    *even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    *odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+static __m128i mask_subsample_epu32(const uint32_t *vsum)
+{
+    __m128 a0, a1, b0, b1;
+    __m128i x;
+
+    deinterleave_ps(_mm_loadu_ps((const float *)vsum), _mm_loadu_ps((const float *)(vsum + 4)), &a0, &a1);
+    deinterleave_ps(_mm_loadu_ps((const float *)(vsum + 2)), _mm_loadu_ps((const float *)(vsum + 6)), &b0, &b1);
+
+    x = _mm_add_epi32(_mm_castps_si128(a1), _mm_castps_si128(b0));
+    x = _mm_add_epi32(_mm_add_epi32(_mm_castps_si128(a0), _mm_castps_si128(b1)), _mm_add_epi32(x, _mm_add_epi32(x, x)));
+    return _mm_srli_epi32(_mm_add_epi32(x, _mm_set1_epi32(32)), 6);
+}
+
+void vs_mask_subsample_word_sse2(const void * const rows[4], void *tmp, void *dst, unsigned n)
+{
+    const uint16_t *r0 = rows[0];
+    const uint16_t *r1 = rows[1];
+    const uint16_t *r2 = rows[2];
+    const uint16_t *r3 = rows[3];
+    uint32_t *vsum = tmp;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    const __m128i zero = _mm_setzero_si128();
+
+    for (i = 0; i < 2 * n; i += 8) {
+        __m128i a = _mm_load_si128((const __m128i *)(r0 + i));
+        __m128i b = _mm_load_si128((const __m128i *)(r1 + i));
+        __m128i c = _mm_load_si128((const __m128i *)(r2 + i));
+        __m128i d = _mm_load_si128((const __m128i *)(r3 + i));
+        __m128i outer, inner;
+
+        outer = _mm_add_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpacklo_epi16(d, zero));
+        inner = _mm_add_epi32(_mm_unpacklo_epi16(b, zero), _mm_unpacklo_epi16(c, zero));
+        _mm_storeu_si128((__m128i *)(vsum + 1 + i), _mm_add_epi32(outer, _mm_add_epi32(inner, _mm_add_epi32(inner, inner))));
+
+        outer = _mm_add_epi32(_mm_unpackhi_epi16(a, zero), _mm_unpackhi_epi16(d, zero));
+        inner = _mm_add_epi32(_mm_unpackhi_epi16(b, zero), _mm_unpackhi_epi16(c, zero));
+        _mm_storeu_si128((__m128i *)(vsum + 5 + i), _mm_add_epi32(outer, _mm_add_epi32(inner, _mm_add_epi32(inner, inner))));
+    }
+
+    vsum[0] = vsum[1];
+    vsum[2 * n + 1] = vsum[2 * n];
+
+    for (i = 0; i < n; i += 8) {
+        __m128i lo = mask_subsample_epu32(vsum + 2 * i);
+        __m128i hi = mask_subsample_epu32(vsum + 2 * i + 8);
+
+        /* pack as signed around the midpoint since there's no unsigned 32 to 16 bit pack */
+        lo = _mm_sub_epi32(lo, _mm_set1_epi32(0x8000));
+        hi = _mm_sub_epi32(hi, _mm_set1_epi32(0x8000));
+        _mm_store_si128((__m128i *)(dstp + i), _mm_add_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16(INT16_MIN)));
+    }
+}
+
+void vs_mask_subsample_float_sse2(const void * const rows[4], void *tmp, void *dst, unsigned n)
+{
+    const float *r0 = rows[0];
+    const float *r1 = rows[1];
+    const float *r2 = rows[2];
+    const float *r3 = rows[3];
+    float *vsum = tmp;
+    float *dstp = dst;
+    unsigned i;
+
+    const __m128 three = _mm_set1_ps(3.0f);
+
+    for (i = 0; i < 2 * n; i += 4) {
+        __m128 outer = _mm_add_ps(_mm_load_ps(r0 + i), _mm_load_ps(r3 + i));
+        __m128 inner = _mm_add_ps(_mm_load_ps(r1 + i), _mm_load_ps(r2 + i));
+        _mm_storeu_ps(vsum + 1 + i, _mm_add_ps(outer, _mm_mul_ps(inner, three)));
+    }
+
+    vsum[0] = vsum[1];
+    vsum[2 * n + 1] = vsum[2 * n];
+
+    for (i = 0; i < n; i += 4) {
+        __m128 a0, a1, b0, b1;
+
+        deinterleave_ps(_mm_loadu_ps(vsum + 2 * i), _mm_loadu_ps(vsum + 2 * i + 4), &a0, &a1);
+        deinterleave_ps(_mm_loadu_ps(vsum + 2 * i + 2), _mm_loadu_ps(vsum + 2 * i + 6), &b0, &b1);
+
+        _mm_store_ps(dstp + i, _mm_mul_ps(_mm_add_ps(_mm_add_ps(a0, b1), _mm_mul_ps(_mm_add_ps(a1, b0), three)), _mm_set1_ps(1.0f / 64)));
+    }
+}
@@ -206,6 +206,42 @@ void vs_plane_stats_1_float_avx2(union vs_plane_stats *stats, const void *src, p
     stats->f.acc = hadd_pd(fmacc);
 }
 
+void vs_plane_stats_1_half_avx2(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = src;
+    unsigned tail = width & ~7;
+    unsigned x, y;
+
+    __m256 fmmin = _mm256_set1_ps(INFINITY);
+    __m256 fmmax = _mm256_set1_ps(-INFINITY);
+    __m256d fmacc = _mm256_setzero_pd();
+    __m256 mask = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(width % 8), _mm256_loadu_si256((const __m256i *)ascend32)));
+    __m256 posmask = _mm256_andnot_ps(mask, _mm256_set1_ps(INFINITY));
+    __m256 negmask = _mm256_andnot_ps(mask, _mm256_set1_ps(-INFINITY));
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < tail; x += 8) {
+            __m256 v = _mm256_cvtph_ps(_mm_load_si128((const __m128i *)((const uint16_t *)srcp + x)));
+            fmmin = _mm256_min_ps(fmmin, v);
+            fmmax = _mm256_max_ps(fmmax, v);
+            fmacc = _mm256_add_pd(fmacc, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+            fmacc = _mm256_add_pd(fmacc, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+        }
+        if (width != tail) {
+            __m256 v = _mm256_and_ps(_mm256_cvtph_ps(_mm_load_si128((const __m128i *)((const uint16_t *)srcp + tail))), mask);
+            fmmin = _mm256_min_ps(fmmin, _mm256_or_ps(v, posmask));
+            fmmax = _mm256_max_ps(fmmax, _mm256_or_ps(v, negmask));
+            fmacc = _mm256_add_pd(fmacc, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+            fmacc = _mm256_add_pd(fmacc, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+        }
+        srcp += stride;
+    }
+
+    stats->f.min = hmin_ps(fmmin);
+    stats->f.max = hmax_ps(fmmax);
+    stats->f.acc = hadd_pd(fmacc);
+}
+
 void vs_plane_stats_2_byte_avx2(union vs_plane_stats *stats, const void *src1, ptrdiff_t src1_stride, const void *src2, ptrdiff_t src2_stride, unsigned width, unsigned height)
 {
     const uint8_t *srcp1 = src1;
@@ -359,3 +395,224 @@ void vs_plane_stats_2_float_avx2(union vs_plane_stats *stats, const void *src1,
     stats->f.acc = hadd_pd(fmacc);
     stats->f.diffacc = hadd_pd(fmdiffacc);
 }
+
+void vs_plane_stats_2_half_avx2(union vs_plane_stats *stats, const void *src1, ptrdiff_t src1_stride, const void *src2, ptrdiff_t src2_stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp1 = src1;
+    const uint8_t *srcp2 = src2;
+    unsigned tail = width & ~7;
+    unsigned x, y;
+
+    __m256 fmmin = _mm256_set1_ps(INFINITY);
+    __m256 fmmax = _mm256_set1_ps(-INFINITY);
+    __m256d fmacc = _mm256_setzero_pd();
+    __m256d fmdiffacc = _mm256_setzero_pd();
+    __m256 mask = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(width % 8), _mm256_loadu_si256((const __m256i *)ascend32)));
+    __m256 posmask = _mm256_andnot_ps(mask, _mm256_set1_ps(INFINITY));
+    __m256 negmask = _mm256_andnot_ps(mask, _mm256_set1_ps(-INFINITY));
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < tail; x += 8) {
+            __m256 v1 = _mm256_cvtph_ps(_mm_load_si128((const __m128i *)((const uint16_t *)srcp1 + x)));
+            __m256 v2 = _mm256_cvtph_ps(_mm_load_si128((const __m128i *)((const uint16_t *)srcp2 + x)));
+            __m256 tmp;
+            fmmin = _mm256_min_ps(fmmin, v1);
+            fmmax = _mm256_max_ps(fmmax, v1);
+            fmacc = _mm256_add_pd(fmacc, _mm256_cvtps_pd(_mm256_castps256_ps128(v1)));
+            fmacc = _mm256_add_pd(fmacc, _mm256_cvtps_pd(_mm256_extractf128_ps(v1, 1)));
+            tmp = _mm256_and_ps(_mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF)), _mm256_sub_ps(v1, v2));
+            fmdiffacc = _mm256_add_pd(fmdiffacc, _mm256_cvtps_pd(_mm256_castps256_ps128(tmp)));
+            fmdiffacc = _mm256_add_pd(fmdiffacc, _mm256_cvtps_pd(_mm256_extractf128_ps(tmp, 1)));
+        }
+        if (width != tail) {
+            __m256 v1 = _mm256_and_ps(_mm256_cvtph_ps(_mm_load_si128((const __m128i *)((const uint16_t *)srcp1 + tail))), mask);
+            __m256 v2 = _mm256_and_ps(_mm256_cvtph_ps(_mm_load_si128((const __m128i *)((const uint16_t *)srcp2 + tail))), mask);
+            __m256 tmp;
+            fmmin = _mm256_min_ps(fmmin, _mm256_or_ps(v1, posmask));
+            fmmax = _mm256_max_ps(fmmax, _mm256_or_ps(v1, negmask));
+            fmacc = _mm256_add_pd(fmacc, _mm256_cvtps_pd(_mm256_castps256_ps128(v1)));
+            fmacc = _mm256_add_pd(fmacc, _mm256_cvtps_pd(_mm256_extractf128_ps(v1, 1)));
+            tmp = _mm256_and_ps(_mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF)), _mm256_sub_ps(v1, v2));
+            fmdiffacc = _mm256_add_pd(fmdiffacc, _mm256_cvtps_pd(_mm256_castps256_ps128(tmp)));
+            fmdiffacc = _mm256_add_pd(fmdiffacc, _mm256_cvtps_pd(_mm256_extractf128_ps(tmp, 1)));
+        }
+        srcp1 += src1_stride;
+        srcp2 += src2_stride;
+    }
+
+    stats->f.min = hmin_ps(fmmin);
+    stats->f.max = hmax_ps(fmmax);
+    stats->f.acc = hadd_pd(fmacc);
+    stats->f.diffacc = hadd_pd(fmdiffacc);
+}
+
+/* Squares are summed in 32 bits over a row and widened once per row. */
+static __m256i widen_add_epu32(__m256i acc, __m256i x)
+{
+    acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(x, _mm256_setzero_si256()));
+    acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(x, _mm256_setzero_si256()));
+    return acc;
+}
+
+static uint64_t hsum_epi64(__m256i x)
+{
+    uint64_t ret;
+    _mm_storel_epi64((__m128i *)&ret, hadd_epi64(x));
+    return ret;
+}
+
+void vs_plane_stats_sq_byte_avx2(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = src;
+    unsigned tail = width & ~31;
+    unsigned x, y;
+
+    __m256i mmin = _mm256_set1_epi8(UINT8_MAX);
+    __m256i mmax = _mm256_setzero_si256();
+    __m256i macc = _mm256_setzero_si256();
+    __m256i msqacc = _mm256_setzero_si256();
+    __m256i mask = _mm256_cmpgt_epi8(_mm256_set1_epi8(width % 32), _mm256_loadu_si256((const __m256i *)ascend8));
+    __m256i onesmask = _mm256_andnot_si256(mask, _mm256_set1_epi8(UINT8_MAX));
+
+    for (y = 0; y < height; y++) {
+        __m256i rowsq = _mm256_setzero_si256();
+
+        for (x = 0; x < tail; x += 32) {
+            __m256i v = _mm256_load_si256((const __m256i *)(srcp + x));
+            __m256i lo = _mm256_unpacklo_epi8(v, _mm256_setzero_si256());
+            __m256i hi = _mm256_unpackhi_epi8(v, _mm256_setzero_si256());
+            mmin = _mm256_min_epu8(mmin, v);
+            mmax = _mm256_max_epu8(mmax, v);
+            macc = _mm256_add_epi64(macc, _mm256_sad_epu8(v, _mm256_setzero_si256()));
+            rowsq = _mm256_add_epi32(rowsq, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+        }
+        if (width != tail) {
+            __m256i v = _mm256_and_si256(_mm256_load_si256((const __m256i *)(srcp + tail)), mask);
+            __m256i lo = _mm256_unpacklo_epi8(v, _mm256_setzero_si256());
+            __m256i hi = _mm256_unpackhi_epi8(v, _mm256_setzero_si256());
+            mmin = _mm256_min_epu8(mmin, _mm256_or_si256(v, onesmask));
+            mmax = _mm256_max_epu8(mmax, v);
+            macc = _mm256_add_epi64(macc, _mm256_sad_epu8(v, _mm256_setzero_si256()));
+            rowsq = _mm256_add_epi32(rowsq, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+        }
+        msqacc = widen_add_epu32(msqacc, rowsq);
+        srcp += stride;
+    }
+
+    stats->i.min = hmin_epu8(mmin);
+    stats->i.max = hmax_epu8(mmax);
+    stats->i.acc = hsum_epi64(macc);
+    stats->i.sqacc = hsum_epi64(msqacc);
+}
+
+/* With v = 256 * hi + lo the square is 65536 * hi * hi + 512 * hi * lo + lo * lo, each term fits pmaddwd. */
+void vs_plane_stats_sq_word_avx2(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = src;
+    unsigned tail = width & ~15;
+    unsigned x, y;
+
+    __m256i mmin = _mm256_set1_epi16(UINT16_MAX);
+    __m256i mmax = _mm256_setzero_si256();
+    __m256i macc_lo = _mm256_setzero_si256();
+    __m256i macc_hi = _mm256_setzero_si256();
+    __m256i msq_ll = _mm256_setzero_si256();
+    __m256i msq_hl = _mm256_setzero_si256();
+    __m256i msq_hh = _mm256_setzero_si256();
+    __m256i mask = _mm256_cmpgt_epi16(_mm256_set1_epi16(width % 16), _mm256_loadu_si256((const __m256i *)ascend16));
+    __m256i onesmask = _mm256_andnot_si256(mask, _mm256_set1_epi16(UINT16_MAX));
+    __m256i low8mask = _mm256_set1_epi16(0xFF);
+    __m256i tmp;
+
+    for (y = 0; y < height; y++) {
+        __m256i row_ll = _mm256_setzero_si256();
+        __m256i row_hl = _mm256_setzero_si256();
+        __m256i row_hh = _mm256_setzero_si256();
+
+        for (x = 0; x < tail; x += 16) {
+            __m256i v = _mm256_load_si256((const __m256i *)((const uint16_t *)srcp + x));
+            __m256i lo = _mm256_and_si256(low8mask, v);
+            __m256i hi = _mm256_srli_epi16(v, 8);
+            mmin = _mm256_min_epu16(mmin, v);
+            mmax = _mm256_max_epu16(mmax, v);
+
+            macc_lo = _mm256_add_epi64(macc_lo, _mm256_sad_epu8(lo, _mm256_setzero_si256()));
+            macc_hi = _mm256_add_epi64(macc_hi, _mm256_sad_epu8(_mm256_andnot_si256(low8mask, v), _mm256_setzero_si256()));
+
+            row_ll = _mm256_add_epi32(row_ll, _mm256_madd_epi16(lo, lo));
+            row_hl = _mm256_add_epi32(row_hl, _mm256_madd_epi16(hi, lo));
+            row_hh = _mm256_add_epi32(row_hh, _mm256_madd_epi16(hi, hi));
+        }
+        if (width != tail) {
+            __m256i v = _mm256_and_si256(_mm256_load_si256((const __m256i *)((const uint16_t *)srcp + tail)), mask);
+            __m256i lo = _mm256_and_si256(low8mask, v);
+            __m256i hi = _mm256_srli_epi16(v, 8);
+            mmin = _mm256_min_epu16(mmin, _mm256_or_si256(v, onesmask));
+            mmax = _mm256_max_epu16(mmax, v);
+
+            macc_lo = _mm256_add_epi64(macc_lo, _mm256_sad_epu8(lo, _mm256_setzero_si256()));
+            macc_hi = _mm256_add_epi64(macc_hi, _mm256_sad_epu8(_mm256_andnot_si256(low8mask, v), _mm256_setzero_si256()));
+
+            row_ll = _mm256_add_epi32(row_ll, _mm256_madd_epi16(lo, lo));
+            row_hl = _mm256_add_epi32(row_hl, _mm256_madd_epi16(hi, lo));
+            row_hh = _mm256_add_epi32(row_hh, _mm256_madd_epi16(hi, hi));
+        }
+        msq_ll = widen_add_epu32(msq_ll, row_ll);
+        msq_hl = widen_add_epu32(msq_hl, row_hl);
+        msq_hh = widen_add_epu32(msq_hh, row_hh);
+        srcp += stride;
+    }
+
+    stats->i.min = hmin_epu16(mmin);
+    stats->i.max = hmax_epu16(mmax);
+
+    tmp = _mm256_add_epi64(_mm256_unpacklo_epi64(macc_lo, macc_hi), _mm256_unpackhi_epi64(macc_lo, macc_hi));
+    tmp = _mm256_add_epi64(tmp, _mm256_slli_epi64(_mm256_unpackhi_epi64(tmp, tmp), 8));
+    _mm_storel_epi64((__m128i *)&stats->i.acc, _mm_add_epi64(_mm256_castsi256_si128(tmp), _mm256_extractf128_si256(tmp, 1)));
+
+    stats->i.sqacc = (hsum_epi64(msq_hh) << 16) + (hsum_epi64(msq_hl) << 9) + hsum_epi64(msq_ll);
+}
+
+void vs_plane_stats_sq_float_avx2(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = src;
+    unsigned tail = width & ~7;
+    unsigned x, y;
+
+    __m256 fmmin = _mm256_set1_ps(INFINITY);
+    __m256 fmmax = _mm256_set1_ps(-INFINITY);
+    __m256d fmacc = _mm256_setzero_pd();
+    __m256d fmsqacc = _mm256_setzero_pd();
+    __m256 mask = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(width % 8), _mm256_loadu_si256((const __m256i *)ascend32)));
+    __m256 posmask = _mm256_andnot_ps(mask, _mm256_set1_ps(INFINITY));
+    __m256 negmask = _mm256_andnot_ps(mask, _mm256_set1_ps(-INFINITY));
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < tail; x += 8) {
+            __m256 v = _mm256_load_ps((const float *)srcp + x);
+            __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+            __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+            fmmin = _mm256_min_ps(fmmin, v);
+            fmmax = _mm256_max_ps(fmmax, v);
+            fmacc = _mm256_add_pd(fmacc, _mm256_add_pd(lo, hi));
+            fmsqacc = _mm256_fmadd_pd(lo, lo, fmsqacc);
+            fmsqacc = _mm256_fmadd_pd(hi, hi, fmsqacc);
+        }
+        if (width != tail) {
+            __m256 v = _mm256_and_ps(_mm256_load_ps((const float *)srcp + tail), mask);
+            __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+            __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+            fmmin = _mm256_min_ps(fmmin, _mm256_or_ps(v, posmask));
+            fmmax = _mm256_max_ps(fmmax, _mm256_or_ps(v, negmask));
+            fmacc = _mm256_add_pd(fmacc, _mm256_add_pd(lo, hi));
+            fmsqacc = _mm256_fmadd_pd(lo, lo, fmsqacc);
+            fmsqacc = _mm256_fmadd_pd(hi, hi, fmsqacc);
+        }
+        srcp += stride;
+    }
+
+    stats->f.min = hmin_ps(fmmin);
+    stats->f.max = hmax_ps(fmmax);
+    stats->f.acc = hadd_pd(fmacc);
+    stats->f.sqacc = hadd_pd(fmsqacc);
+}
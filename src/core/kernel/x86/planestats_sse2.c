@@ -347,3 +347,173 @@ void vs_plane_stats_2_float_sse2(union vs_plane_stats *stats, const void *src1,
     stats->f.acc = hadd_pd(fmacc);
     stats->f.diffacc = hadd_pd(fmdiffacc);
 }
+
+/* Squares are summed in 32 bits over a row and widened once per row. */
+static __m128i widen_add_epu32(__m128i acc, __m128i x)
+{
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(x, _mm_setzero_si128()));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(x, _mm_setzero_si128()));
+    return acc;
+}
+
+static uint64_t hadd_epi64(__m128i x)
+{
+    uint64_t ret;
+    _mm_storel_epi64((__m128i *)&ret, _mm_add_epi64(x, _mm_srli_si128(x, 8)));
+    return ret;
+}
+
+void vs_plane_stats_sq_byte_sse2(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = src;
+    unsigned tail = width & ~15;
+    unsigned x, y;
+
+    __m128i mmin = _mm_set1_epi8(UINT8_MAX);
+    __m128i mmax = _mm_setzero_si128();
+    __m128i macc = _mm_setzero_si128();
+    __m128i msqacc = _mm_setzero_si128();
+    __m128i mask = _mm_cmplt_epi8(_mm_loadu_si128((const __m128i *)ascend8), _mm_set1_epi8(width % 16));
+    __m128i onesmask = _mm_andnot_si128(mask, _mm_set1_epi8(UINT8_MAX));
+
+    for (y = 0; y < height; y++) {
+        __m128i rowsq = _mm_setzero_si128();
+
+        for (x = 0; x < tail; x += 16) {
+            __m128i v = _mm_load_si128((const __m128i *)(srcp + x));
+            __m128i lo = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+            __m128i hi = _mm_unpackhi_epi8(v, _mm_setzero_si128());
+            mmin = _mm_min_epu8(mmin, v);
+            mmax = _mm_max_epu8(mmax, v);
+            macc = _mm_add_epi64(macc, _mm_sad_epu8(v, _mm_setzero_si128()));
+            rowsq = _mm_add_epi32(rowsq, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+        }
+        if (width != tail) {
+            __m128i v = _mm_and_si128(_mm_load_si128((const __m128i *)(srcp + tail)), mask);
+            __m128i lo = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+            __m128i hi = _mm_unpackhi_epi8(v, _mm_setzero_si128());
+            mmin = _mm_min_epu8(mmin, _mm_or_si128(v, onesmask));
+            mmax = _mm_max_epu8(mmax, v);
+            macc = _mm_add_epi64(macc, _mm_sad_epu8(v, _mm_setzero_si128()));
+            rowsq = _mm_add_epi32(rowsq, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+        }
+        msqacc = widen_add_epu32(msqacc, rowsq);
+        srcp += stride;
+    }
+
+    stats->i.min = hmin_epu8(mmin);
+    stats->i.max = hmax_epu8(mmax);
+    stats->i.acc = hadd_epi64(macc);
+    stats->i.sqacc = hadd_epi64(msqacc);
+}
+
+/* With v = 256 * hi + lo the square is 65536 * hi * hi + 512 * hi * lo + lo * lo, each term fits pmaddwd. */
+void vs_plane_stats_sq_word_sse2(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = src;
+    unsigned tail = width & ~7;
+    unsigned x, y;
+
+    __m128i mmin = _mm_set1_epi16(INT16_MAX);
+    __m128i mmax = _mm_set1_epi16(INT16_MIN);
+    __m128i macc_lo = _mm_setzero_si128();
+    __m128i macc_hi = _mm_setzero_si128();
+    __m128i msq_ll = _mm_setzero_si128();
+    __m128i msq_hl = _mm_setzero_si128();
+    __m128i msq_hh = _mm_setzero_si128();
+    __m128i mask = _mm_cmplt_epi16(_mm_loadu_si128((const __m128i *)ascend16), _mm_set1_epi16(width % 8));
+    __m128i onesmask = _mm_andnot_si128(mask, _mm_set1_epi16(UINT16_MAX));
+    __m128i low8mask = _mm_set1_epi16(0xFF);
+    __m128i tmp;
+
+    for (y = 0; y < height; y++) {
+        __m128i row_ll = _mm_setzero_si128();
+        __m128i row_hl = _mm_setzero_si128();
+        __m128i row_hh = _mm_setzero_si128();
+
+        for (x = 0; x < tail; x += 8) {
+            __m128i v = _mm_load_si128((const __m128i *)((const uint16_t *)srcp + x));
+            __m128i v_signed = _mm_add_epi16(v, _mm_set1_epi16(INT16_MIN));
+            __m128i lo = _mm_and_si128(low8mask, v);
+            __m128i hi = _mm_srli_epi16(v, 8);
+            mmin = _mm_min_epi16(mmin, v_signed);
+            mmax = _mm_max_epi16(mmax, v_signed);
+
+            macc_lo = _mm_add_epi64(macc_lo, _mm_sad_epu8(lo, _mm_setzero_si128()));
+            macc_hi = _mm_add_epi64(macc_hi, _mm_sad_epu8(_mm_andnot_si128(low8mask, v), _mm_setzero_si128()));
+
+            row_ll = _mm_add_epi32(row_ll, _mm_madd_epi16(lo, lo));
+            row_hl = _mm_add_epi32(row_hl, _mm_madd_epi16(hi, lo));
+            row_hh = _mm_add_epi32(row_hh, _mm_madd_epi16(hi, hi));
+        }
+        if (width != tail) {
+            __m128i v = _mm_and_si128(_mm_load_si128((const __m128i *)((const uint16_t *)srcp + tail)), mask);
+            __m128i lo = _mm_and_si128(low8mask, v);
+            __m128i hi = _mm_srli_epi16(v, 8);
+            mmin = _mm_min_epi16(mmin, _mm_add_epi16(_mm_or_si128(v, onesmask), _mm_set1_epi16(INT16_MIN)));
+            mmax = _mm_max_epi16(mmax, _mm_add_epi16(v, _mm_set1_epi16(INT16_MIN)));
+
+            macc_lo = _mm_add_epi64(macc_lo, _mm_sad_epu8(lo, _mm_setzero_si128()));
+            macc_hi = _mm_add_epi64(macc_hi, _mm_sad_epu8(_mm_andnot_si128(low8mask, v), _mm_setzero_si128()));
+
+            row_ll = _mm_add_epi32(row_ll, _mm_madd_epi16(lo, lo));
+            row_hl = _mm_add_epi32(row_hl, _mm_madd_epi16(hi, lo));
+            row_hh = _mm_add_epi32(row_hh, _mm_madd_epi16(hi, hi));
+        }
+        msq_ll = widen_add_epu32(msq_ll, row_ll);
+        msq_hl = widen_add_epu32(msq_hl, row_hl);
+        msq_hh = widen_add_epu32(msq_hh, row_hh);
+        srcp += stride;
+    }
+
+    stats->i.min = hmin_epi16(mmin) - INT16_MIN;
+    stats->i.max = hmax_epi16(mmax) - INT16_MIN;
+
+    tmp = _mm_add_epi64(_mm_unpacklo_epi64(macc_lo, macc_hi), _mm_unpackhi_epi64(macc_lo, macc_hi));
+    tmp = _mm_add_epi64(tmp, _mm_slli_epi64(_mm_unpackhi_epi64(tmp, tmp), 8));
+    _mm_storel_epi64((__m128i *)&stats->i.acc, tmp);
+
+    stats->i.sqacc = (hadd_epi64(msq_hh) << 16) + (hadd_epi64(msq_hl) << 9) + hadd_epi64(msq_ll);
+}
+
+void vs_plane_stats_sq_float_sse2(union vs_plane_stats *stats, const void *src, ptrdiff_t stride, unsigned width, unsigned height)
+{
+    const uint8_t *srcp = src;
+    unsigned tail = width & ~3;
+    unsigned x, y;
+
+    __m128 fmmin = _mm_set_ps1(INFINITY);
+    __m128 fmmax = _mm_set_ps1(-INFINITY);
+    __m128d fmacc = _mm_setzero_pd();
+    __m128d fmsqacc = _mm_setzero_pd();
+    __m128 mask = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_loadu_si128((const __m128i *)ascend32), _mm_set1_epi32(width % 4)));
+    __m128 posmask = _mm_andnot_ps(mask, _mm_set_ps1(INFINITY));
+    __m128 negmask = _mm_andnot_ps(mask, _mm_set_ps1(-INFINITY));
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < tail; x += 4) {
+            __m128 v = _mm_load_ps((const float *)srcp + x);
+            __m128d lo = _mm_cvtps_pd(v);
+            __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+            fmmin = _mm_min_ps(fmmin, v);
+            fmmax = _mm_max_ps(fmmax, v);
+            fmacc = _mm_add_pd(fmacc, _mm_add_pd(lo, hi));
+            fmsqacc = _mm_add_pd(fmsqacc, _mm_add_pd(_mm_mul_pd(lo, lo), _mm_mul_pd(hi, hi)));
+        }
+        if (width != tail) {
+            __m128 v = _mm_and_ps(_mm_load_ps((const float *)srcp + tail), mask);
+            __m128d lo = _mm_cvtps_pd(v);
+            __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+            fmmin = _mm_min_ps(fmmin, _mm_or_ps(v, posmask));
+            fmmax = _mm_max_ps(fmmax, _mm_or_ps(v, negmask));
+            fmacc = _mm_add_pd(fmacc, _mm_add_pd(lo, hi));
+            fmsqacc = _mm_add_pd(fmsqacc, _mm_add_pd(_mm_mul_pd(lo, lo), _mm_mul_pd(hi, hi)));
+        }
+        srcp += stride;
+    }
+
+    stats->f.min = hmin_ps(fmmin);
+    stats->f.max = hmax_ps(fmmax);
+    stats->f.acc = hadd_pd(fmacc);
+    stats->f.sqacc = hadd_pd(fmsqacc);
+}
@@ -0,0 +1,243 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <immintrin.h>
+#include "../pointops.h"
+
+void vs_invert_byte_avx2(const void *src, void *dst, union vs_pixel_value max, unsigned n)
+{
+    const uint8_t *srcp = src;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    __m256i maxval = _mm256_set1_epi8((char)max.u);
+
+    for (i = 0; i < n; i += 32) {
+        __m256i x = _mm256_load_si256((const __m256i *)(srcp + i));
+        _mm256_store_si256((__m256i *)(dstp + i), _mm256_sub_epi8(maxval, _mm256_min_epu8(x, maxval)));
+    }
+}
+
+void vs_invert_word_avx2(const void *src, void *dst, union vs_pixel_value max, unsigned n)
+{
+    const uint16_t *srcp = src;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    __m256i maxval = _mm256_set1_epi16((short)max.u);
+
+    for (i = 0; i < n; i += 16) {
+        __m256i x = _mm256_load_si256((const __m256i *)(srcp + i));
+        _mm256_store_si256((__m256i *)(dstp + i), _mm256_sub_epi16(maxval, _mm256_min_epu16(x, maxval)));
+    }
+}
+
+void vs_invert_float_avx2(const void *src, void *dst, union vs_pixel_value max, unsigned n)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    __m256 maxval = _mm256_set1_ps(max.f);
+
+    for (i = 0; i < n; i += 8) {
+        _mm256_store_ps(dstp + i, _mm256_sub_ps(maxval, _mm256_load_ps(srcp + i)));
+    }
+}
+
+void vs_limit_byte_avx2(const void *src, void *dst, union vs_pixel_value min, union vs_pixel_value max, unsigned n)
+{
+    const uint8_t *srcp = src;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    __m256i minval = _mm256_set1_epi8((char)min.u);
+    __m256i maxval = _mm256_set1_epi8((char)max.u);
+
+    for (i = 0; i < n; i += 32) {
+        __m256i x = _mm256_load_si256((const __m256i *)(srcp + i));
+        _mm256_store_si256((__m256i *)(dstp + i), _mm256_min_epu8(_mm256_max_epu8(x, minval), maxval));
+    }
+}
+
+void vs_limit_word_avx2(const void *src, void *dst, union vs_pixel_value min, union vs_pixel_value max, unsigned n)
+{
+    const uint16_t *srcp = src;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    __m256i minval = _mm256_set1_epi16((short)min.u);
+    __m256i maxval = _mm256_set1_epi16((short)max.u);
+
+    for (i = 0; i < n; i += 16) {
+        __m256i x = _mm256_load_si256((const __m256i *)(srcp + i));
+        _mm256_store_si256((__m256i *)(dstp + i), _mm256_min_epu16(_mm256_max_epu16(x, minval), maxval));
+    }
+}
+
+void vs_limit_float_avx2(const void *src, void *dst, union vs_pixel_value min, union vs_pixel_value max, unsigned n)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    __m256 minval = _mm256_set1_ps(min.f);
+    __m256 maxval = _mm256_set1_ps(max.f);
+
+    for (i = 0; i < n; i += 8) {
+        _mm256_store_ps(dstp + i, _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(srcp + i), minval), maxval));
+    }
+}
+
+void vs_binarize_byte_avx2(const void *src, void *dst, union vs_pixel_value threshold, union vs_pixel_value v0, union vs_pixel_value v1, unsigned n)
+{
+    const uint8_t *srcp = src;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    __m256i thr = _mm256_set1_epi8((char)threshold.u);
+    __m256i val0 = _mm256_set1_epi8((char)v0.u);
+    __m256i val1 = _mm256_set1_epi8((char)v1.u);
+
+    for (i = 0; i < n; i += 32) {
+        __m256i x = _mm256_load_si256((const __m256i *)(srcp + i));
+        __m256i ge = _mm256_cmpeq_epi8(_mm256_max_epu8(x, thr), x);
+        _mm256_store_si256((__m256i *)(dstp + i), _mm256_blendv_epi8(val0, val1, ge));
+    }
+}
+
+void vs_binarize_word_avx2(const void *src, void *dst, union vs_pixel_value threshold, union vs_pixel_value v0, union vs_pixel_value v1, unsigned n)
+{
+    const uint16_t *srcp = src;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    __m256i thr = _mm256_set1_epi16((short)threshold.u);
+    __m256i val0 = _mm256_set1_epi16((short)v0.u);
+    __m256i val1 = _mm256_set1_epi16((short)v1.u);
+
+    for (i = 0; i < n; i += 16) {
+        __m256i x = _mm256_load_si256((const __m256i *)(srcp + i));
+        __m256i ge = _mm256_cmpeq_epi16(_mm256_max_epu16(x, thr), x);
+        _mm256_store_si256((__m256i *)(dstp + i), _mm256_blendv_epi8(val0, val1, ge));
+    }
+}
+
+void vs_binarize_float_avx2(const void *src, void *dst, union vs_pixel_value threshold, union vs_pixel_value v0, union vs_pixel_value v1, unsigned n)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    __m256 thr = _mm256_set1_ps(threshold.f);
+    __m256 val0 = _mm256_set1_ps(v0.f);
+    __m256 val1 = _mm256_set1_ps(v1.f);
+
+    for (i = 0; i < n; i += 8) {
+        __m256 lt = _mm256_cmp_ps(_mm256_load_ps(srcp + i), thr, _CMP_LT_OQ);
+        _mm256_store_ps(dstp + i, _mm256_blendv_ps(val1, val0, lt));
+    }
+}
+
+/* Same approximation as the SSE2 version. */
+static __m256 pow_ps(__m256 x, __m256 gamma)
+{
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 valid = _mm256_cmp_ps(x, _mm256_set1_ps(1.17549435e-38f), _CMP_GE_OQ);
+    __m256i e;
+    __m256 m, fe, mask, z, y, t;
+
+    /* log: x = m * 2^e with m in [sqrt(0.5), sqrt(2)) */
+    e = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(x), 23), _mm256_set1_epi32(0x7E));
+    m = _mm256_or_ps(_mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(0x007FFFFF))), _mm256_set1_ps(0.5f));
+    fe = _mm256_cvtepi32_ps(e);
+    mask = _mm256_cmp_ps(m, _mm256_set1_ps(0.707106781186547524f), _CMP_LT_OQ);
+    t = _mm256_and_ps(m, mask);
+    m = _mm256_sub_ps(m, one);
+    fe = _mm256_sub_ps(fe, _mm256_and_ps(one, mask));
+    m = _mm256_add_ps(m, t);
+
+    z = _mm256_mul_ps(m, m);
+    y = _mm256_set1_ps(7.0376836292e-2f);
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(-1.1514610310e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(1.1676998740e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(-1.2420140846e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(1.4249322787e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(-1.6668057665e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(2.0000714765e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(-2.4999993993e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(3.3333331174e-1f));
+    y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+    y = _mm256_add_ps(y, _mm256_mul_ps(fe, _mm256_set1_ps(-2.12194440e-4f)));
+    y = _mm256_sub_ps(y, _mm256_mul_ps(z, _mm256_set1_ps(0.5f)));
+    x = _mm256_add_ps(_mm256_add_ps(m, y), _mm256_mul_ps(fe, _mm256_set1_ps(0.693359375f)));
+
+    /* exp of gamma * log(x) */
+    x = _mm256_mul_ps(x, gamma);
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3365448f)), _mm256_set1_ps(88.3762626647949f));
+
+    fe = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)), _mm256_set1_ps(0.5f)));
+
+    x = _mm256_sub_ps(x, _mm256_mul_ps(fe, _mm256_set1_ps(0.693359375f)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(fe, _mm256_set1_ps(-2.12194440e-4f)));
+    z = _mm256_mul_ps(x, x);
+
+    y = _mm256_set1_ps(1.9875691500e-4f);
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(1.3981999507e-3f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(8.3334519073e-3f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(4.1665795894e-2f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(1.6666665459e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(5.0000001201e-1f));
+    y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(y, z), x), one);
+
+    e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(fe), _mm256_set1_epi32(0x7F)), 23);
+    y = _mm256_mul_ps(y, _mm256_castsi256_ps(e));
+
+    return _mm256_and_ps(y, valid);
+}
+
+void vs_levels_float_avx2(const void *src, void *dst, const struct vs_levels_params *params, unsigned n)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    __m256 max_in = _mm256_set1_ps(params->max_in);
+    __m256 min_in = _mm256_set1_ps(params->min_in);
+    __m256 min_out = _mm256_set1_ps(params->min_out);
+    __m256 scale_in = _mm256_set1_ps(params->scale_in);
+    __m256 scale_out = _mm256_set1_ps(params->scale_out);
+    __m256 gamma = _mm256_set1_ps(params->gamma);
+
+    if (params->gamma == 1.0f) {
+        __m256 scale = _mm256_set1_ps(params->scale_in * params->scale_out);
+
+        for (i = 0; i < n; i += 8) {
+            __m256 x = _mm256_max_ps(_mm256_sub_ps(_mm256_min_ps(_mm256_load_ps(srcp + i), max_in), min_in), _mm256_setzero_ps());
+            _mm256_store_ps(dstp + i, _mm256_add_ps(_mm256_mul_ps(x, scale), min_out));
+        }
+    } else {
+        for (i = 0; i < n; i += 8) {
+            __m256 x = _mm256_max_ps(_mm256_sub_ps(_mm256_min_ps(_mm256_load_ps(srcp + i), max_in), min_in), _mm256_setzero_ps());
+            x = pow_ps(_mm256_mul_ps(x, scale_in), gamma);
+            _mm256_store_ps(dstp + i, _mm256_add_ps(_mm256_mul_ps(x, scale_out), min_out));
+        }
+    }
+}
@@ -0,0 +1,253 @@
+/*
+* Copyright (c) 2012-2020 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <emmintrin.h>
+#include "../pointops.h"
+
+void vs_invert_byte_sse2(const void *src, void *dst, union vs_pixel_value max, unsigned n)
+{
+    const uint8_t *srcp = src;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    __m128i maxval = _mm_set1_epi8((char)max.u);
+
+    for (i = 0; i < n; i += 16) {
+        __m128i x = _mm_load_si128((const __m128i *)(srcp + i));
+        _mm_store_si128((__m128i *)(dstp + i), _mm_sub_epi8(maxval, _mm_min_epu8(x, maxval)));
+    }
+}
+
+void vs_invert_word_sse2(const void *src, void *dst, union vs_pixel_value max, unsigned n)
+{
+    const uint16_t *srcp = src;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    __m128i maxval = _mm_set1_epi16((short)max.u);
+
+    for (i = 0; i < n; i += 8) {
+        __m128i x = _mm_load_si128((const __m128i *)(srcp + i));
+        /* max - min(x, max) without an unsigned 16 bit min */
+        _mm_store_si128((__m128i *)(dstp + i), _mm_subs_epu16(maxval, x));
+    }
+}
+
+void vs_invert_float_sse2(const void *src, void *dst, union vs_pixel_value max, unsigned n)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    __m128 maxval = _mm_set_ps1(max.f);
+
+    for (i = 0; i < n; i += 4) {
+        _mm_store_ps(dstp + i, _mm_sub_ps(maxval, _mm_load_ps(srcp + i)));
+    }
+}
+
+void vs_limit_byte_sse2(const void *src, void *dst, union vs_pixel_value min, union vs_pixel_value max, unsigned n)
+{
+    const uint8_t *srcp = src;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    __m128i minval = _mm_set1_epi8((char)min.u);
+    __m128i maxval = _mm_set1_epi8((char)max.u);
+
+    for (i = 0; i < n; i += 16) {
+        __m128i x = _mm_load_si128((const __m128i *)(srcp + i));
+        _mm_store_si128((__m128i *)(dstp + i), _mm_min_epu8(_mm_max_epu8(x, minval), maxval));
+    }
+}
+
+void vs_limit_word_sse2(const void *src, void *dst, union vs_pixel_value min, union vs_pixel_value max, unsigned n)
+{
+    const uint16_t *srcp = src;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    __m128i minval = _mm_set1_epi16((short)min.u);
+    __m128i maxval = _mm_set1_epi16((short)max.u);
+
+    for (i = 0; i < n; i += 8) {
+        __m128i x = _mm_load_si128((const __m128i *)(srcp + i));
+        /* unsigned max and min through saturating arithmetic */
+        x = _mm_adds_epu16(_mm_subs_epu16(x, minval), minval);
+        x = _mm_sub_epi16(x, _mm_subs_epu16(x, maxval));
+        _mm_store_si128((__m128i *)(dstp + i), x);
+    }
+}
+
+void vs_limit_float_sse2(const void *src, void *dst, union vs_pixel_value min, union vs_pixel_value max, unsigned n)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    __m128 minval = _mm_set_ps1(min.f);
+    __m128 maxval = _mm_set_ps1(max.f);
+
+    for (i = 0; i < n; i += 4) {
+        _mm_store_ps(dstp + i, _mm_min_ps(_mm_max_ps(_mm_load_ps(srcp + i), minval), maxval));
+    }
+}
+
+void vs_binarize_byte_sse2(const void *src, void *dst, union vs_pixel_value threshold, union vs_pixel_value v0, union vs_pixel_value v1, unsigned n)
+{
+    const uint8_t *srcp = src;
+    uint8_t *dstp = dst;
+    unsigned i;
+
+    __m128i thr = _mm_set1_epi8((char)threshold.u);
+    __m128i val0 = _mm_set1_epi8((char)v0.u);
+    __m128i val1 = _mm_set1_epi8((char)v1.u);
+
+    for (i = 0; i < n; i += 16) {
+        __m128i x = _mm_load_si128((const __m128i *)(srcp + i));
+        /* thr - x saturates to zero exactly when x >= thr */
+        __m128i lt = _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(thr, x), _mm_setzero_si128()), _mm_set1_epi8(-1));
+        _mm_store_si128((__m128i *)(dstp + i), _mm_or_si128(_mm_and_si128(lt, val0), _mm_andnot_si128(lt, val1)));
+    }
+}
+
+void vs_binarize_word_sse2(const void *src, void *dst, union vs_pixel_value threshold, union vs_pixel_value v0, union vs_pixel_value v1, unsigned n)
+{
+    const uint16_t *srcp = src;
+    uint16_t *dstp = dst;
+    unsigned i;
+
+    __m128i thr = _mm_set1_epi16((short)threshold.u);
+    __m128i val0 = _mm_set1_epi16((short)v0.u);
+    __m128i val1 = _mm_set1_epi16((short)v1.u);
+
+    for (i = 0; i < n; i += 8) {
+        __m128i x = _mm_load_si128((const __m128i *)(srcp + i));
+        __m128i ge = _mm_cmpeq_epi16(_mm_subs_epu16(thr, x), _mm_setzero_si128());
+        _mm_store_si128((__m128i *)(dstp + i), _mm_or_si128(_mm_andnot_si128(ge, val0), _mm_and_si128(ge, val1)));
+    }
+}
+
+void vs_binarize_float_sse2(const void *src, void *dst, union vs_pixel_value threshold, union vs_pixel_value v0, union vs_pixel_value v1, unsigned n)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    __m128 thr = _mm_set_ps1(threshold.f);
+    __m128 val0 = _mm_set_ps1(v0.f);
+    __m128 val1 = _mm_set_ps1(v1.f);
+
+    for (i = 0; i < n; i += 4) {
+        __m128 lt = _mm_cmplt_ps(_mm_load_ps(srcp + i), thr);
+        _mm_store_ps(dstp + i, _mm_or_ps(_mm_and_ps(lt, val0), _mm_andnot_ps(lt, val1)));
+    }
+}
+
+/*
+ * Cephes style logf and expf, accurate to a few ulp over the range Levels needs. Inputs below
+ * FLT_MIN give 0 so denormals and zero don't have to be special cased afterwards.
+ */
+static __m128 pow_ps(__m128 x, __m128 gamma)
+{
+    __m128 one = _mm_set_ps1(1.0f);
+    __m128 valid = _mm_cmpge_ps(x, _mm_set_ps1(1.17549435e-38f));
+    __m128i e;
+    __m128 m, fe, mask, z, y, t;
+
+    /* log: x = m * 2^e with m in [sqrt(0.5), sqrt(2)) */
+    e = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(x), 23), _mm_set1_epi32(0x7E));
+    m = _mm_or_ps(_mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x007FFFFF))), _mm_set_ps1(0.5f));
+    fe = _mm_cvtepi32_ps(e);
+    mask = _mm_cmplt_ps(m, _mm_set_ps1(0.707106781186547524f));
+    t = _mm_and_ps(m, mask);
+    m = _mm_sub_ps(m, one);
+    fe = _mm_sub_ps(fe, _mm_and_ps(one, mask));
+    m = _mm_add_ps(m, t);
+
+    z = _mm_mul_ps(m, m);
+    y = _mm_set_ps1(7.0376836292e-2f);
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set_ps1(-1.1514610310e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set_ps1(1.1676998740e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set_ps1(-1.2420140846e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set_ps1(1.4249322787e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set_ps1(-1.6668057665e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set_ps1(2.0000714765e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set_ps1(-2.4999993993e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set_ps1(3.3333331174e-1f));
+    y = _mm_mul_ps(_mm_mul_ps(y, m), z);
+    y = _mm_add_ps(y, _mm_mul_ps(fe, _mm_set_ps1(-2.12194440e-4f)));
+    y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set_ps1(0.5f)));
+    x = _mm_add_ps(_mm_add_ps(m, y), _mm_mul_ps(fe, _mm_set_ps1(0.693359375f)));
+
+    /* exp of gamma * log(x) */
+    x = _mm_mul_ps(x, gamma);
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set_ps1(-87.3365448f)), _mm_set_ps1(88.3762626647949f));
+
+    t = _mm_add_ps(_mm_mul_ps(x, _mm_set_ps1(1.44269504088896341f)), _mm_set_ps1(0.5f));
+    fe = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+    fe = _mm_sub_ps(fe, _mm_and_ps(_mm_cmpgt_ps(fe, t), one));
+
+    x = _mm_sub_ps(x, _mm_mul_ps(fe, _mm_set_ps1(0.693359375f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(fe, _mm_set_ps1(-2.12194440e-4f)));
+    z = _mm_mul_ps(x, x);
+
+    y = _mm_set_ps1(1.9875691500e-4f);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set_ps1(1.3981999507e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set_ps1(8.3334519073e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set_ps1(4.1665795894e-2f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set_ps1(1.6666665459e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set_ps1(5.0000001201e-1f));
+    y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), one);
+
+    e = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(fe), _mm_set1_epi32(0x7F)), 23);
+    y = _mm_mul_ps(y, _mm_castsi128_ps(e));
+
+    return _mm_and_ps(y, valid);
+}
+
+void vs_levels_float_sse2(const void *src, void *dst, const struct vs_levels_params *params, unsigned n)
+{
+    const float *srcp = src;
+    float *dstp = dst;
+    unsigned i;
+
+    __m128 max_in = _mm_set_ps1(params->max_in);
+    __m128 min_in = _mm_set_ps1(params->min_in);
+    __m128 min_out = _mm_set_ps1(params->min_out);
+    __m128 scale_in = _mm_set_ps1(params->scale_in);
+    __m128 scale_out = _mm_set_ps1(params->scale_out);
+    __m128 gamma = _mm_set_ps1(params->gamma);
+
+    if (params->gamma == 1.0f) {
+        __m128 scale = _mm_set_ps1(params->scale_in * params->scale_out);
+
+        for (i = 0; i < n; i += 4) {
+            __m128 x = _mm_max_ps(_mm_sub_ps(_mm_min_ps(_mm_load_ps(srcp + i), max_in), min_in), _mm_setzero_ps());
+            _mm_store_ps(dstp + i, _mm_add_ps(_mm_mul_ps(x, scale), min_out));
+        }
+    } else {
+        for (i = 0; i < n; i += 4) {
+            __m128 x = _mm_max_ps(_mm_sub_ps(_mm_min_ps(_mm_load_ps(srcp + i), max_in), min_in), _mm_setzero_ps());
+            x = pow_ps(_mm_mul_ps(x, scale_in), gamma);
+            _mm_store_ps(dstp + i, _mm_add_ps(_mm_mul_ps(x, scale_out), min_out));
+        }
+    }
+}
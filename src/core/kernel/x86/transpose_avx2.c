@@ -0,0 +1,132 @@
+/*
+* Copyright (c) 2012-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+#define VS_TRANSPOSE_IMPL
+#define BLOCK_WIDTH_BYTE 32
+#define BLOCK_HEIGHT_BYTE 16
+#define BLOCK_WIDTH_WORD 16
+#define BLOCK_HEIGHT_WORD 8
+#define BLOCK_WIDTH_DWORD 8
+#define BLOCK_HEIGHT_DWORD 8
+#include "../transpose.h"
+
+/*
+ * The byte and word blocks transpose both 128-bit lanes independently, lane L of result k is then
+ * output row L * lanewidth + k. The dword block combines two 4x4 lane transposes into full rows.
+ */
+static void transpose_block_byte(const uint8_t * VS_RESTRICT src, ptrdiff_t src_stride, uint8_t * VS_RESTRICT dst, ptrdiff_t dst_stride)
+{
+    __m256i row[16];
+    __m256i tmp[16];
+    unsigned i, k;
+
+    for (i = 0; i < 16; ++i) {
+        row[i] = _mm256_loadu_si256((const __m256i *)ADD_OFFSET(src, i * src_stride));
+    }
+
+    for (k = 0; k < 4; ++k) {
+        for (i = 0; i < 8; ++i) {
+            tmp[2 * i + 0] = _mm256_unpacklo_epi8(row[i], row[i + 8]);
+            tmp[2 * i + 1] = _mm256_unpackhi_epi8(row[i], row[i + 8]);
+        }
+        for (i = 0; i < 16; ++i) {
+            row[i] = tmp[i];
+        }
+    }
+
+    for (k = 0; k < 16; ++k) {
+        _mm_storeu_si128((__m128i *)ADD_OFFSET(dst, k * dst_stride), _mm256_castsi256_si128(row[k]));
+        _mm_storeu_si128((__m128i *)ADD_OFFSET(dst, (k + 16) * dst_stride), _mm256_extracti128_si256(row[k], 1));
+    }
+}
+
+static void transpose_block_word(const uint16_t * VS_RESTRICT src, ptrdiff_t src_stride, uint16_t * VS_RESTRICT dst, ptrdiff_t dst_stride)
+{
+    __m256i row[8];
+    __m256i tmp[8];
+    unsigned i, k;
+
+    for (i = 0; i < 8; ++i) {
+        row[i] = _mm256_loadu_si256((const __m256i *)ADD_OFFSET(src, i * src_stride));
+    }
+
+    for (k = 0; k < 3; ++k) {
+        for (i = 0; i < 4; ++i) {
+            tmp[2 * i + 0] = _mm256_unpacklo_epi16(row[i], row[i + 4]);
+            tmp[2 * i + 1] = _mm256_unpackhi_epi16(row[i], row[i + 4]);
+        }
+        for (i = 0; i < 8; ++i) {
+            row[i] = tmp[i];
+        }
+    }
+
+    for (k = 0; k < 8; ++k) {
+        _mm_storeu_si128((__m128i *)ADD_OFFSET(dst, k * dst_stride), _mm256_castsi256_si128(row[k]));
+        _mm_storeu_si128((__m128i *)ADD_OFFSET(dst, (k + 8) * dst_stride), _mm256_extracti128_si256(row[k], 1));
+    }
+}
+
+static void transpose_block_dword(const uint32_t * VS_RESTRICT src, ptrdiff_t src_stride, uint32_t * VS_RESTRICT dst, ptrdiff_t dst_stride)
+{
+    __m256i row[8];
+    __m256i tmp[8];
+    unsigned i, k;
+
+    for (i = 0; i < 8; ++i) {
+        row[i] = _mm256_loadu_si256((const __m256i *)ADD_OFFSET(src, i * src_stride));
+    }
+
+    /* Rows 0-3 and 4-7 are transposed as separate groups. */
+    for (k = 0; k < 2; ++k) {
+        for (i = 0; i < 2; ++i) {
+            tmp[2 * i + 0] = _mm256_unpacklo_epi32(row[i], row[i + 2]);
+            tmp[2 * i + 1] = _mm256_unpackhi_epi32(row[i], row[i + 2]);
+            tmp[2 * i + 4] = _mm256_unpacklo_epi32(row[i + 4], row[i + 6]);
+            tmp[2 * i + 5] = _mm256_unpackhi_epi32(row[i + 4], row[i + 6]);
+        }
+        for (i = 0; i < 8; ++i) {
+            row[i] = tmp[i];
+        }
+    }
+
+    for (k = 0; k < 4; ++k) {
+        _mm256_storeu_si256((__m256i *)ADD_OFFSET(dst, k * dst_stride), _mm256_permute2x128_si256(row[k], row[k + 4], 0x20));
+        _mm256_storeu_si256((__m256i *)ADD_OFFSET(dst, (k + 4) * dst_stride), _mm256_permute2x128_si256(row[k], row[k + 4], 0x31));
+    }
+}
+
+void vs_transpose_plane_byte_avx2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height)
+{
+    transpose_plane_byte(src, src_stride, dst, dst_stride, width, height);
+}
+
+void vs_transpose_plane_word_avx2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height)
+{
+    transpose_plane_word(src, src_stride, dst, dst_stride, width, height);
+}
+
+void vs_transpose_plane_dword_avx2(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height)
+{
+    transpose_plane_dword(src, src_stride, dst, dst_stride, width, height);
+}
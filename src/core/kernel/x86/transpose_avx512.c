@@ -0,0 +1,182 @@
+/*
+* Copyright (c) 2012-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+#include "../transpose.h"
+
+#define ADD_OFFSET(p, stride) ((p) + (stride) / (sizeof(*(p))))
+
+#define CACHELINE_SIZE 64
+
+/* Same two level tiling as transpose.h, a multiple of all block widths and cache line sizes in pixels. */
+#define TILE_SIZE 64U
+
+/*
+ * Each block loads up to 16 rows of 64 bytes (8 rows of 32 words, 4 rows of 16 dwords) and transposes
+ * the four 128-bit lanes independently. Lane L of result k then holds output row L * lanewidth + k.
+ * Partial blocks at the right and bottom edge use masked loads and stores, so no scalar remainder loops
+ * are needed and nothing outside the plane is touched.
+ */
+static __mmask64 tail_mask64(unsigned n)
+{
+    return n >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << n) - 1;
+}
+
+static __mmask32 tail_mask32(unsigned n)
+{
+    return n >= 32 ? ~(__mmask32)0 : ((__mmask32)1 << n) - 1;
+}
+
+static __mmask16 tail_mask16(unsigned n)
+{
+    return n >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1U << n) - 1);
+}
+
+static __m128i extract_lane(__m512i x, unsigned lane)
+{
+    switch (lane) {
+    case 0: return _mm512_castsi512_si128(x);
+    case 1: return _mm512_extracti32x4_epi32(x, 1);
+    case 2: return _mm512_extracti32x4_epi32(x, 2);
+    default: return _mm512_extracti32x4_epi32(x, 3);
+    }
+}
+
+static void transpose_block_byte(const uint8_t * VS_RESTRICT src, ptrdiff_t src_stride, uint8_t * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned w, unsigned h)
+{
+    __mmask64 load_mask = tail_mask64(w);
+    __mmask16 store_mask = tail_mask16(h);
+    __m512i row[16];
+    __m512i tmp[16];
+    unsigned i, k, lane;
+
+    for (i = 0; i < 16; ++i) {
+        row[i] = i < h ? _mm512_maskz_loadu_epi8(load_mask, ADD_OFFSET(src, i * src_stride)) : _mm512_setzero_si512();
+    }
+
+    for (k = 0; k < 4; ++k) {
+        for (i = 0; i < 8; ++i) {
+            tmp[2 * i + 0] = _mm512_unpacklo_epi8(row[i], row[i + 8]);
+            tmp[2 * i + 1] = _mm512_unpackhi_epi8(row[i], row[i + 8]);
+        }
+        for (i = 0; i < 16; ++i) {
+            row[i] = tmp[i];
+        }
+    }
+
+    for (lane = 0; lane < 4; ++lane) {
+        for (k = 0; k < 16 && lane * 16 + k < w; ++k) {
+            _mm_mask_storeu_epi8(ADD_OFFSET(dst, (lane * 16 + k) * dst_stride), store_mask, extract_lane(row[k], lane));
+        }
+    }
+}
+
+static void transpose_block_word(const uint16_t * VS_RESTRICT src, ptrdiff_t src_stride, uint16_t * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned w, unsigned h)
+{
+    __mmask32 load_mask = tail_mask32(w);
+    __mmask8 store_mask = (__mmask8)tail_mask16(h);
+    __m512i row[8];
+    __m512i tmp[8];
+    unsigned i, k, lane;
+
+    for (i = 0; i < 8; ++i) {
+        row[i] = i < h ? _mm512_maskz_loadu_epi16(load_mask, ADD_OFFSET(src, i * src_stride)) : _mm512_setzero_si512();
+    }
+
+    for (k = 0; k < 3; ++k) {
+        for (i = 0; i < 4; ++i) {
+            tmp[2 * i + 0] = _mm512_unpacklo_epi16(row[i], row[i + 4]);
+            tmp[2 * i + 1] = _mm512_unpackhi_epi16(row[i], row[i + 4]);
+        }
+        for (i = 0; i < 8; ++i) {
+            row[i] = tmp[i];
+        }
+    }
+
+    for (lane = 0; lane < 4; ++lane) {
+        for (k = 0; k < 8 && lane * 8 + k < w; ++k) {
+            _mm_mask_storeu_epi16(ADD_OFFSET(dst, (lane * 8 + k) * dst_stride), store_mask, extract_lane(row[k], lane));
+        }
+    }
+}
+
+static void transpose_block_dword(const uint32_t * VS_RESTRICT src, ptrdiff_t src_stride, uint32_t * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned w, unsigned h)
+{
+    __mmask16 load_mask = tail_mask16(w);
+    __mmask8 store_mask = (__mmask8)tail_mask16(h);
+    __m512i row[4];
+    __m512i tmp[4];
+    unsigned i, k, lane;
+
+    for (i = 0; i < 4; ++i) {
+        row[i] = i < h ? _mm512_maskz_loadu_epi32(load_mask, ADD_OFFSET(src, i * src_stride)) : _mm512_setzero_si512();
+    }
+
+    for (k = 0; k < 2; ++k) {
+        for (i = 0; i < 2; ++i) {
+            tmp[2 * i + 0] = _mm512_unpacklo_epi32(row[i], row[i + 2]);
+            tmp[2 * i + 1] = _mm512_unpackhi_epi32(row[i], row[i + 2]);
+        }
+        for (i = 0; i < 4; ++i) {
+            row[i] = tmp[i];
+        }
+    }
+
+    for (lane = 0; lane < 4; ++lane) {
+        for (k = 0; k < 4 && lane * 4 + k < w; ++k) {
+            _mm_mask_storeu_epi32(ADD_OFFSET(dst, (lane * 4 + k) * dst_stride), store_mask, extract_lane(row[k], lane));
+        }
+    }
+}
+
+#define TRANSPOSE_PLANE(pixel, T, block_width, block_height) \
+void vs_transpose_plane_##pixel##_avx512(const void * VS_RESTRICT src, ptrdiff_t src_stride, void * VS_RESTRICT dst, ptrdiff_t dst_stride, unsigned width, unsigned height) \
+{ \
+    const T *src_p = src; \
+    T *dst_p = dst; \
+    unsigned i, j, ii, ti, tj; \
+ \
+    for (ti = 0; ti < height; ti += TILE_SIZE) { \
+        unsigned ti_end = VSMIN(height, ti + TILE_SIZE); \
+ \
+        for (tj = 0; tj < width; tj += TILE_SIZE) { \
+            unsigned tj_end = VSMIN(width, tj + TILE_SIZE); \
+ \
+            for (i = ti; i < ti_end; i += CACHELINE_SIZE / sizeof(T)) { \
+                unsigned i_end = VSMIN(ti_end, i + (unsigned)(CACHELINE_SIZE / sizeof(T))); \
+ \
+                for (j = tj; j < tj_end; j += block_width) { \
+                    /* Prioritize contiguous stores over contiguous loads. */ \
+                    for (ii = i; ii < i_end; ii += block_height) { \
+                        transpose_block_##pixel(ADD_OFFSET(src_p, ii * src_stride) + j, src_stride, ADD_OFFSET(dst_p, j * dst_stride) + ii, dst_stride, \
+                            VSMIN(tj_end - j, block_width), VSMIN(i_end - ii, block_height)); \
+                    } \
+                } \
+            } \
+        } \
+    } \
+}
+
+TRANSPOSE_PLANE(byte, uint8_t, 64U, 16U)
+TRANSPOSE_PLANE(word, uint16_t, 32U, 8U)
+TRANSPOSE_PLANE(dword, uint32_t, 16U, 4U)
@@ -25,12 +25,19 @@
 #include <limits>
 #include <string>
 #include <algorithm>
+#include <vector>
+#include "cpufeatures.h"
 #include "internalfilters.h"
 #include "VSHelper4.h"
 #include "filtershared.h"
+#include "kernel/cpulevel.h"
+#include "kernel/lut.h"
 
 using namespace vsh;
 
+// Script functions are called for chunks of this many table entries in parallel
+static const int lutChunkSize = 256;
+
 //////////////////////////////////////////
 // Lut
 
@@ -40,6 +47,7 @@ typedef struct LutDataExtra {
     VSVideoInfo vi_out;
     const VSVideoInfo *vi;
     void *lut;
+    decltype(&vs_lut_byte_byte_c) func;
     bool process[3];
     ~LutDataExtra() { free(lut); };
 } LutDataExtra;
@@ -48,7 +56,6 @@ typedef SingleNodeData<LutDataExtra> LutData;
 
 } // namespace
 
-template<typename T, typename U>
 static const VSFrame *VS_CC lutGetframe(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     LutData *d = reinterpret_cast<LutData *>(instanceData);
 
@@ -57,30 +64,29 @@ static const VSFrame *VS_CC lutGetframe(int n, int activationReason, void *insta
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
         const VSVideoFormat &fi = d->vi_out.format;
+        if (vsapi->isPropsOnlyRequest(frameCtx))
+            return propsOnlyFrame(src, &fi, vsapi->getFrameWidth(src, 0), vsapi->getFrameHeight(src, 0), core, vsapi);
         const int pl[] = {0, 1, 2};
         const VSFrame *fr[] = {d->process[0] ? 0 : src, d->process[1] ? 0 : src, d->process[2] ? 0 : src};
         VSFrame *dst = vsapi->newVideoFrame2(&fi, vsapi->getFrameWidth(src, 0), vsapi->getFrameHeight(src, 0), fr, pl, src, core);
 
-        T maxval = static_cast<T>((static_cast<int64_t>(1) << fi.bitsPerSample) - 1);
+        unsigned maxval = (1U << d->vi->format.bitsPerSample) - 1;
 
         for (int plane = 0; plane < fi.numPlanes; plane++) {
 
             if (d->process[plane]) {
-                const T * VS_RESTRICT srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane));
+                const uint8_t *srcp = vsapi->getReadPtr(src, plane);
                 ptrdiff_t src_stride = vsapi->getStride(src, plane);
-                U * VS_RESTRICT dstp = reinterpret_cast<U *>(vsapi->getWritePtr(dst, plane));
+                uint8_t *dstp = vsapi->getWritePtr(dst, plane);
                 ptrdiff_t dst_stride = vsapi->getStride(dst, plane);
                 int h = vsapi->getFrameHeight(src, plane);
                 int w = vsapi->getFrameWidth(src, plane);
 
-                const U * VS_RESTRICT lut = reinterpret_cast<const U *>(d->lut);
-
                 for (int hl = 0; hl < h; hl++) {
-                    for (int x = 0; x < w; x++)
-                        dstp[x] =  lut[std::min(srcp[x], maxval)];
+                    d->func(srcp, dstp, d->lut, maxval, w);
 
-                    dstp += dst_stride / sizeof(U);
-                    srcp += src_stride / sizeof(T);
+                    dstp += dst_stride;
+                    srcp += src_stride;
                 }
             }
         }
@@ -92,67 +98,94 @@ static const VSFrame *VS_CC lutGetframe(int n, int activationReason, void *insta
     return nullptr;
 }
 
-template<typename T>
-static bool funcToLut(int nin, int nout, void *vlut, VSFunction *func, const VSAPI *vsapi, std::string &errstr) {
-    VSMap *in = vsapi->createMap();
-    VSMap *out = vsapi->createMap();
+static void VS_CC lutStripe(int plane, const uint8_t *srcp, ptrdiff_t srcStride, uint8_t *dstp, ptrdiff_t dstStride, int width, int height, void *instanceData, const VSAPI *vsapi) {
+    LutData *d = reinterpret_cast<LutData *>(instanceData);
+    unsigned maxval = (1U << d->vi->format.bitsPerSample) - 1;
 
-    T *lut = reinterpret_cast<T *>(vlut);
+    for (int hl = 0; hl < height; hl++) {
+        d->func(srcp, dstp, d->lut, maxval, width);
+
+        dstp += dstStride;
+        srcp += srcStride;
+    }
+}
 
-    for (int i = 0; i < nin; i++) {
-        vsapi->mapSetInt(in, "x", i, maReplace);
-        vsapi->callFunction(func, in, out);
+template<typename T>
+static bool funcToLut(int nin, int nout, void *vlut, VSFunction *func, VSCore *core, const VSAPI *vsapi, std::string &errstr) {
+    T *lut = reinterpret_cast<T *>(vlut);
+    int nchunks = (nin + lutChunkSize - 1) / lutChunkSize;
+    std::vector<std::string> errors(nchunks);
 
-        const char *ret = vsapi->mapGetError(out);
-        if (ret) {
-            errstr = ret;
-            break;
-        }
+    parallelForEach(nchunks, [&](int chunk) {
+        VSMap *in = vsapi->createMap();
+        VSMap *out = vsapi->createMap();
+        std::string &errstr = errors[chunk];
 
-        int err;
-        if (std::numeric_limits<T>::is_integer) {
-            int64_t v = vsapi->mapGetInt(out, "val", 0, &err);
-            vsapi->clearMap(out);
+        for (int i = chunk * lutChunkSize; i < std::min(nin, (chunk + 1) * lutChunkSize); i++) {
+            vsapi->mapSetInt(in, "x", i, maReplace);
+            vsapi->callFunction(func, in, out);
 
-            if (v < 0 || v >= nout || err) {
-                errstr = "Lut: function(" + std::to_string(i) + ") returned invalid value: " + std::to_string(v);
+            const char *ret = vsapi->mapGetError(out);
+            if (ret) {
+                errstr = ret;
                 break;
             }
 
-            lut[i] = static_cast<T>(v);
-        } else {
-            double v = vsapi->mapGetFloat(out, "val", 0, &err);
-            vsapi->clearMap(out);
+            int err;
+            if (std::numeric_limits<T>::is_integer) {
+                int64_t v = vsapi->mapGetInt(out, "val", 0, &err);
+                vsapi->clearMap(out);
 
-            if (err) {
-                errstr = "Lut: function(" + std::to_string(i) + ") returned invalid value: " + std::to_string(v);
-                break;
+                if (v < 0 || v >= nout || err) {
+                    errstr = "Lut: function(" + std::to_string(i) + ") returned invalid value: " + std::to_string(v);
+                    break;
+                }
+
+                lut[i] = static_cast<T>(v);
+            } else {
+                double v = vsapi->mapGetFloat(out, "val", 0, &err);
+                vsapi->clearMap(out);
+
+                if (err) {
+                    errstr = "Lut: function(" + std::to_string(i) + ") returned invalid value: " + std::to_string(v);
+                    break;
+                }
+
+                lut[i] = static_cast<T>(v);
             }
+        }
+
+        vsapi->freeMap(in);
+        vsapi->freeMap(out);
+    }, core, vsapi);
 
-            lut[i] = static_cast<T>(v);
+    // report the error of the lowest entry like a serial evaluation would
+    for (const std::string &e : errors) {
+        if (!e.empty()) {
+            errstr = e;
+            break;
         }
     }
 
-    vsapi->freeMap(in);
-    vsapi->freeMap(out);
-
     return errstr.empty();
 }
 
 template<typename T, typename U>
-static void lutCreateHelper(const VSMap *in, VSMap *out, VSFunction *func, std::unique_ptr<LutData> &d, VSCore *core, const VSAPI *vsapi) {
+static void lutCreateHelper(const VSMap *in, VSMap *out, VSFunction *func, const char *expr, std::unique_ptr<LutData> &d, VSCore *core, const VSAPI *vsapi) {
     int inrange = 1 << d->vi->format.bitsPerSample;
     int maxval = 1 << d->vi_out.format.bitsPerSample;
 
-    d->lut = malloc(inrange * sizeof(U));
+    d->lut = malloc(inrange * sizeof(U) + VS_LUT_PADDING);
 
     if (func) {
         std::string errstr;
-        funcToLut<U>(inrange, maxval, d->lut, func, vsapi, errstr);
+        funcToLut<U>(inrange, maxval, d->lut, func, core, vsapi, errstr);
         vsapi->freeFunction(func);
 
         if (!errstr.empty())
             RETERROR(errstr.c_str());
+    } else if (expr) {
+        exprGenerateLut(expr, d->vi->format.bitsPerSample, 0, &d->vi_out.format, d->lut, core, vsapi);
     } else {
 
         U *lut = reinterpret_cast<U *>(d->lut);
@@ -176,8 +209,33 @@ static void lutCreateHelper(const VSMap *in, VSMap *out, VSFunction *func, std::
         }
     }
 
+    bool wordin = sizeof(T) == 2;
+    int outbytes = d->vi_out.format.bytesPerSample;
+    d->func = nullptr;
+#ifdef VS_TARGET_CPU_X86
+    if (getCPUFeatures()->avx2 && vs_get_cpulevel(core) >= VS_CPU_LEVEL_AVX2) {
+        if (outbytes == 1)
+            d->func = wordin ? vs_lut_word_byte_avx2 : vs_lut_byte_byte_avx2;
+        else if (outbytes == 2)
+            d->func = wordin ? vs_lut_word_word_avx2 : vs_lut_byte_word_avx2;
+        else
+            d->func = wordin ? vs_lut_word_float_avx2 : vs_lut_byte_float_avx2;
+    }
+#endif
+    if (!d->func) {
+        if (outbytes == 1)
+            d->func = wordin ? vs_lut_word_byte_c : vs_lut_byte_byte_c;
+        else if (outbytes == 2)
+            d->func = wordin ? vs_lut_word_word_c : vs_lut_byte_word_c;
+        else
+            d->func = wordin ? vs_lut_word_float_c : vs_lut_byte_float_c;
+    }
+
     VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
-    vsapi->createVideoFilter(out, "Lut", &d->vi_out, lutGetframe<T, U>, filterFree<LutData>, fmParallel, deps, 1, d.get(), core);
+    VSNode *node = vsapi->createVideoFilter2("Lut", &d->vi_out, lutGetframe, filterFree<LutData>, fmParallel, deps, 1, d.get(), core);
+    vsapi->setFilterStripe(node, lutStripe, 0, getPlanesMask(d->process));
+    vsapi->setFilterHints(node, fcUnknown, 0, 0);
+    vsapi->mapConsumeNode(out, "clip", node, maAppend);
     d.release();
 }
 
@@ -210,19 +268,20 @@ static void VS_CC lutCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         getPlanesArg(in, d->process, vsapi);
 
         VSFunction *func = vsapi->mapGetFunction(in, "function", 0, &err);
+        const char *expr = vsapi->mapGetData(in, "expr", 0, &err);
         int lut_elem = vsapi->mapNumElements(in, "lut");
         int lutf_elem = vsapi->mapNumElements(in, "lutf");
 
-        int num_set = (lut_elem >= 0) + (lutf_elem >= 0) + !!func;
+        int num_set = (lut_elem >= 0) + (lutf_elem >= 0) + !!func + !!expr;
 
         if (!num_set) {
             vsapi->freeFunction(func);
-            RETERROR("Lut: none of lut, lutf and function are set");
+            RETERROR("Lut: none of lut, lutf, function and expr are set");
         }
 
         if (num_set > 1) {
             vsapi->freeFunction(func);
-            RETERROR("Lut: more than one of lut, lutf and function are set");
+            RETERROR("Lut: more than one of lut, lutf, function and expr are set");
         }
 
         if (lut_elem >= 0 && floatout) {
@@ -247,17 +306,17 @@ static void VS_CC lutCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         vsapi->queryVideoFormat(&d->vi_out.format, d->vi->format.colorFamily, floatout ? stFloat : stInteger, bitsout, d->vi->format.subSamplingW, d->vi->format.subSamplingH, core);
 
         if (d->vi->format.bytesPerSample == 1 && bitsout == 8)
-            lutCreateHelper<uint8_t, uint8_t>(in, out, func, d, core, vsapi);
+            lutCreateHelper<uint8_t, uint8_t>(in, out, func, expr, d, core, vsapi);
         else if (d->vi->format.bytesPerSample == 1 && bitsout > 8 && bitsout <= 16)
-            lutCreateHelper<uint8_t, uint16_t>(in, out, func, d, core, vsapi);
+            lutCreateHelper<uint8_t, uint16_t>(in, out, func, expr, d, core, vsapi);
         else if (d->vi->format.bytesPerSample == 1 && floatout)
-            lutCreateHelper<uint8_t, float>(in, out, func, d, core, vsapi);
+            lutCreateHelper<uint8_t, float>(in, out, func, expr, d, core, vsapi);
         else if (d->vi->format.bytesPerSample == 2 && bitsout == 8)
-            lutCreateHelper<uint16_t, uint8_t>(in, out, func, d, core, vsapi);
+            lutCreateHelper<uint16_t, uint8_t>(in, out, func, expr, d, core, vsapi);
         else if (d->vi->format.bytesPerSample == 2 && bitsout > 8 && bitsout <= 16)
-            lutCreateHelper<uint16_t, uint16_t>(in, out, func, d, core, vsapi);
+            lutCreateHelper<uint16_t, uint16_t>(in, out, func, expr, d, core, vsapi);
         else if (d->vi->format.bytesPerSample == 2 && floatout)
-            lutCreateHelper<uint16_t, float>(in, out, func, d, core, vsapi);
+            lutCreateHelper<uint16_t, float>(in, out, func, expr, d, core, vsapi);
 
     } catch (std::runtime_error &e) {
         RETERROR(("Lut " + std::string(e.what())).c_str());
@@ -271,12 +330,23 @@ struct Lut2DataExtra {
     VSVideoInfo vi_out;
     const VSVideoInfo *vi[2];
     void *lut;
+    bool blocked;
     bool process[3];
     ~Lut2DataExtra() { free(lut); };
 };
 
 typedef DualNodeData<Lut2DataExtra> Lut2Data;
 
+// Tables with more entries than this are stored as 16x16 tiles, neighbouring pixels usually have similar
+// values in both clips so the lookups then mostly hit the same few cache lines
+static const int lut2BlockedMinBits = 17;
+static const int lut2BlockBits = 4;
+
+static inline unsigned lut2BlockedIndex(unsigned x, unsigned y, int xbits) {
+    const unsigned mask = (1 << lut2BlockBits) - 1;
+    return ((y >> lut2BlockBits) << (xbits + lut2BlockBits)) | ((x >> lut2BlockBits) << (2 * lut2BlockBits)) | ((y & mask) << lut2BlockBits) | (x & mask);
+}
+
 template<typename T, typename U, typename V>
 static const VSFrame *VS_CC lut2Getframe(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     Lut2Data *d = reinterpret_cast<Lut2Data *>(instanceData);
@@ -286,8 +356,10 @@ static const VSFrame *VS_CC lut2Getframe(int n, int activationReason, void *inst
         vsapi->requestFrameFilter(n, d->node2, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *srcx = vsapi->getFrameFilter(n, d->node1, frameCtx);
-        const VSFrame *srcy = vsapi->getFrameFilter(n, d->node2, frameCtx);
         const VSVideoFormat &fi = d->vi_out.format;
+        if (vsapi->isPropsOnlyRequest(frameCtx))
+            return propsOnlyFrame(srcx, &fi, vsapi->getFrameWidth(srcx, 0), vsapi->getFrameHeight(srcx, 0), core, vsapi);
+        const VSFrame *srcy = vsapi->getFrameFilter(n, d->node2, frameCtx);
         const int pl[] = {0, 1, 2};
         const VSFrame *fr[] = {d->process[0] ? 0 : srcx, d->process[1] ? 0 : srcx, d->process[2] ? 0 : srcx};
         VSFrame *dst = vsapi->newVideoFrame2(&fi, vsapi->getFrameWidth(srcx, 0), vsapi->getFrameHeight(srcx, 0), fr, pl, srcx, core);
@@ -310,8 +382,13 @@ static const VSFrame *VS_CC lut2Getframe(int n, int activationReason, void *inst
                 int w = vsapi->getFrameWidth(srcx, plane);
 
                 for (int hl = 0; hl < h; hl++) {
-                    for (int x = 0; x < w; x++)
-                        dstp[x] =  lut[(std::min(srcpy[x], maxvaly) << shift) + std::min(srcpx[x], maxvalx)];
+                    if (d->blocked) {
+                        for (int x = 0; x < w; x++)
+                            dstp[x] = lut[lut2BlockedIndex(std::min(srcpx[x], maxvalx), std::min(srcpy[x], maxvaly), shift)];
+                    } else {
+                        for (int x = 0; x < w; x++)
+                            dstp[x] = lut[(std::min(srcpy[x], maxvaly) << shift) + std::min(srcpx[x], maxvalx)];
+                    }
                     srcpx += srcx_stride / sizeof(T);
                     srcpy += srcy_stride / sizeof(U);
                     dstp += dst_stride / sizeof(V);
@@ -328,13 +405,16 @@ static const VSFrame *VS_CC lut2Getframe(int n, int activationReason, void *inst
 }
 
 template<typename T>
-static bool funcToLut2(int nxin, int nyin, int nout, void *vlut, VSFunction *func, const VSAPI *vsapi, std::string &errstr) {
-    VSMap *in = vsapi->createMap();
-    VSMap *out = vsapi->createMap();
-
+static bool funcToLut2(int nxin, int nyin, int nout, void *vlut, VSFunction *func, VSCore *core, const VSAPI *vsapi, std::string &errstr) {
     T *lut = reinterpret_cast<T *>(vlut);
+    std::vector<std::string> errors(nyin);
+
+    // every row of the table is evaluated on its own
+    parallelForEach(nyin, [&](int i) {
+        VSMap *in = vsapi->createMap();
+        VSMap *out = vsapi->createMap();
+        std::string &errstr = errors[i];
 
-    for (int i = 0; i < nyin; i++) {
         vsapi->mapSetInt(in, "y", i, maReplace);
         for (int j = 0; j < nxin; j++) {
             vsapi->mapSetInt(in, "x", j, maReplace);
@@ -374,15 +454,23 @@ static bool funcToLut2(int nxin, int nyin, int nout, void *vlut, VSFunction *fun
                 lut[j + i * nxin] = static_cast<T>(v);
             }
         }
+
+        vsapi->freeMap(in);
+        vsapi->freeMap(out);
+    }, core, vsapi);
+
+    for (const std::string &e : errors) {
+        if (!e.empty()) {
+            errstr = e;
+            break;
+        }
     }
 
-    vsapi->freeMap(in);
-    vsapi->freeMap(out);
     return errstr.empty();
 }
 
 template<typename T, typename U, typename V>
-static void lut2CreateHelper(const VSMap *in, VSMap *out, VSFunction *func, std::unique_ptr<Lut2Data> &d, VSCore *core, const VSAPI *vsapi) {
+static void lut2CreateHelper(const VSMap *in, VSMap *out, VSFunction *func, const char *expr, std::unique_ptr<Lut2Data> &d, VSCore *core, const VSAPI *vsapi) {
     int inrange = (1 << d->vi[0]->format.bitsPerSample) * (1 << d->vi[1]->format.bitsPerSample);
     int maxval = 1 << d->vi_out.format.bitsPerSample;
 
@@ -390,11 +478,13 @@ static void lut2CreateHelper(const VSMap *in, VSMap *out, VSFunction *func, std:
 
     if (func) {
         std::string errstr;
-        funcToLut2<V>(1 << d->vi[0]->format.bitsPerSample, 1 << d->vi[1]->format.bitsPerSample, maxval, d->lut, func, vsapi, errstr);
+        funcToLut2<V>(1 << d->vi[0]->format.bitsPerSample, 1 << d->vi[1]->format.bitsPerSample, maxval, d->lut, func, core, vsapi, errstr);
         vsapi->freeFunction(func);
 
         if (!errstr.empty())
             RETERROR(errstr.c_str());
+    } else if (expr) {
+        exprGenerateLut(expr, d->vi[0]->format.bitsPerSample, d->vi[1]->format.bitsPerSample, &d->vi_out.format, d->lut, core, vsapi);
     } else {
 
         V *lut = reinterpret_cast<V *>(d->lut);
@@ -418,8 +508,23 @@ static void lut2CreateHelper(const VSMap *in, VSMap *out, VSFunction *func, std:
         }
     }
 
+    int xbits = d->vi[0]->format.bitsPerSample;
+    int ybits = d->vi[1]->format.bitsPerSample;
+    d->blocked = xbits + ybits >= lut2BlockedMinBits;
+    if (d->blocked) {
+        const V *linear = reinterpret_cast<const V *>(d->lut);
+        V *blocked = reinterpret_cast<V *>(malloc(inrange * sizeof(V)));
+        for (int y = 0; y < (1 << ybits); y++)
+            for (int x = 0; x < (1 << xbits); x++)
+                blocked[lut2BlockedIndex(x, y, xbits)] = linear[(y << xbits) + x];
+        free(d->lut);
+        d->lut = blocked;
+    }
+
     VSFilterDependency deps[] = {{ d->node1, rpStrictSpatial }, { d->node2, (d->vi[0]->numFrames <= d->vi[1]->numFrames) ? rpStrictSpatial : rpGeneral }};
-    vsapi->createVideoFilter(out, "Lut2", &d->vi_out, lut2Getframe<T, U, V>, filterFree<Lut2Data>, fmParallel, deps, 2, d.get(), core);
+    VSNode *node = vsapi->createVideoFilter2("Lut2", &d->vi_out, lut2Getframe<T, U, V>, filterFree<Lut2Data>, fmParallel, deps, 2, d.get(), core);
+    vsapi->setFilterHints(node, fcUnknown, 0, 0);
+    vsapi->mapConsumeNode(out, "clip", node, maAppend);
     d.release();
 }
 
@@ -456,19 +561,20 @@ static void VS_CC lut2Create(const VSMap *in, VSMap *out, void *userData, VSCore
         getPlanesArg(in, d->process, vsapi);
 
         VSFunction *func = vsapi->mapGetFunction(in, "function", 0, &err);
+        const char *expr = vsapi->mapGetData(in, "expr", 0, &err);
         int lut_elem = vsapi->mapNumElements(in, "lut");
         int lutf_elem = vsapi->mapNumElements(in, "lutf");
 
-        int num_set = (lut_elem >= 0) + (lutf_elem >= 0) + !!func;
+        int num_set = (lut_elem >= 0) + (lutf_elem >= 0) + !!func + !!expr;
 
         if (!num_set) {
             vsapi->freeFunction(func);
-            RETERROR("Lut2: none of lut, lutf and function are set");
+            RETERROR("Lut2: none of lut, lutf, function and expr are set");
         }
 
         if (num_set > 1) {
             vsapi->freeFunction(func);
-            RETERROR("Lut2: more than one of lut, lutf and function are set");
+            RETERROR("Lut2: more than one of lut, lutf, function and expr are set");
         }
 
         if (lut_elem >= 0 && floatout) {
@@ -493,34 +599,34 @@ static void VS_CC lut2Create(const VSMap *in, VSMap *out, void *userData, VSCore
         if (d->vi[0]->format.bytesPerSample == 1) {
             if (d->vi[1]->format.bytesPerSample == 1) {
                 if (d->vi_out.format.bytesPerSample == 1 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint8_t, uint8_t, uint8_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint8_t, uint8_t, uint8_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bytesPerSample == 2 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint8_t, uint8_t, uint16_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint8_t, uint8_t, uint16_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bitsPerSample == 32 && d->vi_out.format.sampleType == stFloat)
-                    lut2CreateHelper<uint8_t, uint8_t, float>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint8_t, uint8_t, float>(in, out, func, expr, d, core, vsapi);
             } else if (d->vi[1]->format.bytesPerSample == 2) {
                 if (d->vi_out.format.bytesPerSample == 1 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint8_t, uint16_t, uint8_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint8_t, uint16_t, uint8_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bytesPerSample == 2 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint8_t, uint16_t, uint16_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint8_t, uint16_t, uint16_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bitsPerSample == 32 && d->vi_out.format.sampleType == stFloat)
-                    lut2CreateHelper<uint8_t, uint16_t, float>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint8_t, uint16_t, float>(in, out, func, expr, d, core, vsapi);
             }
         } else if (d->vi[0]->format.bytesPerSample == 2) {
             if (d->vi[1]->format.bytesPerSample == 1) {
                 if (d->vi_out.format.bytesPerSample == 1 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint16_t, uint8_t, uint8_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint16_t, uint8_t, uint8_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bytesPerSample == 2 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint16_t, uint8_t, uint16_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint16_t, uint8_t, uint16_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bitsPerSample == 32 && d->vi_out.format.sampleType == stFloat)
-                    lut2CreateHelper<uint16_t, uint8_t, float>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint16_t, uint8_t, float>(in, out, func, expr, d, core, vsapi);
             } else if (d->vi[1]->format.bytesPerSample == 2) {
                 if (d->vi_out.format.bytesPerSample == 1 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint16_t, uint16_t, uint8_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint16_t, uint16_t, uint8_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bytesPerSample == 2 && d->vi_out.format.sampleType == stInteger)
-                    lut2CreateHelper<uint16_t, uint16_t, uint16_t>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint16_t, uint16_t, uint16_t>(in, out, func, expr, d, core, vsapi);
                 else if (d->vi_out.format.bitsPerSample == 32 && d->vi_out.format.sampleType == stFloat)
-                    lut2CreateHelper<uint16_t, uint16_t, float>(in, out, func, d, core, vsapi);
+                    lut2CreateHelper<uint16_t, uint16_t, float>(in, out, func, expr, d, core, vsapi);
             }
         }
 
@@ -533,6 +639,8 @@ static void VS_CC lut2Create(const VSMap *in, VSMap *out, void *userData, VSCore
 // Init
 
 void lutInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
-    vspapi->registerFunction("Lut", "clip:vnode;planes:int[]:opt;lut:int[]:opt;lutf:float[]:opt;function:func:opt;bits:int:opt;floatout:int:opt;", "clip:vnode;", lutCreate, 0, plugin);
-    vspapi->registerFunction("Lut2", "clipa:vnode;clipb:vnode;planes:int[]:opt;lut:int[]:opt;lutf:float[]:opt;function:func:opt;bits:int:opt;floatout:int:opt;", "clip:vnode;", lut2Create, 0, plugin);
+    vspapi->registerFunction("Lut", "clip:vnode;planes:int[]:opt;lut:int[]:opt;lutf:float[]:opt;function:func:opt;bits:int:opt;floatout:int:opt;expr:data:opt;", "clip:vnode;", lutCreate, 0, plugin);
+    vspapi->registerFunction("Lut2", "clipa:vnode;clipb:vnode;planes:int[]:opt;lut:int[]:opt;lutf:float[]:opt;function:func:opt;bits:int:opt;floatout:int:opt;expr:data:opt;", "clip:vnode;", lut2Create, 0, plugin);
+    vspapi->setFunctionFlags("Lut", pffProxyScalable, plugin);
+    vspapi->setFunctionFlags("Lut2", pffProxyScalable, plugin);
 }
@@ -55,6 +55,8 @@ static const VSFrame *VS_CC preMultiplyGetFrame(int n, int activationReason, voi
             vsapi->requestFrameFilter(n, d->nodes[2], frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src1 = vsapi->getFrameFilter(n, d->nodes[0], frameCtx);
+        if (vsapi->isPropsOnlyRequest(frameCtx))
+            return propsOnlyFrame(src1, &d->vi->format, d->vi->width, d->vi->height, core, vsapi);
         const VSFrame *src2 = vsapi->getFrameFilter(n, d->nodes[1], frameCtx);
         const VSFrame *src2_23 = 0;
         if (d->nodes[2])
@@ -73,12 +75,19 @@ static const VSFrame *VS_CC preMultiplyGetFrame(int n, int activationReason, voi
 
             void (*func)(const void *, const void *, void *, unsigned, unsigned, unsigned) = nullptr;
 
+#ifdef VS_TARGET_CPU_X86
+            if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 2 && getCPUFeatures()->avx2 && getCPUFeatures()->f16c && vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_MERGE) >= VS_CPU_LEVEL_AVX2)
+                func = vs_premultiply_half_avx2;
+            else
+#endif
             if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
                 func = vs_premultiply_byte_c;
             else if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 2)
                 func = vs_premultiply_word_c;
             else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
                 func = vs_premultiply_float_c;
+            else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 2)
+                func = vs_premultiply_half_c;
 
             if (!func)
                 continue;
@@ -118,8 +127,8 @@ static void VS_CC preMultiplyCreate(const VSMap *in, VSMap *out, void *userData,
     if (!isConstantVideoFormat(d->vi) || !isConstantVideoFormat(alphavi) || d->vi->width != alphavi->width || d->vi->height != alphavi->height)
         RETERROR("PreMultiply: both clips must have the same constant format and dimensions");
 
-    if (!is8to16orFloatFormat(d->vi->format))
-        RETERROR("PreMultiply: only 8-16 bit integer and 32 bit float input supported");
+    if (!is8to16orHalfOrFloatFormat(d->vi->format))
+        RETERROR("PreMultiply: only 8-16 bit integer and 16/32 bit float input supported");
 
     // do we need to resample the first mask plane and use it for all the planes?
     if ((d->vi->format.numPlanes > 1) && (d->vi->format.subSamplingH > 0 || d->vi->format.subSamplingW > 0)) {
@@ -136,7 +145,9 @@ static void VS_CC preMultiplyCreate(const VSMap *in, VSMap *out, void *userData,
     }
 
     VSFilterDependency deps[] = {{ d->nodes[0], rpStrictSpatial }, { d->nodes[1], (d->vi->numFrames <= vsapi->getVideoInfo(d->nodes[1])->numFrames) ? rpStrictSpatial : rpGeneral }, { d->nodes[2], (d->vi->numFrames <= vsapi->getVideoInfo(d->nodes[1])->numFrames) ? rpStrictSpatial : rpGeneral }};
-    vsapi->createVideoFilter(out, "PreMultiply", d->vi, preMultiplyGetFrame, filterFree<PreMultiplyData>, fmParallel, deps, d->nodes[2] ? 3 : 2, d.get(), core);
+    VSNode *node = vsapi->createVideoFilter2("PreMultiply", d->vi, preMultiplyGetFrame, filterFree<PreMultiplyData>, fmParallel, deps, d->nodes[2] ? 3 : 2, d.get(), core);
+    vsapi->setFilterHints(node, fcUnknown, 0, 0);
+    vsapi->mapConsumeNode(out, "clip", node, maAppend);
     d.release();
 }
 
@@ -163,6 +174,8 @@ static const VSFrame *VS_CC mergeGetFrame(int n, int activationReason, void *ins
         vsapi->requestFrameFilter(n, d->node2, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src1 = vsapi->getFrameFilter(n, d->node1, frameCtx);
+        if (vsapi->isPropsOnlyRequest(frameCtx))
+            return propsOnlyFrame(src1, &d->vi->format, d->vi->width, d->vi->height, core, vsapi);
         const VSFrame *src2 = vsapi->getFrameFilter(n, d->node2, frameCtx);
         const int pl[] = {0, 1, 2};
         const VSFrame *fs[] = { 0, src1, src2 };
@@ -181,13 +194,23 @@ static const VSFrame *VS_CC mergeGetFrame(int n, int activationReason, void *ins
                 union vs_merge_weight weight;
 
 #ifdef VS_TARGET_CPU_X86
-                if (getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
+                if (getCPUFeatures()->avx512_bw && getCPUFeatures()->avx512_vl && d->cpulevel >= VS_CPU_LEVEL_AVX512) {
+                    if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
+                        func = vs_merge_byte_avx512;
+                    else if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 2)
+                        func = vs_merge_word_avx512;
+                    else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
+                        func = vs_merge_float_avx512;
+                }
+                if (!func && getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
                     if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
                         func = vs_merge_byte_avx2;
                     else if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 2)
                         func = vs_merge_word_avx2;
                     else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
                         func = vs_merge_float_avx2;
+                    else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 2 && getCPUFeatures()->f16c)
+                        func = vs_merge_half_avx2;
                 }
                 if (!func && d->cpulevel >= VS_CPU_LEVEL_SSE2) {
                     if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
@@ -205,6 +228,8 @@ static const VSFrame *VS_CC mergeGetFrame(int n, int activationReason, void *ins
                         func = vs_merge_word_c;
                     else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
                         func = vs_merge_float_c;
+                    else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 2)
+                        func = vs_merge_half_c;
                 }
 
                 if (!func)
@@ -273,19 +298,21 @@ static void VS_CC mergeCreate(const VSMap *in, VSMap *out, void *userData, VSCor
         }
     }
 
-    d->cpulevel = vs_get_cpulevel(core);
+    d->cpulevel = vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_MERGE);
 
     if (!isConstantVideoFormat(d->vi) || !isSameVideoInfo(d->vi, vsapi->getVideoInfo(d->node2)))
         RETERROR("Merge: both clips must have constant format and dimensions, and the same format and dimensions");
 
-    if (!is8to16orFloatFormat(d->vi->format))
-        RETERROR("Merge: only 8-16 bit integer and 32 bit float input supported");
+    if (!is8to16orHalfOrFloatFormat(d->vi->format))
+        RETERROR("Merge: only 8-16 bit integer and 16/32 bit float input supported");
 
     if (nweight > d->vi->format.numPlanes)
         RETERROR("Merge: more weights given than the number of planes to merge");
 
     VSFilterDependency deps[] = {{d->node1, rpStrictSpatial}, {d->node2, (d->vi->numFrames <= vsapi->getVideoInfo(d->node2)->numFrames) ? rpStrictSpatial : rpGeneral}};
-    vsapi->createVideoFilter(out, "Merge", d->vi, mergeGetFrame, filterFree<MergeData>, fmParallel, deps, 2, d.get(), core);
+    VSNode *node = vsapi->createVideoFilter2("Merge", d->vi, mergeGetFrame, filterFree<MergeData>, fmParallel, deps, 2, d.get(), core);
+    vsapi->setFilterHints(node, fcUnknown, 0, 0);
+    vsapi->mapConsumeNode(out, "clip", node, maAppend);
     d.release();
 }
 
@@ -296,12 +323,82 @@ typedef struct {
     const VSVideoInfo *vi;
     bool premultiplied;
     bool first_plane;
+    bool subsample_mask;
+    bool dirty_rect;
     bool process[3];
     int cpulevel;
 } MaskedMergeDataExtra;
 
 typedef VariableNodeData<MaskedMergeDataExtra> MaskedMergeData;
 
+typedef void (*MaskSubsampleFunc)(const void * const rows[4], void *tmp, void *dst, unsigned n);
+
+static MaskSubsampleFunc selectMaskSubsample(const VSVideoFormat &fi, int cpulevel) {
+    MaskSubsampleFunc func = nullptr;
+
+    // there's only a C version for half precision masks
+    if (fi.sampleType == stFloat && fi.bytesPerSample == 2)
+        return vs_mask_subsample_half_c;
+
+#ifdef VS_TARGET_CPU_X86
+    if (getCPUFeatures()->avx512_bw && getCPUFeatures()->avx512_vl && cpulevel >= VS_CPU_LEVEL_AVX512)
+        func = (fi.bytesPerSample == 1) ? vs_mask_subsample_byte_avx512 : (fi.bytesPerSample == 2) ? vs_mask_subsample_word_avx512 : vs_mask_subsample_float_avx512;
+    if (!func && getCPUFeatures()->avx2 && cpulevel >= VS_CPU_LEVEL_AVX2)
+        func = (fi.bytesPerSample == 1) ? vs_mask_subsample_byte_avx2 : (fi.bytesPerSample == 2) ? vs_mask_subsample_word_avx2 : vs_mask_subsample_float_avx2;
+    if (!func && cpulevel >= VS_CPU_LEVEL_SSE2)
+        func = (fi.bytesPerSample == 1) ? vs_mask_subsample_byte_sse2 : (fi.bytesPerSample == 2) ? vs_mask_subsample_word_sse2 : vs_mask_subsample_float_sse2;
+#endif
+    if (!func)
+        func = (fi.bytesPerSample == 1) ? vs_mask_subsample_byte_c : (fi.bytesPerSample == 2) ? vs_mask_subsample_word_c : vs_mask_subsample_float_c;
+
+    return func;
+}
+
+// Reads the mask's _DirtyRect as the luma area x0, y0, x1, y1 outside of which it's 0, returns false if there's none.
+static bool getMaskDirtyRect(const VSFrame *mask, const VSVideoInfo *vi, int rect[4], const VSAPI *vsapi) {
+    const VSMap *props = vsapi->getFramePropertiesRO(mask);
+    if (vsapi->mapNumElements(props, "_DirtyRect") != 4)
+        return false;
+
+    const int64_t *r = vsapi->mapGetIntArray(props, "_DirtyRect", nullptr);
+    if (r[2] <= 0 || r[3] <= 0) {
+        rect[0] = rect[1] = rect[2] = rect[3] = 0;
+        return true;
+    }
+
+    rect[0] = static_cast<int>(std::min<int64_t>(std::max<int64_t>(r[0], 0), vi->width));
+    rect[1] = static_cast<int>(std::min<int64_t>(std::max<int64_t>(r[1], 0), vi->height));
+    rect[2] = static_cast<int>(std::min<int64_t>(std::max<int64_t>(r[0] + r[2], 0), vi->width));
+    rect[3] = static_cast<int>(std::min<int64_t>(std::max<int64_t>(r[1] + r[3], 0), vi->height));
+    return true;
+}
+
+// The part of a plane that can be affected by the luma area in rect, widened by the taps of the mask subsampling.
+static void getPlaneDirtyRect(const MaskedMergeData *d, const int rect[4], int plane, int w, int h, int prect[4]) {
+    int ssW = plane ? d->vi->format.subSamplingW : 0;
+    int ssH = plane ? d->vi->format.subSamplingH : 0;
+
+    if (d->subsample_mask) {
+        // chroma pixel x uses luma 2x-1 to 2x+2, the same for the rows when subsampled vertically
+        prect[0] = ssW ? (rect[0] - 1) >> 1 : rect[0];
+        prect[2] = ssW ? (rect[2] >> 1) + 1 : rect[2];
+        prect[1] = ssH ? (rect[1] - 1) >> 1 : rect[1];
+        prect[3] = ssH ? (rect[3] >> 1) + 1 : rect[3];
+    } else {
+        // a bilinearly resized mask spreads by less than two pixels
+        int margin = (plane && d->nodes[3]) ? 2 : 0;
+        prect[0] = (rect[0] >> ssW) - margin;
+        prect[2] = ((rect[2] + (1 << ssW) - 1) >> ssW) + margin;
+        prect[1] = (rect[1] >> ssH) - margin;
+        prect[3] = ((rect[3] + (1 << ssH) - 1) >> ssH) + margin;
+    }
+
+    prect[0] = std::max(prect[0], 0);
+    prect[1] = std::max(prect[1], 0);
+    prect[2] = std::min(prect[2], w);
+    prect[3] = std::min(prect[3], h);
+}
+
 static const VSFrame *VS_CC maskedMergeGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     MaskedMergeData *d = reinterpret_cast<MaskedMergeData *>(instanceData);
 
@@ -313,12 +410,24 @@ static const VSFrame *VS_CC maskedMergeGetFrame(int n, int activationReason, voi
             vsapi->requestFrameFilter(n, d->nodes[3], frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src1 = vsapi->getFrameFilter(n, d->nodes[0], frameCtx);
+        if (vsapi->isPropsOnlyRequest(frameCtx))
+            return propsOnlyFrame(src1, &d->vi->format, d->vi->width, d->vi->height, core, vsapi);
         const VSFrame *src2 = vsapi->getFrameFilter(n, d->nodes[1], frameCtx);
         const VSFrame *mask = vsapi->getFrameFilter(n, d->nodes[2], frameCtx);
         const VSFrame *mask23 = nullptr;
         unsigned offset1 = getLimitedRangeOffset(src1, d->vi, vsapi);
         unsigned offset2 = getLimitedRangeOffset(src2, d->vi, vsapi);
 
+        // clipa is returned where the mask is 0 so only the mask's dirty area has to be merged
+        int rect[4] = { 0, 0, d->vi->width, d->vi->height };
+        bool sparse = d->dirty_rect && !d->premultiplied && getMaskDirtyRect(mask, d->vi, rect, vsapi);
+
+        if (sparse && (rect[0] >= rect[2] || rect[1] >= rect[3])) {
+            vsapi->freeFrame(src2);
+            vsapi->freeFrame(mask);
+            return src1;
+        }
+
         const int pl[] = {0, 1, 2};
         const VSFrame *fr[] = {d->process[0] ? 0 : src1, d->process[1] ? 0 : src1, d->process[2] ? 0 : src1};
         VSFrame *dst = vsapi->newVideoFrame2(&d->vi->format, d->vi->width, d->vi->height, fr, pl, src1, core);
@@ -348,13 +457,23 @@ static const VSFrame *VS_CC maskedMergeGetFrame(int n, int activationReason, voi
                 }
 
 #ifdef VS_TARGET_CPU_X86
-                if (getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
+                if (getCPUFeatures()->avx512_bw && getCPUFeatures()->avx512_vl && d->cpulevel >= VS_CPU_LEVEL_AVX512) {
+                    if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
+                        func = d->premultiplied ? vs_mask_merge_premul_byte_avx512 : vs_mask_merge_byte_avx512;
+                    else if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 2)
+                        func = d->premultiplied ? vs_mask_merge_premul_word_avx512 : vs_mask_merge_word_avx512;
+                    else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
+                        func = d->premultiplied ? vs_mask_merge_premul_float_avx512 : vs_mask_merge_float_avx512;
+                }
+                if (!func && getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
                     if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
                         func = d->premultiplied ? vs_mask_merge_premul_byte_avx2 : vs_mask_merge_byte_avx2;
                     else if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 2)
                         func = d->premultiplied ? vs_mask_merge_premul_word_avx2 : vs_mask_merge_word_avx2;
                     else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
                         func = d->premultiplied ? vs_mask_merge_premul_float_avx2 : vs_mask_merge_float_avx2;
+                    else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 2 && getCPUFeatures()->f16c)
+                        func = d->premultiplied ? vs_mask_merge_premul_half_avx2 : vs_mask_merge_half_avx2;
                 }
                 if (!func && d->cpulevel >= VS_CPU_LEVEL_SSE2) {
                     if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
@@ -372,19 +491,69 @@ static const VSFrame *VS_CC maskedMergeGetFrame(int n, int activationReason, voi
                         func = d->premultiplied ? vs_mask_merge_premul_word_c : vs_mask_merge_word_c;
                     else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
                         func = d->premultiplied ? vs_mask_merge_premul_float_c : vs_mask_merge_float_c;
+                    else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 2)
+                        func = d->premultiplied ? vs_mask_merge_premul_half_c : vs_mask_merge_half_c;
                 }
 
                 if (!func)
                     continue;
 
                 int depth = d->vi->format.bitsPerSample;
+                int bytesPerSample = d->vi->format.bytesPerSample;
+                int y0 = 0, y1 = h, x0 = 0, x1 = w;
+
+                if (sparse) {
+                    int prect[4];
+                    getPlaneDirtyRect(d, rect, plane, w, h, prect);
+                    x0 = prect[0];
+                    y0 = prect[1];
+                    x1 = prect[2];
+                    y1 = prect[3];
+
+                    bitblt(dstp, stride, srcp1, stride, w * bytesPerSample, h);
+
+                    if (x0 >= x1 || y0 >= y1)
+                        continue;
+
+                    srcp1 += y0 * stride + x0 * bytesPerSample;
+                    srcp2 += y0 * stride + x0 * bytesPerSample;
+                    dstp += y0 * stride + x0 * bytesPerSample;
+                    if (!(plane && d->subsample_mask))
+                        maskp += y0 * stride + x0 * bytesPerSample;
+                }
 
-                for (int y = 0; y < h; y++) {
-                    func(srcp1, srcp2, maskp, dstp, depth, yuvhandling ? (1 << (depth - 1)) : offset1, w);
-                    srcp1 += stride;
-                    srcp2 += stride;
-                    maskp += stride;
-                    dstp += stride;
+                if (plane && d->subsample_mask) {
+                    // Subsample the luma mask a row at a time right before it's used so it never has to be written out as a whole plane.
+                    MaskSubsampleFunc subsample = selectMaskSubsample(d->vi->format, d->cpulevel);
+                    ptrdiff_t maskStride = vsapi->getStride(mask, 0);
+                    int maskHeight = vsapi->getFrameHeight(mask, 0);
+                    int ssH = d->vi->format.subSamplingH;
+                    uint8_t *maskRow = vsh_aligned_malloc<uint8_t>((w + 64) * d->vi->format.bytesPerSample, 64);
+                    void *tmp = vsh_aligned_malloc<void>((2 * w + 64) * sizeof(uint32_t), 64);
+
+                    for (int y = y0; y < y1; y++) {
+                        const void *rows[4];
+                        for (int k = 0; k < 4; k++) {
+                            int row = ssH ? std::min(std::max(2 * y + k - 1, 0), maskHeight - 1) : y;
+                            rows[k] = maskp + row * maskStride;
+                        }
+                        subsample(rows, tmp, maskRow, w);
+                        func(srcp1, srcp2, maskRow + x0 * bytesPerSample, dstp, depth, yuvhandling ? (1 << (depth - 1)) : offset1, x1 - x0);
+                        srcp1 += stride;
+                        srcp2 += stride;
+                        dstp += stride;
+                    }
+
+                    vsh_aligned_free(tmp);
+                    vsh_aligned_free(maskRow);
+                } else {
+                    for (int y = y0; y < y1; y++) {
+                        func(srcp1, srcp2, maskp, dstp, depth, yuvhandling ? (1 << (depth - 1)) : offset1, x1 - x0);
+                        srcp1 += stride;
+                        srcp2 += stride;
+                        maskp += stride;
+                        dstp += stride;
+                    }
                 }
             }
         }
@@ -411,6 +580,7 @@ static void VS_CC maskedMergeCreate(const VSMap *in, VSMap *out, void *userData,
     const VSVideoInfo *maskvi = vsapi->getVideoInfo(d->nodes[2]);
     d->first_plane = !!vsapi->mapGetInt(in, "first_plane", 0, &err);
     d->premultiplied = !!vsapi->mapGetInt(in, "premultiplied", 0, &err);
+    d->dirty_rect = !!vsapi->mapGetInt(in, "dirty_rect", 0, &err);
     // always use the first mask plane for all planes when it is the only one
     if (maskvi->format.numPlanes == 1)
         d->first_plane = 1;
@@ -418,8 +588,8 @@ static void VS_CC maskedMergeCreate(const VSMap *in, VSMap *out, void *userData,
     if (!isConstantVideoFormat(d->vi) || !isSameVideoInfo(d->vi, vsapi->getVideoInfo(d->nodes[1])))
         RETERROR("MaskedMerge: both clips must have constant format and dimensions, and the same format and dimensions");
 
-    if (!is8to16orFloatFormat(d->vi->format))
-        RETERROR("MaskedMerge: only 8-16 bit integer and 32 bit float input supported");
+    if (!is8to16orHalfOrFloatFormat(d->vi->format))
+        RETERROR("MaskedMerge: only 8-16 bit integer and 16/32 bit float input supported");
 
     if (maskvi->width != d->vi->width || maskvi->height != d->vi->height || maskvi->format.bitsPerSample != d->vi->format.bitsPerSample
         || (!isSameVideoFormat(&maskvi->format, &d->vi->format) && maskvi->format.colorFamily != cfGray && !d->first_plane))
@@ -429,7 +599,11 @@ static void VS_CC maskedMergeCreate(const VSMap *in, VSMap *out, void *userData,
         return;
 
     // do we need to resample the first mask plane and use it for all the planes?
-    if ((d->first_plane && d->vi->format.numPlanes > 1) && (d->vi->format.subSamplingH > 0 || d->vi->format.subSamplingW > 0) && (d->process[1] || d->process[2])) {
+    // 4:2:0 and 4:2:2 are subsampled on the fly in the same bilinear way, everything else goes through the resizer
+    bool needs_subsampling = (d->first_plane && d->vi->format.numPlanes > 1) && (d->vi->format.subSamplingH > 0 || d->vi->format.subSamplingW > 0) && (d->process[1] || d->process[2]);
+    d->subsample_mask = needs_subsampling && d->vi->format.subSamplingW == 1 && d->vi->format.subSamplingH <= 1;
+
+    if (needs_subsampling && !d->subsample_mask) {
         VSMap *min = vsapi->createMap();
 
         if (maskvi->format.numPlanes > 1) {
@@ -454,10 +628,12 @@ static void VS_CC maskedMergeCreate(const VSMap *in, VSMap *out, void *userData,
         vsapi->freeMap(min);
     }
 
-    d->cpulevel = vs_get_cpulevel(core);
+    d->cpulevel = vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_MERGE);
 
     VSFilterDependency deps[] = {{ d->nodes[0], rpStrictSpatial }, { d->nodes[1], (d->vi->numFrames <= vsapi->getVideoInfo(d->nodes[1])->numFrames) ? rpStrictSpatial : rpGeneral }, { d->nodes[2], (d->vi->numFrames <= vsapi->getVideoInfo(d->nodes[2])->numFrames) ? rpStrictSpatial : rpGeneral }, { d->nodes[3], (d->vi->numFrames <= vsapi->getVideoInfo(d->nodes[2])->numFrames) ? rpStrictSpatial : rpGeneral }};
-    vsapi->createVideoFilter(out, "MaskedMerge", d->vi, maskedMergeGetFrame, filterFree<MaskedMergeData>, fmParallel, deps, d->nodes[3] ? 4 : 3, d.get(), core);
+    VSNode *node = vsapi->createVideoFilter2("MaskedMerge", d->vi, maskedMergeGetFrame, filterFree<MaskedMergeData>, fmParallel, deps, d->nodes[3] ? 4 : 3, d.get(), core);
+    vsapi->setFilterHints(node, fcUnknown, 0, 0);
+    vsapi->mapConsumeNode(out, "clip", node, maAppend);
     d.release();
 }
 
@@ -480,6 +656,8 @@ static const VSFrame *VS_CC makeDiffGetFrame(int n, int activationReason, void *
         vsapi->requestFrameFilter(n, d->node2, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src1 = vsapi->getFrameFilter(n, d->node1, frameCtx);
+        if (vsapi->isPropsOnlyRequest(frameCtx))
+            return propsOnlyFrame(src1, &d->vi->format, d->vi->width, d->vi->height, core, vsapi);
         const VSFrame *src2 = vsapi->getFrameFilter(n, d->node2, frameCtx);
         const int pl[] = { 0, 1, 2 };
         const VSFrame *fr[] = { d->process[0] ? 0 : src1, d->process[1] ? 0 : src1, d->process[2] ? 0 : src1 };
@@ -496,13 +674,23 @@ static const VSFrame *VS_CC makeDiffGetFrame(int n, int activationReason, void *
                 void (*func)(const void *, const void *, void *, unsigned, unsigned) = 0;
 
 #ifdef VS_TARGET_CPU_X86
-                if (getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
+                if (getCPUFeatures()->avx512_bw && getCPUFeatures()->avx512_vl && d->cpulevel >= VS_CPU_LEVEL_AVX512) {
+                    if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
+                        func = vs_makediff_byte_avx512;
+                    else if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 2)
+                        func = vs_makediff_word_avx512;
+                    else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
+                        func = vs_makediff_float_avx512;
+                }
+                if (!func && getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
                     if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
                         func = vs_makediff_byte_avx2;
                     else if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 2)
                         func = vs_makediff_word_avx2;
                     else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
                         func = vs_makediff_float_avx2;
+                    else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 2 && getCPUFeatures()->f16c)
+                        func = vs_makediff_half_avx2;
                 }
                 if (!func && d->cpulevel >= VS_CPU_LEVEL_SSE2) {
                     if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
@@ -520,6 +708,8 @@ static const VSFrame *VS_CC makeDiffGetFrame(int n, int activationReason, void *
                         func = vs_makediff_word_c;
                     else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
                         func = vs_makediff_float_c;
+                    else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 2)
+                        func = vs_makediff_half_c;
                 }
 
                 if (!func)
@@ -554,16 +744,18 @@ static void VS_CC makeDiffCreate(const VSMap *in, VSMap *out, void *userData, VS
     if (!isConstantVideoFormat(d->vi) || !isSameVideoInfo(d->vi, vsapi->getVideoInfo(d->node2)))
         RETERROR("MakeDiff: both clips must have constant format and dimensions, and the same format and dimensions");
 
-    if (!is8to16orFloatFormat(d->vi->format))
-        RETERROR("MakeDiff: only 8-16 bit integer and 32 bit float input supported");
+    if (!is8to16orHalfOrFloatFormat(d->vi->format))
+        RETERROR("MakeDiff: only 8-16 bit integer and 16/32 bit float input supported");
 
     if (!getProcessPlanesArg(in, out, "MakeDiff", d->process, vsapi))
         return;
 
-    d->cpulevel = vs_get_cpulevel(core);
+    d->cpulevel = vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_MERGE);
 
     VSFilterDependency deps[] = {{d->node1, rpStrictSpatial}, {d->node2, (d->vi->numFrames <= vsapi->getVideoInfo(d->node2)->numFrames) ? rpStrictSpatial : rpGeneral}};
-    vsapi->createVideoFilter(out, "MakeDiff", d->vi, makeDiffGetFrame, filterFree<MakeDiffData>, fmParallel, deps, 2, d.get(), core);
+    VSNode *node = vsapi->createVideoFilter2("MakeDiff", d->vi, makeDiffGetFrame, filterFree<MakeDiffData>, fmParallel, deps, 2, d.get(), core);
+    vsapi->setFilterHints(node, fcUnknown, 0, 0);
+    vsapi->mapConsumeNode(out, "clip", node, maAppend);
     d.release();
 }
 
@@ -586,6 +778,8 @@ static const VSFrame *VS_CC mergeDiffGetFrame(int n, int activationReason, void
         vsapi->requestFrameFilter(n, d->node2, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src1 = vsapi->getFrameFilter(n, d->node1, frameCtx);
+        if (vsapi->isPropsOnlyRequest(frameCtx))
+            return propsOnlyFrame(src1, &d->vi->format, d->vi->width, d->vi->height, core, vsapi);
         const VSFrame *src2 = vsapi->getFrameFilter(n, d->node2, frameCtx);
         const int pl[] = { 0, 1, 2 };
         const VSFrame *fr[] = { d->process[0] ? 0 : src1, d->process[1] ? 0 : src1, d->process[2] ? 0 : src1 };
@@ -602,13 +796,23 @@ static const VSFrame *VS_CC mergeDiffGetFrame(int n, int activationReason, void
                 void (*func)(const void *, const void *, void *, unsigned, unsigned) = 0;
 
 #ifdef VS_TARGET_CPU_X86
-                if (getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
+                if (getCPUFeatures()->avx512_bw && getCPUFeatures()->avx512_vl && d->cpulevel >= VS_CPU_LEVEL_AVX512) {
+                    if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
+                        func = vs_mergediff_byte_avx512;
+                    else if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 2)
+                        func = vs_mergediff_word_avx512;
+                    else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
+                        func = vs_mergediff_float_avx512;
+                }
+                if (!func && getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
                     if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
                         func = vs_mergediff_byte_avx2;
                     else if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 2)
                         func = vs_mergediff_word_avx2;
                     else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
                         func = vs_mergediff_float_avx2;
+                    else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 2 && getCPUFeatures()->f16c)
+                        func = vs_mergediff_half_avx2;
                 }
                 if (!func && d->cpulevel >= VS_CPU_LEVEL_SSE2) {
                     if (d->vi->format.sampleType == stInteger && d->vi->format.bytesPerSample == 1)
@@ -626,6 +830,8 @@ static const VSFrame *VS_CC mergeDiffGetFrame(int n, int activationReason, void
                         func = vs_mergediff_word_c;
                     else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
                         func = vs_mergediff_float_c;
+                    else if (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 2)
+                        func = vs_mergediff_half_c;
                 }
 
                 if (!func)
@@ -660,16 +866,18 @@ static void VS_CC mergeDiffCreate(const VSMap *in, VSMap *out, void *userData, V
     if (!isConstantVideoFormat(d->vi) || !isSameVideoInfo(d->vi, vsapi->getVideoInfo(d->node2)))
         RETERROR("MergeDiff: both clips must have constant format and dimensions, and the same format and dimensions");
 
-    if (!is8to16orFloatFormat(d->vi->format))
-        RETERROR("MergeDiff: only 8-16 bit integer and 32 bit float input supported");
+    if (!is8to16orHalfOrFloatFormat(d->vi->format))
+        RETERROR("MergeDiff: only 8-16 bit integer and 16/32 bit float input supported");
 
     if (!getProcessPlanesArg(in, out, "MergeDiff", d->process, vsapi))
         return;
 
-    d->cpulevel = vs_get_cpulevel(core);
+    d->cpulevel = vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_MERGE);
 
     VSFilterDependency deps[] = {{d->node1, rpStrictSpatial}, {d->node2, (d->vi->numFrames <= vsapi->getVideoInfo(d->node2)->numFrames) ? rpStrictSpatial : rpGeneral}};
-    vsapi->createVideoFilter(out, "MergeDiff", d->vi, mergeDiffGetFrame, filterFree<MergeDiffData>, fmParallel, deps, 2, d.get(), core);
+    VSNode *node = vsapi->createVideoFilter2("MergeDiff", d->vi, mergeDiffGetFrame, filterFree<MergeDiffData>, fmParallel, deps, 2, d.get(), core);
+    vsapi->setFilterHints(node, fcUnknown, 0, 0);
+    vsapi->mapConsumeNode(out, "clip", node, maAppend);
     d.release();
 }
 
@@ -679,7 +887,10 @@ static void VS_CC mergeDiffCreate(const VSMap *in, VSMap *out, void *userData, V
 void mergeInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->registerFunction("PreMultiply", "clip:vnode;alpha:vnode;", "clip:vnode;", preMultiplyCreate, 0, plugin);
     vspapi->registerFunction("Merge", "clipa:vnode;clipb:vnode;weight:float[]:opt;", "clip:vnode;", mergeCreate, 0, plugin);
-    vspapi->registerFunction("MaskedMerge", "clipa:vnode;clipb:vnode;mask:vnode;planes:int[]:opt;first_plane:int:opt;premultiplied:int:opt;", "clip:vnode;", maskedMergeCreate, 0, plugin);
+    vspapi->registerFunction("MaskedMerge", "clipa:vnode;clipb:vnode;mask:vnode;planes:int[]:opt;first_plane:int:opt;premultiplied:int:opt;dirty_rect:int:opt;", "clip:vnode;", maskedMergeCreate, 0, plugin);
     vspapi->registerFunction("MakeDiff", "clipa:vnode;clipb:vnode;planes:int[]:opt;", "clip:vnode;", makeDiffCreate, 0, plugin);
     vspapi->registerFunction("MergeDiff", "clipa:vnode;clipb:vnode;planes:int[]:opt;", "clip:vnode;", mergeDiffCreate, 0, plugin);
+
+    for (const char *name : { "PreMultiply", "Merge", "MaskedMerge", "MakeDiff", "MergeDiff" })
+        vspapi->setFunctionFlags(name, pffDeterministic | pffProxyScalable, plugin);
 }
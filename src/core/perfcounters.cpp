@@ -0,0 +1,101 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "perfcounters.h"
+
+#ifdef VS_TARGET_OS_LINUX
+
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+struct PerfCounterGroup {
+    int fds[pcNumCounters];
+    bool opened = false;
+    bool failed = false;
+
+    PerfCounterGroup() {
+        for (int i = 0; i < pcNumCounters; i++)
+            fds[i] = -1;
+    }
+
+    ~PerfCounterGroup() {
+        for (int i = 0; i < pcNumCounters; i++)
+            if (fds[i] >= 0)
+                close(fds[i]);
+    }
+
+    bool open() {
+        static const uint64_t configs[pcNumCounters] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+        for (int i = 0; i < pcNumCounters; i++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.read_format = PERF_FORMAT_GROUP;
+            // user space only so it works with the default perf_event_paranoid setting
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.disabled = (i == 0);
+            fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, i ? fds[0] : -1, 0));
+            if (fds[i] < 0)
+                return false;
+        }
+
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+    }
+};
+
+}
+
+bool vs_read_perf_counters(int64_t values[pcNumCounters]) {
+    thread_local PerfCounterGroup group;
+
+    if (!group.opened && !group.failed) {
+        group.opened = group.open();
+        group.failed = !group.opened;
+    }
+
+    if (group.failed)
+        return false;
+
+    uint64_t buffer[1 + pcNumCounters];
+    if (read(group.fds[0], buffer, sizeof(buffer)) != sizeof(buffer) || buffer[0] != pcNumCounters)
+        return false;
+
+    for (int i = 0; i < pcNumCounters; i++)
+        values[i] = static_cast<int64_t>(buffer[i + 1]);
+    return true;
+}
+
+#else
+
+bool vs_read_perf_counters(int64_t values[pcNumCounters]) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <cstdint>
+
+// Hardware performance counters for the calling thread, only implemented on Linux
+// using perf_event_open. The counters are opened the first time a thread reads them.
+
+enum VSPerfCounter {
+    pcCycles = 0,
+    pcInstructions = 1,
+    pcCacheMisses = 2, // last level cache
+    pcBranchMisses = 3,
+    pcNumCounters = 4
+};
+
+// returns false if the counters can't be used from this thread
+bool vs_read_perf_counters(int64_t values[pcNumCounters]);
+
+#endif // PERFCOUNTERS_H
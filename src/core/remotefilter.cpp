@@ -0,0 +1,301 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+// RemoteClip is a source that gets its frames from one or more vspipe --serve processes. Frames are
+// spread over the servers in ranges of chunk frames, a request for frame n also sends the requests
+// for the frames after it so up to window of them are always on their way. Every server has a
+// receiver thread that writes the replies straight into new frames, getFrame waits until its own
+// frame has arrived so the clip is returned in order no matter the order the servers finish in.
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "VapourSynth4.h"
+#include "VSHelper4.h"
+#include "filtershared.h"
+#include "internalfilters.h"
+#include "../common/vsremote.h"
+
+using namespace vsh;
+
+#ifndef VS_TARGET_OS_WINDOWS
+
+namespace {
+
+struct RemoteServer {
+    std::string address;
+    int fd = -1;
+    bool lost = false; // protected by the lock of the clip
+    std::thread receiver;
+};
+
+struct RemoteClipData {
+    VSVideoInfo vi = {};
+    std::vector<std::unique_ptr<RemoteServer>> servers;
+    int window = 0;
+    int chunk = 1;
+
+    std::mutex lock;
+    std::condition_variable arrived;
+    std::map<int, size_t> pending; // frames requested and not received yet, and the server they were sent to
+    std::map<int, const VSFrame *> frames; // received and not returned yet
+    std::map<int, std::string> errors;
+
+    const VSAPI *vsapi;
+    VSCore *core;
+
+    RemoteClipData(const VSAPI *vsapi, VSCore *core) : vsapi(vsapi), core(core) {}
+
+    ~RemoteClipData() {
+        for (auto &server : servers) {
+            if (server->fd >= 0) {
+                VSRemoteRequest request = { rmClose, 0 };
+                sendAll(server->fd, &request, sizeof(request));
+                shutdown(server->fd, SHUT_RDWR);
+            }
+        }
+        for (auto &server : servers) {
+            if (server->receiver.joinable())
+                server->receiver.join();
+            if (server->fd >= 0)
+                close(server->fd);
+        }
+        for (auto &iter : frames)
+            vsapi->freeFrame(iter.second);
+    }
+
+    // sends the request to the server the chunk of n belongs to or the next one still connected,
+    // called with the lock held
+    bool request(int n) {
+        size_t first = static_cast<size_t>(n / chunk) % servers.size();
+        for (size_t i = 0; i < servers.size(); i++) {
+            size_t index = (first + i) % servers.size();
+            RemoteServer *server = servers[index].get();
+            if (server->lost)
+                continue;
+            VSRemoteRequest request = { rmFrame, n };
+            if (sendAll(server->fd, &request, sizeof(request))) {
+                pending[n] = index;
+                return true;
+            }
+            server->lost = true;
+        }
+        return false;
+    }
+
+    // frames that were prefetched but skipped over by a seek would otherwise pile up
+    void trimFrames(int n) {
+        while (frames.size() > static_cast<size_t>(window) * 2) {
+            auto low = frames.begin();
+            auto high = std::prev(frames.end());
+            auto &victim = (n - low->first > high->first - n) ? low : high;
+            vsapi->freeFrame(victim->second);
+            frames.erase(victim);
+        }
+    }
+
+    void receive(size_t index);
+};
+
+void RemoteClipData::receive(size_t index) {
+    RemoteServer *server = servers[index].get();
+    std::vector<uint8_t> buffer;
+
+    while (true) {
+        VSRemoteReply reply;
+        if (!recvAll(server->fd, &reply, sizeof(reply)) || (reply.type != rmFrame && reply.type != rmError))
+            break;
+
+        if (reply.type == rmError) {
+            std::string error(reply.propSize, '\0');
+            if (!recvAll(server->fd, &error[0], error.size()))
+                break;
+            std::lock_guard<std::mutex> l(lock);
+            pending.erase(reply.n);
+            errors[reply.n] = error;
+            arrived.notify_all();
+            continue;
+        }
+
+        buffer.resize(reply.propSize);
+        if (!recvAll(server->fd, buffer.data(), buffer.size()))
+            break;
+
+        VSFrame *frame = vsapi->newVideoFrame(&vi.format, vi.width, vi.height, nullptr, core);
+        uint64_t frameSize = 0;
+        for (int plane = 0; plane < vi.format.numPlanes; plane++)
+            frameSize += static_cast<uint64_t>(vsapi->getFrameWidth(frame, plane)) * vi.format.bytesPerSample * vsapi->getFrameHeight(frame, plane);
+
+        bool ok = frameSize == reply.frameSize && deserializeRemoteProperties(vsapi->getFramePropertiesRW(frame), buffer.data(), buffer.size(), vsapi);
+        for (int plane = 0; ok && plane < vi.format.numPlanes; plane++) {
+            size_t rowSize = static_cast<size_t>(vsapi->getFrameWidth(frame, plane)) * vi.format.bytesPerSample;
+            ptrdiff_t stride = vsapi->getStride(frame, plane);
+            uint8_t *dstp = vsapi->getWritePtr(frame, plane);
+            int height = vsapi->getFrameHeight(frame, plane);
+            if (stride == static_cast<ptrdiff_t>(rowSize)) {
+                ok = recvAll(server->fd, dstp, rowSize * height);
+            } else {
+                for (int y = 0; ok && y < height; y++)
+                    ok = recvAll(server->fd, dstp + stride * y, rowSize);
+            }
+        }
+
+        if (!ok) {
+            vsapi->freeFrame(frame);
+            break;
+        }
+
+        std::lock_guard<std::mutex> l(lock);
+        pending.erase(reply.n);
+        auto iter = frames.find(reply.n);
+        if (iter != frames.end()) {
+            vsapi->freeFrame(iter->second);
+            iter->second = frame;
+        } else {
+            frames[reply.n] = frame;
+        }
+        arrived.notify_all();
+    }
+
+    // whatever was still on its way from this server is requested again from another one
+    std::lock_guard<std::mutex> l(lock);
+    server->lost = true;
+    arrived.notify_all();
+}
+
+static const VSFrame *VS_CC remoteClipGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    RemoteClipData *d = reinterpret_cast<RemoteClipData *>(instanceData);
+
+    if (activationReason != arInitial)
+        return nullptr;
+
+    std::unique_lock<std::mutex> lock(d->lock);
+
+    int last = std::min(n + d->window, d->vi.numFrames);
+    for (int i = n; i < last; i++) {
+        if (!d->frames.count(i) && !d->pending.count(i) && !d->errors.count(i) && !d->request(i))
+            break;
+    }
+
+    while (true) {
+        auto frame = d->frames.find(n);
+        if (frame != d->frames.end()) {
+            const VSFrame *f = frame->second;
+            d->frames.erase(frame);
+            d->trimFrames(n);
+            return f;
+        }
+
+        auto error = d->errors.find(n);
+        if (error != d->errors.end()) {
+            vsapi->setFilterError(("RemoteClip: " + error->second).c_str(), frameCtx);
+            d->errors.erase(error);
+            return nullptr;
+        }
+
+        auto pending = d->pending.find(n);
+        if (pending == d->pending.end() || d->servers[pending->second]->lost) {
+            if (pending != d->pending.end())
+                d->pending.erase(pending);
+            if (!d->request(n)) {
+                vsapi->setFilterError("RemoteClip: lost the connection to all servers", frameCtx);
+                return nullptr;
+            }
+        }
+
+        d->arrived.wait(lock);
+    }
+}
+
+static void VS_CC remoteClipCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<RemoteClipData> d(new RemoteClipData(vsapi, core));
+    int err;
+
+    int numServers = vsapi->mapNumElements(in, "servers");
+    if (numServers < 1)
+        RETERROR("RemoteClip: at least one server must be given");
+
+    d->chunk = vsapi->mapGetIntSaturated(in, "chunk", 0, &err);
+    if (err)
+        d->chunk = 1;
+    if (d->chunk < 1)
+        RETERROR("RemoteClip: chunk must be at least 1");
+
+    d->window = vsapi->mapGetIntSaturated(in, "window", 0, &err);
+    if (err)
+        d->window = 2 * numServers;
+    if (d->window < 1)
+        RETERROR("RemoteClip: window must be at least 1");
+
+    for (int i = 0; i < numServers; i++) {
+        std::unique_ptr<RemoteServer> server(new RemoteServer);
+        server->address = vsapi->mapGetData(in, "servers", i, nullptr);
+
+        std::string error;
+        server->fd = openRemoteSocket(server->address, false, error);
+        if (server->fd < 0)
+            RETERROR(("RemoteClip: " + error).c_str());
+        d->servers.push_back(std::move(server));
+
+        VSRemoteHello hello;
+        if (!recvAll(d->servers.back()->fd, &hello, sizeof(hello)) || memcmp(hello.magic, remoteMagic, sizeof(remoteMagic)))
+            RETERROR(("RemoteClip: " + d->servers.back()->address + " is not a frame server").c_str());
+        if (hello.version != remoteVersion)
+            RETERROR(("RemoteClip: " + d->servers.back()->address + " uses a different protocol version").c_str());
+
+        VSVideoInfo vi = {};
+        if (!vsapi->getVideoFormatByID(&vi.format, hello.formatID, core) || hello.width <= 0 || hello.height <= 0 || hello.numFrames <= 0)
+            RETERROR(("RemoteClip: " + d->servers.back()->address + " sent an invalid clip").c_str());
+        vi.width = hello.width;
+        vi.height = hello.height;
+        vi.numFrames = hello.numFrames;
+        vi.fpsNum = hello.fpsNum;
+        vi.fpsDen = hello.fpsDen;
+
+        if (i == 0)
+            d->vi = vi;
+        else if (!isSameVideoInfo(&d->vi, &vi) || d->vi.numFrames != vi.numFrames || d->vi.fpsNum != vi.fpsNum || d->vi.fpsDen != vi.fpsDen)
+            RETERROR(("RemoteClip: " + d->servers.back()->address + " serves a different clip than " + d->servers.front()->address).c_str());
+    }
+
+    for (size_t i = 0; i < d->servers.size(); i++)
+        d->servers[i]->receiver = std::thread(&RemoteClipData::receive, d.get(), i);
+
+    // requests are handed over one at a time, the waiting happens for the frames in the window together
+    vsapi->createVideoFilter(out, "RemoteClip", &d->vi, remoteClipGetFrame, filterFree<RemoteClipData>, fmUnordered, nullptr, 0, d.get(), core);
+    d.release();
+}
+
+} // namespace
+
+#endif
+
+//////////////////////////////////////////
+// Init
+
+void remoteInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
+#ifndef VS_TARGET_OS_WINDOWS
+    vspapi->registerFunction("RemoteClip", "servers:data[];window:int:opt;chunk:int:opt;", "clip:vnode;", remoteClipCreate, nullptr, plugin);
+#endif
+}
@@ -75,6 +75,62 @@ static MismatchCauses findCommonVi(VSNode **nodes, int num, VSVideoInfo *outvi,
     return mismatch;
 }
 
+// Filters that only pick frames from their inputs describe what they do as runs of source frames
+// that are step apart. When such a filter gets another one that nothing else uses as input both
+// are combined into a single node, see createRemap().
+
+struct RemapSegment {
+    int start; // first output frame
+    int length;
+    int source;
+    int frame; // first source frame
+    int step;
+};
+
+struct RemapList {
+    static const size_t maxSegments = 1 << 16;
+
+    std::vector<VSNode *> sources; // borrowed
+    std::vector<RemapSegment> segments;
+    int numFrames = 0;
+
+    int addSource(VSNode *node) {
+        auto it = std::find(sources.begin(), sources.end(), node);
+        if (it != sources.end())
+            return static_cast<int>(it - sources.begin());
+        sources.push_back(node);
+        return static_cast<int>(sources.size() - 1);
+    }
+
+    // runs that continue the previous one are merged, returns false once there are too many to be worthwhile
+    bool append(int source, int frame, int length, int step = 1) {
+        if (length <= 0)
+            return true;
+
+        if (!segments.empty() && segments.back().source == source) {
+            RemapSegment &prev = segments.back();
+            int64_t gap = static_cast<int64_t>(frame) - (prev.frame + static_cast<int64_t>(prev.length - 1) * prev.step);
+            if ((prev.length == 1 || prev.step == gap) && (length == 1 || step == gap) && gap >= INT_MIN && gap <= INT_MAX) {
+                prev.step = static_cast<int>(gap);
+                prev.length += length;
+                numFrames += length;
+                return true;
+            }
+        }
+
+        segments.push_back({ numFrames, length, source, frame, (length > 1) ? step : 1 });
+        numFrames += length;
+        return segments.size() <= maxSegments;
+    }
+
+    const RemapSegment &find(int n) const {
+        auto it = std::upper_bound(segments.begin(), segments.end(), n, [](int n, const RemapSegment &seg) { return n < seg.start; });
+        return *(it - 1);
+    }
+};
+
+static bool createRemap(const char *name, const VSVideoInfo &vi, const RemapList &list, VSMap *out, VSCore *core, const VSAPI *vsapi);
+
 static std::string mismatchToText(MismatchCauses mismatchCause) {
     if (mismatchCause == MismatchCauses::DifferentDimensions)
         return "the clips' dimensions don't match";
@@ -109,6 +165,10 @@ static const VSFrame *VS_CC trimGetframe(int n, int activationReason, void *inst
     return nullptr;
 }
 
+static bool trimRemap(const TrimData *d, const VSVideoInfo &vi, RemapList &list) {
+    return list.append(list.addSource(d->node), d->first, vi.numFrames);
+}
+
 static void VS_CC trimCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<TrimData> d(new TrimData(vsapi));
     int err;
@@ -156,8 +216,13 @@ static void VS_CC trimCreate(const VSMap *in, VSMap *out, void *userData, VSCore
 
     vi.numFrames = trimlen;
 
+    RemapList remap;
+    if (trimRemap(d.get(), vi, remap) && createRemap("Trim", vi, remap, out, core, vsapi))
+        return;
+
     VSFilterDependency deps[] = {{d->node, rpNoFrameReuse}};
     vsapi->createVideoFilter(out, "Trim", &vi, trimGetframe, filterFree<TrimData>, fmParallel, deps, 1, d.release(), core);
+    setPassThroughHints(out, vsapi);
 }
 
 //////////////////////////////////////////
@@ -201,6 +266,22 @@ static const VSFrame *VS_CC interleaveGetframe(int n, int activationReason, void
     return nullptr;
 }
 
+static bool interleaveRemap(const InterleaveData *d, const VSVideoInfo &vi, RemapList &list, const VSAPI *vsapi) {
+    if (d->modifyDuration)
+        return false;
+
+    for (int i = 0; i < d->numclips; i++)
+        list.addSource(d->nodes[i]);
+
+    for (int n = 0; n < vi.numFrames; n++) {
+        int clip = n % d->numclips;
+        if (!list.append(clip, std::min(n / d->numclips, vsapi->getVideoInfo(d->nodes[clip])->numFrames - 1), 1))
+            return false;
+    }
+
+    return true;
+}
+
 static void VS_CC interleaveCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<InterleaveData> d(new InterleaveData(vsapi));
     int err;
@@ -248,10 +329,15 @@ static void VS_CC interleaveCreate(const VSMap *in, VSMap *out, void *userData,
         if (d->modifyDuration)
             muldivRational(&d->vi.fpsNum, &d->vi.fpsDen, d->numclips, 1);
 
+        RemapList remap;
+        if (interleaveRemap(d.get(), d->vi, remap, vsapi) && createRemap("Interleave", d->vi, remap, out, core, vsapi))
+            return;
+
         std::vector<VSFilterDependency> deps;
         for (int i = 0; i < d->numclips; i++)
             deps.push_back({d->nodes[i], (maxNumFrames <= vsapi->getVideoInfo(d->nodes[i])->numFrames) ? rpStrictSpatial : rpGeneral});
         vsapi->createVideoFilter(out, "Interleave", &d->vi, interleaveGetframe, filterFree<InterleaveData>, fmParallel, deps.data(), d->numclips, d.get(), core);
+        setPassThroughHints(out, vsapi);
         d.release();
     }
 }
@@ -273,14 +359,23 @@ static const VSFrame *VS_CC reverseGetframe(int n, int activationReason, void *i
     return nullptr;
 }
 
+static bool reverseRemap(const ReverseData *d, const VSVideoInfo &vi, RemapList &list) {
+    return list.append(list.addSource(d->node), vi.numFrames - 1, vi.numFrames, -1);
+}
+
 static void VS_CC reverseCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<ReverseData> d(new ReverseData(vsapi));
 
     d->node = vsapi->mapGetNode(in, "clip", 0, 0);
     d->vi = vsapi->getVideoInfo(d->node);
 
+    RemapList remap;
+    if (reverseRemap(d.get(), *d->vi, remap) && createRemap("Reverse", *d->vi, remap, out, core, vsapi))
+        return;
+
     VSFilterDependency deps[] = {{ d->node, rpNoFrameReuse }};
     vsapi->createVideoFilter(out, "Reverse", d->vi, reverseGetframe, filterFree<ReverseData>, fmParallel, deps, 1, d.get(), core);
+    setPassThroughHints(out, vsapi);
     d.release();
 }
 
@@ -301,6 +396,15 @@ static const VSFrame *VS_CC loopGetframe(int n, int activationReason, void *inst
     return nullptr;
 }
 
+static bool loopRemap(const LoopData *d, const VSVideoInfo &vi, RemapList &list) {
+    int source = list.addSource(d->node);
+    for (int64_t n = 0; n < vi.numFrames; n += d->vi->numFrames) {
+        if (!list.append(source, 0, static_cast<int>(std::min<int64_t>(d->vi->numFrames, vi.numFrames - n))))
+            return false;
+    }
+    return true;
+}
+
 static void VS_CC loopCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<LoopData> d(new LoopData(vsapi));
     int err;
@@ -327,8 +431,13 @@ static void VS_CC loopCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         vi.numFrames = INT_MAX;
     }
 
+    RemapList remap;
+    if (loopRemap(d.get(), vi, remap) && createRemap("Loop", vi, remap, out, core, vsapi))
+        return;
+
     VSFilterDependency deps[] = {{d->node, rpGeneral}};
     vsapi->createVideoFilter(out, "Loop", &vi, loopGetframe, filterFree<LoopData>, fmParallel, deps, 1, d.release(), core);
+    setPassThroughHints(out, vsapi);
 }
 
 //////////////////////////////////////////
@@ -373,6 +482,18 @@ static const VSFrame *VS_CC selectEveryGetframe(int n, int activationReason, voi
     return nullptr;
 }
 
+static bool selectEveryRemap(const SelectEveryData *d, const VSVideoInfo &vi, RemapList &list) {
+    if (d->modifyDuration)
+        return false;
+
+    int source = list.addSource(d->node);
+    for (int n = 0; n < vi.numFrames; n++) {
+        if (!list.append(source, (n / d->num) * d->cycle + d->offsets[n % d->num], 1))
+            return false;
+    }
+    return true;
+}
+
 static void VS_CC selectEveryCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<SelectEveryData> d(new SelectEveryData(vsapi));
     int err;
@@ -413,8 +534,13 @@ static void VS_CC selectEveryCreate(const VSMap *in, VSMap *out, void *userData,
     if (d->modifyDuration)
         muldivRational(&vi.fpsNum, &vi.fpsDen, d->num, d->cycle);
 
+    RemapList remap;
+    if (selectEveryRemap(d.get(), vi, remap) && createRemap("SelectEvery", vi, remap, out, core, vsapi))
+        return;
+
     VSFilterDependency deps[] = {{d->node, rpNoFrameReuse}};
     vsapi->createVideoFilter(out, "SelectEvery", &vi, selectEveryGetframe, filterFree<SelectEveryData>, fmParallel, deps, 1, d.release(), core);
+    setPassThroughHints(out, vsapi);
 }
 
 //////////////////////////////////////////
@@ -422,6 +548,7 @@ static void VS_CC selectEveryCreate(const VSMap *in, VSMap *out, void *userData,
 
 typedef struct {
     std::vector<int> numframes;
+    std::vector<int> cumframes; // end of each clip in the output
     int numclips;
 } SpliceDataExtra;
 
@@ -431,19 +558,8 @@ static const VSFrame *VS_CC spliceGetframe(int n, int activationReason, void *in
     SpliceData *d = reinterpret_cast<SpliceData *>(instanceData);
 
     if (activationReason == arInitial) {
-        int frame = 0;
-        int idx = 0;
-        int cumframe = 0;
-
-        for (int i = 0; i < d->numclips; i++) {
-            if ((n >= cumframe && n < cumframe + d->numframes[i]) || i == d->numclips - 1) {
-                idx = i;
-                frame = n - cumframe;
-                break;
-            }
-
-            cumframe += d->numframes[i];
-        }
+        int idx = static_cast<int>(std::upper_bound(d->cumframes.begin(), d->cumframes.end() - 1, n) - d->cumframes.begin());
+        int frame = n - ((idx > 0) ? d->cumframes[idx - 1] : 0);
 
         frameData[0] = d->nodes[idx];
         frameData[1] = reinterpret_cast<void *>(static_cast<intptr_t>(frame));
@@ -456,6 +572,14 @@ static const VSFrame *VS_CC spliceGetframe(int n, int activationReason, void *in
     return nullptr;
 }
 
+static bool spliceRemap(const SpliceData *d, RemapList &list) {
+    for (int i = 0; i < d->numclips; i++) {
+        if (!list.append(list.addSource(d->nodes[i]), 0, d->numframes[i]))
+            return false;
+    }
+    return true;
+}
+
 static void VS_CC spliceCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<SpliceData> d(new SpliceData(vsapi));
     int err;
@@ -478,6 +602,7 @@ static void VS_CC spliceCreate(const VSMap *in, VSMap *out, void *userData, VSCo
             RETERROR(("Splice: " + mismatchToText(mismatchCause)).c_str());
 
         d->numframes.resize(d->numclips);
+        d->cumframes.resize(d->numclips);
         vi.numFrames = 0;
 
         for (int i = 0; i < d->numclips; i++) {
@@ -487,35 +612,40 @@ static void VS_CC spliceCreate(const VSMap *in, VSMap *out, void *userData, VSCo
             // did it overflow?
             if (vi.numFrames < d->numframes[i])
                 RETERROR("Splice: the resulting clip is too long");
+            d->cumframes[i] = vi.numFrames;
         }
 
+        RemapList remap;
+        if (spliceRemap(d.get(), remap) && createRemap("Splice", vi, remap, out, core, vsapi))
+            return;
+
         std::vector<VSFilterDependency> deps;
         for (int i = 0; i < d->numclips; i++)
             deps.push_back({ d->nodes[i], rpNoFrameReuse });
         vsapi->createVideoFilter(out, "Splice", &vi, spliceGetframe, filterFree<SpliceData>, fmParallel, deps.data(), d->numclips, d.get(), core);
+        setPassThroughHints(out, vsapi);
         d.release();
     }
 }
 
 //////////////////////////////////////////
-// DuplicateFrames
+// Frame maps
+
+// DuplicateFrames, DeleteFrames and FreezeFrames build the list of source runs once at creation and
+// look frames up in it, so long frame lists only cost a binary search per request
 
 typedef struct {
-    std::vector<int> dups;
-    int num_dups;
-} DuplicateFramesDataExtra;
+    RemapList map;
+} FrameMapDataExtra;
 
-typedef SingleNodeData<DuplicateFramesDataExtra> DuplicateFramesData;
+typedef SingleNodeData<FrameMapDataExtra> FrameMapData;
 
-static const VSFrame *VS_CC duplicateFramesGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
-    DuplicateFramesData *d = reinterpret_cast<DuplicateFramesData *>(instanceData);
+static const VSFrame *VS_CC frameMapGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    FrameMapData *d = reinterpret_cast<FrameMapData *>(instanceData);
 
     if (activationReason == arInitial) {
-        for (int i = 0; i < d->num_dups; i++)
-            if (n > d->dups[i])
-                n--;
-            else
-                break;
+        const RemapSegment &seg = d->map.find(n);
+        n = seg.frame + (n - seg.start) * seg.step;
 
         frameData[0] = reinterpret_cast<void *>(static_cast<intptr_t>(n));
 
@@ -527,94 +657,103 @@ static const VSFrame *VS_CC duplicateFramesGetFrame(int n, int activationReason,
     return nullptr;
 }
 
+static bool frameMapRemap(const FrameMapData *d, RemapList &list) {
+    int source = list.addSource(d->node);
+    for (const RemapSegment &seg : d->map.segments)
+        if (!list.append(source, seg.frame, seg.length, seg.step))
+            return false;
+    return true;
+}
+
+// The map itself is kept whole however long it gets, it's only folded into other nodes while it's short enough
+static void createFrameMap(const char *name, std::unique_ptr<FrameMapData> d, const VSVideoInfo &vi, VSRequestPattern requestPattern, VSMap *out, VSCore *core, const VSAPI *vsapi) {
+    if (d->map.segments.size() <= RemapList::maxSegments && createRemap(name, vi, d->map, out, core, vsapi))
+        return;
+
+    VSFilterDependency deps[] = {{d->node, requestPattern}};
+    vsapi->createVideoFilter(out, name, &vi, frameMapGetFrame, filterFree<FrameMapData>, fmParallel, deps, 1, d.release(), core);
+    setPassThroughHints(out, vsapi);
+}
+
+//////////////////////////////////////////
+// DuplicateFrames
+
 static void VS_CC duplicateFramesCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
-    std::unique_ptr<DuplicateFramesData> d(new DuplicateFramesData(vsapi));
+    std::unique_ptr<FrameMapData> d(new FrameMapData(vsapi));
 
     d->node = vsapi->mapGetNode(in, "clip", 0, 0);
     VSVideoInfo vi = *vsapi->getVideoInfo(d->node);
 
-    d->num_dups = vsapi->mapNumElements(in, "frames");
+    int num_dups = vsapi->mapNumElements(in, "frames");
 
-    d->dups.resize(d->num_dups);
+    std::vector<int> dups(num_dups);
 
-    for (int i = 0; i < d->num_dups; i++) {
-        d->dups[i] = vsapi->mapGetIntSaturated(in, "frames", i, 0);
+    for (int i = 0; i < num_dups; i++) {
+        dups[i] = vsapi->mapGetIntSaturated(in, "frames", i, 0);
 
-        if (d->dups[i] < 0 || (vi.numFrames && d->dups[i] > vi.numFrames - 1))
+        if (dups[i] < 0 || (vi.numFrames && dups[i] > vi.numFrames - 1))
             RETERROR("DuplicateFrames: out of bounds frame number");
     }
 
-    std::sort(d->dups.begin(), d->dups.end());
+    std::sort(dups.begin(), dups.end());
 
-    if (vi.numFrames + d->num_dups < vi.numFrames)
+    if (vi.numFrames + num_dups < vi.numFrames)
         RETERROR("DuplicateFrames: resulting clip is too long");
 
-    vi.numFrames += d->num_dups;
+    int source = d->map.addSource(d->node);
+    int next = 0;
+    for (int dup : dups) {
+        d->map.append(source, next, dup - next + 1);
+        next = dup;
+    }
+    d->map.append(source, next, vi.numFrames - next);
+
+    vi.numFrames += num_dups;
 
-    VSFilterDependency deps[] = {{d->node, rpGeneral}};
-    vsapi->createVideoFilter(out, "DuplicateFrames", &vi, duplicateFramesGetFrame, filterFree<DuplicateFramesData>, fmParallel, deps, 1, d.release(), core);
+    createFrameMap("DuplicateFrames", std::move(d), vi, rpGeneral, out, core, vsapi);
 }
 
 //////////////////////////////////////////
 // DeleteFrames
 
-typedef struct {
-    std::vector<int> del;
-    int num_delete;
-} DeleteFramesDataExtra;
-
-typedef SingleNodeData<DeleteFramesDataExtra> DeleteFramesData;
-
-static const VSFrame *VS_CC deleteFramesGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
-    DeleteFramesData *d = reinterpret_cast<DeleteFramesData *>(instanceData);
-
-    if (activationReason == arInitial) {
-        for (int i = 0; i < d->num_delete; i++)
-            if (n >= d->del[i])
-                n++;
-            else
-                break;
-        frameData[0] = reinterpret_cast<void *>(static_cast<intptr_t>(n));
-        vsapi->requestFrameFilter(n, d->node, frameCtx);
-    } else if (activationReason == arAllFramesReady) {
-        return vsapi->getFrameFilter(static_cast<int>(reinterpret_cast<intptr_t>(frameData[0])), d->node, frameCtx);
-    }
-
-    return nullptr;
-}
-
 static void VS_CC deleteFramesCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
-    std::unique_ptr<DeleteFramesData> d(new DeleteFramesData(vsapi));
+    std::unique_ptr<FrameMapData> d(new FrameMapData(vsapi));
 
     d->node = vsapi->mapGetNode(in, "clip", 0, 0);
     VSVideoInfo vi = *vsapi->getVideoInfo(d->node);
 
-    d->num_delete = vsapi->mapNumElements(in, "frames");
+    int num_delete = vsapi->mapNumElements(in, "frames");
 
-    d->del.resize(d->num_delete);
+    std::vector<int> del(num_delete);
 
-    for (int i = 0; i < d->num_delete; i++) {
-        d->del[i] = vsapi->mapGetIntSaturated(in, "frames", i, 0);
+    for (int i = 0; i < num_delete; i++) {
+        del[i] = vsapi->mapGetIntSaturated(in, "frames", i, 0);
 
-        if (d->del[i] < 0 || (vi.numFrames && d->del[i] >= vi.numFrames))
+        if (del[i] < 0 || (vi.numFrames && del[i] >= vi.numFrames))
             RETERROR("DeleteFrames: out of bounds frame number");
     }
 
-    std::sort(d->del.begin(), d->del.end());
+    std::sort(del.begin(), del.end());
 
-    for (int i = 0; i < d->num_delete - 1; i++) {
-        if (d->del[i] == d->del[i + 1])
+    for (int i = 0; i < num_delete - 1; i++) {
+        if (del[i] == del[i + 1])
             RETERROR("DeleteFrames: can't delete a frame more than once");
     }
 
-    if (vi.numFrames) {
-        vi.numFrames -= d->num_delete;
-        if (vi.numFrames <= 0)
-            RETERROR("DeleteFrames: can't delete all frames");
+    if (vi.numFrames - num_delete <= 0)
+        RETERROR("DeleteFrames: can't delete all frames");
+
+    int source = d->map.addSource(d->node);
+    int next = 0;
+    for (int frame : del) {
+        d->map.append(source, next, frame - next);
+        next = frame + 1;
     }
+    d->map.append(source, next, vi.numFrames - next);
 
-    VSFilterDependency deps[] = {{d->node, rpNoFrameReuse}};
-    vsapi->createVideoFilter(out, "DeleteFrames", &vi, deleteFramesGetFrame, filterFree<DeleteFramesData>, fmParallel, deps, 1, d.release(), core);
+    vi.numFrames -= num_delete;
+
+    createFrameMap("DeleteFrames", std::move(d), vi, rpNoFrameReuse, out, core, vsapi);
 }
 
 //////////////////////////////////////////
@@ -629,69 +768,186 @@ struct Freeze {
     }
 };
 
-typedef struct {
-    std::vector<Freeze> freeze;
-} FreezeFramesDataExtra;
+static void VS_CC freezeFramesCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<FrameMapData> d(new FrameMapData(vsapi));
+
+    int num_freeze = vsapi->mapNumElements(in, "first");
+    if (num_freeze != vsapi->mapNumElements(in, "last") || num_freeze != vsapi->mapNumElements(in, "replacement"))
+        RETERROR("FreezeFrames: 'first', 'last', and 'replacement' must have the same length.");
 
-typedef SingleNodeData<FreezeFramesDataExtra> FreezeFramesData;
+    d->node = vsapi->mapGetNode(in, "clip", 0, 0);
+    const VSVideoInfo *vi = vsapi->getVideoInfo(d->node);
 
-static const VSFrame *VS_CC freezeFramesGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
-    FreezeFramesData *d = reinterpret_cast<FreezeFramesData *>(instanceData);
+    std::vector<Freeze> freeze(num_freeze);
 
-    if (activationReason == arInitial) {
-        if (n >= d->freeze.front().first && n <= d->freeze.back().last)
-            for (auto &iter : d->freeze)
-                if (n >= iter.first && n <= iter.last) {
-                    n = iter.replacement;
-                    break;
-                }
+    for (int i = 0; i < num_freeze; i++) {
+        freeze[i].first = vsapi->mapGetIntSaturated(in, "first", i, 0);
+        freeze[i].last = vsapi->mapGetIntSaturated(in, "last", i, 0);
+        freeze[i].replacement = vsapi->mapGetIntSaturated(in, "replacement", i, 0);
 
-        frameData[0] = reinterpret_cast<void *>(static_cast<intptr_t>(n));
+        if (freeze[i].first > freeze[i].last)
+            std::swap(freeze[i].first, freeze[i].last);
 
-        vsapi->requestFrameFilter(n, d->node, frameCtx);
+        if (freeze[i].first < 0 || (vi->numFrames && freeze[i].last >= vi->numFrames) ||
+            freeze[i].replacement < 0 || (vi->numFrames && freeze[i].replacement >= vi->numFrames))
+            RETERROR("FreezeFrames: out of bounds frame number(s)");
+    }
+
+    std::sort(freeze.begin(), freeze.end());
+
+    for (int i = 0; i < num_freeze - 1; i++)
+        if (freeze[i].last >= freeze[i + 1].first)
+            RETERROR("FreezeFrames: the frame ranges must not overlap");
+
+    int source = d->map.addSource(d->node);
+    int next = 0;
+    for (const Freeze &iter : freeze) {
+        d->map.append(source, next, iter.first - next);
+        d->map.append(source, iter.replacement, iter.last - iter.first + 1, 0);
+        next = iter.last + 1;
+    }
+    d->map.append(source, next, vi->numFrames - next);
+
+    createFrameMap("FreezeFrames", std::move(d), *vi, rpGeneral, out, core, vsapi);
+}
+
+//////////////////////////////////////////
+// Remap
+
+typedef struct {
+    std::vector<RemapSegment> segments;
+} RemapDataExtra;
+
+typedef VariableNodeData<RemapDataExtra> RemapData;
+
+static const VSFrame *VS_CC remapGetframe(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    RemapData *d = reinterpret_cast<RemapData *>(instanceData);
+
+    if (activationReason == arInitial) {
+        auto it = std::upper_bound(d->segments.begin(), d->segments.end(), n, [](int n, const RemapSegment &seg) { return n < seg.start; }) - 1;
+        int frame = it->frame + (n - it->start) * it->step;
+        frameData[0] = d->nodes[it->source];
+        frameData[1] = reinterpret_cast<void *>(static_cast<intptr_t>(frame));
+        vsapi->requestFrameFilter(frame, d->nodes[it->source], frameCtx);
     } else if (activationReason == arAllFramesReady) {
-        return vsapi->getFrameFilter(static_cast<int>(reinterpret_cast<intptr_t>(frameData[0])), d->node, frameCtx);
+        return vsapi->getFrameFilter(static_cast<int>(reinterpret_cast<intptr_t>(frameData[1])), reinterpret_cast<VSNode *>(frameData[0]), frameCtx);
     }
 
     return nullptr;
 }
 
-static void VS_CC freezeFramesCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
-    std::unique_ptr<FreezeFramesData> d(new FreezeFramesData(vsapi));
+// Describes node as a remapping of its inputs if it's one of the filters above and nothing else uses it
+static bool describeRemap(VSNode *node, RemapList &list, const VSAPI *vsapi) {
+    if (vsapi->getNodeType(node) != mtVideo)
+        return false;
+    const VSVideoInfo &vi = *vsapi->getVideoInfo(node);
+
+    if (const RemapData *d = reinterpret_cast<const RemapData *>(getFusableInstanceData(node, remapGetframe))) {
+        for (VSNode *source : d->nodes)
+            list.addSource(source);
+        for (const RemapSegment &seg : d->segments)
+            list.append(seg.source, seg.frame, seg.length, seg.step);
+        return true;
+    } else if (const TrimData *d = reinterpret_cast<const TrimData *>(getFusableInstanceData(node, trimGetframe))) {
+        return trimRemap(d, vi, list);
+    } else if (const InterleaveData *d = reinterpret_cast<const InterleaveData *>(getFusableInstanceData(node, interleaveGetframe))) {
+        return interleaveRemap(d, vi, list, vsapi);
+    } else if (const ReverseData *d = reinterpret_cast<const ReverseData *>(getFusableInstanceData(node, reverseGetframe))) {
+        return reverseRemap(d, vi, list);
+    } else if (const LoopData *d = reinterpret_cast<const LoopData *>(getFusableInstanceData(node, loopGetframe))) {
+        return loopRemap(d, vi, list);
+    } else if (const SelectEveryData *d = reinterpret_cast<const SelectEveryData *>(getFusableInstanceData(node, selectEveryGetframe))) {
+        return selectEveryRemap(d, vi, list);
+    } else if (const SpliceData *d = reinterpret_cast<const SpliceData *>(getFusableInstanceData(node, spliceGetframe))) {
+        return spliceRemap(d, list);
+    } else if (const FrameMapData *d = reinterpret_cast<const FrameMapData *>(getFusableInstanceData(node, frameMapGetFrame))) {
+        return frameMapRemap(d, list);
+    }
 
-    int num_freeze = vsapi->mapNumElements(in, "first");
-    if (num_freeze != vsapi->mapNumElements(in, "last") || num_freeze != vsapi->mapNumElements(in, "replacement"))
-        RETERROR("FreezeFrames: 'first', 'last', and 'replacement' must have the same length.");
+    return false;
+}
 
-    d->node = vsapi->mapGetNode(in, "clip", 0, 0);
-    const VSVideoInfo *vi = vsapi->getVideoInfo(d->node);
+// Looks through the inputs of list and creates a single node that takes the frames straight from
+// their sources if any of them can be folded in, returns false when nothing would be gained
+static bool createRemap(const char *name, const VSVideoInfo &vi, const RemapList &list, VSMap *out, VSCore *core, const VSAPI *vsapi) {
+    std::vector<RemapList> inputs(list.sources.size());
+    bool folded = false;
 
-    d->freeze.resize(num_freeze);
+    for (size_t i = 0; i < list.sources.size(); i++) {
+        if (describeRemap(list.sources[i], inputs[i], vsapi)) {
+            folded = true;
+        } else {
+            inputs[i] = RemapList();
+            inputs[i].append(inputs[i].addSource(list.sources[i]), 0, vsapi->getVideoInfo(list.sources[i])->numFrames);
+        }
+    }
 
-    for (int i = 0; i < num_freeze; i++) {
-        d->freeze[i].first = vsapi->mapGetIntSaturated(in, "first", i, 0);
-        d->freeze[i].last = vsapi->mapGetIntSaturated(in, "last", i, 0);
-        d->freeze[i].replacement = vsapi->mapGetIntSaturated(in, "replacement", i, 0);
-
-        if (d->freeze[i].first > d->freeze[i].last) {
-            int tmp = d->freeze[i].first;
-            d->freeze[i].first = d->freeze[i].last;
-            d->freeze[i].last = tmp;
+    if (!folded)
+        return false;
+
+    RemapList result;
+    for (const RemapSegment &seg : list.segments) {
+        const RemapList &input = inputs[seg.source];
+
+        // out of range requests are clamped by the core so only exact runs are composed
+        int last = seg.frame + (seg.length - 1) * seg.step;
+        if (std::min(seg.frame, last) < 0 || std::max(seg.frame, last) >= input.numFrames)
+            return false;
+
+        int k = 0;
+        while (k < seg.length) {
+            int pos = seg.frame + k * seg.step;
+            const RemapSegment &inner = input.find(pos);
+            int count;
+            if (seg.step > 0)
+                count = (inner.start + inner.length - 1 - pos) / seg.step + 1;
+            else if (seg.step < 0)
+                count = (pos - inner.start) / -seg.step + 1;
+            else
+                count = seg.length - k;
+            count = std::min(count, seg.length - k);
+
+            int source = result.addSource(input.sources[inner.source]);
+            if (!result.append(source, inner.frame + (pos - inner.start) * inner.step, count, (count > 1) ? seg.step * inner.step : 1))
+                return false;
+            k += count;
         }
+    }
 
-        if (d->freeze[i].first < 0 || (vi->numFrames && d->freeze[i].last >= vi->numFrames) ||
-            d->freeze[i].replacement < 0 || (vi->numFrames && d->freeze[i].replacement >= vi->numFrames))
-            RETERROR("FreezeFrames: out of bounds frame number(s)");
+    // everything cancelled out
+    if (result.sources.size() == 1 && result.segments.size() == 1 && result.segments[0].frame == 0 && result.segments[0].step == 1 &&
+        isSameVideoInfo(&vi, vsapi->getVideoInfo(result.sources[0]))) {
+        vsapi->mapSetNode(out, "clip", result.sources[0], maReplace);
+        return true;
     }
 
-    std::sort(d->freeze.begin(), d->freeze.end());
+    // a source's frames only get reused when runs overlap or repeat a frame
+    std::vector<std::vector<std::pair<int, int>>> ranges(result.sources.size());
+    std::vector<bool> reused(result.sources.size());
+    for (const RemapSegment &seg : result.segments) {
+        int last = seg.frame + (seg.length - 1) * seg.step;
+        ranges[seg.source].push_back({ std::min(seg.frame, last), std::max(seg.frame, last) });
+        if (seg.step == 0 && seg.length > 1)
+            reused[seg.source] = true;
+    }
 
-    for (int i = 0; i < num_freeze - 1; i++)
-        if (d->freeze[i].last >= d->freeze[i + 1].first)
-            RETERROR("FreezeFrames: the frame ranges must not overlap");
+    std::unique_ptr<RemapData> d(new RemapData(vsapi));
+    std::vector<VSFilterDependency> deps;
+    for (size_t i = 0; i < result.sources.size(); i++) {
+        std::sort(ranges[i].begin(), ranges[i].end());
+        for (size_t j = 1; j < ranges[i].size(); j++) {
+            if (ranges[i][j].first <= ranges[i][j - 1].second)
+                reused[i] = true;
+        }
 
-    VSFilterDependency deps[] = {{d->node, rpGeneral}};
-    vsapi->createVideoFilter(out, "FreezeFrames", vi, freezeFramesGetFrame, filterFree<FreezeFramesData>, fmParallel, deps, 1, d.release(), core);
+        d->nodes.push_back(vsapi->addNodeRef(result.sources[i]));
+        deps.push_back({ d->nodes[i], reused[i] ? rpGeneral : rpNoFrameReuse });
+    }
+    d->segments = std::move(result.segments);
+
+    vsapi->createVideoFilter(out, name, &vi, remapGetframe, filterFree<RemapData>, fmParallel, deps.data(), static_cast<int>(deps.size()), d.get(), core);
+    d.release();
+    return true;
 }
 
 //////////////////////////////////////////
@@ -707,4 +963,7 @@ void reorderInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->registerFunction("DuplicateFrames", "clip:vnode;frames:int[];", "clip:vnode;", duplicateFramesCreate, 0, plugin);
     vspapi->registerFunction("DeleteFrames", "clip:vnode;frames:int[];", "clip:vnode;", deleteFramesCreate, 0, plugin);
     vspapi->registerFunction("FreezeFrames", "clip:vnode;first:int[];last:int[];replacement:int[];", "clip:vnode;", freezeFramesCreate, 0, plugin);
+
+    for (const char *name : { "Trim", "Reverse", "Loop", "Interleave", "SelectEvery", "Splice", "DuplicateFrames", "DeleteFrames", "FreezeFrames" })
+        vspapi->setFunctionFlags(name, pffProxyScalable, plugin);
 }
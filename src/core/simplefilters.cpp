@@ -23,16 +23,24 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <algorithm>
+#include <locale>
+#include <sstream>
 #include "VSHelper4.h"
 #include "VSConstants4.h"
 #include "cpufeatures.h"
 #include "internalfilters.h"
 #include "filtershared.h"
+#include "kernel/copy.h"
 #include "kernel/cpulevel.h"
+#include "kernel/downscale.h"
+#include "kernel/fill.h"
 #include "kernel/planestats.h"
 #include "kernel/transpose.h"
+#include "../common/xxhash64.h"
 #include "VapourSynth3.h" // only used for old colorfamily constant conversion in ShufflePlanes
 
 using namespace vsh;
@@ -190,7 +198,13 @@ static const VSFrame *VS_CC cropGetframe(int n, int activationReason, void *inst
     CropData *d = reinterpret_cast<CropData *>(instanceData);
 
     if (activationReason == arInitial) {
-        vsapi->requestFrameFilter(n, d->node, frameCtx);
+        int left, top, width, height;
+        if (vsapi->isPropsOnlyRequest(frameCtx))
+            vsapi->requestFramePropsFilter(n, d->node, frameCtx);
+        else if (vsapi->getRequestedRegion(frameCtx, &left, &top, &width, &height))
+            vsapi->requestFrameRegionFilter(n, d->node, left + d->x, top + d->y, width, height, frameCtx);
+        else
+            vsapi->requestFrameFilter(n, d->node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         char msg[150];
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
@@ -204,16 +218,21 @@ static const VSFrame *VS_CC cropGetframe(int n, int activationReason, void *inst
             return nullptr;
         }
 
-        VSFrame *dst = vsapi->newVideoFrame(fi, d->width, d->height, src, core);
+        // the cropped frame shares the source planes when that keeps its rows aligned and its strides compact
+        VSFrame *dst = newVideoFrameView(src, d->x, d->y, d->width, d->height);
 
-        for (int plane = 0; plane < fi->numPlanes; plane++) {
-            ptrdiff_t srcstride = vsapi->getStride(src, plane);
-            ptrdiff_t dststride = vsapi->getStride(dst, plane);
-            const uint8_t *srcdata = vsapi->getReadPtr(src, plane);
-            uint8_t *dstdata = vsapi->getWritePtr(dst, plane);
-            srcdata += srcstride * (d->y >> (plane ? fi->subSamplingH : 0));
-            srcdata += (d->x >> (plane ? fi->subSamplingW : 0)) * fi->bytesPerSample;
-            bitblt(dstdata, dststride, srcdata, srcstride, (d->width >> (plane ? fi->subSamplingW : 0)) * fi->bytesPerSample, vsapi->getFrameHeight(dst, plane));
+        if (!dst) {
+            dst = vsapi->newVideoFrame(fi, d->width, d->height, src, core);
+
+            for (int plane = 0; plane < fi->numPlanes; plane++) {
+                ptrdiff_t srcstride = vsapi->getStride(src, plane);
+                ptrdiff_t dststride = vsapi->getStride(dst, plane);
+                const uint8_t *srcdata = vsapi->getReadPtr(src, plane);
+                uint8_t *dstdata = vsapi->getWritePtr(dst, plane);
+                srcdata += srcstride * (d->y >> (plane ? fi->subSamplingH : 0));
+                srcdata += (d->x >> (plane ? fi->subSamplingW : 0)) * fi->bytesPerSample;
+                bitblt(dstdata, dststride, srcdata, srcstride, (d->width >> (plane ? fi->subSamplingW : 0)) * fi->bytesPerSample, vsapi->getFrameHeight(dst, plane));
+            }
         }
 
         vsapi->freeFrame(src);
@@ -232,6 +251,11 @@ static const VSFrame *VS_CC cropGetframe(int n, int activationReason, void *inst
     return nullptr;
 }
 
+// Sizes are given for the full size clip, a reduced proxy clip gets them reduced to whole chroma samples
+static int proxyScaleSize(int value, int scale, int subSampling) {
+    return (scale > 1) ? (value / scale) >> subSampling << subSampling : value;
+}
+
 static void VS_CC cropAbsCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<CropData> d(new CropData(vsapi));
     char msg[150];
@@ -250,6 +274,14 @@ static void VS_CC cropAbsCreate(const VSMap *in, VSMap *out, void *userData, VSC
 
     d->vi = vsapi->getVideoInfo(d->node);
 
+    int proxyScale = vsapi->getNodeProxyScale(d->node);
+    if (proxyScale > 1) {
+        d->x = proxyScaleSize(d->x, proxyScale, d->vi->format.subSamplingW);
+        d->y = proxyScaleSize(d->y, proxyScale, d->vi->format.subSamplingH);
+        d->width = std::min(proxyScaleSize(d->width, proxyScale, d->vi->format.subSamplingW), d->vi->width - d->x);
+        d->height = std::min(proxyScaleSize(d->height, proxyScale, d->vi->format.subSamplingH), d->vi->height - d->y);
+    }
+
     if (cropVerify(d->x, d->y, d->width, d->height, d->vi->width, d->vi->height, &d->vi->format, msg, sizeof(msg)))
         RETERROR(msg);
 
@@ -272,11 +304,15 @@ static void VS_CC cropRelCreate(const VSMap *in, VSMap *out, void *userData, VSC
     if (!isConstantVideoFormat(d->vi))
         RETERROR("Crop: constant format and dimensions needed");
 
-    d->x = vsapi->mapGetIntSaturated(in, "left", 0, &err);
-    d->y = vsapi->mapGetIntSaturated(in, "top", 0, &err);
+    int proxyScale = vsapi->getNodeProxyScale(d->node);
+    int ssw = d->vi->format.subSamplingW;
+    int ssh = d->vi->format.subSamplingH;
 
-    d->height = d->vi->height - d->y - vsapi->mapGetIntSaturated(in, "bottom", 0, &err);
-    d->width = d->vi->width - d->x - vsapi->mapGetIntSaturated(in, "right", 0, &err);
+    d->x = proxyScaleSize(vsapi->mapGetIntSaturated(in, "left", 0, &err), proxyScale, ssw);
+    d->y = proxyScaleSize(vsapi->mapGetIntSaturated(in, "top", 0, &err), proxyScale, ssh);
+
+    d->height = d->vi->height - d->y - proxyScaleSize(vsapi->mapGetIntSaturated(in, "bottom", 0, &err), proxyScale, ssh);
+    d->width = d->vi->width - d->x - proxyScaleSize(vsapi->mapGetIntSaturated(in, "right", 0, &err), proxyScale, ssw);
 
     // passthrough for the no cropping case
     if (d->x == 0 && d->y == 0 && d->width == d->vi->width && d->height == d->vi->height) {
@@ -295,6 +331,19 @@ static void VS_CC cropRelCreate(const VSMap *in, VSMap *out, void *userData, VSC
     vsapi->createVideoFilter(out, "Crop", &vi, cropGetframe, filterFree<CropData>, fmParallel, deps, 1, d.release(), core);
 }
 
+bool getCropWindow(VSNode *node, VSNode **source, int *left, int *top, int *width, int *height) {
+    const CropData *d = reinterpret_cast<const CropData *>(getFusableInstanceData(node, cropGetframe));
+    if (!d)
+        return false;
+
+    *source = d->node;
+    *left = d->x;
+    *top = d->y;
+    *width = d->width;
+    *height = d->height;
+    return true;
+}
+
 //////////////////////////////////////////
 // AddBorders
 
@@ -333,21 +382,37 @@ static const VSFrame *VS_CC addBordersGetframe(int n, int activationReason, void
     char msg[150];
 
     if (activationReason == arInitial) {
-        vsapi->requestFrameFilter(n, d->node, frameCtx);
+        const VSVideoInfo *vi = vsapi->getVideoInfo(d->node);
+
+        // with a known size the source can be rendered straight into the middle of the output
+        if (isConstantVideoFormat(vi)) {
+            VSFrame *dst = vsapi->newVideoFrame(&vi->format, vi->width + d->left + d->right, vi->height + d->top + d->bottom, nullptr, core);
+            requestFrameFilterInto(n, d->node, frameCtx, dst, d->left, d->top, true);
+            *frameData = dst;
+        } else {
+            vsapi->requestFrameFilter(n, d->node, frameCtx);
+        }
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
         const VSVideoFormat *fi = vsapi->getVideoFrameFormat(src);
-        VSFrame *dst;
+        VSFrame *dst = reinterpret_cast<VSFrame *>(*frameData);
+        *frameData = nullptr;
 
         if (addBordersVerify(d->left, d->right, d->top, d->bottom, fi, msg, sizeof(msg))) {
             vsapi->freeFrame(src);
+            vsapi->freeFrame(dst);
             vsapi->setFilterError(msg, frameCtx);
             return nullptr;
         }
 
-        dst = vsapi->newVideoFrame(fi, vsapi->getFrameWidth(src, 0) + d->left + d->right, vsapi->getFrameHeight(src, 0) + d->top + d->bottom, src, core);
+        if (dst) {
+            vsapi->copyMap(vsapi->getFramePropertiesRO(src), vsapi->getFramePropertiesRW(dst));
+        } else {
+            dst = vsapi->newVideoFrame(fi, vsapi->getFrameWidth(src, 0) + d->left + d->right, vsapi->getFrameHeight(src, 0) + d->top + d->bottom, src, core);
+        }
 
         int bytesPerSample = fi->bytesPerSample;
+        int cpulevel = vs_get_cpulevel(core);
 
         // now that argument validation is over we can spend the next few lines actually adding borders
         for (int plane = 0; plane < fi->numPlanes; plane++) {
@@ -362,54 +427,20 @@ static const VSFrame *VS_CC addBordersGetframe(int n, int activationReason, void
             int padl = (d->left >> (plane ? fi->subSamplingW : 0)) * bytesPerSample;
             int padr = (d->right >> (plane ? fi->subSamplingW : 0)) * bytesPerSample;
             uint32_t color = d->color[plane];
+            bool placed = (srcdata == dstdata + padt * dststride + padl);
 
-            switch (bytesPerSample) {
-            case 1:
-                vs_memset<uint8_t>(dstdata, color, padt * dststride);
-                break;
-            case 2:
-                vs_memset<uint16_t>(dstdata, color, padt * dststride / 2);
-                break;
-            case 4:
-                vs_memset<uint32_t>(dstdata, color, padt * dststride / 4);
-                break;
-            }
+            // the top and bottom borders include the stride padding so they can be filled as one run
+            vs_fill_plane(dstdata, dststride, color, bytesPerSample, dststride / bytesPerSample, padt, cpulevel);
             dstdata += padt * dststride;
 
-            for (int hloop = 0; hloop < srcheight; hloop++) {
-                switch (bytesPerSample) {
-                case 1:
-                    vs_memset<uint8_t>(dstdata, color, padl);
-                    memcpy(dstdata + padl, srcdata, rowsize);
-                    vs_memset<uint8_t>(dstdata + padl + rowsize, color, padr);
-                    break;
-                case 2:
-                    vs_memset<uint16_t>(dstdata, color, padl / 2);
-                    memcpy(dstdata + padl, srcdata, rowsize);
-                    vs_memset<uint16_t>(dstdata + padl + rowsize, color, padr / 2);
-                    break;
-                case 4:
-                    vs_memset<uint32_t>(dstdata, color, padl / 4);
-                    memcpy(dstdata + padl, srcdata, rowsize);
-                    vs_memset<uint32_t>(dstdata + padl + rowsize, color, padr / 4);
-                    break;
-                }
+            if (!placed)
+                vs_copy_plane(dstdata + padl, dststride, srcdata, srcstride, rowsize, srcheight, 0, cpulevel);
 
-                dstdata += dststride;
-                srcdata += srcstride;
-            }
+            vs_fill_plane(dstdata, dststride, color, bytesPerSample, padl / bytesPerSample, srcheight, cpulevel);
+            vs_fill_plane(dstdata + padl + rowsize, dststride, color, bytesPerSample, padr / bytesPerSample, srcheight, cpulevel);
+            dstdata += srcheight * dststride;
 
-            switch (bytesPerSample) {
-            case 1:
-                vs_memset<uint8_t>(dstdata, color, padb * dststride);
-                break;
-            case 2:
-                vs_memset<uint16_t>(dstdata, color, padb * dststride / 2);
-                break;
-            case 4:
-                vs_memset<uint32_t>(dstdata, color, padb * dststride / 4);
-                break;
-            }
+            vs_fill_plane(dstdata, dststride, color, bytesPerSample, dststride / bytesPerSample, padb, cpulevel);
         }
 
         vsapi->freeFrame(src);
@@ -423,6 +454,8 @@ static const VSFrame *VS_CC addBordersGetframe(int n, int activationReason, void
         }
 
         return dst;
+    } else if (activationReason == arError) {
+        vsapi->freeFrame(reinterpret_cast<VSFrame *>(*frameData));
     }
 
     return nullptr;
@@ -453,6 +486,14 @@ static void VS_CC addBordersCreate(const VSMap *in, VSMap *out, void *userData,
     if (vi.format.colorFamily == cfUndefined)
         RETERROR("AddBorders: input needs to be constant format");
 
+    int proxyScale = vsapi->getNodeProxyScale(d->node);
+    if (proxyScale > 1) {
+        d->left = proxyScaleSize(d->left, proxyScale, vi.format.subSamplingW);
+        d->right = proxyScaleSize(d->right, proxyScale, vi.format.subSamplingW);
+        d->top = proxyScaleSize(d->top, proxyScale, vi.format.subSamplingH);
+        d->bottom = proxyScaleSize(d->bottom, proxyScale, vi.format.subSamplingH);
+    }
+
     if (addBordersVerify(d->left, d->right, d->top, d->bottom, &vi.format, msg, sizeof(msg)))
         RETERROR(msg);
 
@@ -1057,12 +1098,25 @@ static const VSFrame *VS_CC stackGetframe(int n, int activationReason, void *ins
     StackData *d = reinterpret_cast<StackData *>(instanceData);
 
     if (activationReason == arInitial) {
-        for (auto iter: d->nodes)
-            vsapi->requestFrameFilter(n, iter, frameCtx);
+        // inputs that have to be produced are rendered straight into their place in the output
+        VSFrame *dst = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, nullptr, core);
+        int offset = 0;
+
+        for (auto iter : d->nodes) {
+            const VSVideoInfo *vi = vsapi->getVideoInfo(iter);
+            requestFrameFilterInto(n, iter, frameCtx, dst, d->vertical ? 0 : offset, d->vertical ? offset : 0, false);
+            offset += d->vertical ? vi->height : vi->width;
+        }
+
+        *frameData = dst;
     } else if (activationReason == arAllFramesReady) {
+        VSFrame *dst = reinterpret_cast<VSFrame *>(*frameData);
+        *frameData = nullptr;
+
         const VSFrame *src = vsapi->getFrameFilter(n, d->nodes[0], frameCtx);
-        VSFrame *dst = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, src, core);
+        vsapi->copyMap(vsapi->getFramePropertiesRO(src), vsapi->getFramePropertiesRW(dst));
         vsapi->freeFrame(src);
+        int cpulevel = vs_get_cpulevel(core);
 
         for (int plane = 0; plane < d->vi.format.numPlanes; plane++) {
             uint8_t *dstp = vsapi->getWritePtr(dst, plane);
@@ -1071,27 +1125,26 @@ static const VSFrame *VS_CC stackGetframe(int n, int activationReason, void *ins
             for (auto iter : d->nodes) {
                 src = vsapi->getFrameFilter(n, iter, frameCtx);
 
-                if (d->vertical) {
-                    const uint8_t *srcp = vsapi->getReadPtr(src, plane);
-                    size_t size = dst_stride * vsapi->getFrameHeight(src, plane);
-                    memcpy(dstp, srcp, size);
-                    dstp += size;
-                } else {
-                    const uint8_t *srcp = vsapi->getReadPtr(src, plane);
-                    ptrdiff_t src_stride = vsapi->getStride(src, plane);
-                    size_t rowsize = vsapi->getFrameWidth(src, plane) * d->vi.format.bytesPerSample;
-                    bitblt(dstp, dst_stride,
-                        srcp, src_stride,
-                        rowsize,
-                        vsapi->getFrameHeight(src, plane));
+                const uint8_t *srcp = vsapi->getReadPtr(src, plane);
+                ptrdiff_t src_stride = vsapi->getStride(src, plane);
+                size_t rowsize = vsapi->getFrameWidth(src, plane) * d->vi.format.bytesPerSample;
+                int height = vsapi->getFrameHeight(src, plane);
+
+                if (srcp != dstp)
+                    vs_copy_plane(dstp, dst_stride, srcp, src_stride, rowsize, height, 0, cpulevel);
+
+                if (d->vertical)
+                    dstp += dst_stride * height;
+                else
                     dstp += rowsize;
-                }
 
                 vsapi->freeFrame(src);
             }
         }
 
         return dst;
+    } else if (activationReason == arError) {
+        vsapi->freeFrame(reinterpret_cast<VSFrame *>(*frameData));
     }
 
     return nullptr;
@@ -1146,48 +1199,40 @@ static void VS_CC stackCreate(const VSMap *in, VSMap *out, void *userData, VSCor
 
 typedef struct {
     VSFrame *f;
+    std::once_flag once;
     VSVideoInfo vi;
     uint32_t color[3];
     bool keep;
 } BlankClipData;
 
+static VSFrame *blankClipNewFrame(const BlankClipData *d, VSCore *core, const VSAPI *vsapi) {
+    VSFrame *frame = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, 0, core);
+    int cpulevel = vs_get_cpulevel(core);
+
+    for (int plane = 0; plane < d->vi.format.numPlanes; plane++) {
+        // only the visible samples, the padding may belong to a neighbouring window when rendering in place
+        vs_fill_plane(vsapi->getWritePtr(frame, plane), vsapi->getStride(frame, plane), d->color[plane], d->vi.format.bytesPerSample, vsapi->getFrameWidth(frame, plane), vsapi->getFrameHeight(frame, plane), cpulevel);
+    }
+
+    if (d->vi.fpsNum > 0) {
+        VSMap *frameProps = vsapi->getFramePropertiesRW(frame);
+        vsapi->mapSetInt(frameProps, "_DurationNum", d->vi.fpsDen, maReplace);
+        vsapi->mapSetInt(frameProps, "_DurationDen", d->vi.fpsNum, maReplace);
+    }
+
+    return frame;
+}
+
 static const VSFrame *VS_CC blankClipGetframe(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     BlankClipData *d = reinterpret_cast<BlankClipData *>(instanceData);
 
     if (activationReason == arInitial) {
-        VSFrame *frame = nullptr;
-        if (!d->f) {
-            frame = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, 0, core);
-            int bytesPerSample = d->vi.format.bytesPerSample;
-
-            for (int plane = 0; plane < d->vi.format.numPlanes; plane++) {
-                switch (bytesPerSample) {
-                case 1:
-                    vs_memset<uint8_t>(vsapi->getWritePtr(frame, plane), d->color[plane], vsapi->getStride(frame, plane) * vsapi->getFrameHeight(frame, plane));
-                    break;
-                case 2:
-                    vs_memset<uint16_t>(vsapi->getWritePtr(frame, plane), d->color[plane], (vsapi->getStride(frame, plane) * vsapi->getFrameHeight(frame, plane)) / 2);
-                    break;
-                case 4:
-                    vs_memset<uint32_t>(vsapi->getWritePtr(frame, plane), d->color[plane], (vsapi->getStride(frame, plane) * vsapi->getFrameHeight(frame, plane)) / 4);
-                    break;
-                }
-            }
+        if (!d->keep)
+            return blankClipNewFrame(d, core, vsapi);
 
-            if (d->vi.fpsNum > 0) {
-                VSMap *frameProps = vsapi->getFramePropertiesRW(frame);
-                vsapi->mapSetInt(frameProps, "_DurationNum", d->vi.fpsDen, maReplace);
-                vsapi->mapSetInt(frameProps, "_DurationDen", d->vi.fpsNum, maReplace);
-            }
-        }
-
-        if (d->keep) {
-            if (frame)
-                d->f = frame;
-            return vsapi->addFrameRef(d->f);
-        } else {
-            return frame;
-        }
+        // the frame is never written to after this so every request can share it without a lock
+        std::call_once(d->once, [&]() { d->f = blankClipNewFrame(d, core, vsapi); });
+        return vsapi->addFrameRef(d->f);
     }
 
     return nullptr;
@@ -1314,11 +1359,27 @@ static void VS_CC blankClipCreate(const VSMap *in, VSMap *out, void *userData, V
 
     d->keep = !!vsapi->mapGetInt(in, "keep", 0, &err);
 
-    vsapi->createVideoFilter(out, "BlankClip", &d->vi, blankClipGetframe, blankClipFree, d->keep ? fmUnordered : fmParallel, nullptr, 0, d.get(), core);
+    VSNode *blank = vsapi->createVideoFilter2("BlankClip", &d->vi, blankClipGetframe, blankClipFree, fmParallel, nullptr, 0, d.get(), core);
+    // the kept frame is shared by every request so it must never be a window of another frame
+    if (!d->keep)
+        setNodeRendersInPlace(blank);
+    vsapi->mapConsumeNode(out, "clip", blank, maAppend);
     d.release();
 }
 
 
+//////////////////////////////////////////
+// Shared by the filters that only modify frame properties or clip metadata
+
+static void markPassthrough(VSMap *out, const VSAPI *vsapi) {
+    int err;
+    VSNode *node = vsapi->mapGetNode(out, "clip", 0, &err);
+    if (node) {
+        setCachePassthrough(node);
+        vsapi->freeNode(node);
+    }
+}
+
 //////////////////////////////////////////
 // AssumeFPS
 
@@ -1385,20 +1446,331 @@ static void VS_CC assumeFPSCreate(const VSMap *in, VSMap *out, void *userData, V
 
     VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
     vsapi->createVideoFilter(out, "AssumeFPS", &d->vi, assumeFPSGetframe, filterFree<AssumeFPSData>, fmParallel, deps, 1, d.get(), core);
+    setPassThroughHints(out, vsapi);
     d.release();
+    markPassthrough(out, vsapi);
+}
+
+//////////////////////////////////////////
+// Selection programs
+
+// A small RPN program over the frame number and the properties of the source frames. FrameEval and ModifyFrame
+// can use one instead of a script function so picking a clip never has to leave the core.
+
+namespace {
+
+enum class SelectOpType {
+    Constant, FrameNumber, Prop, Add, Sub, Mul, Div, Abs, Round, Max, Min,
+    LT, GT, EQ, GE, LE, And, Or, Xor, Not, Ternary, Dup, Swap
+};
+
+struct SelectOp {
+    SelectOpType type;
+    double value;
+    int src;
+    const VSMapKey *key;
+};
+
+class SelectProgram {
+    std::vector<SelectOp> ops;
+    std::vector<std::string> propNames; // same order as the Prop ops, only used for error messages
+    size_t maxStack = 0;
+public:
+    void parse(const std::string &expr, int numSrcs, const VSAPI *vsapi);
+    bool empty() const { return ops.empty(); }
+    bool evaluate(int n, const VSFrame * const *frames, double &result, std::string &error, const VSAPI *vsapi) const;
+};
+
+} // namespace
+
+void SelectProgram::parse(const std::string &expr, int numSrcs, const VSAPI *vsapi) {
+    static const std::pair<const char *, SelectOpType> simple[] = {
+        { "+", SelectOpType::Add }, { "-", SelectOpType::Sub }, { "*", SelectOpType::Mul }, { "/", SelectOpType::Div },
+        { "abs", SelectOpType::Abs }, { "round", SelectOpType::Round }, { "max", SelectOpType::Max }, { "min", SelectOpType::Min },
+        { "<", SelectOpType::LT }, { ">", SelectOpType::GT }, { "=", SelectOpType::EQ }, { ">=", SelectOpType::GE }, { "<=", SelectOpType::LE },
+        { "and", SelectOpType::And }, { "or", SelectOpType::Or }, { "xor", SelectOpType::Xor }, { "not", SelectOpType::Not },
+        { "?", SelectOpType::Ternary }, { "dup", SelectOpType::Dup }, { "swap", SelectOpType::Swap }, { "N", SelectOpType::FrameNumber }
+    };
+
+    size_t depth = 0;
+    std::istringstream tokens(expr);
+    tokens.imbue(std::locale::classic());
+    std::string token;
+
+    while (tokens >> token) {
+        SelectOp op = { SelectOpType::Constant, 0, 0, nullptr };
+        auto it = std::find_if(std::begin(simple), std::end(simple), [&token](const std::pair<const char *, SelectOpType> &v) { return token == v.first; });
+
+        if (it != std::end(simple)) {
+            op.type = it->second;
+        } else if (token.size() > 2 && token[0] >= 'a' && token[0] <= 'z' && token[1] == '.') {
+            op.type = SelectOpType::Prop;
+            op.src = token[0] >= 'x' ? token[0] - 'x' : token[0] - 'a' + 3;
+            if (op.src >= numSrcs)
+                throw std::runtime_error("reference to undefined clip: " + token);
+            op.key = vsapi->getMapKey(token.c_str() + 2);
+            if (!op.key)
+                throw std::runtime_error("invalid property name: " + token);
+            propNames.push_back(token.substr(2));
+        } else {
+            std::istringstream numStream(token);
+            numStream.imbue(std::locale::classic());
+            std::string rest;
+            if (!(numStream >> op.value) || (numStream >> rest))
+                throw std::runtime_error("illegal token: " + token);
+        }
+
+        size_t operands;
+        size_t results = 1;
+        switch (op.type) {
+        case SelectOpType::Constant: case SelectOpType::FrameNumber: case SelectOpType::Prop: operands = 0; break;
+        case SelectOpType::Abs: case SelectOpType::Round: case SelectOpType::Not: operands = 1; break;
+        case SelectOpType::Ternary: operands = 3; break;
+        case SelectOpType::Dup: operands = 1; results = 2; break;
+        case SelectOpType::Swap: operands = 2; results = 2; break;
+        default: operands = 2; break;
+        }
+
+        if (depth < operands)
+            throw std::runtime_error("insufficient values on stack: " + token);
+        depth = depth - operands + results;
+        maxStack = std::max(maxStack, depth);
+        ops.push_back(op);
+    }
+
+    if (ops.empty())
+        throw std::runtime_error("empty expression");
+    if (depth != 1)
+        throw std::runtime_error("unconsumed values on stack");
+}
+
+bool SelectProgram::evaluate(int n, const VSFrame * const *frames, double &result, std::string &error, const VSAPI *vsapi) const {
+    std::vector<double> stack;
+    stack.reserve(maxStack);
+    size_t prop = 0;
+
+    for (const auto &op : ops) {
+        double a, b, c;
+        switch (op.type) {
+        case SelectOpType::Constant:
+            stack.push_back(op.value);
+            continue;
+        case SelectOpType::FrameNumber:
+            stack.push_back(n);
+            continue;
+        case SelectOpType::Prop: {
+            const VSMap *props = vsapi->getFramePropertiesRO(frames[op.src]);
+            int err;
+            double v = static_cast<double>(vsapi->mapGetIntKey(props, op.key, 0, &err));
+            if (err == peType)
+                v = vsapi->mapGetFloatKey(props, op.key, 0, &err);
+            if (err) {
+                error = "frame property '" + propNames[prop] + "' is missing or not a number at frame " + std::to_string(n);
+                return false;
+            }
+            stack.push_back(v);
+            prop++;
+            continue;
+        }
+        case SelectOpType::Dup:
+            stack.push_back(stack.back());
+            continue;
+        case SelectOpType::Swap:
+            std::swap(stack[stack.size() - 1], stack[stack.size() - 2]);
+            continue;
+        case SelectOpType::Abs:
+            stack.back() = std::fabs(stack.back());
+            continue;
+        case SelectOpType::Round:
+            stack.back() = std::round(stack.back());
+            continue;
+        case SelectOpType::Not:
+            stack.back() = (stack.back() > 0) ? 0 : 1;
+            continue;
+        case SelectOpType::Ternary:
+            c = stack.back();
+            stack.pop_back();
+            b = stack.back();
+            stack.pop_back();
+            stack.back() = (stack.back() > 0) ? b : c;
+            continue;
+        default:
+            break;
+        }
+
+        b = stack.back();
+        stack.pop_back();
+        a = stack.back();
+        switch (op.type) {
+        case SelectOpType::Add: a = a + b; break;
+        case SelectOpType::Sub: a = a - b; break;
+        case SelectOpType::Mul: a = a * b; break;
+        case SelectOpType::Div: a = a / b; break;
+        case SelectOpType::Max: a = std::max(a, b); break;
+        case SelectOpType::Min: a = std::min(a, b); break;
+        case SelectOpType::LT: a = (a < b); break;
+        case SelectOpType::GT: a = (a > b); break;
+        case SelectOpType::EQ: a = (a == b); break;
+        case SelectOpType::GE: a = (a >= b); break;
+        case SelectOpType::LE: a = (a <= b); break;
+        case SelectOpType::And: a = (a > 0 && b > 0); break;
+        case SelectOpType::Or: a = (a > 0 || b > 0); break;
+        case SelectOpType::Xor: a = ((a > 0) != (b > 0)); break;
+        default: break;
+        }
+        stack.back() = a;
+    }
+
+    result = stack.back();
+    return true;
+}
+
+// Turns the program result into an index, out of range values pick the first or last clip
+static int selectIndex(double v, int numClips) {
+    if (!(v >= 0))
+        return 0;
+    return static_cast<int>(std::min<double>(std::floor(v), numClips - 1));
 }
 
 //////////////////////////////////////////
 // FrameEval
 
+// The maps a script function is called with, filters marked parallel give every call its own pair instead of sharing them
+struct ScriptCallMaps {
+    VSMap *in;
+    VSMap *out;
+    bool owned;
+    const VSAPI *vsapi;
+
+    ScriptCallMaps(VSMap *sharedIn, VSMap *sharedOut, bool parallel, const VSAPI *vsapi) : in(parallel ? vsapi->createMap() : sharedIn), out(parallel ? vsapi->createMap() : sharedOut), owned(parallel), vsapi(vsapi) {
+    }
+
+    ~ScriptCallMaps() {
+        if (owned) {
+            vsapi->freeMap(in);
+            vsapi->freeMap(out);
+        }
+    }
+};
+
+// The frames passed to a function made with createFrameCallFunction, on the stack for the usual handful of clips
+class FrameCallFrames {
+    const VSFrame *fixed[16];
+    std::vector<const VSFrame *> more;
+    const VSFrame **frames;
+    int count;
+    const VSAPI *vsapi;
+public:
+    FrameCallFrames(int n, const std::vector<VSNode *> &nodes, VSFrameContext *frameCtx, const VSAPI *vsapi) : count(static_cast<int>(nodes.size())), vsapi(vsapi) {
+        if (count > 16)
+            more.resize(count);
+        frames = (count > 16) ? more.data() : fixed;
+        for (int i = 0; i < count; i++)
+            frames[i] = vsapi->getFrameFilter(n, nodes[i], frameCtx);
+    }
+
+    ~FrameCallFrames() {
+        for (int i = 0; i < count; i++)
+            vsapi->freeFrame(frames[i]);
+    }
+
+    const VSFrame * const *data() const {
+        return frames;
+    }
+
+    int size() const {
+        return count;
+    }
+};
+
 typedef struct {
     VSVideoInfo vi;
     VSFunction *func;
+    bool parallel;
     std::vector<VSNode *> propsrc;
+    std::vector<VSNode *> clipsrc; // only kept when selecting with a table or program
+    std::vector<int> select;
+    SelectProgram program;
+    NodeReuseScope *reuse; // nullptr when every call gets new nodes
     VSMap *in;
     VSMap *out;
 } FrameEvalData;
 
+// Enough for the handful of graphs a function usually alternates between
+static const size_t frameEvalReuseEntries = 256;
+
+// The calls the function makes reuse the nodes of identical calls it made for earlier frames
+class FrameEvalReuse {
+    NodeReuseScope *previous;
+    bool entered;
+public:
+    explicit FrameEvalReuse(NodeReuseScope *scope) : previous(nullptr), entered(!!scope) {
+        if (entered)
+            previous = enterNodeReuseScope(scope);
+    }
+
+    ~FrameEvalReuse() {
+        if (entered)
+            enterNodeReuseScope(previous);
+    }
+};
+
+static const VSFrame *frameEvalCheckFrame(const FrameEvalData *d, const VSFrame *frame, VSFrameContext *frameCtx, const VSAPI *vsapi) {
+    if (d->vi.width || d->vi.height) {
+        if (d->vi.width != vsapi->getFrameWidth(frame, 0) || d->vi.height != vsapi->getFrameHeight(frame, 0)) {
+            vsapi->freeFrame(frame);
+            vsapi->setFilterError("FrameEval: Returned frame has wrong dimensions", frameCtx);
+            return nullptr;
+        }
+    }
+
+    if (d->vi.format.colorFamily != cfUndefined) {
+        if (!isSameVideoFormat(&d->vi.format, vsapi->getVideoFrameFormat(frame))) {
+            vsapi->freeFrame(frame);
+            vsapi->setFilterError("FrameEval: Returned frame has wrong format", frameCtx);
+            return nullptr;
+        }
+    }
+    return frame;
+}
+
+// Returns the node the function picked for frame n, native functions are called without any maps
+static VSNode *frameEvalCall(FrameEvalData *d, int n, const VSFrame * const *frames, int numFrames, VSFrameContext *frameCtx, const VSAPI *vsapi) {
+    FrameEvalReuse reuse(d->reuse);
+    VSFrameCallResult result;
+    if (vsapi->callFrameFunction(d->func, n, frames, numFrames, &result)) {
+        vsapi->freeFrame(result.frame);
+        if (result.error) {
+            vsapi->freeNode(result.node);
+            vsapi->setFilterError(result.error, frameCtx);
+            return nullptr;
+        } else if (!result.node) {
+            vsapi->setFilterError("FrameEval: Function didn't return a clip", frameCtx);
+        }
+        return result.node;
+    }
+
+    int err;
+    ScriptCallMaps maps(d->in, d->out, d->parallel, vsapi);
+    vsapi->mapSetInt(maps.in, "n", n, maAppend);
+    for (int i = 0; i < numFrames; i++)
+        vsapi->mapSetFrame(maps.in, "f", frames[i], maAppend);
+    vsapi->callFunction(d->func, maps.in, maps.out);
+    vsapi->clearMap(maps.in);
+    if (vsapi->mapGetError(maps.out)) {
+        vsapi->setFilterError(vsapi->mapGetError(maps.out), frameCtx);
+        vsapi->clearMap(maps.out);
+        return nullptr;
+    }
+
+    VSNode *node = vsapi->mapGetNode(maps.out, "val", 0, &err);
+    vsapi->clearMap(maps.out);
+
+    if (err)
+        vsapi->setFilterError("FrameEval: Function didn't return a clip", frameCtx);
+    return node;
+}
+
 static const VSFrame *VS_CC frameEvalGetFrameWithProps(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     FrameEvalData *d = reinterpret_cast<FrameEvalData *>(instanceData);
 
@@ -1406,54 +1778,19 @@ static const VSFrame *VS_CC frameEvalGetFrameWithProps(int n, int activationReas
         for (auto iter : d->propsrc)
             vsapi->requestFrameFilter(n, iter, frameCtx);
     } else if (activationReason == arAllFramesReady && !*frameData) {
-        int err;
-        vsapi->mapSetInt(d->in, "n", n, maAppend);
-        for (auto iter : d->propsrc) {
-            const VSFrame *f = vsapi->getFrameFilter(n, iter, frameCtx);
-            vsapi->mapSetFrame(d->in, "f", f, maAppend);
-            vsapi->freeFrame(f);
-        }
-        vsapi->callFunction(d->func, d->in, d->out);
-        vsapi->clearMap(d->in);
-        if (vsapi->mapGetError(d->out)) {
-            vsapi->setFilterError(vsapi->mapGetError(d->out), frameCtx);
-            vsapi->clearMap(d->out);
-            return nullptr;
-        }
-
-        VSNode *node = vsapi->mapGetNode(d->out, "val", 0, &err);
-        vsapi->clearMap(d->out);
-
-        if (err) {
-            vsapi->setFilterError("FrameEval: Function didn't return a clip", frameCtx);
+        FrameCallFrames frames(n, d->propsrc, frameCtx, vsapi);
+        VSNode *node = frameEvalCall(d, n, frames.data(), frames.size(), frameCtx, vsapi);
+        if (!node)
             return nullptr;
-        }
 
         frameData[0] = node;
 
         vsapi->requestFrameFilter(n, node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
-        const VSFrame *frame;
         VSNode *node = reinterpret_cast<VSNode *>(frameData[0]);
-        frame = vsapi->getFrameFilter(n, node, frameCtx);
+        const VSFrame *frame = vsapi->getFrameFilter(n, node, frameCtx);
         vsapi->freeNode(node);
-
-        if (d->vi.width || d->vi.height) {
-            if (d->vi.width != vsapi->getFrameWidth(frame, 0) || d->vi.height != vsapi->getFrameHeight(frame, 0)) {
-                vsapi->freeFrame(frame);
-                vsapi->setFilterError("FrameEval: Returned frame has wrong dimensions", frameCtx);
-                return nullptr;
-            }
-        }
-
-        if (d->vi.format.colorFamily != cfUndefined) {
-            if (!isSameVideoFormat(&d->vi.format, vsapi->getVideoFrameFormat(frame))) {
-                vsapi->freeFrame(frame);
-                vsapi->setFilterError("FrameEval: Returned frame has wrong format", frameCtx);
-                return nullptr;
-            }
-        }
-        return frame;
+        return frameEvalCheckFrame(d, frame, frameCtx, vsapi);
     } else if (activationReason == arError) {
         vsapi->freeNode(reinterpret_cast<VSNode *>(frameData[0]));
     }
@@ -1465,24 +1802,9 @@ static const VSFrame *VS_CC frameEvalGetFrameNoProps(int n, int activationReason
     FrameEvalData *d = reinterpret_cast<FrameEvalData *>(instanceData);
 
     if (activationReason == arInitial) {
-
-        int err;
-        vsapi->mapSetInt(d->in, "n", n, maAppend);
-        vsapi->callFunction(d->func, d->in, d->out);
-        vsapi->clearMap(d->in);
-        if (vsapi->mapGetError(d->out)) {
-            vsapi->setFilterError(vsapi->mapGetError(d->out), frameCtx);
-            vsapi->clearMap(d->out);
-            return nullptr;
-        }
-
-        VSNode *node = vsapi->mapGetNode(d->out, "val", 0, &err);
-        vsapi->clearMap(d->out);
-
-        if (err) {
-            vsapi->setFilterError("FrameEval: Function didn't return a clip", frameCtx);
+        VSNode *node = frameEvalCall(d, n, nullptr, 0, frameCtx, vsapi);
+        if (!node)
             return nullptr;
-        }
 
         frameData[0] = node;
 
@@ -1491,25 +1813,62 @@ static const VSFrame *VS_CC frameEvalGetFrameNoProps(int n, int activationReason
         VSNode *node = reinterpret_cast<VSNode *>(frameData[0]);
         const VSFrame *frame = vsapi->getFrameFilter(n, node, frameCtx);
         vsapi->freeNode(node);
+        return frameEvalCheckFrame(d, frame, frameCtx, vsapi);
+    } else if (activationReason == arError) {
+        vsapi->freeNode(reinterpret_cast<VSNode *>(frameData[0]));
+    }
 
-        if (d->vi.width || d->vi.height) {
-            if (d->vi.width != vsapi->getFrameWidth(frame, 0) || d->vi.height != vsapi->getFrameHeight(frame, 0)) {
-                vsapi->freeFrame(frame);
-                vsapi->setFilterError("FrameEval: Returned frame has wrong dimensions", frameCtx);
-                return nullptr;
-            }
+    return nullptr;
+}
+
+// Picks frames from clip_src with the select table or select_expr program, never calls back into a script
+static const VSFrame *VS_CC frameEvalGetFrameSelect(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    FrameEvalData *d = reinterpret_cast<FrameEvalData *>(instanceData);
+
+    if (activationReason == arInitial) {
+        if (!d->program.empty() && !d->propsrc.empty()) {
+            for (auto iter : d->propsrc)
+                vsapi->requestFrameFilter(n, iter, frameCtx);
+            return nullptr;
         }
 
-        if (d->vi.format.colorFamily != cfUndefined) {
-            if (!isSameVideoFormat(&d->vi.format, vsapi->getVideoFrameFormat(frame))) {
-                vsapi->freeFrame(frame);
-                vsapi->setFilterError("FrameEval: Returned frame has wrong format", frameCtx);
+        int index;
+        if (d->program.empty()) {
+            index = d->select[std::min<size_t>(n, d->select.size() - 1)];
+        } else {
+            double v;
+            std::string error;
+            if (!d->program.evaluate(n, nullptr, v, error, vsapi)) {
+                vsapi->setFilterError(("FrameEval: " + error).c_str(), frameCtx);
                 return nullptr;
             }
+            index = selectIndex(v, static_cast<int>(d->clipsrc.size()));
         }
-        return frame;
-    } else if (activationReason == arError) {
-        vsapi->freeNode(reinterpret_cast<VSNode *>(frameData[0]));
+
+        frameData[0] = d->clipsrc[index];
+        vsapi->requestFrameFilter(n, d->clipsrc[index], frameCtx);
+    } else if (activationReason == arAllFramesReady && !*frameData) {
+        std::vector<const VSFrame *> frames;
+        for (auto iter : d->propsrc)
+            frames.push_back(vsapi->getFrameFilter(n, iter, frameCtx));
+
+        double v;
+        std::string error;
+        bool success = d->program.evaluate(n, frames.data(), v, error, vsapi);
+        for (auto iter : frames)
+            vsapi->freeFrame(iter);
+
+        if (!success) {
+            vsapi->setFilterError(("FrameEval: " + error).c_str(), frameCtx);
+            return nullptr;
+        }
+
+        VSNode *node = d->clipsrc[selectIndex(v, static_cast<int>(d->clipsrc.size()))];
+        frameData[0] = node;
+        vsapi->requestFrameFilter(n, node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrame *frame = vsapi->getFrameFilter(n, reinterpret_cast<VSNode *>(frameData[0]), frameCtx);
+        return frameEvalCheckFrame(d, frame, frameCtx, vsapi);
     }
 
     return nullptr;
@@ -1519,18 +1878,32 @@ static void VS_CC frameEvalFree(void *instanceData, VSCore *core, const VSAPI *v
     FrameEvalData *d = reinterpret_cast<FrameEvalData *>(instanceData);
     for (auto iter : d->propsrc)
         vsapi->freeNode(iter);
+    for (auto iter : d->clipsrc)
+        vsapi->freeNode(iter);
     vsapi->freeFunction(d->func);
     vsapi->freeMap(d->in);
     vsapi->freeMap(d->out);
+    if (d->reuse)
+        freeNodeReuseScope(d->reuse);
     delete d;
 }
 
 static void VS_CC frameEvalCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<FrameEvalData> d(new FrameEvalData());
+    int err;
     VSNode *node = vsapi->mapGetNode(in, "clip", 0, 0);
     d->vi = *vsapi->getVideoInfo(node);
     vsapi->freeNode(node);
-    d->func = vsapi->mapGetFunction(in, "eval", 0, 0);
+    d->func = vsapi->mapGetFunction(in, "eval", 0, nullptr);
+    d->parallel = !!vsapi->mapGetInt(in, "parallel", 0, &err);
+    bool reuse = !!vsapi->mapGetInt(in, "reuse", 0, &err);
+
+    int numselect = vsapi->mapNumElements(in, "select");
+    const char *selectexpr = vsapi->mapGetData(in, "select_expr", 0, nullptr);
+    if (!!d->func + (numselect > 0) + !!selectexpr != 1) {
+        vsapi->freeFunction(d->func);
+        RETERROR("FrameEval: exactly one of eval, select and select_expr must be given");
+    }
 
     int numpropsrc = vsapi->mapNumElements(in, "prop_src");
     if (numpropsrc > 0) {
@@ -1547,15 +1920,56 @@ static void VS_CC frameEvalCreate(const VSMap *in, VSMap *out, void *userData, V
             clipsrc[i] = vsapi->mapGetNode(in, "clip_src", i, 0);
     }
 
+    auto freeNodes = [&] {
+        for (auto iter : d->propsrc)
+            vsapi->freeNode(iter);
+        for (auto iter : clipsrc)
+            vsapi->freeNode(iter);
+    };
+
+    if (!d->func) {
+        if (numclipsrc <= 0) {
+            freeNodes();
+            RETERROR("FrameEval: clip_src must be given when selecting with select or select_expr");
+        }
+
+        for (int i = 0; i < numselect; i++) {
+            int64_t v = vsapi->mapGetInt(in, "select", i, nullptr);
+            if (v < 0 || v >= numclipsrc) {
+                freeNodes();
+                RETERROR("FrameEval: select values must be valid clip_src indices");
+            }
+            d->select.push_back(static_cast<int>(v));
+        }
+
+        if (selectexpr) {
+            try {
+                d->program.parse(selectexpr, std::max(numpropsrc, 0), vsapi);
+            } catch (const std::runtime_error &e) {
+                freeNodes();
+                RETERROR((std::string("FrameEval: failed to parse select_expr: ") + e.what()).c_str());
+            }
+        }
+    }
+
     d->in = vsapi->createMap();
     d->out = vsapi->createMap();
+    d->reuse = (d->func && reuse) ? createNodeReuseScope(core, frameEvalReuseEntries) : nullptr;
 
     std::vector<VSFilterDependency> deps;
     for (int i = 0; i < numpropsrc; i++)
         deps.push_back({d->propsrc[i], rpGeneral}); // FIXME, propsrc could be strict spatial
     for (int i = 0; i < numclipsrc; i++)
         deps.push_back({clipsrc[i], rpGeneral});
-    vsapi->createVideoFilter(out, "FrameEval", &d->vi, (d->propsrc.size() > 0) ? frameEvalGetFrameWithProps : frameEvalGetFrameNoProps, frameEvalFree, (d->propsrc.size() > 0) ? fmParallelRequests : fmUnordered, deps.data(), deps.size(), d.get(), core);
+
+    if (!d->func) {
+        d->clipsrc = clipsrc;
+        clipsrc.clear();
+        vsapi->createVideoFilter(out, "FrameEval", &d->vi, frameEvalGetFrameSelect, frameEvalFree, fmParallel, deps.data(), deps.size(), d.get(), core);
+    } else {
+        int mode = d->parallel ? fmParallel : (d->propsrc.size() > 0) ? fmParallelRequests : fmUnordered;
+        vsapi->createVideoFilter(out, "FrameEval", &d->vi, (d->propsrc.size() > 0) ? frameEvalGetFrameWithProps : frameEvalGetFrameNoProps, frameEvalFree, mode, deps.data(), deps.size(), d.get(), core);
+    }
     d.release();
 
     for (auto &iter : clipsrc)
@@ -1569,6 +1983,8 @@ typedef struct {
     std::vector<VSNode *> node;
     const VSVideoInfo *vi;
     VSFunction *func;
+    bool parallel;
+    SelectProgram program; // passes one of the frames through instead of calling func
     VSMap *in;
     VSMap *out;
 } ModifyFrameData;
@@ -1581,30 +1997,62 @@ static const VSFrame *VS_CC modifyFrameGetFrame(int n, int activationReason, voi
             vsapi->requestFrameFilter(n, iter, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         int err;
+        const VSFrame *f;
+
+        if (!d->program.empty()) {
+            std::vector<const VSFrame *> frames;
+            for (auto iter : d->node)
+                frames.push_back(vsapi->getFrameFilter(n, iter, frameCtx));
+
+            double v;
+            std::string error;
+            bool success = d->program.evaluate(n, frames.data(), v, error, vsapi);
+            int index = selectIndex(v, static_cast<int>(frames.size()));
+            for (int i = 0; i < static_cast<int>(frames.size()); i++) {
+                if (!success || i != index)
+                    vsapi->freeFrame(frames[i]);
+            }
 
-        vsapi->mapSetInt(d->in, "n", n, maAppend);
+            if (!success) {
+                vsapi->setFilterError(("ModifyFrame: " + error).c_str(), frameCtx);
+                return nullptr;
+            }
+            f = frames[index];
+        } else {
+            FrameCallFrames frames(n, d->node, frameCtx, vsapi);
+            VSFrameCallResult result;
+            if (vsapi->callFrameFunction(d->func, n, frames.data(), frames.size(), &result)) {
+                vsapi->freeNode(result.node);
+                if (result.error || !result.frame) {
+                    vsapi->freeFrame(result.frame);
+                    vsapi->setFilterError(result.error ? result.error : "ModifyFrame: Returned value not a frame", frameCtx);
+                    return nullptr;
+                }
+                f = result.frame;
+            } else {
+                ScriptCallMaps maps(d->in, d->out, d->parallel, vsapi);
+                vsapi->mapSetInt(maps.in, "n", n, maAppend);
 
-        for (auto iter : d->node) {
-            const VSFrame *f = vsapi->getFrameFilter(n, iter, frameCtx);
-            vsapi->mapSetFrame(d->in, "f", f, maAppend);
-            vsapi->freeFrame(f);
-        }
+                for (int i = 0; i < frames.size(); i++)
+                    vsapi->mapSetFrame(maps.in, "f", frames.data()[i], maAppend);
 
-        vsapi->callFunction(d->func, d->in, d->out);
-        vsapi->clearMap(d->in);
+                vsapi->callFunction(d->func, maps.in, maps.out);
+                vsapi->clearMap(maps.in);
 
-        if (vsapi->mapGetError(d->out)) {
-            vsapi->setFilterError(vsapi->mapGetError(d->out), frameCtx);
-            vsapi->clearMap(d->out);
-            return nullptr;
-        }
+                if (vsapi->mapGetError(maps.out)) {
+                    vsapi->setFilterError(vsapi->mapGetError(maps.out), frameCtx);
+                    vsapi->clearMap(maps.out);
+                    return nullptr;
+                }
 
-        const VSFrame *f = vsapi->mapGetFrame(d->out, "val", 0, &err);
-        vsapi->clearMap(d->out);
-        if (err) {
-            vsapi->freeFrame(f);
-            vsapi->setFilterError("ModifyFrame: Returned value not a frame", frameCtx);
-            return nullptr;
+                f = vsapi->mapGetFrame(maps.out, "val", 0, &err);
+                vsapi->clearMap(maps.out);
+                if (err) {
+                    vsapi->freeFrame(f);
+                    vsapi->setFilterError("ModifyFrame: Returned value not a frame", frameCtx);
+                    return nullptr;
+                }
+            }
         }
 
         if (d->vi->format.colorFamily != cfUndefined && !isSameVideoFormat(&d->vi->format, vsapi->getVideoFrameFormat(f))) {
@@ -1637,23 +2085,40 @@ static void VS_CC modifyFrameFree(void *instanceData, VSCore *core, const VSAPI
 
 static void VS_CC modifyFrameCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<ModifyFrameData> d(new ModifyFrameData());
+    int err;
+    d->func = vsapi->mapGetFunction(in, "selector", 0, nullptr);
+    d->parallel = !!vsapi->mapGetInt(in, "parallel", 0, &err);
+    const char *selectexpr = vsapi->mapGetData(in, "select_expr", 0, nullptr);
+    if (!d->func == !selectexpr) {
+        vsapi->freeFunction(d->func);
+        RETERROR("ModifyFrame: exactly one of selector and select_expr must be given");
+    }
+
+    int numnode = vsapi->mapNumElements(in, "clips");
+
+    if (selectexpr) {
+        try {
+            d->program.parse(selectexpr, numnode, vsapi);
+        } catch (const std::runtime_error &e) {
+            RETERROR((std::string("ModifyFrame: failed to parse select_expr: ") + e.what()).c_str());
+        }
+    }
+
     VSNode *formatnode = vsapi->mapGetNode(in, "clip", 0, 0);
     d->vi = vsapi->getVideoInfo(formatnode);
     vsapi->freeNode(formatnode);
 
-    int numnode = vsapi->mapNumElements(in, "clips");
     d->node.resize(numnode);
     for (int i = 0; i < numnode; i++)
         d->node[i] = vsapi->mapGetNode(in, "clips", i, 0);
 
-    d->func = vsapi->mapGetFunction(in, "selector", 0, 0);
     d->in = vsapi->createMap();
     d->out = vsapi->createMap();
 
     std::vector<VSFilterDependency> deps;
     for (int i = 0; i < numnode; i++)
         deps.push_back({d->node[i], rpStrictSpatial});
-    vsapi->createVideoFilter(out, "ModifyFrame", d->vi, modifyFrameGetFrame, modifyFrameFree, fmParallelRequests, deps.data(), numnode, d.get(), core);
+    vsapi->createVideoFilter(out, "ModifyFrame", d->vi, modifyFrameGetFrame, modifyFrameFree, (d->func && !d->parallel) ? fmParallelRequests : fmParallel, deps.data(), numnode, d.get(), core);
     d.release();
 }
 
@@ -1685,7 +2150,21 @@ static const VSFrame *VS_CC transposeGetFrame(int n, int activationReason, void
         void (*func)(const void *, ptrdiff_t, void *, ptrdiff_t, unsigned, unsigned) = nullptr;
 
 #ifdef VS_TARGET_CPU_X86
-        if (d->cpulevel >= VS_CPU_LEVEL_SSE2) {
+        if (getCPUFeatures()->avx512_bw && getCPUFeatures()->avx512_vl && d->cpulevel >= VS_CPU_LEVEL_AVX512) {
+            switch (d->vi.format.bytesPerSample) {
+            case 1: func = vs_transpose_plane_byte_avx512; break;
+            case 2: func = vs_transpose_plane_word_avx512; break;
+            case 4: func = vs_transpose_plane_dword_avx512; break;
+            }
+        }
+        if (!func && getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
+            switch (d->vi.format.bytesPerSample) {
+            case 1: func = vs_transpose_plane_byte_avx2; break;
+            case 2: func = vs_transpose_plane_word_avx2; break;
+            case 4: func = vs_transpose_plane_dword_avx2; break;
+            }
+        }
+        if (!func && d->cpulevel >= VS_CPU_LEVEL_SSE2) {
             switch (d->vi.format.bytesPerSample) {
             case 1: func = vs_transpose_plane_byte_sse2; break;
             case 2: func = vs_transpose_plane_word_sse2; break;
@@ -1735,13 +2214,123 @@ static void VS_CC transposeCreate(const VSMap *in, VSMap *out, void *userData, V
         RETERROR("Transpose: clip must have constant format and dimensions and must not be CompatYUY2");
 
     vsapi->queryVideoFormat(&d->vi.format, d->vi.format.colorFamily, d->vi.format.sampleType, d->vi.format.bitsPerSample, d->vi.format.subSamplingH, d->vi.format.subSamplingW, core);
-    d->cpulevel = vs_get_cpulevel(core);
+    d->cpulevel = vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_TRANSPOSE);
 
     VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
     vsapi->createVideoFilter(out, "Transpose", &d->vi, transposeGetFrame, filterFree<TransposeData>, fmParallel, deps, 1, d.get(), core);
     d.release();
 }
 
+//////////////////////////////////////////
+// BoxDownscale
+
+typedef struct {
+    VSVideoInfo vi;
+    unsigned factor;
+    int cpulevel;
+} BoxDownscaleDataExtra;
+
+typedef SingleNodeData<BoxDownscaleDataExtra> BoxDownscaleData;
+
+static const VSFrame *VS_CC boxDownscaleGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    BoxDownscaleData *d = reinterpret_cast<BoxDownscaleData *>(instanceData);
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+        VSFrame *dst = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, src, core);
+
+        void (*func)(const void *, ptrdiff_t, void *, unsigned, unsigned) = nullptr;
+        bool isFloat = (d->vi.format.sampleType == stFloat);
+
+#ifdef VS_TARGET_CPU_X86
+        if (getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
+            switch (d->vi.format.bytesPerSample) {
+            case 1: func = vs_box_downscale_byte_avx2; break;
+            case 2: func = isFloat ? (getCPUFeatures()->f16c ? vs_box_downscale_half_avx2 : nullptr) : vs_box_downscale_word_avx2; break;
+            case 4: func = vs_box_downscale_float_avx2; break;
+            }
+        }
+        if (!func && d->cpulevel >= VS_CPU_LEVEL_SSE2) {
+            switch (d->vi.format.bytesPerSample) {
+            case 1: func = vs_box_downscale_byte_sse2; break;
+            case 2: func = isFloat ? nullptr : vs_box_downscale_word_sse2; break;
+            case 4: func = vs_box_downscale_float_sse2; break;
+            }
+        }
+#endif
+        if (!func) {
+            switch (d->vi.format.bytesPerSample) {
+            case 1: func = vs_box_downscale_byte_c; break;
+            case 2: func = isFloat ? vs_box_downscale_half_c : vs_box_downscale_word_c; break;
+            case 4: func = vs_box_downscale_float_c; break;
+            }
+        }
+
+        // with luma only the dst format has a single plane so the chroma is never touched
+        for (int plane = 0; plane < d->vi.format.numPlanes; plane++) {
+            const uint8_t *srcp = vsapi->getReadPtr(src, plane);
+            ptrdiff_t src_stride = vsapi->getStride(src, plane);
+            uint8_t *dstp = vsapi->getWritePtr(dst, plane);
+            ptrdiff_t dst_stride = vsapi->getStride(dst, plane);
+            int width = vsapi->getFrameWidth(dst, plane);
+            int height = vsapi->getFrameHeight(dst, plane);
+
+            for (int y = 0; y < height; y++) {
+                func(srcp, src_stride, dstp, d->factor, width);
+                srcp += src_stride * d->factor;
+                dstp += dst_stride;
+            }
+        }
+
+        if (d->vi.format.colorFamily == cfGray)
+            vsapi->mapDeleteKey(vsapi->getFramePropertiesRW(dst), "_ChromaLocation");
+
+        vsapi->freeFrame(src);
+        return dst;
+    }
+
+    return nullptr;
+}
+
+static void VS_CC boxDownscaleCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<BoxDownscaleData> d(new BoxDownscaleData(vsapi));
+    int err;
+
+    d->node = vsapi->mapGetNode(in, "clip", 0, 0);
+    d->vi = *vsapi->getVideoInfo(d->node);
+
+    if (!isConstantVideoFormat(&d->vi))
+        RETERROR("BoxDownscale: clip must have constant format and dimensions");
+
+    int factor = vsapi->mapGetIntSaturated(in, "factor", 0, &err);
+    if (err)
+        factor = 2;
+    if (factor != 2 && factor != 4 && factor != 8)
+        RETERROR("BoxDownscale: factor must be 2, 4 or 8");
+    d->factor = factor;
+
+    bool luma = !!vsapi->mapGetInt(in, "luma", 0, &err);
+    if (luma && d->vi.format.colorFamily == cfRGB)
+        RETERROR("BoxDownscale: luma can only be used with YUV and Gray clips");
+
+    if (luma)
+        vsapi->queryVideoFormat(&d->vi.format, cfGray, d->vi.format.sampleType, d->vi.format.bitsPerSample, 0, 0, core);
+
+    // samples that don't fill a whole block on the right and bottom, and any needed to keep the subsampling, are dropped
+    d->vi.width = (d->vi.width / factor) & ~((1 << d->vi.format.subSamplingW) - 1);
+    d->vi.height = (d->vi.height / factor) & ~((1 << d->vi.format.subSamplingH) - 1);
+    if (!d->vi.width || !d->vi.height)
+        RETERROR("BoxDownscale: clip is too small to be downscaled by factor");
+
+    d->cpulevel = vs_get_cpulevel(core);
+
+    VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
+    vsapi->createVideoFilter(out, "BoxDownscale", &d->vi, boxDownscaleGetFrame, filterFree<BoxDownscaleData>, fmParallel, deps, 1, d.get(), core);
+    d.release();
+}
+
 //////////////////////////////////////////
 // PEM(Level)Verifier
 
@@ -1874,10 +2463,10 @@ static void VS_CC pemVerifierCreate(const VSMap *in, VSMap *out, void *userData,
 // PlaneStats
 
 typedef struct {
-    std::string propAverage;
-    std::string propMin;
-    std::string propMax;
-    std::string propDiff;
+    const VSMapKey *propAverage;
+    const VSMapKey *propMin;
+    const VSMapKey *propMax;
+    const VSMapKey *propDiff;
     int plane;
     int cpulevel;
 } PlaneStatsDataExtra;
@@ -1907,8 +2496,24 @@ static const VSFrame *VS_CC planeStatsGetFrame(int n, int activationReason, void
             ptrdiff_t src2_stride = vsapi->getStride(src2, d->plane);
             void (*func)(union vs_plane_stats *, const void *, ptrdiff_t, const void *, ptrdiff_t, unsigned, unsigned) = nullptr;
 
+            if (fi->sampleType == stFloat && fi->bytesPerSample == 2) {
+#ifdef VS_TARGET_CPU_X86
+                if (getCPUFeatures()->avx2 && getCPUFeatures()->f16c && d->cpulevel >= VS_CPU_LEVEL_AVX2)
+                    func = vs_plane_stats_2_half_avx2;
+                else
+#endif
+                    func = vs_plane_stats_2_half_c;
+            }
+
 #ifdef VS_TARGET_CPU_X86
-            if (getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
+            if (!func && getCPUFeatures()->avx512_bw && getCPUFeatures()->avx512_vl && d->cpulevel >= VS_CPU_LEVEL_AVX512) {
+                switch (fi->bytesPerSample) {
+                case 1: func = vs_plane_stats_2_byte_avx512; break;
+                case 2: func = vs_plane_stats_2_word_avx512; break;
+                case 4: func = vs_plane_stats_2_float_avx512; break;
+                }
+            }
+            if (!func && getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
                 switch (fi->bytesPerSample) {
                 case 1: func = vs_plane_stats_2_byte_avx2; break;
                 case 2: func = vs_plane_stats_2_word_avx2; break;
@@ -1936,8 +2541,24 @@ static const VSFrame *VS_CC planeStatsGetFrame(int n, int activationReason, void
         } else {
             void (*func)(union vs_plane_stats *, const void *, ptrdiff_t, unsigned, unsigned) = nullptr;
 
+            if (fi->sampleType == stFloat && fi->bytesPerSample == 2) {
+#ifdef VS_TARGET_CPU_X86
+                if (getCPUFeatures()->avx2 && getCPUFeatures()->f16c && d->cpulevel >= VS_CPU_LEVEL_AVX2)
+                    func = vs_plane_stats_1_half_avx2;
+                else
+#endif
+                    func = vs_plane_stats_1_half_c;
+            }
+
 #ifdef VS_TARGET_CPU_X86
-            if (getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
+            if (!func && getCPUFeatures()->avx512_bw && getCPUFeatures()->avx512_vl && d->cpulevel >= VS_CPU_LEVEL_AVX512) {
+                switch (fi->bytesPerSample) {
+                case 1: func = vs_plane_stats_1_byte_avx512; break;
+                case 2: func = vs_plane_stats_1_word_avx512; break;
+                case 4: func = vs_plane_stats_1_float_avx512; break;
+                }
+            }
+            if (!func && getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
                 switch (fi->bytesPerSample) {
                 case 1: func = vs_plane_stats_1_byte_avx2; break;
                 case 2: func = vs_plane_stats_1_word_avx2; break;
@@ -1967,11 +2588,11 @@ static const VSFrame *VS_CC planeStatsGetFrame(int n, int activationReason, void
         VSMap *dstProps = vsapi->getFramePropertiesRW(dst);
 
         if (fi->sampleType == stInteger) {
-            vsapi->mapSetInt(dstProps, d->propMin.c_str(), stats.i.min, maReplace);
-            vsapi->mapSetInt(dstProps, d->propMax.c_str(), stats.i.max, maReplace);
+            vsapi->mapSetIntKey(dstProps, d->propMin, stats.i.min, maReplace);
+            vsapi->mapSetIntKey(dstProps, d->propMax, stats.i.max, maReplace);
         } else {
-            vsapi->mapSetFloat(dstProps, d->propMin.c_str(), stats.f.min, maReplace);
-            vsapi->mapSetFloat(dstProps, d->propMax.c_str(), stats.f.max, maReplace);
+            vsapi->mapSetFloatKey(dstProps, d->propMin, stats.f.min, maReplace);
+            vsapi->mapSetFloatKey(dstProps, d->propMax, stats.f.max, maReplace);
         }
 
         double avg = 0.0;
@@ -1986,9 +2607,9 @@ static const VSFrame *VS_CC planeStatsGetFrame(int n, int activationReason, void
                 diff = stats.f.diffacc / (double)((int64_t)width * height);
         }
 
-        vsapi->mapSetFloat(dstProps, d->propAverage.c_str(), avg, maReplace);
+        vsapi->mapSetFloatKey(dstProps, d->propAverage, avg, maReplace);
         if (d->node2)
-            vsapi->mapSetFloat(dstProps, d->propDiff.c_str(), diff, maReplace);
+            vsapi->mapSetFloatKey(dstProps, d->propDiff, diff, maReplace);
 
         vsapi->freeFrame(src1);
         vsapi->freeFrame(src2);
@@ -2004,8 +2625,8 @@ static void VS_CC planeStatsCreate(const VSMap *in, VSMap *out, void *userData,
     d->node1 = vsapi->mapGetNode(in, "clipa", 0, 0);
     const VSVideoInfo *vi = vsapi->getVideoInfo(d->node1);
 
-    if (!is8to16orFloatFormat(vi->format))
-        RETERROR("PlaneStats: clip must be constant format and of integer 8-16 bit type or 32 bit float");
+    if (!is8to16orHalfOrFloatFormat(vi->format))
+        RETERROR("PlaneStats: clip must be constant format and of integer 8-16 bit type or 16/32 bit float");
 
     d->plane = vsapi->mapGetIntSaturated(in, "plane", 0, &err);
     if (d->plane < 0 || d->plane >= vi->format.numPlanes)
@@ -2020,14 +2641,250 @@ static void VS_CC planeStatsCreate(const VSMap *in, VSMap *out, void *userData,
 
     const char *tmpprop = vsapi->mapGetData(in, "prop", 0, &err);
     std::string tempprop = tmpprop ? tmpprop : "PlaneStats";
+    d->propMin = vsapi->getMapKey((tempprop + "Min").c_str());
+    d->propMax = vsapi->getMapKey((tempprop + "Max").c_str());
+    d->propAverage = vsapi->getMapKey((tempprop + "Average").c_str());
+    d->propDiff = vsapi->getMapKey((tempprop + "Diff").c_str());
+    if (!d->propMin)
+        RETERROR("PlaneStats: prop must be a valid property name");
+    d->cpulevel = vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_PLANESTATS);
+
+    VSFilterDependency deps[] = {{d->node1, rpStrictSpatial}, {d->node2, !d->node2 ? 0 : (vi->numFrames <= vsapi->getVideoInfo(d->node2)->numFrames) ? rpStrictSpatial : rpGeneral}};
+    vsapi->createVideoFilter(out, "PlaneStats", vi, planeStatsGetFrame, filterFree<PlaneStatsData>, fmParallel, deps, d->node2 ? 2 : 1, d.get(), core);
+    d.release();
+}
+
+//////////////////////////////////////////
+// FrameStats
+
+typedef struct {
+    std::string propMin;
+    std::string propMax;
+    std::string propAverage;
+    std::string propStdDev;
+    std::string propPercentiles;
+    std::string propHistogram;
+    bool process[3];
+    std::vector<double> percentiles;
+    int bins;
+    int cpulevel;
+} FrameStatsDataExtra;
+
+typedef SingleNodeData<FrameStatsDataExtra> FrameStatsData;
+
+struct FrameStatsResult {
+    union vs_plane_stats stats;
+    std::vector<double> percentiles;
+    std::vector<int64_t> histogram;
+};
+
+static size_t frameStatsRank(double percentile, size_t count) {
+    return static_cast<size_t>(std::llround(percentile / 100 * (count - 1)));
+}
+
+static void frameStatsPlane(FrameStatsResult &res, const FrameStatsData *d, const VSFrame *src, int plane, const VSAPI *vsapi) {
+    const VSVideoFormat *fi = vsapi->getVideoFrameFormat(src);
+    int width = vsapi->getFrameWidth(src, plane);
+    int height = vsapi->getFrameHeight(src, plane);
+    const uint8_t *srcp = vsapi->getReadPtr(src, plane);
+    ptrdiff_t stride = vsapi->getStride(src, plane);
+    size_t count = static_cast<size_t>(width) * height;
+
+    res.stats = {};
+    res.percentiles.clear();
+    res.histogram.assign(d->bins, 0);
+
+    if (fi->sampleType == stInteger && (!d->percentiles.empty() || d->bins)) {
+        // A single pass collects the full histogram and every statistic is derived from it
+        std::vector<uint32_t> hist(fi->bytesPerSample == 1 ? 256 : 65536);
+        if (fi->bytesPerSample == 1)
+            vs_plane_histogram_byte_c(hist.data(), srcp, stride, width, height);
+        else
+            vs_plane_histogram_word_c(hist.data(), srcp, stride, width, height);
+
+        res.stats.i.min = std::numeric_limits<unsigned>::max();
+        for (unsigned v = 0; v < hist.size(); v++) {
+            if (!hist[v])
+                continue;
+            res.stats.i.min = std::min(res.stats.i.min, v);
+            res.stats.i.max = v;
+            res.stats.i.acc += static_cast<uint64_t>(hist[v]) * v;
+            res.stats.i.sqacc += static_cast<uint64_t>(hist[v]) * v * v;
+            if (d->bins)
+                res.histogram[std::min<uint64_t>((static_cast<uint64_t>(v) * d->bins) >> fi->bitsPerSample, d->bins - 1)] += hist[v];
+        }
+
+        for (double p : d->percentiles) {
+            size_t rank = frameStatsRank(p, count);
+            size_t seen = 0;
+            unsigned v = 0;
+            while (seen + hist[v] <= rank)
+                seen += hist[v++];
+            res.percentiles.push_back(v);
+        }
+        return;
+    }
+
+    void (*func)(union vs_plane_stats *, const void *, ptrdiff_t, unsigned, unsigned) = nullptr;
+
+#ifdef VS_TARGET_CPU_X86
+    if (getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2) {
+        switch (fi->bytesPerSample) {
+        case 1: func = vs_plane_stats_sq_byte_avx2; break;
+        case 2: func = vs_plane_stats_sq_word_avx2; break;
+        case 4: func = vs_plane_stats_sq_float_avx2; break;
+        }
+    }
+    if (!func && d->cpulevel >= VS_CPU_LEVEL_SSE2) {
+        switch (fi->bytesPerSample) {
+        case 1: func = vs_plane_stats_sq_byte_sse2; break;
+        case 2: func = vs_plane_stats_sq_word_sse2; break;
+        case 4: func = vs_plane_stats_sq_float_sse2; break;
+        }
+    }
+#endif
+    if (!func) {
+        switch (fi->bytesPerSample) {
+        case 1: func = vs_plane_stats_sq_byte_c; break;
+        case 2: func = vs_plane_stats_sq_word_c; break;
+        case 4: func = vs_plane_stats_sq_float_c; break;
+        }
+    }
+
+    func(&res.stats, srcp, stride, width, height);
+
+    if (fi->sampleType == stFloat && (!d->percentiles.empty() || d->bins)) {
+        std::vector<float> values;
+        values.reserve(count);
+        for (int y = 0; y < height; y++) {
+            const float *row = reinterpret_cast<const float *>(srcp + y * stride);
+            values.insert(values.end(), row, row + width);
+        }
+
+        if (d->bins) {
+            float offset = (fi->colorFamily == cfYUV && plane > 0) ? 0.5f : 0.f;
+            for (float v : values) {
+                int bin = static_cast<int>((v + offset) * d->bins);
+                res.histogram[std::min(std::max(bin, 0), d->bins - 1)]++;
+            }
+        }
+
+        for (double p : d->percentiles) {
+            auto nth = values.begin() + frameStatsRank(p, count);
+            std::nth_element(values.begin(), nth, values.end());
+            res.percentiles.push_back(*nth);
+        }
+    }
+}
+
+static const VSFrame *VS_CC frameStatsGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    FrameStatsData *d = reinterpret_cast<FrameStatsData *>(instanceData);
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+        VSFrame *dst = vsapi->copyFrame(src, core);
+        const VSVideoFormat *fi = vsapi->getVideoFrameFormat(src);
+        FrameStatsResult res[3];
+
+        parallelForEach(fi->numPlanes, [&](int plane) {
+            if (d->process[plane])
+                frameStatsPlane(res[plane], d, src, plane, vsapi);
+        }, core, vsapi);
+
+        VSMap *dstProps = vsapi->getFramePropertiesRW(dst);
+        vsapi->mapDeleteKey(dstProps, d->propMin.c_str());
+        vsapi->mapDeleteKey(dstProps, d->propMax.c_str());
+        vsapi->mapDeleteKey(dstProps, d->propAverage.c_str());
+        vsapi->mapDeleteKey(dstProps, d->propStdDev.c_str());
+        vsapi->mapDeleteKey(dstProps, d->propPercentiles.c_str());
+        vsapi->mapDeleteKey(dstProps, d->propHistogram.c_str());
+
+        std::vector<int64_t> histogram;
+        for (int plane = 0; plane < fi->numPlanes; plane++) {
+            if (!d->process[plane])
+                continue;
+
+            const union vs_plane_stats &stats = res[plane].stats;
+            double count = static_cast<double>(vsapi->getFrameWidth(src, plane)) * vsapi->getFrameHeight(src, plane);
+            double avg, stddev;
+
+            if (fi->sampleType == stInteger) {
+                double maxval = static_cast<double>((static_cast<int64_t>(1) << fi->bitsPerSample) - 1);
+                double mean = stats.i.acc / count;
+                vsapi->mapSetInt(dstProps, d->propMin.c_str(), stats.i.min, maAppend);
+                vsapi->mapSetInt(dstProps, d->propMax.c_str(), stats.i.max, maAppend);
+                avg = mean / maxval;
+                stddev = std::sqrt(std::max(stats.i.sqacc / count - mean * mean, 0.0)) / maxval;
+                for (double v : res[plane].percentiles)
+                    vsapi->mapSetInt(dstProps, d->propPercentiles.c_str(), static_cast<int64_t>(v), maAppend);
+            } else {
+                double mean = stats.f.acc / count;
+                vsapi->mapSetFloat(dstProps, d->propMin.c_str(), stats.f.min, maAppend);
+                vsapi->mapSetFloat(dstProps, d->propMax.c_str(), stats.f.max, maAppend);
+                avg = mean;
+                stddev = std::sqrt(std::max(stats.f.sqacc / count - mean * mean, 0.0));
+                for (double v : res[plane].percentiles)
+                    vsapi->mapSetFloat(dstProps, d->propPercentiles.c_str(), v, maAppend);
+            }
+
+            vsapi->mapSetFloat(dstProps, d->propAverage.c_str(), avg, maAppend);
+            vsapi->mapSetFloat(dstProps, d->propStdDev.c_str(), stddev, maAppend);
+            histogram.insert(histogram.end(), res[plane].histogram.begin(), res[plane].histogram.end());
+        }
+
+        if (d->bins)
+            vsapi->mapSetIntArray(dstProps, d->propHistogram.c_str(), histogram.data(), static_cast<int>(histogram.size()));
+
+        vsapi->freeFrame(src);
+        return dst;
+    }
+    return nullptr;
+}
+
+static void VS_CC frameStatsCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<FrameStatsData> d(new FrameStatsData(vsapi));
+    int err;
+
+    d->node = vsapi->mapGetNode(in, "clip", 0, 0);
+    const VSVideoInfo *vi = vsapi->getVideoInfo(d->node);
+
+    if (!is8to16orFloatFormat(vi->format))
+        RETERROR("FrameStats: clip must be constant format and of integer 8-16 bit type or 32 bit float");
+
+    try {
+        getPlanesArg(in, d->process, vsapi);
+    } catch (const std::runtime_error &e) {
+        RETERROR((std::string("FrameStats: ") + e.what()).c_str());
+    }
+
+    int numPercentiles = vsapi->mapNumElements(in, "percentiles");
+    for (int i = 0; i < numPercentiles; i++) {
+        double p = vsapi->mapGetFloat(in, "percentiles", i, nullptr);
+        if (p < 0 || p > 100)
+            RETERROR("FrameStats: percentiles must be between 0 and 100");
+        d->percentiles.push_back(p);
+    }
+
+    d->bins = vsapi->mapGetIntSaturated(in, "bins", 0, &err);
+    if (d->bins < 0 || d->bins > 65536)
+        RETERROR("FrameStats: bins must be between 0 and 65536");
+    if (vi->format.sampleType == stInteger && d->bins > (1 << vi->format.bitsPerSample))
+        RETERROR("FrameStats: bins must not be greater than the number of possible sample values");
+
+    const char *tmpprop = vsapi->mapGetData(in, "prop", 0, &err);
+    std::string tempprop = tmpprop ? tmpprop : "FrameStats";
     d->propMin = tempprop + "Min";
     d->propMax = tempprop + "Max";
     d->propAverage = tempprop + "Average";
-    d->propDiff = tempprop + "Diff";
-    d->cpulevel = vs_get_cpulevel(core);
+    d->propStdDev = tempprop + "StdDev";
+    d->propPercentiles = tempprop + "Percentiles";
+    d->propHistogram = tempprop + "Histogram";
+    d->cpulevel = vs_get_kernel_cpulevel(core, VS_KERNEL_FAMILY_PLANESTATS);
 
-    VSFilterDependency deps[] = {{d->node1, rpStrictSpatial}, {d->node2, !d->node2 ? 0 : (vi->numFrames <= vsapi->getVideoInfo(d->node2)->numFrames) ? rpStrictSpatial : rpGeneral}};
-    vsapi->createVideoFilter(out, "PlaneStats", vi, planeStatsGetFrame, filterFree<PlaneStatsData>, fmParallel, deps, d->node2 ? 2 : 1, d.get(), core);
+    VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
+    vsapi->createVideoFilter(out, "FrameStats", vi, frameStatsGetFrame, filterFree<FrameStatsData>, fmParallel, deps, 1, d.get(), core);
     d.release();
 }
 
@@ -2246,7 +3103,9 @@ static void VS_CC setFramePropCreate(const VSMap *in, VSMap *out, void *userData
 
     VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
     vsapi->createVideoFilter(out, "SetFrameProp", vsapi->getVideoInfo(d->node), setFramePropGetFrame, filterFree<SetFramePropData>, fmParallel, deps, 1, d.get(), core);
+    setPassThroughHints(out, vsapi);
     d.release();
+    markPassthrough(out, vsapi);
 }
 
 //////////////////////////////////////////
@@ -2295,7 +3154,9 @@ static void VS_CC setFramePropsCreate(const VSMap *in, VSMap *out, void *userDat
 
     VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
     vsapi->createVideoFilter(out, "SetFrameProps", vsapi->getVideoInfo(d->node), setFramePropsGetFrame, filterFree<SetFramePropsData>, fmParallel, deps, 1, d.get(), core);
+    setPassThroughHints(out, vsapi);
     d.release();
+    markPassthrough(out, vsapi);
 }
 
 //////////////////////////////////////////
@@ -2348,7 +3209,9 @@ static void VS_CC removeFramePropsCreate(const VSMap *in, VSMap *out, void *user
 
     VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
     vsapi->createVideoFilter(out, "RemoveFrameProps", vsapi->getVideoInfo(d->node), removeFramePropsGetFrame, filterFree<RemoveFramePropsData>, fmParallel, deps, 1, d.get(), core);
+    setPassThroughHints(out, vsapi);
     d.release();
+    markPassthrough(out, vsapi);
 }
 
 //////////////////////////////////////////
@@ -2390,6 +3253,59 @@ static void VS_CC setFieldBasedCreate(const VSMap *in, VSMap *out, void *userDat
 
     VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
     vsapi->createVideoFilter(out, "SetFieldBased", vsapi->getVideoInfo(d->node), setFieldBasedGetFrame, filterFree<SetFieldBasedData>, fmParallel, deps, 1, d.get(), core);
+    setPassThroughHints(out, vsapi);
+    d.release();
+    markPassthrough(out, vsapi);
+}
+
+//////////////////////////////////////////
+// Dedup
+
+typedef SingleNodeData<NoExtraData> DedupData;
+
+static const VSFrame *VS_CC dedupGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    DedupData *d = reinterpret_cast<DedupData *>(instanceData);
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+        const VSVideoFormat *fi = vsapi->getVideoFrameFormat(src);
+
+        // only the visible part of every row is hashed, the padding up to the stride is undefined
+        XXH64_CTX ctx;
+        XXH64_Init(&ctx, vsapi->queryVideoFormatID(fi->colorFamily, fi->sampleType, fi->bitsPerSample, fi->subSamplingW, fi->subSamplingH, core));
+        for (int plane = 0; plane < fi->numPlanes; plane++) {
+            const uint8_t *srcp = vsapi->getReadPtr(src, plane);
+            ptrdiff_t stride = vsapi->getStride(src, plane);
+            int width = vsapi->getFrameWidth(src, plane);
+            int height = vsapi->getFrameHeight(src, plane);
+            XXH64_Update(&ctx, &width, sizeof(width));
+            XXH64_Update(&ctx, &height, sizeof(height));
+            for (int y = 0; y < height; y++)
+                XXH64_Update(&ctx, srcp + y * stride, width * fi->bytesPerSample);
+        }
+
+        VSFrame *dst = vsapi->copyFrame(src, core);
+        vsapi->freeFrame(src);
+        vsapi->mapSetInt(vsapi->getFramePropertiesRW(dst), "_ContentHash", static_cast<int64_t>(XXH64_Final(&ctx)), maReplace);
+        return dst;
+    }
+
+    return nullptr;
+}
+
+static void VS_CC dedupCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<DedupData> d(new DedupData(vsapi));
+
+    d->node = vsapi->mapGetNode(in, "clip", 0, nullptr);
+    const VSVideoInfo *vi = vsapi->getVideoInfo(d->node);
+
+    if (vi->format.colorFamily == cfUndefined)
+        RETERROR("Dedup: clip must have a constant format");
+
+    VSFilterDependency deps[] = {{d->node, rpStrictSpatial}};
+    vsapi->createVideoFilter(out, "Dedup", vi, dedupGetFrame, filterFree<DedupData>, fmParallel, deps, 1, d.get(), core);
     d.release();
 }
 
@@ -2427,7 +3343,9 @@ static void VS_CC copyFramePropsCreate(const VSMap *in, VSMap *out, void *userDa
 
     VSFilterDependency deps[] = {{d->node1, rpStrictSpatial}, {d->node2, (vsapi->getVideoInfo(d->node1)->numFrames <= vsapi->getVideoInfo(d->node2)->numFrames) ? rpStrictSpatial : rpGeneral}};
     vsapi->createVideoFilter(out, "CopyFrameProps", vsapi->getVideoInfo(d->node1), copyFramePropsGetFrame, filterFree<CopyFramePropsData>, fmParallel, deps, 2, d.get(), core);
+    setPassThroughHints(out, vsapi);
     d.release();
+    markPassthrough(out, vsapi);
 }
 
 //////////////////////////////////////////
@@ -2449,6 +3367,33 @@ static void VS_CC setCache(const VSMap *in, VSMap *out, void *userData, VSCore *
     if (err)
         maxhistory = -1;
     vsapi->setCacheOptions(node, fixedsize, maxsize, maxhistory);
+    int ring = vsapi->mapGetIntSaturated(in, "ring", 0, &err);
+    if (!err)
+        setCacheRingMode(node, !!ring);
+    int scanResistant = vsapi->mapGetIntSaturated(in, "scanresistant", 0, &err);
+    if (!err)
+        setCacheScanResistant(node, !!scanResistant);
+    int64_t compressedsize = vsapi->mapGetInt(in, "compressedsize", 0, &err);
+    if (!err) {
+        if (compressedsize < 0) {
+            vsapi->mapSetError(out, "SetVideoCache: compressedsize can't be negative");
+            vsapi->freeNode(node);
+            return;
+        }
+        setCompressedCacheSize(node, compressedsize * 1024 * 1024);
+    }
+}
+
+static void VS_CC setMaxConcurrency(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    VSNode *node = vsapi->mapGetNode(in, "clip", 0, nullptr);
+    int max = vsapi->mapGetIntSaturated(in, "max", 0, nullptr);
+    if (max < 0) {
+        vsapi->mapSetError(out, "SetMaxConcurrency: max can't be negative");
+        vsapi->freeNode(node);
+        return;
+    }
+    setNodeMaxConcurrency(node, max);
+    vsapi->freeNode(node);
 }
 
 //////////////////////////////////////////
@@ -2482,19 +3427,29 @@ void stdlibInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->registerFunction("StackHorizontal", "clips:vnode[];", "clip:vnode;", stackCreate, 0, plugin);
     vspapi->registerFunction("BlankClip", "clip:vnode:opt;width:int:opt;height:int:opt;format:int:opt;length:int:opt;fpsnum:int:opt;fpsden:int:opt;color:float[]:opt;keep:int:opt;", "clip:vnode;", blankClipCreate, 0, plugin);
     vspapi->registerFunction("AssumeFPS", "clip:vnode;src:vnode:opt;fpsnum:int:opt;fpsden:int:opt;", "clip:vnode;", assumeFPSCreate, 0, plugin);
-    vspapi->registerFunction("FrameEval", "clip:vnode;eval:func;prop_src:vnode[]:opt;clip_src:vnode[]:opt;", "clip:vnode;", frameEvalCreate, 0, plugin);
-    vspapi->registerFunction("ModifyFrame", "clip:vnode;clips:vnode[];selector:func;", "clip:vnode;", modifyFrameCreate, 0, plugin);
+    vspapi->registerFunction("FrameEval", "clip:vnode;eval:func:opt;prop_src:vnode[]:opt;clip_src:vnode[]:opt;select:int[]:opt;select_expr:data:opt;parallel:int:opt;reuse:int:opt;", "clip:vnode;", frameEvalCreate, 0, plugin);
+    vspapi->registerFunction("ModifyFrame", "clip:vnode;clips:vnode[];selector:func:opt;select_expr:data:opt;parallel:int:opt;", "clip:vnode;", modifyFrameCreate, 0, plugin);
     vspapi->registerFunction("Transpose", "clip:vnode;", "clip:vnode;", transposeCreate, 0, plugin);
+    vspapi->registerFunction("BoxDownscale", "clip:vnode;factor:int:opt;luma:int:opt;", "clip:vnode;", boxDownscaleCreate, 0, plugin);
     vspapi->registerFunction("PEMVerifier", "clip:vnode;upper:float[]:opt;lower:float[]:opt;", "clip:vnode;", pemVerifierCreate, 0, plugin);
     vspapi->registerFunction("PlaneStats", "clipa:vnode;clipb:vnode:opt;plane:int:opt;prop:data:opt;", "clip:vnode;", planeStatsCreate, 0, plugin);
+    vspapi->registerFunction("FrameStats", "clip:vnode;planes:int[]:opt;percentiles:float[]:opt;bins:int:opt;prop:data:opt;", "clip:vnode;", frameStatsCreate, 0, plugin);
     vspapi->registerFunction("ClipToProp", "clip:vnode;mclip:vnode;prop:data:opt;", "clip:vnode;", clipToPropCreate, 0, plugin);
     vspapi->registerFunction("PropToClip", "clip:vnode;prop:data:opt;", "clip:vnode;", propToClipCreate, 0, plugin);
     vspapi->registerFunction("SetFrameProp", "clip:vnode;prop:data;delete:int:opt;intval:int[]:opt;floatval:float[]:opt;data:data[]:opt;", "clip:vnode;", setFramePropCreate, 0, plugin);
     vspapi->registerFunction("SetFrameProps", "clip:vnode;any", "clip:vnode;", setFramePropsCreate, 0, plugin);
     vspapi->registerFunction("RemoveFrameProps", "clip:vnode;props:data[]:opt;", "clip:vnode;", removeFramePropsCreate, 0, plugin);
     vspapi->registerFunction("SetFieldBased", "clip:vnode;value:int;", "clip:vnode;", setFieldBasedCreate, 0, plugin);
+    vspapi->registerFunction("Dedup", "clip:vnode;", "clip:vnode;", dedupCreate, 0, plugin);
     vspapi->registerFunction("CopyFrameProps", "clip:vnode;prop_src:vnode;", "clip:vnode;", copyFramePropsCreate, 0, plugin);
-    vspapi->registerFunction("SetAudioCache", "clip:anode;mode:int:opt;fixedsize:int:opt;maxsize:int:opt;maxhistory:int:opt;", "", setCache, 0, plugin);
-    vspapi->registerFunction("SetVideoCache", "clip:vnode;mode:int:opt;fixedsize:int:opt;maxsize:int:opt;maxhistory:int:opt;", "", setCache, 0, plugin);
+    vspapi->registerFunction("SetAudioCache", "clip:anode;mode:int:opt;fixedsize:int:opt;maxsize:int:opt;maxhistory:int:opt;scanresistant:int:opt;", "", setCache, 0, plugin);
+    vspapi->registerFunction("SetVideoCache", "clip:vnode;mode:int:opt;fixedsize:int:opt;maxsize:int:opt;maxhistory:int:opt;ring:int:opt;compressedsize:int:opt;scanresistant:int:opt;", "", setCache, 0, plugin);
+    vspapi->registerFunction("SetMaxConcurrency", "clip:vnode;max:int;", "", setMaxConcurrency, 0, plugin);
     vspapi->registerFunction("SetMaxCPU", "cpu:data;", "cpu:data;", setMaxCpu, 0, plugin);
+
+    for (const char *name : { "Cache", "CropAbs", "CropRel", "Crop", "AddBorders", "ShufflePlanes", "SplitPlanes", "SeparateFields", "DoubleWeave",
+        "FlipVertical", "FlipHorizontal", "Turn180", "StackVertical", "StackHorizontal", "AssumeFPS", "Transpose", "BoxDownscale", "PEMVerifier", "PlaneStats",
+        "FrameStats", "ClipToProp", "PropToClip", "SetFrameProp", "SetFrameProps", "RemoveFrameProps", "SetFieldBased", "Dedup", "CopyFrameProps",
+        "SetVideoCache", "SetMaxConcurrency" })
+        vspapi->setFunctionFlags(name, pffProxyScalable, plugin);
 }
@@ -23,6 +23,8 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "VapourSynth4.h"
 #include "VSHelper4.h"
 #include "VSConstants4.h"
@@ -30,6 +32,8 @@
 #include "filtershared.h"
 #include "ter-116n.h"
 #include "internalfilters.h"
+#include "kernel/cpulevel.h"
+#include "kernel/fill.h"
 
 const int margin_h = 16;
 const int margin_v = 16;
@@ -40,56 +44,69 @@ std::string operator""_s(const char *str, size_t len) { return{ str, len }; }
 typedef std::vector<std::string> stringlist;
 } // namespace
 
-static void scrawl_character_int(unsigned char c, uint8_t *image, ptrdiff_t stride, int dest_x, int dest_y, int bitsPerSample, int scale) {
-    int black = 16 << (bitsPerSample - 8);
-    int white = 235 << (bitsPerSample - 8);
-    int x, y;
-    if (bitsPerSample == 8) {
-        for (y = 0; y < character_height * scale; y++) {
-            for (x = 0; x < character_width * scale; x++) {
-                if (__font_bitmap__[c * character_height + y/scale] & (1 << (7 - x/scale))) {
-                    image[dest_y*stride + dest_x + x] = white;
-                } else {
-                    image[dest_y*stride + dest_x + x] = black;
-                }
-            }
+namespace {
 
-            dest_y++;
-        }
-    } else {
-        for (y = 0; y < character_height * scale; y++) {
-            for (x = 0; x < character_width * scale; x++) {
-                if (__font_bitmap__[c * character_height + y/scale] & (1 << (7 - x/scale))) {
-                    reinterpret_cast<uint16_t *>(image)[dest_y*stride/2 + dest_x + x] = white;
-                } else {
-                    reinterpret_cast<uint16_t *>(image)[dest_y*stride/2 + dest_x + x] = black;
-                }
-            }
+// A line of text rendered for one format, drawing it is then a single copy per row
+struct GlyphRun {
+    int width; // in pixels
+    int height;
+    std::vector<uint8_t> samples;
+};
 
-            dest_y++;
-        }
+typedef std::shared_ptr<const GlyphRun> GlyphRunPtr;
+
+// Lines that change with every frame keep adding new runs so once there are too many
+// everything is dropped and the lines still in use get rendered again
+class GlyphRunCache {
+    static const size_t maxRuns = 512;
+    std::mutex lock;
+    std::unordered_map<std::string, GlyphRunPtr> runs;
+public:
+    GlyphRunPtr get(const std::string &key) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = runs.find(key);
+        return (it != runs.end()) ? it->second : nullptr;
     }
-}
 
+    void add(const std::string &key, GlyphRunPtr run) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (runs.size() >= maxRuns)
+            runs.clear();
+        runs[key] = std::move(run);
+    }
+};
+
+} // namespace
 
-static void scrawl_character_float(unsigned char c, uint8_t *image, ptrdiff_t stride, int dest_x, int dest_y, int scale) {
-    float white = 1.0f;
-    float black = 0.0f;
-    int x, y;
+template<typename T>
+static void render_glyph_run(GlyphRun &run, const std::string &line, T black, T white, int scale) {
+    T *dstp = reinterpret_cast<T *>(run.samples.data());
 
-    for (y = 0; y < character_height * scale; y++) {
-        for (x = 0; x < character_width * scale; x++) {
-            if (__font_bitmap__[c * character_height + y/scale] & (1 << (7 - x/scale))) {
-                reinterpret_cast<float *>(image)[dest_y*stride/4 + dest_x + x] = white;
-            } else {
-                reinterpret_cast<float *>(image)[dest_y*stride/4 + dest_x + x] = black;
-            }
+    for (int y = 0; y < run.height; y++) {
+        for (size_t i = 0; i < line.size(); i++) {
+            unsigned char bits = __font_bitmap__[static_cast<unsigned char>(line[i]) * character_height + y / scale];
+            for (int x = 0; x < character_width * scale; x++)
+                *dstp++ = (bits & (1 << (7 - x / scale))) ? white : black;
         }
-
-        dest_y++;
     }
 }
 
+static GlyphRunPtr make_glyph_run(const std::string &line, const VSVideoFormat *format, int scale) {
+    std::shared_ptr<GlyphRun> run = std::make_shared<GlyphRun>();
+    run->width = static_cast<int>(line.size()) * character_width * scale;
+    run->height = character_height * scale;
+    run->samples.resize(static_cast<size_t>(run->width) * run->height * format->bytesPerSample);
+
+    if (format->sampleType == stFloat)
+        render_glyph_run<float>(*run, line, 0.0f, 1.0f, scale);
+    else if (format->bytesPerSample == 1)
+        render_glyph_run<uint8_t>(*run, line, 16, 235, scale);
+    else
+        render_glyph_run<uint16_t>(*run, line, 16 << (format->bitsPerSample - 8), 235 << (format->bitsPerSample - 8), scale);
+
+    return run;
+}
+
 static void sanitise_text(std::string& txt) {
     for (size_t i = 0; i < txt.length(); i++) {
         if (txt[i] == '\r') {
@@ -163,7 +180,8 @@ static stringlist split_text(const std::string& txt, int width, int height, int
 }
 
 
-static void scrawl_text(std::string txt, int alignment, int scale, VSFrame *frame, const VSAPI *vsapi) {
+// Runs are looked up in cache when it's set, the sample type is part of the key since the format may vary
+static void scrawl_text(std::string txt, int alignment, int scale, VSFrame *frame, GlyphRunCache *cache, int cpulevel, const VSAPI *vsapi) {
     const VSVideoFormat *frame_format = vsapi->getVideoFrameFormat(frame);
     int width = vsapi->getFrameWidth(frame, 0);
     int height = vsapi->getFrameHeight(frame, 0);
@@ -193,6 +211,10 @@ static void scrawl_text(std::string txt, int alignment, int scale, VSFrame *fram
         break;
     }
 
+    // chroma is set to grey under the text
+    uint32_t neutral = (frame_format->sampleType == stInteger) ? (128u << (frame_format->bitsPerSample - 8)) : 0;
+    std::string prefix = { static_cast<char>(frame_format->sampleType), static_cast<char>(frame_format->bitsPerSample) };
+
     for (const auto &iter : lines) {
         switch (alignment) {
         case 1:
@@ -212,56 +234,43 @@ static void scrawl_text(std::string txt, int alignment, int scale, VSFrame *fram
             break;
         }
 
-        for (size_t i = 0; i < iter.size(); i++) {
-            int dest_x = start_x + static_cast<int>(i)*character_width*scale;
-            int dest_y = start_y;
+        if (iter.empty()) {
+            start_y += character_height * scale;
+            continue;
+        }
+
+        GlyphRunPtr run;
+        std::string key;
+        if (cache) {
+            key = prefix + iter;
+            run = cache->get(key);
+        }
+        if (!run) {
+            run = make_glyph_run(iter, frame_format, scale);
+            if (cache)
+                cache->add(key, run);
+        }
 
-            if (frame_format->colorFamily == cfRGB) {
-                for (int plane = 0; plane < frame_format->numPlanes; plane++) {
-                    uint8_t *image = vsapi->getWritePtr(frame, plane);
-                    ptrdiff_t stride = vsapi->getStride(frame, plane);
+        int bytesPerSample = frame_format->bytesPerSample;
+        size_t rowSize = static_cast<size_t>(run->width) * bytesPerSample;
 
-                    if (frame_format->sampleType == stInteger) {
-                        scrawl_character_int(iter[i], image, stride, dest_x, dest_y, frame_format->bitsPerSample, scale);
-                    } else {
-                        scrawl_character_float(iter[i], image, stride, dest_x, dest_y, scale);
-                    }
-                }
+        for (int plane = 0; plane < frame_format->numPlanes; plane++) {
+            uint8_t *image = vsapi->getWritePtr(frame, plane);
+            ptrdiff_t stride = vsapi->getStride(frame, plane);
+
+            if (plane == 0 || frame_format->colorFamily == cfRGB) {
+                vsh::bitblt(image + start_y * stride + start_x * bytesPerSample, stride, run->samples.data(), rowSize, rowSize, run->height);
             } else {
-                for (int plane = 0; plane < frame_format->numPlanes; plane++) {
-                    uint8_t *image = vsapi->getWritePtr(frame, plane);
-                    ptrdiff_t stride = vsapi->getStride(frame, plane);
-
-                    if (plane == 0) {
-                        if (frame_format->sampleType == stInteger) {
-                            scrawl_character_int(iter[i], image, stride, dest_x, dest_y, frame_format->bitsPerSample, scale);
-                        } else {
-                            scrawl_character_float(iter[i], image, stride, dest_x, dest_y, scale);
-                        }
-                    } else {
-                        int sub_w = scale * character_width  >> frame_format->subSamplingW;
-                        int sub_h = scale * character_height >> frame_format->subSamplingH;
-                        int sub_dest_x = dest_x >> frame_format->subSamplingW;
-                        int sub_dest_y = dest_y >> frame_format->subSamplingH;
-                        int y;
-
-                        if (frame_format->bitsPerSample == 8) {
-                            for (y = 0; y < sub_h; y++) {
-                                vs_memset<uint8_t>(image + (y+sub_dest_y)*stride + sub_dest_x, 128, sub_w);
-                            }
-                        } else if (frame_format->bitsPerSample <= 16) {
-                            for (y = 0; y < sub_h; y++) {
-                                vs_memset<uint16_t>(reinterpret_cast<uint16_t *>(image) + (y+sub_dest_y)*stride/2 + sub_dest_x, 128 << (frame_format->bitsPerSample - 8), sub_w);
-                            }
-                        } else {
-                            for (y = 0; y < sub_h; y++) {
-                                vs_memset<float>(reinterpret_cast<float *>(image) + (y+sub_dest_y)*stride/4 + sub_dest_x, 0.0f, sub_w);
-                            }
-                        }
-                    } // if plane
-                } // for plane in planes
-            } // if colorFamily
-        } // for i in line
+                // every character covers a whole number of chroma samples so the line is a single rectangle
+                int sub_w = (scale * character_width >> frame_format->subSamplingW) * static_cast<int>(iter.size());
+                int sub_h = scale * character_height >> frame_format->subSamplingH;
+                int sub_dest_x = start_x >> frame_format->subSamplingW;
+                int sub_dest_y = start_y >> frame_format->subSamplingH;
+
+                vs_fill_plane(image + sub_dest_y * stride + sub_dest_x * bytesPerSample, stride, neutral, bytesPerSample, sub_w, sub_h, cpulevel);
+            }
+        }
+
         start_y += character_height * scale;
     } // for iter in lines
 }
@@ -288,6 +297,7 @@ typedef struct {
     intptr_t filter;
     stringlist props;
     std::string instanceName;
+    GlyphRunCache cache;
 } TextData;
 
 } // namespace
@@ -517,9 +527,11 @@ static const VSFrame *VS_CC textGetFrame(int n, int activationReason, void *inst
         }
 
         VSFrame *dst = vsapi->copyFrame(src, core);
+        int cpulevel = vs_get_cpulevel(core);
 
         if (d->filter == FILTER_FRAMENUM) {
-            scrawl_text(std::to_string(n), d->alignment, d->scale, dst, vsapi);
+            // the number is different on every frame so there is nothing to gain from caching it
+            scrawl_text(std::to_string(n), d->alignment, d->scale, dst, nullptr, cpulevel, vsapi);
         } else if (d->filter == FILTER_FRAMEPROPS) {
             const VSMap *props = vsapi->getFramePropertiesRO(dst);
             int numKeys = vsapi->mapNumKeys(props);
@@ -537,7 +549,7 @@ static const VSFrame *VS_CC textGetFrame(int n, int activationReason, void *inst
                 }
             }
 
-            scrawl_text(text, d->alignment, d->scale, dst, vsapi);
+            scrawl_text(text, d->alignment, d->scale, dst, &d->cache, cpulevel, vsapi);
         } else if (d->filter == FILTER_COREINFO) {
             VSCoreInfo ci;
             vsapi->getCoreInfo(core, &ci);
@@ -548,7 +560,7 @@ static const VSFrame *VS_CC textGetFrame(int n, int activationReason, void *inst
             text.append("Maximum framebuffer cache size: ").append(std::to_string(ci.maxFramebufferSize)).append(" bytes\n");
             text.append("Used framebuffer cache size: ").append(std::to_string(ci.usedFramebufferSize)).append(" bytes");
 
-            scrawl_text(text, d->alignment, d->scale, dst, vsapi);
+            scrawl_text(text, d->alignment, d->scale, dst, &d->cache, cpulevel, vsapi);
         } else if (d->filter == FILTER_CLIPINFO) {
             const VSMap *props = vsapi->getFramePropertiesRO(src);
             std::string text = "Clip info:\n";
@@ -626,9 +638,9 @@ static const VSFrame *VS_CC textGetFrame(int n, int activationReason, void *inst
                 text += "Frame duration: " + std::to_string(fn) + "/" + std::to_string(fd) + " (" + std::to_string(static_cast<double>(fn) / fd) + ")\n";
             }
 
-            scrawl_text(text, d->alignment, d->scale, dst, vsapi);
+            scrawl_text(text, d->alignment, d->scale, dst, &d->cache, cpulevel, vsapi);
         } else {
-            scrawl_text(d->text, d->alignment, d->scale, dst, vsapi);
+            scrawl_text(d->text, d->alignment, d->scale, dst, &d->cache, cpulevel, vsapi);
         }
 
         vsapi->freeFrame(src);
@@ -39,6 +39,11 @@ static int VS_CC registerFunction(const char *name, const char *args, const char
     return plugin->registerFunction(name, args, returnType, argsFunc, functionData);
 }
 
+static int VS_CC setFunctionFlags(const char *name, int flags, VSPlugin *plugin) VS_NOEXCEPT {
+    assert(name && plugin);
+    return plugin->setFunctionFlags(name, flags);
+}
+
 static void VS_CC registerFunction3(const char *name, const char *args, vs3::VSPublicFunction argsFunc, void *functionData, VSPlugin *plugin) VS_NOEXCEPT {
     assert(name && args && argsFunc && plugin);
     plugin->registerFunction(name, args, "any", reinterpret_cast<VSPublicFunction>(argsFunc), functionData);
@@ -97,18 +102,17 @@ static void VS_CC getFrameAsync(int n, VSNode *clip, VSFrameDoneCallback fdc, vo
     clip->getFrame(ctx);
 }
 
+// The thread pool does the waiting, and the helping out while waiting, so only the result is kept here
 struct GetFrameWaiter {
-    std::mutex b;
-    std::condition_variable a;
     const VSFrame *r = nullptr;
     char *errorMsg;
     int bufSize;
+    std::atomic<bool> done{false};
     GetFrameWaiter(char *errorMsg, int bufSize) : errorMsg(errorMsg), bufSize(bufSize) {}
 };
 
 static void VS_CC frameWaiterCallback(void *userData, const VSFrame *frame, int n, VSNode *node, const char *errorMsg) VS_NOEXCEPT {
     GetFrameWaiter *g = static_cast<GetFrameWaiter *>(userData);
-    std::lock_guard<std::mutex> l(g->b);
     g->r = frame;
     if (g->errorMsg && g->bufSize > 0) {
         memset(g->errorMsg, 0, g->bufSize);
@@ -117,7 +121,7 @@ static void VS_CC frameWaiterCallback(void *userData, const VSFrame *frame, int
             g->errorMsg[g->bufSize - 1] = 0;
         }
     }
-    g->a.notify_one();
+    g->done = true;
 }
 
 static const VSFrame *VS_CC getFrame(int n, VSNode *node, char *errorMsg, int bufSize) VS_NOEXCEPT {
@@ -135,19 +139,22 @@ static const VSFrame *VS_CC getFrame(int n, VSNode *node, char *errorMsg, int bu
     }
 
     GetFrameWaiter g(errorMsg, bufSize);
-    std::unique_lock<std::mutex> l(g.b);
-    bool isWorker = node->isWorkerThread();
-    if (isWorker)
-        node->releaseThread();
-    node->getFrame(new VSFrameContext(n, node, &frameWaiterCallback, &g, false));
-    g.a.wait(l);
-    if (isWorker)
-        node->reserveThread();
+    node->getFrameSync(new VSFrameContext(n, node, &frameWaiterCallback, &g, false), g.done);
     return g.r;
 }
 
+// filters that don't know about large audio frames would only work with part of them
+static void checkAudioFrameSamples(VSNode *node, VSFrameContext *frameCtx) {
+    if (node->getNodeType() == mtVideo || node->getAudioFrameSamples() == VS_AUDIO_FRAME_SAMPLES || frameCtx->hasError())
+        return;
+    VSNode *requester = frameCtx->key.first;
+    if (!requester->acceptsAnyAudioFrameSamples())
+        frameCtx->setError(requester->getName() + ": input " + node->getName() + " has " + std::to_string(node->getAudioFrameSamples()) + " samples per frame but only " + std::to_string(VS_AUDIO_FRAME_SAMPLES) + " are supported, use std.AudioReframe() to convert it");
+}
+
 static void VS_CC requestFrameFilter(int n, VSNode *node, VSFrameContext *frameCtx) VS_NOEXCEPT {
     assert(node && frameCtx);
+    checkAudioFrameSamples(node, frameCtx);
     int numFrames = (node->getNodeType() == mtVideo) ? node->getVideoInfo().numFrames : node->getAudioInfo().numFrames;
     if (n >= numFrames)
         n = numFrames - 1;
@@ -171,6 +178,117 @@ static const VSFrame *VS_CC getFrameFilter(int n, VSNode *node, VSFrameContext *
     return nullptr;
 }
 
+static void VS_CC requestFrameRangeFilter(int first, int last, VSNode *node, VSFrameContext *frameCtx) VS_NOEXCEPT {
+    assert(node && frameCtx && first <= last);
+    checkAudioFrameSamples(node, frameCtx);
+    int numFrames = (node->getNodeType() == mtVideo) ? node->getVideoInfo().numFrames : node->getAudioInfo().numFrames;
+    first = std::max(first, 0);
+    last = std::min(last, numFrames - 1);
+    // out of range frames clamp to the first or last frame which is already part of the range
+    if (first > last)
+        first = last = std::min(first, numFrames - 1);
+    for (int n = first; n <= last; n++)
+        frameCtx->reqList.emplace_back(NodeOutputKey(node, n));
+}
+
+static int VS_CC getFrameRangeFilter(int first, int last, VSNode *node, VSFrameContext *frameCtx, const VSFrame **frames) VS_NOEXCEPT {
+    assert(node && frameCtx && frames && first <= last);
+    int numFrames = (node->getNodeType() == mtVideo) ? node->getVideoInfo().numFrames : node->getAudioInfo().numFrames;
+    int count = last - first + 1;
+    std::fill(frames, frames + count, nullptr);
+
+    // a single pass over the available frames, clamped positions are filled in afterwards
+    int lo = std::max(first, 0);
+    int hi = std::min(last, numFrames - 1);
+    if (lo > hi) {
+        // the whole range is outside the clip so everything maps to the same edge frame
+        const VSFrame *f = getFrameFilter(first, node, frameCtx);
+        if (!f)
+            return 1;
+        const_cast<VSFrame *>(f)->release();
+        std::fill(frames, frames + count, f);
+        lo = hi = first;
+    }
+
+    for (size_t i = 0; i < frameCtx->availableFrames.size(); i++) {
+        const auto &tmp = frameCtx->availableFrames[i];
+        if (tmp.first.first == node && tmp.first.second >= lo && tmp.first.second <= hi)
+            frames[tmp.first.second - first] = tmp.second.get();
+    }
+
+    for (int i = 0; i < count; i++) {
+        int n = std::min(std::max(first + i, lo), hi);
+        frames[i] = frames[n - first];
+        if (!frames[i]) {
+            std::fill(frames, frames + count, nullptr);
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+        const_cast<VSFrame *>(frames[i])->add_ref();
+    return 0;
+}
+
+static void VS_CC getFrameDeadlineAsync(int n, VSNode *clip, int64_t latency, const VSFrame *fallback, VSFrameDoneCallback fdc, void *userData) VS_NOEXCEPT {
+    assert(clip && fdc);
+    int numFrames = (clip->getNodeType() == mtVideo) ? clip->getVideoInfo().numFrames : clip->getAudioInfo().numFrames;
+    VSFrameContext *ctx = new VSFrameContext(n, clip, fdc, userData, true);
+
+    if (n < 0 || n >= numFrames)
+        ctx->setError("Invalid frame number " + std::to_string(n) + " requested, clip only has " + std::to_string(numFrames) + " frames");
+    else
+        ctx->setDeadline(latency, fallback);
+
+    clip->getFrame(ctx);
+}
+
+static VSFrameWindow *VS_CC attachFrameWindow(VSNode *node, int radius) VS_NOEXCEPT {
+    assert(node);
+    if (radius < 0)
+        return nullptr;
+    return new VSFrameWindow(node, radius);
+}
+
+static void VS_CC detachFrameWindow(VSFrameWindow *window) VS_NOEXCEPT {
+    delete window;
+}
+
+static void VS_CC requestFrameWindowFilter(int n, VSFrameWindow *window, VSFrameContext *frameCtx) VS_NOEXCEPT {
+    assert(window && frameCtx);
+    VSNode *node = window->node;
+    checkAudioFrameSamples(node, frameCtx);
+    int numFrames = (node->getNodeType() == mtVideo) ? node->getVideoInfo().numFrames : node->getAudioInfo().numFrames;
+    int first = std::max(n - window->radius, 0);
+    int last = std::min(n + window->radius, numFrames - 1);
+    if (first > last)
+        first = last = std::min(first, numFrames - 1);
+    window->request(first, last, frameCtx);
+}
+
+static int VS_CC getFrameWindowFilter(int n, VSFrameWindow *window, VSFrameContext *frameCtx, const VSFrame **frames) VS_NOEXCEPT {
+    assert(window && frameCtx && frames);
+    if (getFrameRangeFilter(n - window->radius, n + window->radius, window->node, frameCtx, frames))
+        return 1;
+    window->update(n, frameCtx);
+    return 0;
+}
+
+static int VS_CC cancelFrameAsync(int n, VSNode *node, VSFrameDoneCallback callback, void *userData) VS_NOEXCEPT {
+    assert(node && callback);
+    return static_cast<int>(node->cancelFrames(n, callback, userData));
+}
+
+static void VS_CC parallelFor(int count, VSParallelForFunc func, void *userData, VSCore *core) VS_NOEXCEPT {
+    assert(func && core);
+    core->threadPool->parallelFor(count, func, userData);
+}
+
+static int VS_CC setFilterStripe(VSNode *node, VSFilterStripe stripe, int radius, int planes) VS_NOEXCEPT {
+    assert(node && stripe);
+    return node->setFilterStripe(stripe, radius, planes);
+}
+
 static void VS_CC freeFrame(const VSFrame *frame) VS_NOEXCEPT {
     if (frame)
         const_cast<VSFrame *>(frame)->release();
@@ -183,6 +301,8 @@ static void VS_CC freeNode(VSNode *clip) VS_NOEXCEPT {
 
 static VSFrame *VS_CC newVideoFrame(const VSVideoFormat *format, int width, int height, const VSFrame *propSrc, VSCore *core) VS_NOEXCEPT {
     assert(format && core);
+    if (VSFrame *f = VSFrameContext::takePlacement(*format, width, height, propSrc))
+        return f;
     return new VSFrame(*format, width, height, propSrc, core);
 }
 
@@ -348,7 +468,16 @@ static char VS_CC propGetType3(const VSMap *map, const char *key) VS_NOEXCEPT {
     }
 }
 
-static VSArrayBase *propGetShared(const VSMap *map, const char *key, int index, int *error, VSPropertyType propType) noexcept {
+static inline std::string keyName(const char *key) {
+    return key;
+}
+
+static inline const std::string &keyName(const VSMapKey *key) {
+    return key->name;
+}
+
+template<typename K>
+static VSArrayBase *propGetShared(const VSMap *map, const K &key, int index, int *error, VSPropertyType propType) noexcept {
     assert(map && key && index >= 0);
 
     if (error)
@@ -358,7 +487,7 @@ static VSArrayBase *propGetShared(const VSMap *map, const char *key, int index,
         if (error)
             *error = peError;
         else
-            VS_FATAL_ERROR(("Property read unsuccessful on map with error set but no error output: " + std::string(key)).c_str());
+            VS_FATAL_ERROR(("Property read unsuccessful on map with error set but no error output: " + keyName(key)).c_str());
         return nullptr;
     }
 
@@ -368,7 +497,7 @@ static VSArrayBase *propGetShared(const VSMap *map, const char *key, int index,
         if (error)
             *error = peUnset;
         else
-            VS_FATAL_ERROR(("Property read unsuccessful due to missing key but no error output: " + std::string(key)).c_str());
+            VS_FATAL_ERROR(("Property read unsuccessful due to missing key but no error output: " + keyName(key)).c_str());
         return nullptr;
     }
 
@@ -376,7 +505,7 @@ static VSArrayBase *propGetShared(const VSMap *map, const char *key, int index,
         if (error)
             *error = peIndex;
         else
-            VS_FATAL_ERROR(("Property read unsuccessful due to out of bounds index but no error output: " + std::string(key)).c_str());
+            VS_FATAL_ERROR(("Property read unsuccessful due to out of bounds index but no error output: " + keyName(key)).c_str());
         return nullptr;
     }
 
@@ -384,7 +513,7 @@ static VSArrayBase *propGetShared(const VSMap *map, const char *key, int index,
         if (error)
             *error = peType;
         else
-            VS_FATAL_ERROR(("Property read unsuccessful due to wrong type but no error output: " + std::string(key)).c_str());
+            VS_FATAL_ERROR(("Property read unsuccessful due to wrong type but no error output: " + keyName(key)).c_str());
         return nullptr;
     }
 
@@ -418,7 +547,7 @@ static float VS_CC mapGetFloatSaturated(const VSMap *map, const char *key, int i
 static const char *VS_CC mapGetData(const VSMap *map, const char *key, int index, int *error) VS_NOEXCEPT {
     VSArrayBase *arr = propGetShared(map, key, index, error, ptData);
     if (arr)
-        return reinterpret_cast<const VSDataArray *>(arr)->at(index).data.c_str();
+        return reinterpret_cast<const VSDataArray *>(arr)->at(index).getData();
     else
         return nullptr;
 }
@@ -426,7 +555,7 @@ static const char *VS_CC mapGetData(const VSMap *map, const char *key, int index
 static int VS_CC mapGetDataSize(const VSMap *map, const char *key, int index, int *error) VS_NOEXCEPT {
     VSArrayBase *arr = propGetShared(map, key, index, error, ptData);
     if (arr)
-        return static_cast<int>(reinterpret_cast<const VSDataArray *>(arr)->at(index).data.size());
+        return static_cast<int>(reinterpret_cast<const VSDataArray *>(arr)->at(index).getSize());
     else
         return -1;
 }
@@ -549,15 +678,19 @@ static int VS_CC mapSetEmpty(VSMap *map, const char *key, int type) VS_NOEXCEPT
     return 0;
 }
 
-template<typename T, VSPropertyType propType>
-bool propSetShared(VSMap *map, const char *key, const T &val, int append) {
+static bool isValidVSMapKey(const VSMapKey *) {
+    return true; // checked by getMapKey()
+}
+
+template<typename T, VSPropertyType propType, typename K>
+bool propSetShared(VSMap *map, const K &key, const T &val, int append) {
     assert(map && key);
     if (append != maReplace && append != maAppend && append != vs3::paTouch)
-        VS_FATAL_ERROR(("Invalid prop append mode given when setting key '" + std::string(key) + "'").c_str());
+        VS_FATAL_ERROR(("Invalid prop append mode given when setting key '" + keyName(key) + "'").c_str());
 
     if (!isValidVSMapKey(key))
         return false;
-    std::string skey = key;
+    const auto &skey = key;
 
     if (append == maReplace) {
         VSArray<T, propType> *v = new VSArray<T, propType>();
@@ -579,7 +712,7 @@ bool propSetShared(VSMap *map, const char *key, const T &val, int append) {
             return true;
         }
     } else /* if (append == vs3::paTouch) */ {
-        return !mapSetEmpty(map, key, propType);
+        return !mapSetEmpty(map, keyName(key).c_str(), propType);
     }
 }
 
@@ -591,10 +724,224 @@ static int VS_CC mapSetFloat(VSMap *map, const char *key, double d, int append)
     return !propSetShared<double, ptFloat>(map, key, d, append);
 }
 
+static const VSMapKey *VS_CC getMapKey(const char *key) VS_NOEXCEPT {
+    if (!isValidVSMapKey(key))
+        return nullptr;
+    return VSMapKey::intern(key, strlen(key));
+}
+
+static int VS_CC mapNumElementsKey(const VSMap *map, const VSMapKey *key) VS_NOEXCEPT {
+    assert(map && key);
+    VSArrayBase *val = map->find(key);
+    return val ? static_cast<int>(val->size()) : -1;
+}
+
+static int64_t VS_CC mapGetIntKey(const VSMap *map, const VSMapKey *key, int index, int *error) VS_NOEXCEPT {
+    VSArrayBase *arr = propGetShared(map, key, index, error, ptInt);
+    return arr ? reinterpret_cast<const VSIntArray *>(arr)->at(index) : 0;
+}
+
+static int VS_CC mapSetIntKey(VSMap *map, const VSMapKey *key, int64_t i, int append) VS_NOEXCEPT {
+    return !propSetShared<int64_t, ptInt>(map, key, i, append);
+}
+
+static double VS_CC mapGetFloatKey(const VSMap *map, const VSMapKey *key, int index, int *error) VS_NOEXCEPT {
+    VSArrayBase *arr = propGetShared(map, key, index, error, ptFloat);
+    return arr ? reinterpret_cast<const VSFloatArray *>(arr)->at(index) : 0;
+}
+
+static int VS_CC mapSetFloatKey(VSMap *map, const VSMapKey *key, double d, int append) VS_NOEXCEPT {
+    return !propSetShared<double, ptFloat>(map, key, d, append);
+}
+
+static void VS_CC setNodeReuse(VSCore *core, int enable) VS_NOEXCEPT {
+    assert(core);
+    core->setNodeReuse(!!enable);
+}
+
+static int VS_CC releaseUnusedNodes(VSCore *core) VS_NOEXCEPT {
+    assert(core);
+    return core->releaseUnusedNodes();
+}
+
+static void VS_CC setFilterHints(VSNode *node, int cost, int temporalRadius, int spatialRadius) VS_NOEXCEPT {
+    assert(node);
+    node->setFilterHints(cost, temporalRadius, spatialRadius);
+}
+
 static int VS_CC mapSetData(VSMap *map, const char *key, const char *d, int length, int type, int append) VS_NOEXCEPT {
     return !propSetShared<VSMapData, ptData>(map, key, { static_cast<VSDataTypeHint>(type), (length >= 0) ? std::string(d, length) : std::string(d) }, append);
 }
 
+static int VS_CC mapConsumeData(VSMap *map, const char *key, const char *d, int length, int type, VSFreeFunctionData free, void *userData, int append) VS_NOEXCEPT {
+    assert(d && length >= 0);
+    PVSDataBlob blob(new VSDataBlob(d, length, free, userData));
+    return !propSetShared<VSMapData, ptData>(map, key, { static_cast<VSDataTypeHint>(type), blob }, append);
+}
+
+static int VS_CC mapShareData(VSMap *dst, const char *dstKey, const VSMap *src, const char *srcKey, int index, int append) VS_NOEXCEPT {
+    int error = 0;
+    VSArrayBase *arr = propGetShared(src, srcKey, index, &error, ptData);
+    if (!arr)
+        return 1;
+    // a copy of the element so it stays valid when dst and src are the same map
+    VSMapData data = reinterpret_cast<const VSDataArray *>(arr)->at(index);
+    return !propSetShared<VSMapData, ptData>(dst, dstKey, data, append);
+}
+
+static void VS_CC setNodeMemoization(VSNode *node, int maxFrames) VS_NOEXCEPT {
+    assert(node);
+    node->setMemoization(maxFrames);
+}
+
+static void VS_CC setSharedResourceLimits(int threads, int64_t memoryBytes) VS_NOEXCEPT {
+    VSSharedBudget::instance().setLimits(threads, memoryBytes);
+}
+
+static void VS_CC setNodeSeekSensitive(VSNode *node, int enabled) VS_NOEXCEPT {
+    assert(node);
+    node->setSeekSensitive(!!enabled);
+}
+
+static void VS_CC getFrameRegionAsync(int n, VSNode *clip, int left, int top, int width, int height, VSFrameDoneCallback fdc, void *userData) VS_NOEXCEPT {
+    assert(clip && fdc);
+    int numFrames = (clip->getNodeType() == mtVideo) ? clip->getVideoInfo().numFrames : clip->getAudioInfo().numFrames;
+    VSFrameContext *ctx = new VSFrameContext(n, clip, fdc, userData, true);
+
+    if (n < 0 || n >= numFrames)
+        ctx->setError("Invalid frame number " + std::to_string(n) + " requested, clip only has " + std::to_string(numFrames) + " frames");
+    else if (width > 0 && height > 0)
+        ctx->region = VSFrameContext::makeRegion(left, top, static_cast<int64_t>(left) + width, static_cast<int64_t>(top) + height, clip);
+
+    clip->getFrame(ctx);
+}
+
+static void VS_CC requestFrameRegionFilter(int n, VSNode *node, int left, int top, int width, int height, VSFrameContext *frameCtx) VS_NOEXCEPT {
+    assert(node && frameCtx);
+    int numFrames = (node->getNodeType() == mtVideo) ? node->getVideoInfo().numFrames : node->getAudioInfo().numFrames;
+    if (n >= numFrames)
+        n = numFrames - 1;
+    NodeOutputKey key(node, n);
+    frameCtx->reqList.emplace_back(key);
+    if (width > 0 && height > 0) {
+        VSFrameContext::Region region = VSFrameContext::makeRegion(left, top, static_cast<int64_t>(left) + width, static_cast<int64_t>(top) + height, node);
+        if (!region.isWholeFrame())
+            frameCtx->regions.push_back(std::make_pair(key, region));
+    }
+}
+
+static int VS_CC getRequestedRegion(VSFrameContext *frameCtx, int *left, int *top, int *width, int *height) VS_NOEXCEPT {
+    assert(frameCtx);
+    const VSFrameContext::Region &region = frameCtx->region;
+    if (region.isWholeFrame() || region.propsOnly)
+        return 0;
+    if (left)
+        *left = region.left;
+    if (top)
+        *top = region.top;
+    if (width)
+        *width = region.width;
+    if (height)
+        *height = region.height;
+    return 1;
+}
+
+static void VS_CC getFramePropsAsync(int n, VSNode *clip, VSFrameDoneCallback fdc, void *userData) VS_NOEXCEPT {
+    assert(clip && fdc);
+    int numFrames = (clip->getNodeType() == mtVideo) ? clip->getVideoInfo().numFrames : clip->getAudioInfo().numFrames;
+    VSFrameContext *ctx = new VSFrameContext(n, clip, fdc, userData, true);
+
+    if (n < 0 || n >= numFrames)
+        ctx->setError("Invalid frame number " + std::to_string(n) + " requested, clip only has " + std::to_string(numFrames) + " frames");
+    else
+        ctx->region.propsOnly = true;
+
+    clip->getFrame(ctx);
+}
+
+static void VS_CC requestFramePropsFilter(int n, VSNode *node, VSFrameContext *frameCtx) VS_NOEXCEPT {
+    assert(node && frameCtx);
+    checkAudioFrameSamples(node, frameCtx);
+    int numFrames = (node->getNodeType() == mtVideo) ? node->getVideoInfo().numFrames : node->getAudioInfo().numFrames;
+    if (n >= numFrames)
+        n = numFrames - 1;
+    NodeOutputKey key(node, n);
+    frameCtx->reqList.emplace_back(key);
+    VSFrameContext::Region region;
+    region.propsOnly = true;
+    frameCtx->regions.push_back(std::make_pair(key, region));
+}
+
+static int VS_CC isPropsOnlyRequest(VSFrameContext *frameCtx) VS_NOEXCEPT {
+    assert(frameCtx);
+    return frameCtx->region.propsOnly;
+}
+
+static void VS_CC setProxyScale(VSCore *core, int scale) VS_NOEXCEPT {
+    assert(core);
+    core->setProxyScale(scale);
+}
+
+static int VS_CC getNodeProxyScale(VSNode *node) VS_NOEXCEPT {
+    assert(node);
+    return node->getProxyScale();
+}
+
+static int VS_CC setDeviceMemoryFunctions(const VSDeviceMemoryFunctions *funcs, VSCore *core) VS_NOEXCEPT {
+    assert(funcs && core);
+    return core->memory->device.setFunctions(funcs);
+}
+
+static int VS_CC getDeviceType(VSCore *core) VS_NOEXCEPT {
+    assert(core);
+    return core->memory->device.getDeviceType();
+}
+
+static int64_t VS_CC setDeviceMemoryLimit(int64_t bytes, VSCore *core) VS_NOEXCEPT {
+    assert(core);
+    return core->memory->device.setLimit(bytes);
+}
+
+static VSFrame *VS_CC newVideoFrameDevice(const VSVideoFormat *format, int width, int height, const VSFrame *propSrc, VSCore *core) VS_NOEXCEPT {
+    assert(format && core);
+    return new VSFrame(*format, width, height, propSrc, core, true);
+}
+
+static const void *VS_CC getReadDevicePtr(const VSFrame *f, int plane) VS_NOEXCEPT {
+    assert(f);
+    return f->getReadDevicePtr(plane);
+}
+
+static void *VS_CC getWriteDevicePtr(VSFrame *f, int plane) VS_NOEXCEPT {
+    assert(f);
+    return f->getWriteDevicePtr(plane);
+}
+
+static int VS_CC getPlaneResidency(const VSFrame *f, int plane) VS_NOEXCEPT {
+    assert(f);
+    return f->getPlaneResidency(plane);
+}
+
+static int VS_CC setDeviceComputeFunctions(const VSDeviceComputeFunctions *funcs, VSCore *core) VS_NOEXCEPT {
+    assert(funcs && core);
+    return core->memory->device.setComputeFunctions(funcs);
+}
+
+static VSFrame *VS_CC newVideoFrameExternal(const VSVideoFormat *format, int width, int height, const uint8_t * const *planes, const ptrdiff_t *strides, VSFreeExternalMemory free, void *userData, const VSFrame *propSrc, VSCore *core) VS_NOEXCEPT {
+    assert(format && planes && strides && core);
+    return new VSFrame(*format, width, height, planes, strides, free, userData, propSrc, core);
+}
+
+static int VS_CC setAudioFrameSamples(VSNode *node, int samples) VS_NOEXCEPT {
+    assert(node);
+    return node->setAudioFrameSamples(samples);
+}
+
+static int VS_CC getAudioFrameSamples(VSNode *node) VS_NOEXCEPT {
+    assert(node);
+    return (node->getNodeType() == mtAudio) ? node->getAudioFrameSamples() : 0;
+}
+
 static int VS_CC propSetData3(VSMap *map, const char *key, const char *d, int length, int append) VS_NOEXCEPT {
     return mapSetData(map, key, d, length, dtUnknown, append);
 }
@@ -777,6 +1124,16 @@ static VSFunction *VS_CC createFunction3(vs3::VSPublicFunction func, void *userD
     return new VSFunction(reinterpret_cast<VSPublicFunction>(func), userData, free, core, VAPOURSYNTH3_API_MAJOR);
 }
 
+static VSFunction *VS_CC createFrameCallFunction(VSFrameCallFunction func, void *userData, VSFreeFunctionData free, VSCore *core) VS_NOEXCEPT {
+    assert(func && core);
+    return new VSFunction(func, userData, free, core);
+}
+
+static int VS_CC callFrameFunction(VSFunction *func, int n, const VSFrame * const *frames, int numFrames, VSFrameCallResult *result) VS_NOEXCEPT {
+    assert(func && (frames || !numFrames) && result);
+    return func->callFrame(n, frames, numFrames, result);
+}
+
 static void VS_CC freeFunction(VSFunction *f) VS_NOEXCEPT {
     if (f)
         f->release();
@@ -792,7 +1149,7 @@ static void VS_CC queryCompletedFrame3(VSNode **node, int *n, VSFrameContext *fr
 static void VS_CC releaseFrameEarly(VSNode *node, int n, VSFrameContext *frameCtx) VS_NOEXCEPT {
     assert(node && frameCtx);
     auto key = NodeOutputKey(node, n);
-    for (size_t i = 0; i < frameCtx->reqList.size(); i++) {
+    for (size_t i = 0; i < frameCtx->availableFrames.size(); i++) {
         auto &tmp = frameCtx->availableFrames[i];
         if (tmp.first == key) {
             tmp.first = NodeOutputKey(nullptr, -1);
@@ -902,6 +1259,11 @@ static int VS_CC removeLogHandler(VSLogHandle *handle, VSCore *core) VS_NOEXCEPT
     return core->removeLogHandler(reinterpret_cast<VSLogHandle *>(handle));
 }
 
+static void VS_CC setNodeAccessPattern(VSNode *node, int pattern, int lookahead) VS_NOEXCEPT {
+    assert(node);
+    node->setAccessPattern(pattern, lookahead);
+}
+
 static void VS_CC logMessage3(int msgType, const char *msg) VS_NOEXCEPT {
     vsLog3(static_cast<vs3::VSMessageType>(msgType), "%s", msg);
 }
@@ -1031,6 +1393,11 @@ static const VSMap *VS_CC getNodeCreationFunctionArguments(VSNode *node, int lev
     return node->getCreationFunctionArguments(level);
 }
 
+static const char *VS_CC getNodeCreationFunctionOutput(VSNode *node, int level, int *index) VS_NOEXCEPT {
+    assert(node);
+    return node->getCreationFunctionOutput(level, index);
+}
+
 static const char *VS_CC getNodeName(VSNode *node) VS_NOEXCEPT {
     assert(node);
     return node->getName().c_str();
@@ -1056,10 +1423,51 @@ static int VS_CC getNumNodeDependencies(VSNode *node) VS_NOEXCEPT {
     return static_cast<int>(node->getNumDependencies());
 }
 
+static int VS_CC getNodeCacheBudget(VSNode *node) VS_NOEXCEPT {
+    assert(node);
+    return node->getCacheBudget();
+}
+
+static void VS_CC getNodeCompressedCacheStats(VSNode *node, int64_t *hits, int64_t *misses, int64_t *size) VS_NOEXCEPT {
+    assert(node);
+    node->getCompressedCacheStats(hits, misses, size);
+}
+
+static void VS_CC getNodeStats(VSNode *node, VSNodeStats *stats) VS_NOEXCEPT {
+    assert(node && stats);
+    node->getStats(stats);
+}
+
+static void VS_CC getCoreTrace(VSCore *core, VSMap *out) VS_NOEXCEPT {
+    assert(core && out);
+    if (core->tracer) {
+        std::string trace = core->tracer->toJSON();
+        vs_internal_vsapi.mapSetData(out, "trace", trace.c_str(), static_cast<int>(trace.size()), dtUtf8, maReplace);
+    } else {
+        vs_internal_vsapi.mapSetError(out, "Tracing wasn't enabled when the core was created");
+    }
+}
+
+static void VS_CC getNodeFilterHints(VSNode *node, int *cost, int *temporalRadius, int *spatialRadius) VS_NOEXCEPT {
+    assert(node);
+    node->getFilterHints(cost, temporalRadius, spatialRadius);
+}
+
+static void VS_CC getCoreStats(VSCore *core, VSCoreStats *stats) VS_NOEXCEPT {
+    assert(core && stats);
+    core->threadPool->getStats(stats);
+}
+
+static void VS_CC getNodeMemoryStats(VSNode *node, VSNodeMemoryStats *stats) VS_NOEXCEPT {
+    assert(node && stats);
+    node->getMemoryStats(stats);
+}
+
 const VSPLUGINAPI vs_internal_vspapi {
     &getAPIVersion,
     &configPlugin,
-    &registerFunction
+    &registerFunction,
+    &setFunctionFlags
 };
 
 const VSAPI vs_internal_vsapi = {
@@ -1195,7 +1603,72 @@ const VSAPI vs_internal_vsapi = {
     &getNodeFilterMode,
     &getNodeFilterTime,
     &getNodeDependencies,
-    &getNumNodeDependencies
+    &getNumNodeDependencies,
+
+    &setNodeAccessPattern,
+
+    &requestFrameRangeFilter,
+    &getFrameRangeFilter,
+
+    &parallelFor,
+
+    &cancelFrameAsync,
+
+    &setFilterStripe,
+
+    &getMapKey,
+    &mapNumElementsKey,
+    &mapGetIntKey,
+    &mapSetIntKey,
+    &mapGetFloatKey,
+    &mapSetFloatKey,
+
+    &setNodeReuse,
+    &releaseUnusedNodes,
+
+    &setFilterHints,
+
+    &mapConsumeData,
+    &mapShareData,
+
+    &setNodeMemoization,
+    &setSharedResourceLimits,
+    &setNodeSeekSensitive,
+    &getFrameRegionAsync,
+    &requestFrameRegionFilter,
+    &getRequestedRegion,
+    &setProxyScale,
+    &getNodeProxyScale,
+    &getFramePropsAsync,
+    &requestFramePropsFilter,
+    &isPropsOnlyRequest,
+    &setDeviceMemoryFunctions,
+    &getDeviceType,
+    &setDeviceMemoryLimit,
+    &newVideoFrameDevice,
+    &getReadDevicePtr,
+    &getWriteDevicePtr,
+    &getPlaneResidency,
+    &setDeviceComputeFunctions,
+    &newVideoFrameExternal,
+    &setAudioFrameSamples,
+    &getAudioFrameSamples,
+    &createFrameCallFunction,
+    &callFrameFunction,
+    &getFrameDeadlineAsync,
+    &attachFrameWindow,
+    &detachFrameWindow,
+    &requestFrameWindowFilter,
+    &getFrameWindowFilter,
+
+    &getNodeCacheBudget,
+    &getNodeCompressedCacheStats,
+    &getNodeStats,
+    &getCoreTrace,
+    &getNodeFilterHints,
+    &getCoreStats,
+    &getNodeCreationFunctionOutput,
+    &getNodeMemoryStats
 };
 
 const vs3::VSAPI3 vs_internal_vsapi3 = {
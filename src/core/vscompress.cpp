@@ -0,0 +1,165 @@
+/*
+* Copyright (c) 2012-2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "vscompress.h"
+#include <cstring>
+
+// The stream is a sequence of tokens. Every token starts with a byte where the high nibble is the
+// number of literals and the low nibble the match length minus minMatch, a nibble value of 15 means
+// more length bytes follow (255 means continue). The literals follow and then a two byte little
+// endian match offset. The final token only has literals and ends the stream.
+
+static const size_t minMatch = 4;
+static const size_t hashBits = 14;
+static const size_t maxOffset = 65535;
+static const size_t lastLiterals = 8; // the tail is always stored as literals so the match search never reads past the end
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash32(uint32_t v) {
+    return (v * 2654435761U) >> (32 - hashBits);
+}
+
+static inline uint8_t *writeLength(uint8_t *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = static_cast<uint8_t>(len);
+    return op;
+}
+
+static inline uint8_t *writeSequence(uint8_t *op, const uint8_t *literals, size_t numLiterals, size_t matchLength, size_t offset) {
+    uint8_t *token = op++;
+    *token = static_cast<uint8_t>(((numLiterals >= 15) ? 15 : numLiterals) << 4);
+    if (numLiterals >= 15)
+        op = writeLength(op, numLiterals - 15);
+    memcpy(op, literals, numLiterals);
+    op += numLiterals;
+
+    if (matchLength) {
+        *op++ = static_cast<uint8_t>(offset & 0xFF);
+        *op++ = static_cast<uint8_t>(offset >> 8);
+        size_t ml = matchLength - minMatch;
+        *token |= static_cast<uint8_t>((ml >= 15) ? 15 : ml);
+        if (ml >= 15)
+            op = writeLength(op, ml - 15);
+    }
+    return op;
+}
+
+size_t vs_lz_compress_bound(size_t srcSize) {
+    return srcSize + srcSize / 255 + 16;
+}
+
+size_t vs_lz_compress(const uint8_t *src, size_t srcSize, uint8_t *dst) {
+    uint32_t table[1 << hashBits] = {};
+    uint8_t *op = dst;
+    size_t anchor = 0;
+    size_t ip = 1; // position 0 can't be distinguished from an empty table entry so it's never matched against
+
+    if (srcSize > lastLiterals + minMatch) {
+        size_t limit = srcSize - lastLiterals - minMatch;
+        while (ip < limit) {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = hash32(seq);
+            size_t ref = table[h];
+            table[h] = static_cast<uint32_t>(ip);
+
+            if (!ref || ip - ref > maxOffset || read32(src + ref) != seq) {
+                // skip ahead faster in data that doesn't compress
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            size_t matchLength = minMatch;
+            size_t matchLimit = srcSize - lastLiterals;
+            while (ip + matchLength < matchLimit && src[ip + matchLength] == src[ref + matchLength])
+                matchLength++;
+
+            op = writeSequence(op, src + anchor, ip - anchor, matchLength, ip - ref);
+            ip += matchLength;
+            anchor = ip;
+        }
+    }
+
+    return writeSequence(op, src + anchor, srcSize - anchor, 0, 0) - dst;
+}
+
+static inline bool readLength(const uint8_t *&ip, const uint8_t *end, size_t &len) {
+    uint8_t v;
+    do {
+        if (ip >= end)
+            return false;
+        v = *ip++;
+        len += v;
+    } while (v == 255);
+    return true;
+}
+
+bool vs_lz_decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize) {
+    const uint8_t *ip = src;
+    const uint8_t *end = src + srcSize;
+    size_t op = 0;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t numLiterals = token >> 4;
+        if (numLiterals == 15 && !readLength(ip, end, numLiterals))
+            return false;
+        if (numLiterals > static_cast<size_t>(end - ip) || numLiterals > dstSize - op)
+            return false;
+        memcpy(dst + op, ip, numLiterals);
+        ip += numLiterals;
+        op += numLiterals;
+
+        // the last sequence has no match
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            return false;
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(ip, end, matchLength))
+            return false;
+        matchLength += minMatch;
+
+        if (offset == 0 || offset > op || matchLength > dstSize - op)
+            return false;
+
+        // matches may overlap the output so copy byte by byte when they do
+        const uint8_t *ref = dst + op - offset;
+        if (offset >= matchLength) {
+            memcpy(dst + op, ref, matchLength);
+        } else {
+            for (size_t i = 0; i < matchLength; i++)
+                dst[op + i] = ref[i];
+        }
+        op += matchLength;
+    }
+
+    return op == dstSize;
+}
@@ -0,0 +1,37 @@
+/*
+* Copyright (c) 2012-2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+// A small LZ77 style byte compressor in the spirit of LZ4, used for keeping
+// evicted frames around in compressed form. Speed matters far more than ratio.
+
+#ifndef VSCOMPRESS_H
+#define VSCOMPRESS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// the largest possible output size of vs_lz_compress for the given input size
+size_t vs_lz_compress_bound(size_t srcSize);
+// returns the number of bytes written to dst which must have room for vs_lz_compress_bound(srcSize) bytes
+size_t vs_lz_compress(const uint8_t *src, size_t srcSize, uint8_t *dst);
+// returns false if the compressed data is corrupt or doesn't decompress to exactly dstSize bytes
+bool vs_lz_decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize);
+
+#endif // VSCOMPRESS_H
@@ -26,6 +26,8 @@
 #include <dirent.h>
 #include <cstddef>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "settings.h"
 #endif
 #include <cassert>
@@ -48,6 +50,9 @@
 
 // Internal filter headers
 #include "internalfilters.h"
+#include "vscompress.h"
+#include "kernel/copy.h"
+#include "kernel/cpulevel.h"
 
 #ifdef VS_USE_MIMALLOC
 #   include <mimalloc-new-delete.h>
@@ -108,10 +113,71 @@ static std::wstring readRegistryValue(const wchar_t *keyName, const wchar_t *val
 VSFrameContext::VSFrameContext(NodeOutputKey key, const PVSFrameContext &notify) :
     refcount(1), reqOrder(notify->reqOrder), external(false), lockOnOutput(true), frameDone(nullptr),  userData(nullptr), key(key), frameContext() {
     notifyCtxList.push_back(notify);
+    reserveRequests();
+}
+
+VSFrameContext::VSFrameContext(NodeOutputKey key, uint64_t reqOrder) :
+    refcount(1), reqOrder(reqOrder), external(false), lockOnOutput(true), speculative(true), frameDone(nullptr), userData(nullptr), key(key), frameContext() {
+    reserveRequests();
 }
 
 VSFrameContext::VSFrameContext(int n, VSNode *node, VSFrameDoneCallback frameDone, void *userData, bool lockOnOutput) :
     refcount(1), reqOrder(0), external(true), lockOnOutput(lockOnOutput), frameDone(frameDone), userData(userData), key(node, n), frameContext() {
+    reserveRequests();
+}
+
+void VSFrameContext::setDeadline(int64_t latency, const VSFrame *fallbackFrame) {
+    deadline = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() + std::max<int64_t>(latency, 0);
+    if (fallbackFrame)
+        fallback = PVSFrame(const_cast<VSFrame *>(fallbackFrame), true);
+}
+
+void VSFrameContext::reserveRequests() {
+    size_t capacity = key.first->getRequestCapacity();
+    reqList.reserve(capacity);
+    availableFrames.reserve(capacity);
+}
+
+// Grows the region to whole chroma samples and clips it to the frame, a region covering all of
+// it or a clip of variable format or size is the same as asking for the whole frame
+VSFrameContext::Region VSFrameContext::makeRegion(int64_t left, int64_t top, int64_t right, int64_t bottom, const VSNode *node) {
+    Region region;
+    if (node->getNodeType() != mtVideo)
+        return region;
+    const VSVideoInfo &vi = node->getVideoInfo();
+    if (!isConstantVideoFormat(&vi))
+        return region;
+
+    int64_t alignW = static_cast<int64_t>(1) << vi.format.subSamplingW;
+    int64_t alignH = static_cast<int64_t>(1) << vi.format.subSamplingH;
+    left = std::max<int64_t>(left & ~(alignW - 1), 0);
+    top = std::max<int64_t>(top & ~(alignH - 1), 0);
+    right = std::min<int64_t>((right + alignW - 1) & ~(alignW - 1), vi.width);
+    bottom = std::min<int64_t>((bottom + alignH - 1) & ~(alignH - 1), vi.height);
+    if (right <= left || bottom <= top || (left == 0 && top == 0 && right == vi.width && bottom == vi.height))
+        return region;
+
+    region.left = static_cast<int>(left);
+    region.top = static_cast<int>(top);
+    region.width = static_cast<int>(right - left);
+    region.height = static_cast<int>(bottom - top);
+    return region;
+}
+
+thread_local VSFrameContext *VSFrameContext::currentPlacement = nullptr;
+
+VSFrame *VSFrameContext::takePlacement(const VSVideoFormat &format, int width, int height, const VSFrame *propSrc) {
+    VSFrameContext *ctx = currentPlacement;
+    if (!ctx || width != ctx->placement.width || height != ctx->placement.height || !isSameVideoFormat(&format, ctx->placement.target->getVideoFormat()))
+        return nullptr;
+
+    // only the first matching frame is placed, that's almost always the one that gets returned
+    currentPlacement = nullptr;
+    PVSFrame target = std::move(ctx->placement.target);
+    VSFrame *f = new VSFrame(*target, ctx->placement.left, ctx->placement.top, width, height);
+    f->setProperties(VSMap(propSrc ? &propSrc->getConstProperties() : nullptr));
+    f->setRenderTarget(true);
+    return f;
 }
 
 bool VSFrameContext::setError(const std::string &errorMsg) {
@@ -124,18 +190,40 @@ bool VSFrameContext::setError(const std::string &errorMsg) {
 
 ///////////////
 
-bool VSMap::isV3Compatible() const noexcept {
-    for (const auto &iter : data->data) {
-        if (iter.second->type() == ptAudioNode || iter.second->type() == ptAudioFrame || iter.second->type() == ptUnset)
-            return false;
-    }
-    return true;
+// An insert only hash table so looking up keys that already exist never takes a lock, keys are never freed
+static constexpr size_t numMapKeyBuckets = 4096;
+static std::atomic<VSMapKey *> mapKeyBuckets[numMapKeyBuckets];
+static std::mutex mapKeyInsertLock;
+
+const VSMapKey *VSMapKey::intern(const char *key, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ static_cast<uint8_t>(key[i])) * 1099511628211ULL;
+
+    std::atomic<VSMapKey *> &bucket = mapKeyBuckets[hash % numMapKeyBuckets];
+    for (VSMapKey *k = bucket.load(std::memory_order_acquire); k; k = k->next)
+        if (k->hash == hash && k->name.size() == length && !memcmp(k->name.data(), key, length))
+            return k;
+
+    std::lock_guard<std::mutex> lock(mapKeyInsertLock);
+    VSMapKey *head = bucket.load(std::memory_order_relaxed);
+    for (VSMapKey *k = head; k; k = k->next)
+        if (k->hash == hash && k->name.size() == length && !memcmp(k->name.data(), key, length))
+            return k;
+
+    VSMapKey *k = new VSMapKey{ std::string(key, length), hash, head };
+    bucket.store(k, std::memory_order_release);
+    return k;
 }
 
 VSFunction::VSFunction(VSPublicFunction func, void *userData, VSFreeFunctionData freeFunction, VSCore *core, int apiMajor) : refcount(1), func(func), userData(userData), freeFunction(freeFunction), core(core), apiMajor(apiMajor) {
     core->functionInstanceCreated();
 }
 
+VSFunction::VSFunction(VSFrameCallFunction func, void *userData, VSFreeFunctionData freeFunction, VSCore *core) : refcount(1), func(nullptr), frameFunc(func), userData(userData), freeFunction(freeFunction), core(core), apiMajor(VAPOURSYNTH_API_MAJOR) {
+    core->functionInstanceCreated();
+}
+
 VSFunction::~VSFunction() {
     if (freeFunction)
         freeFunction(userData);
@@ -147,10 +235,43 @@ void VSFunction::call(const VSMap *in, VSMap *out) {
         vs_internal_vsapi.mapSetError(out, "Function was passed values that are unknown to its API version");
         return;
     }
-        
+
+    if (frameFunc) {
+        int err;
+        int n = static_cast<int>(vs_internal_vsapi.mapGetInt(in, "n", 0, &err));
+        int numFrames = std::max(0, vs_internal_vsapi.mapNumElements(in, "f"));
+        std::vector<const VSFrame *> frames;
+        for (int i = 0; i < numFrames; i++)
+            frames.push_back(vs_internal_vsapi.mapGetFrame(in, "f", i, nullptr));
+
+        VSFrameCallResult result = {};
+        frameFunc(n, frames.data(), numFrames, &result, userData, core, &vs_internal_vsapi);
+        for (auto iter : frames)
+            vs_internal_vsapi.freeFrame(iter);
+
+        if (result.error) {
+            vs_internal_vsapi.freeNode(result.node);
+            vs_internal_vsapi.freeFrame(result.frame);
+            vs_internal_vsapi.mapSetError(out, result.error);
+        } else if (result.node) {
+            vs_internal_vsapi.mapConsumeNode(out, "val", result.node, maReplace);
+        } else if (result.frame) {
+            vs_internal_vsapi.mapConsumeFrame(out, "val", result.frame, maReplace);
+        }
+        return;
+    }
+
     func(in, out, userData, core, getVSAPIInternal(apiMajor));
 }
 
+bool VSFunction::callFrame(int n, const VSFrame * const *frames, int numFrames, VSFrameCallResult *result) {
+    if (!frameFunc)
+        return false;
+    *result = {};
+    frameFunc(n, frames, numFrames, result, userData, core, &vs_internal_vsapi);
+    return true;
+}
+
 ///////////////
 
 static bool isWindowsLargePageBroken() {
@@ -234,43 +355,73 @@ static bool isWindowsLargePageBroken() {
     return size;
 }
 
-void *MemoryUse::allocateLargePage(size_t bytes) const {
+void *MemoryUse::allocateLargePage(size_t bytes) {
     if (!largePageEnabled)
         return nullptr;
 
+    // Smaller buffers would leave most of the page unused.
     size_t granularity = largePageSize();
+    if (bytes < granularity)
+        return nullptr;
+
     size_t allocBytes = VSFrame::alignment + bytes;
     allocBytes = (allocBytes + (granularity - 1)) & ~(granularity - 1);
     assert(allocBytes % granularity == 0);
 
-    // Don't allocate a large page if it would conflict with the buffer recycling logic.
-    if (!isGoodFit(bytes, allocBytes - VSFrame::alignment))
-        return nullptr;
-
     void *ptr = nullptr;
 #ifdef VS_TARGET_OS_WINDOWS
     ptr = VirtualAlloc(nullptr, allocBytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
 #else
-    ptr = vsh_aligned_malloc(allocBytes, VSFrame::alignment);
+    // Try explicitly reserved huge pages first and fall back to asking for transparent huge pages
+    ptr = mmap(nullptr, allocBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (prefault ? MAP_POPULATE : 0), -1, 0);
+    if (ptr == MAP_FAILED) {
+        // transparent huge pages only back ranges aligned to the page size so map a bit more and trim it
+        void *raw = mmap(nullptr, allocBytes + granularity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED)
+            return nullptr;
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + (granularity - 1)) & ~static_cast<uintptr_t>(granularity - 1);
+        size_t head = aligned - reinterpret_cast<uintptr_t>(raw);
+        if (head)
+            munmap(raw, head);
+        if (granularity - head)
+            munmap(reinterpret_cast<void *>(aligned + allocBytes), granularity - head);
+        ptr = reinterpret_cast<void *>(aligned);
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, allocBytes, MADV_HUGEPAGE);
+#endif
+        // touch every page after the madvise so they're faulted in as huge pages when possible
+        if (prefault) {
+            for (size_t i = 0; i < allocBytes; i += 4096)
+                static_cast<volatile uint8_t *>(ptr)[i] = 0;
+        }
+    }
 #endif
     if (!ptr)
         return nullptr;
+    size_t total = largePageUsed += allocBytes;
+    size_t peak = largePagePeak;
+    while (total > peak && !largePagePeak.compare_exchange_weak(peak, total)) {}
 
+    // the buffer keeps the requested size to stay in its class, the tail of the last page goes unused
     BlockHeader *header = new (ptr) BlockHeader;
-    header->size = allocBytes - VSFrame::alignment;
+    header->size = bytes;
     header->large = true;
+    header->node = currentNode;
     return ptr;
 }
 
-void MemoryUse::freeLargePage(void *ptr) const {
+void MemoryUse::freeLargePage(void *ptr) {
+    size_t granularity = largePageSize();
+    size_t allocBytes = (static_cast<const BlockHeader *>(ptr)->size + VSFrame::alignment + (granularity - 1)) & ~(granularity - 1);
+    largePageUsed -= allocBytes;
 #ifdef VS_TARGET_OS_WINDOWS
     VirtualFree(ptr, 0, MEM_RELEASE);
 #else
-    vsh_aligned_free(ptr);
+    munmap(ptr, allocBytes);
 #endif
 }
 
-void *MemoryUse::allocateMemory(size_t bytes) const {
+void *MemoryUse::allocateMemory(size_t bytes) {
     void *ptr = allocateLargePage(bytes);
     if (ptr)
         return ptr;
@@ -282,10 +433,11 @@ void *MemoryUse::allocateMemory(size_t bytes) const {
     BlockHeader *header = new (ptr) BlockHeader;
     header->size = bytes;
     header->large = false;
+    header->node = currentNode;
     return ptr;
 }
 
-void MemoryUse::freeMemory(void *ptr) const {
+void MemoryUse::freeMemory(void *ptr) {
     const BlockHeader *header = static_cast<const BlockHeader *>(ptr);
     if (header->large)
         freeLargePage(ptr);
@@ -293,62 +445,160 @@ void MemoryUse::freeMemory(void *ptr) const {
         vsh_aligned_free(ptr);
 }
 
-bool MemoryUse::isGoodFit(size_t requested, size_t actual) const {
-    return actual <= requested + requested / 8;
+// Classes below 16 bytes are exact, above that class (e + 3) * 8 + step holds (8 + step) << e bytes.
+/* static */ size_t MemoryUse::sizeClassBytes(size_t sizeClass) {
+    if (sizeClass < 2 * sizeClassSteps)
+        return sizeClass + 1;
+    return (sizeClassSteps + sizeClass % sizeClassSteps) << (sizeClass / sizeClassSteps - 3);
+}
+
+// smallest class that can hold bytes
+/* static */ size_t MemoryUse::sizeClassCeil(size_t bytes) {
+    size_t sizeClass = sizeClassFloor(bytes);
+    if (sizeClassBytes(sizeClass) < bytes)
+        sizeClass++;
+    return sizeClass;
+}
+
+// largest class that fits inside bytes
+/* static */ size_t MemoryUse::sizeClassFloor(size_t bytes) {
+    if (bytes < 2 * sizeClassSteps)
+        return bytes ? bytes - 1 : 0;
+    size_t exponent = 0;
+    while ((bytes >> exponent) >= 2 * sizeClassSteps)
+        exponent++;
+    size_t step = (bytes >> exponent) - sizeClassSteps;
+    return (exponent + 3) * sizeClassSteps + step;
 }
 
 void MemoryUse::add(size_t bytes) {
     used.fetch_add(bytes);
+    if (shared)
+        VSSharedBudget::instance().addMemory(bytes);
 }
 
 void MemoryUse::subtract(size_t bytes) {
+    if (shared)
+        VSSharedBudget::instance().subtractMemory(bytes);
     size_t tmp = used.fetch_sub(bytes) - bytes;
     if (freeOnZero && !tmp)
         delete this;
 }
 
 uint8_t *MemoryUse::allocBuffer(size_t bytes) {
-    std::lock_guard<std::mutex> lock(mutex);
-    auto iter = buffers.lower_bound(bytes);
-    if (iter != buffers.end()) {
-        if (isGoodFit(bytes, iter->first)) {
-            unusedBufferSize -= iter->first;
-            uint8_t *buf = iter->second;
-            buffers.erase(iter);
+    size_t sizeClass = sizeClassCeil(bytes);
+    BufferBin &bin = bins[currentNode < bins.size() ? currentNode : 0][sizeClass];
+
+    if (bin.numBuffers > 0) {
+        std::lock_guard<std::mutex> lock(bin.lock);
+        if (!bin.buffers.empty()) {
+            uint8_t *buf = bin.buffers.back();
+            bin.buffers.pop_back();
+            --bin.numBuffers;
+            size_t size = reinterpret_cast<const BlockHeader *>(buf)->size;
+            unusedBufferSize -= size;
+            if (shared)
+                VSSharedBudget::instance().subtractPooled(size);
             return buf + VSFrame::alignment;
         }
     }
 
-    uint8_t *buf = static_cast<uint8_t *>(allocateMemory(bytes));
+    // always allocate the full class size so the buffer can be reused for anything in the same class
+    uint8_t *buf = static_cast<uint8_t *>(allocateMemory(sizeClassBytes(sizeClass)));
     return buf + VSFrame::alignment;
 }
 
 void MemoryUse::freeBuffer(uint8_t *buf) {
     assert(buf);
 
-    std::lock_guard<std::mutex> lock(mutex);
     buf -= VSFrame::alignment;
 
     const BlockHeader *header = reinterpret_cast<const BlockHeader *>(buf);
     if (!header->size)
         VS_FATAL_ERROR("Memory corruption detected. Windows bug?");
 
-    buffers.emplace(std::make_pair(header->size, buf));
-    unusedBufferSize += header->size;
+    // buffers always go back to the pool of the node they were allocated on
+    size_t node = header->node < bins.size() ? header->node : 0;
+    size_t size = header->size;
+    BufferBin &bin = bins[node][sizeClassFloor(size)];
+    {
+        std::lock_guard<std::mutex> lock(bin.lock);
+        bin.buffers.push_back(buf);
+        ++bin.numBuffers;
+    }
+    unusedBufferSize += size;
+    if (shared)
+        VSSharedBudget::instance().addPooled(size);
+
+    if (used + unusedBufferSize > maxMemoryUse || (shared && VSSharedBudget::instance().isOverPoolLimit()))
+        evictBuffers(node);
+}
+
+// Puts up to count pre-faulted buffers able to hold bytes into the pool of the calling thread's node
+// without exceeding budget, counting what's already in use or pooled. Returns the number of bytes added.
+size_t MemoryUse::prewarm(size_t bytes, size_t count, size_t budget) {
+    if (!poolEnabled || !bytes)
+        return 0;
+
+    size_t sizeClass = sizeClassCeil(bytes);
+    size_t classBytes = sizeClassBytes(sizeClass);
+    size_t node = currentNode < bins.size() ? currentNode : 0;
+    BufferBin &bin = bins[node][sizeClass];
+    budget = std::min<size_t>(budget, maxMemoryUse);
+
+    size_t added = 0;
+    for (size_t i = bin.numBuffers; i < count; i++) {
+        if (used + unusedBufferSize + classBytes > budget)
+            break;
+        uint8_t *buf = static_cast<uint8_t *>(allocateMemory(classBytes));
+        // fault in every page now instead of on the first write of a frame
+        for (size_t j = VSFrame::alignment; j < VSFrame::alignment + classBytes; j += 4096)
+            static_cast<volatile uint8_t *>(buf)[j] = 0;
+        {
+            std::lock_guard<std::mutex> lock(bin.lock);
+            bin.buffers.push_back(buf);
+            ++bin.numBuffers;
+        }
+        unusedBufferSize += classBytes;
+        if (shared)
+            VSSharedBudget::instance().addPooled(classBytes);
+        added += classBytes;
+    }
+    return added;
+}
+
+void MemoryUse::evictBuffers(size_t node) {
+    if (!memoryWarningIssued) {
+        //vsWarning("Script exceeded memory limit. Consider raising cache size.");
+        memoryWarningIssued = true;
+    }
 
-    size_t memoryUsed = used;
-    while (memoryUsed + unusedBufferSize > maxMemoryUse && !buffers.empty()) {
-        if (!memoryWarningIssued) {
-            //vsWarning("Script exceeded memory limit. Consider raising cache size.");
-            memoryWarningIssued = true;
+    // Go through the bins starting at a different one every time to spread out the evictions,
+    // the bins of the node the last buffer was returned to are emptied first.
+    size_t start = evictionCounter++ % numSizeClasses;
+    for (size_t n = 0; n < bins.size(); n++) {
+        BufferBin *nodeBins = bins[(node + n) % bins.size()].get();
+        for (size_t i = 0; i < numSizeClasses; i++) {
+            BufferBin &bin = nodeBins[(start + i) % numSizeClasses];
+            while ((used + unusedBufferSize > maxMemoryUse || (shared && VSSharedBudget::instance().isOverPoolLimit())) && bin.numBuffers > 0) {
+                uint8_t *buf = nullptr;
+                {
+                    std::lock_guard<std::mutex> lock(bin.lock);
+                    if (bin.buffers.empty())
+                        break;
+                    buf = bin.buffers.back();
+                    bin.buffers.pop_back();
+                    --bin.numBuffers;
+                }
+                size_t size = reinterpret_cast<const BlockHeader *>(buf)->size;
+                unusedBufferSize -= size;
+                if (shared)
+                    VSSharedBudget::instance().subtractPooled(size);
+                freeMemory(buf);
+            }
+            if (used + unusedBufferSize <= maxMemoryUse && !(shared && VSSharedBudget::instance().isOverPoolLimit()))
+                return;
         }
-        std::uniform_int_distribution<size_t> randSrc(0, buffers.size() - 1);
-        auto iter = buffers.begin();
-        std::advance(iter, randSrc(generator));
-        assert(unusedBufferSize >= iter->first);
-        unusedBufferSize -= iter->first;
-        freeMemory(iter->second);
-        buffers.erase(iter);
     }
 }
 
@@ -357,19 +607,29 @@ size_t MemoryUse::memoryUse() {
 }
 
 size_t MemoryUse::getLimit() {
-    std::lock_guard<std::mutex> lock(mutex);
     return maxMemoryUse;
 }
 
 int64_t MemoryUse::setMaxMemoryUse(int64_t bytes) {
-    std::lock_guard<std::mutex> lock(mutex);
-    if (bytes > 0 && static_cast<uint64_t>(bytes) <= SIZE_MAX)
+    if (bytes > 0 && static_cast<uint64_t>(bytes) <= SIZE_MAX) {
         maxMemoryUse = static_cast<size_t>(bytes);
+        softMemoryUse = maxMemoryUse - maxMemoryUse / 8;
+    }
     return maxMemoryUse;
 }
 
 bool MemoryUse::isOverLimit() {
-    return used > maxMemoryUse;
+    return used > maxMemoryUse || (shared && VSSharedBudget::instance().isOverMemoryLimit());
+}
+
+bool MemoryUse::isOverSoftLimit() {
+    return used > softMemoryUse || (shared && VSSharedBudget::instance().isOverSoftMemoryLimit());
+}
+
+void MemoryUse::enableSharedBudget() {
+    // only called before anything was allocated so the shared total always matches
+    assert(!used);
+    shared = true;
 }
 
 void MemoryUse::signalFree() {
@@ -378,7 +638,96 @@ void MemoryUse::signalFree() {
         delete this;
 }
 
-MemoryUse::MemoryUse() : used(0), freeOnZero(false), largePageEnabled(largePageSupported()), memoryWarningIssued(false), unusedBufferSize(0) {
+void MemoryUse::setNumaNodes(size_t nodes) {
+    // only called when the core is created so there can't be any concurrent allocations
+    std::lock_guard<std::mutex> lock(mutex);
+    while (bins.size() < nodes)
+        bins.emplace_back(new BufferBin[numSizeClasses]);
+}
+
+void MemoryUse::enableLargePages(bool prefault) {
+#ifndef VS_TARGET_OS_WINDOWS
+    // the frame pool is needed to amortize the cost of mapping huge pages
+    largePageEnabled = true;
+    poolEnabled = true;
+    this->prefault = prefault;
+#endif
+}
+
+thread_local unsigned MemoryUse::currentNode = 0;
+thread_local VSMemoryAccount *MemoryUse::currentAccount = nullptr;
+
+void VSMemoryAccount::add(size_t size) noexcept {
+    int64_t current = bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    int64_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (current > peak && !peakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {
+    }
+}
+
+void VSMemoryAccount::subtract(size_t size) noexcept {
+    bytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+bool DeviceMemory::setFunctions(const VSDeviceMemoryFunctions *f) {
+    if (!f || !f->alloc || !f->free || !f->download || !f->upload)
+        return false;
+    std::lock_guard<std::mutex> l(lock);
+    if (available)
+        return funcs.deviceType == f->deviceType && funcs.alloc == f->alloc && funcs.free == f->free && funcs.download == f->download &&
+            funcs.upload == f->upload && funcs.copy == f->copy && funcs.userData == f->userData;
+    funcs = *f;
+    available = true;
+    return true;
+}
+
+bool DeviceMemory::setComputeFunctions(const VSDeviceComputeFunctions *f) {
+    if (!f || !f->compileKernel || !f->launchKernel || !f->freeKernel)
+        return false;
+    std::lock_guard<std::mutex> l(lock);
+    if (!available)
+        return false;
+    if (computeAvailable)
+        return compute.compileKernel == f->compileKernel && compute.launchKernel == f->launchKernel && compute.freeKernel == f->freeKernel && compute.userData == f->userData;
+    compute = *f;
+    computeAvailable = true;
+    return true;
+}
+
+int64_t DeviceMemory::setLimit(int64_t bytes) {
+    if (bytes > 0 && static_cast<uint64_t>(bytes) <= SIZE_MAX)
+        limit = static_cast<size_t>(bytes);
+    return static_cast<int64_t>(std::min<size_t>(limit, INT64_MAX));
+}
+
+void *DeviceMemory::alloc(size_t size) {
+    if (!available || used.fetch_add(size) + size > limit) {
+        used -= size;
+        return nullptr;
+    }
+    void *ptr = funcs.alloc(size, funcs.userData);
+    if (!ptr)
+        used -= size;
+    return ptr;
+}
+
+void DeviceMemory::free(void *ptr, size_t size) {
+    funcs.free(ptr, funcs.userData);
+    used -= size;
+}
+
+MemoryUse::MemoryUse() : used(0), freeOnZero(false), largePageEnabled(largePageSupported()),
+#ifdef VS_FRAME_POOL
+    poolEnabled(true),
+#else
+    poolEnabled(false),
+#endif
+    prefault(false), memoryWarningIssued(false), largePageUsed(0), largePagePeak(0), unusedBufferSize(0), evictionCounter(0),
+#ifdef VS_FRAME_GUARD
+    guardInterval(1) {
+#else
+    guardInterval(0) {
+#endif
+    bins.emplace_back(new BufferBin[numSizeClasses]);
     assert(VSFrame::alignment >= sizeof(BlockHeader));
 
     // If the Windows VirtualAlloc bug is present, it is not safe to use large pages by default,
@@ -398,56 +747,195 @@ MemoryUse::MemoryUse() : used(0), freeOnZero(false), largePageEnabled(largePageS
 }
 
 MemoryUse::~MemoryUse() {
-    for (auto &iter : buffers)
-        freeMemory(iter.second);
+    if (shared)
+        VSSharedBudget::instance().subtractPooled(unusedBufferSize);
+    for (auto &nodeBins : bins)
+        for (size_t i = 0; i < numSizeClasses; i++)
+            for (uint8_t *buf : nodeBins[i].buffers)
+                freeMemory(buf);
 }
 
 ///////////////
 
-VSPlaneData::VSPlaneData(size_t dataSize, MemoryUse &mem) noexcept : refcount(1), mem(mem), size(dataSize + 2 * VSFrame::guardSpace) {
-#ifdef VS_FRAME_POOL
-    data = mem.allocBuffer(size + 2 * VSFrame::guardSpace);
-#else
-    data = internal_aligned_malloc<uint8_t>(size + 2 * VSFrame::guardSpace, VSFrame::alignment);
-#endif
+VSPlaneData::VSPlaneData(size_t dataSize, MemoryUse &mem) noexcept : refcount(1), mem(mem), guard(mem.nextGuarded() ? VSFrame::guardSpace : 0), size(dataSize + 2 * guard) {
+    if (mem.isPoolEnabled())
+        data = mem.allocBuffer(size);
+    else
+        data = internal_aligned_malloc<uint8_t>(size, VSFrame::alignment);
     assert(data);
     if (!data)
         VS_FATAL_ERROR("Failed to allocate memory for plane. Out of memory.");
 
     mem.add(size);
-#ifdef VS_FRAME_GUARD
-    for (size_t i = 0; i < VSFrame::guardSpace / sizeof(VS_FRAME_GUARD_PATTERN); i++) {
+    account = MemoryUse::currentAccount;
+    if (account) {
+        account->add_ref();
+        account->add(size);
+    }
+    for (size_t i = 0; i < guard / sizeof(VS_FRAME_GUARD_PATTERN); i++) {
         reinterpret_cast<uint32_t *>(data)[i] = VS_FRAME_GUARD_PATTERN;
-        reinterpret_cast<uint32_t *>(data + size - VSFrame::guardSpace)[i] = VS_FRAME_GUARD_PATTERN;
+        reinterpret_cast<uint32_t *>(data + size - guard)[i] = VS_FRAME_GUARD_PATTERN;
     }
-#endif
 }
 
-VSPlaneData::VSPlaneData(const VSPlaneData &d) noexcept : refcount(1), mem(d.mem), size(d.size) {
-#ifdef VS_FRAME_POOL
-    data = mem.allocBuffer(size);
-#else
-    data = internal_aligned_malloc<uint8_t>(size, VSFrame::alignment);
-#endif
+VSPlaneData::VSPlaneData(const VSPlaneData &d) noexcept : refcount(1), mem(d.mem), guard(d.guard), size(d.size) {
+    if (mem.isPoolEnabled())
+        data = mem.allocBuffer(size);
+    else
+        data = internal_aligned_malloc<uint8_t>(size, VSFrame::alignment);
     assert(data);
     if (!data)
         VS_FATAL_ERROR("Failed to allocate memory for plane in copy constructor. Out of memory.");
 
     mem.add(size);
-    memcpy(data, d.data, size);
+    account = MemoryUse::currentAccount;
+    if (account) {
+        account->add_ref();
+        account->add(size);
+    }
+    memcpy(data, d.host(), size);
+}
+
+VSPlaneData::VSPlaneData(size_t dataSize, MemoryUse &mem, void *devicePtr) noexcept : refcount(1), mem(mem), data(nullptr), guard(0), size(dataSize) {
+    device = new VSDevicePlane{ devicePtr, {}, false, true };
+}
+
+void VSExternalMemory::release() noexcept {
+    if (!--refcount) {
+        if (free)
+            free(userData);
+        delete this;
+    }
+}
+
+VSPlaneData::VSPlaneData(size_t dataSize, MemoryUse &mem, const uint8_t *externalData, VSExternalMemory *external) noexcept : refcount(1), mem(mem), external(external), data(const_cast<uint8_t *>(externalData)), guard(0), size(dataSize) {
+    ++external->refcount;
 }
 
 VSPlaneData::~VSPlaneData() {
-#ifdef VS_FRAME_POOL
-    mem.freeBuffer(data);
-#else
-    internal_aligned_free(data);
-#endif
+    if (account) {
+        account->subtract(size);
+        account->release();
+    }
+    VSDevicePlane *dev = device.load();
+    if (dev) {
+        mem.device.free(dev->ptr, size - 2 * guard);
+        delete dev;
+    }
+    if (external) {
+        external->release();
+        return;
+    }
+    if (!data)
+        return;
+    if (mem.isPoolEnabled())
+        mem.freeBuffer(data);
+    else
+        internal_aligned_free(data);
     mem.subtract(size);
 }
 
+// only for planes created in device memory, called with the lock of the device copy held
+void VSPlaneData::allocHost() {
+    if (mem.isPoolEnabled())
+        data = mem.allocBuffer(size);
+    else
+        data = internal_aligned_malloc<uint8_t>(size, VSFrame::alignment);
+    if (!data)
+        VS_FATAL_ERROR("Failed to allocate memory for the host copy of a plane. Out of memory.");
+    mem.add(size);
+}
+
+uint8_t *VSPlaneData::syncHost(VSDevicePlane *dev) const {
+    std::lock_guard<std::mutex> l(dev->lock);
+    if (!dev->hostValid) {
+        VSPlaneData *self = const_cast<VSPlaneData *>(this);
+        if (!data)
+            self->allocHost();
+        if (!mem.device.download(data + guard, dev->ptr, size - 2 * guard))
+            VS_FATAL_ERROR("Failed to download a plane from device memory");
+        dev->hostValid = true;
+    }
+    return data;
+}
+
+uint8_t *VSPlaneData::hostForWrite() noexcept {
+    VSDevicePlane *dev = device.load(std::memory_order_acquire);
+    if (!dev)
+        return data;
+    uint8_t *ptr = syncHost(dev);
+    std::lock_guard<std::mutex> l(dev->lock);
+    dev->deviceValid = false;
+    return ptr;
+}
+
+void *VSPlaneData::deviceForRead() noexcept {
+    VSDevicePlane *dev = device.load(std::memory_order_acquire);
+    if (!dev) {
+        // the first device read of a host plane, several threads may get here at once and only one copy is kept
+        size_t deviceSize = size - 2 * guard;
+        void *ptr = mem.device.alloc(deviceSize);
+        if (!ptr)
+            return nullptr;
+        if (!mem.device.upload(ptr, data + guard, deviceSize)) {
+            mem.device.free(ptr, deviceSize);
+            return nullptr;
+        }
+        VSDevicePlane *newDev = new VSDevicePlane{ ptr, {}, true, true };
+        if (device.compare_exchange_strong(dev, newDev, std::memory_order_acq_rel))
+            return ptr;
+        mem.device.free(ptr, deviceSize);
+        delete newDev;
+    }
+
+    std::lock_guard<std::mutex> l(dev->lock);
+    if (!dev->deviceValid) {
+        if (!mem.device.upload(dev->ptr, data + guard, size - 2 * guard))
+            return nullptr;
+        dev->deviceValid = true;
+    }
+    return dev->ptr;
+}
+
+void *VSPlaneData::deviceForWrite() noexcept {
+    void *ptr = deviceForRead();
+    if (ptr) {
+        VSDevicePlane *dev = device.load(std::memory_order_acquire);
+        std::lock_guard<std::mutex> l(dev->lock);
+        dev->hostValid = false;
+    }
+    return ptr;
+}
+
+VSPlaneData *VSPlaneData::copyOnDevice(const VSPlaneData &d) noexcept {
+    VSDevicePlane *dev = d.device.load(std::memory_order_acquire);
+    if (!dev)
+        return nullptr;
+    std::lock_guard<std::mutex> l(dev->lock);
+    if (!dev->deviceValid)
+        return nullptr;
+    size_t deviceSize = d.size - 2 * d.guard;
+    void *ptr = d.mem.device.alloc(deviceSize);
+    if (!ptr)
+        return nullptr;
+    if (!d.mem.device.copy(ptr, dev->ptr, deviceSize)) {
+        d.mem.device.free(ptr, deviceSize);
+        return nullptr;
+    }
+    return new VSPlaneData(deviceSize, d.mem, ptr);
+}
+
+int VSPlaneData::residency() const noexcept {
+    VSDevicePlane *dev = device.load(std::memory_order_acquire);
+    if (!dev)
+        return prHost;
+    std::lock_guard<std::mutex> l(dev->lock);
+    return (dev->hostValid ? prHost : 0) | (dev->deviceValid ? prDevice : 0);
+}
+
 bool VSPlaneData::unique() noexcept {
-    return (refcount == 1);
+    // external memory is copied before the first write
+    return (refcount == 1) && !external;
 }
 
 void VSPlaneData::add_ref() noexcept {
@@ -461,17 +949,26 @@ void VSPlaneData::release() noexcept {
 
 ///////////////
 
-VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *propSrc, VSCore *core) noexcept : refcount(1), contentType(mtVideo), v3format(nullptr), width(width), height(height), properties(propSrc ? &propSrc->properties : nullptr), core(core) {
+// planes asked for in device memory are allocated in host memory when there's no room on the device
+static VSPlaneData *newPlaneData(size_t size, MemoryUse &mem, bool onDevice) {
+    if (onDevice) {
+        if (void *ptr = mem.device.alloc(size))
+            return new VSPlaneData(size, mem, ptr);
+    }
+    return new VSPlaneData(size, mem);
+}
+
+VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *propSrc, VSCore *core, bool onDevice) noexcept : refcount(1), contentType(mtVideo), v3format(nullptr), width(width), height(height), properties(propSrc ? &propSrc->properties : nullptr), core(core) {
     if (width <= 0 || height <= 0)
         core->logFatal("Error in frame creation: dimensions are negative (" + std::to_string(width) + "x" + std::to_string(height) + ")");
 
     format.vf = f;
     numPlanes = format.vf.numPlanes;
 
-    stride[0] = (width * (f.bytesPerSample) + (alignment - 1)) & ~(alignment - 1);
+    stride[0] = core->planeStride(width * f.bytesPerSample);
 
     if (numPlanes == 3) {
-        int plane23 = ((width >> format.vf.subSamplingW) * (format.vf.bytesPerSample) + (alignment - 1)) & ~(alignment - 1);
+        ptrdiff_t plane23 = core->planeStride((width >> f.subSamplingW) * f.bytesPerSample);
         stride[1] = plane23;
         stride[2] = plane23;
     } else {
@@ -479,12 +976,38 @@ VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *p
         stride[2] = 0;
     }
 
-    data[0] = new VSPlaneData(stride[0] * height, *core->memory);
+    data[0] = newPlaneData(stride[0] * height, *core->memory, onDevice);
     if (numPlanes == 3) {
         size_t size23 = stride[1] * (height >> format.vf.subSamplingH);
-        data[1] = new VSPlaneData(size23, *core->memory);
-        data[2] = new VSPlaneData(size23, *core->memory);
+        data[1] = newPlaneData(size23, *core->memory, onDevice);
+        data[2] = newPlaneData(size23, *core->memory, onDevice);
+    }
+}
+
+VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const uint8_t * const *planes, const ptrdiff_t *strides, VSFreeExternalMemory free, void *userData, const VSFrame *propSrc, VSCore *core) noexcept : refcount(1), contentType(mtVideo), v3format(nullptr), width(width), height(height), properties(propSrc ? &propSrc->properties : nullptr), core(core) {
+    if (width <= 0 || height <= 0)
+        core->logFatal("Error in frame creation: dimensions are negative (" + std::to_string(width) + "x" + std::to_string(height) + ")");
+
+    format.vf = f;
+    numPlanes = format.vf.numPlanes;
+
+    // the reference held here keeps free from being called while the planes are set up
+    VSExternalMemory *external = new VSExternalMemory{ {1}, free, userData };
+
+    for (int p = 0; p < numPlanes; p++) {
+        ptrdiff_t rowSize = getWidth(p) * f.bytesPerSample;
+        int planeHeight = getHeight(p);
+        if (!(reinterpret_cast<uintptr_t>(planes[p]) % alignment) && strides[p] >= rowSize && !(strides[p] % alignment)) {
+            stride[p] = strides[p];
+            data[p] = new VSPlaneData(stride[p] * planeHeight, *core->memory, planes[p], external);
+        } else {
+            stride[p] = core->planeStride(rowSize);
+            data[p] = new VSPlaneData(stride[p] * planeHeight, *core->memory);
+            vsh::bitblt(data[p]->data + data[p]->guard, stride[p], planes[p], strides[p], rowSize, planeHeight);
+        }
     }
+
+    external->release();
 }
 
 VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame * const *planeSrc, const int *plane, const VSFrame *propSrc, VSCore *core) noexcept : refcount(1), contentType(mtVideo), v3format(nullptr), width(width), height(height), properties(propSrc ? &propSrc->properties : nullptr), core(core) {
@@ -494,10 +1017,10 @@ VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *
     format.vf = f;
     numPlanes = format.vf.numPlanes;
 
-    stride[0] = (width * (format.vf.bytesPerSample) + (alignment - 1)) & ~(alignment - 1);
+    stride[0] = core->planeStride(width * f.bytesPerSample);
 
     if (numPlanes == 3) {
-        int plane23 = ((width >> format.vf.subSamplingW) * (format.vf.bytesPerSample) + (alignment - 1)) & ~(alignment - 1);
+        ptrdiff_t plane23 = core->planeStride((width >> f.subSamplingW) * f.bytesPerSample);
         stride[1] = plane23;
         stride[2] = plane23;
     } else {
@@ -513,6 +1036,8 @@ VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *
                 core->logFatal("Error in frame creation: dimensions of plane " + std::to_string(plane[i]) + " do not match. Source: " + std::to_string(planeSrc[i]->getWidth(plane[i])) + "x" + std::to_string(planeSrc[i]->getHeight(plane[i])) + "; destination: " + std::to_string(getWidth(i)) + "x" + std::to_string(getHeight(i)));
             data[i] = planeSrc[i]->data[plane[i]];
             data[i]->add_ref();
+            stride[i] = planeSrc[i]->stride[plane[i]];
+            offset[i] = planeSrc[i]->offset[plane[i]];
         } else {
             if (i == 0) {
                 data[i] = new VSPlaneData(stride[i] * height, *core->memory);
@@ -523,9 +1048,15 @@ VSFrame::VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *
     }
 }
 
+// the channels are always VS_AUDIO_FRAME_SAMPLES apart in frames up to that size, larger frames round
+// it up to a multiple of it to keep them aligned
+static ptrdiff_t audioFrameStride(int numSamples) {
+    return static_cast<ptrdiff_t>(numSamples + VS_AUDIO_FRAME_SAMPLES - 1) / VS_AUDIO_FRAME_SAMPLES * VS_AUDIO_FRAME_SAMPLES;
+}
+
 VSFrame::VSFrame(const VSAudioFormat &f, int numSamples, const VSFrame *propSrc, VSCore *core) noexcept
     : refcount(1), contentType(mtAudio), v3format(nullptr), properties(propSrc ? &propSrc->properties : nullptr), core(core) {
-    if (numSamples <= 0)
+    if (numSamples <= 0 || numSamples > VS_AUDIO_MAX_FRAME_SAMPLES)
         core->logFatal("Error in frame creation: bad number of samples (" + std::to_string(numSamples) + ")");
     
     format.af = f;
@@ -533,14 +1064,14 @@ VSFrame::VSFrame(const VSAudioFormat &f, int numSamples, const VSFrame *propSrc,
 
     width = numSamples;
 
-    stride[0] = format.af.bytesPerSample * VS_AUDIO_FRAME_SAMPLES;
+    stride[0] = format.af.bytesPerSample * audioFrameStride(numSamples);
 
     data[0] = new VSPlaneData(stride[0] * format.af.numChannels, *core->memory);
 }
 
 VSFrame::VSFrame(const VSAudioFormat &f, int numSamples, const VSFrame * const *channelSrc, const int *channel, const VSFrame *propSrc, VSCore *core) noexcept
     : refcount(1), contentType(mtAudio), v3format(nullptr), properties(propSrc ? &propSrc->properties : nullptr), core(core) {
-    if (numSamples <= 0)
+    if (numSamples <= 0 || numSamples > VS_AUDIO_MAX_FRAME_SAMPLES)
         core->logFatal("Error in frame creation: bad number of samples (" + std::to_string(numSamples) + ")");
 
     format.af = f;
@@ -548,7 +1079,7 @@ VSFrame::VSFrame(const VSAudioFormat &f, int numSamples, const VSFrame * const *
 
     width = numSamples;
 
-    stride[0] = format.af.bytesPerSample * VS_AUDIO_FRAME_SAMPLES;
+    stride[0] = format.af.bytesPerSample * audioFrameStride(numSamples);
 
     data[0] = new VSPlaneData(stride[0] * format.af.numChannels, *core->memory);
 
@@ -580,10 +1111,40 @@ VSFrame::VSFrame(const VSFrame &f) noexcept : refcount(1), v3format(nullptr) {
     stride[0] = f.stride[0];
     stride[1] = f.stride[1];
     stride[2] = f.stride[2];
+    offset[0] = f.offset[0];
+    offset[1] = f.offset[1];
+    offset[2] = f.offset[2];
     properties = f.properties;
     core = f.core;
 }
 
+VSFrame::VSFrame(const VSFrame &f, int left, int top, int width, int height) noexcept : VSFrame(f) {
+    assert(contentType == mtVideo);
+    this->width = width;
+    this->height = height;
+
+    for (int p = 0; p < numPlanes; p++) {
+        int ssw = p ? format.vf.subSamplingW : 0;
+        int ssh = p ? format.vf.subSamplingH : 0;
+        offset[p] += stride[p] * (top >> ssh) + (left >> ssw) * format.vf.bytesPerSample;
+    }
+}
+
+VSFrame::VSFrame(const VSFrame &f, int firstSample, int numSamples) noexcept : VSFrame(f) {
+    assert(contentType == mtAudio && firstSample >= 0 && firstSample + numSamples <= f.width);
+    width = numSamples;
+    offset[0] += firstSample * format.af.bytesPerSample;
+}
+
+bool VSFrame::hasAllocatedStrides(int width) const noexcept {
+    assert(contentType == mtVideo);
+    for (int p = 0; p < numPlanes; p++) {
+        if (stride[p] != core->planeStride((width >> (p ? format.vf.subSamplingW : 0)) * format.vf.bytesPerSample))
+            return false;
+    }
+    return true;
+}
+
 VSFrame::~VSFrame() {
     data[0]->release();
     if (data[1]) {
@@ -611,9 +1172,9 @@ const uint8_t *VSFrame::getReadPtr(int plane) const {
         return nullptr;
 
     if (contentType == mtVideo)
-        return data[plane]->data + guardSpace;
+        return data[plane]->host() + data[plane]->guard + offset[plane];
     else
-        return data[0]->data + guardSpace + plane * stride[0];
+        return data[0]->data + data[0]->guard + offset[0] + plane * stride[0];
 }
 
 uint8_t *VSFrame::getWritePtr(int plane) {
@@ -622,13 +1183,23 @@ uint8_t *VSFrame::getWritePtr(int plane) {
 
     // copy the plane data if this isn't the only reference
     if (contentType == mtVideo) {
-        if (!data[plane]->unique()) {
+        if (!renderTarget && !data[plane]->unique()) {
             VSPlaneData *old = data[plane];
-            data[plane] = new VSPlaneData(*data[plane]);
+            ptrdiff_t rowSize = getWidth(plane) * format.vf.bytesPerSample;
+            ptrdiff_t compactStride = core->planeStride(rowSize);
+            if (offset[plane] || stride[plane] != compactStride || old->size != stride[plane] * getHeight(plane) + 2 * old->guard) {
+                // a view only gets a copy of the rows it shows
+                data[plane] = new VSPlaneData(compactStride * getHeight(plane), *core->memory);
+                vs_copy_plane(data[plane]->data + data[plane]->guard, compactStride, old->host() + old->guard + offset[plane], stride[plane], rowSize, getHeight(plane), 0, vs_get_cpulevel(core));
+                stride[plane] = compactStride;
+                offset[plane] = 0;
+            } else {
+                data[plane] = new VSPlaneData(*data[plane]);
+            }
             old->release();
         }
 
-        return data[plane]->data + guardSpace;
+        return data[plane]->hostForWrite() + data[plane]->guard + offset[plane];
     } else {
         if (!data[0]->unique()) {
             VSPlaneData *old = data[0];
@@ -636,25 +1207,63 @@ uint8_t *VSFrame::getWritePtr(int plane) {
             old->release();
         }
 
-        return data[0]->data + guardSpace + plane * stride[0];
+        return data[0]->data + data[0]->guard + offset[0] + plane * stride[0];
     }
 }
 
-#ifdef VS_FRAME_GUARD
+const void *VSFrame::getReadDevicePtr(int plane) const {
+    if (contentType != mtVideo || plane < 0 || plane >= numPlanes)
+        return nullptr;
+
+    uint8_t *ptr = static_cast<uint8_t *>(data[plane]->deviceForRead());
+    return ptr ? ptr + offset[plane] : nullptr;
+}
+
+void *VSFrame::getWriteDevicePtr(int plane) {
+    if (contentType != mtVideo || plane < 0 || plane >= numPlanes)
+        return nullptr;
+
+    // a plane that's only up to date on the device is copied there, everything else the same way as for host writes
+    if (!renderTarget && !data[plane]->unique()) {
+        VSPlaneData *old = data[plane];
+        VSPlaneData *copy = offset[plane] ? nullptr : VSPlaneData::copyOnDevice(*old);
+        if (copy) {
+            data[plane] = copy;
+            old->release();
+        } else {
+            getWritePtr(plane);
+        }
+    }
+
+    uint8_t *ptr = static_cast<uint8_t *>(data[plane]->deviceForWrite());
+    return ptr ? ptr + offset[plane] : nullptr;
+}
+
+int VSFrame::getPlaneResidency(int plane) const {
+    if (plane < 0 || plane >= numPlanes)
+        return 0;
+    return contentType == mtVideo ? data[plane]->residency() : prHost;
+}
+
 bool VSFrame::verifyGuardPattern() const {
     for (int p = 0; p < ((contentType == mtVideo) ? numPlanes : 1); p++) {
-        for (size_t i = 0; i < guardSpace / sizeof(VS_FRAME_GUARD_PATTERN); i++) {
-            uint32_t p1 = reinterpret_cast<uint32_t *>(data[p]->data)[i];
-            uint32_t p2 = reinterpret_cast<uint32_t *>(data[p]->data + data[p]->size - guardSpace)[i];
-            if (reinterpret_cast<uint32_t *>(data[p]->data)[i] != VS_FRAME_GUARD_PATTERN ||
-                reinterpret_cast<uint32_t *>(data[p]->data + data[p]->size - guardSpace)[i] != VS_FRAME_GUARD_PATTERN)
+        const VSPlaneData *d = data[p];
+        for (size_t i = 0; i < d->guard / sizeof(VS_FRAME_GUARD_PATTERN); i++) {
+            if (reinterpret_cast<const uint32_t *>(d->data)[i] != VS_FRAME_GUARD_PATTERN ||
+                reinterpret_cast<const uint32_t *>(d->data + d->size - d->guard)[i] != VS_FRAME_GUARD_PATTERN)
                 return false;
         }
     }
 
     return true;
 }
-#endif
+
+size_t VSFrame::memorySize() const {
+    size_t bytes = 0;
+    for (int p = 0; p < ((contentType == mtVideo) ? numPlanes : 1); p++)
+        bytes += data[p]->size;
+    return bytes;
+}
 
 struct split1 {
     enum empties_t { empties_ok, no_empties };
@@ -759,69 +1368,352 @@ void VSPluginFunction::parseArgString(const std::string &argString, std::vector<
 VSPluginFunction::VSPluginFunction(const std::string &name, const std::string &argString, const std::string &returnType, VSPublicFunction func, void *functionData, VSPlugin *plugin)
     : func(func), functionData(functionData), plugin(plugin), name(name), argString(argString), returnType(returnType) {
     parseArgString(argString, inArgs, plugin->apiMajor);
+    for (size_t i = 0; i < inArgs.size(); i++) {
+        // ptUnset as an argument type means any value is accepted beyond the declared ones
+        if (inArgs[i].type == ptUnset) {
+            acceptsAnyArgs = true;
+            continue;
+        }
+        argIndex.emplace_back(inArgs[i].key, i);
+        if (!inArgs[i].opt)
+            numRequiredArgs++;
+    }
+    std::sort(argIndex.begin(), argIndex.end());
     if (plugin->apiMajor == 3)
         this->argString = getV4ArgString(); // construct to V4 equivalent arg string
     if (returnType != "any")
         parseArgString(returnType, retArgs, plugin->apiMajor);
 }
 
-VSMap *VSPluginFunction::invoke(const VSMap &args) {
-    VSMap *v = new VSMap;
-
-    try {
-        std::set<std::string> remainingArgs;
-        for (size_t i = 0; i < args.size(); i++)
-            remainingArgs.insert(args.key(i));
-
-        for (const FilterArgument &fa : inArgs) {
-            // ptUnset as an argument type means any value is accepted beyond the declared ones
-            if (fa.type == ptUnset) {
-                // this will always be the last argument, therefore it's safe to clear out the remaining ones since they'll
-                // already have been checked
-                remainingArgs.clear();
-                continue;
+// Identifies a call for node reuse, nodes, frames and functions only compare equal when they're the same object
+static std::string nodeReuseKey(const VSPluginFunction *func, const std::string &pluginID, const VSMap &args) {
+    std::string key = pluginID + '\0' + func->getName() + '\0';
+    auto append = [&key](const void *p, size_t size) { key.append(reinterpret_cast<const char *>(p), size); };
+
+    for (const auto &iter : args.entries()) {
+        const VSArrayBase *arr = iter.value.get();
+        int type = arr->type();
+        size_t size = arr->size();
+        key.append(iter.key->name.c_str(), iter.key->name.size() + 1);
+        append(&type, sizeof(type));
+        append(&size, sizeof(size));
+
+        for (size_t i = 0; i < size; i++) {
+            const void *p = nullptr;
+            switch (type) {
+                case ptInt:
+                    append(&reinterpret_cast<const VSIntArray *>(arr)->at(i), sizeof(int64_t));
+                    break;
+                case ptFloat:
+                    append(&reinterpret_cast<const VSFloatArray *>(arr)->at(i), sizeof(double));
+                    break;
+                case ptData: {
+                    const VSMapData &d = reinterpret_cast<const VSDataArray *>(arr)->at(i);
+                    size_t length = d.getSize();
+                    append(&d.typeHint, sizeof(d.typeHint));
+                    append(&length, sizeof(length));
+                    key.append(d.getData(), length);
+                    break;
+                }
+                case ptVideoNode:
+                case ptAudioNode:
+                    p = reinterpret_cast<const VSVideoNodeArray *>(arr)->at(i).get();
+                    break;
+                case ptVideoFrame:
+                case ptAudioFrame:
+                    p = reinterpret_cast<const VSVideoFrameArray *>(arr)->at(i).get();
+                    break;
+                case ptFunction:
+                    p = reinterpret_cast<const VSFunctionArray *>(arr)->at(i).get();
+                    break;
             }
+            if (p)
+                append(&p, sizeof(p));
+        }
+    }
+    return key;
+}
 
-            int propType = vs_internal_vsapi.mapGetType(&args, fa.name.c_str());
-
-            if (propType != ptUnset) {
-                remainingArgs.erase(fa.name);
+// Only calls that produced nodes are worth remembering, everything else is either cheap or has side effects
+static bool isReusableResult(const VSMap &result) {
+    if (result.hasError() || !result.size())
+        return false;
+    for (const auto &iter : result.entries()) {
+        int type = iter.value->type();
+        if (type != ptVideoNode && type != ptAudioNode)
+            return false;
+    }
+    return true;
+}
 
-                if (fa.type != propType)
-                    throw VSException(name + ": argument " + fa.name + " is not of the correct type");
+// Calls made while a scope is entered on the thread are remembered in it, a structurally identical graph
+// built again in the same scope is made of the same nodes and keeps their caches
+struct NodeReuseScope {
+    struct Entry {
+        std::unique_ptr<VSMap> args; // keeps the argument nodes alive so their addresses can't end up identifying other nodes
+        std::unique_ptr<VSMap> result;
+        uint64_t lastUse;
+    };
 
-                VSArrayBase *arr = args.find(fa.name);
+    VSCore *core;
+    size_t maxEntries;
+    std::mutex lock;
+    std::unordered_map<std::string, Entry> entries;
+    uint64_t clock = 0;
 
-                if (!fa.arr && arr->size() > 1)
-                    throw VSException(name + ": argument " + fa.name + " is not of array type but more than one value was supplied");
+    NodeReuseScope(VSCore *core, size_t maxEntries) : core(core), maxEntries(maxEntries) {}
 
-                if (!fa.empty && arr->size() < 1)
-                    throw VSException(name + ": argument " + fa.name + " does not accept empty arrays");
+    bool find(const std::string &key, VSMap *out) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto iter = entries.find(key);
+        if (iter == entries.end())
+            return false;
+        iter->second.lastUse = ++clock;
+        out->copy(iter->second.result.get());
+        return true;
+    }
 
-            } else if (!fa.opt) {
-                throw VSException(name + ": argument " + fa.name + " is required");
+    void add(const std::string &key, const VSMap &args, const VSMap &result) {
+        // the least recently used entry is released after the lock since freeing a node can end up back in invoke()
+        Entry released;
+        std::lock_guard<std::mutex> guard(lock);
+        entries[key] = { std::unique_ptr<VSMap>(new VSMap(&args)), std::unique_ptr<VSMap>(new VSMap(&result)), ++clock };
+        if (entries.size() > maxEntries) {
+            auto oldest = entries.begin();
+            for (auto iter = entries.begin(); iter != entries.end(); ++iter) {
+                if (iter->second.lastUse < oldest->second.lastUse)
+                    oldest = iter;
             }
+            released = std::move(oldest->second);
+            entries.erase(oldest);
         }
+    }
+};
 
-        if (!remainingArgs.empty()) {
-            auto iter = remainingArgs.cbegin();
-            std::string s = *iter;
-            ++iter;
-            for (; iter != remainingArgs.cend(); ++iter)
-                s += ", " + *iter;
-            throw VSException(name + ": no argument(s) named " + s);
-        }
+static thread_local NodeReuseScope *currentReuseScope = nullptr;
 
-        bool enableGraphInspection = plugin->core->enableGraphInspection;
-        if (enableGraphInspection) {
+NodeReuseScope *createNodeReuseScope(VSCore *core, size_t maxEntries) {
+    return new NodeReuseScope(core, maxEntries);
+}
+
+void freeNodeReuseScope(NodeReuseScope *scope) {
+    delete scope;
+}
+
+NodeReuseScope *enterNodeReuseScope(NodeReuseScope *scope) {
+    NodeReuseScope *previous = currentReuseScope;
+    currentReuseScope = scope;
+    return previous;
+}
+
+// Non-zero while the resizes proxy mode inserts itself are created, they see every clip at the size it has
+static thread_local int proxyConversion = 0;
+
+int VSNode::getProxyScale() const {
+    return proxyConversion ? 1 : proxyScale;
+}
+
+static VSNode *proxyResize(VSCore *core, VSNode *node, int width, int height) {
+    VSPlugin *resize = core->getPluginByID(VSH_RESIZE_PLUGIN_ID);
+    if (!resize)
+        throw VSException("Proxy mode requires the resize plugin");
+
+    VSMap in;
+    vs_internal_vsapi.mapSetNode(&in, "clip", node, maReplace);
+    vs_internal_vsapi.mapSetInt(&in, "width", width, maReplace);
+    vs_internal_vsapi.mapSetInt(&in, "height", height, maReplace);
+
+    proxyConversion++;
+    std::unique_ptr<VSMap> out(resize->invoke("Bilinear", in));
+    proxyConversion--;
+
+    if (out->hasError())
+        throw VSException(out->getErrorMessage());
+    return vs_internal_vsapi.mapGetNode(out.get(), "clip", 0, nullptr);
+}
+
+// Replaces the reduced clips in args with ones upscaled to the size they stand in for, returns true when any were found
+static bool proxyUpscaleArgs(VSCore *core, VSMap &args) {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < args.size(); i++)
+        if (vs_internal_vsapi.mapGetType(&args, args.key(i)) == ptVideoNode)
+            keys.push_back(args.key(i));
+
+    bool converted = false;
+    for (const auto &key : keys) {
+        int numNodes = vs_internal_vsapi.mapNumElements(&args, key.c_str());
+        std::vector<VSNode *> nodes;
+        for (int i = 0; i < numNodes; i++)
+            nodes.push_back(vs_internal_vsapi.mapGetNode(&args, key.c_str(), i, nullptr));
+        vs_internal_vsapi.mapDeleteKey(&args, key.c_str());
+
+        for (VSNode *&node : nodes) {
+            if (node->proxyScale > 1) {
+                VSNode *full = proxyResize(core, node, node->proxyWidth, node->proxyHeight);
+                vs_internal_vsapi.freeNode(node);
+                node = full;
+                converted = true;
+            }
+            vs_internal_vsapi.mapConsumeNode(&args, key.c_str(), node, maAppend);
+        }
+    }
+    return converted;
+}
+
+// Applies the proxy scale to the clips a function returned, inputs are the clips it was called with
+static void proxyScaleResult(VSCore *core, VSMap &result, const VSMap &inputs, int scale, bool scalable, bool upscaled) {
+    std::set<const VSNode *> inputNodes;
+    const VSNode *firstInput = nullptr;
+    int inputScale = 1;
+    for (const auto &iter : inputs.entries()) {
+        if (iter.value->type() != ptVideoNode)
+            continue;
+        const VSVideoNodeArray *arr = reinterpret_cast<const VSVideoNodeArray *>(iter.value.get());
+        for (size_t i = 0; i < arr->size(); i++) {
+            const VSNode *node = arr->at(i).get();
+            if (!firstInput) {
+                firstInput = node;
+                inputScale = node->proxyScale;
+            }
+            inputNodes.insert(node);
+        }
+    }
+
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < result.size(); i++)
+        if (vs_internal_vsapi.mapGetType(&result, result.key(i)) == ptVideoNode)
+            keys.push_back(result.key(i));
+
+    for (const auto &key : keys) {
+        int numNodes = vs_internal_vsapi.mapNumElements(&result, key.c_str());
+        std::vector<VSNode *> nodes;
+        for (int i = 0; i < numNodes; i++)
+            nodes.push_back(vs_internal_vsapi.mapGetNode(&result, key.c_str(), i, nullptr));
+        vs_internal_vsapi.mapDeleteKey(&result, key.c_str());
+
+        for (VSNode *&node : nodes) {
+            const VSVideoInfo &vi = node->getVideoInfo();
+            if (inputNodes.count(node) || node->proxyScale > 1) {
+                // passed through unchanged
+            } else if (scalable && inputScale > 1) {
+                node->proxyScale = inputScale;
+                bool sameSize = (vi.width == firstInput->getVideoInfo().width && vi.height == firstInput->getVideoInfo().height);
+                node->proxyWidth = sameSize ? firstInput->proxyWidth : vi.width * inputScale;
+                node->proxyHeight = sameSize ? firstInput->proxyHeight : vi.height * inputScale;
+            } else if ((node->isSource() || upscaled) && isConstantVideoFormat(&vi)) {
+                // sources and the output of functions that had to work at full resolution are made small again
+                int width = std::max((vi.width / scale) >> vi.format.subSamplingW << vi.format.subSamplingW, 1 << vi.format.subSamplingW);
+                int height = std::max((vi.height / scale) >> vi.format.subSamplingH << vi.format.subSamplingH, 1 << vi.format.subSamplingH);
+                VSNode *proxy = proxyResize(core, node, width, height);
+                proxy->proxyScale = scale;
+                proxy->proxyWidth = vi.width;
+                proxy->proxyHeight = vi.height;
+                vs_internal_vsapi.freeNode(node);
+                node = proxy;
+            }
+            vs_internal_vsapi.mapConsumeNode(&result, key.c_str(), node, maAppend);
+        }
+    }
+}
+
+VSMap *VSPluginFunction::invoke(const VSMap &args) {
+    VSMap *v = new VSMap;
+
+    try {
+        if (plugin->isDeferred())
+            plugin->ensureLoaded();
+        if (!func)
+            throw VSException(name + ": the plugin " + plugin->getFilename() + " failed to load or no longer provides this function");
+
+        // the map's keys are interned so every supplied value is matched to its argument by pointer, the
+        // required ones only have to be searched for by name when one of them is missing
+        size_t numRequired = 0;
+        std::string unknownArgs;
+        for (const auto &iter : args.entries()) {
+            auto ai = std::lower_bound(argIndex.begin(), argIndex.end(), std::make_pair(iter.key, static_cast<size_t>(0)));
+            if (ai == argIndex.end() || ai->first != iter.key) {
+                if (!acceptsAnyArgs)
+                    unknownArgs += (unknownArgs.empty() ? "" : ", ") + iter.key->name;
+                continue;
+            }
+
+            const FilterArgument &fa = inArgs[ai->second];
+            const VSArrayBase *arr = iter.value.get();
+
+            if (fa.type != arr->type())
+                throw VSException(name + ": argument " + fa.name + " is not of the correct type");
+
+            if (!fa.arr && arr->size() > 1)
+                throw VSException(name + ": argument " + fa.name + " is not of array type but more than one value was supplied");
+
+            if (!fa.empty && arr->size() < 1)
+                throw VSException(name + ": argument " + fa.name + " does not accept empty arrays");
+
+            if (!fa.opt)
+                numRequired++;
+        }
+
+        if (numRequired < numRequiredArgs) {
+            for (const FilterArgument &fa : inArgs)
+                if (fa.type != ptUnset && !fa.opt && !args.find(fa.key))
+                    throw VSException(name + ": argument " + fa.name + " is required");
+        }
+
+        if (!unknownArgs.empty())
+            throw VSException(name + ": no argument(s) named " + unknownArgs);
+
+        // in proxy mode functions that can't work on reduced clips get them at full resolution, when the
+        // inputs are a mix of reduced and full clips everything is brought to full resolution
+        int proxyScale = proxyConversion ? 1 : plugin->core->getProxyScale();
+        bool proxyScalable = (flags & pffProxyScalable);
+        bool proxyUpscaled = false;
+        VSMap proxyArgs(&args);
+        if (proxyScale > 1) {
+            int inputScale = 0;
+            bool mixedScales = false;
+            for (const auto &iter : args.entries()) {
+                if (iter.value->type() != ptVideoNode)
+                    continue;
+                const VSVideoNodeArray *arr = reinterpret_cast<const VSVideoNodeArray *>(iter.value.get());
+                for (size_t i = 0; i < arr->size(); i++) {
+                    int scale = arr->at(i)->proxyScale;
+                    mixedScales = mixedScales || (inputScale && scale != inputScale);
+                    inputScale = inputScale ? inputScale : scale;
+                }
+            }
+            if (!proxyScalable || mixedScales)
+                proxyUpscaled = proxyUpscaleArgs(plugin->core, proxyArgs);
+        }
+        const VSMap &callArgs = proxyUpscaled ? proxyArgs : args;
+
+        // only deterministic calls can be answered with the nodes of an earlier frame's call
+        NodeReuseScope *scope = ((flags & pffDeterministic) && currentReuseScope && currentReuseScope->core == plugin->core) ? currentReuseScope : nullptr;
+        bool reuse = plugin->core->isNodeReuseEnabled();
+        bool dedup = !reuse && (flags & pffDeterministic);
+        std::string reuseKey;
+        if (reuse || dedup || scope) {
+            reuseKey = nodeReuseKey(this, plugin->getID(), callArgs);
+            if (scope && scope->find(reuseKey, v))
+                return v;
+            if ((reuse || dedup) && (reuse ? plugin->core->findReusableNodes(reuseKey, v) : plugin->core->findDedupNode(reuseKey, v))) {
+                if (scope)
+                    scope->add(reuseKey, callArgs, *v);
+                return v;
+            }
+        }
+
+        bool enableGraphInspection = plugin->core->enableGraphInspection;
+        PVSFunctionFrame frame;
+        if (enableGraphInspection) {
             std::string fullName = plugin->getNamespace() + "." + name;
-            plugin->core->functionFrame = std::make_shared<VSFunctionFrame>(fullName, new VSMap(&args), plugin->core->functionFrame);
+            frame = std::make_shared<VSFunctionFrame>(fullName, new VSMap(&callArgs), plugin->core->functionFrame);
+            plugin->core->functionFrame = frame;
         }
 
 #ifdef VS_PROFILE_CREATE
         std::chrono::time_point<std::chrono::high_resolution_clock> startTime = std::chrono::high_resolution_clock::now();
 #endif
-        func(&args, v, functionData, plugin->core, getVSAPIInternal(plugin->apiMajor));
+        func(&callArgs, v, functionData, plugin->core, getVSAPIInternal(plugin->apiMajor));
 #ifdef VS_PROFILE_CREATE
         std::chrono::nanoseconds duration = std::chrono::high_resolution_clock::now() - startTime;
         std::cerr << this->plugin->fnamespace << "." << this->name << " uses " << 0.001 * (double)duration.count() << " us" << std::endl;
@@ -832,6 +1724,27 @@ VSMap *VSPluginFunction::invoke(const VSMap &args) {
             plugin->core->functionFrame = plugin->core->functionFrame->next;
         }
 
+        if (proxyScale > 1 && !v->hasError())
+            proxyScaleResult(plugin->core, *v, callArgs, proxyScale, proxyScalable, proxyUpscaled);
+
+        if (reuse && isReusableResult(*v))
+            plugin->core->addReusableNodes(reuseKey, callArgs, *v);
+        else if (dedup)
+            plugin->core->addDedupNode(reuseKey, callArgs, *v);
+        if (scope && isReusableResult(*v))
+            scope->add(reuseKey, callArgs, *v);
+
+        if (frame && !v->hasError()) {
+            for (const auto &iter : v->entries()) {
+                if (iter.value->type() != ptVideoNode && iter.value->type() != ptAudioNode)
+                    continue;
+                // both array types hold the same element type so either cast works
+                const VSVideoNodeArray *arr = reinterpret_cast<const VSVideoNodeArray *>(iter.value.get());
+                for (size_t i = 0; i < arr->size(); i++)
+                    frame->outputs.push_back({ arr->at(i).get(), iter.key, static_cast<int>(i) });
+            }
+        }
+
         if (plugin->apiMajor == VAPOURSYNTH3_API_MAJOR && !args.isV3Compatible())
             plugin->core->logFatal(name + ": filter node returned not yet supported type");
 
@@ -1059,6 +1972,7 @@ VSNode::VSNode(const std::string &name, const VSAudioInfo *ai, VSFilterGetFrame
 }
 
 VSNode::~VSNode() {
+    core->forgetDedupNode(this);
     registerCache(false);
 
     cache.clear();
@@ -1069,6 +1983,7 @@ VSNode::~VSNode() {
     }
 
     core->destroyFilterInstance(this);
+    memoryAccount->release();
 }
 
 void VSNode::registerCache(bool add) {
@@ -1079,15 +1994,205 @@ void VSNode::registerCache(bool add) {
         core->caches.erase(this);
 }
 
+// Nodes with more than one consumer or one that doesn't request frames in a strictly spatial way benefit
+// from a cache. A passthrough consumer counts as non-spatial when it would have wanted a cache itself.
+// With streaming caches a consumer hinting a temporal radius of 0 only reads every frame once as well.
+// Must be called with cacheMutex held.
+bool VSNode::wantsCache() const {
+    // cheap nodes are recomputed instead unless several consumers may ask for the same frame
+    if (costHint == fcCheap)
+        return consumers.size() > 1;
+    if (consumers.size() == 1) {
+        const VSNode *consumer = consumers[0].source;
+        bool spatial = consumers[0].requestPattern || (core->streamingCaches && consumer->temporalRadius == 0);
+        return !spatial || (consumer->cachePassthrough && consumer->passthroughWantsCache);
+    }
+    return consumers.size() > 1;
+}
+
+void VSNode::updateAutoCache() {
+    bool forward;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        bool wants = wantsCache();
+        forward = cachePassthrough && (passthroughWantsCache != wants);
+        passthroughWantsCache = wants;
+
+        if (!cacheOverride) {
+            cacheEnabled = wants && !cachePassthrough;
+            if (!cacheEnabled)
+                cache.clear();
+        }
+    }
+    registerCache(cacheEnabled);
+
+    if (forward) {
+        for (auto &iter : dependencies)
+            iter.source->updateAutoCache();
+    }
+}
+
+// Filters that only change metadata return frames sharing everything with their input, caching
+// them would only duplicate cache entries so the sources are cached instead when needed
+void VSNode::setCachePassthrough() {
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        cachePassthrough = true;
+    }
+    updateAutoCache();
+    for (auto &iter : dependencies)
+        iter.source->updateAutoCache();
+}
+
+void setCachePassthrough(VSNode *node) {
+    node->setCachePassthrough();
+}
+
+void *compileDeviceKernel(VSCore *core, const char *source, const char *entryPoint) {
+    return core->memory->device.compileKernel(source, entryPoint);
+}
+
+bool launchDeviceKernel(VSCore *core, void *kernel, int width, int height, void **params) {
+    return core->memory->device.launchKernel(kernel, width, height, params);
+}
+
+void freeDeviceKernel(VSCore *core, void *kernel) {
+    core->memory->device.freeKernel(kernel);
+}
+
+void *VSNode::getFusableInstanceData(VSFilterGetFrame getFrame) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return (filterGetFrame == getFrame && consumers.empty()) ? instanceData : nullptr;
+}
+
+void *getFusableInstanceData(VSNode *node, VSFilterGetFrame getFrame) {
+    return node->getFusableInstanceData(getFrame);
+}
+
+VSFrame *newVideoFrameView(const VSFrame *f, int left, int top, int width, int height) {
+    const VSVideoFormat *fi = f->getVideoFormat();
+
+    // every row has to start as aligned as in a newly allocated frame
+    for (int p = 0; p < fi->numPlanes; p++) {
+        if (((left >> (p ? fi->subSamplingW : 0)) * fi->bytesPerSample) % VSFrame::alignment)
+            return nullptr;
+    }
+
+    // filters commonly step through a new frame of the same size with the stride of their input
+    if (!f->hasAllocatedStrides(width))
+        return nullptr;
+
+    return new VSFrame(*f, left, top, width, height);
+}
+
+VSFrame *newAudioFrameView(const VSFrame *f, int firstSample, int numSamples) {
+    // the channels have to start as aligned as in a newly allocated frame
+    if ((firstSample * f->getAudioFormat()->bytesPerSample) % VSFrame::alignment)
+        return nullptr;
+
+    return new VSFrame(*f, firstSample, numSamples);
+}
+
+void setNodeRendersInPlace(VSNode *node) {
+    node->setRendersInPlace();
+}
+
+bool requestFrameFilterInto(int n, VSNode *node, VSFrameContext *frameCtx, VSFrame *target, int left, int top, bool fillsRight) {
+    const VSVideoInfo &vi = node->getVideoInfo();
+    if (n >= vi.numFrames)
+        n = vi.numFrames - 1;
+    frameCtx->reqList.emplace_back(NodeOutputKey(node, n));
+
+    // most filters assume their new frames have the strides of their input
+    if (!node->getRendersInPlace())
+        return false;
+
+    const VSVideoFormat *fi = target->getVideoFormat();
+    if (node->getNodeType() != mtVideo || !isConstantVideoFormat(&vi) || !isSameVideoFormat(&vi.format, fi) ||
+        left < 0 || top < 0 || left + vi.width > target->getWidth(0) || top + vi.height > target->getHeight(0))
+        return false;
+
+    // rows are written up to their aligned size, that mustn't reach into a neighbour's window
+    bool rightEdge = fillsRight || left + vi.width == target->getWidth(0);
+    for (int p = 0; p < fi->numPlanes; p++) {
+        int ssw = p ? fi->subSamplingW : 0;
+        int ssh = p ? fi->subSamplingH : 0;
+        if (((left | vi.width) & ((1 << ssw) - 1)) || ((top | vi.height) & ((1 << ssh) - 1)))
+            return false;
+        if (((left >> ssw) * fi->bytesPerSample) % VSFrame::alignment)
+            return false;
+        if (!rightEdge && ((vi.width >> ssw) * fi->bytesPerSample) % VSFrame::alignment)
+            return false;
+    }
+
+    target->setRenderTarget(true);
+
+    VSFrameContext::Placement placement;
+    placement.key = NodeOutputKey(node, n);
+    placement.target = PVSFrame(target, true);
+    placement.left = left;
+    placement.top = top;
+    placement.width = vi.width;
+    placement.height = vi.height;
+    frameCtx->placements.push_back(std::move(placement));
+    return true;
+}
+
+// Merging is limited to chains whose halos stay small compared to a stripe
+static const int maxStripeChainRadius = 32;
+
+bool VSNode::setFilterStripe(VSFilterStripe stripe, int radius, int planes) {
+    if (nodeType != mtVideo || apiMajor != VAPOURSYNTH_API_MAJOR || filterMode != fmParallel || radius < 0)
+        return false;
+    if (dependencies.size() != 1 || dependencies[0].requestPattern != rpStrictSpatial)
+        return false;
+
+    const VSNode *source = dependencies[0].source;
+    const VSVideoInfo &svi = source->vi;
+    if (source->nodeType != mtVideo || !isConstantVideoFormat(&vi) || !isConstantVideoFormat(&svi))
+        return false;
+    if (vi.width != svi.width || vi.height != svi.height || vi.numFrames != svi.numFrames || vi.format.numPlanes != svi.format.numPlanes ||
+        vi.format.subSamplingW != svi.format.subSamplingW || vi.format.subSamplingH != svi.format.subSamplingH)
+        return false;
+    // passed through planes are shared with the input
+    if ((planes & ((1 << vi.format.numPlanes) - 1)) != (1 << vi.format.numPlanes) - 1 && !isSameVideoFormat(&vi.format, &svi.format))
+        return false;
+
+    stripeFunc = stripe;
+    stripeRadius = radius;
+    stripePlanes = planes & 7;
+
+    std::vector<VSNode *> chain;
+    {
+        std::lock_guard<std::mutex> lock(dependencies[0].source->cacheMutex);
+        if (!source->stripeFunc || source->consumers.size() != 1)
+            return false;
+    }
+
+    if (source->stripeSource) {
+        chain = source->stripeChain;
+    } else {
+        chain.push_back(dependencies[0].source);
+    }
+    chain.push_back(this);
+
+    int total = 0;
+    for (const VSNode *node : chain)
+        total += node->stripeRadius;
+    if (total > maxStripeChainRadius)
+        return false;
+
+    stripeSource = source->stripeSource ? source->stripeSource : source->dependencies[0].source;
+    stripeChain = std::move(chain);
+    return true;
+}
+
 void VSNode::addConsumer(VSNode *consumer, int strictSpatial) {
     {
         std::lock_guard<std::mutex> lock(cacheMutex);
         consumers.push_back({consumer, strictSpatial});
-
-        if (!cacheOverride)
-            cacheEnabled = (consumers.size() > 1) || (consumers.size() == 1 && !consumers[0].requestPattern);
     }
-    registerCache(cacheEnabled);
+    updateAutoCache();
 }
 
 void VSNode::removeConsumer(VSNode *consumer, int strictSpatial) {
@@ -1099,21 +2204,65 @@ void VSNode::removeConsumer(VSNode *consumer, int strictSpatial) {
                 break;
             }
         }
+    }
+    updateAutoCache();
+}
 
-        if (!cacheOverride)
-            cacheEnabled = (consumers.size() > 1) || (consumers.size() == 1 && !consumers[0].requestPattern);
 
-        if (!cacheEnabled)
-            cache.clear();
+// Fills the frame pool before the first request so the start of a render doesn't pay for a fresh
+// allocation and page faults of every frame. The graph upstream is walked once and the number of
+// planes in flight per size is estimated as every worker holding up to four of them, for its
+// output and inputs, plus one per producing plane that may be waiting to be consumed. Nodes
+// reached through an earlier output are skipped and at most a quarter of the memory limit is used.
+void VSNode::prewarmFramePool() {
+    if (prewarmed.exchange(true) || !core->memory->isPoolEnabled())
+        return;
+
+    std::map<size_t, size_t> planeSizes; // plane size to number of nodes producing it
+    std::vector<VSNode *> stack = { this };
+    std::set<VSNode *> visited = { this };
+    while (!stack.empty()) {
+        VSNode *node = stack.back();
+        stack.pop_back();
+
+        if (node->nodeType == mtVideo && node->vi.format.colorFamily != cfUndefined && node->vi.width > 0 && node->vi.height > 0) {
+            const VSVideoFormat &f = node->vi.format;
+            size_t stride = core->planeStride(node->vi.width * f.bytesPerSample);
+            planeSizes[stride * node->vi.height]++;
+            if (f.numPlanes == 3) {
+                size_t stride23 = core->planeStride((node->vi.width >> f.subSamplingW) * f.bytesPerSample);
+                planeSizes[stride23 * (node->vi.height >> f.subSamplingH)] += 2;
+            }
+        }
+
+        for (const auto &dep : node->dependencies) {
+            if (visited.insert(dep.source).second && !dep.source->prewarmed.exchange(true))
+                stack.push_back(dep.source);
+        }
     }
-    registerCache(cacheEnabled);
-}
 
+    size_t threads = core->threadPool->threadCount();
+    size_t budget = core->memory->getLimit() / 4;
+    for (const auto &iter : planeSizes) {
+        size_t planes = iter.second;
+        core->memory->prewarm(iter.first, threads * std::min<size_t>(planes, 4) + planes, budget);
+    }
+}
 
 void VSNode::getFrame(const PVSFrameContext &ct) {
+    prewarmFramePool();
     core->threadPool->startExternal(ct);
 }
 
+void VSNode::getFrameSync(const PVSFrameContext &ct, const std::atomic<bool> &done) {
+    prewarmFramePool();
+    core->threadPool->startExternalSync(ct, done);
+}
+
+size_t VSNode::cancelFrames(int n, VSFrameDoneCallback frameDone, void *userData) {
+    return core->threadPool->cancelExternal(NodeOutputKey(this, n), frameDone, userData);
+}
+
 const VSVideoInfo &VSNode::getVideoInfo() const {
     return vi;
 }
@@ -1177,9 +2326,31 @@ const VSMap *VSNode::getCreationFunctionArguments(int level) const {
     return nullptr;
 }
 
+const char *VSNode::getCreationFunctionOutput(int level, int *index) const {
+    if (core->enableGraphInspection) {
+        VSFunctionFrame *frame = functionFrame.get();
+        for (int i = 0; i < level; i++) {
+            if (frame)
+                frame = frame->next.get();
+        }
+
+        if (frame) {
+            for (const auto &iter : frame->outputs) {
+                if (iter.node == this) {
+                    if (index)
+                        *index = iter.index;
+                    return iter.key->name.c_str();
+                }
+            }
+        }
+    }
+    return nullptr;
+}
+
 int VSNode::setLinear() {
     std::lock_guard<std::mutex> lock(cacheMutex);
     cacheLinear = true;
+    seekSensitive = true;
     cacheOverride = true;
     cacheEnabled = true;
     cache.setFixedSize(true);   
@@ -1199,7 +2370,7 @@ void VSNode::setCacheMode(int mode) {
 
         if (mode == -1) {
             cacheOverride = false;
-            cacheEnabled = (consumers.size() > 1) || (consumers.size() == 1 && !consumers[0].requestPattern);
+            cacheEnabled = wantsCache() && !cachePassthrough;
         } else if (mode == 0) {
             cacheOverride = true;
             cacheEnabled = false;
@@ -1209,6 +2380,8 @@ void VSNode::setCacheMode(int mode) {
         }
 
         // always reset to defaults on mode change
+        cache.setRingMode(false);
+        cache.setScanResistant(false);
         cache.setFixedSize(false);
         cache.setMaxFrames(10);
         cache.setMaxHistory(10);
@@ -1228,25 +2401,510 @@ void VSNode::setCacheOptions(int fixedSize, int maxSize, int maxHistorySize) {
         cache.setMaxHistory(maxHistorySize);
 }
 
-PVSFrame VSNode::getCachedFrameInternal(int n) {
+void VSNode::setCacheRingMode(bool ring) {
     std::lock_guard<std::mutex> lock(cacheMutex);
-    if (cacheEnabled)
-        return cache.object(n);
-    else
+    cache.setRingMode(ring);
+}
+
+void setCacheRingMode(VSNode *node, bool ring) {
+    node->setCacheRingMode(ring);
+}
+
+void VSNode::setCacheScanResistant(bool scanResistant) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.setScanResistant(scanResistant);
+}
+
+void setCacheScanResistant(VSNode *node, bool scanResistant) {
+    node->setCacheScanResistant(scanResistant);
+}
+
+void VSNode::setCompressedCacheSize(int64_t bytes) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    compressedMaxSize = static_cast<size_t>(std::max<int64_t>(bytes, 0));
+    cache.setKeepEvicted(compressedMaxSize > 0);
+    while (compressedSize > compressedMaxSize && !compressedOrder.empty()) {
+        auto iter = compressedCache.find(compressedOrder.front().first);
+        if (iter != compressedCache.end() && iter->second->sequence == compressedOrder.front().second) {
+            compressedSize -= iter->second->size;
+            compressedCache.erase(iter);
+        }
+        compressedOrder.pop_front();
+    }
+}
+
+void VSNode::getCompressedCacheStats(int64_t *hits, int64_t *misses, int64_t *size) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (hits)
+        *hits = compressedHits;
+    if (misses)
+        *misses = compressedMisses;
+    if (size)
+        *size = compressedSize;
+}
+
+void setCompressedCacheSize(VSNode *node, int64_t bytes) {
+    node->setCompressedCacheSize(bytes);
+}
+
+void VSNode::setMemoization(int maxFrames) {
+    std::lock_guard<std::mutex> lock(memoMutex);
+    memoMaxFrames = std::max(maxFrames, 0);
+    while (memoOrder.size() > memoMaxFrames) {
+        memo.erase(memoOrder.front());
+        memoOrder.pop_front();
+    }
+}
+
+// A region explicitly requested by the filter wins, otherwise a filter that declared how far it
+// looks around a pixel with setFilterHints() needs the same region grown by that from inputs of
+// the same size and subsampling. Such a filter only computes pixels from pixels so when only the
+// properties are needed the same goes for all of its inputs.
+VSFrameContext::Region VSNode::inputRegion(const VSFrameContext *ctx, NodeOutputKey input) const {
+    for (const auto &iter : ctx->regions)
+        if (iter.first == input)
+            return iter.second;
+
+    const VSFrameContext::Region &region = ctx->region;
+    if (region.propsOnly)
+        return (spatialRadius >= 0) ? region : VSFrameContext::Region();
+    if (region.isWholeFrame() || spatialRadius < 0 || input.first->getNodeType() != mtVideo)
+        return VSFrameContext::Region();
+    const VSVideoInfo &ivi = input.first->getVideoInfo();
+    if (ivi.width != vi.width || ivi.height != vi.height || ivi.format.subSamplingW != vi.format.subSamplingW || ivi.format.subSamplingH != vi.format.subSamplingH)
+        return VSFrameContext::Region();
+
+    // the radius counts pixels of the plane being processed so subsampled planes reach further in luma
+    int64_t r = static_cast<int64_t>(spatialRadius) << std::max(vi.format.subSamplingW, vi.format.subSamplingH);
+    return VSFrameContext::makeRegion(region.left - r, region.top - r, region.left + region.width + r, region.top + region.height + r, input.first);
+}
+
+// The key combines the content hash, source node and offset from n of every input frame so it
+// doesn't depend on the order the frames arrived in, it only exists when all of them have a hash.
+bool VSNode::getMemoKey(int n, const VSFrameContext *frameCtx, uint64_t &key, const VSFrame *&propSrc) const {
+    static const VSMapKey *hashKey = VSMapKey::intern("_ContentHash");
+    if (dependencies.empty() || frameCtx->availableFrames.size() == 0)
+        return false;
+
+    key = frameCtx->availableFrames.size();
+    propSrc = nullptr;
+    for (size_t i = 0; i < frameCtx->availableFrames.size(); i++) {
+        const auto &input = frameCtx->availableFrames[i];
+        int err = 0;
+        int64_t hash = vs_internal_vsapi.mapGetIntKey(&input.second->getConstProperties(), hashKey, 0, &err);
+        if (err)
+            return false;
+        uint64_t h = static_cast<uint64_t>(hash) ^ (reinterpret_cast<uintptr_t>(input.first.first) * 0x9E3779B97F4A7C15ULL) ^ (static_cast<uint64_t>(static_cast<int64_t>(input.first.second) - n) * 0xC2B2AE3D27D4EB4FULL);
+        h ^= h >> 31;
+        h *= 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 29;
+        key += h;
+        if (input.first.first == dependencies[0].source && input.first.second == n)
+            propSrc = input.second.get();
+    }
+
+    return propSrc != nullptr;
+}
+
+void VSNode::setMaxConcurrency(int max) {
+    maxConcurrency = std::max(max, 0);
+}
+
+void setNodeMaxConcurrency(VSNode *node, int max) {
+    node->setMaxConcurrency(max);
+}
+
+void VSNode::setAccessPattern(int pattern, int lookahead) {
+    if (pattern == apLinear && lookahead > 0) {
+        {
+            // speculatively produced frames are only useful if they're kept until requested
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            cacheOverride = true;
+            cacheEnabled = true;
+            if (cache.getMaxFrames() < lookahead * 2)
+                cache.setMaxFrames(lookahead * 2);
+        }
+        registerCache(true);
+        accessLookahead = lookahead;
+    } else {
+        accessLookahead = 0;
+    }
+}
+
+bool VSNode::setAudioFrameSamples(int samples) {
+    if (nodeType != mtAudio || samples <= 0 || samples > VS_AUDIO_MAX_FRAME_SAMPLES || samples % VS_AUDIO_FRAME_SAMPLES)
+        return false;
+
+    // the consumers were created for the old number of frames
+    if (!consumers.empty())
+        return false;
+
+    audioFrameSamples = samples;
+    anyAudioFrameSamples = true;
+    ai.numFrames = static_cast<int>((ai.numSamples + samples - 1) / samples);
+    return true;
+}
+
+void VSNode::setFilterHints(int cost, int temporalRadius, int spatialRadius) {
+    if (cost < fcUnknown || cost > fcExpensive)
+        core->logFatal("setFilterHints: invalid cost passed for " + name);
+
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        costHint = cost;
+        this->temporalRadius = std::max(temporalRadius, -1);
+        this->spatialRadius = std::max(spatialRadius, -1);
+    }
+    updateAutoCache();
+
+    if (core->streamingCaches) {
+        for (auto &iter : dependencies)
+            iter.source->updateAutoCache();
+    }
+
+    // neighbouring output frames share most of their window so the inputs should be able to hold all of it
+    if (temporalRadius > 0) {
+        int frames = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(temporalRadius) * 2 + 1, INT_MAX));
+        raiseRequestCapacity(static_cast<size_t>(frames) * std::max<size_t>(dependencies.size(), 1));
+        for (auto &iter : dependencies)
+            if (iter.requestPattern == rpGeneral)
+                iter.source->raiseCacheFloor(frames);
+    }
+}
+
+void VSNode::getFilterHints(int *cost, int *temporalRadius, int *spatialRadius) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (cost)
+        *cost = costHint;
+    if (temporalRadius)
+        *temporalRadius = this->temporalRadius;
+    if (spatialRadius)
+        *spatialRadius = this->spatialRadius;
+}
+
+size_t VSNode::getRequestCapacity() const {
+    return std::max(static_cast<size_t>(requestCapacity), dependencies.size());
+}
+
+void VSNode::raiseRequestCapacity(size_t frames) {
+    // a bound so a single odd request can't make every later context reserve a huge amount
+    int capped = static_cast<int>(std::min<size_t>(frames, 1024));
+    int current = requestCapacity;
+    while (current < capped && !requestCapacity.compare_exchange_weak(current, capped)) {}
+}
+
+void VSNode::raiseCacheFloor(int frames) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cacheFloor = std::max(cacheFloor, frames);
+    if (cache.getMaxFrames() < cacheFloor)
+        cache.setMaxFrames(cacheFloor);
+}
+
+VSFrameWindow::VSFrameWindow(VSNode *node, int radius) : node(node), radius(radius) {
+    node->add_ref();
+    slack = static_cast<int>(node->core->threadPool->threadCount());
+    {
+        std::lock_guard<std::mutex> lock(node->cacheMutex);
+        store = node->frameWindow.lock();
+        if (!store) {
+            store = std::make_shared<VSFrameWindowStore>();
+            node->frameWindow = store;
+        }
+    }
+    std::lock_guard<std::mutex> lock(store->lock);
+    store->windows.push_back(this);
+}
+
+VSFrameWindow::~VSFrameWindow() {
+    {
+        std::lock_guard<std::mutex> lock(store->lock);
+        store->windows.erase(std::find(store->windows.begin(), store->windows.end(), this));
+        store->evict();
+    }
+    store.reset();
+    node->release();
+}
+
+// frames the window holds are handed to the context right away and only the others are requested
+void VSFrameWindow::request(int first, int last, VSFrameContext *frameCtx) {
+    std::lock_guard<std::mutex> lock(store->lock);
+    for (int n = first; n <= last; n++) {
+        NodeOutputKey key(node, n);
+        auto iter = store->frames.find(n);
+        if (iter != store->frames.end()) {
+            frameCtx->availableFrames.push_back({key, iter->second});
+            frameCtx->windowFrames = true;
+        } else {
+            frameCtx->reqList.emplace_back(key);
+        }
+    }
+}
+
+// frames produced for only a region of the output are incomplete so they're never kept
+void VSFrameWindow::update(int n, const VSFrameContext *frameCtx) {
+    std::lock_guard<std::mutex> lock(store->lock);
+    center = n;
+    if (frameCtx->region.isWholeFrame()) {
+        for (size_t i = 0; i < frameCtx->availableFrames.size(); i++) {
+            const auto &tmp = frameCtx->availableFrames[i];
+            if (tmp.first.first == node && tmp.first.second >= n - radius && tmp.first.second <= n + radius)
+                store->frames.emplace(tmp.first.second, tmp.second);
+        }
+    }
+    store->evict();
+}
+
+void VSFrameWindowStore::evict() {
+    for (auto iter = frames.begin(); iter != frames.end();) {
+        bool needed = false;
+        bool started = false;
+        for (const VSFrameWindow *window : windows) {
+            if (window->center < 0)
+                continue;
+            started = true;
+            int64_t distance = std::abs(static_cast<int64_t>(iter->first) - window->center);
+            if (distance <= static_cast<int64_t>(window->radius) + window->slack) {
+                needed = true;
+                break;
+            }
+        }
+        if (needed || (!started && !windows.empty()))
+            ++iter;
+        else
+            iter = frames.erase(iter);
+    }
+}
+
+bool VSNode::feedsTemporalFilter() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return cacheFloor > 0;
+}
+
+bool VSNode::isFrameCached(int n) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return cacheEnabled && cache.contains(n);
+}
+
+// Compresses everything the regular cache evicted since the last call, the compression itself
+// is done without holding the cache lock
+void VSNode::storeEvictedFrames() {
+    std::vector<std::pair<int, PVSFrame>> frames;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        if (!compressedMaxSize)
+            return;
+        cache.takeEvicted(frames);
+    }
+
+    if (frames.empty())
+        return;
+
+    std::vector<uint8_t> packed;
+    std::vector<std::shared_ptr<CompressedFrame>> compressed;
+    compressed.reserve(frames.size());
+
+    for (auto &iter : frames) {
+        const VSFrame *f = iter.second.get();
+        std::shared_ptr<CompressedFrame> cf = std::make_shared<CompressedFrame>();
+        cf->format = *f->getVideoFormat();
+        cf->width = f->getWidth(0);
+        cf->height = f->getHeight(0);
+        cf->properties = f->getConstProperties();
+        for (int p = 0; p < cf->format.numPlanes; p++) {
+            size_t rowSize = static_cast<size_t>(f->getWidth(p)) * cf->format.bytesPerSample;
+            size_t planeSize = rowSize * f->getHeight(p);
+            packed.resize(planeSize);
+            bitblt(packed.data(), rowSize, f->getReadPtr(p), f->getStride(p), rowSize, f->getHeight(p));
+            cf->planes[p].resize(vs_lz_compress_bound(planeSize));
+            cf->planes[p].resize(vs_lz_compress(packed.data(), planeSize, cf->planes[p].data()));
+            cf->planes[p].shrink_to_fit();
+            cf->size += cf->planes[p].size();
+        }
+        compressed.push_back(cf);
+        iter.second.reset();
+    }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for (size_t i = 0; i < frames.size(); i++) {
+        int n = frames[i].first;
+        std::shared_ptr<CompressedFrame> &cf = compressed[i];
+        if (cf->size > compressedMaxSize)
+            continue;
+        auto old = compressedCache.find(n);
+        if (old != compressedCache.end()) {
+            compressedSize -= old->second->size;
+            compressedCache.erase(old);
+        }
+        cf->sequence = ++compressedSequence;
+        compressedCache[n] = cf;
+        compressedOrder.emplace_back(n, cf->sequence);
+        compressedSize += cf->size;
+    }
+
+    // oldest entries go first, entries that were already taken out or replaced are skipped
+    while (compressedSize > compressedMaxSize && !compressedOrder.empty()) {
+        auto iter = compressedCache.find(compressedOrder.front().first);
+        if (iter != compressedCache.end() && iter->second->sequence == compressedOrder.front().second) {
+            compressedSize -= iter->second->size;
+            compressedCache.erase(iter);
+        }
+        compressedOrder.pop_front();
+    }
+}
+
+PVSFrame VSNode::getCompressedFrame(int n) {
+    std::shared_ptr<CompressedFrame> cf;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        if (!compressedMaxSize)
+            return nullptr;
+        auto iter = compressedCache.find(n);
+        if (iter == compressedCache.end()) {
+            ++compressedMisses;
+            return nullptr;
+        }
+        cf = iter->second;
+        compressedSize -= cf->size;
+        compressedCache.erase(iter);
+    }
+
+    PVSFrame f = new VSFrame(cf->format, cf->width, cf->height, nullptr, core);
+    f->setProperties(cf->properties);
+    std::vector<uint8_t> packed;
+    for (int p = 0; p < cf->format.numPlanes; p++) {
+        size_t rowSize = static_cast<size_t>(f->getWidth(p)) * cf->format.bytesPerSample;
+        size_t planeSize = rowSize * f->getHeight(p);
+        packed.resize(planeSize);
+        if (!vs_lz_decompress(cf->planes[p].data(), cf->planes[p].size(), packed.data(), planeSize))
+            core->logFatal("Compressed cache of " + name + " is corrupt at frame " + std::to_string(n));
+        vs_copy_plane(f->getWritePtr(p), f->getStride(p), packed.data(), rowSize, rowSize, f->getHeight(p), 0, vs_get_cpulevel(core));
+    }
+
+    ++compressedHits;
+    return f;
+}
+
+PVSFrame VSNode::getCachedFrameInternal(int n, bool countMiss) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (cacheEnabled) {
+        PVSFrame f = cache.object(n);
+        if (core->enableGraphInspection && (f || countMiss))
+            ++(f ? stats.cacheHits : stats.cacheMisses);
+        return f;
+    } else {
         return nullptr;
+    }
+}
+
+void VSNode::getStats(VSNodeStats *dst) const {
+    dst->framesProduced = stats.framesProduced;
+    dst->getFrameCalls = stats.getFrameCalls;
+    dst->cacheHits = stats.cacheHits;
+    dst->cacheMisses = stats.cacheMisses;
+    dst->queueWaitTime = stats.queueWaitTime;
+    dst->serialWaitTime = stats.serialWaitTime;
+    dst->hwCycles = stats.hwCounters[pcCycles];
+    dst->hwInstructions = stats.hwCounters[pcInstructions];
+    dst->hwCacheMisses = stats.hwCounters[pcCacheMisses];
+    dst->hwBranchMisses = stats.hwCounters[pcBranchMisses];
+    for (int i = 0; i < VS_NODE_STATS_BUCKETS; i++) {
+        dst->getFrameLatency[i] = stats.getFrameLatency[i];
+        dst->queueWait[i] = stats.queueWait[i];
+    }
+}
+
+void VSNode::getMemoryStats(VSNodeMemoryStats *dst) {
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        dst->cacheBytes = cache.frameBytes();
+        dst->cachedFrames = cache.getSize();
+    }
+    dst->frameBytes = memoryAccount->bytes.load(std::memory_order_relaxed);
+    dst->peakFrameBytes = memoryAccount->peakBytes.load(std::memory_order_relaxed);
+}
+
+void VSNode::addQueueWait(int64_t nanoSeconds) {
+    stats.queueWaitTime.fetch_add(nanoSeconds, std::memory_order_relaxed);
+    stats.queueWait[NodeStats::bucket(nanoSeconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void VSNode::addSerialWait(int64_t nanoSeconds) {
+    stats.serialWaitTime.fetch_add(nanoSeconds, std::memory_order_relaxed);
 }
 
 PVSFrame VSNode::getFrameInternal(int n, int activationReason, VSFrameContext *frameCtx) {
+    // frames that were pushed out of the regular cache may still be around in compressed form
+    if (activationReason == arInitial && compressedMaxSize) {
+        PVSFrame cf = getCompressedFrame(n);
+        if (cf) {
+            if (cacheEnabled) {
+                {
+                    std::lock_guard<std::mutex> lock(cacheMutex);
+                    if (cacheEnabled)
+                        cache.insert(n, cf);
+                }
+                storeEvictedFrames();
+            }
+            return cf;
+        }
+    }
+
+    // inputs with the same contents as an earlier call get that call's output planes with the
+    // properties of the current input
+    uint64_t memoKey = 0;
+    const VSFrame *propSrc = nullptr;
+    bool partial = !frameCtx->region.isWholeFrame();
+    bool memoize = memoMaxFrames && !partial && activationReason == arAllFramesReady && getMemoKey(n, frameCtx, memoKey, propSrc);
+    if (memoize) {
+        PVSFrame hit;
+        {
+            std::lock_guard<std::mutex> lock(memoMutex);
+            auto iter = memo.find(memoKey);
+            if (iter != memo.end())
+                hit = iter->second;
+        }
+
+        if (hit) {
+            PVSFrame f(new VSFrame(*hit));
+            f->setProperties(propSrc->getConstProperties());
+            if (cacheEnabled) {
+                {
+                    std::lock_guard<std::mutex> lock(cacheMutex);
+                    if (cacheEnabled)
+                        cache.insert(n, f);
+                }
+                storeEvictedFrames();
+            }
+            return f;
+        }
+    }
+
     std::chrono::time_point<std::chrono::high_resolution_clock> startTime;
     bool enableGraphInspection = core->enableGraphInspection;
-    if (enableGraphInspection)
+    int64_t countersBefore[pcNumCounters];
+    bool readCounters = core->enablePerfCounters && vs_read_perf_counters(countersBefore);
+    VSMemoryAccount *prevAccount = MemoryUse::currentAccount;
+    if (enableGraphInspection) {
+        MemoryUse::currentAccount = memoryAccount;
         startTime = std::chrono::high_resolution_clock::now();
+    }
 
-    const VSFrame *r = (apiMajor == VAPOURSYNTH_API_MAJOR) ? filterGetFrame(n, activationReason, instanceData, frameCtx->frameContext, frameCtx, core, &vs_internal_vsapi) : reinterpret_cast<vs3::VSFilterGetFrame>(filterGetFrame)(n, activationReason, &instanceData, frameCtx->frameContext, frameCtx, core, &vs_internal_vsapi3);
+    const VSFrame *r = stripeSource ? getStripeChainFrame(n, activationReason, frameCtx) : (apiMajor == VAPOURSYNTH_API_MAJOR) ? filterGetFrame(n, activationReason, instanceData, frameCtx->frameContext, frameCtx, core, &vs_internal_vsapi) : reinterpret_cast<vs3::VSFilterGetFrame>(filterGetFrame)(n, activationReason, &instanceData, frameCtx->frameContext, frameCtx, core, &vs_internal_vsapi3);
 
     if (enableGraphInspection) {
+        MemoryUse::currentAccount = prevAccount;
         std::chrono::nanoseconds duration = std::chrono::high_resolution_clock::now() - startTime;
         processingTime.fetch_add(duration.count(), std::memory_order_relaxed);
+        stats.getFrameCalls.fetch_add(1, std::memory_order_relaxed);
+        stats.getFrameLatency[NodeStats::bucket(duration.count())].fetch_add(1, std::memory_order_relaxed);
+        if (r)
+            stats.framesProduced.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int64_t countersAfter[pcNumCounters];
+    if (readCounters && vs_read_perf_counters(countersAfter)) {
+        for (int i = 0; i < pcNumCounters; i++)
+            stats.hwCounters[i].fetch_add(countersAfter[i] - countersBefore[i], std::memory_order_relaxed);
     }
 #ifdef VS_TARGET_OS_WINDOWS
     if (!vs_isSSEStateOk())
@@ -1255,6 +2913,7 @@ PVSFrame VSNode::getFrameInternal(int n, int activationReason, VSFrameContext *f
 
     if (r) {
         assert(r->getFrameType());
+        const_cast<VSFrame *>(r)->setRenderTarget(false);
 
         if (r->getFrameType() == mtVideo) {
             const VSVideoFormat *fi = r->getVideoFormat();
@@ -1266,7 +2925,7 @@ PVSFrame VSNode::getFrameInternal(int n, int activationReason, VSFrameContext *f
         } else {
             const VSAudioFormat *fi = r->getAudioFormat();
 
-            int expectedSamples = (n < ai.numFrames - 1) ? VS_AUDIO_FRAME_SAMPLES : (((ai.numSamples % VS_AUDIO_FRAME_SAMPLES) ? (ai.numSamples % VS_AUDIO_FRAME_SAMPLES) : VS_AUDIO_FRAME_SAMPLES));
+            int expectedSamples = (n < ai.numFrames - 1) ? audioFrameSamples : (((ai.numSamples % audioFrameSamples) ? (ai.numSamples % audioFrameSamples) : audioFrameSamples));
 
             if (ai.format.bitsPerSample != fi->bitsPerSample || ai.format.sampleType != fi->sampleType || ai.format.channelLayout != fi->channelLayout) {
                 core->logFatal("Filter " + name + " returned a frame that's not of the declared format");
@@ -1275,20 +2934,205 @@ PVSFrame VSNode::getFrameInternal(int n, int activationReason, VSFrameContext *f
             }
         }
 
-#ifdef VS_FRAME_GUARD
-        if (!r->verifyGuardPattern())
-            core->logFatal("Guard memory corrupted in frame " + std::to_string(n) + " returned from " + name);
-#endif
+        if (core->memory->guardsEnabled() && !r->verifyGuardPattern())
+            core->logFatal("Guard memory corrupted in frame " + std::to_string(n) + " returned from " + name);
+
+        PVSFrame ref(const_cast<VSFrame *>(r));
+
+        if (memoize) {
+            std::lock_guard<std::mutex> lock(memoMutex);
+            if (memoMaxFrames && memo.emplace(memoKey, ref).second) {
+                memoOrder.push_back(memoKey);
+                if (memoOrder.size() > memoMaxFrames) {
+                    memo.erase(memoOrder.front());
+                    memoOrder.pop_front();
+                }
+            }
+        }
+
+        if (cacheEnabled && !partial) {
+            {
+                std::lock_guard<std::mutex> lock(cacheMutex);
+                if (cacheEnabled)
+                    cache.insert(n, ref);
+            }
+            storeEvictedFrames();
+        }
+
+        return ref;
+    }
+
+    return nullptr;
+}
+
+// Rows of intermediate stripes for each plane are sized so that the two buffers stay in a typical L2 cache
+static const size_t stripeCacheBytes = 256 * 1024;
+static const int minStripeHeight = 16;
+
+namespace {
+
+struct StripeJob {
+    int plane;
+    int top;
+    int bottom;
+};
+
+struct StripeBuffer {
+    uint8_t *data = nullptr;
+    size_t size = 0;
+
+    uint8_t *get(size_t bytes) {
+        if (bytes > size) {
+            vsh_aligned_free(data);
+            data = static_cast<uint8_t *>(vsh_aligned_malloc(bytes, VSFrame::alignment));
+            size = bytes;
+        }
+        return data;
+    }
+
+    ~StripeBuffer() {
+        vsh_aligned_free(data);
+    }
+};
+
+} // namespace
+
+static ptrdiff_t stripeStride(const VSCore *core, int width, int bytesPerSample) {
+    return core->planeStride(static_cast<ptrdiff_t>(width) * bytesPerSample);
+}
+
+// Runs every node of the chain that processes plane on the rows needed for output rows jobTop to jobBottom. Each step
+// is given its input rows plus the halo any later step needs and the rows within its radius of an edge that
+// isn't a frame edge are discarded, so only the step writing output rows has to produce them exactly.
+void VSNode::runStripeJob(int plane, int jobTop, int jobBottom, const VSFrame *src, VSFrame *dst) const {
+    const std::vector<VSNode *> &chain = stripeChain;
+    static thread_local StripeBuffer buffers[2];
+    const VSAPI *vsapi = &vs_internal_vsapi;
+    const int width = vsapi->getFrameWidth(dst, plane);
+    const int height = vsapi->getFrameHeight(dst, plane);
+
+    std::vector<int> halo(chain.size() + 1, 0);
+    size_t last = 0;
+    for (size_t i = chain.size(); i > 0; i--) {
+        bool processed = !!(chain[i - 1]->stripePlanes & (1 << plane));
+        halo[i - 1] = halo[i] + (processed ? chain[i - 1]->stripeRadius : 0);
+        if (processed && !last)
+            last = i;
+    }
+
+    const uint8_t *curp = vsapi->getReadPtr(src, plane);
+    ptrdiff_t curStride = vsapi->getStride(src, plane);
+    int curTop = 0;
+    uint8_t *dstp = vsapi->getWritePtr(dst, plane);
+    ptrdiff_t dstStride = vsapi->getStride(dst, plane);
+    int next = 0;
+
+    for (size_t i = 0; i < chain.size(); i++) {
+        const VSNode *node = chain[i];
+        if (!(node->stripePlanes & (1 << plane)))
+            continue;
+
+        int top = std::max(jobTop - halo[i], 0);
+        int bottom = std::min(jobBottom + halo[i], height);
+        const uint8_t *srcp = curp + (top - curTop) * curStride;
+
+        if (i + 1 == last && halo[i] == 0) {
+            node->stripeFunc(plane, srcp, curStride, dstp + jobTop * dstStride, dstStride, width, bottom - top, node->instanceData, vsapi);
+            return;
+        }
+
+        ptrdiff_t stride = stripeStride(core, width, node->vi.format.bytesPerSample);
+        uint8_t *bufp = buffers[next].get((jobBottom - jobTop + 2 * halo[0]) * stride);
+        node->stripeFunc(plane, srcp, curStride, bufp, stride, width, bottom - top, node->instanceData, vsapi);
+
+        curp = bufp;
+        curStride = stride;
+        curTop = top;
+        next ^= 1;
+    }
+
+    // the last step had a radius so its rows were computed into a buffer first
+    bitblt(dstp + jobTop * dstStride, dstStride, curp + (jobTop - curTop) * curStride, curStride, static_cast<size_t>(width) * chain.back()->vi.format.bytesPerSample, jobBottom - jobTop);
+}
+
+const VSFrame *VSNode::getStripeChainFrame(int n, int activationReason, VSFrameContext *frameCtx) {
+    const VSAPI *vsapi = &vs_internal_vsapi;
+
+    const VSFrameContext::Region &region = frameCtx->region;
+
+    if (activationReason == arInitial) {
+        // only the rows of the region and within reach of the chain are needed from the source
+        int radius = 0;
+        for (int plane = 0; plane < vi.format.numPlanes; plane++) {
+            int planeRadius = 0;
+            for (const VSNode *node : stripeChain)
+                if (node->stripePlanes & (1 << plane))
+                    planeRadius += node->stripeRadius;
+            radius = std::max(radius, planeRadius << (plane ? vi.format.subSamplingH : 0));
+        }
+        if (region.propsOnly)
+            vsapi->requestFramePropsFilter(n, stripeSource, frameCtx);
+        else if (region.isWholeFrame())
+            vsapi->requestFrameFilter(n, stripeSource, frameCtx);
+        else
+            vsapi->requestFrameRegionFilter(n, stripeSource, 0, region.top - radius, vi.width, region.height + 2 * radius, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrame *src = vsapi->getFrameFilter(n, stripeSource, frameCtx);
+        const VSVideoFormat &fi = vi.format;
+
+        // nothing has to be computed, the planes of the source stand in for the output
+        if (region.propsOnly)
+            return src;
+
+        const int pl[] = { 0, 1, 2 };
+        const VSFrame *fr[] = { src, src, src };
+        for (const VSNode *node : stripeChain) {
+            for (int plane = 0; plane < fi.numPlanes; plane++)
+                if (node->stripePlanes & (1 << plane))
+                    fr[plane] = nullptr;
+        }
+
+        VSFrame *dst = vsapi->newVideoFrame2(&fi, vi.width, vi.height, fr, pl, src, core);
+
+        std::vector<StripeJob> jobs;
+        for (int plane = 0; plane < fi.numPlanes; plane++) {
+            if (fr[plane])
+                continue;
 
-        PVSFrame ref(const_cast<VSFrame *>(r));
+            int width = vsapi->getFrameWidth(dst, plane);
+            int height = vsapi->getFrameHeight(dst, plane);
+            int radius = 0;
+            ptrdiff_t stride = 0;
+            for (const VSNode *node : stripeChain) {
+                if (node->stripePlanes & (1 << plane)) {
+                    radius += node->stripeRadius;
+                    stride = std::max(stride, stripeStride(core, width, node->vi.format.bytesPerSample));
+                }
+            }
 
-        if (cacheEnabled) {
-            std::lock_guard<std::mutex> lock(cacheMutex);
-            if (cacheEnabled)
-                cache.insert(n, ref);
+            // rows outside a requested region are left unprocessed
+            int first = 0;
+            int last = height;
+            if (!region.isWholeFrame()) {
+                int ssh = plane ? fi.subSamplingH : 0;
+                first = region.top >> ssh;
+                last = (region.top + region.height) >> ssh;
+            }
+
+            int stripeHeight = std::max(static_cast<int>(stripeCacheBytes / (2 * stride)) - 2 * radius, minStripeHeight);
+            int numStripes = std::max((last - first) / stripeHeight, 1);
+            for (int i = 0; i < numStripes; i++)
+                jobs.push_back({ plane, first + static_cast<int>(static_cast<int64_t>(last - first) * i / numStripes), first + static_cast<int>(static_cast<int64_t>(last - first) * (i + 1) / numStripes) });
         }
 
-        return ref;
+        auto run = [&](int index) {
+            runStripeJob(jobs[index].plane, jobs[index].top, jobs[index].bottom, src, dst);
+        };
+        typedef decltype(run) RunType;
+        core->threadPool->parallelFor(static_cast<int>(jobs.size()), [](int index, void *userData) { (*static_cast<RunType *>(userData))(index); }, &run);
+
+        vsapi->freeFrame(src);
+        return dst;
     }
 
     return nullptr;
@@ -1343,15 +3187,48 @@ bool VSNode::isWorkerThread() {
     return core->threadPool->isWorkerThread();
 }
 
-void VSNode::notifyCache(bool needMemory) {
+void VSNode::notifyCache(bool needMemory, bool allowGrow) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.adjustSize(needMemory, allowGrow, cacheFloor, costHint);
+    // anything evicted here is compressed the next time a frame is inserted, doing it now would
+    // mean compressing while the core wide cache lock is held
+}
+
+double VSNode::getCacheHitRate() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return cache.hitRate();
+}
+
+int VSNode::getCacheBudget() {
     std::lock_guard<std::mutex> lock(cacheMutex);
-    cache.adjustSize(needMemory);
+    return cacheEnabled ? cache.getMaxFrames() : 0;
 }
 
 void VSCore::notifyCaches(bool needMemory) {
     std::lock_guard<std::mutex> lock(cacheLock);
-    for (auto &cache : caches)
-        cache->notifyCache(needMemory);
+
+    if (!needMemory && memory->isOverSoftLimit()) {
+        // Between the soft and hard limit no cache may grow and the caches that were reused the least
+        // since the last adjustment are trimmed as if memory was needed, this is usually enough to never
+        // reach the hard limit where everything has to shrink
+        // with streaming caches the inputs of temporal filters get the memory the others give up
+        std::vector<std::pair<double, VSNode *>> rates;
+        rates.reserve(caches.size());
+        for (auto &cache : caches) {
+            if (streamingCaches && cache->feedsTemporalFilter())
+                cache->notifyCache(false, true);
+            else
+                rates.emplace_back(cache->getCacheHitRate(), cache);
+        }
+
+        size_t numTrimmed = (rates.size() + 1) / 2;
+        std::nth_element(rates.begin(), rates.begin() + numTrimmed, rates.end());
+        for (size_t i = 0; i < rates.size(); i++)
+            rates[i].second->notifyCache(i < numTrimmed, false);
+    } else {
+        for (auto &cache : caches)
+            cache->notifyCache(needMemory, true);
+    }
 }
 
 const vs3::VSVideoFormat *VSCore::getV3VideoFormat(int id) {
@@ -1932,10 +3809,117 @@ void VSCore::registerFormats() {
 }
 
 
+#ifndef VS_TARGET_OS_WINDOWS
+// The cache is a text file with a P line describing each plugin followed by one F line per function, all fields
+// are tab separated and a plugin is only stored when none of its strings contain tabs or line breaks
+static const char pluginCacheSignature[] = "VapourSynth plugin cache 1";
+
+static void readPluginCache(const std::string &path, VSPluginCache &cache) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return;
+
+    std::string data;
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        data.append(buffer, n);
+    fclose(f);
+
+    std::vector<std::string> fields;
+    VSPluginManifest *current = nullptr;
+    bool first = true;
+    for (size_t pos = 0; pos < data.size();) {
+        size_t end = data.find('\n', pos);
+        if (end == std::string::npos)
+            end = data.size();
+        std::string line = data.substr(pos, end - pos);
+        pos = end + 1;
+
+        if (first) {
+            // also invalidates the cache when the core changes
+            if (line != std::string(pluginCacheSignature) + "\t" XSTR(VAPOURSYNTH_CORE_VERSION))
+                return;
+            first = false;
+            continue;
+        }
+
+        fields.clear();
+        for (size_t fpos = 0;;) {
+            size_t fend = line.find('\t', fpos);
+            fields.push_back(line.substr(fpos, fend == std::string::npos ? std::string::npos : fend - fpos));
+            if (fend == std::string::npos)
+                break;
+            fpos = fend + 1;
+        }
+
+        try {
+            if (fields[0] == "P" && fields.size() == 10) {
+                VSPluginManifest m;
+                m.filename = fields[1];
+                m.modified = std::stoll(fields[2]);
+                m.size = std::stoll(fields[3]);
+                m.id = fields[4];
+                m.fnamespace = fields[5];
+                m.pluginVersion = std::stoi(fields[6]);
+                m.apiVersion = std::stoi(fields[7]);
+                m.readOnly = fields[8] == "1";
+                m.fullname = fields[9];
+                current = &(cache.entries[m.filename] = m);
+            } else if (fields[0] == "F" && fields.size() == 4 && current) {
+                current->functions.push_back({ fields[1], fields[2], fields[3] });
+            } else {
+                current = nullptr;
+            }
+        } catch (std::logic_error &) {
+            current = nullptr;
+        }
+    }
+}
+
+static bool isCacheableString(const std::string &s) {
+    return s.find_first_of("\t\r\n") == std::string::npos;
+}
+
+static void writePluginCache(const std::string &path, const VSPluginCache &cache) {
+    // create the missing directories, errors show up when opening the file
+    for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1))
+        mkdir(path.substr(0, pos).c_str(), 0755);
+
+    std::string data = std::string(pluginCacheSignature) + "\t" XSTR(VAPOURSYNTH_CORE_VERSION) + "\n";
+    for (const auto &iter : cache.entries) {
+        const VSPluginManifest &m = iter.second;
+        if (!cache.used.count(m.filename))
+            continue;
+
+        bool cacheable = isCacheableString(m.filename) && isCacheableString(m.id) && isCacheableString(m.fnamespace) && isCacheableString(m.fullname);
+        for (const auto &func : m.functions)
+            cacheable = cacheable && isCacheableString(func.name) && isCacheableString(func.args) && isCacheableString(func.returnType);
+        if (!cacheable)
+            continue;
+
+        data += "P\t" + m.filename + "\t" + std::to_string(m.modified) + "\t" + std::to_string(m.size) + "\t" + m.id + "\t" + m.fnamespace + "\t" +
+            std::to_string(m.pluginVersion) + "\t" + std::to_string(m.apiVersion) + "\t" + (m.readOnly ? "1" : "0") + "\t" + m.fullname + "\n";
+        for (const auto &func : m.functions)
+            data += "F\t" + func.name + "\t" + func.args + "\t" + func.returnType + "\n";
+    }
+
+    // written next to the old cache and renamed so concurrently created cores never see half a file
+    std::string tmpPath = path + "." + std::to_string(getpid());
+    FILE *f = fopen(tmpPath.c_str(), "wb");
+    if (!f)
+        return;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = !fclose(f) && ok;
+    if (!ok || ::rename(tmpPath.c_str(), path.c_str()))
+        remove(tmpPath.c_str());
+}
+#endif
+
 #ifdef VS_TARGET_OS_WINDOWS
 bool VSCore::loadAllPluginsInPath(const std::wstring &path, const std::wstring &filter) {
 #else
-bool VSCore::loadAllPluginsInPath(const std::string &path, const std::string &filter) {
+bool VSCore::loadAllPluginsInPath(const std::string &path, const std::string &filter, VSPluginCache *cache) {
 #endif
     if (path.empty())
         return false;
@@ -1975,7 +3959,10 @@ bool VSCore::loadAllPluginsInPath(const std::string &path, const std::string &fi
             try {
                 std::string fullname;
                 fullname.append(path).append("/").append(name);
-                loadPlugin(fullname);
+                if (cache)
+                    loadPluginCached(fullname, *cache);
+                else
+                    loadPlugin(fullname);
             } catch (VSException &) {
                 // Ignore any errors
             }
@@ -2046,16 +4033,38 @@ VSCore::VSCore(int flags) :
     coreFreed(false),
     videoFormatIdOffset(1000),
     cpuLevel(INT_MAX),
+    nodeReuse(false),
     memory(new MemoryUse()),
-    enableGraphInspection(flags & ccfEnableGraphInspection) {
+    tracer((flags & ccfEnableTracing) ? new VSTracer() : nullptr),
+    enableGraphInspection(flags & ccfEnableGraphInspection),
+    enablePerfCounters((flags & ccfEnablePerfCounters) && (flags & ccfEnableGraphInspection)) {
+    std::fill_n(kernelCpuLevels, VS_KERNEL_FAMILY_COUNT, INT_MAX);
+
 #ifdef VS_TARGET_OS_WINDOWS
     if (!vs_isSSEStateOk())
         logFatal("Bad SSE state detected when creating new core");
 #endif
 
     disableLibraryUnloading = !!(flags & ccfDisableLibraryUnloading);
+    streamingCaches = !!(flags & ccfStreamingCaches);
     bool disableAutoLoading = !!(flags & ccfDisableAutoLoading);
-    threadPool = new VSThreadPool(this);
+    threadPool = new VSThreadPool(this, !!(flags & ccfNumaAware), !!(flags & ccfAdaptiveThreads), !!(flags & ccfLowLatency), !!(flags & ccfSharedResources), !!(flags & ccfTopologyAware), !!(flags & ccfRealTime));
+    if (flags & ccfSharedResources)
+        memory->enableSharedBudget();
+    memory->setNumaNodes(threadPool->numaNodeCount());
+    if (flags & ccfLargePages)
+        memory->enableLargePages(!!(flags & ccfPrefaultFrames));
+    // builds with VS_FRAME_GUARD already guard every plane
+    if ((flags & ccfFrameGuard) && !memory->guardsEnabled())
+        memory->setGuardInterval(64);
+
+    if (enablePerfCounters) {
+        int64_t counters[pcNumCounters];
+        if (!vs_read_perf_counters(counters)) {
+            logMessage(mtWarning, "Hardware performance counters aren't available, check perf_event_paranoid");
+            enablePerfCounters = false;
+        }
+    }
 
     registerFormats();
 
@@ -2071,9 +4080,13 @@ VSCore::VSCore(int flags) :
     lutInitialize(p, &vs_internal_vspapi);
     boxBlurInitialize(p, &vs_internal_vspapi);
     averageFramesInitialize(p, &vs_internal_vspapi);
+    diskCacheInitialize(p, &vs_internal_vspapi);
+    remoteInitialize(p, &vs_internal_vspapi);
+    intermediateInitialize(p, &vs_internal_vspapi);
     mergeInitialize(p, &vs_internal_vspapi);
     reorderInitialize(p, &vs_internal_vspapi);
     audioInitialize(p, &vs_internal_vspapi);
+    audioStatsInitialize(p, &vs_internal_vspapi);
     stdlibInitialize(p, &vs_internal_vspapi);
     p->lock();
 
@@ -2151,11 +4164,13 @@ VSCore::VSCore(int flags) :
 
 #else
     std::string configFile;
+    std::string defaultPluginCacheFile;
     const char *home = getenv("HOME");
 #ifdef VS_TARGET_OS_DARWIN
     std::string filter = ".dylib";
     if (home) {
         configFile.append(home).append("/Library/Application Support/VapourSynth/vapoursynth.conf");
+        defaultPluginCacheFile.append(home).append("/Library/Caches/VapourSynth/plugincache");
     }
 #else
     std::string filter = ".so";
@@ -2165,6 +4180,12 @@ VSCore::VSCore(int flags) :
     } else if (home) {
         configFile.append(home).append("/.config/vapoursynth/vapoursynth.conf");
     } // If neither exists, an empty string will do.
+    const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+    if (xdg_cache_home) {
+        defaultPluginCacheFile.append(xdg_cache_home).append("/vapoursynth/plugincache");
+    } else if (home) {
+        defaultPluginCacheFile.append(home).append("/.cache/vapoursynth/plugincache");
+    }
 #endif
 
     VSMap *settings = readSettings(configFile);
@@ -2175,6 +4196,23 @@ VSCore::VSCore(int flags) :
         int err;
         const char *tmp;
 
+        // the values written by "make calibrate" come first so the ones set by hand take precedence
+        tmp = vs_internal_vsapi.mapGetData(settings, "CalibrationFile", 0, &err);
+        std::string calibrationFile(tmp ? tmp : "");
+        if (!tmp && !configFile.empty())
+            calibrationFile = configFile.substr(0, configFile.find_last_of('/') + 1) + "calibration.conf";
+
+        if (!calibrationFile.empty()) {
+            VSMap *calibration = readSettings(calibrationFile);
+            if (vs_internal_vsapi.mapGetError(calibration))
+                logMessage(mtWarning, vs_internal_vsapi.mapGetError(calibration));
+            else
+                applyTuningSettings(calibration, calibrationFile);
+            vs_internal_vsapi.freeMap(calibration);
+        }
+
+        applyTuningSettings(settings, configFile);
+
         tmp = vs_internal_vsapi.mapGetData(settings, "UserPluginDir", 0, &err);
         std::string userPluginDir(tmp ? tmp : "");
 
@@ -2187,17 +4225,34 @@ VSCore::VSCore(int flags) :
         tmp = vs_internal_vsapi.mapGetData(settings, "AutoloadSystemPluginDir", 0, &err);
         bool autoloadSystemPluginDir = tmp ? std::string(tmp) == "true" : true;
 
+        // autoloaded plugins found in the cache are only registered and loaded when one of their functions is first invoked
+        tmp = vs_internal_vsapi.mapGetData(settings, "LazyPluginLoading", 0, &err);
+        bool lazyPluginLoading = tmp ? std::string(tmp) == "true" : false;
+
+        tmp = vs_internal_vsapi.mapGetData(settings, "PluginCacheFile", 0, &err);
+        std::string pluginCacheFile(tmp ? tmp : defaultPluginCacheFile);
+
+        VSPluginCache pluginCache;
+        VSPluginCache *cache = nullptr;
+        if (lazyPluginLoading && !pluginCacheFile.empty()) {
+            readPluginCache(pluginCacheFile, pluginCache);
+            cache = &pluginCache;
+        }
+
         if (!disableAutoLoading && autoloadUserPluginDir && !userPluginDir.empty()) {
-            if (!loadAllPluginsInPath(userPluginDir, filter)) {
+            if (!loadAllPluginsInPath(userPluginDir, filter, cache)) {
                 logMessage(mtWarning, "Autoloading the user plugin dir '" + userPluginDir + "' failed. Directory doesn't exist?");
             }
         }
 
         if (autoloadSystemPluginDir) {
-            if (!loadAllPluginsInPath(systemPluginDir, filter)) {
+            if (!loadAllPluginsInPath(systemPluginDir, filter, cache)) {
                 logMessage(mtCritical, "Autoloading the system plugin dir '" + systemPluginDir + "' failed. Directory doesn't exist?");
             }
         }
+
+        if (cache && (pluginCache.changed || pluginCache.used.size() != pluginCache.entries.size()))
+            writePluginCache(pluginCacheFile, pluginCache);
     }
 
     vs_internal_vsapi.freeMap(settings);
@@ -2209,12 +4264,15 @@ void VSCore::freeCore() {
         logFatal("Double free of core");
     coreFreed = true;
     threadPool->waitForDone();
+    setNodeReuse(false);
     if (numFilterInstances > 1)
         logMessage(mtWarning, "Core freed but " + std::to_string(numFilterInstances.load() - 1) + " filter instance(s) still exist");
     if (memory->memoryUse() > 0)
         logMessage(mtWarning, "Core freed but " + std::to_string(memory->memoryUse()) + " bytes still allocated in framebuffers");
     if (numFunctionInstances > 0)
         logMessage(mtWarning, "Core freed but " + std::to_string(numFunctionInstances.load()) + " function instance(s) still exist");
+    if (memory->largePagePeakUse() > 0)
+        logMessage(mtDebug, "Up to " + std::to_string(memory->largePagePeakUse()) + " bytes of framebuffers were allocated with large pages");
     // Remove all message handlers on free to prevent a zombie core from crashing the whole application by calling a no longer usable
     // message handler
     while (!messageHandlers.empty())
@@ -2226,6 +4284,7 @@ void VSCore::freeCore() {
 VSCore::~VSCore() {
     memory->signalFree();
     delete threadPool;
+    delete tracer;
     for(const auto &iter : plugins)
         delete iter.second;
     plugins.clear();
@@ -2271,9 +4330,48 @@ VSPlugin *VSCore::getNextPlugin(VSPlugin *plugin) {
     }
 }
 
-void VSCore::loadPlugin(const std::string &filename, const std::string &forcedNamespace, const std::string &forcedId, bool altSearchPath) {
+VSPlugin *VSCore::loadPlugin(const std::string &filename, const std::string &forcedNamespace, const std::string &forcedId, bool altSearchPath) {
     std::unique_ptr<VSPlugin> p(new VSPlugin(filename, forcedNamespace, forcedId, altSearchPath, this));
+    return addPlugin(p, filename);
+}
+
+#ifndef VS_TARGET_OS_WINDOWS
+void VSCore::loadPluginCached(const std::string &filename, VSPluginCache &cache) {
+    std::vector<char> fullPathBuffer(PATH_MAX + 1);
+    std::string fullPath = realpath(filename.c_str(), fullPathBuffer.data()) ? fullPathBuffer.data() : filename;
+
+    struct stat st;
+    if (stat(fullPath.c_str(), &st)) {
+        loadPlugin(filename);
+        return;
+    }
+
+    auto entry = cache.entries.find(fullPath);
+    if (entry != cache.entries.end() && entry->second.modified == static_cast<int64_t>(st.st_mtime) && entry->second.size == static_cast<int64_t>(st.st_size)) {
+        std::unique_ptr<VSPlugin> p;
+        try {
+            p.reset(new VSPlugin(entry->second, this));
+        } catch (std::runtime_error &) {
+            // a damaged entry, load the plugin normally below and replace it
+        }
+        if (p) {
+            cache.used.insert(fullPath);
+            addPlugin(p, filename);
+            return;
+        }
+    }
+
+    VSPluginManifest manifest = loadPlugin(filename)->getManifest();
+    manifest.modified = st.st_mtime;
+    manifest.size = st.st_size;
+    cache.entries[manifest.filename] = manifest;
+    cache.used.insert(manifest.filename);
+    cache.changed = true;
+}
 
+#endif
+
+VSPlugin *VSCore::addPlugin(std::unique_ptr<VSPlugin> &p, const std::string &filename) {
     std::lock_guard<std::recursive_mutex> lock(pluginLock);
 
     VSPlugin *already_loaded_plugin = getPluginByID(p->getID());
@@ -2293,7 +4391,7 @@ void VSCore::loadPlugin(const std::string &filename, const std::string &forcedNa
     }
 
     plugins.insert(std::make_pair(p->getID(), p.get()));
-    p.release();
+    return p.release();
 }
 
 void VSCore::createFilter3(const VSMap *in, VSMap *out, const std::string &name, vs3::VSFilterInit init, VSFilterGetFrame getFrame, VSFilterFree free, VSFilterMode filterMode, int flags, void *instanceData, int apiMajor) {
@@ -2347,8 +4445,190 @@ int VSCore::setCpuLevel(int cpu) {
     return cpuLevel.exchange(cpu);
 }
 
+int VSCore::getKernelCpuLevel(int family) const {
+    int level = cpuLevel;
+    if (family >= 0 && family < VS_KERNEL_FAMILY_COUNT)
+        level = std::min(level, kernelCpuLevels[family]);
+    return level;
+}
+
+void VSCore::applyTuningSettings(const VSMap *settings, const std::string &source) {
+    int err;
+    const char *tmp;
+
+    auto parseLevel = [&](const char *key, int &level) {
+        const char *value = vs_internal_vsapi.mapGetData(settings, key, 0, &err);
+        if (!value)
+            return;
+        int parsed = vs_cpulevel_from_str(value);
+        if (parsed == VS_CPU_LEVEL_MAX)
+            logMessage(mtWarning, std::string("Unknown cpu level '") + value + "' for " + key + " in '" + source + "'");
+        else
+            level = parsed;
+    };
+
+    int level = cpuLevel;
+    parseLevel("CPULevel", level);
+    cpuLevel = level;
+
+    for (int family = 0; family < VS_KERNEL_FAMILY_COUNT; family++)
+        parseLevel(vs_kernel_family_setting(family), kernelCpuLevels[family]);
+
+    tmp = vs_internal_vsapi.mapGetData(settings, "Threads", 0, &err);
+    if (tmp) {
+        int threads = atoi(tmp);
+        if (threads > 0)
+            threadPool->setThreadCount(threads);
+        else
+            logMessage(mtWarning, std::string("Invalid Threads value '") + tmp + "' in '" + source + "'");
+    }
+
+    // in megabytes like setMaxCacheSize()
+    tmp = vs_internal_vsapi.mapGetData(settings, "MaxCacheSize", 0, &err);
+    if (tmp) {
+        int64_t size = atoll(tmp);
+        if (size > 0)
+            memory->setMaxMemoryUse(size * 1024 * 1024);
+        else
+            logMessage(mtWarning, std::string("Invalid MaxCacheSize value '") + tmp + "' in '" + source + "'");
+    }
+
+    // in microseconds, 0 parks idle workers right away
+    tmp = vs_internal_vsapi.mapGetData(settings, "WorkerSpinTime", 0, &err);
+    if (tmp) {
+        char *end = nullptr;
+        int64_t spinTime = strtoll(tmp, &end, 10);
+        if (end != tmp && !*end && spinTime >= 0)
+            threadPool->setSpinTime(spinTime * 1000);
+        else
+            logMessage(mtWarning, std::string("Invalid WorkerSpinTime value '") + tmp + "' in '" + source + "'");
+    }
+
+    tmp = vs_internal_vsapi.mapGetData(settings, "BatchWakeups", 0, &err);
+    if (tmp)
+        threadPool->setBatchWakeups(std::string(tmp) == "true");
+
+    // in bytes, has to keep the rows aligned
+    tmp = vs_internal_vsapi.mapGetData(settings, "StridePadding", 0, &err);
+    if (tmp) {
+        char *end = nullptr;
+        long padding = strtol(tmp, &end, 10);
+        if (end != tmp && !*end && padding >= 0 && padding <= 4096 && !(padding % VSFrame::alignment))
+            stridePadding = static_cast<int>(padding);
+        else
+            logMessage(mtWarning, std::string("Invalid StridePadding value '") + tmp + "' in '" + source + "'");
+    }
+}
+
+void VSCore::setNodeReuse(bool enable) {
+    std::unordered_map<std::string, NodeReuseEntry> released;
+    std::lock_guard<std::mutex> lock(nodeReuseLock);
+    nodeReuse = enable;
+    if (!enable)
+        released.swap(nodeReuseEntries);
+}
+
+int VSCore::releaseUnusedNodes() {
+    // the maps are only released after the lock since freeing a node can end up back in invoke()
+    std::vector<NodeReuseEntry> released;
+    {
+        std::lock_guard<std::mutex> lock(nodeReuseLock);
+        for (auto iter = nodeReuseEntries.begin(); iter != nodeReuseEntries.end();) {
+            if (!iter->second.used) {
+                released.push_back(std::move(iter->second));
+                iter = nodeReuseEntries.erase(iter);
+            } else {
+                iter->second.used = false;
+                ++iter;
+            }
+        }
+    }
+    return static_cast<int>(released.size());
+}
+
+bool VSCore::isNodeReuseEnabled() {
+    return nodeReuse;
+}
+
+void VSCore::setProxyScale(int scale) {
+    proxyScale = std::max(scale, 1);
+}
+
+int VSCore::getProxyScale() const {
+    return proxyScale;
+}
+
+// Rows a multiple of 1024 bytes apart share their L1 sets and 4K aliasing every few rows, so vertical
+// kernels keep evicting the rows they're about to read. Such strides get stridePadding extra bytes.
+ptrdiff_t VSCore::planeStride(ptrdiff_t rowSize) const {
+    ptrdiff_t stride = (rowSize + (VSFrame::alignment - 1)) & ~static_cast<ptrdiff_t>(VSFrame::alignment - 1);
+    if (stridePadding && !(stride % 1024))
+        stride += stridePadding;
+    return stride;
+}
+
+bool VSCore::findReusableNodes(const std::string &key, VSMap *out) {
+    std::lock_guard<std::mutex> lock(nodeReuseLock);
+    auto iter = nodeReuseEntries.find(key);
+    if (iter == nodeReuseEntries.end())
+        return false;
+    iter->second.used = true;
+    out->copy(iter->second.result.get());
+    return true;
+}
+
+void VSCore::addReusableNodes(const std::string &key, const VSMap &args, const VSMap &result) {
+    std::lock_guard<std::mutex> lock(nodeReuseLock);
+    if (nodeReuse)
+        nodeReuseEntries[key] = { std::unique_ptr<VSMap>(new VSMap(&args)), std::unique_ptr<VSMap>(new VSMap(&result)), true };
+}
+
+bool VSCore::findDedupNode(const std::string &key, VSMap *out) {
+    std::lock_guard<std::mutex> lock(dedupLock);
+    auto iter = dedupNodes.find(key);
+    if (iter == dedupNodes.end() || !iter->second.node->tryAddRef())
+        return false;
+    vs_internal_vsapi.mapConsumeNode(out, iter->second.retKey.c_str(), iter->second.node, maAppend);
+    return true;
+}
+
+void VSCore::addDedupNode(const std::string &key, const VSMap &args, const VSMap &result) {
+    // only a single node can be tracked by its own lifetime
+    if (result.hasError() || result.size() != 1)
+        return;
+    const auto &ret = result.entries()[0];
+    if (ret.value->type() != ptVideoNode || ret.value->size() != 1)
+        return;
+
+    VSNode *node = reinterpret_cast<const VSVideoNodeArray *>(ret.value.get())->at(0).get();
+    std::unique_ptr<VSMap> released;
+    std::lock_guard<std::mutex> lock(dedupLock);
+    DedupEntry &entry = dedupNodes[key];
+    // a concurrent identical call may have won the race, its node stays valid but is no longer shared
+    if (entry.node)
+        entry.node->dedupKey.clear();
+    released.swap(entry.args);
+    entry = { node, ret.key->name, std::unique_ptr<VSMap>(new VSMap(&args)) };
+    node->dedupKey = key;
+}
+
+void VSCore::forgetDedupNode(VSNode *node) {
+    // the arguments are released after the lock since they may hold the last reference to other shared nodes
+    std::unique_ptr<VSMap> released;
+    {
+        std::lock_guard<std::mutex> lock(dedupLock);
+        if (node->dedupKey.empty())
+            return;
+        auto iter = dedupNodes.find(node->dedupKey);
+        if (iter != dedupNodes.end() && iter->second.node == node) {
+            released.swap(iter->second.args);
+            dedupNodes.erase(iter);
+        }
+    }
+}
+
 VSPlugin::VSPlugin(VSCore *core)
-    : libHandle(0), core(core) {
+    : libHandle(0), core(core), deferred(false) {
 }
 
 static void VS_CC configPlugin3(const char *identifier, const char *defaultNamespace, const char *name, int apiVersion, int readOnly, VSPlugin *plugin) VS_NOEXCEPT {
@@ -2357,7 +4637,24 @@ static void VS_CC configPlugin3(const char *identifier, const char *defaultNames
 }
 
 VSPlugin::VSPlugin(const std::string &relFilename, const std::string &forcedNamespace, const std::string &forcedId, bool altSearchPath, VSCore *core)
-    : fnamespace(forcedNamespace), id(forcedId), core(core) {
+    : fnamespace(forcedNamespace), id(forcedId), core(core), deferred(false) {
+    load(relFilename, altSearchPath);
+}
+
+VSPlugin::VSPlugin(const VSPluginManifest &manifest, VSCore *core)
+    : pluginVersion(manifest.pluginVersion), hasConfig(true), readOnlySet(manifest.readOnly), filename(manifest.filename), fullname(manifest.fullname),
+    fnamespace(manifest.fnamespace), id(manifest.id), libHandle(0), core(core), deferred(true) {
+    // the cached argument strings are always in the V4 form
+    apiMajor = VAPOURSYNTH_API_MAJOR;
+    for (const auto &iter : manifest.functions)
+        funcs.emplace(std::make_pair(iter.name, VSPluginFunction(iter.name, iter.args, iter.returnType, nullptr, nullptr, this)));
+
+    apiMajor = manifest.apiVersion >> 16;
+    apiMinor = manifest.apiVersion & 0xFFFF;
+    readOnly = readOnlySet;
+}
+
+void VSPlugin::load(const std::string &relFilename, bool altSearchPath) {
 #ifdef VS_TARGET_OS_WINDOWS
     std::wstring wPath = utf16_from_utf8(relFilename);
     std::vector<wchar_t> fullPathBuffer(32767 + 1); // add 1 since msdn sucks at mentioning whether or not it includes the final null
@@ -2449,10 +4746,39 @@ VSPlugin::VSPlugin(const std::string &relFilename, const std::string &forcedName
         if (!core->disableLibraryUnloading)
             dlclose(libHandle);
 #endif
+        libHandle = 0;
         throw VSException("Core only supports API R" + std::to_string(VAPOURSYNTH_API_MAJOR) + "." + std::to_string(VAPOURSYNTH_API_MINOR) + " but the loaded plugin requires API R" + std::to_string(apiMajor) + "." + std::to_string(apiMinor) + "; Filename: " + relFilename + "; Name: " + fullname);
     }
 }
 
+void VSPlugin::ensureLoaded() {
+    std::lock_guard<std::mutex> lock(loadLock);
+    if (!deferred)
+        return;
+
+    // the library registers its functions into the existing stubs, anything it no longer provides stays unresolved
+    try {
+        load(filename, false);
+    } catch (VSException &e) {
+        core->logMessage(mtCritical, e.what());
+    }
+    deferred = false;
+}
+
+VSPluginManifest VSPlugin::getManifest() const {
+    VSPluginManifest m;
+    m.filename = filename;
+    m.id = id;
+    m.fnamespace = fnamespace;
+    m.fullname = fullname;
+    m.pluginVersion = pluginVersion;
+    m.apiVersion = (apiMajor << 16) | apiMinor;
+    m.readOnly = readOnlySet;
+    for (const auto &iter : funcs)
+        m.functions.push_back({ iter.first, iter.second.getArguments(), iter.second.getReturnType() });
+    return m;
+}
+
 VSPlugin::~VSPlugin() {
 #ifdef VS_TARGET_OS_WINDOWS
     if (libHandle != INVALID_HANDLE_VALUE && !core->disableLibraryUnloading)
@@ -2464,7 +4790,7 @@ VSPlugin::~VSPlugin() {
 }
 
 bool VSPlugin::configPlugin(const std::string &identifier, const std::string &pluginNamespace, const std::string &fullname, int pluginVersion, int apiVersion, int flags) {
-    if (hasConfig)
+    if (hasConfig && !deferred)
         core->logFatal("Attempted to configure plugin " + identifier + " twice");
 
     if (flags & ~pcModifiable)
@@ -2490,8 +4816,29 @@ bool VSPlugin::configPlugin(const std::string &identifier, const std::string &pl
     return true;
 }
 
+bool VSPlugin::setFunctionFlags(const std::string &name, int flags) {
+    if (readOnly && !deferred) {
+        core->logMessage(mtCritical, "API MISUSE! Tried to set the flags of function " + name + " but plugin " + id + " is read only");
+        return false;
+    }
+
+    if (flags & ~(pffDeterministic | pffProxyScalable)) {
+        core->logMessage(mtCritical, "API MISUSE! Invalid flags passed to setFunctionFlags() for function " + name + " by plugin " + id);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(functionLock);
+    auto iter = funcs.find(name);
+    if (iter == funcs.end() || !iter->second.func) {
+        core->logMessage(mtCritical, "API MISUSE! Tried to set the flags of function " + name + " which plugin " + id + " hasn't registered");
+        return false;
+    }
+    iter->second.flags = flags;
+    return true;
+}
+
 bool VSPlugin::registerFunction(const std::string &name, const std::string &args, const std::string &returnType, VSPublicFunction argsFunc, void *functionData) {
-    if (readOnly) {
+    if (readOnly && !deferred) {
         core->logMessage(mtCritical, "API MISUSE! Tried to register function " + name + " but plugin " + id + " is read only");
         return false;
     }
@@ -2503,6 +4850,18 @@ bool VSPlugin::registerFunction(const std::string &name, const std::string &args
 
     std::lock_guard<std::mutex> lock(functionLock);
 
+    // resolving a stub keeps the function at the same address since it may already have been handed out
+    auto stub = funcs.find(name);
+    if (deferred && stub != funcs.end() && !stub->second.func) {
+        try {
+            stub->second = VSPluginFunction(name, args, returnType, argsFunc, functionData, this);
+        } catch (std::runtime_error &e) {
+            core->logMessage(mtCritical, "API MISUSE! Function '" + name + "' failed to register with error: " + e.what());
+            return false;
+        }
+        return true;
+    }
+
     if (funcs.count(name)) {
         core->logMessage(mtCritical, "API MISUSE! Tried to register function '" + name + "' more than once for plugin " + id);
         return false;
@@ -2599,10 +4958,19 @@ inline VSNode::VSCache::VSCache(int maxSize, int maxHistorySize, bool fixedSize)
 }
 
 inline PVSFrame VSNode::VSCache::object(const int key) {
+    if (ringMode)
+        return ringObject(key);
+    if (scanMode)
+        return scanObject(key);
     return this->relink(key);
 }
 
 inline bool VSNode::VSCache::remove(const int key) {
+    if (ringMode)
+        return ringRemove(key);
+    if (scanMode)
+        return scanRemove(key);
+
     auto i = hash.find(key);
 
     if (i == hash.end()) {
@@ -2617,6 +4985,13 @@ inline bool VSNode::VSCache::remove(const int key) {
 bool VSNode::VSCache::insert(const int akey, const PVSFrame &aobject) {
     assert(aobject);
     assert(akey >= 0);
+    if (ringMode) {
+        ringInsert(akey, aobject);
+        return true;
+    } else if (scanMode) {
+        scanInsert(akey, aobject);
+        return true;
+    }
     remove(akey);
     auto i = hash.insert(std::make_pair(akey, Node(akey, aobject)));
     currentSize++;
@@ -2637,7 +5012,31 @@ bool VSNode::VSCache::insert(const int akey, const PVSFrame &aobject) {
 }
 
 
+size_t VSNode::VSCache::frameBytes() const {
+    // only the storage of the current mode has any entries
+    size_t bytes = 0;
+    for (const auto &iter : hash)
+        if (iter.second.frame)
+            bytes += iter.second.frame->memorySize();
+    for (const auto &slot : ring)
+        if (slot.frame)
+            bytes += slot.frame->memorySize();
+    for (const auto &iter : scanEntries)
+        if (iter.second.frame)
+            bytes += iter.second.frame->memorySize();
+    return bytes;
+}
+
 void VSNode::VSCache::trim(int max, int maxHistory) {
+    if (ringMode) {
+        ringResize();
+        ringTrim(max, maxHistory);
+        return;
+    } else if (scanMode) {
+        scanTrim(max, maxHistory);
+        return;
+    }
+
     // first adjust the number of cached frames and extra history length
     while (currentSize > max) {
         if (!weakpoint)
@@ -2646,7 +5045,7 @@ void VSNode::VSCache::trim(int max, int maxHistory) {
             weakpoint = weakpoint->prevNode;
 
         if (weakpoint)
-            weakpoint->frame.reset();
+            evict(weakpoint->key, weakpoint->frame);
 
         currentSize--;
         historySize++;
@@ -2658,7 +5057,211 @@ void VSNode::VSCache::trim(int max, int maxHistory) {
     }
 }
 
-void VSNode::VSCache::adjustSize(bool needMemory) {
+void VSNode::VSCache::setRingMode(bool ring) {
+    if (ring == ringMode)
+        return;
+    clear();
+    ringMode = ring;
+    if (!ringMode)
+        this->ring.clear();
+    else
+        scanMode = false;
+    trim(maxSize, maxHistorySize);
+}
+
+void VSNode::VSCache::setScanResistant(bool scanResistant) {
+    if (scanResistant == scanMode)
+        return;
+    if (scanResistant)
+        setRingMode(false);
+    clear();
+    scanMode = scanResistant;
+    trim(maxSize, maxHistorySize);
+}
+
+// Makes sure there are enough slots for all cached frames and history entries, entries that end
+// up in the same slot after resizing only keep the most recently used one
+void VSNode::VSCache::ringResize() {
+    size_t needed = 4;
+    while (needed < static_cast<size_t>(std::max(maxSize, 0) + std::max(maxHistorySize, 0)))
+        needed *= 2;
+    if (needed == ring.size())
+        return;
+
+    std::vector<RingSlot> old;
+    old.swap(ring);
+    ring.resize(needed);
+    ringMask = needed - 1;
+    currentSize = 0;
+    historySize = 0;
+
+    for (auto &slot : old) {
+        if (slot.key < 0)
+            continue;
+        RingSlot &dst = ring[slot.key & ringMask];
+        if (dst.key >= 0) {
+            if (dst.lastUse >= slot.lastUse)
+                continue;
+            if (dst.frame)
+                currentSize--;
+            else
+                historySize--;
+        }
+        dst = std::move(slot);
+        if (dst.frame)
+            currentSize++;
+        else
+            historySize++;
+    }
+}
+
+PVSFrame VSNode::VSCache::ringObject(const int key) {
+    RingSlot &slot = ring[key & ringMask];
+    if (slot.key != key) {
+        farMiss++;
+        return nullptr;
+    } else if (!slot.frame) {
+        nearMiss++;
+        return nullptr;
+    }
+
+    hits++;
+    slot.lastUse = ++ringClock;
+    return slot.frame;
+}
+
+void VSNode::VSCache::ringInsert(const int key, const PVSFrame &object) {
+    RingSlot &slot = ring[key & ringMask];
+    if (slot.key >= 0) {
+        if (slot.frame)
+            currentSize--;
+        else
+            historySize--;
+        if (slot.key != key)
+            evict(slot.key, slot.frame);
+    }
+    slot.key = key;
+    slot.frame = object;
+    slot.lastUse = ++ringClock;
+    currentSize++;
+    ringTrim(maxSize, maxHistorySize);
+}
+
+bool VSNode::VSCache::ringRemove(const int key) {
+    RingSlot &slot = ring[key & ringMask];
+    if (slot.key != key)
+        return false;
+    if (slot.frame)
+        currentSize--;
+    else
+        historySize--;
+    slot.key = -1;
+    slot.frame.reset();
+    return true;
+}
+
+// The ring is small so finding the least recently used entry with a linear scan is cheap
+void VSNode::VSCache::ringTrim(int max, int maxHistory) {
+    while (currentSize > std::max(max, 0) || historySize > std::max(maxHistory, 0)) {
+        bool dropFrame = currentSize > std::max(max, 0);
+        RingSlot *oldest = nullptr;
+        for (auto &slot : ring)
+            if (slot.key >= 0 && !!slot.frame == dropFrame && (!oldest || slot.lastUse < oldest->lastUse))
+                oldest = &slot;
+        assert(oldest);
+        if (dropFrame) {
+            // the frame turns into a history entry
+            evict(oldest->key, oldest->frame);
+            currentSize--;
+            historySize++;
+        } else {
+            oldest->key = -1;
+            historySize--;
+        }
+    }
+}
+
+PVSFrame VSNode::VSCache::scanObject(const int key) {
+    auto i = scanEntries.find(key);
+    if (i == scanEntries.end()) {
+        farMiss++;
+        return nullptr;
+    } else if (i->second.list == slHistory) {
+        nearMiss++;
+        return nullptr;
+    }
+
+    // anything requested a second time while it's still cached is worth protecting
+    hits++;
+    PVSFrame frame = i->second.frame;
+    scanMove(i->second, key, slProtected);
+    scanTrim(maxSize, maxHistorySize);
+    return frame;
+}
+
+void VSNode::VSCache::scanInsert(const int key, const PVSFrame &object) {
+    auto i = scanEntries.find(key);
+    if (i == scanEntries.end()) {
+        ScanEntry &e = scanEntries[key];
+        e.frame = object;
+        e.list = slProbation;
+        scanLists[slProbation].push_front(key);
+        e.pos = scanLists[slProbation].begin();
+    } else {
+        ScanEntry &e = i->second;
+        if (e.list == slHistory) {
+            historySize--;
+            scanMove(e, key, slProtected);
+        } else {
+            currentSize--;
+            scanMove(e, key, e.list);
+        }
+        e.frame = object;
+    }
+    currentSize++;
+    scanTrim(maxSize, maxHistorySize);
+}
+
+bool VSNode::VSCache::scanRemove(const int key) {
+    auto i = scanEntries.find(key);
+    if (i == scanEntries.end())
+        return false;
+    if (i->second.list == slHistory)
+        historySize--;
+    else
+        currentSize--;
+    scanLists[i->second.list].erase(i->second.pos);
+    scanEntries.erase(i);
+    return true;
+}
+
+void VSNode::VSCache::scanTrim(int max, int maxHistory) {
+    max = std::max(max, 0);
+    // at least a quarter of the frames are left for probation so new frames get the chance to be requested again
+    int maxProtected = max - std::max(max / 4, std::min(max, 1));
+    while (static_cast<int>(scanLists[slProtected].size()) > maxProtected) {
+        int key = scanLists[slProtected].back();
+        scanMove(scanEntries[key], key, slProbation);
+    }
+
+    while (currentSize > max) {
+        int key = scanLists[slProbation].back();
+        ScanEntry &e = scanEntries[key];
+        evict(key, e.frame);
+        scanMove(e, key, slHistory);
+        currentSize--;
+        historySize++;
+    }
+
+    while (historySize > std::max(maxHistory, 0)) {
+        int key = scanLists[slHistory].back();
+        scanLists[slHistory].pop_back();
+        scanEntries.erase(key);
+        historySize--;
+    }
+}
+
+void VSNode::VSCache::adjustSize(bool needMemory, bool allowGrow, int minFrames, int cost) {
     if (!fixedSize) {
         if (!needMemory) {
             switch (recommendSize()) {
@@ -2667,7 +5270,8 @@ void VSNode::VSCache::adjustSize(bool needMemory) {
                 setMaxFrames(std::max(getMaxFrames() - 2, 0));
                 break;
             case VSCache::CacheAction::Grow:
-                setMaxFrames(getMaxFrames() + 2);
+                if (allowGrow)
+                    setMaxFrames(getMaxFrames() + 2);
                 break;
             case VSCache::CacheAction::Shrink:
                 setMaxFrames(std::max(getMaxFrames() - 1, 0));
@@ -2684,13 +5288,19 @@ void VSNode::VSCache::adjustSize(bool needMemory) {
                 setMaxFrames(std::max(getMaxFrames() - 2, 0));
                 break;
             case VSCache::CacheAction::NoChange:
+                // expensive frames are the last to give up space, cheap ones the first
+                if (cost == fcExpensive)
+                    break;
                 if (getMaxFrames() <= 1)
                     clear();
-                setMaxFrames(std::max(getMaxFrames() - 1, 1));
+                setMaxFrames(std::max(getMaxFrames() - (cost == fcCheap ? 2 : 1), 1));
                 break;
             default:;
             }
         }
+
+        if (getMaxFrames() < minFrames)
+            setMaxFrames(minFrames);
     }
 }
 
@@ -25,6 +25,9 @@
 #include "VapourSynth3.h"
 #include "vslog.h"
 #include "intrusive_ptr.h"
+#include "vstrace.h"
+#include "perfcounters.h"
+#include "kernel/cpulevel.h"
 #include <cstdlib>
 #include <stdexcept>
 #include <string>
@@ -54,9 +57,7 @@
 #    include <dlfcn.h>
 #endif
 
-#ifdef VS_FRAME_GUARD
 static const uint32_t VS_FRAME_GUARD_PATTERN = 0xDEADBEEF;
-#endif
 
 #define VS_FATAL_ERROR(msg) do { fprintf(stderr, "%s\n", (msg)); std::terminate(); } while (false);
 
@@ -89,8 +90,11 @@ typedef std::pair<VSNode *, int> NodeOutputKey;
 
 template<>
 struct std::hash<NodeOutputKey> {
-    inline size_t operator()(const NodeOutputKey &val) const {  
-        return reinterpret_cast<size_t>(std::get<0>(val)) + (static_cast<size_t>(std::get<1>(val)) << 16);
+    // the pointers of nodes created after each other are close so both parts have to be mixed
+    inline size_t operator()(const NodeOutputKey &val) const {
+        size_t h = reinterpret_cast<size_t>(std::get<0>(val));
+        h ^= static_cast<size_t>(std::get<1>(val)) * static_cast<size_t>(0x9E3779B97F4A7C15ULL) + (h << 6) + (h >> 2);
+        return h;
     }
 };
 
@@ -98,6 +102,7 @@ struct VSFunction {
 private:
     std::atomic<long> refcount;
     VSPublicFunction func;
+    VSFrameCallFunction frameFunc = nullptr; // set instead of func, maps are converted when it's called with them
     void *userData;
     VSFreeFunctionData freeFunction;
     VSCore *core;
@@ -115,7 +120,9 @@ public:
     }
 
     VSFunction(VSPublicFunction func, void *userData, VSFreeFunctionData free, VSCore *core, int apiMajor);
+    VSFunction(VSFrameCallFunction func, void *userData, VSFreeFunctionData free, VSCore *core);
     void call(const VSMap *in, VSMap *out);
+    bool callFrame(int n, const VSFrame * const *frames, int numFrames, VSFrameCallResult *result);
 };
 
 class VSArrayBase {
@@ -214,10 +221,62 @@ public:
     }
 };
 
+// The contents of a data property, immutable once created so every copy of the property and of the
+// maps holding it shares it. Data props can be large and get passed on through every filter.
+class VSDataBlob : public vs_pooled<VSDataBlob> {
+private:
+    std::atomic<long> refcount;
+    std::string storage;
+    const char *data;
+    size_t size;
+    VSFreeFunctionData freeFunc = nullptr;
+    void *userData = nullptr;
+    ~VSDataBlob() {
+        if (freeFunc)
+            freeFunc(userData);
+    }
+public:
+    explicit VSDataBlob(std::string &&value) noexcept : refcount(1), storage(std::move(value)), data(storage.c_str()), size(storage.size()) {}
+    // takes over memory owned by the caller, free is called with userData once nothing references it
+    VSDataBlob(const char *data, size_t size, VSFreeFunctionData free, void *userData) noexcept : refcount(1), data(data), size(size), freeFunc(free), userData(userData) {}
+
+    const char *getData() const noexcept {
+        return data;
+    }
+
+    size_t getSize() const noexcept {
+        return size;
+    }
+
+    void add_ref() noexcept {
+        ++refcount;
+    }
+
+    void release() noexcept {
+        assert(refcount > 0);
+        if (--refcount == 0)
+            delete this;
+    }
+};
+
+typedef vs_intrusive_ptr<VSDataBlob> PVSDataBlob;
+
 class VSMapData {
 public:
-    VSDataTypeHint typeHint;
-    std::string data;
+    VSDataTypeHint typeHint = dtUnknown;
+    PVSDataBlob blob;
+
+    VSMapData() = default;
+    VSMapData(VSDataTypeHint typeHint, std::string value) : typeHint(typeHint), blob(new VSDataBlob(std::move(value))) {}
+    VSMapData(VSDataTypeHint typeHint, const PVSDataBlob &blob) : typeHint(typeHint), blob(blob) {}
+
+    const char *getData() const noexcept {
+        return blob ? blob->getData() : "";
+    }
+
+    size_t getSize() const noexcept {
+        return blob ? blob->getSize() : 0;
+    }
 };
 
 
@@ -230,16 +289,116 @@ typedef VSArray<PVSFrame, ptVideoFrame> VSVideoFrameArray;
 typedef VSArray<PVSFrame, ptAudioFrame> VSAudioFrameArray;
 typedef VSArray<PVSFunction, ptFunction> VSFunctionArray;
 
-class VSMapStorage {
+// Map keys are interned for the lifetime of the process so maps can compare them by address, the
+// interned key is also the VSMapKey handle of the public API
+struct VSMapKey {
+    std::string name;
+    uint64_t hash;
+    VSMapKey *next; // in the same intern table bucket
+
+    static const VSMapKey *intern(const char *key, size_t length);
+    static const VSMapKey *intern(const std::string &key) {
+        return intern(key.c_str(), key.size());
+    }
+};
+
+class VSMapStorage;
+typedef vs_intrusive_ptr<VSMapStorage> PVSMapStorage;
+
+// A storage is either flat or a layer of changes over a shared parent storage, detaching a shared map creates a
+// new empty layer instead of copying every entry. Parents are never modified since all their owners detach before
+// writing, the chain is flattened once it gets too deep to keep lookups cheap.
+class VSMapStorage : public vs_pooled<VSMapStorage> {
+public:
+    struct Entry {
+        const VSMapKey *key;
+        PVSArrayBase value; // only null in layers where it hides the parent's entry
+    };
 private:
+    static constexpr unsigned maxDepth = 8;
+
     std::atomic<long> refcount;
+    // sorted by key name, frame property maps rarely have more than a dozen entries so a flat array beats a tree
+    std::vector<Entry> data;
+    PVSMapStorage parent;
+    unsigned depth;
+    // the merged view of all layers, built on demand and shared by concurrent readers
+    mutable std::atomic<std::vector<Entry> *> merged;
+    // whether all values can be passed to an API3 plugin, kept up to date on every change when it's cheap
+    // to do so and otherwise left as v3Unknown until the next check scans the entries
+    enum : int8_t { v3Incompatible = 0, v3Compatible = 1, v3Unknown = -1 };
+    mutable std::atomic<int8_t> v3;
+
+    static bool isV3Type(VSPropertyType type) noexcept {
+        return type != ptAudioNode && type != ptAudioFrame && type != ptUnset;
+    }
+
+    void updateV3(const PVSArrayBase &val) noexcept {
+        int8_t state = v3.load(std::memory_order_relaxed);
+        if (val && !isV3Type(val->type()))
+            state = v3Incompatible;
+        else if (state != v3Compatible)
+            state = v3Unknown; // the removed or replaced value may have been the only incompatible one
+        v3.store(state, std::memory_order_relaxed);
+    }
+
+    void invalidate() noexcept {
+        delete merged.exchange(nullptr);
+    }
+
+    static Entry *findIn(std::vector<Entry> &entries, const char *key) noexcept {
+        // the lower bound of a binary search by name
+        size_t lo = 0;
+        size_t hi = entries.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (strcmp(entries[mid].key->name.c_str(), key) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return (lo < entries.size() && entries[lo].key->name == key) ? &entries[lo] : nullptr;
+    }
+
+    static Entry *findIn(std::vector<Entry> &entries, const VSMapKey *key) noexcept {
+        for (Entry &iter : entries)
+            if (iter.key == key)
+                return &iter;
+        return nullptr;
+    }
+
+    std::vector<Entry> merge() const {
+        const std::vector<Entry> &base = parent->entries();
+        std::vector<Entry> result;
+        result.reserve(base.size() + data.size());
+        auto b = base.begin();
+        for (const Entry &iter : data) {
+            while (b != base.end() && b->key->name < iter.key->name)
+                result.push_back(*b++);
+            if (b != base.end() && b->key == iter.key)
+                ++b;
+            if (iter.value)
+                result.push_back(iter);
+        }
+        result.insert(result.end(), b, base.end());
+        return result;
+    }
 public:
-    std::map<std::string, PVSArrayBase> data;
     bool error;
 
-    explicit VSMapStorage() : refcount(1), error(false) {}
+    explicit VSMapStorage() : refcount(1), depth(0), merged(nullptr), v3(v3Compatible), error(false) {}
 
-    explicit VSMapStorage(const VSMapStorage &s) : refcount(1), data(s.data), error(s.error) {
+    explicit VSMapStorage(const PVSMapStorage &s) : refcount(1), depth(0), merged(nullptr), v3(s->v3.load(std::memory_order_relaxed)), error(s->error) {
+        if (s->depth < maxDepth) {
+            parent = s;
+            depth = s->depth + 1;
+        } else {
+            data = s->entries();
+        }
+    }
+
+    ~VSMapStorage() {
+        invalidate();
     }
 
     bool unique() noexcept {
@@ -255,13 +414,128 @@ public:
         if (--refcount == 0)
             delete this;
     }
-};
 
-typedef vs_intrusive_ptr<VSMapStorage> PVSMapStorage;
+    // all entries of all layers sorted by name
+    const std::vector<Entry> &entries() const {
+        if (!parent)
+            return data;
+        std::vector<Entry> *m = merged.load(std::memory_order_acquire);
+        if (!m) {
+            std::vector<Entry> *n = new std::vector<Entry>(merge());
+            if (merged.compare_exchange_strong(m, n, std::memory_order_acq_rel))
+                m = n;
+            else
+                delete n;
+        }
+        return *m;
+    }
+
+    template<typename K>
+    const Entry *find(const K &key) const noexcept {
+        for (const VSMapStorage *s = this; s; s = s->parent.get()) {
+            const Entry *e = findIn(const_cast<std::vector<Entry> &>(s->data), key);
+            if (e)
+                return e->value ? e : nullptr;
+        }
+        return nullptr;
+    }
+
+    // an entry of this layer that can be modified, values found in a parent are copied up first
+    template<typename K>
+    Entry *findWritable(const K &key) {
+        Entry *e = findIn(data, key);
+        if (e)
+            return e->value ? e : nullptr;
+        const Entry *p = parent ? parent->find(key) : nullptr;
+        if (!p)
+            return nullptr;
+        insert(p->key, PVSArrayBase(p->value->copy()));
+        return findIn(data, p->key);
+    }
+
+    void insert(const VSMapKey *key, PVSArrayBase val) {
+        invalidate();
+        updateV3(val);
+        auto it = std::lower_bound(data.begin(), data.end(), key, [](const Entry &e, const VSMapKey *k) { return e.key->name < k->name; });
+        if (it != data.end() && it->key == key) {
+            it->value = std::move(val);
+        } else if (data.empty()) {
+            data.reserve(8);
+            data.push_back({ key, std::move(val) });
+        } else {
+            data.insert(it, { key, std::move(val) });
+        }
+    }
+
+    template<typename K>
+    void erase(const K &key) {
+        const Entry *e = find(key);
+        if (!e)
+            return;
+        const VSMapKey *k = e->key;
+        if (parent) {
+            insert(k, PVSArrayBase());
+        } else {
+            invalidate();
+            updateV3(PVSArrayBase());
+            data.erase(data.begin() + (findIn(data, k) - data.data()));
+        }
+    }
+
+    void clear() noexcept {
+        invalidate();
+        data.clear();
+        parent = nullptr;
+        depth = 0;
+        v3.store(v3Compatible, std::memory_order_relaxed);
+    }
+
+    bool isV3Compatible() const noexcept {
+        int8_t state = v3.load(std::memory_order_relaxed);
+        if (state == v3Unknown) {
+            state = v3Compatible;
+            for (const Entry &iter : entries()) {
+                if (!isV3Type(iter.value->type())) {
+                    state = v3Incompatible;
+                    break;
+                }
+            }
+            v3.store(state, std::memory_order_relaxed);
+        }
+        return state == v3Compatible;
+    }
+};
 
 struct VSMap {
 private:
     PVSMapStorage data;
+
+    template<typename K>
+    VSArrayBase *findImpl(const K &key) const {
+        const VSMapStorage::Entry *e = data->find(key);
+        return e ? e->value.get() : nullptr;
+    }
+
+    template<typename K>
+    VSArrayBase *detachImpl(const K &key) {
+        detach();
+        VSMapStorage::Entry *e = data->findWritable(key);
+        if (e) {
+            if (!e->value->unique())
+                e->value = e->value->copy();
+            return e->value.get();
+        }
+        return nullptr;
+    }
+
+    template<typename K>
+    bool eraseImpl(const K &key) {
+        if (!data->find(key))
+            return false;
+        detach();
+        data->erase(key);
+        return true;
+    }
 public:
     VSMap(const VSMap *map = nullptr) : data(map ? map->data : new VSMapStorage()) {
     }
@@ -273,47 +547,43 @@ public:
 
     bool detach() {
         if (!data->unique()) {
-            data = new VSMapStorage(*data);
+            data = new VSMapStorage(data);
             return true;
         }
         return false;
     }
 
     VSArrayBase *find(const std::string &key) const {
-        auto it = data->data.find(key);
-        return (it == data->data.end()) ? nullptr : it->second.get();
+        return findImpl(key.c_str());
+    }
+
+    VSArrayBase *find(const VSMapKey *key) const {
+        return findImpl(key);
     }
 
     VSArrayBase *detach(const std::string &key) {
-        detach();
-        auto it = data->data.find(key);
-        if (it != data->data.end()) {
-            if (!it->second->unique())
-                it->second = it->second->copy();
-            return it->second.get();
-        }
-        return nullptr;
+        return detachImpl(key.c_str());
+    }
+
+    VSArrayBase *detach(const VSMapKey *key) {
+        return detachImpl(key);
     }
 
     bool erase(const std::string &key) {
-        auto it = data->data.find(key);
-        if (it != data->data.end()) {
-            if (detach())
-                it = data->data.find(key);
-            data->data.erase(it);
-            return true;
-        }
-        return false;
+        return eraseImpl(key.c_str());
     }
 
-    void insert(const std::string &key, VSArrayBase *val) {
+    bool erase(const VSMapKey *key) {
+        return eraseImpl(key);
+    }
+
+    void insert(const VSMapKey *key, VSArrayBase *val) {
         detach();
-        auto it = data->data.find(key);
-        if (it != data->data.end()) {
-            it->second = val;
-        } else {
-            data->data.insert(std::make_pair(key, val));
-        }
+        data->insert(key, PVSArrayBase(val));
+    }
+
+    void insert(const std::string &key, VSArrayBase *val) {
+        insert(VSMapKey::intern(key), val);
     }
 
     void copy(const VSMap *src) {
@@ -321,17 +591,18 @@ public:
             return;
         
         detach();
-        for (auto &iter : src->data->data)
-            data->data[iter.first] = iter.second;
+        PVSMapStorage srcData = src->data;
+        for (auto &iter : srcData->entries())
+            data->insert(iter.key, iter.value);
     }
 
     size_t size() const {
-        return data->data.size();
+        return data->entries().size();
     }
 
     void clear() {
         if (data->unique())
-            data->data.clear();
+            data->clear();
         else
             data = new VSMapStorage();
     }
@@ -339,16 +610,14 @@ public:
     const char *key(size_t n) const {
         if (n >= size())
             return nullptr;
-        auto iter = data->data.cbegin();
-        std::advance(iter, n);
-        return iter->first.c_str();
+        return data->entries()[n].key->name.c_str();
     }
 
     void setError(const std::string &errMsg) {
         clear();
         VSDataArray *arr = new VSDataArray();
         arr->push_back({ dtUtf8, errMsg });
-        data->data.insert(std::make_pair("_Error", arr));
+        data->insert(VSMapKey::intern("_Error"), PVSArrayBase(arr));
         data->error = true;
     }
 
@@ -358,25 +627,130 @@ public:
 
     const char *getErrorMessage() const {
         if (data->error) {
-            return reinterpret_cast<VSDataArray *>(data->data.at("_Error").get())->at(0).data.c_str();
+            return reinterpret_cast<VSDataArray *>(find("_Error"))->at(0).getData();
         } else {
             return nullptr;
         }
     }
 
-    bool isV3Compatible() const noexcept;
+    const std::vector<VSMapStorage::Entry> &entries() const {
+        return data->entries();
+    }
+
+    bool isV3Compatible() const noexcept {
+        return data->isV3Compatible();
+    }
 };
 
 class FilterArgument {
 public:
     std::string name;
+    const VSMapKey *key; // the interned name, compared by pointer when arguments are checked
     VSPropertyType type;
     
     bool arr;
     bool empty;
     bool opt;
     FilterArgument(const std::string &name, VSPropertyType type, bool arr, bool empty, bool opt)
-        : name(name), type(type), arr(arr), empty(empty), opt(opt) {}
+        : name(name), key(VSMapKey::intern(name)), type(type), arr(arr), empty(empty), opt(opt) {}
+};
+
+// Process-wide limits for the cores created with ccfSharedResources. The threads are split evenly
+// between the cores that currently have work, a core without work only gets its share once it has
+// some. Frame memory of all the cores together is kept below the memory limit the same way a
+// single core's is.
+class VSSharedBudget {
+private:
+    std::mutex lock;
+    std::vector<VSThreadPool *> pools; // protected by lock
+    std::atomic<size_t> threads{0};
+    std::atomic<size_t> memoryLimit{std::numeric_limits<size_t>::max()};
+    std::atomic<size_t> memoryUsed{0};
+    std::atomic<size_t> memoryPooled{0}; // unused buffers kept for reuse
+public:
+    static VSSharedBudget &instance();
+    void attach(VSThreadPool *pool);
+    void detach(VSThreadPool *pool);
+    void updateShares();
+    void setLimits(int threads, int64_t memoryBytes);
+
+    void addMemory(size_t bytes) noexcept {
+        memoryUsed += bytes;
+    }
+
+    void subtractMemory(size_t bytes) noexcept {
+        memoryUsed -= bytes;
+    }
+
+    void addPooled(size_t bytes) noexcept {
+        memoryPooled += bytes;
+    }
+
+    void subtractPooled(size_t bytes) noexcept {
+        memoryPooled -= bytes;
+    }
+
+    bool isOverMemoryLimit() const noexcept {
+        return memoryUsed > memoryLimit;
+    }
+
+    bool isOverPoolLimit() const noexcept {
+        return memoryUsed + memoryPooled > memoryLimit;
+    }
+
+    bool isOverSoftMemoryLimit() const noexcept {
+        size_t limit = memoryLimit;
+        return memoryUsed > limit - limit / 8;
+    }
+};
+
+// Device memory set by a GPU plugin, planes only get a device copy through it on demand
+class DeviceMemory {
+private:
+    VSDeviceMemoryFunctions funcs = {};
+    VSDeviceComputeFunctions compute = {};
+    std::atomic<bool> available{false};
+    std::atomic<bool> computeAvailable{false};
+    std::mutex lock;
+    std::atomic<size_t> used{0};
+    std::atomic<size_t> limit{SIZE_MAX};
+public:
+    bool setFunctions(const VSDeviceMemoryFunctions *f);
+    bool isAvailable() const { return available; }
+    int getDeviceType() const { return available ? funcs.deviceType : dtNone; }
+    int64_t setLimit(int64_t bytes);
+    void *alloc(size_t size); // nullptr when over the limit
+    void free(void *ptr, size_t size);
+    bool download(uint8_t *dst, const void *src, size_t size) { return !!funcs.download(dst, src, size, funcs.userData); }
+    bool upload(void *dst, const uint8_t *src, size_t size) { return !!funcs.upload(dst, src, size, funcs.userData); }
+    bool copy(void *dst, const void *src, size_t size) { return funcs.copy && funcs.copy(dst, src, size, funcs.userData); }
+
+    bool setComputeFunctions(const VSDeviceComputeFunctions *f);
+    bool hasCompute() const { return computeAvailable; }
+    void *compileKernel(const char *source, const char *entryPoint) { return computeAvailable ? compute.compileKernel(source, entryPoint, compute.userData) : nullptr; }
+    bool launchKernel(void *kernel, int width, int height, void **params) { return !!compute.launchKernel(kernel, width, height, params, compute.userData); }
+    void freeKernel(void *kernel) { compute.freeKernel(kernel, compute.userData); }
+};
+
+// Plane memory allocated while a node's getframe function ran, the planes hold a reference so
+// it can outlive the node when frames it created are still around
+struct VSMemoryAccount {
+    std::atomic<long> refcount{1};
+    std::atomic<int64_t> bytes{0};
+    std::atomic<int64_t> peakBytes{0};
+
+    void add(size_t size) noexcept;
+    void subtract(size_t size) noexcept;
+
+    void add_ref() noexcept {
+        ++refcount;
+    }
+
+    void release() noexcept {
+        assert(refcount > 0);
+        if (--refcount == 0)
+            delete this;
+    }
 };
 
 class MemoryUse {
@@ -384,58 +758,135 @@ private:
     struct BlockHeader {
         size_t size; // Size of memory allocation, minus header and padding.
         bool large : 1; // Memory is allocated with large pages.
+        unsigned node : 15; // NUMA node of the thread that allocated the memory.
     };
     static_assert(sizeof(BlockHeader) <= 16, "block header too large");
 
+    // Unused buffers are binned in size classes with 8 steps per power of two so a lookup is
+    // a single index calculation, every bin has its own lock so threads allocating different
+    // sizes never contend.
+    static constexpr size_t sizeClassSteps = 8;
+    static constexpr size_t numSizeClasses = sizeof(size_t) * 8 * sizeClassSteps;
+
+    struct BufferBin {
+        std::mutex lock;
+        std::vector<uint8_t *> buffers;
+        std::atomic<size_t> numBuffers{0};
+    };
+
     std::atomic<size_t> used;
-    size_t maxMemoryUse;
+    std::atomic<size_t> maxMemoryUse;
+    std::atomic<size_t> softMemoryUse; // caches with little reuse start shrinking once this is exceeded
     bool freeOnZero;
     bool largePageEnabled;
-    bool memoryWarningIssued;
-    std::multimap<size_t, uint8_t *> buffers;
-    size_t unusedBufferSize;
-    std::minstd_rand generator;
+    bool poolEnabled;
+    bool prefault;
+    bool shared = false; // also counted in the process-wide VSSharedBudget
+    std::atomic<bool> memoryWarningIssued;
+    std::atomic<size_t> largePageUsed;
+    std::atomic<size_t> largePagePeak;
+    std::vector<std::unique_ptr<BufferBin[]>> bins; // one set of bins per NUMA node
+    std::atomic<size_t> unusedBufferSize;
+    std::atomic<size_t> evictionCounter;
     std::mutex mutex;
 
+    // every guardInterval-th plane gets guard bytes on both sides, 0 disables them
+    unsigned guardInterval;
+    std::atomic<unsigned> guardCounter{0};
+
+    static size_t sizeClassCeil(size_t bytes);
+    static size_t sizeClassFloor(size_t bytes);
+    static size_t sizeClassBytes(size_t sizeClass);
+    void evictBuffers(size_t node);
+
     static bool largePageSupported();
     static size_t largePageSize();
 
-    // May allocate more than the requested amount.
-    void *allocateLargePage(size_t bytes) const;
-    void freeLargePage(void *ptr) const;
-    void *allocateMemory(size_t bytes) const;
-    void freeMemory(void *ptr) const;
-    bool isGoodFit(size_t requested, size_t actual) const;
+    // Maps whole pages for buffers of at least one page, the rest of the last page is unused.
+    void *allocateLargePage(size_t bytes);
+    void freeLargePage(void *ptr);
+    void *allocateMemory(size_t bytes);
+    void freeMemory(void *ptr);
 public:
+    static thread_local unsigned currentNode;
+    static thread_local VSMemoryAccount *currentAccount; // planes allocated by this thread are attributed to it, nullptr when not tracked
+    DeviceMemory device;
     void add(size_t bytes);
     void subtract(size_t bytes);
     uint8_t *allocBuffer(size_t bytes);
     void freeBuffer(uint8_t *buf);
+    size_t prewarm(size_t bytes, size_t count, size_t budget);
     size_t memoryUse();
     size_t getLimit();
     int64_t setMaxMemoryUse(int64_t bytes);
     bool isOverLimit();
+    bool isOverSoftLimit();
     void signalFree();
+    void setNumaNodes(size_t nodes);
+    void enableLargePages(bool prefault);
+    void enableSharedBudget();
+    bool isPoolEnabled() const { return poolEnabled; }
+    void setGuardInterval(unsigned interval) { guardInterval = interval; }
+    bool guardsEnabled() const { return guardInterval != 0; }
+    bool nextGuarded() noexcept { return guardInterval && (guardInterval == 1 || ++guardCounter % guardInterval == 0); }
+    size_t largePageUse() const { return largePageUsed; }
+    size_t largePagePeakUse() const { return largePagePeak; }
     MemoryUse();
     ~MemoryUse();
 };
 
-class VSPlaneData {
+// The device copy of a plane, the host and device copies are brought up to date when the other side was written
+struct VSDevicePlane {
+    void *ptr;
+    std::mutex lock;
+    bool hostValid;
+    bool deviceValid;
+};
+
+// Memory of the creator of a frame that its planes point into, handed back once no plane uses it anymore
+struct VSExternalMemory {
+    std::atomic<long> refcount;
+    VSFreeExternalMemory free;
+    void *userData;
+
+    void release() noexcept;
+};
+
+class VSPlaneData : public vs_pooled<VSPlaneData> {
 private:
     std::atomic<long> refcount;
     MemoryUse &mem;
+    std::atomic<VSDevicePlane *> device{nullptr}; // only set once a device copy exists
+    VSExternalMemory *external = nullptr; // data isn't ours and must not be written
+    VSMemoryAccount *account = nullptr; // the node the host memory was allocated for
+    uint8_t *syncHost(VSDevicePlane *dev) const;
+    void allocHost();
 public:
-    uint8_t *data;
+    uint8_t *data; // nullptr for planes created in device memory until the host copy is needed, use host()
+    const size_t guard; // bytes of guard pattern before and after the plane, included in size
     const size_t size;
     VSPlaneData(size_t dataSize, MemoryUse &mem) noexcept;
+    VSPlaneData(size_t dataSize, MemoryUse &mem, void *devicePtr) noexcept; // only in device memory
+    VSPlaneData(size_t dataSize, MemoryUse &mem, const uint8_t *externalData, VSExternalMemory *external) noexcept; // takes a reference to external
     VSPlaneData(const VSPlaneData &d) noexcept;
     ~VSPlaneData();
+
+    // the up to date host copy, downloaded first if only the device copy is
+    uint8_t *host() const noexcept {
+        VSDevicePlane *dev = device.load(std::memory_order_acquire);
+        return dev ? syncHost(dev) : data;
+    }
+    uint8_t *hostForWrite() noexcept;
+    void *deviceForRead() noexcept;
+    void *deviceForWrite() noexcept;
+    static VSPlaneData *copyOnDevice(const VSPlaneData &d) noexcept; // nullptr unless d only has to be copied on the device
+    int residency() const noexcept;
     bool unique() noexcept;
     void add_ref() noexcept;
     void release() noexcept;
 };
 
-struct VSFrame {
+struct VSFrame : public vs_pooled<VSFrame> {
 private:
     std::atomic<long> refcount;
     VSMediaType contentType;
@@ -448,25 +899,29 @@ private:
     int width; /* stores number of samples for audio */
     int height;
     ptrdiff_t stride[3] = {}; /* stride[0] stores internal offset between audio channels */
+    ptrdiff_t offset[3] = {}; /* start of a video plane or the audio channels in their data, only views of another frame have one */
     int numPlanes;
+    bool renderTarget = false; /* shared planes are written in place until the frame is returned by a filter */
     VSMap properties;
     VSCore *core;
 public:
     static int alignment;
 
-#ifdef VS_FRAME_GUARD
-    static const int guardSpace = 64;
-#else
-    static const int guardSpace = 0;
-#endif
+    static const int guardSpace = 64; // for the planes that have guards
 
-    VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *propSrc, VSCore *core) noexcept;
+    VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame *propSrc, VSCore *core, bool onDevice = false) noexcept;
     VSFrame(const VSVideoFormat &f, int width, int height, const VSFrame * const *planeSrc, const int *plane, const VSFrame *propSrc, VSCore *core) noexcept;
+    VSFrame(const VSVideoFormat &f, int width, int height, const uint8_t * const *planes, const ptrdiff_t *strides, VSFreeExternalMemory free, void *userData, const VSFrame *propSrc, VSCore *core) noexcept;
     VSFrame(const VSAudioFormat &f, int numSamples, const VSFrame *propSrc, VSCore *core) noexcept;
     VSFrame(const VSAudioFormat &f, int numSamples, const VSFrame * const *channelSrc, const int *channel, const VSFrame *propSrc, VSCore *core) noexcept;
     VSFrame(const VSFrame &f) noexcept;
+    VSFrame(const VSFrame &f, int left, int top, int width, int height) noexcept;
+    VSFrame(const VSFrame &f, int firstSample, int numSamples) noexcept; // audio samples firstSample to firstSample + numSamples - 1
     ~VSFrame();
 
+    // true when every plane has the stride a newly allocated frame of the given width would get
+    bool hasAllocatedStrides(int width) const noexcept;
+
     void add_ref() noexcept {
         ++refcount;
     }
@@ -519,14 +974,23 @@ public:
     ptrdiff_t getStride(int plane) const;
     const uint8_t *getReadPtr(int plane) const;
     uint8_t *getWritePtr(int plane);
+    const void *getReadDevicePtr(int plane) const;
+    void *getWriteDevicePtr(int plane);
+    int getPlaneResidency(int plane) const;
+
+    void setRenderTarget(bool enable) noexcept {
+        renderTarget = enable;
+    }
 
-#ifdef VS_FRAME_GUARD
     bool verifyGuardPattern() const;
-#endif
+    size_t memorySize() const; // bytes of all planes including the parts other frames share
 };
 
 #define NUM_FRAMECONTEXT_FAST_REQS 10
 
+// The first staticSize elements are stored inline, the rest go in a spill vector. Spill vectors are
+// recycled through a small per thread list when the owner goes away so contexts of temporal filters,
+// which reserve room for their whole window up front, don't allocate for every frame.
 template<typename T, size_t staticSize>
 class SemiStaticVector {
 private:
@@ -537,32 +1001,69 @@ private:
         for (size_t pos = 0; pos < std::min(numElems, staticSize); ++pos)
             reinterpret_cast<T *>(&staticData[pos])->~T();
     }
+
+    struct SpareList {
+        std::vector<std::vector<T>> spares;
+        bool closed = false;
+        ~SpareList() {
+            // vectors released by later thread exit handlers are simply freed
+            closed = true;
+        }
+    };
+
+    static SpareList &spareList() noexcept {
+        static thread_local SpareList list;
+        return list;
+    }
+
+    void takeSpare() noexcept {
+        SpareList &list = spareList();
+        if (!list.spares.empty()) {
+            dynamicData.swap(list.spares.back());
+            list.spares.pop_back();
+        }
+    }
+
+    void releaseSpare() noexcept {
+        if (!dynamicData.capacity())
+            return;
+        SpareList &list = spareList();
+        if (!list.closed && list.spares.size() < 64) {
+            dynamicData.clear();
+            list.spares.emplace_back(std::move(dynamicData));
+        }
+    }
 public:
+    SemiStaticVector() = default;
+    SemiStaticVector(const SemiStaticVector &) = delete;
+    SemiStaticVector &operator=(const SemiStaticVector &) = delete;
+
+    // makes room for n elements in total without further allocations
+    void reserve(size_t n) noexcept {
+        if (n <= staticSize)
+            return;
+        if (!dynamicData.capacity())
+            takeSpare();
+        dynamicData.reserve(n - staticSize);
+    }
+
     template<typename ...Args> void emplace_back(Args &&... args) noexcept {
         if (numElems < staticSize) {
             new(&staticData[numElems]) T(std::forward<Args>(args)...);
         } else {
+            if (!dynamicData.capacity())
+                takeSpare();
             dynamicData.emplace_back(std::forward<Args>(args)...);
         }
         numElems++;
     }
 
     void push_back(const T &val) noexcept {
-        if (numElems < staticSize) {
-            new(&staticData[numElems]) T(val);
-        } else {
-            dynamicData.push_back(val);
-        }
-        numElems++;
+        emplace_back(val);
     }
 
     void push_back(T &&val) noexcept {
-        if (numElems < staticSize) {
-            new(&staticData[numElems]) T(val);
-        } else {
-            dynamicData.push_back(val);
-        }
-        numElems++;
+        emplace_back(std::move(val));
     }
 
     const T &operator[](size_t pos) const noexcept {
@@ -593,20 +1094,29 @@ public:
 
     ~SemiStaticVector() {
         freeStatic();
+        releaseSpare();
     }
 };
 
-struct VSFrameContext {
+struct VSFrameContext : public vs_pooled<VSFrameContext> {
     friend class VSThreadPool;
 private:
     std::atomic<long> refcount;
-    size_t reqOrder;
+    uint64_t reqOrder;
     size_t numFrameRequests = 0;
 
     bool error = false;
     bool first = true;
     bool external;
     bool lockOnOutput;
+    bool speculative = false;
+    std::atomic<bool> cancelled{false}; // external only, set without holding the context
+    size_t waitId = 0; // the synchronous request this was started for, its waiting thread may run it
+
+    /// external real-time requests only
+    int64_t deadline = 0; // in steady clock nanoseconds, 0 when there's none
+    bool deadlineMissed = false; // the callback was already invoked when the deadline passed
+    PVSFrame fallback;
 
     /// internal return only
     SemiStaticVector<PVSFrameContext, NUM_FRAMECONTEXT_FAST_REQS> notifyCtxList;
@@ -618,10 +1128,50 @@ private:
 public:
     SemiStaticVector<NodeOutputKey, NUM_FRAMECONTEXT_FAST_REQS> reqList;
     SemiStaticVector<std::pair<NodeOutputKey, PVSFrame>, NUM_FRAMECONTEXT_FAST_REQS> availableFrames;
+    bool windowFrames = false; // frames were put in availableFrames by a window at request time, so the filter waits even when reqList is empty
+
+    // a window of a frame owned by the requester that an output frame can be rendered into directly
+    struct Placement {
+        NodeOutputKey key;
+        PVSFrame target;
+        int left = 0;
+        int top = 0;
+        int width = 0;
+        int height = 0;
+    };
+
+    std::vector<Placement> placements; // for the frames in reqList
+    Placement placement; // for this context's output, the target is unset when there's none
+
+    // the part of the output the requester needs in luma coordinates, the rest of the frame may be
+    // left unprocessed so frames made for a region are never cached or handed to other requests
+    struct Region {
+        int left = 0;
+        int top = 0;
+        int width = 0; // 0 when the whole frame is needed
+        int height = 0;
+        bool propsOnly = false; // no pixels are needed at all, only the frame properties
+
+        bool isWholeFrame() const {
+            return !propsOnly && (width <= 0 || height <= 0);
+        }
+    };
+
+    std::vector<std::pair<NodeOutputKey, Region>> regions; // set with requestFrameRegionFilter() for the frames in reqList
+    Region region; // for this context's output
+    static Region makeRegion(int64_t left, int64_t top, int64_t right, int64_t bottom, const VSNode *node);
+
+    // the context whose filter is running on this thread if it has a placement
+    static thread_local VSFrameContext *currentPlacement;
+    static VSFrame *takePlacement(const VSVideoFormat &format, int width, int height, const VSFrame *propSrc);
 
     NodeOutputKey key;
     void *frameContext[4];
 
+    // only recorded with graph inspection enabled, 0 when not set
+    int64_t queuedTime = 0;
+    int64_t serialWaitStart = 0;
+
     void add_ref() noexcept {
         ++refcount;
     }
@@ -641,16 +1191,49 @@ public:
     }
 
     bool setError(const std::string &errorMsg);
+    void reserveRequests(); // sized from what the node is expected to request
     VSFrameContext(NodeOutputKey key, const PVSFrameContext &notify);
+    VSFrameContext(NodeOutputKey key, uint64_t reqOrder); // speculative, nothing waits for the result
     VSFrameContext(int n, VSNode *node, VSFrameDoneCallback frameDone, void *userData, bool lockOnOutput);
+    void setDeadline(int64_t latency, const VSFrame *fallback);
+};
+
+// The frames of a node that the temporal filters attached to it still need. Every filter keeps the
+// frames within its radius, plus one frame per worker thread for output frames processed out of order,
+// around the last output frame it got a window for.
+struct VSFrameWindowStore {
+    std::mutex lock;
+    std::map<int, PVSFrame> frames;
+    std::vector<VSFrameWindow *> windows;
+    void evict(); // called with lock held
+};
+
+struct VSFrameWindow {
+    std::shared_ptr<VSFrameWindowStore> store;
+    VSNode *node;
+    int radius;
+    int slack;
+    int center = -1; // protected by the store's lock, -1 until the first output frame
+
+    VSFrameWindow(VSNode *node, int radius);
+    ~VSFrameWindow();
+    void request(int first, int last, VSFrameContext *frameCtx);
+    void update(int n, const VSFrameContext *frameCtx);
 };
 
 struct VSFunctionFrame;
 typedef std::shared_ptr<VSFunctionFrame> PVSFunctionFrame;
 
+struct VSFunctionFrameOutput {
+    const VSNode *node;
+    const VSMapKey *key;
+    int index;
+};
+
 struct VSFunctionFrame {
     std::string name;
     const VSMap *args;
+    std::vector<VSFunctionFrameOutput> outputs; // the nodes the call returned, filled in once it completes
     VSFunctionFrame(const std::string &name, const VSMap *args, PVSFunctionFrame next) : name(name), args(args), next(next) {};
     ~VSFunctionFrame() { delete args; }
     PVSFunctionFrame next;
@@ -661,6 +1244,7 @@ struct VSFunctionFrame {
 struct VSNode {
     friend class VSThreadPool;
     friend struct VSCore;
+    friend struct VSFrameWindow;
 private:
     class VSCache {
     private:
@@ -679,6 +1263,58 @@ private:
 
         std::unordered_map<int, Node> hash;
 
+        // Ring storage, used instead of the hash and list above in ring mode. Frame n always
+        // lives in slot n & ringMask so sliding window access never allocates or chases pointers,
+        // slots that have a key but no frame are the history entries.
+        struct RingSlot {
+            int key = -1;
+            PVSFrame frame;
+            uint64_t lastUse = 0;
+        };
+
+        bool ringMode = false;
+        std::vector<RingSlot> ring;
+        size_t ringMask = 0;
+        uint64_t ringClock = 0;
+
+        // Scan resistant storage, used instead of the hash and list above in scan resistant mode. New frames
+        // start out on probation and only move to the protected list once they're requested again so a linear
+        // scan can only push out other frames on probation. Keys of frames evicted from probation are kept as
+        // history and a frame inserted again while its key is still there goes straight to the protected list.
+        enum ScanList : uint8_t {
+            slProbation,
+            slProtected,
+            slHistory
+        };
+
+        struct ScanEntry {
+            PVSFrame frame;
+            ScanList list;
+            std::list<int>::iterator pos;
+        };
+
+        bool scanMode = false;
+        std::unordered_map<int, ScanEntry> scanEntries;
+        std::list<int> scanLists[3]; // most recently used first
+
+        inline void scanMove(ScanEntry &e, int key, ScanList list) {
+            scanLists[e.list].erase(e.pos);
+            e.list = list;
+            scanLists[list].push_front(key);
+            e.pos = scanLists[list].begin();
+        }
+
+        // frames pushed out of the cache end up here when the node has a compressed cache tier,
+        // they're compressed by the node after the cache lock has been released
+        bool keepEvicted = false;
+        std::vector<std::pair<int, PVSFrame>> evicted;
+
+        inline void evict(int key, PVSFrame &frame) {
+            if (keepEvicted && frame && frame->getFrameType() == mtVideo)
+                evicted.emplace_back(key, frame);
+            frame.reset();
+        }
+
         int maxSize;
         int currentSize;
         int maxHistorySize;
@@ -754,11 +1390,11 @@ private:
             if (!weakpoint) {
                 if (currentSize > maxSize) {
                     weakpoint = last;
-                    weakpoint->frame.reset();
+                    evict(weakpoint->key, weakpoint->frame);
                 }
             } else if (&n == origWeakPoint || historySize > maxHistorySize) {
                 weakpoint = weakpoint->prevNode;
-                weakpoint->frame.reset();
+                evict(weakpoint->key, weakpoint->frame);
             }
 
             assert(historySize <= maxHistorySize);
@@ -767,6 +1403,17 @@ private:
         }
 
         void trim(int max, int maxHistory);
+
+        void ringResize();
+        PVSFrame ringObject(const int key);
+        void ringInsert(const int key, const PVSFrame &object);
+        bool ringRemove(const int key);
+        void ringTrim(int max, int maxHistory);
+
+        PVSFrame scanObject(const int key);
+        void scanInsert(const int key, const PVSFrame &object);
+        bool scanRemove(const int key);
+        void scanTrim(int max, int maxHistory);
     public:
         enum class CacheAction {
             Grow,
@@ -803,11 +1450,40 @@ private:
             fixedSize = fixed;
         }
 
+        inline bool isRingMode() const {
+            return ringMode;
+        }
+
+        void setRingMode(bool ring);
+
+        inline bool isScanResistant() const {
+            return scanMode;
+        }
+
+        void setScanResistant(bool scanResistant);
+
+        inline void setKeepEvicted(bool keep) {
+            keepEvicted = keep;
+            if (!keep)
+                evicted.clear();
+        }
+
+        inline void takeEvicted(std::vector<std::pair<int, PVSFrame>> &frames) {
+            frames.swap(evicted);
+        }
+
         inline size_t size() const {
-            return hash.size();
+            return (ringMode || scanMode) ? static_cast<size_t>(currentSize + historySize) : hash.size();
         }
 
         inline void clear() {
+            for (auto &slot : ring) {
+                slot.key = -1;
+                slot.frame.reset();
+            }
+            scanEntries.clear();
+            for (auto &list : scanLists)
+                list.clear();
             hash.clear();
             first = nullptr;
             last = nullptr;
@@ -823,9 +1499,25 @@ private:
             farMiss = 0;
         }
 
+        // fraction of the lookups since the last size adjustment that were hits, -1 when there were none
+        inline double hitRate() const {
+            int total = hits + nearMiss + farMiss;
+            return total ? hits / static_cast<double>(total) : -1;
+        }
+
         bool insert(const int key, const PVSFrame &object);
         PVSFrame object(const int key);
+        size_t frameBytes() const; // planes shared by several cached frames are counted for each of them
+
+        inline int getSize() const {
+            return currentSize;
+        }
+
         inline bool contains(const int key) const {
+            if (ringMode)
+                return !ring.empty() && ring[key & ringMask].key == key;
+            if (scanMode)
+                return scanEntries.count(key) > 0;
             return hash.count(key) > 0;
         }
 
@@ -833,7 +1525,7 @@ private:
 
         CacheAction recommendSize();
 
-        void adjustSize(bool needMemory);
+        void adjustSize(bool needMemory, bool allowGrow = true, int minFrames = 0, int cost = fcUnknown);
     };
 
     std::atomic<long> refcount;
@@ -856,23 +1548,151 @@ private:
     std::mutex serialMutex;
     int serialFrame;
 
+    // the contexts producing frames of this node by frame number, at most one per frame so requests
+    // for the same frame are merged, protected by the thread pool's taskLock like the contexts
+    std::unordered_map<int, PVSFrameContext> inFlight;
+
     std::vector<VSFilterDependency> dependencies;
     std::vector<VSFilterDependency> consumers;
 
     std::atomic<int64_t> processingTime;
 
+    // limits how many threads may run the filter at the same time, 0 means no limit,
+    // only for fmParallel and fmParallelRequests since the other modes already run one at a time
+    std::atomic<int> maxConcurrency{0};
+    std::atomic<int> concurrency{0};
+
+    // set by filters that write only the samples of their output frame through its own stride, only
+    // their output can be rendered straight into a window of the consumer's frame
+    bool rendersInPlace = false;
+
+    // ready tasks that couldn't get the serial lock or a concurrency slot wait here instead of in the
+    // queues so scans don't keep walking over them, they're queued again once either is released
+    std::mutex blockedLock;
+    std::vector<PVSFrameContext> blockedTasks;
+    std::atomic<size_t> releaseEpoch{0}; // incremented after every release, a task only blocks if it hasn't changed since the attempt
+
+    // set with setAccessPattern(), frames up to this far beyond an external request
+    // may be produced ahead of time when threads are idle
+    std::atomic<int> accessLookahead{0};
+
+    // set with setFilterStripe(), when the node was merged with its input stripeChain holds every node
+    // from the one reading stripeSource up to this one and frames are produced by running their stripe
+    // functions on horizontal stripes instead of calling filterGetFrame, the dependencies keep them alive
+    VSFilterStripe stripeFunc = nullptr;
+    int stripeRadius = 0;
+    int stripePlanes = 0;
+    VSNode *stripeSource = nullptr;
+    std::vector<VSNode *> stripeChain;
+
+    // set while the node is the shared result of a deterministic function call, protected by the core's dedupLock
+    std::string dedupKey;
+
+    // set with setFilterHints(), cacheFloor is the largest temporal window of a consumer and is never
+    // shrunk below by the automatic sizing, all protected by cacheMutex
+    int costHint = fcUnknown;
+    int temporalRadius = -1;
+    int spatialRadius = -1;
+    int cacheFloor = 0;
+
+    // shared by all windows attached to the node, protected by cacheMutex
+    std::weak_ptr<VSFrameWindowStore> frameWindow;
+
+    // set with setAudioFrameSamples(), only nodes that called it may request frames from inputs
+    // with another frame size than VS_AUDIO_FRAME_SAMPLES
+    int audioFrameSamples = VS_AUDIO_FRAME_SAMPLES;
+    bool anyAudioFrameSamples = false;
+
+    // how many frames a single call of the filter is expected to request, the contexts reserve this
+    // much room up front, raised by the temporal radius hint and by what the filter actually requested
+    std::atomic<int> requestCapacity{0};
+
+    // statistics only collected with graph inspection enabled
+    struct NodeStats {
+        std::atomic<int64_t> framesProduced{0};
+        std::atomic<int64_t> getFrameCalls{0};
+        std::atomic<int64_t> cacheHits{0};
+        std::atomic<int64_t> cacheMisses{0};
+        std::atomic<int64_t> queueWaitTime{0};
+        std::atomic<int64_t> serialWaitTime{0};
+        std::atomic<int64_t> hwCounters[pcNumCounters] = {};
+        std::atomic<int64_t> getFrameLatency[VS_NODE_STATS_BUCKETS] = {};
+        std::atomic<int64_t> queueWait[VS_NODE_STATS_BUCKETS] = {};
+
+        static int bucket(int64_t nanoSeconds) {
+            int b = 0;
+            for (int64_t us = nanoSeconds / 1000; us > 0 && b < VS_NODE_STATS_BUCKETS - 1; us >>= 1)
+                b++;
+            return b;
+        }
+    } stats;
+
+    // planes allocated by the filter while graph inspection is enabled
+    VSMemoryAccount *memoryAccount = new VSMemoryAccount;
+
+    // Compressed second cache tier that frames evicted from the regular cache go to, it has its own
+    // size limit and isn't counted as framebuffer memory. Disabled when compressedMaxSize is 0.
+    struct CompressedFrame {
+        VSVideoFormat format;
+        int width;
+        int height;
+        VSMap properties;
+        std::vector<uint8_t> planes[3];
+        size_t size = 0;
+        uint64_t sequence = 0;
+    };
+
+    std::unordered_map<int, std::shared_ptr<CompressedFrame>> compressedCache; // protected by cacheMutex
+    std::deque<std::pair<int, uint64_t>> compressedOrder;
+    size_t compressedSize = 0;
+    size_t compressedMaxSize = 0;
+    uint64_t compressedSequence = 0;
+    std::atomic<int64_t> compressedHits{0};
+    std::atomic<int64_t> compressedMisses{0};
+
+    // set with setNodeMemoization(), output frames by the content hashes of the input frames they were
+    // made from so inputs with the same pixels as earlier ones don't get processed again, memoMaxFrames
+    // is 0 when disabled and the rest is protected by memoMutex
+    size_t memoMaxFrames = 0;
+    std::mutex memoMutex;
+    std::unordered_map<uint64_t, PVSFrame> memo;
+    std::deque<uint64_t> memoOrder;
+
+    bool getMemoKey(int n, const VSFrameContext *frameCtx, uint64_t &key, const VSFrame *&propSrc) const;
+
+    // set with setNodeSeekSensitive() or setLinearFilter(), all pending requests of an fmUnordered node
+    // go to the same queue and are taken in frame order starting at seekPosition, the frame after
+    // the one the filter was last called for
+    std::atomic<bool> seekSensitive{false};
+    std::atomic<int> seekPosition{-1};
+
+    // set once the frame pool has been filled for this node and everything upstream of it
+    std::atomic<bool> prewarmed{false};
+    void prewarmFramePool();
+
+    // the region of an input frame needed for the region of the output ctx was made for, whole frame when unknown
+    VSFrameContext::Region inputRegion(const VSFrameContext *ctx, NodeOutputKey input) const;
+
     std::mutex cacheMutex;
     bool cacheLinear = false;
     bool cacheOverride = false;
     bool cacheEnabled = false; // FIXME, needs to be atomic?
+    std::atomic<bool> cachePassthrough{false};
+    std::atomic<bool> passthroughWantsCache{false}; // what the automatic cache mode would have picked for a passthrough node
     VSCache cache;
 
     // api3
     vs3::VSVideoInfo v3vi;
 
     void registerCache(bool add);
-    PVSFrame getCachedFrameInternal(int n);
+    bool wantsCache() const;
+    void updateAutoCache();
+    void storeEvictedFrames();
+    PVSFrame getCompressedFrame(int n);
+    PVSFrame getCachedFrameInternal(int n, bool countMiss = true);
     PVSFrame getFrameInternal(int n, int activationReason, VSFrameContext *frameCtx);
+    const VSFrame *getStripeChainFrame(int n, int activationReason, VSFrameContext *frameCtx);
+    void runStripeJob(int plane, int jobTop, int jobBottom, const VSFrame *src, VSFrame *dst) const;
 public:
     VSNode(const VSMap *in, VSMap *out, const std::string &name, vs3::VSFilterInit init, VSFilterGetFrame getFrame, VSFilterFree free, VSFilterMode filterMode, int flags, void *instanceData, int apiMajor, VSCore *core); // V3 compatibility
     VSNode(const std::string &name, const VSVideoInfo *vi, VSFilterGetFrame getFrame, VSFilterFree free, VSFilterMode filterMode, const VSFilterDependency *dependencies, int numDeps, void *instanceData, int apiMajor, VSCore *core);
@@ -880,12 +1700,24 @@ public:
     ~VSNode();
 
     void addConsumer(VSNode *consumer, int strictSpatial);
+    void setCachePassthrough();
+    void *getFusableInstanceData(VSFilterGetFrame getFrame);
+    bool setFilterStripe(VSFilterStripe stripe, int radius, int planes);
     void removeConsumer(VSNode *consumer, int strictSpatial);
 
     void add_ref() noexcept {
         ++refcount;
     }
 
+    // fails once the last reference is gone and the node is being destroyed
+    bool tryAddRef() noexcept {
+        long count = refcount;
+        while (count > 0)
+            if (refcount.compare_exchange_weak(count, count + 1))
+                return true;
+        return false;
+    }
+
     void release() noexcept {
         assert(refcount > 0);
         if (--refcount == 0)
@@ -908,6 +1740,11 @@ public:
         return processingTime;
     }
 
+    void getStats(VSNodeStats *dst) const;
+    void getMemoryStats(VSNodeMemoryStats *dst);
+    void addQueueWait(int64_t nanoSeconds);
+    void addSerialWait(int64_t nanoSeconds);
+
     const VSFilterDependency *getDependencies() const {
         return dependencies.data();
     }
@@ -920,11 +1757,33 @@ public:
         return core == core2;
     }
 
+    bool isSource() const {
+        return dependencies.empty();
+    }
+
+    // set in proxy mode, the node is proxyScale times smaller than the proxyWidth x proxyHeight clip it stands in for
+    int proxyScale = 1;
+    int proxyWidth = 0;
+    int proxyHeight = 0;
+
+    int getProxyScale() const;
+
     void getFrame(const PVSFrameContext &ct);
+    void getFrameSync(const PVSFrameContext &ct, const std::atomic<bool> &done);
+    size_t cancelFrames(int n, VSFrameDoneCallback frameDone, void *userData);
 
     const VSVideoInfo &getVideoInfo() const;
     const vs3::VSVideoInfo &getVideoInfo3() const;
     const VSAudioInfo &getAudioInfo() const;
+    bool setAudioFrameSamples(int samples);
+
+    int getAudioFrameSamples() const {
+        return audioFrameSamples;
+    }
+
+    bool acceptsAnyAudioFrameSamples() const {
+        return anyAudioFrameSamples;
+    }
 
     void setVideoInfo3(const vs3::VSVideoInfo *vi, int numOutputs);
 
@@ -934,10 +1793,34 @@ public:
 
     const char *getCreationFunctionName(int level) const;
     const VSMap *getCreationFunctionArguments(int level) const;
+    const char *getCreationFunctionOutput(int level, int *index) const;
 
     int setLinear();
     void setCacheMode(int mode);
     void setCacheOptions(int fixedSize, int maxSize, int maxHistorySize);
+    void setCacheRingMode(bool ring);
+    void setCacheScanResistant(bool scanResistant);
+    void setCompressedCacheSize(int64_t bytes);
+    void setMaxConcurrency(int max);
+    void setMemoization(int maxFrames);
+    void setSeekSensitive(bool enabled) {
+        seekSensitive = enabled;
+    }
+    void setRendersInPlace() {
+        rendersInPlace = true;
+    }
+    bool getRendersInPlace() const {
+        return rendersInPlace;
+    }
+    void setAccessPattern(int pattern, int lookahead);
+    void setFilterHints(int cost, int temporalRadius, int spatialRadius);
+    void getFilterHints(int *cost, int *temporalRadius, int *spatialRadius);
+    void raiseCacheFloor(int frames);
+    bool feedsTemporalFilter();
+    size_t getRequestCapacity() const;
+    void raiseRequestCapacity(size_t frames);
+    bool isFrameCached(int n);
+    void getCompressedCacheStats(int64_t *hits, int64_t *misses, int64_t *size);
     void cacheFrame(const VSFrame *frame, int n);
 
     // to get around encapsulation a bit, more elegant than making everything friends in this case
@@ -945,48 +1828,165 @@ public:
     void releaseThread();
     bool isWorkerThread();
 
-    void notifyCache(bool needMemory);
+    void notifyCache(bool needMemory, bool allowGrow);
+    double getCacheHitRate();
+    int getCacheBudget();
 };
 
 class VSThreadPool {
 private:
+    // Every worker owns one queue (or shares it when there are more workers than queues) and
+    // only looks at the other queues when there's nothing it can run in its own.
+    // The queues are indexed by (reqOrder, frame) as it was when the task was queued and only
+    // hold tasks that are ready to run, the dependency bookkeeping is still done under taskLock.
+    typedef std::pair<uint64_t, int> TaskOrder;
+    struct TaskQueue {
+        std::mutex lock;
+        std::multimap<TaskOrder, PVSFrameContext> tasks;
+        std::atomic<size_t> numTasks{0};
+    };
+
+    // Indices are claimed one at a time by the calling thread and any idle workers that
+    // were woken up, so the caller never depends on a helper that hasn't started yet
+    struct ParallelJob {
+        VSParallelForFunc func;
+        void *userData;
+        int count;
+        std::atomic<int> next{0};
+        std::atomic<int> done{0};
+        std::mutex lock;
+        std::condition_variable finished;
+    };
+
     VSCore *core;
     std::mutex taskLock;
     std::mutex callbackLock;
     std::map<std::thread::id, std::thread *> allThreads;
-    std::list<PVSFrameContext> tasks;
-    std::unordered_map<NodeOutputKey, PVSFrameContext> allContexts;
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::vector<size_t>> queueScanOrder; // queues on the same NUMA node come first
+    std::vector<std::vector<int>> numaNodeCpus; // only filled in when NUMA mode is enabled and more than one node exists
+    // Topology mode pins the worker of queue i to workerCpus[i % size], primary threads of the fastest
+    // cores come first, then the E-cores and last the SMT siblings. Workers on the latter two prefer
+    // light work and leave heavy fmParallel filters to the others. Empty when all cpus are equal.
+    std::vector<int> workerCpus;
+    std::vector<char> secondaryQueues;
     std::condition_variable newWork;
     std::condition_variable allIdle;
+    std::condition_variable helperWork; // threads waiting in startExternalSync
+    std::atomic<size_t> numHelpers;
+    std::atomic<size_t> waitCounter;
     std::atomic<size_t> activeThreads;
     std::atomic<size_t> idleThreads;
     std::atomic<size_t> reqCounter;
-    size_t maxThreads;
+    std::atomic<size_t> workEpoch; // incremented every time a task is queued, used to detect new work that arrived during a scan
+    std::atomic<size_t> nextQueue;
+    std::atomic<size_t> maxThreads;
     std::atomic<bool> stopThreads;
     std::atomic<size_t> ticks;
     std::atomic<size_t> nextAdjTicks;
+    std::mutex parallelLock;
+    std::deque<std::shared_ptr<ParallelJob>> parallelJobs; // protected by parallelLock
+    std::atomic<size_t> numParallelJobs;
+
+    // outstanding external requests so they can be cancelled, protected by taskLock
+    std::unordered_multimap<NodeOutputKey, PVSFrameContext> externalContexts;
+    std::atomic<size_t> numCancelled; // cancelled external requests that haven't been returned yet
+    bool lowLatency;
+    bool isAbandoned(const VSFrameContext *ctx, std::unordered_map<const VSFrameContext *, bool> &visited);
+
+    // adaptive mode searches for the number of threads between 1 and maxThreads that gives
+    // the highest output frame rate, all except the target are protected by taskLock
+    bool adaptive;
+    std::atomic<size_t> targetThreads;
+    int64_t adaptFrames = 0;
+    std::chrono::steady_clock::time_point adaptStart;
+    double adaptLastRate = 0;
+    int adaptDirection = -1;
+    void adaptThreadCount();
+    // the part of the VSSharedBudget threads this pool may use, 0 when it isn't attached
+    std::atomic<size_t> sharedShare{0};
+    size_t threadLimit() const {
+        size_t limit = adaptive ? targetThreads.load() : maxThreads.load();
+        size_t share = sharedShare;
+        return share ? std::min(limit, share) : limit;
+    }
+
+    // real-time mode orders external requests with a deadline by it, the deadline thread returns the ones
+    // that aren't done in time and is only started with the first of them, protected by taskLock
+    bool realTime;
+    std::multimap<int64_t, PVSFrameContext> deadlines;
+    std::thread *deadlineThread = nullptr;
+    std::condition_variable deadlineWork;
+    std::atomic<int64_t> deadlineMisses{0};
+    void runDeadlines();
+
+    // idle workers spin for up to maxSpinTime nanoseconds before they park, spinning ones are counted so
+    // new tasks don't wake an additional thread for them, the count may be lower but never higher than
+    // the number of threads actually spinning
+    std::atomic<int64_t> maxSpinTime{0};
+    std::atomic<size_t> spinningThreads{0};
+    std::atomic<size_t> numBlocked{0}; // tasks in the blocked sets of all nodes
+    bool spinForWork(size_t epoch, const std::atomic<bool> &stop, int64_t maxSpin, int64_t &spinTime);
+    bool claimSpinningThread();
+
+    // the tasks queued by one thread while it holds taskLock are woken up with a single notification
+    class WakeBatch;
+    static thread_local WakeBatch *currentWakeBatch;
+    std::atomic<bool> batchWakeups{true};
+
+    static thread_local VSThreadPool *currentPool;
+    static thread_local size_t currentQueue;
     size_t getNumAvailableThreads();
+    static std::vector<std::vector<int>> getNumaNodes();
+    static std::vector<std::pair<int, bool>> getCpuTopology();
+    void pinThread(std::thread *thread, const std::vector<int> &cpus, const char *what);
     void queueTask(const PVSFrameContext &ctx);
-    void wakeThread();
+    void startSpeculative(VSNode *node, int n, int lookahead);
+    bool takeTask(size_t queueIndex, size_t waitId, PVSFrameContext &task, PVSFrame &cached, bool &useSerialLock, bool &useConcurrencyLimit);
+    bool blockTask(TaskQueue &queue, std::multimap<TaskOrder, PVSFrameContext>::iterator iter, size_t epoch);
+    void requeueBlocked(VSNode *node);
+    bool runTask(size_t queueIndex, size_t waitId);
+    VSFrameContext *findContext(NodeOutputKey key);
+    void addContext(const PVSFrameContext &ctx);
+    void eraseContext(const PVSFrameContext &ctx);
+    void notifyDependents(const PVSFrameContext &ctx, const PVSFrame &f);
+    void invokeFrameDone(const VSFrameContext *rCtx, const PVSFrame &f, const char *errorMsg);
+    void wakeThreads(size_t count);
+    size_t startInternalRequests(const PVSFrameContext &notify);
     void startInternalRequest(const PVSFrameContext &notify, NodeOutputKey key);
     void spawnThread();
-    static void runTasksWrapper(VSThreadPool *owner, std::atomic<bool> &stop);
-    void runTasks(std::atomic<bool> &stop);
-    static bool taskCmp(const PVSFrameContext &a, const PVSFrameContext &b);
+    static void runTasksWrapper(VSThreadPool *owner, size_t queueIndex, std::atomic<bool> &stop);
+    void runTasks(size_t queueIndex, std::atomic<bool> &stop);
+    static bool runParallelJob(ParallelJob &job);
+    bool helpParallelJobs();
 public:
-    VSThreadPool(VSCore *core);
+    VSThreadPool(VSCore *core, bool numaAware, bool adaptive, bool lowLatency, bool shared, bool topologyAware, bool realTime);
+    bool isBusy() const;
+    void getStats(VSCoreStats *stats);
+    void setSharedShare(size_t share);
+    void setSpinTime(int64_t nanoseconds) {
+        maxSpinTime = std::max<int64_t>(nanoseconds, 0);
+    }
+    void setBatchWakeups(bool enabled) {
+        batchWakeups = enabled;
+    }
+    size_t numaNodeCount() const;
     ~VSThreadPool();
     void returnFrame(const VSFrameContext *rCtx, const PVSFrame &f);
     size_t threadCount();
     size_t setThreadCount(size_t threads);
     void startExternal(const PVSFrameContext &context);
+    void startExternalSync(const PVSFrameContext &context, const std::atomic<bool> &done);
+    size_t cancelExternal(NodeOutputKey key, VSFrameDoneCallback frameDone, void *userData);
     void releaseThread();
     void reserveThread();
     bool isWorkerThread();
     void waitForDone();
+    void parallelFor(int count, VSParallelForFunc func, void *userData);
 };
 
 struct VSPluginFunction {
+    friend struct VSPlugin;
 private:
     VSPublicFunction func;
     void *functionData;
@@ -996,6 +1996,11 @@ private:
     std::string returnType;
     std::vector<FilterArgument> inArgs;
     std::vector<FilterArgument> retArgs;
+    // the indexes of inArgs sorted by key pointer, so invoke checks a map without comparing any strings
+    std::vector<std::pair<const VSMapKey *, size_t>> argIndex;
+    size_t numRequiredArgs = 0;
+    bool acceptsAnyArgs = false;
+    int flags = 0; // VSPluginFunctionFlags
     static void parseArgString(const std::string &argString, std::vector<FilterArgument> &argsOut, int apiMajor);
 public:
     VSPluginFunction(const std::string &name, const std::string &argString, const std::string &returnType, VSPublicFunction func, void *functionData, VSPlugin *plugin);
@@ -1009,6 +2014,32 @@ public:
     bool rename(const std::string &newname); // 'vs-c'
 };
 
+// Everything needed to register a plugin's functions without loading it, saved in the plugin cache
+struct VSPluginManifest {
+    struct Function {
+        std::string name;
+        std::string args;
+        std::string returnType;
+    };
+
+    std::string filename;
+    int64_t modified = 0;
+    int64_t size = 0;
+    std::string id;
+    std::string fnamespace;
+    std::string fullname;
+    int pluginVersion = 0;
+    int apiVersion = 0;
+    bool readOnly = false;
+    std::vector<Function> functions;
+};
+
+struct VSPluginCache {
+    std::map<std::string, VSPluginManifest> entries; // by full filename
+    std::set<std::string> used;
+    bool changed = false;
+};
+
 
 struct VSPlugin {
     friend struct VSPluginFunction;
@@ -1031,15 +2062,21 @@ private:
     std::map<std::string, VSPluginFunction> funcs;
     std::mutex functionLock;
     VSCore *core;
+    // set for plugins created from a manifest until the library is loaded on the first invoke
+    std::atomic<bool> deferred;
+    std::mutex loadLock;
+    void load(const std::string &relFilename, bool altSearchPath);
 public:
     explicit VSPlugin(VSCore *core);
     VSPlugin(const std::string &relFilename, const std::string &forcedNamespace, const std::string &forcedId, bool altSearchPath, VSCore *core);
+    VSPlugin(const VSPluginManifest &manifest, VSCore *core);
     ~VSPlugin();
     void lock() { readOnly = true; }
     void unlock() { readOnly = false; } // 'vs-c'
     bool isLocked() const { return readOnly; } // 'vs-c'
     bool configPlugin(const std::string &identifier, const std::string &pluginsNamespace, const std::string &fullname, int pluginVersion, int apiVersion, int flags);
     bool registerFunction(const std::string &name, const std::string &args, const std::string &returnType, VSPublicFunction argsFunc, void *functionData);
+    bool setFunctionFlags(const std::string &name, int flags);
     VSMap *invoke(const std::string &funcName, const VSMap &args);
     VSPluginFunction *getNextFunction(VSPluginFunction *func);
     VSPluginFunction *getFunctionByName(const std::string name);
@@ -1050,6 +2087,9 @@ public:
     int getPluginVersion() const { return pluginVersion; }
     int getAPIVersion() const { return apiMajor; } // 'vs-c'
     void getFunctions3(VSMap *out) const;
+    void ensureLoaded();
+    bool isDeferred() const { return deferred; }
+    VSPluginManifest getManifest() const;
 };
 
 struct VSLogHandle {
@@ -1081,10 +2121,33 @@ private:
     std::mutex cacheLock;
 
     std::atomic<int> cpuLevel;
+    int kernelCpuLevels[VS_KERNEL_FAMILY_COUNT]; // only set while the core is created
+
+    // Filter calls remembered between script evaluations so identical calls get the same nodes back
+    struct NodeReuseEntry {
+        std::unique_ptr<VSMap> args; // keeps the argument nodes alive so their addresses can't end up identifying other nodes
+        std::unique_ptr<VSMap> result;
+        bool used;
+    };
+    std::mutex nodeReuseLock;
+    std::atomic<bool> nodeReuse;
+    std::atomic<int> proxyScale{1};
+    int stridePadding = 64; // only set while the core is created
+    std::unordered_map<std::string, NodeReuseEntry> nodeReuseEntries;
+
+    // Nodes returned by deterministic functions, an entry only lives as long as its node
+    struct DedupEntry {
+        VSNode *node;
+        std::string retKey;
+        std::unique_ptr<VSMap> args;
+    };
+    std::mutex dedupLock;
+    std::unordered_map<std::string, DedupEntry> dedupNodes;
 
     ~VSCore();
 
     void registerFormats();
+    VSPlugin *addPlugin(std::unique_ptr<VSPlugin> &p, const std::string &filename);
 
     std::mutex logMutex;
     std::set<VSLogHandle *> messageHandlers;
@@ -1094,8 +2157,15 @@ public:
 
     bool disableLibraryUnloading;
 
+    // set with ccfStreamingCaches
+    bool streamingCaches;
+
+    // only exists when the core was created with ccfEnableTracing
+    VSTracer *tracer;
+
     // Used only for graph inspection
     bool enableGraphInspection; 
+    bool enablePerfCounters;
     static thread_local PVSFunctionFrame functionFrame;
     //
 
@@ -1131,12 +2201,13 @@ public:
     vs3::VSVideoInfo VideoInfoToV3(const VSVideoInfo &vi) noexcept;
     VSVideoInfo VideoInfoFromV3(const vs3::VSVideoInfo &vi) noexcept;
 
-    void loadPlugin(const std::string &filename, const std::string &forcedNamespace = std::string(), const std::string &forcedId = std::string(), bool altSearchPath = false);
+    VSPlugin *loadPlugin(const std::string &filename, const std::string &forcedNamespace = std::string(), const std::string &forcedId = std::string(), bool altSearchPath = false);
 
 #ifdef VS_TARGET_OS_WINDOWS
     bool loadAllPluginsInPath(const std::wstring &path, const std::wstring &filter);
 #else
-    bool loadAllPluginsInPath(const std::string &path, const std::string &filter);
+    void loadPluginCached(const std::string &filename, VSPluginCache &cache);
+    bool loadAllPluginsInPath(const std::string &path, const std::string &filter, VSPluginCache *cache = nullptr);
 #endif
 
     void createFilter3(const VSMap *in, VSMap *out, const std::string &name, vs3::VSFilterInit init, VSFilterGetFrame getFrame, VSFilterFree free, VSFilterMode filterMode, int flags, void *instanceData, int apiMajor);
@@ -1147,6 +2218,20 @@ public:
 
     int getCpuLevel() const;
     int setCpuLevel(int cpu);
+    int getKernelCpuLevel(int family) const;
+    void applyTuningSettings(const VSMap *settings, const std::string &source);
+
+    void setNodeReuse(bool enable);
+    int releaseUnusedNodes();
+    bool isNodeReuseEnabled();
+    void setProxyScale(int scale);
+    int getProxyScale() const;
+    ptrdiff_t planeStride(ptrdiff_t rowSize) const;
+    bool findReusableNodes(const std::string &key, VSMap *out);
+    void addReusableNodes(const std::string &key, const VSMap &args, const VSMap &result);
+    bool findDedupNode(const std::string &key, VSMap *out);
+    void addDedupNode(const std::string &key, const VSMap &args, const VSMap &result);
+    void forgetDedupNode(VSNode *node);
 
     VSMap *getPlugins3();
     VSPlugin *getPluginByID(const std::string &identifier);
@@ -21,11 +21,15 @@
 #include <cmath>
 #include <cstring>
 #include <algorithm>
+#include <exception>
 #include <limits>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #define ZIMGXX_NAMESPACE vszimgxx
 #include <zimg++.hpp>
@@ -34,6 +38,7 @@
 #include "VSHelper4.h"
 #include "VSConstants4.h"
 #include "internalfilters.h"
+#include "filtershared.h"
 #include "version.h"
 
 using namespace vsh;
@@ -399,10 +404,6 @@ bool operator==(const zimg_image_format &a, const zimg_image_format &b) {
     return ret;
 }
 
-bool operator!=(const zimg_image_format &a, const zimg_image_format &b) {
-    return !operator==(a, b);
-}
-
 bool is_shifted(const zimg_image_format &fmt) {
     bool ret = false;
     ret = ret || (!std::isnan(fmt.active_region.left) && fmt.active_region.left != 0);
@@ -412,6 +413,190 @@ bool is_shifted(const zimg_image_format &fmt) {
     return ret;
 }
 
+// True if a conversion leaves the luma plane unchanged and only resamples chroma.
+bool is_chroma_only(const zimg_image_format &src, const zimg_image_format &dst) {
+    return src.color_family == ZIMG_COLOR_YUV && dst.color_family == ZIMG_COLOR_YUV &&
+        src.width == dst.width && src.height == dst.height && !is_shifted(src) &&
+        src.pixel_type == dst.pixel_type && src.depth == dst.depth && src.pixel_range == dst.pixel_range &&
+        src.matrix_coefficients == dst.matrix_coefficients &&
+        src.transfer_characteristics == dst.transfer_characteristics &&
+        src.color_primaries == dst.color_primaries;
+}
+
+// Position of the chroma samples relative to the centre of the luma pixels they cover, in luma pixels.
+void get_chroma_offset(const zimg_image_format &fmt, double *x, double *y) {
+    zimg_chroma_location_e loc = fmt.chroma_location;
+    bool left = loc == ZIMG_CHROMA_LEFT || loc == ZIMG_CHROMA_TOP_LEFT || loc == ZIMG_CHROMA_BOTTOM_LEFT;
+    bool top = loc == ZIMG_CHROMA_TOP_LEFT || loc == ZIMG_CHROMA_TOP;
+    bool bottom = loc == ZIMG_CHROMA_BOTTOM_LEFT || loc == ZIMG_CHROMA_BOTTOM;
+    double factor_w = 1 << fmt.subsample_w;
+    double factor_h = 1 << fmt.subsample_h;
+
+    *x = left ? 0.5 - 0.5 * factor_w : 0.0;
+    *y = top ? 0.5 - 0.5 * factor_h : bottom ? 0.5 * factor_h - 0.5 : 0.0;
+}
+
+// Describes the chroma planes of a chroma only conversion as a pair of grey images, the source window
+// moves the samples to where the destination chroma location expects them.
+void get_chroma_plane_formats(const zimg_image_format &src, const zimg_image_format &dst, zimg_image_format *src_plane, zimg_image_format *dst_plane) {
+    double src_x, src_y, dst_x, dst_y;
+    get_chroma_offset(src, &src_x, &src_y);
+    get_chroma_offset(dst, &dst_x, &dst_y);
+
+    src_plane->width = src.width >> src.subsample_w;
+    src_plane->height = src.height >> src.subsample_h;
+    dst_plane->width = dst.width >> dst.subsample_w;
+    dst_plane->height = dst.height >> dst.subsample_h;
+
+    for (zimg_image_format *plane : { src_plane, dst_plane }) {
+        plane->pixel_type = src.pixel_type;
+        plane->depth = src.depth;
+        plane->pixel_range = src.pixel_range;
+        plane->color_family = ZIMG_COLOR_GREY;
+    }
+
+    src_plane->active_region.left = (dst_x - src_x) / (1 << src.subsample_w);
+    src_plane->active_region.top = (dst_y - src_y) / (1 << src.subsample_h);
+    src_plane->active_region.width = src_plane->width;
+    src_plane->active_region.height = src_plane->height;
+}
+
+vszimgxx::zimage_buffer_const import_plane_as_buffer_const(const VSFrame *frame, int plane, const VSAPI *vsapi) {
+    vszimgxx::zimage_buffer_const buffer;
+    buffer.plane[0].data = vsapi->getReadPtr(frame, plane);
+    buffer.plane[0].stride = vsapi->getStride(frame, plane);
+    buffer.plane[0].mask = ZIMG_BUFFER_MAX;
+    return buffer;
+}
+
+vszimgxx::zimage_buffer import_plane_as_buffer(VSFrame *frame, int plane, const VSAPI *vsapi) {
+    vszimgxx::zimage_buffer buffer;
+    buffer.plane[0].data = vsapi->getWritePtr(frame, plane);
+    buffer.plane[0].stride = vsapi->getStride(frame, plane);
+    buffer.plane[0].mask = ZIMG_BUFFER_MAX;
+    return buffer;
+}
+
+bool same_double(double a, double b) {
+    return a == b || (std::isnan(a) && std::isnan(b));
+}
+
+// operator== only looks at what can change between frames, the caches also need everything fixed at creation
+bool same_graph_format(const zimg_image_format &a, const zimg_image_format &b) {
+    bool ret = a == b;
+    ret = ret && same_double(a.active_region.left, b.active_region.left);
+    ret = ret && same_double(a.active_region.top, b.active_region.top);
+    ret = ret && same_double(a.active_region.width, b.active_region.width);
+    ret = ret && same_double(a.active_region.height, b.active_region.height);
+    return ret;
+}
+
+bool same_graph_params(const zimg_graph_builder_params &a, const zimg_graph_builder_params &b) {
+    bool ret = true;
+    ret = ret && a.resample_filter == b.resample_filter;
+    ret = ret && same_double(a.filter_param_a, b.filter_param_a);
+    ret = ret && same_double(a.filter_param_b, b.filter_param_b);
+    ret = ret && a.resample_filter_uv == b.resample_filter_uv;
+    ret = ret && same_double(a.filter_param_a_uv, b.filter_param_a_uv);
+    ret = ret && same_double(a.filter_param_b_uv, b.filter_param_b_uv);
+    ret = ret && a.dither_type == b.dither_type;
+    ret = ret && a.cpu_type == b.cpu_type;
+    ret = ret && same_double(a.nominal_peak_luminance, b.nominal_peak_luminance);
+    ret = ret && a.allow_approximate_gamma == b.allow_approximate_gamma;
+    return ret;
+}
+
+struct graph_data {
+    vszimgxx::FilterGraph graph;
+    zimg_image_format src_format;
+    zimg_image_format dst_format;
+    zimg_graph_builder_params params;
+
+    graph_data(const zimg_image_format &src_format, const zimg_image_format &dst_format, const zimg_graph_builder_params &params) :
+        graph(vszimgxx::FilterGraph::build(src_format, dst_format, &params)),
+        src_format(src_format),
+        dst_format(dst_format),
+        params(params) {}
+
+    bool matches(const zimg_image_format &src, const zimg_image_format &dst, const zimg_graph_builder_params &p) const {
+        return same_graph_format(src_format, src) && same_graph_format(dst_format, dst) && same_graph_params(params, p);
+    }
+};
+
+// A small most recently used first list of built graphs. Graphs are immutable once built so
+// the returned pointers can be used from any number of frames at the same time.
+class graph_cache {
+    std::mutex m_lock;
+    std::list<std::shared_ptr<graph_data>> m_graphs;
+    size_t m_capacity;
+public:
+    explicit graph_cache(size_t capacity) : m_capacity(capacity) {}
+
+    std::shared_ptr<graph_data> find(const zimg_image_format &src_format, const zimg_image_format &dst_format, const zimg_graph_builder_params &params) {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        for (auto iter = m_graphs.begin(); iter != m_graphs.end(); ++iter) {
+            if ((*iter)->matches(src_format, dst_format, params)) {
+                m_graphs.splice(m_graphs.begin(), m_graphs, iter);
+                return m_graphs.front();
+            }
+        }
+        return nullptr;
+    }
+
+    void insert(const std::shared_ptr<graph_data> &data) {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        // another frame may have built the same graph in the meantime
+        for (const auto &iter : m_graphs) {
+            if (iter->matches(data->src_format, data->dst_format, data->params))
+                return;
+        }
+
+        m_graphs.push_front(data);
+        if (m_graphs.size() > m_capacity)
+            m_graphs.pop_back();
+    }
+};
+
+// Shared by all resizers so identical conversions in different parts of a script are only built once.
+graph_cache g_shared_graph_cache{ 64 };
+
+// The zimg temporary buffer is taken from a scratch frame so it's recycled through the frame
+// pool and counted against the core's memory limit like any other frame data.
+class tmp_buffer {
+    static constexpr int row_bytes = 4096;
+    static constexpr size_t zimg_alignment = 64;
+
+    VSFrame *m_frame;
+    void *m_data;
+    const VSAPI *m_vsapi;
+public:
+    tmp_buffer(size_t size, VSCore *core, const VSAPI *vsapi) : m_frame(nullptr), m_data(nullptr), m_vsapi(vsapi) {
+        VSVideoFormat format;
+        vsapi->queryVideoFormat(&format, cfGray, stInteger, 8, 0, 0, core);
+
+        // rows are a multiple of the frame alignment so the plane is contiguous, the extra space covers
+        // aligning up when frames are only 32 byte aligned
+        size_t height = (size + zimg_alignment + row_bytes - 1) / row_bytes;
+        if (height > static_cast<size_t>(std::numeric_limits<int>::max()))
+            throw std::bad_alloc{};
+
+        m_frame = vsapi->newVideoFrame(&format, row_bytes, static_cast<int>(height), nullptr, core);
+        uintptr_t ptr = reinterpret_cast<uintptr_t>(vsapi->getWritePtr(m_frame, 0));
+        m_data = reinterpret_cast<void *>((ptr + zimg_alignment - 1) & ~static_cast<uintptr_t>(zimg_alignment - 1));
+    }
+
+    tmp_buffer(const tmp_buffer &) = delete;
+    tmp_buffer &operator=(const tmp_buffer &) = delete;
+
+    ~tmp_buffer() {
+        m_vsapi->freeFrame(m_frame);
+    }
+
+    void *get() const { return m_data; }
+};
+
 
 void VS_CC vszimg_free(void *instanceData, VSCore *core, const VSAPI *vsapi);
 const VSFrame * VS_CC vszimg_get_frame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi);
@@ -448,30 +633,21 @@ class vszimg {
         optional_of<zimg_chroma_location_e> chromaloc;
     };
 
-    struct graph_data {
-        vszimgxx::FilterGraph graph;
-        zimg_image_format src_format;
-        zimg_image_format dst_format;
-
-        graph_data(const zimg_image_format &src_format, const zimg_image_format &dst_format, const zimg_graph_builder_params &params) :
-            graph(vszimgxx::FilterGraph::build(src_format, dst_format, &params)),
-            src_format(src_format),
-            dst_format(dst_format) {}
-    };
-
-    std::shared_ptr<graph_data> m_graph_data_p;
-    std::shared_ptr<graph_data> m_graph_data_t;
-    std::shared_ptr<graph_data> m_graph_data_b;
+    graph_cache m_graph_cache{ 8 };
 
     VSNode *m_node;
     VSVideoInfo m_vi;
     bool m_prefer_props; // If true, frame properties have precedence over filter arguments.
     double m_src_left, m_src_top, m_src_width, m_src_height;
+    int m_crop_left, m_crop_top, m_crop_width, m_crop_height; // Crop folded into the source window, zero width if none.
     vszimgxx::zfilter_graph_builder_params m_params;
 
     frame_params m_frame_params;
     frame_params m_frame_params_in;
 
+    // Format-only resizes folded into this one keep their settings here, the one reading the source first.
+    std::vector<std::shared_ptr<const vszimg>> m_folded;
+
     template <class T, class Map>
     static void lookup_enum_str(const VSMap *map, const char *key, const Map &enum_table, optional_of<T> *out, const VSAPI *vsapi) {
         if (vsapi->mapNumElements(map, key) > 0) {
@@ -509,6 +685,55 @@ class vszimg {
             *out = in.get();
     }
 
+    static bool is_any_present(const frame_params &params) {
+        return params.matrix.is_present() || params.transfer.is_present() || params.primaries.is_present() ||
+            params.range.is_present() || params.chromaloc.is_present();
+    }
+
+    // Filters that reproduce the source exactly at whole pixel offsets, moving the source window by a
+    // Crop then changes nothing but the edges.
+    static bool is_interpolating(zimg_resample_filter_e filter, double param_a) {
+        return filter != ZIMG_RESIZE_BICUBIC || param_a == 0;
+    }
+
+    // Unset filter parameters are NaN and count as equal.
+    static bool is_same_param(double a, double b) {
+        return a == b || (std::isnan(a) && std::isnan(b));
+    }
+
+    static bool is_same_resampling(const vszimgxx::zfilter_graph_builder_params &a, const vszimgxx::zfilter_graph_builder_params &b) {
+        return a.resample_filter == b.resample_filter && is_same_param(a.filter_param_a, b.filter_param_a) && is_same_param(a.filter_param_b, b.filter_param_b) &&
+            a.resample_filter_uv == b.resample_filter_uv && is_same_param(a.filter_param_a_uv, b.filter_param_a_uv) && is_same_param(a.filter_param_b_uv, b.filter_param_b_uv) &&
+            is_same_param(a.nominal_peak_luminance, b.nominal_peak_luminance);
+    }
+
+    // Skipping the quantization to the intermediate format only leaves the output unchanged when it can
+    // hold everything the final format can.
+    static bool is_lossless_intermediate(const VSVideoFormat &mid, const VSVideoFormat &dst) {
+        if (mid.sampleType == stFloat)
+            return mid.bitsPerSample == 32 || (dst.sampleType == stFloat && dst.bitsPerSample <= mid.bitsPerSample);
+        return dst.sampleType == stInteger && dst.bitsPerSample <= mid.bitsPerSample;
+    }
+
+    // Copies the settings of a resize folded into another one, the copy doesn't hold a node.
+    vszimg(const vszimg &other) :
+        m_node{ nullptr },
+        m_vi(other.m_vi),
+        m_prefer_props(other.m_prefer_props),
+        m_src_left(other.m_src_left),
+        m_src_top(other.m_src_top),
+        m_src_width(other.m_src_width),
+        m_src_height(other.m_src_height),
+        m_crop_left(other.m_crop_left),
+        m_crop_top(other.m_crop_top),
+        m_crop_width(other.m_crop_width),
+        m_crop_height(other.m_crop_height),
+        m_params(other.m_params),
+        m_frame_params(other.m_frame_params),
+        m_frame_params_in(other.m_frame_params_in)
+    {
+    }
+
     vszimg(const VSMap *in, void *userData, VSCore *core, const VSAPI *vsapi) :
         m_node{ nullptr },
         m_vi(),
@@ -516,7 +741,11 @@ class vszimg {
         m_src_left(),
         m_src_top(),
         m_src_width(),
-        m_src_height()
+        m_src_height(),
+        m_crop_left(),
+        m_crop_top(),
+        m_crop_width(),
+        m_crop_height()
     {
         try {
             m_node = vsapi->mapGetNode(in, "clip", 0, nullptr);
@@ -569,6 +798,21 @@ class vszimg {
             m_src_top = propGetScalarDef<double>(in, "src_top", NAN, vsapi);
             m_src_width = propGetScalarDef<double>(in, "src_width", NAN, vsapi);
             m_src_height = propGetScalarDef<double>(in, "src_height", NAN, vsapi);
+
+            // the dimensions are given for the full size clip, a reduced proxy clip stays reduced by the same amount
+            int proxy_scale = vsapi->getNodeProxyScale(m_node);
+            if (proxy_scale > 1) {
+                unsigned ssw = isConstantVideoFormat(&m_vi) ? m_vi.format.subSamplingW : 0;
+                unsigned ssh = isConstantVideoFormat(&m_vi) ? m_vi.format.subSamplingH : 0;
+                if (vsapi->mapNumElements(in, "width") > 0)
+                    m_vi.width = std::max(m_vi.width / proxy_scale >> ssw << ssw, 1 << ssw);
+                if (vsapi->mapNumElements(in, "height") > 0)
+                    m_vi.height = std::max(m_vi.height / proxy_scale >> ssh << ssh, 1 << ssh);
+                m_src_left /= proxy_scale;
+                m_src_top /= proxy_scale;
+                m_src_width /= proxy_scale;
+                m_src_height /= proxy_scale;
+            }
             m_params.nominal_peak_luminance = propGetScalarDef<double>(in, "nominal_luminance", NAN, vsapi);
 
             // Basic compatibility check.
@@ -590,6 +834,8 @@ class vszimg {
                     && !m_frame_params.matrix.is_present()) {
                     throw std::runtime_error{ "Matrix must be specified when converting to YUV or GRAY from RGB" };
                 }
+
+                fold_source(vsapi);
             }
         } catch (...) {
             freeFunc(core, vsapi);
@@ -597,26 +843,118 @@ class vszimg {
         }
     }
 
+    // Takes over an unshared Crop or format-only resize in front of this one so both run in the same
+    // zimg graph and the intermediate frames are never created.
+    void fold_source(const VSAPI *vsapi) {
+        const VSVideoInfo &node_vi = *vsapi->getVideoInfo(m_node);
+        VSNode *source = nullptr;
+        int left, top, width, height;
+
+        if (const vszimg *inner = static_cast<const vszimg *>(getFusableInstanceData(m_node, vszimg_get_frame))) {
+            bool format_only = m_vi.width == node_vi.width && m_vi.height == node_vi.height &&
+                std::isnan(m_src_left) && std::isnan(m_src_top) && std::isnan(m_src_width) && std::isnan(m_src_height) &&
+                !is_any_present(m_frame_params_in);
+
+            if (!format_only || !isConstantVideoFormat(vsapi->getVideoInfo(inner->m_node)))
+                return;
+
+            // The merged graph resamples everything with one set of filters and never quantizes to the
+            // intermediate format, so only fold when neither can make a difference.
+            if (!is_same_resampling(m_params, inner->m_params) ||
+                node_vi.format.subSamplingW != m_vi.format.subSamplingW || node_vi.format.subSamplingH != m_vi.format.subSamplingH ||
+                !is_lossless_intermediate(node_vi.format, m_vi.format))
+                return;
+
+            m_folded = inner->m_folded;
+            m_folded.emplace_back(new vszimg{ *inner });
+
+            source = inner->m_node;
+        } else if (getCropWindow(m_node, &source, &left, &top, &width, &height)) {
+            // Odd offsets swap the field order and odd heights can't be split into fields.
+            if ((top | height) & 1 || !isConstantVideoFormat(vsapi->getVideoInfo(source)))
+                return;
+            if (!is_interpolating(m_params.resample_filter, m_params.filter_param_a) ||
+                !is_interpolating(m_params.resample_filter_uv, m_params.filter_param_a_uv))
+                return;
+
+            m_crop_left = left;
+            m_crop_top = top;
+            m_crop_width = width;
+            m_crop_height = height;
+        } else {
+            return;
+        }
+
+        source = vsapi->addNodeRef(source);
+        vsapi->freeNode(m_node);
+        m_node = source;
+    }
+
+    // The source window is relative to the cropped frame when a Crop was folded in, field based
+    // processing gives it in field lines.
+    void set_active_region(zimg_image_format *format, bool field) const {
+        if (!m_crop_width) {
+            format->active_region.left = m_src_left;
+            format->active_region.top = m_src_top;
+            format->active_region.width = m_src_width;
+            format->active_region.height = m_src_height;
+            return;
+        }
+
+        double scale = field ? 0.5 : 1.0;
+        format->active_region.left = m_crop_left + (std::isnan(m_src_left) ? 0.0 : m_src_left);
+        format->active_region.top = m_crop_top * scale + (std::isnan(m_src_top) ? 0.0 : m_src_top);
+        format->active_region.width = std::isnan(m_src_width) ? m_crop_width : m_src_width;
+        format->active_region.height = std::isnan(m_src_height) ? m_crop_height * scale : m_src_height;
+    }
+
+    void import_source_format(const VSFrame *src_frame, const VSMap *src_props, const VSVideoFormat *src_vsformat, zimg_image_format *src_format, bool *interlaced, const VSAPI *vsapi) const {
+        src_format->width = vsapi->getFrameWidth(src_frame, 0);
+        src_format->height = vsapi->getFrameHeight(src_frame, 0);
+        set_active_region(src_format, false);
+
+        translate_vsformat(src_vsformat, src_format, vsapi);
+
+        if (m_prefer_props) {
+            set_src_colorspace(src_format);
+            import_frame_props(src_props, src_format, interlaced, vsapi);
+        } else {
+            import_frame_props(src_props, src_format, interlaced, vsapi);
+            set_src_colorspace(src_format);
+        }
+    }
+
+    const VSVideoFormat *export_dst_format(const zimg_image_format &src_format, const VSVideoFormat *src_vsformat, zimg_image_format *dst_format, const VSAPI *vsapi) const {
+        const VSVideoFormat *dst_vsformat = (m_vi.format.colorFamily != cfUndefined) ? &m_vi.format : src_vsformat;
+
+        dst_format->width = m_vi.width ? static_cast<unsigned>(m_vi.width) : src_format.width;
+        dst_format->height = m_vi.height ? static_cast<unsigned>(m_vi.height) : src_format.height;
+
+        translate_vsformat(dst_vsformat, dst_format, vsapi);
+        set_dst_colorspace(src_format, dst_format);
+        return dst_vsformat;
+    }
+
     std::shared_ptr<graph_data> get_graph_data(const zimg_image_format &src_format, const zimg_image_format &dst_format) {
-        std::shared_ptr<graph_data> *data_ptr;
+        return get_graph_data(src_format, dst_format, m_params);
+    }
 
-        if (src_format.field_parity == ZIMG_FIELD_TOP)
-            data_ptr = &m_graph_data_t;
-        else if (src_format.field_parity == ZIMG_FIELD_BOTTOM)
-            data_ptr = &m_graph_data_b;
-        else
-            data_ptr = &m_graph_data_p;
+    std::shared_ptr<graph_data> get_graph_data(const zimg_image_format &src_format, const zimg_image_format &dst_format, const zimg_graph_builder_params &params) {
+        std::shared_ptr<graph_data> data = m_graph_cache.find(src_format, dst_format, params);
+        if (data)
+            return data;
 
-        std::shared_ptr<graph_data> data = std::atomic_load(data_ptr);
-        if (!data || data->src_format != src_format || data->dst_format != dst_format) {
-            data = std::make_shared<graph_data>(src_format, dst_format, m_params);
-            std::atomic_store(data_ptr, data);
+        data = g_shared_graph_cache.find(src_format, dst_format, params);
+        if (!data) {
+            data = std::make_shared<graph_data>(src_format, dst_format, params);
+            g_shared_graph_cache.insert(data);
         }
 
+        m_graph_cache.insert(data);
         return data;
     }
 
-    void set_src_colorspace(zimg_image_format *src_format) {
+    void set_src_colorspace(zimg_image_format *src_format) const {
         propagate_if_present(m_frame_params_in.matrix, &src_format->matrix_coefficients);
         propagate_if_present(m_frame_params_in.transfer, &src_format->transfer_characteristics);
         propagate_if_present(m_frame_params_in.primaries, &src_format->color_primaries);
@@ -624,7 +962,7 @@ class vszimg {
         propagate_if_present(m_frame_params_in.chromaloc, &src_format->chroma_location);
     }
 
-    void set_dst_colorspace(const zimg_image_format &src_format, zimg_image_format *dst_format) {
+    void set_dst_colorspace(const zimg_image_format &src_format, zimg_image_format *dst_format) const {
         // Avoid copying matrix coefficients when restricted by color family.
         if (dst_format->matrix_coefficients != ZIMG_MATRIX_RGB && dst_format->matrix_coefficients != ZIMG_MATRIX_YCGCO)
             dst_format->matrix_coefficients = src_format.matrix_coefficients;
@@ -660,32 +998,21 @@ class vszimg {
         try {
             const VSMap *src_props = vsapi->getFramePropertiesRO(src_frame);
             const VSVideoFormat *src_vsformat = vsapi->getVideoFrameFormat(src_frame);
-            const VSVideoFormat *dst_vsformat = (m_vi.format.colorFamily != cfUndefined) ? &m_vi.format : src_vsformat;
-
-            src_format.width = vsapi->getFrameWidth(src_frame, 0);
-            src_format.height = vsapi->getFrameHeight(src_frame, 0);
-            dst_format.width = m_vi.width ? static_cast<unsigned>(m_vi.width) : src_format.width;
-            dst_format.height = m_vi.height ? static_cast<unsigned>(m_vi.height) : src_format.height;
-
-            src_format.active_region.left = m_src_left;
-            src_format.active_region.top = m_src_top;
-            src_format.active_region.width = m_src_width;
-            src_format.active_region.height = m_src_height;
-
-            translate_vsformat(src_vsformat, &src_format, vsapi);
-            translate_vsformat(dst_vsformat, &dst_format, vsapi);
-
+            const vszimg &first = m_folded.empty() ? *this : *m_folded.front();
             bool interlaced = false;
 
-            if (m_prefer_props) {
-                set_src_colorspace(&src_format);
-                import_frame_props(src_props, &src_format, &interlaced, vsapi);
-            } else {
-                import_frame_props(src_props, &src_format, &interlaced, vsapi);
-                set_src_colorspace(&src_format);
+            first.import_source_format(src_frame, src_props, src_vsformat, &src_format, &interlaced, vsapi);
+
+            // Folded resizes only contribute the colorspace they would have output.
+            vszimgxx::zimage_format stage_format = src_format;
+            const VSVideoFormat *stage_vsformat = src_vsformat;
+            for (const auto &stage : m_folded) {
+                vszimgxx::zimage_format next_format;
+                stage_vsformat = stage->export_dst_format(stage_format, stage_vsformat, &next_format, vsapi);
+                stage_format = next_format;
             }
 
-            set_dst_colorspace(src_format, &dst_format);
+            const VSVideoFormat *dst_vsformat = export_dst_format(stage_format, stage_vsformat, &dst_format, vsapi);
 
             if (src_format == dst_format && isSameVideoFormat(src_vsformat, dst_vsformat) && !is_shifted(src_format)) {
                 VSFrame *clone = vsapi->copyFrame(src_frame, core);
@@ -693,14 +1020,37 @@ class vszimg {
                 return clone;
             }
 
-            dst_frame = vsapi->newVideoFrame(dst_vsformat, dst_format.width, dst_format.height, src_frame, core);
+            if (!interlaced && is_chroma_only(src_format, dst_format)) {
+                // luma is shared with the source frame, the chroma planes are resampled on their own
+                const VSFrame *plane_src[3] = { src_frame, nullptr, nullptr };
+                const int planes[3] = { 0, 0, 0 };
+                dst_frame = vsapi->newVideoFrame2(dst_vsformat, dst_format.width, dst_format.height, plane_src, planes, src_frame, core);
+
+                vszimgxx::zimage_format src_plane_format, dst_plane_format;
+                get_chroma_plane_formats(src_format, dst_format, &src_plane_format, &dst_plane_format);
+
+                vszimgxx::zfilter_graph_builder_params params = m_params;
+                params.resample_filter = params.resample_filter_uv;
+                params.filter_param_a = params.filter_param_a_uv;
+                params.filter_param_b = params.filter_param_b_uv;
+                std::shared_ptr<graph_data> graph = get_graph_data(src_plane_format, dst_plane_format, params);
+
+                tmp_buffer tmp{ graph->graph.get_tmp_size(), core, vsapi };
+
+                for (int plane = 1; plane < 3; ++plane) {
+                    auto src_buffer = import_plane_as_buffer_const(src_frame, plane, vsapi);
+                    auto dst_buffer = import_plane_as_buffer(dst_frame, plane, vsapi);
+                    graph->graph.process(src_buffer, dst_buffer, tmp.get());
+                }
+            } else if (interlaced) {
+                dst_frame = vsapi->newVideoFrame(dst_vsformat, dst_format.width, dst_format.height, src_frame, core);
 
-            if (interlaced) {
                 vszimgxx::zimage_format src_format_t = src_format;
                 vszimgxx::zimage_format dst_format_t = dst_format;
 
                 src_format_t.height /= 2;
                 dst_format_t.height /= 2;
+                first.set_active_region(&src_format_t, true);
 
                 src_format_t.field_parity = ZIMG_FIELD_TOP;
                 dst_format_t.field_parity = ZIMG_FIELD_TOP;
@@ -712,32 +1062,36 @@ class vszimg {
                 dst_format_b.field_parity = ZIMG_FIELD_BOTTOM;
                 std::shared_ptr<graph_data> graph_b = get_graph_data(src_format_b, dst_format_b);
 
-                std::unique_ptr<void, decltype(&internal_aligned_free)> tmp{
-                    internal_aligned_malloc<void>(std::max(graph_t->graph.get_tmp_size(), graph_b->graph.get_tmp_size()), 64),
-                    internal_aligned_free
-                };
-                if (!tmp)
-                    throw std::bad_alloc{};
-
                 auto src_buffer = import_frame_as_buffer_const(src_frame, vsapi);
                 auto dst_buffer = import_frame_as_buffer(dst_frame, vsapi);
 
-                auto src_buffer_b = get_field_buffer(src_buffer, src_vsformat->numPlanes, ZIMG_FIELD_BOTTOM);
-                auto dst_buffer_b = get_field_buffer(dst_buffer, dst_vsformat->numPlanes, ZIMG_FIELD_BOTTOM);
-                graph_b->graph.process(src_buffer_b, dst_buffer_b, tmp.get());
-
-                auto src_buffer_t = get_field_buffer(src_buffer, src_vsformat->numPlanes, ZIMG_FIELD_TOP);
-                auto dst_buffer_t = get_field_buffer(dst_buffer, dst_vsformat->numPlanes, ZIMG_FIELD_TOP);
-                graph_t->graph.process(src_buffer_t, dst_buffer_t, tmp.get());
+                // the fields are independent so they're processed in parallel when there are idle threads,
+                // zimg can't split a single graph so progressive frames are always done in one go
+                std::exception_ptr field_error[2];
+                parallelForEach(2, [&](int field) {
+                    try {
+                        const graph_data *graph = field ? graph_t.get() : graph_b.get();
+                        zimg_field_parity_e parity = field ? ZIMG_FIELD_TOP : ZIMG_FIELD_BOTTOM;
+
+                        tmp_buffer tmp{ graph->graph.get_tmp_size(), core, vsapi };
+
+                        auto src_buffer_f = get_field_buffer(src_buffer, src_vsformat->numPlanes, parity);
+                        auto dst_buffer_f = get_field_buffer(dst_buffer, dst_vsformat->numPlanes, parity);
+                        graph->graph.process(src_buffer_f, dst_buffer_f, tmp.get());
+                    } catch (...) {
+                        field_error[field] = std::current_exception();
+                    }
+                }, core, vsapi);
+
+                for (const auto &e : field_error) {
+                    if (e)
+                        std::rethrow_exception(e);
+                }
             } else {
+                dst_frame = vsapi->newVideoFrame(dst_vsformat, dst_format.width, dst_format.height, src_frame, core);
                 std::shared_ptr<graph_data> graph = get_graph_data(src_format, dst_format);
 
-                std::unique_ptr<void, decltype(&internal_aligned_free)> tmp{
-                    internal_aligned_malloc<void>(graph->graph.get_tmp_size(), 64),
-                    internal_aligned_free
-                };
-                if (!tmp)
-                    throw std::bad_alloc{};
+                tmp_buffer tmp{ graph->graph.get_tmp_size(), core, vsapi };
 
                 auto src_buffer = import_frame_as_buffer_const(src_frame, vsapi);
                 auto dst_buffer = import_frame_as_buffer(dst_frame, vsapi);
@@ -745,7 +1099,12 @@ class vszimg {
             }
 
             VSMap *dst_props = vsapi->getFramePropertiesRW(dst_frame);
-            propagate_sar(src_props, dst_props, src_format, dst_format, vsapi);
+            vszimgxx::zimage_format sar_format = src_format;
+            if (first.m_crop_width) {
+                sar_format.width = first.m_crop_width;
+                sar_format.height = first.m_crop_height;
+            }
+            propagate_sar(src_props, dst_props, sar_format, dst_format, vsapi);
             export_frame_props(dst_format, dst_props, vsapi);
         } catch (const vszimgxx::zerror &e) {
             vsapi->freeFrame(dst_frame);
@@ -902,4 +1261,7 @@ void resizeInitialize(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->registerFunction("Spline16", FORMAT_DEFINITION, RETURN_FORMAT_DEFINITION, vszimg_create, (void *)ZIMG_RESIZE_SPLINE16, plugin);
     vspapi->registerFunction("Spline36", FORMAT_DEFINITION, RETURN_FORMAT_DEFINITION, vszimg_create, (void *)ZIMG_RESIZE_SPLINE36, plugin);
     vspapi->registerFunction("Spline64", FORMAT_DEFINITION, RETURN_FORMAT_DEFINITION, vszimg_create, (void *)ZIMG_RESIZE_SPLINE64, plugin);
+
+    for (const char *name : { "Bilinear", "Bicubic", "Point", "Lanczos", "Spline16", "Spline36", "Spline64" })
+        vspapi->setFunctionFlags(name, pffDeterministic | pffProxyScalable, plugin);
 }
@@ -21,18 +21,70 @@
 #include "vscore.h"
 #include <cassert>
 #include <bitset>
+#include <unordered_set>
 #ifdef VS_TARGET_CPU_X86
 #include "x86utils.h"
 #endif
 
 #if defined(HAVE_SCHED_GETAFFINITY)
 #include <sched.h>
+#include <pthread.h>
+#include <cstdio>
 #elif defined(HAVE_CPUSET_GETAFFINITY)
 #include <sys/param.h>
 #include <sys/_cpuset.h>
 #include <sys/cpuset.h>
 #endif
 
+thread_local VSThreadPool *VSThreadPool::currentPool = nullptr;
+thread_local size_t VSThreadPool::currentQueue = 0;
+thread_local VSThreadPool::WakeBatch *VSThreadPool::currentWakeBatch = nullptr;
+
+// Counts the wake ups of the tasks queued by this thread until it's flushed or destroyed, both have to
+// happen with taskLock held. Batches nest when a callback ends up running tasks itself.
+class VSThreadPool::WakeBatch {
+private:
+    VSThreadPool *pool;
+    WakeBatch *prev;
+    size_t count = 0;
+    bool active;
+public:
+    explicit WakeBatch(VSThreadPool *pool) : pool(pool), prev(currentWakeBatch), active(pool->batchWakeups) {
+        if (active)
+            currentWakeBatch = this;
+    }
+
+    static bool add(VSThreadPool *pool) {
+        if (!currentWakeBatch || currentWakeBatch->pool != pool)
+            return false;
+        currentWakeBatch->count++;
+        return true;
+    }
+
+    static void flush(VSThreadPool *pool) {
+        if (currentWakeBatch && currentWakeBatch->pool == pool && currentWakeBatch->count) {
+            size_t n = currentWakeBatch->count;
+            currentWakeBatch->count = 0;
+            pool->wakeThreads(n);
+        }
+    }
+
+    ~WakeBatch() {
+        if (active) {
+            flush(pool);
+            currentWakeBatch = prev;
+        }
+    }
+};
+
+static inline void cpuRelax() {
+#ifdef VS_TARGET_CPU_X86
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
 size_t VSThreadPool::getNumAvailableThreads() {
     size_t nthreads = std::thread::hardware_concurrency();
 #ifdef _WIN32
@@ -58,216 +110,814 @@ size_t VSThreadPool::getNumAvailableThreads() {
     return nthreads;
 }
 
-bool VSThreadPool::taskCmp(const PVSFrameContext &a, const PVSFrameContext &b) {
-    return (a->reqOrder < b->reqOrder) || (a->reqOrder == b->reqOrder && a->key.second < b->key.second);
+#if defined(HAVE_SCHED_GETAFFINITY)
+// cpulist has the format "0-15,32-47"
+static bool readCpuList(const std::string &path, std::vector<int> &cpus) {
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f)
+        return false;
+    int first, last;
+    while (fscanf(f, "%d", &first) == 1) {
+        last = first;
+        int c = fgetc(f);
+        if (c == '-') {
+            if (fscanf(f, "%d", &last) != 1)
+                break;
+            c = fgetc(f);
+        }
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+        if (c != ',')
+            break;
+    }
+    fclose(f);
+    return true;
 }
 
-void VSThreadPool::runTasksWrapper(VSThreadPool *owner, std::atomic<bool> &stop) {
-    owner->runTasks(stop);
+static int readCpuValue(int cpu, const char *file) {
+    FILE *f = fopen(("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/" + file).c_str(), "r");
+    if (!f)
+        return -1;
+    int value = -1;
+    if (fscanf(f, "%d", &value) != 1)
+        value = -1;
+    fclose(f);
+    return value;
 }
+#endif
 
-void VSThreadPool::runTasks(std::atomic<bool> &stop) {
-#ifdef VS_TARGET_OS_WINDOWS
-    if (!vs_isSSEStateOk())
-        core->logFatal("Bad SSE state detected after creating new thread");
+std::vector<std::vector<int>> VSThreadPool::getNumaNodes() {
+    std::vector<std::vector<int>> nodes;
+#ifdef _WIN32
+    ULONG highestNode = 0;
+    if (GetNumaHighestNodeNumber(&highestNode)) {
+        for (ULONG i = 0; i <= highestNode; i++) {
+            ULONGLONG mask = 0;
+            if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(i), &mask) || !mask)
+                continue;
+            std::vector<int> cpus;
+            for (int cpu = 0; cpu < 64; cpu++)
+                if (mask & (static_cast<ULONGLONG>(1) << cpu))
+                    cpus.push_back(cpu);
+            nodes.push_back(cpus);
+        }
+    }
+#elif defined(HAVE_SCHED_GETAFFINITY)
+    for (int i = 0; ; i++) {
+        std::vector<int> cpus;
+        if (!readCpuList("/sys/devices/system/node/node" + std::to_string(i) + "/cpulist", cpus))
+            break;
+        if (!cpus.empty())
+            nodes.push_back(cpus);
+    }
 #endif
+    return nodes;
+}
 
-    std::unique_lock<std::mutex> lock(taskLock);
+// Returns the usable cpus in the order workers should be placed on them together with whether
+// it's an E-core or an SMT sibling of a core that already got a worker. The first thread of
+// every P-core comes first, then the E-cores and last the remaining SMT siblings. Returns
+// nothing when all cpus are equal since there's nothing to gain from pinning then.
+std::vector<std::pair<int, bool>> VSThreadPool::getCpuTopology() {
+    // 0 = first thread of a fast core, 1 = E-core, 2 = SMT sibling, 3 = SMT sibling on an E-core
+    std::vector<std::pair<int, int>> ranked;
+#ifdef _WIN32
+    DWORD_PTR pAff = 0;
+    DWORD_PTR sAff = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &pAff, &sAff))
+        return {};
+    DWORD length = 0;
+    GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+    std::vector<uint8_t> buffer(length);
+    if (!length || !GetLogicalProcessorInformationEx(RelationProcessorCore, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data()), &length))
+        return {};
+
+    // a higher efficiency class means a faster core, all are 0 on cpus that aren't hybrid
+    int maxClass = 0;
+    for (DWORD offset = 0; offset < length; ) {
+        auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data() + offset);
+        maxClass = std::max<int>(maxClass, info->Processor.EfficiencyClass);
+        offset += info->Size;
+    }
+    for (DWORD offset = 0; offset < length; ) {
+        auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data() + offset);
+        offset += info->Size;
+        // like the NUMA code only the first processor group is supported
+        if (info->Processor.GroupCount < 1 || info->Processor.GroupMask[0].Group != 0)
+            continue;
+        bool efficient = info->Processor.EfficiencyClass < maxClass;
+        bool first = true;
+        for (int cpu = 0; cpu < static_cast<int>(sizeof(pAff) * 8); cpu++) {
+            if (!(info->Processor.GroupMask[0].Mask & (static_cast<KAFFINITY>(1) << cpu)) || !(pAff & (static_cast<DWORD_PTR>(1) << cpu)))
+                continue;
+            ranked.push_back(std::make_pair(cpu, (first ? 0 : 2) + efficient));
+            first = false;
+        }
+    }
+#elif defined(HAVE_SCHED_GETAFFINITY)
+    cpu_set_t affinity;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &affinity) != 0)
+        return {};
+
+    // hybrid Intel cpus list the E-cores separately, other big.LITTLE designs only report a lower capacity
+    std::vector<int> atomCpus;
+    readCpuList("/sys/devices/cpu_atom/cpus", atomCpus);
+    std::unordered_set<int> efficientCpus(atomCpus.begin(), atomCpus.end());
+    if (efficientCpus.empty()) {
+        std::vector<std::pair<int, int>> capacities;
+        int maxCapacity = -1;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &affinity))
+                continue;
+            int capacity = readCpuValue(cpu, "cpu_capacity");
+            capacities.push_back(std::make_pair(cpu, capacity));
+            maxCapacity = std::max(maxCapacity, capacity);
+        }
+        for (const auto &iter : capacities)
+            if (iter.second >= 0 && iter.second < maxCapacity)
+                efficientCpus.insert(iter.first);
+    }
 
-    while (true) {
-        bool ranTask = false;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &affinity))
+            continue;
+        std::vector<int> siblings;
+        readCpuList("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list", siblings);
+        // the lowest usable sibling is the one counted as the core's first thread
+        bool first = true;
+        for (int sibling : siblings) {
+            if (sibling < cpu && sibling < CPU_SETSIZE && CPU_ISSET(sibling, &affinity)) {
+                first = false;
+                break;
+            }
+        }
+        ranked.push_back(std::make_pair(cpu, (first ? 0 : 2) + !!efficientCpus.count(cpu)));
+    }
+#endif
 
-/////////////////////////////////////////////////////////////////////////////////////////////
-// Go through all tasks from the top (oldest) and process the first one possible
+    bool allEqual = std::all_of(ranked.begin(), ranked.end(), [&](const std::pair<int, int> &v) { return v.second == ranked.front().second; });
+    if (ranked.size() < 2 || allEqual)
+        return {};
+
+    std::stable_sort(ranked.begin(), ranked.end(), [](const std::pair<int, int> &a, const std::pair<int, int> &b) { return a.second < b.second; });
+    std::vector<std::pair<int, bool>> result;
+    for (const auto &iter : ranked)
+        result.push_back(std::make_pair(iter.first, iter.second > 0));
+    return result;
+}
 
-        std::set<VSNode *> seenNodes;
+size_t VSThreadPool::numaNodeCount() const {
+    return std::max<size_t>(numaNodeCpus.size(), 1);
+}
 
-        for (auto iter = tasks.begin(); iter != tasks.end(); ++iter) {
-            VSFrameContext *frameContext = iter->get();
-            VSNode *node = frameContext->key.first;
+void VSThreadPool::runTasksWrapper(VSThreadPool *owner, size_t queueIndex, std::atomic<bool> &stop) {
+    owner->runTasks(queueIndex, stop);
+}
+
+// timestamps for the node statistics, only taken with graph inspection enabled
+static inline int64_t statsClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline void recordTaken(VSFrameContext *frameContext, VSNode *node) {
+    if (frameContext->queuedTime || frameContext->serialWaitStart) {
+        int64_t now = statsClock();
+        if (frameContext->queuedTime)
+            node->addQueueWait(now - frameContext->queuedTime);
+        if (frameContext->serialWaitStart)
+            node->addSerialWait(now - frameContext->serialWaitStart);
+        frameContext->queuedTime = 0;
+        frameContext->serialWaitStart = 0;
+    }
+}
+
+// the nodes whose serial lock is held by filters further up the calling thread's stack,
+// only a thread that helps with a synchronous request can get here again while holding one
+static thread_local std::vector<VSNode *> heldSerialLocks;
+
+bool VSThreadPool::takeTask(size_t queueIndex, size_t waitId, PVSFrameContext &task, PVSFrame &cached, bool &useSerialLock, bool &useConcurrencyLimit) {
+    // reused between scans to avoid allocating every time a worker looks for something to do
+    thread_local std::unordered_set<VSNode *> seenNodes;
+    // the nodes whose tasks were blocked during this scan and the release epoch seen at the time
+    thread_local std::unordered_map<VSNode *, size_t> blockedNodes;
+
+    // 1 for heavy filters that should run on the fastest cores, -1 for light and speculative work
+    // that E-cores and SMT siblings do just as well
+    auto placementClass = [](const VSFrameContext *frameContext, const VSNode *node) {
+        if (frameContext->reqOrder >= std::numeric_limits<uint64_t>::max() / 2 || node->costHint == fcCheap)
+            return -1;
+        if (node->costHint == fcExpensive && (node->filterMode == fmParallel || node->filterMode == fmParallelRequests))
+            return 1;
+        return 0;
+    };
 
 /////////////////////////////////////////////////////////////////////////////////////////////
-// Fast path if a frame is cached
+// Go through the worker's own queue first and then steal from the others, in each queue
+// tasks are checked from the top (oldest) and the first one possible is removed. A thread
+// waiting for a synchronous request only takes the tasks that were started for it.
+// With a mixed topology the first pass skips the work better suited to the other kind of
+// worker, the second pass only happens if something was skipped and takes anything.
+// Tasks that can't get their node's serial lock or a concurrency slot are moved to the node's
+// blocked set, together with the node's other tasks found later in the same scan.
+
+    int avoidClass = secondaryQueues.empty() ? 0 : (secondaryQueues[queueIndex] ? 1 : -1);
+    bool skipped = false;
+
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            if (!skipped)
+                break;
+            avoidClass = 0;
+        }
+        seenNodes.clear();
+        blockedNodes.clear();
 
-            if (node->cacheEnabled) {
-                PVSFrame f = node->getCachedFrameInternal(frameContext->key.second);
+        for (size_t i : queueScanOrder[queueIndex]) {
+            TaskQueue &queue = *queues[i];
+            if (queue.numTasks == 0)
+                continue;
 
-                if (f) {                    
-                    bool needsSort = false;
+            std::lock_guard<std::mutex> lock(queue.lock);
 
-                    for (size_t i = 0; i < frameContext->notifyCtxList.size(); i++) {
-                        PVSFrameContext &notify = frameContext->notifyCtxList[i];
-                        notify->availableFrames.push_back({frameContext->key, f});
+            for (auto next = queue.tasks.begin(); next != queue.tasks.end();) {
+                auto iter = next++;
+                VSFrameContext *frameContext = iter->second.get();
+                VSNode *node = frameContext->key.first;
 
-                        assert(notify->numFrameRequests > 0);
-                        if (--notify->numFrameRequests == 0) {
-                            queueTask(notify);
-                            needsSort = true;
-                        }
-                    }
+                if (waitId && frameContext->waitId != waitId)
+                    continue;
 
-                    PVSFrameContext mainContextRef = std::move(*iter);
-                    tasks.erase(iter);
-                    allContexts.erase(frameContext->key);
+                if (avoidClass && placementClass(frameContext, node) == avoidClass) {
+                    skipped = true;
+                    continue;
+                }
 
-                    if (frameContext->external)
-                        returnFrame(frameContext, f);
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Fast path if a frame is cached
 
-                    if (needsSort)
-                        tasks.sort(taskCmp);
+                if (node->cacheEnabled) {
+                    cached = node->getCachedFrameInternal(frameContext->key.second);
 
-                    ranTask = true;
-                    break;
+                    if (cached) {
+                        recordTaken(frameContext, node);
+                        task = std::move(iter->second);
+                        queue.tasks.erase(iter);
+                        --queue.numTasks;
+                        return true;
+                    }
                 }
-            }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // This part handles the locking for the different filter modes
 
-            int filterMode = node->filterMode;
+                int filterMode = node->filterMode;
 
-            // Don't try to lock the same node twice since it's likely to fail and will produce more out of order requests as well
-            if (filterMode != fmFrameState && !seenNodes.insert(node).second)
-                continue;
+                // Don't try to lock the same node twice since it's likely to fail and will produce more out of order requests as well
+                if (filterMode != fmFrameState && !seenNodes.insert(node).second) {
+                    auto blocked = blockedNodes.find(node);
+                    if (blocked != blockedNodes.end())
+                        blockTask(queue, iter, blocked->second);
+                    continue;
+                }
 
-            // Does the filter need the per instance mutex? fmFrameState, fmUnordered and fmParallelRequests (when in the arAllFramesReady state) use this
-            bool useSerialLock = (filterMode == fmFrameState || filterMode == fmUnordered || (filterMode == fmParallelRequests && !frameContext->first));
+                size_t epoch = node->releaseEpoch;
+
+                // Does the filter need the per instance mutex? fmFrameState, fmUnordered and fmParallelRequests (when in the arAllFramesReady state) use this
+                useSerialLock = (filterMode == fmFrameState || filterMode == fmUnordered || (filterMode == fmParallelRequests && !frameContext->first));
+
+                // Is the number of threads running it limited? Only checked for the parallel modes.
+                int maxConcurrency = node->maxConcurrency;
+                useConcurrencyLimit = (maxConcurrency > 0 && !useSerialLock);
+                if (useConcurrencyLimit) {
+                    int current = node->concurrency;
+                    do {
+                        if (current >= maxConcurrency)
+                            break;
+                    } while (!node->concurrency.compare_exchange_weak(current, current + 1));
+                    if (current >= maxConcurrency) {
+                        if (blockTask(queue, iter, epoch))
+                            blockedNodes[node] = epoch;
+                        continue;
+                    }
+                }
 
-            if (useSerialLock) {
-                if (!node->serialMutex.try_lock())
-                    continue;
-                if (filterMode == fmFrameState) {
-                    if (node->serialFrame == -1) {
-                        node->serialFrame = frameContext->key.second;
-                        // another frame already in progress?
-                    } else if (node->serialFrame != frameContext->key.second) {
-                        node->serialMutex.unlock();
+                if (useSerialLock) {
+                    if (!heldSerialLocks.empty() && std::find(heldSerialLocks.begin(), heldSerialLocks.end(), node) != heldSerialLocks.end())
+                        continue;
+                    if (!node->serialMutex.try_lock()) {
+                        if (frameContext->queuedTime && !frameContext->serialWaitStart)
+                            frameContext->serialWaitStart = statsClock();
+                        if (blockTask(queue, iter, epoch))
+                            blockedNodes[node] = epoch;
                         continue;
                     }
+                    if (filterMode == fmFrameState) {
+                        if (node->serialFrame == -1) {
+                            node->serialFrame = frameContext->key.second;
+                            // another frame already in progress?
+                        } else if (node->serialFrame != frameContext->key.second) {
+                            node->serialMutex.unlock();
+                            if (frameContext->queuedTime && !frameContext->serialWaitStart)
+                                frameContext->serialWaitStart = statsClock();
+                            blockTask(queue, iter, epoch);
+                            continue;
+                        }
+                    }
+                }
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Seek sensitive sources continue at the current decoder position when possible, otherwise
+// with the closest frame after it and only wrap around to the lowest pending frame when
+// nothing is left ahead, so a batch of requests is decoded in a single forward pass
+
+                if (node->seekSensitive && filterMode == fmUnordered) {
+                    int64_t pos = node->seekPosition;
+                    auto distance = [pos](int n) { return (n >= pos) ? n - pos : (static_cast<int64_t>(1) << 32) + n; };
+                    auto best = iter;
+                    for (auto it = std::next(iter); it != queue.tasks.end(); ++it) {
+                        const VSFrameContext *candidate = it->second.get();
+                        if (candidate->key.first != node || (waitId && candidate->waitId != waitId))
+                            continue;
+                        if (distance(candidate->key.second) < distance(best->second->key.second) && !(node->cacheEnabled && node->isFrameCached(candidate->key.second)))
+                            best = it;
+                    }
+                    iter = best;
+                    frameContext = iter->second.get();
+                    node->seekPosition = frameContext->key.second + 1;
                 }
-            }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
-// Remove the context from the task list and keep references around until processing is done
+// Remove the context from the queue and keep references around until processing is done
+
+                recordTaken(frameContext, node);
+                task = std::move(iter->second);
+                queue.tasks.erase(iter);
+                --queue.numTasks;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// Moves a task out of its queue into the blocked set of its node, unless the node was released since the
+// attempt to run it. Then the releasing thread may already have requeued the blocked tasks and this one
+// would wait for the next release, so it stays where it is.
+bool VSThreadPool::blockTask(TaskQueue &queue, std::multimap<TaskOrder, PVSFrameContext>::iterator iter, size_t epoch) {
+    VSNode *node = iter->second->key.first;
+    std::lock_guard<std::mutex> lock(node->blockedLock);
+    if (node->releaseEpoch != epoch)
+        return false;
+    node->blockedTasks.push_back(std::move(iter->second));
+    queue.tasks.erase(iter);
+    --queue.numTasks;
+    ++numBlocked;
+    return true;
+}
+
+// Called with taskLock held after the node's serial lock or a concurrency slot was released
+void VSThreadPool::requeueBlocked(VSNode *node) {
+    std::vector<PVSFrameContext> tasks;
+    {
+        std::lock_guard<std::mutex> lock(node->blockedLock);
+        tasks.swap(node->blockedTasks);
+    }
+    numBlocked -= tasks.size();
+    for (const auto &iter : tasks)
+        queueTask(iter);
+}
+
+// External requests with an error were never registered so only the context itself is removed
+void VSThreadPool::eraseContext(const PVSFrameContext &ctx) {
+    auto &inFlight = ctx->key.first->inFlight;
+    auto it = inFlight.find(ctx->key.second);
+    if (it != inFlight.end() && it->second.get() == ctx.get())
+        inFlight.erase(it);
+}
+
+VSFrameContext *VSThreadPool::findContext(NodeOutputKey key) {
+    auto &inFlight = key.first->inFlight;
+    auto it = inFlight.find(key.second);
+    return (it != inFlight.end()) ? it->second.get() : nullptr;
+}
+
+void VSThreadPool::addContext(const PVSFrameContext &ctx) {
+    ctx->key.first->inFlight.insert(std::make_pair(ctx->key.second, ctx));
+}
+
+void VSThreadPool::notifyDependents(const PVSFrameContext &ctx, const PVSFrame &f) {
+    for (size_t i = 0; i < ctx->notifyCtxList.size(); i++) {
+        PVSFrameContext &notify = ctx->notifyCtxList[i];
+
+        // an external request for a frame that was already being produced for something else
+        if (notify->external && notify->key == ctx->key) {
+            if (ctx->hasError())
+                notify->setError(ctx->getErrorMessage());
+            returnFrame(notify.get(), f);
+            continue;
+        }
+
+        if (ctx->hasError())
+            notify->setError(ctx->getErrorMessage());
+        else
+            notify->availableFrames.push_back({ctx->key, f});
+
+        assert(notify->numFrameRequests > 0);
+        if (--notify->numFrameRequests == 0)
+            queueTask(notify);
+    }
+
+    if (ctx->external) {
+        if (adaptive)
+            adaptThreadCount();
+        returnFrame(ctx.get(), f);
+    }
+}
 
-            PVSFrameContext frameContextRef = std::move(*iter);
-            tasks.erase(iter);
+// Hill climbing on the output frame rate, the thread target keeps moving in the same direction
+// as long as the rate improves and turns around when it drops.
+// Called with taskLock held every time a frame is returned to the user.
+void VSThreadPool::adaptThreadCount() {
+    auto now = std::chrono::steady_clock::now();
+    if (adaptFrames++ == 0) {
+        adaptStart = now;
+        return;
+    }
+
+    // measure over enough frames and time to not react to noise
+    std::chrono::duration<double> elapsed = now - adaptStart;
+    if (elapsed.count() < 0.5 || adaptFrames < static_cast<int64_t>(maxThreads))
+        return;
+
+    double rate = adaptFrames / elapsed.count();
+    if (rate < adaptLastRate * 0.98)
+        adaptDirection = -adaptDirection;
+    adaptLastRate = rate;
+    adaptFrames = 0;
+
+    size_t step = std::max<size_t>(maxThreads / 8, 1);
+    size_t target = targetThreads;
+    if (adaptDirection < 0)
+        target = (target > step) ? target - step : 1;
+    else
+        target = std::min<size_t>(target + step, maxThreads);
+
+    if (target != targetThreads) {
+        if (target > targetThreads)
+            newWork.notify_all();
+        targetThreads = target;
+        core->logMessage(mtDebug, "Adaptive thread count changed to " + std::to_string(target) + " at " + std::to_string(rate) + " fps");
+    }
+}
+
+// Takes one task and runs it, returns false if there was nothing that could be run
+bool VSThreadPool::runTask(size_t queueIndex, size_t waitId) {
+    PVSFrameContext frameContextRef;
+    PVSFrame f;
+    bool useSerialLock = false;
+    bool useConcurrencyLimit = false;
+
+    if (!takeTask(queueIndex, waitId, frameContextRef, f, useSerialLock, useConcurrencyLimit))
+        return false;
+
+    VSFrameContext *frameContext = frameContextRef.get();
+    VSNode *node = frameContext->key.first;
+
+    if (f) {
+        if (core->tracer)
+            core->tracer->addEvent("cache", node->name, core->tracer->now(), -1, frameContext->key.second);
+        std::lock_guard<std::mutex> lock(taskLock);
+        WakeBatch batch(this);
+        eraseContext(frameContextRef);
+        notifyDependents(frameContextRef, f);
+        return true;
+    }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Figure out the activation reason
 
-            assert(frameContext->numFrameRequests == 0);
-            int ar = arInitial;
-            if (frameContext->hasError()) {
-                ar = arError;
-            } else if (!frameContext->first) {
-                ar = (node->apiMajor == 3) ? static_cast<int>(vs3::arAllFramesReady) : static_cast<int>(arAllFramesReady);
-            } else if (frameContext->first) {
-                frameContext->first = false;
-            }
+    // work that only cancelled requests are waiting for is failed without calling the filter,
+    // filters that already started still get an arError call so they can clean up
+    bool skipFilter = false;
+    if (numCancelled > 0 && !frameContext->hasError()) {
+        std::lock_guard<std::mutex> lock(taskLock);
+        std::unordered_map<const VSFrameContext *, bool> visited;
+        if (isAbandoned(frameContext, visited)) {
+            frameContext->setError("Frame request cancelled");
+            skipFilter = frameContext->first;
+        }
+    }
+
+    assert(frameContext->numFrameRequests == 0);
+    int ar = arInitial;
+    const char *traceReason = "initial";
+    if (frameContext->hasError()) {
+        ar = arError;
+        traceReason = "error";
+    } else if (!frameContext->first) {
+        ar = (node->apiMajor == 3) ? static_cast<int>(vs3::arAllFramesReady) : static_cast<int>(arAllFramesReady);
+        traceReason = "allFramesReady";
+    } else if (frameContext->first) {
+        frameContext->first = false;
+    }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Do the actual processing
 
-            lock.unlock();
+    int64_t traceStart = core->tracer ? core->tracer->now() : 0;
+
+    if (!skipFilter) {
+        // a filter waiting in getFrame further up the stack may still use its placement afterwards
+        VSFrameContext *prevPlacement = VSFrameContext::currentPlacement;
+        if (useSerialLock)
+            heldSerialLocks.push_back(node);
+        VSFrameContext::currentPlacement = frameContext->placement.target ? frameContext : nullptr;
+        f = node->getFrameInternal(frameContext->key.second, ar, frameContext);
+        VSFrameContext::currentPlacement = prevPlacement;
+        if (useSerialLock)
+            heldSerialLocks.pop_back();
+    }
 
-            PVSFrame f = node->getFrameInternal(frameContext->key.second, ar, frameContext);
-            ranTask = true;
+    if (core->tracer) {
+        // the first context waiting for the frame is what caused it to be requested
+        if (frameContext->external)
+            core->tracer->addEvent("filter", node->name, traceStart, core->tracer->now() - traceStart, frameContext->key.second, traceReason, "output");
+        else if (frameContext->notifyCtxList.size() > 0)
+            core->tracer->addEvent("filter", node->name, traceStart, core->tracer->now() - traceStart, frameContext->key.second, traceReason, frameContext->notifyCtxList[0]->key.first->name, frameContext->notifyCtxList[0]->key.second);
+        else
+            core->tracer->addEvent("filter", node->name, traceStart, core->tracer->now() - traceStart, frameContext->key.second, traceReason);
+    }
 
-            bool frameProcessingDone = f || frameContext->hasError();
-            if (frameContext->hasError() && f)
-                core->logFatal("A frame was returned by " + node->name + " but an error was also set, this is not allowed");
+    bool frameProcessingDone = f || frameContext->hasError();
+    if (frameContext->hasError() && f)
+        core->logFatal("A frame was returned by " + node->name + " but an error was also set, this is not allowed");
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Unlock so the next job can run on the context
-            if (useSerialLock) {
-                if (frameProcessingDone && filterMode == fmFrameState)
-                    node->serialFrame = -1;
-                node->serialMutex.unlock();
-            }
+    if (useSerialLock) {
+        if (frameProcessingDone && node->filterMode == fmFrameState)
+            node->serialFrame = -1;
+        node->serialMutex.unlock();
+    }
+    if (useConcurrencyLimit)
+        --node->concurrency;
+    if (useSerialLock || useConcurrencyLimit)
+        ++node->releaseEpoch;
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Handle frames that were requested
-            bool requestedFrames = frameContext->reqList.size() > 0 && !frameProcessingDone;
-            bool needsSort = false;
-            if (f && requestedFrames)
-                core->logFatal("A frame was returned at the end of processing by " + node->name + " but there are still outstanding requests");
+    bool requestedFrames = (frameContext->reqList.size() > 0 || frameContext->windowFrames) && !frameProcessingDone;
+    frameContext->windowFrames = false;
+    if (f && requestedFrames)
+        core->logFatal("A frame was returned at the end of processing by " + node->name + " but there are still outstanding requests");
 
-            lock.lock();
+    std::lock_guard<std::mutex> lock(taskLock);
+    WakeBatch batch(this);
 
-            if (requestedFrames) {
-                assert(frameContext->numFrameRequests == 0);
+    if (useSerialLock || useConcurrencyLimit)
+        requeueBlocked(node);
 
-                for (size_t i = 0; i < frameContext->reqList.size(); i++)
-                    startInternalRequest(frameContextRef, frameContext->reqList[i]);
+    if (requestedFrames) {
+        assert(frameContext->numFrameRequests == 0);
 
-                frameContext->numFrameRequests = frameContext->reqList.size();
-                frameContext->reqList.clear();
-            }
+        if (frameContext->reqList.size() > node->getRequestCapacity())
+            node->raiseRequestCapacity(frameContext->reqList.size());
+
+        frameContext->numFrameRequests = startInternalRequests(frameContextRef);
+        frameContext->reqList.clear();
+        frameContext->placements.clear();
+        frameContext->regions.clear();
+
+        // everything requested was already cached so the filter can continue right away
+        if (frameContext->numFrameRequests == 0)
+            queueTask(frameContextRef);
+    }
 
-            if (frameProcessingDone)
-                allContexts.erase(frameContext->key);
+    if (frameProcessingDone)
+        eraseContext(frameContextRef);
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Notify all dependent contexts
 
-            if (frameContext->hasError()) {
-                for (size_t i = 0; i < frameContextRef->notifyCtxList.size(); i++) {
-                    PVSFrameContext &notify = frameContextRef->notifyCtxList[i];
-                    notify->setError(frameContextRef->getErrorMessage());
+    if (frameProcessingDone) {
+        notifyDependents(frameContextRef, f);
+    } else if (requestedFrames) {
+        // already scheduled, do nothing
+    } else {
+        core->logFatal("No frame returned at the end of processing by " + node->name);
+    }
+    return true;
+}
 
-                    assert(notify->numFrameRequests > 0);
-                    if (--notify->numFrameRequests == 0) {
-                        queueTask(notify);
-                        needsSort = true;
-                    }
-                }
+void VSThreadPool::runTasks(size_t queueIndex, std::atomic<bool> &stop) {
+#ifdef VS_TARGET_OS_WINDOWS
+    if (!vs_isSSEStateOk())
+        core->logFatal("Bad SSE state detected after creating new thread");
+#endif
 
-                if (frameContext->external)
-                    returnFrame(frameContext, f);
-            } else if (f) {
-                for (size_t i = 0; i < frameContextRef->notifyCtxList.size(); i++) {
-                    PVSFrameContext &notify = frameContextRef->notifyCtxList[i];
-                    notify->availableFrames.push_back({frameContextRef->key, f});
-
-                    assert(notify->numFrameRequests > 0);
-                    if (--notify->numFrameRequests == 0) {
-                        queueTask(notify);
-                        needsSort = true;
-                    }
-                }
+    currentPool = this;
+    currentQueue = queueIndex;
+    MemoryUse::currentNode = static_cast<unsigned>(queueIndex % numaNodeCount());
+    int64_t spinTime = maxSpinTime;
 
-                if (frameContext->external)
-                    returnFrame(frameContext, f);
-            } else if (requestedFrames) {
-                // already scheduled, do nothing
-            } else {
-                core->logFatal("No frame returned at the end of processing by " + node->name);
-            }
+    while (true) {
+        size_t epoch = workEpoch;
+
+        if (numParallelJobs > 0 && activeThreads <= threadLimit() && helpParallelJobs())
+            continue;
+
+        if (activeThreads <= threadLimit() && runTask(queueIndex, 0))
+            continue;
 
-            if (needsSort)
-                tasks.sort(taskCmp);
+        int64_t maxSpin = maxSpinTime;
+        if (maxSpin > 0 && activeThreads <= threadLimit() && spinForWork(epoch, stop, maxSpin, spinTime))
+            continue;
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Nothing could run, sleep unless new work was queued while the queues were being scanned
+
+        std::unique_lock<std::mutex> lock(taskLock);
+        --activeThreads;
+        if (stop)
             break;
+
+        if (workEpoch != epoch && activeThreads < threadLimit()) {
+            ++activeThreads;
+            continue;
         }
 
-        if (!ranTask || activeThreads > maxThreads) {
-            --activeThreads;
-            if (stop) {
-                lock.unlock();
-                break;
-            }
-            if (++idleThreads == allThreads.size())
-                allIdle.notify_one();
+        if (++idleThreads == allThreads.size())
+            allIdle.notify_one();
 
-            newWork.wait(lock);
-            --idleThreads;
-            ++activeThreads;
+        // the other cores sharing the threads can use this one's share now
+        if (sharedShare && activeThreads == 0)
+            VSSharedBudget::instance().updateShares();
+
+        int64_t idleStart = core->tracer ? core->tracer->now() : 0;
+        newWork.wait(lock);
+        if (core->tracer)
+            core->tracer->addEvent("scheduler", "idle", idleStart, core->tracer->now() - idleStart);
+        --idleThreads;
+        ++activeThreads;
+    }
+}
+
+// Waits for new work without giving up the cpu, returns true if something was queued in the meantime. The
+// time spent is doubled every time spinning paid off and halved every time the thread had to park afterwards
+// anyway, so pipelines where dependent tasks follow each other closely skip the wake up latency while
+// threads that have nothing to do soon stop wasting cpu time.
+bool VSThreadPool::spinForWork(size_t epoch, const std::atomic<bool> &stop, int64_t maxSpin, int64_t &spinTime) {
+    spinTime = std::min(std::max(spinTime, maxSpin / 16), maxSpin);
+    auto start = std::chrono::steady_clock::now();
+    bool found = false;
+
+    ++spinningThreads;
+    while (!stop) {
+        if (workEpoch != epoch) {
+            found = true;
+            break;
         }
+        for (int i = 0; i < 16; i++)
+            cpuRelax();
+        if (std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() >= spinTime)
+            break;
+    }
+    // a thread that queued work may already have taken this one out of the count
+    size_t spinning = spinningThreads;
+    while (spinning > 0 && !spinningThreads.compare_exchange_weak(spinning, spinning - 1)) {}
+
+    spinTime = found ? std::min(spinTime * 2, maxSpin) : std::max(spinTime / 2, maxSpin / 16);
+    return found;
+}
+
+bool VSThreadPool::claimSpinningThread() {
+    size_t spinning = spinningThreads;
+    while (spinning > 0) {
+        if (spinningThreads.compare_exchange_weak(spinning, spinning - 1))
+            return true;
+    }
+    return false;
+}
+
+VSSharedBudget &VSSharedBudget::instance() {
+    static VSSharedBudget budget;
+    return budget;
+}
+
+void VSSharedBudget::attach(VSThreadPool *pool) {
+    {
+        std::lock_guard<std::mutex> l(lock);
+        pools.push_back(pool);
     }
+    updateShares();
 }
 
-VSThreadPool::VSThreadPool(VSCore *core) : core(core), activeThreads(0), idleThreads(0), reqCounter(0), stopThreads(false), ticks(0), nextAdjTicks(50) {
+void VSSharedBudget::detach(VSThreadPool *pool) {
+    {
+        std::lock_guard<std::mutex> l(lock);
+        pools.erase(std::find(pools.begin(), pools.end(), pool));
+    }
+    updateShares();
+}
+
+void VSSharedBudget::setLimits(int threads, int64_t memoryBytes) {
+    this->threads = threads > 0 ? threads : 0;
+    memoryLimit = (memoryBytes > 0 && static_cast<uint64_t>(memoryBytes) <= SIZE_MAX) ? static_cast<size_t>(memoryBytes) : std::numeric_limits<size_t>::max();
+    updateShares();
+}
+
+// Every core with work gets an equal part of the threads, an idle core gets the part it would have
+// if it had work so it can start right away.
+void VSSharedBudget::updateShares() {
+    std::lock_guard<std::mutex> l(lock);
+    size_t total = threads ? threads.load() : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    size_t busy = 0;
+    for (VSThreadPool *pool : pools)
+        busy += pool->isBusy();
+
+    for (VSThreadPool *pool : pools) {
+        size_t n = pool->isBusy() ? std::max<size_t>(busy, 1) : busy + 1;
+        pool->setSharedShare(std::max<size_t>(total / n, 1));
+    }
+}
+
+bool VSThreadPool::isBusy() const {
+    if (activeThreads > 0)
+        return true;
+    if (numBlocked > 0)
+        return true;
+    for (const auto &queue : queues)
+        if (queue->numTasks > 0)
+            return true;
+    return false;
+}
+
+void VSThreadPool::getStats(VSCoreStats *stats) {
+    int64_t queued = numBlocked;
+    for (const auto &queue : queues)
+        queued += queue->numTasks;
+    stats->queuedTasks = queued;
+    stats->activeThreads = static_cast<int>(activeThreads);
+    stats->threadLimit = static_cast<int>(threadLimit());
+
+    std::lock_guard<std::mutex> l(taskLock);
+    stats->threads = static_cast<int>(allThreads.size());
+    stats->externalRequests = static_cast<int64_t>(externalContexts.size());
+    stats->deadlineMisses = deadlineMisses;
+}
+
+void VSThreadPool::setSharedShare(size_t share) {
+    // the workers recheck the limit after every task so only a larger share needs them woken up
+    if (sharedShare.exchange(share) < share)
+        newWork.notify_all();
+}
+
+VSThreadPool::VSThreadPool(VSCore *core, bool numaAware, bool adaptive, bool lowLatency, bool shared, bool topologyAware, bool realTime) : core(core), numHelpers(0), waitCounter(0), activeThreads(0), idleThreads(0), reqCounter(0), workEpoch(0), nextQueue(0), maxThreads(0), stopThreads(false), ticks(0), nextAdjTicks(50), numParallelJobs(0), numCancelled(0), lowLatency(lowLatency), adaptive(adaptive), targetThreads(0), realTime(realTime) {
+    if (numaAware) {
+        numaNodeCpus = getNumaNodes();
+        if (numaNodeCpus.size() < 2)
+            numaNodeCpus.clear();
+        else
+            core->logMessage(mtDebug, "NUMA mode enabled with " + std::to_string(numaNodeCpus.size()) + " nodes");
+    }
+
+    size_t numQueues = std::max<size_t>(getNumAvailableThreads(), numaNodeCount());
+
+    if (topologyAware && numaNodeCpus.empty()) {
+        std::vector<std::pair<int, bool>> topology = getCpuTopology();
+        if (!topology.empty()) {
+            secondaryQueues.resize(numQueues);
+            for (size_t i = 0; i < numQueues; i++)
+                secondaryQueues[i] = topology[i % topology.size()].second;
+            for (const auto &iter : topology)
+                workerCpus.push_back(iter.first);
+            size_t numPrimary = std::count(secondaryQueues.begin(), secondaryQueues.begin() + std::min(numQueues, topology.size()), 0);
+            core->logMessage(mtDebug, "Topology mode enabled with " + std::to_string(numPrimary) + " primary and " + std::to_string(topology.size() - numPrimary) + " E-core or SMT sibling cpus");
+        }
+    } else if (topologyAware) {
+        core->logMessage(mtDebug, "Topology mode is ignored in NUMA mode");
+    }
+    for (size_t i = 0; i < numQueues; i++)
+        queues.emplace_back(new TaskQueue());
+
+    // queue i belongs to node i % numNodes, a worker first steals from the queues on its own node
+    size_t numNodes = numaNodeCount();
+    queueScanOrder.resize(numQueues);
+    for (size_t i = 0; i < numQueues; i++) {
+        for (int sameNode = 1; sameNode >= 0; sameNode--) {
+            for (size_t j = 0; j < numQueues; j++) {
+                size_t q = (i + j) % numQueues;
+                if ((q % numNodes == i % numNodes) == !!sameNode)
+                    queueScanOrder[i].push_back(q);
+            }
+        }
+    }
+
     setThreadCount(0);
+
+    if (shared)
+        VSSharedBudget::instance().attach(this);
 }
 
 size_t VSThreadPool::threadCount() {
@@ -276,11 +926,36 @@ size_t VSThreadPool::threadCount() {
 }
 
 void VSThreadPool::spawnThread() {
-    std::thread *thread = new std::thread(runTasksWrapper, this, std::ref(stopThreads));
+    size_t queueIndex = allThreads.size() % queues.size();
+    std::thread *thread = new std::thread(runTasksWrapper, this, queueIndex, std::ref(stopThreads));
     allThreads.insert(std::make_pair(thread->get_id(), thread));
+
+    if (!numaNodeCpus.empty())
+        pinThread(thread, numaNodeCpus[queueIndex % numaNodeCpus.size()], "NUMA node");
+    else if (!workerCpus.empty())
+        pinThread(thread, { workerCpus[queueIndex % workerCpus.size()] }, "cpu");
     ++activeThreads;
 }
 
+void VSThreadPool::pinThread(std::thread *thread, const std::vector<int> &cpus, const char *what) {
+#ifdef _WIN32
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus)
+        if (cpu < static_cast<int>(sizeof(mask) * 8))
+            mask |= static_cast<DWORD_PTR>(1) << cpu;
+    if (!SetThreadAffinityMask(thread->native_handle(), mask))
+        core->logMessage(mtWarning, std::string("Failed to set ") + what + " affinity for worker thread");
+#elif defined(HAVE_SCHED_GETAFFINITY)
+    cpu_set_t affinity;
+    CPU_ZERO(&affinity);
+    for (int cpu : cpus)
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &affinity);
+    if (pthread_setaffinity_np(thread->native_handle(), sizeof(cpu_set_t), &affinity))
+        core->logMessage(mtWarning, std::string("Failed to set ") + what + " affinity for worker thread");
+#endif
+}
+
 size_t VSThreadPool::setThreadCount(size_t threads) {
     std::lock_guard<std::mutex> l(taskLock);
     maxThreads = threads > 0 ? threads : getNumAvailableThreads();
@@ -288,22 +963,69 @@ size_t VSThreadPool::setThreadCount(size_t threads) {
         maxThreads = 1;
         core->logMessage(mtWarning, "Couldn't detect optimal number of threads. Thread count set to 1.");
     }
+    // the adaptive search starts over from the top every time the limit changes
+    targetThreads = maxThreads.load();
+    adaptFrames = 0;
+    adaptLastRate = 0;
+    adaptDirection = -1;
     return maxThreads;
 }
 
 void VSThreadPool::queueTask(const PVSFrameContext &ctx) {
     assert(ctx);
-    tasks.push_front(ctx);
-    wakeThread();
+    // tasks queued from a worker stay local, external ones are spread over the queues of the threads that exist
+    size_t queueIndex;
+    VSNode *node = ctx->key.first;
+    if (node->seekSensitive && node->filterMode == fmUnordered)
+        queueIndex = (reinterpret_cast<uintptr_t>(node) / sizeof(void *)) % queues.size();
+    else if (currentPool == this)
+        queueIndex = currentQueue;
+    else
+        queueIndex = nextQueue++ % std::min<size_t>(queues.size(), std::max<size_t>(allThreads.size(), 1));
+
+    // a task coming back from a blocked set keeps counting its wait from when it was first queued
+    if (core->enableGraphInspection && !ctx->queuedTime)
+        ctx->queuedTime = statsClock();
+
+    TaskQueue &queue = *queues[queueIndex];
+    {
+        std::lock_guard<std::mutex> lock(queue.lock);
+        // equal keys are appended so tasks with the same priority are handled in the order they arrived
+        queue.tasks.emplace(TaskOrder(ctx->reqOrder, ctx->key.second), ctx);
+        ++queue.numTasks;
+    }
+    ++workEpoch;
+    if (!WakeBatch::add(this))
+        wakeThreads(1);
+    // always called with taskLock held so a helper can't miss it between checking and sleeping
+    if (numHelpers > 0)
+        helperWork.notify_all();
 }
 
-void VSThreadPool::wakeThread() {
-    if (activeThreads < maxThreads) {
-        if (idleThreads == 0) // newly spawned threads are active so no need to notify an additional thread
-            spawnThread();
-        else
-            newWork.notify_one();
-    }
+// Makes sure there are enough threads for count newly queued tasks, spinning threads pick up one task each
+// on their own and several sleeping threads are woken up with a single notification
+void VSThreadPool::wakeThreads(size_t count) {
+    // the shares only count the cores with work, so cores that were busy so far have to give up some threads
+    if (sharedShare && activeThreads == 0)
+        VSSharedBudget::instance().updateShares();
+
+    size_t limit = threadLimit();
+    if (activeThreads >= limit)
+        return;
+    size_t wanted = std::min(count, limit - activeThreads);
+    while (wanted > 0 && claimSpinningThread())
+        wanted--;
+    if (wanted == 0)
+        return;
+
+    // newly spawned threads are active so no need to notify an additional thread
+    size_t wake = std::min<size_t>(wanted, idleThreads);
+    if (wake == 1)
+        newWork.notify_one();
+    else if (wake > 1)
+        newWork.notify_all();
+    for (size_t i = wake; i < wanted && activeThreads < limit; i++)
+        spawnThread();
 }
 
 void VSThreadPool::releaseThread() {
@@ -317,22 +1039,156 @@ void VSThreadPool::reserveThread() {
 void VSThreadPool::startExternal(const PVSFrameContext &context) {
     assert(context);
     std::lock_guard<std::mutex> l(taskLock);
-    context->reqOrder = ++reqCounter;
-    assert(context);
-    tasks.push_back(context); // external requests can't be combined so just add to queue
-    wakeThread();
+    // in low latency mode newer requests get a lower order so they're processed first, still before all speculative work,
+    // in real-time mode the requests with a deadline are ordered by it and come before everything else
+    if (realTime && context->deadline) {
+        context->reqOrder = static_cast<uint64_t>(context->deadline);
+        deadlines.insert(std::make_pair(context->deadline, context));
+        if (!deadlineThread)
+            deadlineThread = new std::thread(&VSThreadPool::runDeadlines, this);
+        deadlineWork.notify_one();
+    } else {
+        context->deadline = 0;
+        context->fallback.reset();
+        if (lowLatency)
+            context->reqOrder = std::numeric_limits<uint64_t>::max() / 4 - ++reqCounter;
+        else
+            context->reqOrder = (realTime ? std::numeric_limits<uint64_t>::max() / 8 : 0) + ++reqCounter;
+    }
+    externalContexts.insert(std::make_pair(context->key, context));
+
+    // a frame that's already being produced for another request, external, internal or speculative,
+    // is only produced once and the result is passed on, otherwise the request is registered so
+    // later requests for the same frame can be attached to it
+    VSFrameContext *existing = context->hasError() ? nullptr : findContext(context->key);
+    if (existing) {
+        existing->notifyCtxList.push_back(context);
+        existing->reqOrder = std::min(existing->reqOrder, context->reqOrder);
+    } else {
+        if (!context->hasError() && context->region.isWholeFrame())
+            addContext(context);
+        queueTask(context);
+    }
+
+    int lookahead = context->key.first->accessLookahead;
+    if (lookahead > 0 && idleThreads > 0)
+        startSpeculative(context->key.first, context->key.second, lookahead);
+}
+
+// Starts an external request and returns once done is set by its callback. The calling thread
+// runs the tasks the request needs itself in the meantime instead of sleeping until the workers
+// are done. This saves a wake up per frame when frames are pulled one at a time and lets workers
+// calling getFrame from inside a filter continue with the nested request without an extra thread.
+// Only tasks started for this request are taken so the wait never depends on unrelated work.
+void VSThreadPool::startExternalSync(const PVSFrameContext &context, const std::atomic<bool> &done) {
+    bool isWorker = isWorkerThread();
+    size_t waitId = ++waitCounter;
+    context->waitId = waitId;
+
+    VSThreadPool *prevPool = currentPool;
+    size_t prevQueue = currentQueue;
+    if (!isWorker) {
+        currentPool = this;
+        currentQueue = nextQueue++ % queues.size();
+    }
+
+    startExternal(context);
+
+    std::unique_lock<std::mutex> lock(taskLock);
+    ++numHelpers;
+    while (!done) {
+        size_t epoch = workEpoch;
+        lock.unlock();
+        // other threads only count while they're running something
+        if (!isWorker)
+            ++activeThreads;
+        bool ran = runTask(currentQueue, waitId);
+        if (!isWorker)
+            --activeThreads;
+        lock.lock();
+        if (ran || done || workEpoch != epoch)
+            continue;
+
+        // what's left is running elsewhere or shared with other requests, a worker gives up its
+        // place while it sleeps so that work can't end up waiting for it
+        if (isWorker) {
+            releaseThread();
+            wakeThreads(1);
+        }
+        helperWork.wait(lock);
+        if (isWorker)
+            reserveThread();
+    }
+    --numHelpers;
+    lock.unlock();
+
+    currentPool = prevPool;
+    currentQueue = prevQueue;
+}
+
+// Queues requests for the frames following n that nobody asked for yet, they're ordered after all
+// regular work so they only run on threads that would otherwise be idle and the results end up in the cache
+void VSThreadPool::startSpeculative(VSNode *node, int n, int lookahead) {
+    int numFrames = (node->getNodeType() == mtVideo) ? node->getVideoInfo().numFrames : node->getAudioInfo().numFrames;
+    size_t started = 0;
+    for (int i = n + 1; i <= n + lookahead && i < numFrames && started < idleThreads; i++) {
+        NodeOutputKey key(node, i);
+        if (findContext(key) || node->isFrameCached(i))
+            continue;
+        PVSFrameContext ctx = new VSFrameContext(key, std::numeric_limits<uint64_t>::max() / 2 + i);
+        addContext(ctx);
+        queueTask(ctx);
+        started++;
+    }
 }
 
 void VSThreadPool::returnFrame(const VSFrameContext *rCtx, const PVSFrame &f) {
     assert(rCtx->frameDone);
+
+    PVSFrameContext keepAlive;
+    auto range = externalContexts.equal_range(rCtx->key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.get() == rCtx) {
+            keepAlive = it->second;
+            externalContexts.erase(it);
+            if (rCtx->cancelled)
+                --numCancelled;
+            break;
+        }
+    }
+
+    // the deadline thread already invoked the callback for requests that were late
+    if (rCtx->deadlineMissed)
+        return;
+    if (rCtx->deadline) {
+        auto drange = deadlines.equal_range(rCtx->deadline);
+        for (auto it = drange.first; it != drange.second; ++it) {
+            if (it->second.get() == rCtx) {
+                deadlines.erase(it);
+                break;
+            }
+        }
+    }
+
+    if (rCtx->hasError())
+        invokeFrameDone(rCtx, nullptr, rCtx->errorMessage.c_str());
+    else
+        invokeFrameDone(rCtx, f, nullptr);
+}
+
+// Called with taskLock held, f is only used when there's no error
+void VSThreadPool::invokeFrameDone(const VSFrameContext *rCtx, const PVSFrame &f, const char *errorMsg) {
     bool outputLock = rCtx->lockOnOutput;
+    // the tasks queued so far shouldn't have to wait for the callback
+    WakeBatch::flush(this);
+
     // we need to unlock here so the callback may request more frames without causing a deadlock
     // AND so that slow callbacks will only block operations in this thread, not all the others
     taskLock.unlock();
-    if (rCtx->hasError()) {
+    if (errorMsg) {
         if (outputLock)
             callbackLock.lock();
-        rCtx->frameDone(rCtx->userData, nullptr, rCtx->key.second, rCtx->key.first, rCtx->errorMessage.c_str());
+        rCtx->frameDone(rCtx->userData, nullptr, rCtx->key.second, rCtx->key.first, errorMsg);
         if (outputLock)
             callbackLock.unlock();
     } else {
@@ -344,20 +1200,57 @@ void VSThreadPool::returnFrame(const VSFrameContext *rCtx, const PVSFrame &f) {
             callbackLock.unlock();
     }
     taskLock.lock();
+    if (rCtx->waitId)
+        helperWork.notify_all();
 }
 
-void VSThreadPool::startInternalRequest(const PVSFrameContext &notify, NodeOutputKey key) {
-    //technically this could be done by walking up the context chain and add a new notification to the correct one
-    //unfortunately this would probably be quite slow for deep scripts so just hope the cache catches it
+// Returns the real-time requests whose deadline passed right away, with the fallback frame or an error. They
+// stay registered like cancelled requests so the work only they wait for is dropped and the callback isn't
+// invoked a second time when the frame is done after all.
+void VSThreadPool::runDeadlines() {
+    std::unique_lock<std::mutex> lock(taskLock);
+    while (!stopThreads) {
+        if (deadlines.empty()) {
+            deadlineWork.wait(lock);
+            continue;
+        }
+
+        auto it = deadlines.begin();
+        int64_t now = statsClock();
+        if (it->first > now) {
+            deadlineWork.wait_for(lock, std::chrono::nanoseconds(it->first - now));
+            continue;
+        }
+
+        PVSFrameContext ctx = std::move(it->second);
+        deadlines.erase(it);
+        ctx->deadlineMissed = true;
+        if (!ctx->cancelled) {
+            ctx->cancelled = true;
+            ++numCancelled;
+        }
+        ++deadlineMisses;
 
-    if (key.second < 0)
-        core->logFatal("Negative frame request by: " + notify->key.first->getName());
+        PVSFrame fallback = std::move(ctx->fallback);
+        if (fallback)
+            invokeFrameDone(ctx.get(), fallback, nullptr);
+        else
+            invokeFrameDone(ctx.get(), nullptr, ("Frame " + std::to_string(ctx->key.second) + " missed its deadline").c_str());
+    }
+}
+
+// Starts everything in notify's request list, done as one batch so the cache size bookkeeping
+// only happens once however many frames a temporal filter asks for. Frames that are already cached
+// are handed over directly without creating a context. Returns the number of requests that have
+// to complete before notify can run again.
+size_t VSThreadPool::startInternalRequests(const PVSFrameContext &notify) {
+    size_t numRequests = notify->reqList.size();
 
     // check to see if it's time to reevaluate cache sizes
     if (core->memory->isOverLimit()) {
         ticks = 0;
         core->notifyCaches(true);
-    } else if (++ticks == nextAdjTicks) { // a normal tick for caches to adjust their sizes based on recent history
+    } else if ((ticks += numRequests) >= nextAdjTicks || (ticks >= 50 && core->memory->isOverSoftLimit())) { // a normal tick for caches to adjust their sizes based on recent history, done more often when memory is getting low
         // gradually slow down the adjustment to avoid negatively affecting the performance.
         int next = ticks * 9 / 8;
         if (next > 1000) next = 1000;
@@ -366,23 +1259,173 @@ void VSThreadPool::startInternalRequest(const PVSFrameContext &notify, NodeOutpu
         core->notifyCaches(false);
     }
 
-        
-    auto it = allContexts.find(key);
-    if (it != allContexts.end()) {
-        PVSFrameContext &ctx = it->second;
-        ctx->notifyCtxList.push_back(notify);
-        ctx->reqOrder = std::min(ctx->reqOrder, notify->reqOrder);
+    size_t started = 0;
+    for (size_t i = 0; i < numRequests; i++) {
+        NodeOutputKey key = notify->reqList[i];
+        if (key.second < 0)
+            core->logFatal("Negative frame request by: " + notify->key.first->getName());
+
+        if (key.first->cacheEnabled && !findContext(key)) {
+            // a miss gets counted later when the queued task is looked at
+            PVSFrame f = key.first->getCachedFrameInternal(key.second, false);
+            if (f) {
+                notify->availableFrames.push_back({key, f});
+                continue;
+            }
+        }
+
+        startInternalRequest(notify, key);
+        started++;
+    }
+    return started;
+}
+
+void VSThreadPool::startInternalRequest(const PVSFrameContext &notify, NodeOutputKey key) {
+    //technically this could be done by walking up the context chain and add a new notification to the correct one
+    //unfortunately this would probably be quite slow for deep scripts so just hope the cache catches it
+
+    // only contexts for whole frames are registered, they can serve requests for a region too
+    VSFrameContext *existing = findContext(key);
+    if (existing) {
+        existing->notifyCtxList.push_back(notify);
+        existing->reqOrder = std::min(existing->reqOrder, notify->reqOrder);
     } else {
         PVSFrameContext ctx = new VSFrameContext(key, notify);
+        ctx->waitId = notify->waitId;
+        ctx->region = notify->key.first->inputRegion(notify.get(), key);
+        for (const auto &placement : notify->placements) {
+            if (placement.key == key) {
+                ctx->placement = placement;
+                break;
+            }
+        }
         // create a new context and append it to the tasks
-        allContexts.insert(std::make_pair(key, ctx));
+        if (ctx->region.isWholeFrame())
+            addContext(ctx);
         queueTask(ctx);
     } 
 }
 
+// Returns true if any of the job's indices was run by the calling thread, the last one to
+// finish an index wakes up the thread waiting in parallelFor
+bool VSThreadPool::runParallelJob(ParallelJob &job) {
+    bool ran = false;
+    int i;
+    while ((i = job.next++) < job.count) {
+        job.func(i, job.userData);
+        ran = true;
+        if (++job.done == job.count) {
+            std::lock_guard<std::mutex> lock(job.lock);
+            job.finished.notify_all();
+        }
+    }
+    return ran;
+}
+
+bool VSThreadPool::helpParallelJobs() {
+    std::shared_ptr<ParallelJob> job;
+    {
+        std::lock_guard<std::mutex> lock(parallelLock);
+        // jobs that have all their indices claimed only need to be waited for by their owner
+        while (!parallelJobs.empty() && parallelJobs.front()->next >= parallelJobs.front()->count) {
+            parallelJobs.pop_front();
+            --numParallelJobs;
+        }
+        if (parallelJobs.empty())
+            return false;
+        job = parallelJobs.front();
+    }
+    return runParallelJob(*job);
+}
+
+void VSThreadPool::parallelFor(int count, VSParallelForFunc func, void *userData) {
+    // helpers only come from idle threads so the work is done inline when every worker
+    // is already busy with other frames, in that case there's nothing to gain
+    size_t helpers = std::min<size_t>(std::max(count - 1, 0), idleThreads);
+    if (helpers == 0) {
+        for (int i = 0; i < count; i++)
+            func(i, userData);
+        return;
+    }
+
+    std::shared_ptr<ParallelJob> job = std::make_shared<ParallelJob>();
+    job->func = func;
+    job->userData = userData;
+    job->count = count;
+
+    {
+        std::lock_guard<std::mutex> lock(parallelLock);
+        parallelJobs.push_back(job);
+        ++numParallelJobs;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(taskLock);
+        ++workEpoch;
+        for (size_t i = 0; i < helpers && activeThreads < threadLimit(); i++)
+            newWork.notify_one();
+    }
+
+    runParallelJob(*job);
+
+    {
+        std::lock_guard<std::mutex> lock(parallelLock);
+        auto it = std::find(parallelJobs.begin(), parallelJobs.end(), job);
+        if (it != parallelJobs.end()) {
+            parallelJobs.erase(it);
+            --numParallelJobs;
+        }
+    }
+
+    // only indices that a helper is running at this moment can still be outstanding
+    if (job->done < count) {
+        bool isWorker = isWorkerThread();
+        if (isWorker)
+            releaseThread();
+        std::unique_lock<std::mutex> lock(job->lock);
+        job->finished.wait(lock, [&job, count]() { return job->done == count; });
+        if (isWorker)
+            reserveThread();
+    }
+}
+
+size_t VSThreadPool::cancelExternal(NodeOutputKey key, VSFrameDoneCallback frameDone, void *userData) {
+    std::lock_guard<std::mutex> l(taskLock);
+    size_t count = 0;
+    auto range = externalContexts.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        VSFrameContext *ctx = it->second.get();
+        if (ctx->frameDone == frameDone && ctx->userData == userData && !ctx->cancelled) {
+            ctx->cancelled = true;
+            ++numCancelled;
+            ++count;
+        }
+    }
+    return count;
+}
+
+// A context is abandoned when every request waiting for it, directly or through other contexts, has
+// been cancelled. Speculative contexts are never abandoned since their result still goes to the cache.
+// External requests can have other requests for the same frame attached to them.
+bool VSThreadPool::isAbandoned(const VSFrameContext *ctx, std::unordered_map<const VSFrameContext *, bool> &visited) {
+    if (ctx->external && !ctx->cancelled)
+        return false;
+    if (ctx->speculative || (ctx->notifyCtxList.size() == 0 && !ctx->external))
+        return false;
+
+    auto it = visited.find(ctx);
+    if (it != visited.end())
+        return it->second;
+
+    bool abandoned = true;
+    for (size_t i = 0; i < ctx->notifyCtxList.size() && abandoned; i++)
+        abandoned = isAbandoned(ctx->notifyCtxList[i].get(), visited);
+    visited[ctx] = abandoned;
+    return abandoned;
+}
+
 bool VSThreadPool::isWorkerThread() {
-    std::lock_guard<std::mutex> m(taskLock);
-    return allThreads.count(std::this_thread::get_id()) > 0;
+    return currentPool == this;
 }
 
 void VSThreadPool::waitForDone() {
@@ -392,9 +1435,20 @@ void VSThreadPool::waitForDone() {
 }
 
 VSThreadPool::~VSThreadPool() {
+    if (sharedShare)
+        VSSharedBudget::instance().detach(this);
+
     std::unique_lock<std::mutex> m(taskLock);
     stopThreads = true;
 
+    if (deadlineThread) {
+        deadlineWork.notify_all();
+        m.unlock();
+        deadlineThread->join();
+        delete deadlineThread;
+        m.lock();
+    }
+
     while (!allThreads.empty()) {
         auto iter = allThreads.begin();
         auto thread = iter->second;
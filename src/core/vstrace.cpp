@@ -0,0 +1,111 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "vstrace.h"
+#include <cstdio>
+
+std::atomic<uint64_t> VSTracer::tracerCounter(0);
+
+VSTracer::VSTracer() : id(++tracerCounter), startTime(std::chrono::steady_clock::now()) {
+}
+
+int64_t VSTracer::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+VSTracer::ThreadBuffer *VSTracer::getBuffer() {
+    // tracers are told apart by id since a new one may be allocated at the address of a freed one
+    thread_local uint64_t currentTracer = 0;
+    thread_local ThreadBuffer *currentBuffer = nullptr;
+
+    if (currentTracer != id) {
+        std::lock_guard<std::mutex> l(lock);
+        buffers.emplace_back(new ThreadBuffer());
+        buffers.back()->tid = static_cast<int>(buffers.size());
+        currentBuffer = buffers.back().get();
+        currentTracer = id;
+    }
+    return currentBuffer;
+}
+
+void VSTracer::addEvent(const char *category, const std::string &name, int64_t start, int64_t duration, int frame, const char *reason, const std::string &parentName, int parentFrame) {
+    ThreadBuffer *buffer = getBuffer();
+    std::lock_guard<std::mutex> l(buffer->lock);
+    buffer->events.push_back(Event{ category, name, start, duration, frame, reason, parentName, parentFrame });
+}
+
+static std::string escapeJSON(const std::string &s) {
+    std::string r;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            r += '\\';
+            r += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            r += buffer;
+        } else {
+            r += c;
+        }
+    }
+    return r;
+}
+
+static std::string microseconds(int64_t ns) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.3f", ns / 1000.);
+    return buffer;
+}
+
+std::string VSTracer::toJSON() {
+    std::lock_guard<std::mutex> l(lock);
+    std::string s = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+
+    for (const auto &buffer : buffers) {
+        std::lock_guard<std::mutex> bl(buffer->lock);
+        std::string tid = std::to_string(buffer->tid);
+
+        s += first ? "" : ",\n";
+        first = false;
+        s += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" + tid + ",\"args\":{\"name\":\"thread " + tid + "\"}}";
+
+        for (const Event &e : buffer->events) {
+            s += ",\n{\"name\":\"" + escapeJSON(e.name) + "\",\"cat\":\"" + e.category + "\"";
+            if (e.duration >= 0)
+                s += ",\"ph\":\"X\",\"ts\":" + microseconds(e.start) + ",\"dur\":" + microseconds(e.duration);
+            else
+                s += ",\"ph\":\"i\",\"s\":\"t\",\"ts\":" + microseconds(e.start);
+            s += ",\"pid\":0,\"tid\":" + tid + ",\"args\":{";
+
+            std::string args;
+            if (e.frame >= 0)
+                args += "\"frame\":" + std::to_string(e.frame);
+            if (e.reason)
+                args += std::string(args.empty() ? "" : ",") + "\"reason\":\"" + e.reason + "\"";
+            if (!e.parentName.empty())
+                args += std::string(args.empty() ? "" : ",") + "\"parent\":\"" + escapeJSON(e.parentName) + (e.parentFrame >= 0 ? ":" + std::to_string(e.parentFrame) : "") + "\"";
+            s += args + "}}";
+        }
+    }
+
+    s += "\n]}\n";
+    return s;
+}
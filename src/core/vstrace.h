@@ -0,0 +1,68 @@
+/*
+* Copyright (c) 2021 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef VSTRACE_H
+#define VSTRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Records scheduling events when the core was created with ccfEnableTracing and
+// turns them into the Chrome trace event format (also readable by Perfetto).
+// Every thread appends to its own buffer so recording is almost never contended.
+
+class VSTracer {
+public:
+    struct Event {
+        const char *category; // static string
+        std::string name;
+        int64_t start; // nanoseconds since the tracer was created
+        int64_t duration; // -1 for instant events
+        int frame;
+        const char *reason; // static string, only set for filter calls
+        std::string parentName;
+        int parentFrame;
+    };
+private:
+    struct ThreadBuffer {
+        int tid;
+        std::mutex lock;
+        std::vector<Event> events;
+    };
+
+    static std::atomic<uint64_t> tracerCounter;
+    const uint64_t id;
+    const std::chrono::steady_clock::time_point startTime;
+    std::mutex lock;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    ThreadBuffer *getBuffer();
+public:
+    VSTracer();
+    int64_t now() const;
+    void addEvent(const char *category, const std::string &name, int64_t start, int64_t duration, int frame = -1, const char *reason = nullptr, const std::string &parentName = std::string(), int parentFrame = -1);
+    std::string toJSON();
+};
+
+#endif // VSTRACE_H
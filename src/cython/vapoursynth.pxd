@@ -225,9 +225,25 @@ cdef extern from "include/VapourSynth4.h" nogil:
         ccfEnableGraphInspection
         ccfDisableAutoLoading
         ccfDisableLibraryUnloading
+        ccfNumaAware
+        ccfLargePages
+        ccfPrefaultFrames
+        ccfEnableTracing
+        ccfEnablePerfCounters
+        ccfAdaptiveThreads
+        ccfLowLatency
+        ccfFrameGuard
+        ccfSharedResources
+        ccfTopologyAware
+        ccfStreamingCaches
+        ccfRealTime
 
     enum VSPluginConfigFlags:
         pcModifiable
+
+    enum VSAccessPattern:
+        apUnknown
+        apLinear
         
     enum VSDataTypeHint:
         dtUnknown
@@ -241,12 +257,15 @@ cdef extern from "include/VapourSynth4.h" nogil:
     ctypedef void (__stdcall *VSInitPlugin)(VSPlugin *plugin, const VSPLUGINAPI *vspapi)  
 
     ctypedef void (__stdcall *VSFreeFunctionData)(void *userData)
+    ctypedef void (__stdcall *VSFreeExternalMemory)(void *userData)
     ctypedef const VSFrame *(__stdcall *VSFilterGetFrame)(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi)
     ctypedef void (__stdcall *VSFilterFree)(void *instanceData, VSCore *core, const VSAPI *vsapi)
    
     ctypedef void (__stdcall *VSFrameDoneCallback)(void *userData, const VSFrame *f, int n, VSNode *node, const char *errorMsg)
     ctypedef void (__stdcall *VSLogHandler)(int msgType, const char *msg, void *userData)
     ctypedef void (__stdcall *VSLogHandlerFree)(void *userData)
+    ctypedef void (__stdcall *VSParallelForFunc)(int index, void *userData)
+    ctypedef void (__stdcall *VSFilterStripe)(int plane, const uint8_t *srcp, ptrdiff_t srcStride, uint8_t *dstp, ptrdiff_t dstStride, int width, int height, void *instanceData, const VSAPI *vsapi)
 
     ctypedef struct VSPLUGINAPI:
         int getAPIVersion() nogil
@@ -271,6 +290,8 @@ cdef extern from "include/VapourSynth4.h" nogil:
         # Frame related
         VSFrame *newVideoFrame(const VSVideoFormat *format, int width, int height, const VSFrame *propSrc, VSCore *core) nogil
         VSFrame *newVideoFrame2(const VSVideoFormat *format, int width, int height, const VSFrame **planeSrc, const int *planes, const VSFrame *propSrc, VSCore *core) nogil
+        VSFrame *newVideoFrameExternal(const VSVideoFormat *format, int width, int height, const uint8_t **planes, const ptrdiff_t *strides, VSFreeExternalMemory free, void *userData, const VSFrame *propSrc, VSCore *core) nogil
+        int getAudioFrameSamples(VSNode *node) nogil
         VSFrame *newAudioFrame(const VSAudioFormat *format, int sampleRate, const VSFrame *propSrc, VSCore *core) nogil
         VSFrame *newAudioFrame2(const VSAudioFormat *format, int numSamples, const VSFrame **channelSrc, const int *channels, const VSFrame *propSrc, VSCore *core) nogil
         void freeFrame(const VSFrame *f) nogil
@@ -386,6 +407,32 @@ cdef extern from "include/VapourSynth4.h" nogil:
         void logMessage(int msgType, const char *msg, VSCore *core) nogil
         VSLogHandle *addLogHandler(VSLogHandler handler, VSLogHandlerFree free, void *userData, VSCore *core) nogil
         bint removeLogHandler(VSLogHandle *handle, VSCore *core) nogil
+
+        # Scheduling hints
+        void setNodeAccessPattern(VSNode *node, int pattern, int lookahead) nogil
+
+        # Batched frame requests
+        void requestFrameRangeFilter(int first, int last, VSNode *node, VSFrameContext *frameCtx) nogil
+        int getFrameRangeFilter(int first, int last, VSNode *node, VSFrameContext *frameCtx, const VSFrame **frames) nogil
+
+        # Intra-frame parallelism
+        void parallelFor(int count, VSParallelForFunc func, void *userData, VSCore *core) nogil
+
+        # Request cancellation
+        int cancelFrameAsync(int n, VSNode *node, VSFrameDoneCallback callback, void *userData) nogil
+
+        # Stripe execution
+        bint setFilterStripe(VSNode *node, VSFilterStripe stripe, int radius, int planes) nogil
+
+        # Node reuse across script evaluations
+        void setNodeReuse(VSCore *core, int enable) nogil
+        int releaseUnusedNodes(VSCore *core) nogil
+
+        # Props-only requests
+        void getFramePropsAsync(int n, VSNode *node, VSFrameDoneCallback callback, void *userData) nogil
+
+        # Real-time requests
+        void getFrameDeadlineAsync(int n, VSNode *node, int64_t latency, const VSFrame *fallback, VSFrameDoneCallback callback, void *userData) nogil
                 
     const VSAPI *getVapourSynthAPI(int version) nogil
 
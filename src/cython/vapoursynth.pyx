@@ -1,3 +1,4 @@
+# cython: freethreading_compatible=True
 #  Copyright (c) 2012-2021 Fredrik Mellbin
 #
 #  This file is part of VapourSynth.
@@ -20,6 +21,7 @@
 cimport vapoursynth
 include 'vsconstants.pxd'
 from vsscript_internal cimport VSScript
+from vsframewriter cimport VSFWProgress, vsfwGetY4MHeader, vsfwOutputNode, vsfwCopyFrames
 cimport cython.parallel
 from cython cimport view, final
 from cython.view cimport memoryview
@@ -30,11 +32,14 @@ from cpython.buffer cimport PyBuffer_IsContiguous
 from cpython.buffer cimport PyBuffer_Release
 from cpython.buffer cimport PyObject_GetBuffer
 from cpython.buffer cimport PyBUF_RECORDS_RO, PyBUF_RECORDS
+from cpython.buffer cimport PyBUF_WRITABLE, PyBUF_STRIDES, PyBUF_INDIRECT
 from cpython.memoryview cimport PyMemoryView_FromObject
 from cpython.memoryview cimport PyMemoryView_GET_BUFFER
 from cpython.number cimport PyIndex_Check
 from cpython.number cimport PyNumber_Index
 from cpython.ref cimport Py_INCREF, Py_DECREF
+from cpython.pycapsule cimport PyCapsule_New, PyCapsule_IsValid, PyCapsule_GetPointer
+from libc.stdlib cimport malloc, free
 import os
 import ctypes
 import threading
@@ -169,6 +174,8 @@ cdef class StandaloneEnvironmentPolicy:
 
 # Internal holder of the current policy.
 cdef object _policy = None
+# Without a GIL nothing else keeps two threads from registering a policy at the same time.
+cdef object _policy_lock = RLock()
 
 cdef const VSAPI *_vsapi = NULL
 cdef const VSCAPI *_vscapi = NULL
@@ -256,32 +263,39 @@ cdef class EnvironmentPolicyAPI:
 
 def register_policy(policy):
     global _policy
-    if _policy is not None:
-        raise RuntimeError("There is already a policy registered.")
-    _policy = policy
+    cdef EnvironmentPolicyAPI _api
+    with _policy_lock:
+        if _policy is not None:
+            raise RuntimeError("There is already a policy registered.")
+        _policy = policy
 
-    # Expose Additional API-calls to the newly registered Environment-policy.
-    cdef EnvironmentPolicyAPI _api = EnvironmentPolicyAPI.__new__(EnvironmentPolicyAPI)
-    _api._target_policy = weakref.ref(_policy)
-    _policy.on_policy_registered(_api)
+        # Expose Additional API-calls to the newly registered Environment-policy.
+        _api = EnvironmentPolicyAPI.__new__(EnvironmentPolicyAPI)
+        _api._target_policy = weakref.ref(_policy)
+        _policy.on_policy_registered(_api)
 
 
 ## DO NOT EXPOSE THIS FUNCTION TO PYTHON-LAND!
 cdef get_policy():
     global _policy
-    if _policy is None:
-        standalone_policy = StandaloneEnvironmentPolicy.__new__(StandaloneEnvironmentPolicy)
-        register_policy(standalone_policy)
+    policy = _policy
+    if policy is not None:
+        return policy
 
-    return _policy
+    with _policy_lock:
+        if _policy is None:
+            standalone_policy = StandaloneEnvironmentPolicy.__new__(StandaloneEnvironmentPolicy)
+            register_policy(standalone_policy)
+        return _policy
 
 def has_policy():
     return _policy is not None
 
 cdef clear_policy():
     global _policy
-    old_policy = _policy
-    _policy = None
+    with _policy_lock:
+        old_policy = _policy
+        _policy = None
     if old_policy is not None:
         old_policy.on_policy_cleared()
     return old_policy
@@ -979,17 +993,12 @@ cdef class FrameProps(object):
         cdef int numelem = self.funcs.mapNumElements(m, b)
         return numelem > 0
 
-    def __getitem__(self, str name):
-        cdef const VSMap *m = self.funcs.getFramePropertiesRO(self.constf)
-        cdef bytes b = name.encode('utf-8')
+    cdef object _get_value(self, const VSMap *m, const char *b, int numelem):
         cdef list ol = []
-        cdef int numelem = self.funcs.mapNumElements(m, b)
         cdef const int64_t *intArray
         cdef const double *floatArray
         cdef const char *data
-
-        if numelem < 0:
-            raise KeyError('No key named ' + name + ' exists')
+        cdef int i
         cdef int t = self.funcs.mapGetType(m, b)
         if t == ptInt:
             if numelem > 0:
@@ -1020,6 +1029,28 @@ cdef class FrameProps(object):
         else:
             return ol
 
+    def __getitem__(self, str name):
+        cdef const VSMap *m = self.funcs.getFramePropertiesRO(self.constf)
+        cdef bytes b = name.encode('utf-8')
+        cdef int numelem = self.funcs.mapNumElements(m, b)
+        if numelem < 0:
+            raise KeyError('No key named ' + name + ' exists')
+        return self._get_value(m, b, numelem)
+
+    def to_dict(self):
+        """
+        Returns a snapshot of all properties as a regular dict, converted in a single pass over the map.
+        """
+        cdef const VSMap *m = self.funcs.getFramePropertiesRO(self.constf)
+        cdef int numkeys = self.funcs.mapNumKeys(m)
+        cdef const char *key
+        cdef dict result = {}
+        cdef int i
+        for i in range(numkeys):
+            key = self.funcs.mapGetKey(m, i)
+            result[key.decode('utf-8')] = self._get_value(m, key, self.funcs.mapNumElements(m, key))
+        return result
+
     def __setitem__(self, str name, value):
         if self.readonly:
             raise Error('Cannot delete properties of a read only object')
@@ -1164,7 +1195,7 @@ cdef class FrameProps(object):
         """
         We can't copy VideoFrames directly, so we're just gonna return a real dictionary.
         """
-        return dict(self)
+        return self.to_dict()
 
     def __iter__(self):
         yield from self.keys()
@@ -1177,7 +1208,7 @@ cdef class FrameProps(object):
         return super(FrameProps, self).__dir__() + list(self.keys())
 
     def __repr__(self):
-        return "<vapoursynth.FrameProps %r>" % dict(self)
+        return "<vapoursynth.FrameProps %r>" % self.to_dict()
 
 cdef FrameProps createFrameProps(RawFrame f):
     cdef FrameProps instance = FrameProps.__new__(FrameProps)
@@ -1258,6 +1289,26 @@ cdef class VideoFrame(RawFrame):
     cdef readonly VideoFormat format
     cdef readonly int width
     cdef readonly int height
+    # plane dimensions never change so they're only queried once, the pointers are refreshed on every export
+    # since the first write access may copy the planes
+    cdef bint info_ready
+    cdef Py_ssize_t plane_shape[3][2]
+    cdef Py_ssize_t plane_strides[3][2]
+    cdef void *buffer_planes[3]
+    cdef Py_ssize_t buffer_shape[3]
+    cdef Py_ssize_t buffer_strides[3]
+    cdef Py_ssize_t buffer_suboffsets[3]
+
+    cdef void _fill_info(self, const VSVideoFormat *format):
+        cdef int p
+        if self.info_ready:
+            return
+        for p in range(format.numPlanes):
+            self.plane_shape[p][0] = self.funcs.getFrameHeight(self.constf, p)
+            self.plane_shape[p][1] = self.funcs.getFrameWidth(self.constf, p)
+            self.plane_strides[p][0] = self.funcs.getStride(self.constf, p)
+            self.plane_strides[p][1] = format.bytesPerSample
+        self.info_ready = True
 
     def __init__(self):
         raise Error('Class cannot be instantiated directly')
@@ -1316,14 +1367,114 @@ cdef class VideoFrame(RawFrame):
         if not 0 <= index < format.numPlanes:
             raise IndexError("index out of range")
 
+        self._fill_info(format)
+
         data = _video.allocinfo(format)
         data.base.obj = self
         data.base.readonly = not self.flags & 1
-
-        _video.fillinfo(&data.base, frame, index, &self.flags, lib)
+        data.base.shape[0] = self.plane_shape[index][0]
+        data.base.shape[1] = self.plane_shape[index][1]
+        data.base.strides[0] = self.plane_strides[index][0]
+        data.base.len = data.base.shape[0] * data.base.shape[1] * data.base.itemsize
+        data.base.buf = _frame.getdata(frame, index, &self.flags, lib)
 
         return PyMemoryView_FromObject(data)
 
+    def __getbuffer__(self, Py_buffer *view, int flags):
+        # Exposes the whole frame as one (height, width) buffer for single plane formats or a (plane, height, width)
+        # one otherwise, so numpy.asarray(frame) doesn't need a view per plane. When the planes aren't evenly spaced
+        # in memory the first dimension is indirect and only consumers that request PyBUF_INDIRECT can use it.
+        cdef const VSVideoFormat *format = self.funcs.getVideoFrameFormat(self.constf)
+        cdef VSFrame *frame = <VSFrame *>self.constf
+        cdef int numPlanes = format.numPlanes
+        cdef Py_ssize_t delta
+        cdef int p
+
+        if (flags & PyBUF_WRITABLE) and not self.flags & 1:
+            raise BufferError('Cannot obtain a writable buffer of a read only frame')
+        if (flags & PyBUF_STRIDES) != PyBUF_STRIDES:
+            raise BufferError('Frame buffers are always strided')
+        if numPlanes > 1 and (format.subSamplingW or format.subSamplingH):
+            raise BufferError('The planes of subsampled frames can only be accessed individually')
+
+        self._fill_info(format)
+        for p in range(numPlanes):
+            self.buffer_planes[p] = _frame.getdata(frame, p, &self.flags, self.funcs)
+
+        view.obj = self
+        view.readonly = not self.flags & 1
+        view.itemsize = format.bytesPerSample
+        view.format = _sample_format(format)
+        view.internal = NULL
+
+        if numPlanes == 1:
+            view.buf = self.buffer_planes[0]
+            view.ndim = 2
+            view.shape = &self.plane_shape[0][0]
+            view.strides = &self.plane_strides[0][0]
+            view.suboffsets = NULL
+        else:
+            view.ndim = 3
+            self.buffer_shape[0] = numPlanes
+            self.buffer_shape[1] = self.plane_shape[0][0]
+            self.buffer_shape[2] = self.plane_shape[0][1]
+            self.buffer_strides[1] = self.plane_strides[0][0]
+            self.buffer_strides[2] = self.plane_strides[0][1]
+            view.shape = self.buffer_shape
+            view.strides = self.buffer_strides
+
+            delta = <char *>self.buffer_planes[1] - <char *>self.buffer_planes[0]
+            if numPlanes == 2 or <char *>self.buffer_planes[2] - <char *>self.buffer_planes[1] == delta:
+                view.buf = self.buffer_planes[0]
+                self.buffer_strides[0] = delta
+                view.suboffsets = NULL
+            elif (flags & PyBUF_INDIRECT) == PyBUF_INDIRECT:
+                view.buf = <void *>self.buffer_planes
+                self.buffer_strides[0] = sizeof(void *)
+                self.buffer_suboffsets[0] = 0
+                self.buffer_suboffsets[1] = -1
+                self.buffer_suboffsets[2] = -1
+                view.suboffsets = self.buffer_suboffsets
+            else:
+                raise BufferError('The planes of this frame are not evenly spaced in memory, request an indirect buffer or access them individually')
+
+        view.len = numPlanes * self.plane_shape[0][0] * self.plane_shape[0][1] * view.itemsize
+
+    def __dlpack__(self, *, stream=None, **kwargs):
+        # Shares the frame without a copy in the same (height, width) or (plane, height, width) layout as the buffer
+        # interface, which DLPack can only describe when the planes are evenly spaced in memory.
+        cdef const VSVideoFormat *format = self.funcs.getVideoFrameFormat(self.constf)
+        cdef VSFrame *frame = <VSFrame *>self.constf
+        cdef Py_ssize_t shape[3]
+        cdef Py_ssize_t strides[3]
+        cdef void *planes[3]
+        cdef int p
+
+        if stream is not None:
+            raise BufferError('Frames are in host memory and have no stream')
+        if format.numPlanes > 1 and (format.subSamplingW or format.subSamplingH):
+            raise BufferError('The planes of subsampled frames can only be accessed individually')
+
+        self._fill_info(format)
+        for p in range(format.numPlanes):
+            planes[p] = _frame.getdata(frame, p, &self.flags, self.funcs)
+
+        if format.numPlanes == 1:
+            return _dlpack_capsule(self, planes[0], 2, &self.plane_shape[0][0], &self.plane_strides[0][0], format)
+
+        shape[0] = format.numPlanes
+        shape[1] = self.plane_shape[0][0]
+        shape[2] = self.plane_shape[0][1]
+        strides[0] = <char *>planes[1] - <char *>planes[0]
+        strides[1] = self.plane_strides[0][0]
+        strides[2] = self.plane_strides[0][1]
+        if <char *>planes[2] - <char *>planes[1] != strides[0]:
+            raise BufferError('The planes of this frame are not evenly spaced in memory, use VideoNode.get_frame_batch() to copy them into one tensor')
+        return _dlpack_capsule(self, planes[0], 3, shape, strides, format)
+
+    def __dlpack_device__(self):
+        return (_kDLCPU, 0)
+
     def __len__(self):
         lib = self.funcs
         return lib.getVideoFrameFormat(self.constf).numPlanes
@@ -1452,6 +1603,99 @@ cdef class _2dview:
         view.internal = self.base.internal
 
 
+cdef char *_sample_format(const VSVideoFormat* format) nogil:
+    if format.sampleType == INTEGER:
+        if format.bytesPerSample == 1:
+            return 'B'
+        elif format.bytesPerSample == 2:
+            return 'H'
+        elif format.bytesPerSample == 4:
+            return 'I'
+    elif format.sampleType == FLOAT:
+        if format.bytesPerSample == 2:
+            return 'e'
+        elif format.bytesPerSample == 4:
+            return 'f'
+    return NULL
+
+
+# The DLPack tensor ABI, frames and batches are exported as host memory tensors that keep their owner alive
+ctypedef struct DLDevice:
+    int32_t device_type
+    int32_t device_id
+
+ctypedef struct DLDataType:
+    uint8_t code
+    uint8_t bits
+    uint16_t lanes
+
+ctypedef struct DLTensor:
+    void *data
+    DLDevice device
+    int32_t ndim
+    DLDataType dtype
+    int64_t *shape
+    int64_t *strides
+    uint64_t byte_offset
+
+ctypedef struct DLManagedTensor:
+    DLTensor dl_tensor
+    void *manager_ctx
+    void (*deleter)(DLManagedTensor *tensor) noexcept nogil
+
+ctypedef struct _DLPackExport:
+    DLManagedTensor tensor
+    int64_t shape[4]
+    int64_t strides[4]
+
+cdef enum:
+    _kDLCPU = 1
+    _kDLUInt = 1
+    _kDLFloat = 2
+
+cdef void _dlpack_deleter(DLManagedTensor *tensor) noexcept nogil:
+    with gil:
+        Py_DECREF(<object>tensor.manager_ctx)
+    free(tensor)
+
+cdef void _dlpack_capsule_free(object capsule) noexcept:
+    cdef DLManagedTensor *tensor
+    # a consumer renames the capsule once it owns the tensor
+    if PyCapsule_IsValid(capsule, 'dltensor'):
+        tensor = <DLManagedTensor *>PyCapsule_GetPointer(capsule, 'dltensor')
+        tensor.deleter(tensor)
+
+cdef object _dlpack_capsule(object owner, void *data, int ndim, const Py_ssize_t *shape, const Py_ssize_t *strides, const VSVideoFormat *format):
+    cdef _DLPackExport *exported
+    cdef int i
+    # DLPack strides are in samples
+    for i in range(ndim):
+        if strides[i] % format.bytesPerSample:
+            raise BufferError('The planes of this frame are not a whole number of samples apart')
+
+    exported = <_DLPackExport *>malloc(sizeof(_DLPackExport))
+    if exported == NULL:
+        raise MemoryError()
+    for i in range(ndim):
+        exported.shape[i] = shape[i]
+        exported.strides[i] = strides[i] // format.bytesPerSample
+
+    exported.tensor.dl_tensor.data = data
+    exported.tensor.dl_tensor.device.device_type = _kDLCPU
+    exported.tensor.dl_tensor.device.device_id = 0
+    exported.tensor.dl_tensor.ndim = ndim
+    exported.tensor.dl_tensor.dtype.code = _kDLFloat if format.sampleType == FLOAT else _kDLUInt
+    exported.tensor.dl_tensor.dtype.bits = format.bytesPerSample * 8
+    exported.tensor.dl_tensor.dtype.lanes = 1
+    exported.tensor.dl_tensor.shape = exported.shape
+    exported.tensor.dl_tensor.strides = exported.strides
+    exported.tensor.dl_tensor.byte_offset = 0
+    exported.tensor.manager_ctx = <void *>owner
+    exported.tensor.deleter = _dlpack_deleter
+    Py_INCREF(owner)
+    return PyCapsule_New(exported, 'dltensor', _dlpack_capsule_free)
+
+
 @cython.final
 @cython.internal
 cdef class _video:
@@ -1464,19 +1708,7 @@ cdef class _video:
         self = _2dview.__new__(_2dview)
         self.base.itemsize = format.bytesPerSample
         self.base.strides[1] = format.bytesPerSample
-
-        if format.sampleType == INTEGER:
-            if format.bytesPerSample == 1:
-                self.base.format = 'B'
-            elif format.bytesPerSample == 2:
-                self.base.format = 'H'
-            elif format.bytesPerSample == 4:
-                self.base.format = 'I'
-        elif format.sampleType == FLOAT:
-            if format.bytesPerSample == 2:
-                self.base.format = 'e'
-            elif format.bytesPerSample == 4:
-                self.base.format = 'f'
+        self.base.format = _sample_format(format)
 
         return self
 
@@ -1489,6 +1721,67 @@ cdef class _video:
         view.buf = _frame.getdata(frame, plane, flags, lib)
 
 
+@cython.final
+cdef class FrameBatch:
+    """ A C-contiguous (frame, plane, height, width) array of samples returned by VideoNode.get_frame_batch(). """
+    cdef void *data
+    cdef VSVideoFormat vsformat
+    cdef Py_ssize_t batch_shape[4]
+    cdef Py_ssize_t batch_strides[4]
+    cdef readonly VideoFormat format
+
+    def __init__(self):
+        raise Error('Class cannot be instantiated directly')
+
+    def __dealloc__(self):
+        free(self.data)
+
+    @property
+    def shape(self):
+        return (self.batch_shape[0], self.batch_shape[1], self.batch_shape[2], self.batch_shape[3])
+
+    def __len__(self):
+        return self.batch_shape[0]
+
+    def __getbuffer__(self, Py_buffer *view, int flags):
+        view.obj = self
+        view.buf = self.data
+        view.readonly = False
+        view.itemsize = self.vsformat.bytesPerSample
+        view.format = _sample_format(&self.vsformat)
+        view.ndim = 4
+        view.shape = self.batch_shape
+        view.strides = self.batch_strides
+        view.suboffsets = NULL
+        view.internal = NULL
+        view.len = self.batch_shape[0] * self.batch_strides[0]
+
+    def __dlpack__(self, *, stream=None, **kwargs):
+        if stream is not None:
+            raise BufferError('Frame batches are in host memory and have no stream')
+        return _dlpack_capsule(self, self.data, 4, self.batch_shape, self.batch_strides, &self.vsformat)
+
+    def __dlpack_device__(self):
+        return (_kDLCPU, 0)
+
+cdef FrameBatch createFrameBatch(const VSVideoFormat *format, int frames, int height, int width, const VSAPI *funcs, VSCore *core):
+    cdef FrameBatch instance = FrameBatch.__new__(FrameBatch)
+    cdef int i
+    instance.vsformat = format[0]
+    instance.format = createVideoFormat(format, funcs, core)
+    instance.batch_shape[0] = frames
+    instance.batch_shape[1] = format.numPlanes
+    instance.batch_shape[2] = height
+    instance.batch_shape[3] = width
+    instance.batch_strides[3] = format.bytesPerSample
+    for i in range(2, -1, -1):
+        instance.batch_strides[i] = instance.batch_strides[i + 1] * instance.batch_shape[i + 1]
+    instance.data = malloc(<size_t>instance.batch_strides[0] * frames)
+    if instance.data == NULL:
+        raise MemoryError()
+    return instance
+
+
 cdef class AudioFrame(RawFrame):
     cdef readonly object sample_type
     cdef readonly int bits_per_sample
@@ -1629,6 +1922,84 @@ cdef class _audio:
         view.buf = _frame.getdata(frame, channel, flags, lib)
 
 
+class _AsyncFrameIterator(object):
+    """
+    Yields the frames of a node in order to an asyncio event loop with at most window requests in flight.
+    Frames completed by the core threads are collected under a lock and the loop is only woken up once for
+    every batch that arrives while it's waiting, not once per frame.
+    """
+
+    def __init__(self, node, window):
+        self.node = node
+        self.window = window
+        self.num_frames = node.num_frames
+        self.loop = None
+        self.lock = Lock()
+        self.done = {}
+        self.waiter = None
+        self.wake_pending = False
+        self.next_request = 0
+        self.next_yield = 0
+        self.failed = False
+
+    def __aiter__(self):
+        return self
+
+    async def __anext__(self):
+        import asyncio
+
+        if self.loop is None:
+            self.loop = asyncio.get_running_loop()
+            self._request()
+
+        if self.failed or self.next_yield >= self.num_frames:
+            raise StopAsyncIteration
+
+        while True:
+            with self.lock:
+                if self.next_yield in self.done:
+                    result = self.done.pop(self.next_yield)
+                    break
+                waiter = self.waiter = self.loop.create_future()
+            await waiter
+
+        self.next_yield += 1
+        if isinstance(result, Error):
+            self.failed = True
+            raise result
+
+        self._request()
+        return result
+
+    def _request(self):
+        while self.next_request < self.num_frames and self.next_request - self.next_yield < self.window:
+            self.node.get_frame_async_raw(self.next_request, self._receive)
+            self.next_request += 1
+
+    def _receive(self, node, n, result):
+        # called from the core's threads
+        with self.lock:
+            self.done[n] = result
+            if self.waiter is None or self.wake_pending:
+                return
+            self.wake_pending = True
+
+        try:
+            self.loop.call_soon_threadsafe(self._wake)
+        except RuntimeError:
+            # the loop is already closed so nobody is waiting anymore
+            pass
+
+    def _wake(self):
+        with self.lock:
+            waiter = self.waiter
+            self.waiter = None
+            self.wake_pending = False
+
+        if waiter is not None and not waiter.done():
+            waiter.set_result(None)
+
+
 cdef class RawNode(object):
     cdef VSNode *node
     cdef const VSAPI *funcs
@@ -1642,21 +2013,24 @@ cdef class RawNode(object):
     cdef ensure_valid_frame_number(self, int n):
         raise NotImplementedError("Needs to be implemented by subclass.")
 
-    def get_frame_async_raw(self, int n, object cb, object future_wrapper=None):
+    def get_frame_async_raw(self, int n, object cb, object future_wrapper=None, bint props_only=False):
         self.ensure_valid_frame_number(n)
 
         data = createCallbackData(self.funcs, self, cb, future_wrapper)
         Py_INCREF(data)
         with nogil:
-            self.funcs.getFrameAsync(n, self.node, frameDoneCallback, <void *>data)
+            if props_only:
+                self.funcs.getFramePropsAsync(n, self.node, frameDoneCallback, <void *>data)
+            else:
+                self.funcs.getFrameAsync(n, self.node, frameDoneCallback, <void *>data)
 
-    def get_frame_async(self, int n):
+    def get_frame_async(self, int n, bint props_only=False):
         from concurrent.futures import Future
         fut = Future()
         fut.set_running_or_notify_cancel()
 
         try:
-            self.get_frame_async_raw(n, fut)
+            self.get_frame_async_raw(n, fut, props_only=props_only)
         except Exception as e:
             fut.set_exception(e)
 
@@ -1664,7 +2038,16 @@ cdef class RawNode(object):
 
         return fut
 
-    def frames(self, prefetch=None, backlog=None):
+    def frames_async(self, window=None):
+        if window is None or window <= 0:
+            window = self.core.num_threads
+
+        # lets the core produce the next frames ahead of time when threads are idle
+        self.funcs.setNodeAccessPattern(self.node, apLinear, window)
+
+        return _AsyncFrameIterator(self, window)
+
+    def frames(self, prefetch=None, backlog=None, props_only=False):
         if prefetch is None or prefetch <= 0:
             prefetch = self.core.num_threads
         if backlog is None or backlog < 0:
@@ -1672,7 +2055,11 @@ cdef class RawNode(object):
         elif backlog < prefetch:
             backlog = prefetch
 
-        enum_fut = enumerate((self.get_frame_async(frameno) for frameno in range(self.num_frames)))
+        # lets the core produce the next frames ahead of time when threads are idle
+        self.funcs.setNodeAccessPattern(self.node, apLinear, prefetch)
+
+        # only the properties of the frames are correct, for analysis passes that never look at the pixels
+        enum_fut = enumerate((self.get_frame_async(frameno, props_only) for frameno in range(self.num_frames)))
 
         finished = False
         running = 0
@@ -1746,6 +2133,16 @@ cdef class RawNode(object):
             self.funcs.freeNode(self.node)
 
 
+cdef int __stdcall _outputProgress(int written, int total, void *userData) nogil:
+    with gil:
+        state = <list>userData
+        try:
+            state[0](written, total)
+        except BaseException as e:
+            state[1] = e
+            return 1
+        return 0
+
 cdef class VideoNode(RawNode):
     cdef const VSVideoInfo *vi
     cdef readonly VideoFormat format
@@ -1795,6 +2192,60 @@ cdef class VideoNode(RawNode):
         else:
             return createConstVideoFrame(f, self.funcs, self.core.core)
 
+    def get_frame_batch(self, int start = 0, int count = -1, object out = None, int prefetch = 0):
+        cdef char errorMsg[512]
+        cdef Py_buffer view
+        cdef ptrdiff_t strides[4]
+        cdef Py_ssize_t shape[4]
+        cdef uint8_t *dst
+        cdef int ret = 0
+        cdef int i
+        cdef const VSVideoFormat *format = &self.vi.format
+
+        if format.colorFamily == UNDEFINED or self.vi.width == 0 or self.vi.height == 0:
+            raise Error('Frame batches can only be made from clips with a constant format and dimensions')
+        if format.numPlanes > 1 and (format.subSamplingW or format.subSamplingH):
+            raise Error('Frame batches can not be made from subsampled clips')
+        if count < 0:
+            count = self.num_frames - start
+        if count <= 0:
+            raise ValueError('A frame batch must contain at least one frame')
+        self.ensure_valid_frame_number(start)
+        self.ensure_valid_frame_number(start + count - 1)
+
+        shape[0] = count
+        shape[1] = format.numPlanes
+        shape[2] = self.vi.height
+        shape[3] = self.vi.width
+
+        if out is None:
+            out = createFrameBatch(format, count, self.vi.height, self.vi.width, self.funcs, self.core.core)
+
+        PyObject_GetBuffer(out, &view, PyBUF_RECORDS)
+        try:
+            matches = view.ndim == 4
+            for i in range(4 if matches else 0):
+                matches = matches and view.shape[i] == shape[i]
+            if not matches:
+                raise ValueError('The output must have the shape ' + str((count, format.numPlanes, self.vi.height, self.vi.width)))
+            sample_format = (<bytes>view.format if view.format != NULL else b'B').lstrip(b'@=<')
+            if view.itemsize != format.bytesPerSample or sample_format != <bytes>_sample_format(format):
+                raise ValueError('The output must have the sample type ' + (<bytes>_sample_format(format)).decode('ascii') + ' to hold ' + self.format.name)
+            for i in range(4):
+                strides[i] = view.strides[i]
+            dst = <uint8_t *>view.buf
+
+            if prefetch <= 0:
+                prefetch = self.core.num_threads
+            with nogil:
+                ret = vsfwCopyFrames(self.node, start, count, dst, strides, prefetch, errorMsg, sizeof(errorMsg), self.funcs)
+        finally:
+            PyBuffer_Release(&view)
+
+        if ret < 0:
+            raise Error(errorMsg.decode('utf-8'))
+        return out
+
     def set_output(self, int index = 0, VideoNode alpha = None, int alt_output = 0):
         cdef const VSVideoFormat *aformat = NULL
         clip = self
@@ -1816,6 +2267,13 @@ cdef class VideoNode(RawNode):
             _get_output_dict("set_output")[index] = self
 
     def output(self, object fileobj not None, bint y4m = False, object progress_update = None, int prefetch = 0, int backlog = -1):
+        cdef char header[256]
+        cdef char errorMsg[512]
+        cdef int fd = -1
+        cdef int ret
+        cdef VSFWProgress progress = NULL
+        cdef void *progressData = NULL
+
         if (fileobj is sys.stdout or fileobj is sys.stderr):
             # If you are embedded in a vsscript-application, don't allow outputting to stdout/stderr.
             # This is the responsibility of the application, which does know better where to output it.
@@ -1825,44 +2283,41 @@ cdef class VideoNode(RawNode):
             if hasattr(fileobj, "buffer"):
                 fileobj = fileobj.buffer
 
+        if y4m and vsfwGetY4MHeader(self.vi, header, sizeof(header)) < 0:
+            raise ValueError("Can only use GRAY and YUV for V4M-Streams")
+
+        try:
+            fd = fileobj.fileno()
+        except (AttributeError, OSError, ValueError):
+            fd = -1
+
         if progress_update is not None:
             progress_update(0, len(self))
 
-        if y4m:
-            if self.format.color_family == GRAY:
-                y4mformat = 'mono'
-                if self.format.bits_per_sample > 8:
-                    y4mformat = y4mformat + str(self.format.bits_per_sample)
-            elif self.format.color_family == YUV:
-                if self.format.subsampling_w == 1 and self.format.subsampling_h == 1:
-                    y4mformat = '420'
-                elif self.format.subsampling_w == 1 and self.format.subsampling_h == 0:
-                    y4mformat = '422'
-                elif self.format.subsampling_w == 0 and self.format.subsampling_h == 0:
-                    y4mformat = '444'
-                elif self.format.subsampling_w == 2 and self.format.subsampling_h == 2:
-                    y4mformat = '410'
-                elif self.format.subsampling_w == 2 and self.format.subsampling_h == 0:
-                    y4mformat = '411'
-                elif self.format.subsampling_w == 0 and self.format.subsampling_h == 1:
-                    y4mformat = '440'
-                if self.format.bits_per_sample > 8:
-                    y4mformat = y4mformat + 'p' + str(self.format.bits_per_sample)
-            else:
-                raise ValueError("Can only use GRAY and YUV for V4M-Streams")
+        if fd >= 0:
+            # a real file descriptor is written to natively, the header and frames then never need the GIL
+            if hasattr(fileobj, "flush"):
+                fileobj.flush()
+            if prefetch <= 0:
+                prefetch = self.core.num_threads
+            self.funcs.setNodeAccessPattern(self.node, apLinear, prefetch)
+
+            state = [progress_update, None]
+            if progress_update is not None:
+                progress = _outputProgress
+                progressData = <void *>state
 
-            if len(y4mformat) > 0:
-                y4mformat = 'C' + y4mformat + ' '
+            with nogil:
+                ret = vsfwOutputNode(self.node, fd, y4m, prefetch, progress, progressData, errorMsg, sizeof(errorMsg), self.funcs)
 
-            data = 'YUV4MPEG2 {y4mformat}W{width} H{height} F{fps_num}:{fps_den} Ip A0:0 XLENGTH={length}\n'.format(
-                y4mformat=y4mformat,
-                width=self.width,
-                height=self.height,
-                fps_num=self.fps_num,
-                fps_den=self.fps_den,
-                length=len(self)
-            )
-            fileobj.write(data.encode("ascii"))
+            if ret > 0 and state[1] is not None:
+                raise state[1]
+            elif ret < 0:
+                raise Error(errorMsg.decode('utf-8'))
+            return
+
+        if y4m:
+            fileobj.write(<bytes>header)
 
         write = fileobj.write
         writelines = VideoFrame._writelines
@@ -2012,6 +2467,7 @@ cdef class AudioNode(RawNode):
     cdef readonly int sample_rate
     cdef readonly int64_t num_samples
     cdef readonly int num_frames
+    cdef readonly int frame_samples
     
     def __init__(self):
         raise Error('Class cannot be instantiated directly')
@@ -2154,6 +2610,7 @@ cdef AudioNode createAudioNode(VSNode *node, const VSAPI *funcs, Core core):
     instance.sample_rate = instance.ai.sampleRate
     instance.num_samples = instance.ai.numSamples
     instance.num_frames = instance.ai.numFrames
+    instance.frame_samples = funcs.getAudioFrameSamples(node)
     instance.sample_type = SampleType(instance.ai.format.sampleType);
     instance.bits_per_sample = instance.ai.format.bitsPerSample
     instance.bytes_per_sample = instance.ai.format.bytesPerSample
@@ -2182,6 +2639,10 @@ cdef void __stdcall log_handler_free(void *userData) nogil:
     with gil:
         Py_DECREF(<LogHandle>userData)
 
+cdef void __stdcall external_memory_free(void *userData) nogil:
+    with gil:
+        Py_DECREF(<object>userData)
+
 cdef class Core(object):
     cdef VSCore *core
     cdef const VSAPI *funcs
@@ -2224,6 +2685,19 @@ cdef class Core(object):
             new_size = new_size * 1024 * 1024
             self.funcs.setMaxCacheSize(new_size, self.core)
 
+    property core_info:
+        def __get__(self):
+            cdef VSCoreInfo v
+            self.funcs.getCoreInfo(self.core, &v)
+            return {
+                'version_string': (<const char *>v.versionString).decode('utf-8'),
+                'core_version': v.core,
+                'api_version': v.api,
+                'num_threads': v.numThreads,
+                'max_framebuffer_size': v.maxFramebufferSize,
+                'used_framebuffer_size': v.usedFramebufferSize
+            }
+
     def __getattr__(self, name):
         cdef VSPlugin *plugin
         tname = name.encode('utf-8')
@@ -2299,6 +2773,39 @@ cdef class Core(object):
         else:
             return createVideoFormat(&fmt, self.funcs, self.core)
 
+    def create_video_frame(self, format, int width, int height, planes):
+        # the planes are used in place when their rows are aligned, the memoryviews keep them alive until the
+        # frame and everything sharing its planes are gone
+        cdef VSVideoFormat fmt
+        cdef const uint8_t *ptrs[3]
+        cdef ptrdiff_t strides[3]
+        cdef Py_buffer *buf
+        cdef int p
+        if not self.funcs.getVideoFormatByID(&fmt, int(format), self.core):
+            raise Error('Invalid format specified')
+        if width <= 0 or height <= 0:
+            raise ValueError('Frame dimensions must be positive')
+        planes = tuple(planes)
+        if len(planes) != fmt.numPlanes:
+            raise ValueError(f'{fmt.numPlanes} planes must be given')
+
+        views = []
+        for p in range(fmt.numPlanes):
+            view = PyMemoryView_FromObject(planes[p])
+            buf = PyMemoryView_GET_BUFFER(view)
+            pw = width >> (fmt.subSamplingW if p else 0)
+            ph = height >> (fmt.subSamplingH if p else 0)
+            if buf.ndim != 2 or buf.shape[0] != ph or buf.shape[1] != pw or buf.itemsize != fmt.bytesPerSample or buf.strides[1] != fmt.bytesPerSample or buf.suboffsets != NULL:
+                raise ValueError(f'Plane {p} must be a ({ph}, {pw}) buffer of {fmt.bytesPerSample} byte samples with contiguous rows')
+            ptrs[p] = <const uint8_t *>buf.buf
+            strides[p] = buf.strides[0]
+            views.append(view)
+
+        views = tuple(views)
+        Py_INCREF(views)
+        cdef VSFrame *f = self.funcs.newVideoFrameExternal(&fmt, width, height, ptrs, strides, external_memory_free, <void *>views, NULL, self.core)
+        return createVideoFrame(f, self.funcs, self.core)
+
     def get_format(self, uint32_t id):
         #import warnings
         #warnings.warn("get_format() is deprecated. Use \"get_video_format\" instead.", DeprecationWarning)
@@ -2401,7 +2908,10 @@ def get_core(threads = None, add_cache = None):
     
 cdef Core vsscript_get_core_internal(EnvironmentData env):
     if env.core is None:
-        env.core = createCore(env)
+        # a callback running on another thread may get here first when there is no GIL
+        with _policy_lock:
+            if env.core is None:
+                env.core = createCore(env)
     return env.core
     
 cdef class _CoreProxy(object):
@@ -2953,7 +3463,12 @@ cdef void _vpy_replace_pyenvdict(VSScript *se, dict pyenvdict):
         se.pyenvdict = <void*>pyenvdict
 
 
+# names each incremental evaluation added to the script dict, keyed by script id
+cdef dict _vsscript_script_names = {}
+
 cdef int _vpy_evaluate(VSScript *se, bytes script, str filename):
+    cdef EnvironmentData env
+    cdef Core core = None
     try:
         pyenvdict = {}
         if se.pyenvdict:
@@ -2976,9 +3491,24 @@ cdef int _vpy_evaluate(VSScript *se, bytes script, str filename):
             Py_DECREF(errstr)
             errstr = None
 
-        with _vsscript_use_or_create_environment2(se.id, se).use():
+        environment = _vsscript_use_or_create_environment2(se.id, se)
+        if se.incremental:
+            # drop what the last evaluation created so only its reusable nodes survive
+            for name in _vsscript_script_names.pop(se.id, ()):
+                pyenvdict.pop(name, None)
+            env = _get_vsscript_policy().get_environment(se.id)
+            env.outputs.clear()
+            core = vsscript_get_core_internal(env)
+            core.funcs.setNodeReuse(core.core, 1)
+            old_names = set(pyenvdict)
+
+        with environment.use():
             exec(code, pyenvdict, pyenvdict)
 
+        if core is not None:
+            _vsscript_script_names[se.id] = [name for name in pyenvdict if name not in old_names]
+            core.funcs.releaseUnusedNodes(core.core)
+
     except SystemExit, e:
         se.exitCode = e.code
         errstr = 'Python exit with code ' + str(e.code) + '\n'
@@ -3109,6 +3639,7 @@ cdef public api void vpy4_freeScript(VSScript *se) nogil:
             Py_DECREF(errstr)
             errstr = None
 
+        _vsscript_script_names.pop(se.id, None)
         try:
             _get_vsscript_policy()._free_environment(se.id)
         except:
@@ -3168,6 +3699,31 @@ cdef public api int vpy4_getAltOutputMode(VSScript *se, int index) nogil:
             return output[2]   
         return 0
         
+cdef public api int vpy4_setOutput(VSScript *se, int index, VSNode *node, VSNode *alpha, int altOutput) nogil:
+    with gil:
+        try:
+            env = _get_vsscript_policy().get_environment(se.id)
+            core = vsscript_get_core_internal(env)
+            funcs = getVSAPIInternal()
+            clip = createNode(funcs.addNodeRef(node), funcs, core)
+            if alpha != NULL or altOutput != 0:
+                env.outputs[index] = AlphaOutputTuple(clip, createNode(funcs.addNodeRef(alpha), funcs, core) if alpha != NULL else None, altOutput)
+            else:
+                env.outputs[index] = clip
+        except:
+            return 1
+        return 0
+
+cdef public api void vpy4_setError(VSScript *se, const char *error) nogil:
+    with gil:
+        if se.errstr:
+            errstr = <bytes>se.errstr
+            se.errstr = NULL
+            Py_DECREF(errstr)
+        errstr = <bytes>error
+        Py_INCREF(errstr)
+        se.errstr = <void *>errstr
+
 cdef public api int vpy_clearOutput(VSScript *se, int index) nogil:
     with gil:
         try:
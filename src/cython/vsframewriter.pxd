@@ -0,0 +1,31 @@
+#
+# Copyright (c) 2021 Fredrik Mellbin
+#
+# This file is part of VapourSynth.
+#
+# VapourSynth is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# VapourSynth is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with VapourSynth; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+#
+
+from libc.stdint cimport uint8_t
+from libc.stddef cimport ptrdiff_t
+from vapoursynth cimport VSAPI, VSNode, VSVideoInfo
+
+cdef extern from "src/common/framewriter.h" nogil:
+
+    ctypedef int (__stdcall *VSFWProgress)(int written, int total, void *userData)
+
+    int vsfwGetY4MHeader(const VSVideoInfo *vi, char *buf, size_t size)
+    int vsfwOutputNode(VSNode *node, int fd, int y4m, int requests, VSFWProgress progress, void *userData, char *errorMsg, size_t errorSize, const VSAPI *vsapi)
+    int vsfwCopyFrames(VSNode *node, int start, int count, uint8_t *dst, const ptrdiff_t *strides, int requests, char *errorMsg, size_t errorSize, const VSAPI *vsapi)
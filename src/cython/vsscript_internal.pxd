@@ -29,3 +29,4 @@ cdef extern from "src/vsscript/vsscript_internal.h" nogil:
         int id
         int exitCode
         int setCWD
+        int incremental
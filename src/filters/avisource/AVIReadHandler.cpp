@@ -281,8 +281,259 @@ public:
     VDFile        mFile;
     VDFile        mFileUnbuffered;
     sint64        mFileSize;
+
+    // A read-only view of the whole file, chunks are copied straight out of it
+    // instead of going through seek and read on the shared handle. It's null
+    // when the file can't be mapped, e.g. when it doesn't fit into the address
+    // space of a 32 bit process, and everything falls back to mFile.
+    HANDLE        mhMapFile;
+    HANDLE        mhMapping;
+    const char    *mpView;
+
+    // Where the index cache of this file lives and the time stamp it's keyed by
+    // together with the file size.
+    VDStringW    mIndexCachePath;
+    uint64        mLastWriteTime;
+
+    AVIFileDesc() : mFileSize(0), mhMapFile(INVALID_HANDLE_VALUE), mhMapping(nullptr), mpView(nullptr), mLastWriteTime(0) {}
+    ~AVIFileDesc() { Unmap(); }
+
+    void Open(const wchar_t *pszFile);
+    void Map(const wchar_t *pszFile);
+    void Unmap();
+};
+
+void AVIFileDesc::Open(const wchar_t *pszFile) {
+    mFile.open(pszFile, nsVDFile::kRead | nsVDFile::kDenyWrite | nsVDFile::kOpenExisting | nsVDFile::kSequential);
+    mFileUnbuffered.openNT(pszFile, nsVDFile::kRead | nsVDFile::kDenyWrite | nsVDFile::kOpenExisting | nsVDFile::kUnbuffered);
+    mFileSize = mFile.size();
+    Map(pszFile);
+
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (GetFileAttributesExW(pszFile, GetFileExInfoStandard, &attr)) {
+        mLastWriteTime = ((uint64)attr.ftLastWriteTime.dwHighDateTime << 32) + attr.ftLastWriteTime.dwLowDateTime;
+        mIndexCachePath = pszFile;
+        mIndexCachePath += L".vsidx";
+    }
+}
+
+void AVIFileDesc::Map(const wchar_t *pszFile) {
+    if (mFileSize <= 0 || (uint64)mFileSize > (uint64)(size_t)-1)
+        return;
+
+    mhMapFile = CreateFileW(pszFile, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (mhMapFile == INVALID_HANDLE_VALUE)
+        return;
+
+    mhMapping = CreateFileMappingW(mhMapFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mhMapping)
+        mpView = (const char *)MapViewOfFile(mhMapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (!mpView)
+        Unmap();
+}
+
+void AVIFileDesc::Unmap() {
+    if (mpView)
+        UnmapViewOfFile(mpView);
+    if (mhMapping)
+        CloseHandle(mhMapping);
+    if (mhMapFile != INVALID_HANDLE_VALUE)
+        CloseHandle(mhMapFile);
+
+    mpView = nullptr;
+    mhMapping = nullptr;
+    mhMapFile = INVALID_HANDLE_VALUE;
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+//    Index cache
+//
+//    Reading the index of a huge capture means walking all the OpenDML
+//    index blocks spread over the file or, without a usable index, scanning
+//    every chunk. For files of at least kAVIIndexCacheMinSize the result is
+//    saved next to the file and mapped on the next open, keyed by the file
+//    size and last write time. The cache holds the header and one
+//    AVIIndexCacheStream per stream followed by the chunks of all streams in
+//    VDAVIReadIndex::Save() format. It's only an optimization, a cache that
+//    can't be written or doesn't match is ignored.
+//
+///////////////////////////////////////////////////////////////////////////
+
+static const sint64 kAVIIndexCacheMinSize = 0x40000000;
+
+struct AVIIndexCacheHeader {
+    enum {
+        kSignature            = 'XISV',
+        kVersion            = 1,
+
+        kFlagFakeIndex        = 1,
+        kFlagPaletteChanges    = 2,
+        kFlagDamaged        = 4
+    };
+
+    uint32    mSignature;
+    uint32    mVersion;
+    uint64    mFileSize;
+    uint64    mLastWriteTime;
+    uint32    mStreamCount;
+    uint32    mFlags;
+};
+
+struct AVIIndexCacheStream {
+    sint64    mBytes;
+    uint32    mChunkCount;
+    uint32    mfccType;
 };
 
+class AVIIndexCache {
+public:
+    AVIIndexCache() : mhFile(INVALID_HANDLE_VALUE), mhMapping(nullptr), mpView(nullptr) {}
+    ~AVIIndexCache() { Close(); }
+
+    bool Open(const AVIFileDesc& desc);
+    void Close();
+
+    const AVIIndexCacheHeader& GetHeader() const { return *(const AVIIndexCacheHeader *)mpView; }
+    const AVIIndexCacheStream *GetStreams() const { return (const AVIIndexCacheStream *)(mpView + sizeof(AVIIndexCacheHeader)); }
+    const void *GetChunks() const { return mpView + sizeof(AVIIndexCacheHeader) + GetHeader().mStreamCount * sizeof(AVIIndexCacheStream); }
+
+    static void Write(const AVIFileDesc& desc, uint32 flags, List2<AVIStreamNode>& streamlist);
+
+protected:
+    HANDLE        mhFile;
+    HANDLE        mhMapping;
+    const char    *mpView;
+};
+
+bool AVIIndexCache::Open(const AVIFileDesc& desc) {
+    if (desc.mFileSize < kAVIIndexCacheMinSize || desc.mIndexCachePath.empty())
+        return false;
+
+    mhFile = CreateFileW(desc.mIndexCachePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mhFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mhFile, &size) || (uint64)size.QuadPart < sizeof(AVIIndexCacheHeader) || (uint64)size.QuadPart > (uint64)(size_t)-1) {
+        Close();
+        return false;
+    }
+
+    mhMapping = CreateFileMappingW(mhFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mhMapping)
+        mpView = (const char *)MapViewOfFile(mhMapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (!mpView) {
+        Close();
+        return false;
+    }
+
+    const AVIIndexCacheHeader& hdr = GetHeader();
+    bool valid = hdr.mSignature == AVIIndexCacheHeader::kSignature
+        && hdr.mVersion == AVIIndexCacheHeader::kVersion
+        && hdr.mFileSize == (uint64)desc.mFileSize
+        && hdr.mLastWriteTime == desc.mLastWriteTime
+        && hdr.mStreamCount < 0x10000;
+
+    if (valid) {
+        uint64 expected = sizeof(AVIIndexCacheHeader) + (uint64)hdr.mStreamCount * sizeof(AVIIndexCacheStream);
+
+        if (expected > (uint64)size.QuadPart)
+            valid = false;
+        else {
+            for(uint32 i=0; i<hdr.mStreamCount; ++i)
+                expected += (uint64)GetStreams()[i].mChunkCount * VDAVIReadIndex::kSavedChunkSize;
+
+            valid = expected == (uint64)size.QuadPart;
+        }
+    }
+
+    if (!valid)
+        Close();
+
+    return valid;
+}
+
+void AVIIndexCache::Close() {
+    if (mpView)
+        UnmapViewOfFile(mpView);
+    if (mhMapping)
+        CloseHandle(mhMapping);
+    if (mhFile != INVALID_HANDLE_VALUE)
+        CloseHandle(mhFile);
+
+    mpView = nullptr;
+    mhMapping = nullptr;
+    mhFile = INVALID_HANDLE_VALUE;
+}
+
+void AVIIndexCache::Write(const AVIFileDesc& desc, uint32 flags, List2<AVIStreamNode>& streamlist) {
+    if (desc.mFileSize < kAVIIndexCacheMinSize || desc.mIndexCachePath.empty())
+        return;
+
+    AVIStreamNode *pasn, *pasn_next;
+    uint32 streamCount = 0;
+
+    for(pasn = streamlist.AtHead(); pasn_next = pasn->NextFromHead(); pasn = pasn_next)
+        ++streamCount;
+
+    vdfastvector<uint8> buf;
+    buf.resize(sizeof(AVIIndexCacheHeader) + streamCount * sizeof(AVIIndexCacheStream));
+
+    AVIIndexCacheHeader& hdr = *(AVIIndexCacheHeader *)buf.data();
+    hdr.mSignature        = AVIIndexCacheHeader::kSignature;
+    hdr.mVersion        = AVIIndexCacheHeader::kVersion;
+    hdr.mFileSize        = desc.mFileSize;
+    hdr.mLastWriteTime    = desc.mLastWriteTime;
+    hdr.mStreamCount    = streamCount;
+    hdr.mFlags            = flags;
+
+    uint32 i = 0;
+    for(pasn = streamlist.AtHead(); pasn_next = pasn->NextFromHead(); pasn = pasn_next) {
+        AVIIndexCacheStream& st = ((AVIIndexCacheStream *)(buf.data() + sizeof(AVIIndexCacheHeader)))[i++];
+
+        st.mBytes        = pasn->bytes;
+        st.mChunkCount    = pasn->mIndex.GetChunkCount();
+        st.mfccType        = pasn->hdr.fccType;
+    }
+
+    for(pasn = streamlist.AtHead(); pasn_next = pasn->NextFromHead(); pasn = pasn_next)
+        pasn->mIndex.Save(buf);
+
+    // Write to a temporary file and move it into place so a reader never maps a
+    // partially written cache.
+    VDStringW tempPath(desc.mIndexCachePath);
+    tempPath += L".tmp";
+
+    HANDLE h = CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return;
+
+    const uint8 *src = buf.data();
+    size_t left = buf.size();
+    bool success = true;
+
+    while(left) {
+        DWORD tc = (DWORD)std::min<size_t>(left, 0x10000000);
+        DWORD actual;
+
+        if (!WriteFile(h, src, tc, &actual, nullptr) || actual != tc) {
+            success = false;
+            break;
+        }
+
+        src += tc;
+        left -= tc;
+    }
+
+    CloseHandle(h);
+
+    if (!success || !MoveFileExW(tempPath.c_str(), desc.mIndexCachePath.c_str(), MOVEFILE_REPLACE_EXISTING))
+        DeleteFileW(tempPath.c_str());
+}
+
 class AVIStreamNode;
 
 class AVIReadHandler : public IAVIReadHandler, public IAVIReadCacheSource {
@@ -307,6 +558,7 @@ public:
     void AdjustRealTime(bool fRealTime);
     void FixCacheProblems(class AVIReadStream *);
     long ReadData(int stream, void *buffer, sint64 position, long len);
+    bool isMapped();
 
 public:    // IAVIReadCacheSource
     bool Stream(AVIStreamNode *, _int64 pos);
@@ -347,6 +599,10 @@ private:
     bool        mbFileIsDamaged;
     bool        mbPaletteChangesDetected;
 
+    // Set while parsing a file whose index comes from its index cache, the index
+    // blocks in the file are skipped then.
+    bool        mbIndexCached;
+
     int            mTextInfoCodePage;
     int            mTextInfoCountryCode;
     int            mTextInfoLanguage;
@@ -359,6 +615,7 @@ private:
 
     void        _construct(const wchar_t *pszFile);
     void        _parseFile(List2<AVIStreamNode>& streams);
+    bool        _parseFile(List2<AVIStreamNode>& streams, const AVIIndexCache *cache, uint32& cacheFlags);
     bool        _parseStreamHeader(List2<AVIStreamNode>& streams, uint32 dwLengthLeft, bool& bIndexDamaged);
     bool        _parseIndexBlock(List2<AVIStreamNode>& streams, int count, sint64);
     void        _parseExtendedIndexBlock(List2<AVIStreamNode>& streams, AVIStreamNode *pasn, sint64 fpos, uint32 dwLength);
@@ -639,7 +896,7 @@ sint32 AVIReadStream::Read(VDPosition lStart, long lSamples, void *lpBuffer, lon
                 if (tc > bytecnt)
                     tc = (uint32)bytecnt;
 
-                if (psnData->cache && fStreamingActive && tc < psnData->cache->getMaxRead()) {
+                if (psnData->cache && fStreamingActive && tc < psnData->cache->getMaxRead() && !parent->isMapped()) {
                     lActual = psnData->cache->Read(lpBuffer, chunkPos - 8, chunkPos + chunkOffset, tc);
                     psnData->stream_bytes += lActual;
                 } else
@@ -744,7 +1001,7 @@ sint32 AVIReadStream::Read(VDPosition lStart, long lSamples, void *lpBuffer, lon
 
             // read data
 
-            if (psnData->cache && fStreamingActive && byteSize < psnData->cache->getMaxRead()) {
+            if (psnData->cache && fStreamingActive && byteSize < psnData->cache->getMaxRead() && !parent->isMapped()) {
 //OutputDebugString("[v] attempting cached read\n");
                 lActual = psnData->cache->Read(lpBuffer, chunkPos - 8, chunkPos + chunkOffset, byteSize);
                 psnData->stream_bytes += lActual;
@@ -929,6 +1186,7 @@ VDTime AVIReadStream::PositionToTime(VDPosition sample) {
 
 AVIReadHandler::AVIReadHandler(const wchar_t *s)
     : mbFileIsDamaged(false)
+    , mbIndexCached(false)
     , mTextInfoCodePage(0)
     , mTextInfoCountryCode(0)
     , mTextInfoLanguage(0)
@@ -962,9 +1220,7 @@ void AVIReadHandler::_construct(const wchar_t *pszFile) {
             throw MyMemoryError();
 
         // open file
-        pDesc->mFile.open(pszFile, nsVDFile::kRead | nsVDFile::kDenyWrite | nsVDFile::kOpenExisting | nsVDFile::kSequential);
-        pDesc->mFileUnbuffered.openNT(pszFile, nsVDFile::kRead | nsVDFile::kDenyWrite | nsVDFile::kOpenExisting | nsVDFile::kUnbuffered);
-        pDesc->mFileSize = pDesc->mFile.size();
+        pDesc->Open(pszFile);
 
         mpCurrentFile = pDesc;
         mCurrentFile = -1;
@@ -991,9 +1247,7 @@ bool AVIReadHandler::AppendFile(const wchar_t *pszFile) {
     if (!pDesc)
         throw MyMemoryError();
 
-    pDesc->mFile.open(pszFile, nsVDFile::kRead | nsVDFile::kDenyWrite | nsVDFile::kOpenExisting | nsVDFile::kSequential);
-    pDesc->mFileUnbuffered.openNT(pszFile, nsVDFile::kRead | nsVDFile::kDenyWrite | nsVDFile::kOpenExisting | nsVDFile::kUnbuffered);
-    pDesc->mFileSize = pDesc->mFile.size();
+    pDesc->Open(pszFile);
     mFiles.push_back(pDesc.release());
 
     mpCurrentFile = mFiles.back();
@@ -1162,6 +1416,36 @@ bool AVIReadHandler::AppendFile(const wchar_t *pszFile) {
 }
 
 void AVIReadHandler::_parseFile(List2<AVIStreamNode>& streamlist) {
+    AVIIndexCache cache;
+    uint32 cacheFlags = 0;
+
+    if (cache.Open(*mpCurrentFile)) {
+        const int streamsBefore = streams;
+        const size_t textInfoBefore = mTextInfo.size();
+
+        if (_parseFile(streamlist, &cache, cacheFlags))
+            return;
+
+        // The cache matched the size and time stamp of the file but not its
+        // streams. Throw away what was parsed and read the index from the file.
+        AVIStreamNode *pasn;
+        while(pasn = streamlist.RemoveTail())
+            delete pasn;
+
+        streams = streamsBefore;
+        while(mTextInfo.size() > textInfoBefore)
+            mTextInfo.pop_back();
+
+        cache.Close();
+        mpCurrentFile->mFile.seek(0);
+    }
+
+    _parseFile(streamlist, nullptr, cacheFlags);
+
+    AVIIndexCache::Write(*mpCurrentFile, cacheFlags, streamlist);
+}
+
+bool AVIReadHandler::_parseFile(List2<AVIStreamNode>& streamlist, const AVIIndexCache *cache, uint32& cacheFlags) {
     uint32 fccType;
     uint32 dwLength;
     bool index_found = false;
@@ -1197,6 +1481,7 @@ void AVIReadHandler::_parseFile(List2<AVIStreamNode>& streamlist) {
 
     // begin parsing chunks
     mbPaletteChangesDetected = false;
+    mbIndexCached = cache != nullptr;
 
     sint64    infoChunkEnd = 0;
     sint64    fileSize = mpCurrentFile->mFile.size();
@@ -1277,7 +1562,7 @@ void AVIReadHandler::_parseFile(List2<AVIStreamNode>& streamlist) {
 
             switch(fccType) {
             case VDMAKEFOURCC('i', 'd', 'x', '1'):
-                if (!hyperindexed) {
+                if (!hyperindexed && !mbIndexCached) {
                     index_found = _parseIndexBlock(streamlist, dwLength/16, i64ChunkMoviPos);
                     dwLength &= 15;
                 }
@@ -1397,7 +1682,41 @@ void AVIReadHandler::_parseFile(List2<AVIStreamNode>& streamlist) {
 
 terminate_scan:
 
-    if (!hyperindexed && !index_found)
+    mbIndexCached = false;
+
+    if (cache) {
+        const AVIIndexCacheHeader& hdr = cache->GetHeader();
+        const AVIIndexCacheStream *st = cache->GetStreams();
+        uint32 n = 0;
+
+        for(pasn = streamlist.AtHead(); pasn_next = pasn->NextFromHead(); pasn = pasn_next) {
+            if (n >= hdr.mStreamCount || st[n].mfccType != pasn->hdr.fccType)
+                return false;
+            ++n;
+        }
+
+        if (n != hdr.mStreamCount)
+            return false;
+
+        const void *src = cache->GetChunks();
+
+        for(pasn = streamlist.AtHead(); pasn_next = pasn->NextFromHead(); pasn = pasn_next, ++st) {
+            pasn->mIndex.Clear();
+            src = pasn->mIndex.Load(src, st->mChunkCount);
+            pasn->bytes = st->mBytes;
+        }
+
+        if (hdr.mFlags & AVIIndexCacheHeader::kFlagFakeIndex)
+            fFakeIndex = true;
+
+        if (hdr.mFlags & AVIIndexCacheHeader::kFlagPaletteChanges)
+            mbPaletteChangesDetected = true;
+
+        if (hdr.mFlags & AVIIndexCacheHeader::kFlagDamaged)
+            bAggressive = true;
+
+        bScanRequired = false;
+    } else if (!hyperindexed && !index_found)
         bScanRequired = true;
 
     if (bScanRequired) {
@@ -1426,6 +1745,7 @@ terminate_scan:
         long length = (hyperindexed || bAggressive) ? long_length : short_length;
 
         fFakeIndex = true;
+        cacheFlags |= AVIIndexCacheHeader::kFlagFakeIndex;
 
         mpCurrentFile->mFile.seek(i64ChunkMoviPos);
 
@@ -1577,6 +1897,12 @@ terminate_scan:
 
     mbFileIsDamaged |= bAggressive;
 
+    if (mbPaletteChangesDetected)
+        cacheFlags |= AVIIndexCacheHeader::kFlagPaletteChanges;
+
+    if (bAggressive)
+        cacheFlags |= AVIIndexCacheHeader::kFlagDamaged;
+
     // glue together indices
 
     pasn = streamlist.AtHead();
@@ -1644,6 +1970,8 @@ terminate_scan:
     }
 
 //    throw MyError("Parse complete.  Aborting.");
+
+    return true;
 }
 
 bool AVIReadHandler::_parseStreamHeader(List2<AVIStreamNode>& streamlist, uint32 dwLengthLeft, bool& bIndexDamaged) {
@@ -1754,10 +2082,12 @@ bool AVIReadHandler::_parseStreamHeader(List2<AVIStreamNode>& streamlist, uint32
     pasn->mIndex.Init(sampsize);
 
     if (extendedIndexPos >= 0) {
-        try {
-            _parseExtendedIndexBlock(streamlist, pasn, extendedIndexPos, dwLength);
-        } catch(const MyError&) {
-            bIndexDamaged = true;
+        if (!mbIndexCached) {
+            try {
+                _parseExtendedIndexBlock(streamlist, pasn, extendedIndexPos, dwLength);
+            } catch(const MyError&) {
+                bIndexDamaged = true;
+            }
         }
 
         hyperindexed = true;
@@ -2391,7 +2721,30 @@ void AVIReadHandler::FixCacheProblems(AVIReadStream *arse) {
     }
 }
 
+bool AVIReadHandler::isMapped() {
+    for (AVIFileDesc *desc : mFiles)
+        if (!desc->mpView)
+            return false;
+
+    return true;
+}
+
 long AVIReadHandler::ReadData(int stream, void *buffer, sint64 position, long len) {
+    const AVIFileDesc *desc = mFiles[(int)(position>>48)];
+
+    // Mapped files don't touch the current file or its position, so streams can read concurrently.
+    if (desc->mpView) {
+        sint64 offset = position & 0x0000FFFFFFFFFFFFi64;
+
+        if (offset > desc->mFileSize)
+            return -1;
+        if (len > desc->mFileSize - offset)
+            len = (long)(desc->mFileSize - offset);
+
+        memcpy(buffer, desc->mpView + offset, len);
+        return len;
+    }
+
     if (mCurrentFile<0 || mCurrentFile != (int)(position>>48))
         SelectFile((int)(position>>48));
 
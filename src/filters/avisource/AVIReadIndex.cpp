@@ -304,6 +304,46 @@ void VDAVIReadIndex::Append(const VDAVIReadIndex& src, sint64 bytePosOffset) {
     Finalize();
 }
 
+void VDAVIReadIndex::Save(vdfastvector<uint8>& dst) const {
+    VDASSERT(mbFinalized);
+
+    size_t pos = dst.size();
+    dst.resize(pos + (size_t)mChunkCount * kSavedChunkSize);
+
+    uint8 *p = dst.data() + pos;
+    const SectorEntry *sec = &mSectors[0];
+    uint32 next = sec[1].mChunkOffset;
+    for(uint32 i=0; i<mChunkCount; ++i) {
+        if (i >= next) {
+            ++sec;
+            next = sec[1].mChunkOffset;
+        }
+
+        const IndexEntry& ient = mIndex[i >> kBlockSizeBits][i & kBlockMask];
+
+        sint64 bytePos = sec->mByteOffset + ient.mByteOffset;
+        memcpy(p, &bytePos, 8);
+        memcpy(p + 8, &ient.mSizeAndKeyFrameFlag, 4);
+        p += kSavedChunkSize;
+    }
+}
+
+const void *VDAVIReadIndex::Load(const void *src, uint32 chunkCount) {
+    const uint8 *p = (const uint8 *)src;
+
+    for(uint32 i=0; i<chunkCount; ++i) {
+        sint64 bytePos;
+        uint32 sizeAndKey;
+
+        memcpy(&bytePos, p, 8);
+        memcpy(&sizeAndKey, p + 8, 4);
+        AddChunk(bytePos, sizeAndKey);
+        p += kSavedChunkSize;
+    }
+
+    return p;
+}
+
 void VDAVIReadIndex::Finalize() {
     if (mbFinalized)
         return;
@@ -65,6 +65,14 @@ public:
     void    Append(const VDAVIReadIndex& src, sint64 bytePosOffset);
     void    Finalize();
 
+    // Flat copies of the chunk list for the index cache, every chunk is stored as
+    // its 64 bit position followed by the size and key frame flag. Save() needs
+    // a finalized index, Load() adds the chunks like AddChunk().
+    enum { kSavedChunkSize = 12 };
+
+    void    Save(vdfastvector<uint8>& dst) const;
+    const void *Load(const void *src, uint32 chunkCount);
+
 protected:
     enum {
         kBlockSizeBits    = 10,
@@ -22,6 +22,9 @@
 // been rewritten during the porting
 
 #include <stdexcept>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
 #include "stdafx.h"
 
 #include "VapourSynth4.h"
@@ -174,27 +177,48 @@ static void unpackframe(const VSVideoInfo *vi, VSFrame *dst, VSFrame *dst_alpha,
     }
 }
 
+// A decompressor instance and the buffers frames are decoded through. The first one uses hic, streams
+// with only keyframes open another one whenever all of them are busy so frames can be decoded in parallel.
+struct Decompressor {
+    HIC hic;
+    bool ex;
+    BITMAPINFOHEADER *pbiSrc; // a copy unless it's the first one, biSizeImage changes with every frame
+    BYTE *srcbuffer;
+    int srcbuffer_size;
+    BYTE *decbuf;
+};
+
 class AVISource {
     IAVIReadHandler *pfile;
     IAVIReadStream *pvideo;
     HIC hic;
     VSVideoInfo vi[2];
-    BYTE* srcbuffer;
-    int srcbuffer_size;
     BITMAPINFOHEADER* pbiSrc;
+    long pbiSrcSize;
     BITMAPINFOHEADER biDst;
     bool ex;
     bool bIsType1;
     bool bInvertFrames;
     char buf[1024];
-    BYTE* decbuf;
     bool output_alpha;
+    bool parallel;
+
+    std::vector<Decompressor *> decompressors;
+    std::vector<Decompressor *> idle;
+    bool decompressorsExhausted;
+    std::mutex decompressorMutex;
+    std::condition_variable decompressorReleased;
+    std::mutex readMutex; // the streams keep their read position so only one frame is read at a time
 
     VSFrame *last_frame;
     int last_frame_no;
 
-    LRESULT DecompressBegin(LPBITMAPINFOHEADER lpbiSrc, LPBITMAPINFOHEADER lpbiDst);
-    LRESULT DecompressFrame(int n, bool preroll, bool &dropped_frame, VSFrame *frame, VSFrame *alpha, VSCore *core, const VSAPI *vsapi);
+    static LRESULT DecompressBegin(HIC hic, bool &ex, LPBITMAPINFOHEADER lpbiSrc, LPBITMAPINFOHEADER lpbiDst);
+    LRESULT DecompressFrame(Decompressor &dc, int n, bool preroll, bool &dropped_frame, VSFrame *frame, VSFrame *alpha, VSCore *core, const VSAPI *vsapi);
+    Decompressor *CreateDecompressor();
+    Decompressor *AcquireDecompressor();
+    void ReleaseDecompressor(Decompressor *dc);
+    const VSFrame *GetIntraFrame(int n, VSCore *core, const VSAPI *vsapi);
 
     void CheckHresult(HRESULT hr, const char* msg, VSCore *core, const VSAPI *vsapi);
     bool AttemptCodecNegotiation(DWORD fccHandler, BITMAPINFOHEADER* bmih);
@@ -228,8 +252,9 @@ public:
             bool output_alpha = !!vsapi->mapGetInt(in, "alpha", 0, &err);
 
             AVISource *avs = new AVISource(path, pixel_type, fourCC, output_alpha, static_cast<int>(mode), core, vsapi);
-            VSNode *node = vsapi->createVideoFilter2("AVISource", avs->vi, filterGetFrame, filterFree, fmUnordered, nullptr, 0, static_cast<void *>(avs), core);
-            vsapi->setLinearFilter(node);
+            VSNode *node = vsapi->createVideoFilter2("AVISource", avs->vi, filterGetFrame, filterFree, avs->parallel ? fmParallel : fmUnordered, nullptr, 0, static_cast<void *>(avs), core);
+            if (!avs->parallel)
+                vsapi->setLinearFilter(node);
             vsapi->mapConsumeNode(out, "clip", node, maAppend);
         } catch (std::runtime_error &e) {
             vsapi->mapSetError(out, e.what());
@@ -282,7 +307,7 @@ bool AVISource::DecompressQuery(uint32_t format, VSCore *core, const VSAPI *vsap
 }
 
 
-LRESULT AVISource::DecompressBegin(LPBITMAPINFOHEADER lpbiSrc, LPBITMAPINFOHEADER lpbiDst) {
+LRESULT AVISource::DecompressBegin(HIC hic, bool &ex, LPBITMAPINFOHEADER lpbiSrc, LPBITMAPINFOHEADER lpbiDst) {
     if (!ex) {
         LRESULT result = ICDecompressBegin(hic, lpbiSrc, lpbiDst);
         if (result != ICERR_UNSUPPORTED)
@@ -296,50 +321,114 @@ LRESULT AVISource::DecompressBegin(LPBITMAPINFOHEADER lpbiSrc, LPBITMAPINFOHEADE
         lpbiDst, 0, 0, 0, lpbiDst->biWidth, lpbiDst->biHeight);
 }
 
-LRESULT AVISource::DecompressFrame(int n, bool preroll, bool &dropped_frame, VSFrame *frame, VSFrame *alpha, VSCore *core, const VSAPI *vsapi) {
+LRESULT AVISource::DecompressFrame(Decompressor &dc, int n, bool preroll, bool &dropped_frame, VSFrame *frame, VSFrame *alpha, VSCore *core, const VSAPI *vsapi) {
     _RPT2(0,"AVISource: Decompressing frame %d%s\n", n, preroll ? " (preroll)" : "");
     long bytes_read;
-    if (!hic) {
-        bytes_read = pbiSrc->biSizeImage;
-        pvideo->Read(n, 1, decbuf, pbiSrc->biSizeImage, &bytes_read, nullptr);
+    if (!dc.hic) {
+        bytes_read = dc.pbiSrc->biSizeImage;
+        {
+            std::lock_guard<std::mutex> lock(readMutex);
+            pvideo->Read(n, 1, dc.decbuf, dc.pbiSrc->biSizeImage, &bytes_read, nullptr);
+        }
         dropped_frame = !bytes_read;
-        unpackframe(vi, frame, alpha, decbuf, bytes_read, pbiSrc->biCompression, pbiSrc->biBitCount, bInvertFrames, vsapi);
+        unpackframe(vi, frame, alpha, dc.decbuf, bytes_read, dc.pbiSrc->biCompression, dc.pbiSrc->biBitCount, bInvertFrames, vsapi);
         return ICERR_OK;
     }
-    bytes_read = srcbuffer_size;
-    LRESULT err = pvideo->Read(n, 1, srcbuffer, srcbuffer_size, &bytes_read, nullptr);
-    while (err == AVIERR_BUFFERTOOSMALL || (err == 0 && !srcbuffer)) {
-        delete[] srcbuffer;
-        pvideo->Read(n, 1, 0, srcbuffer_size, &bytes_read, nullptr);
-        srcbuffer_size = bytes_read;
-        srcbuffer = new BYTE[bytes_read + 16]; // Provide 16 hidden guard bytes for HuffYUV, Xvid, etc bug
-        err = pvideo->Read(n, 1, srcbuffer, srcbuffer_size, &bytes_read, nullptr);
+    bool keyframe;
+    {
+        std::lock_guard<std::mutex> lock(readMutex);
+        bytes_read = dc.srcbuffer_size;
+        LRESULT err = pvideo->Read(n, 1, dc.srcbuffer, dc.srcbuffer_size, &bytes_read, nullptr);
+        while (err == AVIERR_BUFFERTOOSMALL || (err == 0 && !dc.srcbuffer)) {
+            delete[] dc.srcbuffer;
+            pvideo->Read(n, 1, 0, dc.srcbuffer_size, &bytes_read, nullptr);
+            dc.srcbuffer_size = bytes_read;
+            dc.srcbuffer = new BYTE[bytes_read + 16]; // Provide 16 hidden guard bytes for HuffYUV, Xvid, etc bug
+            err = pvideo->Read(n, 1, dc.srcbuffer, dc.srcbuffer_size, &bytes_read, nullptr);
+        }
+        keyframe = pvideo->IsKeyFrame(n);
     }
     dropped_frame = !bytes_read;
     if (dropped_frame) return ICERR_OK;  // If frame is 0 bytes (dropped), return instead of attempt decompressing as Vdub.
 
     // Fill guard bytes with 0xA5's for Xvid bug
-    memset(srcbuffer + bytes_read, 0xA5, 16);
+    memset(dc.srcbuffer + bytes_read, 0xA5, 16);
     // and a Null terminator for good measure
-    srcbuffer[bytes_read + 15] = 0;
+    dc.srcbuffer[bytes_read + 15] = 0;
 
     int flags = preroll ? ICDECOMPRESS_PREROLL : 0;
     flags |= dropped_frame ? ICDECOMPRESS_NULLFRAME : 0;
-    flags |= !pvideo->IsKeyFrame(n) ? ICDECOMPRESS_NOTKEYFRAME : 0;
-    pbiSrc->biSizeImage = bytes_read;
-    LRESULT ret = (!ex ? ICDecompress(hic, flags, pbiSrc, srcbuffer, &biDst, decbuf)
-        : ICDecompressEx(hic, flags, pbiSrc, srcbuffer, 0, 0, vi[0].width, vi[0].height, &biDst, decbuf, 0, 0, vi[0].width, vi[0].height));
+    flags |= !keyframe ? ICDECOMPRESS_NOTKEYFRAME : 0;
+    dc.pbiSrc->biSizeImage = bytes_read;
+    LRESULT ret = (!dc.ex ? ICDecompress(dc.hic, flags, dc.pbiSrc, dc.srcbuffer, &biDst, dc.decbuf)
+        : ICDecompressEx(dc.hic, flags, dc.pbiSrc, dc.srcbuffer, 0, 0, vi[0].width, vi[0].height, &biDst, dc.decbuf, 0, 0, vi[0].width, vi[0].height));
 
     if (ret != ICERR_OK)
         return ret;
 
-    unpackframe(vi, frame, alpha, decbuf, 0, biDst.biCompression, biDst.biBitCount, bInvertFrames, vsapi);
+    unpackframe(vi, frame, alpha, dc.decbuf, 0, biDst.biCompression, biDst.biBitCount, bInvertFrames, vsapi);
 
-    vsapi->mapSetData(vsapi->getFramePropertiesRW(frame), "_PictType", pvideo->IsKeyFrame(n) ? "I" : "P", 1, dtUtf8, maAppend);
+    vsapi->mapSetData(vsapi->getFramePropertiesRW(frame), "_PictType", keyframe ? "I" : "P", 1, dtUtf8, maAppend);
 
     return ICERR_OK;
 }
 
+// Opens one more instance of the decompressor that was negotiated for the stream, returns null
+// when the codec won't give out another one
+Decompressor *AVISource::CreateDecompressor() {
+    Decompressor *dc = new Decompressor();
+    dc->pbiSrc = pbiSrc;
+
+    if (hic) {
+        ICINFO info = {};
+        info.dwSize = sizeof(info);
+        if (ICGetInfo(hic, &info, sizeof(info)))
+            dc->hic = ICOpen(ICTYPE_VIDEO, info.fccHandler, ICMODE_DECOMPRESS);
+        if (dc->hic) {
+            dc->pbiSrc = (BITMAPINFOHEADER *)malloc(pbiSrcSize);
+            if (dc->pbiSrc)
+                memcpy(dc->pbiSrc, pbiSrc, pbiSrcSize);
+        }
+        if (!dc->hic || !dc->pbiSrc || DecompressBegin(dc->hic, dc->ex, dc->pbiSrc, &biDst) != ICERR_OK) {
+            if (dc->hic)
+                ICClose(dc->hic);
+            if (dc->pbiSrc != pbiSrc)
+                free(dc->pbiSrc);
+            delete dc;
+            return nullptr;
+        }
+    }
+
+    dc->decbuf = vsh_aligned_malloc<BYTE>(hic ? biDst.biSizeImage : pbiSrc->biSizeImage, 32);
+    return dc;
+}
+
+Decompressor *AVISource::AcquireDecompressor() {
+    std::unique_lock<std::mutex> lock(decompressorMutex);
+    while (idle.empty()) {
+        if (!decompressorsExhausted) {
+            Decompressor *dc = CreateDecompressor();
+            if (dc) {
+                decompressors.push_back(dc);
+                return dc;
+            }
+            decompressorsExhausted = true;
+        }
+        decompressorReleased.wait(lock);
+    }
+    Decompressor *dc = idle.back();
+    idle.pop_back();
+    return dc;
+}
+
+void AVISource::ReleaseDecompressor(Decompressor *dc) {
+    {
+        std::lock_guard<std::mutex> lock(decompressorMutex);
+        idle.push_back(dc);
+    }
+    decompressorReleased.notify_one();
+}
+
 
 void AVISource::CheckHresult(HRESULT hr, const char* msg, VSCore *core, const VSAPI *vsapi) {
     if (SUCCEEDED(hr)) return;
@@ -417,6 +506,7 @@ void AVISource::LocateVideoCodec(const char fourCC[], VSCore *core, const VSAPI
         pbiSrc = (LPBITMAPINFOHEADER)malloc(size);
         CheckHresult(pvideo->ReadFormat(0, pbiSrc, &size), "couldn't get video format", core, vsapi);
     }
+    pbiSrcSize = size;
 
     vi[0].width = pbiSrc->biWidth;
     vi[0].height = abs(pbiSrc->biHeight);
@@ -497,8 +587,8 @@ void AVISource::LocateVideoCodec(const char fourCC[], VSCore *core, const VSAPI
 
 
 AVISource::AVISource(const char filename[], const char pixel_type[], const char fourCC[], bool output_alpha, int mode, VSCore *core, const VSAPI *vsapi)
-    : output_alpha(output_alpha), last_frame_no(-1), last_frame(nullptr), srcbuffer(nullptr), srcbuffer_size(0), ex(false), pbiSrc(nullptr),
-    pvideo(nullptr), pfile(nullptr), bIsType1(false), hic(0), bInvertFrames(false), decbuf(nullptr)  {
+    : output_alpha(output_alpha), last_frame_no(-1), last_frame(nullptr), ex(false), pbiSrc(nullptr), pbiSrcSize(0),
+    pvideo(nullptr), pfile(nullptr), bIsType1(false), hic(0), bInvertFrames(false), parallel(false), decompressorsExhausted(false)  {
     vi[0] = {};
     vi[1] = {};
 
@@ -634,7 +724,7 @@ AVISource::AVISource(const char filename[], const char pixel_type[], const char
                     if (bOpen)
                         throw std::runtime_error("AviSource: Could not open video stream in any supported format.");
 
-                    DecompressBegin(pbiSrc, &biDst);
+                    DecompressBegin(hic, ex, pbiSrc, &biDst);
                     if ((biDst.biCompression == BI_RGB) && (biDst.biHeight > 0))
                         bInvertFrames = true;
                 }
@@ -648,13 +738,19 @@ AVISource::AVISource(const char filename[], const char pixel_type[], const char
         bool dropped_frame = false;
 
         if (mode != MODE_WAV) {
-            decbuf = vsh_aligned_malloc<BYTE>(hic ? biDst.biSizeImage : pbiSrc->biSizeImage, 32);
+            Decompressor *primary = new Decompressor();
+            primary->hic = hic;
+            primary->ex = ex;
+            primary->pbiSrc = pbiSrc;
+            primary->decbuf = vsh_aligned_malloc<BYTE>(hic ? biDst.biSizeImage : pbiSrc->biSizeImage, 32);
+            decompressors.push_back(primary);
+
             int keyframe = pvideo->NearestKeyFrame(0);
             VSFrame *frame = vsapi->newVideoFrame(&vi[0].format, vi[0].width, vi[0].height, nullptr, core);
             VSFrame *alpha_frame = nullptr;
             if (output_alpha)
                 alpha_frame = vsapi->newVideoFrame(&vi[1].format, vi[1].width, vi[1].height, nullptr, core);
-            LRESULT error = DecompressFrame(keyframe, false, dropped_frame, frame, alpha_frame, core, vsapi);
+            LRESULT error = DecompressFrame(*primary, keyframe, false, dropped_frame, frame, alpha_frame, core, vsapi);
             if (error != ICERR_OK)   // shutdown, if init not successful.
                 throw std::runtime_error("AviSource: Could not decompress frame 0");
 
@@ -662,7 +758,7 @@ AVISource::AVISource(const char filename[], const char pixel_type[], const char
             // frames, just return the first key frame
             if (dropped_frame) {
                 keyframe = pvideo->NextKeyFrame(0);
-                error = DecompressFrame(keyframe, false, dropped_frame, frame, alpha_frame, core, vsapi);
+                error = DecompressFrame(*primary, keyframe, false, dropped_frame, frame, alpha_frame, core, vsapi);
                 if (error != ICERR_OK) {   // shutdown, if init not successful.
                     sprintf(buf, "AviSource: Could not decompress first keyframe %d", keyframe);
                     throw std::runtime_error(buf);
@@ -675,6 +771,11 @@ AVISource::AVISource(const char filename[], const char pixel_type[], const char
                 vsapi->mapConsumeFrame(vsapi->getFramePropertiesRW(frame), "_Alpha", alpha_frame, maAppend);
             }
             last_frame = frame;
+
+            // every frame can be decoded on its own, reads through the avifile tunnel stay on one thread
+            parallel = (mode == MODE_OPENDML) && pvideo->isKeyframeOnly();
+            if (parallel)
+                idle.push_back(primary);
         }
     } catch (std::runtime_error &) {
         AVISource::CleanUp(vsapi);
@@ -686,6 +787,20 @@ AVISource::AVISource(const char filename[], const char pixel_type[], const char
 }
 
 void AVISource::CleanUp(const VSAPI *vsapi) {
+    for (Decompressor *dc : decompressors) {
+        if (dc->hic && dc->hic != hic) {
+            !dc->ex ? ICDecompressEnd(dc->hic) : ICDecompressExEnd(dc->hic);
+            ICClose(dc->hic);
+        }
+        if (dc->pbiSrc != pbiSrc)
+            free(dc->pbiSrc);
+        delete[] dc->srcbuffer;
+        vsh_aligned_free(dc->decbuf);
+        delete dc;
+    }
+    decompressors.clear();
+    idle.clear();
+
     if (hic) {
         !ex ? ICDecompressEnd(hic) : ICDecompressExEnd(hic);
         ICClose(hic);
@@ -695,14 +810,51 @@ void AVISource::CleanUp(const VSAPI *vsapi) {
         pfile->Release();
     AVIFileExit();
     free(pbiSrc);
-    delete[] srcbuffer;
-    vsh_aligned_free(decbuf);
 
     vsapi->freeFrame(last_frame);
 }
 
+// Requests for streams with only keyframes each borrow a decompressor and decode just the frame asked for
+const VSFrame *AVISource::GetIntraFrame(int n, VSCore *core, const VSAPI *vsapi) {
+    Decompressor *dc = AcquireDecompressor();
+    VSFrame *frame = vsapi->newVideoFrame(&vi[0].format, vi[0].width, vi[0].height, nullptr, core);
+    VSFrame *alpha_frame = nullptr;
+    if (output_alpha)
+        alpha_frame = vsapi->newVideoFrame(&vi[1].format, vi[1].width, vi[1].height, nullptr, core);
+
+    bool frameok = false;
+    try {
+        // dropped frames repeat the last one before them
+        for (int i = n; i >= 0 && !frameok; i--) {
+            bool dropped_frame = false;
+            LRESULT error = DecompressFrame(*dc, i, false, dropped_frame, frame, alpha_frame, core, vsapi);
+            frameok = !dropped_frame && error == ICERR_OK;
+        }
+    } catch (...) {
+        ReleaseDecompressor(dc);
+        vsapi->freeFrame(frame);
+        vsapi->freeFrame(alpha_frame);
+        throw;
+    }
+    ReleaseDecompressor(dc);
+
+    if (!frameok) {
+        vsapi->freeFrame(frame);
+        vsapi->freeFrame(alpha_frame);
+        throw std::runtime_error("AVISource: failed to decode frame " + std::to_string(n));
+    }
+
+    if (output_alpha)
+        vsapi->mapConsumeFrame(vsapi->getFramePropertiesRW(frame), "_Alpha", alpha_frame, maAppend);
+
+    return frame;
+}
+
 const VSFrame *AVISource::GetFrame(int n, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     n = min(max(n, 0), vi[0].numFrames - 1);
+    if (parallel)
+        return GetIntraFrame(n, core, vsapi);
+
     bool dropped_frame = false;
     if (n != last_frame_no || !last_frame) {
         // find the last keyframe
@@ -723,7 +875,7 @@ const VSFrame *AVISource::GetFrame(int n, VSFrameContext *frameCtx, VSCore *core
                     frame = vsapi->newVideoFrame(&vi[0].format, vi[0].width, vi[0].height, nullptr, core);
                 if (output_alpha && !alpha_frame)
                     alpha_frame = vsapi->newVideoFrame(&vi[1].format, vi[1].width, vi[1].height, nullptr, core);
-                LRESULT error = DecompressFrame(i, i != n, dropped_frame, frame, alpha_frame, core, vsapi);
+                LRESULT error = DecompressFrame(*decompressors.front(), i, i != n, dropped_frame, frame, alpha_frame, core, vsapi);
                 if ((!dropped_frame) && (error == ICERR_OK))
                     frameok = true;   // Better safe than sorry
                 if (frameok) {
@@ -33,129 +33,107 @@
 #include "VapourSynth4.h"
 #include "VSHelper4.h"
 #include "VSConstants4.h"
+#include "eedi3.h"
+
+#if defined(VS_TARGET_CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
 
 typedef struct {
     VSNode *node;
     VSVideoInfo vi;
 
     VSNode *sclip;
+    VSNode *mclip;
 
     int dh, hp, ucubic, cost3;
     int planes;
     float alpha, beta, gamma,  vthresh0, vthresh1, vthresh2;
     int field, nrad, mdis, vcheck;
+    eedi3CostsFunc costs;
+    eedi3PathFunc path;
 } eedi3Data;
 
-static void interpLineFP(const uint8_t *srcp, const int width, const ptrdiff_t pitch,
-                         const float alpha, const float beta, const float gamma, const int nrad,
-                         const int mdis, float *temp, uint8_t *dstp, int *dmap, const int ucubic,
-                         const int cost3)
+void eedi3CostsFP_c(const uint8_t *src3p, const uint8_t *src1p, const uint8_t *src1n, const uint8_t *src3n,
+                    int width, float alpha, float beta, int nrad, int mdis, int cost3, const uint8_t *mask, float *ccosts)
 {
-    const uint8_t *src3p = srcp - 3 * pitch;
-    const uint8_t *src1p = srcp - 1 * pitch;
-    const uint8_t *src1n = srcp + 1 * pitch;
-    const uint8_t *src3n = srcp + 3 * pitch;
     const ptrdiff_t tpitch = mdis * 2 + 1;
-    float *ccosts = temp;
-    float *pcosts = ccosts + width * tpitch;
-    int *pbackt = (int *)(pcosts + width * tpitch);
-    int *fpath = pbackt + width * tpitch;
-
-    int k, u, v, x;
+    int u, x;
 
-    // calculate all connection costs
-    if(!cost3) {
-        for(x = 0; x < width; ++x) {
-            const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
-
-            for(u = -umax; u <= umax; ++u) {
-                int s = 0;
-
-                for(k = -nrad; k <= nrad; ++k)
-                    s +=
-                        abs(src3p[x + u + k] - src1p[x - u + k]) +
-                        abs(src1p[x + u + k] - src1n[x - u + k]) +
-                        abs(src1n[x + u + k] - src3n[x - u + k]);
+    for(x = 0; x < width; ++x) {
+        const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
 
-                const int ip = (src1p[x + u] + src1n[x - u] + 1) >> 1; // should use cubic if ucubic=true
-                const int v = abs(src1p[x] - ip) + abs(src1n[x] - ip);
-                ccosts[x * tpitch + mdis + u] = alpha * s + beta * abs(u) + (1.0f - alpha - beta) * v;
-            }
+        if(mask && !mask[x]) {
+            for(u = -umax; u <= umax; ++u)
+                ccosts[x * tpitch + mdis + u] = beta * abs(u);
+            continue;
         }
-    } else {
-        for(x = 0; x < width; ++x) {
-            const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
-
-            for(u = -umax; u <= umax; ++u) {
-                int s0 = 0, s1 = -1, s2 = -1;
-
-                for(k = -nrad; k <= nrad; ++k)
-                    s0 +=
-                        abs(src3p[x + u + k] - src1p[x - u + k]) +
-                        abs(src1p[x + u + k] - src1n[x - u + k]) +
-                        abs(src1n[x + u + k] - src3n[x - u + k]);
-
-                if((u >= 0 && x >= u * 2) || (u <= 0 && x < width + u * 2)) {
-                    s1 = 0;
-
-                    for(k = -nrad; k <= nrad; ++k)
-                        s1 +=
-                            abs(src3p[x + k] - src1p[x - u * 2 + k]) +
-                            abs(src1p[x + k] - src1n[x - u * 2 + k]) +
-                            abs(src1n[x + k] - src3n[x - u * 2 + k]);
-                }
-
-                if((u <= 0 && x >= u * 2) || (u >= 0 && x < width + u * 2)) {
-                    s2 = 0;
 
-                    for(k = -nrad; k <= nrad; ++k)
-                        s2 +=
-                            abs(src3p[x + u * 2 + k] - src1p[x + k]) +
-                            abs(src1p[x + u * 2 + k] - src1n[x + k]) +
-                            abs(src1n[x + u * 2 + k] - src3n[x + k]);
-                }
-
-                s1 = s1 >= 0 ? s1 : (s2 >= 0 ? s2 : s0);
-                s2 = s2 >= 0 ? s2 : (s1 >= 0 ? s1 : s0);
-                const int ip = (src1p[x + u] + src1n[x - u] + 1) >> 1; // should use cubic if ucubic=true
-                const int v = abs(src1p[x] - ip) + abs(src1n[x] - ip);
-                ccosts[x * tpitch + mdis + u] = alpha * (s0 + s1 + s2) * 0.333333f + beta * abs(u) + (1.0f - alpha - beta) * v;
-            }
-        }
+        for(u = -umax; u <= umax; ++u)
+            ccosts[x * tpitch + mdis + u] = eedi3CostFP(src3p, src1p, src1n, src3n, x, u, width, alpha, beta, nrad, cost3);
     }
+}
 
-    // calculate path costs
-    pcosts[mdis] = ccosts[mdis];
+void eedi3PathCosts_c(const float *ccosts, float *pcosts, int *pbackt, int width, int mdis, int step, float gamma)
+{
+    const int c = mdis * step;
+    const ptrdiff_t tpitch = c * 2 + 1;
+    const float scale = step == 1 ? 1.0f : 0.5f;
+    int u, x;
 
-    for(x = 1; x < width; ++x) {
-        float *tT = ccosts + x * tpitch;
-        float *ppT = pcosts + (x - 1) * tpitch;
-        float *pT = pcosts + x * tpitch;
-        int *piT = pbackt + (x - 1) * tpitch;
-        const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
+    pcosts[c] = ccosts[c];
 
-        for(u = -umax; u <= umax; ++u) {
-            int idx = 0;
-            float bval = FLT_MAX;
-            const int umax2 = VSMIN(VSMIN(x - 1, width - x), mdis);
+    for(x = 1; x < width; ++x) {
+        const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis) * step;
+        const int umax2 = VSMIN(VSMIN(x - 1, width - x), mdis) * step;
 
-            for(v = VSMAX(-umax2, u - 1); v <= VSMIN(umax2, u + 1); ++v) {
-                const double y = ppT[mdis + v] + gamma * abs(u - v);
-                const float ccost = (float)VSMIN(y, FLT_MAX * 0.9);
+        for(u = -umax; u <= umax; ++u)
+            eedi3PathCost(pcosts + (x - 1) * tpitch, ccosts + x * tpitch, pcosts + x * tpitch, pbackt + (x - 1) * tpitch,
+                          c, u, umax2, step, gamma, scale);
+    }
+}
 
-                if(ccost < bval) {
-                    bval = ccost;
-                    idx = v;
-                }
-            }
+#ifdef VS_TARGET_CPU_X86
+static int hasAVX2(void)
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0);
+    if(regs[0] < 7)
+        return 0;
+    __cpuid(regs, 1);
+    // osxsave, avx and fma, the os also has to save the ymm registers
+    if((regs[2] & 0x18001000) != 0x18001000 || (_xgetbv(0) & 6) != 6)
+        return 0;
+    __cpuidex(regs, 7, 0);
+    return !!(regs[1] & (1 << 5));
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+#endif
 
-            const double y = bval + tT[mdis + u];
+static void interpLineFP(const uint8_t *srcp, const int width, const ptrdiff_t pitch,
+                         const float alpha, const float beta, const float gamma, const int nrad,
+                         const int mdis, float *temp, uint8_t *dstp, int *dmap, const int ucubic,
+                         const int cost3, const uint8_t *mask, eedi3CostsFunc costs, eedi3PathFunc path)
+{
+    const uint8_t *src3p = srcp - 3 * pitch;
+    const uint8_t *src1p = srcp - 1 * pitch;
+    const uint8_t *src1n = srcp + 1 * pitch;
+    const uint8_t *src3n = srcp + 3 * pitch;
+    const ptrdiff_t tpitch = mdis * 2 + 1;
+    float *ccosts = temp;
+    float *pcosts = ccosts + width * tpitch;
+    int *pbackt = (int *)(pcosts + width * tpitch);
+    int *fpath = pbackt + width * tpitch;
 
-            pT[mdis + u] = (float)VSMIN(y, FLT_MAX * 0.9);
+    int x;
 
-            piT[mdis + u] = idx;
-        }
-    }
+    costs(src3p, src1p, src1n, src3n, width, alpha, beta, nrad, mdis, cost3, mask, ccosts);
+    path(ccosts, pcosts, pbackt, width, mdis, 1, gamma);
 
     // backtrack
     fpath[width - 1] = 0;
@@ -181,7 +159,7 @@ static void interpLineFP(const uint8_t *srcp, const int width, const ptrdiff_t p
 static void interpLineHP(const uint8_t *srcp, const int width, const ptrdiff_t pitch,
                          const float alpha, const float beta, const float gamma, const int nrad,
                          const int mdis, float *temp, uint8_t *dstp, int *dmap, const int ucubic,
-                         const int cost3)
+                         const int cost3, const uint8_t *mask, eedi3CostsFunc costs, eedi3PathFunc path)
 {
     const uint8_t *src3p = srcp - 3 * pitch;
     const uint8_t *src1p = srcp - 1 * pitch;
@@ -198,7 +176,7 @@ static void interpLineHP(const uint8_t *srcp, const int width, const ptrdiff_t p
     uint8_t *hp1n = hp1p + width;
     uint8_t *hp3n = hp1n + width;
 
-    int k, u, v, x;
+    int k, u, x;
 
     for(x = 0; x < width - 1; ++x) {
         if(!ucubic || (x == 0 || x == width - 2)) {
@@ -219,6 +197,12 @@ static void interpLineHP(const uint8_t *srcp, const int width, const ptrdiff_t p
         for(x = 0; x < width; ++x) {
             const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
 
+            if(mask && !mask[x]) {
+                for(u = -umax * 2; u <= umax * 2; ++u)
+                    ccosts[x * tpitch + mdis * 2 + u] = beta * abs(u) * 0.5f;
+                continue;
+            }
+
             for(u = -umax * 2; u <= umax * 2; ++u) {
                 int s = 0, ip;
                 const int u2 = u >> 1;
@@ -250,6 +234,12 @@ static void interpLineHP(const uint8_t *srcp, const int width, const ptrdiff_t p
         for(x = 0; x < width; ++x) {
             const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
 
+            if(mask && !mask[x]) {
+                for(u = -umax * 2; u <= umax * 2; ++u)
+                    ccosts[x * tpitch + mdis * 2 + u] = beta * abs(u) * 0.5f;
+                continue;
+            }
+
             for(u = -umax * 2; u <= umax * 2; ++u) {
                 int s0 = 0, s1 = -1, s2 = -1, ip;
                 const int u2 = u >> 1;
@@ -301,37 +291,7 @@ static void interpLineHP(const uint8_t *srcp, const int width, const ptrdiff_t p
     }
 
     // calculate path costs
-    pcosts[mdis * 2] = ccosts[mdis * 2];
-
-    for(x = 1; x < width; ++x) {
-        float *tT = ccosts + x * tpitch;
-        float *ppT = pcosts + (x - 1) * tpitch;
-        float *pT = pcosts + x * tpitch;
-        int *piT = pbackt + (x - 1) * tpitch;
-        const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
-
-        for(u = -umax * 2; u <= umax * 2; ++u) {
-            int idx = 0;
-            float bval = FLT_MAX;
-            const int umax2 = VSMIN(VSMIN(x - 1, width - x), mdis);
-
-            for(v = VSMAX(-umax2 * 2, u - 2); v <= VSMIN(umax2 * 2, u + 2); ++v) {
-                const double y = ppT[mdis * 2 + v] + gamma * abs(u - v) * 0.5f;
-                const float ccost = (float)VSMIN(y, FLT_MAX * 0.9);
-
-                if(ccost < bval) {
-                    bval = ccost;
-                    idx = v;
-                }
-            }
-
-            const double y = bval + tT[mdis * 2 + u];
-
-            pT[mdis * 2 + u] = (float)VSMIN(y, FLT_MAX * 0.9);
-
-            piT[mdis * 2 + u] = idx;
-        }
-    }
+    path(ccosts, pcosts, pbackt, width, mdis, 2, gamma);
 
     // backtrack
     fpath[width - 1] = 0;
@@ -373,6 +333,39 @@ static void interpLineHP(const uint8_t *srcp, const int width, const ptrdiff_t p
 }
 
 
+static int maskIsEmpty(const uint8_t *maskp, const int width)
+{
+    int x;
+
+    for(x = 0; x < width; ++x)
+        if(maskp[x])
+            return 0;
+
+    return 1;
+}
+
+
+// pixels outside the mask take cint, the same value vcheck falls back to
+static void fillUnmasked(const uint8_t *srcp, const int width, const ptrdiff_t pitch, const uint8_t *maskp,
+                         const uint8_t *scpp, uint8_t *dstp, int *dmap)
+{
+    const uint8_t *src3p = srcp - 3 * pitch;
+    const uint8_t *src1p = srcp - 1 * pitch;
+    const uint8_t *src1n = srcp + 1 * pitch;
+    const uint8_t *src3n = srcp + 3 * pitch;
+    int x;
+
+    for(x = 0; x < width; ++x) {
+        if(maskp[x])
+            continue;
+
+        dstp[x] = scpp ? scpp[x] :
+                  VSMIN(VSMAX((36 * (src1p[x] + src1n[x]) - 4 * (src3p[x] + src3n[x]) + 32) >> 6, 0), 255);
+        dmap[x] = 0;
+    }
+}
+
+
 static VSFrame *copyPad(const VSFrame *src, int fn, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi, void *instanceData)
 {
     eedi3Data *d = (eedi3Data *)instanceData;
@@ -446,6 +439,9 @@ static const VSFrame *VS_CC eedi3GetFrame(int n, int activationReason, void *ins
 
         if(d->sclip)
             vsapi->requestFrameFilter(n, d->sclip, frameCtx);
+
+        if(d->mclip)
+            vsapi->requestFrameFilter(n, d->mclip, frameCtx);
     } else if(activationReason == arAllFramesReady) {
 
         const VSFrame *src = vsapi->getFrameFilter(d->field > 1 ? (n >> 1) : n, d->node, frameCtx);
@@ -477,11 +473,13 @@ static const VSFrame *VS_CC eedi3GetFrame(int n, int activationReason, void *ins
 
         const VSFrame *scpPF;
 
-        if(d->vcheck > 0 && d->sclip)
+        if((d->vcheck > 0 || d->mclip) && d->sclip)
             scpPF = vsapi->getFrameFilter(n, d->sclip, frameCtx);
         else
             scpPF = NULL;
 
+        const VSFrame *mskPF = d->mclip ? vsapi->getFrameFilter(n, d->mclip, frameCtx) : NULL;
+
         VSFrame *dst = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, src, core);
         vsapi->freeFrame(src);
 
@@ -489,6 +487,7 @@ static const VSFrame *VS_CC eedi3GetFrame(int n, int activationReason, void *ins
         VSH_ALIGNED_MALLOC((void **)&workspace, d->vi.width * VSMAX(d->mdis * 4 + 1, 16) * 4 * sizeof(float), 16);
         if (!workspace){
             vsapi->setFilterError("EEDI3: Memory allocation failed", frameCtx);
+            vsapi->freeFrame(mskPF);
             vsapi->freeFrame(scpPF);
             vsapi->freeFrame(srcPF);
             vsapi->freeFrame(dst);
@@ -500,6 +499,7 @@ static const VSFrame *VS_CC eedi3GetFrame(int n, int activationReason, void *ins
         if (!dmapa) {
             VSH_ALIGNED_FREE(workspace);
             vsapi->setFilterError("EEDI3: Memory allocation failed", frameCtx);
+            vsapi->freeFrame(mskPF);
             vsapi->freeFrame(scpPF);
             vsapi->freeFrame(srcPF);
             vsapi->freeFrame(dst);
@@ -525,18 +525,45 @@ static const VSFrame *VS_CC eedi3GetFrame(int n, int activationReason, void *ins
             srcp += (4 + field_n) * spitch;
             dstp += field_n * dpitch;
 
+            const uint8_t *mskp = NULL;
+            const uint8_t *sclp = NULL;
+            ptrdiff_t mpitch = 0;
+            ptrdiff_t slpitch = 0;
+
+            if(mskPF) {
+                mpitch = vsapi->getStride(mskPF, b);
+                mskp = vsapi->getReadPtr(mskPF, b) + field_n * mpitch;
+
+                if(scpPF) {
+                    slpitch = vsapi->getStride(scpPF, b);
+                    sclp = vsapi->getReadPtr(scpPF, b) + field_n * slpitch;
+                }
+            }
+
             // ~99% of the processing time is spent in this loop
             for(y = 4 + field_n; y < height - 4; y += 2) {
                 const int off = (y - 4 - field_n) >> 1;
+                const uint8_t *linep = srcp + 12 + off * 2 * spitch;
+                const uint8_t *maskp = mskp ? mskp + off * 2 * mpitch : NULL;
+                const uint8_t *scp = sclp ? sclp + off * 2 * slpitch : NULL;
+
+                // nothing in this line needs the search
+                if(maskp && maskIsEmpty(maskp, width - 24)) {
+                    fillUnmasked(linep, width - 24, spitch, maskp, scp, dstp + off * 2 * dpitch, dmapa + off * dpitch);
+                    continue;
+                }
 
                 if(d->hp)
-                    interpLineHP(srcp + 12 + off * 2 * spitch, width - 24, spitch, d->alpha, d->beta,
+                    interpLineHP(linep, width - 24, spitch, d->alpha, d->beta,
                                  d->gamma, d->nrad, d->mdis, workspace, dstp + off * 2 * dpitch,
-                                 dmapa + off * dpitch, d->ucubic, d->cost3);
+                                 dmapa + off * dpitch, d->ucubic, d->cost3, maskp, d->costs, d->path);
                 else
-                    interpLineFP(srcp + 12 + off * 2 * spitch, width - 24, spitch, d->alpha, d->beta,
+                    interpLineFP(linep, width - 24, spitch, d->alpha, d->beta,
                                  d->gamma, d->nrad, d->mdis, workspace, dstp + off * 2 * dpitch,
-                                 dmapa + off * dpitch, d->ucubic, d->cost3);
+                                 dmapa + off * dpitch, d->ucubic, d->cost3, maskp, d->costs, d->path);
+
+                if(maskp)
+                    fillUnmasked(linep, width - 24, spitch, maskp, scp, dstp + off * 2 * dpitch, dmapa + off * dpitch);
             }
 
             if(d->vcheck > 0) {
@@ -646,6 +673,7 @@ static const VSFrame *VS_CC eedi3GetFrame(int n, int activationReason, void *ins
         VSH_ALIGNED_FREE(workspace);
         vsapi->freeFrame(srcPF);
         vsapi->freeFrame(scpPF);
+        vsapi->freeFrame(mskPF);
 
         if (d->field > 1) {
             VSMap *dst_props = vsapi->getFramePropertiesRW(dst);
@@ -671,6 +699,7 @@ static void VS_CC eedi3Free(void *instanceData, VSCore *core, const VSAPI *vsapi
     eedi3Data *d = (eedi3Data *)instanceData;
     vsapi->freeNode(d->node);
     vsapi->freeNode(d->sclip);
+    vsapi->freeNode(d->mclip);
     free(d);
 }
 
@@ -747,6 +776,22 @@ static void VS_CC eedi3Create(const VSMap *in, VSMap *out, void *userData, VSCor
         d.vthresh2 = 4.0f;
 
     d.sclip = vsapi->mapGetNode(in, "sclip", 0, &err);
+    d.mclip = vsapi->mapGetNode(in, "mclip", 0, &err);
+
+    int opt = vsapi->mapGetIntSaturated(in, "opt", 0, &err);
+
+    if(err)
+        opt = 1;
+
+    d.costs = eedi3CostsFP_c;
+    d.path = eedi3PathCosts_c;
+
+#ifdef VS_TARGET_CPU_X86
+    if(opt && hasAVX2()) {
+        d.costs = eedi3CostsFP_avx2;
+        d.path = eedi3PathCosts_avx2;
+    }
+#endif
 
     d.planes = 0;
     int nump = vsapi->mapNumElements(in, "planes");
@@ -837,7 +882,7 @@ static void VS_CC eedi3Create(const VSMap *in, VSMap *out, void *userData, VSCor
     if(d.dh)
         d.vi.height *= 2;
 
-    if(d.vcheck > 0 && d.sclip) {
+    if((d.vcheck > 0 || d.mclip) && d.sclip) {
         const VSVideoInfo *vi2 = vsapi->getVideoInfo(d.sclip);
 
         if(!vsh_isSameVideoInfo(&d.vi, vi2)) {
@@ -846,17 +891,31 @@ static void VS_CC eedi3Create(const VSMap *in, VSMap *out, void *userData, VSCor
         }
     }
 
+    if(d.mclip && !vsh_isSameVideoInfo(&d.vi, vsapi->getVideoInfo(d.mclip))) {
+        snprintf(msg, sizeof(msg), "eedi3: mclip doesn't match!");
+        goto error;
+    }
+
 
     data = (eedi3Data *)malloc(sizeof(d));
     *data = d;
 
-    VSFilterDependency deps[] = {{d.node, rpStrictSpatial}};
-    vsapi->createVideoFilter(out, "eedi3", &data->vi, eedi3GetFrame, eedi3Free, fmParallel, deps, 1, data, core);
+    VSFilterDependency deps[3] = {{d.node, rpStrictSpatial}};
+    int numDeps = 1;
+
+    if(d.sclip)
+        deps[numDeps++] = (VSFilterDependency){d.sclip, rpStrictSpatial};
+
+    if(d.mclip)
+        deps[numDeps++] = (VSFilterDependency){d.mclip, rpStrictSpatial};
+
+    vsapi->createVideoFilter(out, "eedi3", &data->vi, eedi3GetFrame, eedi3Free, fmParallel, deps, numDeps, data, core);
     return;
 
 error:
     vsapi->freeNode(d.node);
     vsapi->freeNode(d.sclip);
+    vsapi->freeNode(d.mclip);
     vsapi->mapSetError(out, msg);
     return;
 }
@@ -864,6 +923,6 @@ error:
 VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->configPlugin("com.vapoursynth.eedi3", "eedi3", "EEDI3", VS_MAKE_VERSION(1, 0), VAPOURSYNTH_API_VERSION, 0, plugin);
     vspapi->registerFunction("eedi3", "clip:vnode;field:int;dh:int:opt;planes:int[]:opt;alpha:float:opt;beta:float:opt;gamma:float:opt;nrad:int:opt;mdis:int:opt;" \
-        "hp:int:opt;ucubic:int:opt;cost3:int:opt;vcheck:int:opt;vthresh0:float:opt;vthresh1:float:opt;vthresh2:float:opt;sclip:vnode:opt;", "clip:vnode;",
+        "hp:int:opt;ucubic:int:opt;cost3:int:opt;vcheck:int:opt;vthresh0:float:opt;vthresh1:float:opt;vthresh2:float:opt;sclip:vnode:opt;mclip:vnode:opt;opt:int:opt;", "clip:vnode;",
         eedi3Create, NULL, plugin);
 }
@@ -0,0 +1,113 @@
+/*
+**   eedi3 cost and path kernels shared by the scalar and SIMD implementations.
+**
+**   Copyright (C) 2010 Kevin Stone
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef EEDI3_H
+#define EEDI3_H
+
+#include <float.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "VSHelper4.h"
+
+// Computes the connection costs of a line for every x and every offset u within mdis,
+// ccosts[x * (mdis * 2 + 1) + mdis + u]. Offsets that would leave the line aren't written. If mask
+// is set, pixels where it's 0 only get the direction cost so the path passes through them cheaply.
+typedef void (*eedi3CostsFunc)(const uint8_t *src3p, const uint8_t *src1p, const uint8_t *src1n, const uint8_t *src3n,
+                               int width, float alpha, float beta, int nrad, int mdis, int cost3, const uint8_t *mask, float *ccosts);
+
+// Computes the path costs and the backtracking table from the connection costs. step is 1 for full
+// pel and 2 for half pel offsets, which also halves the penalty for direction changes.
+typedef void (*eedi3PathFunc)(const float *ccosts, float *pcosts, int *pbackt, int width, int mdis, int step, float gamma);
+
+void eedi3CostsFP_c(const uint8_t *src3p, const uint8_t *src1p, const uint8_t *src1n, const uint8_t *src3n,
+                    int width, float alpha, float beta, int nrad, int mdis, int cost3, const uint8_t *mask, float *ccosts);
+void eedi3PathCosts_c(const float *ccosts, float *pcosts, int *pbackt, int width, int mdis, int step, float gamma);
+
+#ifdef VS_TARGET_CPU_X86
+void eedi3CostsFP_avx2(const uint8_t *src3p, const uint8_t *src1p, const uint8_t *src1n, const uint8_t *src3n,
+                       int width, float alpha, float beta, int nrad, int mdis, int cost3, const uint8_t *mask, float *ccosts);
+void eedi3PathCosts_avx2(const float *ccosts, float *pcosts, int *pbackt, int width, int mdis, int step, float gamma);
+#endif
+
+static inline int eedi3Similarity(const uint8_t *src3p, const uint8_t *src1p, const uint8_t *src1n, const uint8_t *src3n,
+                                  int a, int b, int nrad)
+{
+    int k, s = 0;
+
+    for(k = -nrad; k <= nrad; ++k)
+        s +=
+            abs(src3p[a + k] - src1p[b + k]) +
+            abs(src1p[a + k] - src1n[b + k]) +
+            abs(src1n[a + k] - src3n[b + k]);
+
+    return s;
+}
+
+// the scalar reference for a single connection, the SIMD versions must produce the same bits
+static inline float eedi3CostFP(const uint8_t *src3p, const uint8_t *src1p, const uint8_t *src1n, const uint8_t *src3n,
+                                int x, int u, int width, float alpha, float beta, int nrad, int cost3)
+{
+    const int ip = (src1p[x + u] + src1n[x - u] + 1) >> 1; // should use cubic if ucubic=true
+    const int v = abs(src1p[x] - ip) + abs(src1n[x] - ip);
+    const int s0 = eedi3Similarity(src3p, src1p, src1n, src3n, x + u, x - u, nrad);
+
+    if(!cost3)
+        return alpha * s0 + beta * abs(u) + (1.0f - alpha - beta) * v;
+
+    int s1 = -1, s2 = -1;
+
+    if((u >= 0 && x >= u * 2) || (u <= 0 && x < width + u * 2))
+        s1 = eedi3Similarity(src3p, src1p, src1n, src3n, x, x - u * 2, nrad);
+
+    if((u <= 0 && x >= u * 2) || (u >= 0 && x < width + u * 2))
+        s2 = eedi3Similarity(src3p, src1p, src1n, src3n, x + u * 2, x, nrad);
+
+    s1 = s1 >= 0 ? s1 : (s2 >= 0 ? s2 : s0);
+    s2 = s2 >= 0 ? s2 : (s1 >= 0 ? s1 : s0);
+    return alpha * (s0 + s1 + s2) * 0.333333f + beta * abs(u) + (1.0f - alpha - beta) * v;
+}
+
+// the scalar reference for a single offset u of path cost line x, c is the offset of u = 0 in a line
+static inline void eedi3PathCost(const float *ppT, const float *tT, float *pT, int *piT, int c, int u, int umax2,
+                                 int step, float gamma, float scale)
+{
+    int v, idx = 0;
+    float bval = FLT_MAX;
+
+    for(v = VSMAX(-umax2, u - step); v <= VSMIN(umax2, u + step); ++v) {
+        const double y = ppT[c + v] + gamma * abs(u - v) * scale;
+        const float ccost = (float)VSMIN(y, FLT_MAX * 0.9);
+
+        if(ccost < bval) {
+            bval = ccost;
+            idx = v;
+        }
+    }
+
+    const double y = bval + tT[c + u];
+
+    pT[c + u] = (float)VSMIN(y, FLT_MAX * 0.9);
+
+    piT[c + u] = idx;
+}
+
+#endif
@@ -0,0 +1,193 @@
+/*
+**   AVX2 versions of the eedi3 connection and path cost calculations, both are
+**   vectorized across 8 neighbouring offsets and produce the same results as the
+**   scalar code.
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <math.h>
+#include <immintrin.h>
+
+#include "eedi3.h"
+
+// p[0] to p[7]
+static inline __m256i load8(const uint8_t *p)
+{
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+}
+
+// p[0], p[-1] to p[-7]
+static inline __m256i load8Reverse(const uint8_t *p)
+{
+    return _mm256_permutevar8x32_epi32(load8(p - 7), _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+// p[0], p[2] to p[14]
+static inline __m256i load8Even(const uint8_t *p)
+{
+    const __m128i even = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+    return _mm256_cvtepu8_epi32(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p), even));
+}
+
+// p[0], p[-2] to p[-14]
+static inline __m256i load8EvenReverse(const uint8_t *p)
+{
+    const __m128i even = _mm_setr_epi8(15, 13, 11, 9, 7, 5, 3, 1, -1, -1, -1, -1, -1, -1, -1, -1);
+    return _mm256_cvtepu8_epi32(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p - 15)), even));
+}
+
+static inline __m256i absDiff(__m256i a, __m256i b)
+{
+    return _mm256_abs_epi32(_mm256_sub_epi32(a, b));
+}
+
+void eedi3CostsFP_avx2(const uint8_t *src3p, const uint8_t *src1p, const uint8_t *src1n, const uint8_t *src3n,
+                       int width, float alpha, float beta, int nrad, int mdis, int cost3, const uint8_t *mask, float *ccosts)
+{
+    const ptrdiff_t tpitch = mdis * 2 + 1;
+    const __m256 valpha = _mm256_set1_ps(alpha);
+    const __m256 vbeta = _mm256_set1_ps(beta);
+    const __m256 vrest = _mm256_set1_ps(1.0f - alpha - beta);
+    const __m256 vthird = _mm256_set1_ps(0.333333f);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    int k, u, x;
+
+    for(x = 0; x < width; ++x) {
+        const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
+        const __m256i vx = _mm256_set1_epi32(x);
+        const __m256i vxw = _mm256_set1_epi32(x - width);
+        float *dst = ccosts + x * tpitch + mdis;
+
+        if(mask && !mask[x]) {
+            for(u = -umax; u <= umax; ++u)
+                dst[u] = beta * abs(u);
+            continue;
+        }
+
+        for(u = -umax; u + 7 <= umax; u += 8) {
+            const __m256i vu = _mm256_add_epi32(_mm256_set1_epi32(u), lanes);
+            __m256i s0 = _mm256_setzero_si256();
+
+            for(k = -nrad; k <= nrad; ++k) {
+                s0 = _mm256_add_epi32(s0, absDiff(load8(src3p + x + u + k), load8Reverse(src1p + x - u + k)));
+                s0 = _mm256_add_epi32(s0, absDiff(load8(src1p + x + u + k), load8Reverse(src1n + x - u + k)));
+                s0 = _mm256_add_epi32(s0, absDiff(load8(src1n + x + u + k), load8Reverse(src3n + x - u + k)));
+            }
+
+            __m256 sim;
+
+            if(!cost3) {
+                sim = _mm256_mul_ps(valpha, _mm256_cvtepi32_ps(s0));
+            } else {
+                __m256i s1 = _mm256_setzero_si256();
+                __m256i s2 = _mm256_setzero_si256();
+
+                for(k = -nrad; k <= nrad; ++k) {
+                    s1 = _mm256_add_epi32(s1, absDiff(_mm256_set1_epi32(src3p[x + k]), load8EvenReverse(src1p + x - u * 2 + k)));
+                    s1 = _mm256_add_epi32(s1, absDiff(_mm256_set1_epi32(src1p[x + k]), load8EvenReverse(src1n + x - u * 2 + k)));
+                    s1 = _mm256_add_epi32(s1, absDiff(_mm256_set1_epi32(src1n[x + k]), load8EvenReverse(src3n + x - u * 2 + k)));
+                    s2 = _mm256_add_epi32(s2, absDiff(load8Even(src3p + x + u * 2 + k), _mm256_set1_epi32(src1p[x + k])));
+                    s2 = _mm256_add_epi32(s2, absDiff(load8Even(src1p + x + u * 2 + k), _mm256_set1_epi32(src1n[x + k])));
+                    s2 = _mm256_add_epi32(s2, absDiff(load8Even(src1n + x + u * 2 + k), _mm256_set1_epi32(src3n[x + k])));
+                }
+
+                // (u >= 0 && x >= u * 2) || (u <= 0 && x < width + u * 2) for s1 and the mirrored condition for s2
+                const __m256i u2 = _mm256_add_epi32(vu, vu);
+                const __m256i upos = _mm256_cmpgt_epi32(vu, _mm256_set1_epi32(-1));
+                const __m256i uneg = _mm256_cmpgt_epi32(_mm256_set1_epi32(1), vu);
+                const __m256i left = _mm256_cmpgt_epi32(_mm256_add_epi32(vx, _mm256_set1_epi32(1)), u2);
+                const __m256i right = _mm256_cmpgt_epi32(u2, vxw);
+                const __m256i m1 = _mm256_or_si256(_mm256_and_si256(upos, left), _mm256_and_si256(uneg, right));
+                const __m256i m2 = _mm256_or_si256(_mm256_and_si256(uneg, left), _mm256_and_si256(upos, right));
+
+                s1 = _mm256_blendv_epi8(_mm256_blendv_epi8(s0, s2, m2), s1, m1);
+                s2 = _mm256_blendv_epi8(s1, s2, m2);
+
+                const __m256i sum = _mm256_add_epi32(_mm256_add_epi32(s0, s1), s2);
+                sim = _mm256_mul_ps(_mm256_mul_ps(valpha, _mm256_cvtepi32_ps(sum)), vthird);
+            }
+
+            const __m256i p1 = load8(src1p + x + u);
+            const __m256i n1 = load8Reverse(src1n + x - u);
+            const __m256i ip = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(p1, n1), _mm256_set1_epi32(1)), 1);
+            const __m256i v = _mm256_add_epi32(absDiff(_mm256_set1_epi32(src1p[x]), ip), absDiff(_mm256_set1_epi32(src1n[x]), ip));
+
+            __m256 cost = _mm256_add_ps(sim, _mm256_mul_ps(vbeta, _mm256_cvtepi32_ps(_mm256_abs_epi32(vu))));
+            cost = _mm256_add_ps(cost, _mm256_mul_ps(vrest, _mm256_cvtepi32_ps(v)));
+            _mm256_storeu_ps(dst + u, cost);
+        }
+
+        for(; u <= umax; ++u)
+            dst[u] = eedi3CostFP(src3p, src1p, src1n, src3n, x, u, width, alpha, beta, nrad, cost3);
+    }
+}
+
+void eedi3PathCosts_avx2(const float *ccosts, float *pcosts, int *pbackt, int width, int mdis, int step, float gamma)
+{
+    const int c = mdis * step;
+    const ptrdiff_t tpitch = c * 2 + 1;
+    const float scale = step == 1 ? 1.0f : 0.5f;
+    const __m256 limit = _mm256_set1_ps((float)(FLT_MAX * 0.9));
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 penalty[3];
+    int d, u, x;
+
+    for(d = 0; d <= step; ++d)
+        penalty[d] = _mm256_set1_ps(gamma * d * scale);
+
+    pcosts[c] = ccosts[c];
+
+    for(x = 1; x < width; ++x) {
+        float *ppT = pcosts + (x - 1) * tpitch;
+        const float *tT = ccosts + x * tpitch;
+        float *pT = pcosts + x * tpitch;
+        int *piT = pbackt + (x - 1) * tpitch;
+        const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis) * step;
+        const int umax2 = VSMIN(VSMIN(x - 1, width - x), mdis) * step;
+
+        // Offsets beyond umax2 weren't calculated for the previous line, NaN makes sure they're never
+        // picked. umax is at most umax2 + step so up to twice the step is read beyond it. The lower ones
+        // are still inside the previous lines, the upper ones may spill into the start of the current
+        // one which is only written below. Lines too short for a vector only use the scalar code.
+        if(umax * 2 + 1 >= 8) {
+            for(d = 1; d <= step * 2; ++d) {
+                ppT[c - umax2 - d] = NAN;
+                ppT[c + umax2 + d] = NAN;
+            }
+        }
+
+        for(u = -umax; u + 7 <= umax; u += 8) {
+            const __m256i vu = _mm256_add_epi32(_mm256_set1_epi32(u), lanes);
+            __m256 bval = _mm256_set1_ps(FLT_MAX);
+            __m256i idx = _mm256_setzero_si256();
+
+            for(d = -step; d <= step; ++d) {
+                const __m256 y = _mm256_add_ps(_mm256_loadu_ps(ppT + c + u + d), penalty[abs(d)]);
+                // keeps NaN so the comparison below fails for it
+                const __m256 ccost = _mm256_min_ps(limit, y);
+                const __m256 better = _mm256_cmp_ps(ccost, bval, _CMP_LT_OQ);
+                bval = _mm256_blendv_ps(bval, ccost, better);
+                idx = _mm256_blendv_epi8(idx, _mm256_add_epi32(vu, _mm256_set1_epi32(d)), _mm256_castps_si256(better));
+            }
+
+            _mm256_storeu_ps(pT + c + u, _mm256_min_ps(_mm256_add_ps(bval, _mm256_loadu_ps(tT + c + u)), limit));
+            _mm256_storeu_si256((__m256i *)(piT + c + u), idx);
+        }
+
+        for(; u <= umax; ++u)
+            eedi3PathCost(ppT, tT, pT, piT, c, u, umax2, step, gamma, scale);
+    }
+}
@@ -35,6 +35,12 @@
 #include <vector>
 #include <algorithm>
 #include <memory>
+#include <type_traits>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -46,6 +52,11 @@
 #include <unistd.h>
 #endif
 #include "../../core/version.h"
+#include "rawreader.h"
+
+#ifdef VS_TARGET_CPU_X86
+#include <emmintrin.h>
+#endif
 
 // Handle both with and without hdri
 #if MAGICKCORE_HDRI_ENABLE
@@ -167,9 +178,134 @@ static void getWorkingDir(std::string &path) {
 #endif
 }
 
+// Conversion of whole lines between samples and ImageMagick's quantum values. With HDRI a quantum is always
+// a float so there's no layout where the conversion could be skipped, but it can be done for many values at
+// once instead of pixel by pixel.
+
+#ifdef VS_TARGET_CPU_X86
+template<typename Q, typename T>
+static size_t quantumToSamples_sse2(const Q *, T *, size_t, float) {
+    return 0;
+}
+
+static size_t quantumToSamples_sse2(const float *src, uint8_t *dst, size_t count, float scale) {
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 half = _mm_set1_ps(.5f);
+    size_t i;
+    for (i = 0; i + 16 <= count; i += 16) {
+        __m128i v[4];
+        for (int k = 0; k < 4; k++)
+            v[k] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i + k * 4), vscale), half));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3])));
+    }
+    return i;
+}
+
+static size_t quantumToSamples_sse2(const float *src, uint16_t *dst, size_t count, float scale) {
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 half = _mm_set1_ps(.5f);
+    // there's no unsigned pack in sse2, so the values are packed with a bias
+    const __m128i bias = _mm_set1_epi32(32768);
+    size_t i;
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m128i lo = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i), vscale), half));
+        __m128i hi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), vscale), half));
+        __m128i v = _mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(v, _mm_set1_epi16(static_cast<short>(0x8000))));
+    }
+    return i;
+}
+
+static size_t quantumToSamples_sse2(const float *src, float *dst, size_t count, float) {
+    const __m128 range = _mm_set1_ps(QuantumRange);
+    size_t i;
+    for (i = 0; i + 4 <= count; i += 4)
+        _mm_storeu_ps(dst + i, _mm_div_ps(_mm_loadu_ps(src + i), range));
+    return i;
+}
+
+template<typename T, typename Q>
+static int samplesToQuantum_sse2(const T *, Q *, int, unsigned, unsigned) {
+    return 0;
+}
+
+// the scaled values never need more than 16 bits for 8-16 bit input
+static inline void samplesToQuantum_sse2(__m128i v, float *dst, __m128i scale, __m128i shift) {
+    v = _mm_add_epi16(_mm_mullo_epi16(v, scale), _mm_srl_epi16(v, shift));
+    _mm_storeu_ps(dst, _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128())));
+    _mm_storeu_ps(dst + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, _mm_setzero_si128())));
+}
+
+static int samplesToQuantum_sse2(const uint8_t *src, float *dst, int count, unsigned scaleFactor, unsigned shiftFactor) {
+    const __m128i scale = _mm_set1_epi16(static_cast<short>(scaleFactor));
+    const __m128i shift = _mm_cvtsi32_si128(shiftFactor);
+    int i;
+    for (i = 0; i + 8 <= count; i += 8)
+        samplesToQuantum_sse2(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)), _mm_setzero_si128()), dst + i, scale, shift);
+    return i;
+}
+
+static int samplesToQuantum_sse2(const uint16_t *src, float *dst, int count, unsigned scaleFactor, unsigned shiftFactor) {
+    const __m128i scale = _mm_set1_epi16(static_cast<short>(scaleFactor));
+    const __m128i shift = _mm_cvtsi32_si128(shiftFactor);
+    int i;
+    for (i = 0; i + 8 <= count; i += 8)
+        samplesToQuantum_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), dst + i, scale, shift);
+    return i;
+}
+
+static int samplesToQuantum_sse2(const float *src, float *dst, int count, unsigned, unsigned) {
+    const __m128 range = _mm_set1_ps(QuantumRange);
+    int i;
+    for (i = 0; i + 4 <= count; i += 4)
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), range));
+    return i;
+}
+#endif
+
+template<typename T>
+static void quantumToSamples(const Quantum *src, T *dst, size_t count, float scale) {
+    size_t i = 0;
+#ifdef VS_TARGET_CPU_X86
+    i = quantumToSamples_sse2(src, dst, count, scale);
+#endif
+    for (; i < count; i++)
+        dst[i] = (unsigned)(src[i] * scale + .5f);
+}
+
+static void quantumToSamples(const Quantum *src, float *dst, size_t count, float scale) {
+    size_t i = 0;
+#ifdef VS_TARGET_CPU_X86
+    i = quantumToSamples_sse2(src, dst, count, scale);
+#endif
+    for (; i < count; i++)
+        dst[i] = src[i] / QuantumRange;
+}
+
+template<typename T>
+static void samplesToQuantum(const T *src, Quantum *dst, int count, unsigned scaleFactor, unsigned shiftFactor) {
+    int i = 0;
+#ifdef VS_TARGET_CPU_X86
+    i = samplesToQuantum_sse2(src, dst, count, scaleFactor, shiftFactor);
+#endif
+    for (; i < count; i++)
+        dst[i] = src[i] * scaleFactor + (src[i] >> shiftFactor);
+}
+
+static void samplesToQuantum(const float *src, Quantum *dst, int count, unsigned scaleFactor, unsigned shiftFactor) {
+    int i = 0;
+#ifdef VS_TARGET_CPU_X86
+    i = samplesToQuantum_sse2(src, dst, count, scaleFactor, shiftFactor);
+#endif
+    for (; i < count; i++)
+        dst[i] = src[i] * QuantumRange;
+}
+
 //////////////////////////////////////////
 // Write
 
+class WriteQueue;
+
 struct WriteData {
     VSNode *videoNode;
     VSNode *alphaNode;
@@ -182,73 +318,181 @@ struct WriteData {
     MagickCore::CompressionType compressType;
     bool dither;
     bool overwrite;
+    WriteQueue *queue;
 
-    WriteData() : videoNode(nullptr), alphaNode(nullptr), vi(nullptr), quality(0), compressType(MagickCore::UndefinedCompression), dither(true) {}
+    WriteData() : videoNode(nullptr), alphaNode(nullptr), vi(nullptr), quality(0), compressType(MagickCore::UndefinedCompression), dither(true), queue(nullptr) {}
 };
 
 template<typename T>
 static void writeImageHelper(const VSFrame *frame, const VSFrame *alphaFrame, bool isGray, Magick::Image &image, int width, int height, int bitsPerSample, const VSAPI *vsapi) {
-    unsigned prepeat = (MAGICKCORE_QUANTUM_DEPTH - 1) / bitsPerSample;
-    unsigned pleftover = MAGICKCORE_QUANTUM_DEPTH - (bitsPerSample * prepeat);
-    unsigned shiftFactor = bitsPerSample - pleftover;
     unsigned scaleFactor = 0;
-    for (unsigned i = 0; i < prepeat; i++) {
-        scaleFactor <<= bitsPerSample;
-        scaleFactor += 1;
+    unsigned shiftFactor = 0;
+    if (std::is_integral<T>::value) {
+        unsigned prepeat = (MAGICKCORE_QUANTUM_DEPTH - 1) / bitsPerSample;
+        unsigned pleftover = MAGICKCORE_QUANTUM_DEPTH - (bitsPerSample * prepeat);
+        shiftFactor = bitsPerSample - pleftover;
+        for (unsigned i = 0; i < prepeat; i++) {
+            scaleFactor <<= bitsPerSample;
+            scaleFactor += 1;
+        }
+        scaleFactor <<= pleftover;
     }
-    scaleFactor <<= pleftover;
 
     Magick::Pixels pixelCache(image);
 
-    const T * VS_RESTRICT r = reinterpret_cast<const T *>(vsapi->getReadPtr(frame, 0));
-    const T * VS_RESTRICT g = reinterpret_cast<const T *>(vsapi->getReadPtr(frame, isGray ? 0 : 1));
-    const T * VS_RESTRICT b = reinterpret_cast<const T *>(vsapi->getReadPtr(frame, isGray ? 0 : 2));
-    ptrdiff_t strideR = vsapi->getStride(frame, 0);
-    ptrdiff_t strideG = vsapi->getStride(frame, isGray ? 0 : 1);
-    ptrdiff_t strideB = vsapi->getStride(frame, isGray ? 0 : 2);
-    ssize_t rOff = pixelCache.offset(MagickCore::RedPixelChannel);
-    ssize_t gOff = pixelCache.offset(MagickCore::GreenPixelChannel);
-    ssize_t bOff = pixelCache.offset(MagickCore::BluePixelChannel);
+    const T * VS_RESTRICT src[4] = {
+        reinterpret_cast<const T *>(vsapi->getReadPtr(frame, 0)),
+        reinterpret_cast<const T *>(vsapi->getReadPtr(frame, isGray ? 0 : 1)),
+        reinterpret_cast<const T *>(vsapi->getReadPtr(frame, isGray ? 0 : 2)),
+        alphaFrame ? reinterpret_cast<const T *>(vsapi->getReadPtr(alphaFrame, 0)) : nullptr
+    };
+    ptrdiff_t stride[4] = {
+        vsapi->getStride(frame, 0),
+        vsapi->getStride(frame, isGray ? 0 : 1),
+        vsapi->getStride(frame, isGray ? 0 : 2),
+        alphaFrame ? vsapi->getStride(alphaFrame, 0) : 0
+    };
+    ssize_t offset[4] = {
+        pixelCache.offset(MagickCore::RedPixelChannel),
+        pixelCache.offset(MagickCore::GreenPixelChannel),
+        pixelCache.offset(MagickCore::BluePixelChannel),
+        alphaFrame ? pixelCache.offset(MagickCore::AlphaPixelChannel) : -1
+    };
+    int numPlanes = alphaFrame ? 4 : 3;
     size_t channels = image.channels();
 
-    if (alphaFrame) {
-        ssize_t aOff = pixelCache.offset(MagickCore::AlphaPixelChannel);
-        ptrdiff_t strideA = vsapi->getStride(alphaFrame, 0);
-        const T * VS_RESTRICT a = reinterpret_cast<const T *>(vsapi->getReadPtr(alphaFrame, 0));
-
-        for (int y = 0; y < height; y++) {
-            MagickCore::Quantum *pixels = pixelCache.get(0, y, width, 1);
-            for (int x = 0; x < width; x++) {
-                pixels[x * channels + rOff] = r[x] * scaleFactor + (r[x] >> shiftFactor);
-                pixels[x * channels + gOff] = g[x] * scaleFactor + (g[x] >> shiftFactor);
-                pixels[x * channels + bOff] = b[x] * scaleFactor + (b[x] >> shiftFactor);
-                pixels[x * channels + aOff] = a[x] * scaleFactor + (a[x] >> shiftFactor);
-            }
+    std::vector<Quantum> line(width);
+    MagickCore::Quantum *pixels = pixelCache.get(0, 0, width, height);
+
+    for (int y = 0; y < height; y++) {
+        for (int p = 0; p < numPlanes; p++) {
+            // gray uses the same plane for all three color channels
+            if (!isGray || p == 0 || p == 3)
+                samplesToQuantum(src[p], line.data(), width, scaleFactor, shiftFactor);
+            for (int x = 0; x < width; x++)
+                pixels[x * channels + offset[p]] = line[x];
+            src[p] += stride[p] / sizeof(T);
+        }
+        pixels += width * channels;
+    }
+
+    pixelCache.sync();
+}
 
-            r += strideR / sizeof(T);
-            g += strideG / sizeof(T);
-            b += strideB / sizeof(T);
-            a += strideA / sizeof(T);
+static void writeImage(const WriteData *d, const VSFrame *frame, const VSFrame *alphaFrame, const std::string &filename, const VSAPI *vsapi) {
+    const VSVideoFormat *fi = vsapi->getVideoFrameFormat(frame);
+    int width = vsapi->getFrameWidth(frame, 0);
+    int height = vsapi->getFrameHeight(frame, 0);
+
+    Magick::Image image(Magick::Geometry(width, height), Magick::Color(0, 0, 0, 0));
+    image.magick(d->imgFormat);
+    image.modulusDepth(fi->bitsPerSample);
+    if (d->compressType != MagickCore::UndefinedCompression)
+        image.compressType(d->compressType);
+    image.quantizeDitherMethod(Magick::FloydSteinbergDitherMethod);
+    image.quantizeDither(d->dither);
+    image.quality(d->quality);
+    image.alphaChannel(alphaFrame ? Magick::ActivateAlphaChannel : Magick::RemoveAlphaChannel);
+
+    bool isGray = fi->colorFamily == cfGray;
+    if (isGray)
+        image.colorSpace(Magick::GRAYColorspace);
+
+    if (fi->bytesPerSample == 4 && fi->sampleType == stFloat) {
+        image.attribute("quantum:format", "floating-point");
+        writeImageHelper<float>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
+    } else if (fi->bytesPerSample == 4) {
+        writeImageHelper<uint32_t>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
+    } else if (fi->bytesPerSample == 2) {
+        writeImageHelper<uint16_t>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
+    } else if (fi->bytesPerSample == 1) {
+        writeImageHelper<uint8_t>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
+    }
 
-            pixelCache.sync();
-        }
-    } else {
-        for (int y = 0; y < height; y++) {
-            MagickCore::Quantum *pixels = pixelCache.get(0, y, width, 1);
-            for (int x = 0; x < width; x++) {
-                pixels[x * channels + rOff] = r[x] * scaleFactor + (r[x] >> shiftFactor);
-                pixels[x * channels + gOff] = g[x] * scaleFactor + (g[x] >> shiftFactor);
-                pixels[x * channels + bOff] = b[x] * scaleFactor + (b[x] >> shiftFactor);
+    image.strip();
+
+    image.write(filename);
+}
+
+// Encodes and writes images on a fixed number of threads so the frames can be returned right away. At most
+// two images per thread can be waiting, after that the frame requests wait for a free slot. Destroying the
+// queue writes all images that are still waiting.
+class WriteQueue {
+    struct Job {
+        const VSFrame *frame;
+        const VSFrame *alphaFrame;
+        std::string filename;
+    };
+
+    const WriteData *d;
+    const VSAPI *vsapi;
+    VSCore *core;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::condition_variable space;
+    std::deque<Job> jobs;
+    size_t maxJobs;
+    bool stop = false;
+    std::string error;
+    std::vector<std::thread> threads;
+
+    void worker() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            cond.wait(guard, [this] { return stop || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+
+            Job job = jobs.front();
+            jobs.pop_front();
+            space.notify_one();
+            guard.unlock();
+
+            std::string msg;
+            try {
+                writeImage(d, job.frame, job.alphaFrame, job.filename, vsapi);
+            } catch (Magick::Exception &e) {
+                msg = std::string("Write: ImageMagick error: ") + e.what();
+                vsapi->logMessage(mtCritical, msg.c_str(), core);
             }
+            vsapi->freeFrame(job.frame);
+            vsapi->freeFrame(job.alphaFrame);
 
-            r += strideR / sizeof(T);
-            g += strideG / sizeof(T);
-            b += strideB / sizeof(T);
+            guard.lock();
+            if (error.empty())
+                error = msg;
+        }
+    }
+public:
+    WriteQueue(const WriteData *d, int numThreads, const VSAPI *vsapi, VSCore *core) : d(d), vsapi(vsapi), core(core), maxJobs(static_cast<size_t>(numThreads) * 2) {
+        for (int i = 0; i < numThreads; i++)
+            threads.emplace_back(&WriteQueue::worker, this);
+    }
 
-            pixelCache.sync();
+    ~WriteQueue() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
         }
+        cond.notify_all();
+        for (auto &iter : threads)
+            iter.join();
+    }
+
+    // takes ownership of the frames
+    void push(const VSFrame *frame, const VSFrame *alphaFrame, const std::string &filename) {
+        std::unique_lock<std::mutex> guard(lock);
+        space.wait(guard, [this] { return jobs.size() < maxJobs; });
+        jobs.push_back({ frame, alphaFrame, filename });
+        cond.notify_one();
     }
-}
+
+    // the first error of an earlier image, if any
+    std::string getError() {
+        std::lock_guard<std::mutex> guard(lock);
+        return error;
+    }
+};
 
 static const VSFrame *VS_CC writeGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     WriteData *d = static_cast<WriteData *>(instanceData);
@@ -259,7 +503,6 @@ static const VSFrame *VS_CC writeGetFrame(int n, int activationReason, void *ins
             vsapi->requestFrameFilter(n, d->alphaNode, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *frame = vsapi->getFrameFilter(n, d->videoNode, frameCtx);
-        const VSVideoFormat *fi = vsapi->getVideoFrameFormat(frame);
         int width = vsapi->getFrameWidth(frame, 0);
         int height = vsapi->getFrameHeight(frame, 0);
 
@@ -267,6 +510,15 @@ static const VSFrame *VS_CC writeGetFrame(int n, int activationReason, void *ins
         int alphaWidth = 0;
         int alphaHeight = 0;
 
+        if (d->queue) {
+            std::string error = d->queue->getError();
+            if (!error.empty()) {
+                vsapi->setFilterError(error.c_str(), frameCtx);
+                vsapi->freeFrame(frame);
+                return nullptr;
+            }
+        }
+
         std::string filename = specialPrintf(d->filename, n + d->firstNum);
         if (!isAbsolute(filename))
             filename = d->workingDir + filename;
@@ -287,91 +539,13 @@ static const VSFrame *VS_CC writeGetFrame(int n, int activationReason, void *ins
             }
         }
 
-        try {
-            Magick::Image image(Magick::Geometry(width, height), Magick::Color(0, 0, 0, 0));
-            image.magick(d->imgFormat);
-            image.modulusDepth(fi->bitsPerSample);
-            if (d->compressType != MagickCore::UndefinedCompression)
-                image.compressType(d->compressType);
-            image.quantizeDitherMethod(Magick::FloydSteinbergDitherMethod);
-            image.quantizeDither(d->dither);
-            image.quality(d->quality);
-            image.alphaChannel(alphaFrame ? Magick::ActivateAlphaChannel : Magick::RemoveAlphaChannel);
-
-            bool isGray = fi->colorFamily == cfGray;
-            if (isGray)
-                image.colorSpace(Magick::GRAYColorspace);
-
-            if (fi->bytesPerSample == 4 && fi->sampleType == stFloat) {
-                image.attribute("quantum:format", "floating-point");
-                Magick::Pixels pixelCache(image);
-                const Quantum scaleFactor = QuantumRange;
-
-                const float * VS_RESTRICT r = reinterpret_cast<const float *>(vsapi->getReadPtr(frame, 0));
-                const float * VS_RESTRICT g = reinterpret_cast<const float *>(vsapi->getReadPtr(frame, isGray ? 0 : 1));
-                const float * VS_RESTRICT b = reinterpret_cast<const float *>(vsapi->getReadPtr(frame, isGray ? 0 : 2));
-               
-                ptrdiff_t strideR = vsapi->getStride(frame, 0);
-                ptrdiff_t strideG = vsapi->getStride(frame, isGray ? 0 : 1);
-                ptrdiff_t strideB = vsapi->getStride(frame, isGray ? 0 : 2);
-                    
-                ssize_t rOff = pixelCache.offset(MagickCore::RedPixelChannel);
-                ssize_t gOff = pixelCache.offset(MagickCore::GreenPixelChannel);
-                ssize_t bOff = pixelCache.offset(MagickCore::BluePixelChannel);
-                size_t channels = image.channels();
-
-                if (alphaFrame) {
-                    const float * VS_RESTRICT a = reinterpret_cast<const float *>(vsapi->getReadPtr(alphaFrame, 0));
-                    ptrdiff_t strideA = vsapi->getStride(alphaFrame, 0);
-                    ssize_t aOff = pixelCache.offset(MagickCore::AlphaPixelChannel);
-            
-                    for (int y = 0; y < height; y++) {
-                        MagickCore::Quantum* pixels = pixelCache.get(0, y, width, 1);
-                        for (int x = 0; x < width; x++) {
-                            pixels[x * channels + rOff] = r[x] * scaleFactor;
-                            pixels[x * channels + gOff] = g[x] * scaleFactor;
-                            pixels[x * channels + bOff] = b[x] * scaleFactor;
-                            pixels[x * channels + aOff] = a[x] * scaleFactor;
-                        }
-
-                        r += strideR / sizeof(float);
-                        g += strideG / sizeof(float);
-                        b += strideB / sizeof(float);
-                        a += strideA / sizeof(float);
-
-                        pixelCache.sync();
-                    }
-                } else {
-                    const float *r = reinterpret_cast<const float *>(vsapi->getReadPtr(frame, 0));
-                    const float *g = reinterpret_cast<const float *>(vsapi->getReadPtr(frame, isGray ? 0 : 1));
-                    const float *b = reinterpret_cast<const float *>(vsapi->getReadPtr(frame, isGray ? 0 : 2));
-
-                    for (int y = 0; y < height; y++) {
-                        MagickCore::Quantum* pixels = pixelCache.get(0, y, width, 1);
-                        for (int x = 0; x < width; x++) {
-                            pixels[x * channels + rOff] = r[x] * scaleFactor;
-                            pixels[x * channels + gOff] = g[x] * scaleFactor;
-                            pixels[x * channels + bOff] = b[x] * scaleFactor;
-                        }
-
-                        r += strideR / sizeof(float);
-                        g += strideG / sizeof(float);
-                        b += strideB / sizeof(float);
-
-                        pixelCache.sync();
-                    }
-                }
-            } else if (fi->bytesPerSample == 4) {
-                writeImageHelper<uint32_t>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
-            } else if (fi->bytesPerSample == 2) {
-                writeImageHelper<uint16_t>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
-            } else if (fi->bytesPerSample == 1) {
-                writeImageHelper<uint8_t>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
-            }
-
-            image.strip();
+        if (d->queue) {
+            d->queue->push(vsapi->addFrameRef(frame), alphaFrame, filename);
+            return frame;
+        }
 
-            image.write(filename);
+        try {
+            writeImage(d, frame, alphaFrame, filename, vsapi);
 
             vsapi->freeFrame(alphaFrame);
             return frame;
@@ -388,6 +562,8 @@ static const VSFrame *VS_CC writeGetFrame(int n, int activationReason, void *ins
 
 static void VS_CC writeFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     WriteData *d = static_cast<WriteData *>(instanceData);
+    // waits for all queued images to be written
+    delete d->queue;
     vsapi->freeNode(d->videoNode);
     vsapi->freeNode(d->alphaNode);
     delete d;
@@ -484,6 +660,13 @@ static void VS_CC writeCreate(const VSMap *in, VSMap *out, void *userData, VSCor
     if (err)
         d->dither = true;
     d->overwrite = !!vsapi->mapGetInt(in, "overwrite", 0, &err);
+    int asyncThreads = vsapi->mapGetIntSaturated(in, "async", 0, &err);
+    if (asyncThreads < 0) {
+        vsapi->freeNode(d->videoNode);
+        vsapi->freeNode(d->alphaNode);
+        vsapi->mapSetError(out, "Write: async can't be negative");
+        return;
+    }
 
     d->vi = vsapi->getVideoInfo(d->videoNode);
     if (d->alphaNode) {
@@ -511,6 +694,9 @@ static void VS_CC writeCreate(const VSMap *in, VSMap *out, void *userData, VSCor
 
     getWorkingDir(d->workingDir);
 
+    if (asyncThreads > 0)
+        d->queue = new WriteQueue(d.get(), asyncThreads, vsapi, core);
+
     VSFilterDependency deps[] = {{ d->videoNode, rpStrictSpatial }, { d->alphaNode, rpStrictSpatial }};
     vsapi->createVideoFilter(out, "Write", d->vi, writeGetFrame, writeFree, fmParallelRequests, deps, d->alphaNode ? 2 : 1, d.get(), core);
     d.release();
@@ -519,6 +705,128 @@ static void VS_CC writeCreate(const VSMap *in, VSMap *out, void *userData, VSCor
 //////////////////////////////////////////
 // Read
 
+static bool readFile(const std::string &filename, std::string &data) {
+#ifdef _WIN32
+    FILE * f = _wfopen(utf16_from_utf8(filename).c_str(), L"rb");
+#else
+    FILE * f = fopen(filename.c_str(), "rb");
+#endif
+    if (!f)
+        return false;
+
+    data.clear();
+    char buffer[65536];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        data.append(buffer, size);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// Reads the files of the next frames into memory on a separate thread so slow storage doesn't hold up the
+// decoding. Only the reading is done ahead, ImageMagick then decodes from the memory copy.
+class ReadAhead {
+    enum State { Queued, Reading, Done, Failed };
+
+    struct Entry {
+        State state;
+        bool taken;
+        std::string filename;
+        std::string data;
+    };
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::map<int, Entry> entries;
+    std::deque<int> queue;
+    size_t maxEntries;
+    bool stop = false;
+    std::thread thread;
+
+    void worker() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            cond.wait(guard, [this] { return stop || !queue.empty(); });
+            if (stop)
+                return;
+
+            int n = queue.front();
+            queue.pop_front();
+            auto it = entries.find(n);
+            if (it == entries.end() || it->second.state != Queued)
+                continue;
+
+            it->second.state = Reading;
+            std::string filename = it->second.filename;
+            std::string data;
+            guard.unlock();
+            bool ok = readFile(filename, data);
+            guard.lock();
+
+            // entries are never removed while being read, only the one taking it removes it after
+            it->second.data.swap(data);
+            it->second.state = ok ? Done : Failed;
+            cond.notify_all();
+        }
+    }
+public:
+    explicit ReadAhead(size_t maxEntries) : maxEntries(maxEntries) {
+        thread = std::thread(&ReadAhead::worker, this);
+    }
+
+    ~ReadAhead() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        cond.notify_all();
+        thread.join();
+    }
+
+    // Queues a file unless it's already known, files before the current frame that were never requested are
+    // dropped to make room. Returns false once there's no more room.
+    bool schedule(int n, const std::string &filename, int current) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (entries.count(n))
+            return true;
+        if (entries.size() >= maxEntries) {
+            auto it = entries.begin();
+            while (it != entries.end() && it->first < current && (it->second.taken || it->second.state == Reading))
+                ++it;
+            if (it == entries.end() || it->first >= current)
+                return false;
+            entries.erase(it);
+        }
+        entries[n] = { Queued, false, filename, {} };
+        queue.push_back(n);
+        cond.notify_all();
+        return true;
+    }
+
+    // Returns the contents of a file read ahead of time or false if it has to be read directly.
+    bool take(int n, std::string &data) {
+        std::unique_lock<std::mutex> guard(lock);
+        auto it = entries.find(n);
+        if (it == entries.end() || it->second.taken)
+            return false;
+
+        // no point in waiting behind the rest of the queue
+        if (it->second.state == Queued) {
+            entries.erase(it);
+            return false;
+        }
+
+        it->second.taken = true;
+        cond.wait(guard, [it] { return it->second.state == Done || it->second.state == Failed; });
+        bool ok = it->second.state == Done;
+        if (ok)
+            data.swap(it->second.data);
+        entries.erase(it);
+        return ok;
+    }
+};
+
 struct ReadData {
     VSVideoInfo vi[2];
     std::vector<std::string> filenames;
@@ -531,68 +839,65 @@ struct ReadData {
     int cachedFrameNum;
     bool cachedAlpha;
     bool embedICC;
+    bool raw;
     const VSFrame *cachedFrame;
+    int readAheadFrames;
+    std::unique_ptr<ReadAhead> readAhead;
 
     ReadData() : fileListMode(true) {};
 };
 
+static std::string getReadFilename(const ReadData *d, int n) {
+    std::string filename = d->fileListMode ? d->filenames[n] : specialPrintf(d->filenames[0], n + d->firstNum);
+    if (!isAbsolute(filename))
+        filename = d->workingDir + filename;
+    return filename;
+}
+
 template<typename T>
 static void readImageHelper(VSFrame *frame, VSFrame *alphaFrame, bool isGray, Magick::Image &image, int width, int height, int bitsPerSample, const VSAPI *vsapi) {
-    float outScale = ((1 << bitsPerSample) - 1) / static_cast<float>((1 << MAGICKCORE_QUANTUM_DEPTH) - 1);
+    float outScale = 1.f;
+    if (std::is_integral<T>::value)
+        outScale = ((1 << bitsPerSample) - 1) / static_cast<float>((1 << MAGICKCORE_QUANTUM_DEPTH) - 1);
     size_t channels = image.channels();
     Magick::Pixels pixelCache(image);
 
-    T *r = reinterpret_cast<T *>(vsapi->getWritePtr(frame, 0));
-    T *g = reinterpret_cast<T *>(vsapi->getWritePtr(frame, isGray ? 0 : 1));
-    T *b = reinterpret_cast<T *>(vsapi->getWritePtr(frame, isGray ? 0 : 2));
-
-    ptrdiff_t strideR = vsapi->getStride(frame, 0);
-    ptrdiff_t strideG = vsapi->getStride(frame, isGray ? 0 : 1);
-    ptrdiff_t strideB = vsapi->getStride(frame, isGray ? 0 : 2);
-
-    ssize_t rOff = pixelCache.offset(MagickCore::RedPixelChannel);
-    ssize_t gOff = pixelCache.offset(MagickCore::GreenPixelChannel);
-    ssize_t bOff = pixelCache.offset(MagickCore::BluePixelChannel);
-    ssize_t aOff = pixelCache.offset(MagickCore::AlphaPixelChannel);
-
-    if (alphaFrame && aOff >= 0) {
-        T *a = reinterpret_cast<T *>(vsapi->getWritePtr(alphaFrame, 0));
-        ptrdiff_t strideA = vsapi->getStride(alphaFrame, 0);
-
-        for (int y = 0; y < height; y++) {
-            const Magick::Quantum *pixels = pixelCache.getConst(0, y, width, 1);
-            for (int x = 0; x < width; x++) {
-                r[x] = (unsigned)(pixels[x * channels + rOff] * outScale + .5f);
-                g[x] = (unsigned)(pixels[x * channels + gOff] * outScale + .5f);
-                b[x] = (unsigned)(pixels[x * channels + bOff] * outScale + .5f);
-                a[x] = (unsigned)(pixels[x * channels + aOff] * outScale + .5f);
-            }
-
-            r += strideR / sizeof(T);
-            g += strideG / sizeof(T);
-            b += strideB / sizeof(T);
-            a += strideA / sizeof(T);
-        }
-    } else {
-        for (int y = 0; y < height; y++) {
-            const Magick::Quantum *pixels = pixelCache.getConst(0, y, width, 1);
-            for (int x = 0; x < width; x++) {
-                r[x] = (unsigned)(pixels[x * channels + rOff] * outScale + .5f);
-                g[x] = (unsigned)(pixels[x * channels + gOff] * outScale + .5f);
-                b[x] = (unsigned)(pixels[x * channels + bOff] * outScale + .5f);
-            }
-
-            r += strideR / sizeof(T);
-            g += strideG / sizeof(T);
-            b += strideB / sizeof(T);
-        }
-
-        if (alphaFrame) {
-            T *a = reinterpret_cast<T *>(vsapi->getWritePtr(alphaFrame, 0));
-            ptrdiff_t strideA = vsapi->getStride(alphaFrame, 0);
-            memset(a, 0, strideA  * height);
+    T *dst[4] = {
+        reinterpret_cast<T *>(vsapi->getWritePtr(frame, 0)),
+        reinterpret_cast<T *>(vsapi->getWritePtr(frame, isGray ? 0 : 1)),
+        reinterpret_cast<T *>(vsapi->getWritePtr(frame, isGray ? 0 : 2)),
+        alphaFrame ? reinterpret_cast<T *>(vsapi->getWritePtr(alphaFrame, 0)) : nullptr
+    };
+    ptrdiff_t stride[4] = {
+        vsapi->getStride(frame, 0),
+        vsapi->getStride(frame, isGray ? 0 : 1),
+        vsapi->getStride(frame, isGray ? 0 : 2),
+        alphaFrame ? vsapi->getStride(alphaFrame, 0) : 0
+    };
+    ssize_t offset[4] = {
+        pixelCache.offset(MagickCore::RedPixelChannel),
+        pixelCache.offset(MagickCore::GreenPixelChannel),
+        pixelCache.offset(MagickCore::BluePixelChannel),
+        pixelCache.offset(MagickCore::AlphaPixelChannel)
+    };
+    int numPlanes = (alphaFrame && offset[3] >= 0) ? 4 : 3;
+
+    // all channels of a line are converted at once, the planes are then picked out of it
+    std::vector<T> line(width * channels);
+    const Magick::Quantum *pixels = pixelCache.getConst(0, 0, width, height);
+
+    for (int y = 0; y < height; y++) {
+        quantumToSamples(pixels, line.data(), width * channels, outScale);
+        for (int p = 0; p < numPlanes; p++) {
+            for (int x = 0; x < width; x++)
+                dst[p][x] = line[x * channels + offset[p]];
+            dst[p] += stride[p] / sizeof(T);
         }
+        pixels += width * channels;
     }
+
+    if (alphaFrame && numPlanes < 4)
+        memset(vsapi->getWritePtr(alphaFrame, 0), 0, stride[3] * height);
 }
 
 static void readSampleTypeDepth(const ReadData *d, const Magick::Image &image, VSSampleType &st, int &depth) {
@@ -627,22 +932,59 @@ static const VSFrame *VS_CC readGetFrame(int n, int activationReason, void *inst
         VSFrame *alphaFrame = nullptr;
         
         try {
-            std::string filename = d->fileListMode ? d->filenames[n] : specialPrintf(d->filenames[0], n + d->firstNum);
-            if (!isAbsolute(filename))
-                filename = d->workingDir + filename;
-
-            Magick::Image image(filename);
-            VSColorFamily cf = cfRGB;
-            if (image.colorSpace() == Magick::GRAYColorspace)
-                cf = cfGray;
+            std::string filename = getReadFilename(d, n);
+
+            Magick::Image image;
+            std::string data;
+            if (d->readAhead) {
+                for (int i = n + 1; i <= std::min(n + d->readAheadFrames, d->vi[0].numFrames - 1); i++) {
+                    if (!d->readAhead->schedule(i, getReadFilename(d, i), n))
+                        break;
+                }
+            }
 
-            int width = static_cast<int>(image.columns());
-            int height = static_cast<int>(image.rows());
-            size_t channels = image.channels();
+            bool haveData = d->readAhead && d->readAhead->take(n, data);
+
+            MappedFile mapped;
+            RawImage raw;
+            bool useRaw = false;
+            if (d->raw && !d->floatOutput) {
+                if (haveData)
+                    useRaw = raw.parse(reinterpret_cast<const uint8_t *>(data.data()), data.size());
+                else if (mapped.open(filename))
+                    useRaw = raw.parse(mapped.data(), mapped.size());
+                // tiff can carry an icc profile and only ImageMagick extracts it
+                useRaw = useRaw && !(d->embedICC && raw.isTIFF);
+            }
 
+            VSColorFamily cf = cfRGB;
+            int width;
+            int height;
             VSSampleType st;
             int depth;
-            readSampleTypeDepth(d, image, st, depth);
+
+            if (useRaw) {
+                cf = raw.colorFamily;
+                width = raw.width;
+                height = raw.height;
+                st = raw.sampleType;
+                depth = raw.bitsPerSample;
+            } else {
+                if (haveData) {
+                    // the filename is still needed for formats that can only be detected by their extension
+                    image.fileName(filename);
+                    image.read(Magick::Blob(data.data(), data.size()));
+                } else {
+                    image.read(filename);
+                }
+
+                if (image.colorSpace() == Magick::GRAYColorspace)
+                    cf = cfGray;
+
+                width = static_cast<int>(image.columns());
+                height = static_cast<int>(image.rows());
+                readSampleTypeDepth(d, image, st, depth);
+            }
 
             if (d->vi[0].format.colorFamily != cfUndefined && (cf != d->vi[0].format.colorFamily || depth != d->vi[0].format.bitsPerSample)) {
                 VSVideoFormat tmp;
@@ -674,59 +1016,10 @@ static const VSFrame *VS_CC readGetFrame(int n, int activationReason, void *inst
  
             bool isGray = fi->colorFamily == cfGray;                
      
-            if (fi->bytesPerSample == 4 && fi->sampleType == stFloat) {
-                const Quantum scaleFactor = QuantumRange;
-                Magick::Pixels pixelCache(image);
-
-                float *r = reinterpret_cast<float *>(vsapi->getWritePtr(frame, 0));
-                float *g = reinterpret_cast<float *>(vsapi->getWritePtr(frame, isGray ? 0 : 1));
-                float *b = reinterpret_cast<float *>(vsapi->getWritePtr(frame, isGray ? 0 : 2));
-
-                ptrdiff_t strideR = vsapi->getStride(frame, 0);
-                ptrdiff_t strideG = vsapi->getStride(frame, isGray ? 0 : 1);
-                ptrdiff_t strideB = vsapi->getStride(frame, isGray ? 0 : 2);
-
-                ssize_t rOff = pixelCache.offset(MagickCore::RedPixelChannel);
-                ssize_t gOff = pixelCache.offset(MagickCore::GreenPixelChannel);
-                ssize_t bOff = pixelCache.offset(MagickCore::BluePixelChannel);
-
-                if (alphaFrame) {
-                    float *a = reinterpret_cast<float *>(vsapi->getWritePtr(alphaFrame, 0));
-                    ptrdiff_t strideA = vsapi->getStride(alphaFrame, 0);
-                    ssize_t aOff = pixelCache.offset(MagickCore::AlphaPixelChannel);
-
-                    if (aOff >= 0) {
-                        for (int y = 0; y < height; y++) {
-                            const MagickCore::Quantum* pixels = pixelCache.getConst(0, y, width, 1);
-                            for (int x = 0; x < width; x++) {
-                                r[x] = pixels[x * channels + rOff] / scaleFactor;
-                                g[x] = pixels[x * channels + gOff] / scaleFactor;
-                                b[x] = pixels[x * channels + bOff] / scaleFactor;
-                                a[x] = pixels[x * channels + aOff] / scaleFactor;
-                            }
-
-                            r += strideR / sizeof(float);
-                            g += strideG / sizeof(float);
-                            b += strideB / sizeof(float);
-                            a += strideA / sizeof(float);
-                        }
-                    } else {
-                        memset(a, 0, strideA  * height);
-                    }
-                } else {
-                    for (int y = 0; y < height; y++) {
-                        const MagickCore::Quantum* pixels = pixelCache.getConst(0, y, width, 1);
-                        for (int x = 0; x < width; x++) {
-                            r[x] = pixels[x * channels + rOff] / scaleFactor;
-                            g[x] = pixels[x * channels + gOff] / scaleFactor;
-                            b[x] = pixels[x * channels + bOff] / scaleFactor;
-                        }
-
-                        r += strideR / sizeof(float);
-                        g += strideG / sizeof(float);
-                        b += strideB / sizeof(float);
-                    }
-                }
+            if (useRaw) {
+                raw.unpack(frame, alphaFrame, vsapi);
+            } else if (fi->bytesPerSample == 4 && fi->sampleType == stFloat) {
+                readImageHelper<float>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
             } else if (fi->bytesPerSample == 4) {
                 readImageHelper<uint32_t>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
             } else if (fi->bytesPerSample == 2) {
@@ -735,7 +1028,7 @@ static const VSFrame *VS_CC readGetFrame(int n, int activationReason, void *inst
                 readImageHelper<uint8_t>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
             }
 #if defined(IMWRI_HAS_LCMS2)
-            if (d->embedICC) {
+            if (d->embedICC && !useRaw) {
                 const MagickCore::StringInfo *icc_profile = MagickCore::GetImageProfile(image.constImage(), "icc");
                 if (icc_profile) {
                     vsapi->mapSetData(vsapi->getFramePropertiesRW(frame), "ICCProfile", reinterpret_cast<const char *>(icc_profile->datum), icc_profile->length, dtBinary, maReplace);
@@ -777,11 +1070,19 @@ static void VS_CC readCreate(const VSMap *in, VSMap *out, void *userData, VSCore
     d->alpha = !!vsapi->mapGetInt(in, "alpha", 0, &err);
     d->mismatch = !!vsapi->mapGetInt(in, "mismatch", 0, &err);
     d->floatOutput = !!vsapi->mapGetInt(in, "float_output", 0, &err);
+    d->readAheadFrames = vsapi->mapGetIntSaturated(in, "readahead", 0, &err);
+    if (d->readAheadFrames < 0) {
+        vsapi->mapSetError(out, "Read: readahead can't be negative");
+        return;
+    }
 #if defined(IMWRI_HAS_LCMS2)
     d->embedICC = !!vsapi->mapGetInt(in, "embed_icc", 0, &err);
 #else
     d->embedICC = false;
 #endif
+    d->raw = !!vsapi->mapGetInt(in, "raw", 0, &err);
+    if (err)
+        d->raw = true;
     int numElem = vsapi->mapNumElements(in, "filename");
     d->filenames.resize(numElem);
     for (int i = 0; i < numElem; i++)
@@ -806,19 +1107,34 @@ static void VS_CC readCreate(const VSMap *in, VSMap *out, void *userData, VSCore
     }
 
     try {
-        Magick::Image image(d->fileListMode ? d->filenames[0] : specialPrintf(d->filenames[0], d->firstNum));
+        std::string filename = d->fileListMode ? d->filenames[0] : specialPrintf(d->filenames[0], d->firstNum);
 
+        MappedFile mapped;
+        RawImage raw;
+        VSColorFamily cf = cfRGB;
+        int width;
+        int height;
         VSSampleType st;
         int depth;
-        readSampleTypeDepth(d.get(), image, st, depth);
 
-        if (!d->mismatch || d->vi[0].numFrames == 1) {
-            d->vi[0].height = static_cast<int>(image.rows());
-            d->vi[0].width = static_cast<int>(image.columns());
-            VSColorFamily cf = cfRGB;
+        if (d->raw && !d->floatOutput && mapped.open(filename) && raw.parse(mapped.data(), mapped.size()) && !(d->embedICC && raw.isTIFF)) {
+            cf = raw.colorFamily;
+            width = raw.width;
+            height = raw.height;
+            st = raw.sampleType;
+            depth = raw.bitsPerSample;
+        } else {
+            Magick::Image image(filename);
             if (image.colorSpace() == Magick::GRAYColorspace)
                 cf = cfGray;
+            width = static_cast<int>(image.columns());
+            height = static_cast<int>(image.rows());
+            readSampleTypeDepth(d.get(), image, st, depth);
+        }
 
+        if (!d->mismatch || d->vi[0].numFrames == 1) {
+            d->vi[0].height = height;
+            d->vi[0].width = width;
             vsapi->queryVideoFormat(&d->vi[0].format, cf, st, depth, 0, 0, core);
         }
 
@@ -834,7 +1150,13 @@ static void VS_CC readCreate(const VSMap *in, VSMap *out, void *userData, VSCore
 
     getWorkingDir(d->workingDir);
 
-    vsapi->createVideoFilter(out, "Read", d->vi, readGetFrame, readFree, fmUnordered, nullptr, 0, d.get(), core);
+    // room for both the frames being read ahead and the ones already requested in parallel
+    d->readAheadFrames = std::min(d->readAheadFrames, d->vi[0].numFrames - 1);
+    if (d->readAheadFrames > 0)
+        d->readAhead.reset(new ReadAhead(d->readAheadFrames * 2));
+
+    // every frame is decoded from its own file into its own image so there's no shared state
+    vsapi->createVideoFilter(out, "Read", d->vi, readGetFrame, readFree, fmParallel, nullptr, 0, d.get(), core);
     d.release();
 }
 
@@ -844,6 +1166,6 @@ static void VS_CC readCreate(const VSMap *in, VSMap *out, void *userData, VSCore
 
 VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->configPlugin(IMWRI_ID, IMWRI_NAMESPACE, IMWRI_PLUGIN_NAME, VAPOURSYNTH_INTERNAL_PLUGIN_VERSION, VAPOURSYNTH_API_VERSION, 0, plugin);
-    vspapi->registerFunction("Write", "clip:vnode;imgformat:data;filename:data;firstnum:int:opt;quality:int:opt;dither:int:opt;compression_type:data:opt;overwrite:int:opt;alpha:vnode:opt;", "clip:vnode;", writeCreate, nullptr, plugin);
-    vspapi->registerFunction("Read", "filename:data[];firstnum:int:opt;mismatch:int:opt;alpha:int:opt;float_output:int:opt;embed_icc:int:opt;", "clip:vnode;", readCreate, nullptr, plugin);
+    vspapi->registerFunction("Write", "clip:vnode;imgformat:data;filename:data;firstnum:int:opt;quality:int:opt;dither:int:opt;compression_type:data:opt;overwrite:int:opt;alpha:vnode:opt;async:int:opt;", "clip:vnode;", writeCreate, nullptr, plugin);
+    vspapi->registerFunction("Read", "filename:data[];firstnum:int:opt;mismatch:int:opt;alpha:int:opt;float_output:int:opt;embed_icc:int:opt;readahead:int:opt;raw:int:opt;", "clip:vnode;", readCreate, nullptr, plugin);
 }
\ No newline at end of file
@@ -0,0 +1,549 @@
+/*
+* Copyright (c) 2014-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifdef _WIN32
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "rawreader.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include "../../common/vsutf16.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef VS_TARGET_CPU_X86
+#include <emmintrin.h>
+#endif
+
+//////////////////////////////////////////
+// MappedFile
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (ptr)
+        UnmapViewOfFile(ptr);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file)
+        CloseHandle(file);
+#else
+    if (ptr)
+        munmap(const_cast<uint8_t *>(ptr), length);
+#endif
+}
+
+bool MappedFile::open(const std::string &filename) {
+#ifdef _WIN32
+    HANDLE h = CreateFileW(utf16_from_utf8(filename).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+    file = h;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(h, &fileSize) || fileSize.QuadPart <= 0 || static_cast<uint64_t>(fileSize.QuadPart) > std::numeric_limits<size_t>::max())
+        return false;
+
+    mapping = CreateFileMappingW(h, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+        return false;
+
+    ptr = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!ptr)
+        return false;
+    length = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void *view = MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size > 0 && static_cast<uint64_t>(st.st_size) <= std::numeric_limits<size_t>::max())
+        view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (view == MAP_FAILED)
+        return false;
+
+    // every image is read once from start to end
+    madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    ptr = static_cast<const uint8_t *>(view);
+    length = static_cast<size_t>(st.st_size);
+    return true;
+#endif
+}
+
+//////////////////////////////////////////
+// Parsing
+
+static inline uint16_t readU16(const uint8_t *p, bool bigEndian) {
+    return bigEndian ? static_cast<uint16_t>((p[0] << 8) | p[1]) : static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t readU32(const uint8_t *p, bool bigEndian) {
+    return bigEndian ? ((static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3])
+                     : (p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24));
+}
+
+// larger dimensions than this are certainly a broken header
+static const uint32_t maxDimension = 1 << 16;
+
+bool RawImage::parse(const uint8_t *ptr, size_t size) {
+    data = ptr;
+    if (size < 8)
+        return false;
+
+    if (!memcmp(ptr, "SDPX", 4) || !memcmp(ptr, "XPDS", 4)) {
+        bigEndian = (ptr[0] == 'S');
+        return parseDPX(size);
+    } else if (readU32(ptr, true) == 0x802A5FD7 || readU32(ptr, false) == 0x802A5FD7) {
+        bigEndian = (readU32(ptr, true) == 0x802A5FD7);
+        return parseCineon(size);
+    } else if (!memcmp(ptr, "II*\0", 4) || !memcmp(ptr, "MM\0*", 4)) {
+        bigEndian = (ptr[0] == 'M');
+        isTIFF = true;
+        return parseTIFF(size);
+    }
+
+    return false;
+}
+
+size_t RawImage::rowDataBytes() const {
+    size_t samples = static_cast<size_t>(width) * channels;
+    switch (container) {
+    case Container::Byte:
+        return samples;
+    case Container::Word:
+        return samples * 2;
+    case Container::Float:
+        return samples * 4;
+    case Container::Packed10:
+        return (samples + 2) / 3 * 4;
+    }
+    return 0;
+}
+
+// Rows that follow each other at a fixed distance
+bool RawImage::setRows(size_t size, size_t first, size_t rowBytes) {
+    uint64_t end = first + static_cast<uint64_t>(height - 1) * rowBytes + rowDataBytes();
+    if (end > size)
+        return false;
+
+    rowOffsets.resize(height);
+    for (int y = 0; y < height; y++)
+        rowOffsets[y] = first + y * rowBytes;
+    return true;
+}
+
+// DPX with a single image element that isn't run length encoded, only the filled packing is handled
+// for 10 and 12 bit since the tightly packed one is rare and is left to ImageMagick
+bool RawImage::parseDPX(size_t size) {
+    if (size < 816)
+        return false;
+
+    uint32_t imageOffset = readU32(data + 4, bigEndian);
+    uint16_t orientation = readU16(data + 768, bigEndian);
+    uint16_t elements = readU16(data + 770, bigEndian);
+    uint32_t pixelsPerLine = readU32(data + 772, bigEndian);
+    uint32_t linesPerElement = readU32(data + 776, bigEndian);
+
+    const uint8_t *element = data + 780;
+    uint32_t dataSign = readU32(element, bigEndian);
+    uint8_t descriptor = element[20];
+    uint8_t depth = element[23];
+    uint16_t packing = readU16(element + 24, bigEndian);
+    uint16_t encoding = readU16(element + 26, bigEndian);
+    uint32_t dataOffset = readU32(element + 28, bigEndian);
+    uint32_t eolPadding = readU32(element + 32, bigEndian);
+
+    if (orientation != 0 || elements != 1 || dataSign != 0 || encoding != 0)
+        return false;
+    if (!pixelsPerLine || !linesPerElement || pixelsPerLine > maxDimension || linesPerElement > maxDimension)
+        return false;
+
+    switch (descriptor) {
+    case 6: // luma
+        channels = 1;
+        colorFamily = cfGray;
+        break;
+    case 50: // rgb
+        channels = 3;
+        colorFamily = cfRGB;
+        break;
+    case 51: // rgba
+        channels = 4;
+        colorFamily = cfRGB;
+        break;
+    default:
+        return false;
+    }
+
+    width = static_cast<int>(pixelsPerLine);
+    height = static_cast<int>(linesPerElement);
+    hasAlpha = (channels == 4);
+    sampleType = stInteger;
+    bitsPerSample = depth;
+
+    if (depth == 8) {
+        container = Container::Byte;
+    } else if (depth == 10 && packing == 1) {
+        container = Container::Packed10;
+    } else if (depth == 12 && packing == 1) {
+        container = Container::Word;
+        shift = 4;
+    } else if (depth == 16) {
+        container = Container::Word;
+    } else {
+        return false;
+    }
+
+    if (!dataOffset || dataOffset == 0xFFFFFFFF)
+        dataOffset = imageOffset;
+    if (eolPadding == 0xFFFFFFFF)
+        eolPadding = 0;
+
+    // every line starts on a 32 bit boundary
+    size_t rowBytes = ((rowDataBytes() + 3) & ~static_cast<size_t>(3)) + eolPadding;
+    return setRows(size, dataOffset, rowBytes);
+}
+
+// Cineon as it's almost always written, 10 bit pixel interleaved samples three to a word
+bool RawImage::parseCineon(size_t size) {
+    if (size < 712)
+        return false;
+
+    uint32_t imageOffset = readU32(data + 4, bigEndian);
+    uint8_t orientation = data[192];
+    uint8_t numChannels = data[193];
+
+    if (orientation != 0 || (numChannels != 1 && numChannels != 3))
+        return false;
+
+    const uint8_t *channel = data + 196;
+    uint32_t pixelsPerLine = readU32(channel + 4, bigEndian);
+    uint32_t linesPerImage = readU32(channel + 8, bigEndian);
+
+    for (int i = 0; i < numChannels; i++) {
+        const uint8_t *c = channel + i * 28;
+        if (c[2] != 10 || readU32(c + 4, bigEndian) != pixelsPerLine || readU32(c + 8, bigEndian) != linesPerImage)
+            return false;
+    }
+
+    uint8_t interleave = data[680];
+    uint8_t packing = data[681];
+    uint8_t dataSigned = data[682];
+    uint32_t linePadding = readU32(data + 684, bigEndian);
+
+    if (interleave != 0 || packing != 5 || dataSigned != 0)
+        return false;
+    if (!pixelsPerLine || !linesPerImage || pixelsPerLine > maxDimension || linesPerImage > maxDimension)
+        return false;
+    if (linePadding == 0xFFFFFFFF)
+        linePadding = 0;
+
+    width = static_cast<int>(pixelsPerLine);
+    height = static_cast<int>(linesPerImage);
+    channels = numChannels;
+    colorFamily = (numChannels == 3) ? cfRGB : cfGray;
+    sampleType = stInteger;
+    bitsPerSample = 10;
+    container = Container::Packed10;
+
+    return setRows(size, imageOffset, rowDataBytes() + linePadding);
+}
+
+// Reads value index of a SHORT or LONG field, false if it's out of range or has another type
+static bool tiffValue(const uint8_t *data, size_t size, const uint8_t *entry, uint32_t index, bool bigEndian, uint32_t &value) {
+    uint16_t type = readU16(entry + 2, bigEndian);
+    uint32_t count = readU32(entry + 4, bigEndian);
+    uint64_t unit = (type == 3) ? 2 : (type == 4) ? 4 : 0;
+    if (!unit || index >= count)
+        return false;
+
+    const uint8_t *p = entry + 8;
+    if (count * unit > 4) {
+        uint32_t offset = readU32(entry + 8, bigEndian);
+        if (offset + count * unit > size)
+            return false;
+        p = data + offset;
+    }
+
+    p += index * unit;
+    value = (unit == 2) ? readU16(p, bigEndian) : readU32(p, bigEndian);
+    return true;
+}
+
+// Every sample has to have the same value such as for BitsPerSample
+static bool tiffUniformValue(const uint8_t *data, size_t size, const uint8_t *entry, uint32_t count, bool bigEndian, uint32_t &value) {
+    if (!tiffValue(data, size, entry, 0, bigEndian, value))
+        return false;
+    for (uint32_t i = 1; i < count; i++) {
+        uint32_t other;
+        if (!tiffValue(data, size, entry, i, bigEndian, other) || other != value)
+            return false;
+    }
+    return true;
+}
+
+// Uncompressed chunky tiff in strips, gray or rgb with an optional alpha channel
+bool RawImage::parseTIFF(size_t size) {
+    uint32_t ifd = readU32(data + 4, bigEndian);
+    if (static_cast<uint64_t>(ifd) + 2 > size)
+        return false;
+    uint16_t numEntries = readU16(data + ifd, bigEndian);
+    if (static_cast<uint64_t>(ifd) + 2 + numEntries * 12 > size)
+        return false;
+
+    uint32_t imageWidth = 0;
+    uint32_t imageLength = 0;
+    uint32_t compression = 1;
+    uint32_t photometric = 0xFFFFFFFF;
+    uint32_t orientation = 1;
+    uint32_t samplesPerPixel = 1;
+    uint32_t rowsPerStrip = 0xFFFFFFFF;
+    uint32_t planarConfig = 1;
+    uint32_t extraSamples = 0;
+    uint32_t bits = 1;
+    uint32_t sampleFormat = 1;
+    const uint8_t *bitsEntry = nullptr;
+    const uint8_t *sampleFormatEntry = nullptr;
+    const uint8_t *stripOffsets = nullptr;
+
+    for (int i = 0; i < numEntries; i++) {
+        const uint8_t *entry = data + ifd + 2 + i * 12;
+        uint16_t tag = readU16(entry, bigEndian);
+        bool ok = true;
+
+        switch (tag) {
+        case 256: ok = tiffValue(data, size, entry, 0, bigEndian, imageWidth); break;
+        case 257: ok = tiffValue(data, size, entry, 0, bigEndian, imageLength); break;
+        case 258: bitsEntry = entry; break;
+        case 259: ok = tiffValue(data, size, entry, 0, bigEndian, compression); break;
+        case 262: ok = tiffValue(data, size, entry, 0, bigEndian, photometric); break;
+        case 273: stripOffsets = entry; break;
+        case 274: ok = tiffValue(data, size, entry, 0, bigEndian, orientation); break;
+        case 277: ok = tiffValue(data, size, entry, 0, bigEndian, samplesPerPixel); break;
+        case 278: ok = tiffValue(data, size, entry, 0, bigEndian, rowsPerStrip); break;
+        case 284: ok = tiffValue(data, size, entry, 0, bigEndian, planarConfig); break;
+        case 322: // tiles
+        case 324:
+            return false;
+        case 338: extraSamples = readU32(entry + 4, bigEndian); break;
+        case 339: sampleFormatEntry = entry; break;
+        }
+
+        if (!ok)
+            return false;
+    }
+
+    if (bitsEntry && !tiffUniformValue(data, size, bitsEntry, samplesPerPixel, bigEndian, bits))
+        return false;
+    if (sampleFormatEntry && !tiffUniformValue(data, size, sampleFormatEntry, samplesPerPixel, bigEndian, sampleFormat))
+        return false;
+
+    if (compression != 1 || orientation != 1 || (planarConfig != 1 && samplesPerPixel > 1) || !stripOffsets)
+        return false;
+    if (!imageWidth || !imageLength || imageWidth > maxDimension || imageLength > maxDimension)
+        return false;
+
+    if (photometric == 1 && (samplesPerPixel == 1 || (samplesPerPixel == 2 && extraSamples == 1)))
+        colorFamily = cfGray;
+    else if (photometric == 2 && (samplesPerPixel == 3 || (samplesPerPixel == 4 && extraSamples == 1)))
+        colorFamily = cfRGB;
+    else
+        return false;
+
+    if (bits == 8 && sampleFormat == 1) {
+        container = Container::Byte;
+        sampleType = stInteger;
+    } else if (bits == 16 && sampleFormat == 1) {
+        container = Container::Word;
+        sampleType = stInteger;
+    } else if (bits == 32 && sampleFormat == 3) {
+        container = Container::Float;
+        sampleType = stFloat;
+    } else {
+        return false;
+    }
+
+    width = static_cast<int>(imageWidth);
+    height = static_cast<int>(imageLength);
+    channels = static_cast<int>(samplesPerPixel);
+    hasAlpha = (extraSamples == 1);
+    bitsPerSample = static_cast<int>(bits);
+
+    if (!rowsPerStrip || rowsPerStrip > imageLength)
+        rowsPerStrip = imageLength;
+
+    size_t rowBytes = rowDataBytes();
+    rowOffsets.resize(height);
+    for (uint32_t strip = 0; strip * rowsPerStrip < imageLength; strip++) {
+        uint32_t offset;
+        if (!tiffValue(data, size, stripOffsets, strip, bigEndian, offset))
+            return false;
+
+        uint32_t rows = std::min(rowsPerStrip, imageLength - strip * rowsPerStrip);
+        if (offset + static_cast<uint64_t>(rows) * rowBytes > size)
+            return false;
+
+        for (uint32_t y = 0; y < rows; y++)
+            rowOffsets[strip * rowsPerStrip + y] = offset + y * rowBytes;
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////
+// Unpacking
+
+// The samples of a row are spread over up to four planes, channels without a plane are skipped
+
+static void unpackBytes(const uint8_t *src, uint8_t *const *dst, int width, int channels, int numPlanes) {
+    if (channels == 1) {
+        memcpy(dst[0], src, width);
+        return;
+    }
+
+    for (int p = 0; p < numPlanes; p++)
+        for (int x = 0; x < width; x++)
+            dst[p][x] = src[x * channels + p];
+}
+
+static void unpackWords(const uint8_t *src, uint8_t *const *dst, int width, int channels, int numPlanes, int shift, bool bigEndian) {
+    for (int p = 0; p < numPlanes; p++) {
+        uint16_t *dstp = reinterpret_cast<uint16_t *>(dst[p]);
+        for (int x = 0; x < width; x++)
+            dstp[x] = readU16(src + 2 * (x * channels + p), bigEndian) >> shift;
+    }
+}
+
+static void unpackFloats(const uint8_t *src, uint8_t *const *dst, int width, int channels, int numPlanes, bool bigEndian) {
+    for (int p = 0; p < numPlanes; p++) {
+        float *dstp = reinterpret_cast<float *>(dst[p]);
+        for (int x = 0; x < width; x++) {
+            uint32_t bits = readU32(src + 4 * (x * channels + p), bigEndian);
+            memcpy(dstp + x, &bits, sizeof(bits));
+        }
+    }
+}
+
+#ifdef VS_TARGET_CPU_X86
+static inline __m128i byteSwap32_sse2(__m128i v) {
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+// rgb has exactly one pixel per word so eight of them are split into the planes at once
+static int unpackPacked10RGB_sse2(const uint8_t *src, uint8_t *const *dst, int width, bool bigEndian) {
+    const __m128i mask = _mm_set1_epi32(0x3FF);
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4 + 16));
+        if (bigEndian) {
+            lo = byteSwap32_sse2(lo);
+            hi = byteSwap32_sse2(hi);
+        }
+
+        __m128i r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 22), mask), _mm_and_si128(_mm_srli_epi32(hi, 22), mask));
+        __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 12), mask), _mm_and_si128(_mm_srli_epi32(hi, 12), mask));
+        __m128i b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 2), mask), _mm_and_si128(_mm_srli_epi32(hi, 2), mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[0] + x * 2), r);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[1] + x * 2), g);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[2] + x * 2), b);
+    }
+
+    return x;
+}
+#endif
+
+static void unpackPacked10(const uint8_t *src, uint8_t *const *dst, int width, int channels, int numPlanes, bool bigEndian) {
+    int x = 0;
+#ifdef VS_TARGET_CPU_X86
+    if (channels == 3)
+        x = unpackPacked10RGB_sse2(src, dst, width, bigEndian);
+#endif
+
+    // the samples run on over pixel boundaries when there are 1, 2 or 4 channels
+    size_t count = static_cast<size_t>(width) * channels;
+    for (size_t i = static_cast<size_t>(x) * channels; i < count; i++) {
+        int p = static_cast<int>(i % channels);
+        if (p >= numPlanes)
+            continue;
+        uint32_t word = readU32(src + 4 * (i / 3), bigEndian);
+        reinterpret_cast<uint16_t *>(dst[p])[i / channels] = (word >> (22 - 10 * (i % 3))) & 0x3FF;
+    }
+}
+
+void RawImage::unpack(VSFrame *frame, VSFrame *alphaFrame, const VSAPI *vsapi) const {
+    int numPlanes = (colorFamily == cfRGB) ? 3 : 1;
+    uint8_t *dst[4] = {};
+    ptrdiff_t stride[4] = {};
+
+    for (int p = 0; p < numPlanes; p++) {
+        dst[p] = vsapi->getWritePtr(frame, p);
+        stride[p] = vsapi->getStride(frame, p);
+    }
+
+    // the alpha channel always comes last
+    if (alphaFrame && hasAlpha) {
+        dst[numPlanes] = vsapi->getWritePtr(alphaFrame, 0);
+        stride[numPlanes] = vsapi->getStride(alphaFrame, 0);
+        numPlanes++;
+    }
+
+    for (int y = 0; y < height; y++) {
+        const uint8_t *src = data + rowOffsets[y];
+
+        switch (container) {
+        case Container::Byte:
+            unpackBytes(src, dst, width, channels, numPlanes);
+            break;
+        case Container::Word:
+            unpackWords(src, dst, width, channels, numPlanes, shift, bigEndian);
+            break;
+        case Container::Float:
+            unpackFloats(src, dst, width, channels, numPlanes, bigEndian);
+            break;
+        case Container::Packed10:
+            unpackPacked10(src, dst, width, channels, numPlanes, bigEndian);
+            break;
+        }
+
+        for (int p = 0; p < numPlanes; p++)
+            dst[p] += stride[p];
+    }
+
+    if (alphaFrame && !hasAlpha)
+        memset(vsapi->getWritePtr(alphaFrame, 0), 0, vsapi->getStride(alphaFrame, 0) * height);
+}
@@ -0,0 +1,91 @@
+/*
+* Copyright (c) 2014-2019 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef RAWREADER_H
+#define RAWREADER_H
+
+#include <VapourSynth4.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Film scans usually come as DPX, Cineon or uncompressed TIFF which are little more than a header in
+// front of packed samples. Those are unpacked straight into the frame instead of going through
+// ImageMagick, anything with a layout that isn't handled here is left to ImageMagick.
+
+// A read-only view of a whole file
+class MappedFile {
+    const uint8_t *ptr = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void *file = nullptr;
+    void *mapping = nullptr;
+#endif
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    bool open(const std::string &filename);
+    const uint8_t *data() const { return ptr; }
+    size_t size() const { return length; }
+};
+
+class RawImage {
+public:
+    enum class Container {
+        Byte,
+        Word,       // 16 bit samples, right shifted by shift
+        Float,
+        Packed10    // three 10 bit samples to a 32 bit word, the first one in the top bits
+    };
+
+    int width = 0;
+    int height = 0;
+    VSColorFamily colorFamily = cfUndefined;
+    VSSampleType sampleType = stInteger;
+    int bitsPerSample = 0;
+    bool hasAlpha = false;
+    bool isTIFF = false;
+
+    // Returns false when the data isn't a file in one of the handled layouts
+    bool parse(const uint8_t *data, size_t size);
+
+    // The frame has to be in the format described above, a missing alpha channel is returned as 0
+    void unpack(VSFrame *frame, VSFrame *alphaFrame, const VSAPI *vsapi) const;
+
+private:
+    const uint8_t *data = nullptr;
+    Container container = Container::Byte;
+    int channels = 0;
+    int shift = 0;
+    bool bigEndian = false;
+    std::vector<size_t> rowOffsets;
+
+    bool parseDPX(size_t size);
+    bool parseCineon(size_t size);
+    bool parseTIFF(size_t size);
+    bool setRows(size_t size, size_t first, size_t rowBytes);
+    size_t rowDataBytes() const;
+};
+
+#endif
@@ -26,6 +26,7 @@
 #include <limits>
 #include <memory>
 #include <stdexcept>
+#include <type_traits>
 #include <vector>
 #include <VapourSynth4.h>
 #include <VSHelper4.h>
@@ -47,19 +48,147 @@ using namespace vsh;
 
 typedef struct {
     double threshold;
+    int downscale;
+    int last;
 } SCDetectDataExtra;
 
 typedef DualNodeData<SCDetectDataExtra> SCDetectData;
 
+// The downscaled difference compares the 2x2 averages of the luma planes, which also makes it less sensitive to
+// noise. The averages are rounded the same way as pavgb/pavgw so the SIMD versions give identical results.
+template<typename T>
+static T average2(T a, T b) {
+    return static_cast<T>((a + b + 1) >> 1);
+}
+
+template<>
+float average2(float a, float b) {
+    return (a + b) * 0.5f;
+}
+
+template<typename T, typename Acc>
+static void halfResDiffLine_c(const T *a0, const T *a1, const T *b0, const T *b1, int x, int width, Acc &acc) {
+    for (; x < width; x++) {
+        T a = average2(average2(a0[x * 2], a1[x * 2]), average2(a0[x * 2 + 1], a1[x * 2 + 1]));
+        T b = average2(average2(b0[x * 2], b1[x * 2]), average2(b0[x * 2 + 1], b1[x * 2 + 1]));
+        acc += (a > b) ? (a - b) : (b - a);
+    }
+}
+
+#ifdef VS_TARGET_CPU_X86
+// Both return the first output pixel left to do.
+static int halfResDiffLine_sse2(const uint8_t *a0, const uint8_t *a1, const uint8_t *b0, const uint8_t *b1, int width, uint64_t &acc) {
+    const __m128i even = _mm_set1_epi16(0x00FF);
+    __m128i sum = _mm_setzero_si128();
+    int x;
+    for (x = 0; x + 8 <= width; x += 8) {
+        __m128i va = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a0 + x * 2)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(a1 + x * 2)));
+        __m128i vb = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b0 + x * 2)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(b1 + x * 2)));
+        va = _mm_and_si128(_mm_avg_epu8(va, _mm_srli_epi16(va, 8)), even);
+        vb = _mm_and_si128(_mm_avg_epu8(vb, _mm_srli_epi16(vb, 8)), even);
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(va, vb));
+    }
+    acc += static_cast<uint64_t>(_mm_cvtsi128_si32(sum)) + static_cast<uint64_t>(_mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+    return x;
+}
+
+static int halfResDiffLine_sse2(const uint16_t *a0, const uint16_t *a1, const uint16_t *b0, const uint16_t *b1, int width, uint64_t &acc) {
+    const __m128i even = _mm_set1_epi32(0xFFFF);
+    __m128i sum = _mm_setzero_si128();
+    int x;
+    for (x = 0; x + 4 <= width; x += 4) {
+        __m128i va = _mm_avg_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a0 + x * 2)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(a1 + x * 2)));
+        __m128i vb = _mm_avg_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b0 + x * 2)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(b1 + x * 2)));
+        va = _mm_and_si128(_mm_avg_epu16(va, _mm_srli_epi32(va, 16)), even);
+        vb = _mm_and_si128(_mm_avg_epu16(vb, _mm_srli_epi32(vb, 16)), even);
+        sum = _mm_add_epi32(sum, _mm_or_si128(_mm_subs_epu16(va, vb), _mm_subs_epu16(vb, va)));
+    }
+    alignas(16) uint32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), sum);
+    acc += static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    return x;
+}
+
+// never called, float has no SIMD version
+static int halfResDiffLine_sse2(const float *, const float *, const float *, const float *, int, double &) {
+    return 0;
+}
+#endif
+
+template<typename T, typename Acc>
+static Acc halfResDiff(const VSFrame *f1, const VSFrame *f2, const VSAPI *vsapi) {
+    const int width = vsapi->getFrameWidth(f1, 0) / 2;
+    const int height = vsapi->getFrameHeight(f1, 0) / 2;
+    const ptrdiff_t stride1 = vsapi->getStride(f1, 0) / sizeof(T);
+    const ptrdiff_t stride2 = vsapi->getStride(f2, 0) / sizeof(T);
+    const T *srcp1 = reinterpret_cast<const T *>(vsapi->getReadPtr(f1, 0));
+    const T *srcp2 = reinterpret_cast<const T *>(vsapi->getReadPtr(f2, 0));
+    Acc acc = 0;
+
+    for (int y = 0; y < height; y++) {
+        const T *a0 = srcp1 + stride1 * y * 2;
+        const T *b0 = srcp2 + stride2 * y * 2;
+        int x = 0;
+#ifdef VS_TARGET_CPU_X86
+        if (!std::is_floating_point<T>::value)
+            x = halfResDiffLine_sse2(a0, a0 + stride1, b0, b0 + stride2, width, acc);
+#endif
+        halfResDiffLine_c(a0, a0 + stride1, b0, b0 + stride2, x, width, acc);
+    }
+
+    return acc;
+}
+
+// The normalized difference of the downscaled luma, in the same range as the PlaneStats one.
+static double scDetectDiff(const VSFrame *f1, const VSFrame *f2, const VSAPI *vsapi) {
+    const VSVideoFormat *fi = vsapi->getVideoFrameFormat(f1);
+    const double pixels = static_cast<double>(vsapi->getFrameWidth(f1, 0) / 2) * (vsapi->getFrameHeight(f1, 0) / 2);
+
+    if (fi->bytesPerSample == 1)
+        return halfResDiff<uint8_t, uint64_t>(f1, f2, vsapi) / (pixels * ((1 << fi->bitsPerSample) - 1));
+    else if (fi->bytesPerSample == 2)
+        return halfResDiff<uint16_t, uint64_t>(f1, f2, vsapi) / (pixels * ((1 << fi->bitsPerSample) - 1));
+    else
+        return halfResDiff<float, double>(f1, f2, vsapi) / pixels;
+}
+
 static const VSFrame *VS_CC scDetectGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     SCDetectData *d = static_cast<SCDetectData *>(instanceData);
 
     if (activationReason == arInitial) {
-        vsapi->requestFrameFilter(n, d->node1, frameCtx);
-        vsapi->requestFrameFilter(std::max(n - 1, 0), d->node2, frameCtx);
-        vsapi->requestFrameFilter(n, d->node2, frameCtx);
+        if (d->downscale > 1) {
+            // the first frame is compared to the second one for both diffs, like the PlaneStats path does
+            vsapi->requestFrameFilter(std::max(n - 1, 0), d->node1, frameCtx);
+            vsapi->requestFrameFilter(std::max(n, 1), d->node1, frameCtx);
+            vsapi->requestFrameFilter(std::min(n + 1, d->last), d->node1, frameCtx);
+        } else {
+            vsapi->requestFrameFilter(n, d->node1, frameCtx);
+            vsapi->requestFrameFilter(std::max(n - 1, 0), d->node2, frameCtx);
+            vsapi->requestFrameFilter(n, d->node2, frameCtx);
+        }
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src = vsapi->getFrameFilter(n, d->node1, frameCtx);
+
+        if (d->downscale > 1) {
+            const VSFrame *prevframe = vsapi->getFrameFilter(std::max(n - 1, 0), d->node1, frameCtx);
+            const VSFrame *prevnext = vsapi->getFrameFilter(std::max(n, 1), d->node1, frameCtx);
+            const VSFrame *nextframe = vsapi->getFrameFilter(std::min(n + 1, d->last), d->node1, frameCtx);
+
+            double prevdiff = scDetectDiff(prevframe, prevnext, vsapi);
+            double nextdiff = (n < d->last) ? ((n == 0) ? prevdiff : scDetectDiff(src, nextframe, vsapi)) : 0.0;
+
+            VSFrame *dst = vsapi->copyFrame(src, core);
+            VSMap *rwprops = vsapi->getFramePropertiesRW(dst);
+            vsapi->mapSetInt(rwprops, "_SceneChangePrev", prevdiff > d->threshold, maReplace);
+            vsapi->mapSetInt(rwprops, "_SceneChangeNext", nextdiff > d->threshold, maReplace);
+            vsapi->freeFrame(src);
+            vsapi->freeFrame(prevframe);
+            vsapi->freeFrame(prevnext);
+            vsapi->freeFrame(nextframe);
+
+            return dst;
+        }
+
         const VSFrame *prevframe = vsapi->getFrameFilter(std::max(n - 1, 0), d->node2, frameCtx);
         const VSFrame *nextframe = vsapi->getFrameFilter(n, d->node2, frameCtx);
 
@@ -86,8 +215,12 @@ static void VS_CC scDetectCreate(const VSMap *in, VSMap *out, void *userData, VS
     d->threshold = vsapi->mapGetFloat(in, "threshold", 0, &err);
     if (err)
         d->threshold = 0.1;
+    d->downscale = vsapi->mapGetIntSaturated(in, "downscale", 0, &err);
+    if (err)
+        d->downscale = 1;
     d->node1 = vsapi->mapGetNode(in, "clip", 0, nullptr);
     const VSVideoInfo *vi = vsapi->getVideoInfo(d->node1);
+    d->last = vi->numFrames - 1;
 
     try {
         if (d->threshold < 0.0 || d->threshold > 1.0)
@@ -96,7 +229,22 @@ static void VS_CC scDetectCreate(const VSMap *in, VSMap *out, void *userData, VS
             throw std::runtime_error("clip must be constant format and of integer 8-16 bit type or 32 bit float");
         if (vi->numFrames == 1)
             throw std::runtime_error("clip must have more than one frame");
+        if (d->downscale != 1 && d->downscale != 2)
+            throw std::runtime_error("downscale must be 1 or 2");
+        if (d->downscale > 1 && (vi->width < 2 || vi->height < 2))
+            throw std::runtime_error("clip must be at least 2x2 pixels when downscaling");
+    } catch (const std::runtime_error &e) {
+        vsapi->mapSetError(out, ("SCDetect: "_s + e.what()).c_str());
+        return;
+    }
+
+    if (d->downscale > 1) {
+        VSFilterDependency deps[] = {{ d->node1, rpGeneral }};
+        vsapi->createVideoFilter(out, "SCDetect", vi, scDetectGetFrame, filterFree<SCDetectData>, fmParallel, deps, 1, d.release(), core);
+        return;
+    }
 
+    try {
         VSPlugin *stdplugin = vsapi->getPluginByID(VSH_STD_PLUGIN_ID, core);
         VSMap *invmap = vsapi->createMap();
         VSMap *invmap2 = nullptr;
@@ -142,19 +290,57 @@ static void VS_CC averageFramesCreate(const VSMap *in, VSMap *out, void *userDat
 struct HysteresisExtraData {
     bool process[3];
     uint16_t peak;
-    size_t labelSize;
 };
 
 typedef DualNodeData<HysteresisExtraData> HysteresisData;
 
+#ifdef VS_TARGET_CPU_X86
+// Skips the whole vectors of a line that contain no seed pixels, where both clips are above 0, and returns the
+// position of the first one that may contain one. The vector size is returned in step.
+static int hysteresisSkipLine(const uint8_t *srcp1, const uint8_t *srcp2, int x, int width, int &step) {
+    const __m128i zero = _mm_setzero_si128();
+    step = 16;
+    for (; x + 16 <= width; x += 16) {
+        __m128i m = _mm_min_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(srcp1 + x)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(srcp2 + x)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(m, zero)) != 0xFFFF)
+            break;
+    }
+    return x;
+}
+
+static int hysteresisSkipLine(const uint16_t *srcp1, const uint16_t *srcp2, int x, int width, int &step) {
+    const __m128i zero = _mm_setzero_si128();
+    step = 8;
+    for (; x + 8 <= width; x += 8) {
+        __m128i za = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(srcp1 + x)), zero);
+        __m128i zb = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(srcp2 + x)), zero);
+        if (_mm_movemask_epi8(_mm_or_si128(za, zb)) != 0xFFFF)
+            break;
+    }
+    return x;
+}
+
+static int hysteresisSkipLine(const float *srcp1, const float *srcp2, int x, int width, int &step) {
+    const __m128 zero = _mm_setzero_ps();
+    step = 4;
+    for (; x + 4 <= width; x += 4) {
+        __m128 ga = _mm_cmpgt_ps(_mm_loadu_ps(srcp1 + x), zero);
+        __m128 gb = _mm_cmpgt_ps(_mm_loadu_ps(srcp2 + x), zero);
+        if (_mm_movemask_ps(_mm_and_ps(ga, gb)))
+            break;
+    }
+    return x;
+}
+#endif
+
+// Scanline flood fill of the clipb pixels 8-connected to a seed. The output itself marks the visited pixels
+// so no per frame buffer is needed, the span stack is kept per thread.
 template<typename T>
 static void process_frame_hysteresis(const VSFrame * src1, const VSFrame * src2, VSFrame * dst, const VSVideoFormat *fi, const HysteresisData * d, const VSAPI * vsapi) VS_NOEXCEPT {
-    uint8_t * VS_RESTRICT label = nullptr;
+    static thread_local std::vector<std::pair<int, int>> spans;
 
     for (int plane = 0; plane < fi->numPlanes; plane++) {
         if (d->process[plane]) {
-            if (!label)
-                label = new uint8_t[d->labelSize]();
             const int width = vsapi->getFrameWidth(src1, plane);
             const int height = vsapi->getFrameHeight(src1, plane);
             const ptrdiff_t stride = vsapi->getStride(src1, plane) / sizeof(T);
@@ -173,28 +359,60 @@ static void process_frame_hysteresis(const VSFrame * src1, const VSFrame * src2,
 
             std::fill_n(dstp, stride * height, lower);
 
-            std::vector<std::pair<int, int>> coordinates;
+            auto fillable = [&](int x, int y) {
+                return srcp2[stride * y + x] > lower && dstp[stride * y + x] != upper;
+            };
 
             for (int y = 0; y < height; y++) {
-                for (int x = 0; x < width; x++) {
-                    if (!label[width * y + x] && srcp1[stride * y + x] > lower && srcp2[stride * y + x] > lower) {
-                        label[width * y + x] = std::numeric_limits<uint8_t>::max();
-                        dstp[stride * y + x] = upper;
-
-                        coordinates.emplace_back(std::make_pair(x, y));
-
-                        while (!coordinates.empty()) {
-                            const auto pos = coordinates.back();
-                            coordinates.pop_back();
-
-                            for (int yy = std::max(pos.second - 1, 0); yy <= std::min(pos.second + 1, height - 1); yy++) {
-                                for (int xx = std::max(pos.first - 1, 0); xx <= std::min(pos.first + 1, width - 1); xx++) {
-                                    if (!label[width * yy + xx] && srcp2[stride * yy + xx] > lower) {
-                                        label[width * yy + xx] = std::numeric_limits<uint8_t>::max();
-                                        dstp[stride * yy + xx] = upper;
+                const T *line1 = srcp1 + stride * y;
+                const T *line2 = srcp2 + stride * y;
+#ifdef VS_TARGET_CPU_X86
+                int scalarEnd = 0;
+#endif
 
-                                        coordinates.emplace_back(std::make_pair(xx, yy));
-                                    }
+                for (int x = 0; x < width; x++) {
+#ifdef VS_TARGET_CPU_X86
+                    if (x >= scalarEnd) {
+                        int step;
+                        x = hysteresisSkipLine(line1, line2, x, width, step);
+                        if (x >= width)
+                            break;
+                        scalarEnd = x + step;
+                    }
+#endif
+                    if (!(line1[x] > lower && line2[x] > lower) || dstp[stride * y + x] == upper)
+                        continue;
+
+                    spans.emplace_back(x, y);
+
+                    while (!spans.empty()) {
+                        const auto pos = spans.back();
+                        spans.pop_back();
+                        const int sy = pos.second;
+                        T *dstl = dstp + stride * sy;
+
+                        if (dstl[pos.first] == upper)
+                            continue;
+
+                        // an unvisited pixel always starts a completely unvisited run
+                        int xl = pos.first;
+                        int xr = pos.first;
+                        while (xl > 0 && srcp2[stride * sy + xl - 1] > lower)
+                            xl--;
+                        while (xr < width - 1 && srcp2[stride * sy + xr + 1] > lower)
+                            xr++;
+                        std::fill(dstl + xl, dstl + xr + 1, upper);
+
+                        const int nl = std::max(xl - 1, 0);
+                        const int nr = std::min(xr + 1, width - 1);
+                        for (int ny = std::max(sy - 1, 0); ny <= std::min(sy + 1, height - 1); ny++) {
+                            if (ny == sy)
+                                continue;
+                            for (int nx = nl; nx <= nr; nx++) {
+                                if (fillable(nx, ny)) {
+                                    spans.emplace_back(nx, ny);
+                                    while (nx < nr && fillable(nx + 1, ny))
+                                        nx++;
                                 }
                             }
                         }
@@ -203,8 +421,6 @@ static void process_frame_hysteresis(const VSFrame * src1, const VSFrame * src2,
             }
         }
     }
-
-    delete[] label;
 }
 
 static const VSFrame *VS_CC hysteresisGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
@@ -257,8 +473,6 @@ static void VS_CC hysteresisCreate(const VSMap *in, VSMap *out, void *userData,
             d->peak = (1 << vi->format.bitsPerSample) - 1;
         }
 
-        d->labelSize = vi->width * vi->height;
-
     } catch (const std::runtime_error &e) {
         vsapi->mapSetError(out, ("Hysteresis: "_s + e.what()).c_str());
         return;
@@ -273,7 +487,7 @@ static void VS_CC hysteresisCreate(const VSMap *in, VSMap *out, void *userData,
 
 VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->configPlugin("com.vapoursynth.misc", "misc", "Miscellaneous filters", VAPOURSYNTH_INTERNAL_PLUGIN_VERSION, VAPOURSYNTH_API_VERSION, 0, plugin);
-    vspapi->registerFunction("SCDetect", "clip:vnode;threshold:float:opt;", "clip:vnode;", scDetectCreate, 0, plugin);
+    vspapi->registerFunction("SCDetect", "clip:vnode;threshold:float:opt;downscale:int:opt;", "clip:vnode;", scDetectCreate, 0, plugin);
     vspapi->registerFunction("AverageFrames", "clips:vnode[];weights:float[];scale:float:opt;scenechange:int:opt;planes:int[]:opt;", "clip:vnode;", averageFramesCreate, 0, plugin);
     vspapi->registerFunction("Hysteresis", "clipa:vnode;clipb:vnode;planes:int[]:opt;", "clip:vnode;", hysteresisCreate, nullptr, plugin);
 }
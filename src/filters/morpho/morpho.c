@@ -44,10 +44,10 @@ static void VS_CC MorphoCreate(const VSMap *in, VSMap *out, void *userData,
         goto error;
     }
 
-    if (d.vi.format.sampleType != stInteger ||
-        d.vi.format.bytesPerSample > 2) {
+    if ((d.vi.format.sampleType == stInteger && d.vi.format.bytesPerSample > 2) ||
+        (d.vi.format.sampleType == stFloat && d.vi.format.bitsPerSample != 32)) {
 
-        sprintf(msg, "Only 8-16 bit int formats supported");
+        sprintf(msg, "Only 8-16 bit int and 32 bit float formats supported");
         goto error;
     }
 
@@ -78,12 +78,42 @@ static void VS_CC MorphoCreate(const VSMap *in, VSMap *out, void *userData,
 
     d.selem = calloc(1, sizeof(uint8_t) * pads * pads);
     if (!d.selem) {
-        vsapi->mapSetError(out, "Failed to allocate structuring element");
+        sprintf(msg, "Failed to allocate structuring element");
         goto error;
     }
 
     SElemFuncs[d.shape](d.selem, d.size);
 
+    d.segs = malloc(sizeof(SElemSegment) * (d.size + 1) * (d.size + 2) / 2);
+    d.lengths = malloc(sizeof(int) * (d.size + 1));
+    if (!d.segs || !d.lengths) {
+        free(d.selem);
+        free(d.segs);
+        free(d.lengths);
+        sprintf(msg, "Failed to allocate structuring element");
+        goto error;
+    }
+
+    d.nsegs = SElemSegments(d.selem, d.size, d.segs);
+    d.nlengths = 0;
+    d.rect = d.nsegs == (d.size / 2) * 2 + 1;
+
+    for (int i = 0; i < d.nsegs; i++) {
+        int slot;
+
+        for (slot = 0; slot < d.nlengths; slot++)
+            if (d.lengths[slot] == d.segs[i].length)
+                break;
+
+        if (slot == d.nlengths)
+            d.lengths[d.nlengths++] = d.segs[i].length;
+
+        d.segs[i].slot = slot;
+
+        if (d.segs[i].length != d.segs[0].length || d.segs[i].x != d.segs[0].x)
+            d.rect = 0;
+    }
+
     data = malloc(sizeof(d));
     *data = d;
 
@@ -122,7 +152,12 @@ static const VSFrame *VS_CC MorphoGetFrame(int n, int activationReason,
             int height = vsapi->getFrameHeight(src, i);
             ptrdiff_t stride = vsapi->getStride(src, i);
 
-            FilterFuncs[d->filter](srcp, dstp, width, height, stride, d);
+            if (FilterFuncs[d->filter](srcp, dstp, width, height, stride, d)) {
+                vsapi->setFilterError("Morpho: Failed to allocate memory", frameCtx);
+                vsapi->freeFrame(src);
+                vsapi->freeFrame(dst);
+                return 0;
+            }
         }
 
         vsapi->freeFrame(src);
@@ -140,6 +175,8 @@ static void VS_CC MorphoFree(void *instanceData, VSCore *core,
 
     vsapi->freeNode(d->node);
     free(d->selem);
+    free(d->segs);
+    free(d->lengths);
     free(d);
 }
 
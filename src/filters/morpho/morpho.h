@@ -24,6 +24,14 @@ typedef struct MorphoData {
     int shape;
     int size;
 
+    /* The structuring element as horizontal runs, rect is set when it's a
+     * single run repeated on every row. */
+    struct SElemSegment *segs;
+    int nsegs;
+    int *lengths;
+    int nlengths;
+    int rect;
+
     uintptr_t filter;
 } MorphoData;
 
@@ -18,11 +18,14 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "VapourSynth4.h"
 #include "VSHelper4.h"
 
 #include "morpho.h"
+#include "morpho_selems.h"
 #include "morpho_filters.h"
 
 const char *FilterNames[] = {
@@ -51,89 +54,219 @@ static inline int Border(int v, int max) {
     else if (v > max)
         v = max - (v - max);
 
-    return v;
+    return VSMIN(VSMAX(v, 0), max);
 }
 
-#define MORPHO(T,V,OP)                                                         \
-    int x, y;                                                                  \
+/*
+ * Every horizontal run of the structuring element is computed for a whole
+ * line at once with the van Herk/Gil-Werman algorithm, the running extreme
+ * from the start (g) and from the end (h) of each block of length samples
+ * gives any window of that length with a single comparison. A rectangular
+ * element is then finished the same way vertically, other shapes combine
+ * one line per run. The cost no longer depends on the element area and all
+ * the inner loops are plain array operations the compiler can vectorize.
+ */
+#define MORPHO(T,OP,NAME)                                                      \
+static void NAME##Line(const T *src, T *dst, T *g, T *h, int n, int length)   \
+{                                                                              \
+    int k;                                                                     \
+                                                                               \
+    for (k = 0; k < n; k++)                                                    \
+        g[k] = (k % length) ? OP(g[k - 1], src[k]) : src[k];                   \
+                                                                               \
+    h[n - 1] = src[n - 1];                                                     \
+                                                                               \
+    for (k = n - 2; k >= 0; k--)                                               \
+        h[k] = ((k + 1) % length) ? OP(h[k + 1], src[k]) : src[k];             \
+                                                                               \
+    for (k = 0; k + length <= n; k++)                                          \
+        dst[k] = OP(h[k], g[k + length - 1]);                                  \
+}                                                                              \
+                                                                               \
+static void NAME##Rows(T *dst, const T *a, const T *b, int width)              \
+{                                                                              \
+    int x;                                                                     \
+                                                                               \
+    for (x = 0; x < width; x++)                                                \
+        dst[x] = OP(a[x], b[x]);                                               \
+}                                                                              \
+                                                                               \
+static void NAME##PadRow(const uint8_t *src, T *dst, int k, int width,         \
+                         int height, ptrdiff_t stride, int hsize)              \
+{                                                                              \
+    const T *srcp = (const T *)(src + Border(k - hsize, height - 1) * stride); \
+    int x;                                                                     \
+                                                                               \
+    for (x = 0; x < width + hsize * 2; x++)                                    \
+        dst[x] = srcp[Border(x - hsize, width - 1)];                           \
+}                                                                              \
+                                                                               \
+static int NAME(const uint8_t *src, uint8_t *dst, int width, int height,       \
+                ptrdiff_t stride, const MorphoData *d)                         \
+{                                                                              \
     int hsize = d->size / 2;                                                   \
+    int win = hsize * 2 + 1;                                                   \
+    int pw = width + hsize * 2;                                                \
+    int ph = height + hsize * 2;                                               \
+    size_t bufsize = d->rect ? (size_t)ph * width * 2                          \
+                             : (size_t)win * d->nlengths * pw;                 \
+    T *row = malloc(sizeof(T) * (pw * 4 + bufsize));                           \
+    T *line, *g, *h, *buf;                                                     \
+    int i, k, y;                                                               \
                                                                                \
-    for (y = 0; y < height; y++) {                                             \
-        for (x = 0; x < width; x++) {                                          \
-            int i, j;                                                          \
-            T v = (V);                                                         \
-                                                                               \
-            for (j = -hsize; j <= hsize; j++) {                                \
-                for (i = -hsize; i <= hsize; i++) {                            \
-                    uint8_t mv = d->selem[i + hsize + ((j + hsize) * d->size)];\
-                                                                               \
-                    if (mv) {                                                  \
-                        int sx = Border(x + i, width - 1);                     \
-                        int sy = Border(y + j, height - 1);                    \
-                        T sv = ((const T *)&src[sy * stride])[sx];             \
-                        v = OP(v, sv);                                         \
-                    }                                                          \
-                }                                                              \
-            }                                                                  \
+    if (!row)                                                                  \
+        return 1;                                                              \
+                                                                               \
+    line = row + pw;                                                           \
+    g = line + pw;                                                             \
+    h = g + pw;                                                                \
+    buf = h + pw;                                                              \
                                                                                \
-            ((T *)dst)[x] = v;                                                 \
+    if (d->rect) {                                                             \
+        const SElemSegment *seg = d->segs;                                     \
+        T *hor = buf;                                                          \
+        T *suf = buf + (size_t)ph * width;                                     \
+                                                                               \
+        for (k = 0; k < ph; k++) {                                             \
+            NAME##PadRow(src, row, k, width, height, stride, hsize);           \
+            NAME##Line(row, line, g, h, pw, seg->length);                      \
+            memcpy(hor + (size_t)k * width, line + hsize + seg->x,             \
+                   sizeof(T) * width);                                         \
         }                                                                      \
                                                                                \
-        dst += stride;                                                         \
-    }
-
-void MorphoDilate(const uint8_t *src, uint8_t *dst,
-                  int width, int height, ptrdiff_t stride, MorphoData *d)
-{
-    if (d->vi.format.bytesPerSample == 1) {
-        MORPHO(uint8_t, 0, VSMAX);
-    } else {
-        MORPHO(uint16_t, 0, VSMAX);
-    }
+        memcpy(suf + (size_t)(ph - 1) * width, hor + (size_t)(ph - 1) * width, \
+               sizeof(T) * width);                                             \
+                                                                               \
+        for (k = ph - 2; k >= 0; k--) {                                        \
+            if ((k + 1) % win)                                                 \
+                NAME##Rows(suf + (size_t)k * width, hor + (size_t)k * width,   \
+                           suf + (size_t)(k + 1) * width, width);              \
+            else                                                               \
+                memcpy(suf + (size_t)k * width, hor + (size_t)k * width,       \
+                       sizeof(T) * width);                                     \
+        }                                                                      \
+                                                                               \
+        for (k = 1; k < ph; k++)                                               \
+            if (k % win)                                                       \
+                NAME##Rows(hor + (size_t)k * width, hor + (size_t)k * width,   \
+                           hor + (size_t)(k - 1) * width, width);              \
+                                                                               \
+        for (y = 0; y < height; y++)                                           \
+            NAME##Rows((T *)(dst + y * stride), suf + (size_t)y * width,       \
+                       hor + (size_t)(y + win - 1) * width, width);            \
+    } else {                                                                   \
+        for (k = 0; k < ph; k++) {                                             \
+            T *ring = buf + (size_t)(k % win) * d->nlengths * pw;              \
+                                                                               \
+            NAME##PadRow(src, row, k, width, height, stride, hsize);           \
+                                                                               \
+            for (i = 0; i < d->nlengths; i++)                                  \
+                NAME##Line(row, ring + (size_t)i * pw, g, h, pw,               \
+                           d->lengths[i]);                                     \
+                                                                               \
+            if (k < win - 1)                                                   \
+                continue;                                                      \
+                                                                               \
+            y = k - win + 1;                                                   \
+                                                                               \
+            for (i = 0; i < d->nsegs; i++) {                                   \
+                const SElemSegment *seg = &d->segs[i];                         \
+                int sk = y + hsize + seg->y;                                   \
+                const T *sp = buf + ((size_t)(sk % win) * d->nlengths +        \
+                              seg->slot) * pw + hsize + seg->x;                \
+                T *dstp = (T *)(dst + y * stride);                             \
+                                                                               \
+                if (i == 0)                                                    \
+                    memcpy(dstp, sp, sizeof(T) * width);                       \
+                else                                                           \
+                    NAME##Rows(dstp, dstp, sp, width);                         \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    free(row);                                                                 \
+    return 0;                                                                  \
 }
 
-void MorphoErode(const uint8_t *src, uint8_t *dst,
+MORPHO(uint8_t, VSMAX, DilateU8)
+MORPHO(uint16_t, VSMAX, DilateU16)
+MORPHO(float, VSMAX, DilateF)
+MORPHO(uint8_t, VSMIN, ErodeU8)
+MORPHO(uint16_t, VSMIN, ErodeU16)
+MORPHO(float, VSMIN, ErodeF)
+
+int MorphoDilate(const uint8_t *src, uint8_t *dst,
                  int width, int height, ptrdiff_t stride, MorphoData *d)
 {
-    int sval = (1 << d->vi.format.bitsPerSample) - 1;
-
-    if (d->vi.format.bytesPerSample == 1) {
-        MORPHO(uint8_t, sval, VSMIN);
-    } else {
-        MORPHO(uint16_t, sval, VSMIN);
-    }
+    if (d->vi.format.bytesPerSample == 1)
+        return DilateU8(src, dst, width, height, stride, d);
+    else if (d->vi.format.bytesPerSample == 2)
+        return DilateU16(src, dst, width, height, stride, d);
+    else
+        return DilateF(src, dst, width, height, stride, d);
 }
 
-void MorphoOpen(const uint8_t *src, uint8_t *dst,
+int MorphoErode(const uint8_t *src, uint8_t *dst,
                 int width, int height, ptrdiff_t stride, MorphoData *d)
 {
+    if (d->vi.format.bytesPerSample == 1)
+        return ErodeU8(src, dst, width, height, stride, d);
+    else if (d->vi.format.bytesPerSample == 2)
+        return ErodeU16(src, dst, width, height, stride, d);
+    else
+        return ErodeF(src, dst, width, height, stride, d);
+}
+
+int MorphoOpen(const uint8_t *src, uint8_t *dst,
+               int width, int height, ptrdiff_t stride, MorphoData *d)
+{
+    int ret;
     uint8_t *tmp = malloc(sizeof(uint8_t) * stride * height);
-    MorphoErode(src, tmp, width, height, stride, d);
-    MorphoDilate((const uint8_t*)tmp, dst, width, height, stride, d);
+
+    if (!tmp)
+        return 1;
+
+    ret = MorphoErode(src, tmp, width, height, stride, d) ||
+          MorphoDilate((const uint8_t*)tmp, dst, width, height, stride, d);
     free(tmp);
+    return ret;
 }
 
-void MorphoClose(const uint8_t *src, uint8_t *dst,
-                 int width, int height, ptrdiff_t stride, MorphoData *d)
+int MorphoClose(const uint8_t *src, uint8_t *dst,
+                int width, int height, ptrdiff_t stride, MorphoData *d)
 {
+    int ret;
     uint8_t *tmp = malloc(sizeof(uint8_t) * stride * height);
-    MorphoDilate(src, tmp, width, height, stride, d);
-    MorphoErode((const uint8_t*)tmp, dst, width, height, stride, d);
+
+    if (!tmp)
+        return 1;
+
+    ret = MorphoDilate(src, tmp, width, height, stride, d) ||
+          MorphoErode((const uint8_t*)tmp, dst, width, height, stride, d);
     free(tmp);
+    return ret;
 }
 
-void MorphoTopHat(const uint8_t *src, uint8_t *dst,
-                  int width, int height, ptrdiff_t stride, MorphoData *d)
+int MorphoTopHat(const uint8_t *src, uint8_t *dst,
+                 int width, int height, ptrdiff_t stride, MorphoData *d)
 {
     int x, y;
 
-    MorphoOpen(src, dst, width, height, stride, d);
+    if (MorphoOpen(src, dst, width, height, stride, d))
+        return 1;
 
     for (y = 0; y < height; y++) {
         if (d->vi.format.bytesPerSample == 1) {
             for (x = 0; x < width; x++) {
                 dst[x] = VSMAX(0, (int16_t)src[x] - dst[x]);
             }
+        } else if (d->vi.format.bytesPerSample == 4) {
+            const float *srcp = (const float *)src;
+            float *dstp = (float *)dst;
+
+            for (x = 0; x < width; x++) {
+                dstp[x] = VSMAX(0.0f, srcp[x] - dstp[x]);
+            }
         } else {
             const uint16_t *srcp = (const uint16_t *)src;
             uint16_t *dstp = (uint16_t *)dst;
@@ -146,20 +279,30 @@ void MorphoTopHat(const uint8_t *src, uint8_t *dst,
         dst += stride;
         src += stride;
     }
+
+    return 0;
 }
 
-void MorphoBottomHat(const uint8_t *src, uint8_t *dst,
-                     int width, int height, ptrdiff_t stride, MorphoData *d)
+int MorphoBottomHat(const uint8_t *src, uint8_t *dst,
+                    int width, int height, ptrdiff_t stride, MorphoData *d)
 {
     int x, y;
 
-    MorphoClose(src, dst, width, height, stride, d);
+    if (MorphoClose(src, dst, width, height, stride, d))
+        return 1;
 
     for (y = 0; y < height; y++) {
         if (d->vi.format.bytesPerSample == 1) {
             for (x = 0; x < width; x++) {
                 dst[x] = VSMAX(0, (int16_t)dst[x] - src[x]);
             }
+        } else if (d->vi.format.bytesPerSample == 4) {
+            const float *srcp = (const float *)src;
+            float *dstp = (float *)dst;
+
+            for (x = 0; x < width; x++) {
+                dstp[x] = VSMAX(0.0f, dstp[x] - srcp[x]);
+            }
         } else {
             const uint16_t *srcp = (const uint16_t *)src;
             uint16_t *dstp = (uint16_t *)dst;
@@ -172,4 +315,6 @@ void MorphoBottomHat(const uint8_t *src, uint8_t *dst,
         dst += stride;
         src += stride;
     }
+
+    return 0;
 }
@@ -84,3 +84,33 @@ void CircleSElem(uint8_t *selem, int size) {
         selem[y + (r * size)] = 9;
     }
 }
+
+/* Splits the structuring element into horizontal runs, using the same tap
+ * layout as the filters have always used. segs needs room for
+ * (size + 1) * (size + 2) / 2 entries. Returns the number of runs. */
+int SElemSegments(const uint8_t *selem, int size, SElemSegment *segs) {
+    int hsize = size / 2;
+    int n = 0;
+    int i, j;
+
+    for (j = -hsize; j <= hsize; j++) {
+        for (i = -hsize; i <= hsize;) {
+            int start = i;
+
+            while (i <= hsize && selem[i + hsize + ((j + hsize) * size)])
+                i++;
+
+            if (i > start) {
+                segs[n].y = j;
+                segs[n].x = start;
+                segs[n].length = i - start;
+                segs[n].slot = 0;
+                n++;
+            } else {
+                i++;
+            }
+        }
+    }
+
+    return n;
+}
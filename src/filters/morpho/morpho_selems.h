@@ -18,8 +18,19 @@
 
 typedef void (*SElemFunc)(uint8_t*, int);
 
+/* A horizontal run of taps, row y and columns x to x + length - 1 relative
+ * to the center. slot indexes the distinct run lengths. */
+typedef struct SElemSegment {
+    int y;
+    int x;
+    int length;
+    int slot;
+} SElemSegment;
+
 void SquareSElem(uint8_t *selem, int size);
 void DiamondSElem(uint8_t *selem, int size);
 void CircleSElem(uint8_t *selem, int size);
 
+int SElemSegments(const uint8_t *selem, int size, SElemSegment *segs);
+
 extern const SElemFunc SElemFuncs[];
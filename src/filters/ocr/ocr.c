@@ -19,13 +19,45 @@
 #include <ctype.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 #include <tesseract/capi.h>
 
 #include "VapourSynth4.h"
 #include "VSHelper4.h"
 
+#ifdef _WIN32
+typedef SRWLOCK OCRLock;
+
+static void OCRLockInit(OCRLock *lock) { InitializeSRWLock(lock); }
+static void OCRLockDestroy(OCRLock *lock) { (void)lock; }
+static void OCRLockAcquire(OCRLock *lock) { AcquireSRWLockExclusive(lock); }
+static void OCRLockRelease(OCRLock *lock) { ReleaseSRWLockExclusive(lock); }
+#else
+typedef pthread_mutex_t OCRLock;
+
+static void OCRLockInit(OCRLock *lock) { pthread_mutex_init(lock, NULL); }
+static void OCRLockDestroy(OCRLock *lock) { pthread_mutex_destroy(lock); }
+static void OCRLockAcquire(OCRLock *lock) { pthread_mutex_lock(lock); }
+static void OCRLockRelease(OCRLock *lock) { pthread_mutex_unlock(lock); }
+#endif
+
+/* Initializing Tesseract loads the language data, which takes far longer
+   than recognizing a line of subtitles. The instances are kept and reused
+   by whichever thread needs one next. */
+typedef struct OCRInstance {
+    TessBaseAPI *api;
+    struct OCRInstance *next;
+} OCRInstance;
+
 typedef struct OCRData {
     VSNode *node;
     VSVideoInfo vi;
@@ -33,12 +65,71 @@ typedef struct OCRData {
     VSMap *options;
     char *datapath;
     char *language;
+
+    int rect[4];
+    int dirty_rect;
+
+    OCRLock lock;
+    OCRInstance *instances;
 } OCRData;
 
+static void OCRFreeInstance(OCRInstance *instance) {
+    TessBaseAPIEnd(instance->api);
+    TessBaseAPIDelete(instance->api);
+    free(instance);
+}
+
+static OCRInstance *OCRCreateInstance(const OCRData *d, char *msg, size_t msg_size,
+    const VSAPI *vsapi) {
+    OCRInstance *instance = malloc(sizeof(OCRInstance));
+
+    instance->api = TessBaseAPICreate();
+    instance->next = NULL;
+
+    if (TessBaseAPIInit3(instance->api, d->datapath, d->language) == -1) {
+        snprintf(msg, msg_size, "Failed to initialize Tesseract");
+
+        TessBaseAPIDelete(instance->api);
+        free(instance);
+
+        return NULL;
+    }
+
+    if (d->options) {
+        int i, err;
+        int nopts = vsapi->mapNumElements(d->options, "options");
+
+        for (i = 0; i < nopts; i += 2) {
+            const char *key = vsapi->mapGetData(d->options, "options",
+                i, &err);
+            const char *value = vsapi->mapGetData(d->options, "options",
+                i + 1, &err);
+
+            if (!TessBaseAPISetVariable(instance->api, key, value)) {
+                snprintf(msg, msg_size,
+                    "Failed to set Tesseract option '%s'", key);
+
+                OCRFreeInstance(instance);
+
+                return NULL;
+            }
+        }
+    }
+
+    return instance;
+}
+
 static void VS_CC OCRFree(void *instanceData, VSCore *core,
     const VSAPI *vsapi) {
     OCRData *d = (OCRData *)instanceData;
 
+    while (d->instances) {
+        OCRInstance *next = d->instances->next;
+        OCRFreeInstance(d->instances);
+        d->instances = next;
+    }
+
+    OCRLockDestroy(&d->lock);
     vsapi->freeNode(d->node);
     vsapi->freeMap(d->options);
     free(d->datapath);
@@ -60,63 +151,75 @@ static const VSFrame *VS_CC OCRGetFrame(int n, int activationReason,
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
         VSFrame *dst = vsapi->copyFrame(src, core);
         VSMap *m = vsapi->getFramePropertiesRW(dst);
+        OCRInstance *instance;
 
         const uint8_t *srcp = vsapi->getReadPtr(src, 0);
         int width = vsapi->getFrameWidth(src, 0);
         int height = vsapi->getFrameHeight(src, 0);
         ptrdiff_t stride = vsapi->getStride(src, 0);
 
-        TessBaseAPI *api = TessBaseAPICreate();
-        if (TessBaseAPIInit3(api, d->datapath, d->language) == -1) {
-            vsapi->setFilterError("Failed to initialize Tesseract", frameCtx);
+        /* The region to recognize as left, top, right and bottom. */
+        int left = d->rect[0];
+        int top = d->rect[1];
+        int right = d->rect[2] > 0 ? d->rect[0] + d->rect[2] : width;
+        int bottom = d->rect[3] > 0 ? d->rect[1] + d->rect[3] : height;
 
-            TessBaseAPIDelete(api);
-            vsapi->freeFrame(src);
-            vsapi->freeFrame(dst);
+        if (d->dirty_rect) {
+            const VSMap *props = vsapi->getFramePropertiesRO(src);
+
+            if (vsapi->mapNumElements(props, "_DirtyRect") == 4) {
+                const int64_t *r = vsapi->mapGetIntArray(props, "_DirtyRect", NULL);
 
-            return 0;
+                left = VSMAX(left, (int)VSMIN(r[0], width));
+                top = VSMAX(top, (int)VSMIN(r[1], height));
+                right = VSMIN(right, (int)VSMIN(r[0] + VSMAX(r[2], 0), width));
+                bottom = VSMIN(bottom, (int)VSMIN(r[1] + VSMAX(r[3], 0), height));
+            }
         }
 
-        if (d->options) {
-            int i, err;
-            int nopts = vsapi->mapNumElements(d->options, "options");
+        right = VSMIN(right, width);
+        bottom = VSMIN(bottom, height);
+
+        /* Nothing to read, don't bother Tesseract. */
+        if (left >= right || top >= bottom) {
+            vsapi->mapSetData(m, "OCRString", "", 0, dtUtf8, maReplace);
+            vsapi->freeFrame(src);
 
-            for (i = 0; i < nopts; i += 2) {
-                const char *key = vsapi->mapGetData(d->options, "options",
-                    i, &err);
-                const char *value = vsapi->mapGetData(d->options, "options",
-                    i + 1, &err);
+            return dst;
+        }
 
-                if (!TessBaseAPISetVariable(api, key, value)) {
-                    char msg[200];
+        OCRLockAcquire(&d->lock);
+        instance = d->instances;
+        if (instance)
+            d->instances = instance->next;
+        OCRLockRelease(&d->lock);
 
-                    snprintf(msg, 200,
-                        "Failed to set Tesseract option '%s'", key);
+        if (!instance) {
+            char msg[200];
 
-                    vsapi->setFilterError(msg, frameCtx);
+            instance = OCRCreateInstance(d, msg, sizeof(msg), vsapi);
 
-                    TessBaseAPIEnd(api);
-                    TessBaseAPIDelete(api);
-                    vsapi->freeFrame(src);
-                    vsapi->freeFrame(dst);
+            if (!instance) {
+                vsapi->setFilterError(msg, frameCtx);
+                vsapi->freeFrame(src);
+                vsapi->freeFrame(dst);
 
-                    return 0;
-                }
+                return 0;
             }
         }
 
         {
             unsigned i;
 
-            char *result = TessBaseAPIRect(api, srcp, 1,
-                stride, 0, 0, width, height);
-            int *confs = TessBaseAPIAllWordConfidences(api);
-            int length = strlen(result);
+            char *result = TessBaseAPIRect(instance->api, srcp, 1,
+                stride, left, top, right - left, bottom - top);
+            int *confs = TessBaseAPIAllWordConfidences(instance->api);
+            int length = result ? strlen(result) : 0;
 
             for (; length > 0 && isspace(result[length - 1]); length--);
-            vsapi->mapSetData(m, "OCRString", result, length, dtUtf8, maReplace);
+            vsapi->mapSetData(m, "OCRString", result ? result : "", length, dtUtf8, maReplace);
 
-            for (i = 0; confs[i] != -1; i++) {
+            for (i = 0; confs && confs[i] != -1; i++) {
                 vsapi->mapSetInt(m, "OCRConfidence", confs[i], maAppend);
             }
 
@@ -124,8 +227,14 @@ static const VSFrame *VS_CC OCRGetFrame(int n, int activationReason,
             free(result);
         }
 
-        TessBaseAPIEnd(api);
-        TessBaseAPIDelete(api);
+        /* Keeps the recognized text out of the next frame's results. */
+        TessBaseAPIClear(instance->api);
+
+        OCRLockAcquire(&d->lock);
+        instance->next = d->instances;
+        d->instances = instance;
+        OCRLockRelease(&d->lock);
+
         vsapi->freeFrame(src);
 
         return dst;
@@ -156,7 +265,8 @@ static void VS_CC OCRCreate(const VSMap *in, VSMap *out, void *userData,
     VSCore *core, const VSAPI *vsapi) {
     OCRData d, *data;
     const char *msg;
-    int err, nopts;
+    char errmsg[200];
+    int err, nopts, i;
 
     int size;
     const char *opt;
@@ -166,6 +276,7 @@ static void VS_CC OCRCreate(const VSMap *in, VSMap *out, void *userData,
     d.options = NULL;
     d.datapath = NULL;
     d.language = NULL;
+    d.instances = NULL;
 
     if (d.vi.format.colorFamily == cfUndefined) {
         msg = "Only constant format input supported";
@@ -185,8 +296,6 @@ static void VS_CC OCRCreate(const VSMap *in, VSMap *out, void *userData,
             msg = "Options must be key,value pairs";
             goto error;
         } else {
-            int i;
-
             d.options = vsapi->createMap();
 
             for (i = 0; i < nopts; i++) {
@@ -231,7 +340,7 @@ static void VS_CC OCRCreate(const VSMap *in, VSMap *out, void *userData,
     size = vsapi->mapGetDataSize(in, "datapath", 0, &err);
 
     if (!err) {
-        d.language = szterm(opt, size);
+        d.datapath = szterm(opt, size);
 #ifdef _WIN32
     } else {
         VSPlugin *ocr_plugin = vsapi->getPluginByID("biz.srsfckn.ocr", core);
@@ -244,6 +353,39 @@ static void VS_CC OCRCreate(const VSMap *in, VSMap *out, void *userData,
 #endif
     }
 
+    nopts = vsapi->mapNumElements(in, "rect");
+
+    if (nopts > 0 && nopts != 4) {
+        msg = "rect must be x, y, width and height";
+        goto error;
+    }
+
+    for (i = 0; i < 4; i++) {
+        d.rect[i] = nopts > 0 ? vsapi->mapGetIntSaturated(in, "rect", i, NULL) : 0;
+
+        if (d.rect[i] < 0) {
+            msg = "rect can't be negative";
+            goto error;
+        }
+    }
+
+    if (d.vi.width && (d.rect[0] >= d.vi.width || d.rect[1] >= d.vi.height)) {
+        msg = "rect must start inside the frame";
+        goto error;
+    }
+
+    d.dirty_rect = !!vsapi->mapGetInt(in, "dirty_rect", 0, &err);
+
+    /* The first instance also checks that the settings work. */
+    d.instances = OCRCreateInstance(&d, errmsg, sizeof(errmsg), vsapi);
+
+    if (!d.instances) {
+        msg = errmsg;
+        goto error;
+    }
+
+    OCRLockInit(&d.lock);
+
     data = malloc(sizeof(d));
     *data = d;
 
@@ -265,5 +407,5 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI
 
 VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->configPlugin("biz.srsfckn.ocr", "ocr", "Tesseract OCR Filter", VS_MAKE_VERSION(1, 0), VAPOURSYNTH_API_VERSION, 0, plugin);
-    vspapi->registerFunction("Recognize", "clip:vnode;datapath:data:opt;language:data:opt;options:data[]:opt", "clip:vnode;", OCRCreate, 0, plugin);
+    vspapi->registerFunction("Recognize", "clip:vnode;datapath:data:opt;language:data:opt;options:data[]:opt;rect:int[]:opt;dirty_rect:int:opt;", "clip:vnode;", OCRCreate, 0, plugin);
 }
@@ -27,6 +27,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 #include <limits>
 #include "shared.h"
+#include "clense.h"
 
 #define CLENSE_RETERROR(x) do { vsapi->mapSetError(out, (x)); vsapi->freeNode(d.cnode); vsapi->freeNode(d.pnode); vsapi->freeNode(d.nnode); return; } while (0)
 #define CLAMP(value, lower, upper) do { if (value < lower) value = lower; else if (value > upper) value = upper; } while(0)
@@ -38,14 +39,28 @@ typedef struct {
     const VSVideoInfo *vi;
     int mode;
     int process[3];
+    bool mask;
+    bool avx2;
 } ClenseData;
 
+template<typename T>
+static void clenseMaskLine(T* VS_RESTRICT pMask, const T* VS_RESTRICT pDst, const T* VS_RESTRICT pSrc, int width) {
+    for (int x = 0; x < width; ++x)
+        pMask[x] = (pDst[x] != pSrc[x]) ? std::numeric_limits<T>::max() : 0;
+}
+
 struct PlaneProc {
+    static const bool fb = false;
+
     template<typename T>
-    static void clenseProcessPlane(T* VS_RESTRICT pDst, const T* VS_RESTRICT pSrc, const T* VS_RESTRICT pRef1, const T* VS_RESTRICT pRef2, ptrdiff_t stride, int width, int height) {
+    static void clenseProcessPlane(T* VS_RESTRICT pDst, T* VS_RESTRICT pMask, const T* VS_RESTRICT pSrc, const T* VS_RESTRICT pRef1, const T* VS_RESTRICT pRef2, ptrdiff_t stride, int width, int height) {
         for (int y = 0; y < height; ++y) {
             for (int x = 0; x < width; ++x)
                 pDst[x] = std::min(std::max(pSrc[x], std::min(pRef1[x], pRef2[x])), std::max(pRef1[x], pRef2[x]));
+            if (pMask) {
+                clenseMaskLine(pMask, pDst, pSrc, width);
+                pMask += stride;
+            }
             pDst += stride;
             pSrc += stride;
             pRef1 += stride;
@@ -55,8 +70,10 @@ struct PlaneProc {
 };
 
 struct PlaneProcFB {
+    static const bool fb = true;
+
     template<typename T>
-    static void clenseProcessPlane(T* VS_RESTRICT pDst, const T* VS_RESTRICT pSrc, const T* VS_RESTRICT pRef1, const T* VS_RESTRICT pRef2, ptrdiff_t stride, int width, int height) {
+    static void clenseProcessPlane(T* VS_RESTRICT pDst, T* VS_RESTRICT pMask, const T* VS_RESTRICT pSrc, const T* VS_RESTRICT pRef1, const T* VS_RESTRICT pRef2, ptrdiff_t stride, int width, int height) {
         for (int y = 0; y < height; ++y) {
             for (int x = 0; x < width; ++x) {
                 T minref = std::min(pRef1[x], pRef2[x]);
@@ -67,6 +84,10 @@ struct PlaneProcFB {
                 CLAMP(src, std::max<int>(lowref, std::numeric_limits<T>::min()), std::min<int>(upref, std::numeric_limits<T>::max()));
                 pDst[x] = src;
             }
+            if (pMask) {
+                clenseMaskLine(pMask, pDst, pSrc, width);
+                pMask += stride;
+            }
 
             pDst += stride;
             pSrc += stride;
@@ -76,6 +97,15 @@ struct PlaneProcFB {
     }
 };
 
+// The mask has the same format as the clip, planes that aren't processed are left at 0
+static void clenseAttachMask(VSFrame *dst, VSFrame *mask, const int *process, const VSAPI *vsapi) {
+    const VSVideoFormat *fi = vsapi->getVideoFrameFormat(mask);
+    for (int i = 0; i < fi->numPlanes; i++)
+        if (!process[i])
+            memset(vsapi->getWritePtr(mask, i), 0, vsapi->getStride(mask, i) * vsapi->getFrameHeight(mask, i));
+    vsapi->mapConsumeFrame(vsapi->getFramePropertiesRW(dst), "ClenseMask", mask, maReplace);
+}
+
 template<typename T, typename Processor>
 static const VSFrame *VS_CC clenseGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     ClenseData *d = static_cast<ClenseData *>(instanceData);
@@ -108,8 +138,17 @@ static const VSFrame *VS_CC clenseGetFrame(int n, int activationReason, void *in
     } else if (activationReason == arAllFramesReady) {
         const VSFrame *src = nullptr, *frame1 = nullptr, *frame2 = nullptr;
 
-        if (!*frameData) // skip processing on first/last frames
-            return vsapi->getFrameFilter(n, d->cnode, frameCtx);
+        if (!*frameData) { // skip processing on first/last frames
+            src = vsapi->getFrameFilter(n, d->cnode, frameCtx);
+            if (!d->mask)
+                return src;
+
+            VSFrame *dst = vsapi->copyFrame(src, core);
+            vsapi->freeFrame(src);
+            const int process[3] = {};
+            clenseAttachMask(dst, vsapi->newVideoFrame(&d->vi->format, d->vi->width, d->vi->height, nullptr, core), process, vsapi);
+            return dst;
+        }
 
         if (d->mode == cmNormal) {
             frame1 = vsapi->getFrameFilter(n - 1, d->pnode, frameCtx);
@@ -129,21 +168,33 @@ static const VSFrame *VS_CC clenseGetFrame(int n, int activationReason, void *in
         const VSFrame *fr[] = { d->process[0] ? nullptr : src, d->process[1] ? nullptr : src, d->process[2] ? nullptr : src };
 
         VSFrame *dst = vsapi->newVideoFrame2(&d->vi->format, d->vi->width, d->vi->height, fr, pl, src, core);
+        VSFrame *mask = d->mask ? vsapi->newVideoFrame(&d->vi->format, d->vi->width, d->vi->height, nullptr, core) : nullptr;
 
         int numPlanes = d->vi->format.numPlanes;
         for (int i = 0; i < numPlanes; i++) {
             if (d->process[i]) {
-                Processor::template clenseProcessPlane<T>(
-                    reinterpret_cast<T *>(vsapi->getWritePtr(dst, i)),
-                    reinterpret_cast<const T *>(vsapi->getReadPtr(src, i)),
-                    reinterpret_cast<const T *>(vsapi->getReadPtr(frame1, i)),
-                    reinterpret_cast<const T *>(vsapi->getReadPtr(frame2, i)),
-                    vsapi->getStride(dst, i)/sizeof(T),
-                    vsapi->getFrameWidth(dst, i),
-                    vsapi->getFrameHeight(dst, i));
+                T *dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, i));
+                T *maskp = mask ? reinterpret_cast<T *>(vsapi->getWritePtr(mask, i)) : nullptr;
+                const T *srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, i));
+                const T *ref1p = reinterpret_cast<const T *>(vsapi->getReadPtr(frame1, i));
+                const T *ref2p = reinterpret_cast<const T *>(vsapi->getReadPtr(frame2, i));
+                ptrdiff_t stride = vsapi->getStride(dst, i) / sizeof(T);
+                int width = vsapi->getFrameWidth(dst, i);
+                int height = vsapi->getFrameHeight(dst, i);
+#ifdef VS_TARGET_CPU_X86
+                if (d->avx2)
+                    clensePlaneAVX2(Processor::fb, sizeof(T), dstp, maskp, srcp, ref1p, ref2p, stride, width, height);
+                else
+                    clenseProcessPlaneSimd<VecSse2, T, Processor::fb>(dstp, maskp, srcp, ref1p, ref2p, stride, width, height);
+#else
+                Processor::template clenseProcessPlane<T>(dstp, maskp, srcp, ref1p, ref2p, stride, width, height);
+#endif
             }
         }
 
+        if (mask)
+            clenseAttachMask(dst, mask, d->process, vsapi);
+
         vsapi->freeFrame(src);
         vsapi->freeFrame(frame1);
         vsapi->freeFrame(frame2);
@@ -208,6 +259,11 @@ void VS_CC clenseCreate(const VSMap *in, VSMap *out, void *userData, VSCore *cor
         d.process[o] = 1;
     }
 
+    d.mask = !!vsapi->mapGetInt(in, "mask", 0, &err);
+#ifdef VS_TARGET_CPU_X86
+    d.avx2 = hasAVX2();
+#endif
+
     VSFilterGetFrame getFrameFunc = nullptr;
     if (d.vi->format.sampleType == stInteger) {
         if (d.mode == cmNormal) {
@@ -0,0 +1,105 @@
+/*
+VapourSynth adaption by Fredrik Mellbin
+
+Copyright(c) 2013 Victor Efimov
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files(the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions :
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CLENSE_H
+#define CLENSE_H
+
+#include "shared.h"
+
+#ifdef VS_TARGET_CPU_X86
+
+// Shared with the AVX2 version which is built separately, the anonymous namespace keeps the
+// differently compiled copies apart.
+namespace {
+
+template<class V, typename T>
+static __forceinline typename V::R clenseMin(typename V::R a, typename V::R b) {
+    return (sizeof(T) == 1) ? V::min_epu8(a, b) : V::min_epu16(a, b);
+}
+
+template<class V, typename T>
+static __forceinline typename V::R clenseMax(typename V::R a, typename V::R b) {
+    return (sizeof(T) == 1) ? V::max_epu8(a, b) : V::max_epu16(a, b);
+}
+
+template<class V, typename T>
+static __forceinline typename V::R clenseAdds(typename V::R a, typename V::R b) {
+    return (sizeof(T) == 1) ? V::adds_epu8(a, b) : V::adds_epu16(a, b);
+}
+
+template<class V, typename T>
+static __forceinline typename V::R clenseSubs(typename V::R a, typename V::R b) {
+    return (sizeof(T) == 1) ? V::subs_epu8(a, b) : V::subs_epu16(a, b);
+}
+
+template<class V, typename T>
+static __forceinline typename V::R clenseCmpeq(typename V::R a, typename V::R b) {
+    return (sizeof(T) == 1) ? V::cmpeq_epi8(a, b) : V::cmpeq_epi16(a, b);
+}
+
+// Lines are processed in whole vectors, this stays within the stride since it's always a multiple
+// of the frame alignment. Where the mask is set changed pixels become the maximum value and the
+// others 0. The forward/backward limits are computed with saturation in place of the clamping.
+template<class V, typename T, bool FB>
+static void clenseProcessPlaneSimd(T * VS_RESTRICT pDst, T * VS_RESTRICT pMask, const T * VS_RESTRICT pSrc, const T * VS_RESTRICT pRef1, const T * VS_RESTRICT pRef2, ptrdiff_t stride, int width, int height) {
+    typedef typename V::R R;
+    const int step = sizeof(R) / sizeof(T);
+    const R ones = V::set1_epi16(-1);
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; x += step) {
+            const R src = V::loadu_si128(pSrc + x);
+            const R ref1 = V::loadu_si128(pRef1 + x);
+            const R ref2 = V::loadu_si128(pRef2 + x);
+            R lower = clenseMin<V, T>(ref1, ref2);
+            R upper = clenseMax<V, T>(ref1, ref2);
+
+            if (FB) {
+                lower = clenseSubs<V, T>(lower, clenseSubs<V, T>(ref2, lower));
+                upper = clenseAdds<V, T>(upper, clenseSubs<V, T>(upper, ref2));
+            }
+
+            const R res = clenseMin<V, T>(clenseMax<V, T>(src, lower), upper);
+            V::storeu_si128(pDst + x, res);
+            if (pMask)
+                V::storeu_si128(pMask + x, V::xor_si128(clenseCmpeq<V, T>(res, src), ones));
+        }
+
+        pDst += stride;
+        if (pMask)
+            pMask += stride;
+        pSrc += stride;
+        pRef1 += stride;
+        pRef2 += stride;
+    }
+}
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+/*
+VapourSynth adaption by Fredrik Mellbin
+
+Copyright(c) 2013 Victor Efimov
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files(the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions :
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "shared_avx2.h"
+#include "clense.h"
+
+void clensePlaneAVX2(bool fb, int bytesPerSample, void *dst, void *mask, const void *src, const void *ref1, const void *ref2, ptrdiff_t stride, int width, int height) {
+    if (bytesPerSample == 1) {
+        if (fb)
+            clenseProcessPlaneSimd<VecAvx2, uint8_t, true>(static_cast<uint8_t *>(dst), static_cast<uint8_t *>(mask), static_cast<const uint8_t *>(src), static_cast<const uint8_t *>(ref1), static_cast<const uint8_t *>(ref2), stride, width, height);
+        else
+            clenseProcessPlaneSimd<VecAvx2, uint8_t, false>(static_cast<uint8_t *>(dst), static_cast<uint8_t *>(mask), static_cast<const uint8_t *>(src), static_cast<const uint8_t *>(ref1), static_cast<const uint8_t *>(ref2), stride, width, height);
+    } else {
+        if (fb)
+            clenseProcessPlaneSimd<VecAvx2, uint16_t, true>(static_cast<uint16_t *>(dst), static_cast<uint16_t *>(mask), static_cast<const uint16_t *>(src), static_cast<const uint16_t *>(ref1), static_cast<const uint16_t *>(ref2), stride, width, height);
+        else
+            clenseProcessPlaneSimd<VecAvx2, uint16_t, false>(static_cast<uint16_t *>(dst), static_cast<uint16_t *>(mask), static_cast<const uint16_t *>(src), static_cast<const uint16_t *>(ref1), static_cast<const uint16_t *>(ref2), stride, width, height);
+    }
+}
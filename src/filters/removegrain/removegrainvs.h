@@ -0,0 +1,1579 @@
+/*****************************************************************************
+
+        AvsFilterRemoveGrain/Repair16
+        Author: Laurent de Soras, 2012
+        Modified for VapourSynth by Fredrik Mellbin 2013
+
+--- Legal stuff ---
+
+This program is free software. It comes without any warranty, to
+the extent permitted by applicable law. You can redistribute it
+and/or modify it under the terms of the Do What The Fuck You Want
+To Public License, Version 2, as published by Sam Hocevar. See
+http://sam.zoy.org/wtfpl/COPYING for more details.
+
+*Tab=3***********************************************************************/
+
+#ifndef REMOVEGRAINVS_H
+#define REMOVEGRAINVS_H
+
+#include "shared.h"
+
+// The operators and the plane processing are shared with the AVX2 version which is built
+// separately, the anonymous namespace keeps the differently compiled copies apart.
+namespace {
+
+#ifdef VS_TARGET_CPU_X86
+class ConvSigned
+{
+public:
+    template<class V>
+    static __forceinline typename V::R cv (typename V::R a, typename V::R m)
+    {
+        return (V::xor_si128 (a, m));
+    }
+};
+
+
+class ConvUnsigned
+{
+public:
+    template<class V>
+    static __forceinline typename V::R cv (typename V::R a, typename V::R m)
+    {
+        return (a);
+    }
+};
+
+#define AvsFilterRemoveGrain16_READ_PIX    \
+   typedef typename V::R R;                 \
+   const ptrdiff_t      om = stride_src - 1;     \
+   const ptrdiff_t      o0 = stride_src    ;     \
+   const ptrdiff_t      op = stride_src + 1;     \
+   R              a1, a2, a3, a4, c, a5, a6, a7, a8; \
+   a1 = ConvSign::template cv<V> (V::load (src_ptr - op), mask_sign); \
+   a2 = ConvSign::template cv<V> (V::load (src_ptr - o0), mask_sign); \
+   a3 = ConvSign::template cv<V> (V::load (src_ptr - om), mask_sign); \
+   a4 = ConvSign::template cv<V> (V::load (src_ptr - 1 ), mask_sign); \
+   c  = ConvSign::template cv<V> (V::load (src_ptr + 0 ), mask_sign); \
+   a5 = ConvSign::template cv<V> (V::load (src_ptr + 1 ), mask_sign); \
+   a6 = ConvSign::template cv<V> (V::load (src_ptr + om), mask_sign); \
+   a7 = ConvSign::template cv<V> (V::load (src_ptr + o0), mask_sign); \
+   a8 = ConvSign::template cv<V> (V::load (src_ptr + op), mask_sign);
+
+#define AvsFilterRemoveGrain16_SORT_AXIS_SSE2   \
+    const R  ma1 = V::max_epi16(a1, a8); \
+    const R  mi1 = V::min_epi16(a1, a8); \
+    const R  ma2 = V::max_epi16(a2, a7); \
+    const R  mi2 = V::min_epi16(a2, a7); \
+    const R  ma3 = V::max_epi16(a3, a6); \
+    const R  mi3 = V::min_epi16(a3, a6); \
+    const R  ma4 = V::max_epi16(a4, a5); \
+    const R  mi4 = V::min_epi16(a4, a5);
+
+#else
+
+class ConvSigned
+{
+};
+
+
+class ConvUnsigned
+{
+};
+#endif
+
+#define AvsFilterRemoveGrain16_SORT_AXIS_CPP \
+    const int      ma1 = std::max(a1, a8);   \
+    const int      mi1 = std::min(a1, a8);   \
+    const int      ma2 = std::max(a2, a7);   \
+    const int      mi2 = std::min(a2, a7);   \
+    const int      ma3 = std::max(a3, a6);   \
+    const int      mi3 = std::min(a3, a6);   \
+    const int      ma4 = std::max(a4, a5);   \
+    const int      mi4 = std::min(a4, a5);
+
+class OpRG01 : public LineProcAll {
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg (int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+        const int        mi = std::min (
+            std::min (std::min (a1, a2), std::min (a3, a4)),
+            std::min (std::min (a5, a6), std::min (a7, a8))
+        );
+        const int        ma = std::max (
+            std::max (std::max (a1, a2), std::max (a3, a4)),
+            std::max (std::max (a5, a6), std::max (a7, a8))
+        );
+
+        return (limit (c, mi, ma));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+        AvsFilterRemoveGrain16_READ_PIX
+
+        const R    mi = V::min_epi16 (
+            V::min_epi16 (V::min_epi16 (a1, a2), V::min_epi16 (a3, a4)),
+            V::min_epi16 (V::min_epi16 (a5, a6), V::min_epi16 (a7, a8))
+        );
+        const R    ma = V::max_epi16 (
+            V::max_epi16 (V::max_epi16 (a1, a2), V::max_epi16 (a3, a4)),
+            V::max_epi16 (V::max_epi16 (a5, a6), V::max_epi16 (a7, a8))
+        );
+
+        return (V::min_epi16 (V::max_epi16 (c, mi), ma));
+    }
+#endif
+};
+
+class OpRG02 : public LineProcAll {
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg (int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+        int                a [8] = { a1, a2, a3, a4, a5, a6, a7, a8 };
+
+        std::sort (&a [0], (&a [7]) + 1);
+
+        return (limit (c, a [2-1], a [7-1]));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+        AvsFilterRemoveGrain16_READ_PIX
+
+        sort_pair<V> (a1, a2);
+        sort_pair<V> (a3, a4);
+        sort_pair<V> (a5, a6);
+        sort_pair<V> (a7, a8);
+
+        sort_pair<V> (a1, a3);
+        sort_pair<V> (a2, a4);
+        sort_pair<V> (a5, a7);
+        sort_pair<V> (a6, a8);
+
+        sort_pair<V> (a2, a3);
+        sort_pair<V> (a6, a7);
+
+        a5 = V::max_epi16 (a1, a5);    // sort_pair<V> (a1, a5);
+        sort_pair<V> (a2, a6);
+        sort_pair<V> (a3, a7);
+        a4 = V::min_epi16 (a4, a8);    // sort_pair<V> (a4, a8);
+
+        a3 = V::min_epi16 (a3, a5);    // sort_pair<V> (a3, a5);
+        a6 = V::max_epi16 (a4, a6);    // sort_pair<V> (a4, a6);
+
+        a2 = V::min_epi16 (a2, a3);    // sort_pair<V> (a2, a3);
+        a7 = V::max_epi16 (a6, a7);    // sort_pair<V> (a6, a7);
+
+        return (V::min_epi16 (V::max_epi16 (c, a2), a7));
+    }
+#endif
+};
+
+class OpRG03 : public LineProcAll {
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg (int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+        int                a [8] = { a1, a2, a3, a4, a5, a6, a7, a8 };
+
+        std::sort (&a [0], (&a [7]) + 1);
+
+        return (limit (c, a [3-1], a [6-1]));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+        AvsFilterRemoveGrain16_READ_PIX
+
+        sort_pair<V> (a1, a2);
+        sort_pair<V> (a3, a4);
+        sort_pair<V> (a5, a6);
+        sort_pair<V> (a7, a8);
+
+        sort_pair<V> (a1, a3);
+        sort_pair<V> (a2, a4);
+        sort_pair<V> (a5, a7);
+        sort_pair<V> (a6, a8);
+
+        sort_pair<V> (a2, a3);
+        sort_pair<V> (a6, a7);
+
+        a5 = V::max_epi16 (a1, a5);    // sort_pair<V> (a1, a5);
+        sort_pair<V> (a2, a6);
+        sort_pair<V> (a3, a7);
+        a4 = V::min_epi16 (a4, a8);    // sort_pair<V> (a4, a8);
+
+        a3 = V::min_epi16 (a3, a5);    // sort_pair<V> (a3, a5);
+        a6 = V::max_epi16 (a4, a6);    // sort_pair<V> (a4, a6);
+
+        a3 = V::max_epi16 (a2, a3);    // sort_pair<V> (a2, a3);
+        a6 = V::min_epi16 (a6, a7);    // sort_pair<V> (a6, a7);
+
+        return (V::min_epi16 (V::max_epi16 (c, a3), a6));
+    }
+#endif
+};
+
+class OpRG04 : public LineProcAll {
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg (int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+        int                a [8] = { a1, a2, a3, a4, a5, a6, a7, a8 };
+
+        std::sort (&a [0], (&a [7]) + 1);
+
+        return (limit (c, a [4-1], a [5-1]));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+        // http://en.wikipedia.org/wiki/Batcher_odd%E2%80%93even_mergesort
+
+        AvsFilterRemoveGrain16_READ_PIX
+
+        sort_pair<V> (a1, a2);
+        sort_pair<V> (a3, a4);
+        sort_pair<V> (a5, a6);
+        sort_pair<V> (a7, a8);
+
+        sort_pair<V> (a1, a3);
+        sort_pair<V> (a2, a4);
+        sort_pair<V> (a5, a7);
+        sort_pair<V> (a6, a8);
+
+        sort_pair<V> (a2, a3);
+        sort_pair<V> (a6, a7);
+
+        a5 = V::max_epi16 (a1, a5);    // sort_pair<V> (a1, a5);
+        a6 = V::max_epi16 (a2, a6);    // sort_pair<V> (a2, a6);
+        a3 = V::min_epi16 (a3, a7);    // sort_pair<V> (a3, a7);
+        a4 = V::min_epi16 (a4, a8);    // sort_pair<V> (a4, a8);
+
+        a5 = V::max_epi16 (a3, a5);    // sort_pair<V> (a3, a5);
+        a4 = V::min_epi16 (a4, a6);    // sort_pair<V> (a4, a6);
+
+                                                // sort_pair<V> (a2, a3);
+        sort_pair<V> (a4, a5);
+                                                // sort_pair<V> (a6, a7);
+
+        return (V::min_epi16 (V::max_epi16 (c, a4), a5));
+    }
+#endif
+};
+
+class OpRG05 : public LineProcAll {
+public:
+    typedef ConvSigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const int      c1 = std::abs(c - limit(c, mi1, ma1));
+            const int      c2 = std::abs(c - limit(c, mi2, ma2));
+            const int      c3 = std::abs(c - limit(c, mi3, ma3));
+            const int      c4 = std::abs(c - limit(c, mi4, ma4));
+
+            const int      mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+            if (mindiff == c4) {
+                return (limit(c, mi4, ma4));
+            } else if (mindiff == c2) {
+                return (limit(c, mi2, ma2));
+            } else if (mindiff == c3) {
+                return (limit(c, mi3, ma3));
+            }
+
+            return (limit(c, mi1, ma1));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SSE2
+
+                const R  cli1 = limit_epi16<V>(c, mi1, ma1);
+            const R  cli2 = limit_epi16<V>(c, mi2, ma2);
+            const R  cli3 = limit_epi16<V>(c, mi3, ma3);
+            const R  cli4 = limit_epi16<V>(c, mi4, ma4);
+
+            const R  cli1u = V::xor_si128(cli1, mask_sign);
+            const R  cli2u = V::xor_si128(cli2, mask_sign);
+            const R  cli3u = V::xor_si128(cli3, mask_sign);
+            const R  cli4u = V::xor_si128(cli4, mask_sign);
+            const R  cu = V::xor_si128(c, mask_sign);
+
+            const R  c1u = abs_dif_epu16<V>(cu, cli1u);
+            const R  c2u = abs_dif_epu16<V>(cu, cli2u);
+            const R  c3u = abs_dif_epu16<V>(cu, cli3u);
+            const R  c4u = abs_dif_epu16<V>(cu, cli4u);
+
+            const R  c1 = V::xor_si128(c1u, mask_sign);
+            const R  c2 = V::xor_si128(c2u, mask_sign);
+            const R  c3 = V::xor_si128(c3u, mask_sign);
+            const R  c4 = V::xor_si128(c4u, mask_sign);
+
+            const R  mindiff = V::min_epi16(
+                V::min_epi16(c1, c2),
+                V::min_epi16(c3, c4)
+                );
+
+            R        res = cli1;
+            res = select_16_equ<V>(mindiff, c3, cli3, res);
+            res = select_16_equ<V>(mindiff, c2, cli2, res);
+            res = select_16_equ<V>(mindiff, c4, cli4, res);
+
+            return (res);
+
+        }
+#endif
+};
+
+
+class OpRG06 : public LineProcAll {
+public:
+    typedef ConvSigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const int      d1 = ma1 - mi1;
+            const int      d2 = ma2 - mi2;
+            const int      d3 = ma3 - mi3;
+            const int      d4 = ma4 - mi4;
+
+            const int      cli1 = limit(c, mi1, ma1);
+            const int      cli2 = limit(c, mi2, ma2);
+            const int      cli3 = limit(c, mi3, ma3);
+            const int      cli4 = limit(c, mi4, ma4);
+
+            const int      c1 = limit((std::abs(c - cli1) << 1) + d1, 0, 0xFFFF);
+            const int      c2 = limit((std::abs(c - cli2) << 1) + d2, 0, 0xFFFF);
+            const int      c3 = limit((std::abs(c - cli3) << 1) + d3, 0, 0xFFFF);
+            const int      c4 = limit((std::abs(c - cli4) << 1) + d4, 0, 0xFFFF);
+
+            const int      mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+            if (mindiff == c4) {
+                return (cli4);
+            } else if (mindiff == c2) {
+                return (cli2);
+            } else if (mindiff == c3) {
+                return (cli3);
+            }
+
+            return (cli1);
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SSE2
+
+                const R  d1u = V::sub_epi16(ma1, mi1);
+            const R  d2u = V::sub_epi16(ma2, mi2);
+            const R  d3u = V::sub_epi16(ma3, mi3);
+            const R  d4u = V::sub_epi16(ma4, mi4);
+
+            const R  cli1 = limit_epi16<V>(c, mi1, ma1);
+            const R  cli2 = limit_epi16<V>(c, mi2, ma2);
+            const R  cli3 = limit_epi16<V>(c, mi3, ma3);
+            const R  cli4 = limit_epi16<V>(c, mi4, ma4);
+
+            const R  cli1u = V::xor_si128(cli1, mask_sign);
+            const R  cli2u = V::xor_si128(cli2, mask_sign);
+            const R  cli3u = V::xor_si128(cli3, mask_sign);
+            const R  cli4u = V::xor_si128(cli4, mask_sign);
+            const R  cu = V::xor_si128(c, mask_sign);
+
+            const R  ad1u = abs_dif_epu16<V>(cu, cli1u);
+            const R  ad2u = abs_dif_epu16<V>(cu, cli2u);
+            const R  ad3u = abs_dif_epu16<V>(cu, cli3u);
+            const R  ad4u = abs_dif_epu16<V>(cu, cli4u);
+
+            const R  c1u = V::adds_epu16(V::adds_epu16(d1u, ad1u), ad1u);
+            const R  c2u = V::adds_epu16(V::adds_epu16(d2u, ad2u), ad2u);
+            const R  c3u = V::adds_epu16(V::adds_epu16(d3u, ad3u), ad3u);
+            const R  c4u = V::adds_epu16(V::adds_epu16(d4u, ad4u), ad4u);
+
+            const R  c1 = V::xor_si128(c1u, mask_sign);
+            const R  c2 = V::xor_si128(c2u, mask_sign);
+            const R  c3 = V::xor_si128(c3u, mask_sign);
+            const R  c4 = V::xor_si128(c4u, mask_sign);
+
+            const R  mindiff = V::min_epi16(
+                V::min_epi16(c1, c2),
+                V::min_epi16(c3, c4)
+                );
+
+            R        res = cli1;
+            res = select_16_equ<V>(mindiff, c3, cli3, res);
+            res = select_16_equ<V>(mindiff, c2, cli2, res);
+            res = select_16_equ<V>(mindiff, c4, cli4, res);
+
+            return (res);
+        }
+#endif
+};
+
+class OpRG07 : public LineProcAll {
+public:
+    typedef ConvSigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const int      d1 = ma1 - mi1;
+            const int      d2 = ma2 - mi2;
+            const int      d3 = ma3 - mi3;
+            const int      d4 = ma4 - mi4;
+
+            const int      cli1 = limit(c, mi1, ma1);
+            const int      cli2 = limit(c, mi2, ma2);
+            const int      cli3 = limit(c, mi3, ma3);
+            const int      cli4 = limit(c, mi4, ma4);
+
+            const int      c1 = std::abs(c - cli1) + d1;
+            const int      c2 = std::abs(c - cli2) + d2;
+            const int      c3 = std::abs(c - cli3) + d3;
+            const int      c4 = std::abs(c - cli4) + d4;
+
+            const int      mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+            if (mindiff == c4) {
+                return (cli4);
+            } else if (mindiff == c2) {
+                return (cli2);
+            } else if (mindiff == c3) {
+                return (cli3);
+            }
+
+            return (cli1);
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SSE2
+
+                const R  d1u = V::sub_epi16(ma1, mi1);
+            const R  d2u = V::sub_epi16(ma2, mi2);
+            const R  d3u = V::sub_epi16(ma3, mi3);
+            const R  d4u = V::sub_epi16(ma4, mi4);
+
+            const R  cli1 = limit_epi16<V>(c, mi1, ma1);
+            const R  cli2 = limit_epi16<V>(c, mi2, ma2);
+            const R  cli3 = limit_epi16<V>(c, mi3, ma3);
+            const R  cli4 = limit_epi16<V>(c, mi4, ma4);
+
+            const R  cli1u = V::xor_si128(cli1, mask_sign);
+            const R  cli2u = V::xor_si128(cli2, mask_sign);
+            const R  cli3u = V::xor_si128(cli3, mask_sign);
+            const R  cli4u = V::xor_si128(cli4, mask_sign);
+            const R  cu = V::xor_si128(c, mask_sign);
+
+            const R  ad1u = abs_dif_epu16<V>(cu, cli1u);
+            const R  ad2u = abs_dif_epu16<V>(cu, cli2u);
+            const R  ad3u = abs_dif_epu16<V>(cu, cli3u);
+            const R  ad4u = abs_dif_epu16<V>(cu, cli4u);
+
+            const R  c1u = V::adds_epu16(d1u, ad1u);
+            const R  c2u = V::adds_epu16(d2u, ad2u);
+            const R  c3u = V::adds_epu16(d3u, ad3u);
+            const R  c4u = V::adds_epu16(d4u, ad4u);
+
+            const R  c1 = V::xor_si128(c1u, mask_sign);
+            const R  c2 = V::xor_si128(c2u, mask_sign);
+            const R  c3 = V::xor_si128(c3u, mask_sign);
+            const R  c4 = V::xor_si128(c4u, mask_sign);
+
+            const R  mindiff = V::min_epi16(
+                V::min_epi16(c1, c2),
+                V::min_epi16(c3, c4)
+                );
+
+            R        res = cli1;
+            res = select_16_equ<V>(mindiff, c3, cli3, res);
+            res = select_16_equ<V>(mindiff, c2, cli2, res);
+            res = select_16_equ<V>(mindiff, c4, cli4, res);
+
+            return (res);
+        }
+#endif
+};
+
+class OpRG08 : public LineProcAll {
+public:
+    typedef ConvSigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const int      d1 = ma1 - mi1;
+            const int      d2 = ma2 - mi2;
+            const int      d3 = ma3 - mi3;
+            const int      d4 = ma4 - mi4;
+
+            const int      cli1 = limit(c, mi1, ma1);
+            const int      cli2 = limit(c, mi2, ma2);
+            const int      cli3 = limit(c, mi3, ma3);
+            const int      cli4 = limit(c, mi4, ma4);
+
+            const int      c1 = limit(std::abs(c - cli1) + (d1 << 1), 0, 0xFFFF);
+            const int      c2 = limit(std::abs(c - cli2) + (d2 << 1), 0, 0xFFFF);
+            const int      c3 = limit(std::abs(c - cli3) + (d3 << 1), 0, 0xFFFF);
+            const int      c4 = limit(std::abs(c - cli4) + (d4 << 1), 0, 0xFFFF);
+
+            const int      mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+            if (mindiff == c4) {
+                return (cli4);
+            } else if (mindiff == c2) {
+                return (cli2);
+            } else if (mindiff == c3) {
+                return (cli3);
+            }
+
+            return (cli1);
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SSE2
+
+                const R  d1u = V::sub_epi16(ma1, mi1);
+            const R  d2u = V::sub_epi16(ma2, mi2);
+            const R  d3u = V::sub_epi16(ma3, mi3);
+            const R  d4u = V::sub_epi16(ma4, mi4);
+
+            const R  cli1 = limit_epi16<V>(c, mi1, ma1);
+            const R  cli2 = limit_epi16<V>(c, mi2, ma2);
+            const R  cli3 = limit_epi16<V>(c, mi3, ma3);
+            const R  cli4 = limit_epi16<V>(c, mi4, ma4);
+
+            const R  cli1u = V::xor_si128(cli1, mask_sign);
+            const R  cli2u = V::xor_si128(cli2, mask_sign);
+            const R  cli3u = V::xor_si128(cli3, mask_sign);
+            const R  cli4u = V::xor_si128(cli4, mask_sign);
+            const R  cu = V::xor_si128(c, mask_sign);
+
+            const R  ad1u = abs_dif_epu16<V>(cu, cli1u);
+            const R  ad2u = abs_dif_epu16<V>(cu, cli2u);
+            const R  ad3u = abs_dif_epu16<V>(cu, cli3u);
+            const R  ad4u = abs_dif_epu16<V>(cu, cli4u);
+
+            const R  c1u = V::adds_epu16(V::adds_epu16(d1u, d1u), ad1u);
+            const R  c2u = V::adds_epu16(V::adds_epu16(d2u, d2u), ad2u);
+            const R  c3u = V::adds_epu16(V::adds_epu16(d3u, d3u), ad3u);
+            const R  c4u = V::adds_epu16(V::adds_epu16(d4u, d4u), ad4u);
+
+            const R  c1 = V::xor_si128(c1u, mask_sign);
+            const R  c2 = V::xor_si128(c2u, mask_sign);
+            const R  c3 = V::xor_si128(c3u, mask_sign);
+            const R  c4 = V::xor_si128(c4u, mask_sign);
+
+            const R  mindiff = V::min_epi16(
+                V::min_epi16(c1, c2),
+                V::min_epi16(c3, c4)
+                );
+
+            R        res = cli1;
+            res = select_16_equ<V>(mindiff, c3, cli3, res);
+            res = select_16_equ<V>(mindiff, c2, cli2, res);
+            res = select_16_equ<V>(mindiff, c4, cli4, res);
+
+            return (res);
+        }
+#endif
+};
+class OpRG09 : public LineProcAll {
+public:
+    typedef ConvSigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const int      d1 = ma1 - mi1;
+            const int      d2 = ma2 - mi2;
+            const int      d3 = ma3 - mi3;
+            const int      d4 = ma4 - mi4;
+
+            const int      mindiff = std::min(std::min(d1, d2), std::min(d3, d4));
+
+            if (mindiff == d4) {
+                return (limit(c, mi4, ma4));
+            } else if (mindiff == d2) {
+                return (limit(c, mi2, ma2));
+            } else if (mindiff == d3) {
+                return (limit(c, mi3, ma3));
+            }
+
+            return (limit(c, mi1, ma1));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SSE2
+
+                const R  cli1 = limit_epi16<V>(c, mi1, ma1);
+            const R  cli2 = limit_epi16<V>(c, mi2, ma2);
+            const R  cli3 = limit_epi16<V>(c, mi3, ma3);
+            const R  cli4 = limit_epi16<V>(c, mi4, ma4);
+
+            const R  d1u = V::sub_epi16(ma1, mi1);
+            const R  d2u = V::sub_epi16(ma2, mi2);
+            const R  d3u = V::sub_epi16(ma3, mi3);
+            const R  d4u = V::sub_epi16(ma4, mi4);
+
+            const R  d1 = V::xor_si128(d1u, mask_sign);
+            const R  d2 = V::xor_si128(d2u, mask_sign);
+            const R  d3 = V::xor_si128(d3u, mask_sign);
+            const R  d4 = V::xor_si128(d4u, mask_sign);
+
+            const R  mindiff = V::min_epi16(
+                V::min_epi16(d1, d2),
+                V::min_epi16(d3, d4)
+                );
+
+            R        res = cli1;
+            res = select_16_equ<V>(mindiff, d3, cli3, res);
+            res = select_16_equ<V>(mindiff, d2, cli2, res);
+            res = select_16_equ<V>(mindiff, d4, cli4, res);
+
+            return (res);
+        }
+#endif
+};
+class OpRG10 : public LineProcAll {
+public:
+    typedef ConvUnsigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            const int      d1 = std::abs(c - a1);
+            const int      d2 = std::abs(c - a2);
+            const int      d3 = std::abs(c - a3);
+            const int      d4 = std::abs(c - a4);
+            const int      d5 = std::abs(c - a5);
+            const int      d6 = std::abs(c - a6);
+            const int      d7 = std::abs(c - a7);
+            const int      d8 = std::abs(c - a8);
+
+            const int      mindiff = std::min(
+                std::min(std::min(d1, d2), std::min(d3, d4)),
+                std::min(std::min(d5, d6), std::min(d7, d8))
+                );
+
+            if (mindiff == d7) { return (a7); }
+            if (mindiff == d8) { return (a8); }
+            if (mindiff == d6) { return (a6); }
+            if (mindiff == d2) { return (a2); }
+            if (mindiff == d3) { return (a3); }
+            if (mindiff == d1) { return (a1); }
+            if (mindiff == d5) { return (a5); }
+
+            return (a4);
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+                const R  d1u = abs_dif_epu16<V>(c, a1);
+            const R  d2u = abs_dif_epu16<V>(c, a2);
+            const R  d3u = abs_dif_epu16<V>(c, a3);
+            const R  d4u = abs_dif_epu16<V>(c, a4);
+            const R  d5u = abs_dif_epu16<V>(c, a5);
+            const R  d6u = abs_dif_epu16<V>(c, a6);
+            const R  d7u = abs_dif_epu16<V>(c, a7);
+            const R  d8u = abs_dif_epu16<V>(c, a8);
+
+            const R  d1 = V::xor_si128(d1u, mask_sign);
+            const R  d2 = V::xor_si128(d2u, mask_sign);
+            const R  d3 = V::xor_si128(d3u, mask_sign);
+            const R  d4 = V::xor_si128(d4u, mask_sign);
+            const R  d5 = V::xor_si128(d5u, mask_sign);
+            const R  d6 = V::xor_si128(d6u, mask_sign);
+            const R  d7 = V::xor_si128(d7u, mask_sign);
+            const R  d8 = V::xor_si128(d8u, mask_sign);
+
+            const R  mindiff = V::min_epi16(
+                V::min_epi16(V::min_epi16(d1, d2), V::min_epi16(d3, d4)),
+                V::min_epi16(V::min_epi16(d5, d6), V::min_epi16(d7, d8))
+                );
+
+            R        res = a4;
+            res = select_16_equ<V>(mindiff, d5, a5, res);
+            res = select_16_equ<V>(mindiff, d1, a1, res);
+            res = select_16_equ<V>(mindiff, d3, a3, res);
+            res = select_16_equ<V>(mindiff, d2, a2, res);
+            res = select_16_equ<V>(mindiff, d6, a6, res);
+            res = select_16_equ<V>(mindiff, d8, a8, res);
+            res = select_16_equ<V>(mindiff, d7, a7, res);
+
+            return (res);
+        }
+#endif
+};
+
+
+#ifdef VS_TARGET_CPU_X86
+class OpRG12sse2
+{
+public:
+    typedef    ConvUnsigned    ConvSign;
+
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+        AvsFilterRemoveGrain16_READ_PIX
+
+        const R    bias = V::set1_epi16 (1);
+
+        const R    a13  = V::avg_epu16 (a1, a3);
+        const R    a123 = V::avg_epu16 (a2, a13);
+
+        const R    a68  = V::avg_epu16 (a6, a8);
+        const R    a678 = V::avg_epu16 (a7, a68);
+
+        const R    a45  = V::avg_epu16 (a4, a5);
+        const R    a4c5 = V::avg_epu16 (c, a45);
+
+        const R    a123678  = V::avg_epu16 (a123, a678);
+        const R    a123678b = V::subs_epu16 (a123678, bias);
+        const R    val      = V::avg_epu16 (a4c5, a123678b);
+
+        return (val);
+    }
+};
+#endif
+
+class OpRG11 : public LineProcAll {
+public:
+    typedef    ConvUnsigned    ConvSign;
+    static __forceinline int rg (int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+        const int        sum = 4 * c + 2 * (a2 + a4 + a5 + a7) + a1 + a3 + a6 + a8;
+        const int        val = (sum + 8) >> 4;
+
+        return (val);
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+        return (OpRG12sse2::rg<V> (src_ptr, stride_src, mask_sign));
+    }
+#endif
+};
+
+class OpRG12 : public LineProcAll {
+public:
+    typedef    ConvUnsigned    ConvSign;
+    static __forceinline int rg (int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+        return (OpRG11::rg (c, a1, a2, a3, a4, a5, a6, a7, a8));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+        return (OpRG12sse2::rg<V> (src_ptr, stride_src, mask_sign));
+    }
+#endif
+};
+
+class OpRG1314 {
+public:
+    typedef ConvUnsigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            const int      d1 = std::abs(a1 - a8);
+            const int      d2 = std::abs(a2 - a7);
+            const int      d3 = std::abs(a3 - a6);
+
+            const int      mindiff = std::min(std::min(d1, d2), d3);
+
+            if (mindiff == d2) {
+                return ((a2 + a7 + 1) >> 1);
+            }
+            if (mindiff == d3) {
+                return ((a3 + a6 + 1) >> 1);
+            }
+
+            return ((a1 + a8 + 1) >> 1);
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+            (void)c;
+            (void)a4;
+            (void)a5;
+
+            const R  d1 = V::xor_si128(abs_dif_epu16<V>(a1, a8), mask_sign);
+            const R  d2 = V::xor_si128(abs_dif_epu16<V>(a2, a7), mask_sign);
+            const R  d3 = V::xor_si128(abs_dif_epu16<V>(a3, a6), mask_sign);
+
+            const R  mindiff = V::min_epi16(V::min_epi16(d1, d2), d3);
+
+            R        res = V::avg_epu16(a1, a8);
+            res = select_16_equ<V>(mindiff, d3, V::avg_epu16(a3, a6), res);
+            res = select_16_equ<V>(mindiff, d2, V::avg_epu16(a2, a7), res);
+
+            return (res);
+        }
+#endif
+};
+class OpRG13 : public OpRG1314, public LineProcEven {};
+class OpRG14 : public OpRG1314, public LineProcOdd {};
+class OpRG1516 {
+public:
+    typedef ConvSigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            const int      d1 = std::abs(a1 - a8);
+            const int      d2 = std::abs(a2 - a7);
+            const int      d3 = std::abs(a3 - a6);
+
+            const int      mindiff = std::min(std::min(d1, d2), d3);
+            const int      average = (2 * (a2 + a7) + a1 + a3 + a6 + a8 + 4) >> 3;
+
+            if (mindiff == d2) {
+                return (limit(average, std::min(a2, a7), std::max(a2, a7)));
+            }
+            if (mindiff == d3) {
+                return (limit(average, std::min(a3, a6), std::max(a3, a6)));
+            }
+
+            return (limit(average, std::min(a1, a8), std::max(a1, a8)));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SSE2
+
+            (void)c;
+            (void)ma4;
+            (void)mi4;
+
+            const R  d1 = V::xor_si128(V::sub_epi16(ma1, mi1), mask_sign);
+            const R  d2 = V::xor_si128(V::sub_epi16(ma2, mi2), mask_sign);
+            const R  d3 = V::xor_si128(V::sub_epi16(ma3, mi3), mask_sign);
+
+            const R  mindiff = V::min_epi16(V::min_epi16(d1, d2), d3);
+
+            // the sum doesn't fit in 16 bits, the offset of the signed values cancels out in the shift
+            R        sum_0 = V::set1_epi32(4);
+            R        sum_1 = sum_0;
+
+            add_s16_s32<V>(sum_0, sum_1, a2);
+            add_s16_s32<V>(sum_0, sum_1, a2);
+            add_s16_s32<V>(sum_0, sum_1, a7);
+            add_s16_s32<V>(sum_0, sum_1, a7);
+            add_s16_s32<V>(sum_0, sum_1, a1);
+            add_s16_s32<V>(sum_0, sum_1, a3);
+            add_s16_s32<V>(sum_0, sum_1, a6);
+            add_s16_s32<V>(sum_0, sum_1, a8);
+
+            const R  average = V::packs_epi32(V::srai_epi32(sum_0, 3), V::srai_epi32(sum_1, 3));
+
+            R        res = limit_epi16<V>(average, mi1, ma1);
+            res = select_16_equ<V>(mindiff, d3, limit_epi16<V>(average, mi3, ma3), res);
+            res = select_16_equ<V>(mindiff, d2, limit_epi16<V>(average, mi2, ma2), res);
+
+            return (res);
+        }
+#endif
+};
+class OpRG15 : public OpRG1516, public LineProcEven {};
+class OpRG16 : public OpRG1516, public LineProcOdd {};
+class OpRG17 : public LineProcAll {
+public:
+    typedef ConvSigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const int      l = std::max(std::max(mi1, mi2), std::max(mi3, mi4));
+            const int      u = std::min(std::min(ma1, ma2), std::min(ma3, ma4));
+
+            return (limit(c, std::min(l, u), std::max(l, u)));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SSE2
+
+                const R  l = V::max_epi16(
+                V::max_epi16(mi1, mi2),
+                V::max_epi16(mi3, mi4)
+                );
+            const R  u = V::min_epi16(
+                V::min_epi16(ma1, ma2),
+                V::min_epi16(ma3, ma4)
+                );
+            const R  mi = V::min_epi16(l, u);
+            const R  ma = V::max_epi16(l, u);
+
+            return (limit_epi16<V>(c, mi, ma));
+        }
+#endif
+};
+
+class OpRG18 : public LineProcAll {
+public:
+    typedef ConvUnsigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            const int      d1 = std::max(std::abs(c - a1), std::abs(c - a8));
+            const int      d2 = std::max(std::abs(c - a2), std::abs(c - a7));
+            const int      d3 = std::max(std::abs(c - a3), std::abs(c - a6));
+            const int      d4 = std::max(std::abs(c - a4), std::abs(c - a5));
+
+            const int      mindiff = std::min(std::min(d1, d2), std::min(d3, d4));
+
+            if (mindiff == d4) {
+                return (limit(c, std::min(a4, a5), std::max(a4, a5)));
+            }
+            if (mindiff == d2) {
+                return (limit(c, std::min(a2, a7), std::max(a2, a7)));
+            }
+            if (mindiff == d3) {
+                return (limit(c, std::min(a3, a6), std::max(a3, a6)));
+            }
+
+            return (limit(c, std::min(a1, a8), std::max(a1, a8)));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+                const R  absdiff1u = abs_dif_epu16<V>(c, a1);
+            const R  absdiff2u = abs_dif_epu16<V>(c, a2);
+            const R  absdiff3u = abs_dif_epu16<V>(c, a3);
+            const R  absdiff4u = abs_dif_epu16<V>(c, a4);
+            const R  absdiff5u = abs_dif_epu16<V>(c, a5);
+            const R  absdiff6u = abs_dif_epu16<V>(c, a6);
+            const R  absdiff7u = abs_dif_epu16<V>(c, a7);
+            const R  absdiff8u = abs_dif_epu16<V>(c, a8);
+
+            const R  absdiff1 = V::xor_si128(absdiff1u, mask_sign);
+            const R  absdiff2 = V::xor_si128(absdiff2u, mask_sign);
+            const R  absdiff3 = V::xor_si128(absdiff3u, mask_sign);
+            const R  absdiff4 = V::xor_si128(absdiff4u, mask_sign);
+            const R  absdiff5 = V::xor_si128(absdiff5u, mask_sign);
+            const R  absdiff6 = V::xor_si128(absdiff6u, mask_sign);
+            const R  absdiff7 = V::xor_si128(absdiff7u, mask_sign);
+            const R  absdiff8 = V::xor_si128(absdiff8u, mask_sign);
+
+            const R  d1 = V::max_epi16(absdiff1, absdiff8);
+            const R  d2 = V::max_epi16(absdiff2, absdiff7);
+            const R  d3 = V::max_epi16(absdiff3, absdiff6);
+            const R  d4 = V::max_epi16(absdiff4, absdiff5);
+
+            const R  mindiff = V::min_epi16(
+                V::min_epi16(d1, d2),
+                V::min_epi16(d3, d4)
+                );
+
+            const R  a1s = V::xor_si128(a1, mask_sign);
+            const R  a2s = V::xor_si128(a2, mask_sign);
+            const R  a3s = V::xor_si128(a3, mask_sign);
+            const R  a4s = V::xor_si128(a4, mask_sign);
+            const R  a5s = V::xor_si128(a5, mask_sign);
+            const R  a6s = V::xor_si128(a6, mask_sign);
+            const R  a7s = V::xor_si128(a7, mask_sign);
+            const R  a8s = V::xor_si128(a8, mask_sign);
+            const R  cs = V::xor_si128(c, mask_sign);
+
+            const R  ma1 = V::max_epi16(a1s, a8s);
+            const R  mi1 = V::min_epi16(a1s, a8s);
+            const R  ma2 = V::max_epi16(a2s, a7s);
+            const R  mi2 = V::min_epi16(a2s, a7s);
+            const R  ma3 = V::max_epi16(a3s, a6s);
+            const R  mi3 = V::min_epi16(a3s, a6s);
+            const R  ma4 = V::max_epi16(a4s, a5s);
+            const R  mi4 = V::min_epi16(a4s, a5s);
+
+            const R  cli1 = limit_epi16<V>(cs, mi1, ma1);
+            const R  cli2 = limit_epi16<V>(cs, mi2, ma2);
+            const R  cli3 = limit_epi16<V>(cs, mi3, ma3);
+            const R  cli4 = limit_epi16<V>(cs, mi4, ma4);
+
+            R        res = cli1;
+            res = select_16_equ<V>(mindiff, d3, cli3, res);
+            res = select_16_equ<V>(mindiff, d2, cli2, res);
+            res = select_16_equ<V>(mindiff, d4, cli4, res);
+
+            return (V::xor_si128(res, mask_sign));
+        }
+#endif
+};
+
+class OpRG19 : public LineProcAll {
+public:
+    typedef    ConvUnsigned    ConvSign;
+    static __forceinline int rg (int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+        const int        sum = a1 + a2 + a3 + a4 + a5 + a6 + a7 + a8;
+        const int        val = (sum + 4) >> 3;
+
+        return (val);
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+        AvsFilterRemoveGrain16_READ_PIX
+
+        (void)c;
+
+        const R    bias = V::set1_epi16 (1);
+
+        const R    a13    = V::avg_epu16 (a1, a3);
+        const R    a68    = V::avg_epu16 (a6, a8);
+        const R    a1368  = V::avg_epu16 (a13, a68);
+        const R    a1368b = V::subs_epu16 (a1368, bias);
+        const R    a25    = V::avg_epu16 (a2, a5);
+        const R    a47    = V::avg_epu16 (a4, a7);
+        const R    a2457  = V::avg_epu16 (a25, a47);
+        const R    val    = V::avg_epu16 (a1368b, a2457);
+
+        return (val);
+    }
+#endif
+};
+
+class OpRG20 : public LineProcAll {
+public:
+    typedef    ConvUnsigned    ConvSign;
+    static __forceinline int rg (int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+        const int        sum = a1 + a2 + a3 + a4 + c + a5 + a6 + a7 + a8;
+        const int        val = (sum + 4) / 9;
+
+        return (val);
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+        AvsFilterRemoveGrain16_READ_PIX
+
+            const R  zero = V::setzero_si128();
+
+        R        sum_0 = V::set1_epi32 (-0x8000 * 9 + 4);
+        R        sum_1 = sum_0;
+
+        add_x16_s32<V>(sum_0, sum_1, c, zero);
+        add_x16_s32<V>(sum_0, sum_1, a1, zero);
+        add_x16_s32<V>(sum_0, sum_1, a2, zero);
+        add_x16_s32<V>(sum_0, sum_1, a3, zero);
+        add_x16_s32<V>(sum_0, sum_1, a4, zero);
+        add_x16_s32<V>(sum_0, sum_1, a5, zero);
+        add_x16_s32<V>(sum_0, sum_1, a6, zero);
+        add_x16_s32<V>(sum_0, sum_1, a7, zero);
+        add_x16_s32<V>(sum_0, sum_1, a8, zero);
+
+        const R  fix_0 = V::srai_epi32(sum_0, 15);
+        const R  fix_1 = V::srai_epi32(sum_1, 15);
+        sum_0 = V::sub_epi32(sum_0, fix_0);
+        sum_1 = V::sub_epi32(sum_1, fix_1);
+
+        const R  mult = V::set1_epi16 (7282);
+        const R  val = mul_s32_s15_s16<V>(sum_0, sum_1, mult);
+
+        return (V::xor_si128(val, mask_sign));
+    }
+#endif
+};
+
+class OpRG21 : public LineProcAll {
+public:
+    typedef ConvUnsigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            const int      l1l = (a1 + a8) >> 1;
+            const int      l2l = (a2 + a7) >> 1;
+            const int      l3l = (a3 + a6) >> 1;
+            const int      l4l = (a4 + a5) >> 1;
+
+            const int      l1h = (a1 + a8 + 1) >> 1;
+            const int      l2h = (a2 + a7 + 1) >> 1;
+            const int      l3h = (a3 + a6 + 1) >> 1;
+            const int      l4h = (a4 + a5 + 1) >> 1;
+
+            const int      mi = std::min(std::min(l1l, l2l), std::min(l3l, l4l));
+            const int      ma = std::max(std::max(l1h, l2h), std::max(l3h, l4h));
+
+            return (limit(c, mi, ma));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+                const R  bit0 = V::set1_epi16 (1);
+
+            const R  odd1 = V::and_si128(V::xor_si128(a1, a8), bit0);
+            const R  odd2 = V::and_si128(V::xor_si128(a2, a7), bit0);
+            const R  odd3 = V::and_si128(V::xor_si128(a3, a6), bit0);
+            const R  odd4 = V::and_si128(V::xor_si128(a4, a5), bit0);
+
+            const R  l1hu = V::avg_epu16(a1, a8);
+            const R  l2hu = V::avg_epu16(a2, a7);
+            const R  l3hu = V::avg_epu16(a3, a6);
+            const R  l4hu = V::avg_epu16(a4, a5);
+
+            const R  l1h = V::xor_si128(l1hu, mask_sign);
+            const R  l2h = V::xor_si128(l2hu, mask_sign);
+            const R  l3h = V::xor_si128(l3hu, mask_sign);
+            const R  l4h = V::xor_si128(l4hu, mask_sign);
+
+            const R  l1l = V::subs_epi16(l1h, odd1);
+            const R  l2l = V::subs_epi16(l2h, odd2);
+            const R  l3l = V::subs_epi16(l3h, odd3);
+            const R  l4l = V::subs_epi16(l4h, odd4);
+
+            const R  mi = V::min_epi16(
+                V::min_epi16(l1l, l2l),
+                V::min_epi16(l3l, l4l)
+                );
+            const R  ma = V::max_epi16(
+                V::max_epi16(l1h, l2h),
+                V::max_epi16(l3h, l4h)
+                );
+
+            const R  cs = V::xor_si128(c, mask_sign);
+            const R  res = limit_epi16<V>(cs, mi, ma);
+
+            return (V::xor_si128(res, mask_sign));
+        }
+#endif
+};
+
+
+class OpRG22 : public LineProcAll {
+public:
+    typedef ConvUnsigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            const int      l1 = (a1 + a8 + 1) >> 1;
+            const int      l2 = (a2 + a7 + 1) >> 1;
+            const int      l3 = (a3 + a6 + 1) >> 1;
+            const int      l4 = (a4 + a5 + 1) >> 1;
+
+            const int      mi = std::min(std::min(l1, l2), std::min(l3, l4));
+            const int      ma = std::max(std::max(l1, l2), std::max(l3, l4));
+
+            return (limit(c, mi, ma));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+                const R  l1u = V::avg_epu16(a1, a8);
+            const R  l2u = V::avg_epu16(a2, a7);
+            const R  l3u = V::avg_epu16(a3, a6);
+            const R  l4u = V::avg_epu16(a4, a5);
+
+            const R  l1 = V::xor_si128(l1u, mask_sign);
+            const R  l2 = V::xor_si128(l2u, mask_sign);
+            const R  l3 = V::xor_si128(l3u, mask_sign);
+            const R  l4 = V::xor_si128(l4u, mask_sign);
+
+            const R  mi = V::min_epi16(
+                V::min_epi16(l1, l2),
+                V::min_epi16(l3, l4)
+                );
+            const R  ma = V::max_epi16(
+                V::max_epi16(l1, l2),
+                V::max_epi16(l3, l4)
+                );
+
+            const R  cs = V::xor_si128(c, mask_sign);
+            const R  res = limit_epi16<V>(cs, mi, ma);
+
+            return (V::xor_si128(res, mask_sign));
+        }
+#endif
+};
+
+class OpRG23 : public LineProcAll {
+public:
+    typedef ConvUnsigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const int      linediff1 = ma1 - mi1;
+            const int      linediff2 = ma2 - mi2;
+            const int      linediff3 = ma3 - mi3;
+            const int      linediff4 = ma4 - mi4;
+
+            const int      u1 = std::min(c - ma1, linediff1);
+            const int      u2 = std::min(c - ma2, linediff2);
+            const int      u3 = std::min(c - ma3, linediff3);
+            const int      u4 = std::min(c - ma4, linediff4);
+            const int      u = std::max(
+                std::max(std::max(u1, u2), std::max(u3, u4)),
+                0
+                );
+
+            const int      d1 = std::min(mi1 - c, linediff1);
+            const int      d2 = std::min(mi2 - c, linediff2);
+            const int      d3 = std::min(mi3 - c, linediff3);
+            const int      d4 = std::min(mi4 - c, linediff4);
+            const int      d = std::max(
+                std::max(std::max(d1, d2), std::max(d3, d4)),
+                0
+                );
+
+            return (c - u + d);  // This probably will never overflow.
+        }
+#ifdef VS_TARGET_CPU_X86
+    // The pixels are unsigned here, saturation does the clamping of u and d to 0. The result
+    // is never out of range because c - u can't be below 0 and d can't exceed mi - c.
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+            (void)mask_sign;
+
+            const R  ma1 = V::max_epu16(a1, a8);
+            const R  mi1 = V::min_epu16(a1, a8);
+            const R  ma2 = V::max_epu16(a2, a7);
+            const R  mi2 = V::min_epu16(a2, a7);
+            const R  ma3 = V::max_epu16(a3, a6);
+            const R  mi3 = V::min_epu16(a3, a6);
+            const R  ma4 = V::max_epu16(a4, a5);
+            const R  mi4 = V::min_epu16(a4, a5);
+
+            const R  linediff1 = V::sub_epi16(ma1, mi1);
+            const R  linediff2 = V::sub_epi16(ma2, mi2);
+            const R  linediff3 = V::sub_epi16(ma3, mi3);
+            const R  linediff4 = V::sub_epi16(ma4, mi4);
+
+            const R  u1 = V::min_epu16(V::subs_epu16(c, ma1), linediff1);
+            const R  u2 = V::min_epu16(V::subs_epu16(c, ma2), linediff2);
+            const R  u3 = V::min_epu16(V::subs_epu16(c, ma3), linediff3);
+            const R  u4 = V::min_epu16(V::subs_epu16(c, ma4), linediff4);
+            const R  u = V::max_epu16(V::max_epu16(u1, u2), V::max_epu16(u3, u4));
+
+            const R  d1 = V::min_epu16(V::subs_epu16(mi1, c), linediff1);
+            const R  d2 = V::min_epu16(V::subs_epu16(mi2, c), linediff2);
+            const R  d3 = V::min_epu16(V::subs_epu16(mi3, c), linediff3);
+            const R  d4 = V::min_epu16(V::subs_epu16(mi4, c), linediff4);
+            const R  d = V::max_epu16(V::max_epu16(d1, d2), V::max_epu16(d3, d4));
+
+            return (V::add_epi16(V::sub_epi16(c, u), d));
+        }
+#endif
+};
+class OpRG24 : public LineProcAll {
+public:
+    typedef ConvUnsigned ConvSign;
+    static __forceinline int
+        rg(int c, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const int      linediff1 = ma1 - mi1;
+            const int      linediff2 = ma2 - mi2;
+            const int      linediff3 = ma3 - mi3;
+            const int      linediff4 = ma4 - mi4;
+
+            const int      tu1 = c - ma1;
+            const int      tu2 = c - ma2;
+            const int      tu3 = c - ma3;
+            const int      tu4 = c - ma4;
+
+            const int      u1 = std::min(tu1, linediff1 - tu1);
+            const int      u2 = std::min(tu2, linediff2 - tu2);
+            const int      u3 = std::min(tu3, linediff3 - tu3);
+            const int      u4 = std::min(tu4, linediff4 - tu4);
+            const int      u = std::max(
+                std::max(std::max(u1, u2), std::max(u3, u4)),
+                0
+                );
+
+            const int      td1 = mi1 - c;
+            const int      td2 = mi2 - c;
+            const int      td3 = mi3 - c;
+            const int      td4 = mi4 - c;
+
+            const int      d1 = std::min(td1, linediff1 - td1);
+            const int      d2 = std::min(td2, linediff2 - td2);
+            const int      d3 = std::min(td3, linediff3 - td3);
+            const int      d4 = std::min(td4, linediff4 - td4);
+            const int      d = std::max(
+                std::max(std::max(d1, d2), std::max(d3, d4)),
+                0
+                );
+
+            return (c - u + d);  // This probably will never overflow.
+        }
+#ifdef VS_TARGET_CPU_X86
+    // Same as OpRG23 apart from how u and d are limited
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src_ptr, ptrdiff_t stride_src, typename V::R mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+            (void)mask_sign;
+
+            const R  ma1 = V::max_epu16(a1, a8);
+            const R  mi1 = V::min_epu16(a1, a8);
+            const R  ma2 = V::max_epu16(a2, a7);
+            const R  mi2 = V::min_epu16(a2, a7);
+            const R  ma3 = V::max_epu16(a3, a6);
+            const R  mi3 = V::min_epu16(a3, a6);
+            const R  ma4 = V::max_epu16(a4, a5);
+            const R  mi4 = V::min_epu16(a4, a5);
+
+            const R  linediff1 = V::sub_epi16(ma1, mi1);
+            const R  linediff2 = V::sub_epi16(ma2, mi2);
+            const R  linediff3 = V::sub_epi16(ma3, mi3);
+            const R  linediff4 = V::sub_epi16(ma4, mi4);
+
+            const R  tu1 = V::subs_epu16(c, ma1);
+            const R  tu2 = V::subs_epu16(c, ma2);
+            const R  tu3 = V::subs_epu16(c, ma3);
+            const R  tu4 = V::subs_epu16(c, ma4);
+
+            const R  u1 = V::min_epu16(tu1, V::subs_epu16(linediff1, tu1));
+            const R  u2 = V::min_epu16(tu2, V::subs_epu16(linediff2, tu2));
+            const R  u3 = V::min_epu16(tu3, V::subs_epu16(linediff3, tu3));
+            const R  u4 = V::min_epu16(tu4, V::subs_epu16(linediff4, tu4));
+            const R  u = V::max_epu16(V::max_epu16(u1, u2), V::max_epu16(u3, u4));
+
+            const R  td1 = V::subs_epu16(mi1, c);
+            const R  td2 = V::subs_epu16(mi2, c);
+            const R  td3 = V::subs_epu16(mi3, c);
+            const R  td4 = V::subs_epu16(mi4, c);
+
+            const R  d1 = V::min_epu16(td1, V::subs_epu16(linediff1, td1));
+            const R  d2 = V::min_epu16(td2, V::subs_epu16(linediff2, td2));
+            const R  d3 = V::min_epu16(td3, V::subs_epu16(linediff3, td3));
+            const R  d4 = V::min_epu16(td4, V::subs_epu16(linediff4, td4));
+            const R  d = V::max_epu16(V::max_epu16(d1, d2), V::max_epu16(d3, d4));
+
+            return (V::add_epi16(V::sub_epi16(c, u), d));
+        }
+#endif
+};
+
+template <class OP, class T>
+class PlaneProc {
+public:
+
+static void process_subplane_cpp (const T *src_ptr, ptrdiff_t stride_src, T *dst_ptr, ptrdiff_t stride_dst, int width, int height)
+{
+    const int        y_b = 1;
+    const int        y_e = height - 1;
+
+    dst_ptr += y_b * stride_dst;
+    src_ptr += y_b * stride_src;
+
+    const int        x_e = width - 1;
+
+    for (int y = y_b; y < y_e; ++y)
+    {
+        if (OP::skip_line(y)) {
+            memcpy(dst_ptr, src_ptr, width * sizeof(T));
+        } else {
+
+            dst_ptr[0] = src_ptr[0];
+
+            process_row_cpp(
+                dst_ptr,
+                src_ptr,
+                stride_src,
+                1,
+                x_e
+                );
+
+            dst_ptr[x_e] = src_ptr[x_e];
+        }
+
+        dst_ptr += stride_dst;
+        src_ptr += stride_src;
+    }
+}
+
+static void process_row_cpp (T *dst_ptr, const T *src_ptr, ptrdiff_t stride_src, int x_beg, int x_end)
+{
+    const ptrdiff_t      om = stride_src - 1;
+    const ptrdiff_t      o0 = stride_src    ;
+    const ptrdiff_t      op = stride_src + 1;
+
+    src_ptr += x_beg;
+
+    for (int x = x_beg; x < x_end; ++x)
+    {
+        const int        a1 = src_ptr [-op];
+        const int        a2 = src_ptr [-o0];
+        const int        a3 = src_ptr [-om];
+        const int        a4 = src_ptr [-1 ];
+        const int        c  = src_ptr [ 0 ];
+        const int        a5 = src_ptr [ 1 ];
+        const int        a6 = src_ptr [ om];
+        const int        a7 = src_ptr [ o0];
+        const int        a8 = src_ptr [ op];
+
+        const int        res = OP::rg (c, a1, a2, a3, a4, a5, a6, a7, a8);
+
+        dst_ptr [x] = res;
+
+        ++ src_ptr;
+    }
+}
+
+#ifdef VS_TARGET_CPU_X86
+// Filters the columns [x_beg, x_end) of a line with V, x_end - x_beg must be a multiple of the vector width
+template <class V>
+static __forceinline void process_row_simd (T *dst_ptr, const T *src_ptr, ptrdiff_t stride_src, int x_beg, int x_end, typename V::R mask_sign)
+{
+    for (int x = x_beg; x < x_end; x += V::width) {
+        typename V::R      res = OP::template rg<V>(
+            src_ptr + x,
+            stride_src,
+            mask_sign
+            );
+
+        res = OP::ConvSign::template cv<V>(res, mask_sign);
+        V::store(dst_ptr + x, res);
+    }
+}
+
+// Returns the end of the columns a whole number of vectors starting at x_beg covers
+template <class V>
+static int simd_end (int width, int x_beg)
+{
+    return (x_beg + ((width - 1 - x_beg) & -static_cast<int>(V::width)));
+}
+
+// Only filters the vectorizable columns of the lines that aren't skipped, used for the wider
+// instruction sets so process_subplane_sse2 can pick up where they stopped
+template <class V>
+static int process_subplane_simd (const T *src_ptr, ptrdiff_t stride_src, T *dst_ptr, ptrdiff_t stride_dst, int width, int height)
+{
+    const int        y_b = 1;
+    const int        y_e = height - 1;
+
+    dst_ptr += y_b * stride_dst;
+    src_ptr += y_b * stride_src;
+
+    const typename V::R mask_sign = V::set1_epi16 (-0x8000);
+
+    const int        x_end = simd_end<V>(width, 1);
+
+    for (int y = y_b; y < y_e; ++y)
+    {
+        if (!OP::skip_line(y))
+            process_row_simd<V>(dst_ptr, src_ptr, stride_src, 1, x_end, mask_sign);
+
+        dst_ptr += stride_dst;
+        src_ptr += stride_src;
+    }
+
+    return (x_end);
+}
+
+static void process_subplane_sse2 (const T *src_ptr, ptrdiff_t stride_src, T *dst_ptr, ptrdiff_t stride_dst, int width, int height, int x_beg)
+{
+    const int        y_b = 1;
+    const int        y_e = height - 1;
+
+    dst_ptr += y_b * stride_dst;
+    src_ptr += y_b * stride_src;
+
+    const __m128i    mask_sign = _mm_set1_epi16 (-0x8000);
+
+    const int        x_e =   width - 1;
+    const int        w8  = simd_end<VecSse2>(width, x_beg);
+
+    for (int y = y_b; y < y_e; ++y)
+    {
+
+        if (OP::skip_line(y)) {
+            memcpy(dst_ptr, src_ptr, width * sizeof(T));
+        } else {
+            dst_ptr[0] = src_ptr[0];
+
+            process_row_simd<VecSse2>(dst_ptr, src_ptr, stride_src, x_beg, w8, mask_sign);
+
+            process_row_cpp(
+                dst_ptr,
+                src_ptr,
+                stride_src,
+                w8,
+                x_e
+                );
+
+            dst_ptr[x_e] = src_ptr[x_e];
+        }
+        dst_ptr += stride_dst;
+        src_ptr += stride_src;
+    }
+}
+
+// x_beg is where the columns still to be filtered start, anything before it was already done by a wider version
+template <class OP1, class T1>
+static void do_process_plane_sse2 (const VSFrame *src_frame, VSFrame *dst_frame, int plane_id, const VSAPI *vsapi, int x_beg)
+{
+    const int        w             = vsapi->getFrameWidth(src_frame, plane_id);
+    const int        h             = vsapi->getFrameHeight(src_frame, plane_id);
+    T1 *             dst_ptr       = reinterpret_cast<T1*>(vsapi->getWritePtr(dst_frame, plane_id));
+    const ptrdiff_t  stride        = vsapi->getStride(dst_frame, plane_id);
+
+    const T1*        src_ptr       = reinterpret_cast<const T1*>(vsapi->getReadPtr(src_frame, plane_id));
+
+    // First line
+    memcpy (dst_ptr, src_ptr, stride);
+
+    // Main content
+    PlaneProc<OP1, T1>::process_subplane_sse2(src_ptr, stride/sizeof(T1), dst_ptr, stride/sizeof(T1), w, h, x_beg);
+
+    // Last line
+    const ptrdiff_t  lp = (h - 1) * stride/sizeof(T1);
+    memcpy (dst_ptr + lp, src_ptr + lp, stride);
+}
+
+template <class OP1, class T1, class V>
+static int do_process_plane_simd (const VSFrame *src_frame, VSFrame *dst_frame, int plane_id, const VSAPI *vsapi)
+{
+    const int        w             = vsapi->getFrameWidth(src_frame, plane_id);
+    const int        h             = vsapi->getFrameHeight(src_frame, plane_id);
+    T1 *             dst_ptr       = reinterpret_cast<T1*>(vsapi->getWritePtr(dst_frame, plane_id));
+    const ptrdiff_t  stride        = vsapi->getStride(dst_frame, plane_id);
+
+    const T1*        src_ptr       = reinterpret_cast<const T1*>(vsapi->getReadPtr(src_frame, plane_id));
+
+    return (PlaneProc<OP1, T1>::template process_subplane_simd<V>(src_ptr, stride/sizeof(T1), dst_ptr, stride/sizeof(T1), w, h));
+}
+
+#endif
+
+template <class OP1, class T1>
+static void do_process_plane_cpp (const VSFrame *src_frame, VSFrame *dst_frame, int plane_id, const VSAPI *vsapi)
+{
+    const int        w             = vsapi->getFrameWidth(src_frame, plane_id);
+    const int        h             = vsapi->getFrameHeight(src_frame, plane_id);
+    T1 *             dst_ptr       = reinterpret_cast<T1*>(vsapi->getWritePtr(dst_frame, plane_id));
+    const ptrdiff_t  stride        = vsapi->getStride(dst_frame, plane_id);
+
+    const T1*        src_ptr       = reinterpret_cast<const T1*>(vsapi->getReadPtr(src_frame, plane_id));
+
+    // First line
+    memcpy(dst_ptr, src_ptr, w * sizeof(T1));
+
+    // Main content
+    PlaneProc<OP1, T1>::process_subplane_cpp(src_ptr, stride/sizeof(T1), dst_ptr, stride/sizeof(T1), w, h);
+
+    // Last line
+    const ptrdiff_t lp = (h - 1) * stride/sizeof(T1);
+    memcpy(dst_ptr + lp, src_ptr + lp, w * sizeof(T1));
+}
+
+};
+
+}
+
+#endif
@@ -0,0 +1,1885 @@
+/*****************************************************************************
+
+        AvsFilterRemoveGrain/Repair16
+        Author: Laurent de Soras, 2012
+        Modified for VapourSynth by Fredrik Mellbin 2013
+
+--- Legal stuff ---
+
+This program is free software. It comes without any warranty, to
+the extent permitted by applicable law. You can redistribute it
+and/or modify it under the terms of the Do What The Fuck You Want
+To Public License, Version 2, as published by Sam Hocevar. See
+http://sam.zoy.org/wtfpl/COPYING for more details.
+
+*Tab=3***********************************************************************/
+
+#ifndef REPAIRVS_H
+#define REPAIRVS_H
+
+#include "shared.h"
+
+// The operators and the plane processing are shared with the AVX2 version which is built
+// separately, the anonymous namespace keeps the differently compiled copies apart.
+namespace {
+
+#ifdef VS_TARGET_CPU_X86
+
+class ConvSigned
+{
+public:
+    template<class V>
+    static __forceinline typename V::R cv (typename V::R a, typename V::R m)
+    {
+        return (V::xor_si128 (a, m));
+    }
+};
+
+
+class ConvUnsigned
+{
+public:
+    template<class V>
+    static __forceinline typename V::R cv (typename V::R a, typename V::R m)
+    {
+        return (a);
+    }
+};
+
+#define AvsFilterRepair16_READ_PIX    \
+   typedef typename V::R R;                 \
+   const ptrdiff_t      om = stride_src2 - 1;     \
+   const ptrdiff_t      o0 = stride_src2    ;     \
+   const ptrdiff_t      op = stride_src2 + 1;     \
+   R              cr, a1, a2, a3, a4, c, a5, a6, a7, a8; \
+   cr = ConvSign::template cv<V> (V::load (src1_ptr + 0), mask_sign); \
+   a1 = ConvSign::template cv<V> (V::load (src2_ptr - op), mask_sign); \
+   a2 = ConvSign::template cv<V> (V::load (src2_ptr - o0), mask_sign); \
+   a3 = ConvSign::template cv<V> (V::load (src2_ptr - om), mask_sign); \
+   a4 = ConvSign::template cv<V> (V::load (src2_ptr - 1 ), mask_sign); \
+   c  = ConvSign::template cv<V> (V::load (src2_ptr + 0 ), mask_sign); \
+   a5 = ConvSign::template cv<V> (V::load (src2_ptr + 1 ), mask_sign); \
+   a6 = ConvSign::template cv<V> (V::load (src2_ptr + om), mask_sign); \
+   a7 = ConvSign::template cv<V> (V::load (src2_ptr + o0), mask_sign); \
+   a8 = ConvSign::template cv<V> (V::load (src2_ptr + op), mask_sign);
+
+#define AvsFilterRepair16_SORT_AXIS_SSE2   \
+    const R  ma1 = V::max_epi16(a1, a8); \
+    const R  mi1 = V::min_epi16(a1, a8); \
+    const R  ma2 = V::max_epi16(a2, a7); \
+    const R  mi2 = V::min_epi16(a2, a7); \
+    const R  ma3 = V::max_epi16(a3, a6); \
+    const R  mi3 = V::min_epi16(a3, a6); \
+    const R  ma4 = V::max_epi16(a4, a5); \
+    const R  mi4 = V::min_epi16(a4, a5);
+
+#else
+
+class ConvSigned
+{
+};
+
+
+class ConvUnsigned
+{
+};
+#endif
+
+#define AvsFilterRepair16_SORT_AXIS_CPP \
+    const int      ma1 = std::max(a1, a8);   \
+    const int      mi1 = std::min(a1, a8);   \
+    const int      ma2 = std::max(a2, a7);   \
+    const int      mi2 = std::min(a2, a7);   \
+    const int      ma3 = std::max(a3, a6);   \
+    const int      mi3 = std::min(a3, a6);   \
+    const int      ma4 = std::max(a4, a5);   \
+    const int      mi4 = std::min(a4, a5);
+
+
+class OpRG01
+{
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg (int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        const int        mi = std::min (std::min (
+            std::min (std::min (a1, a2), std::min (a3, a4)),
+            std::min (std::min (a5, a6), std::min (a7, a8))
+        ), c);
+        const int        ma = std::max (std::max (
+            std::max (std::max (a1, a2), std::max (a3, a4)),
+            std::max (std::max (a5, a6), std::max (a7, a8))
+        ), c);
+
+        return (limit (cr, mi, ma));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        const R    mi = V::min_epi16 (V::min_epi16 (
+            V::min_epi16 (V::min_epi16 (a1, a2), V::min_epi16 (a3, a4)),
+            V::min_epi16 (V::min_epi16 (a5, a6), V::min_epi16 (a7, a8))
+        ), c);
+        const R    ma = V::max_epi16 (V::max_epi16 (
+            V::max_epi16 (V::max_epi16 (a1, a2), V::max_epi16 (a3, a4)),
+            V::max_epi16 (V::max_epi16 (a5, a6), V::max_epi16 (a7, a8))
+        ), c);
+
+        return (V::min_epi16 (V::max_epi16 (cr, mi), ma));
+    }
+#endif
+};
+
+class OpRG02
+{
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg (int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        int                a [9] = { a1, a2, a3, a4, c, a5, a6, a7, a8 };
+
+        std::sort (&a [0], (&a [8]) + 1);
+
+        return (limit (cr, a [2-1], a [7]));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        sort_pair<V> (a1, a8);
+
+        sort_pair<V> (a1,  c);
+        sort_pair<V> (a2, a5);
+        sort_pair<V> (a3, a6);
+        sort_pair<V> (a4, a7);
+        sort_pair<V> ( c, a8);
+
+        sort_pair<V> (a1, a3);
+        sort_pair<V> ( c, a6);
+        sort_pair<V> (a2, a4);
+        sort_pair<V> (a5, a7);
+
+        sort_pair<V> (a3, a8);
+
+        sort_pair<V> (a3,  c);
+        sort_pair<V> (a6, a8);
+        sort_pair<V> (a4, a5);
+
+        a2 = V::max_epi16 (a1, a2);    // sort_pair<V> (a1, a2);
+        a3 = V::min_epi16 (a3, a4);    // sort_pair<V> (a3, a4);
+        sort_pair<V> ( c, a5);
+        a7 = V::max_epi16 (a6, a7);    // sort_pair<V> (a6, a7);
+
+        sort_pair<V> (a2, a8);
+
+        a2 = V::min_epi16 (a2,  c);    // sort_pair<V> (a2,  c);
+        a8 = V::max_epi16 (a5, a8);    // sort_pair<V> (a5, a8);
+
+        a2 = V::min_epi16 (a2, a3);    // sort_pair<V> (a2, a3);
+        a7 = V::min_epi16 (a7, a8);    // sort_pair<V> (a7, a8);
+
+        return (V::min_epi16 (V::max_epi16 (cr, a2), a7));
+    }
+#endif
+};
+
+class OpRG03
+{
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg (int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        int                a [9] = { a1, a2, a3, a4, c, a5, a6, a7, a8 };
+
+        std::sort (&a [0], (&a [8]) + 1);
+
+        return (limit (cr, a [3-1], a [6]));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        sort_pair<V> (a1, a8);
+
+        sort_pair<V> (a1,  c);
+        sort_pair<V> (a2, a5);
+        sort_pair<V> (a3, a6);
+        sort_pair<V> (a4, a7);
+        sort_pair<V> ( c, a8);
+
+        sort_pair<V> (a1, a3);
+        sort_pair<V> ( c, a6);
+        sort_pair<V> (a2, a4);
+        sort_pair<V> (a5, a7);
+
+        sort_pair<V> (a3, a8);
+
+        sort_pair<V> (a3,  c);
+        sort_pair<V> (a6, a8);
+        sort_pair<V> (a4, a5);
+
+        a2 = V::max_epi16 (a1, a2);    // sort_pair<V> (a1, a2);
+        sort_pair<V> (a3, a4);
+        sort_pair<V> ( c, a5);
+        a6 = V::min_epi16 (a6, a7);    // sort_pair<V> (a6, a7);
+
+        sort_pair<V> (a2, a8);
+
+        a2 = V::min_epi16 (a2,  c);    // sort_pair<V> (a2,  c);
+        a6 = V::max_epi16 (a4, a6);    // sort_pair<V> (a4, a6);
+        a5 = V::min_epi16 (a5, a8);    // sort_pair<V> (a5, a8);
+
+        a3 = V::max_epi16 (a2, a3);    // sort_pair<V> (a2, a3);
+        a6 = V::max_epi16 (a5, a6);    // sort_pair<V> (a5, a6);
+
+        return (V::min_epi16 (V::max_epi16 (cr, a3), a6));
+    }
+#endif
+};
+
+class OpRG04
+{
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg (int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        int                a [9] = { a1, a2, a3, a4, c, a5, a6, a7, a8 };
+
+        std::sort (&a [0], (&a [8]) + 1);
+
+        return (limit (cr, a [4-1], a [5]));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        // http://jgamble.ripco.net/cgi-bin/nw.cgi?inputs=9&algorithm=batcher&output=text
+
+        AvsFilterRepair16_READ_PIX
+
+        sort_pair<V> (a1, a8);
+
+        sort_pair<V> (a1,  c);
+        sort_pair<V> (a2, a5);
+        sort_pair<V> (a3, a6);
+        sort_pair<V> (a4, a7);
+        sort_pair<V> ( c, a8);
+
+        sort_pair<V> (a1, a3);
+        sort_pair<V> ( c, a6);
+        sort_pair<V> (a2, a4);
+        sort_pair<V> (a5, a7);
+
+        sort_pair<V> (a3, a8);
+
+        sort_pair<V> (a3,  c);
+        sort_pair<V> (a6, a8);
+        sort_pair<V> (a4, a5);
+
+        a2 = V::max_epi16 (a1, a2);    // sort_pair<V> (a1, a2);
+        a4 = V::max_epi16 (a3, a4);    // sort_pair<V> (a3, a4);
+        sort_pair<V> ( c, a5);
+        a6 = V::min_epi16 (a6, a7);    // sort_pair<V> (a6, a7);
+
+        sort_pair<V> (a2, a8);
+
+        c  = V::max_epi16 (a2,  c);    // sort_pair<V> (a2,  c);
+        sort_pair<V> (a4, a6);
+        a5 = V::min_epi16 (a5, a8);    // sort_pair<V> (a5, a8);
+
+        a4 = V::min_epi16 (a4,  c);    // sort_pair<V> (a4,  c);
+        a5 = V::min_epi16 (a5, a6);    // sort_pair<V> (a5, a6);
+
+        return (V::min_epi16 (V::max_epi16 (cr, a4), a5));
+    }
+#endif
+};
+
+class OpRG05
+{
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        const int mal1 = std::max(std::max(a1, a8), c);
+        const int mil1 = std::min(std::min(a1, a8), c);
+
+        const int mal2 = std::max(std::max(a2, a7), c);
+        const int mil2 = std::min(std::min(a2, a7), c);
+
+        const int mal3 = std::max(std::max(a3, a6), c);
+        const int mil3 = std::min(std::min(a3, a6), c);
+
+        const int mal4 = std::max(std::max(a4, a5), c);
+        const int mil4 = std::min(std::min(a4, a5), c);
+
+        const int clipped1 = limit(cr, mil1, mal1);
+        const int clipped2 = limit(cr, mil2, mal2);
+        const int clipped3 = limit(cr, mil3, mal3);
+        const int clipped4 = limit(cr, mil4, mal4);
+
+        const int c1 = std::abs(cr - clipped1);
+        const int c2 = std::abs(cr - clipped2);
+        const int c3 = std::abs(cr - clipped3);
+        const int c4 = std::abs(cr - clipped4);
+
+        const int mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+        if (mindiff == c4)
+            return clipped4;
+        else if (mindiff == c2)
+            return clipped2;
+        else if (mindiff == c3)
+            return clipped3;
+        else
+            return clipped1;
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        const R mal1 = V::max_epi16(V::max_epi16(a1, a8), c);
+        const R mil1 = V::min_epi16(V::min_epi16(a1, a8), c);
+
+        const R mal2 = V::max_epi16(V::max_epi16(a2, a7), c);
+        const R mil2 = V::min_epi16(V::min_epi16(a2, a7), c);
+
+        const R mal3 = V::max_epi16(V::max_epi16(a3, a6), c);
+        const R mil3 = V::min_epi16(V::min_epi16(a3, a6), c);
+
+        const R mal4 = V::max_epi16(V::max_epi16(a4, a5), c);
+        const R mil4 = V::min_epi16(V::min_epi16(a4, a5), c);
+
+        const R clipped1 = limit_epi16<V>(cr, mil1, mal1);
+        const R clipped2 = limit_epi16<V>(cr, mil2, mal2);
+        const R clipped3 = limit_epi16<V>(cr, mil3, mal3);
+        const R clipped4 = limit_epi16<V>(cr, mil4, mal4);
+
+        const R clipped1u = V::xor_si128(clipped1, mask_sign);
+        const R clipped2u = V::xor_si128(clipped2, mask_sign);
+        const R clipped3u = V::xor_si128(clipped3, mask_sign);
+        const R clipped4u = V::xor_si128(clipped4, mask_sign);
+        const R cru = V::xor_si128(cr, mask_sign);
+
+        const R c1u = abs_dif_epu16<V>(cru, clipped1u);
+        const R c2u = abs_dif_epu16<V>(cru, clipped2u);
+        const R c3u = abs_dif_epu16<V>(cru, clipped3u);
+        const R c4u = abs_dif_epu16<V>(cru, clipped4u);
+
+        const R c1 = V::xor_si128(c1u, mask_sign);
+        const R c2 = V::xor_si128(c2u, mask_sign);
+        const R c3 = V::xor_si128(c3u, mask_sign);
+        const R c4 = V::xor_si128(c4u, mask_sign);
+
+        const R mindiff = V::min_epi16(V::min_epi16(c1, c2), V::min_epi16(c3, c4));
+
+        R result = select_16_equ<V>(mindiff, c1, clipped1, cr);
+        result = select_16_equ<V>(mindiff, c3, clipped3, result);
+        result = select_16_equ<V>(mindiff, c2, clipped2, result);
+        return select_16_equ<V>(mindiff, c4, clipped4, result);
+}
+#endif
+};
+
+class OpRG06
+{
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        const int mal1 = std::max(std::max(a1, a8), c);
+        const int mil1 = std::min(std::min(a1, a8), c);
+
+        const int mal2 = std::max(std::max(a2, a7), c);
+        const int mil2 = std::min(std::min(a2, a7), c);
+
+        const int mal3 = std::max(std::max(a3, a6), c);
+        const int mil3 = std::min(std::min(a3, a6), c);
+
+        const int mal4 = std::max(std::max(a4, a5), c);
+        const int mil4 = std::min(std::min(a4, a5), c);
+
+        const int d1 = mal1 - mil1;
+        const int d2 = mal2 - mil2;
+        const int d3 = mal3 - mil3;
+        const int d4 = mal4 - mil4;
+
+        const int clipped1 = limit(cr, mil1, mal1);
+        const int clipped2 = limit(cr, mil2, mal2);
+        const int clipped3 = limit(cr, mil3, mal3);
+        const int clipped4 = limit(cr, mil4, mal4);
+
+        const int c1 = limit((std::abs(cr - clipped1) << 1) + d1, 0, 0xFFFF);
+        const int c2 = limit((std::abs(cr - clipped2) << 1) + d2, 0, 0xFFFF);
+        const int c3 = limit((std::abs(cr - clipped3) << 1) + d3, 0, 0xFFFF);
+        const int c4 = limit((std::abs(cr - clipped4) << 1) + d4, 0, 0xFFFF);
+
+        const int mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+        if (mindiff == c4)
+            return clipped4;
+        else if (mindiff == c2)
+            return clipped2;
+        else if (mindiff == c3)
+            return clipped3;
+        else
+            return clipped1;
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        const R mal1 = V::max_epi16(V::max_epi16(a1, a8), c);
+        const R mil1 = V::min_epi16(V::min_epi16(a1, a8), c);
+
+        const R mal2 = V::max_epi16(V::max_epi16(a2, a7), c);
+        const R mil2 = V::min_epi16(V::min_epi16(a2, a7), c);
+
+        const R mal3 = V::max_epi16(V::max_epi16(a3, a6), c);
+        const R mil3 = V::min_epi16(V::min_epi16(a3, a6), c);
+
+        const R mal4 = V::max_epi16(V::max_epi16(a4, a5), c);
+        const R mil4 = V::min_epi16(V::min_epi16(a4, a5), c);
+
+        const R d1 = V::sub_epi16(mal1, mil1);
+        const R d2 = V::sub_epi16(mal2, mil2);
+        const R d3 = V::sub_epi16(mal3, mil3);
+        const R d4 = V::sub_epi16(mal4, mil4);
+
+        const R clipped1 = limit_epi16<V>(cr, mil1, mal1);
+        const R clipped2 = limit_epi16<V>(cr, mil2, mal2);
+        const R clipped3 = limit_epi16<V>(cr, mil3, mal3);
+        const R clipped4 = limit_epi16<V>(cr, mil4, mal4);
+
+        const R clipped1u = V::xor_si128(clipped1, mask_sign);
+        const R clipped2u = V::xor_si128(clipped2, mask_sign);
+        const R clipped3u = V::xor_si128(clipped3, mask_sign);
+        const R clipped4u = V::xor_si128(clipped4, mask_sign);
+        const R cru = V::xor_si128(cr, mask_sign);
+
+        const R absdiff1 = abs_dif_epu16<V>(cru, clipped1u);
+        const R absdiff2 = abs_dif_epu16<V>(cru, clipped2u);
+        const R absdiff3 = abs_dif_epu16<V>(cru, clipped3u);
+        const R absdiff4 = abs_dif_epu16<V>(cru, clipped4u);
+
+        const R c1u = V::adds_epu16(V::adds_epu16(absdiff1, absdiff1), d1);
+        const R c2u = V::adds_epu16(V::adds_epu16(absdiff2, absdiff2), d2);
+        const R c3u = V::adds_epu16(V::adds_epu16(absdiff3, absdiff3), d3);
+        const R c4u = V::adds_epu16(V::adds_epu16(absdiff4, absdiff4), d4);
+
+        const R c1 = V::xor_si128(c1u, mask_sign);
+        const R c2 = V::xor_si128(c2u, mask_sign);
+        const R c3 = V::xor_si128(c3u, mask_sign);
+        const R c4 = V::xor_si128(c4u, mask_sign);
+
+        const R mindiff = V::min_epi16(V::min_epi16(c1, c2), V::min_epi16(c3, c4));
+
+        R result = select_16_equ<V>(mindiff, c1, clipped1, cr);
+        result = select_16_equ<V>(mindiff, c3, clipped3, result);
+        result = select_16_equ<V>(mindiff, c2, clipped2, result);
+        return select_16_equ<V>(mindiff, c4, clipped4, result);
+    }
+#endif
+};
+
+class OpRG07
+{
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        const int mal1 = std::max(std::max(a1, a8), c);
+        const int mil1 = std::min(std::min(a1, a8), c);
+
+        const int mal2 = std::max(std::max(a2, a7), c);
+        const int mil2 = std::min(std::min(a2, a7), c);
+
+        const int mal3 = std::max(std::max(a3, a6), c);
+        const int mil3 = std::min(std::min(a3, a6), c);
+
+        const int mal4 = std::max(std::max(a4, a5), c);
+        const int mil4 = std::min(std::min(a4, a5), c);
+
+        const int d1 = mal1 - mil1;
+        const int d2 = mal2 - mil2;
+        const int d3 = mal3 - mil3;
+        const int d4 = mal4 - mil4;
+
+        const int clipped1 = limit(cr, mil1, mal1);
+        const int clipped2 = limit(cr, mil2, mal2);
+        const int clipped3 = limit(cr, mil3, mal3);
+        const int clipped4 = limit(cr, mil4, mal4);
+
+        const int c1 = std::abs(cr - clipped1) + d1;
+        const int c2 = std::abs(cr - clipped2) + d2;
+        const int c3 = std::abs(cr - clipped3) + d3;
+        const int c4 = std::abs(cr - clipped4) + d4;
+
+        const int mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+        if (mindiff == c4)
+            return clipped4;
+        else if (mindiff == c2)
+            return clipped2;
+        else if (mindiff == c3)
+            return clipped3;
+        else
+            return clipped1;
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        const R mal1 = V::max_epi16(V::max_epi16(a1, a8), c);
+        const R mil1 = V::min_epi16(V::min_epi16(a1, a8), c);
+
+        const R mal2 = V::max_epi16(V::max_epi16(a2, a7), c);
+        const R mil2 = V::min_epi16(V::min_epi16(a2, a7), c);
+
+        const R mal3 = V::max_epi16(V::max_epi16(a3, a6), c);
+        const R mil3 = V::min_epi16(V::min_epi16(a3, a6), c);
+
+        const R mal4 = V::max_epi16(V::max_epi16(a4, a5), c);
+        const R mil4 = V::min_epi16(V::min_epi16(a4, a5), c);
+
+        const R d1 = V::sub_epi16(mal1, mil1);
+        const R d2 = V::sub_epi16(mal2, mil2);
+        const R d3 = V::sub_epi16(mal3, mil3);
+        const R d4 = V::sub_epi16(mal4, mil4);
+
+        const R clipped1 = limit_epi16<V>(cr, mil1, mal1);
+        const R clipped2 = limit_epi16<V>(cr, mil2, mal2);
+        const R clipped3 = limit_epi16<V>(cr, mil3, mal3);
+        const R clipped4 = limit_epi16<V>(cr, mil4, mal4);
+
+        const R clipped1u = V::xor_si128(clipped1, mask_sign);
+        const R clipped2u = V::xor_si128(clipped2, mask_sign);
+        const R clipped3u = V::xor_si128(clipped3, mask_sign);
+        const R clipped4u = V::xor_si128(clipped4, mask_sign);
+        const R cru = V::xor_si128(cr, mask_sign);
+
+        //todo: what happens when this overflows?
+        const R c1u = V::adds_epu16(abs_dif_epu16<V>(cru, clipped1u), d1);
+        const R c2u = V::adds_epu16(abs_dif_epu16<V>(cru, clipped2u), d2);
+        const R c3u = V::adds_epu16(abs_dif_epu16<V>(cru, clipped3u), d3);
+        const R c4u = V::adds_epu16(abs_dif_epu16<V>(cru, clipped4u), d4);
+
+        const R c1 = V::xor_si128(c1u, mask_sign);
+        const R c2 = V::xor_si128(c2u, mask_sign);
+        const R c3 = V::xor_si128(c3u, mask_sign);
+        const R c4 = V::xor_si128(c4u, mask_sign);
+
+        const R mindiff = V::min_epi16(V::min_epi16(c1, c2), V::min_epi16(c3, c4));
+
+        R result = select_16_equ<V>(mindiff, c1, clipped1, cr);
+        result = select_16_equ<V>(mindiff, c3, clipped3, result);
+        result = select_16_equ<V>(mindiff, c2, clipped2, result);
+        return select_16_equ<V>(mindiff, c4, clipped4, result);
+    }
+#endif
+};
+
+class OpRG08
+{
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        const int mal1 = std::max(std::max(a1, a8), c);
+        const int mil1 = std::min(std::min(a1, a8), c);
+
+        const int mal2 = std::max(std::max(a2, a7), c);
+        const int mil2 = std::min(std::min(a2, a7), c);
+
+        const int mal3 = std::max(std::max(a3, a6), c);
+        const int mil3 = std::min(std::min(a3, a6), c);
+
+        const int mal4 = std::max(std::max(a4, a5), c);
+        const int mil4 = std::min(std::min(a4, a5), c);
+
+        const int d1 = mal1 - mil1;
+        const int d2 = mal2 - mil2;
+        const int d3 = mal3 - mil3;
+        const int d4 = mal4 - mil4;
+
+        const int clipped1 = limit(cr, mil1, mal1);
+        const int clipped2 = limit(cr, mil2, mal2);
+        const int clipped3 = limit(cr, mil3, mal3);
+        const int clipped4 = limit(cr, mil4, mal4);
+
+        const int c1 = limit(std::abs(cr - clipped1) + (d1 << 1), 0, 0xFFFF);
+        const int c2 = limit(std::abs(cr - clipped2) + (d2 << 1), 0, 0xFFFF);
+        const int c3 = limit(std::abs(cr - clipped3) + (d3 << 1), 0, 0xFFFF);
+        const int c4 = limit(std::abs(cr - clipped4) + (d4 << 1), 0, 0xFFFF);
+
+        const int mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+        if (mindiff == c4)
+            return clipped4;
+        else if (mindiff == c2)
+            return clipped2;
+        else if (mindiff == c3)
+            return clipped3;
+        else
+            return clipped1;
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        const R mal1 = V::max_epi16(V::max_epi16(a1, a8), c);
+        const R mil1 = V::min_epi16(V::min_epi16(a1, a8), c);
+
+        const R mal2 = V::max_epi16(V::max_epi16(a2, a7), c);
+        const R mil2 = V::min_epi16(V::min_epi16(a2, a7), c);
+
+        const R mal3 = V::max_epi16(V::max_epi16(a3, a6), c);
+        const R mil3 = V::min_epi16(V::min_epi16(a3, a6), c);
+
+        const R mal4 = V::max_epi16(V::max_epi16(a4, a5), c);
+        const R mil4 = V::min_epi16(V::min_epi16(a4, a5), c);
+
+        const R d1 = V::sub_epi16(mal1, mil1);
+        const R d2 = V::sub_epi16(mal2, mil2);
+        const R d3 = V::sub_epi16(mal3, mil3);
+        const R d4 = V::sub_epi16(mal4, mil4);
+
+        const R clipped1 = limit_epi16<V>(cr, mil1, mal1);
+        const R clipped2 = limit_epi16<V>(cr, mil2, mal2);
+        const R clipped3 = limit_epi16<V>(cr, mil3, mal3);
+        const R clipped4 = limit_epi16<V>(cr, mil4, mal4);
+
+        const R clipped1u = V::xor_si128(clipped1, mask_sign);
+        const R clipped2u = V::xor_si128(clipped2, mask_sign);
+        const R clipped3u = V::xor_si128(clipped3, mask_sign);
+        const R clipped4u = V::xor_si128(clipped4, mask_sign);
+        const R cru = V::xor_si128(cr, mask_sign);
+
+        const R c1u = V::adds_epu16(abs_dif_epu16<V>(cru, clipped1u), V::adds_epu16(d1, d1));
+        const R c2u = V::adds_epu16(abs_dif_epu16<V>(cru, clipped2u), V::adds_epu16(d2, d2));
+        const R c3u = V::adds_epu16(abs_dif_epu16<V>(cru, clipped3u), V::adds_epu16(d3, d3));
+        const R c4u = V::adds_epu16(abs_dif_epu16<V>(cru, clipped4u), V::adds_epu16(d4, d4));
+
+        const R c1 = V::xor_si128(c1u, mask_sign);
+        const R c2 = V::xor_si128(c2u, mask_sign);
+        const R c3 = V::xor_si128(c3u, mask_sign);
+        const R c4 = V::xor_si128(c4u, mask_sign);
+
+        const R mindiff = V::min_epi16(V::min_epi16(c1, c2), V::min_epi16(c3, c4));
+
+        R result = select_16_equ<V>(mindiff, c1, clipped1, cr);
+        result = select_16_equ<V>(mindiff, c3, clipped3, result);
+        result = select_16_equ<V>(mindiff, c2, clipped2, result);
+        return select_16_equ<V>(mindiff, c4, clipped4, result);
+    }
+#endif
+};
+
+class OpRG09
+{
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        const int mal1 = std::max(std::max(a1, a8), c);
+        const int mil1 = std::min(std::min(a1, a8), c);
+
+        const int mal2 = std::max(std::max(a2, a7), c);
+        const int mil2 = std::min(std::min(a2, a7), c);
+
+        const int mal3 = std::max(std::max(a3, a6), c);
+        const int mil3 = std::min(std::min(a3, a6), c);
+
+        const int mal4 = std::max(std::max(a4, a5), c);
+        const int mil4 = std::min(std::min(a4, a5), c);
+
+        const int d1 = mal1 - mil1;
+        const int d2 = mal2 - mil2;
+        const int d3 = mal3 - mil3;
+        const int d4 = mal4 - mil4;
+
+        const int mindiff = std::min(std::min(d1, d2), std::min(d3, d4));
+
+        if (mindiff == d4)
+            return limit(cr, mil4, mal4);
+        else if (mindiff == d2)
+            return limit(cr, mil2, mal2);
+        else if (mindiff == d3)
+            return limit(cr, mil3, mal3);
+        else
+            return limit(cr, mil1, mal1);
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        const R mal1 = V::max_epi16(V::max_epi16(a1, a8), c);
+        const R mil1 = V::min_epi16(V::min_epi16(a1, a8), c);
+
+        const R mal2 = V::max_epi16(V::max_epi16(a2, a7), c);
+        const R mil2 = V::min_epi16(V::min_epi16(a2, a7), c);
+
+        const R mal3 = V::max_epi16(V::max_epi16(a3, a6), c);
+        const R mil3 = V::min_epi16(V::min_epi16(a3, a6), c);
+
+        const R mal4 = V::max_epi16(V::max_epi16(a4, a5), c);
+        const R mil4 = V::min_epi16(V::min_epi16(a4, a5), c);
+
+        const R d1 = V::sub_epi16(mal1, mil1);
+        const R d2 = V::sub_epi16(mal2, mil2);
+        const R d3 = V::sub_epi16(mal3, mil3);
+        const R d4 = V::sub_epi16(mal4, mil4);
+
+        const R mindiff = V::min_epi16(V::min_epi16(d1, d2), V::min_epi16(d3, d4));
+
+        R result = select_16_equ<V>(mindiff, d1, limit_epi16<V>(cr, mil1, mal1), cr);
+        result = select_16_equ<V>(mindiff, d3, limit_epi16<V>(cr, mil3, mal3), result);
+        result = select_16_equ<V>(mindiff, d2, limit_epi16<V>(cr, mil2, mal2), result);
+        return select_16_equ<V>(mindiff, d4, limit_epi16<V>(cr, mil4, mal4), result);
+    }
+#endif
+};
+
+class OpRG10
+{
+public:
+    typedef    ConvUnsigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        const int d1 = std::abs(cr - a1);
+        const int d2 = std::abs(cr - a2);
+        const int d3 = std::abs(cr - a3);
+        const int d4 = std::abs(cr - a4);
+        const int d5 = std::abs(cr - a5);
+        const int d6 = std::abs(cr - a6);
+        const int d7 = std::abs(cr - a7);
+        const int d8 = std::abs(cr - a8);
+        const int dc = std::abs(cr - c);
+
+        const int mindiff = std::min(std::min(std::min(std::min(d1, d2), std::min(d3, d4)), std::min(std::min(d5, d6), std::min(d7, d8))), dc);
+
+        if (mindiff == d7)
+            return a7;
+        else if (mindiff == d8)
+            return a8;
+        else if (mindiff == d6)
+            return a6;
+        else if (mindiff == d2)
+            return a2;
+        else if (mindiff == d3)
+            return a3;
+        else if (mindiff == d1)
+            return a1;
+        else if (mindiff == d5)
+            return a5;
+        else if (mindiff == dc)
+            return c;
+        else
+            return a4;
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        const R d1u = abs_dif_epu16<V>(cr, a1);
+        const R d2u = abs_dif_epu16<V>(cr, a2);
+        const R d3u = abs_dif_epu16<V>(cr, a3);
+        const R d4u = abs_dif_epu16<V>(cr, a4);
+        const R d5u = abs_dif_epu16<V>(cr, a5);
+        const R d6u = abs_dif_epu16<V>(cr, a6);
+        const R d7u = abs_dif_epu16<V>(cr, a7);
+        const R d8u = abs_dif_epu16<V>(cr, a8);
+        const R dcu = abs_dif_epu16<V>(cr, c);
+
+        const R d1 = V::xor_si128(d1u, mask_sign);
+        const R d2 = V::xor_si128(d2u, mask_sign);
+        const R d3 = V::xor_si128(d3u, mask_sign);
+        const R d4 = V::xor_si128(d4u, mask_sign);
+        const R d5 = V::xor_si128(d5u, mask_sign);
+        const R d6 = V::xor_si128(d6u, mask_sign);
+        const R d7 = V::xor_si128(d7u, mask_sign);
+        const R d8 = V::xor_si128(d8u, mask_sign);
+        const R dc = V::xor_si128(dcu, mask_sign);
+
+        const R mindiff = V::min_epi16(V::min_epi16(V::min_epi16(V::min_epi16(d1, d2), V::min_epi16(d3, d4)), V::min_epi16(V::min_epi16(d5, d6), V::min_epi16(d7, d8))), dc);
+
+        R result = select_16_equ<V>(mindiff, d4, a4, c);
+        result = select_16_equ<V>(mindiff, dc, c, result);
+        result = select_16_equ<V>(mindiff, d5, a5, result);
+        result = select_16_equ<V>(mindiff, d1, a1, result);
+        result = select_16_equ<V>(mindiff, d3, a3, result);
+        result = select_16_equ<V>(mindiff, d2, a2, result);
+        result = select_16_equ<V>(mindiff, d6, a6, result);
+        result = select_16_equ<V>(mindiff, d8, a8, result);
+        return select_16_equ<V>(mindiff, d7, a7, result);
+    }
+#endif
+};
+
+class OpRG12
+{
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg (int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        int                a [8] = { a1, a2, a3, a4, a5, a6, a7, a8 };
+
+        std::sort (&a [0], (&a [0]) + 8);
+        const int        mi = std::min (a [2-1], c);
+        const int        ma = std::max (a [7-1], c);
+
+        return (limit (cr, mi, ma));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        sort_pair<V> (a1, a2);
+        sort_pair<V> (a3, a4);
+        sort_pair<V> (a5, a6);
+        sort_pair<V> (a7, a8);
+
+        sort_pair<V> (a1, a3);
+        sort_pair<V> (a2, a4);
+        sort_pair<V> (a5, a7);
+        sort_pair<V> (a6, a8);
+
+        sort_pair<V> (a2, a3);
+        sort_pair<V> (a6, a7);
+
+        a5 = V::max_epi16 (a1, a5);    // sort_pair<V> (a1, a5);
+        sort_pair<V> (a2, a6);
+        sort_pair<V> (a3, a7);
+        a4 = V::min_epi16 (a4, a8);    // sort_pair<V> (a4, a8);
+
+        a3 = V::min_epi16 (a3, a5);    // sort_pair<V> (a3, a5);
+        a6 = V::max_epi16 (a4, a6);    // sort_pair<V> (a4, a6);
+
+        a2 = V::min_epi16 (a2, a3);    // sort_pair<V> (a2, a3);
+        a7 = V::max_epi16 (a6, a7);    // sort_pair<V> (a6, a7);
+
+        const R    mi = V::min_epi16 (c, a2);
+        const R    ma = V::max_epi16 (c, a7);
+
+        return (V::min_epi16 (V::max_epi16 (cr, mi), ma));
+    }
+#endif
+};
+
+class OpRG13
+{
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg (int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        int                a [8] = { a1, a2, a3, a4, a5, a6, a7, a8 };
+
+        std::sort (&a [0], (&a [0]) + 8);
+        const int        mi = std::min (a [3-1], c);
+        const int        ma = std::max (a [6-1], c);
+
+        return (limit (cr, mi, ma));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        sort_pair<V> (a1, a2);
+        sort_pair<V> (a3, a4);
+        sort_pair<V> (a5, a6);
+        sort_pair<V> (a7, a8);
+
+        sort_pair<V> (a1, a3);
+        sort_pair<V> (a2, a4);
+        sort_pair<V> (a5, a7);
+        sort_pair<V> (a6, a8);
+
+        sort_pair<V> (a2, a3);
+        sort_pair<V> (a6, a7);
+
+        a5 = V::max_epi16 (a1, a5);    // sort_pair<V> (a1, a5);
+        sort_pair<V> (a2, a6);
+        sort_pair<V> (a3, a7);
+        a4 = V::min_epi16 (a4, a8);    // sort_pair<V> (a4, a8);
+
+        a3 = V::min_epi16 (a3, a5);    // sort_pair<V> (a3, a5);
+        a6 = V::max_epi16 (a4, a6);    // sort_pair<V> (a4, a6);
+
+        a3 = V::max_epi16 (a2, a3);    // sort_pair<V> (a2, a3);
+        a6 = V::min_epi16 (a6, a7);    // sort_pair<V> (a6, a7);
+
+        const R    mi = V::min_epi16 (c, a3);
+        const R    ma = V::max_epi16 (c, a6);
+
+        return (V::min_epi16 (V::max_epi16 (cr, mi), ma));
+    }
+#endif
+};
+
+class OpRG14
+{
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg (int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        int                a [8] = { a1, a2, a3, a4, a5, a6, a7, a8 };
+
+        std::sort (&a [0], (&a [0]) + 8);
+        const int        mi = std::min (a [4-1], c);
+        const int        ma = std::max (a [5-1], c);
+
+        return (limit (cr, mi, ma));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg (const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        sort_pair<V> (a1, a2);
+        sort_pair<V> (a3, a4);
+        sort_pair<V> (a5, a6);
+        sort_pair<V> (a7, a8);
+
+        sort_pair<V> (a1, a3);
+        sort_pair<V> (a2, a4);
+        sort_pair<V> (a5, a7);
+        sort_pair<V> (a6, a8);
+
+        sort_pair<V> (a2, a3);
+        sort_pair<V> (a6, a7);
+
+        a5 = V::max_epi16 (a1, a5);    // sort_pair<V> (a1, a5);
+        a6 = V::max_epi16 (a2, a6);    // sort_pair<V> (a2, a6);
+        a3 = V::min_epi16 (a3, a7);    // sort_pair<V> (a3, a7);
+        a4 = V::min_epi16 (a4, a8);    // sort_pair<V> (a4, a8);
+
+        a5 = V::max_epi16 (a3, a5);    // sort_pair<V> (a3, a5);
+        a4 = V::min_epi16 (a4, a6);    // sort_pair<V> (a4, a6);
+
+        sort_pair<V> (a4, a5);
+
+        const R    mi = V::min_epi16 (c, a4);
+        const R    ma = V::max_epi16 (c, a5);
+
+        return (V::min_epi16 (V::max_epi16 (cr, mi), ma));
+    }
+#endif
+};
+
+class OpRG15 {
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        AvsFilterRepair16_SORT_AXIS_CPP
+
+        const int      c1 = std::abs(c - limit(c, mi1, ma1));
+        const int      c2 = std::abs(c - limit(c, mi2, ma2));
+        const int      c3 = std::abs(c - limit(c, mi3, ma3));
+        const int      c4 = std::abs(c - limit(c, mi4, ma4));
+
+        const int      mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+        int            mi;
+        int            ma;
+        if (mindiff == c4) {
+            mi = mi4;
+            ma = ma4;
+        } else if (mindiff == c2) {
+            mi = mi2;
+            ma = ma2;
+        } else if (mindiff == c3) {
+            mi = mi3;
+            ma = ma3;
+        } else {
+            mi = mi1;
+            ma = ma1;
+        }
+
+        mi = std::min(mi, c);
+        ma = std::max(ma, c);
+
+        return (limit(cr, mi, ma));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+        AvsFilterRepair16_SORT_AXIS_SSE2
+
+        const R cma1 = V::max_epi16(c, ma1);
+        const R cma2 = V::max_epi16(c, ma2);
+        const R cma3 = V::max_epi16(c, ma3);
+        const R cma4 = V::max_epi16(c, ma4);
+
+        const R cmi1 = V::min_epi16(c, mi1);
+        const R cmi2 = V::min_epi16(c, mi2);
+        const R cmi3 = V::min_epi16(c, mi3);
+        const R cmi4 = V::min_epi16(c, mi4);
+
+        const R clipped1 = limit_epi16<V>(c, mi1, ma1);
+        const R clipped2 = limit_epi16<V>(c, mi2, ma2);
+        const R clipped3 = limit_epi16<V>(c, mi3, ma3);
+        const R clipped4 = limit_epi16<V>(c, mi4, ma4);
+
+        const R clipped1u = V::xor_si128(clipped1, mask_sign);
+        const R clipped2u = V::xor_si128(clipped2, mask_sign);
+        const R clipped3u = V::xor_si128(clipped3, mask_sign);
+        const R clipped4u = V::xor_si128(clipped4, mask_sign);
+        const R cu = V::xor_si128(c, mask_sign);
+
+        const R c1u = abs_dif_epu16<V>(cu, clipped1u);
+        const R c2u = abs_dif_epu16<V>(cu, clipped2u);
+        const R c3u = abs_dif_epu16<V>(cu, clipped3u);
+        const R c4u = abs_dif_epu16<V>(cu, clipped4u);
+
+        const R c1 = V::xor_si128(c1u, mask_sign);
+        const R c2 = V::xor_si128(c2u, mask_sign);
+        const R c3 = V::xor_si128(c3u, mask_sign);
+        const R c4 = V::xor_si128(c4u, mask_sign);
+
+        const R mindiff = V::min_epi16(V::min_epi16(c1, c2), V::min_epi16(c3, c4));
+
+        R result = select_16_equ<V>(mindiff, c1, limit_epi16<V>(cr, cmi1, cma1), cr);
+        result = select_16_equ<V>(mindiff, c3, limit_epi16<V>(cr, cmi3, cma3), result);
+        result = select_16_equ<V>(mindiff, c2, limit_epi16<V>(cr, cmi2, cma2), result);
+        return select_16_equ<V>(mindiff, c4, limit_epi16<V>(cr, cmi4, cma4), result);
+    }
+#endif
+};
+
+class OpRG16 {
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        AvsFilterRepair16_SORT_AXIS_CPP
+
+        const int      d1 = ma1 - mi1;
+        const int      d2 = ma2 - mi2;
+        const int      d3 = ma3 - mi3;
+        const int      d4 = ma4 - mi4;
+
+        const int      c1 = limit((std::abs(c - limit(c, mi1, ma1)) << 1) + d1, 0, 0xFFFF);
+        const int      c2 = limit((std::abs(c - limit(c, mi2, ma2)) << 1) + d2, 0, 0xFFFF);
+        const int      c3 = limit((std::abs(c - limit(c, mi3, ma3)) << 1) + d3, 0, 0xFFFF);
+        const int      c4 = limit((std::abs(c - limit(c, mi4, ma4)) << 1) + d4, 0, 0xFFFF);
+
+        const int      mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+        int            mi;
+        int            ma;
+        if (mindiff == c4) {
+            mi = mi4;
+            ma = ma4;
+        } else if (mindiff == c2) {
+            mi = mi2;
+            ma = ma2;
+        } else if (mindiff == c3) {
+            mi = mi3;
+            ma = ma3;
+        } else {
+            mi = mi1;
+            ma = ma1;
+        }
+
+        mi = std::min(mi, c);
+        ma = std::max(ma, c);
+
+        return (limit(cr, mi, ma));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+        AvsFilterRepair16_SORT_AXIS_SSE2
+
+        const R cma1 = V::max_epi16(c, ma1);
+        const R cma2 = V::max_epi16(c, ma2);
+        const R cma3 = V::max_epi16(c, ma3);
+        const R cma4 = V::max_epi16(c, ma4);
+
+        const R cmi1 = V::min_epi16(c, mi1);
+        const R cmi2 = V::min_epi16(c, mi2);
+        const R cmi3 = V::min_epi16(c, mi3);
+        const R cmi4 = V::min_epi16(c, mi4);
+
+        const R d1 = V::sub_epi16(ma1, mi1);
+        const R d2 = V::sub_epi16(ma2, mi2);
+        const R d3 = V::sub_epi16(ma3, mi3);
+        const R d4 = V::sub_epi16(ma4, mi4);
+
+        const R clipped1 = limit_epi16<V>(c, mi1, ma1);
+        const R clipped2 = limit_epi16<V>(c, mi2, ma2);
+        const R clipped3 = limit_epi16<V>(c, mi3, ma3);
+        const R clipped4 = limit_epi16<V>(c, mi4, ma4);
+
+        const R clipped1u = V::xor_si128(clipped1, mask_sign);
+        const R clipped2u = V::xor_si128(clipped2, mask_sign);
+        const R clipped3u = V::xor_si128(clipped3, mask_sign);
+        const R clipped4u = V::xor_si128(clipped4, mask_sign);
+        const R cu = V::xor_si128(c, mask_sign);
+
+        const R absdiff1 = abs_dif_epu16<V>(cu, clipped1u);
+        const R absdiff2 = abs_dif_epu16<V>(cu, clipped2u);
+        const R absdiff3 = abs_dif_epu16<V>(cu, clipped3u);
+        const R absdiff4 = abs_dif_epu16<V>(cu, clipped4u);
+
+        const R c1u = V::adds_epu16(V::adds_epu16(absdiff1, absdiff1), d1);
+        const R c2u = V::adds_epu16(V::adds_epu16(absdiff2, absdiff2), d2);
+        const R c3u = V::adds_epu16(V::adds_epu16(absdiff3, absdiff3), d3);
+        const R c4u = V::adds_epu16(V::adds_epu16(absdiff4, absdiff4), d4);
+
+        const R c1 = V::xor_si128(c1u, mask_sign);
+        const R c2 = V::xor_si128(c2u, mask_sign);
+        const R c3 = V::xor_si128(c3u, mask_sign);
+        const R c4 = V::xor_si128(c4u, mask_sign);
+
+        const R mindiff = V::min_epi16(V::min_epi16(c1, c2), V::min_epi16(c3, c4));
+
+        R result = select_16_equ<V>(mindiff, c1, limit_epi16<V>(cr, cmi1, cma1), cr);
+        result = select_16_equ<V>(mindiff, c3, limit_epi16<V>(cr, cmi3, cma3), result);
+        result = select_16_equ<V>(mindiff, c2, limit_epi16<V>(cr, cmi2, cma2), result);
+        return select_16_equ<V>(mindiff, c4, limit_epi16<V>(cr, cmi4, cma4), result);
+    }
+#endif
+};
+
+class OpRG17 {
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        AvsFilterRepair16_SORT_AXIS_CPP
+
+        const int      l = std::max(std::max(mi1, mi2), std::max(mi3, mi4));
+        const int      u = std::min(std::min(ma1, ma2), std::min(ma3, ma4));
+
+        const int      mi = std::min(std::min(l, u), c);
+        const int      ma = std::max(std::max(l, u), c);
+
+        return (limit(cr, mi, ma));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+        AvsFilterRepair16_SORT_AXIS_SSE2
+
+        const R lower = V::max_epi16(V::max_epi16(mi1, mi2), V::max_epi16(mi3, mi4));
+        const R upper = V::min_epi16(V::min_epi16(ma1, ma2), V::min_epi16(ma3, ma4));
+
+        const R real_upper = V::max_epi16(V::max_epi16(upper, lower), c);
+        const R real_lower = V::min_epi16(V::min_epi16(upper, lower), c);
+
+        return limit_epi16<V>(cr, real_lower, real_upper);
+    }
+#endif
+};
+
+class OpRG18 {
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        const int      d1 = std::max(std::abs(c - a1), std::abs(c - a8));
+        const int      d2 = std::max(std::abs(c - a2), std::abs(c - a7));
+        const int      d3 = std::max(std::abs(c - a3), std::abs(c - a6));
+        const int      d4 = std::max(std::abs(c - a4), std::abs(c - a5));
+
+        const int      mindiff = std::min(std::min(d1, d2), std::min(d3, d4));
+
+        int            mi;
+        int            ma;
+        if (mindiff == d4) {
+            mi = std::min(a4, a5);
+            ma = std::max(a4, a5);
+        } else if (mindiff == d2) {
+            mi = std::min(a2, a7);
+            ma = std::max(a2, a7);
+        } else if (mindiff == d3) {
+            mi = std::min(a3, a6);
+            ma = std::max(a3, a6);
+        } else {
+            mi = std::min(a1, a8);
+            ma = std::max(a1, a8);
+        }
+
+        mi = std::min(mi, c);
+        ma = std::max(ma, c);
+
+        return (limit(cr, mi, ma));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        const R a1u = V::xor_si128(a1, mask_sign);
+        const R a2u = V::xor_si128(a2, mask_sign);
+        const R a3u = V::xor_si128(a3, mask_sign);
+        const R a4u = V::xor_si128(a4, mask_sign);
+        const R a5u = V::xor_si128(a5, mask_sign);
+        const R a6u = V::xor_si128(a6, mask_sign);
+        const R a7u = V::xor_si128(a7, mask_sign);
+        const R a8u = V::xor_si128(a8, mask_sign);
+        const R cu = V::xor_si128(c, mask_sign);
+
+        const R absdiff1u = abs_dif_epu16<V>(cu, a1u);
+        const R absdiff2u = abs_dif_epu16<V>(cu, a2u);
+        const R absdiff3u = abs_dif_epu16<V>(cu, a3u);
+        const R absdiff4u = abs_dif_epu16<V>(cu, a4u);
+        const R absdiff5u = abs_dif_epu16<V>(cu, a5u);
+        const R absdiff6u = abs_dif_epu16<V>(cu, a6u);
+        const R absdiff7u = abs_dif_epu16<V>(cu, a7u);
+        const R absdiff8u = abs_dif_epu16<V>(cu, a8u);
+
+        const R absdiff1 = V::xor_si128(absdiff1u, mask_sign);
+        const R absdiff2 = V::xor_si128(absdiff2u, mask_sign);
+        const R absdiff3 = V::xor_si128(absdiff3u, mask_sign);
+        const R absdiff4 = V::xor_si128(absdiff4u, mask_sign);
+        const R absdiff5 = V::xor_si128(absdiff5u, mask_sign);
+        const R absdiff6 = V::xor_si128(absdiff6u, mask_sign);
+        const R absdiff7 = V::xor_si128(absdiff7u, mask_sign);
+        const R absdiff8 = V::xor_si128(absdiff8u, mask_sign);
+
+        const R d1 = V::max_epi16(absdiff1, absdiff8);
+        const R d2 = V::max_epi16(absdiff2, absdiff7);
+        const R d3 = V::max_epi16(absdiff3, absdiff6);
+        const R d4 = V::max_epi16(absdiff4, absdiff5);
+
+        const R mindiff = V::min_epi16(V::min_epi16(d1, d2), V::min_epi16(d3, d4));
+
+        const R mi1 = V::min_epi16(c, V::min_epi16(a1, a8));
+        const R mi2 = V::min_epi16(c, V::min_epi16(a2, a7));
+        const R mi3 = V::min_epi16(c, V::min_epi16(a3, a6));
+        const R mi4 = V::min_epi16(c, V::min_epi16(a4, a5));
+
+        const R ma1 = V::max_epi16(c, V::max_epi16(a1, a8));
+        const R ma2 = V::max_epi16(c, V::max_epi16(a2, a7));
+        const R ma3 = V::max_epi16(c, V::max_epi16(a3, a6));
+        const R ma4 = V::max_epi16(c, V::max_epi16(a4, a5));
+
+        const R c1 = limit_epi16<V>(cr, mi1, ma1);
+        const R c2 = limit_epi16<V>(cr, mi2, ma2);
+        const R c3 = limit_epi16<V>(cr, mi3, ma3);
+        const R c4 = limit_epi16<V>(cr, mi4, ma4);
+
+        R result = select_16_equ<V>(mindiff, d1, c1, cr);
+        result = select_16_equ<V>(mindiff, d3, c3, result);
+        result = select_16_equ<V>(mindiff, d2, c2, result);
+        return select_16_equ<V>(mindiff, d4, c4, result);
+    }
+#endif
+};
+
+class OpRG19 {
+public:
+    typedef    ConvUnsigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        const int d1 = std::abs(c - a1);
+        const int d2 = std::abs(c - a2);
+        const int d3 = std::abs(c - a3);
+        const int d4 = std::abs(c - a4);
+        const int d5 = std::abs(c - a5);
+        const int d6 = std::abs(c - a6);
+        const int d7 = std::abs(c - a7);
+        const int d8 = std::abs(c - a8);
+
+        const int mindiff = std::min(std::min(std::min(d1, d2), std::min(d3, d4)), std::min(std::min(d5, d6), std::min(d7, d8)));
+
+        return limit(cr, limit(c - mindiff, 0, 0xFFFF), limit(c + mindiff, 0, 0xFFFF));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        const R d1u = abs_dif_epu16<V>(c, a1);
+        const R d2u = abs_dif_epu16<V>(c, a2);
+        const R d3u = abs_dif_epu16<V>(c, a3);
+        const R d4u = abs_dif_epu16<V>(c, a4);
+        const R d5u = abs_dif_epu16<V>(c, a5);
+        const R d6u = abs_dif_epu16<V>(c, a6);
+        const R d7u = abs_dif_epu16<V>(c, a7);
+        const R d8u = abs_dif_epu16<V>(c, a8);
+
+        const R d1 = V::xor_si128(d1u, mask_sign);
+        const R d2 = V::xor_si128(d2u, mask_sign);
+        const R d3 = V::xor_si128(d3u, mask_sign);
+        const R d4 = V::xor_si128(d4u, mask_sign);
+        const R d5 = V::xor_si128(d5u, mask_sign);
+        const R d6 = V::xor_si128(d6u, mask_sign);
+        const R d7 = V::xor_si128(d7u, mask_sign);
+        const R d8 = V::xor_si128(d8u, mask_sign);
+
+        const R mindiff = V::min_epi16(V::min_epi16(V::min_epi16(d1, d2), V::min_epi16(d3, d4)), V::min_epi16(V::min_epi16(d5, d6), V::min_epi16(d7, d8)));
+
+        const R mindiffu = V::xor_si128(mindiff, mask_sign);
+
+        const R mi = V::xor_si128(V::subs_epu16(c, mindiffu), mask_sign);
+        const R ma = V::xor_si128(V::adds_epu16(c, mindiffu), mask_sign);
+
+        return V::xor_si128(limit_epi16<V>(V::xor_si128(cr, mask_sign), mi, ma), mask_sign);
+    }
+#endif
+};
+
+class OpRG20 {
+public:
+    typedef    ConvUnsigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        const int d1 = std::abs(c - a1);
+        const int d2 = std::abs(c - a2);
+        const int d3 = std::abs(c - a3);
+        const int d4 = std::abs(c - a4);
+        const int d5 = std::abs(c - a5);
+        const int d6 = std::abs(c - a6);
+        const int d7 = std::abs(c - a7);
+        const int d8 = std::abs(c - a8);
+
+        int mindiff = std::min(d1, d2);
+        int maxdiff = std::max(d1, d2);
+
+        maxdiff = limit(maxdiff, mindiff, d3);
+        mindiff = std::min(mindiff, d3);
+
+        maxdiff = limit(maxdiff, mindiff, d4);
+        mindiff = std::min(mindiff, d4);
+
+        maxdiff = limit(maxdiff, mindiff, d5);
+        mindiff = std::min(mindiff, d5);
+
+        maxdiff = limit(maxdiff, mindiff, d6);
+        mindiff = std::min(mindiff, d6);
+
+        maxdiff = limit(maxdiff, mindiff, d7);
+        mindiff = std::min(mindiff, d7);
+
+        maxdiff = limit(maxdiff, mindiff, d8);
+
+        return limit(cr, limit(c - maxdiff, 0, 0xFFFF), limit(c + maxdiff, 0, 0xFFFF));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        const R d1u = abs_dif_epu16<V>(c, a1);
+        const R d2u = abs_dif_epu16<V>(c, a2);
+        const R d3u = abs_dif_epu16<V>(c, a3);
+        const R d4u = abs_dif_epu16<V>(c, a4);
+        const R d5u = abs_dif_epu16<V>(c, a5);
+        const R d6u = abs_dif_epu16<V>(c, a6);
+        const R d7u = abs_dif_epu16<V>(c, a7);
+        const R d8u = abs_dif_epu16<V>(c, a8);
+
+        const R d1 = V::xor_si128(d1u, mask_sign);
+        const R d2 = V::xor_si128(d2u, mask_sign);
+        const R d3 = V::xor_si128(d3u, mask_sign);
+        const R d4 = V::xor_si128(d4u, mask_sign);
+        const R d5 = V::xor_si128(d5u, mask_sign);
+        const R d6 = V::xor_si128(d6u, mask_sign);
+        const R d7 = V::xor_si128(d7u, mask_sign);
+        const R d8 = V::xor_si128(d8u, mask_sign);
+
+        R mindiff = V::min_epi16(d1, d2);
+        R maxdiff = V::max_epi16(d1, d2);
+
+        maxdiff = limit_epi16<V>(maxdiff, mindiff, d3);
+        mindiff = V::min_epi16(mindiff, d3);
+
+        maxdiff = limit_epi16<V>(maxdiff, mindiff, d4);
+        mindiff = V::min_epi16(mindiff, d4);
+
+        maxdiff = limit_epi16<V>(maxdiff, mindiff, d5);
+        mindiff = V::min_epi16(mindiff, d5);
+
+        maxdiff = limit_epi16<V>(maxdiff, mindiff, d6);
+        mindiff = V::min_epi16(mindiff, d6);
+
+        maxdiff = limit_epi16<V>(maxdiff, mindiff, d7);
+        mindiff = V::min_epi16(mindiff, d7);
+
+        maxdiff = limit_epi16<V>(maxdiff, mindiff, d8);
+
+        const R maxdiffu = V::xor_si128(maxdiff, mask_sign);
+
+        const R mi = V::xor_si128(V::subs_epu16(c, maxdiffu), mask_sign);
+        const R ma = V::xor_si128(V::adds_epu16(c, maxdiffu), mask_sign);
+
+        return V::xor_si128(limit_epi16<V>(V::xor_si128(cr, mask_sign), mi, ma), mask_sign);
+    }
+#endif
+};
+
+class OpRG21 {
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        AvsFilterRepair16_SORT_AXIS_CPP
+
+        const int d1 = limit(ma1 - c, 0, 0xFFFF);
+        const int d2 = limit(ma2 - c, 0, 0xFFFF);
+        const int d3 = limit(ma3 - c, 0, 0xFFFF);
+        const int d4 = limit(ma4 - c, 0, 0xFFFF);
+
+        const int rd1 = limit(c - mi1, 0, 0xFFFF);
+        const int rd2 = limit(c - mi2, 0, 0xFFFF);
+        const int rd3 = limit(c - mi3, 0, 0xFFFF);
+        const int rd4 = limit(c - mi4, 0, 0xFFFF);
+
+        const int u1 = std::max(d1, rd1);
+        const int u2 = std::max(d2, rd2);
+        const int u3 = std::max(d3, rd3);
+        const int u4 = std::max(d4, rd4);
+
+        const int u = std::min(std::min(u1, u2), std::min(u3, u4));
+
+        return limit(cr, limit(c - u, 0, 0xFFFF), limit(c + u, 0, 0xFFFF));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+        AvsFilterRepair16_SORT_AXIS_SSE2
+
+        const R d1 = V::subs_epi16(ma1, c);
+        const R d2 = V::subs_epi16(ma2, c);
+        const R d3 = V::subs_epi16(ma3, c);
+        const R d4 = V::subs_epi16(ma4, c);
+
+        const R rd1 = V::subs_epi16(c, mi1);
+        const R rd2 = V::subs_epi16(c, mi2);
+        const R rd3 = V::subs_epi16(c, mi3);
+        const R rd4 = V::subs_epi16(c, mi4);
+
+        const R u1 = V::max_epi16(d1, rd1);
+        const R u2 = V::max_epi16(d2, rd2);
+        const R u3 = V::max_epi16(d3, rd3);
+        const R u4 = V::max_epi16(d4, rd4);
+
+        const R u = V::min_epi16(V::min_epi16(u1, u2), V::min_epi16(u3, u4));
+
+        const R mi = V::subs_epi16(c, u);
+        const R ma = V::adds_epi16(c, u);
+
+        return limit_epi16<V>(cr, mi, ma);
+    }
+#endif
+};
+
+class OpRG22 {
+public:
+    typedef    ConvUnsigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        const int d1 = std::abs(cr - a1);
+        const int d2 = std::abs(cr - a2);
+        const int d3 = std::abs(cr - a3);
+        const int d4 = std::abs(cr - a4);
+        const int d5 = std::abs(cr - a5);
+        const int d6 = std::abs(cr - a6);
+        const int d7 = std::abs(cr - a7);
+        const int d8 = std::abs(cr - a8);
+
+        const int mindiff = std::min(std::min(std::min(d1, d2), std::min(d3, d4)), std::min(std::min(d5, d6), std::min(d7, d8)));
+
+        return limit(c, limit(cr - mindiff, 0, 0xFFFF), limit(cr + mindiff, 0, 0xFFFF));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        const R d1u = abs_dif_epu16<V>(cr, a1);
+        const R d2u = abs_dif_epu16<V>(cr, a2);
+        const R d3u = abs_dif_epu16<V>(cr, a3);
+        const R d4u = abs_dif_epu16<V>(cr, a4);
+        const R d5u = abs_dif_epu16<V>(cr, a5);
+        const R d6u = abs_dif_epu16<V>(cr, a6);
+        const R d7u = abs_dif_epu16<V>(cr, a7);
+        const R d8u = abs_dif_epu16<V>(cr, a8);
+
+        const R d1 = V::xor_si128(d1u, mask_sign);
+        const R d2 = V::xor_si128(d2u, mask_sign);
+        const R d3 = V::xor_si128(d3u, mask_sign);
+        const R d4 = V::xor_si128(d4u, mask_sign);
+        const R d5 = V::xor_si128(d5u, mask_sign);
+        const R d6 = V::xor_si128(d6u, mask_sign);
+        const R d7 = V::xor_si128(d7u, mask_sign);
+        const R d8 = V::xor_si128(d8u, mask_sign);
+
+        const R mindiff = V::min_epi16(V::min_epi16(V::min_epi16(d1, d2), V::min_epi16(d3, d4)), V::min_epi16(V::min_epi16(d5, d6), V::min_epi16(d7, d8)));
+
+        const R mindiffu = V::xor_si128(mindiff, mask_sign);
+
+        const R mi = V::xor_si128(V::subs_epu16(cr, mindiffu), mask_sign);
+        const R ma = V::xor_si128(V::adds_epu16(cr, mindiffu), mask_sign);
+
+        return V::xor_si128(limit_epi16<V>(V::xor_si128(c, mask_sign), mi, ma), mask_sign);
+    }
+#endif
+};
+
+class OpRG23 {
+public:
+    typedef    ConvUnsigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        const int d1 = std::abs(cr - a1);
+        const int d2 = std::abs(cr - a2);
+        const int d3 = std::abs(cr - a3);
+        const int d4 = std::abs(cr - a4);
+        const int d5 = std::abs(cr - a5);
+        const int d6 = std::abs(cr - a6);
+        const int d7 = std::abs(cr - a7);
+        const int d8 = std::abs(cr - a8);
+
+        int mindiff = std::min(d1, d2);
+        int maxdiff = std::max(d1, d2);
+
+        maxdiff = limit(maxdiff, mindiff, d3);
+        mindiff = std::min(mindiff, d3);
+
+        maxdiff = limit(maxdiff, mindiff, d4);
+        mindiff = std::min(mindiff, d4);
+
+        maxdiff = limit(maxdiff, mindiff, d5);
+        mindiff = std::min(mindiff, d5);
+
+        maxdiff = limit(maxdiff, mindiff, d6);
+        mindiff = std::min(mindiff, d6);
+
+        maxdiff = limit(maxdiff, mindiff, d7);
+        mindiff = std::min(mindiff, d7);
+
+        maxdiff = limit(maxdiff, mindiff, d8);
+
+        return limit(c, limit(cr - maxdiff, 0, 0xFFFF), limit(cr + maxdiff, 0, 0xFFFF));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+
+        const R d1u = abs_dif_epu16<V>(cr, a1);
+        const R d2u = abs_dif_epu16<V>(cr, a2);
+        const R d3u = abs_dif_epu16<V>(cr, a3);
+        const R d4u = abs_dif_epu16<V>(cr, a4);
+        const R d5u = abs_dif_epu16<V>(cr, a5);
+        const R d6u = abs_dif_epu16<V>(cr, a6);
+        const R d7u = abs_dif_epu16<V>(cr, a7);
+        const R d8u = abs_dif_epu16<V>(cr, a8);
+
+        const R d1 = V::xor_si128(d1u, mask_sign);
+        const R d2 = V::xor_si128(d2u, mask_sign);
+        const R d3 = V::xor_si128(d3u, mask_sign);
+        const R d4 = V::xor_si128(d4u, mask_sign);
+        const R d5 = V::xor_si128(d5u, mask_sign);
+        const R d6 = V::xor_si128(d6u, mask_sign);
+        const R d7 = V::xor_si128(d7u, mask_sign);
+        const R d8 = V::xor_si128(d8u, mask_sign);
+
+        R mindiff = V::min_epi16(d1, d2);
+        R maxdiff = V::max_epi16(d1, d2);
+
+        maxdiff = limit_epi16<V>(maxdiff, mindiff, d3);
+        mindiff = V::min_epi16(mindiff, d3);
+
+        maxdiff = limit_epi16<V>(maxdiff, mindiff, d4);
+        mindiff = V::min_epi16(mindiff, d4);
+
+        maxdiff = limit_epi16<V>(maxdiff, mindiff, d5);
+        mindiff = V::min_epi16(mindiff, d5);
+
+        maxdiff = limit_epi16<V>(maxdiff, mindiff, d6);
+        mindiff = V::min_epi16(mindiff, d6);
+
+        maxdiff = limit_epi16<V>(maxdiff, mindiff, d7);
+        mindiff = V::min_epi16(mindiff, d7);
+
+        maxdiff = limit_epi16<V>(maxdiff, mindiff, d8);
+
+        const R maxdiffu = V::xor_si128(maxdiff, mask_sign);
+
+        const R mi = V::xor_si128(V::subs_epu16(cr, maxdiffu), mask_sign);
+        const R ma = V::xor_si128(V::adds_epu16(cr, maxdiffu), mask_sign);
+
+        return V::xor_si128(limit_epi16<V>(V::xor_si128(c, mask_sign), mi, ma), mask_sign);
+    }
+#endif
+};
+
+class OpRG24 {
+public:
+    typedef    ConvSigned    ConvSign;
+    static __forceinline int rg(int cr, int a1, int a2, int a3, int a4, int c, int a5, int a6, int a7, int a8) {
+        AvsFilterRepair16_SORT_AXIS_CPP
+
+        const int d1 = limit(ma1 - cr, 0, 0xFFFF);
+        const int d2 = limit(ma2 - cr, 0, 0xFFFF);
+        const int d3 = limit(ma3 - cr, 0, 0xFFFF);
+        const int d4 = limit(ma4 - cr, 0, 0xFFFF);
+
+        const int rd1 = limit(cr - mi1, 0, 0xFFFF);
+        const int rd2 = limit(cr - mi2, 0, 0xFFFF);
+        const int rd3 = limit(cr - mi3, 0, 0xFFFF);
+        const int rd4 = limit(cr - mi4, 0, 0xFFFF);
+
+        const int u1 = std::max(d1, rd1);
+        const int u2 = std::max(d2, rd2);
+        const int u3 = std::max(d3, rd3);
+        const int u4 = std::max(d4, rd4);
+
+        const int u = std::min(std::min(u1, u2), std::min(u3, u4));
+
+        return limit(c, limit(cr - u, 0, 0xFFFF), limit(cr + u, 0, 0xFFFF));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<class V, typename T>
+    static __forceinline typename V::R rg(const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src2, typename V::R mask_sign) {
+        AvsFilterRepair16_READ_PIX
+        AvsFilterRepair16_SORT_AXIS_SSE2
+
+        const R d1 = V::subs_epi16(ma1, cr);
+        const R d2 = V::subs_epi16(ma2, cr);
+        const R d3 = V::subs_epi16(ma3, cr);
+        const R d4 = V::subs_epi16(ma4, cr);
+
+        const R rd1 = V::subs_epi16(cr, mi1);
+        const R rd2 = V::subs_epi16(cr, mi2);
+        const R rd3 = V::subs_epi16(cr, mi3);
+        const R rd4 = V::subs_epi16(cr, mi4);
+
+        const R u1 = V::max_epi16(d1, rd1);
+        const R u2 = V::max_epi16(d2, rd2);
+        const R u3 = V::max_epi16(d3, rd3);
+        const R u4 = V::max_epi16(d4, rd4);
+
+        const R u = V::min_epi16(V::min_epi16(u1, u2), V::min_epi16(u3, u4));
+
+        const R mi = V::subs_epi16(cr, u);
+        const R ma = V::adds_epi16(cr, u);
+
+        return limit_epi16<V>(c, mi, ma);
+    }
+#endif
+};
+
+template <class OP, class T>
+class PlaneProc {
+public:
+
+static void process_subplane_cpp (const T *src1_ptr, const T *src2_ptr, T *dst_ptr, ptrdiff_t stride, int width, int height)
+{
+    const int        y_b = 1;
+    const int        y_e = height - 1;
+
+    dst_ptr += y_b * stride;
+    src1_ptr += y_b * stride;
+    src2_ptr += y_b * stride;
+
+    const int        x_e = width - 1;
+
+    for (int y = y_b; y < y_e; ++y)
+    {
+        dst_ptr [0] = src1_ptr [0];
+
+        process_row_cpp (
+            dst_ptr,
+            src1_ptr,
+            src2_ptr,
+            stride,
+            1,
+            x_e
+        );
+
+        dst_ptr [x_e] = src1_ptr [x_e];
+
+        dst_ptr += stride;
+        src1_ptr += stride;
+        src2_ptr += stride;
+    }
+}
+
+static void process_row_cpp (T *dst_ptr, const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride_src, int x_beg, int x_end)
+{
+    const ptrdiff_t      om = stride_src - 1;
+    const ptrdiff_t      o0 = stride_src    ;
+    const ptrdiff_t      op = stride_src + 1;
+
+    src1_ptr += x_beg;
+    src2_ptr += x_beg;
+
+    for (int x = x_beg; x < x_end; ++x)
+    {
+        const int       cr = src1_ptr [0];
+        const int        a1 = src2_ptr [-op];
+        const int        a2 = src2_ptr [-o0];
+        const int        a3 = src2_ptr [-om];
+        const int        a4 = src2_ptr [-1 ];
+        const int        c  = src2_ptr [ 0 ];
+        const int        a5 = src2_ptr [ 1 ];
+        const int        a6 = src2_ptr [ om];
+        const int        a7 = src2_ptr [ o0];
+        const int        a8 = src2_ptr [ op];
+
+        const int        res = OP::rg (cr, a1, a2, a3, a4, c, a5, a6, a7, a8);
+
+        dst_ptr [x] = res;
+
+        ++ src1_ptr;
+        ++ src2_ptr;
+    }
+}
+
+#ifdef VS_TARGET_CPU_X86
+// Filters the columns [x_beg, x_end) of a line with V, x_end - x_beg must be a multiple of the vector width
+template <class V>
+static __forceinline void process_row_simd (T *dst_ptr, const T *src1_ptr, const T *src2_ptr, ptrdiff_t stride, int x_beg, int x_end, typename V::R mask_sign)
+{
+    for (int x = x_beg; x < x_end; x += V::width)
+    {
+        typename V::R      res = OP::template rg<V> (
+            src1_ptr + x,
+            src2_ptr + x,
+            stride,
+            mask_sign
+        );
+
+        res = OP::ConvSign::template cv<V> (res, mask_sign);
+        V::store (dst_ptr + x, res);
+    }
+}
+
+// Returns the end of the columns a whole number of vectors starting at x_beg covers
+template <class V>
+static int simd_end (int width, int x_beg)
+{
+    return (x_beg + ((width - 1 - x_beg) & -static_cast<int>(V::width)));
+}
+
+// Only filters the vectorizable columns of the inner lines, used for the wider instruction
+// sets so process_subplane_sse2 can pick up where they stopped
+template <class V>
+static int process_subplane_simd (const T *src1_ptr, const T *src2_ptr, T *dst_ptr, ptrdiff_t stride, int width, int height)
+{
+    const int        y_b = 1;
+    const int        y_e = height - 1;
+
+    dst_ptr += y_b * stride;
+    src1_ptr += y_b * stride;
+    src2_ptr += y_b * stride;
+
+    const typename V::R mask_sign = V::set1_epi16 (-0x8000);
+
+    const int        x_end = simd_end<V> (width, 1);
+
+    for (int y = y_b; y < y_e; ++y)
+    {
+        process_row_simd<V> (dst_ptr, src1_ptr, src2_ptr, stride, 1, x_end, mask_sign);
+
+        dst_ptr += stride;
+        src1_ptr += stride;
+        src2_ptr += stride;
+    }
+
+    return (x_end);
+}
+
+static void process_subplane_sse2 (const T *src1_ptr, const T *src2_ptr, T *dst_ptr, ptrdiff_t stride, int width, int height, int x_beg)
+{
+    const int        y_b = 1;
+    const int        y_e = height - 1;
+
+    dst_ptr += y_b * stride;
+    src1_ptr += y_b * stride;
+    src2_ptr += y_b * stride;
+
+    const __m128i    mask_sign = _mm_set1_epi16 (-0x8000);
+
+    const int        x_e =   width - 1;
+    const int        w8  = simd_end<VecSse2> (width, x_beg);
+
+    for (int y = y_b; y < y_e; ++y)
+    {
+        dst_ptr [0] = src1_ptr [0];
+
+        process_row_simd<VecSse2> (dst_ptr, src1_ptr, src2_ptr, stride, x_beg, w8, mask_sign);
+
+        process_row_cpp (
+            dst_ptr,
+            src1_ptr,
+            src2_ptr,
+            stride,
+            w8,
+            x_e
+        );
+
+        dst_ptr [x_e] = src1_ptr [x_e];
+
+        dst_ptr += stride;
+        src1_ptr += stride;
+        src2_ptr += stride;
+    }
+}
+
+// x_beg is where the columns still to be filtered start, anything before it was already done by a wider version
+template <class OP1, class T1>
+static void do_process_plane_sse2 (const VSFrame *src1_frame, const VSFrame *src2_frame, VSFrame *dst_frame, int plane_id, const VSAPI *vsapi, int x_beg)
+{
+    const int        w             = vsapi->getFrameWidth(src1_frame, plane_id);
+    const int        h             = vsapi->getFrameHeight(src1_frame, plane_id);
+    T1 *             dst_ptr       = reinterpret_cast<T1*>(vsapi->getWritePtr(dst_frame, plane_id));
+    const ptrdiff_t  stride        = vsapi->getStride(src1_frame, plane_id);
+
+    const T1*        src1_ptr       = reinterpret_cast<const T1*>(vsapi->getReadPtr(src1_frame, plane_id));
+    const T1*        src2_ptr       = reinterpret_cast<const T1*>(vsapi->getReadPtr(src2_frame, plane_id));
+
+    // First line
+    memcpy (dst_ptr, src1_ptr, stride);
+
+    // Main content
+    PlaneProc<OP1, T1>::process_subplane_sse2(src1_ptr, src2_ptr, dst_ptr, stride/sizeof(T1), w, h, x_beg);
+
+    // Last line
+    const ptrdiff_t  lp = (h - 1) * stride/sizeof(T1);
+    memcpy (dst_ptr + lp, src1_ptr + lp, stride);
+}
+
+template <class OP1, class T1, class V>
+static int do_process_plane_simd (const VSFrame *src1_frame, const VSFrame *src2_frame, VSFrame *dst_frame, int plane_id, const VSAPI *vsapi)
+{
+    const int        w             = vsapi->getFrameWidth(src1_frame, plane_id);
+    const int        h             = vsapi->getFrameHeight(src1_frame, plane_id);
+    T1 *             dst_ptr       = reinterpret_cast<T1*>(vsapi->getWritePtr(dst_frame, plane_id));
+    const ptrdiff_t  stride        = vsapi->getStride(src1_frame, plane_id);
+
+    const T1*        src1_ptr       = reinterpret_cast<const T1*>(vsapi->getReadPtr(src1_frame, plane_id));
+    const T1*        src2_ptr       = reinterpret_cast<const T1*>(vsapi->getReadPtr(src2_frame, plane_id));
+
+    return (PlaneProc<OP1, T1>::template process_subplane_simd<V>(src1_ptr, src2_ptr, dst_ptr, stride/sizeof(T1), w, h));
+}
+
+#endif
+
+template <class OP1, class T1>
+static void do_process_plane_cpp (const VSFrame *src1_frame, const VSFrame *src2_frame, VSFrame *dst_frame, int plane_id, const VSAPI *vsapi)
+{
+    const int         w             = vsapi->getFrameWidth(src1_frame, plane_id);
+    const int         h             = vsapi->getFrameHeight(src1_frame, plane_id);
+    T1 *             dst_ptr       = reinterpret_cast<T1*>(vsapi->getWritePtr(dst_frame, plane_id));
+    const ptrdiff_t  stride        = vsapi->getStride(src1_frame, plane_id);
+
+    const T1*        src1_ptr       = reinterpret_cast<const T1*>(vsapi->getReadPtr(src1_frame, plane_id));
+    const T1*        src2_ptr       = reinterpret_cast<const T1*>(vsapi->getReadPtr(src2_frame, plane_id));
+
+    // First line
+    memcpy (dst_ptr, src1_ptr, stride);
+
+    // Main content
+    PlaneProc<OP1, T1>::process_subplane_cpp(src1_ptr, src2_ptr, dst_ptr, stride/sizeof(T1), w, h);
+
+    // Last line
+    const int        lp = (h - 1) * stride/sizeof(T1);
+    memcpy (dst_ptr + lp, src1_ptr + lp, stride);
+}
+
+};
+
+}
+
+#endif
@@ -16,6 +16,36 @@ http://sam.zoy.org/wtfpl/COPYING for more details.
 
 #include "shared.h"
 
+#if defined(VS_TARGET_CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#ifdef VS_TARGET_CPU_X86
+static bool detectAVX2() {
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return false;
+    __cpuid(regs, 1);
+    // osxsave and avx, the os also has to save the ymm registers
+    if ((regs[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(regs, 7, 0);
+    return !!(regs[1] & (1 << 5));
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool hasAVX2() {
+    static const bool avx2 = detectAVX2();
+    return avx2;
+}
+#endif
+
 //////////////////////////////////////////
 // Init
 
@@ -23,8 +53,8 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI
     vspapi->configPlugin("com.vapoursynth.removegrainvs", "rgvs", "RemoveGrain VapourSynth Port", VS_MAKE_VERSION(1, 0), VAPOURSYNTH_API_VERSION, 0, plugin);
     vspapi->registerFunction("RemoveGrain", "clip:vnode;mode:int[];", "clip:vnode;", removeGrainCreate, nullptr, plugin);
     vspapi->registerFunction("Repair", "clip:vnode;repairclip:vnode;mode:int[];", "clip:vnode;", repairCreate, nullptr, plugin);
-    vspapi->registerFunction("Clense", "clip:vnode;previous:vnode:opt;next:vnode:opt;planes:int[]:opt;", "clip:vnode;", clenseCreate, reinterpret_cast<void *>(cmNormal), plugin);
-    vspapi->registerFunction("ForwardClense", "clip:vnode;planes:int[]:opt;", "clip:vnode;", clenseCreate, reinterpret_cast<void *>(cmForward), plugin);
-    vspapi->registerFunction("BackwardClense", "clip:vnode;planes:int[]:opt;", "clip:vnode;", clenseCreate, reinterpret_cast<void *>(cmBackward), plugin);
+    vspapi->registerFunction("Clense", "clip:vnode;previous:vnode:opt;next:vnode:opt;planes:int[]:opt;mask:int:opt;", "clip:vnode;", clenseCreate, reinterpret_cast<void *>(cmNormal), plugin);
+    vspapi->registerFunction("ForwardClense", "clip:vnode;planes:int[]:opt;mask:int:opt;", "clip:vnode;", clenseCreate, reinterpret_cast<void *>(cmForward), plugin);
+    vspapi->registerFunction("BackwardClense", "clip:vnode;planes:int[]:opt;mask:int:opt;", "clip:vnode;", clenseCreate, reinterpret_cast<void *>(cmBackward), plugin);
     vspapi->registerFunction("VerticalCleaner", "clip:vnode;mode:int[];", "clip:vnode;", verticalCleanerCreate, nullptr, plugin);
 }
@@ -46,57 +46,128 @@ static __forceinline T limit(T x, T mi, T ma)
 }
 
 #ifdef VS_TARGET_CPU_X86
-static inline __m128i limit_epi16(const __m128i &x, const __m128i &mi, const __m128i &ma) {
-    return (_mm_max_epi16(_mm_min_epi16(x, ma), mi));
+// The SIMD operators are written against this interface so the same code can be
+// instantiated for SSE2 and AVX2 (shared_avx2.h). The function names are those of
+// the SSE2 intrinsics they wrap. Pixels are always processed as 16 bit lanes.
+class VecSse2 {
+public:
+    typedef __m128i R;
+    enum { width = 8 };
+
+    static __forceinline R load(const uint8_t *p) { return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), _mm_setzero_si128()); }
+    static __forceinline R load(const uint16_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+    static __forceinline void store(uint8_t *p, R a) { _mm_storel_epi64(reinterpret_cast<__m128i *>(p), _mm_packus_epi16(a, a)); }
+    static __forceinline void store(uint16_t *p, R a) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), a); }
+    static __forceinline R loadu_si128(const void *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+    static __forceinline void storeu_si128(void *p, R a) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), a); }
+
+    static __forceinline R setzero_si128() { return _mm_setzero_si128(); }
+    static __forceinline R set1_epi16(short a) { return _mm_set1_epi16(a); }
+    static __forceinline R set1_epi32(int a) { return _mm_set1_epi32(a); }
+
+    static __forceinline R and_si128(R a, R b) { return _mm_and_si128(a, b); }
+    static __forceinline R andnot_si128(R a, R b) { return _mm_andnot_si128(a, b); }
+    static __forceinline R or_si128(R a, R b) { return _mm_or_si128(a, b); }
+    static __forceinline R xor_si128(R a, R b) { return _mm_xor_si128(a, b); }
+
+    static __forceinline R min_epi16(R a, R b) { return _mm_min_epi16(a, b); }
+    static __forceinline R max_epi16(R a, R b) { return _mm_max_epi16(a, b); }
+    static __forceinline R min_epu16(R a, R b) { return _mm_sub_epi16(a, _mm_subs_epu16(a, b)); }
+    static __forceinline R max_epu16(R a, R b) { return _mm_add_epi16(b, _mm_subs_epu16(a, b)); }
+    static __forceinline R cmpeq_epi16(R a, R b) { return _mm_cmpeq_epi16(a, b); }
+    static __forceinline R avg_epu16(R a, R b) { return _mm_avg_epu16(a, b); }
+
+    static __forceinline R min_epu8(R a, R b) { return _mm_min_epu8(a, b); }
+    static __forceinline R max_epu8(R a, R b) { return _mm_max_epu8(a, b); }
+    static __forceinline R adds_epu8(R a, R b) { return _mm_adds_epu8(a, b); }
+    static __forceinline R subs_epu8(R a, R b) { return _mm_subs_epu8(a, b); }
+    static __forceinline R cmpeq_epi8(R a, R b) { return _mm_cmpeq_epi8(a, b); }
+
+    static __forceinline R add_epi16(R a, R b) { return _mm_add_epi16(a, b); }
+    static __forceinline R sub_epi16(R a, R b) { return _mm_sub_epi16(a, b); }
+    static __forceinline R adds_epi16(R a, R b) { return _mm_adds_epi16(a, b); }
+    static __forceinline R subs_epi16(R a, R b) { return _mm_subs_epi16(a, b); }
+    static __forceinline R adds_epu16(R a, R b) { return _mm_adds_epu16(a, b); }
+    static __forceinline R subs_epu16(R a, R b) { return _mm_subs_epu16(a, b); }
+    static __forceinline R mullo_epi16(R a, R b) { return _mm_mullo_epi16(a, b); }
+    static __forceinline R mulhi_epu16(R a, R b) { return _mm_mulhi_epu16(a, b); }
+
+    static __forceinline R add_epi32(R a, R b) { return _mm_add_epi32(a, b); }
+    static __forceinline R sub_epi32(R a, R b) { return _mm_sub_epi32(a, b); }
+    static __forceinline R slli_epi32(R a, int n) { return _mm_slli_epi32(a, n); }
+    static __forceinline R srai_epi32(R a, int n) { return _mm_srai_epi32(a, n); }
+
+    // unpacking and packing stay within 128 bit lanes for all widths, so a
+    // round trip keeps the pixel order
+    static __forceinline R unpacklo_epi16(R a, R b) { return _mm_unpacklo_epi16(a, b); }
+    static __forceinline R unpackhi_epi16(R a, R b) { return _mm_unpackhi_epi16(a, b); }
+    static __forceinline R packs_epi32(R a, R b) { return _mm_packs_epi32(a, b); }
+};
+
+template <class V>
+static inline typename V::R limit_epi16(const typename V::R &x, const typename V::R &mi, const typename V::R &ma) {
+    return (V::max_epi16(V::min_epi16(x, ma), mi));
 }
 
-static inline __m128i abs_dif_epu16(const __m128i &a, const __m128i &b) {
-    const __m128i p = _mm_subs_epu16(a, b);
-    const __m128i n = _mm_subs_epu16(b, a);
+template <class V>
+static inline typename V::R abs_dif_epu16(const typename V::R &a, const typename V::R &b) {
+    const typename V::R p = V::subs_epu16(a, b);
+    const typename V::R n = V::subs_epu16(b, a);
 
-    return (_mm_or_si128(p, n));
+    return (V::or_si128(p, n));
 }
 
-static inline __m128i select(const __m128i &cond, const __m128i &v_t, const __m128i &v_f) {
-    const __m128i cond_1 = _mm_and_si128(cond, v_t);
-    const __m128i cond_0 = _mm_andnot_si128(cond, v_f);
-    const __m128i res = _mm_or_si128(cond_0, cond_1);
+template <class V>
+static inline typename V::R select(const typename V::R &cond, const typename V::R &v_t, const typename V::R &v_f) {
+    const typename V::R cond_1 = V::and_si128(cond, v_t);
+    const typename V::R cond_0 = V::andnot_si128(cond, v_f);
+    const typename V::R res = V::or_si128(cond_0, cond_1);
 
     return (res);
 }
 
-static inline __m128i select_16_equ(const __m128i &lhs, const __m128i &rhs, const __m128i &v_t, const __m128i &v_f) {
-    const __m128i cond = _mm_cmpeq_epi16(lhs, rhs);
+template <class V>
+static inline typename V::R select_16_equ(const typename V::R &lhs, const typename V::R &rhs, const typename V::R &v_t, const typename V::R &v_f) {
+    const typename V::R cond = V::cmpeq_epi16(lhs, rhs);
 
-    return (select(cond, v_t, v_f));
+    return (select<V>(cond, v_t, v_f));
 }
 
-static inline void add_x16_s32(__m128i &dst0, __m128i &dst1, __m128i src, __m128i msw) {
-    const __m128i res0 = _mm_unpacklo_epi16(src, msw);
-    const __m128i res1 = _mm_unpackhi_epi16(src, msw);
+template <class V>
+static inline void add_x16_s32(typename V::R &dst0, typename V::R &dst1, typename V::R src, typename V::R msw) {
+    const typename V::R res0 = V::unpacklo_epi16(src, msw);
+    const typename V::R res1 = V::unpackhi_epi16(src, msw);
 
-    dst0 = _mm_add_epi32(dst0, res0);
-    dst1 = _mm_add_epi32(dst1, res1);
+    dst0 = V::add_epi32(dst0, res0);
+    dst1 = V::add_epi32(dst1, res1);
 }
 
-static inline __m128i mul_s32_s15_s16(__m128i src0, __m128i src1, __m128i coef) {
-    const __m128i hi0 = _mm_mulhi_epu16(src0, coef);
-    const __m128i lo0 = _mm_mullo_epi16(src0, coef);
-    const __m128i hi1 = _mm_mulhi_epu16(src1, coef);
-    const __m128i lo1 = _mm_mullo_epi16(src1, coef);
+template <class V>
+static inline typename V::R mul_s32_s15_s16(typename V::R src0, typename V::R src1, typename V::R coef) {
+    const typename V::R hi0 = V::mulhi_epu16(src0, coef);
+    const typename V::R lo0 = V::mullo_epi16(src0, coef);
+    const typename V::R hi1 = V::mulhi_epu16(src1, coef);
+    const typename V::R lo1 = V::mullo_epi16(src1, coef);
 
-    const __m128i hi0s = _mm_slli_epi32(hi0, 16);
-    const __m128i hi1s = _mm_slli_epi32(hi1, 16);
+    const typename V::R hi0s = V::slli_epi32(hi0, 16);
+    const typename V::R hi1s = V::slli_epi32(hi1, 16);
 
-    __m128i sum0 = _mm_add_epi32(hi0s, lo0);
-    __m128i sum1 = _mm_add_epi32(hi1s, lo1);
-    sum0 = _mm_srai_epi32(sum0, 16);
-    sum1 = _mm_srai_epi32(sum1, 16);
+    typename V::R sum0 = V::add_epi32(hi0s, lo0);
+    typename V::R sum1 = V::add_epi32(hi1s, lo1);
+    sum0 = V::srai_epi32(sum0, 16);
+    sum1 = V::srai_epi32(sum1, 16);
 
-    const __m128i res = _mm_packs_epi32(sum0, sum1);
+    const typename V::R res = V::packs_epi32(sum0, sum1);
 
     return (res);
 }
+
+// Sign extends the 16 bit values and adds them to the 32 bit sums
+template <class V>
+static inline void add_s16_s32(typename V::R &dst0, typename V::R &dst1, typename V::R src) {
+    dst0 = V::add_epi32(dst0, V::srai_epi32(V::unpacklo_epi16(src, src), 16));
+    dst1 = V::add_epi32(dst1, V::srai_epi32(V::unpackhi_epi16(src, src), 16));
+}
 #endif
 
 class LineProcAll {
@@ -113,17 +184,19 @@ public:
 };
 
 #ifdef VS_TARGET_CPU_X86
-static __forceinline void sort_pair(__m128i &a1, __m128i &a2)
+template <class V>
+static __forceinline void sort_pair(typename V::R &a1, typename V::R &a2)
 {
-    const __m128i tmp = _mm_min_epi16(a1, a2);
-    a2 = _mm_max_epi16(a1, a2);
+    const typename V::R tmp = V::min_epi16(a1, a2);
+    a2 = V::max_epi16(a1, a2);
     a1 = tmp;
 }
 
-static __forceinline void sort_pair(__m128i &mi, __m128i &ma, __m128i a1, __m128i a2)
+template <class V>
+static __forceinline void sort_pair(typename V::R &mi, typename V::R &ma, typename V::R a1, typename V::R a2)
 {
-    mi = _mm_min_epi16(a1, a2);
-    ma = _mm_max_epi16(a1, a2);
+    mi = V::min_epi16(a1, a2);
+    ma = V::max_epi16(a1, a2);
 }
 #endif
 
@@ -133,6 +206,15 @@ enum cleanseMode {
     cmBackward
 };
 
+#ifdef VS_TARGET_CPU_X86
+bool hasAVX2();
+
+// Filter the inner lines of a plane up to the returned column with AVX2, the rest is left to the SSE2 version
+int removeGrainPlaneAVX2(int mode, const VSFrame *src_frame, VSFrame *dst_frame, int plane_id, const VSAPI *vsapi);
+int repairPlaneAVX2(int mode, const VSFrame *src1_frame, const VSFrame *src2_frame, VSFrame *dst_frame, int plane_id, const VSAPI *vsapi);
+void clensePlaneAVX2(bool fb, int bytesPerSample, void *dst, void *mask, const void *src, const void *ref1, const void *ref2, ptrdiff_t stride, int width, int height);
+#endif
+
 void VS_CC removeGrainCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi);
 void VS_CC repairCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi);
 void VS_CC clenseCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi);
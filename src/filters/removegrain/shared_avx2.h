@@ -0,0 +1,78 @@
+/*****************************************************************************
+
+        AvsFilterRemoveGrain/Repair16
+        Author: Laurent de Soras, 2012
+        Modified for VapourSynth by Fredrik Mellbin 2013
+
+--- Legal stuff ---
+
+This program is free software. It comes without any warranty, to
+the extent permitted by applicable law. You can redistribute it
+and/or modify it under the terms of the Do What The Fuck You Want
+To Public License, Version 2, as published by Sam Hocevar. See
+http://sam.zoy.org/wtfpl/COPYING for more details.
+
+*Tab=3***********************************************************************/
+
+#ifndef SHARED_AVX2_H
+#define SHARED_AVX2_H
+
+#include "shared.h"
+#include <immintrin.h>
+
+// The AVX2 counterpart of VecSse2, only to be included in files compiled with AVX2 enabled.
+// All the operations work within the two 128 bit lanes so they behave like two SSE2 vectors.
+class VecAvx2 {
+public:
+    typedef __m256i R;
+    enum { width = 16 };
+
+    static __forceinline R load(const uint8_t *p) { return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))); }
+    static __forceinline R load(const uint16_t *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+    static __forceinline void store(uint8_t *p, R a) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(a, a), 0xD8))); }
+    static __forceinline void store(uint16_t *p, R a) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), a); }
+    static __forceinline R loadu_si128(const void *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+    static __forceinline void storeu_si128(void *p, R a) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), a); }
+
+    static __forceinline R setzero_si128() { return _mm256_setzero_si256(); }
+    static __forceinline R set1_epi16(short a) { return _mm256_set1_epi16(a); }
+    static __forceinline R set1_epi32(int a) { return _mm256_set1_epi32(a); }
+
+    static __forceinline R and_si128(R a, R b) { return _mm256_and_si256(a, b); }
+    static __forceinline R andnot_si128(R a, R b) { return _mm256_andnot_si256(a, b); }
+    static __forceinline R or_si128(R a, R b) { return _mm256_or_si256(a, b); }
+    static __forceinline R xor_si128(R a, R b) { return _mm256_xor_si256(a, b); }
+
+    static __forceinline R min_epi16(R a, R b) { return _mm256_min_epi16(a, b); }
+    static __forceinline R max_epi16(R a, R b) { return _mm256_max_epi16(a, b); }
+    static __forceinline R min_epu16(R a, R b) { return _mm256_min_epu16(a, b); }
+    static __forceinline R max_epu16(R a, R b) { return _mm256_max_epu16(a, b); }
+    static __forceinline R cmpeq_epi16(R a, R b) { return _mm256_cmpeq_epi16(a, b); }
+    static __forceinline R avg_epu16(R a, R b) { return _mm256_avg_epu16(a, b); }
+
+    static __forceinline R min_epu8(R a, R b) { return _mm256_min_epu8(a, b); }
+    static __forceinline R max_epu8(R a, R b) { return _mm256_max_epu8(a, b); }
+    static __forceinline R adds_epu8(R a, R b) { return _mm256_adds_epu8(a, b); }
+    static __forceinline R subs_epu8(R a, R b) { return _mm256_subs_epu8(a, b); }
+    static __forceinline R cmpeq_epi8(R a, R b) { return _mm256_cmpeq_epi8(a, b); }
+
+    static __forceinline R add_epi16(R a, R b) { return _mm256_add_epi16(a, b); }
+    static __forceinline R sub_epi16(R a, R b) { return _mm256_sub_epi16(a, b); }
+    static __forceinline R adds_epi16(R a, R b) { return _mm256_adds_epi16(a, b); }
+    static __forceinline R subs_epi16(R a, R b) { return _mm256_subs_epi16(a, b); }
+    static __forceinline R adds_epu16(R a, R b) { return _mm256_adds_epu16(a, b); }
+    static __forceinline R subs_epu16(R a, R b) { return _mm256_subs_epu16(a, b); }
+    static __forceinline R mullo_epi16(R a, R b) { return _mm256_mullo_epi16(a, b); }
+    static __forceinline R mulhi_epu16(R a, R b) { return _mm256_mulhi_epu16(a, b); }
+
+    static __forceinline R add_epi32(R a, R b) { return _mm256_add_epi32(a, b); }
+    static __forceinline R sub_epi32(R a, R b) { return _mm256_sub_epi32(a, b); }
+    static __forceinline R slli_epi32(R a, int n) { return _mm256_slli_epi32(a, n); }
+    static __forceinline R srai_epi32(R a, int n) { return _mm256_srai_epi32(a, n); }
+
+    static __forceinline R unpacklo_epi16(R a, R b) { return _mm256_unpacklo_epi16(a, b); }
+    static __forceinline R unpackhi_epi16(R a, R b) { return _mm256_unpackhi_epi16(a, b); }
+    static __forceinline R packs_epi32(R a, R b) { return _mm256_packs_epi32(a, b); }
+};
+
+#endif
@@ -148,6 +148,8 @@ void blendSubtitles(VSNode *clip, VSNode *subs, const VSMap *in, VSMap *out, con
     vsapi->mapSetNode(args, "clipa", clip, maReplace);
     vsapi->mapConsumeNode(args, "clipb", subs, maReplace);
     vsapi->mapConsumeNode(args, "mask", alpha, maReplace);
+    // the mask's _DirtyRect is only valid while it hasn't been resized
+    vsapi->mapSetInt(args, "dirty_rect", !unsuitable_dimensions, maReplace);
 
     ret = vsapi->invoke(std_plugin, "MaskedMerge", args);
     vsapi->freeMap(args);
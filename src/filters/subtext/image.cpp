@@ -7,6 +7,8 @@
 #include <string.h>
 #include <string>
 #include <vector>
+#include <list>
+#include <mutex>
 #include <algorithm>
 
 extern "C" {
@@ -23,6 +25,9 @@ extern "C" {
 
 static const int64_t unused_colour = (int64_t)1 << 42;
 
+// the number of converted subtitles kept around for random access
+static const size_t cache_size = 8;
+
 
 typedef struct Subtitle {
     std::vector<AVPacket *> packets;
@@ -31,6 +36,21 @@ typedef struct Subtitle {
 } Subtitle;
 
 
+// PGS decoders keep state from previous subtitles so each one remembers where it is.
+typedef struct SubtitleDecoder {
+    AVCodecContext *avctx;
+    int last_subtitle;
+} SubtitleDecoder;
+
+
+// Everything that changes while frames are requested, shared by all threads.
+typedef struct DecoderPool {
+    std::mutex lock;
+    std::vector<SubtitleDecoder> decoders;
+    std::list<std::pair<int, const VSFrame *>> cache;
+} DecoderPool;
+
+
 typedef struct ImageFileData {
     std::string filter_name;
 
@@ -41,27 +61,73 @@ typedef struct ImageFileData {
     VSFrame *blank_rgb;
     VSFrame *blank_alpha;
 
-    const VSFrame *last_frame;
-    int last_subtitle;
+    // returned for every frame without a subtitle
+    const VSFrame *blank_frame;
 
     std::vector<Subtitle> subtitles;
 
+    // max_end_frame[i] is the largest end_frame of subtitles 0 to i, used to search when start_frame is sorted
+    std::vector<int> max_end_frame;
+    bool sorted_index;
+
     std::vector<int64_t> palette;
 
     bool gray;
 
     bool flatten;
 
-    AVCodecContext *avctx;
+    const AVCodec *decoder;
+    std::vector<uint8_t> extradata;
+
+    DecoderPool *pool;
 } ImageFileData;
 
 
-static int findSubtitleIndex(int frame, const std::vector<Subtitle> &subtitles) {
-    for (size_t i = 0; i < subtitles.size(); i++)
-        if (subtitles[i].start_frame <= frame && frame < subtitles[i].end_frame)
-            return i;
+static int findSubtitleIndex(int frame, const ImageFileData *d) {
+    const std::vector<Subtitle> &subtitles = d->subtitles;
+
+    if (!d->sorted_index) {
+        for (size_t i = 0; i < subtitles.size(); i++)
+            if (subtitles[i].start_frame <= frame && frame < subtitles[i].end_frame)
+                return i;
+
+        return -1;
+    }
+
+    // The first subtitle that hasn't ended yet is the one that is displayed, if it has started already.
+    auto it = std::upper_bound(d->max_end_frame.begin(), d->max_end_frame.end(), frame);
+    if (it == d->max_end_frame.end())
+        return -1;
+
+    size_t i = it - d->max_end_frame.begin();
+
+    return subtitles[i].start_frame <= frame ? (int)i : -1;
+}
+
+
+static AVCodecContext *openDecoder(const AVCodec *decoder, const std::vector<uint8_t> &extradata) {
+    AVCodecContext *avctx = avcodec_alloc_context3(decoder);
+    if (!avctx)
+        return nullptr;
+
+    if (extradata.size()) {
+        avctx->extradata_size = (int)extradata.size();
+        avctx->extradata = (uint8_t *)av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+        memcpy(avctx->extradata, extradata.data(), extradata.size());
+    }
+
+    if (avcodec_open2(avctx, decoder, nullptr) < 0) {
+        avcodec_free_context(&avctx);
+        return nullptr;
+    }
 
-    return -1;
+    return avctx;
+}
+
+
+static void closeDecoder(AVCodecContext *avctx) {
+    avcodec_close(avctx);
+    avcodec_free_context(&avctx);
 }
 
 
@@ -79,160 +145,227 @@ static void makePaletteGray(uint32_t *palette) {
 }
 
 
-static const VSFrame *VS_CC imageFileGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
-    (void)frameData;
+static const VSFrame *decodeSubtitle(const ImageFileData *d, SubtitleDecoder &decoder, int subtitle_index, std::string &error, VSCore *core, const VSAPI *vsapi) {
+    if (d->decoder->id == AV_CODEC_ID_HDMV_PGS_SUBTITLE &&
+        decoder.last_subtitle != subtitle_index - 1) {
+        // Random access in PGS doesn't quite work without decoding some previous subtitles.
+        // 5 was not enough. 10 seems to work. A decoder that is already a bit behind only has to catch up.
+        int first = std::max(0, subtitle_index - 10);
+        if (decoder.last_subtitle >= first && decoder.last_subtitle < subtitle_index)
+            first = decoder.last_subtitle + 1;
 
-    ImageFileData *d = (ImageFileData *) instanceData;
+        for (int s = first; s < subtitle_index; s++) {
+            const Subtitle &sub = d->subtitles[s];
 
-    if (activationReason == arInitial) {
-        int subtitle_index;
-        if (d->flatten) {
-            subtitle_index = n;
-        } else {
-            subtitle_index = findSubtitleIndex(n, d->subtitles);
-            if (subtitle_index == d->last_subtitle)
-                return vsapi->addFrameRef(d->last_frame);
+            int got_subtitle = 0;
+
+            AVSubtitle avsub;
+
+            for (size_t i = 0; i < sub.packets.size(); i++) {
+                AVPacket *packet = sub.packets[i];
+
+                avcodec_decode_subtitle2(decoder.avctx, &avsub, &got_subtitle, packet);
+
+                if (got_subtitle)
+                    avsubtitle_free(&avsub);
+            }
         }
+    }
 
-        VSFrame *rgb = vsapi->copyFrame(d->blank_rgb, core);
-        VSFrame *alpha = vsapi->copyFrame(d->blank_alpha, core);
+    // Whatever happens below the decoder state no longer matches any previous subtitle.
+    decoder.last_subtitle = subtitle_index;
 
-        if (subtitle_index > -1) {
-            if (d->avctx->codec_id == AV_CODEC_ID_HDMV_PGS_SUBTITLE &&
-                d->last_subtitle != subtitle_index - 1) {
-                // Random access in PGS doesn't quite work without decoding some previous subtitles.
-                // 5 was not enough. 10 seems to work.
-                for (int s = std::max(0, subtitle_index - 10); s < subtitle_index; s++) {
-                    const Subtitle &sub = d->subtitles[s];
+    const Subtitle &sub = d->subtitles[subtitle_index];
 
-                    int got_subtitle = 0;
+    int got_subtitle = 0;
 
-                    AVSubtitle avsub;
+    AVSubtitle avsub;
 
-                    for (size_t i = 0; i < sub.packets.size(); i++) {
-                        AVPacket *packet = sub.packets[i];
+    for (size_t i = 0; i < sub.packets.size(); i++) {
+        AVPacket *packet = sub.packets[i];
 
-                        avcodec_decode_subtitle2(d->avctx, &avsub, &got_subtitle, packet);
+        if (avcodec_decode_subtitle2(decoder.avctx, &avsub, &got_subtitle, packet) < 0) {
+            error = d->filter_name + ": Failed to decode subtitle.";
+            return nullptr;
+        }
 
-                        if (got_subtitle)
-                            avsubtitle_free(&avsub);
-                    }
-                }
-            }
+        if (got_subtitle && i < sub.packets.size() - 1) {
+            avsubtitle_free(&avsub);
+            error = d->filter_name + ": Got subtitle sooner than expected.";
+            return nullptr;
+        }
+    }
 
-            d->last_subtitle = subtitle_index;
+    if (!got_subtitle) {
+        error = d->filter_name + ": Got no subtitle after decoding all the packets.";
+        return nullptr;
+    }
 
-            const Subtitle &sub = d->subtitles[subtitle_index];
+    if (avsub.num_rects == 0) {
+        avsubtitle_free(&avsub);
+        error = d->filter_name + ": Got subtitle with num_rects=0.";
+        return nullptr;
+    }
 
-            int got_subtitle = 0;
+    VSFrame *rgb = vsapi->copyFrame(d->blank_rgb, core);
+    VSFrame *alpha = vsapi->copyFrame(d->blank_alpha, core);
 
-            AVSubtitle avsub;
+    int left = d->vi.width, top = d->vi.height, right = 0, bottom = 0;
 
-            for (size_t i = 0; i < sub.packets.size(); i++) {
-                AVPacket *packet = sub.packets[i];
+    for (unsigned r = 0; r < avsub.num_rects; r++) {
+        AVSubtitleRect *rect = avsub.rects[r];
 
-                if (avcodec_decode_subtitle2(d->avctx, &avsub, &got_subtitle, packet) < 0) {
-                    vsapi->setFilterError((d->filter_name + ": Failed to decode subtitle.").c_str(), frameCtx);
+        if (rect->w <= 0 || rect->h <= 0 || rect->type != SUBTITLE_BITMAP)
+            continue;
 
-                    vsapi->freeFrame(rgb);
-                    vsapi->freeFrame(alpha);
+#ifdef VS_HAVE_AVSUBTITLERECT_AVPICTURE
+        uint8_t **rect_data = rect->pict.data;
+        int *rect_linesize = rect->pict.linesize;
+#else
+        uint8_t **rect_data = rect->data;
+        int *rect_linesize = rect->linesize;
+#endif
 
-                    return nullptr;
-                }
+        uint32_t palette[AVPALETTE_COUNT];
+        memcpy(palette, rect_data[1], AVPALETTE_SIZE);
+        for (size_t i = 0; i < d->palette.size(); i++)
+            if (d->palette[i] != unused_colour)
+                palette[i] = d->palette[i];
+
+        if (d->gray)
+            makePaletteGray(palette);
+
+        // One table per output plane so each pixel is four plain byte lookups.
+        uint8_t lut_a[AVPALETTE_COUNT], lut_r[AVPALETTE_COUNT], lut_g[AVPALETTE_COUNT], lut_b[AVPALETTE_COUNT];
+        for (int i = 0; i < AVPALETTE_COUNT; i++) {
+            lut_a[i] = (palette[i] >> 24) & 0xff;
+            lut_r[i] = (palette[i] >> 16) & 0xff;
+            lut_g[i] = (palette[i] >> 8) & 0xff;
+            lut_b[i] = palette[i] & 0xff;
+        }
 
-                if (got_subtitle && i < sub.packets.size() - 1) {
-                    vsapi->setFilterError((d->filter_name + ": Got subtitle sooner than expected.").c_str(), frameCtx);
+        const uint8_t *input = rect_data[0];
 
-                    vsapi->freeFrame(rgb);
-                    vsapi->freeFrame(alpha);
+        uint8_t *dst_a = vsapi->getWritePtr(alpha, 0);
+        uint8_t *dst_r = vsapi->getWritePtr(rgb, 0);
+        uint8_t *dst_g = vsapi->getWritePtr(rgb, 1);
+        uint8_t *dst_b = vsapi->getWritePtr(rgb, 2);
+        ptrdiff_t stride = vsapi->getStride(rgb, 0);
 
-                    return nullptr;
-                }
+        dst_a += rect->y * stride + rect->x;
+        dst_r += rect->y * stride + rect->x;
+        dst_g += rect->y * stride + rect->x;
+        dst_b += rect->y * stride + rect->x;
+
+        for (int y = 0; y < rect->h; y++) {
+            for (int x = 0; x < rect->w; x++) {
+                uint8_t index = input[x];
+
+                dst_a[x] = lut_a[index];
+                dst_r[x] = lut_r[index];
+                dst_g[x] = lut_g[index];
+                dst_b[x] = lut_b[index];
             }
 
-            if (!got_subtitle) {
-                vsapi->setFilterError((d->filter_name + ": Got no subtitle after decoding all the packets.").c_str(), frameCtx);
+            input += rect_linesize[0];
+            dst_a += stride;
+            dst_r += stride;
+            dst_g += stride;
+            dst_b += stride;
+        }
 
-                vsapi->freeFrame(rgb);
-                vsapi->freeFrame(alpha);
+        left = std::min(left, rect->x);
+        top = std::min(top, rect->y);
+        right = std::max(right, rect->x + rect->w);
+        bottom = std::max(bottom, rect->y + rect->h);
+    }
 
-                return nullptr;
-            }
+    avsubtitle_free(&avsub);
 
-            if (avsub.num_rects == 0) {
-                vsapi->setFilterError((d->filter_name + ": Got subtitle with num_rects=0.").c_str(), frameCtx);
+    int64_t dirty[4] = { 0, 0, 0, 0 };
+    if (left < right && top < bottom) {
+        dirty[0] = left;
+        dirty[1] = top;
+        dirty[2] = right - left;
+        dirty[3] = bottom - top;
+    }
+    vsapi->mapSetIntArray(vsapi->getFramePropertiesRW(rgb), "_DirtyRect", dirty, 4);
+    vsapi->mapSetIntArray(vsapi->getFramePropertiesRW(alpha), "_DirtyRect", dirty, 4);
 
-                vsapi->freeFrame(rgb);
-                vsapi->freeFrame(alpha);
+    vsapi->mapConsumeFrame(vsapi->getFramePropertiesRW(rgb), "_Alpha", alpha, maReplace);
 
-                return nullptr;
-            }
+    return rgb;
+}
 
-            for (unsigned r = 0; r < avsub.num_rects; r++) {
-                AVSubtitleRect *rect = avsub.rects[r];
 
-                if (rect->w <= 0 || rect->h <= 0 || rect->type != SUBTITLE_BITMAP)
-                    continue;
+static const VSFrame *VS_CC imageFileGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    (void)frameData;
 
-#ifdef VS_HAVE_AVSUBTITLERECT_AVPICTURE
-                uint8_t **rect_data = rect->pict.data;
-                int *rect_linesize = rect->pict.linesize;
-#else
-                uint8_t **rect_data = rect->data;
-                int *rect_linesize = rect->linesize;
-#endif
+    ImageFileData *d = (ImageFileData *) instanceData;
+
+    if (activationReason == arInitial) {
+        int subtitle_index = d->flatten ? n : findSubtitleIndex(n, d);
+
+        if (subtitle_index < 0)
+            return vsapi->addFrameRef(d->blank_frame);
 
-                uint32_t palette[AVPALETTE_COUNT];
-                memcpy(palette, rect_data[1], AVPALETTE_SIZE);
-                for (size_t i = 0; i < d->palette.size(); i++)
-                    if (d->palette[i] != unused_colour)
-                        palette[i] = d->palette[i];
-
-                if (d->gray)
-                    makePaletteGray(palette);
-
-                const uint8_t *input = rect_data[0];
-
-                uint8_t *dst_a = vsapi->getWritePtr(alpha, 0);
-                uint8_t *dst_r = vsapi->getWritePtr(rgb, 0);
-                uint8_t *dst_g = vsapi->getWritePtr(rgb, 1);
-                uint8_t *dst_b = vsapi->getWritePtr(rgb, 2);
-                ptrdiff_t stride = vsapi->getStride(rgb, 0);
-
-                dst_a += rect->y * stride + rect->x;
-                dst_r += rect->y * stride + rect->x;
-                dst_g += rect->y * stride + rect->x;
-                dst_b += rect->y * stride + rect->x;
-
-                for (int y = 0; y < rect->h; y++) {
-                    for (int x = 0; x < rect->w; x++) {
-                        uint32_t argb = palette[input[x]];
-
-                        dst_a[x] = (argb >> 24) & 0xff;
-                        dst_r[x] = (argb >> 16) & 0xff;
-                        dst_g[x] = (argb >> 8) & 0xff;
-                        dst_b[x] = argb & 0xff;
-                    }
-
-                    input += rect_linesize[0];
-                    dst_a += stride;
-                    dst_r += stride;
-                    dst_g += stride;
-                    dst_b += stride;
+        SubtitleDecoder decoder = { nullptr, INT_MIN };
+
+        {
+            std::lock_guard<std::mutex> guard(d->pool->lock);
+
+            auto &cache = d->pool->cache;
+            for (auto it = cache.begin(); it != cache.end(); ++it) {
+                if (it->first == subtitle_index) {
+                    cache.splice(cache.begin(), cache, it);
+                    return vsapi->addFrameRef(it->second);
                 }
             }
 
-            avsubtitle_free(&avsub);
+            // Prefer the decoder that can continue with the least work.
+            auto &decoders = d->pool->decoders;
+            if (decoders.size()) {
+                size_t best = 0;
+                for (size_t i = 1; i < decoders.size(); i++) {
+                    int last = decoders[i].last_subtitle;
+                    if (last < subtitle_index && (decoders[best].last_subtitle >= subtitle_index || last > decoders[best].last_subtitle))
+                        best = i;
+                }
+
+                decoder = decoders[best];
+                decoders.erase(decoders.begin() + best);
+            }
+        }
+
+        if (!decoder.avctx) {
+            decoder.avctx = openDecoder(d->decoder, d->extradata);
+
+            if (!decoder.avctx) {
+                vsapi->setFilterError((d->filter_name + ": failed to open AVCodecContext.").c_str(), frameCtx);
+                return nullptr;
+            }
         }
 
-        vsapi->mapConsumeFrame(vsapi->getFramePropertiesRW(rgb), "_Alpha", alpha, maReplace);
+        std::string error;
+        const VSFrame *frame = decodeSubtitle(d, decoder, subtitle_index, error, core, vsapi);
+
+        std::lock_guard<std::mutex> guard(d->pool->lock);
+
+        d->pool->decoders.push_back(decoder);
 
-        if (subtitle_index > -1) {
-            vsapi->freeFrame(d->last_frame);
-            d->last_frame = vsapi->addFrameRef(rgb);
+        if (!frame) {
+            vsapi->setFilterError(error.c_str(), frameCtx);
+            return nullptr;
         }
 
-        return rgb;
+        auto &cache = d->pool->cache;
+        cache.emplace_front(subtitle_index, vsapi->addFrameRef(frame));
+        if (cache.size() > cache_size) {
+            vsapi->freeFrame(cache.back().second);
+            cache.pop_back();
+        }
+
+        return frame;
     }
 
     return nullptr;
@@ -248,15 +381,20 @@ static void VS_CC imageFileFree(void *instanceData, VSCore *core, const VSAPI *v
 
     vsapi->freeFrame(d->blank_rgb);
     vsapi->freeFrame(d->blank_alpha);
-    vsapi->freeFrame(d->last_frame);
+    vsapi->freeFrame(d->blank_frame);
+
+    for (auto &entry : d->pool->cache)
+        vsapi->freeFrame(entry.second);
+
+    for (auto &decoder : d->pool->decoders)
+        closeDecoder(decoder.avctx);
+
+    delete d->pool;
 
     for (auto &sub : d->subtitles)
         for (auto &packet : sub.packets)
             av_packet_free(&packet);
 
-    avcodec_close(d->avctx);
-    avcodec_free_context(&d->avctx);
-
     delete d;
 }
 
@@ -403,6 +541,9 @@ extern "C" void VS_CC imageFileCreate(const VSMap *in, VSMap *out, void *userDat
 
     int stream_index = -1;
 
+    // only the timing of the subtitles is needed here, their pictures are decoded again when requested
+    AVCodecContext *avctx = nullptr;
+
     try {
         if (id > -1) {
             for (unsigned i = 0; i < fctx->nb_streams; i++) {
@@ -435,32 +576,21 @@ extern "C" void VS_CC imageFileCreate(const VSMap *in, VSMap *out, void *userDat
 
         AVCodecID codec_id = fctx->streams[stream_index]->codecpar->codec_id;
 
-        const AVCodec *decoder = avcodec_find_decoder(codec_id);
-        if (!decoder)
+        d.decoder = avcodec_find_decoder(codec_id);
+        if (!d.decoder)
             throw std::string("failed to find decoder for '") + avcodec_get_name(codec_id) + "'.";
 
-        d.avctx = avcodec_alloc_context3(decoder);
-        if (!d.avctx)
-            throw std::string("failed to allocate AVCodecContext.");
+        const AVCodecParameters *codecpar = fctx->streams[stream_index]->codecpar;
+        d.extradata.assign(codecpar->extradata, codecpar->extradata + codecpar->extradata_size);
 
-        int extradata_size = fctx->streams[stream_index]->codecpar->extradata_size;
-        if (extradata_size) {
-            d.avctx->extradata_size = extradata_size;
-            d.avctx->extradata = (uint8_t *)av_mallocz(extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
-            memcpy(d.avctx->extradata, fctx->streams[stream_index]->codecpar->extradata, extradata_size);
-        }
-
-        ret = avcodec_open2(d.avctx, decoder, nullptr);
-        if (ret < 0)
+        avctx = openDecoder(d.decoder, d.extradata);
+        if (!avctx)
             throw std::string("failed to open AVCodecContext.");
     } catch (const std::string &e) {
         vsapi->mapSetError(out, (d.filter_name + ": " + e).c_str());
 
         avformat_close_input(&fctx);
 
-        if (d.avctx)
-            avcodec_free_context(&d.avctx);
-
         vsapi->freeNode(d.clip);
 
         return;
@@ -483,7 +613,7 @@ extern "C" void VS_CC imageFileCreate(const VSMap *in, VSMap *out, void *userDat
 
         int got_avsub = 0;
 
-        ret = avcodec_decode_subtitle2(d.avctx, &avsub, &got_avsub, packet);
+        ret = avcodec_decode_subtitle2(avctx, &avsub, &got_avsub, packet);
         if (ret < 0) {
             av_packet_unref(packet);
             continue;
@@ -535,8 +665,7 @@ extern "C" void VS_CC imageFileCreate(const VSMap *in, VSMap *out, void *userDat
 
         avformat_close_input(&fctx);
 
-        if (d.avctx)
-            avcodec_free_context(&d.avctx);
+        closeDecoder(avctx);
 
         vsapi->freeNode(d.clip);
 
@@ -555,6 +684,14 @@ extern "C" void VS_CC imageFileCreate(const VSMap *in, VSMap *out, void *userDat
         }
     }
 
+    d.sorted_index = true;
+    d.max_end_frame.resize(d.subtitles.size());
+    for (size_t i = 0; i < d.subtitles.size(); i++) {
+        d.max_end_frame[i] = i ? std::max(d.max_end_frame[i - 1], d.subtitles[i].end_frame) : d.subtitles[i].end_frame;
+        if (i && d.subtitles[i].start_frame < d.subtitles[i - 1].start_frame)
+            d.sorted_index = false;
+    }
+
 
     d.blank_rgb = vsapi->newVideoFrame(&d.vi.format, d.vi.width, d.vi.height, nullptr, core);
     VSVideoFormat blank_alpha_format;
@@ -573,7 +710,17 @@ extern "C" void VS_CC imageFileCreate(const VSMap *in, VSMap *out, void *userDat
         }
     }
 
-    d.last_subtitle = INT_MIN;
+    int64_t dirty[4] = { 0, 0, 0, 0 };
+    vsapi->mapSetIntArray(vsapi->getFramePropertiesRW(d.blank_rgb), "_DirtyRect", dirty, 4);
+    vsapi->mapSetIntArray(vsapi->getFramePropertiesRW(d.blank_alpha), "_DirtyRect", dirty, 4);
+
+    VSFrame *blank_frame = vsapi->copyFrame(d.blank_rgb, core);
+    vsapi->mapSetFrame(vsapi->getFramePropertiesRW(blank_frame), "_Alpha", d.blank_alpha, maReplace);
+    d.blank_frame = blank_frame;
+
+    // The decoder used for the timing has already seen every packet and is as good as any other.
+    d.pool = new DecoderPool;
+    d.pool->decoders.push_back({ avctx, INT_MIN });
 
 
     d.flatten = !!vsapi->mapGetInt(in, "flatten", 0, &err);
@@ -582,7 +729,7 @@ extern "C" void VS_CC imageFileCreate(const VSMap *in, VSMap *out, void *userDat
 
     data = new ImageFileData(d);
 
-    vsapi->createVideoFilter(out, d.filter_name.c_str(), &d.vi, imageFileGetFrame, imageFileFree, fmUnordered, nullptr, 0, data, core);
+    vsapi->createVideoFilter(out, d.filter_name.c_str(), &d.vi, imageFileGetFrame, imageFileFree, fmParallel, nullptr, 0, data, core);
 
     if (vsapi->mapGetError(out)) {
         avformat_close_input(&fctx);
@@ -19,11 +19,20 @@
 #ifdef _WIN32
 #define _CRT_SECURE_NO_WARNINGS
 #endif
+#include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ass/ass.h>
 #include <time.h>
 #include <inttypes.h>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 #include "VapourSynth4.h"
 #include "VSHelper4.h"
 
@@ -47,27 +56,61 @@ struct AssTime {
 };
 typedef struct AssTime AssTime;
 
+#ifdef _WIN32
+typedef SRWLOCK AssLock;
+
+static void assLockInit(AssLock *lock) { InitializeSRWLock(lock); }
+static void assLockDestroy(AssLock *lock) { (void)lock; }
+static void assLock(AssLock *lock) { AcquireSRWLockExclusive(lock); }
+static void assUnlock(AssLock *lock) { ReleaseSRWLockExclusive(lock); }
+#else
+typedef pthread_mutex_t AssLock;
+
+static void assLockInit(AssLock *lock) { pthread_mutex_init(lock, NULL); }
+static void assLockDestroy(AssLock *lock) { pthread_mutex_destroy(lock); }
+static void assLock(AssLock *lock) { pthread_mutex_lock(lock); }
+static void assUnlock(AssLock *lock) { pthread_mutex_unlock(lock); }
+#endif
+
+// A renderer can only be used by one thread at a time so every thread that renders gets its own library,
+// renderer and track. The last rendered frame is kept to reuse when libass reports that nothing changed.
+struct AssContext {
+    ASS_Library *ass_library;
+    ASS_Renderer *ass_renderer;
+    ASS_Track *ass;
+
+    int lastn;
+    const VSFrame *lastframe;
+
+    struct AssContext *next;
+};
+typedef struct AssContext AssContext;
+
 struct AssData {
     VSNode *node;
     VSVideoInfo vi[2];
+    const char *filter_name;
 
-    int lastn;
-    VSFrame *lastframe;
+    // returned for all times without any events
+    const VSFrame *blankframe;
 
-    const char *file;
+    char *file;
     const char *text;
-    const char *style;
-    const char *charset;
-    const char *fontdir;
+    char *style;
+    char *charset;
+    char *fontdir;
     double scale;
     double linespacing;
     double sar;
     int margins[4];
     intptr_t debuglevel;
 
-    ASS_Track *ass;
-    ASS_Library *ass_library;
-    ASS_Renderer *ass_renderer;
+    // the script or file contents every context's track is created from
+    char *script;
+    size_t script_size;
+
+    AssLock lock;
+    AssContext *contexts;
 
     int startframe;
     int endframe;
@@ -126,10 +169,11 @@ static void assDebugCallback(int level, const char *fmt, va_list va, void *data)
 }
 
 static void assRender(VSFrame *dst, VSFrame *alpha, const VSAPI *vsapi,
-                      ASS_Image *img)
+                      ASS_Image *img, const int rect[4])
 {
     uint8_t *planes[4];
     ptrdiff_t strides[4], p;
+    int64_t dirty[4];
 
     for(p = 0; p < 4; p++) {
         VSFrame *fr = p == 3 ? alpha : dst;
@@ -139,6 +183,12 @@ static void assRender(VSFrame *dst, VSFrame *alpha, const VSAPI *vsapi,
         memset(planes[p], 0, strides[p] * vsapi->getFrameHeight(fr, p % 3));
     }
 
+    // the area covered by bitmaps so later filters can skip the rest
+    for(p = 0; p < 4; p++)
+        dirty[p] = rect[p];
+    vsapi->mapSetIntArray(vsapi->getFramePropertiesRW(dst), "_DirtyRect", dirty, 4);
+    vsapi->mapSetIntArray(vsapi->getFramePropertiesRW(alpha), "_DirtyRect", dirty, 4);
+
     while(img) {
         uint8_t *dstp[4], *alphap, *sp, color[4];
         uint16_t outa;
@@ -186,54 +236,217 @@ static void assRender(VSFrame *dst, VSFrame *alpha, const VSAPI *vsapi,
     }
 }
 
+// The bounding box of all bitmaps as x, y, width and height, returns 0 if there's nothing to draw.
+static int assBoundingBox(const ASS_Image *img, int rect[4])
+{
+    int left = INT_MAX, top = INT_MAX, right = 0, bottom = 0;
+
+    for(; img; img = img->next) {
+        if(img->w == 0 || img->h == 0)
+            continue;
+
+        left = VSMIN(left, img->dst_x);
+        top = VSMIN(top, img->dst_y);
+        right = VSMAX(right, img->dst_x + img->w);
+        bottom = VSMAX(bottom, img->dst_y + img->h);
+    }
+
+    if(left >= right || top >= bottom)
+        return 0;
+
+    rect[0] = left;
+    rect[1] = top;
+    rect[2] = right - left;
+    rect[3] = bottom - top;
+    return 1;
+}
+
+static int assHasEvents(const ASS_Track *track, int64_t ts)
+{
+    for(int i = 0; i < track->n_events; i++) {
+        const ASS_Event *event = &track->events[i];
+
+        if(event->Start <= ts && ts < event->Start + event->Duration)
+            return 1;
+    }
+
+    return 0;
+}
+
+char *convertToUtf8(const char *file_name, const char *charset, int64_t *file_size, char *error, size_t error_size);
+ASS_Track *convertToASS(const char *file_name, const char *contents, size_t contents_size, ASS_Library *ass_library, const char *user_style, const char *charset, char *error, size_t error_size);
+
+static void assFreeContext(AssContext *ctx, const VSAPI *vsapi)
+{
+    vsapi->freeFrame(ctx->lastframe);
+    ass_free_track(ctx->ass);
+    ass_renderer_done(ctx->ass_renderer);
+    ass_library_done(ctx->ass_library);
+    free(ctx);
+}
+
+static AssContext *assCreateContext(const AssData *d, char *error, size_t error_size)
+{
+    const char *filter_name = d->filter_name;
+    AssContext *ctx = calloc(1, sizeof(AssContext));
+
+    ctx->lastn = -1;
+    ctx->ass_library = ass_library_init();
+
+    if(!ctx->ass_library) {
+        snprintf(error, error_size, "%s: failed to initialize ASS library", filter_name);
+        free(ctx);
+        return NULL;
+    }
+
+    ass_set_message_cb(ctx->ass_library, assDebugCallback, (void *)d->debuglevel);
+    ass_set_extract_fonts(ctx->ass_library, 0);
+    ass_set_style_overrides(ctx->ass_library, 0);
+
+    ctx->ass_renderer = ass_renderer_init(ctx->ass_library);
+
+    if(!ctx->ass_renderer) {
+        snprintf(error, error_size, "%s: failed to initialize ASS renderer", filter_name);
+        ass_library_done(ctx->ass_library);
+        free(ctx);
+        return NULL;
+    }
+
+    ass_set_font_scale(ctx->ass_renderer, d->scale);
+    ass_set_frame_size(ctx->ass_renderer, d->vi[0].width, d->vi[0].height);
+    ass_set_margins(ctx->ass_renderer,
+                    d->margins[0], d->margins[1], d->margins[2], d->margins[3]);
+    ass_set_use_margins(ctx->ass_renderer, 0);
+
+    if(d->linespacing)
+        ass_set_line_spacing(ctx->ass_renderer, d->linespacing);
+
+    if(d->sar) {
+        ass_set_pixel_aspect(ctx->ass_renderer,
+                             (double)d->vi[0].width /
+                             d->vi[0].height * d->sar);
+    }
+
+    if(d->fontdir)
+        ass_set_fonts_dir(ctx->ass_library, d->fontdir);
+
+    ass_set_fonts(ctx->ass_renderer, NULL, NULL, 1, NULL, 1);
+
+    if(d->file == NULL) {
+        ctx->ass = ass_new_track(ctx->ass_library);
+        ass_process_data(ctx->ass, d->script, (int)d->script_size);
+    } else {
+        snprintf(error, error_size, "%s: ", filter_name);
+
+        ctx->ass = ass_read_memory(ctx->ass_library, d->script, d->script_size, NULL);
+
+        if (!ctx->ass)
+            ctx->ass = convertToASS(d->file, d->script, d->script_size, ctx->ass_library, d->style, d->charset, error + strlen(error), error_size - strlen(error));
+
+        if (!ctx->ass) {
+            ass_renderer_done(ctx->ass_renderer);
+            ass_library_done(ctx->ass_library);
+            free(ctx);
+            return NULL;
+        }
+
+        error[0] = 0;
+    }
+
+    return ctx;
+}
+
 static const VSFrame *VS_CC assGetFrame(int n, int activationReason,
         void *instanceData, void **frameData,
         VSFrameContext *frameCtx, VSCore *core,
         const VSAPI *vsapi)
 {
     AssData *d = (AssData *) instanceData;
+    AssContext *ctx;
+    const VSFrame *result;
+    int64_t ts = (int64_t)n * 1000 * d->vi[0].fpsDen / d->vi[0].fpsNum;
 
-    if(n != d->lastn) {
-        ASS_Image *img;
-        int64_t ts = 0;
-        int changed;
+    assLock(&d->lock);
+    ctx = d->contexts;
+    if(ctx)
+        d->contexts = ctx->next;
+    assUnlock(&d->lock);
 
-        ts = (int64_t)n * 1000 * d->vi[0].fpsDen / d->vi[0].fpsNum;
+    if(!ctx) {
+        char error[512] = { 0 };
 
-        img = ass_render_frame(d->ass_renderer, d->ass, ts, &changed);
+        ctx = assCreateContext(d, error, sizeof(error));
 
-        if (changed) {
-            VSFrame *dst = vsapi->newVideoFrame(&d->vi[0].format,
-                                                   d->vi[0].width,
-                                                   d->vi[0].height,
-                                                   NULL, core);
+        if(!ctx) {
+            vsapi->setFilterError(error, frameCtx);
+            return NULL;
+        }
+    }
 
-            VSFrame *a = vsapi->newVideoFrame(&d->vi[1].format,
-                                                 d->vi[1].width,
-                                                 d->vi[1].height,
-                                                 NULL, core);
+    if(!assHasEvents(ctx->ass, ts)) {
+        result = vsapi->addFrameRef(d->blankframe);
+    } else {
+        if(n != ctx->lastn) {
+            int changed;
+            ASS_Image *img = ass_render_frame(ctx->ass_renderer, ctx->ass, ts, &changed);
+
+            if(changed || !ctx->lastframe) {
+                int rect[4];
+
+                vsapi->freeFrame(ctx->lastframe);
+
+                if(assBoundingBox(img, rect)) {
+                    VSFrame *dst = vsapi->newVideoFrame(&d->vi[0].format,
+                                                           d->vi[0].width,
+                                                           d->vi[0].height,
+                                                           NULL, core);
+
+                    VSFrame *a = vsapi->newVideoFrame(&d->vi[1].format,
+                                                         d->vi[1].width,
+                                                         d->vi[1].height,
+                                                         NULL, core);
+
+                    assRender(dst, a, vsapi, img, rect);
+                    vsapi->mapSetInt(vsapi->getFramePropertiesRW(a), "_ColorRange", 0, maReplace);
+                    vsapi->mapConsumeFrame(vsapi->getFramePropertiesRW(dst), "_Alpha", a, maAppend);
+                    ctx->lastframe = dst;
+                } else {
+                    ctx->lastframe = vsapi->addFrameRef(d->blankframe);
+                }
+            }
 
-            assRender(dst, a, vsapi, img);
-            vsapi->mapSetInt(vsapi->getFramePropertiesRW(a), "_ColorRange", 0, maReplace);
-            vsapi->mapConsumeFrame(vsapi->getFramePropertiesRW(dst), "_Alpha", a, maAppend);
-            vsapi->freeFrame(d->lastframe);
-            d->lastframe = dst;
+            ctx->lastn = n;
         }
 
-        d->lastn = n;
+        result = vsapi->addFrameRef(ctx->lastframe);
     }
 
-    return vsapi->addFrameRef(d->lastframe);
+    assLock(&d->lock);
+    ctx->next = d->contexts;
+    d->contexts = ctx;
+    assUnlock(&d->lock);
+
+    return result;
 }
 
 static void VS_CC assFree(void *instanceData, VSCore *core, const VSAPI *vsapi)
 {
     AssData *d = (AssData *)instanceData;
+
+    while(d->contexts) {
+        AssContext *next = d->contexts->next;
+        assFreeContext(d->contexts, vsapi);
+        d->contexts = next;
+    }
+
+    assLockDestroy(&d->lock);
     vsapi->freeNode(d->node);
-    vsapi->freeFrame(d->lastframe);
-    ass_renderer_done(d->ass_renderer);
-    ass_library_done(d->ass_library);
-    ass_free_track(d->ass);
+    vsapi->freeFrame(d->blankframe);
+    free(d->file);
+    free(d->style);
+    free(d->charset);
+    free(d->fontdir);
+    free(d->script);
     free(d);
 }
 
@@ -257,10 +470,17 @@ static int frameToTime(int frame, int64_t fpsNum, int64_t fpsDen, char *str, siz
     return 1;
 }
 
+static char *assStrdup(const char *str)
+{
+    char *copy;
 
-char *convertToUtf8(const char *file_name, const char *charset, int64_t *file_size, char *error, size_t error_size);
-ASS_Track *convertToASS(const char *file_name, const char *contents, size_t contents_size, ASS_Library *ass_library, const char *user_style, const char *charset, char *error, size_t error_size);
+    if(!str)
+        return NULL;
 
+    copy = malloc(strlen(str) + 1);
+    strcpy(copy, str);
+    return copy;
+}
 
 static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
                                   VSCore *core, const VSAPI *vsapi)
@@ -274,8 +494,7 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
 #define ERROR_SIZE 512
     char error[ERROR_SIZE] = { 0 };
 
-    d.ass = NULL;
-    d.lastn = -1;
+    d.filter_name = filter_name;
     d.node = vsapi->mapGetNode(in, "clip", 0, 0);
     d.vi[0] = *vsapi->getVideoInfo(d.node);
 
@@ -286,9 +505,7 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
     d.vi[1] = d.vi[0];
     vsapi->getVideoFormatByID(&d.vi[1].format, pfGray8, core);
 
-    d.lastframe = NULL;
-
-    d.file = vsapi->mapGetData(in, "file", 0, &err);
+    d.file = (char *)vsapi->mapGetData(in, "file", 0, &err);
 
     if(err) {
         d.file = NULL;
@@ -315,18 +532,18 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
         }
     }
 
-    d.style = vsapi->mapGetData(in, "style", 0, &err);
+    d.style = (char *)vsapi->mapGetData(in, "style", 0, &err);
 
     if(err && !d.file) {
-        d.style = "sans-serif,20,&H00FFFFFF,&H000000FF,&H00000000,&H00000000,0,0,0,0,100,100,0,0,1,2,0,7,10,10,10,1";
+        d.style = (char *)"sans-serif,20,&H00FFFFFF,&H000000FF,&H00000000,&H00000000,0,0,0,0,100,100,0,0,1,2,0,7,10,10,10,1";
     }
 
-    d.charset = vsapi->mapGetData(in, "charset", 0, &err);
+    d.charset = (char *)vsapi->mapGetData(in, "charset", 0, &err);
 
     if(err)
-        d.charset = "UTF-8";
+        d.charset = (char *)"UTF-8";
 
-    d.fontdir = vsapi->mapGetData(in, "fontdir", 0, &err);
+    d.fontdir = (char *)vsapi->mapGetData(in, "fontdir", 0, &err);
 
     if(err)
         d.fontdir = 0;
@@ -366,49 +583,6 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
         return;
     }
 
-    d.ass_library = ass_library_init();
-
-    if(!d.ass_library) {
-        snprintf(error, ERROR_SIZE, "%s: failed to initialize ASS library", filter_name);
-        vsapi->mapSetError(out, error);
-        vsapi->freeNode(d.node);
-        return;
-    }
-
-    ass_set_message_cb(d.ass_library, assDebugCallback, (void *)d.debuglevel);
-    ass_set_extract_fonts(d.ass_library, 0);
-    ass_set_style_overrides(d.ass_library, 0);
-
-    d.ass_renderer = ass_renderer_init(d.ass_library);
-
-    if(!d.ass_renderer) {
-        snprintf(error, ERROR_SIZE, "%s: failed to initialize ASS renderer", filter_name);
-        vsapi->mapSetError(out, error);
-        vsapi->freeNode(d.node);
-        ass_library_done(d.ass_library);
-        return;
-    }
-
-    ass_set_font_scale(d.ass_renderer, d.scale);
-    ass_set_frame_size(d.ass_renderer, d.vi[0].width, d.vi[0].height);
-    ass_set_margins(d.ass_renderer,
-                    d.margins[0], d.margins[1], d.margins[2], d.margins[3]);
-    ass_set_use_margins(d.ass_renderer, 0);
-
-    if(d.linespacing)
-        ass_set_line_spacing(d.ass_renderer, d.linespacing);
-
-    if(d.sar) {
-        ass_set_pixel_aspect(d.ass_renderer,
-                             (double)d.vi[0].width /
-                             d.vi[0].height * d.sar);
-    }
-
-    if(d.fontdir)
-        ass_set_fonts_dir(d.ass_library, d.fontdir);
-
-    ass_set_fonts(d.ass_renderer, NULL, NULL, 1, NULL, 1);
-
     if(d.file == NULL) {
 #define BUFFER_SIZE 16
         char *str, *text, x[BUFFER_SIZE], y[BUFFER_SIZE], start[BUFFER_SIZE] = { 0 }, end[BUFFER_SIZE] = { 0 };
@@ -432,8 +606,6 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
             snprintf(error, ERROR_SIZE, "%s: Unable to calculate %s time", filter_name, start[0] ? "end" : "start");
             vsapi->mapSetError(out, error);
             vsapi->freeNode(d.node);
-            ass_renderer_done(d.ass_renderer);
-            ass_library_done(d.ass_library);
             return;
         }
 
@@ -447,32 +619,45 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
 
         free(text);
 
-        d.ass = ass_new_track(d.ass_library);
-        ass_process_data(d.ass, str, strlen(str));
-
-        free(str);
+        d.script = str;
+        d.script_size = strlen(str);
     } else {
         snprintf(error, ERROR_SIZE, "%s: ", filter_name);
 
         int64_t contents_size;
-        char *contents = convertToUtf8(d.file, d.charset, &contents_size, error + strlen(error), ERROR_SIZE - strlen(error));
-
-        if (contents) {
-            d.ass = ass_read_memory(d.ass_library, contents, contents_size, NULL);
-
-            if (!d.ass)
-                d.ass = convertToASS(d.file, contents, contents_size, d.ass_library, d.style, d.charset, error + strlen(error), ERROR_SIZE - strlen(error));
+        d.script = convertToUtf8(d.file, d.charset, &contents_size, error + strlen(error), ERROR_SIZE - strlen(error));
 
-            free(contents);
-        }
-
-        if (!contents || !d.ass) {
+        if (!d.script) {
             vsapi->mapSetError(out, error);
             vsapi->freeNode(d.node);
-            ass_renderer_done(d.ass_renderer);
-            ass_library_done(d.ass_library);
             return;
         }
+
+        d.script_size = (size_t)contents_size;
+        error[0] = 0;
+    }
+
+    // the strings from the arguments don't outlive this function but every new context needs them
+    d.text = NULL;
+    d.file = assStrdup(d.file);
+    d.style = assStrdup(d.style);
+    d.charset = assStrdup(d.charset);
+    d.fontdir = assStrdup(d.fontdir);
+    assLockInit(&d.lock);
+
+    // the first context is created here so errors in the script are reported right away
+    d.contexts = assCreateContext(&d, error, ERROR_SIZE);
+
+    if (!d.contexts) {
+        vsapi->mapSetError(out, error);
+        vsapi->freeNode(d.node);
+        assLockDestroy(&d.lock);
+        free(d.file);
+        free(d.style);
+        free(d.charset);
+        free(d.fontdir);
+        free(d.script);
+        return;
     }
 
     VSFrame *frame = vsapi->newVideoFrame(&d.vi[0].format,
@@ -489,16 +674,20 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
         memset(vsapi->getWritePtr(frame, plane), 0, vsapi->getStride(frame, plane) * vsapi->getFrameHeight(frame, plane));
     memset(vsapi->getWritePtr(alpha, 0), 0, vsapi->getStride(alpha, 0) *vsapi->getFrameHeight(alpha, 0));
 
+    int64_t dirty[4] = { 0, 0, 0, 0 };
+    vsapi->mapSetIntArray(vsapi->getFramePropertiesRW(frame), "_DirtyRect", dirty, 4);
+    vsapi->mapSetIntArray(vsapi->getFramePropertiesRW(alpha), "_DirtyRect", dirty, 4);
+    vsapi->mapSetInt(vsapi->getFramePropertiesRW(alpha), "_ColorRange", 0, maReplace);
     vsapi->mapConsumeFrame(vsapi->getFramePropertiesRW(frame), "_Alpha", alpha, maAppend);
 
-    d.lastframe = frame;
+    d.blankframe = frame;
 
     data = malloc(sizeof(d));
     *data = d;
 
     VSFilterDependency deps[] = {{ d.node, rpStrictSpatial }};
     vsapi->createVideoFilter(out, filter_name, d.vi, assGetFrame, assFree,
-                        fmUnordered, deps, 1, data, core);
+                        fmParallel, deps, 1, data, core);
 
     int blend = !!vsapi->mapGetInt(in, "blend", 0, &err);
     if (err)
@@ -19,55 +19,182 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <math.h>
+#include <stdlib.h>
 
 #include "VapourSynth4.h"
 #include "VSHelper4.h"
+#include "vinverse.h"
+
+#ifdef VS_TARGET_CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
 
 struct VinverseData {
     VSNode *node;
     VSVideoInfo vi;
 
-    double sstr;
-    double scl;
-    int amnt;
-
-    int *dlut;
+    VinverseParams params;
+    VinverseLineFunc line;
 };
 typedef struct VinverseData VinverseData;
 
+static void vinverseLine8_c(const void *srcpp_, const void *srcp_, const void *src_, const void *srcn_, const void *srcnn_,
+                            void *dst_, int width, const VinverseParams *p)
+{
+    const uint8_t *srcpp = srcpp_, *srcp = srcp_, *src = src_, *srcn = srcn_, *srcnn = srcnn_;
+    uint8_t *dst = dst_;
+
+    for (int x = 0; x < width; x++)
+        dst[x] = vinversePixel(srcpp[x], srcp[x], src[x], srcn[x], srcnn[x], p);
+}
+
+static void vinverseLine16_c(const void *srcpp_, const void *srcp_, const void *src_, const void *srcn_, const void *srcnn_,
+                             void *dst_, int width, const VinverseParams *p)
+{
+    const uint16_t *srcpp = srcpp_, *srcp = srcp_, *src = src_, *srcn = srcn_, *srcnn = srcnn_;
+    uint16_t *dst = dst_;
+
+    for (int x = 0; x < width; x++)
+        dst[x] = vinversePixel(srcpp[x], srcp[x], src[x], srcn[x], srcnn[x], p);
+}
+
+#ifdef VS_TARGET_CPU_X86
+// The sharpening limit is calculated in double precision like the scalar code so the results are the same.
+static inline __m128i vinverseLimit_sse2(__m128d x, __m128d y, __m128d sstr, __m128d scl)
+{
+    const __m128d absmask = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+    __m128d y2 = _mm_mul_pd(y, sstr);
+    __m128d smaller = _mm_cmplt_pd(_mm_and_pd(x, absmask), _mm_and_pd(y2, absmask));
+    __m128d da = _mm_or_pd(_mm_and_pd(smaller, x), _mm_andnot_pd(smaller, y2));
+    __m128d opposite = _mm_cmplt_pd(_mm_mul_pd(x, y2), _mm_setzero_pd());
+    da = _mm_or_pd(_mm_and_pd(opposite, _mm_mul_pd(da, scl)), _mm_andnot_pd(opposite, da));
+    return _mm_cvttpd_epi32(da);
+}
+
+// four pixels as 32 bit integers
+static inline __m128i vinversePixels_sse2(__m128i pp, __m128i p, __m128i c, __m128i n, __m128i nn, __m128d sstr, __m128d scl, __m128i amnt, __m128i peak)
+{
+    __m128i b3p = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(p, n), _mm_add_epi32(_mm_slli_epi32(c, 1), _mm_set1_epi32(2))), 2);
+    __m128i b6p = _mm_add_epi32(_mm_add_epi32(pp, nn), _mm_slli_epi32(_mm_add_epi32(p, n), 2));
+    b6p = _mm_add_epi32(b6p, _mm_add_epi32(_mm_slli_epi32(c, 2), _mm_slli_epi32(c, 1)));
+    b6p = _mm_srli_epi32(_mm_add_epi32(b6p, _mm_set1_epi32(8)), 4);
+
+    __m128i x = _mm_sub_epi32(c, b3p);
+    __m128i y = _mm_sub_epi32(b3p, b6p);
+    __m128i lo = vinverseLimit_sse2(_mm_cvtepi32_pd(x), _mm_cvtepi32_pd(y), sstr, scl);
+    __m128i hi = vinverseLimit_sse2(_mm_cvtepi32_pd(_mm_srli_si128(x, 8)), _mm_cvtepi32_pd(_mm_srli_si128(y, 8)), sstr, scl);
+    __m128i df = _mm_add_epi32(b3p, _mm_unpacklo_epi64(lo, hi));
+
+    __m128i minm = _mm_sub_epi32(c, amnt);
+    minm = _mm_andnot_si128(_mm_cmpgt_epi32(_mm_setzero_si128(), minm), minm);
+    __m128i maxm = _mm_add_epi32(c, amnt);
+    __m128i over = _mm_cmpgt_epi32(maxm, peak);
+    maxm = _mm_or_si128(_mm_and_si128(over, peak), _mm_andnot_si128(over, maxm));
+
+    __m128i below = _mm_cmpgt_epi32(minm, df);
+    df = _mm_or_si128(_mm_and_si128(below, minm), _mm_andnot_si128(below, df));
+    over = _mm_cmpgt_epi32(df, maxm);
+    return _mm_or_si128(_mm_and_si128(over, maxm), _mm_andnot_si128(over, df));
+}
+
+static void vinverseLine8_sse2(const void *srcpp_, const void *srcp_, const void *src_, const void *srcn_, const void *srcnn_,
+                               void *dst_, int width, const VinverseParams *p)
+{
+    const uint8_t *srcpp = srcpp_, *srcp = srcp_, *src = src_, *srcn = srcn_, *srcnn = srcnn_;
+    uint8_t *dst = dst_;
+    const __m128d sstr = _mm_set1_pd(p->sstr);
+    const __m128d scl = _mm_set1_pd(p->scl);
+    const __m128i amnt = _mm_set1_epi32(p->amnt);
+    const __m128i peak = _mm_set1_epi32(p->peak);
+    const __m128i zero = _mm_setzero_si128();
+    int x;
+
+#define VINVERSE_LOAD8(ptr) _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)((ptr) + x)), zero)
+    for (x = 0; x + 8 <= width; x += 8) {
+        __m128i pp = VINVERSE_LOAD8(srcpp), pr = VINVERSE_LOAD8(srcp), c = VINVERSE_LOAD8(src), n = VINVERSE_LOAD8(srcn), nn = VINVERSE_LOAD8(srcnn);
+        __m128i lo = vinversePixels_sse2(_mm_unpacklo_epi16(pp, zero), _mm_unpacklo_epi16(pr, zero), _mm_unpacklo_epi16(c, zero),
+                                         _mm_unpacklo_epi16(n, zero), _mm_unpacklo_epi16(nn, zero), sstr, scl, amnt, peak);
+        __m128i hi = vinversePixels_sse2(_mm_unpackhi_epi16(pp, zero), _mm_unpackhi_epi16(pr, zero), _mm_unpackhi_epi16(c, zero),
+                                         _mm_unpackhi_epi16(n, zero), _mm_unpackhi_epi16(nn, zero), sstr, scl, amnt, peak);
+        __m128i out = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64((__m128i *)(dst + x), _mm_packus_epi16(out, out));
+    }
+#undef VINVERSE_LOAD8
+
+    for (; x < width; x++)
+        dst[x] = vinversePixel(srcpp[x], srcp[x], src[x], srcn[x], srcnn[x], p);
+}
+
+static void vinverseLine16_sse2(const void *srcpp_, const void *srcp_, const void *src_, const void *srcn_, const void *srcnn_,
+                                void *dst_, int width, const VinverseParams *p)
+{
+    const uint16_t *srcpp = srcpp_, *srcp = srcp_, *src = src_, *srcn = srcn_, *srcnn = srcnn_;
+    uint16_t *dst = dst_;
+    const __m128d sstr = _mm_set1_pd(p->sstr);
+    const __m128d scl = _mm_set1_pd(p->scl);
+    const __m128i amnt = _mm_set1_epi32(p->amnt);
+    const __m128i peak = _mm_set1_epi32(p->peak);
+    const __m128i zero = _mm_setzero_si128();
+    int x;
+
+#define VINVERSE_LOAD16(ptr) _mm_loadu_si128((const __m128i *)((ptr) + x))
+    for (x = 0; x + 8 <= width; x += 8) {
+        __m128i pp = VINVERSE_LOAD16(srcpp), pr = VINVERSE_LOAD16(srcp), c = VINVERSE_LOAD16(src), n = VINVERSE_LOAD16(srcn), nn = VINVERSE_LOAD16(srcnn);
+        __m128i lo = vinversePixels_sse2(_mm_unpacklo_epi16(pp, zero), _mm_unpacklo_epi16(pr, zero), _mm_unpacklo_epi16(c, zero),
+                                         _mm_unpacklo_epi16(n, zero), _mm_unpacklo_epi16(nn, zero), sstr, scl, amnt, peak);
+        __m128i hi = vinversePixels_sse2(_mm_unpackhi_epi16(pp, zero), _mm_unpackhi_epi16(pr, zero), _mm_unpackhi_epi16(c, zero),
+                                         _mm_unpackhi_epi16(n, zero), _mm_unpackhi_epi16(nn, zero), sstr, scl, amnt, peak);
+        // there's no unsigned pack in sse2, so the values are packed with a bias
+        const __m128i bias = _mm_set1_epi32(32768);
+        __m128i out = _mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_xor_si128(out, _mm_set1_epi16((short)0x8000)));
+    }
+#undef VINVERSE_LOAD16
+
+    for (; x < width; x++)
+        dst[x] = vinversePixel(srcpp[x], srcp[x], src[x], srcn[x], srcnn[x], p);
+}
+
+static int hasAVX2(void)
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return 0;
+    __cpuid(regs, 1);
+    // osxsave and avx, the os also has to save the ymm registers
+    if ((regs[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 6) != 6)
+        return 0;
+    __cpuidex(regs, 7, 0);
+    return !!(regs[1] & (1 << 5));
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
 static void Vinverse(const uint8_t *src, uint8_t *dst,
                      int width, int height, ptrdiff_t stride, VinverseData *d)
 {
-    int x, y;
+    int y;
 
     for (y = 0; y < height; y++) {
-        const uint8_t *srcpp = y <  2 ? src + stride * 2 : src - stride * 2;
-        const uint8_t *srcp  = y == 0 ? src + stride     : src - stride;
-        const uint8_t *srcn  = y == height - 1 ? src - stride     : src + stride;
-        const uint8_t *srcnn = y >  height - 3 ? src - stride * 2 : src + stride * 2;
-
-        for (x = 0; x < width; x++) {
-            uint8_t b3p = (srcp[x] + (src[x] << 1) + srcn[x] + 2) >> 2;
-            uint8_t b6p = (srcpp[x] + ((srcp[x] + srcn[x]) << 2) +
-                          src[x] * 6 + srcnn[x] + 8) >> 4;
-
-            int d1 = src[x] - b3p + 255;
-            int d2 = b3p - b6p + 255;
-            int df = b3p + d->dlut[(d1 << 9) + d2];
-
-            int minm = VSMAX(src[x] - d->amnt, 0);
-            int maxm = VSMIN(src[x] + d->amnt, 255);
-
-            if (df <= minm)
-                dst[x] = minm;
-            else if (df >= maxm)
-                dst[x] = maxm;
-            else
-                dst[x] = df;
-        }
+        // the clamping only matters for planes less than 4 lines high
+        const uint8_t *srcpp = src + stride * VSMIN(y <  2 ? y + 2 : y - 2, height - 1);
+        const uint8_t *srcp  = src + stride * VSMIN(y == 0 ? y + 1 : y - 1, height - 1);
+        const uint8_t *srcc  = src + stride * y;
+        const uint8_t *srcn  = src + stride * VSMAX(y == height - 1 ? y - 1 : y + 1, 0);
+        const uint8_t *srcnn = src + stride * VSMAX(y >  height - 3 ? y - 2 : y + 2, 0);
+
+        d->line(srcpp, srcp, srcc, srcn, srcnn, dst, width, &d->params);
 
-        src += stride;
         dst += stride;
     }
 }
@@ -111,7 +238,6 @@ static void VS_CC VinverseFree(void *instanceData,
 {
     VinverseData *d = (VinverseData *)instanceData;
 
-    free(d->dlut);
     vsapi->freeNode(d->node);
     free(d);
 }
@@ -122,7 +248,6 @@ static void VS_CC VinverseCreate(const VSMap *in, VSMap *out, void *userData,
     VinverseData d, *data;
     int err;
 
-    d.dlut = NULL;
     d.node = vsapi->mapGetNode(in, "clip", 0, 0);
     d.vi = *vsapi->getVideoInfo(d.node);
 
@@ -133,49 +258,48 @@ static void VS_CC VinverseCreate(const VSMap *in, VSMap *out, void *userData,
     }
 
     if (d.vi.format.sampleType != stInteger ||
-        d.vi.format.bytesPerSample != 1) {
+        d.vi.format.bitsPerSample > 16) {
 
-        vsapi->mapSetError(out, "Only 8-bit int formats supported");
+        vsapi->mapSetError(out, "Only 8-16 bit int formats supported");
         vsapi->freeNode(d.node);
         return;
     }
 
-    d.sstr = vsapi->mapGetFloat(in, "sstr", 0, &err);
+    d.params.sstr = vsapi->mapGetFloat(in, "sstr", 0, &err);
 
     if (err)
-        d.sstr = 2.7;
+        d.params.sstr = 2.7;
 
-    d.amnt = vsapi->mapGetIntSaturated(in, "amnt", 0, &err);
+    int amnt = vsapi->mapGetIntSaturated(in, "amnt", 0, &err);
 
     if (err)
-        d.amnt = 255;
+        amnt = 255;
 
-    if (d.amnt < 1 || d.amnt > 255) {
+    if (amnt < 1 || amnt > 255) {
         vsapi->mapSetError(out, "amnt must be greater than 0 and less than 256");
         vsapi->freeNode(d.node);
         return;
     }
 
-    d.scl = vsapi->mapGetFloat(in, "scl", 0, &err);
+    d.params.scl = vsapi->mapGetFloat(in, "scl", 0, &err);
 
     if (err)
-        d.scl = 0.25;
-
-    d.dlut = malloc(512 * 511 * sizeof(int));
-
-    if (!d.dlut) {
-        vsapi->mapSetError(out, "malloc failure (dlut)");
-        vsapi->freeNode(d.node);
-        return;
-    }
-
-    for (int x = -255; x <= 255; x++) {
-        for (int y = -255; y <= 255; y++) {
-            double y2 = y * d.sstr;
-            double da = fabs((double)x) < fabs(y2) ? x : y2;
-            d.dlut[((x + 255) << 9) + (y + 255)] = (double)x * y2 < 0.0 ?
-                (int)(da * d.scl) : (int)da;
-        }
+        d.params.scl = 0.25;
+
+    // amnt is always given in the 8 bit range
+    d.params.peak = (1 << d.vi.format.bitsPerSample) - 1;
+    d.params.amnt = (amnt * d.params.peak + 127) / 255;
+
+    if (d.vi.format.bytesPerSample == 1) {
+        d.line = vinverseLine8_c;
+#ifdef VS_TARGET_CPU_X86
+        d.line = hasAVX2() ? vinverseLine8_avx2 : vinverseLine8_sse2;
+#endif
+    } else {
+        d.line = vinverseLine16_c;
+#ifdef VS_TARGET_CPU_X86
+        d.line = hasAVX2() ? vinverseLine16_avx2 : vinverseLine16_sse2;
+#endif
     }
 
     data = malloc(sizeof(d));
@@ -0,0 +1,69 @@
+/*
+ * Vinverse line kernels shared by the scalar and SIMD implementations.
+ *
+ * Copyright (C) 2006 Kevin Stone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VINVERSE_H
+#define VINVERSE_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "VSHelper4.h"
+
+typedef struct VinverseParams {
+    double sstr;
+    double scl;
+    int amnt; // already scaled to the bit depth
+    int peak;
+} VinverseParams;
+
+// Filters one line from the two lines above and below it, srcpp to srcnn are already mirrored at the edges.
+typedef void (*VinverseLineFunc)(const void *srcpp, const void *srcp, const void *src, const void *srcn, const void *srcnn,
+                                 void *dst, int width, const VinverseParams *p);
+
+#ifdef VS_TARGET_CPU_X86
+void vinverseLine8_avx2(const void *srcpp, const void *srcp, const void *src, const void *srcn, const void *srcnn,
+                        void *dst, int width, const VinverseParams *p);
+void vinverseLine16_avx2(const void *srcpp, const void *srcp, const void *src, const void *srcn, const void *srcnn,
+                         void *dst, int width, const VinverseParams *p);
+#endif
+
+// the scalar reference for a single pixel, the SIMD versions must produce the same values
+static inline int vinversePixel(int pp, int p, int c, int n, int nn, const VinverseParams *d)
+{
+    int b3p = (p + (c << 1) + n + 2) >> 2;
+    int b6p = (pp + ((p + n) << 2) + c * 6 + nn + 8) >> 4;
+
+    int x = c - b3p;
+    double y2 = (b3p - b6p) * d->sstr;
+    double da = fabs((double)x) < fabs(y2) ? x : y2;
+    int df = b3p + ((double)x * y2 < 0.0 ? (int)(da * d->scl) : (int)da);
+
+    int minm = VSMAX(c - d->amnt, 0);
+    int maxm = VSMIN(c + d->amnt, d->peak);
+
+    if (df <= minm)
+        return minm;
+    else if (df >= maxm)
+        return maxm;
+    else
+        return df;
+}
+
+#endif
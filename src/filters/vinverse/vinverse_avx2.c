@@ -0,0 +1,96 @@
+/*
+ * AVX2 versions of the Vinverse line filter, eight pixels are processed at a
+ * time as 32 bit integers and produce the same results as the scalar code.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <immintrin.h>
+
+#include "vinverse.h"
+
+// the sharpening limit in double precision, like the scalar code
+static inline __m128i limit(__m128i x, __m128i y, __m256d sstr, __m256d scl)
+{
+    const __m256d absmask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+    const __m256d xd = _mm256_cvtepi32_pd(x);
+    const __m256d y2 = _mm256_mul_pd(_mm256_cvtepi32_pd(y), sstr);
+    const __m256d smaller = _mm256_cmp_pd(_mm256_and_pd(xd, absmask), _mm256_and_pd(y2, absmask), _CMP_LT_OQ);
+    __m256d da = _mm256_blendv_pd(y2, xd, smaller);
+    const __m256d opposite = _mm256_cmp_pd(_mm256_mul_pd(xd, y2), _mm256_setzero_pd(), _CMP_LT_OQ);
+    da = _mm256_blendv_pd(da, _mm256_mul_pd(da, scl), opposite);
+    return _mm256_cvttpd_epi32(da);
+}
+
+static inline __m128i pixels(__m256i pp, __m256i p, __m256i c, __m256i n, __m256i nn, __m256d sstr, __m256d scl, __m256i amnt, __m256i peak)
+{
+    const __m256i b3p = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(p, n), _mm256_add_epi32(_mm256_slli_epi32(c, 1), _mm256_set1_epi32(2))), 2);
+    __m256i b6p = _mm256_add_epi32(_mm256_add_epi32(pp, nn), _mm256_slli_epi32(_mm256_add_epi32(p, n), 2));
+    b6p = _mm256_add_epi32(b6p, _mm256_mullo_epi32(c, _mm256_set1_epi32(6)));
+    b6p = _mm256_srli_epi32(_mm256_add_epi32(b6p, _mm256_set1_epi32(8)), 4);
+
+    const __m256i x = _mm256_sub_epi32(c, b3p);
+    const __m256i y = _mm256_sub_epi32(b3p, b6p);
+    const __m128i lo = limit(_mm256_castsi256_si128(x), _mm256_castsi256_si128(y), sstr, scl);
+    const __m128i hi = limit(_mm256_extracti128_si256(x, 1), _mm256_extracti128_si256(y, 1), sstr, scl);
+    __m256i df = _mm256_add_epi32(b3p, _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1));
+
+    const __m256i minm = _mm256_max_epi32(_mm256_sub_epi32(c, amnt), _mm256_setzero_si256());
+    const __m256i maxm = _mm256_min_epi32(_mm256_add_epi32(c, amnt), peak);
+    df = _mm256_min_epi32(_mm256_max_epi32(df, minm), maxm);
+
+    return _mm_packus_epi32(_mm256_castsi256_si128(df), _mm256_extracti128_si256(df, 1));
+}
+
+void vinverseLine8_avx2(const void *srcpp_, const void *srcp_, const void *src_, const void *srcn_, const void *srcnn_,
+                        void *dst_, int width, const VinverseParams *p)
+{
+    const uint8_t *srcpp = srcpp_, *srcp = srcp_, *src = src_, *srcn = srcn_, *srcnn = srcnn_;
+    uint8_t *dst = dst_;
+    const __m256d sstr = _mm256_set1_pd(p->sstr);
+    const __m256d scl = _mm256_set1_pd(p->scl);
+    const __m256i amnt = _mm256_set1_epi32(p->amnt);
+    const __m256i peak = _mm256_set1_epi32(p->peak);
+    int x;
+
+#define LOAD(ptr) _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)((ptr) + x)))
+    for (x = 0; x + 8 <= width; x += 8) {
+        const __m128i out = pixels(LOAD(srcpp), LOAD(srcp), LOAD(src), LOAD(srcn), LOAD(srcnn), sstr, scl, amnt, peak);
+        _mm_storel_epi64((__m128i *)(dst + x), _mm_packus_epi16(out, out));
+    }
+#undef LOAD
+
+    for (; x < width; x++)
+        dst[x] = vinversePixel(srcpp[x], srcp[x], src[x], srcn[x], srcnn[x], p);
+}
+
+void vinverseLine16_avx2(const void *srcpp_, const void *srcp_, const void *src_, const void *srcn_, const void *srcnn_,
+                         void *dst_, int width, const VinverseParams *p)
+{
+    const uint16_t *srcpp = srcpp_, *srcp = srcp_, *src = src_, *srcn = srcn_, *srcnn = srcnn_;
+    uint16_t *dst = dst_;
+    const __m256d sstr = _mm256_set1_pd(p->sstr);
+    const __m256d scl = _mm256_set1_pd(p->scl);
+    const __m256i amnt = _mm256_set1_epi32(p->amnt);
+    const __m256i peak = _mm256_set1_epi32(p->peak);
+    int x;
+
+#define LOAD(ptr) _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)((ptr) + x)))
+    for (x = 0; x + 8 <= width; x += 8)
+        _mm_storeu_si128((__m128i *)(dst + x), pixels(LOAD(srcpp), LOAD(srcp), LOAD(src), LOAD(srcn), LOAD(srcnn), sstr, scl, amnt, peak));
+#undef LOAD
+
+    for (; x < width; x++)
+        dst[x] = vinversePixel(srcpp[x], srcp[x], src[x], srcn[x], srcnn[x], p);
+}
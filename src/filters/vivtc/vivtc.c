@@ -28,6 +28,11 @@
 #include <stddef.h>
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#ifdef VS_TARGET_CPU_X86
+#include <emmintrin.h>
 #endif
 #include "VapourSynth4.h"
 #include "VSHelper4.h"
@@ -41,6 +46,70 @@ static int isPowerOf2(int i) {
 
 // VFM
 
+// Match metrics are pure functions of the input frames so they're remembered between calls. The
+// mics are keyed by the frames the two fields of the weave come from, which lets neighbouring
+// frames share them, and the field comparisons by the frame and the two matches compared.
+#define VFMCacheSize 256
+
+typedef struct {
+    int frame;
+    int key;
+    int value;
+} VFMCacheEntry;
+
+#ifdef _WIN32
+typedef SRWLOCK VFMLock;
+
+static void vfmLockInit(VFMLock *lock) { InitializeSRWLock(lock); }
+static void vfmLockDestroy(VFMLock *lock) { (void)lock; }
+static void vfmLock(VFMLock *lock) { AcquireSRWLockExclusive(lock); }
+static void vfmUnlock(VFMLock *lock) { ReleaseSRWLockExclusive(lock); }
+#else
+typedef pthread_mutex_t VFMLock;
+
+static void vfmLockInit(VFMLock *lock) { pthread_mutex_init(lock, NULL); }
+static void vfmLockDestroy(VFMLock *lock) { pthread_mutex_destroy(lock); }
+static void vfmLock(VFMLock *lock) { pthread_mutex_lock(lock); }
+static void vfmUnlock(VFMLock *lock) { pthread_mutex_unlock(lock); }
+#endif
+
+typedef struct {
+    VFMCacheEntry mics[VFMCacheSize];
+    VFMCacheEntry compares[VFMCacheSize];
+    VFMLock lock;
+} VFMCache;
+
+static void vfmInitCache(VFMCache *cache) {
+    int i;
+    for (i = 0; i < VFMCacheSize; i++)
+        cache->mics[i].frame = cache->compares[i].frame = -1;
+    vfmLockInit(&cache->lock);
+}
+
+static VFMCacheEntry *vfmCacheEntry(VFMCacheEntry *entries, int frame, int key) {
+    return &entries[((unsigned)frame * 5 + (unsigned)key) % VFMCacheSize];
+}
+
+// returns -1 if the value isn't cached
+static int vfmCacheLookup(VFMCache *cache, VFMCacheEntry *entries, int frame, int key) {
+    int value = -1;
+    vfmLock(&cache->lock);
+    const VFMCacheEntry *entry = vfmCacheEntry(entries, frame, key);
+    if (entry->frame == frame && entry->key == key)
+        value = entry->value;
+    vfmUnlock(&cache->lock);
+    return value;
+}
+
+static void vfmCacheStore(VFMCache *cache, VFMCacheEntry *entries, int frame, int key, int value) {
+    vfmLock(&cache->lock);
+    VFMCacheEntry *entry = vfmCacheEntry(entries, frame, key);
+    entry->frame = frame;
+    entry->key = key;
+    entry->value = value;
+    vfmUnlock(&cache->lock);
+}
+
 typedef struct {
     VSNode *node;
     VSNode *clip2;
@@ -61,6 +130,7 @@ typedef struct {
     int y1;
     int micmatch;
     int micout;
+    VFMCache *cache;
 } VFMData;
 
 
@@ -81,7 +151,15 @@ static void buildABSDiffMask(const uint8_t *prvp, const uint8_t *nxtp,
 
     int y, x;
     for (y=0; y<height; ++y) {
-        for (x=0; x<width; x++)
+        x = 0;
+#ifdef VS_TARGET_CPU_X86
+        for (; x + 16 <= width; x += 16) {
+            const __m128i p = _mm_loadu_si128((const __m128i *)(prvp + x));
+            const __m128i n = _mm_loadu_si128((const __m128i *)(nxtp + x));
+            _mm_storeu_si128((__m128i *)(tbuffer + x), _mm_or_si128(_mm_subs_epu8(p, n), _mm_subs_epu8(n, p)));
+        }
+#endif
+        for (; x<width; x++)
             tbuffer[x] = abs(prvp[x]-nxtp[x]);
 
         prvp += src_pitch;
@@ -90,6 +168,91 @@ static void buildABSDiffMask(const uint8_t *prvp, const uint8_t *nxtp,
     }
 }
 
+#ifdef VS_TARGET_CPU_X86
+// the comb test of calcMI for a line with two lines above and below it, returns the first x left to do
+static int combLineSSE2(const uint8_t *srcp, ptrdiff_t src_pitch, uint8_t *cmkp, int width, int cthresh) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i thresh = _mm_set1_epi16(cthresh);
+    const __m128i threshn = _mm_set1_epi16(-cthresh);
+    const __m128i thresh6 = _mm_set1_epi16(cthresh*6);
+    int x, i;
+    for (x=0; x + 16 <= width; x += 16) {
+        const __m128i pp8 = _mm_loadu_si128((const __m128i *)(srcp + x - 2*src_pitch));
+        const __m128i p8 = _mm_loadu_si128((const __m128i *)(srcp + x - src_pitch));
+        const __m128i c8 = _mm_loadu_si128((const __m128i *)(srcp + x));
+        const __m128i n8 = _mm_loadu_si128((const __m128i *)(srcp + x + src_pitch));
+        const __m128i nn8 = _mm_loadu_si128((const __m128i *)(srcp + x + 2*src_pitch));
+        __m128i combed[2];
+        for (i=0; i<2; i++) {
+            const __m128i pp = i ? _mm_unpackhi_epi8(pp8, zero) : _mm_unpacklo_epi8(pp8, zero);
+            const __m128i p = i ? _mm_unpackhi_epi8(p8, zero) : _mm_unpacklo_epi8(p8, zero);
+            const __m128i c = i ? _mm_unpackhi_epi8(c8, zero) : _mm_unpacklo_epi8(c8, zero);
+            const __m128i n = i ? _mm_unpackhi_epi8(n8, zero) : _mm_unpacklo_epi8(n8, zero);
+            const __m128i nn = i ? _mm_unpackhi_epi8(nn8, zero) : _mm_unpacklo_epi8(nn8, zero);
+            const __m128i sFirst = _mm_sub_epi16(c, p);
+            const __m128i sSecond = _mm_sub_epi16(c, n);
+            const __m128i above = _mm_and_si128(_mm_cmpgt_epi16(sFirst, thresh), _mm_cmpgt_epi16(sSecond, thresh));
+            const __m128i below = _mm_and_si128(_mm_cmplt_epi16(sFirst, threshn), _mm_cmplt_epi16(sSecond, threshn));
+            const __m128i pn = _mm_add_epi16(p, n);
+            const __m128i diff = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(pp, nn), _mm_slli_epi16(c, 2)), _mm_add_epi16(pn, _mm_add_epi16(pn, pn)));
+            const __m128i absdiff = _mm_max_epi16(diff, _mm_sub_epi16(zero, diff));
+            combed[i] = _mm_and_si128(_mm_or_si128(above, below), _mm_cmpgt_epi16(absdiff, thresh6));
+        }
+        _mm_storeu_si128((__m128i *)(cmkp + x), _mm_packs_epi16(combed[0], combed[1]));
+    }
+    return x;
+}
+#endif
+
+// adds the pixels that are combed in all 3 lines to the column sums for the given number of lines
+static void addCombedColumns(const uint8_t *cmkpp, const uint8_t *cmkp, const uint8_t *cmkpn, ptrdiff_t cmk_pitch,
+    uint16_t *colSums, int width, int lines) {
+    int x, u;
+    for (u=0; u<lines; ++u) {
+        x = 0;
+#ifdef VS_TARGET_CPU_X86
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i ff = _mm_set1_epi8(-1);
+            const __m128i one = _mm_set1_epi8(1);
+            for (; x + 16 <= width; x += 16) {
+                __m128i m = _mm_and_si128(_mm_loadu_si128((const __m128i *)(cmkpp + x)), _mm_loadu_si128((const __m128i *)(cmkp + x)));
+                m = _mm_and_si128(m, _mm_loadu_si128((const __m128i *)(cmkpn + x)));
+                m = _mm_and_si128(_mm_cmpeq_epi8(m, ff), one);
+                _mm_storeu_si128((__m128i *)(colSums + x), _mm_add_epi16(_mm_loadu_si128((const __m128i *)(colSums + x)), _mm_unpacklo_epi8(m, zero)));
+                _mm_storeu_si128((__m128i *)(colSums + x + 8), _mm_add_epi16(_mm_loadu_si128((const __m128i *)(colSums + x + 8)), _mm_unpackhi_epi8(m, zero)));
+            }
+        }
+#endif
+        for (; x<width; ++x) {
+            if (cmkpp[x] == 0xFF && cmkp[x] == 0xFF && cmkpn[x] == 0xFF)
+                ++colSums[x];
+        }
+        cmkpp += cmk_pitch;
+        cmkp += cmk_pitch;
+        cmkpn += cmk_pitch;
+    }
+}
+
+// all columns of a half block fall into the same 4 overlapping blocks so they're added together
+static void addCombedBlocks(const uint16_t *colSums, int *cArray, int temp1, int temp2, int width, int blockx) {
+    const int xhalf = blockx/2;
+    int x, v;
+    for (x=0; x<width; x+=xhalf) {
+        const int stop = VSMIN(x+xhalf, width);
+        int sum = 0;
+        for (v=x; v<stop; ++v)
+            sum += colSums[v];
+        if (sum) {
+            const int box1 = (x/blockx)*4;
+            const int box2 = ((x+xhalf)/blockx)*4;
+            cArray[temp1+box1+0] += sum;
+            cArray[temp1+box2+1] += sum;
+            cArray[temp2+box1+2] += sum;
+            cArray[temp2+box2+3] += sum;
+        }
+    }
+}
 
 static int calcMI(const VSFrame *src, const VSAPI *vsapi,
     int *blockN, int chroma, int cthresh, VSFrame *cmask, int *cArray, int blockx, int blocky)
@@ -97,7 +260,7 @@ static int calcMI(const VSFrame *src, const VSAPI *vsapi,
     int ret = 0;
     const int cthresh6 = cthresh*6;
     int plane;
-    int x, y, u, v;
+    int x, y;
     for (plane=0; plane < (chroma ? 3 : 1); plane++) {
         const uint8_t *srcp = vsapi->getReadPtr(src, plane);
         const ptrdiff_t src_pitch = vsapi->getStride(src, plane);
@@ -131,7 +294,12 @@ static int calcMI(const VSFrame *src, const VSAPI *vsapi,
         cmkp += cmk_pitch;
 
         for (y=2; y<Height-2; ++y) {
-            for (x=0; x<Width; ++x) {
+#ifdef VS_TARGET_CPU_X86
+            x = combLineSSE2(srcp, src_pitch, cmkp, Width, cthresh);
+#else
+            x = 0;
+#endif
+            for (; x<Width; ++x) {
                 const int sFirst = srcp[x] - srcp[x - src_pitch];
                 const int sSecond = srcp[x] - srcp[x + src_pitch];
                 if ((sFirst > cthresh && sSecond > cthresh) || (sFirst < -cthresh && sSecond < -cthresh)) {
@@ -235,23 +403,16 @@ static int calcMI(const VSFrame *src, const VSAPI *vsapi,
     const int yblocks = ((Height+yhalf)/blocky) + 1;
     const int arraysize = (xblocks*yblocks)<<2;
     int Heighta = (Height/(blocky/2))*(blocky/2);
-    const int Widtha = (Width/(blockx/2))*(blockx/2);
     if (Heighta == Height)
         Heighta = Height-yhalf;
+    uint16_t *colSums = (uint16_t *)malloc(Width*sizeof(uint16_t));
     memset(&cArray[0],0,arraysize*sizeof(int));
     for (y=1; y<yhalf; ++y) {
         const int temp1 = (y/blocky)*xblocks4;
         const int temp2 = ((y+yhalf)/blocky)*xblocks4;
-        for (x=0; x<Width; ++x) {
-            if (cmkpp[x] == 0xFF && cmkp[x] == 0xFF && cmkpn[x] == 0xFF) {
-                const int box1 = (x/blockx)*4;
-                const int box2 = ((x+xhalf)/blockx)*4;
-                ++cArray[temp1+box1+0];
-                ++cArray[temp1+box2+1];
-                ++cArray[temp2+box1+2];
-                ++cArray[temp2+box2+3];
-            }
-        }
+        memset(colSums,0,Width*sizeof(uint16_t));
+        addCombedColumns(cmkpp, cmkp, cmkpn, cmk_pitch, colSums, Width, 1);
+        addCombedBlocks(colSums, cArray, temp1, temp2, Width, blockx);
         cmkpp += cmk_pitch;
         cmkp += cmk_pitch;
         cmkpn += cmk_pitch;
@@ -259,52 +420,9 @@ static int calcMI(const VSFrame *src, const VSAPI *vsapi,
     for (y=yhalf; y<Heighta; y+=yhalf) {
         const int temp1 = (y/blocky)*xblocks4;
         const int temp2 = ((y+yhalf)/blocky)*xblocks4;
-
-        for (x=0; x<Widtha; x+=xhalf) {
-            const uint8_t *cmkppT = cmkpp;
-            const uint8_t *cmkpT = cmkp;
-            const uint8_t *cmkpnT = cmkpn;
-            int sum = 0;
-            for (u=0; u<yhalf; ++u) {
-                for (v=0; v<xhalf; ++v) {
-                    if (cmkppT[x+v] == 0xFF && cmkpT[x+v] == 0xFF &&
-                        cmkpnT[x+v] == 0xFF) ++sum;
-                }
-                cmkppT += cmk_pitch;
-                cmkpT += cmk_pitch;
-                cmkpnT += cmk_pitch;
-            }
-            if (sum) {
-                const int box1 = (x/blockx)*4;
-                const int box2 = ((x+xhalf)/blockx)*4;
-                cArray[temp1+box1+0] += sum;
-                cArray[temp1+box2+1] += sum;
-                cArray[temp2+box1+2] += sum;
-                cArray[temp2+box2+3] += sum;
-            }
-        }
-
-        for (x=Widtha; x<Width; ++x) {
-            const uint8_t *cmkppT = cmkpp;
-            const uint8_t *cmkpT = cmkp;
-            const uint8_t *cmkpnT = cmkpn;
-            int sum = 0;
-            for (u=0; u<yhalf; ++u) {
-                if (cmkppT[x] == 0xFF && cmkpT[x] == 0xFF &&
-                    cmkpnT[x] == 0xFF) ++sum;
-                cmkppT += cmk_pitch;
-                cmkpT += cmk_pitch;
-                cmkpnT += cmk_pitch;
-            }
-            if (sum) {
-                const int box1 = (x/blockx)*4;
-                const int box2 = ((x+xhalf)/blockx)*4;
-                cArray[temp1+box1+0] += sum;
-                cArray[temp1+box2+1] += sum;
-                cArray[temp2+box1+2] += sum;
-                cArray[temp2+box2+3] += sum;
-            }
-        }
+        memset(colSums,0,Width*sizeof(uint16_t));
+        addCombedColumns(cmkpp, cmkp, cmkpn, cmk_pitch, colSums, Width, yhalf);
+        addCombedBlocks(colSums, cArray, temp1, temp2, Width, blockx);
         cmkpp += cmk_pitch*yhalf;
         cmkp += cmk_pitch*yhalf;
         cmkpn += cmk_pitch*yhalf;
@@ -312,20 +430,14 @@ static int calcMI(const VSFrame *src, const VSAPI *vsapi,
     for (y=Heighta; y<Height-1; ++y) {
         const int temp1 = (y/blocky)*xblocks4;
         const int temp2 = ((y+yhalf)/blocky)*xblocks4;
-        for (x=0; x<Width; ++x) {
-            if (cmkpp[x] == 0xFF && cmkp[x] == 0xFF && cmkpn[x] == 0xFF) {
-                const int box1 = (x/blockx)*4;
-                const int box2 = ((x+xhalf)/blockx)*4;
-                ++cArray[temp1+box1+0];
-                ++cArray[temp1+box2+1];
-                ++cArray[temp2+box1+2];
-                ++cArray[temp2+box2+3];
-            }
-        }
+        memset(colSums,0,Width*sizeof(uint16_t));
+        addCombedColumns(cmkpp, cmkp, cmkpn, cmk_pitch, colSums, Width, 1);
+        addCombedBlocks(colSums, cArray, temp1, temp2, Width, blockx);
         cmkpp += cmk_pitch;
         cmkp += cmk_pitch;
         cmkpn += cmk_pitch;
     }
+    free(colSums);
     for (x=0; x<arraysize; ++x) {
         if (cArray[x] > ret) {
             ret = cArray[x];
@@ -349,8 +461,21 @@ static void buildDiffMap(const uint8_t *prvp, const uint8_t *nxtp,
     buildABSDiffMask(prvp-src_pitch, nxtp-src_pitch, src_pitch,
         tpitch, tbuffer, Width, Height>>1, vsapi);
 
+#ifdef VS_TARGET_CPU_X86
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i three = _mm_set1_epi8(3);
+#endif
+
     for (y=2; y<Height-2; y+=2) {
         for (x=1; x<Width-1; ++x) {
+#ifdef VS_TARGET_CPU_X86
+            // nothing is done for pixels with a difference of 3 or less so skip whole vectors of them
+            while (x + 16 <= Width-1 &&
+                _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(_mm_loadu_si128((const __m128i *)(dp + x)), three), zero)) == 0xFFFF)
+                x += 16;
+            if (x >= Width-1)
+                break;
+#endif
             diff = dp[x];
             if (diff > 3) {
                 for (count=0,u=x-1; u<x+2 && count<2; ++u) {
@@ -398,6 +523,67 @@ static void buildDiffMap(const uint8_t *prvp, const uint8_t *nxtp,
     }
 }
 
+#ifdef VS_TARGET_CPU_X86
+static unsigned long hsumEpi32(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (unsigned)_mm_cvtsi128_si32(v);
+}
+
+// the accumulation of compareFieldsSlow for one line, accum is Pc, Nc, Pm, Nm, Pml, Nml, returns the first x left to do
+static int compareFieldsLineSSE2(const uint8_t *mapp, ptrdiff_t map_pitch, const uint8_t *prvpf, const uint8_t *prvnf,
+    const uint8_t *curpf, const uint8_t *curf, const uint8_t *curnf, const uint8_t *nxtpf, const uint8_t *nxtnf,
+    int startx, int stopx, unsigned long *accum) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i bit1 = _mm_set1_epi16(1);
+    const __m128i bit2 = _mm_set1_epi16(2);
+    const __m128i bit4 = _mm_set1_epi16(4);
+    const __m128i t23 = _mm_set1_epi16(23);
+    const __m128i t42 = _mm_set1_epi16(42);
+    __m128i acc[6];
+    int x, i, k;
+    for (k=0; k<6; k++)
+        acc[k] = zero;
+    for (x=startx; x + 16 <= stopx; x += 16) {
+        const __m128i m8 = _mm_or_si128(_mm_loadu_si128((const __m128i *)(mapp + x)), _mm_loadu_si128((const __m128i *)(mapp + x + map_pitch)));
+        const __m128i ppf8 = _mm_loadu_si128((const __m128i *)(prvpf + x));
+        const __m128i pnf8 = _mm_loadu_si128((const __m128i *)(prvnf + x));
+        const __m128i cpf8 = _mm_loadu_si128((const __m128i *)(curpf + x));
+        const __m128i cf8 = _mm_loadu_si128((const __m128i *)(curf + x));
+        const __m128i cnf8 = _mm_loadu_si128((const __m128i *)(curnf + x));
+        const __m128i npf8 = _mm_loadu_si128((const __m128i *)(nxtpf + x));
+        const __m128i nnf8 = _mm_loadu_si128((const __m128i *)(nxtnf + x));
+        for (i=0; i<2; i++) {
+            const __m128i m = i ? _mm_unpackhi_epi8(m8, zero) : _mm_unpacklo_epi8(m8, zero);
+            const __m128i has1 = _mm_cmpeq_epi16(_mm_and_si128(m, bit1), bit1);
+            const __m128i has2 = _mm_cmpeq_epi16(_mm_and_si128(m, bit2), bit2);
+            const __m128i has4 = _mm_cmpeq_epi16(_mm_and_si128(m, bit4), bit4);
+            const __m128i cpf = i ? _mm_unpackhi_epi8(cpf8, zero) : _mm_unpacklo_epi8(cpf8, zero);
+            const __m128i cf = i ? _mm_unpackhi_epi8(cf8, zero) : _mm_unpacklo_epi8(cf8, zero);
+            const __m128i cnf = i ? _mm_unpackhi_epi8(cnf8, zero) : _mm_unpacklo_epi8(cnf8, zero);
+            const __m128i temp1 = _mm_add_epi16(_mm_add_epi16(cpf, cnf), _mm_slli_epi16(cf, 2));
+            for (k=0; k<2; k++) {
+                const __m128i pf8 = k ? npf8 : ppf8;
+                const __m128i nf8 = k ? nnf8 : pnf8;
+                const __m128i pf = i ? _mm_unpackhi_epi8(pf8, zero) : _mm_unpacklo_epi8(pf8, zero);
+                const __m128i nf = i ? _mm_unpackhi_epi8(nf8, zero) : _mm_unpacklo_epi8(nf8, zero);
+                const __m128i sum = _mm_add_epi16(pf, nf);
+                const __m128i diff = _mm_sub_epi16(_mm_add_epi16(sum, _mm_add_epi16(sum, sum)), temp1);
+                const __m128i temp2 = _mm_max_epi16(diff, _mm_sub_epi16(zero, diff));
+                const __m128i over42 = _mm_cmpgt_epi16(temp2, t42);
+                acc[k] = _mm_add_epi32(acc[k], _mm_madd_epi16(_mm_and_si128(temp2, _mm_and_si128(has1, _mm_cmpgt_epi16(temp2, t23))), ones));
+                acc[k+2] = _mm_add_epi32(acc[k+2], _mm_madd_epi16(_mm_and_si128(temp2, _mm_and_si128(has2, over42)), ones));
+                acc[k+4] = _mm_add_epi32(acc[k+4], _mm_madd_epi16(_mm_and_si128(temp2, _mm_and_si128(has4, over42)), ones));
+            }
+        }
+    }
+    for (k=0; k<6; k++)
+        accum[k] += hsumEpi32(acc[k]);
+    return x;
+}
+#endif
+
 static int compareFieldsSlow(const VSFrame *prv, const VSFrame *src, const VSFrame *nxt, VSFrame *map, int match1,
     int match2, int mchroma, int field, int y0, int y1, uint8_t *tbuffer, int tpitchy, int tpitchuv, const VSAPI *vsapi)
 {
@@ -485,7 +671,19 @@ static int compareFieldsSlow(const VSFrame *prv, const VSFrame *src, const VSFra
 
         for (y=2; y<Height-2; y+=2) {
             if (y0a == y1a || y < y0a || y > y1a) {
-                for (x=startx; x<stopx; x++) {
+#ifdef VS_TARGET_CPU_X86
+                unsigned long accum[6] = { 0, 0, 0, 0, 0, 0 };
+                x = compareFieldsLineSSE2(mapp, map_pitch, prvpf, prvnf, curpf, curf, curnf, nxtpf, nxtnf, startx, stopx, accum);
+                accumPc += accum[0];
+                accumNc += accum[1];
+                accumPm += accum[2];
+                accumNm += accum[3];
+                accumPml += accum[4];
+                accumNml += accum[5];
+#else
+                x = startx;
+#endif
+                for (; x<stopx; x++) {
                     if (mapp[x] > 0 || mapp[x + map_pitch] > 0) {
                         temp1 = curpf[x]+(curf[x]<<2)+curnf[x];
                         temp2 = abs(3*(prvpf[x]+prvnf[x])-temp1);
@@ -582,18 +780,26 @@ static const VSFrame *createWeaveFrame(const VSFrame *prv, const VSFrame *src,
 }
 
 
-static int checkmm(int m1, int m2, int *m1mic, int *m2mic, int *blockN, int MI, int field, int chroma, int cthresh, const VSFrame **genFrames,
+static int checkmm(int m1, int m2, int *m1mic, int *m2mic, const int *cachedMics, int *blockN, int MI, int field, int chroma, int cthresh, const VSFrame **genFrames,
     const VSFrame *prv, const VSFrame *src, const VSFrame *nxt, VSFrame *cmask, int *cArray, int blockx, int blocky, const VSAPI *vsapi, VSCore *core) {
     if (*m1mic < 0) {
-        if (!genFrames[m1])
-            genFrames[m1] = createWeaveFrame(prv, src, nxt, vsapi, core, m1, field);
-        *m1mic = calcMI(genFrames[m1], vsapi, blockN, chroma, cthresh, cmask, cArray, blockx, blocky);
+        if (cachedMics[m1] >= 0) {
+            *m1mic = cachedMics[m1];
+        } else {
+            if (!genFrames[m1])
+                genFrames[m1] = createWeaveFrame(prv, src, nxt, vsapi, core, m1, field);
+            *m1mic = calcMI(genFrames[m1], vsapi, blockN, chroma, cthresh, cmask, cArray, blockx, blocky);
+        }
     }
 
     if (*m2mic < 0) {
-        if (!genFrames[m2])
-            genFrames[m2] = createWeaveFrame(prv, src, nxt, vsapi, core, m2, field);
-        *m2mic = calcMI(genFrames[m2], vsapi, blockN, chroma, cthresh, cmask, cArray, blockx, blocky);
+        if (cachedMics[m2] >= 0) {
+            *m2mic = cachedMics[m2];
+        } else {
+            if (!genFrames[m2])
+                genFrames[m2] = createWeaveFrame(prv, src, nxt, vsapi, core, m2, field);
+            *m2mic = calcMI(genFrames[m2], vsapi, blockN, chroma, cthresh, cmask, cArray, blockx, blocky);
+        }
     }
 
     if (((*m2mic)*3 < *m1mic || ((*m2mic)*2 < *m1mic && *m1mic > MI)) &&
@@ -603,6 +809,25 @@ static int checkmm(int m1, int m2, int *m1mic, int *m2mic, int *blockN, int MI,
         return m1;
 }
 
+// the cache key of a weave is the frame its field comes from plus where the other field comes from
+static int vfmMicKey(int match, int n, int prvn, int nxtn, int field, int *frame) {
+    const int fieldFrames[] = { prvn, n, nxtn, n, n };
+    const int otherFrames[] = { n, n, n, prvn, nxtn };
+    *frame = fieldFrames[match];
+    return field*3 + otherFrames[match] - fieldFrames[match] + 1;
+}
+
+static int vfmCompareFields(const VFMData *vfm, int n, const VSFrame *prv, const VSFrame *src, const VSFrame *nxt, VSFrame *map,
+    int match1, int match2, int field, uint8_t *tbuffer, const VSAPI *vsapi) {
+    const int key = field*25 + match1*5 + match2;
+    int match = vfmCacheLookup(vfm->cache, vfm->cache->compares, n, key);
+    if (match < 0) {
+        match = compareFieldsSlow(prv, src, nxt, map, match1, match2, vfm->mchroma, field, vfm->y0, vfm->y1, tbuffer, vfm->tpitchy, vfm->tpitchuv, vsapi);
+        vfmCacheStore(vfm->cache, vfm->cache->compares, n, key, match);
+    }
+    return match;
+}
+
 typedef enum {
     mP = 0,
     mC = 1,
@@ -641,10 +866,15 @@ static const VSFrame *VS_CC vfmGetFrame(int n, int activationReason, void *insta
                 vsapi->requestFrameFilter(n+1, vfm->clip2, frameCtx);
         }
     } else if (activationReason == arAllFramesReady) {
-        const VSFrame *prv = vsapi->getFrameFilter(n > 0 ? n-1 : 0, vfm->node, frameCtx);
+        const int prvn = n > 0 ? n-1 : 0;
+        const int nxtn = n < vfm->vi->numFrames - 1 ? n+1 : vfm->vi->numFrames - 1;
+        const VSFrame *prv = vsapi->getFrameFilter(prvn, vfm->node, frameCtx);
         const VSFrame *src = vsapi->getFrameFilter(n, vfm->node, frameCtx);
-        const VSFrame *nxt = vsapi->getFrameFilter(n < vfm->vi->numFrames - 1 ? n+1 : vfm->vi->numFrames - 1, vfm->node, frameCtx);
+        const VSFrame *nxt = vsapi->getFrameFilter(nxtn, vfm->node, frameCtx);
         int mics[] = { -1,-1,-1,-1,-1 };
+        int cachedMics[5];
+        int micFrames[5];
+        int micKeys[5];
 
         int order, field;
         int missing;
@@ -695,19 +925,24 @@ static const VSFrame *VS_CC vfmGetFrame(int n, int activationReason, void *insta
             }
         }
 
+        for (i = 0; i < 5; i++) {
+            micKeys[i] = vfmMicKey(i, n, prvn, nxtn, field, &micFrames[i]);
+            cachedMics[i] = vfmCacheLookup(vfm->cache, vfm->cache->mics, micFrames[i], micKeys[i]);
+        }
+
         // p/c selection
-        match = compareFieldsSlow(prv, src, nxt, map, fxo[mC], fxo[mP], vfm->mchroma, field, vfm->y0, vfm->y1, tbuffer, vfm->tpitchy, vfm->tpitchuv, vsapi);
+        match = vfmCompareFields(vfm, n, prv, src, nxt, map, fxo[mC], fxo[mP], field, tbuffer, vsapi);
         // the mode has 3-way p/c/n matches
         if (vfm->mode >= 4)
-            match = compareFieldsSlow(prv, src, nxt, map, match, fxo[mN], vfm->mchroma, field, vfm->y0, vfm->y1, tbuffer, vfm->tpitchy, vfm->tpitchuv, vsapi);
+            match = vfmCompareFields(vfm, n, prv, src, nxt, map, match, fxo[mN], field, tbuffer, vsapi);
 
         genFrames[mC] = vsapi->addFrameRef(src);
 
         // calculate all values for mic output, checkmm calculates and prepares it for the two matches if not already done
         if (vfm->micout) {
-            checkmm(0, 1, &mics[0], &mics[1], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
-            checkmm(2, 3, &mics[2], &mics[3], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
-            checkmm(4, 0, &mics[4], &mics[0], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+            checkmm(0, 1, &mics[0], &mics[1], cachedMics, &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+            checkmm(2, 3, &mics[2], &mics[3], cachedMics, &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+            checkmm(4, 0, &mics[4], &mics[0], cachedMics, &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
         }
 
         // check the micmatches to see if one of the options are better
@@ -717,31 +952,38 @@ static const VSFrame *VS_CC vfmGetFrame(int n, int activationReason, void *insta
             // here comes the conditional hell to try to approximate mode 0-5 in tfm
             if (vfm->mode == 0) {
                 // maybe not completely appropriate but go back and see if the discarded match is less sucky
-                match = checkmm(match, match == fxo[mP] ? fxo[mC] : fxo[mP], &mics[match], &mics[match == fxo[mP] ? fxo[mC] : fxo[mP]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, match == fxo[mP] ? fxo[mC] : fxo[mP], &mics[match], &mics[match == fxo[mP] ? fxo[mC] : fxo[mP]], cachedMics, &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
             } else if (vfm->mode == 1) {
-                match = checkmm(match, fxo[mN], &mics[match], &mics[fxo[mN]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mN], &mics[match], &mics[fxo[mN]], cachedMics, &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
             } else if (vfm->mode == 2) {
-                match = checkmm(match, fxo[mU], &mics[match], &mics[fxo[mU]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mU], &mics[match], &mics[fxo[mU]], cachedMics, &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
             } else if (vfm->mode == 3) {
-                match = checkmm(match, fxo[mN], &mics[match], &mics[fxo[mN]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
-                match = checkmm(match, fxo[mU], &mics[match], &mics[fxo[mU]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
-                match = checkmm(match, fxo[mB], &mics[match], &mics[fxo[mB]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mN], &mics[match], &mics[fxo[mN]], cachedMics, &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mU], &mics[match], &mics[fxo[mU]], cachedMics, &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mB], &mics[match], &mics[fxo[mB]], cachedMics, &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
             } else if (vfm->mode == 4) {
                 // degenerate check because I'm lazy
-                match = checkmm(match, match == fxo[mP] ? fxo[mC] : fxo[mP], &mics[match], &mics[match == fxo[mP] ? fxo[mC] : fxo[mP]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky,vsapi, core);
+                match = checkmm(match, match == fxo[mP] ? fxo[mC] : fxo[mP], &mics[match], &mics[match == fxo[mP] ? fxo[mC] : fxo[mP]], cachedMics, &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky,vsapi, core);
             } else if (vfm->mode == 5) {
-                match = checkmm(match, fxo[mU], &mics[match], &mics[fxo[mU]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
-                match = checkmm(match, fxo[mB], &mics[match], &mics[fxo[mB]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mU], &mics[match], &mics[fxo[mU]], cachedMics, &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mB], &mics[match], &mics[fxo[mB]], cachedMics, &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
             }
         }
 
         // Make sure mic is always calculated for selected match so _Combed will work
-        if (mics[match] < 0) {
+        if (mics[match] < 0 && cachedMics[match] >= 0) {
+            mics[match] = cachedMics[match];
+        } else if (mics[match] < 0) {
             if (!genFrames[match])
                 genFrames[match] = createWeaveFrame(prv, src, nxt, vsapi, core, match, field);
             mics[match] = calcMI(genFrames[match], vsapi, &blockN, vfm->chroma, vfm->cthresh, cmask, cArray, vfm->blockx, vfm->blocky);
         }
 
+        for (i = 0; i < 5; i++) {
+            if (mics[i] >= 0 && cachedMics[i] < 0)
+                vfmCacheStore(vfm->cache, vfm->cache->mics, micFrames[i], micKeys[i], mics[i]);
+        }
+
         // Alternative clip handling
         if (vfm->clip2) {
             const VSFrame *prv2 = vsapi->getFrameFilter(n > 0 ? n-1 : 0, vfm->clip2, frameCtx);
@@ -787,6 +1029,8 @@ static void VS_CC vfmFree(void *instanceData, VSCore *core, const VSAPI *vsapi)
     VFMData *vfm = (VFMData *)instanceData;
     vsapi->freeNode(vfm->node);
     vsapi->freeNode(vfm->clip2);
+    vfmLockDestroy(&vfm->cache->lock);
+    free(vfm->cache);
     free(vfm);
 }
 
@@ -969,6 +1213,9 @@ static void VS_CC createVFM(const VSMap *in, VSMap *out, void *userData, VSCore
     int widthuv = vi->width >> vi->format.subSamplingW;
     vfm.tpitchuv = (widthuv&15) ? widthuv+16-(widthuv&15) : widthuv;
 
+    vfm.cache = (VFMCache *)malloc(sizeof(VFMCache));
+    vfmInitCache(vfm.cache);
+
     vfmd = (VFMData *)malloc(sizeof(vfm));
     *vfmd = vfm;
 
@@ -1000,6 +1247,11 @@ typedef struct CycleCache {
     int size;                   // Number of cycles in the cache.
 } CycleCache;
 
+typedef struct FrameMetrics {
+    VDInfo metrics;             // The unadjusted metrics of the frame, DropUnknown if not known yet.
+    FrameDuration duration;     // The duration of the frame in the clip the durations are taken from.
+} FrameMetrics;
+
 
 typedef struct {
     VSNode *node;
@@ -1022,6 +1274,8 @@ typedef struct {
     int dryrun;
     signed char *drop;
     CycleCache cache;
+    FrameMetrics *frameMetrics; // Metrics of all input frames, allocated only if a metrics file is read or written.
+    FILE *metricsOut;
 } VDecimateData;
 
 
@@ -1176,25 +1430,30 @@ static int64_t calcMetric(const VSFrame *f1, const VSFrame *f2, int64_t *totdiff
     return maxdiff;
 }
 
-static int vdecimateLoadOVR(const char *ovrfile, signed char *drop, int cycle, int numFrames, char *err, size_t errlen) {
-    int line = 0;
-    char buf[80];
-    char* pos;
+static FILE *vdecimateOpenFile(const char *filename, int write) {
 #ifdef _WIN32
-    FILE* moo = NULL;
+    FILE* f = NULL;
     int len, ret;
-    wchar_t *ovrfile_wc;
-    len = MultiByteToWideChar(CP_UTF8, 0, ovrfile, -1, NULL, 0);
-    ovrfile_wc = malloc(len * sizeof(wchar_t));
-    if (ovrfile_wc) {
-        ret = MultiByteToWideChar(CP_UTF8, 0, ovrfile, -1, ovrfile_wc, len);
+    wchar_t *filename_wc;
+    len = MultiByteToWideChar(CP_UTF8, 0, filename, -1, NULL, 0);
+    filename_wc = malloc(len * sizeof(wchar_t));
+    if (filename_wc) {
+        ret = MultiByteToWideChar(CP_UTF8, 0, filename, -1, filename_wc, len);
         if (ret == len)
-            moo = _wfopen(ovrfile_wc, L"rb");
-        free(ovrfile_wc);
+            f = _wfopen(filename_wc, write ? L"wb" : L"rb");
+        free(filename_wc);
     }
+    return f;
 #else
-    FILE* moo = fopen(ovrfile, "r");
+    return fopen(filename, write ? "w" : "r");
 #endif
+}
+
+static int vdecimateLoadOVR(const char *ovrfile, signed char *drop, int cycle, int numFrames, char *err, size_t errlen) {
+    int line = 0;
+    char buf[80];
+    char* pos;
+    FILE* moo = vdecimateOpenFile(ovrfile, 0);
     if (!moo) {
         snprintf(err, errlen, "VDecimate: can't open ovr file");
         return 1;
@@ -1256,6 +1515,72 @@ static int vdecimateLoadOVR(const char *ovrfile, signed char *drop, int cycle, i
     return 0;
 }
 
+// The metrics only depend on these settings, the drop decisions are made again when the file is read
+// so cycle and the thresholds can differ between the two passes.
+static const char MetricsHeader[] = "# VDecimate metrics v1 frames %d chroma %d blockx %d blocky %d\n";
+
+static int vdecimateLoadMetrics(const char *metricsfile, FrameMetrics *frameMetrics, const VDecimateData *vdm, char *err, size_t errlen) {
+    int line = 1;
+    char buf[160];
+    int frames, chroma, blockx, blocky;
+    FILE* f = vdecimateOpenFile(metricsfile, 0);
+    if (!f) {
+        snprintf(err, errlen, "VDecimate: can't open metrics file");
+        return 1;
+    }
+
+    if (!fgets(buf, sizeof(buf), f) || sscanf(buf, MetricsHeader, &frames, &chroma, &blockx, &blocky) != 4) {
+        snprintf(err, errlen, "VDecimate: metrics file has no valid header");
+        fclose(f);
+        return 1;
+    }
+
+    if (frames != vdm->inputNumFrames || chroma != vdm->chroma || blockx != vdm->blockx || blocky != vdm->blocky) {
+        snprintf(err, errlen, "VDecimate: metrics file was made for a different clip length, chroma, blockx or blocky");
+        fclose(f);
+        return 1;
+    }
+
+    while (fgets(buf, sizeof(buf), f)) {
+        const char *pos = buf + strspn(buf, " \t\r\n");
+        int frame, drop;
+        long long maxbdiff, totdiff, durationNum, durationDen;
+
+        line++;
+
+        if (pos[0] == '#' || pos[0] == 0)
+            continue;
+
+        if (sscanf(pos, "%d %lld %lld %lld %lld %d", &frame, &maxbdiff, &totdiff, &durationNum, &durationDen, &drop) != 6 ||
+            frame < 0 || frame >= frames || maxbdiff < 0 || totdiff < 0) {
+            snprintf(err, errlen, "VDecimate: Bad metrics at line %d in metrics file", line);
+            fclose(f);
+            return 1;
+        }
+
+        frameMetrics[frame].metrics.maxbdiff = maxbdiff;
+        frameMetrics[frame].metrics.totdiff = totdiff;
+        frameMetrics[frame].duration.num = durationNum;
+        frameMetrics[frame].duration.den = durationDen;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static void vdecimateSaveMetrics(FILE *f, const VDecimateData *vdm) {
+    fprintf(f, MetricsHeader, vdm->inputNumFrames, vdm->chroma, vdm->blockx, vdm->blocky);
+    fprintf(f, "# frame maxbdiff totdiff durationnum durationden drop\n");
+
+    for (int i = 0; i < vdm->inputNumFrames; i++) {
+        const FrameMetrics *fm = &vdm->frameMetrics[i];
+        if (fm->metrics.totdiff == DropUnknown)
+            continue;
+        fprintf(f, "%d %lld %lld %lld %lld %d\n", i, (long long)fm->metrics.maxbdiff, (long long)fm->metrics.totdiff,
+            (long long)fm->duration.num, (long long)fm->duration.den, vdm->drop[i / vdm->inCycle] == i % vdm->inCycle);
+    }
+}
+
 static inline int findOutputFrame(int requestedFrame, int cycleStart, int outCycle, int drop, int dryrun) {
     if (dryrun)
         return requestedFrame;
@@ -1345,6 +1670,50 @@ static inline void getCycleBoundaries(int n, int *cyclestart, int *cycleend, VDe
         *cycleend = vdm->inputNumFrames;
 }
 
+// Adjusts the metrics of the first cycle and makes the drop decision once the metrics of a cycle are known.
+static void finishCycleMetrics(CycleInfo *cycle, int cyclestart, int cycleend, VDecimateData *vdm) {
+    // The first frame's metrics are always 0, thus it's always considered a duplicate.
+    // Unless we do something about it.
+    if (cyclestart == 0) {
+        cycle->metrics[0].maxbdiff = cycle->metrics[1].maxbdiff;
+        cycle->metrics[0].totdiff = vdm->scthresh + 1;
+    }
+
+    if (cycle->drop == DropUnknown) {
+        cycle->drop = findDropFrame(cycle->metrics, cycleend - cyclestart, vdm->scthresh, vdm->dupthresh);
+        if (vdm->drop)
+            vdm->drop[cyclestart / vdm->inCycle] = cycle->drop;
+    }
+}
+
+// Takes the metrics of a cycle from the per frame metrics, returns 0 if they aren't all known.
+static int loadCycleMetrics(CycleInfo *cycle, int cyclestart, int cycleend, VDecimateData *vdm) {
+    if (!vdm->frameMetrics)
+        return 0;
+
+    for (int i = cyclestart; i < cycleend; i++)
+        if (vdm->frameMetrics[i].metrics.totdiff == DropUnknown)
+            return 0;
+
+    for (int i = cyclestart; i < cycleend; i++)
+        cycle->metrics[i - cyclestart] = vdm->frameMetrics[i].metrics;
+
+    finishCycleMetrics(cycle, cyclestart, cycleend, vdm);
+    return 1;
+}
+
+// The durations are read from a full cycle of frames, the core clamps the ones past the end of the clip.
+static int haveCycleDurations(int cyclestart, VDecimateData *vdm) {
+    if (!vdm->frameMetrics)
+        return 0;
+
+    for (int i = cyclestart; i < cyclestart + vdm->inCycle; i++)
+        if (vdm->frameMetrics[VSMIN(i, vdm->inputNumFrames - 1)].metrics.totdiff == DropUnknown)
+            return 0;
+
+    return 1;
+}
+
 static const VSFrame *VS_CC vdecimateGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     VDecimateData *vdm = (VDecimateData *)instanceData;
 
@@ -1358,14 +1727,15 @@ static const VSFrame *VS_CC vdecimateGetFrame(int n, int activationReason, void
         if (vdm->drop && vdm->drop[cyclestart / vdm->inCycle] != DropUnknown)
             cycle->drop = vdm->drop[cyclestart / vdm->inCycle];
 
-        if (cycle->drop == DropUnknown || (vdm->dryrun && cycle->metrics[0].totdiff == DropUnknown)) {
+        if ((cycle->drop == DropUnknown || (vdm->dryrun && cycle->metrics[0].totdiff == DropUnknown)) &&
+            !loadCycleMetrics(cycle, cyclestart, cycleend, vdm)) {
             if (cyclestart > 0)
                 vsapi->requestFrameFilter(cyclestart - 1, vdm->node, frameCtx);
 
             for (int i = cyclestart; i < cycleend; i++) {
                 vsapi->requestFrameFilter(i, vdm->node, frameCtx);
                 
-                if (vdm->dryrun && vdm->clip2)
+                if ((vdm->dryrun || vdm->frameMetrics) && vdm->clip2)
                     vsapi->requestFrameFilter(i, vdm->clip2, frameCtx);
             }
         }
@@ -1376,7 +1746,7 @@ static const VSFrame *VS_CC vdecimateGetFrame(int n, int activationReason, void
             vsapi->requestFrameFilter(outputFrame, vdm->clip2 ? vdm->clip2 : vdm->node, frameCtx);
         }
 
-        if (!vdm->dryrun && cycle->durations[n % vdm->outCycle].den == 0)
+        if (!vdm->dryrun && cycle->durations[n % vdm->outCycle].den == 0 && !haveCycleDurations(cyclestart, vdm))
             for (int i = cyclestart; i < cycleend; i++)
                 vsapi->requestFrameFilter(i, vdm->clip2 ? vdm->clip2 : vdm->node, frameCtx);
 
@@ -1393,40 +1763,48 @@ static const VSFrame *VS_CC vdecimateGetFrame(int n, int activationReason, void
         if (vdm->drop && vdm->drop[cyclestart / vdm->inCycle] != DropUnknown)
             cycle->drop = vdm->drop[cyclestart / vdm->inCycle];
 
-        if (cycle->drop == DropUnknown || (vdm->dryrun && cycle->metrics[0].totdiff == DropUnknown)) {
+        if ((cycle->drop == DropUnknown || (vdm->dryrun && cycle->metrics[0].totdiff == DropUnknown)) &&
+            !loadCycleMetrics(cycle, cyclestart, cycleend, vdm)) {
             // Calculate metrics
             for (int i = cyclestart; i < cycleend; i++) {
                 const VSFrame *prv = vsapi->getFrameFilter(VSMAX(i - 1, 0), vdm->node, frameCtx);
                 const VSFrame *cur = vsapi->getFrameFilter(i, vdm->node, frameCtx);
                 cycle->metrics[i - cyclestart].maxbdiff = calcMetric(prv, cur, &cycle->metrics[i - cyclestart].totdiff, vdm, vsapi);
+
+                if (vdm->frameMetrics) {
+                    FrameMetrics *fm = &vdm->frameMetrics[i];
+                    const VSFrame *frame = vdm->clip2 ? vsapi->getFrameFilter(i, vdm->clip2, frameCtx) : cur;
+                    const VSMap *frameProps = vsapi->getFramePropertiesRO(frame);
+                    int err;
+                    fm->metrics = cycle->metrics[i - cyclestart];
+                    fm->duration.num = vsapi->mapGetInt(frameProps, "_DurationNum", 0, &err);
+                    fm->duration.den = vsapi->mapGetInt(frameProps, "_DurationDen", 0, &err);
+                    if (vdm->clip2)
+                        vsapi->freeFrame(frame);
+                }
+
                 vsapi->freeFrame(prv);
                 vsapi->freeFrame(cur);
             }
 
-            // The first frame's metrics are always 0, thus it's always considered a duplicate.
-            // Unless we do something about it.
-            if (cyclestart == 0) {
-                cycle->metrics[0].maxbdiff = cycle->metrics[1].maxbdiff;
-                cycle->metrics[0].totdiff = vdm->scthresh + 1;
-            }
-
-            if (cycle->drop == DropUnknown) {
-                cycle->drop = findDropFrame(cycle->metrics, cycleend - cyclestart, vdm->scthresh, vdm->dupthresh);
-                if (vdm->drop)
-                    vdm->drop[cyclestart / vdm->inCycle] = cycle->drop;
-            }
+            finishCycleMetrics(cycle, cyclestart, cycleend, vdm);
         }
 
         if (!vdm->dryrun && cycle->durations[n % vdm->outCycle].den == 0) {
             FrameDuration oldDurations[MaxCycleLength];
 
-            for (int i = cyclestart; i < cyclestart + vdm->inCycle; i++) {
-                const VSFrame *frame = vsapi->getFrameFilter(i, vdm->clip2 ? vdm->clip2 : vdm->node, frameCtx);
-                const VSMap *frameProps = vsapi->getFramePropertiesRO(frame);
-                int err;
-                oldDurations[i % vdm->inCycle].num = vsapi->mapGetInt(frameProps, "_DurationNum", 0, &err);
-                oldDurations[i % vdm->inCycle].den = vsapi->mapGetInt(frameProps, "_DurationDen", 0, &err);
-                vsapi->freeFrame(frame);
+            if (haveCycleDurations(cyclestart, vdm)) {
+                for (int i = cyclestart; i < cyclestart + vdm->inCycle; i++)
+                    oldDurations[i % vdm->inCycle] = vdm->frameMetrics[VSMIN(i, vdm->inputNumFrames - 1)].duration;
+            } else {
+                for (int i = cyclestart; i < cyclestart + vdm->inCycle; i++) {
+                    const VSFrame *frame = vsapi->getFrameFilter(i, vdm->clip2 ? vdm->clip2 : vdm->node, frameCtx);
+                    const VSMap *frameProps = vsapi->getFramePropertiesRO(frame);
+                    int err;
+                    oldDurations[i % vdm->inCycle].num = vsapi->mapGetInt(frameProps, "_DurationNum", 0, &err);
+                    oldDurations[i % vdm->inCycle].den = vsapi->mapGetInt(frameProps, "_DurationDen", 0, &err);
+                    vsapi->freeFrame(frame);
+                }
             }
 
             calculateNewDurations(oldDurations, cycle->durations, vdm->inCycle, cycle->drop);
@@ -1461,6 +1839,11 @@ static void VS_CC vdecimateFree(void *instanceData, VSCore *core, const VSAPI *v
     vsapi->freeNode(vdm->node);
     vsapi->freeNode(vdm->clip2);
     free(vdm->bdiffs);
+    if (vdm->metricsOut) {
+        vdecimateSaveMetrics(vdm->metricsOut, vdm);
+        fclose(vdm->metricsOut);
+    }
+    free(vdm->frameMetrics);
     if (vdm->drop)
         free(vdm->drop);
     freeCache(&vdm->cache);
@@ -1545,6 +1928,8 @@ static void VS_CC createVDecimate(const VSMap *in, VSMap *out, void *userData, V
     }
 
     vdm.ovrfile = vsapi->mapGetData(in, "ovr", 0, &err);
+    const char *metricsin = vsapi->mapGetData(in, "metricsin", 0, &err);
+    const char *metricsout = vsapi->mapGetData(in, "metricsout", 0, &err);
 
     vdm.dryrun = !!vsapi->mapGetInt(in, "dryrun", 0, &err);
 
@@ -1558,10 +1943,12 @@ static void VS_CC createVDecimate(const VSMap *in, VSMap *out, void *userData, V
     vdm.bdiffsize = vdm.nxblocks * vdm.nyblocks;
     vdm.bdiffs = (int64_t *)malloc(vdm.bdiffsize * sizeof(int64_t));
 
-    if (vdm.ovrfile) {
+    if (vdm.ovrfile || metricsin || metricsout) {
         vdm.drop = (signed char *)malloc(vdm.vi.numFrames / vdm.inCycle + 1);
         memset(vdm.drop, DropUnknown, vdm.vi.numFrames / vdm.inCycle + 1);
+    }
 
+    if (vdm.ovrfile) {
         char err2[80];
 
         if (vdecimateLoadOVR(vdm.ovrfile, vdm.drop, vdm.inCycle, vdm.vi.numFrames, err2, sizeof(err2))) {
@@ -1580,6 +1967,32 @@ static void VS_CC createVDecimate(const VSMap *in, VSMap *out, void *userData, V
         vdm.outCycle = vdm.inCycle - 1;
 
     vdm.inputNumFrames = vdm.vi.numFrames;
+
+    if (metricsin || metricsout) {
+        vdm.frameMetrics = (FrameMetrics *)malloc(vdm.inputNumFrames * sizeof(FrameMetrics));
+        for (int i = 0; i < vdm.inputNumFrames; i++) {
+            vdm.frameMetrics[i].metrics.maxbdiff = vdm.frameMetrics[i].metrics.totdiff = DropUnknown;
+            vdm.frameMetrics[i].duration.num = vdm.frameMetrics[i].duration.den = 0;
+        }
+
+        char err2[120];
+
+        if (metricsin && vdecimateLoadMetrics(metricsin, vdm.frameMetrics, &vdm, err2, sizeof(err2))) {
+            vsapi->mapSetError(out, err2);
+        } else if (metricsout && !(vdm.metricsOut = vdecimateOpenFile(metricsout, 1))) {
+            vsapi->mapSetError(out, "VDecimate: can't open metrics file for writing");
+        }
+
+        if (vsapi->mapGetError(out)) {
+            free(vdm.frameMetrics);
+            free(vdm.drop);
+            free(vdm.bdiffs);
+            vsapi->freeNode(vdm.node);
+            vsapi->freeNode(vdm.clip2);
+            return;
+        }
+    }
+
     if (!vdm.dryrun) {
         vdm.tail = vdm.vi.numFrames % vdm.inCycle;
         vdm.vi.numFrames /= vdm.inCycle;
@@ -1634,6 +2047,8 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI
                              "clip2:vnode:opt;"
                              "ovr:data:opt;"
                              "dryrun:int:opt;"
+                             "metricsin:data:opt;"
+                             "metricsout:data:opt;"
                              , "clip:vnode;"
                              , createVDecimate, NULL, plugin);
 }
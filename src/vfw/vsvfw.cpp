@@ -30,8 +30,7 @@
 #include <mutex>
 #include <atomic>
 #include <vector>
-#include <chrono>
-#include <thread>
+#include <condition_variable>
 
 #include "VSScript4.h"
 #include "VSHelper4.h"
@@ -70,10 +69,37 @@ private:
     const VSVideoInfo *vi = nullptr;
     const VSAudioInfo* ai = nullptr;
     std::string error_msg;
-    std::atomic<long> pending_requests;
+
+    // A bounded ring of packed frames filled by the read ahead. The packing
+    // happens in frameDoneCallback on the core's threads so a read of a
+    // prefetched frame is only a copy. Slots that are pending are never
+    // reused, pending_requests is protected by prefetch_lock.
+    struct PrefetchSlot {
+        int n = -1;
+        bool pending = false;
+        bool ok = false;
+        uint64_t last_use = 0;
+        std::vector<uint8_t> data;
+    };
+
+    std::mutex prefetch_lock;
+    std::condition_variable prefetch_cond;
+    std::vector<PrefetchSlot> prefetch_ring;
+    uint64_t prefetch_use = 0;
+    long pending_requests = 0;
+    size_t image_size = 0;
+
+    // The read ahead only starts on sequential reads and its window doubles
+    // while the reads hit prefetched frames, up to the size of the ring
+    int read_ahead = 0;
+    int last_request = -1;
 
     std::mutex cs_filter_graph;
 
+    void PackFrame(const VSFrame *f, uint8_t *dst);
+    bool ReadPrefetched(void *lpBuffer, int n);
+    void Prefetch(int n, bool hit);
+
     bool DelayInit();
     bool DelayInit2();
 
@@ -376,7 +402,7 @@ STDMETHODIMP VapourSynthFile::DeleteStream(DWORD fccType, LONG lParam) noexcept
 ///////////////////////////////////////////////////
 /////// local
 
-VapourSynthFile::VapourSynthFile(const CLSID& rclsid) : m_refs(0), pending_requests(0) {
+VapourSynthFile::VapourSynthFile(const CLSID& rclsid) : m_refs(0) {
     vssapi = getVSScriptAPI(VSSCRIPT_API_VERSION);
     assert(vssapi);
     vsapi = vssapi->getVSAPI(VAPOURSYNTH_API_VERSION);
@@ -386,7 +412,9 @@ VapourSynthFile::VapourSynthFile(const CLSID& rclsid) : m_refs(0), pending_reque
 VapourSynthFile::~VapourSynthFile() {
     Lock();
     if (vi) {
-        while (pending_requests > 0) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); };
+        std::unique_lock<std::mutex> lock(prefetch_lock);
+        prefetch_cond.wait(lock, [this] { return pending_requests == 0; });
+        lock.unlock();
         vsapi->freeNode(videoNode);
         videoNode = nullptr;
     }
@@ -479,6 +507,11 @@ bool VapourSynthFile::DelayInit2() {
 
             alt_output = vssapi->getAltOutputMode(se, 0);
 
+            // Two frames per thread like the cache but no more than 512MB
+            image_size = BMPSize(vi, alt_output);
+            prefetch_ring.resize(std::max<size_t>(std::min<size_t>(num_threads * 2, (512 << 20) / std::max<size_t>(image_size, 1)), 1));
+            read_ahead = std::min<int>(num_threads, static_cast<int>(prefetch_ring.size()));
+
             ////////// audio
 
             audioNode = vssapi->getOutputNode(se, 1);
@@ -747,11 +780,123 @@ STDMETHODIMP_(LONG) VapourSynthStream::FindSample(LONG lPos, LONG lFlags) noexce
 
 void VS_CC VapourSynthFile::frameDoneCallback(void *userData, const VSFrame *f, int n, VSNode *, const char *errorMsg) {
     VapourSynthFile *vsfile = static_cast<VapourSynthFile *>(userData);
+    PrefetchSlot *slot = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(vsfile->prefetch_lock);
+        for (auto &iter : vsfile->prefetch_ring) {
+            if (iter.pending && iter.n == n) {
+                slot = &iter;
+                break;
+            }
+        }
+    }
+
+    // The slot can't be touched by anything else while it's pending
+    if (f && slot) {
+        slot->data.resize(vsfile->image_size);
+        vsfile->PackFrame(f, slot->data.data());
+    }
+
     vsfile->vsapi->freeFrame(f);
-    --vsfile->pending_requests;
+
+    {
+        std::lock_guard<std::mutex> lock(vsfile->prefetch_lock);
+        if (slot) {
+            slot->pending = false;
+            slot->ok = !!f;
+        }
+        --vsfile->pending_requests;
+        // Notified under the lock since the destructor may be waiting for the last request
+        vsfile->prefetch_cond.notify_all();
+    }
+}
+
+void VapourSynthFile::PackFrame(const VSFrame *f, uint8_t *dst) {
+    const uint8_t *src[3] = {};
+    ptrdiff_t src_stride[3] = {};
+
+    for (int plane = 0; plane < vi->format.numPlanes; plane++) {
+        src[plane] = vsapi->getReadPtr(f, plane);
+        src_stride[plane] = vsapi->getStride(f, plane);
+    }
+
+    PackOutputFrame(src, src_stride, dst, vsapi->getFrameWidth(f, 0), vsapi->getFrameHeight(f, 0), vi->format, alt_output);
+}
+
+bool VapourSynthFile::ReadPrefetched(void *lpBuffer, int n) {
+    std::unique_lock<std::mutex> lock(prefetch_lock);
+
+    for (auto &iter : prefetch_ring) {
+        if (iter.n == n) {
+            prefetch_cond.wait(lock, [&iter] { return !iter.pending; });
+            // Failed frames are rendered again to produce the error message
+            if (!iter.ok || iter.n != n)
+                return false;
+            iter.last_use = ++prefetch_use;
+            memcpy(lpBuffer, iter.data.data(), image_size);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void VapourSynthFile::Prefetch(int n, bool hit) {
+    bool sequential = (n == last_request + 1);
+    int max_read_ahead = static_cast<int>(prefetch_ring.size());
+
+    if (sequential && hit)
+        read_ahead = std::min(read_ahead * 2, max_read_ahead);
+    else
+        read_ahead = std::min(num_threads, max_read_ahead);
+
+    last_request = n;
+
+    if (!sequential)
+        return;
+
+    for (int i = n + 1; i <= std::min(n + read_ahead, vi->numFrames - 1); i++) {
+        {
+            std::lock_guard<std::mutex> lock(prefetch_lock);
+
+            PrefetchSlot *victim = nullptr;
+            bool present = false;
+
+            for (auto &iter : prefetch_ring) {
+                if (iter.n == i) {
+                    present = true;
+                    break;
+                }
+                // Frames inside the current window are still going to be read
+                if (iter.pending || (iter.n > n && iter.n <= n + read_ahead))
+                    continue;
+                if (!victim || iter.last_use < victim->last_use)
+                    victim = &iter;
+            }
+
+            if (present)
+                continue;
+            if (!victim)
+                break;
+
+            victim->n = i;
+            victim->pending = true;
+            victim->ok = false;
+            victim->last_use = ++prefetch_use;
+            ++pending_requests;
+        }
+
+        vsapi->getFrameAsync(i, videoNode, VapourSynthFile::frameDoneCallback, static_cast<void *>(this));
+    }
 }
 
 bool VapourSynthStream::ReadFrame(void* lpBuffer, int n) {
+    if (parent->ReadPrefetched(lpBuffer, n)) {
+        parent->Prefetch(n, true);
+        return true;
+    }
+
     const VSAPI *vsapi = parent->vsapi;
     const VSSCRIPTAPI *vssapi = parent->vssapi;
     std::vector<char> errMsg(32 * 1024);
@@ -788,25 +933,13 @@ bool VapourSynthStream::ReadFrame(void* lpBuffer, int n) {
         }
     }
 
-    const uint8_t *src[3] = {};
-    ptrdiff_t src_stride[3] = {};
-
-    for (int plane = 0; plane < parent->vi->format.numPlanes; plane++) {
-        src[plane] = vsapi->getReadPtr(f, plane);
-        src_stride[plane] = vsapi->getStride(f, plane);
-    }
-
-    PackOutputFrame(src, src_stride, reinterpret_cast<uint8_t *>(lpBuffer), vsapi->getFrameWidth(f, 0), vsapi->getFrameHeight(f, 0), parent->vi->format, parent->alt_output);
+    parent->PackFrame(f, reinterpret_cast<uint8_t *>(lpBuffer));
 
     vsapi->freeFrame(f);
     vssapi->freeScript(errSe);
 
-    if (!errSe) {
-        for (int i = n + 1; i < std::min<int>(n + parent->num_threads, parent->vi->numFrames); i++) {
-            ++parent->pending_requests;
-            vsapi->getFrameAsync(i, parent->videoNode, VapourSynthFile::frameDoneCallback, static_cast<void *>(parent));
-        }
-    }
+    if (!errSe)
+        parent->Prefetch(n, false);
 
     return !errSe;
 }
@@ -847,8 +980,9 @@ HRESULT VapourSynthStream::Read2(LONG lStart, LONG lSamples, LPVOID lpBuffer, LO
 
         const VSAudioFormat &af = ai->format;
 
-        int startFrame = lStart / VS_AUDIO_FRAME_SAMPLES;
-        int endFrame = (lStart + lSamples - 1) / VS_AUDIO_FRAME_SAMPLES;
+        int frameSamples = parent->vsapi->getAudioFrameSamples(parent->audioNode);
+        int startFrame = lStart / frameSamples;
+        int endFrame = (lStart + lSamples - 1) / frameSamples;
 
         std::vector<const uint8_t *> tmp;
         tmp.resize(ai->format.numChannels);
@@ -858,9 +992,9 @@ HRESULT VapourSynthStream::Read2(LONG lStart, LONG lSamples, LPVOID lpBuffer, LO
 
         for (int i = startFrame; i <= endFrame; i++) {
             const VSFrame *f = vsapi->getFrame(i, parent->audioNode, nullptr, 0);
-            int64_t firstFrameSample = i * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES);
+            int64_t firstFrameSample = i * static_cast<int64_t>(frameSamples);
             size_t offset = 0;
-            size_t copyLength = VS_AUDIO_FRAME_SAMPLES;
+            size_t copyLength = frameSamples;
             if (firstFrameSample < lStart) {
                 offset = (lStart - firstFrameSample) * bytesPerOutputSample;
                 copyLength -= (lStart - firstFrameSample);
@@ -23,8 +23,11 @@
 #include <map>
 #include <list>
 #include <algorithm>
+#include <functional>
 #include <cstring>
 #include <climits>
+#include <cmath>
+#include <vector>
 
 static std::string mangleNode(VSNode *node, const VSAPI *vsapi) {
     return "n" + std::to_string(reinterpret_cast<uintptr_t>(node));
@@ -156,6 +159,8 @@ struct NodeTimeRecord {
     std::string filterName;
     int filterMode;
     int64_t nanoSeconds;
+    VSNodeStats stats;
+    VSNodeMemoryStats memory;
 
     bool operator<(const NodeTimeRecord &other) const noexcept {
         return nanoSeconds > other.nanoSeconds;
@@ -166,7 +171,9 @@ static void printNodeTimesHelper(std::list<NodeTimeRecord> &lines, std::set<VSNo
     if (!visited.insert(node).second)
         return;
 
-    lines.push_back(NodeTimeRecord{ vsapi->getNodeCreationFunctionName(node, 0), vsapi->getNodeFilterMode(node), vsapi->getNodeFilterTime(node) } );
+    lines.push_back(NodeTimeRecord{ vsapi->getNodeCreationFunctionName(node, 0), vsapi->getNodeFilterMode(node), vsapi->getNodeFilterTime(node), {}, {} });
+    vsapi->getNodeStats(node, &lines.back().stats);
+    vsapi->getNodeMemoryStats(node, &lines.back().memory);
 
     int numDeps = vsapi->getNumNodeDependencies(node);
     const VSFilterDependency *deps = vsapi->getNodeDependencies(node);
@@ -217,10 +224,406 @@ std::string printNodeTimes(VSNode *node, double processingTime, const VSAPI *vsa
 
     lines.sort();
 
-    s += extendStringRight("Filtername", 20) + " " + extendStringRight("Filter mode", 10) + " " + extendStringLeft("Time (%)", 10) + " " + extendStringLeft("Time (s)", 10) + "\n";
+    // hardware counters are only shown when they were collected
+    bool haveCounters = false;
+    for (const auto &it : lines)
+        haveCounters = haveCounters || it.stats.hwCycles;
+
+    s += extendStringRight("Filtername", 20) + " " + extendStringRight("Filter mode", 10) + " " + extendStringLeft("Time (%)", 10) + " " + extendStringLeft("Time (s)", 10) + " " + extendStringLeft("Cache (MB)", 10) + " " + extendStringLeft("Peak (MB)", 10);
+    if (haveCounters)
+        s += " " + extendStringLeft("Gcycles", 10) + " " + extendStringLeft("IPC", 10) + " " + extendStringLeft("LLC MPKI", 10) + " " + extendStringLeft("Br MPKI", 10);
+    s += "\n";
+
+    for (const auto & it : lines) {
+        s += extendStringRight(it.filterName, 20) + " " + extendStringRight(filterModeToString(it.filterMode), 10) + " " + extendStringLeft(printWithTwoDecimals((it.nanoSeconds) / (processingTime * 10000000)), 10) + " " + extendStringLeft(printWithTwoDecimals(it.nanoSeconds / 1000000000.), 10);
+        s += " " + extendStringLeft(printWithTwoDecimals(it.memory.cacheBytes / (1024. * 1024.)), 10) + " " + extendStringLeft(printWithTwoDecimals(it.memory.peakFrameBytes / (1024. * 1024.)), 10);
+        if (haveCounters) {
+            double kiloInstructions = std::max<double>(it.stats.hwInstructions, 1) / 1000;
+            s += " " + extendStringLeft(printWithTwoDecimals(it.stats.hwCycles / 1000000000.), 10) + " " + extendStringLeft(printWithTwoDecimals(static_cast<double>(it.stats.hwInstructions) / std::max<int64_t>(it.stats.hwCycles, 1)), 10) + " " + extendStringLeft(printWithTwoDecimals(it.stats.hwCacheMisses / kiloInstructions), 10) + " " + extendStringLeft(printWithTwoDecimals(it.stats.hwBranchMisses / kiloInstructions), 10);
+        }
+        s += "\n";
+    }
+
+    return s;
+}
+static std::string escapeJSON(const std::string &s) {
+    std::string r;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            r += '\\';
+            r += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            r += buffer;
+        } else {
+            r += c;
+        }
+    }
+    return r;
+}
+
+static std::string printHistogramJSON(const int64_t *buckets) {
+    // trailing empty buckets are left out to keep the output readable
+    int last = VS_NODE_STATS_BUCKETS;
+    while (last > 0 && !buckets[last - 1])
+        last--;
+    std::string s = "[";
+    for (int i = 0; i < last; i++)
+        s += (i ? ", " : "") + std::to_string(buckets[i]);
+    return s + "]";
+}
+
+static void printNodeStatsHelper(std::string &s, std::set<VSNode *> &visited, VSNode *node, const VSAPI *vsapi) {
+    if (!visited.insert(node).second)
+        return;
+
+    VSNodeStats stats;
+    vsapi->getNodeStats(node, &stats);
+    VSNodeMemoryStats memory;
+    vsapi->getNodeMemoryStats(node, &memory);
+
+    std::string deps;
+    int numDeps = vsapi->getNumNodeDependencies(node);
+    const VSFilterDependency *depList = vsapi->getNodeDependencies(node);
+    for (int i = 0; i < numDeps; i++)
+        deps += (i ? ", \"" : "\"") + mangleNode(depList[i].source, vsapi) + "\"";
+
+    int64_t lookups = stats.cacheHits + stats.cacheMisses;
+
+    if (visited.size() > 1)
+        s += ",\n";
+    s += "    {\n";
+    s += "      \"id\": \"" + mangleNode(node, vsapi) + "\",\n";
+    s += "      \"function\": \"" + escapeJSON(vsapi->getNodeCreationFunctionName(node, 0)) + "\",\n";
+    s += "      \"name\": \"" + escapeJSON(vsapi->getNodeName(node)) + "\",\n";
+    s += "      \"filter_mode\": \"" + filterModeToString(vsapi->getNodeFilterMode(node)) + "\",\n";
+    s += "      \"dependencies\": [" + deps + "],\n";
+    s += "      \"filter_time_ns\": " + std::to_string(vsapi->getNodeFilterTime(node)) + ",\n";
+    s += "      \"frames_produced\": " + std::to_string(stats.framesProduced) + ",\n";
+    s += "      \"getframe_calls\": " + std::to_string(stats.getFrameCalls) + ",\n";
+    s += "      \"cache_hits\": " + std::to_string(stats.cacheHits) + ",\n";
+    s += "      \"cache_misses\": " + std::to_string(stats.cacheMisses) + ",\n";
+    s += "      \"cache_hit_ratio\": " + (lookups ? printWithTwoDecimals(static_cast<double>(stats.cacheHits) / lookups) : std::string("null")) + ",\n";
+    s += "      \"queue_wait_ns\": " + std::to_string(stats.queueWaitTime) + ",\n";
+    s += "      \"serial_wait_ns\": " + std::to_string(stats.serialWaitTime) + ",\n";
+    s += "      \"hw_cycles\": " + std::to_string(stats.hwCycles) + ",\n";
+    s += "      \"hw_instructions\": " + std::to_string(stats.hwInstructions) + ",\n";
+    s += "      \"hw_llc_misses\": " + std::to_string(stats.hwCacheMisses) + ",\n";
+    s += "      \"hw_branch_misses\": " + std::to_string(stats.hwBranchMisses) + ",\n";
+    s += "      \"cache_bytes\": " + std::to_string(memory.cacheBytes) + ",\n";
+    s += "      \"cached_frames\": " + std::to_string(memory.cachedFrames) + ",\n";
+    s += "      \"frame_bytes\": " + std::to_string(memory.frameBytes) + ",\n";
+    s += "      \"peak_frame_bytes\": " + std::to_string(memory.peakFrameBytes) + ",\n";
+    s += "      \"getframe_latency_histogram\": " + printHistogramJSON(stats.getFrameLatency) + ",\n";
+    s += "      \"queue_wait_histogram\": " + printHistogramJSON(stats.queueWait) + "\n";
+    s += "    }";
+
+    for (int i = 0; i < numDeps; i++)
+        printNodeStatsHelper(s, visited, depList[i].source, vsapi);
+}
+
+std::string printNodeStatsJSON(VSNode *node, double processingTime, const VSAPI *vsapi) {
+    std::set<VSNode *> visited;
+    std::string s = "{\n";
+    s += "  \"elapsed_seconds\": " + printWithTwoDecimals(processingTime) + ",\n";
+    s += "  \"histogram_buckets\": \"bucket 0 is below 1 us, bucket i covers 2^(i-1) to 2^i us\",\n";
+    s += "  \"nodes\": [\n";
+    printNodeStatsHelper(s, visited, node, vsapi);
+    s += "\n  ]\n}\n";
+    return s;
+}
+
+struct CriticalPathNode {
+    VSNode *node;
+    double cost; // filter time per output frame in nanoseconds
+    double downstream = 0; // longest chain from the output down to and including this node
+    double upstream = 0; // longest chain from this node to a source, including this node
+    std::vector<size_t> deps;
+};
+
+static size_t criticalPathHelper(std::vector<CriticalPathNode> &nodes, std::map<VSNode *, size_t> &indexes, VSNode *node, int numFrames, const VSAPI *vsapi) {
+    auto iter = indexes.find(node);
+    if (iter != indexes.end())
+        return iter->second;
+
+    int numDeps = vsapi->getNumNodeDependencies(node);
+    const VSFilterDependency *deps = vsapi->getNodeDependencies(node);
+    std::vector<size_t> depIndexes;
+    for (int i = 0; i < numDeps; i++)
+        depIndexes.push_back(criticalPathHelper(nodes, indexes, deps[i].source, numFrames, vsapi));
+
+    // dependencies always end up before the nodes using them so the list is in topological order
+    size_t index = nodes.size();
+    indexes[node] = index;
+    nodes.push_back(CriticalPathNode{ node, static_cast<double>(vsapi->getNodeFilterTime(node)) / std::max(numFrames, 1), 0, 0, std::move(depIndexes) });
+    return index;
+}
+
+std::string printCriticalPath(VSNode *node, int numFrames, double processingTime, int numThreads, const VSAPI *vsapi) {
+    std::vector<CriticalPathNode> nodes;
+    std::map<VSNode *, size_t> indexes;
+    criticalPathHelper(nodes, indexes, node, numFrames, vsapi);
 
-    for (const auto & it : lines)
-        s += extendStringRight(it.filterName, 20) + " " + extendStringRight(filterModeToString(it.filterMode), 10) + " " + extendStringLeft(printWithTwoDecimals((it.nanoSeconds) / (processingTime * 10000000)), 10) + " " + extendStringLeft(printWithTwoDecimals(it.nanoSeconds / 1000000000.), 10) + "\n";
+    for (auto &n : nodes) {
+        n.upstream = n.cost;
+        for (size_t d : n.deps)
+            n.upstream = std::max(n.upstream, nodes[d].upstream + n.cost);
+    }
+
+    nodes.back().downstream = nodes.back().cost;
+    for (size_t i = nodes.size(); i > 0; i--) {
+        const CriticalPathNode &n = nodes[i - 1];
+        for (size_t d : n.deps)
+            nodes[d].downstream = std::max(nodes[d].downstream, n.downstream + nodes[d].cost);
+    }
+
+    double pathLength = nodes.back().upstream;
+    double totalCost = 0;
+    for (const auto &n : nodes)
+        totalCost += n.cost;
+
+    std::string s = "Critical path (" + printWithTwoDecimals(pathLength / 1000000.) + " ms per frame):\n";
+    s += extendStringRight("Filtername", 20) + " " + extendStringRight("Filter mode", 10) + " " + extendStringLeft("Time (ms)", 10) + " " + extendStringLeft("Path (%)", 10) + "\n";
+
+    // walk from the output to the source along the most expensive dependency
+    size_t current = nodes.size() - 1;
+    while (true) {
+        const CriticalPathNode &n = nodes[current];
+        s += extendStringRight(vsapi->getNodeCreationFunctionName(n.node, 0), 20) + " " + extendStringRight(filterModeToString(vsapi->getNodeFilterMode(n.node)), 10) + " " + extendStringLeft(printWithTwoDecimals(n.cost / 1000000.), 10) + " " + extendStringLeft(printWithTwoDecimals(pathLength > 0 ? 100 * n.cost / pathLength : 0), 10) + "\n";
+        if (n.deps.empty())
+            break;
+        current = *std::max_element(n.deps.begin(), n.deps.end(), [&nodes](size_t a, size_t b) { return nodes[a].upstream < nodes[b].upstream; });
+    }
+
+    // slack is how much slower a node could get before it would become part of the critical path
+    std::vector<const CriticalPathNode *> sorted;
+    for (const auto &n : nodes)
+        sorted.push_back(&n);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const CriticalPathNode *a, const CriticalPathNode *b) { return (a->upstream + a->downstream - a->cost) > (b->upstream + b->downstream - b->cost); });
+
+    s += "\nParallel slack per node:\n";
+    s += extendStringRight("Filtername", 20) + " " + extendStringRight("Filter mode", 10) + " " + extendStringLeft("Time (ms)", 10) + " " + extendStringLeft("Slack (ms)", 10) + "\n";
+    for (const auto &n : sorted) {
+        double slack = pathLength - (n->upstream + n->downstream - n->cost);
+        s += extendStringRight(vsapi->getNodeCreationFunctionName(n->node, 0), 20) + " " + extendStringRight(filterModeToString(vsapi->getNodeFilterMode(n->node)), 10) + " " + extendStringLeft(printWithTwoDecimals(n->cost / 1000000.), 10) + " " + extendStringLeft(printWithTwoDecimals(std::max(slack, 0.) / 1000000.), 10) + "\n";
+    }
+
+    // filters that only process one frame at a time limit the throughput no matter how many threads there are
+    const CriticalPathNode *serialBound = nullptr;
+    for (const auto &n : nodes) {
+        int mode = vsapi->getNodeFilterMode(n.node);
+        if ((mode == fmUnordered || mode == fmFrameState) && (!serialBound || n.cost > serialBound->cost))
+            serialBound = &n;
+    }
+
+    double parallelBound = totalCost / std::max(numThreads, 1);
+    s += "\nThroughput bound by all filters spread over " + std::to_string(numThreads) + " threads: " + printWithTwoDecimals(parallelBound / 1000000.) + " ms per frame\n";
+    if (serialBound)
+        s += "Throughput bound by the slowest serial filter (" + std::string(vsapi->getNodeCreationFunctionName(serialBound->node, 0)) + "): " + printWithTwoDecimals(serialBound->cost / 1000000.) + " ms per frame\n";
+    if (numFrames > 0)
+        s += "Measured: " + printWithTwoDecimals(processingTime * 1000. / numFrames) + " ms per frame\n";
 
     return s;
-}
\ No newline at end of file
+}
+
+static void sumNodeStatsHelper(std::set<VSNode *> &visited, VSNode *node, int64_t &filterTime, int64_t &cacheHits, int64_t &cacheMisses, const VSAPI *vsapi) {
+    if (!visited.insert(node).second)
+        return;
+
+    VSNodeStats stats;
+    vsapi->getNodeStats(node, &stats);
+    filterTime += vsapi->getNodeFilterTime(node);
+    cacheHits += stats.cacheHits;
+    cacheMisses += stats.cacheMisses;
+
+    int numDeps = vsapi->getNumNodeDependencies(node);
+    const VSFilterDependency *deps = vsapi->getNodeDependencies(node);
+    for (int i = 0; i < numDeps; i++)
+        sumNodeStatsHelper(visited, deps[i].source, filterTime, cacheHits, cacheMisses, vsapi);
+}
+
+static std::string printWithThreeDecimals(double d) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.3f", d);
+    return buffer;
+}
+
+std::string printBenchmarkJSON(VSNode *node, BenchmarkResults &results, const VSAPI *vsapi) {
+    std::set<VSNode *> visited;
+    int64_t filterTime = 0;
+    int64_t cacheHits = 0;
+    int64_t cacheMisses = 0;
+    sumNodeStatsHelper(visited, node, filterTime, cacheHits, cacheMisses, vsapi);
+
+    // nearest rank percentiles
+    std::vector<double> &latencies = results.frameLatencies;
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        if (latencies.empty())
+            return std::string("null");
+        size_t rank = static_cast<size_t>(std::ceil(p * latencies.size()));
+        return printWithThreeDecimals(latencies[std::min(std::max<size_t>(rank, 1), latencies.size()) - 1] * 1000);
+    };
+
+    bool steady = results.steadyFrames > 0 && results.steadySeconds > 0;
+    int64_t lookups = cacheHits + cacheMisses;
+
+    std::string s = "{\n";
+    s += "  \"core_version\": " + std::to_string(results.coreVersion) + ",\n";
+    s += "  \"threads\": " + std::to_string(results.numThreads) + ",\n";
+    s += "  \"frames\": " + std::to_string(results.totalFrames) + ",\n";
+    s += "  \"warmup_frames\": " + std::to_string(results.warmupFrames) + ",\n";
+    s += "  \"steady_frames\": " + std::to_string(results.steadyFrames) + ",\n";
+    s += "  \"elapsed_seconds\": " + printWithThreeDecimals(results.elapsedSeconds) + ",\n";
+    s += "  \"steady_seconds\": " + printWithThreeDecimals(results.steadySeconds) + ",\n";
+    s += "  \"fps\": " + (results.elapsedSeconds > 0 ? printWithThreeDecimals(results.totalFrames / results.elapsedSeconds) : std::string("null")) + ",\n";
+    s += "  \"steady_fps\": " + (steady ? printWithThreeDecimals(results.steadyFrames / results.steadySeconds) : std::string("null")) + ",\n";
+    s += "  \"latency_ms\": {\"p50\": " + percentile(0.5) + ", \"p90\": " + percentile(0.9) + ", \"p99\": " + percentile(0.99) + ", \"max\": " + percentile(1) + "},\n";
+    s += "  \"peak_memory_use\": " + std::to_string(results.peakMemoryUse) + ",\n";
+    s += "  \"filter_time_seconds\": " + printWithThreeDecimals(filterTime / 1000000000.) + ",\n";
+    s += "  \"thread_utilization\": " + (results.elapsedSeconds > 0 ? printWithThreeDecimals(filterTime / (results.elapsedSeconds * 1000000000. * std::max(results.numThreads, 1))) : std::string("null")) + ",\n";
+    s += "  \"cache_hits\": " + std::to_string(cacheHits) + ",\n";
+    s += "  \"cache_misses\": " + std::to_string(cacheMisses) + ",\n";
+    s += "  \"cache_hit_ratio\": " + (lookups ? printWithThreeDecimals(static_cast<double>(cacheHits) / lookups) : std::string("null")) + "\n";
+    s += "}\n";
+    return s;
+}
+
+struct NodeMetrics {
+    std::string id;
+    std::string name;
+    int64_t filterTime;
+    VSNodeStats stats;
+    VSNodeMemoryStats memory;
+};
+
+static void collectNodeMetricsHelper(std::vector<NodeMetrics> &nodes, std::set<VSNode *> &visited, VSNode *node, const VSAPI *vsapi) {
+    if (!visited.insert(node).second)
+        return;
+
+    nodes.push_back(NodeMetrics{ mangleNode(node, vsapi), vsapi->getNodeCreationFunctionName(node, 0), vsapi->getNodeFilterTime(node), {}, {} });
+    vsapi->getNodeStats(node, &nodes.back().stats);
+    vsapi->getNodeMemoryStats(node, &nodes.back().memory);
+
+    int numDeps = vsapi->getNumNodeDependencies(node);
+    const VSFilterDependency *deps = vsapi->getNodeDependencies(node);
+    for (int i = 0; i < numDeps; i++)
+        collectNodeMetricsHelper(nodes, visited, deps[i].source, vsapi);
+}
+
+static std::vector<NodeMetrics> collectNodeMetrics(VSNode *node, const VSAPI *vsapi) {
+    std::vector<NodeMetrics> nodes;
+    std::set<VSNode *> visited;
+    collectNodeMetricsHelper(nodes, visited, node, vsapi);
+    return nodes;
+}
+
+static std::string escapePrometheusLabel(const std::string &s) {
+    std::string r;
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            r += '\\';
+        if (c == '\n')
+            r += "\\n";
+        else
+            r += c;
+    }
+    return r;
+}
+
+// the text exposition format, the ratios are left to the queries except for the overall cache hit ratio
+std::string printMetricsPrometheus(VSNode *node, const RenderMetrics &metrics, const VSAPI *vsapi) {
+    std::string s;
+    auto metric = [&s](const char *name, const char *type, const char *help, const std::string &value) {
+        s += std::string("# HELP ") + name + " " + help + "\n";
+        s += std::string("# TYPE ") + name + " " + type + "\n";
+        s += std::string(name) + " " + value + "\n";
+    };
+
+    metric("vspipe_frames_rendered_total", "counter", "Frames of the output that have been rendered.", std::to_string(metrics.framesRendered));
+    metric("vspipe_frames", "gauge", "Frames in the output.", std::to_string(metrics.totalFrames));
+    metric("vspipe_elapsed_seconds", "gauge", "Time since the render started.", printWithThreeDecimals(metrics.elapsedSeconds));
+    metric("vspipe_fps", "gauge", "Frames rendered per second since the previous sample.", printWithThreeDecimals(metrics.fps));
+    metric("vs_framebuffer_used_bytes", "gauge", "Memory used by frames.", std::to_string(metrics.memoryUse));
+    metric("vs_framebuffer_limit_bytes", "gauge", "The maximum cache size of the core.", std::to_string(metrics.memoryLimit));
+    metric("vs_threads", "gauge", "Worker threads of the core.", std::to_string(metrics.core.threads));
+    metric("vs_active_threads", "gauge", "Worker threads that are running or looking for tasks.", std::to_string(metrics.core.activeThreads));
+    metric("vs_thread_limit", "gauge", "Worker threads allowed to run at the same time.", std::to_string(metrics.core.threadLimit));
+    metric("vs_queued_tasks", "gauge", "Tasks waiting for a thread.", std::to_string(metrics.core.queuedTasks));
+    metric("vs_external_requests", "gauge", "Frames requested by vspipe that haven't been returned yet.", std::to_string(metrics.core.externalRequests));
+    metric("vs_deadline_misses_total", "counter", "Real-time requests that weren't done by their deadline.", std::to_string(metrics.core.deadlineMisses));
+
+    std::vector<NodeMetrics> nodes = collectNodeMetrics(node, vsapi);
+
+    int64_t cacheHits = 0;
+    int64_t cacheMisses = 0;
+    for (const auto &it : nodes) {
+        cacheHits += it.stats.cacheHits;
+        cacheMisses += it.stats.cacheMisses;
+    }
+    if (cacheHits + cacheMisses)
+        metric("vs_cache_hit_ratio", "gauge", "Cache hits of all nodes divided by all lookups.", printWithThreeDecimals(static_cast<double>(cacheHits) / (cacheHits + cacheMisses)));
+
+    struct NodeMetric {
+        const char *name;
+        const char *type;
+        const char *help;
+        std::function<std::string(const NodeMetrics &)> value;
+    };
+
+    const NodeMetric nodeMetrics[] = {
+        { "vs_node_busy_seconds_total", "counter", "Time spent in the filter's getframe function.", [](const NodeMetrics &m) { return printWithThreeDecimals(m.filterTime / 1000000000.); } },
+        { "vs_node_frames_produced_total", "counter", "Frames returned by the filter.", [](const NodeMetrics &m) { return std::to_string(m.stats.framesProduced); } },
+        { "vs_node_cache_hits_total", "counter", "Requests served from the cache.", [](const NodeMetrics &m) { return std::to_string(m.stats.cacheHits); } },
+        { "vs_node_cache_misses_total", "counter", "Requests the cache couldn't serve.", [](const NodeMetrics &m) { return std::to_string(m.stats.cacheMisses); } },
+        { "vs_node_queue_wait_seconds_total", "counter", "Time the filter's tasks waited for a thread.", [](const NodeMetrics &m) { return printWithThreeDecimals(m.stats.queueWaitTime / 1000000000.); } },
+        { "vs_node_cache_bytes", "gauge", "Memory used by the frames in the node's cache.", [](const NodeMetrics &m) { return std::to_string(m.memory.cacheBytes); } },
+        { "vs_node_frame_bytes", "gauge", "Memory used by all frames the filter created that still exist.", [](const NodeMetrics &m) { return std::to_string(m.memory.frameBytes); } },
+        { "vs_node_peak_frame_bytes", "gauge", "The most memory the frames created by the filter have used at once.", [](const NodeMetrics &m) { return std::to_string(m.memory.peakFrameBytes); } },
+    };
+
+    for (const auto &nm : nodeMetrics) {
+        s += std::string("# HELP ") + nm.name + " " + nm.help + "\n";
+        s += std::string("# TYPE ") + nm.name + " " + nm.type + "\n";
+        for (const auto &it : nodes)
+            s += std::string(nm.name) + "{node=\"" + it.id + "\",function=\"" + escapePrometheusLabel(it.name) + "\"} " + nm.value(it) + "\n";
+    }
+
+    return s;
+}
+
+std::string printMetricsJSON(VSNode *node, const RenderMetrics &metrics, const VSAPI *vsapi) {
+    std::string s = "{\n";
+    s += "  \"frames_rendered\": " + std::to_string(metrics.framesRendered) + ",\n";
+    s += "  \"frames\": " + std::to_string(metrics.totalFrames) + ",\n";
+    s += "  \"elapsed_seconds\": " + printWithThreeDecimals(metrics.elapsedSeconds) + ",\n";
+    s += "  \"fps\": " + printWithThreeDecimals(metrics.fps) + ",\n";
+    s += "  \"memory_use\": " + std::to_string(metrics.memoryUse) + ",\n";
+    s += "  \"memory_limit\": " + std::to_string(metrics.memoryLimit) + ",\n";
+    s += "  \"threads\": " + std::to_string(metrics.core.threads) + ",\n";
+    s += "  \"active_threads\": " + std::to_string(metrics.core.activeThreads) + ",\n";
+    s += "  \"thread_limit\": " + std::to_string(metrics.core.threadLimit) + ",\n";
+    s += "  \"queued_tasks\": " + std::to_string(metrics.core.queuedTasks) + ",\n";
+    s += "  \"external_requests\": " + std::to_string(metrics.core.externalRequests) + ",\n";
+    s += "  \"deadline_misses\": " + std::to_string(metrics.core.deadlineMisses) + ",\n";
+    s += "  \"nodes\": [";
+
+    std::vector<NodeMetrics> nodes = collectNodeMetrics(node, vsapi);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const NodeMetrics &m = nodes[i];
+        int64_t lookups = m.stats.cacheHits + m.stats.cacheMisses;
+        s += i ? ",\n" : "\n";
+        s += "    {\"id\": \"" + m.id + "\", \"function\": \"" + escapeJSON(m.name) + "\"";
+        s += ", \"busy_seconds\": " + printWithThreeDecimals(m.filterTime / 1000000000.);
+        s += ", \"frames_produced\": " + std::to_string(m.stats.framesProduced);
+        s += ", \"cache_hit_ratio\": " + (lookups ? printWithThreeDecimals(static_cast<double>(m.stats.cacheHits) / lookups) : std::string("null"));
+        s += ", \"queue_wait_seconds\": " + printWithThreeDecimals(m.stats.queueWaitTime / 1000000000.);
+        s += ", \"cache_bytes\": " + std::to_string(m.memory.cacheBytes);
+        s += ", \"frame_bytes\": " + std::to_string(m.memory.frameBytes);
+        s += ", \"peak_frame_bytes\": " + std::to_string(m.memory.peakFrameBytes) + "}";
+    }
+
+    s += "\n  ]\n}\n";
+    return s;
+}
@@ -23,8 +23,39 @@
 
 #include <VapourSynth4.h>
 #include <string>
+#include <vector>
 
 std::string printNodeGraph(bool simple, VSNode *node, const VSAPI *vsapi);
 std::string printNodeTimes(VSNode *node, double processingTime, const VSAPI *vsapi);
+std::string printNodeStatsJSON(VSNode *node, double processingTime, const VSAPI *vsapi);
+std::string printCriticalPath(VSNode *node, int numFrames, double processingTime, int numThreads, const VSAPI *vsapi);
+
+struct BenchmarkResults {
+    int coreVersion;
+    int numThreads;
+    int totalFrames;
+    int warmupFrames;
+    int steadyFrames;
+    double elapsedSeconds;
+    double steadySeconds;
+    std::vector<double> frameLatencies; // seconds from request to completion of every steady state frame
+    int64_t peakMemoryUse;
+};
+
+std::string printBenchmarkJSON(VSNode *node, BenchmarkResults &results, const VSAPI *vsapi);
+
+// A sample of a render that's still running
+struct RenderMetrics {
+    int framesRendered;
+    int totalFrames;
+    double elapsedSeconds;
+    double fps; // since the previous sample
+    int64_t memoryUse;
+    int64_t memoryLimit;
+    VSCoreStats core;
+};
+
+std::string printMetricsPrometheus(VSNode *node, const RenderMetrics &metrics, const VSAPI *vsapi);
+std::string printMetricsJSON(VSNode *node, const RenderMetrics &metrics, const VSAPI *vsapi);
 
 #endif
@@ -23,24 +23,55 @@
 #include "VSScript4.h"
 #include "../core/version.h"
 #include "printgraph.h"
+#include "../common/graphsnapshot.h"
 extern "C" {
 #include "md5.h"
+#include "../common/xxhash64.h"
 }
 #include <string>
 #include <map>
+#include <deque>
+#include <tuple>
 #include <vector>
 #include <mutex>
+#include <thread>
 #include <condition_variable>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <locale>
 #include <sstream>
 #include "../common/wave.h"
+#include "../common/framewriter.h"
+#include "../common/intermediate.h"
+#include "../common/vsremote.h"
+#include "../core/kernel/copy.h"
+#include "../core/kernel/cpulevel.h"
 #ifdef VS_TARGET_OS_WINDOWS
 #include <io.h>
 #include <fcntl.h>
 #include "../common/vsutf16.h"
+#else
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#define VSPIPE_HAVE_SHM
 #endif
+#include "VSPipeShm.h"
 
 #define __STDC_FORMAT_MACROS
 #include <cstdio>
@@ -90,14 +121,18 @@ enum class VSPipeMode {
     PrintHelp,
     PrintInfo,
     PrintSimpleGraph,
-    PrintFullGraph
+    PrintFullGraph,
+    SaveGraphSnapshot,
+    Serve
 };
 
 enum class VSPipeHeaders {
     None,
     Y4M,
     WAVE,
-    WAVE64
+    WAVE64,
+    Matroska,
+    Intermediate
 };
 
 // Struct used to return the parsed command line options
@@ -107,15 +142,40 @@ struct VSPipeOptions {
     int64_t startPos = 0;
     int64_t endPos = -1;
     int outputIndex = 0;
+    int muxAudioIndex = -1;
     int requests = 0;
+    int segments = 1;
+    int benchmarkWarmup = -1; // number of warm-up frames, negative when not benchmarking
+    int proxyScale = 1;
+    std::string shmName;
+    std::string serveAddress;
     bool printProgress = false;
     bool printFilterTime = false;
+    bool printCriticalPath = false;
+    bool perfCounters = false;
     bool calculateMD5 = false;
+    bool calculateHash = false;
     bool preserveCwd = false;
+    bool numaAware = false;
+    bool topologyAware = false;
+    bool streamingCaches = false;
+    bool adaptiveThreads = false;
+    bool frameGuard = false;
+    bool propsOnly = false;
     nstring scriptFilename;
     nstring outputFilename;
     nstring timecodesFilename;
+    nstring hashListFilename;
+    nstring filterStatsFilename;
+    nstring traceFilename;
+    nstring metricsFilename;
+    std::string metricsAddress;
+    double metricsInterval = 10;
+    nstring checkpointFilename;
+    double checkpointInterval = 60;
+    bool resume = false;
     std::map<std::string, std::string> scriptArgs;
+    std::vector<std::pair<int, nstring>> extraOutputs; // output index and file rendered alongside the main output
 };
 
 // All state used for outputting frames
@@ -125,19 +185,23 @@ struct VSPipeOutputData {
     const VSAPI *vsapi = nullptr;
     VSPipeHeaders outputHeaders = VSPipeHeaders::None;
     FILE *outFile = nullptr;
+    bool closeOutFile = false;
+    bool writeStreamHeader = true; // cleared for the later parts of a concatenated stream
     VSNode *node = nullptr;
     VSNode *alphaNode = nullptr;
 
     /* Total number of frames and samples */
     int totalFrames = -1;
     int64_t totalSamples = -1;
+    int audioFrameSamples = VS_AUDIO_FRAME_SAMPLES;
 
     /* Fields used for keeping track of how many frames have been requested and completed and how to reorder them */
     int outputFrames = 0;
     int requestedFrames = 0;
     int completedFrames = 0;
     int completedAlphaFrames = 0;
-    std::map<int, std::pair<const VSFrame *, const VSFrame *>> reorderMap;
+    int requests = 0; // at most this many frames past outputFrames are requested
+    std::vector<std::pair<const VSFrame *, const VSFrame *>> reorderRing; // frame n is stored at n % requests
 
     /* Error reporting */
     bool outputError = false;
@@ -147,20 +211,81 @@ struct VSPipeOutputData {
     std::condition_variable condition;
     std::mutex mutex;
 
-    /* Buffer used to interleave audio or to pack together video where the rowsize isn't the same as pitch due to multiple calls to stdout being very slow */
+    /* Frames are written by a separate thread so a slow output doesn't hold up the frame callbacks, everything below is owned by it */
+    std::thread writerThread;
+    std::mutex writerMutex;
+    std::condition_variable writerCondition;
+    std::vector<std::pair<const VSFrame *, const VSFrame *>> writeQueue; // ring of frames in output order
+    size_t writeQueueStart = 0;
+    size_t writeQueueSize = 0;
+    bool writerStop = false;
+    bool writeError = false;
+    std::string writeErrorMessage;
+    int writtenFrames = 0;
+
+    /* Pieces of the current frame handed to a single gathering write */
+    std::vector<VSFWPiece> writePieces;
+
+    /* Buffer used to interleave audio or, where gathering writes aren't available, to pack together video where the rowsize isn't the same as pitch due to multiple calls to stdout being very slow */
     std::vector<uint8_t> buffer;
 
     /* Statistics */
     bool calculateMD5 = false;
     MD5_CTX md5Ctx = {};
+    bool calculateHash = false; // the per frame hashes are combined in output order
+    XXH64_CTX hashCtx = {};
+    FILE *hashListFile = nullptr;
     bool printProgress = false;
     std::chrono::time_point<std::chrono::steady_clock> startTime;
     std::chrono::time_point<std::chrono::steady_clock> lastFPSReportTime;
 
-    /* Timecode output */
+    /* Only the frame properties are requested, the pixels are never written or hashed */
+    bool propsOnly = false;
+
+    /* Benchmarking, only frames completed after the warm-up and before the last request count as steady state */
+    int benchmarkWarmup = -1;
+    VSCore *core = nullptr;
+    std::vector<std::chrono::time_point<std::chrono::steady_clock>> requestTimes;
+    std::vector<double> frameLatencies;
+    std::chrono::time_point<std::chrono::steady_clock> steadyStartTime;
+    std::chrono::time_point<std::chrono::steady_clock> steadyEndTime;
+    int steadyFrames = 0;
+    int64_t peakMemoryUse = 0;
+
+    /* Read by the metrics exporter while the frames are still being rendered */
+    std::atomic<int> renderedFrames{0};
+
+    /* Timecode output, also the clock for matroska video */
     FILE *timecodesFile = nullptr;
     int64_t currentTimecodeNum = 0;
     int64_t currentTimecodeDen = 1;
+
+    /* Matroska output, the main output is track 1 and audio interleaved with it track 2 */
+    std::vector<uint8_t> containerBuffer;
+    bool clusterStarted = false;
+    int64_t clusterTimestamp = 0;
+    int64_t writtenSamples = 0;
+    VSNode *muxAudioNode = nullptr;
+    int muxAudioFrame = 0;
+    int64_t muxAudioSamples = 0;
+
+    /* Intermediate output, the records are compressed by a filter and their offsets indexed at the end */
+    uint64_t intermediateOffset = 0;
+    std::vector<uint64_t> intermediateIndex;
+
+    /* Shared memory output, the ring in it is owned by the writer thread and the consumer process */
+    VSPipeShmHeader *shm = nullptr;
+    size_t shmSize = 0;
+    std::string shmName;
+
+    /* Checkpoints are written by the writer thread between frames so the files always end with a whole frame */
+    nstring checkpointFilename;
+    double checkpointInterval = 60;
+    std::string checkpointIdentity; // the options a checkpoint has to be resumed with
+    std::chrono::time_point<std::chrono::steady_clock> lastCheckpointTime;
+    bool checkpointWarned = false;
+    int rangeFrames = 0; // totalFrames before it's cut short by an error
+    int firstFrame = 0; // the frame after the checkpoint when resuming
 };
 
 /////////////////////////////////////////////
@@ -228,442 +353,1857 @@ static bool isCompletedFrame(const std::pair<const VSFrame *, const VSFrame *> &
     return (f.first && (!hasAlpha || f.second));
 }
 
-static void outputFrame(const VSFrame *frame, VSPipeOutputData *data) {
-    if (!data->outputError && data->outFile) {
-        if (data->vsapi->getFrameType(frame) == mtVideo) {
-            const VSVideoFormat *fi = data->vsapi->getVideoFrameFormat(frame);
-            const int rgbRemap[] = { 1, 2, 0 };
-            for (int rp = 0; rp < fi->numPlanes; rp++) {
-                int p = (fi->colorFamily == cfRGB) ? rgbRemap[rp] : rp;
-                ptrdiff_t stride = data->vsapi->getStride(frame, p);
-                const uint8_t *readPtr = data->vsapi->getReadPtr(frame, p);
-                int rowSize = data->vsapi->getFrameWidth(frame, p) * fi->bytesPerSample;
-                int height = data->vsapi->getFrameHeight(frame, p);
-
-                if (rowSize != stride) {
-                    bitblt(data->buffer.data(), rowSize, readPtr, stride, rowSize, height);
-                    readPtr = data->buffer.data();
-                }
+static void setWriteError(VSPipeOutputData *data, const std::string &message) {
+    std::lock_guard<std::mutex> lock(data->writerMutex);
+    if (!data->writeError)
+        data->writeErrorMessage = message;
+    data->writeError = true;
+}
 
-                if (data->calculateMD5)
-                    MD5_Update(&data->md5Ctx, readPtr, rowSize * height);
+// Writes all pieces in order, returns false and leaves errno set on failure
+static bool writePieces(VSPipeOutputData *data) {
+#ifdef VS_TARGET_OS_WINDOWS
+    for (const auto &iter : data->writePieces) {
+        if (fwrite(iter.data, 1, iter.size, data->outFile) != iter.size)
+            return false;
+    }
+    return true;
+#else
+    // headers were written through the FILE so it has to be empty before writing to the descriptor
+    if (fflush(data->outFile))
+        return false;
+    return !vsfwWritePieces(fileno(data->outFile), data->writePieces.data(), data->writePieces.size());
+#endif
+}
 
-                if (fwrite(readPtr, 1, rowSize * height, data->outFile) != static_cast<size_t>(rowSize * height)) {
-                    if (data->errorMessage.empty())
-                        data->errorMessage = "Error: fwrite() call failed when writing frame: " + std::to_string(data->outputFrames) + ", plane: " + std::to_string(p) +
-                        ", errno: " + std::to_string(errno);
-                    data->totalFrames = data->requestedFrames;
-                    data->outputError = true;
-                    break;
-                }
-            }
-        } else if (data->vsapi->getFrameType(frame) == mtAudio) {
-            const VSAudioFormat *fi = data->vsapi->getAudioFrameFormat(frame);
-
-            int numChannels = fi->numChannels;
-            int numSamples = data->vsapi->getFrameLength(frame);
-            size_t bytesPerOutputSample = (fi->bitsPerSample + 7) / 8;
-            size_t toOutput = bytesPerOutputSample * numSamples * numChannels;
-
-            std::vector<const uint8_t *> srcPtrs;
-            srcPtrs.reserve(numChannels);
-            for (int channel = 0; channel < numChannels; channel++)
-                srcPtrs.push_back(data->vsapi->getReadPtr(frame, channel));
-            
-            if (bytesPerOutputSample == 2)
-                PackChannels16to16le(srcPtrs.data(), data->buffer.data(), numSamples, numChannels);
-            else if (bytesPerOutputSample == 3)
-                PackChannels32to24le(srcPtrs.data(), data->buffer.data(), numSamples, numChannels);
-            else if (bytesPerOutputSample == 4)
-                PackChannels32to32le(srcPtrs.data(), data->buffer.data(), numSamples, numChannels);
-
-            if (data->calculateMD5)
-                MD5_Update(&data->md5Ctx, data->buffer.data(), static_cast<unsigned long>(toOutput));
-
-            if (fwrite(data->buffer.data(), 1, toOutput, data->outFile) != toOutput) {
-                if (data->errorMessage.empty())
-                    data->errorMessage = "Error: fwrite() call failed when writing frame: " + std::to_string(data->outputFrames) + ", errno: " + std::to_string(errno);
-                data->totalFrames = data->requestedFrames;
-                data->outputError = true;
+static void addFramePieces(const VSFrame *frame, VSPipeOutputData *data, size_t &bufferOffset) {
+    auto &pieces = data->writePieces;
+    if (data->vsapi->getFrameType(frame) == mtVideo) {
+        const VSVideoFormat *fi = data->vsapi->getVideoFrameFormat(frame);
+        const int rgbRemap[] = { 1, 2, 0 };
+        for (int rp = 0; rp < fi->numPlanes; rp++) {
+            int p = (fi->colorFamily == cfRGB) ? rgbRemap[rp] : rp;
+            ptrdiff_t stride = data->vsapi->getStride(frame, p);
+            const uint8_t *readPtr = data->vsapi->getReadPtr(frame, p);
+            size_t rowSize = data->vsapi->getFrameWidth(frame, p) * fi->bytesPerSample;
+            int height = data->vsapi->getFrameHeight(frame, p);
+
+            if (static_cast<ptrdiff_t>(rowSize) == stride) {
+                pieces.push_back({ readPtr, rowSize * height });
+            } else {
+#ifdef VS_TARGET_OS_WINDOWS
+                vs_copy_plane(data->buffer.data() + bufferOffset, rowSize, readPtr, stride, rowSize, height, 1, VS_CPU_LEVEL_MAX);
+                pieces.push_back({ data->buffer.data() + bufferOffset, rowSize * height });
+                bufferOffset += rowSize * height;
+#else
+                for (int y = 0; y < height; y++)
+                    pieces.push_back({ readPtr + y * stride, rowSize });
+#endif
             }
         }
+    } else if (data->vsapi->getFrameType(frame) == mtAudio) {
+        const VSAudioFormat *fi = data->vsapi->getAudioFrameFormat(frame);
+
+        int numChannels = fi->numChannels;
+        int numSamples = data->vsapi->getFrameLength(frame);
+        size_t bytesPerOutputSample = (fi->bitsPerSample + 7) / 8;
+        size_t toOutput = bytesPerOutputSample * numSamples * numChannels;
+
+        std::vector<const uint8_t *> srcPtrs;
+        srcPtrs.reserve(numChannels);
+        for (int channel = 0; channel < numChannels; channel++)
+            srcPtrs.push_back(data->vsapi->getReadPtr(frame, channel));
+
+        uint8_t *dst = data->buffer.data() + bufferOffset;
+        if (bytesPerOutputSample == 2)
+            PackChannels16to16le(srcPtrs.data(), dst, numSamples, numChannels);
+        else if (bytesPerOutputSample == 3)
+            PackChannels32to24le(srcPtrs.data(), dst, numSamples, numChannels);
+        else if (bytesPerOutputSample == 4)
+            PackChannels32to32le(srcPtrs.data(), dst, numSamples, numChannels);
+
+        pieces.push_back({ dst, toOutput });
+        bufferOffset += toOutput;
     }
 }
 
-static void VS_CC frameDoneCallback(void *userData, const VSFrame *f, int n, VSNode *rnode, const char *errorMsg) {
-    VSPipeOutputData *data = reinterpret_cast<VSPipeOutputData *>(userData);
+/////////////////////////////////////////////
+// Matroska
 
-    bool printToConsole = false;
-    bool hasMeaningfulFPS = false;
-    double fps = 0;
+// A minimal streaming writer, the segment and clusters have unknown sizes so nothing has to be seeked back to
 
-    if (data->printProgress) {
-        printToConsole = (n == 0);
+static const uint64_t ebmlUnknownSize = UINT64_C(0x00FFFFFFFFFFFFFF);
 
-        std::chrono::time_point<std::chrono::steady_clock> currentTime(std::chrono::steady_clock::now());
-        std::chrono::duration<double> elapsedSeconds = currentTime - data->lastFPSReportTime;
-        std::chrono::duration<double> elapsedSecondsFromStart = currentTime - data->startTime;
+static void ebmlId(std::vector<uint8_t> &buf, uint32_t id) {
+    for (int shift = (id > 0xFFFFFF) ? 24 : (id > 0xFFFF) ? 16 : (id > 0xFF) ? 8 : 0; shift >= 0; shift -= 8)
+        buf.push_back(static_cast<uint8_t>(id >> shift));
+}
 
-        if (elapsedSeconds.count() > .5) {
-            printToConsole = true;
-            data->lastFPSReportTime = currentTime;
-        }
+// sizes are always written with 8 bytes
+static void ebmlSize(std::vector<uint8_t> &buf, uint64_t size) {
+    buf.push_back(0x01);
+    for (int shift = 48; shift >= 0; shift -= 8)
+        buf.push_back(static_cast<uint8_t>(size >> shift));
+}
 
-        if (elapsedSecondsFromStart.count() > 8) {
-            hasMeaningfulFPS = true;
-            fps = data->completedFrames / elapsedSecondsFromStart.count();
-        }
-    }
+static void ebmlBinary(std::vector<uint8_t> &buf, uint32_t id, const void *data, size_t size) {
+    ebmlId(buf, id);
+    ebmlSize(buf, size);
+    buf.insert(buf.end(), reinterpret_cast<const uint8_t *>(data), reinterpret_cast<const uint8_t *>(data) + size);
+}
 
-    // completed frames simply correspond to how many times the completion callback is called
-    if (rnode == data->node) {
-        data->completedFrames++;
-        if (!data->alphaNode)
-            data->completedAlphaFrames++;
-    } else {
-        data->completedAlphaFrames++;
-    }
+static void ebmlUInt(std::vector<uint8_t> &buf, uint32_t id, uint64_t v) {
+    uint8_t bytes[8];
+    int length = 0;
+    do {
+        bytes[7 - length++] = static_cast<uint8_t>(v);
+        v >>= 8;
+    } while (v);
+    ebmlBinary(buf, id, bytes + 8 - length, length);
+}
 
-    if (f) {
-        if (rnode == data->node)
-            data->reorderMap[n].first = f;
-        else
-            data->reorderMap[n].second = f;
+static void ebmlFloat(std::vector<uint8_t> &buf, uint32_t id, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++)
+        bytes[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+    ebmlBinary(buf, id, bytes, sizeof(bytes));
+}
 
-        bool completed = isCompletedFrame(data->reorderMap[n], !!data->alphaNode);
+static void ebmlString(std::vector<uint8_t> &buf, uint32_t id, const std::string &v) {
+    ebmlBinary(buf, id, v.data(), v.size());
+}
 
-        if (completed && data->requestedFrames < data->totalFrames) {
-            data->vsapi->getFrameAsync(data->requestedFrames, data->node, frameDoneCallback, userData);
-            if (data->alphaNode)
-                data->vsapi->getFrameAsync(data->requestedFrames, data->alphaNode, frameDoneCallback, userData);
-            data->requestedFrames++;
-        }
+static void ebmlMaster(std::vector<uint8_t> &buf, uint32_t id, const std::vector<uint8_t> &content) {
+    ebmlBinary(buf, id, content.data(), content.size());
+}
 
-        while (data->reorderMap.count(data->outputFrames) && isCompletedFrame(data->reorderMap[data->outputFrames], !!data->alphaNode)) {
-            const VSFrame *frame = data->reorderMap[data->outputFrames].first;
-            const VSFrame *alphaFrame = data->reorderMap[data->outputFrames].second;
-            data->reorderMap.erase(data->outputFrames);
-            if (!data->outputError) {
-                if (data->outputHeaders == VSPipeHeaders::Y4M && data->outFile) {
-                    if (fwrite("FRAME\n", 1, 6, data->outFile) != 6) {
-                        if (data->errorMessage.empty())
-                            data->errorMessage = "Error: fwrite() call failed when writing header, errno: " + std::to_string(errno);
-                        data->totalFrames = data->requestedFrames;
-                        data->outputError = true;
-                    }
-                }
+// The raw video tags ffmpeg uses for planar formats: Y/G, number of planes, subsampling and bits
+static bool getMatroskaColourSpace(const VSVideoFormat &format, bool alpha, uint8_t tag[4]) {
+    if (format.sampleType != stInteger || format.bitsPerSample > 16)
+        return false;
 
-                outputFrame(frame, data);
-                if (alphaFrame)
-                    outputFrame(alphaFrame, data);
-
-                if (data->timecodesFile && !data->outputError) {
-                    std::ostringstream stream;
-                    stream.imbue(std::locale("C"));
-                    stream.setf(std::ios::fixed, std::ios::floatfield);
-                    stream << (data->currentTimecodeNum * 1000 / static_cast<double>(data->currentTimecodeDen));
-                    if (fprintf(data->timecodesFile, "%s\n", stream.str().c_str()) < 0) {
-                        if (data->errorMessage.empty())
-                            data->errorMessage = "Error: failed to write timecode for frame " + std::to_string(data->outputFrames) + ". errno: " + std::to_string(errno);
-                        data->totalFrames = data->requestedFrames;
-                        data->outputError = true;
-                    } else {
-                        const VSMap *props = data->vsapi->getFramePropertiesRO(frame);
-                        int err_num, err_den;
-                        int64_t duration_num = data->vsapi->mapGetInt(props, "_DurationNum", 0, &err_num);
-                        int64_t duration_den = data->vsapi->mapGetInt(props, "_DurationDen", 0, &err_den);
-
-                        if (err_num || err_den || !duration_den) {
-                            if (data->errorMessage.empty()) {
-                                if (err_num || err_den)
-                                    data->errorMessage = "Error: missing duration at frame ";
-                                else if (!duration_den)
-                                    data->errorMessage = "Error: duration denominator is zero at frame ";
-                                data->errorMessage += std::to_string(data->outputFrames);
-                            }
-
-                            data->totalFrames = data->requestedFrames;
-                            data->outputError = true;
-                        } else {
-                            addRational(&data->currentTimecodeNum, &data->currentTimecodeDen, duration_num, duration_den);
-                        }
-                    }
-                }
-            }
-            data->vsapi->freeFrame(frame);
-            data->vsapi->freeFrame(alphaFrame);
-            data->outputFrames++;
-        }
+    tag[1] = alpha ? '4' : '3';
+    tag[3] = static_cast<uint8_t>(format.bitsPerSample);
+
+    if (format.colorFamily == cfGray && !alpha) {
+        tag[0] = 'Y';
+        tag[1] = '1';
+        tag[2] = 0;
+    } else if (format.colorFamily == cfRGB) {
+        tag[0] = 'G';
+        tag[2] = 0;
+    } else if (format.colorFamily == cfYUV && format.subSamplingW <= 1 && format.subSamplingH <= format.subSamplingW) {
+        tag[0] = 'Y';
+        tag[2] = static_cast<uint8_t>(format.subSamplingW * 10 + format.subSamplingH);
     } else {
-        data->outputError = true;
-        data->totalFrames = data->requestedFrames;
-        if (data->errorMessage.empty()) {
-            if (errorMsg)
-                data->errorMessage = "Error: Failed to retrieve frame " + std::to_string(n) + " with error: " + errorMsg;
-            else
-                data->errorMessage = "Error: Failed to retrieve frame " + std::to_string(n);
-        }
+        return false;
     }
 
-    if (printToConsole && !data->outputError) {
-        if (data->vsapi->getNodeType(rnode) == mtVideo) {
-            if (hasMeaningfulFPS)
-                fprintf(stderr, "Frame: %d/%d (%.2f fps)\r", data->completedFrames, data->totalFrames, fps);
-            else
-                fprintf(stderr, "Frame: %d/%d\r", data->completedFrames, data->totalFrames);
-        } else {
-            if (hasMeaningfulFPS)
-                fprintf(stderr, "Sample: %" PRId64 "/%" PRId64 " (%.2f sps)\r", static_cast<int64_t>(data->completedFrames * VS_AUDIO_FRAME_SAMPLES), static_cast<int64_t>(data->totalFrames * VS_AUDIO_FRAME_SAMPLES), fps);
-            else
-                fprintf(stderr, "Sample: %" PRId64 "/%" PRId64 "\r", static_cast<int64_t>(data->completedFrames * VS_AUDIO_FRAME_SAMPLES), static_cast<int64_t>(data->totalFrames * VS_AUDIO_FRAME_SAMPLES));
-        }
-    }
+    return true;
+}
 
-    if (data->totalFrames == data->completedFrames && data->totalFrames == data->completedAlphaFrames) {
-        std::lock_guard<std::mutex> lock(data->mutex);
-        data->condition.notify_one();
-    }
+static void matroskaAudioTrack(std::vector<uint8_t> &tracks, int number, const VSAudioInfo *ai) {
+    std::vector<uint8_t> audio;
+    ebmlFloat(audio, 0xB5, ai->sampleRate);
+    ebmlUInt(audio, 0x9F, ai->format.numChannels);
+    ebmlUInt(audio, 0x6264, ((ai->format.bitsPerSample + 7) / 8) * 8);
+
+    std::vector<uint8_t> entry;
+    ebmlUInt(entry, 0xD7, number);
+    ebmlUInt(entry, 0x73C5, number);
+    ebmlUInt(entry, 0x83, 2);
+    ebmlUInt(entry, 0x9C, 0);
+    ebmlString(entry, 0x86, (ai->format.sampleType == stFloat) ? "A_PCM/FLOAT/IEEE" : "A_PCM/INT/LIT");
+    ebmlMaster(entry, 0xE1, audio);
+    ebmlMaster(tracks, 0xAE, entry);
 }
 
-static std::string floatBitsToLetter(int bits) {
-    switch (bits) {
-    case 16:
-        return "h";
-    case 32:
-        return "s";
-    case 64:
-        return "d";
-    default:
-        assert(false);
-        return "u";
+static bool writeMatroskaHeader(VSPipeOutputData *data) {
+    std::vector<uint8_t> tracks;
+
+    if (data->vsapi->getNodeType(data->node) == mtVideo) {
+        const VSVideoInfo *vi = data->vsapi->getVideoInfo(data->node);
+        uint8_t colourSpace[4];
+        if (!getMatroskaColourSpace(vi->format, !!data->alphaNode, colourSpace)) {
+            fprintf(stderr, "Error: no matroska raw video identifier exists for current format\n");
+            return false;
+        }
+
+        std::vector<uint8_t> video;
+        ebmlUInt(video, 0xB0, vi->width);
+        ebmlUInt(video, 0xBA, vi->height);
+        ebmlBinary(video, 0x2EB524, colourSpace, sizeof(colourSpace));
+
+        std::vector<uint8_t> entry;
+        ebmlUInt(entry, 0xD7, 1);
+        ebmlUInt(entry, 0x73C5, 1);
+        ebmlUInt(entry, 0x83, 1);
+        ebmlUInt(entry, 0x9C, 0);
+        ebmlString(entry, 0x86, "V_UNCOMPRESSED");
+        if (vi->fpsNum > 0 && vi->fpsDen > 0)
+            ebmlUInt(entry, 0x23E383, static_cast<uint64_t>(1000000000.0 * vi->fpsDen / vi->fpsNum + 0.5));
+        ebmlMaster(entry, 0xE0, video);
+        ebmlMaster(tracks, 0xAE, entry);
+    } else {
+        matroskaAudioTrack(tracks, 1, data->vsapi->getAudioInfo(data->node));
     }
-}
 
-static bool initializeVideoOutput(VSPipeOutputData *data) {
-    if (data->outputHeaders != VSPipeHeaders::None && data->outputHeaders != VSPipeHeaders::Y4M) {
-        fprintf(stderr, "Error: can't apply selected header type to video\n");
+    if (data->muxAudioNode)
+        matroskaAudioTrack(tracks, 2, data->vsapi->getAudioInfo(data->muxAudioNode));
+
+    std::vector<uint8_t> ebml;
+    ebmlUInt(ebml, 0x4286, 1);
+    ebmlUInt(ebml, 0x42F7, 1);
+    ebmlUInt(ebml, 0x42F2, 4);
+    ebmlUInt(ebml, 0x42F3, 8);
+    ebmlString(ebml, 0x4282, "matroska");
+    ebmlUInt(ebml, 0x4287, 4);
+    ebmlUInt(ebml, 0x4285, 2);
+
+    // timestamps are in milliseconds
+    std::vector<uint8_t> info;
+    ebmlUInt(info, 0x2AD7B1, 1000000);
+    ebmlString(info, 0x4D80, "VSPipe R" XSTR(VAPOURSYNTH_CORE_VERSION));
+    ebmlString(info, 0x5741, "VSPipe R" XSTR(VAPOURSYNTH_CORE_VERSION));
+
+    std::vector<uint8_t> header;
+    ebmlMaster(header, 0x1A45DFA3, ebml);
+    ebmlId(header, 0x18538067);
+    ebmlSize(header, ebmlUnknownSize);
+    ebmlMaster(header, 0x1549A966, info);
+    ebmlMaster(header, 0x1654AE6B, tracks);
+
+    if (data->outFile && fwrite(header.data(), 1, header.size(), data->outFile) != header.size()) {
+        fprintf(stderr, "Error: fwrite() call failed when writing initial header, errno: %d\n", errno);
         return false;
     }
 
-    const VSVideoInfo *vi = data->vsapi->getVideoInfo(data->node);
+    return true;
+}
 
-    if (data->outputHeaders == VSPipeHeaders::Y4M && ((vi->format.colorFamily != cfGray && vi->format.colorFamily != cfYUV) || data->alphaNode)) {
-        fprintf(stderr, "Error: can only apply y4m headers to YUV and Gray format clips without alpha\n");
-        return false;
+// Puts a SimpleBlock header and a new cluster when needed in front of the pieces from first on
+static void addMatroskaBlockHeader(VSPipeOutputData *data, int track, int64_t timestamp, size_t first) {
+    size_t payload = 0;
+    for (size_t i = first; i < data->writePieces.size(); i++)
+        payload += data->writePieces[i].size;
+
+    std::vector<uint8_t> &buf = data->containerBuffer;
+    buf.clear();
+
+    if (!data->clusterStarted || timestamp < data->clusterTimestamp || timestamp - data->clusterTimestamp > INT16_MAX) {
+        ebmlId(buf, 0x1F43B675);
+        ebmlSize(buf, ebmlUnknownSize);
+        ebmlUInt(buf, 0xE7, timestamp);
+        data->clusterStarted = true;
+        data->clusterTimestamp = timestamp;
     }
 
-    std::string y4mFormat;
+    int16_t relative = static_cast<int16_t>(timestamp - data->clusterTimestamp);
+    ebmlId(buf, 0xA3);
+    ebmlSize(buf, payload + 4);
+    buf.push_back(static_cast<uint8_t>(0x80 | track));
+    buf.push_back(static_cast<uint8_t>(relative >> 8));
+    buf.push_back(static_cast<uint8_t>(relative));
+    buf.push_back(0x80); // keyframe
 
-    if (data->outputHeaders == VSPipeHeaders::Y4M) {
-        if (vi->format.colorFamily == cfGray) {
-            y4mFormat = "mono";
-            if (vi->format.bitsPerSample > 8)
-                y4mFormat = y4mFormat + std::to_string(vi->format.bitsPerSample);
-        } else if (vi->format.colorFamily == cfYUV) {
-            if (vi->format.subSamplingW == 1 && vi->format.subSamplingH == 1)
-                y4mFormat = "420";
-            else if (vi->format.subSamplingW == 1 && vi->format.subSamplingH == 0)
-                y4mFormat = "422";
-            else if (vi->format.subSamplingW == 0 && vi->format.subSamplingH == 0)
-                y4mFormat = "444";
-            else if (vi->format.subSamplingW == 2 && vi->format.subSamplingH == 2)
-                y4mFormat = "410";
-            else if (vi->format.subSamplingW == 2 && vi->format.subSamplingH == 0)
-                y4mFormat = "411";
-            else if (vi->format.subSamplingW == 0 && vi->format.subSamplingH == 1)
-                y4mFormat = "440";
-            else {
-                fprintf(stderr, "Error: no y4m identifier exists for current format\n");
-                return false;
-            }
+    data->writePieces.insert(data->writePieces.begin() + first, { buf.data(), buf.size() });
+}
 
-            if (vi->format.bitsPerSample > 8 && vi->format.sampleType == stInteger)
-                y4mFormat += "p" + std::to_string(vi->format.bitsPerSample);
-            else if (vi->format.sampleType == stFloat)
-                y4mFormat += "p" + floatBitsToLetter(vi->format.bitsPerSample);
-        } else {
-            fprintf(stderr, "Error: no y4m identifier exists for current format\n");
+static void updateMD5(VSPipeOutputData *data, size_t first) {
+    if (data->calculateMD5) {
+        for (size_t i = first; i < data->writePieces.size(); i++)
+            MD5_Update(&data->md5Ctx, data->writePieces[i].data, static_cast<unsigned long>(data->writePieces[i].size));
+    }
+}
+
+// Writes the interleaved audio that starts no later than timestamp
+static bool writeMuxedAudio(VSPipeOutputData *data, int64_t timestamp) {
+    const VSAudioInfo *ai = data->vsapi->getAudioInfo(data->muxAudioNode);
+    while (data->muxAudioFrame < ai->numFrames) {
+        int64_t audioTimestamp = data->muxAudioSamples * 1000 / ai->sampleRate;
+        if (audioTimestamp > timestamp)
+            break;
+
+        char errorMsg[1024];
+        const VSFrame *frame = data->vsapi->getFrame(data->muxAudioFrame, data->muxAudioNode, errorMsg, sizeof(errorMsg));
+        if (!frame) {
+            setWriteError(data, "Error: Failed to retrieve audio frame " + std::to_string(data->muxAudioFrame) + " with error: " + errorMsg);
             return false;
         }
 
-        if (!y4mFormat.empty())
-            y4mFormat = " C" + y4mFormat;
+        size_t bufferOffset = 0;
+        data->writePieces.clear();
+        addFramePieces(frame, data, bufferOffset);
+        updateMD5(data, 0);
+        addMatroskaBlockHeader(data, 2, audioTimestamp, 0);
 
-        std::string header = "YUV4MPEG2" + y4mFormat
-            + " W" + std::to_string(vi->width)
-            + " H" + std::to_string(vi->height)
-            + " F" + std::to_string(vi->fpsNum) + ":" + std::to_string(vi->fpsDen)
-            + " Ip A0:0"
-            + " XLENGTH=" + std::to_string(vi->numFrames) + "\n";
-
-        if (data->outFile) {
-            if (fwrite(header.c_str(), 1, header.size(), data->outFile) != header.size()) {
-                fprintf(stderr, "Error: fwrite() call failed when writing initial header, errno: %d\n", errno);
-                return false;
-            }
-        }
-    }
+        data->muxAudioSamples += data->vsapi->getFrameLength(frame);
+        data->muxAudioFrame++;
+        data->vsapi->freeFrame(frame);
 
-    if (data->timecodesFile && !data->outputError) {
-        if (fprintf(data->timecodesFile, "# timecode format v2\n") < 0) {
-            fprintf(stderr, "Error: failed to write timecodes file header, errno: %d\n", errno);
+        if (data->outFile && !writePieces(data)) {
+            setWriteError(data, "Error: write failed when writing audio frame: " + std::to_string(data->muxAudioFrame - 1) + ", errno: " + std::to_string(errno));
             return false;
         }
     }
 
-    data->buffer.resize(vi->width * vi->height * vi->format.bytesPerSample);
     return true;
 }
 
-static bool initializeAudioOutput(VSPipeOutputData *data) {
-    if (data->outputHeaders != VSPipeHeaders::None && data->outputHeaders != VSPipeHeaders::WAVE && data->outputHeaders != VSPipeHeaders::WAVE64) {
-        fprintf(stderr, "Error: can't apply apply selected header type to audio\n");
-        return false;
+/////////////////////////////////////////////
+// Shared memory
+
+#ifdef VSPIPE_HAVE_SHM
+
+static const uint32_t shmSlots = 4;
+
+static size_t alignShm(size_t v) {
+    return (v + 63) & ~static_cast<size_t>(63);
+}
+
+static void shmWait(uint32_t *addr, uint32_t value) {
+    syscall(SYS_futex, addr, FUTEX_WAIT, value, nullptr, nullptr, 0);
+}
+
+static void shmWake(uint32_t *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static bool createShmOutput(VSPipeOutputData *data, const std::string &name) {
+    const VSVideoInfo *vi = data->vsapi->getVideoInfo(data->node);
+
+    VSPipeShmHeader header = {};
+    header.version = VSPIPE_SHM_VERSION;
+    header.numSlots = shmSlots;
+    header.numPlanes = vi->format.numPlanes + (data->alphaNode ? 1 : 0);
+    header.colorFamily = vi->format.colorFamily;
+    header.sampleType = vi->format.sampleType;
+    header.bitsPerSample = vi->format.bitsPerSample;
+    header.bytesPerSample = vi->format.bytesPerSample;
+    header.subSamplingW = vi->format.subSamplingW;
+    header.subSamplingH = vi->format.subSamplingH;
+    header.width = vi->width;
+    header.height = vi->height;
+    header.numFrames = vi->numFrames;
+    header.hasAlpha = !!data->alphaNode;
+    header.fpsNum = vi->fpsNum;
+    header.fpsDen = vi->fpsDen;
+
+    size_t offset = alignShm(sizeof(VSPipeShmSlot));
+    for (uint32_t p = 0; p < header.numPlanes; p++) {
+        bool chroma = (p == 1 || p == 2) && static_cast<int>(p) < vi->format.numPlanes;
+        header.planeWidth[p] = chroma ? (vi->width >> vi->format.subSamplingW) : vi->width;
+        header.planeHeight[p] = chroma ? (vi->height >> vi->format.subSamplingH) : vi->height;
+        header.planeStride[p] = alignShm(static_cast<size_t>(header.planeWidth[p]) * vi->format.bytesPerSample);
+        header.planeOffset[p] = offset;
+        offset += header.planeStride[p] * header.planeHeight[p];
     }
+    header.slotOffset = alignShm(sizeof(VSPipeShmHeader));
+    header.slotSize = alignShm(offset);
 
-    const VSAudioInfo *ai = data->vsapi->getAudioInfo(data->node);
+    data->shmName = "/" + name;
+    data->shmSize = header.slotOffset + header.slotSize * header.numSlots;
 
-    if (data->outputHeaders == VSPipeHeaders::WAVE64) {
-        Wave64Header header;
-        if (!CreateWave64Header(header, ai->format.sampleType == stFloat, ai->format.bitsPerSample, ai->sampleRate, ai->format.channelLayout, ai->numSamples)) {
-            fprintf(stderr, "Error: cannot create valid w64 header\n");
-            return false;
-        }
-        if (data->outFile) {
-            if (fwrite(&header, 1, sizeof(header), data->outFile) != sizeof(header)) {
-                fprintf(stderr, "Error: fwrite() call failed when writing initial header, errno: %d\n", errno);
-                return false;
-            }
-        }
-    } else if (data->outputHeaders == VSPipeHeaders::WAVE) {
-        WaveHeader header;
-        if (!CreateWaveHeader(header, ai->format.sampleType == stFloat, ai->format.bitsPerSample, ai->sampleRate, ai->format.channelLayout, ai->numSamples)) {
-            fprintf(stderr, "Error: cannot create valid wav header\n");
-            return false;
-        }
+    int fd = shm_open(data->shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "Error: failed to create shared memory object %s, errno: %d\n", data->shmName.c_str(), errno);
+        return false;
+    }
 
-        if (data->outFile) {
-            if (fwrite(&header, 1, sizeof(header), data->outFile) != sizeof(header)) {
-                fprintf(stderr, "Error: fwrite() call failed when writing initial header, errno: %d\n", errno);
-                return false;
-            }
-        }
+    void *mapping = MAP_FAILED;
+    if (!ftruncate(fd, data->shmSize))
+        mapping = mmap(nullptr, data->shmSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error: failed to map shared memory object %s, errno: %d\n", data->shmName.c_str(), errno);
+        shm_unlink(data->shmName.c_str());
+        return false;
     }
 
-    data->buffer.resize(ai->format.numChannels * VS_AUDIO_FRAME_SAMPLES * ai->format.bytesPerSample);
+    // the magic is set last so a consumer never sees a partial header
+    data->shm = reinterpret_cast<VSPipeShmHeader *>(mapping);
+    memcpy(data->shm, &header, sizeof(header));
+    __atomic_store_n(&data->shm->magic, VSPIPE_SHM_MAGIC, __ATOMIC_RELEASE);
     return true;
 }
 
-static bool outputNode(const VSPipeOptions &opts, VSPipeOutputData *data, VSCore *core) {
-    int requests = opts.requests;
-    if (requests < 1) {
-        VSCoreInfo info;
-        data->vsapi->getCoreInfo(core, &info);
-        requests = info.numThreads;
+static void signalShmWrite(VSPipeShmHeader *shm) {
+    __atomic_fetch_add(&shm->writeEvent, 1, __ATOMIC_RELEASE);
+    shmWake(&shm->writeEvent);
+}
+
+static void writeShmFrame(const VSFrame *frame, const VSFrame *alphaFrame, VSPipeOutputData *data) {
+    VSPipeShmHeader *shm = data->shm;
+    const VSAPI *vsapi = data->vsapi;
+
+    uint32_t writeCount = shm->writeCount;
+    uint32_t readCount;
+    while (writeCount - (readCount = __atomic_load_n(&shm->readCount, __ATOMIC_ACQUIRE)) >= shm->numSlots)
+        shmWait(&shm->readCount, readCount);
+
+    uint8_t *slotPtr = reinterpret_cast<uint8_t *>(shm) + shm->slotOffset + (writeCount % shm->numSlots) * shm->slotSize;
+    VSPipeShmSlot *slot = reinterpret_cast<VSPipeShmSlot *>(slotPtr);
+    const VSMap *props = vsapi->getFramePropertiesRO(frame);
+    int errNum, errDen;
+    slot->frameNumber = data->writtenFrames;
+    slot->durationNum = vsapi->mapGetInt(props, "_DurationNum", 0, &errNum);
+    slot->durationDen = vsapi->mapGetInt(props, "_DurationDen", 0, &errDen);
+    if (errNum || errDen)
+        slot->durationNum = slot->durationDen = 0;
+
+    int numPlanes = vsapi->getVideoFrameFormat(frame)->numPlanes;
+    for (uint32_t p = 0; p < shm->numPlanes; p++) {
+        bool isAlpha = static_cast<int>(p) >= numPlanes;
+        const VSFrame *src = isAlpha ? alphaFrame : frame;
+        int srcPlane = isAlpha ? 0 : p;
+        vs_copy_plane(slotPtr + shm->planeOffset[p], shm->planeStride[p], vsapi->getReadPtr(src, srcPlane), vsapi->getStride(src, srcPlane),
+            static_cast<size_t>(shm->planeWidth[p]) * shm->bytesPerSample, shm->planeHeight[p], 1, VS_CPU_LEVEL_MAX);
     }
 
-    data->startTime = std::chrono::steady_clock::now();
-    data->lastFPSReportTime = std::chrono::steady_clock::now();
+    __atomic_store_n(&shm->writeCount, writeCount + 1, __ATOMIC_RELEASE);
+    signalShmWrite(shm);
+}
 
-    std::unique_lock<std::mutex> lock(data->mutex);
+static void finishShmOutput(VSPipeOutputData *data, bool error) {
+    VSPipeShmHeader *shm = data->shm;
+    __atomic_store_n(&shm->status, static_cast<uint32_t>(error ? VSPIPE_SHM_ERROR : VSPIPE_SHM_FINISHED), __ATOMIC_RELEASE);
+    signalShmWrite(shm);
 
-    int intitalRequestSize = std::min(requests, data->totalFrames);
-    data->requestedFrames = intitalRequestSize;
-    for (int n = 0; n < intitalRequestSize; n++) {
-        data->vsapi->getFrameAsync(n, data->node, frameDoneCallback, data);
-        if (data->alphaNode)
-            data->vsapi->getFrameAsync(n, data->alphaNode, frameDoneCallback, data);
-    }
+    // the object stays available until the consumer has everything
+    uint32_t readCount;
+    while (!error && (readCount = __atomic_load_n(&shm->readCount, __ATOMIC_ACQUIRE)) != shm->writeCount)
+        shmWait(&shm->readCount, readCount);
 
-    data->condition.wait(lock);
+    shm_unlink(data->shmName.c_str());
+    munmap(shm, data->shmSize);
+    data->shm = nullptr;
+}
 
-    // We must check for spurious wakeups (e.g. SIGINT received), and do *not* proceed to cleanup:
-    // the worker threads might still be running, and cleaning up will probably just trigger SIGSEGV
-    // in the worker threads.
-    if (data->totalFrames != data->completedFrames || data->totalFrames != data->completedAlphaFrames) {
-        fprintf(stderr, "Interrupted\n");
-        exit(1);
-    }
+#endif
 
-    if (data->outputError) {
-        for (auto &iter : data->reorderMap) {
-            data->vsapi->freeFrame(iter.second.first);
-            data->vsapi->freeFrame(iter.second.second);
+/////////////////////////////////////////////
+// Frame hashing
+
+// The hashes are calculated by a filter so they're spread over the worker threads, the writer only combines them
+
+static const char *frameHashKey = "VSPipeFrameHash";
+
+static uint64_t hashFrame(const VSFrame *frame, const VSAPI *vsapi) {
+    XXH64_CTX ctx;
+    XXH64_Init(&ctx, 0);
+
+    if (vsapi->getFrameType(frame) == mtVideo) {
+        const VSVideoFormat *fi = vsapi->getVideoFrameFormat(frame);
+        for (int p = 0; p < fi->numPlanes; p++) {
+            ptrdiff_t stride = vsapi->getStride(frame, p);
+            const uint8_t *readPtr = vsapi->getReadPtr(frame, p);
+            size_t rowSize = vsapi->getFrameWidth(frame, p) * fi->bytesPerSample;
+            int height = vsapi->getFrameHeight(frame, p);
+            for (int y = 0; y < height; y++)
+                XXH64_Update(&ctx, readPtr + y * stride, rowSize);
         }
-        fprintf(stderr, "%s\n", data->errorMessage.c_str());
+    } else {
+        const VSAudioFormat *fi = vsapi->getAudioFrameFormat(frame);
+        size_t channelSize = vsapi->getFrameLength(frame) * fi->bytesPerSample;
+        for (int c = 0; c < fi->numChannels; c++)
+            XXH64_Update(&ctx, vsapi->getReadPtr(frame, c), channelSize);
     }
 
-    return data->outputError;
+    return XXH64_Final(&ctx);
 }
 
-static const char *colorFamilyToString(int colorFamily) {
-    switch (colorFamily) {
-    case cfGray: return "Gray";
-    case cfRGB: return "RGB";
-    case cfYUV: return "YUV";
+static const VSFrame *VS_CC frameHashGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    VSNode *node = reinterpret_cast<VSNode *>(instanceData);
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrame *src = vsapi->getFrameFilter(n, node, frameCtx);
+        // copies only reference the frame data
+        VSFrame *dst = vsapi->copyFrame(src, core);
+        vsapi->freeFrame(src);
+        vsapi->mapSetInt(vsapi->getFramePropertiesRW(dst), frameHashKey, static_cast<int64_t>(hashFrame(dst, vsapi)), maReplace);
+        return dst;
     }
-    return "Error";
+
+    return nullptr;
 }
 
-static bool nstringToInt64(const nstring &ns, int64_t &result) {
-    size_t pos = 0;
-    std::string s = nstringToUtf8(ns);
-    try {
-        result = std::stoll(s, &pos);
-    } catch (std::invalid_argument &) {
-        return false;
-    } catch (std::out_of_range &) {
-        return false;
-    }
-    return pos == s.length();
+static void VS_CC frameHashFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    vsapi->freeNode(reinterpret_cast<VSNode *>(instanceData));
 }
 
-static bool nstringToInt(const nstring &ns, int &result) {
-    size_t pos = 0;
-    std::string s = nstringToUtf8(ns);
-    try {
-        result = std::stoi(s, &pos);
-    } catch (std::invalid_argument &) {
-        return false;
-    } catch (std::out_of_range &) {
-        return false;
-    }
-    return pos == s.length();
+// Takes ownership of node
+static VSNode *createFrameHashNode(VSNode *node, VSCore *core, const VSAPI *vsapi) {
+    VSFilterDependency deps[] = {{ node, rpStrictSpatial }};
+    if (vsapi->getNodeType(node) == mtVideo)
+        return vsapi->createVideoFilter2("FrameHash", vsapi->getVideoInfo(node), frameHashGetFrame, frameHashFree, fmParallel, deps, 1, node, core);
+    else
+        return vsapi->createAudioFilter2("FrameHash", vsapi->getAudioInfo(node), frameHashGetFrame, frameHashFree, fmParallel, deps, 1, node, core);
 }
 
-static bool printVersion(const VSAPI *vsapi) {
-    VSCore *core = vsapi->createCore(0);
-    if (!core) {
-        fprintf(stderr, "Failed to create core\n");
-        return false;
+/////////////////////////////////////////////
+// Intermediate output
+
+// The frames are compressed in parallel like the hashes, the whole record is attached to the frame for the writer
+
+static const char *intermediateKey = "VSPipeIntermediate";
+
+static const VSFrame *VS_CC intermediateGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    VSNode *node = reinterpret_cast<VSNode *>(instanceData);
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrame *src = vsapi->getFrameFilter(n, node, frameCtx);
+        std::vector<uint8_t> record;
+        encodeIntermediateFrame(src, record, vsapi);
+        VSFrame *dst = vsapi->copyFrame(src, core);
+        vsapi->freeFrame(src);
+        vsapi->mapSetData(vsapi->getFramePropertiesRW(dst), intermediateKey, reinterpret_cast<const char *>(record.data()), static_cast<int>(record.size()), dtBinary, maReplace);
+        return dst;
     }
 
-    VSCoreInfo info;
-    vsapi->getCoreInfo(core, &info);
-    printf("%s", info.versionString);
-    vsapi->freeCore(core);
-    return true;
+    return nullptr;
 }
 
-static void printHelp() {
-    fprintf(stderr,
-        "VSPipe R" XSTR(VAPOURSYNTH_CORE_VERSION) " usage:\n"
-        "  vspipe [options] <script> <outfile>\n"
-        "\n"
-        "Available options:\n"
-        "  -a, --arg key=value              Argument to pass to the script environment\n"
+// Takes ownership of node
+static VSNode *createIntermediateNode(VSNode *node, VSCore *core, const VSAPI *vsapi) {
+    VSFilterDependency deps[] = {{ node, rpStrictSpatial }};
+    return vsapi->createVideoFilter2("IntermediateEncode", vsapi->getVideoInfo(node), intermediateGetFrame, frameHashFree, fmParallel, deps, 1, node, core);
+}
+
+static bool writeIntermediateIndexAndTrailer(VSPipeOutputData *data) {
+    std::vector<uint8_t> index;
+    writeIntermediateIndex(data->intermediateIndex, data->intermediateOffset, index);
+    return fwrite(index.data(), 1, index.size(), data->outFile) == index.size() && !fflush(data->outFile);
+}
+
+static void addFrameHash(const VSFrame *frame, const VSFrame *alphaFrame, VSPipeOutputData *data) {
+    uint64_t hashes[2];
+    int numHashes = 0;
+    hashes[numHashes++] = static_cast<uint64_t>(data->vsapi->mapGetInt(data->vsapi->getFramePropertiesRO(frame), frameHashKey, 0, nullptr));
+    if (alphaFrame)
+        hashes[numHashes++] = static_cast<uint64_t>(data->vsapi->mapGetInt(data->vsapi->getFramePropertiesRO(alphaFrame), frameHashKey, 0, nullptr));
+
+    for (int i = 0; i < numHashes; i++) {
+        uint8_t bytes[8];
+        for (int j = 0; j < 8; j++)
+            bytes[j] = static_cast<uint8_t>(hashes[i] >> (8 * j));
+        XXH64_Update(&data->hashCtx, bytes, sizeof(bytes));
+    }
+
+    if (data->hashListFile) {
+        int result;
+        if (alphaFrame)
+            result = fprintf(data->hashListFile, "%d %016" PRIx64 " %016" PRIx64 "\n", data->writtenFrames, hashes[0], hashes[1]);
+        else
+            result = fprintf(data->hashListFile, "%d %016" PRIx64 "\n", data->writtenFrames, hashes[0]);
+        if (result < 0)
+            setWriteError(data, "Error: failed to write hash of frame " + std::to_string(data->writtenFrames) + ". errno: " + std::to_string(errno));
+    }
+}
+
+/////////////////////////////////////////////
+// Checkpoints
+
+// --checkpoint FILE periodically records how far the output, timecodes and hash list files are complete together with the
+// hash states, --resume cuts the files back to that point and continues with the next frame. Checkpoints are only written
+// after the files have been synced so a checkpoint never points past data that didn't reach the disk.
+
+static const char checkpointMagic[] = "vspipe-checkpoint 1";
+
+struct VSPipeCheckpoint {
+    std::string identity;
+    int frame = 0;
+    int64_t outputOffset = 0;
+    int64_t timecodesOffset = -1;
+    int64_t timecodeNum = 0;
+    int64_t timecodeDen = 1;
+    int64_t hashListOffset = -1;
+    std::string md5;
+    std::string xxh64;
+};
+
+static std::string checkpointIdentity(const VSPipeOptions &opts, int totalFrames) {
+    // the hash states are copied as is so they also depend on the build
+    return "index=" + std::to_string(opts.outputIndex) + " start=" + std::to_string(opts.startPos) + " end=" + std::to_string(opts.endPos)
+        + " frames=" + std::to_string(totalFrames) + " headers=" + std::to_string(static_cast<int>(opts.outputHeaders))
+        + " md5=" + std::to_string(opts.calculateMD5 ? sizeof(MD5_CTX) : 0) + " xxh64=" + std::to_string(opts.calculateHash ? sizeof(XXH64_CTX) : 0)
+        + " timecodes=" + (opts.timecodesFilename.empty() ? "0" : "1") + " hashlist=" + (opts.hashListFilename.empty() ? "0" : "1");
+}
+
+static std::string toHex(const void *ptr, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(ptr);
+    std::string s;
+    for (size_t i = 0; i < size; i++) {
+        s += digits[bytes[i] >> 4];
+        s += digits[bytes[i] & 15];
+    }
+    return s;
+}
+
+static bool fromHex(const std::string &s, void *ptr, size_t size) {
+    if (s.size() != size * 2)
+        return false;
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(ptr);
+    for (size_t i = 0; i < size; i++) {
+        unsigned v;
+        if (sscanf(s.c_str() + i * 2, "%2x", &v) != 1)
+            return false;
+        bytes[i] = static_cast<uint8_t>(v);
+    }
+    return true;
+}
+
+// The position everything written so far ends at, frames bypass the FILE buffer outside of Windows
+static bool getFileOffset(FILE *f, int64_t &offset) {
+    if (fflush(f))
+        return false;
+#ifdef VS_TARGET_OS_WINDOWS
+    offset = _ftelli64(f);
+#else
+    offset = static_cast<int64_t>(lseek(fileno(f), 0, SEEK_CUR));
+#endif
+    return offset >= 0;
+}
+
+static bool syncFile(FILE *f) {
+    if (fflush(f))
+        return false;
+#ifdef VS_TARGET_OS_WINDOWS
+    return !_commit(_fileno(f));
+#else
+    return !fsync(fileno(f));
+#endif
+}
+
+// Throws away everything after offset and continues writing there
+static bool truncateFile(FILE *f, int64_t offset) {
+    if (fflush(f))
+        return false;
+#ifdef VS_TARGET_OS_WINDOWS
+    return !_chsize_s(_fileno(f), offset) && !_fseeki64(f, offset, SEEK_SET);
+#else
+    return !ftruncate(fileno(f), static_cast<off_t>(offset)) && !fseeko(f, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+static FILE *openCheckpointFile(const nstring &filename, bool write) {
+#ifdef VS_TARGET_OS_WINDOWS
+    return _wfopen(filename.c_str(), write ? L"wb" : L"rb");
+#else
+    return fopen(filename.c_str(), write ? "wb" : "rb");
+#endif
+}
+
+static bool writeCheckpoint(VSPipeOutputData *data) {
+    VSPipeCheckpoint cp;
+    cp.identity = data->checkpointIdentity;
+    cp.frame = data->writtenFrames;
+    cp.timecodeNum = data->currentTimecodeNum;
+    cp.timecodeDen = data->currentTimecodeDen;
+    if (!syncFile(data->outFile) || !getFileOffset(data->outFile, cp.outputOffset))
+        return false;
+    if (data->timecodesFile && (!syncFile(data->timecodesFile) || !getFileOffset(data->timecodesFile, cp.timecodesOffset)))
+        return false;
+    if (data->hashListFile && (!syncFile(data->hashListFile) || !getFileOffset(data->hashListFile, cp.hashListOffset)))
+        return false;
+    if (data->calculateMD5)
+        cp.md5 = toHex(&data->md5Ctx, sizeof(data->md5Ctx));
+    if (data->calculateHash)
+        cp.xxh64 = toHex(&data->hashCtx, sizeof(data->hashCtx));
+
+    std::string s = std::string(checkpointMagic) + "\n" + cp.identity + "\n";
+    s += "frame " + std::to_string(cp.frame) + "\n";
+    s += "output " + std::to_string(cp.outputOffset) + "\n";
+    s += "timecodes " + std::to_string(cp.timecodesOffset) + " " + std::to_string(cp.timecodeNum) + " " + std::to_string(cp.timecodeDen) + "\n";
+    s += "hashlist " + std::to_string(cp.hashListOffset) + "\n";
+    s += "md5 " + (cp.md5.empty() ? std::string("-") : cp.md5) + "\n";
+    s += "xxh64 " + (cp.xxh64.empty() ? std::string("-") : cp.xxh64) + "\n";
+
+    // written next to the file and renamed over it so the previous checkpoint stays valid until the new one is complete
+    nstring tmpName = data->checkpointFilename + NSTRING(".tmp");
+    FILE *f = openCheckpointFile(tmpName, true);
+    if (!f)
+        return false;
+    bool ok = fwrite(s.data(), 1, s.size(), f) == s.size();
+    ok = syncFile(f) && ok;
+    ok = !fclose(f) && ok;
+#ifdef VS_TARGET_OS_WINDOWS
+    return ok && MoveFileExW(tmpName.c_str(), data->checkpointFilename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    return ok && !rename(tmpName.c_str(), data->checkpointFilename.c_str());
+#endif
+}
+
+static bool readCheckpoint(const nstring &filename, VSPipeCheckpoint &cp) {
+    FILE *f = openCheckpointFile(filename, false);
+    if (!f)
+        return false;
+
+    std::vector<std::string> lines;
+    char buffer[1024];
+    while (fgets(buffer, sizeof(buffer), f)) {
+        std::string line = buffer;
+        if (!line.empty() && line.back() == '\n')
+            line.pop_back();
+        lines.push_back(line);
+    }
+    fclose(f);
+
+    if (lines.size() != 8 || lines[0] != checkpointMagic)
+        return false;
+
+    cp.identity = lines[1];
+    char md5[1024];
+    char xxh64[1024];
+    if (sscanf(lines[2].c_str(), "frame %d", &cp.frame) != 1 || sscanf(lines[3].c_str(), "output %" SCNd64, &cp.outputOffset) != 1
+        || sscanf(lines[4].c_str(), "timecodes %" SCNd64 " %" SCNd64 " %" SCNd64, &cp.timecodesOffset, &cp.timecodeNum, &cp.timecodeDen) != 3
+        || sscanf(lines[5].c_str(), "hashlist %" SCNd64, &cp.hashListOffset) != 1 || sscanf(lines[6].c_str(), "md5 %1023s", md5) != 1
+        || sscanf(lines[7].c_str(), "xxh64 %1023s", xxh64) != 1)
+        return false;
+    cp.md5 = strcmp(md5, "-") ? md5 : "";
+    cp.xxh64 = strcmp(xxh64, "-") ? xxh64 : "";
+    return cp.frame >= 0 && cp.outputOffset >= 0 && cp.timecodeDen > 0;
+}
+
+// Sets up checkpoints for the main output and restores the state of the last one when resuming
+static bool prepareCheckpoint(VSPipeOutputData *data, const VSPipeOptions &opts) {
+    if (opts.checkpointFilename.empty())
+        return true;
+
+    data->checkpointFilename = opts.checkpointFilename;
+    data->checkpointInterval = opts.checkpointInterval;
+    data->checkpointIdentity = checkpointIdentity(opts, data->totalFrames);
+    data->rangeFrames = data->totalFrames;
+    data->lastCheckpointTime = std::chrono::steady_clock::now();
+
+    if (!opts.resume)
+        return true;
+
+    VSPipeCheckpoint cp;
+    if (!readCheckpoint(opts.checkpointFilename, cp)) {
+        fprintf(stderr, "Error: failed to read checkpoint %s\n", nstringToUtf8(opts.checkpointFilename).c_str());
+        return false;
+    } else if (cp.identity != data->checkpointIdentity || cp.frame > data->totalFrames) {
+        fprintf(stderr, "Error: the checkpoint was written by a render with a different range, output, container or hash options\n");
+        return false;
+    } else if ((data->calculateMD5 && !fromHex(cp.md5, &data->md5Ctx, sizeof(data->md5Ctx))) || (data->calculateHash && !fromHex(cp.xxh64, &data->hashCtx, sizeof(data->hashCtx)))) {
+        fprintf(stderr, "Error: the checkpoint has invalid hash states\n");
+        return false;
+    }
+
+    if (!truncateFile(data->outFile, cp.outputOffset) || (data->timecodesFile && !truncateFile(data->timecodesFile, cp.timecodesOffset))
+        || (data->hashListFile && !truncateFile(data->hashListFile, cp.hashListOffset))) {
+        fprintf(stderr, "Error: failed to cut the output files back to the checkpoint, errno: %d\n", errno);
+        return false;
+    }
+
+    data->currentTimecodeNum = cp.timecodeNum;
+    data->currentTimecodeDen = cp.timecodeDen;
+    data->firstFrame = cp.frame;
+    fprintf(stderr, "Resuming at frame %d\n", cp.frame);
+    return true;
+}
+
+static void updateCheckpoint(VSPipeOutputData *data, bool force) {
+    std::chrono::time_point<std::chrono::steady_clock> now = std::chrono::steady_clock::now();
+    if (!force && std::chrono::duration<double>(now - data->lastCheckpointTime).count() < data->checkpointInterval)
+        return;
+    data->lastCheckpointTime = now;
+    if (!writeCheckpoint(data) && !data->checkpointWarned) {
+        fprintf(stderr, "Warning: failed to write checkpoint, errno: %d\n", errno);
+        data->checkpointWarned = true;
+    }
+}
+
+static void outputFrame(const VSFrame *frame, const VSFrame *alphaFrame, VSPipeOutputData *data) {
+    bool isVideo = (data->vsapi->getFrameType(frame) == mtVideo);
+    int64_t timestamp = 0;
+
+    if (data->calculateHash)
+        addFrameHash(frame, alphaFrame, data);
+
+#ifdef VSPIPE_HAVE_SHM
+    if (data->shm)
+        writeShmFrame(frame, alphaFrame, data);
+#endif
+
+    if (data->outputHeaders == VSPipeHeaders::Matroska) {
+        if (isVideo)
+            timestamp = (data->currentTimecodeNum * 1000 + data->currentTimecodeDen / 2) / data->currentTimecodeDen;
+        else
+            timestamp = data->writtenSamples * 1000 / data->vsapi->getAudioInfo(data->node)->sampleRate;
+
+        if (data->muxAudioNode && !writeMuxedAudio(data, timestamp))
+            return;
+    }
+
+    if (data->outFile) {
+        static const char frameHeader[] = "FRAME\n";
+        size_t bufferOffset = 0;
+        data->writePieces.clear();
+
+        if (data->outputHeaders == VSPipeHeaders::Y4M)
+            data->writePieces.push_back({ reinterpret_cast<const uint8_t *>(frameHeader), 6 });
+        size_t headerPieces = data->writePieces.size();
+
+        if (data->outputHeaders == VSPipeHeaders::Intermediate) {
+            // the md5 is of the uncompressed frames so it can be compared with the output of a later pass
+            if (data->calculateMD5) {
+                addFramePieces(frame, data, bufferOffset);
+                updateMD5(data, 0);
+                data->writePieces.clear();
+            }
+            const VSMap *props = data->vsapi->getFramePropertiesRO(frame);
+            const uint8_t *record = reinterpret_cast<const uint8_t *>(data->vsapi->mapGetData(props, intermediateKey, 0, nullptr));
+            size_t recordSize = static_cast<size_t>(data->vsapi->mapGetDataSize(props, intermediateKey, 0, nullptr));
+            data->writePieces.push_back({ record, recordSize });
+            headerPieces = data->writePieces.size();
+            data->intermediateIndex.push_back(data->intermediateOffset);
+            data->intermediateOffset += recordSize;
+        } else {
+            addFramePieces(frame, data, bufferOffset);
+            if (alphaFrame)
+                addFramePieces(alphaFrame, data, bufferOffset);
+        }
+
+        if (data->outputHeaders == VSPipeHeaders::Matroska) {
+            addMatroskaBlockHeader(data, 1, timestamp, headerPieces);
+            headerPieces++;
+        }
+
+        updateMD5(data, headerPieces);
+
+        if (!writePieces(data)) {
+            setWriteError(data, "Error: write failed when writing frame: " + std::to_string(data->writtenFrames) + ", errno: " + std::to_string(errno));
+            return;
+        }
+    }
+
+    if (!isVideo)
+        data->writtenSamples += data->vsapi->getFrameLength(frame);
+
+    if (data->timecodesFile || (isVideo && data->outputHeaders == VSPipeHeaders::Matroska)) {
+        bool timecodeWritten = true;
+        if (data->timecodesFile) {
+            std::ostringstream stream;
+            stream.imbue(std::locale("C"));
+            stream.setf(std::ios::fixed, std::ios::floatfield);
+            stream << (data->currentTimecodeNum * 1000 / static_cast<double>(data->currentTimecodeDen));
+            timecodeWritten = (fprintf(data->timecodesFile, "%s\n", stream.str().c_str()) >= 0);
+        }
+
+        if (!timecodeWritten) {
+            setWriteError(data, "Error: failed to write timecode for frame " + std::to_string(data->writtenFrames) + ". errno: " + std::to_string(errno));
+        } else {
+            const VSMap *props = data->vsapi->getFramePropertiesRO(frame);
+            int err_num, err_den;
+            int64_t duration_num = data->vsapi->mapGetInt(props, "_DurationNum", 0, &err_num);
+            int64_t duration_den = data->vsapi->mapGetInt(props, "_DurationDen", 0, &err_den);
+
+            if (err_num || err_den)
+                setWriteError(data, "Error: missing duration at frame " + std::to_string(data->writtenFrames));
+            else if (!duration_den)
+                setWriteError(data, "Error: duration denominator is zero at frame " + std::to_string(data->writtenFrames));
+            else
+                addRational(&data->currentTimecodeNum, &data->currentTimecodeDen, duration_num, duration_den);
+        }
+    }
+}
+
+static void writerLoop(VSPipeOutputData *data) {
+    std::unique_lock<std::mutex> lock(data->writerMutex);
+    while (true) {
+        data->writerCondition.wait(lock, [data] { return data->writeQueueSize || data->writerStop; });
+        if (!data->writeQueueSize)
+            break;
+
+        std::pair<const VSFrame *, const VSFrame *> frames = data->writeQueue[data->writeQueueStart];
+        bool skip = data->writeError;
+        lock.unlock();
+
+        if (!skip)
+            outputFrame(frames.first, frames.second, data);
+        data->vsapi->freeFrame(frames.first);
+        data->vsapi->freeFrame(frames.second);
+        data->writtenFrames++;
+        if (!data->checkpointFilename.empty() && !data->writeError)
+            updateCheckpoint(data, false);
+
+        lock.lock();
+        data->writeQueueStart = (data->writeQueueStart + 1) % data->writeQueue.size();
+        data->writeQueueSize--;
+        data->writerCondition.notify_all();
+    }
+
+    bool flushAudio = data->muxAudioNode && !data->writeError;
+    bool writeIndex = data->outputHeaders == VSPipeHeaders::Intermediate && data->outFile && !data->writeError;
+    lock.unlock();
+    if (flushAudio)
+        writeMuxedAudio(data, INT64_MAX);
+    if (writeIndex && !writeIntermediateIndexAndTrailer(data))
+        setWriteError(data, "Error: failed to write the intermediate index, errno: " + std::to_string(errno));
+
+    // a finished render has no use for its checkpoint, one that stopped at a bad frame can be resumed from there
+    if (!data->checkpointFilename.empty() && !data->writeError) {
+        if (!data->outputError && data->writtenFrames == data->rangeFrames) {
+#ifdef VS_TARGET_OS_WINDOWS
+            _wremove(data->checkpointFilename.c_str());
+#else
+            remove(data->checkpointFilename.c_str());
+#endif
+        } else {
+            updateCheckpoint(data, true);
+        }
+    }
+
+#ifdef VSPIPE_HAVE_SHM
+    if (data->shm)
+        finishShmOutput(data, data->outputError || data->writeError);
+#endif
+}
+
+// Hands the next frame in output order to the writer, only blocks when the writer has fallen a whole queue behind
+static void queueFrame(VSPipeOutputData *data, const VSFrame *frame, const VSFrame *alphaFrame) {
+    std::unique_lock<std::mutex> lock(data->writerMutex);
+    data->writerCondition.wait(lock, [data] { return data->writeQueueSize < data->writeQueue.size(); });
+    data->writeQueue[(data->writeQueueStart + data->writeQueueSize) % data->writeQueue.size()] = std::make_pair(frame, alphaFrame);
+    data->writeQueueSize++;
+    if (data->writeError && !data->outputError) {
+        data->outputError = true;
+        data->totalFrames = data->requestedFrames;
+    }
+    data->writerCondition.notify_all();
+}
+
+static void VS_CC frameDoneCallback(void *userData, const VSFrame *f, int n, VSNode *rnode, const char *errorMsg);
+
+static void requestFrame(int n, VSPipeOutputData *data) {
+    if (data->benchmarkWarmup >= 0)
+        data->requestTimes[n] = std::chrono::steady_clock::now();
+    if (data->propsOnly) {
+        data->vsapi->getFramePropsAsync(n, data->node, frameDoneCallback, data);
+        if (data->alphaNode)
+            data->vsapi->getFramePropsAsync(n, data->alphaNode, frameDoneCallback, data);
+    } else {
+        data->vsapi->getFrameAsync(n, data->node, frameDoneCallback, data);
+        if (data->alphaNode)
+            data->vsapi->getFrameAsync(n, data->alphaNode, frameDoneCallback, data);
+    }
+}
+
+static void recordBenchmarkFrame(int n, VSPipeOutputData *data) {
+    std::chrono::time_point<std::chrono::steady_clock> currentTime(std::chrono::steady_clock::now());
+
+    VSCoreInfo info;
+    data->vsapi->getCoreInfo(data->core, &info);
+    data->peakMemoryUse = std::max(data->peakMemoryUse, info.usedFramebufferSize);
+
+    if (data->completedFrames == data->benchmarkWarmup) {
+        data->steadyStartTime = currentTime;
+    } else if (data->completedFrames > data->benchmarkWarmup && data->requestedFrames < data->totalFrames) {
+        data->steadyFrames++;
+        data->steadyEndTime = currentTime;
+        data->frameLatencies.push_back(std::chrono::duration<double>(currentTime - data->requestTimes[n]).count());
+    }
+}
+
+static void VS_CC frameDoneCallback(void *userData, const VSFrame *f, int n, VSNode *rnode, const char *errorMsg) {
+    VSPipeOutputData *data = reinterpret_cast<VSPipeOutputData *>(userData);
+
+    bool printToConsole = false;
+    bool hasMeaningfulFPS = false;
+    double fps = 0;
+
+    if (data->printProgress) {
+        printToConsole = (n == 0);
+
+        std::chrono::time_point<std::chrono::steady_clock> currentTime(std::chrono::steady_clock::now());
+        std::chrono::duration<double> elapsedSeconds = currentTime - data->lastFPSReportTime;
+        std::chrono::duration<double> elapsedSecondsFromStart = currentTime - data->startTime;
+
+        if (elapsedSeconds.count() > .5) {
+            printToConsole = true;
+            data->lastFPSReportTime = currentTime;
+        }
+
+        if (elapsedSecondsFromStart.count() > 8) {
+            hasMeaningfulFPS = true;
+            fps = (data->completedFrames - data->firstFrame) / elapsedSecondsFromStart.count();
+        }
+    }
+
+    // completed frames simply correspond to how many times the completion callback is called
+    if (rnode == data->node) {
+        data->completedFrames++;
+        data->renderedFrames++;
+        if (!data->alphaNode)
+            data->completedAlphaFrames++;
+        if (f && data->benchmarkWarmup >= 0)
+            recordBenchmarkFrame(n, data);
+    } else {
+        data->completedAlphaFrames++;
+    }
+
+    if (f) {
+        auto &slot = data->reorderRing[n % data->requests];
+        if (rnode == data->node)
+            slot.first = f;
+        else
+            slot.second = f;
+
+        while (isCompletedFrame(data->reorderRing[data->outputFrames % data->requests], !!data->alphaNode)) {
+            auto &next = data->reorderRing[data->outputFrames % data->requests];
+            const VSFrame *frame = next.first;
+            const VSFrame *alphaFrame = next.second;
+            next = {};
+            if (!data->outputError) {
+                queueFrame(data, frame, alphaFrame);
+            } else {
+                data->vsapi->freeFrame(frame);
+                data->vsapi->freeFrame(alphaFrame);
+            }
+            data->outputFrames++;
+        }
+
+        // only frames that fit in the ring are requested, everything before outputFrames has left it
+        while (data->requestedFrames < data->totalFrames && data->requestedFrames < data->outputFrames + data->requests) {
+            requestFrame(data->requestedFrames, data);
+            data->requestedFrames++;
+        }
+    } else {
+        data->outputError = true;
+        data->totalFrames = data->requestedFrames;
+        if (data->errorMessage.empty()) {
+            if (errorMsg)
+                data->errorMessage = "Error: Failed to retrieve frame " + std::to_string(n) + " with error: " + errorMsg;
+            else
+                data->errorMessage = "Error: Failed to retrieve frame " + std::to_string(n);
+        }
+    }
+
+    if (printToConsole && !data->outputError) {
+        if (data->vsapi->getNodeType(rnode) == mtVideo) {
+            if (hasMeaningfulFPS)
+                fprintf(stderr, "Frame: %d/%d (%.2f fps)\r", data->completedFrames, data->totalFrames, fps);
+            else
+                fprintf(stderr, "Frame: %d/%d\r", data->completedFrames, data->totalFrames);
+        } else {
+            if (hasMeaningfulFPS)
+                fprintf(stderr, "Sample: %" PRId64 "/%" PRId64 " (%.2f sps)\r", static_cast<int64_t>(data->completedFrames) * data->audioFrameSamples, static_cast<int64_t>(data->totalFrames) * data->audioFrameSamples, fps);
+            else
+                fprintf(stderr, "Sample: %" PRId64 "/%" PRId64 "\r", static_cast<int64_t>(data->completedFrames) * data->audioFrameSamples, static_cast<int64_t>(data->totalFrames) * data->audioFrameSamples);
+        }
+    }
+
+    if (data->totalFrames == data->completedFrames && data->totalFrames == data->completedAlphaFrames) {
+        std::lock_guard<std::mutex> lock(data->mutex);
+        data->condition.notify_one();
+    }
+}
+
+static bool initializeVideoOutput(VSPipeOutputData *data) {
+    if (data->outputHeaders != VSPipeHeaders::None && data->outputHeaders != VSPipeHeaders::Y4M && data->outputHeaders != VSPipeHeaders::Matroska && data->outputHeaders != VSPipeHeaders::Intermediate) {
+        fprintf(stderr, "Error: can't apply selected header type to video\n");
+        return false;
+    }
+
+    const VSVideoInfo *vi = data->vsapi->getVideoInfo(data->node);
+
+    if (data->outputHeaders == VSPipeHeaders::Y4M && ((vi->format.colorFamily != cfGray && vi->format.colorFamily != cfYUV) || data->alphaNode)) {
+        fprintf(stderr, "Error: can only apply y4m headers to YUV and Gray format clips without alpha\n");
+        return false;
+    }
+
+    if (data->outputHeaders == VSPipeHeaders::Y4M) {
+        char header[256];
+        int headerSize = vsfwGetY4MHeader(vi, header, sizeof(header));
+        if (headerSize < 0) {
+            fprintf(stderr, "Error: no y4m identifier exists for current format\n");
+            return false;
+        }
+
+        if (data->outFile && data->writeStreamHeader) {
+            if (fwrite(header, 1, headerSize, data->outFile) != static_cast<size_t>(headerSize)) {
+                fprintf(stderr, "Error: fwrite() call failed when writing initial header, errno: %d\n", errno);
+                return false;
+            }
+        }
+    }
+
+    if (data->outputHeaders == VSPipeHeaders::Intermediate) {
+        if (data->alphaNode) {
+            fprintf(stderr, "Error: can't write clips with alpha to vsli\n");
+            return false;
+        }
+
+        std::vector<uint8_t> header;
+        writeIntermediateHeader(vi, header);
+        data->intermediateOffset = header.size();
+        if (data->outFile && data->writeStreamHeader && fwrite(header.data(), 1, header.size(), data->outFile) != header.size()) {
+            fprintf(stderr, "Error: fwrite() call failed when writing initial header, errno: %d\n", errno);
+            return false;
+        }
+    }
+
+    if (data->timecodesFile && data->writeStreamHeader && !data->outputError) {
+        if (fprintf(data->timecodesFile, "# timecode format v2\n") < 0) {
+            fprintf(stderr, "Error: failed to write timecodes file header, errno: %d\n", errno);
+            return false;
+        }
+    }
+
+    if (data->outputHeaders == VSPipeHeaders::Matroska && !writeMatroskaHeader(data))
+        return false;
+
+    // room for every plane and an alpha plane since the whole frame is handed to the writer at once
+    data->buffer.resize((vi->format.numPlanes + 1) * static_cast<size_t>(vi->width) * vi->height * vi->format.bytesPerSample);
+    if (data->muxAudioNode) {
+        const VSAudioInfo *ai = data->vsapi->getAudioInfo(data->muxAudioNode);
+        data->buffer.resize(std::max<size_t>(data->buffer.size(), static_cast<size_t>(ai->format.numChannels) * data->vsapi->getAudioFrameSamples(data->muxAudioNode) * ai->format.bytesPerSample));
+    }
+    return true;
+}
+
+static bool initializeAudioOutput(VSPipeOutputData *data) {
+    if (data->outputHeaders != VSPipeHeaders::None && data->outputHeaders != VSPipeHeaders::WAVE && data->outputHeaders != VSPipeHeaders::WAVE64 && data->outputHeaders != VSPipeHeaders::Matroska) {
+        fprintf(stderr, "Error: can't apply apply selected header type to audio\n");
+        return false;
+    }
+
+    const VSAudioInfo *ai = data->vsapi->getAudioInfo(data->node);
+
+    if (data->outputHeaders == VSPipeHeaders::WAVE64) {
+        Wave64Header header;
+        if (!CreateWave64Header(header, ai->format.sampleType == stFloat, ai->format.bitsPerSample, ai->sampleRate, ai->format.channelLayout, ai->numSamples)) {
+            fprintf(stderr, "Error: cannot create valid w64 header\n");
+            return false;
+        }
+        if (data->outFile && data->writeStreamHeader) {
+            if (fwrite(&header, 1, sizeof(header), data->outFile) != sizeof(header)) {
+                fprintf(stderr, "Error: fwrite() call failed when writing initial header, errno: %d\n", errno);
+                return false;
+            }
+        }
+    } else if (data->outputHeaders == VSPipeHeaders::WAVE) {
+        WaveHeader header;
+        if (!CreateWaveHeader(header, ai->format.sampleType == stFloat, ai->format.bitsPerSample, ai->sampleRate, ai->format.channelLayout, ai->numSamples)) {
+            fprintf(stderr, "Error: cannot create valid wav header\n");
+            return false;
+        }
+
+        if (data->outFile && data->writeStreamHeader) {
+            if (fwrite(&header, 1, sizeof(header), data->outFile) != sizeof(header)) {
+                fprintf(stderr, "Error: fwrite() call failed when writing initial header, errno: %d\n", errno);
+                return false;
+            }
+        }
+    } else if (data->outputHeaders == VSPipeHeaders::Matroska && !writeMatroskaHeader(data)) {
+        return false;
+    }
+
+    data->audioFrameSamples = data->vsapi->getAudioFrameSamples(data->node);
+    data->buffer.resize(static_cast<size_t>(ai->format.numChannels) * data->audioFrameSamples * ai->format.bytesPerSample);
+    return true;
+}
+
+static void startOutput(int requests, VSPipeOutputData *data) {
+    // output is always linear which allows the core to work ahead when it's idle
+    data->vsapi->setNodeAccessPattern(data->node, apLinear, requests);
+    if (data->alphaNode)
+        data->vsapi->setNodeAccessPattern(data->alphaNode, apLinear, requests);
+
+    data->startTime = std::chrono::steady_clock::now();
+    data->lastFPSReportTime = std::chrono::steady_clock::now();
+
+    data->requests = requests;
+    data->reorderRing.resize(requests);
+    data->writeQueue.resize(requests);
+
+    // everything before the first frame is already in the output when resuming
+    data->outputFrames = data->completedFrames = data->completedAlphaFrames = data->writtenFrames = data->firstFrame;
+    data->renderedFrames = data->firstFrame;
+
+    data->writerThread = std::thread(writerLoop, data);
+
+    if (data->benchmarkWarmup >= 0) {
+        data->requestTimes.resize(data->totalFrames);
+        data->steadyStartTime = data->startTime;
+    }
+
+    std::lock_guard<std::mutex> lock(data->mutex);
+
+    int intitalRequestEnd = std::min(data->firstFrame + requests, data->totalFrames);
+    data->requestedFrames = intitalRequestEnd;
+    for (int n = data->firstFrame; n < intitalRequestEnd; n++)
+        requestFrame(n, data);
+}
+
+static bool finishOutput(VSPipeOutputData *data) {
+    std::unique_lock<std::mutex> lock(data->mutex);
+    if (data->totalFrames != data->completedFrames || data->totalFrames != data->completedAlphaFrames)
+        data->condition.wait(lock);
+
+    // We must check for spurious wakeups (e.g. SIGINT received), and do *not* proceed to cleanup:
+    // the worker threads might still be running, and cleaning up will probably just trigger SIGSEGV
+    // in the worker threads.
+    if (data->totalFrames != data->completedFrames || data->totalFrames != data->completedAlphaFrames) {
+        fprintf(stderr, "Interrupted\n");
+        exit(1);
+    }
+
+    {
+        std::lock_guard<std::mutex> writerLock(data->writerMutex);
+        data->writerStop = true;
+        data->writerCondition.notify_all();
+    }
+    data->writerThread.join();
+
+    if (data->writeError) {
+        data->outputError = true;
+        if (data->errorMessage.empty())
+            data->errorMessage = data->writeErrorMessage;
+    }
+
+    if (data->outputError) {
+        for (auto &iter : data->reorderRing) {
+            data->vsapi->freeFrame(iter.first);
+            data->vsapi->freeFrame(iter.second);
+        }
+        fprintf(stderr, "%s\n", data->errorMessage.c_str());
+    }
+
+    return data->outputError;
+}
+
+/////////////////////////////////////////////
+// Live metrics
+
+// --metrics-file rewrites a JSON file every --metrics-interval seconds and --metrics-port answers HTTP requests with the
+// same numbers in the Prometheus text format. Both only read atomic counters in the core so they don't slow down the render.
+class VSPipeMetricsExporter {
+private:
+    const VSPipeOptions &opts;
+    VSPipeOutputData *data;
+    VSCore *core;
+    std::thread thread;
+    std::atomic<bool> stop{false};
+    std::mutex stopMutex;
+    std::condition_variable stopCondition;
+    int listenFd = -1;
+    int lastFrames = 0;
+    std::chrono::time_point<std::chrono::steady_clock> lastTime;
+
+    RenderMetrics sample() {
+        const VSAPI *vsapi = data->vsapi;
+        auto now = std::chrono::steady_clock::now();
+
+        RenderMetrics m = {};
+        m.framesRendered = data->renderedFrames;
+        m.totalFrames = data->totalFrames;
+        m.elapsedSeconds = std::chrono::duration<double>(now - data->startTime).count();
+        double interval = std::chrono::duration<double>(now - lastTime).count();
+        m.fps = interval > 0 ? (m.framesRendered - lastFrames) / interval : 0;
+        lastFrames = m.framesRendered;
+        lastTime = now;
+
+        VSCoreInfo info;
+        vsapi->getCoreInfo(core, &info);
+        m.memoryUse = info.usedFramebufferSize;
+        m.memoryLimit = info.maxFramebufferSize;
+        vsapi->getCoreStats(core, &m.core);
+        return m;
+    }
+
+    void writeFile() {
+        std::string s = printMetricsJSON(data->node, sample(), data->vsapi);
+        // written next to the file and renamed over it so a reader never sees half of it
+        nstring tmpName = opts.metricsFilename + NSTRING(".tmp");
+#ifdef VS_TARGET_OS_WINDOWS
+        FILE *f = _wfopen(tmpName.c_str(), L"wb");
+#else
+        FILE *f = fopen(tmpName.c_str(), "wb");
+#endif
+        if (!f)
+            return;
+        bool ok = fwrite(s.data(), 1, s.size(), f) == s.size();
+        ok = !fclose(f) && ok;
+#ifdef VS_TARGET_OS_WINDOWS
+        if (ok)
+            MoveFileExW(tmpName.c_str(), opts.metricsFilename.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+        if (ok)
+            rename(tmpName.c_str(), opts.metricsFilename.c_str());
+#endif
+    }
+
+#ifndef VS_TARGET_OS_WINDOWS
+    void serveRequest(int fd) {
+        // whoever scrapes gets a second to send the request line
+        timeval timeout = { 1, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0)
+                break;
+            request.append(buffer, n);
+        }
+
+        std::string status = "200 OK";
+        std::string body;
+        if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0)
+            body = printMetricsPrometheus(data->node, sample(), data->vsapi);
+        else
+            status = "404 Not Found";
+
+        std::string reply = "HTTP/1.0 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        sendAll(fd, reply.data(), reply.size());
+        close(fd);
+    }
+#endif
+
+    void run() {
+        auto nextWrite = std::chrono::steady_clock::now();
+        auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(opts.metricsInterval));
+
+        while (!stop) {
+            if (!opts.metricsFilename.empty() && std::chrono::steady_clock::now() >= nextWrite) {
+                writeFile();
+                nextWrite += interval;
+            }
+
+#ifndef VS_TARGET_OS_WINDOWS
+            if (listenFd >= 0) {
+                pollfd pfd = { listenFd, POLLIN, 0 };
+                if (poll(&pfd, 1, 100) > 0) {
+                    int fd = accept(listenFd, nullptr, nullptr);
+                    if (fd >= 0)
+                        serveRequest(fd);
+                }
+                continue;
+            }
+#endif
+
+            std::unique_lock<std::mutex> lock(stopMutex);
+            stopCondition.wait_until(lock, nextWrite, [this] { return stop.load(); });
+        }
+
+        // the last state of the file is the finished render
+        if (!opts.metricsFilename.empty())
+            writeFile();
+    }
+public:
+    VSPipeMetricsExporter(const VSPipeOptions &opts, VSPipeOutputData *data, VSCore *core) : opts(opts), data(data), core(core) {
+        lastTime = data->startTime;
+    }
+
+    bool start() {
+#ifndef VS_TARGET_OS_WINDOWS
+        if (!opts.metricsAddress.empty()) {
+            signal(SIGPIPE, SIG_IGN);
+            // only a port means the local machine, the metrics aren't meant for the whole network
+            std::string address = opts.metricsAddress.find(':') == std::string::npos ? "127.0.0.1:" + opts.metricsAddress : opts.metricsAddress;
+            std::string error;
+            listenFd = openRemoteSocket(address, true, error);
+            if (listenFd < 0) {
+                fprintf(stderr, "Failed to start the metrics endpoint: %s\n", error.c_str());
+                return false;
+            }
+        }
+#endif
+        thread = std::thread(&VSPipeMetricsExporter::run, this);
+        return true;
+    }
+
+    ~VSPipeMetricsExporter() {
+        {
+            std::lock_guard<std::mutex> lock(stopMutex);
+            stop = true;
+        }
+        stopCondition.notify_all();
+        if (thread.joinable())
+            thread.join();
+#ifndef VS_TARGET_OS_WINDOWS
+        if (listenFd >= 0)
+            close(listenFd);
+#endif
+    }
+};
+
+// Renders all outputs at the same time so nodes they share are only processed once, returns true on error
+static bool outputNodes(const VSPipeOptions &opts, const std::vector<VSPipeOutputData *> &outputs, VSCore *core) {
+    int requests = opts.requests;
+    if (requests < 1) {
+        VSCoreInfo info;
+        outputs[0]->vsapi->getCoreInfo(core, &info);
+        requests = std::max(1, info.numThreads / static_cast<int>(outputs.size()));
+    }
+
+    for (auto data : outputs)
+        startOutput(requests, data);
+
+    std::unique_ptr<VSPipeMetricsExporter> metrics;
+    if (!opts.metricsFilename.empty() || !opts.metricsAddress.empty()) {
+        metrics.reset(new VSPipeMetricsExporter(opts, outputs[0], core));
+        if (!metrics->start())
+            metrics.reset();
+    }
+
+    bool error = false;
+    for (auto data : outputs)
+        error = finishOutput(data) || error;
+    return error;
+}
+
+static const char *colorFamilyToString(int colorFamily) {
+    switch (colorFamily) {
+    case cfGray: return "Gray";
+    case cfRGB: return "RGB";
+    case cfYUV: return "YUV";
+    }
+    return "Error";
+}
+
+static bool nstringToInt64(const nstring &ns, int64_t &result) {
+    size_t pos = 0;
+    std::string s = nstringToUtf8(ns);
+    try {
+        result = std::stoll(s, &pos);
+    } catch (std::invalid_argument &) {
+        return false;
+    } catch (std::out_of_range &) {
+        return false;
+    }
+    return pos == s.length();
+}
+
+static bool nstringToInt(const nstring &ns, int &result) {
+    size_t pos = 0;
+    std::string s = nstringToUtf8(ns);
+    try {
+        result = std::stoi(s, &pos);
+    } catch (std::invalid_argument &) {
+        return false;
+    } catch (std::out_of_range &) {
+        return false;
+    }
+    return pos == s.length();
+}
+
+// Returns stdout for "-", nullptr and no error for "." and otherwise opens the file, an existing file is kept as it is to be updated when resuming
+static bool openOutputFile(const nstring &filename, FILE *&file, bool &closeFile, bool update = false) {
+    file = nullptr;
+    closeFile = false;
+
+    if (filename.empty() || filename == NSTRING("-")) {
+        file = stdout;
+    } else if (filename == NSTRING(".")) {
+        // do nothing
+    } else {
+#ifdef VS_TARGET_OS_WINDOWS
+        file = _wfopen(filename.c_str(), update ? L"r+b" : L"wb");
+#else
+        file = fopen(filename.c_str(), update ? "r+b" : "wb");
+#endif
+        if (!file)
+            return false;
+        closeFile = true;
+    }
+
+    return true;
+}
+
+// Applies the start and end options to node, takes ownership of it and returns nullptr on error
+static VSNode *trimOutputNode(const VSPipeOptions &opts, VSNode *node, VSCore *core, const VSAPI *vsapi) {
+    if (opts.startPos == 0 && opts.endPos == -1)
+        return node;
+
+    VSMap *args = vsapi->createMap();
+    vsapi->mapConsumeNode(args, "clip", node, maAppend);
+    if (opts.startPos != 0)
+        vsapi->mapSetInt(args, "first", opts.startPos, maAppend);
+    if (opts.endPos > -1)
+        vsapi->mapSetInt(args, "last", opts.endPos, maAppend);
+    VSMap *result = vsapi->invoke(vsapi->getPluginByID(VSH_STD_PLUGIN_ID, core), (vsapi->getNodeType(node) == mtVideo) ? "Trim" : "AudioTrim", args);
+    vsapi->freeMap(args);
+
+    node = nullptr;
+    if (vsapi->mapGetError(result))
+        fprintf(stderr, "%s\n", vsapi->mapGetError(result));
+    else
+        node = vsapi->mapGetNode(result, "clip", 0, nullptr);
+    vsapi->freeMap(result);
+    return node;
+}
+
+// Fetches the audio to interleave with the video and trims it to the same time range, returns nullptr on error
+static VSNode *createMuxAudioNode(const VSPipeOptions &opts, const VSVideoInfo *vi, VSScript *se, const VSSCRIPTAPI *vssapi, const VSAPI *vsapi) {
+    VSNode *node = vssapi->getOutputNode(se, opts.muxAudioIndex);
+    if (!node || vsapi->getNodeType(node) != mtAudio) {
+        fprintf(stderr, "Failed to retrieve audio output node %d. Invalid index specified?\n", opts.muxAudioIndex);
+        vsapi->freeNode(node);
+        return nullptr;
+    }
+
+    if (opts.startPos == 0 && opts.endPos == -1)
+        return node;
+
+    if (vi->fpsNum <= 0 || vi->fpsDen <= 0) {
+        fprintf(stderr, "Muxed audio can only be trimmed along with constant frame rate video\n");
+        vsapi->freeNode(node);
+        return nullptr;
+    }
+
+    // the sample range covering the selected frames
+    int64_t sampleRate = vsapi->getAudioInfo(node)->sampleRate;
+    VSPipeOptions audioOpts;
+    audioOpts.startPos = opts.startPos * sampleRate * vi->fpsDen / vi->fpsNum;
+    if (opts.endPos > -1)
+        audioOpts.endPos = std::min((opts.endPos + 1) * sampleRate * vi->fpsDen / vi->fpsNum, vsapi->getAudioInfo(node)->numSamples) - 1;
+    return trimOutputNode(audioOpts, node, vssapi->getCore(se), vsapi);
+}
+
+static void freeExtraOutput(VSPipeOutputData *data) {
+    data->vsapi->freeNode(data->node);
+    data->vsapi->freeNode(data->alphaNode);
+    if (data->outFile && data->closeOutFile)
+        fclose(data->outFile);
+}
+
+static std::unique_ptr<VSPipeOutputData> createExtraOutput(const VSPipeOptions &opts, int index, const nstring &filename, int nodeType, VSScript *se, const VSSCRIPTAPI *vssapi, const VSAPI *vsapi) {
+    std::unique_ptr<VSPipeOutputData> data(new VSPipeOutputData());
+    data->vsapi = vsapi;
+    data->outputHeaders = opts.outputHeaders;
+    data->calculateMD5 = opts.calculateMD5;
+    MD5_Init(&data->md5Ctx);
+    data->calculateHash = opts.calculateHash;
+    XXH64_Init(&data->hashCtx, 0);
+
+    data->node = vssapi->getOutputNode(se, index);
+    if (!data->node) {
+        fprintf(stderr, "Failed to retrieve extra output node %d. Invalid index specified?\n", index);
+        return nullptr;
+    }
+    data->alphaNode = vssapi->getOutputAlphaNode(se, index);
+
+    data->node = trimOutputNode(opts, data->node, vssapi->getCore(se), vsapi);
+    if (!data->node || vsapi->getNodeType(data->node) != nodeType) {
+        if (data->node)
+            fprintf(stderr, "Extra output %d must be the same type of clip as the main output\n", index);
+        freeExtraOutput(data.get());
+        return nullptr;
+    }
+
+    if (data->calculateHash) {
+        data->node = createFrameHashNode(data->node, vssapi->getCore(se), vsapi);
+        if (data->alphaNode)
+            data->alphaNode = createFrameHashNode(data->alphaNode, vssapi->getCore(se), vsapi);
+    }
+
+    if (!openOutputFile(filename, data->outFile, data->closeOutFile)) {
+        fprintf(stderr, "Failed to open extra output %d for writing\n", index);
+        freeExtraOutput(data.get());
+        return nullptr;
+    }
+
+    if (data->outputHeaders == VSPipeHeaders::Intermediate && nodeType == mtVideo)
+        data->node = createIntermediateNode(data->node, vssapi->getCore(se), vsapi);
+
+    bool success;
+    if (nodeType == mtVideo) {
+        const VSVideoInfo *vi = vsapi->getVideoInfo(data->node);
+        if (!isConstantVideoFormat(vi)) {
+            fprintf(stderr, "Cannot output clips with varying dimensions\n");
+            freeExtraOutput(data.get());
+            return nullptr;
+        }
+        data->totalFrames = vi->numFrames;
+        success = initializeVideoOutput(data.get());
+    } else {
+        const VSAudioInfo *ai = vsapi->getAudioInfo(data->node);
+        data->totalFrames = ai->numFrames;
+        data->totalSamples = ai->numSamples;
+        success = initializeAudioOutput(data.get());
+    }
+
+    if (!success) {
+        freeExtraOutput(data.get());
+        return nullptr;
+    }
+
+    return data;
+}
+
+static VSScript *createScriptEnvironment(int coreFlags, const VSSCRIPTAPI *vssapi, const VSAPI *vsapi) {
+    VSCore *core = vsapi->createCore(coreFlags);
+    vsapi->addLogHandler(logMessageHandler, nullptr, nullptr, core);
+    return vssapi->createScript(core);
+}
+
+// An environment prepared in advance is used and cleared when no core flags are needed
+static VSScript *evaluateScript(const VSPipeOptions &opts, int coreFlags, VSScript **preparedScript, const VSSCRIPTAPI *vssapi, const VSAPI *vsapi) {
+    VSScript *se;
+    if (preparedScript && *preparedScript && !coreFlags) {
+        se = *preparedScript;
+        *preparedScript = nullptr;
+    } else {
+        se = createScriptEnvironment(coreFlags, vssapi, vsapi);
+    }
+
+    if (opts.proxyScale > 1)
+        vsapi->setProxyScale(vssapi->getCore(se), opts.proxyScale);
+    vssapi->evalSetWorkingDir(se, opts.preserveCwd ? 0:1);
+    if (!opts.scriptArgs.empty()) {
+        VSMap *foldedArgs = vsapi->createMap();
+        for (const auto &iter : opts.scriptArgs)
+            vsapi->mapSetData(foldedArgs, iter.first.c_str(), iter.second.c_str(), static_cast<int>(iter.second.size()), dtUtf8, maAppend);
+        vssapi->setVariables(se, foldedArgs);
+        vsapi->freeMap(foldedArgs);
+    }
+    vssapi->evaluateFile(se, nstringToUtf8(opts.scriptFilename).c_str());
+    return se;
+}
+
+/////////////////////////////////////////////
+// Segments
+
+// The range is split into segments that are rendered by independent script environments at the same time,
+// either into separate files or concatenated in order into the output
+
+static bool isSegmentFilePattern(const nstring &filename) {
+    return filename.find(NSTRING("%d")) != nstring::npos;
+}
+
+static nstring segmentFilename(const nstring &pattern, int segment) {
+    nstring number;
+    for (char c : std::to_string(segment))
+        number.push_back(c);
+    nstring filename = pattern;
+    filename.replace(filename.find(NSTRING("%d")), 2, number);
+    return filename;
+}
+
+struct VSPipeSegment {
+    int64_t first = 0;
+    int64_t last = -1;
+    VSScript *se = nullptr;
+    FILE *outFile = nullptr;
+    bool closeOutFile = false;
+    bool success = false;
+};
+
+static bool renderSegment(const VSPipeOptions &opts, const VSPipeSegment &segment, bool writeStreamHeader, const VSSCRIPTAPI *vssapi, const VSAPI *vsapi) {
+    VSPipeOptions segmentOpts = opts;
+    segmentOpts.startPos = segment.first;
+    segmentOpts.endPos = segment.last;
+    VSCore *core = vssapi->getCore(segment.se);
+
+    std::unique_ptr<VSPipeOutputData> data(new VSPipeOutputData());
+    data->vsapi = vsapi;
+    data->outputHeaders = opts.outputHeaders;
+    data->writeStreamHeader = writeStreamHeader;
+    data->outFile = segment.outFile;
+
+    data->node = vssapi->getOutputNode(segment.se, opts.outputIndex);
+    VSNode *alphaNode = vssapi->getOutputAlphaNode(segment.se, opts.outputIndex);
+    if (data->node)
+        data->node = trimOutputNode(segmentOpts, data->node, core, vsapi);
+    if (alphaNode)
+        data->alphaNode = trimOutputNode(segmentOpts, alphaNode, core, vsapi);
+    if (data->node && data->outFile && opts.outputHeaders == VSPipeHeaders::Intermediate && vsapi->getNodeType(data->node) == mtVideo)
+        data->node = createIntermediateNode(data->node, core, vsapi);
+
+    bool success = data->node && (!alphaNode || data->alphaNode);
+    if (success && vsapi->getNodeType(data->node) == mtVideo) {
+        data->totalFrames = vsapi->getVideoInfo(data->node)->numFrames;
+        success = initializeVideoOutput(data.get());
+    } else if (success) {
+        const VSAudioInfo *ai = vsapi->getAudioInfo(data->node);
+        data->totalFrames = ai->numFrames;
+        data->totalSamples = ai->numSamples;
+        success = initializeAudioOutput(data.get());
+    }
+
+    if (success)
+        success = !outputNodes(segmentOpts, { data.get() }, core);
+
+    vsapi->freeNode(data->node);
+    vsapi->freeNode(data->alphaNode);
+    return success;
+}
+
+static bool appendFile(FILE *src, FILE *dst) {
+    std::vector<uint8_t> buffer(1 << 20);
+    rewind(src);
+    size_t size;
+    while ((size = fread(buffer.data(), 1, buffer.size(), src)) > 0) {
+        if (fwrite(buffer.data(), 1, size, dst) != size)
+            return false;
+    }
+    return !ferror(src);
+}
+
+// Renders the selected range as segments, the first one uses the already evaluated script
+static bool outputSegments(const VSPipeOptions &opts, int coreFlags, VSScript *se, FILE *outFile, const VSSCRIPTAPI *vssapi, const VSAPI *vsapi) {
+    VSNode *node = vssapi->getOutputNode(se, opts.outputIndex);
+    int64_t length = (vsapi->getNodeType(node) == mtVideo) ? vsapi->getVideoInfo(node)->numFrames : vsapi->getAudioInfo(node)->numSamples;
+    int64_t first = opts.startPos;
+    int64_t last = (opts.endPos > -1) ? opts.endPos : length - 1;
+    if (first < 0 || first > last || last >= length) {
+        fprintf(stderr, "Invalid range of frames or samples to output specified\n");
+        vsapi->freeNode(node);
+        return false;
+    }
+
+    bool segmentFiles = isSegmentFilePattern(opts.outputFilename);
+
+    // a concatenated y4m stream has a single header describing the whole range
+    if (!segmentFiles && opts.outputHeaders == VSPipeHeaders::Y4M) {
+        VSPipeOutputData headerData;
+        headerData.vsapi = vsapi;
+        headerData.outputHeaders = opts.outputHeaders;
+        headerData.outFile = outFile;
+        headerData.node = trimOutputNode(opts, node, vssapi->getCore(se), vsapi);
+        node = nullptr;
+        bool success = headerData.node && initializeVideoOutput(&headerData);
+        vsapi->freeNode(headerData.node);
+        if (!success)
+            return false;
+    }
+    vsapi->freeNode(node);
+
+    int numSegments = static_cast<int>(std::min<int64_t>(opts.segments, last - first + 1));
+    VSCoreInfo info;
+    vsapi->getCoreInfo(vssapi->getCore(se), &info);
+    int threads = std::max(1, info.numThreads / numSegments);
+
+    std::vector<VSPipeSegment> segments(numSegments);
+    bool success = true;
+    for (int i = 0; i < numSegments && success; i++) {
+        VSPipeSegment &segment = segments[i];
+        segment.first = first + (last - first + 1) * i / numSegments;
+        segment.last = first + (last - first + 1) * (i + 1) / numSegments - 1;
+
+        segment.se = (i == 0) ? se : evaluateScript(opts, coreFlags, nullptr, vssapi, vsapi);
+        if (vssapi->getError(segment.se)) {
+            fprintf(stderr, "Script evaluation failed for segment %d:\n%s\n", i, vssapi->getError(segment.se));
+            success = false;
+            break;
+        }
+        vsapi->setThreadCount(threads, vssapi->getCore(segment.se));
+
+        if (segmentFiles) {
+            success = openOutputFile(segmentFilename(opts.outputFilename, i), segment.outFile, segment.closeOutFile);
+        } else if (i == 0 || !outFile) {
+            segment.outFile = outFile;
+        } else {
+            segment.outFile = tmpfile();
+            segment.closeOutFile = true;
+            success = !!segment.outFile;
+        }
+
+        if (!success)
+            fprintf(stderr, "Failed to open output for segment %d\n", i);
+    }
+
+    std::vector<std::thread> renderThreads;
+    if (success) {
+        for (auto &iter : segments) {
+            bool writeStreamHeader = segmentFiles || opts.outputHeaders != VSPipeHeaders::Y4M;
+            renderThreads.emplace_back([&opts, &iter, writeStreamHeader, vssapi, vsapi] { iter.success = renderSegment(opts, iter, writeStreamHeader, vssapi, vsapi); });
+        }
+    }
+
+    // the temporary files are appended as soon as each segment is done since they finish roughly in order
+    for (size_t i = 0; i < renderThreads.size(); i++) {
+        renderThreads[i].join();
+        success = success && segments[i].success;
+        if (success && segments[i].outFile && !segmentFiles && i > 0 && !appendFile(segments[i].outFile, outFile)) {
+            fprintf(stderr, "Error: failed to append segment %d to the output, errno: %d\n", static_cast<int>(i), errno);
+            success = false;
+        }
+    }
+
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (segments[i].outFile && segments[i].closeOutFile)
+            fclose(segments[i].outFile);
+        if (i > 0 && segments[i].se)
+            vssapi->freeScript(segments[i].se);
+    }
+
+    return success;
+}
+
+static bool printVersion(const VSAPI *vsapi) {
+    VSCore *core = vsapi->createCore(0);
+    if (!core) {
+        fprintf(stderr, "Failed to create core\n");
+        return false;
+    }
+
+    VSCoreInfo info;
+    vsapi->getCoreInfo(core, &info);
+    printf("%s", info.versionString);
+    vsapi->freeCore(core);
+    return true;
+}
+
+static void printHelp() {
+    fprintf(stderr,
+        "VSPipe R" XSTR(VAPOURSYNTH_CORE_VERSION) " usage:\n"
+        "  vspipe [options] <script> <outfile>\n"
+        "\n"
+        "Available options:\n"
+        "  -a, --arg key=value              Argument to pass to the script environment\n"
         "  -s, --start N                    Set output frame/sample range start\n"
         "  -e, --end N                      Set output frame/sample range end (inclusive)\n"
         "  -o, --outputindex N              Select output index\n"
+        "      --extra-output N FILE        Also write output index N to FILE, can be given several times\n"
         "  -r, --requests N                 Set number of concurrent frame requests\n"
-        "  -c, --container <y4m/wav/w64>    Add headers for the specified format to the output\n"
+        "      --benchmark N                Discard the output and write steady state performance as JSON to the output file after N warm-up frames\n"
+        "      --shm NAME                   Publish the frames in the shared memory ring /NAME, see VSPipeShm.h\n"
+        "      --segments N                 Render N parts of the range with independent script instances at once\n"
+        "  -c, --container <y4m/wav/w64/mkv/vsli> Add headers for the specified format to the output, vsli is losslessly compressed video for IntermediateSource\n"
+        "      --mux-audio N                Interleave audio output index N with the video in mkv output\n"
         "  -c, --preserve-cwd               Don't temporarily change the working directory the script path\n"
         "  -t, --timecodes FILE             Write timecodes v2 file\n"
+        "      --xxh64                      Print a hash of the frame contents calculated in parallel, faster than --md5\n"
+        "      --hash-list FILE             Write the hash of every frame to FILE, implies --xxh64\n"
+        "      --checkpoint FILE            Periodically record how much of the output is complete in FILE\n"
+        "      --checkpoint-interval SECONDS How often the checkpoint is written, default 60\n"
+        "      --resume                     Continue the render recorded in the --checkpoint file\n"
         "  -p, --progress                   Print progress to stderr\n"
         "      --filter-time                Prints time spent in individual filters after processing\n"
+        "      --perf-counters              Adds hardware performance counters to the --filter-time output (Linux only)\n"
+        "      --critical-path              Prints the chain of filters that bounds throughput and the slack of every filter after processing\n"
+        "      --filter-stats FILE          Write per filter latency and queue statistics as JSON after processing\n"
+        "      --trace FILE                 Record a timeline of all filter calls and write it as Chrome trace JSON\n"
+        "      --metrics-file FILE          Rewrite FILE with the progress, memory use, thread pool and per filter statistics as JSON while rendering\n"
+        "      --metrics-port [HOST:]PORT   Serve the same statistics in the Prometheus text format over HTTP, on localhost when only a port is given (not on Windows)\n"
+        "      --metrics-interval SECONDS   How often the metrics file is written, default 10\n"
+        "      --adaptive-threads           Adjust the number of running threads to maximize the output frame rate\n"
+        "      --numa                       Pin worker threads to NUMA nodes and use node local frame pools\n"
+        "      --topology                   Pin worker threads to P-cores first and leave light work to E-cores and SMT siblings\n"
+        "      --streaming-caches           Only cache the inputs of filters that reuse frames and give them the memory of the others\n"
+        "      --frame-guard                Check a sample of the frames for filters writing outside them\n"
+        "      --proxy N                    Evaluate the script at 1/N of the source resolution for quick previews\n"
+        "      --props-only                 Only compute frame properties when the output is discarded\n"
+        "      --serve [HOST:]PORT          Serve the output frames over TCP to std.RemoteClip instead of writing them\n"
         "  -i, --info                       Show output node info and exit\n"
         "  -g  --graph <simple/full>        Print output node filter graph in dot format and exit\n"
+        "  -g  --graph snapshot             Write the calls that create the output node to the output file so it can be loaded without running the script and exit\n"
         "  -v, --version                    Show version info and exit\n"
+        "      --server SOCKET              Wait for jobs on a unix socket with a core and its plugins loaded in advance, must be the only option\n"
+        "      --connect SOCKET ...         Run the rest of the arguments as a job in a server, must be the first option\n"
         "\n"
         "Examples:\n"
         "  Show script info:\n"
@@ -676,6 +2216,21 @@ static void printHelp() {
         "    vspipe --start 5 --end 100 script.vpy output.raw\n"
         "  Pass values to a script:\n"
         "    vspipe --arg deinterlace=yes --arg \"message=fluffy kittens\" script.vpy output.raw\n"
+        "  Write outputs 0 and 1 at the same time:\n"
+        "    vspipe -c y4m script.vpy out0.y4m --extra-output 1 out1.y4m\n"
+        "  Render in 4 parallel segments, concatenated or as out0.y4m to out3.y4m:\n"
+        "    vspipe -c y4m --segments 4 script.vpy out.y4m\n"
+        "    vspipe -c y4m --segments 4 script.vpy out%%d.y4m\n"
+        "  Print throughput after 100 warm-up frames as JSON:\n"
+        "    vspipe --benchmark 100 script.vpy -\n"
+        "  Keep plugins loaded in a server and run jobs in it (not on Windows):\n"
+        "    vspipe --server /tmp/vspipe.sock\n"
+        "    vspipe --connect /tmp/vspipe.sock -c y4m script.vpy -\n"
+        "  Write video and audio to a single raw matroska file:\n"
+        "    vspipe -c mkv --mux-audio 1 script.vpy output.mkv\n"
+        "  Render with a checkpoint every 5 minutes and continue after an interruption:\n"
+        "    vspipe -c y4m --checkpoint out.ckpt --checkpoint-interval 300 script.vpy out.y4m\n"
+        "    vspipe -c y4m --checkpoint out.ckpt --resume script.vpy out.y4m\n"
         "  Pipe to x264 and write timecodes file:\n"
         "    vspipe script.vpy - -c y4m --timecodes timecodes.txt | x264 --demuxer y4m -o script.mkv -\n"
         );
@@ -710,6 +2265,10 @@ static int parseOptions(VSPipeOptions &opts, int argc, T **argv) {
                 opts.outputHeaders = VSPipeHeaders::WAVE;
             } else if (nstringToUtf8(argv[arg + 1]) == "w64") {
                 opts.outputHeaders = VSPipeHeaders::WAVE64;
+            } else if (nstringToUtf8(argv[arg + 1]) == "mkv") {
+                opts.outputHeaders = VSPipeHeaders::Matroska;
+            } else if (nstringToUtf8(argv[arg + 1]) == "vsli") {
+                opts.outputHeaders = VSPipeHeaders::Intermediate;
             } else {
                 if (argString == NSTRING("-c")) {
                     opts.preserveCwd = true;
@@ -727,10 +2286,63 @@ static int parseOptions(VSPipeOptions &opts, int argc, T **argv) {
             opts.printProgress = true;
         } else if (argString == NSTRING("--md5")) {
             opts.calculateMD5 = true;
+        } else if (argString == NSTRING("--xxh64")) {
+            opts.calculateHash = true;
+        } else if (argString == NSTRING("--hash-list")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No hash list file specified\n");
+                return 1;
+            }
+
+            opts.calculateHash = true;
+            opts.hashListFilename = argv[arg + 1];
+
+            arg++;
+        } else if (argString == NSTRING("--checkpoint")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No checkpoint file specified\n");
+                return 1;
+            }
+
+            opts.checkpointFilename = argv[arg + 1];
+
+            arg++;
+        } else if (argString == NSTRING("--checkpoint-interval")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No checkpoint interval specified\n");
+                return 1;
+            }
+
+            opts.checkpointInterval = atof(nstringToUtf8(argv[arg + 1]).c_str());
+            if (!(opts.checkpointInterval > 0)) {
+                fprintf(stderr, "Couldn't convert %s to a positive number (checkpoint-interval)\n", nstringToUtf8(argv[arg + 1]).c_str());
+                return 1;
+            }
+
+            arg++;
+        } else if (argString == NSTRING("--resume")) {
+            opts.resume = true;
         } else if (argString == NSTRING("--filter-time")) {
             opts.printFilterTime = true;
+        } else if (argString == NSTRING("--perf-counters")) {
+            opts.printFilterTime = true;
+            opts.perfCounters = true;
+        } else if (argString == NSTRING("--critical-path")) {
+            opts.printCriticalPath = true;
+        } else if (argString == NSTRING("--numa")) {
+            opts.numaAware = true;
+        } else if (argString == NSTRING("--topology")) {
+            opts.topologyAware = true;
+        } else if (argString == NSTRING("--streaming-caches")) {
+            opts.streamingCaches = true;
+        } else if (argString == NSTRING("--adaptive-threads")) {
+            opts.adaptiveThreads = true;
+        } else if (argString == NSTRING("--frame-guard")) {
+            opts.frameGuard = true;
+        } else if (argString == NSTRING("--props-only")) {
+            opts.propsOnly = true;
         } else if (argString == NSTRING("-i") || argString == NSTRING("--info")) {
-            if (opts.mode == VSPipeMode::PrintSimpleGraph || opts.mode == VSPipeMode::PrintFullGraph) {
+            if (opts.mode == VSPipeMode::PrintSimpleGraph || opts.mode == VSPipeMode::PrintFullGraph || opts.mode == VSPipeMode::SaveGraphSnapshot) {
                 fprintf(stderr, "Cannot combine graph and info arguments\n");
                 return 1;
             }
@@ -751,6 +2363,8 @@ static int parseOptions(VSPipeOptions &opts, int argc, T **argv) {
                 opts.mode = VSPipeMode::PrintSimpleGraph;
             } else if (nstringToUtf8(argv[arg + 1]) == "full") {
                 opts.mode = VSPipeMode::PrintFullGraph;
+            } else if (nstringToUtf8(argv[arg + 1]) == "snapshot") {
+                opts.mode = VSPipeMode::SaveGraphSnapshot;
             } else {
                 fprintf(stderr, "Unknown graph type specified: %s\n", nstringToUtf8(argv[arg + 1]).c_str());
                 return 1;
@@ -810,32 +2424,175 @@ static int parseOptions(VSPipeOptions &opts, int argc, T **argv) {
             }
 
             arg++;
-        } else if (argString == NSTRING("-r") || argString == NSTRING("--requests")) {
+        } else if (argString == NSTRING("--extra-output")) {
+            if (argc <= arg + 2) {
+                fprintf(stderr, "No output index and file specified for extra output\n");
+                return 1;
+            }
+
+            int index;
+            if (!nstringToInt(argv[arg + 1], index)) {
+                fprintf(stderr, "Couldn't convert %s to an integer (extra output index)\n", nstringToUtf8(argv[arg + 1]).c_str());
+                return 1;
+            }
+
+            opts.extraOutputs.push_back(std::make_pair(index, nstring(argv[arg + 2])));
+
+            arg += 2;
+        } else if (argString == NSTRING("--benchmark")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "Number of warm-up frames not specified\n");
+                return 1;
+            }
+
+            if (!nstringToInt(argv[arg + 1], opts.benchmarkWarmup) || opts.benchmarkWarmup < 0) {
+                fprintf(stderr, "Couldn't convert %s to a valid number (warm-up frames)\n", nstringToUtf8(argv[arg + 1]).c_str());
+                return 1;
+            }
+
+            arg++;
+        } else if (argString == NSTRING("--proxy")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No proxy scale specified\n");
+                return 1;
+            }
+
+            if (!nstringToInt(argv[arg + 1], opts.proxyScale) || opts.proxyScale < 1) {
+                fprintf(stderr, "Couldn't convert %s to a valid number (proxy scale)\n", nstringToUtf8(argv[arg + 1]).c_str());
+                return 1;
+            }
+
+            arg++;
+        } else if (argString == NSTRING("--serve")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No address to serve on specified\n");
+                return 1;
+            }
+
+            if (opts.mode != VSPipeMode::Output) {
+                fprintf(stderr, "Cannot combine serving with info or graph arguments\n");
+                return 1;
+            }
+
+            opts.mode = VSPipeMode::Serve;
+            opts.serveAddress = nstringToUtf8(argv[arg + 1]);
+            arg++;
+        } else if (argString == NSTRING("--shm")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No shared memory name specified\n");
+                return 1;
+            }
+
+            opts.shmName = nstringToUtf8(argv[arg + 1]);
+            if (opts.shmName.empty() || opts.shmName.find('/') != std::string::npos) {
+                fprintf(stderr, "Invalid shared memory name specified: %s\n", opts.shmName.c_str());
+                return 1;
+            }
+
+            arg++;
+        } else if (argString == NSTRING("--segments")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "Number of segments not specified\n");
+                return 1;
+            }
+
+            if (!nstringToInt(argv[arg + 1], opts.segments) || opts.segments < 1) {
+                fprintf(stderr, "Couldn't convert %s to a valid number (segments)\n", nstringToUtf8(argv[arg + 1]).c_str());
+                return 1;
+            }
+
+            arg++;
+        } else if (argString == NSTRING("--mux-audio")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No audio output index specified\n");
+                return 1;
+            }
+
+            if (!nstringToInt(argv[arg + 1], opts.muxAudioIndex) || opts.muxAudioIndex < 0) {
+                fprintf(stderr, "Couldn't convert %s to a valid index (audio output index)\n", nstringToUtf8(argv[arg + 1]).c_str());
+                return 1;
+            }
+
+            arg++;
+        } else if (argString == NSTRING("-r") || argString == NSTRING("--requests")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "Number of requests not specified\n");
+                return 1;
+            }
+
+            if (!nstringToInt(argv[arg + 1], opts.requests)) {
+                fprintf(stderr, "Couldn't convert %s to an integer (requests)\n", nstringToUtf8(argv[arg + 1]).c_str());
+                return 1;
+            }
+
+            arg++;
+        } else if (argString == NSTRING("-a") || argString == NSTRING("--arg")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No argument specified\n");
+                return 1;
+            }
+
+            std::string aLine = nstringToUtf8(argv[arg + 1]).c_str();
+            size_t equalsPos = aLine.find("=");
+            if (equalsPos == std::string::npos) {
+                fprintf(stderr, "No value specified for argument: %s\n", aLine.c_str());
+                return 1;
+            }
+
+            opts.scriptArgs[aLine.substr(0, equalsPos)] = aLine.substr(equalsPos + 1);
+
+            arg++;
+        } else if (argString == NSTRING("--filter-stats")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No filter statistics file specified\n");
+                return 1;
+            }
+
+            opts.filterStatsFilename = argv[arg + 1];
+
+            arg++;
+        } else if (argString == NSTRING("--metrics-file")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No metrics file specified\n");
+                return 1;
+            }
+
+            opts.metricsFilename = argv[arg + 1];
+
+            arg++;
+        } else if (argString == NSTRING("--metrics-port")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No metrics address specified\n");
+                return 1;
+            }
+#ifdef VS_TARGET_OS_WINDOWS
+            fprintf(stderr, "The metrics endpoint isn't available on Windows, use --metrics-file instead\n");
+            return 1;
+#else
+            opts.metricsAddress = nstringToUtf8(argv[arg + 1]);
+#endif
+
+            arg++;
+        } else if (argString == NSTRING("--metrics-interval")) {
             if (argc <= arg + 1) {
-                fprintf(stderr, "Number of requests not specified\n");
+                fprintf(stderr, "No metrics interval specified\n");
                 return 1;
             }
 
-            if (!nstringToInt(argv[arg + 1], opts.requests)) {
-                fprintf(stderr, "Couldn't convert %s to an integer (requests)\n", nstringToUtf8(argv[arg + 1]).c_str());
+            opts.metricsInterval = atof(nstringToUtf8(argv[arg + 1]).c_str());
+            if (!(opts.metricsInterval > 0)) {
+                fprintf(stderr, "Couldn't convert %s to a positive number (metrics-interval)\n", nstringToUtf8(argv[arg + 1]).c_str());
                 return 1;
             }
 
             arg++;
-        } else if (argString == NSTRING("-a") || argString == NSTRING("--arg")) {
+        } else if (argString == NSTRING("--trace")) {
             if (argc <= arg + 1) {
-                fprintf(stderr, "No argument specified\n");
-                return 1;
-            }
-
-            std::string aLine = nstringToUtf8(argv[arg + 1]).c_str();
-            size_t equalsPos = aLine.find("=");
-            if (equalsPos == std::string::npos) {
-                fprintf(stderr, "No value specified for argument: %s\n", aLine.c_str());
+                fprintf(stderr, "No trace file specified\n");
                 return 1;
             }
 
-            opts.scriptArgs[aLine.substr(0, equalsPos)] = aLine.substr(equalsPos + 1);
+            opts.traceFilename = argv[arg + 1];
 
             arg++;
         } else if (argString == NSTRING("-t") || argString == NSTRING("--timecodes")) {
@@ -861,32 +2618,257 @@ static int parseOptions(VSPipeOptions &opts, int argc, T **argv) {
     if (argc <= 1)
         opts.mode = VSPipeMode::PrintHelp;
 
-    if ((opts.mode == VSPipeMode::Output || opts.mode == VSPipeMode::PrintInfo || opts.mode == VSPipeMode::PrintSimpleGraph || opts.mode == VSPipeMode::PrintFullGraph) && opts.scriptFilename.empty()) {
+    if ((opts.mode == VSPipeMode::Output || opts.mode == VSPipeMode::PrintInfo || opts.mode == VSPipeMode::PrintSimpleGraph || opts.mode == VSPipeMode::PrintFullGraph || opts.mode == VSPipeMode::SaveGraphSnapshot || opts.mode == VSPipeMode::Serve) && opts.scriptFilename.empty()) {
         fprintf(stderr, "No script file specified\n");
         return 1;
-    } else if (opts.mode == VSPipeMode::Output && opts.outputFilename.empty()) {
-        fprintf(stderr, "No output file specified\n");
+    }
+
+    if (opts.mode == VSPipeMode::Serve) {
+#ifdef VS_TARGET_OS_WINDOWS
+        fprintf(stderr, "Serving frames is not supported on Windows\n");
         return 1;
+#else
+        // the script is served as is, everything else is up to the clients
+        if (!opts.outputFilename.empty() || !opts.shmName.empty() || opts.startPos != 0 || opts.endPos != -1 || opts.outputHeaders != VSPipeHeaders::None || opts.segments > 1
+            || opts.benchmarkWarmup >= 0 || opts.calculateMD5 || opts.calculateHash || !opts.timecodesFilename.empty() || opts.muxAudioIndex >= 0) {
+            fprintf(stderr, "Serving can't be combined with an output file, containers, ranges, segments, hashes or benchmarking\n");
+            return 1;
+        }
+        // nothing is written to stdout
+        opts.outputFilename = NSTRING(".");
+#endif
     }
 
-    return 0;
-}
+    // frames only go to shared memory unless an output file is given as well
+    if (!opts.shmName.empty() && opts.outputFilename.empty())
+        opts.outputFilename = NSTRING(".");
 
-#ifdef VS_TARGET_OS_WINDOWS
-int wmain(int argc, wchar_t **argv) {
-    if (_setmode(_fileno(stdout), _O_BINARY) == -1)
-        fprintf(stderr, "Failed to set stdout to binary mode\n");
-    SetConsoleCtrlHandler(HandlerRoutine, TRUE);
+    if ((opts.mode == VSPipeMode::Output || opts.mode == VSPipeMode::SaveGraphSnapshot) && opts.outputFilename.empty()) {
+        fprintf(stderr, "No output file specified\n");
+        return 1;
+    } else if (opts.mode != VSPipeMode::Output && !opts.extraOutputs.empty()) {
+        fprintf(stderr, "Extra outputs can only be used when writing output\n");
+        return 1;
+    } else if (opts.muxAudioIndex >= 0 && (opts.mode != VSPipeMode::Output || opts.outputHeaders != VSPipeHeaders::Matroska)) {
+        fprintf(stderr, "Audio can only be muxed when writing mkv output\n");
+        return 1;
+    } else if (!opts.shmName.empty()) {
+#ifdef VSPIPE_HAVE_SHM
+        if (opts.mode != VSPipeMode::Output || opts.segments > 1 || opts.benchmarkWarmup >= 0 || opts.muxAudioIndex >= 0 || opts.outputHeaders != VSPipeHeaders::None) {
+            fprintf(stderr, "Shared memory output can't be combined with containers, segments, muxed audio or benchmarking\n");
+            return 1;
+        }
 #else
-int main(int argc, char **argv) {
+        fprintf(stderr, "Shared memory output is only supported on Linux\n");
+        return 1;
 #endif
+    }
 
-    const VSSCRIPTAPI *vssapi = getVSScriptAPI(VSSCRIPT_API_VERSION);
-    if (!vssapi) {
-        fprintf(stderr, "Failed to initialize VSScript\n");
+    if (opts.resume && opts.checkpointFilename.empty()) {
+        fprintf(stderr, "Resuming requires a checkpoint file\n");
+        return 1;
+    } else if (!opts.checkpointFilename.empty()) {
+        if (opts.mode != VSPipeMode::Output || opts.outputFilename == NSTRING("-") || opts.outputFilename == NSTRING(".")) {
+            fprintf(stderr, "Checkpoints can only be used when writing output to a file\n");
+            return 1;
+        } else if (opts.segments > 1 || !opts.extraOutputs.empty() || opts.outputHeaders == VSPipeHeaders::Matroska || opts.outputHeaders == VSPipeHeaders::Intermediate || !opts.shmName.empty() || opts.benchmarkWarmup >= 0) {
+            fprintf(stderr, "Checkpoints can't be combined with segments, extra outputs, mkv, vsli, shared memory output or benchmarking\n");
+            return 1;
+        }
+    }
+
+    if (opts.benchmarkWarmup >= 0 && (opts.mode != VSPipeMode::Output || opts.segments > 1 || !opts.extraOutputs.empty() || opts.muxAudioIndex >= 0 || !opts.timecodesFilename.empty() || opts.calculateMD5 || opts.calculateHash)) {
+        fprintf(stderr, "Benchmarking can't be combined with segments, extra outputs, muxed audio, timecodes or hashes\n");
         return 1;
+    } else if (opts.segments > 1) {
+        if (opts.mode != VSPipeMode::Output) {
+            fprintf(stderr, "Segments can only be used when writing output\n");
+            return 1;
+        } else if (!opts.extraOutputs.empty() || opts.muxAudioIndex >= 0 || !opts.timecodesFilename.empty() || opts.calculateMD5 || opts.calculateHash || opts.printFilterTime
+            || opts.printCriticalPath || !opts.filterStatsFilename.empty() || !opts.traceFilename.empty() || !opts.metricsFilename.empty() || !opts.metricsAddress.empty()) {
+            fprintf(stderr, "Segments can't be combined with extra outputs, muxed audio, timecodes, hashes, filter statistics or metrics\n");
+            return 1;
+        } else if (!isSegmentFilePattern(opts.outputFilename) && opts.outputHeaders != VSPipeHeaders::None && opts.outputHeaders != VSPipeHeaders::Y4M) {
+            fprintf(stderr, "Only y4m and headerless output can be concatenated from segments, use %%d in the output name to write segment files\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/////////////////////////////////////////////
+// Frame server
+
+// vspipe --serve [HOST:]PORT script.vpy makes the output node available to std.RemoteClip, see vsremote.h for the protocol.
+// Every connection has a reader that requests frames as they're asked for and a writer that sends them back as soon as
+// they're done, so a client can keep as many frames in flight as it likes up to remoteMaxInFlight.
+
+#ifndef VS_TARGET_OS_WINDOWS
+
+static const int remoteMaxInFlight = 64;
+
+struct VSPipeRemoteConnection {
+    int fd;
+    VSNode *node;
+    const VSAPI *vsapi;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<std::tuple<int, const VSFrame *, std::string>> done;
+    int inFlight = 0;
+    bool closing = false;
+};
+
+static void VS_CC remoteFrameDone(void *userData, const VSFrame *f, int n, VSNode *node, const char *errorMsg) {
+    VSPipeRemoteConnection *conn = reinterpret_cast<VSPipeRemoteConnection *>(userData);
+    std::lock_guard<std::mutex> lock(conn->lock);
+    conn->done.emplace_back(n, f, errorMsg ? errorMsg : "");
+    conn->cond.notify_all();
+}
+
+// the reply, properties and planes are copied into a single buffer so they leave in as few packets as possible
+static bool sendRemoteReply(int fd, int n, const VSFrame *frame, const std::string &error, std::vector<uint8_t> &buffer, const VSAPI *vsapi) {
+    VSRemoteReply reply = {};
+    reply.n = n;
+    buffer.resize(sizeof(reply));
+
+    if (!frame) {
+        reply.type = rmError;
+        reply.propSize = static_cast<uint32_t>(error.size());
+        buffer.insert(buffer.end(), error.begin(), error.end());
+    } else {
+        reply.type = rmFrame;
+        serializeRemoteProperties(vsapi->getFramePropertiesRO(frame), buffer, vsapi);
+        reply.propSize = static_cast<uint32_t>(buffer.size() - sizeof(reply));
+
+        const VSVideoFormat *fi = vsapi->getVideoFrameFormat(frame);
+        for (int plane = 0; plane < fi->numPlanes; plane++) {
+            size_t rowSize = static_cast<size_t>(vsapi->getFrameWidth(frame, plane)) * fi->bytesPerSample;
+            int height = vsapi->getFrameHeight(frame, plane);
+            size_t offset = buffer.size();
+            buffer.resize(offset + rowSize * height);
+            vs_copy_plane(buffer.data() + offset, rowSize, vsapi->getReadPtr(frame, plane), vsapi->getStride(frame, plane), rowSize, height, 1, VS_CPU_LEVEL_MAX);
+            reply.frameSize += rowSize * height;
+        }
+    }
+
+    memcpy(buffer.data(), &reply, sizeof(reply));
+    return sendAll(fd, buffer.data(), buffer.size());
+}
+
+static void remoteWriter(VSPipeRemoteConnection *conn) {
+    std::vector<uint8_t> buffer;
+    bool failed = false;
+
+    std::unique_lock<std::mutex> lock(conn->lock);
+    while (true) {
+        conn->cond.wait(lock, [conn] { return !conn->done.empty() || (conn->closing && !conn->inFlight); });
+        if (conn->done.empty())
+            break;
+        auto item = std::move(conn->done.front());
+        conn->done.pop_front();
+        lock.unlock();
+
+        const VSFrame *frame = std::get<1>(item);
+        if (!failed && !sendRemoteReply(conn->fd, std::get<0>(item), frame, std::get<2>(item), buffer, conn->vsapi)) {
+            // wakes up the reader so the connection is closed once everything in flight is done
+            failed = true;
+            shutdown(conn->fd, SHUT_RDWR);
+        }
+        conn->vsapi->freeFrame(frame);
+
+        lock.lock();
+        conn->inFlight--;
+        conn->cond.notify_all();
+    }
+}
+
+static void serveRemoteConnection(int fd, VSNode *node, VSCore *core, const VSAPI *vsapi) {
+    VSPipeRemoteConnection conn;
+    conn.fd = fd;
+    conn.node = node;
+    conn.vsapi = vsapi;
+
+    const VSVideoInfo *vi = vsapi->getVideoInfo(node);
+    VSRemoteHello hello = {};
+    memcpy(hello.magic, remoteMagic, sizeof(hello.magic));
+    hello.version = remoteVersion;
+    hello.formatID = vsapi->queryVideoFormatID(vi->format.colorFamily, vi->format.sampleType, vi->format.bitsPerSample, vi->format.subSamplingW, vi->format.subSamplingH, core);
+    hello.width = vi->width;
+    hello.height = vi->height;
+    hello.numFrames = vi->numFrames;
+    hello.fpsNum = vi->fpsNum;
+    hello.fpsDen = vi->fpsDen;
+
+    if (sendAll(fd, &hello, sizeof(hello))) {
+        std::thread writer(remoteWriter, &conn);
+
+        VSRemoteRequest request;
+        while (recvAll(fd, &request, sizeof(request)) && request.type == rmFrame) {
+            {
+                std::unique_lock<std::mutex> lock(conn.lock);
+                conn.cond.wait(lock, [&conn] { return conn.inFlight < remoteMaxInFlight; });
+                conn.inFlight++;
+            }
+            if (request.n < 0 || request.n >= vi->numFrames)
+                remoteFrameDone(&conn, nullptr, request.n, node, "Requested frame number is out of range");
+            else
+                vsapi->getFrameAsync(request.n, node, remoteFrameDone, &conn);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(conn.lock);
+            conn.closing = true;
+            conn.cond.notify_all();
+        }
+        writer.join();
+    }
+
+    close(fd);
+    vsapi->freeNode(node);
+}
+
+static bool serveFrames(const std::string &address, VSNode *node, VSCore *core, const VSAPI *vsapi) {
+    if (vsapi->getNodeType(node) != mtVideo || !isConstantVideoFormat(vsapi->getVideoInfo(node))) {
+        fprintf(stderr, "Only video with a constant format can be served\n");
+        return false;
+    }
+
+    // a client that goes away only ends its own connection
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string error;
+    int listenFd = openRemoteSocket(address, true, error);
+    if (listenFd < 0) {
+        fprintf(stderr, "Failed to serve frames: %s\n", error.c_str());
+        return false;
+    }
+
+    fprintf(stderr, "Serving frames on %s\n", address.c_str());
+
+    while (true) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Failed to accept connection, errno: %d\n", errno);
+            break;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::thread(serveRemoteConnection, fd, vsapi->addNodeRef(node), core, vsapi).detach();
     }
 
+    close(listenFd);
+    return false;
+}
+
+#endif
+
+// Runs a single vspipe invocation, preparedScript is used for it when possible
+template<typename T>
+static int runVSPipe(int argc, T **argv, VSScript **preparedScript, const VSSCRIPTAPI *vssapi) {
     const VSAPI *vsapi = vssapi->getVSAPI(VAPOURSYNTH_API_VERSION);
     if (!vsapi) {
         fprintf(stderr, "Failed to get VapourSynth API pointer\n");
@@ -908,32 +2890,34 @@ int main(int argc, char **argv) {
     FILE *outFile = nullptr;
     bool closeOutFile = false;
 
-    if (opts.outputFilename.empty() || opts.outputFilename == NSTRING("-")) {
-        outFile = stdout;
-    } else if (opts.outputFilename == NSTRING(".")) {
-        // do nothing
-    } else {
+    // segment files are opened once the segments are known
+    if (!(opts.segments > 1 && isSegmentFilePattern(opts.outputFilename)) && !openOutputFile(opts.outputFilename, outFile, closeOutFile, opts.resume)) {
+        fprintf(stderr, "Failed to open output for writing\n");
+        return 1;
+    }
+
+    FILE *timecodesFile = nullptr;
+    if (opts.mode == VSPipeMode::Output && !opts.timecodesFilename.empty()) {
 #ifdef VS_TARGET_OS_WINDOWS
-        outFile = _wfopen(opts.outputFilename.c_str(), L"wb");
+        timecodesFile = _wfopen(opts.timecodesFilename.c_str(), opts.resume ? L"r+b" : L"wb");
 #else
-        outFile = fopen(opts.outputFilename.c_str(), "wb");
+        timecodesFile = fopen(opts.timecodesFilename.c_str(), opts.resume ? "r+b" : "wb");
 #endif
-        if (!outFile) {
-            fprintf(stderr, "Failed to open output for writing\n");
+        if (!timecodesFile) {
+            fprintf(stderr, "Failed to open timecodes file for writing\n");
             return 1;
         }
-        closeOutFile = true;
     }
 
-    FILE *timecodesFile = nullptr;
-    if (opts.mode == VSPipeMode::Output && !opts.timecodesFilename.empty()) {
+    FILE *hashListFile = nullptr;
+    if (opts.mode == VSPipeMode::Output && !opts.hashListFilename.empty()) {
 #ifdef VS_TARGET_OS_WINDOWS
-        timecodesFile = _wfopen(opts.timecodesFilename.c_str(), L"wb");
+        hashListFile = _wfopen(opts.hashListFilename.c_str(), opts.resume ? L"r+b" : L"wb");
 #else
-        timecodesFile = fopen(opts.timecodesFilename.c_str(), "wb");
+        hashListFile = fopen(opts.hashListFilename.c_str(), opts.resume ? "r+b" : "wb");
 #endif
-        if (!timecodesFile) {
-            fprintf(stderr, "Failed to open timecodes file for writing\n");
+        if (!hashListFile) {
+            fprintf(stderr, "Failed to open hash list file for writing\n");
             return 1;
         }
     }
@@ -947,18 +2931,24 @@ int main(int argc, char **argv) {
     std::chrono::time_point<std::chrono::steady_clock> scriptEvaluationStart = std::chrono::steady_clock::now();
     
 
-    VSCore *core = vsapi->createCore((opts.mode == VSPipeMode::PrintSimpleGraph || opts.mode == VSPipeMode::PrintFullGraph || opts.printFilterTime) ? ccfEnableGraphInspection : 0);
-    vsapi->addLogHandler(logMessageHandler, nullptr, nullptr, core);
-    VSScript *se = vssapi->createScript(core);
-    vssapi->evalSetWorkingDir(se, opts.preserveCwd ? 0:1);
-    if (!opts.scriptArgs.empty()) {
-        VSMap *foldedArgs = vsapi->createMap();
-        for (const auto &iter : opts.scriptArgs)
-            vsapi->mapSetData(foldedArgs, iter.first.c_str(), iter.second.c_str(), static_cast<int>(iter.second.size()), dtUtf8, maAppend);
-        vssapi->setVariables(se, foldedArgs);
-        vsapi->freeMap(foldedArgs);
-    }
-    vssapi->evaluateFile(se, nstringToUtf8(opts.scriptFilename).c_str());
+    int coreFlags = (opts.mode == VSPipeMode::PrintSimpleGraph || opts.mode == VSPipeMode::PrintFullGraph || opts.mode == VSPipeMode::SaveGraphSnapshot || opts.printFilterTime || opts.printCriticalPath || !opts.filterStatsFilename.empty() || opts.benchmarkWarmup >= 0
+        || !opts.metricsFilename.empty() || !opts.metricsAddress.empty()) ? ccfEnableGraphInspection : 0;
+    if (opts.numaAware)
+        coreFlags |= ccfNumaAware;
+    if (opts.topologyAware)
+        coreFlags |= ccfTopologyAware;
+    if (opts.streamingCaches)
+        coreFlags |= ccfStreamingCaches;
+    if (opts.adaptiveThreads)
+        coreFlags |= ccfAdaptiveThreads;
+    if (opts.frameGuard)
+        coreFlags |= ccfFrameGuard;
+    if (!opts.traceFilename.empty())
+        coreFlags |= ccfEnableTracing;
+    if (opts.perfCounters)
+        coreFlags |= ccfEnablePerfCounters;
+    VSScript *se = evaluateScript(opts, coreFlags, preparedScript, vssapi, vsapi);
+    VSCore *core = vssapi->getCore(se);
 
     if (vssapi->getError(se)) {
         int code = vssapi->getExitCode(se);
@@ -983,7 +2973,24 @@ int main(int argc, char **argv) {
 
     bool success = true;
 
-    if (opts.mode == VSPipeMode::PrintSimpleGraph) {
+    if (opts.mode == VSPipeMode::Output && opts.segments > 1) {
+        if (vsapi->getNodeType(node) == mtVideo && !isConstantVideoFormat(vsapi->getVideoInfo(node))) {
+            fprintf(stderr, "Cannot output clips with varying dimensions\n");
+            success = false;
+        } else {
+            std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
+            success = outputSegments(opts, coreFlags, se, outFile, vssapi, vsapi);
+            std::chrono::duration<double> elapsedSeconds = std::chrono::steady_clock::now() - startTime;
+            if (success)
+                fprintf(stderr, "Output %d segments in %.2f seconds\n", opts.segments, elapsedSeconds.count());
+        }
+        if (outFile)
+            fflush(outFile);
+#ifndef VS_TARGET_OS_WINDOWS
+    } else if (opts.mode == VSPipeMode::Serve) {
+        success = serveFrames(opts.serveAddress, node, vssapi->getCore(se), vsapi);
+#endif
+    } else if (opts.mode == VSPipeMode::PrintSimpleGraph) {
         std::string graph = printNodeGraph(true, node, vsapi);
         if (outFile)
             fprintf(outFile, "%s\n", graph.c_str());
@@ -991,32 +2998,43 @@ int main(int argc, char **argv) {
         std::string graph = printNodeGraph(false, node, vsapi);
         if (outFile)
             fprintf(outFile, "%s\n", graph.c_str());
+    } else if (opts.mode == VSPipeMode::SaveGraphSnapshot) {
+        std::vector<GraphSnapshotOutput> outputs = { { opts.outputIndex, node, alphaNode, vssapi->getAltOutputMode(se, opts.outputIndex) } };
+        std::string snapshot;
+        std::string error;
+        if (!saveGraphSnapshot(outputs, snapshot, error, core, vsapi)) {
+            fprintf(stderr, "Failed to save graph snapshot: %s\n", error.c_str());
+            success = false;
+        } else if (outFile && fwrite(snapshot.data(), 1, snapshot.size(), outFile) != snapshot.size()) {
+            fprintf(stderr, "Failed to write graph snapshot, errno: %d\n", errno);
+            success = false;
+        }
     } else {
         int nodeType = vsapi->getNodeType(node);
 
-        if (opts.startPos != 0 || opts.endPos != -1) {
-            VSMap *args = vsapi->createMap();
-            vsapi->mapSetNode(args, "clip", node, maAppend);
-            if (opts.startPos != 0)
-                vsapi->mapSetInt(args, "first", opts.startPos, maAppend);
-            if (opts.endPos > -1)
-                vsapi->mapSetInt(args, "last", opts.endPos, maAppend);
-            VSMap *result = vsapi->invoke(vsapi->getPluginByID(VSH_STD_PLUGIN_ID, vssapi->getCore(se)), (nodeType == mtVideo) ? "Trim" : "AudioTrim", args);
-            vsapi->freeMap(args);
-            if (vsapi->mapGetError(result)) {
-                fprintf(stderr, "%s\n", vsapi->mapGetError(result));
-                vsapi->freeMap(result);
+        node = trimOutputNode(opts, node, vssapi->getCore(se), vsapi);
+        if (!node) {
+            vsapi->freeNode(alphaNode);
+            vssapi->freeScript(se);
+            return 1;
+        }
+
+        std::vector<std::unique_ptr<VSPipeOutputData>> extraOutputs;
+        for (const auto &iter : opts.extraOutputs) {
+            std::unique_ptr<VSPipeOutputData> extra = createExtraOutput(opts, iter.first, iter.second, nodeType, se, vssapi, vsapi);
+            if (!extra) {
+                for (auto &extraIter : extraOutputs)
+                    freeExtraOutput(extraIter.get());
                 vsapi->freeNode(node);
                 vsapi->freeNode(alphaNode);
                 vssapi->freeScript(se);
                 return 1;
-            } else {
-                vsapi->freeNode(node);
-                node = vsapi->mapGetNode(result, "clip", 0, nullptr);
-                vsapi->freeMap(result);
             }
+            extraOutputs.push_back(std::move(extra));
         }
 
+        std::vector<VSPipeOutputData *> outputs;
+
         std::unique_ptr<VSPipeOutputData> data(new VSPipeOutputData());
 
         data->vsapi = vsapi;
@@ -1026,8 +3044,29 @@ int main(int argc, char **argv) {
         data->printProgress = opts.printProgress;
         data->node = node;
         data->alphaNode = alphaNode;
-        data->outFile = outFile;
+        data->outFile = (opts.benchmarkWarmup >= 0) ? nullptr : outFile;
         data->timecodesFile = timecodesFile;
+        data->benchmarkWarmup = opts.benchmarkWarmup;
+        data->core = core;
+        data->calculateHash = opts.calculateHash;
+        XXH64_Init(&data->hashCtx, 0);
+        data->hashListFile = hashListFile;
+        data->writeStreamHeader = !opts.resume;
+        data->propsOnly = opts.propsOnly && !data->outFile && !opts.calculateMD5 && !opts.calculateHash && opts.shmName.empty();
+
+        // the wrapped nodes are only used for output
+        if (opts.calculateHash && opts.mode == VSPipeMode::Output) {
+            data->node = createFrameHashNode(vsapi->addNodeRef(node), core, vsapi);
+            if (alphaNode)
+                data->alphaNode = createFrameHashNode(vsapi->addNodeRef(alphaNode), core, vsapi);
+        }
+
+        if (opts.outputHeaders == VSPipeHeaders::Intermediate && opts.mode == VSPipeMode::Output && data->outFile && nodeType == mtVideo)
+            data->node = createIntermediateNode((data->node == node) ? vsapi->addNodeRef(node) : data->node, core, vsapi);
+
+        outputs.push_back(data.get());
+        for (auto &iter : extraOutputs)
+            outputs.push_back(iter.get());
         
         if (nodeType == mtVideo) {
 
@@ -1073,10 +3112,28 @@ int main(int argc, char **argv) {
 
                 data->totalFrames = vi->numFrames;
 
+                if (opts.muxAudioIndex >= 0) {
+                    data->muxAudioNode = createMuxAudioNode(opts, vi, se, vssapi, vsapi);
+                    if (!data->muxAudioNode) {
+                        for (auto &iter : extraOutputs)
+                            freeExtraOutput(iter.get());
+                        vsapi->freeNode(node);
+                        vsapi->freeNode(alphaNode);
+                        vssapi->freeScript(se);
+                        return 1;
+                    }
+                }
+
                 success = initializeVideoOutput(data.get());
+#ifdef VSPIPE_HAVE_SHM
+                if (success && !opts.shmName.empty())
+                    success = createShmOutput(data.get(), opts.shmName);
+#endif
+                if (success)
+                    success = prepareCheckpoint(data.get(), opts);
                 if (success) {
                     data->lastFPSReportTime = std::chrono::steady_clock::now();
-                    success = !outputNode(opts, data.get(), vssapi->getCore(se));
+                    success = !outputNodes(opts, outputs, vssapi->getCore(se));
                 }
             }
         } else if (nodeType == mtAudio) {
@@ -1099,14 +3156,26 @@ int main(int argc, char **argv) {
                 data->totalFrames = ai->numFrames;
                 data->totalSamples = ai->numSamples;
 
-                success = initializeAudioOutput(data.get());
+                if (opts.muxAudioIndex >= 0) {
+                    fprintf(stderr, "Audio can only be muxed with a video output\n");
+                    success = false;
+                } else if (!opts.shmName.empty()) {
+                    fprintf(stderr, "Shared memory output only supports video\n");
+                    success = false;
+                } else {
+                    success = initializeAudioOutput(data.get());
+                }
+                if (success)
+                    success = prepareCheckpoint(data.get(), opts);
                 if (success) {
                     
-                    success = !outputNode(opts, data.get(), vssapi->getCore(se));
+                    success = !outputNodes(opts, outputs, vssapi->getCore(se));
                 }
             }
         }
 
+        vsapi->freeNode(data->muxAudioNode);
+
         unsigned char md5[16];
         MD5_Final(md5, &data->md5Ctx);
 
@@ -1120,7 +3189,7 @@ int main(int argc, char **argv) {
             if (vsapi->getNodeType(node) == mtVideo)
                 fprintf(stderr, "Output %d frames in %.2f seconds (%.2f fps)\n", data->totalFrames, elapsedSeconds.count(), data->totalFrames / elapsedSeconds.count());
             else
-                fprintf(stderr, "Output %" PRId64 " samples in %.2f seconds (%.2f sps)\n", data->totalSamples, elapsedSeconds.count(), (data->totalFrames / elapsedSeconds.count()) * VS_AUDIO_FRAME_SAMPLES);
+                fprintf(stderr, "Output %" PRId64 " samples in %.2f seconds (%.2f sps)\n", data->totalSamples, elapsedSeconds.count(), data->totalSamples / elapsedSeconds.count());
         }
 
         if (opts.calculateMD5 && outFile) {
@@ -1132,14 +3201,108 @@ int main(int argc, char **argv) {
             fprintf(stderr, "MD5: OUTPUT REQUIRED");
         }
 
+        if (opts.calculateHash && opts.mode == VSPipeMode::Output)
+            fprintf(stderr, "XXH64: %016" PRIx64 "\n", XXH64_Final(&data->hashCtx));
+        if (data->node != node)
+            vsapi->freeNode(data->node);
+        if (data->alphaNode != alphaNode)
+            vsapi->freeNode(data->alphaNode);
+
+        for (size_t i = 0; i < extraOutputs.size(); i++) {
+            VSPipeOutputData *extra = extraOutputs[i].get();
+            if (opts.mode == VSPipeMode::Output) {
+                if (vsapi->getNodeType(extra->node) == mtVideo)
+                    fprintf(stderr, "Extra output %d: %d frames\n", opts.extraOutputs[i].first, extra->totalFrames);
+                else
+                    fprintf(stderr, "Extra output %d: %" PRId64 " samples\n", opts.extraOutputs[i].first, extra->totalSamples);
+            }
+
+            MD5_Final(md5, &extra->md5Ctx);
+            if (opts.calculateMD5 && extra->outFile) {
+                fprintf(stderr, "Extra output %d MD5: ", opts.extraOutputs[i].first);
+                for (int j = 0; j < 16; j++)
+                    fprintf(stderr, "%02x", (int)md5[j]);
+                fprintf(stderr, "\n");
+            }
+            if (opts.calculateHash)
+                fprintf(stderr, "Extra output %d XXH64: %016" PRIx64 "\n", opts.extraOutputs[i].first, XXH64_Final(&extra->hashCtx));
+
+            if (extra->outFile)
+                fflush(extra->outFile);
+            freeExtraOutput(extra);
+        }
+
+        if (opts.benchmarkWarmup >= 0 && opts.mode == VSPipeMode::Output && success) {
+            VSCoreInfo info;
+            vsapi->getCoreInfo(core, &info);
+
+            BenchmarkResults results;
+            results.coreVersion = info.core;
+            results.numThreads = info.numThreads;
+            results.totalFrames = data->totalFrames;
+            results.warmupFrames = opts.benchmarkWarmup;
+            results.steadyFrames = data->steadyFrames;
+            results.elapsedSeconds = elapsedSeconds.count();
+            results.steadySeconds = data->steadyFrames ? std::chrono::duration<double>(data->steadyEndTime - data->steadyStartTime).count() : 0;
+            results.frameLatencies = std::move(data->frameLatencies);
+            results.peakMemoryUse = data->peakMemoryUse;
+
+            if (!results.steadyFrames)
+                fprintf(stderr, "Warning: no frames were rendered in the steady state, use fewer warm-up frames or a longer clip\n");
+
+            if (outFile) {
+                fprintf(outFile, "%s", printBenchmarkJSON(node, results, vsapi).c_str());
+                fflush(outFile);
+            }
+        }
+
         if (opts.printFilterTime)
             fprintf(stderr, "%s", printNodeTimes(node, elapsedSeconds.count(), vsapi).c_str());
+
+        if (opts.printCriticalPath) {
+            VSCoreInfo info;
+            vsapi->getCoreInfo(core, &info);
+            fprintf(stderr, "%s", printCriticalPath(node, data->totalFrames, elapsedSeconds.count(), info.numThreads, vsapi).c_str());
+        }
+
+        if (!opts.filterStatsFilename.empty()) {
+#ifdef VS_TARGET_OS_WINDOWS
+            FILE *statsFile = _wfopen(opts.filterStatsFilename.c_str(), L"wb");
+#else
+            FILE *statsFile = fopen(opts.filterStatsFilename.c_str(), "wb");
+#endif
+            if (statsFile) {
+                fprintf(statsFile, "%s", printNodeStatsJSON(node, elapsedSeconds.count(), vsapi).c_str());
+                fclose(statsFile);
+            } else {
+                fprintf(stderr, "Failed to open filter statistics file for writing\n");
+            }
+        }
+
+        if (!opts.traceFilename.empty()) {
+#ifdef VS_TARGET_OS_WINDOWS
+            FILE *traceFile = _wfopen(opts.traceFilename.c_str(), L"wb");
+#else
+            FILE *traceFile = fopen(opts.traceFilename.c_str(), "wb");
+#endif
+            VSMap *traceMap = vsapi->createMap();
+            vsapi->getCoreTrace(core, traceMap);
+            if (traceFile) {
+                fwrite(vsapi->mapGetData(traceMap, "trace", 0, nullptr), 1, vsapi->mapGetDataSize(traceMap, "trace", 0, nullptr), traceFile);
+                fclose(traceFile);
+            } else {
+                fprintf(stderr, "Failed to open trace file for writing\n");
+            }
+            vsapi->freeMap(traceMap);
+        }
     }
 
     if (outFile && closeOutFile)
         fclose(outFile);
     if (timecodesFile)
         fclose(timecodesFile);
+    if (hashListFile)
+        fclose(hashListFile);
 
 
     vsapi->freeNode(node);
@@ -1148,3 +3311,246 @@ int main(int argc, char **argv) {
 
     return success ? 0 : 1;
 }
+
+/////////////////////////////////////////////
+// Server
+
+// vspipe --server SOCKET keeps a core with all plugins loaded waiting for the next job in a process where Python is already
+// initialized, vspipe --connect SOCKET <arguments> runs the arguments there with the working directory, stdout and stderr
+// of the client, jobs are processed one at a time
+
+#ifndef VS_TARGET_OS_WINDOWS
+
+static const char serverMagic[8] = { 'V', 'S', 'P', 'I', 'P', 'E', 'J', '1' };
+static const uint32_t maxJobSize = 1 << 20;
+
+struct VSPipeJobHeader {
+    char magic[8];
+    uint32_t size; // of the working directory and arguments that follow, all NUL terminated
+};
+
+static bool initSocketAddress(sockaddr_un &addr, const char *path) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    return true;
+}
+
+static int runClient(const char *path, int argc, char **argv) {
+    signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un addr;
+    if (!initSocketAddress(addr, path))
+        return 1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+        fprintf(stderr, "Failed to connect to %s, errno: %d\n", path, errno);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        fprintf(stderr, "Failed to get the working directory, errno: %d\n", errno);
+        close(fd);
+        return 1;
+    }
+
+    std::string payload = cwd;
+    payload.push_back(0);
+    for (int i = 0; i < argc; i++) {
+        payload += argv[i];
+        payload.push_back(0);
+    }
+
+    VSPipeJobHeader header;
+    memcpy(header.magic, serverMagic, sizeof(serverMagic));
+    header.size = static_cast<uint32_t>(payload.size());
+
+    // stdout and stderr are passed along with the header
+    int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    iovec iov = { &header, sizeof(header) };
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    int32_t code = 1;
+    if (payload.size() > maxJobSize || sendmsg(fd, &msg, 0) != static_cast<ssize_t>(sizeof(header)) || !sendAll(fd, payload.data(), payload.size()) || !recvAll(fd, &code, sizeof(code))) {
+        fprintf(stderr, "Lost the connection to the server\n");
+        code = 1;
+    }
+
+    close(fd);
+    return code;
+}
+
+static bool receiveJob(int fd, std::string &payload, int fds[2]) {
+    VSPipeJobHeader header;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 2)] = {};
+    iovec iov = { &header, sizeof(header) };
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(fd, &msg, 0);
+    if (n <= 0)
+        return false;
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(int) * 2))
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * 2);
+
+    if (n < static_cast<ssize_t>(sizeof(header)) && !recvAll(fd, reinterpret_cast<char *>(&header) + n, sizeof(header) - n))
+        return false;
+    if (memcmp(header.magic, serverMagic, sizeof(serverMagic)) || header.size > maxJobSize)
+        return false;
+
+    payload.resize(header.size);
+    return recvAll(fd, &payload[0], payload.size()) && !payload.empty() && payload.back() == 0;
+}
+
+static int runServer(const char *path, const VSSCRIPTAPI *vssapi) {
+    // a client that goes away only fails its own job
+    signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un addr;
+    if (!initSocketAddress(addr, path))
+        return 1;
+
+    // only a stale socket is replaced, never a regular file
+    struct stat st;
+    if (!stat(path, &st) && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) || listen(listenFd, 16)) {
+        fprintf(stderr, "Failed to listen on %s, errno: %d\n", path, errno);
+        return 1;
+    }
+
+    char serverCwd[PATH_MAX];
+    if (!getcwd(serverCwd, sizeof(serverCwd))) {
+        fprintf(stderr, "Failed to get the working directory, errno: %d\n", errno);
+        return 1;
+    }
+
+    const VSAPI *vsapi = vssapi->getVSAPI(VAPOURSYNTH_API_VERSION);
+    fprintf(stderr, "Listening on %s\n", path);
+
+    VSScript *preparedScript = nullptr;
+    while (true) {
+        // the core for the next job is created and its plugins loaded before a client arrives
+        if (!preparedScript)
+            preparedScript = createScriptEnvironment(0, vssapi, vsapi);
+
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Failed to accept connection, errno: %d\n", errno);
+            break;
+        }
+
+        std::string payload;
+        int fds[2] = { -1, -1 };
+        if (receiveJob(fd, payload, fds) && fds[0] >= 0 && fds[1] >= 0) {
+            const char *cwd = payload.c_str();
+            std::vector<char *> args;
+            args.push_back(const_cast<char *>("vspipe"));
+            for (size_t pos = strlen(cwd) + 1; pos < payload.size(); pos += strlen(&payload[pos]) + 1)
+                args.push_back(&payload[pos]);
+            args.push_back(nullptr);
+
+            fflush(stdout);
+            fflush(stderr);
+            int savedStdout = dup(STDOUT_FILENO);
+            int savedStderr = dup(STDERR_FILENO);
+            dup2(fds[0], STDOUT_FILENO);
+            dup2(fds[1], STDERR_FILENO);
+
+            int32_t code = 1;
+            if (chdir(cwd))
+                fprintf(stderr, "Failed to change the working directory to %s, errno: %d\n", cwd, errno);
+            else
+                code = runVSPipe(static_cast<int>(args.size() - 1), args.data(), &preparedScript, vssapi);
+
+            fflush(stdout);
+            fflush(stderr);
+            clearerr(stdout);
+            clearerr(stderr);
+            dup2(savedStdout, STDOUT_FILENO);
+            dup2(savedStderr, STDERR_FILENO);
+            close(savedStdout);
+            close(savedStderr);
+            if (chdir(serverCwd))
+                fprintf(stderr, "Failed to restore the working directory, errno: %d\n", errno);
+
+            sendAll(fd, &code, sizeof(code));
+        }
+
+        for (int i = 0; i < 2; i++) {
+            if (fds[i] >= 0)
+                close(fds[i]);
+        }
+        close(fd);
+    }
+
+    if (preparedScript)
+        vssapi->freeScript(preparedScript);
+    close(listenFd);
+    return 1;
+}
+
+#endif
+
+#ifdef VS_TARGET_OS_WINDOWS
+int wmain(int argc, wchar_t **argv) {
+    if (_setmode(_fileno(stdout), _O_BINARY) == -1)
+        fprintf(stderr, "Failed to set stdout to binary mode\n");
+    SetConsoleCtrlHandler(HandlerRoutine, TRUE);
+#else
+int main(int argc, char **argv) {
+    // the client doesn't need VSScript at all
+    if (argc >= 2 && !strcmp(argv[1], "--connect")) {
+        if (argc < 3) {
+            fprintf(stderr, "No server socket specified\n");
+            return 1;
+        }
+        return runClient(argv[2], argc - 3, argv + 3);
+    }
+#endif
+
+    const VSSCRIPTAPI *vssapi = getVSScriptAPI(VSSCRIPT_API_VERSION);
+    if (!vssapi) {
+        fprintf(stderr, "Failed to initialize VSScript\n");
+        return 1;
+    }
+
+#ifndef VS_TARGET_OS_WINDOWS
+    if (argc >= 2 && !strcmp(argv[1], "--server")) {
+        if (argc != 3) {
+            fprintf(stderr, "The server only takes a socket path\n");
+            return 1;
+        }
+        return runServer(argv[2], vssapi);
+    }
+#endif
+
+    return runVSPipe(argc, argv, nullptr, vssapi);
+}
@@ -22,18 +22,27 @@
 #include "VSScript4.h"
 #include "vsscript_internal.h"
 #include "cython/vapoursynth_api.h"
+#include "../common/graphsnapshot.h"
 #include <mutex>
+#include <shared_mutex>
 #include <atomic>
 #include <vector>
+#include <string>
+#include <cstdio>
 
 #ifdef VS_TARGET_OS_WINDOWS
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#include "../common/vsutf16.h"
 #endif
 
 static std::once_flag flag;
 
+// Only Python initialization is process wide, everything else locks the environment it's given. Every entry point
+// into the Python module takes the GIL on its own so environments can be evaluated in parallel.
 static std::mutex vsscriptlock;
+// The working directory is shared by the whole process so evaluations that change it run alone
+static std::shared_mutex workingDirLock;
 static std::atomic<int> initializationCount(0);
 static std::atomic<int> scriptID(1000);
 static bool initialized = false;
@@ -127,21 +136,46 @@ VS_API(int) vsscript_finalize(void) VS_NOEXCEPT {
     return count;
 }
 
+namespace {
+
+// every handle given out is one of these so each environment has its own lock
+struct VSScriptState : public VSScript {
+    std::mutex lock;
+};
+
+} // namespace
+
+static std::mutex &scriptLock(VSScript *handle) {
+    return static_cast<VSScriptState *>(handle)->lock;
+}
+
+template<typename F>
+static int evaluateLocked(VSScript *handle, bool setCWD, F evaluate) {
+    std::lock_guard<std::mutex> lock(scriptLock(handle));
+    if (setCWD) {
+        std::unique_lock<std::shared_mutex> dirLock(workingDirLock);
+        return evaluate();
+    } else {
+        std::shared_lock<std::shared_mutex> dirLock(workingDirLock);
+        return evaluate();
+    }
+}
+
 // V3 API compatibility
 static int createScriptInternal(VSScript **handle) VS_NOEXCEPT {
-    *handle = new VSScript();
+    *handle = new VSScriptState();
     (*handle)->id = ++scriptID;
     return vpy4_createScript(*handle);
 }
 
 static VSScript *VS_CC createScript(VSCore *core) VS_NOEXCEPT {
-    VSScript *handle = new VSScript();
+    VSScript *handle = new VSScriptState();
     handle->core = core;
     handle->id = ++scriptID;
     if (vpy4_createScript(handle)) {
         const VSAPI *vsapi = vpy4_getVSAPI(VAPOURSYNTH_API_VERSION);
         vsapi->freeCore(core);
-        delete handle;
+        delete static_cast<VSScriptState *>(handle);
         return nullptr;
     } else {
         return handle;
@@ -150,66 +184,112 @@ static VSScript *VS_CC createScript(VSCore *core) VS_NOEXCEPT {
 
 // V3 API compatibility
 VS_API(int) vsscript_createScript(VSScript **handle) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
     return createScriptInternal(handle);
 }
 
 // V3 API compatibility
 VS_API(int) vsscript_evaluateScript(VSScript **handle, const char *script, const char *scriptFilename, int flags) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
     if (*handle == nullptr) {
         if (createScriptInternal(handle)) return 1;
     }
-    return vpy_evaluateScript(*handle, script, scriptFilename ? scriptFilename : "<undefined>", flags);
+    return evaluateLocked(*handle, flags & 1 /* efSetWorkingDir */, [&] { return vpy_evaluateScript(*handle, script, scriptFilename ? scriptFilename : "<undefined>", flags); });
 }
 
 // V3 API compatibility
 VS_API(int) vsscript_evaluateFile(VSScript **handle, const char *scriptFilename, int flags) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
     if (*handle == nullptr) {
         if (createScriptInternal(handle)) return 1;
     }
-    return vpy_evaluateFile(*handle, scriptFilename, flags);
+    return evaluateLocked(*handle, flags & 1 /* efSetWorkingDir */, [&] { return vpy_evaluateFile(*handle, scriptFilename, flags); });
 }
 
 static int VS_CC evaluateBuffer(VSScript *handle, const char *buffer, const char *scriptFilename) VS_NOEXCEPT {
     assert(handle);
-    std::lock_guard<std::mutex> lock(vsscriptlock);
-    return vpy4_evaluateBuffer(handle, buffer, scriptFilename);
+    return evaluateLocked(handle, handle->setCWD, [&] { return vpy4_evaluateBuffer(handle, buffer, scriptFilename); });
+}
+
+// Returns true and the whole file in data if it's a graph snapshot
+static bool readGraphSnapshot(const char *scriptFilename, std::string &data) {
+#ifdef VS_TARGET_OS_WINDOWS
+    FILE *f = _wfopen(utf16_from_utf8(scriptFilename).c_str(), L"rb");
+#else
+    FILE *f = fopen(scriptFilename, "rb");
+#endif
+    if (!f)
+        return false;
+
+    char buf[65536];
+    size_t read = fread(buf, 1, 8, f);
+    bool snapshot = isGraphSnapshot(buf, read);
+    if (snapshot) {
+        data.assign(buf, read);
+        while ((read = fread(buf, 1, sizeof(buf), f)) > 0)
+            data.append(buf, read);
+    }
+    fclose(f);
+    return snapshot;
+}
+
+// Snapshots are rebuilt through the core directly so the script and its imports never run
+static int evaluateGraphSnapshot(VSScript *handle, const std::string &data) {
+    const VSAPI *vsapi = vpy4_getVSAPI(VAPOURSYNTH_API_VERSION);
+    VSCore *core = vpy4_getCore(handle);
+    std::vector<GraphSnapshotOutput> outputs;
+    std::string error = "Failed to create a core";
+    if (!core || !loadGraphSnapshot(data.data(), data.size(), outputs, error, core, vsapi)) {
+        vpy4_setError(handle, ("Graph snapshot loading failed: " + error).c_str());
+        return 2;
+    }
+
+    int result = 0;
+    for (const auto &iter : outputs) {
+        if (!result && vpy4_setOutput(handle, iter.index, iter.node, iter.alpha, iter.altOutput)) {
+            vpy4_setError(handle, ("Failed to set output " + std::to_string(iter.index)).c_str());
+            result = 1;
+        }
+        vsapi->freeNode(iter.node);
+        vsapi->freeNode(iter.alpha);
+    }
+    return result;
 }
 
 static int VS_CC evaluateFile(VSScript *handle, const char *scriptFilename) VS_NOEXCEPT {
     assert(handle);
-    std::lock_guard<std::mutex> lock(vsscriptlock);
-    return vpy4_evaluateFile(handle, scriptFilename);
+    std::string snapshot;
+    if (scriptFilename && readGraphSnapshot(scriptFilename, snapshot))
+        return evaluateLocked(handle, false, [&] { return evaluateGraphSnapshot(handle, snapshot); });
+    return evaluateLocked(handle, handle->setCWD, [&] { return vpy4_evaluateFile(handle, scriptFilename); });
 }
 
 VS_API(void) vsscript_freeScript(VSScript *handle) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
     if (handle) {
-        vpy4_freeScript(handle);
-        delete handle;
+        {
+            std::lock_guard<std::mutex> lock(scriptLock(handle));
+            vpy4_freeScript(handle);
+        }
+        delete static_cast<VSScriptState *>(handle);
     }
 }
 
 VS_API(const char *) vsscript_getError(VSScript *handle) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
-    if (handle)
+    if (handle) {
+        std::lock_guard<std::mutex> lock(scriptLock(handle));
         return vpy4_getError(handle);
+    }
     else
         return "Invalid handle (NULL)";
 }
 
 VS_API(int) vsscript_getExitCode(VSScript *handle) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
-    if (handle)
+    if (handle) {
+        std::lock_guard<std::mutex> lock(scriptLock(handle));
         return handle->exitCode;
+    }
     else
         return 0;
 }
 
 VS_API(const VSAPI *) vsscript_getVSApi2(int version) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
     return vpy4_getVSAPI(version);
 }
 
@@ -217,7 +297,7 @@ VS_API(const VSAPI *) vsscript_getVSApi2(int version) VS_NOEXCEPT {
 VS_API(VSNode *) vsscript_getOutput2(VSScript *handle, int index, VSNode **alpha) VS_NOEXCEPT {
     if (alpha)
         *alpha = nullptr;
-    std::lock_guard<std::mutex> lock(vsscriptlock);
+    std::lock_guard<std::mutex> lock(scriptLock(handle));
     VSNode *node = vpy4_getOutput(handle, index);
     const VSAPI *vsapi = vpy4_getVSAPI(VAPOURSYNTH_API_VERSION);
     if (node && vsapi->getNodeType(node) == mtAudio) {
@@ -235,40 +315,39 @@ VS_API(VSNode *) vsscript_getOutput(VSScript *handle, int index) VS_NOEXCEPT {
 }
 
 static VSNode *VS_CC getOutputNode(VSScript *handle, int index) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
+    std::lock_guard<std::mutex> lock(scriptLock(handle));
     return vpy4_getOutput(handle, index);
 }
 
 static VSNode *VS_CC getOutputAlphaNode(VSScript *handle, int index) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
+    std::lock_guard<std::mutex> lock(scriptLock(handle));
     return vpy4_getAlphaOutput(handle, index);
 }
 
 static int VS_CC getAltOutputMode(VSScript *handle, int index) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
+    std::lock_guard<std::mutex> lock(scriptLock(handle));
     return vpy4_getAltOutputMode(handle, index);
 }
 
 // V3 API compatibility
 VS_API(int) vsscript_clearOutput(VSScript *handle, int index) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
+    std::lock_guard<std::mutex> lock(scriptLock(handle));
     return vpy_clearOutput(handle, index);
 }
 
 VS_API(VSCore *) vsscript_getCore(VSScript *handle) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
+    std::lock_guard<std::mutex> lock(scriptLock(handle));
     return vpy4_getCore(handle);
 }
 
 // V3 API compatibility
 VS_API(const VSAPI *) vsscript_getVSApi(void) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
     return vpy4_getVSAPI(3 << 16);
 }
 
 // V3 API compatibility
 VS_API(int) vsscript_getVariable(VSScript *handle, const char *name, VSMap *dst) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
+    std::lock_guard<std::mutex> lock(scriptLock(handle));
     int result = vpy4_getVariable(handle, name, dst);
     const VSAPI *vsapi = vpy4_getVSAPI(VAPOURSYNTH_API_VERSION);
     int numKeys = vsapi->mapNumKeys(dst);
@@ -283,12 +362,12 @@ VS_API(int) vsscript_getVariable(VSScript *handle, const char *name, VSMap *dst)
 }
 
 static int VS_CC getVariable(VSScript *handle, const char *name, VSMap *dst) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
+    std::lock_guard<std::mutex> lock(scriptLock(handle));
     return vpy4_getVariable(handle, name, dst);
 }
 
 VS_API(int) vsscript_setVariable(VSScript *handle, const VSMap *vars) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
+    std::lock_guard<std::mutex> lock(scriptLock(handle));
     return vpy4_setVariables(handle, vars);
 }
 
@@ -296,15 +375,19 @@ static void VS_CC evalSetWorkingDir(VSScript *handle, int setCWD) VS_NOEXCEPT {
     handle->setCWD = setCWD;
 }
 
+static void VS_CC evalSetIncremental(VSScript *handle, int incremental) VS_NOEXCEPT {
+    handle->incremental = incremental;
+}
+
 // V3 API compatibility
 VS_API(int) vsscript_clearVariable(VSScript *handle, const char *name) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
+    std::lock_guard<std::mutex> lock(scriptLock(handle));
     return vpy_clearVariable(handle, name);
 }
 
 // V3 API compatibility
 VS_API(void) vsscript_clearEnvironment(VSScript *handle) VS_NOEXCEPT {
-    std::lock_guard<std::mutex> lock(vsscriptlock);
+    std::lock_guard<std::mutex> lock(scriptLock(handle));
     vpy_clearEnvironment(handle);
 }
 
@@ -323,7 +406,8 @@ static VSSCRIPTAPI vsscript_api = {
     &getOutputAlphaNode,
     &getAltOutputMode,
     &vsscript_freeScript,
-    &evalSetWorkingDir
+    &evalSetWorkingDir,
+    &evalSetIncremental
 };
 
 const VSSCRIPTAPI *VS_CC getVSScriptAPI(int version) VS_NOEXCEPT {
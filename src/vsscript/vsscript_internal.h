@@ -30,6 +30,7 @@ typedef struct VSScript {
     int id;
     int exitCode;
     int setCWD;
+    int incremental;
 } VSScript;
 
 #endif
\ No newline at end of file
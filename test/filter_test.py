@@ -20,5 +20,140 @@ class FilterTestSequence(unittest.TestCase):
         clip = self.BlankClip(format=vs.YUV444PS, color=[0, 0, 0], width=1156, height=752)
         self.Transpose(clip).get_frame(0)
 
+    def test_frameeval_reuse_nondeterministic(self):
+        # Transpose isn't declared deterministic so every frame's call has to create a new node
+        clip = self.BlankClip(format=vs.GRAY8, width=64, height=32, length=2)
+        nodes = []
+        def evaluate(n):
+            nodes.append(self.Transpose(clip))
+            return clip
+        evaluated = self.core.std.FrameEval(clip, evaluate, reuse=True)
+        evaluated.get_frame(0)
+        evaluated.get_frame(1)
+        self.assertEqual(len(nodes), 2)
+        f0 = nodes[0].get_frame(0)
+        f1 = nodes[1].get_frame(0)
+        self.assertNotEqual(f0.get_read_ptr(0).value, f1.get_read_ptr(0).value)
+
+    # blocks of different colors so spatial filters have edges to work on
+    def pattern(self, fmt, width=640, height=96):
+        scale = 257 if fmt.bits_per_sample == 16 else 1
+        rows = []
+        for y in range(2):
+            blocks = [self.BlankClip(format=fmt, width=32, height=height // 2, color=[((x * 37 + y * 101 + p * 53) % 256) * scale for p in range(fmt.num_planes)]) for x in range(width // 32)]
+            rows.append(self.core.std.StackHorizontal(blocks))
+        return self.core.std.StackVertical(rows)
+
+    def assertSameClip(self, a, b):
+        for p in range(a.format.num_planes):
+            props = self.core.std.PlaneStats(a, b, plane=p).get_frame(0).props
+            self.assertEqual(props['PlaneStatsDiff'], 0)
+
+    # filters that write a new frame of the same size as their input
+    def writingFilters(self):
+        std = self.core.std
+        filters = [
+            lambda c: std.Invert(c),
+            lambda c: std.Binarize(c),
+            lambda c: std.Limiter(c, min=[40], max=[200]),
+            lambda c: std.Merge(c, std.Invert(c)),
+            lambda c: std.MakeDiff(c, std.Invert(c)),
+            lambda c: std.MaskedMerge(c, std.Invert(c), c),
+            lambda c: std.BoxBlur(c),
+            lambda c: std.Maximum(c),
+        ]
+        if hasattr(self.core, 'rgvs'):
+            filters += [lambda c: self.core.rgvs.RemoveGrain(c, 4), lambda c: self.core.rgvs.Repair(c, std.Invert(c), 1)]
+        return filters
+
+    def test_crop_into_writing_filters(self):
+        for fmt in (vs.GRAY8, vs.GRAY16, vs.YUV420P8):
+            clip = self.pattern(self.core.get_video_format(fmt))
+            cropped = self.core.std.Crop(clip, left=64, right=448)
+            cropped_top = self.core.std.Crop(clip, top=16, bottom=16)
+            # unaligned crops always copy so they give the reference
+            reference = self.core.std.Crop(self.core.std.Crop(clip, left=62, right=448), left=2)
+            reference_top = self.core.std.Crop(self.core.std.AddBorders(cropped_top, left=2), left=2)
+            for f in self.writingFilters():
+                self.assertSameClip(f(cropped), f(reference))
+                self.assertSameClip(f(cropped_top), f(reference_top))
+
+    def test_separatefields_into_writing_filters(self):
+        for fmt in (vs.GRAY8, vs.GRAY16, vs.GRAYS, vs.RGBS, vs.YUV410P8):
+            clip = self.pattern(self.core.get_video_format(fmt), height=128)
+            fields = self.core.std.SeparateFields(clip, tff=True)
+            # point filters give the same result whether they run before or after separating the fields
+            for f in self.writingFilters()[:6]:
+                self.assertSameClip(f(fields), self.core.std.SeparateFields(f(clip), tff=True))
+            for f in self.writingFilters()[6:]:
+                f(fields).get_frame(0)
+                f(fields).get_frame(1)
+
+    def test_stack_of_writing_filters(self):
+        for fmt in (vs.GRAY8, vs.GRAY16, vs.GRAYS, vs.YUV420P8):
+            clip = self.pattern(self.core.get_video_format(fmt))
+            left = self.core.std.Crop(clip, right=320)
+            right = self.core.std.Crop(clip, left=320)
+            # BlankClip is the only filter whose output gets rendered straight into the stacked frame
+            blank = self.core.std.BlankClip(left, keep=False)
+            for f in self.writingFilters():
+                stacked = self.core.std.StackHorizontal([f(left), f(right)])
+                self.assertSameClip(self.core.std.Crop(stacked, right=320), f(left))
+                self.assertSameClip(self.core.std.Crop(stacked, left=320), f(right))
+                bordered = self.core.std.AddBorders(f(left), left=64, right=32)
+                self.assertSameClip(self.core.std.Crop(bordered, left=64, right=32), f(left))
+                stacked = self.core.std.StackVertical([blank, f(left), blank])
+                self.assertSameClip(self.core.std.Crop(stacked, top=96, bottom=96), f(left))
+                self.assertSameClip(self.core.std.Crop(stacked, bottom=192), blank)
+
+    # a different value for every sample so transposes that mix up rows or columns show
+    def numbered(self, fmt, width, height):
+        clip = self.BlankClip(format=fmt, width=width, height=height, length=1)
+        def fill(n, f):
+            fout = f.copy()
+            for p in range(fout.format.num_planes):
+                plane = fout[p]
+                for y in range(plane.shape[0]):
+                    for x in range(plane.shape[1]):
+                        v = x * 7 + y * 131 + p * 17
+                        plane[y, x] = v % 251 if fmt == vs.GRAY8 else (v / 4096 if fmt == vs.GRAYS else v % 65521)
+            return fout
+        return self.core.std.ModifyFrame(clip, clip, fill)
+
+    def samples(self, clip):
+        plane = clip.get_frame(0)[0]
+        height, width = plane.shape
+        return [[plane[y, x] for x in range(width)] for y in range(height)]
+
+    def test_transpose_matches_reference(self):
+        # the sizes cover partial SIMD blocks and partial 64x64 tiles at both edges
+        for fmt in (vs.GRAY8, vs.GRAY16, vs.GRAYS):
+            for width, height in ((300, 200), (67, 129), (1, 70), (130, 1)):
+                clip = self.numbered(fmt, width, height)
+                src = self.samples(clip)
+                dst = self.samples(self.Transpose(clip))
+                self.assertEqual(dst, [list(column) for column in zip(*src)])
+                self.assertSameClip(self.Transpose(self.Transpose(clip)), clip)
+
+    def test_convolution_edges(self):
+        # taps before the first sample mirror around it, taps past the last sample at offset o
+        # read the sample o before the last one no matter how far from the edge the output is
+        def index(x, o, n):
+            return -(x + o) if x + o < 0 else (x + o if x + o < n else n - 1 - o)
+        clip = self.numbered(vs.GRAY8, 40, 12)
+        src = self.samples(clip)
+        h, w = len(src), len(src[0])
+        def tap(dx, dy, size):
+            return [int(c == dx + size // 2 and r == dy + size // 2) for r in range(size) for c in range(size)]
+        for o in (-3, -2, -1, 1, 2, 3):
+            matrix = [int(k == o + 3) for k in range(7)]
+            self.assertEqual(self.samples(self.core.std.Convolution(clip, matrix, mode='h')), [[row[index(x, o, w)] for x in range(w)] for row in src])
+            self.assertEqual(self.samples(self.core.std.Convolution(clip, matrix, mode='v')), [[src[index(y, o, h)][x] for x in range(w)] for y in range(h)])
+        for dx, dy in ((2, 0), (-2, 1), (1, 2), (0, -2)):
+            # a single tap is separable, adding the center makes it a full 5x5 matrix
+            self.assertEqual(self.samples(self.core.std.Convolution(clip, tap(dx, dy, 5))), [[src[index(y, dy, h)][index(x, dx, w)] for x in range(w)] for y in range(h)])
+            matrix = [a + b for a, b in zip(tap(dx, dy, 5), tap(-2, -2, 5))]
+            self.assertEqual(self.samples(self.core.std.Convolution(clip, matrix)), [[round((src[index(y, dy, h)][index(x, dx, w)] + src[index(y, -2, h)][index(x, -2, w)]) / 2) for x in range(w)] for y in range(h)])
+
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,111 @@
+import json
+import os
+import time
+import unittest
+import vapoursynth as vs
+
+# Renders standardized clips through a few representative filter chains and reports the fps and the
+# peak framebuffer memory of each. Only runs when VS_BENCHMARK is set. If VS_BENCHMARK_MACHINE names
+# one of the classes below a chain that is slower than its minimum fps fails, otherwise the numbers are
+# only printed. VS_BENCHMARK_OUTPUT is the name of a JSON file to write the results to.
+#
+# AviSynth plugins aren't part of the tree, to include the compat layer set VS_BENCHMARK_AVS_PLUGIN to
+# the dll of one and VS_BENCHMARK_AVS_FILTER to a filter in it that takes a YV12 clip and nothing else.
+
+# minimum fps per chain
+thresholds = {
+    'laptop': {
+        'resize_ladder': 20,
+        'expr_mask': 60,
+        'temporal_average': 40,
+        'avs_compat': 20,
+        'audio_mix': 400,
+    },
+    'desktop': {
+        'resize_ladder': 60,
+        'expr_mask': 200,
+        'temporal_average': 120,
+        'avs_compat': 60,
+        'audio_mix': 1000,
+    },
+    'server': {
+        'resize_ladder': 120,
+        'expr_mask': 400,
+        'temporal_average': 250,
+        'avs_compat': 100,
+        'audio_mix': 2000,
+    },
+}
+
+results = {}
+
+def source_clip(core, fmt=vs.YUV420P8, width=1920, height=1080, length=240):
+    # the frames differ so nothing can be shared between them
+    clip = core.std.BlankClip(format=fmt, width=width, height=height, length=length)
+    return core.std.Expr(clip, 'N 7 * 255 %')
+
+@unittest.skipUnless(os.environ.get('VS_BENCHMARK'), 'set VS_BENCHMARK to run benchmarks')
+class PerfTestSequence(unittest.TestCase):
+
+    @classmethod
+    def tearDownClass(cls):
+        output = os.environ.get('VS_BENCHMARK_OUTPUT')
+        if output:
+            with open(output, 'w') as f:
+                json.dump({ 'machine': os.environ.get('VS_BENCHMARK_MACHINE'), 'threads': vs.core.num_threads, 'results': results }, f, indent=2)
+
+    def setUp(self):
+        self.core = vs.core
+
+    def render(self, name, clip):
+        # the first frames only warm up the caches and the JIT
+        for n in range(min(8, clip.num_frames)):
+            clip.get_frame(n)
+        peak = self.core.core_info['used_framebuffer_size']
+        start = time.perf_counter()
+        for frame in clip.frames():
+            peak = max(peak, self.core.core_info['used_framebuffer_size'])
+        elapsed = time.perf_counter() - start
+        fps = clip.num_frames / elapsed
+        results[name] = { 'fps': fps, 'peak_framebuffer_mb': peak / (1024 * 1024) }
+        print('\n{}: {:.1f} fps, {:.1f} MB peak'.format(name, fps, peak / (1024 * 1024)))
+
+        machine = os.environ.get('VS_BENCHMARK_MACHINE')
+        if machine:
+            self.assertIn(machine, thresholds, 'unknown machine class, use one of ' + ', '.join(thresholds))
+            self.assertGreaterEqual(fps, thresholds[machine][name], '{} is slower than expected on a {}'.format(name, machine))
+
+    def test_resize_ladder(self):
+        clip = source_clip(self.core, vs.YUV420P10, 3840, 2160, 60)
+        for width, height in ((2560, 1440), (1920, 1080), (1280, 720), (854, 480)):
+            clip = self.core.resize.Bicubic(clip, width, height)
+        clip = self.core.resize.Spline36(clip, 1920, 1080, format=vs.YUV420P8)
+        self.render('resize_ladder', clip)
+
+    def test_expr_mask(self):
+        clip = self.core.std.ShufflePlanes(source_clip(self.core), 0, vs.GRAY)
+        edge = self.core.std.Expr(clip, 'x[-1,0] x[1,0] - abs x[0,-1] x[0,1] - abs max')
+        mask = self.core.std.Expr(edge, 'x 32 > 255 x 8 * ?')
+        blurred = self.core.std.BoxBlur(clip, hradius=2, vradius=2)
+        self.render('expr_mask', self.core.std.MaskedMerge(clip, blurred, mask))
+
+    def test_temporal_average(self):
+        clip = source_clip(self.core)
+        clips = [clip[0] * 3 + clip[:-3], clip[0] * 2 + clip[:-2], clip[0] + clip[:-1], clip,
+            clip[1:] + clip[-1], clip[2:] + clip[-1] * 2, clip[3:] + clip[-1] * 3]
+        self.render('temporal_average', self.core.std.AverageFrames(clips, [1, 2, 3, 4, 3, 2, 1]))
+
+    @unittest.skipUnless(os.environ.get('VS_BENCHMARK_AVS_PLUGIN') and os.environ.get('VS_BENCHMARK_AVS_FILTER'), 'set VS_BENCHMARK_AVS_PLUGIN and VS_BENCHMARK_AVS_FILTER to benchmark the avisynth compat layer')
+    def test_avs_compat(self):
+        self.core.avs.LoadPlugin(os.environ['VS_BENCHMARK_AVS_PLUGIN'])
+        func = getattr(self.core.avs, os.environ['VS_BENCHMARK_AVS_FILTER'])
+        self.render('avs_compat', func(source_clip(self.core)))
+
+    def test_audio_mix(self):
+        layout = (vs.FRONT_LEFT, vs.FRONT_RIGHT, vs.FRONT_CENTER, vs.LOW_FREQUENCY, vs.BACK_LEFT, vs.BACK_RIGHT)
+        clip = self.core.std.BlankAudio(channels=sum(1 << c for c in layout), sampletype=vs.FLOAT, bits=32, samplerate=48000, length=48000 * 600)
+        downmix = self.core.std.AudioMix(clip, [1, 0, 0.7071, 0, 0.7071, 0, 0, 1, 0.7071, 0, 0, 0.7071], [vs.FRONT_LEFT, vs.FRONT_RIGHT])
+        self.render('audio_mix', self.core.std.AudioGain(downmix, [0.5]))
+
+if __name__ == '__main__':
+    unittest.main()